@@ -0,0 +1,18 @@
+/**
+ * Native Logic Benchmarks
+ *
+ * The LogicBench cases built for the host (pio run -e native), so parser
+ * and data structure changes can be measured before flashing:
+ *
+ *   .pio/build/native/program [name prefix]
+ *
+ * Output is the same "#BENCH <name> <iterations> <ns/op>" lines the
+ * device prints for "BENCH" over USB serial.
+ */
+
+#include "../src/logic_bench.h"
+
+int main(int argc, char **argv) {
+  LogicBench::run(Serial, argc > 1 ? argv[1] : nullptr);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * Native HAL
+ *
+ * Host definitions behind the shims: the clock, Serial on stdout, the
+ * card as a directory (SD_ROOT, default /tmp/native_sd), and stand-ins
+ * for the device services the benchmarked modules call.
+ */
+
+#include "../src/ble/frame_recorder.h"
+#include "../src/utils/loop_monitor.h"
+#include "../src/utils/sd_manager.h"
+#include <chrono>
+#include <sys/stat.h>
+#include <thread>
+
+HostSerial Serial;
+
+static const auto START = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - START)
+      .count();
+}
+
+unsigned long millis() { return micros() / 1000; }
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// ---------------------------------------------------------------------------
+// Files
+// ---------------------------------------------------------------------------
+
+namespace fs {
+
+size_t File::size() const {
+  struct stat st;
+  return _fp && fstat(fileno(_fp.get()), &st) == 0 ? st.st_size : 0;
+}
+
+const char *File::name() const {
+  size_t slash = _path.rfind('/');
+  return _path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+File FS::open(const char *path, const char *mode) {
+  // Binary modes, and "w" files opened for reading back as on the device
+  const char *host = strcmp(mode, FILE_WRITE) == 0    ? "w+b"
+                     : strcmp(mode, FILE_APPEND) == 0 ? "a+b"
+                                                      : "rb";
+  FILE *fp = fopen(hostPath(path).c_str(), host);
+  return fp ? File(fp, path) : File();
+}
+
+bool FS::exists(const char *path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0 || exists(path);
+}
+
+bool FS::rename(const char *from, const char *to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+} // namespace fs
+
+fs::FS &sdFS() {
+  static fs::FS *card = nullptr;
+  if (!card) {
+    const char *root = getenv("SD_ROOT");
+    root = root && *root ? root : "/tmp/native_sd";
+    ::mkdir(root, 0755);
+    card = new fs::FS(root);
+  }
+  return *card;
+}
+
+// ---------------------------------------------------------------------------
+// Device services
+// ---------------------------------------------------------------------------
+
+// Nothing is recorded on the host: recorded_decode skips
+int FrameRecorder::load(Record *, int) { return 0; }
+
+// No watchdog to feed
+void LoopMonitor::feed() {}
@@ -0,0 +1,86 @@
+/**
+ * Arduino Shim (native)
+ *
+ * The part of the Arduino core the host-built modules use: fixed-width
+ * types, millis()/micros() on the host's steady clock, min/max/constrain,
+ * a String over std::string, and Print with a Serial that writes to
+ * stdout. Anything else is left out on purpose: a module that needs more
+ * does not belong in the native build.
+ */
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using std::max;
+using std::min;
+
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
+#define IRAM_ATTR
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+inline void yield() {}
+
+class String {
+public:
+  String(const char *s = "") : _s(s ? s : "") {}
+  String(const std::string &s) : _s(s) {}
+
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return _s.size(); }
+  String &operator+=(const String &other) {
+    _s += other._s;
+    return *this;
+  }
+  String operator+(const String &other) const { return _s + other._s; }
+  bool operator==(const String &other) const { return _s == other._s; }
+  bool operator==(const char *other) const { return _s == other; }
+
+private:
+  std::string _s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *data, size_t len) = 0;
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t println(const char *s = "") { return print(s) + print("\n"); }
+  __attribute__((format(printf, 2, 3))) size_t printf(const char *fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0)
+      return 0;
+    return write((const uint8_t *)buf, min((size_t)n, sizeof(buf) - 1));
+  }
+};
+
+class HostSerial : public Print {
+public:
+  using Print::write;
+  void begin(unsigned long) {}
+  size_t write(const uint8_t *data, size_t len) override {
+    return fwrite(data, 1, len, stdout);
+  }
+  explicit operator bool() const { return true; }
+};
+
+extern HostSerial Serial;
+
+#endif // NATIVE_ARDUINO_H
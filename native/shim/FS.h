@@ -0,0 +1,82 @@
+/**
+ * FS Shim (native)
+ *
+ * fs::File and fs::FS over stdio. An FS maps card paths ("/history/...")
+ * under a host directory; a File is a shared handle, copied like the
+ * Arduino one and closed when the last copy goes.
+ */
+
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include "Arduino.h"
+#include <memory>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File : public Print {
+public:
+  File() {}
+  File(FILE *fp, const std::string &path)
+      : _fp(fp, fclose), _path(path) {}
+
+  using Print::write;
+  size_t write(const uint8_t *data, size_t len) override {
+    return _fp ? fwrite(data, 1, len, _fp.get()) : 0;
+  }
+  size_t read(uint8_t *data, size_t len) {
+    return _fp ? fread(data, 1, len, _fp.get()) : 0;
+  }
+  int read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+    return _fp && fseek(_fp.get(), pos, mode) == 0;
+  }
+  size_t position() const { return _fp ? ftell(_fp.get()) : 0; }
+  size_t size() const;
+  int available() const { return _fp ? size() - position() : 0; }
+  void flush() {
+    if (_fp)
+      fflush(_fp.get());
+  }
+  void close() { _fp.reset(); }
+  const char *name() const;
+  bool isDirectory() const { return false; }
+  explicit operator bool() const { return (bool)_fp; }
+
+private:
+  std::shared_ptr<FILE> _fp;
+  std::string _path;
+};
+
+class FS {
+public:
+  explicit FS(const char *root) : _root(root) {}
+
+  File open(const char *path, const char *mode = FILE_READ);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool mkdir(const char *path);
+  bool rename(const char *from, const char *to);
+
+private:
+  std::string _root;
+  std::string hostPath(const char *path) const { return _root + path; }
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+
+#endif // NATIVE_FS_H
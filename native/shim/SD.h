@@ -0,0 +1,10 @@
+/**
+ * SD Shim (native): the card is a host directory, see hal.cpp
+ */
+
+#ifndef NATIVE_SD_H
+#define NATIVE_SD_H
+
+#include "FS.h"
+
+#endif // NATIVE_SD_H
@@ -0,0 +1,25 @@
+/**
+ * Heap Caps Shim (native): one heap, so PSRAM and internal requests
+ * both come from malloc
+ */
+
+#ifndef NATIVE_ESP_HEAP_CAPS_H
+#define NATIVE_ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+
+inline void *heap_caps_malloc(size_t size, unsigned) { return malloc(size); }
+inline void *heap_caps_calloc(size_t n, size_t size, unsigned) {
+  return calloc(n, size);
+}
+inline void *heap_caps_realloc(void *p, size_t size, unsigned) {
+  return realloc(p, size);
+}
+inline void heap_caps_free(void *p) { free(p); }
+
+#endif // NATIVE_ESP_HEAP_CAPS_H
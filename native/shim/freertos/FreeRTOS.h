@@ -0,0 +1,15 @@
+/**
+ * FreeRTOS Shim (native): the types headers name; nothing runs on them
+ */
+
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+#include <stdint.h>
+
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#endif // NATIVE_FREERTOS_H
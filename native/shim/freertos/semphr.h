@@ -0,0 +1,10 @@
+/**
+ * FreeRTOS Semaphore Shim (native), see FreeRTOS.h
+ */
+
+#ifndef NATIVE_SEMPHR_H
+#define NATIVE_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+#endif // NATIVE_SEMPHR_H
@@ -3,23 +3,70 @@
  */
 
 #include "ble_client.h"
+#include "frame_recorder.h"
+#include "register_map.h"
+#include "../utils/crc16.h"
+#include "../utils/log.h"
+#include "../utils/profiler.h"
+#include "../utils/wake.h"
+#include <Preferences.h>
 #include <cstring>
 
-// Static instance for callbacks
-FossibotBLE *FossibotBLE::_instance = nullptr;
+// NVS namespace for the reconnect cache
+static const char *LINK_CACHE_NS = "fossibot";
+
+// Live sessions, for routing NimBLE callbacks (one per power bank)
+FossibotBLE *FossibotBLE::_instances[FossibotBLE::MAX_SESSIONS] = {nullptr};
+volatile bool FossibotBLE::_connectBusy = false;
+String FossibotBLE::_primedMAC;
+FossibotBLE::LinkCache FossibotBLE::_primedCache = {false, 0, 0, 0};
+
+namespace {
+
+// The scanner takes a single callback object: fan results out to sessions
+class ScanDispatcher : public NimBLEAdvertisedDeviceCallbacks {
+public:
+  void onResult(NimBLEAdvertisedDevice *device) override {
+    FossibotBLE::dispatchAdvertisement(device);
+  }
+};
+ScanDispatcher scanDispatcher;
+
+} // namespace
 
 FossibotBLE::FossibotBLE()
     : _client(nullptr), _service(nullptr), _writeChar(nullptr),
       _notifyChar(nullptr), _initialized(false), _connected(false),
-      _scanning(false), _lastPoll(0), _lastSettingsPoll(0), _socThreshold(1),
-      _powerThreshold(5) {
-  _instance = this;
+      _scanning(false), _socThreshold(1), _powerThreshold(5),
+      _rxLength(0), _rxStarted(0), _liveRangeCount(0), _lastFullPoll(0),
+      _linkTask(nullptr), _linkState(LinkState::IDLE),
+      _reportedState(LinkState::IDLE), _linkFailures(0), _lastLinkAttempt(0),
+      _readyHandled(false), _lastSeen(0), _advRssi(0), _advAddrType(-1),
+      _connectAllowed(true), _lastRssiSample(0), _snapshotGen(0),
+      _session(0), _replayedAt(0) {
+  _cache = {false, BLE_ADDR_PUBLIC, 0, 0};
+  _rxRead = {0, 0, Fossibot::POLL_REGS, 0};
+  bool wanted[Fossibot::POLL_REGS] = {};
+  for (uint8_t reg : Fossibot::LIVE_REGS)
+    wanted[reg] = true;
+  for (uint8_t reg : Fossibot::STATE_REGS)
+    wanted[reg] = true;
+  _liveRangeCount =
+      Fossibot::coverRegisters(wanted, _liveRanges, MAX_POLL_RANGES);
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    if (!_instances[i]) {
+      _instances[i] = this;
+      _session = i;
+      break;
+    }
+  }
 }
 
 FossibotBLE::~FossibotBLE() {
   disconnect();
-  if (_instance == this) {
-    _instance = nullptr;
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    if (_instances[i] == this)
+      _instances[i] = nullptr;
   }
 }
 
@@ -27,36 +74,261 @@ void FossibotBLE::init() {
   if (_initialized)
     return;
 
-  Serial.println("BLE: Initializing NimBLE...");
-
-  NimBLEDevice::init("M5PaperS3");
-  NimBLEDevice::setPower(ESP_PWR_LVL_P9); // Max power for range
-  NimBLEDevice::setSecurityAuth(false, false, false);
-  // NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT); // Reverted
+  _commands.setWriter(
+      [this](uint8_t reg, uint16_t value) { return writeCommand(reg, value); });
+  _commands.setBatchWriter(
+      [this](uint8_t first, const uint16_t *values, int count) {
+        return writeCommands(first, values, count);
+      });
+
+  // The stack is shared by every session; only the first one starts it
+  if (!NimBLEDevice::getInitialized()) {
+    LOG_I("BLE", "Initializing NimBLE...");
+    NimBLEDevice::init("M5PaperS3");
+    // Max power for scanning and connecting; LinkPolicy trims it per link
+    NimBLEDevice::setPower(ESP_PWR_LVL_P9);
+    NimBLEDevice::setSecurityAuth(false, false, false);
+    // Asked for in the MTU exchange after each connect, so an 80-register
+    // response fits one notification
+    NimBLEDevice::setMTU(PREFERRED_MTU);
+    // NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT); // Reverted
+  }
 
   _initialized = true;
-  Serial.println("BLE: Initialized");
+  LOG_I("BLE", "Initialized");
 }
 
 void FossibotBLE::setTargetMAC(const String &mac) {
   _targetMAC = mac;
   _targetAddress = NimBLEAddress(_targetMAC.c_str());
-  Serial.printf("BLE: Target MAC set to %s\n", _targetMAC.c_str());
+  LOG_I("BLE", "Target MAC set to %s", _targetMAC.c_str());
+  loadLinkCache();
+}
+
+void FossibotBLE::primeLinkCache(const String &mac, const LinkCache &cache) {
+  _primedMAC = mac;
+  _primedCache = cache;
+}
+
+void FossibotBLE::loadLinkCache() {
+  if (_primedCache.valid && _primedMAC == _targetMAC) {
+    _cache = _primedCache;
+    LOG_I("BLE", "Link cache from resume state: write=0x%04X notify=0x%04X",
+          _cache.writeHandle, _cache.notifyHandle);
+    return;
+  }
+
+  Preferences prefs;
+  _cache = {false, BLE_ADDR_PUBLIC, 0, 0};
+  if (!prefs.begin(LINK_CACHE_NS, true))
+    return;
+
+  // Only trust entries recorded for this MAC; discovery records the
+  // address type alone
+  if (prefs.getString("mac", "") == _targetMAC) {
+    _cache.addrType = prefs.getUChar("addrType", BLE_ADDR_PUBLIC);
+    _cache.writeHandle = prefs.getUShort("hWrite", 0);
+    _cache.notifyHandle = prefs.getUShort("hNotify", 0);
+    _cache.valid = _cache.writeHandle != 0 && _cache.notifyHandle != 0;
+  }
+  prefs.end();
+
+  if (_cache.valid) {
+    LOG_I("BLE", "Cached link: %s addr, write=0x%04X notify=0x%04X",
+          _cache.addrType == BLE_ADDR_RANDOM ? "RANDOM" : "PUBLIC",
+          _cache.writeHandle, _cache.notifyHandle);
+  }
+}
+
+void FossibotBLE::rememberAddressType(const String &mac, uint8_t addrType) {
+  Preferences prefs;
+  if (!prefs.begin(LINK_CACHE_NS, false)) {
+    LOG_W("BLE", "Could not open NVS for link cache");
+    return;
+  }
+  prefs.putString("mac", mac);
+  prefs.putUChar("addrType", addrType);
+  prefs.putUShort("hWrite", 0); // Another unit's handles, if any
+  prefs.putUShort("hNotify", 0);
+  prefs.end();
+  LOG_I("BLE", "%s recorded as a %s address", mac.c_str(),
+        addrType == BLE_ADDR_RANDOM ? "RANDOM" : "PUBLIC");
+}
+
+void FossibotBLE::saveLinkCache(uint8_t addrType) {
+  uint16_t writeHandle = _writeChar->getHandle();
+  uint16_t notifyHandle = _notifyChar->getHandle();
+  if (_cache.valid && _cache.addrType == addrType &&
+      _cache.writeHandle == writeHandle && _cache.notifyHandle == notifyHandle)
+    return; // Unchanged: skip the flash write
+
+  Preferences prefs;
+  if (!prefs.begin(LINK_CACHE_NS, false)) {
+    LOG_W("BLE", "Could not open NVS for link cache");
+    return;
+  }
+  prefs.putString("mac", _targetMAC);
+  prefs.putUChar("addrType", addrType);
+  prefs.putUShort("hWrite", writeHandle);
+  prefs.putUShort("hNotify", notifyHandle);
+  prefs.end();
+
+  _cache = {true, addrType, writeHandle, notifyHandle};
+  LOG_I("BLE", "Link cache updated");
 }
 
 void FossibotBLE::startScan() {
   if (!_initialized || _targetMAC.length() == 0) {
-    Serial.println("BLE: Cannot scan - not initialized or no target MAC");
+    LOG_W("BLE", "Cannot scan - not initialized or no target MAC");
     return;
   }
 
-  Serial.println("BLE: Starting connection attempt...");
+  if (!_linkTask) {
+    // Core 0 with the NimBLE host; the loop on core 1 never waits on it
+    xTaskCreatePinnedToCore(linkTaskEntry, "ble_link", LINK_TASK_STACK, this,
+                            LINK_TASK_PRIORITY, &_linkTask, 0);
+  }
 
-  // Connect directly to the known address (no scanning needed)
-  if (connectToDevice()) {
-    Serial.println("BLE: Connected successfully!");
-  } else {
-    Serial.println("BLE: Connection failed, will retry...");
+  // Connect only once the device shows up; don't block on an absent unit
+  LOG_I("BLE", "Scanning for device (passive)...");
+  setLinkState(LinkState::SCANNING);
+  startPresenceScan();
+}
+
+void FossibotBLE::startPresenceScan() {
+  NimBLEScan *scan = NimBLEDevice::getScan();
+  _scanning = scan->isScanning();
+  if (_scanning || _connectBusy)
+    return; // Shared scanner already running, or a session is connecting
+
+  // Duplicates wanted: every advertisement refreshes presence and RSSI
+  scan->setAdvertisedDeviceCallbacks(&scanDispatcher, true);
+  scan->setActiveScan(false);
+  scan->setInterval(SCAN_INTERVAL_MS);
+  scan->setWindow(SCAN_WINDOW_MS);
+  scan->setMaxResults(0); // Callback only, keep no result list
+  _scanning = scan->start(0, nullptr, false);
+  if (!_scanning)
+    LOG_W("BLE", "Failed to start presence scan");
+}
+
+void FossibotBLE::dispatchAdvertisement(NimBLEAdvertisedDevice *device) {
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    if (_instances[i])
+      _instances[i]->onAdvertisement(device);
+  }
+}
+
+FossibotBLE *FossibotBLE::sessionFor(NimBLEClient *client) {
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    if (_instances[i] && _instances[i]->_client == client)
+      return _instances[i];
+  }
+  return nullptr;
+}
+
+void FossibotBLE::onAdvertisement(NimBLEAdvertisedDevice *device) {
+  // NimBLE host task: record presence only
+  if (device->getAddress().toString() != _targetAddress.toString())
+    return;
+  _advRssi = device->getRSSI();
+  _advAddrType = device->getAddress().getType();
+  _lastSeen = millis();
+}
+
+bool FossibotBLE::isAdvertising() const {
+  unsigned long seen = _lastSeen;
+  return seen != 0 && millis() - seen < PRESENCE_TIMEOUT_MS;
+}
+
+int FossibotBLE::getRssi() const {
+  if (_connected && _client)
+    return _client->getRssi();
+  return _advRssi;
+}
+
+void FossibotBLE::linkTaskEntry(void *arg) {
+  FossibotBLE *self = static_cast<FossibotBLE *>(arg);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    self->runConnect();
+  }
+}
+
+void FossibotBLE::kickConnect() {
+  LinkState state = _linkState;
+  if (!_linkTask || state == LinkState::CONNECTING ||
+      state == LinkState::DISCOVERING)
+    return;
+
+  // NimBLE runs one connect at a time; other sessions wait their turn
+  if (_connectBusy)
+    return;
+  _connectBusy = true;
+
+  // The scan must be stopped before NimBLE can initiate a connection
+  stopScan();
+  _lastLinkAttempt = millis();
+  _readyHandled = false;
+  setLinkState(LinkState::CONNECTING);
+  xTaskNotifyGive(_linkTask);
+}
+
+void FossibotBLE::runConnect() {
+  unsigned long started = millis();
+  bool ok = connectToDevice();
+  _connectBusy = false;
+  _stats.onAttempt(millis() - started, ok);
+  if (ok) {
+    _linkFailures = 0;
+    setLinkState(LinkState::READY);
+    LOG_I("BLE", "Connected successfully in %lu ms",
+          (unsigned long)_stats.lastAttemptMs);
+    return;
+  }
+
+  // Attempts only happen while the device advertises, so keep retrying
+  // (with backoff) instead of giving up until reboot
+  if (_linkFailures < 255)
+    _linkFailures++;
+  setLinkState(LinkState::BACKOFF);
+  LOG_W("BLE", "Failed after %lu ms. Next retry in %lu seconds",
+        (unsigned long)_stats.lastAttemptMs,
+        (unsigned long)(retryInterval() / 1000));
+}
+
+void FossibotBLE::setLinkState(LinkState state) { _linkState = state; }
+
+uint32_t FossibotBLE::retryInterval() const {
+  // Exponential backoff: 10s, 20s, 40s, 80s, then every 160s
+  uint8_t failures = _linkFailures;
+  uint8_t steps = failures < MAX_BACKOFF_STEPS ? failures : MAX_BACKOFF_STEPS;
+  return 10000UL << steps;
+}
+
+LinkStatus FossibotBLE::getLinkStatus() const {
+  LinkStatus status;
+  status.state = _linkState;
+  status.failures = _linkFailures;
+  status.retryInMs = 0;
+  status.advertising = isAdvertising();
+  status.rssi = _advRssi;
+  if (status.state == LinkState::BACKOFF) {
+    unsigned long elapsed = millis() - _lastLinkAttempt;
+    uint32_t interval = retryInterval();
+    status.retryInMs = elapsed < interval ? interval - elapsed : 0;
+  }
+  return status;
+}
+
+void FossibotBLE::setConnectAllowed(bool allowed) {
+  if (_connectAllowed == allowed)
+    return;
+  _connectAllowed = allowed;
+  if (!allowed && _connected) {
+    LOG_I("BLE", "Releasing link to %s", _targetMAC.c_str());
+    disconnect();
+    setLinkState(LinkState::SCANNING);
   }
 }
 
@@ -69,83 +341,108 @@ bool FossibotBLE::connectToDevice() {
   if (_connected)
     return true;
 
-  Serial.printf("BLE: Connecting to %s...\n", _targetMAC.c_str());
+  LOG_I("BLE", "Connecting to %s...", _targetMAC.c_str());
 
   // Create client if needed
   if (!_client) {
     _client = NimBLEDevice::createClient();
     _client->setClientCallbacks(this);
 
-    // Connection parameters
-    // Connection parameters (Relaxed for stability)
-    _client->setConnectionParams(12, 48, 0, 500); // 15-60ms, 5s timeout
-    _client->setConnectTimeout(10);               // 10 seconds scanning timeout
+    // Connect on the short interval: discovery and the first polls follow
+    ConnParams p = LinkPolicy::burstParams();
+    _client->setConnectionParams(p.minInterval, p.maxInterval, p.latency,
+                                 p.timeout);
+    _client->setConnectTimeout(10); // 10 seconds scanning timeout
   }
 
-  // Connect
-  // Try Public Address first
-  Serial.println("BLE: Connecting with AddrType: PUBLIC...");
-  bool connected = _client->connect(_targetAddress);
-
-  // If failed, try Random Address
-  if (!connected) {
-    Serial.println("BLE: Public failed. Trying RANDOM address type...");
-    NimBLEAddress randomAddr(_targetAddress);
-    randomAddr = NimBLEAddress(_targetAddress.toString(), 1); // 1=Random
-    connected = _client->connect(randomAddr);
+  // Connect with the address type that worked last time, then the other.
+  // Attributes are kept across connects (deleteAttributes=false) so a
+  // reconnect to the same device skips GATT discovery.
+  uint8_t addrType = _cache.addrType; // PUBLIC when nothing is recorded
+  if (_advAddrType >= 0)
+    addrType = _advAddrType; // The advertisement says which one it is
+  bool connected = false;
+  for (int i = 0; i < 2 && !connected; i++) {
+    if (i == 1) {
+      addrType =
+          addrType == BLE_ADDR_PUBLIC ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
+      LOG_W("BLE", "First address type failed, trying the other...");
+    }
+    LOG_I("BLE", "Connecting with AddrType: %s...",
+          addrType == BLE_ADDR_RANDOM ? "RANDOM" : "PUBLIC");
+    connected = _client->connect(
+        NimBLEAddress(_targetAddress.toString(), addrType), false);
   }
 
   if (!connected) {
-    Serial.println("BLE: Failed to connect (Public & Random)");
+    LOG_W("BLE", "Failed to connect (Public & Random)");
     return false;
   }
 
-  // Discover services
-  if (!discoverServices()) {
+  // Discover services (from the attribute cache when it is still valid)
+  setLinkState(LinkState::DISCOVERING);
+  bool discovered = discoverServices();
+
+  // Cached attributes that disagree with NVS, or don't work, are stale
+  bool stale = !discovered ||
+               (_cache.valid &&
+                (_writeChar->getHandle() != _cache.writeHandle ||
+                 _notifyChar->getHandle() != _cache.notifyHandle));
+  if (stale) {
+    LOG_W("BLE", "Cached GATT handles stale, full discovery...");
+    _client->deleteServices();
+    discovered = discoverServices();
+  }
+  if (!discovered) {
     disconnect();
     return false;
   }
+  saveLinkCache(addrType);
 
-  _connected = true;
-  _data.connected = true;
+  // Longer link-layer packets, so a response crosses in one connection
+  // event; the MTU was exchanged on connect. Either may be refused, and
+  // reassemble() copes with the pieces.
+  _client->setDataLen(DATA_LEN);
+  LOG_I("BLE", "MTU %u", (unsigned)_client->getMTU());
+  _rxLength = 0;
 
-  // Request initial data
-  requestStatusData();
+  // Only now is the link usable from the loop (initial poll in update())
+  _connected = true;
 
   return true;
 }
 
 bool FossibotBLE::discoverServices() {
-  Serial.println("BLE: Discovering services...");
+  LOG_I("BLE", "Discovering services...");
 
   // Get service
   _service = _client->getService(Fossibot::SERVICE_UUID);
   if (!_service) {
-    Serial.println("BLE: Service not found!");
+    LOG_W("BLE", "Service not found!");
     return false;
   }
-  Serial.println("BLE: Service found");
+  LOG_I("BLE", "Service found");
 
   // Get write characteristic
   _writeChar = _service->getCharacteristic(Fossibot::WRITE_CHAR_UUID);
   if (!_writeChar) {
-    Serial.println("BLE: Write characteristic not found!");
+    LOG_W("BLE", "Write characteristic not found!");
     return false;
   }
-  Serial.println("BLE: Write characteristic found");
+  LOG_I("BLE", "Write characteristic found");
 
   // Get notify characteristic
   _notifyChar = _service->getCharacteristic(Fossibot::NOTIFY_CHAR_UUID);
   if (!_notifyChar) {
-    Serial.println("BLE: Notify characteristic not found!");
+    LOG_W("BLE", "Notify characteristic not found!");
     return false;
   }
-  Serial.println("BLE: Notify characteristic found");
+  LOG_I("BLE", "Notify characteristic found");
 
   // Subscribe to notifications
   if (_notifyChar->canNotify()) {
     _notifyChar->subscribe(true, notifyCallback);
-    Serial.println("BLE: Subscribed to notifications");
+    LOG_I("BLE", "Subscribed to notifications");
   }
 
   return true;
@@ -157,133 +454,227 @@ void FossibotBLE::disconnect() {
   }
 
   _connected = false;
-  _data.connected = false;
   _service = nullptr;
   _writeChar = nullptr;
   _notifyChar = nullptr;
 }
 
+void FossibotBLE::refreshSnapshot() {
+  bool replaying = this->replaying();
+  _snapshot.connected = _connected || replaying;
+  if (_shared.generation() == _snapshotGen)
+    return; // No new frame: nothing to copy
+
+  // A read that races the host task leaves a torn copy: read into a
+  // local, so the loop keeps serving the last good frame
+  Fossibot::PowerBankData frame;
+  if (!_shared.read(frame, _snapshotGen))
+    return; // Raced the host task repeatedly; pick it up next loop
+
+  // Change-detection fields belong to the loop side; keep them
+  frame.connected = _connected || replaying;
+  frame.lastSocPermille = _snapshot.lastSocPermille;
+  frame.lastInputDeciwatts = _snapshot.lastInputDeciwatts;
+  frame.lastOutputDeciwatts = _snapshot.lastOutputDeciwatts;
+  _snapshot = frame;
+}
+
 void FossibotBLE::update() {
   if (!_initialized)
     return;
 
-  // Try to reconnect if disconnected
-  if (!_connected) {
-    static unsigned long lastReconnectAttempt = 0;
-    static int consecutiveFailures = 0;
-    const int MAX_FAILURES = 5; // Stop trying after 5 failures
+  refreshSnapshot();
 
-    // Exponential backoff: 60s, 120s, 240s, then stop
-    unsigned long retryInterval = 60000 * (1 << min(consecutiveFailures, 2));
+  // Report link progress on the loop task
+  LinkState state = _linkState;
+  if (state != _reportedState) {
+    _reportedState = state;
+    if (_linkCallback)
+      _linkCallback(getLinkStatus());
+  }
 
-    if (consecutiveFailures >= MAX_FAILURES) {
-      // Give up after max failures - user can restart device to retry
-      return;
+  // Another panel holds the link and passes the readings on
+  if (_relay) {
+    if (_connected)
+      disconnect(); // Finished connecting as the relay was set
+    return;
+  }
+
+  // Schedule a reconnect if disconnected; the link task does the work
+  if (!_connected) {
+    // Writes can't be confirmed across a reconnect
+    if (_commands.pending())
+      _commands.clear(CommandResult::FAILED);
+
+    if (state == LinkState::BACKOFF &&
+        millis() - _lastLinkAttempt > retryInterval()) {
+      setLinkState(LinkState::SCANNING);
+      state = LinkState::SCANNING;
     }
 
-    if (millis() - lastReconnectAttempt > retryInterval) {
-      lastReconnectAttempt = millis();
-      Serial.printf("BLE: Retry attempt %d/%d\n", consecutiveFailures + 1,
-                    MAX_FAILURES);
-
-      if (!connectToDevice()) {
-        consecutiveFailures++;
-        Serial.printf("BLE: Failed. Next retry in %lu seconds\n",
-                      retryInterval / 1000);
-      } else {
-        consecutiveFailures = 0; // Reset on success
+    if (state == LinkState::SCANNING) {
+      // The scanner is shared: another session may have stopped it
+      if (!NimBLEDevice::getScan()->isScanning())
+        startPresenceScan();
+      if (_connectAllowed && !_connectBusy && isAdvertising()) {
+        LOG_I("BLE", "Device advertising (RSSI %d), attempt %d",
+              (int)_advRssi, _linkFailures + 1);
+        kickConnect();
       }
     }
     return;
   }
 
-  unsigned long now = millis();
-
-  // Poll status data (every 30s)
-  if (now - _lastPoll >= POLL_INTERVAL) {
-    _lastPoll = now;
+  if (!_readyHandled) {
+    _readyHandled = true;
+    _policy.reset(millis());
+    _commands.resetBatching();
+    _lastRssiSample = millis();
+    // Request initial data, then poll both groups fast while it settles
+    _lastFullPoll = 0;
     requestStatusData();
+    _telemetry.boost(TelemetryGroup::STATUS | TelemetryGroup::SETTINGS,
+                     millis());
   }
 
-  // Poll settings data (every 60s)
-  if (now - _lastSettingsPoll >= SETTINGS_POLL_INTERVAL) {
-    _lastSettingsPoll = now;
+  // Queued register writes: send, confirm, retry
+  if (_commands.pending())
+    _policy.onActivity(millis());
+  _commands.service(millis());
+
+  applyLinkPolicy();
+
+  // Fast after commands and power swings, backing off while stable
+  uint8_t due = _telemetry.due(millis());
+  if (due & TelemetryGroup::STATUS)
+    requestStatusData();
+  if (due & TelemetryGroup::SETTINGS)
     requestSettingsData();
+}
+
+void FossibotBLE::applyLinkPolicy() {
+  unsigned long now = millis();
+
+  bool burst = false;
+  if (_policy.profileChanged(now, burst)) {
+    ConnParams p =
+        burst ? LinkPolicy::burstParams() : LinkPolicy::idleParams();
+    // Only a request: the peripheral may reject it and keep the old one
+    _client->updateConnParams(p.minInterval, p.maxInterval, p.latency,
+                              p.timeout);
+    LOG_I("BLE", "Link %s (interval %d-%d ms, latency %d)",
+          burst ? "burst" : "idle", p.minInterval * 5 / 4,
+          p.maxInterval * 5 / 4, p.latency);
   }
+
+  if (now - _lastRssiSample < LinkPolicy::RSSI_SAMPLE_MS)
+    return;
+  _lastRssiSample = now;
+  int rssi = _client->getRssi();
+  _stats.onRssi(rssi, now);
+
+  // TX power follows the link budget; only adjust while idle so a
+  // command burst never runs on a just-lowered level
+  if (_policy.isBurst() || rssi == 0 || !_policy.onRssi(rssi))
+    return;
+
+  uint16_t handle = _client->getConnId();
+  if (handle > ESP_BLE_PWR_TYPE_CONN_HDL8 - ESP_BLE_PWR_TYPE_CONN_HDL0)
+    return;
+  esp_ble_tx_power_set(
+      (esp_ble_power_type_t)(ESP_BLE_PWR_TYPE_CONN_HDL0 + handle),
+      _policy.txPower());
+  LOG_D("BLE", "RSSI %d dBm, TX power now %d dBm", rssi, _policy.txPowerDbm());
 }
 
 bool FossibotBLE::hasSignificantChange() const {
-  return _data.hasSignificantChange(_socThreshold, _powerThreshold);
+  return _snapshot.hasSignificantChange(_socThreshold, _powerThreshold);
 }
 
 void FossibotBLE::requestStatusData() {
   if (!_connected || !_writeChar)
     return;
 
-  // Read 80 input registers starting from 0: [0x11, 0x04, 0x00, 0x00, 0x00,
-  // 0x50] Based on ESP-FBot source code
-  uint8_t payload[6] = {0x11, 0x04, 0x00, 0x00, 0x00, 0x50};
-
-  // CRC-16 Modbus calculation (from ESP-FBot)
-  uint16_t crc = 0xFFFF;
-  for (size_t i = 0; i < 6; i++) {
-    crc ^= payload[i];
-    for (int j = 0; j < 8; j++) {
-      if (crc & 1) {
-        crc = (crc >> 1) ^ 0xA001;
-      } else {
-        crc >>= 1;
-      }
-    }
+  // The whole block of input registers now and then (and every time for
+  // the frame recorder, which keeps all of it), else only the ranges the
+  // dashboard reads
+  unsigned long now = millis();
+  if (!_lastFullPoll || now - _lastFullPoll >= FULL_POLL_MS ||
+      (recorder && recorder->isEnabled())) {
+    if (sendRead(Fossibot::OPCODE_STATUS, 0, Fossibot::POLL_REGS))
+      _lastFullPoll = now ? now : 1;
+  } else {
+    for (int i = 0; i < _liveRangeCount; i++)
+      sendRead(Fossibot::OPCODE_STATUS, _liveRanges[i].first,
+               _liveRanges[i].count);
   }
+  LOG_D("BLE", "Requested status data");
+}
 
-  uint8_t command[8];
-  memcpy(command, payload, 6);
-  command[6] = (crc >> 8) & 0xFF; // CRC high byte
-  command[7] = crc & 0xFF;        // CRC low byte
-
+bool FossibotBLE::sendRead(uint16_t opcode, uint8_t first, uint8_t count) {
+  // Responses come back in order; the host task pairs each with its read
+  if (!_pending.push({opcode, first, count, (uint32_t)millis()}))
+    return false;
+  // [0x11, function, start register, register count], as ESP-FBot does
+  uint8_t command[8] = {(uint8_t)(opcode >> 8), (uint8_t)(opcode & 0xFF),
+                        0x00, first, 0x00, count};
+  CRC16::seal(command, 6);
   _writeChar->writeValue(command, sizeof(command), false);
-  Serial.println("BLE: Requested status data");
+  return true;
+}
+
+FossibotBLE::PendingRead FossibotBLE::takeRead(uint16_t opcode,
+                                               unsigned long now) {
+  // Reads older than the timeout, or of the other kind, lost their
+  // response
+  PendingRead read;
+  while (_pending.pop(read)) {
+    if (read.opcode == opcode && now - read.ms < RESPONSE_TIMEOUT_MS)
+      return read;
+    _stats.missedReads++;
+  }
+  return {opcode, 0, Fossibot::POLL_REGS, 0}; // Whole block, not timed
 }
 
 void FossibotBLE::requestSettingsData() {
   if (!_connected || !_writeChar)
     return;
 
-  // Read 80 holding registers starting from 0: [0x11, 0x03, 0x00, 0x00, 0x00,
-  // 0x50]
-  uint8_t payload[6] = {0x11, 0x03, 0x00, 0x00, 0x00, 0x50};
-
-  // CRC-16 Modbus calculation
-  uint16_t crc = 0xFFFF;
-  for (size_t i = 0; i < 6; i++) {
-    crc ^= payload[i];
-    for (int j = 0; j < 8; j++) {
-      if (crc & 1) {
-        crc = (crc >> 1) ^ 0xA001;
-      } else {
-        crc >>= 1;
-      }
-    }
+  // All 80 holding registers: the command queue checks its writes in them
+  sendRead(Fossibot::OPCODE_SETTINGS, 0, Fossibot::POLL_REGS);
+  LOG_D("BLE", "Requested settings data");
+}
+
+void FossibotBLE::sendCommand(uint8_t reg, uint16_t value,
+                              CommandCallback done, bool expectAck) {
+  // Relayed: the owner's readings will show whether it took
+  if (_relay) {
+    bool sent = _relay(reg, value);
+    if (done)
+      done(reg, value, sent ? CommandResult::SENT : CommandResult::FAILED);
+    return;
   }
 
-  uint8_t command[8];
-  memcpy(command, payload, 6);
-  command[6] = (crc >> 8) & 0xFF;
-  command[7] = crc & 0xFF;
+  if (!_connected || !_writeChar) {
+    if (done)
+      done(reg, value, CommandResult::FAILED);
+    return;
+  }
 
-  _writeChar->writeValue(command, sizeof(command), false);
-  Serial.println("BLE: Requested settings data");
+  // Written from update(); a newer value for the same register replaces it
+  _commands.push(reg, value, done, expectAck);
+  LOG_D("BLE", "Queued command reg=%d value=%d (%d pending)", reg,
+        value, _commands.size());
 }
 
-void FossibotBLE::sendCommand(uint8_t reg, uint16_t value) {
+bool FossibotBLE::writeCommand(uint8_t reg, uint16_t value) {
   if (!_connected || !_writeChar)
-    return;
+    return false;
 
   // Build command packet using Modbus Write Single Register format
-  // Format: [0x11, 0x06, RegHigh, RegLow, ValueHigh, ValueLow, CRC_Low,
-  // CRC_High]
-  uint8_t payload[6] = {
+  // Format: [0x11, 0x06, RegHigh, RegLow, ValueHigh, ValueLow, CRC_High,
+  // CRC_Low]
+  uint8_t command[8] = {
       0x11,                   // Device address
       0x06,                   // Function code: Write Single Register
       0x00,                   // Register high byte (always 0 for low registers)
@@ -291,206 +682,374 @@ void FossibotBLE::sendCommand(uint8_t reg, uint16_t value) {
       (uint8_t)(value >> 8),  // Value high byte
       (uint8_t)(value & 0xFF) // Value low byte
   };
-
-  // CRC-16 Modbus calculation (same as requestStatusData)
-  uint16_t crc = 0xFFFF;
-  for (size_t i = 0; i < 6; i++) {
-    crc ^= payload[i];
-    for (int j = 0; j < 8; j++) {
-      if (crc & 1) {
-        crc = (crc >> 1) ^ 0xA001;
-      } else {
-        crc >>= 1;
-      }
-    }
+  CRC16::seal(command, 6); // CRC high byte first (Fossibot protocol)
+  uint16_t crc = (command[6] << 8) | command[7];
+
+  // Write with response when the characteristic allows it, so a lost
+  // packet is reported here instead of only by the readback timeout
+  bool withResponse = _writeChar->canWrite();
+  bool success =
+      _writeChar->writeValue(command, sizeof(command), withResponse);
+  if (success) {
+    // Poll fast so the 0x1103 readback confirms the write quickly
+    _telemetry.boost(TelemetryGroup::STATUS | TelemetryGroup::SETTINGS,
+                     millis());
+    LOG_D("BLE", "Sent command reg=%d value=%d (CRC=0x%04X)", reg, value, crc);
+  } else {
+    LOG_E("BLE", "Failed to send command reg=%d value=%d", reg, value);
   }
+  return success;
+}
+
+bool FossibotBLE::writeCommands(uint8_t first, const uint16_t *values,
+                                int count) {
+  if (!_connected || !_writeChar || count > CommandQueue::MAX_BATCH)
+    return false;
 
-  uint8_t command[8];
-  memcpy(command, payload, 6);
-  command[6] = (crc >> 8) & 0xFF; // CRC high byte first (Fossibot protocol)
-  command[7] = crc & 0xFF;        // CRC low byte second
+  // Modbus Write Multiple Registers: [0x11, 0x10, RegHigh, RegLow,
+  // CountHigh, CountLow, ByteCount, values..., CRC_High, CRC_Low]
+  uint8_t command[7 + CommandQueue::MAX_BATCH * 2 + 2] = {
+      0x11, 0x10, 0x00, first, 0x00, (uint8_t)count, (uint8_t)(count * 2)};
+  for (int i = 0; i < count; i++) {
+    command[7 + i * 2] = (uint8_t)(values[i] >> 8);
+    command[8 + i * 2] = (uint8_t)(values[i] & 0xFF);
+  }
+  size_t len = CRC16::seal(command, 7 + count * 2);
 
-  bool success = _writeChar->writeValue(command, sizeof(command), false);
+  bool withResponse = _writeChar->canWrite();
+  bool success = _writeChar->writeValue(command, len, withResponse);
   if (success) {
-    Serial.printf("BLE: Sent command reg=%d value=%d (CRC=0x%04X)\n", reg,
-                  value, crc);
+    _telemetry.boost(TelemetryGroup::STATUS | TelemetryGroup::SETTINGS,
+                     millis());
+    LOG_D("BLE", "Sent regs %d-%d in one write", first, first + count - 1);
   } else {
-    Serial.printf("BLE: ERROR Failed to send command reg=%d value=%d\n", reg,
-                  value);
+    LOG_E("BLE", "Failed to send regs %d-%d", first, first + count - 1);
   }
+  return success;
+}
+
+uint16_t FossibotBLE::outputTarget(uint8_t reg, bool active) const {
+  // Toggle from the newest queued value so quick double taps cancel out
+  uint16_t queued;
+  if (_commands.pendingValue(reg, queued))
+    return queued ? 0 : 1;
+  return active ? 0 : 1;
 }
 
-void FossibotBLE::toggleUSB() {
-  sendCommand(Fossibot::ControlReg::USB_TOGGLE, _data.usbActive ? 0 : 1);
+void FossibotBLE::toggleUSB(CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::USB_TOGGLE,
+              outputTarget(Fossibot::ControlReg::USB_TOGGLE, _snapshot.usbActive),
+              done);
 }
 
-void FossibotBLE::toggleDC() {
-  sendCommand(Fossibot::ControlReg::DC_TOGGLE, _data.dcActive ? 0 : 1);
+void FossibotBLE::toggleDC(CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::DC_TOGGLE,
+              outputTarget(Fossibot::ControlReg::DC_TOGGLE, _snapshot.dcActive),
+              done);
 }
 
-void FossibotBLE::toggleAC() {
-  sendCommand(Fossibot::ControlReg::AC_TOGGLE, _data.acActive ? 0 : 1);
+void FossibotBLE::toggleAC(CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::AC_TOGGLE,
+              outputTarget(Fossibot::ControlReg::AC_TOGGLE, _snapshot.acActive),
+              done);
+}
+
+void FossibotBLE::setUSB(bool on, CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::USB_TOGGLE, on ? 1 : 0, done);
+}
+
+void FossibotBLE::setDC(bool on, CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::DC_TOGGLE, on ? 1 : 0, done);
+}
+
+void FossibotBLE::setAC(bool on, CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::AC_TOGGLE, on ? 1 : 0, done);
 }
 
 // ============================================================
 // Fossibot Settings Commands Implementation
 // ============================================================
 
-void FossibotBLE::setBuzzerEnabled(bool enabled) {
-  sendCommand(Fossibot::ControlReg::KEY_SOUND, enabled ? 1 : 0);
-  Serial.printf("BLE: Buzzer %s\n", enabled ? "enabled" : "disabled");
+void FossibotBLE::setBuzzerEnabled(bool enabled, CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::KEY_SOUND, enabled ? 1 : 0, done);
+  LOG_I("BLE", "Buzzer %s", enabled ? "enabled" : "disabled");
 }
 
-void FossibotBLE::setSilentCharging(bool enabled) {
-  sendCommand(Fossibot::ControlReg::SILENT_CHARGING, enabled ? 1 : 0);
-  Serial.printf("BLE: Silent charging %s\n", enabled ? "enabled" : "disabled");
+void FossibotBLE::setSilentCharging(bool enabled, CommandCallback done) {
+  sendCommand(Fossibot::ControlReg::SILENT_CHARGING, enabled ? 1 : 0, done);
+  LOG_I("BLE", "Silent charging %s", enabled ? "enabled" : "disabled");
 }
 
-void FossibotBLE::setLightMode(int mode) {
+void FossibotBLE::setLightMode(int mode, CommandCallback done) {
   if (mode < 0)
     mode = 0;
   if (mode > 3)
     mode = 3;
-  sendCommand(Fossibot::ControlReg::LIGHT_MODE, mode);
+  sendCommand(Fossibot::ControlReg::LIGHT_MODE, mode, done);
   const char *modeNames[] = {"OFF", "ON", "FLASH", "SOS"};
-  Serial.printf("BLE: Light mode set to %s\n", modeNames[mode]);
+  LOG_I("BLE", "Light mode set to %s", modeNames[mode]);
 }
 
-void FossibotBLE::setDischargeLimit(int percent) {
+void FossibotBLE::setDischargeLimit(int percent, CommandCallback done) {
   if (percent < 0)
     percent = 0;
   if (percent > 30)
     percent = 30;
   // Value is in 0.1% units (e.g., 100 = 10%)
-  sendCommand(Fossibot::ControlReg::DISCHARGE_LIMIT, percent * 10);
-  Serial.printf("BLE: Discharge limit set to %d%%\n", percent);
+  sendCommand(Fossibot::ControlReg::DISCHARGE_LIMIT, percent * 10, done);
+  LOG_I("BLE", "Discharge limit set to %d%%", percent);
 }
 
-void FossibotBLE::setChargeLimit(int percent) {
+void FossibotBLE::setChargeLimit(int percent, CommandCallback done) {
   if (percent < 60)
     percent = 60;
   if (percent > 100)
     percent = 100;
   // Value is in 0.1% units (e.g., 1000 = 100%)
-  sendCommand(Fossibot::ControlReg::CHARGE_LIMIT, percent * 10);
-  Serial.printf("BLE: Charge limit set to %d%%\n", percent);
+  sendCommand(Fossibot::ControlReg::CHARGE_LIMIT, percent * 10, done);
+  LOG_I("BLE", "Charge limit set to %d%%", percent);
 }
 
-void FossibotBLE::setScreenTimeout(int minutes) {
+void FossibotBLE::setScreenTimeout(int minutes, CommandCallback done) {
   if (minutes < 0)
     minutes = 0;
-  sendCommand(Fossibot::ControlReg::SCREEN_TIMEOUT, minutes);
-  Serial.printf("BLE: Screen timeout set to %d minutes\n", minutes);
+  sendCommand(Fossibot::ControlReg::SCREEN_TIMEOUT, minutes, done);
+  LOG_I("BLE", "Screen timeout set to %d minutes", minutes);
 }
 
-void FossibotBLE::setSysStandby(int minutes) {
+void FossibotBLE::setSysStandby(int minutes, CommandCallback done) {
   if (minutes < 0)
     minutes = 0;
-  sendCommand(Fossibot::ControlReg::SYS_STANDBY, minutes);
-  Serial.printf("BLE: System standby set to %d minutes\n", minutes);
+  sendCommand(Fossibot::ControlReg::SYS_STANDBY, minutes, done);
+  LOG_I("BLE", "System standby set to %d minutes", minutes);
 }
 
-void FossibotBLE::setACStandby(int minutes) {
+void FossibotBLE::setACStandby(int minutes, CommandCallback done) {
   if (minutes < 0)
     minutes = 0;
-  sendCommand(Fossibot::ControlReg::AC_STANDBY, minutes);
-  Serial.printf("BLE: AC standby set to %d minutes\n", minutes);
+  sendCommand(Fossibot::ControlReg::AC_STANDBY, minutes, done);
+  LOG_I("BLE", "AC standby set to %d minutes", minutes);
 }
 
-void FossibotBLE::setDCStandby(int minutes) {
+void FossibotBLE::setDCStandby(int minutes, CommandCallback done) {
   if (minutes < 0)
     minutes = 0;
-  sendCommand(Fossibot::ControlReg::DC_STANDBY, minutes);
-  Serial.printf("BLE: DC standby set to %d minutes\n", minutes);
+  sendCommand(Fossibot::ControlReg::DC_STANDBY, minutes, done);
+  LOG_I("BLE", "DC standby set to %d minutes", minutes);
 }
 
-void FossibotBLE::setUSBStandby(int seconds) {
+void FossibotBLE::setUSBStandby(int seconds, CommandCallback done) {
   if (seconds < 0)
     seconds = 0;
-  sendCommand(Fossibot::ControlReg::USB_STANDBY, seconds);
-  Serial.printf("BLE: USB standby set to %d seconds\n", seconds);
+  sendCommand(Fossibot::ControlReg::USB_STANDBY, seconds, done);
+  LOG_I("BLE", "USB standby set to %d seconds", seconds);
 }
 
 void FossibotBLE::powerOff() {
-  Serial.println("BLE: Sending Power OFF command (1)...");
-  sendCommand(Fossibot::ControlReg::POWER_OFF, 1);
-  delay(200); // Ensure command goes out before any state change
-  Serial.println("BLE: Power off command sent!");
+  LOG_I("BLE", "Sending Power OFF command (1)...");
+  // No readback to wait for: the device shuts down
+  sendCommand(Fossibot::ControlReg::POWER_OFF, 1, nullptr, false);
 }
 
-void FossibotBLE::setScheduleCharge(int minutes) {
+void FossibotBLE::setScheduleCharge(int minutes, CommandCallback done) {
   if (minutes < 0)
     minutes = 0;
-  sendCommand(Fossibot::ControlReg::SCHEDULE_CHARGE, minutes);
-  Serial.printf("BLE: Schedule charge set to %d minutes from now\n", minutes);
+  // Register counts down once set, so a readback can't confirm it (and a
+  // resend would restart the timer)
+  sendCommand(Fossibot::ControlReg::SCHEDULE_CHARGE, minutes, done, false);
+  LOG_I("BLE", "Schedule charge set to %d minutes from now", minutes);
 }
 
 void FossibotBLE::notifyCallback(NimBLERemoteCharacteristic *characteristic,
                                  uint8_t *data, size_t length, bool isNotify) {
-  if (!_instance)
+  FossibotBLE *self =
+      sessionFor(characteristic->getRemoteService()->getClient());
+  if (!self)
     return;
+  PROFILE_ZONE(BLE_PARSE);
 
-  Serial.printf("BLE: Received %d bytes\n", length);
+  LOG_D("BLE", "Received %d bytes", length);
+  self->reassemble(data, length);
+  Wake::signal(Wake::BLE);
+}
 
-  // Check opcode
-  if (length >= 2) {
-    uint16_t opcode = (data[0] << 8) | data[1];
+void FossibotBLE::reassemble(const uint8_t *data, size_t length) {
+  unsigned long now = millis();
+  if (_rxLength && (now - _rxStarted > FRAGMENT_TIMEOUT_MS ||
+                    _rxLength + length > sizeof(_rxFrame))) {
+    LOG_W("BLE", "Incomplete %u-byte frame dropped", (unsigned)_rxLength);
+    _stats.shortFrames++;
+    _rxLength = 0;
+  }
 
-    if (opcode == Fossibot::OPCODE_STATUS) {
-      _instance->parseStatusData(data, length);
-    } else if (opcode == Fossibot::OPCODE_SETTINGS) {
-      _instance->parseSettingsData(data, length);
+  if (!_rxLength) {
+    uint16_t opcode = length >= 2 ? (data[0] << 8) | data[1] : 0;
+    if (opcode != Fossibot::OPCODE_STATUS &&
+        opcode != Fossibot::OPCODE_SETTINGS) {
+      handleFrame(data, length); // Not a response to a read
+      return;
+    }
+    _rxRead = takeRead(opcode, now);
+    // Whole already: the usual case at a large MTU
+    if (length >= expectedLength() || CRC16::verify(data, length)) {
+      onResponse(now);
+      handleFrame(data, length, _rxRead.first);
+      return;
     }
+    _rxStarted = now;
   }
+
+  memcpy(_rxFrame + _rxLength, data, length);
+  _rxLength += length;
+  if (_rxLength < expectedLength() && !CRC16::verify(_rxFrame, _rxLength))
+    return; // More to come
+  onResponse(now);
+  handleFrame(_rxFrame, _rxLength, _rxRead.first);
+  _rxLength = 0;
+}
+
+void FossibotBLE::onResponse(unsigned long now) {
+  // From the request going out to the last piece of its answer
+  if (_rxRead.ms)
+    _stats.onResponse(now - _rxRead.ms);
+  else
+    _stats.frames++; // Answers no request we know of
 }
 
-void FossibotBLE::parseStatusData(const uint8_t *data, size_t length) {
-  // Parse status registers from response
-  // Based on ESP-FBot source: registers start at byte offset 6
-  // Each register is 2 bytes, big-endian
+void FossibotBLE::setRelay(CommandRelay relay) {
+  bool was = (bool)_relay;
+  _relay = relay;
+  if (relay && !was) {
+    if (_connected)
+      disconnect();
+    stopScan();
+    setLinkState(LinkState::IDLE);
+    LOG_I("BLE", "Readings relayed by another panel, link released");
+  } else if (!relay && was) {
+    _replayedAt = 0;
+    if (_initialized && _targetMAC.length() > 0)
+      setLinkState(LinkState::SCANNING); // update() starts the scan
+    LOG_I("BLE", "Taking the link back");
+  }
+}
 
+void FossibotBLE::feedRelayed(const Fossibot::PowerBankData &data) {
+  if (!_relay)
+    return;
+  _data = data;
+  _data.connected = true;
+  _shared.write(_data);
+  _replayedAt = millis();
+  if (!_replayedAt)
+    _replayedAt = 1; // 0 means none
+}
+
+bool FossibotBLE::writeRelayed(uint8_t reg, uint16_t value) {
+  using namespace Fossibot::ControlReg;
+  switch (reg) {
+  case USB_TOGGLE:
+  case DC_TOGGLE:
+  case AC_TOGGLE:
+  case LIGHT_MODE:
+  case KEY_SOUND:
+  case SILENT_CHARGING:
+  case SCREEN_TIMEOUT:
+  case AC_STANDBY:
+  case DC_STANDBY:
+  case USB_STANDBY:
+  case DISCHARGE_LIMIT:
+  case CHARGE_LIMIT:
+  case SYS_STANDBY:
+    sendCommand(reg, value, nullptr);
+    break;
+  case SCHEDULE_CHARGE:
+  case POWER_OFF:
+    sendCommand(reg, value, nullptr, false); // No readback confirms these
+    break;
+  default:
+    return false;
+  }
+  LOG_I("BLE", "Relayed write: reg %u = %u", reg, value);
+  return true;
+}
+
+bool FossibotBLE::replayFrame(uint8_t session, uint8_t firstReg,
+                              const uint8_t *data, size_t length) {
+  FossibotBLE *self = session < MAX_SESSIONS ? _instances[session] : nullptr;
+  if (!self || self->_connected)
+    return false;
+  self->_replayedAt = millis();
+  if (!self->_replayedAt)
+    self->_replayedAt = 1; // 0 means none
+  self->handleFrame(data, length, firstReg, true);
+  return true;
+}
+
+void FossibotBLE::handleFrame(const uint8_t *data, size_t length,
+                              uint8_t firstReg, bool replayed) {
+  if (length < 2)
+    return;
+  uint16_t opcode = (data[0] << 8) | data[1];
+
+  // The unit's answer to a multi-register write says whether it takes them
+  if (!replayed && (opcode == Fossibot::OPCODE_WRITE_MULTI ||
+                    opcode == Fossibot::OPCODE_WRITE_MULTI_ERROR)) {
+    if (CRC16::verify(data, length))
+      _commands.onBatchAnswer(opcode == Fossibot::OPCODE_WRITE_MULTI);
+    return;
+  }
+  if (opcode != Fossibot::OPCODE_STATUS &&
+      opcode != Fossibot::OPCODE_SETTINGS)
+    return;
+
+  // Raw, before the CRC check: corrupt frames are worth a look too
+  if (recorder && !replayed)
+    recorder->capture(_session, firstReg, data, length);
+
+  // Drop corrupted register frames before they reach PowerBankData
+  if (!CRC16::verify(data, length)) {
+    if (!replayed)
+      _stats.crcErrors++;
+    LOG_W("BLE", "CRC mismatch on 0x%04X frame, dropped (%u total)", opcode,
+          (unsigned)_stats.crcErrors);
+    return;
+  }
+
+  if (opcode == Fossibot::OPCODE_STATUS)
+    parseStatusData(data, length, firstReg);
+  else if (firstReg == 0) // Settings are only ever read whole
+    parseSettingsData(data, length);
+}
+
+void FossibotBLE::parseStatusData(const uint8_t *data, size_t length,
+                                  uint8_t firstReg) {
   if (length < 10)
     return; // Minimum valid response
 
-  // ESP-FBot shows: registers start at byte 6 (after header bytes)
-  // getRegValue helper to extract register at given index
-  auto getRegValue = [data, length](uint16_t regIndex) -> uint16_t {
-    uint16_t offset = 6 + (regIndex * 2);
-    if (offset + 1 >= length)
-      return 0;
-    return (data[offset] << 8) | data[offset + 1];
-  };
-
-  // Parse values using ESP-FBot register mappings:
-  // Register 3 = AC input watts
-  // Register 4 = DC input watts
-  // Register 6 = Total input watts
-  // Register 39 = Output watts (NOT 20 - that's total_watts which includes
-  // system) Register 22 = Battery voltage Register 41 = State flags Register 56
-  // = Battery percent (divide by 10)
-
-  _data.acInputPower = getRegValue(3);
-  _data.dcInputPower = getRegValue(4);
-  _data.inputPower = getRegValue(6);
-  _data.outputPower = getRegValue(39); // Fixed: was using reg 20
-  _data.batteryVoltage = getRegValue(22) / 100.0f;
-  _data.batteryPercent = getRegValue(56) / 10.0f;
-
-  // Parse output states from bitmask (register 41)
-  uint16_t states = getRegValue(41);
-  _data.usbActive = (states & Fossibot::StateBits::USB_BIT) != 0;
-  _data.dcActive = (states & Fossibot::StateBits::DC_BIT) != 0;
-  _data.acActive = (states & Fossibot::StateBits::AC_BIT) != 0;
-
-  // Get time values from device (not calculated)
-  // Register 58 = time to full (minutes)
-  // Register 59 = remaining time / time to empty (minutes)
-  _data.minutesToFull = getRegValue(58);
-  _data.minutesToEmpty = getRegValue(59);
-
-  Serial.printf("BLE: SOC=%.1f%% IN=%.0fW OUT=%.0fW TTF=%dm TTE=%dm\n",
-                _data.batteryPercent, _data.inputPower, _data.outputPower,
-                _data.minutesToFull, _data.minutesToEmpty);
+  Fixed::Deciwatts prevIn = _data.inputDeciwatts;
+  Fixed::Deciwatts prevOut = _data.outputDeciwatts;
+  Fixed::Permille prevSoc = _data.socPermille;
+
+  // One pass over the frame, straight from the notification buffer; a
+  // partial read leaves the fields it does not hold as they were
+  Fossibot::decode(Fossibot::STATUS_MAP, data, length, _data, firstReg);
+
+  // Let the poll scheduler speed up on swings and back off when stable
+  Fixed::Deciwatts dIn = abs(_data.inputDeciwatts - prevIn);
+  Fixed::Deciwatts dOut = abs(_data.outputDeciwatts - prevOut);
+  Fixed::Deciwatts band = Fixed::fromWatts(_powerThreshold);
+  bool stable = dIn < band && dOut < band &&
+                abs(_data.socPermille - prevSoc) <
+                    Fixed::fromPercent(_socThreshold);
+  _telemetry.onStatus(Fixed::watts(max(dIn, dOut)), stable, millis());
+  _shared.write(_data);
+
+  LOG_D("BLE", "SOC=%s%% IN=%ldW OUT=%ldW TTF=%dm TTE=%dm "
+        "(next poll %lums)",
+        Fixed::format(_data.socPermille, Fixed::PERMILLE_PER_PCT, 1).c_str(),
+        (long)Fixed::watts(_data.inputDeciwatts),
+        (long)Fixed::watts(_data.outputDeciwatts), _data.minutesToFull,
+        _data.minutesToEmpty, (unsigned long)_telemetry.getInterval());
 }
 
 void FossibotBLE::parseSettingsData(const uint8_t *data, size_t length) {
@@ -498,46 +1057,38 @@ void FossibotBLE::parseSettingsData(const uint8_t *data, size_t length) {
   if (length < 10)
     return;
 
-  // Helper to extract register value
-  auto getRegValue = [data, length](uint16_t regIndex) -> uint16_t {
-    uint16_t offset = 6 + (regIndex * 2);
-    if (offset + 1 >= length)
-      return 0;
-    return (data[offset] << 8) | data[offset + 1];
-  };
-
-  // Parse Fossibot settings registers
-  _data.lightMode = getRegValue(27);
-  _data.buzzerEnabled = (getRegValue(56) == 1);
-  _data.silentCharging = (getRegValue(57) == 1);
-  _data.screenTimeout = getRegValue(59);
-  _data.acStandby = getRegValue(60);
-  _data.dcStandby = getRegValue(61);
-  _data.usbStandby = getRegValue(62);
-  _data.scheduleCharge = getRegValue(63);
-  _data.dischargeLimit = getRegValue(66) / 10; // Convert from 0.1% to %
-  _data.chargeLimit = getRegValue(67) / 10;    // Convert from 0.1% to %
-  _data.sysStandby = getRegValue(68);
+  Fossibot::decode(Fossibot::SETTINGS_MAP, data, length, _data);
   _data.settingsReceived = true;
+  _shared.write(_data);
+
+  // Confirms queued writes (applied on the loop task in update())
+  _commands.onReadback(data, length);
 
-  Serial.printf("BLE: Settings received - Buzzer:%d Silent:%d Light:%d "
-                "Charge:%d%% Discharge:%d%%\n",
-                _data.buzzerEnabled, _data.silentCharging, _data.lightMode,
-                _data.chargeLimit, _data.dischargeLimit);
+  LOG_D("BLE", "Settings received - Buzzer:%d Silent:%d Light:%d "
+        "Charge:%d%% Discharge:%d%%",
+        _data.buzzerEnabled, _data.silentCharging, _data.lightMode,
+        _data.chargeLimit, _data.dischargeLimit);
 }
 
 // NimBLE callbacks
 void FossibotBLE::onConnect(NimBLEClient *client) {
-  Serial.println("BLE: Connected callback");
-  _connected = true;
-  _data.connected = true;
+  // Link is up, but not usable until the link task has subscribed
+  LOG_I("BLE", "Connected callback");
 }
 
 void FossibotBLE::onDisconnect(NimBLEClient *client) {
-  Serial.println("BLE: Disconnected callback");
+  // NimBLE leaves the HCI reason in the client's last error
+  int reason = client->getLastError();
+  _stats.onDisconnect(reason);
+  LOG_I("BLE", "Disconnected (%s, reason 0x%03X)",
+        LinkStats::dropName(LinkStats::dropKind(reason)), reason);
   _connected = false;
-  _data.connected = false;
   _service = nullptr;
   _writeChar = nullptr;
   _notifyChar = nullptr;
+
+  // A dropped link reconnects as soon as the device advertises again
+  if (_linkState == LinkState::READY)
+    setLinkState(LinkState::SCANNING);
+  Wake::signal(Wake::BLE);
 }
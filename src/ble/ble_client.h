@@ -8,12 +8,48 @@
 #ifndef BLE_CLIENT_H
 #define BLE_CLIENT_H
 
+#include "../utils/seqlock.h"
+#include "../utils/spsc_ring.h"
+#include "command_queue.h"
 #include "fossibot_protocol.h"
+#include "link_policy.h"
+#include "link_stats.h"
+#include "register_map.h"
+#include "telemetry_scheduler.h"
 #include <Arduino.h>
 #include <NimBLEDevice.h>
+#include <functional>
+
+/**
+ * Connection progress, advanced by the link task
+ */
+enum class LinkState : uint8_t {
+  IDLE,        // Not started (no MAC / not initialized)
+  SCANNING,    // Passive scan, waiting for the device to advertise
+  CONNECTING,  // Link layer connect in progress
+  DISCOVERING, // Service discovery + notify subscribe
+  READY,       // Connected and subscribed
+  BACKOFF      // Connect failed; waiting before scanning again
+};
+
+struct LinkStatus {
+  LinkState state;
+  uint8_t failures;   // Consecutive failed attempts
+  uint32_t retryInMs; // Time until next attempt (BACKOFF only)
+  bool advertising;   // Seen in the passive scan recently
+  int rssi;           // Last advertisement (or link) RSSI, dBm
+};
+
+using LinkCallback = std::function<void(const LinkStatus &status)>;
+
+// Passes a register write to the panel that holds the link
+using CommandRelay = std::function<bool(uint8_t reg, uint16_t value)>;
 
 class FossibotBLE : public NimBLEClientCallbacks {
 public:
+  // Sessions that can exist at once (see FleetManager)
+  static const int MAX_SESSIONS = 4;
+
   FossibotBLE();
   ~FossibotBLE();
 
@@ -28,7 +64,9 @@ public:
   void setTargetMAC(const String &mac);
 
   /**
-   * Start scanning for device
+   * Start a low-duty passive scan for the device. A connect is only
+   * attempted once it is seen advertising; the connect, discovery and
+   * subscribe steps run on a separate link task.
    */
   void startScan();
 
@@ -37,15 +75,59 @@ public:
    */
   void stopScan();
 
+  /**
+   * True if the device advertised within PRESENCE_TIMEOUT_MS
+   */
+  bool isAdvertising() const;
+
+  /**
+   * Signal strength in dBm (link RSSI when connected, else last
+   * advertisement), or 0 if never seen
+   */
+  int getRssi() const;
+
   /**
    * Update - call in main loop
    */
   void update();
 
   /**
-   * Check if connected to power bank
+   * Check if connected to power bank (or, relayed, hearing from the panel
+   * that is)
+   */
+  bool isConnected() const { return _connected || (_relay && replaying()); }
+
+  /**
+   * Take the unit's data from another panel instead of a link of our own
+   * (a PanelMesh peer): the session drops its link and stops scanning,
+   * readings come in through feedRelayed() and register writes go to
+   * relay. nullptr goes back to the own link.
+   */
+  void setRelay(CommandRelay relay);
+  bool isRelayed() const { return (bool)_relay; }
+
+  /**
+   * A reading passed on by the panel holding the link; it reads as
+   * connected for PRESENCE_TIMEOUT_MS. Loop task.
+   */
+  void feedRelayed(const Fossibot::PowerBankData &data);
+
+  /**
+   * A register write a relayed panel passed on, sent as the setter for
+   * that register sends it
+   * @return false for a register no setter writes
+   */
+  bool writeRelayed(uint8_t reg, uint16_t value);
+
+  /**
+   * Snapshot of connection progress (safe to call from the UI loop)
+   */
+  LinkStatus getLinkStatus() const;
+
+  /**
+   * Called from update() on the loop task whenever the link state changes
    */
-  bool isConnected() const { return _connected; }
+  void onLinkChange(LinkCallback callback) { _linkCallback = callback; }
 
   /**
    * Check if data changed significantly (for eInk refresh)
@@ -53,29 +135,77 @@ public:
   bool hasSignificantChange() const;
 
   /**
-   * Get current power bank data
+   * Get current power bank data (loop-task copy, refreshed in update())
    */
-  const Fossibot::PowerBankData &getData() const { return _data; }
+  const Fossibot::PowerBankData &getData() const { return _snapshot; }
+
+  /**
+   * Count of frames copied into getData(); changes only when a new status
+   * or settings frame has arrived
+   */
+  uint32_t getDataGeneration() const { return _snapshotGen; }
 
   /**
    * Mark data as refreshed (call after UI update)
    */
-  void markRefreshed() { _data.markRefreshed(); }
+  void markRefreshed() { _snapshot.markRefreshed(); }
+
+  /**
+   * Number of received frames dropped for a bad CRC
+   */
+  uint32_t getCrcErrorCount() const { return _stats.crcErrors; }
+
+  /**
+   * Connects, RSSI, drops and response latency since boot or the last
+   * resetLinkStats() (see LinkStats for which task writes what)
+   */
+  const LinkStats &getLinkStats() const { return _stats; }
+  void resetLinkStats() { _stats.reset(); }
+
+  /**
+   * Register groups the visible screen needs (TelemetryGroup bits).
+   * Unsubscribed groups are only polled at the idle interval.
+   */
+  void subscribeTelemetry(uint8_t groups) {
+    _telemetry.subscribe(groups, millis());
+  }
+
+  /**
+   * Current status poll interval (ms) chosen by the scheduler
+   */
+  uint32_t getTelemetryInterval() const { return _telemetry.getInterval(); }
+
+  /**
+   * Stretch the poll intervals by scale (power governor, 1 = normal)
+   */
+  void setTelemetryScale(uint8_t scale) { _telemetry.setScale(scale); }
+
+  /**
+   * True while register writes are queued or awaiting readback
+   */
+  bool hasPendingCommands() const { return _commands.pending(); }
 
   /**
    * Toggle USB output
    */
-  void toggleUSB();
+  void toggleUSB(CommandCallback done = nullptr);
 
   /**
    * Toggle DC output
    */
-  void toggleDC();
+  void toggleDC(CommandCallback done = nullptr);
 
   /**
    * Toggle AC output
    */
-  void toggleAC();
+  void toggleAC(CommandCallback done = nullptr);
+
+  /**
+   * Switch an output on or off (automation rules)
+   */
+  void setUSB(bool on, CommandCallback done = nullptr);
+  void setDC(bool on, CommandCallback done = nullptr);
+  void setAC(bool on, CommandCallback done = nullptr);
 
   // ============================================================
   // Fossibot Settings Commands
@@ -84,52 +214,52 @@ public:
   /**
    * Enable/disable button beep sound on Fossibot
    */
-  void setBuzzerEnabled(bool enabled);
+  void setBuzzerEnabled(bool enabled, CommandCallback done = nullptr);
 
   /**
    * Enable/disable silent (quiet) charging mode
    */
-  void setSilentCharging(bool enabled);
+  void setSilentCharging(bool enabled, CommandCallback done = nullptr);
 
   /**
    * Set LED light mode: 0=off, 1=on, 2=flash, 3=sos
    */
-  void setLightMode(int mode);
+  void setLightMode(int mode, CommandCallback done = nullptr);
 
   /**
    * Set discharge lower limit (0-30%)
    */
-  void setDischargeLimit(int percent);
+  void setDischargeLimit(int percent, CommandCallback done = nullptr);
 
   /**
    * Set charge upper limit / EPS (60-100%)
    */
-  void setChargeLimit(int percent);
+  void setChargeLimit(int percent, CommandCallback done = nullptr);
 
   /**
    * Set screen timeout in minutes (0=never)
    */
-  void setScreenTimeout(int minutes);
+  void setScreenTimeout(int minutes, CommandCallback done = nullptr);
 
   /**
    * Set system idle shutdown timer in minutes (0=never)
    */
-  void setSysStandby(int minutes);
+  void setSysStandby(int minutes, CommandCallback done = nullptr);
 
   /**
    * Set AC standby timeout in minutes (0=never)
    */
-  void setACStandby(int minutes);
+  void setACStandby(int minutes, CommandCallback done = nullptr);
 
   /**
    * Set DC standby timeout in minutes (0=never)
    */
-  void setDCStandby(int minutes);
+  void setDCStandby(int minutes, CommandCallback done = nullptr);
 
   /**
    * Set USB standby timeout in seconds (0=never)
    */
-  void setUSBStandby(int seconds);
+  void setUSBStandby(int seconds, CommandCallback done = nullptr);
 
   /**
    * Power off the Fossibot device
@@ -139,12 +269,62 @@ public:
   /**
    * Set schedule charge - sends minutes from now until charge starts
    */
-  void setScheduleCharge(int minutes);
+  void setScheduleCharge(int minutes, CommandCallback done = nullptr);
 
   // NimBLE callbacks
   void onConnect(NimBLEClient *client) override;
   void onDisconnect(NimBLEClient *client) override;
 
+  /**
+   * Route a scan result to every session (called by the shared scanner)
+   */
+  static void dispatchAdvertisement(NimBLEAdvertisedDevice *device);
+
+  /**
+   * Allow or forbid connecting (fleet time-slicing). Forbidding drops an
+   * open link; presence tracking continues.
+   */
+  void setConnectAllowed(bool allowed);
+  bool isConnectAllowed() const { return _connectAllowed; }
+
+  const String &getTargetMAC() const { return _targetMAC; }
+
+  // Last good address type and GATT handles of a device
+  struct LinkCache {
+    bool valid;
+    uint8_t addrType;
+    uint16_t writeHandle;
+    uint16_t notifyHandle;
+  };
+
+  /**
+   * Link cache in use for the target MAC (valid is false if none)
+   */
+  const LinkCache &getLinkCache() const { return _cache; }
+
+  /**
+   * Hand over a link cache kept outside NVS (RTC memory across deep
+   * sleep); a session targeting mac takes it instead of reading NVS
+   */
+  static void primeLinkCache(const String &mac, const LinkCache &cache);
+
+  /**
+   * Record the address type discovery saw a unit advertise with, so the
+   * first connect to it tries the right one (the GATT handles are learnt
+   * on that connect)
+   */
+  static void rememberAddressType(const String &mac, uint8_t addrType);
+
+  /**
+   * Feed a recorded frame through the receive path of the session in slot
+   * session, as if it had just arrived (FrameRecorder replay). Its data
+   * reads as connected for PRESENCE_TIMEOUT_MS after.
+   * @param firstReg Register the frame's data starts at (a partial read)
+   * @return false if there is no such session or it has a live link
+   */
+  static bool replayFrame(uint8_t session, uint8_t firstReg,
+                          const uint8_t *data, size_t length);
+
 private:
   // BLE components
   NimBLEClient *_client;
@@ -159,36 +339,139 @@ private:
   String _targetMAC;
   NimBLEAddress _targetAddress;
 
-  // Data
+  // Data: _data is decoded on the NimBLE host task and published through
+  // _shared; update() copies it into _snapshot only when it changed
   Fossibot::PowerBankData _data;
+  Seqlock<Fossibot::PowerBankData> _shared;
+  Fossibot::PowerBankData _snapshot;
+  uint32_t _snapshotGen;
+  void refreshSnapshot();
+
+  // Timing: adaptive status/settings polling
+  TelemetryScheduler _telemetry;
 
-  // Timing
-  unsigned long _lastPoll;
-  unsigned long _lastSettingsPoll;
-  static const unsigned long POLL_INTERVAL =
-      30000; // 30s - matching ESPHome config
-  static const unsigned long SETTINGS_POLL_INTERVAL = 60000; // 60s
+  // Register writes awaiting send / readback confirmation
+  CommandQueue _commands;
+
+  // Connection interval and TX power for the open link
+  LinkPolicy _policy;
+  unsigned long _lastRssiSample;
+  void applyLinkPolicy();
 
   // Change detection thresholds
   int _socThreshold;
   int _powerThreshold;
 
+  // Link quality and response counters
+  LinkStats _stats;
+
+  // A response longer than a notification (MTU - 3 bytes) arrives in
+  // pieces; they are gathered here on the host task until the CRC checks
+  static const uint16_t PREFERRED_MTU = 247; // 244-byte notifications
+  static const uint16_t DATA_LEN = 251;      // Link-layer payload (DLE)
+  static const uint32_t FRAGMENT_TIMEOUT_MS = 500;
+  uint8_t _rxFrame[Fossibot::POLL_FRAME_LEN];
+  size_t _rxLength; // 0 = nothing gathered
+  unsigned long _rxStarted;
+  void reassemble(const uint8_t *data, size_t length);
+
+  // Status polls read only the ranges covering the live and outlet
+  // registers (planned once), and the whole block every FULL_POLL_MS or
+  // while the frame recorder wants all of it. Each read is queued by the
+  // loop task so the host task knows which registers a response holds.
+  static const int MAX_POLL_RANGES = 4;
+  static const uint32_t FULL_POLL_MS = 300000;
+  static const uint32_t RESPONSE_TIMEOUT_MS = 1000; // Read taken as lost
+  struct PendingRead {
+    uint16_t opcode;
+    uint8_t first;
+    uint8_t count;
+    uint32_t ms;
+  };
+  Fossibot::RegRange _liveRanges[MAX_POLL_RANGES];
+  int _liveRangeCount;
+  unsigned long _lastFullPoll; // 0 = due
+  SpscRing<PendingRead, 8> _pending;
+  PendingRead _rxRead; // What the frame being gathered answers
+  size_t expectedLength() const {
+    return Fossibot::REG_DATA_OFFSET + _rxRead.count * 2 + 2;
+  }
+  bool sendRead(uint16_t opcode, uint8_t first, uint8_t count);
+  PendingRead takeRead(uint16_t opcode, unsigned long now);
+  void onResponse(unsigned long now); // A whole frame came in
+
+  // Slot in _instances (recorded with each frame)
+  uint8_t _session;
+  // millis() a replayed or relayed frame was last fed in, 0: none
+  unsigned long _replayedAt;
+  bool replaying() const {
+    return _replayedAt && millis() - _replayedAt < PRESENCE_TIMEOUT_MS;
+  }
+  CommandRelay _relay;
+
+  // Connection state machine (link task does the blocking NimBLE calls)
+  static const uint8_t MAX_BACKOFF_STEPS = 4; // 10s doubling to 160s
+  static const uint32_t LINK_TASK_STACK = 4096;
+  static const UBaseType_t LINK_TASK_PRIORITY = 2;
+  TaskHandle_t _linkTask;
+  volatile LinkState _linkState;
+  LinkState _reportedState;
+  volatile uint8_t _linkFailures;
+  unsigned long _lastLinkAttempt;
+  bool _readyHandled; // Initial poll issued for the current link
+  LinkCallback _linkCallback;
+
+  // Last good address type and GATT handles, persisted in NVS
+  LinkCache _cache;
+
+  // Passive presence scan: ~5% duty cycle
+  static const uint16_t SCAN_INTERVAL_MS = 1000;
+  static const uint16_t SCAN_WINDOW_MS = 50;
+  static const uint32_t PRESENCE_TIMEOUT_MS = 10000;
+  volatile unsigned long _lastSeen; // 0 = never seen
+  volatile int8_t _advRssi;
+  volatile int8_t _advAddrType; // -1 until seen
+
   // Internal methods
+  void kickConnect();
+  void runConnect();
+  void setLinkState(LinkState state);
+  uint32_t retryInterval() const;
+  static void linkTaskEntry(void *arg);
   bool connectToDevice();
+  void startPresenceScan();
+  void loadLinkCache();
+  void saveLinkCache(uint8_t addrType);
   void disconnect();
   bool discoverServices();
   void requestStatusData();
   void requestSettingsData();
-  void sendCommand(uint8_t reg, uint16_t value);
-  void parseStatusData(const uint8_t *data, size_t length);
+  void sendCommand(uint8_t reg, uint16_t value, CommandCallback done,
+                   bool expectAck = true);
+  bool writeCommand(uint8_t reg, uint16_t value);
+  bool writeCommands(uint8_t first, const uint16_t *values, int count);
+  uint16_t outputTarget(uint8_t reg, bool active) const;
+  void handleFrame(const uint8_t *data, size_t length, uint8_t firstReg = 0,
+                   bool replayed = false);
+  void parseStatusData(const uint8_t *data, size_t length, uint8_t firstReg);
   void parseSettingsData(const uint8_t *data, size_t length);
 
   // Notification callback
   static void notifyCallback(NimBLERemoteCharacteristic *characteristic,
                              uint8_t *data, size_t length, bool isNotify);
 
-  // Static instance for callback
-  static FossibotBLE *_instance;
+  // Registered sessions for callback routing
+  static FossibotBLE *_instances[MAX_SESSIONS];
+  static FossibotBLE *sessionFor(NimBLEClient *client);
+  void onAdvertisement(NimBLEAdvertisedDevice *device);
+
+  // Set while any session's link task is connecting (one at a time)
+  static volatile bool _connectBusy;
+  bool _connectAllowed;
+
+  // Cache handed over by primeLinkCache()
+  static String _primedMAC;
+  static LinkCache _primedCache;
 };
 
 #endif // BLE_CLIENT_H
@@ -0,0 +1,313 @@
+/**
+ * BLE Command Queue Implementation
+ */
+
+#include "command_queue.h"
+#include "register_map.h"
+
+CommandQueue::CommandQueue()
+    : _count(0), _batching(Batching::UNKNOWN), _batchAnswer(ANSWER_NONE),
+      _readbackCount(0), _readbackSeq(0), _appliedSeq(0),
+      _mux(portMUX_INITIALIZER_UNLOCKED) {}
+
+bool CommandQueue::push(uint8_t reg, uint16_t value, CommandCallback done,
+                        bool expectAck) {
+  for (int i = 0; i < _count; i++) {
+    Command &c = _cmds[i];
+    if (c.reg != reg)
+      continue;
+
+    // Coalesce: the newest value wins and is (re)sent from scratch
+    CommandCallback old = c.done;
+    uint16_t oldValue = c.value;
+    c.value = value;
+    c.attempts = 0;
+    c.expectAck = expectAck;
+    c.inFlight = false;
+    c.batched = false;
+    c.done = done;
+    if (old)
+      old(reg, oldValue, CommandResult::SUPERSEDED);
+    return true;
+  }
+
+  if (_count >= MAX_COMMANDS) {
+    Serial.printf("BLE: Command queue full, reg=%d dropped\n", reg);
+    if (done)
+      done(reg, value, CommandResult::FAILED);
+    return false;
+  }
+
+  Command &c = _cmds[_count++];
+  c.reg = reg;
+  c.value = value;
+  c.attempts = 0;
+  c.expectAck = expectAck;
+  c.inFlight = false;
+  c.batched = false;
+  c.sentAt = 0;
+  c.done = done;
+  return true;
+}
+
+void CommandQueue::onReadback(const uint8_t *data, size_t length) {
+  portENTER_CRITICAL(&_mux);
+  int n = 0;
+  for (; n < READBACK_REGS; n++) {
+    size_t pos = Fossibot::REG_DATA_OFFSET + n * 2;
+    if (pos + 1 >= length)
+      break;
+    _readback[n] = (data[pos] << 8) | data[pos + 1];
+  }
+  _readbackCount = n;
+  _readbackSeq++;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void CommandQueue::onBatchAnswer(bool accepted) {
+  portENTER_CRITICAL(&_mux);
+  _batchAnswer = accepted ? ANSWER_ACCEPTED : ANSWER_REJECTED;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void CommandQueue::resetBatching() {
+  _batching = Batching::UNKNOWN;
+  portENTER_CRITICAL(&_mux);
+  _batchAnswer = ANSWER_NONE;
+  portEXIT_CRITICAL(&_mux);
+}
+
+// The unsent command for reg that may join a batch, or -1
+int CommandQueue::unsentAt(uint8_t reg, const bool *finished) const {
+  for (int i = 0; i < _count; i++) {
+    const Command &c = _cmds[i];
+    if (c.reg == reg && !finished[i] && !c.inFlight &&
+        (c.expectAck || _batching == Batching::SUPPORTED))
+      return i;
+  }
+  return -1;
+}
+
+// The run of unsent commands to adjacent registers around index, lowest
+// register first, as indices into run
+// @return Length of the run (1: index alone)
+int CommandQueue::batchFrom(int index, const bool *finished,
+                            int *run) const {
+  run[0] = index;
+  if (!_batchWriter || _batching == Batching::UNSUPPORTED ||
+      unsentAt(_cmds[index].reg, finished) != index)
+    return 1;
+  int first = index;
+  for (int i = 1; i < MAX_BATCH && _cmds[first].reg > 0; i++) {
+    int below = unsentAt(_cmds[first].reg - 1, finished);
+    if (below < 0)
+      break;
+    first = below;
+  }
+  int n = 0;
+  for (int i = first; i >= 0 && n < MAX_BATCH;) {
+    run[n++] = i;
+    if (_cmds[i].reg == UINT8_MAX)
+      break;
+    i = unsentAt(_cmds[i].reg + 1, finished);
+  }
+  return n;
+}
+
+// The unit did not take a batch: its writes go out again singly, with the
+// attempt it cost given back
+void CommandQueue::unbatch() {
+  for (int i = 0; i < _count; i++) {
+    Command &c = _cmds[i];
+    if (!c.inFlight || !c.batched)
+      continue;
+    c.inFlight = false;
+    c.batched = false;
+    if (c.attempts > 0)
+      c.attempts--;
+  }
+}
+
+int CommandQueue::inFlightCount() const {
+  int n = 0;
+  for (int i = 0; i < _count; i++) {
+    if (_cmds[i].inFlight)
+      n++;
+  }
+  return n;
+}
+
+void CommandQueue::service(uint32_t now) {
+  bool finished[MAX_COMMANDS] = {false};
+  CommandResult results[MAX_COMMANDS];
+
+  // 0. What the unit made of a 0x10 frame, if it answered one
+  portENTER_CRITICAL(&_mux);
+  uint8_t answer = _batchAnswer;
+  _batchAnswer = ANSWER_NONE;
+  portEXIT_CRITICAL(&_mux);
+  if (answer == ANSWER_ACCEPTED && _batching == Batching::UNKNOWN) {
+    _batching = Batching::SUPPORTED;
+    Serial.println("BLE: Unit takes multi-register writes");
+  } else if (answer == ANSWER_REJECTED &&
+             _batching != Batching::UNSUPPORTED) {
+    _batching = Batching::UNSUPPORTED;
+    Serial.println("BLE: Multi-register write rejected, writing singly");
+    unbatch();
+  }
+
+  // 1. Confirm in-flight writes against the latest readback
+  if (_readbackSeq != _appliedSeq) {
+    uint16_t regs[READBACK_REGS];
+    int n;
+    portENTER_CRITICAL(&_mux);
+    memcpy(regs, _readback, sizeof(regs));
+    n = _readbackCount;
+    _appliedSeq = _readbackSeq;
+    portEXIT_CRITICAL(&_mux);
+
+    for (int i = 0; i < _count; i++) {
+      const Command &c = _cmds[i];
+      if (c.inFlight && c.expectAck && c.reg < n && regs[c.reg] == c.value) {
+        finished[i] = true;
+        results[i] = CommandResult::CONFIRMED;
+        if (c.batched && _batching == Batching::UNKNOWN) {
+          _batching = Batching::SUPPORTED;
+          Serial.println("BLE: Unit takes multi-register writes");
+        }
+      }
+    }
+  }
+
+  // 2. Resend writes the device has not reflected in time
+  for (int i = 0; i < _count; i++) {
+    Command &c = _cmds[i];
+    if (finished[i] || !c.inFlight || now - c.sentAt < ACK_TIMEOUT_MS)
+      continue;
+    if (c.batched && _batching == Batching::UNKNOWN) {
+      // The first batch went unanswered: the unit may not know 0x10
+      _batching = Batching::UNSUPPORTED;
+      Serial.println("BLE: No readback for multi-register write, "
+                     "writing singly");
+      unbatch();
+      continue;
+    }
+    if (c.attempts >= MAX_ATTEMPTS) {
+      finished[i] = true;
+      results[i] = CommandResult::FAILED;
+    } else {
+      Serial.printf("BLE: No readback for reg=%d, resending\n", c.reg);
+      c.inFlight = false;
+    }
+  }
+
+  // 3. Send one queued write (or one run of adjacent registers) per call
+  // so the loop never stalls on a burst
+  if (_writer && inFlightCount() < MAX_IN_FLIGHT) {
+    for (int i = 0; i < _count; i++) {
+      Command &c = _cmds[i];
+      if (finished[i] || c.inFlight)
+        continue;
+
+      int run[MAX_BATCH];
+      int n = batchFrom(i, finished, run);
+      if (n > 1) {
+        uint16_t values[MAX_BATCH];
+        for (int k = 0; k < n; k++) {
+          values[k] = _cmds[run[k]].value;
+          _cmds[run[k]].attempts++;
+        }
+        bool sent = _batchWriter(_cmds[run[0]].reg, values, n);
+        for (int k = 0; k < n; k++) {
+          int j = run[k];
+          Command &b = _cmds[j];
+          if (sent) {
+            b.inFlight = true;
+            b.batched = true;
+            b.sentAt = now;
+            if (!b.expectAck) {
+              finished[j] = true;
+              results[j] = CommandResult::SENT;
+            }
+          } else if (b.attempts >= MAX_ATTEMPTS) {
+            finished[j] = true;
+            results[j] = CommandResult::FAILED;
+          }
+        }
+        break;
+      }
+
+      c.attempts++;
+      if (_writer(c.reg, c.value)) {
+        c.inFlight = true;
+        c.batched = false;
+        c.sentAt = now;
+        if (!c.expectAck) {
+          finished[i] = true;
+          results[i] = CommandResult::SENT;
+        }
+      } else if (c.attempts >= MAX_ATTEMPTS) {
+        finished[i] = true;
+        results[i] = CommandResult::FAILED;
+      }
+      break;
+    }
+  }
+
+  // 4. Drop finished commands, then run their callbacks (which may push)
+  struct Done {
+    CommandCallback cb;
+    uint8_t reg;
+    uint16_t value;
+    CommandResult result;
+  };
+  Done done[MAX_COMMANDS];
+  int doneCount = 0;
+  int kept = 0;
+  for (int i = 0; i < _count; i++) {
+    if (!finished[i]) {
+      if (kept != i)
+        _cmds[kept] = _cmds[i];
+      kept++;
+      continue;
+    }
+    if (results[i] == CommandResult::FAILED)
+      Serial.printf("BLE: Command reg=%d value=%d failed\n", _cmds[i].reg,
+                    _cmds[i].value);
+    done[doneCount++] = {_cmds[i].done, _cmds[i].reg, _cmds[i].value,
+                         results[i]};
+  }
+  for (int i = kept; i < _count; i++)
+    _cmds[i].done = nullptr;
+  _count = kept;
+
+  for (int i = 0; i < doneCount; i++) {
+    if (done[i].cb)
+      done[i].cb(done[i].reg, done[i].value, done[i].result);
+  }
+}
+
+void CommandQueue::clear(CommandResult result) {
+  int n = _count;
+  Command cmds[MAX_COMMANDS];
+  for (int i = 0; i < n; i++) {
+    cmds[i] = _cmds[i];
+    _cmds[i].done = nullptr;
+  }
+  _count = 0;
+
+  for (int i = 0; i < n; i++) {
+    if (cmds[i].done)
+      cmds[i].done(cmds[i].reg, cmds[i].value, result);
+  }
+}
+
+bool CommandQueue::pendingValue(uint8_t reg, uint16_t &value) const {
+  for (int i = 0; i < _count; i++) {
+    if (_cmds[i].reg == reg) {
+      value = _cmds[i].value;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,137 @@
+/**
+ * BLE Command Queue
+ *
+ * Register writes from the UI are queued instead of written from touch
+ * handlers. Repeated writes to the same register coalesce into one, up to
+ * MAX_IN_FLIGHT writes are outstanding at a time, and each is confirmed by
+ * comparing it against the next 0x1103 (holding register) readback.
+ * Unconfirmed writes are resent after ACK_TIMEOUT_MS and fail after
+ * MAX_ATTEMPTS. Completion callbacks always run from service(), on the
+ * loop task, never from the NimBLE notification context.
+ *
+ * Queued writes to adjacent registers (a charge profile's limits, the
+ * standby timers) go out together as one Modbus 0x10 Write Multiple
+ * Registers frame when the unit takes those. Whether it does is learnt
+ * per connection: the first batch is confirmed by its echo or readback,
+ * or, rejected or unanswered, its writes are resent singly (their attempts
+ * not counted) and batching stays off until the next connection. Until a
+ * batch has been confirmed, writes with no readback are never batched.
+ */
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <functional>
+
+enum class CommandResult {
+  CONFIRMED,  // Readback shows the written value
+  SENT,       // Written; command expects no readback (e.g. power off)
+  SUPERSEDED, // Replaced by a newer write to the same register
+  FAILED      // Not confirmed after all attempts, or link lost
+};
+
+using CommandCallback =
+    std::function<void(uint8_t reg, uint16_t value, CommandResult result)>;
+
+class CommandQueue {
+public:
+  static const int MAX_COMMANDS = 16;
+  static const int MAX_IN_FLIGHT = 4;
+  static const int MAX_ATTEMPTS = 3;
+  static const uint32_t ACK_TIMEOUT_MS = 4000;
+  static const int READBACK_REGS = 80; // 0x1103 reads registers 0-79
+  static const int MAX_BATCH = 5; // A 0x10 frame of 5 fits a 23-byte MTU
+
+  using Writer = std::function<bool(uint8_t reg, uint16_t value)>;
+  using BatchWriter =
+      std::function<bool(uint8_t first, const uint16_t *values, int count)>;
+
+  CommandQueue();
+
+  void setWriter(Writer writer) { _writer = writer; }
+  void setBatchWriter(BatchWriter writer) { _batchWriter = writer; }
+
+  /**
+   * Queue a register write. A queued or in-flight write to the same
+   * register is replaced (its callback gets SUPERSEDED).
+   * @param expectAck false for writes with no readback to wait for
+   * @return false if the queue is full
+   */
+  bool push(uint8_t reg, uint16_t value, CommandCallback done = nullptr,
+            bool expectAck = true);
+
+  /**
+   * Send queued writes, apply readbacks, handle timeouts and run
+   * completion callbacks. Call from the main loop.
+   */
+  void service(uint32_t now);
+
+  /**
+   * Record a holding-register readback (safe from the notify callback)
+   */
+  void onReadback(const uint8_t *data, size_t length);
+
+  /**
+   * Record the unit's answer to a 0x10 frame: its echo, or an exception
+   * (safe from the notify callback)
+   */
+  void onBatchAnswer(bool accepted);
+
+  /**
+   * A new connection, maybe to another unit: whether 0x10 is taken is
+   * learnt again
+   */
+  void resetBatching();
+
+  /**
+   * Fail every queued command (e.g. after a disconnect)
+   */
+  void clear(CommandResult result = CommandResult::FAILED);
+
+  bool pending() const { return _count > 0; }
+  bool batching() const { return _batching == Batching::SUPPORTED; }
+  int size() const { return _count; }
+
+  /**
+   * Latest value queued for a register, if any
+   */
+  bool pendingValue(uint8_t reg, uint16_t &value) const;
+
+private:
+  struct Command {
+    uint8_t reg;
+    uint16_t value;
+    uint8_t attempts;
+    bool expectAck;
+    bool inFlight;
+    bool batched; // In flight as part of a 0x10 frame
+    uint32_t sentAt;
+    CommandCallback done;
+  };
+
+  enum class Batching : uint8_t { UNKNOWN, SUPPORTED, UNSUPPORTED };
+  enum : uint8_t { ANSWER_NONE, ANSWER_ACCEPTED, ANSWER_REJECTED };
+
+  Command _cmds[MAX_COMMANDS];
+  int _count;
+  Writer _writer;
+  BatchWriter _batchWriter;
+  Batching _batching;
+  uint8_t _batchAnswer; // ANSWER_*, set under _mux by the notify callback
+
+  // Latest readback, copied under _mux by the notify callback
+  uint16_t _readback[READBACK_REGS];
+  uint8_t _readbackCount;
+  volatile uint32_t _readbackSeq;
+  uint32_t _appliedSeq;
+  portMUX_TYPE _mux;
+
+  int inFlightCount() const;
+  void complete(int index, CommandResult result);
+  int unsentAt(uint8_t reg, const bool *finished) const;
+  int batchFrom(int index, const bool *finished, int *run) const;
+  void unbatch();
+};
+
+#endif // COMMAND_QUEUE_H
@@ -0,0 +1,216 @@
+/**
+ * Power Bank Fleet Manager Implementation
+ */
+
+#include "fleet_manager.h"
+
+FleetManager::FleetManager()
+    : _count(0), _sliceStart(1), _sliceAt(0), _lastSample(0),
+      _flushMinutes(FLUSH_INTERVAL_MINS) {
+  for (int i = 0; i < MAX_UNITS; i++) {
+    _units[i] = nullptr;
+    _history[i] = nullptr;
+  }
+}
+
+FleetManager::~FleetManager() {
+  for (int i = 0; i < _count; i++) {
+    delete _units[i];
+    delete _history[i];
+  }
+}
+
+bool FleetManager::addUnit(const String &mac) {
+  if (mac.length() == 0)
+    return false;
+  if (_count >= MAX_UNITS) {
+    Serial.printf("BLE: Fleet full, %s ignored\n", mac.c_str());
+    return false;
+  }
+
+  FossibotBLE *unit = new FossibotBLE();
+  unit->setTargetMAC(mac);
+  _units[_count++] = unit;
+  return true;
+}
+
+FossibotBLE *FleetManager::unit(int index) const {
+  if (index < 0 || index >= _count)
+    return nullptr;
+  return _units[index];
+}
+
+int FleetManager::connectedCount() const {
+  int n = 0;
+  for (int i = 0; i < _count; i++) {
+    if (_units[i]->isConnected())
+      n++;
+  }
+  return n;
+}
+
+uint32_t FleetManager::getDataGeneration() const {
+  uint32_t gen = 0;
+  for (int i = 0; i < _count; i++)
+    gen += _units[i]->getDataGeneration();
+  return gen;
+}
+
+int FleetManager::rotatingSlots() const {
+  // Unit 0 keeps its slot; the rest share what is left
+  int slots = MAX_CONNECTIONS - 1;
+  return slots > 0 ? slots : 1;
+}
+
+void FleetManager::begin() {
+  for (int i = 0; i < _count; i++) {
+    Serial.printf("BLE: Fleet unit %d: %s\n", i + 1,
+                  _units[i]->getTargetMAC().c_str());
+    _units[i]->init();
+  }
+
+  applySlice();
+  _sliceAt = millis();
+  _lastSample = millis();
+
+  for (int i = 0; i < _count; i++)
+    _units[i]->startScan(); // Returns at once; connects in the background
+}
+
+void FleetManager::loadHistories() {
+  for (int i = 0; _count > 1 && i < _count; i++) {
+    char dir[24];
+    snprintf(dir, sizeof(dir), "/history_unit%d", i + 1);
+    PowerHistory *history = new PowerHistory();
+    history->setDirectory(dir);
+    history->setFlushInterval(_flushMinutes);
+    history->init();
+    _history[i] = history; // Published only once loaded
+  }
+}
+
+void FleetManager::setTelemetryScale(uint8_t scale) {
+  for (int i = 0; i < _count; i++)
+    _units[i]->setTelemetryScale(scale);
+}
+
+void FleetManager::setFlushInterval(uint8_t minutes) {
+  _flushMinutes = minutes;
+  for (int i = 0; i < _count; i++) {
+    if (_history[i])
+      _history[i]->setFlushInterval(minutes);
+  }
+}
+
+void FleetManager::applySlice() {
+  if (_count <= MAX_CONNECTIONS)
+    return; // Everyone fits, no slicing
+
+  int others = _count - 1;
+  int slots = rotatingSlots();
+  for (int i = 1; i < _count; i++) {
+    // Position of unit i within the current window (wrapping)
+    int pos = (i - _sliceStart + others) % others;
+    _units[i]->setConnectAllowed(pos < slots);
+  }
+}
+
+void FleetManager::update() {
+  for (int i = 0; i < _count; i++)
+    _units[i]->update();
+
+  if (_count > MAX_CONNECTIONS && millis() - _sliceAt >= SLICE_MS) {
+    _sliceAt = millis();
+    int others = _count - 1;
+    _sliceStart = 1 + (_sliceStart - 1 + rotatingSlots()) % others;
+    applySlice();
+  }
+
+  // Each unit's older days are read once its history is published
+  for (int i = 0; i < _count; i++) {
+    if (_history[i])
+      _history[i]->loadPastDays();
+  }
+
+  if (_count > 1 && millis() - _lastSample >= SAMPLE_MS) {
+    _lastSample = millis();
+    recordHistory();
+  }
+}
+
+void FleetManager::compactHistories() {
+  for (int i = 0; i < _count; i++) {
+    if (_history[i])
+      _history[i]->compactArchive();
+  }
+}
+
+bool FleetManager::flushHistories() {
+  bool ok = true;
+  for (int i = 0; i < _count; i++) {
+    if (_history[i] && !_history[i]->flushToSD())
+      ok = false;
+  }
+  return ok;
+}
+
+bool FleetManager::hasPendingCommands() const {
+  for (int i = 0; i < _count; i++) {
+    if (_units[i]->isConnected() && _units[i]->hasPendingCommands())
+      return true;
+  }
+  return false;
+}
+
+void FleetManager::recordHistory() {
+  for (int i = 0; i < _count; i++) {
+    if (!_history[i] || !_units[i]->isConnected())
+      continue;
+    const Fossibot::PowerBankData &d = _units[i]->getData();
+    _history[i]->addSampleAt(PowerHistory::sampleOf(time(nullptr), d));
+    if (_history[i]->shouldFlush())
+      _history[i]->flushToSD();
+  }
+}
+
+bool FleetManager::aggregate(Fossibot::PowerBankData &out) const {
+  if (_count == 0)
+    return false;
+
+  out = _units[0]->getData();
+  out.connected = false;
+  out.socPermille = 0;
+  out.batteryCentivolts = 0;
+  out.inputDeciwatts = 0;
+  out.outputDeciwatts = 0;
+  out.acInputDeciwatts = 0;
+  out.dcInputDeciwatts = 0;
+  out.minutesToFull = -1;
+  out.minutesToEmpty = -1;
+
+  int online = 0;
+  for (int i = 0; i < _count; i++) {
+    if (!_units[i]->isConnected())
+      continue;
+    const Fossibot::PowerBankData &d = _units[i]->getData();
+    online++;
+    out.socPermille += d.socPermille;
+    out.batteryCentivolts += d.batteryCentivolts;
+    out.inputDeciwatts += d.inputDeciwatts;
+    out.outputDeciwatts += d.outputDeciwatts;
+    out.acInputDeciwatts += d.acInputDeciwatts;
+    out.dcInputDeciwatts += d.dcInputDeciwatts;
+    if (d.minutesToFull > out.minutesToFull)
+      out.minutesToFull = d.minutesToFull;
+    if (d.minutesToEmpty >= 0 &&
+        (out.minutesToEmpty < 0 || d.minutesToEmpty < out.minutesToEmpty))
+      out.minutesToEmpty = d.minutesToEmpty;
+  }
+
+  if (online == 0)
+    return false;
+  out.connected = true;
+  out.socPermille = Fixed::divRound(out.socPermille, online);
+  out.batteryCentivolts = Fixed::divRound(out.batteryCentivolts, online);
+  return true;
+}
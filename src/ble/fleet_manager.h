@@ -0,0 +1,111 @@
+/**
+ * Power Bank Fleet Manager
+ *
+ * Owns one FossibotBLE session per configured power bank. NimBLE can hold
+ * only MAX_CONNECTIONS links, so with more units than that the primary unit
+ * (index 0, which the home screen controls) stays connected and the other
+ * slots rotate through the remaining units every SLICE_MS. Connects are
+ * serialized by FossibotBLE, so a unit that keeps failing backs off on its
+ * own without holding up the others or the loop.
+ */
+
+#ifndef FLEET_MANAGER_H
+#define FLEET_MANAGER_H
+
+#include "../power_history.h"
+#include "ble_client.h"
+
+class FleetManager {
+public:
+  static const int MAX_UNITS = FossibotBLE::MAX_SESSIONS;
+  // One controller link stays free for the history export service
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+  static const int MAX_CONNECTIONS = CONFIG_BT_NIMBLE_MAX_CONNECTIONS - 1;
+#else
+  static const int MAX_CONNECTIONS = 2;
+#endif
+  static const uint32_t SLICE_MS = 45000; // Time-sliced connection window
+  static const uint32_t SAMPLE_MS = 60000; // Per-unit history interval
+
+  FleetManager();
+  ~FleetManager();
+
+  /**
+   * Add a power bank by MAC address (before begin())
+   * @return false if the fleet is full or the MAC is empty
+   */
+  bool addUnit(const String &mac);
+
+  /**
+   * Start every session scanning
+   */
+  void begin();
+
+  /**
+   * Load per-unit history for fleets (card reads: may run on a boot task;
+   * units record once their history is in place)
+   */
+  void loadHistories();
+
+  /**
+   * Service sessions, rotate time slices and record per-unit history.
+   * Call from the main loop.
+   */
+  void update();
+
+  /**
+   * Fold each unit's day files past the 7-day ring into monthly archives
+   * (see PowerHistory::compactArchive)
+   */
+  void compactHistories();
+
+  /**
+   * Write every unit's unsaved history samples (card writes, before sleep)
+   * @return false if any write failed
+   */
+  bool flushHistories();
+
+  /**
+   * True while a connected unit has commands waiting for their readback
+   * (a unit without a link cannot send them)
+   */
+  bool hasPendingCommands() const;
+
+  /**
+   * Power governor operating point for every unit: poll interval scale
+   * and per-unit history flush interval
+   */
+  void setTelemetryScale(uint8_t scale);
+  void setFlushInterval(uint8_t minutes);
+
+  int count() const { return _count; }
+  FossibotBLE *unit(int index) const;
+  int connectedCount() const;
+
+  /**
+   * Changes whenever any unit has received a new frame
+   */
+  uint32_t getDataGeneration() const;
+
+  /**
+   * Fleet totals: summed power, average charge, slowest time to full and
+   * soonest time to empty. Outlet states and settings follow unit 0.
+   * @return false if no unit is connected
+   */
+  bool aggregate(Fossibot::PowerBankData &out) const;
+
+private:
+  FossibotBLE *_units[MAX_UNITS];
+  PowerHistory *volatile _history[MAX_UNITS]; // Only for fleets of 2+
+  int _count;
+  int _sliceStart; // First rotating unit with a connection slot
+  unsigned long _sliceAt;
+  unsigned long _lastSample;
+  uint8_t _flushMinutes;
+
+  int rotatingSlots() const;
+  void applySlice();
+  void recordHistory();
+};
+
+#endif // FLEET_MANAGER_H
@@ -0,0 +1,180 @@
+/**
+ * Fossibot Discovery Implementation
+ */
+
+#include "fossibot_discovery.h"
+#include "../utils/log.h"
+#include "../utils/wake.h"
+#include "ble_client.h"
+#include "fossibot_protocol.h"
+#include <NimBLEDevice.h>
+
+static const uint32_t RESTART_MS = 1000; // Retry a scan a connect stopped
+
+namespace {
+
+// Results to the discovery list, and on to the sessions for presence
+class DiscoveryCallbacks : public NimBLEAdvertisedDeviceCallbacks {
+public:
+  void onResult(NimBLEAdvertisedDevice *device) override {
+    if (discovery)
+      discovery->onResult(device);
+    FossibotBLE::dispatchAdvertisement(device);
+  }
+};
+DiscoveryCallbacks discoveryCallbacks;
+
+} // namespace
+
+FossibotDiscovery::FossibotDiscovery()
+    : _count(0), _generation(0), _mux(portMUX_INITIALIZER_UNLOCKED),
+      _running(false), _startedMs(0), _lastRestart(0) {
+  memset(_slots, -1, sizeof(_slots));
+}
+
+bool FossibotDiscovery::start() {
+  if (!NimBLEDevice::getInitialized()) {
+    NimBLEDevice::init("M5PaperS3");
+    NimBLEDevice::setSecurityAuth(false, false, false);
+  }
+
+  portENTER_CRITICAL(&_mux);
+  _count = 0;
+  memset(_slots, -1, sizeof(_slots));
+  _generation++;
+  portEXIT_CRITICAL(&_mux);
+
+  _startedMs = millis();
+  _running = startScan(SCAN_MS);
+  if (_running)
+    LOG_I("Discover", "Scanning for power banks for %lu s",
+          (unsigned long)(SCAN_MS / 1000));
+  else
+    LOG_W("Discover", "Scan did not start");
+  return _running;
+}
+
+bool FossibotDiscovery::startScan(uint32_t ms) {
+  NimBLEScan *scan = NimBLEDevice::getScan();
+  if (scan->isScanning())
+    scan->stop(); // A session's passive scan: ours passes results on
+  _lastRestart = millis();
+
+  // Duplicates wanted, for live RSSI; the hash set keeps one per unit
+  scan->setAdvertisedDeviceCallbacks(&discoveryCallbacks, true);
+  scan->setActiveScan(true); // Names come in the scan response
+  scan->setInterval(100);
+  scan->setWindow(99);
+  scan->setMaxResults(0);
+  return scan->start((ms + 999) / 1000, nullptr, false);
+}
+
+void FossibotDiscovery::stop() {
+  if (!_running)
+    return;
+  _running = false;
+  NimBLEScan *scan = NimBLEDevice::getScan();
+  if (scan->isScanning())
+    scan->stop();
+  LOG_I("Discover", "Scan done, %d found", _count);
+}
+
+uint32_t FossibotDiscovery::msLeft() const {
+  if (!_running)
+    return 0;
+  uint32_t elapsed = millis() - _startedMs;
+  return elapsed >= SCAN_MS ? 0 : SCAN_MS - elapsed;
+}
+
+uint32_t FossibotDiscovery::msUntilDue() const {
+  if (!_running)
+    return UINT32_MAX;
+  uint32_t left = msLeft();
+  return left < RESTART_MS ? left : RESTART_MS;
+}
+
+void FossibotDiscovery::update() {
+  if (!_running)
+    return;
+  uint32_t left = msLeft();
+  if (left == 0) {
+    stop();
+    _generation++; // The screen shows the scan has ended
+    return;
+  }
+
+  // A session stops the scanner to connect; carry on once it is free
+  if (!NimBLEDevice::getScan()->isScanning() &&
+      millis() - _lastRestart >= RESTART_MS)
+    startScan(left);
+}
+
+void FossibotDiscovery::onResult(NimBLEAdvertisedDevice *device) {
+  static const NimBLEUUID service(Fossibot::SERVICE_UUID);
+  if (!device->isAdvertisingService(service))
+    return;
+
+  // Strings built before the lock: nothing allocates inside it
+  NimBLEAddress address = device->getAddress();
+  const uint8_t *addr = address.getNative();
+  std::string mac = address.toString();
+  for (char &c : mac) // As the settings file writes it
+    c = toupper(c);
+  std::string name = device->haveName() ? device->getName() : "";
+  int rssi = device->getRSSI();
+  uint32_t h = 2166136261u; // FNV-1a
+  for (int i = 0; i < 6; i++)
+    h = (h ^ addr[i]) * 16777619u;
+
+  bool changed = false;
+  portENTER_CRITICAL(&_mux);
+  int slot = h & (SLOTS - 1);
+  while (_slots[slot] >= 0 && memcmp(_addr[_slots[slot]], addr, 6) != 0)
+    slot = (slot + 1) & (SLOTS - 1);
+  int index = _slots[slot];
+  if (index < 0 && _count < MAX_RESULTS) {
+    index = _count++;
+    _slots[slot] = index;
+    memcpy(_addr[index], addr, 6);
+    Result &r = _results[index];
+    strlcpy(r.mac, mac.c_str(), sizeof(r.mac));
+    r.addrType = address.getType();
+    r.rssi = rssi;
+    r.name[0] = '\0';
+    changed = true;
+  }
+  if (index >= 0) {
+    Result &r = _results[index];
+    if (abs(rssi - r.rssi) >= RSSI_STEP) {
+      r.rssi = rssi;
+      changed = true;
+    }
+    if (!r.name[0] && !name.empty()) {
+      strlcpy(r.name, name.c_str(), sizeof(r.name));
+      changed = true;
+    }
+  }
+  if (changed)
+    _generation++;
+  portEXIT_CRITICAL(&_mux);
+
+  if (changed)
+    Wake::signal(Wake::BLE);
+}
+
+int FossibotDiscovery::results(Result *out, int max) const {
+  portENTER_CRITICAL(&_mux);
+  int n = _count < max ? _count : max;
+  memcpy(out, _results, n * sizeof(Result));
+  portEXIT_CRITICAL(&_mux);
+
+  // A handful of entries: insertion sort, strongest first
+  for (int i = 1; i < n; i++) {
+    Result r = out[i];
+    int j = i;
+    for (; j > 0 && out[j - 1].rssi < r.rssi; j--)
+      out[j] = out[j - 1];
+    out[j] = r;
+  }
+  return n;
+}
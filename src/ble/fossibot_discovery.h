@@ -0,0 +1,99 @@
+/**
+ * Fossibot Discovery
+ *
+ * Finds power banks in range for the setup screen, so fossibot_mac need
+ * not be typed into the settings file. A time-boxed active scan keeps the
+ * advertisements that carry the Fossibot service (Fossibot::SERVICE_UUID),
+ * one entry per address: the results sit in a small hash set keyed on the
+ * address, and a repeat only moves that entry's RSSI and name.
+ *
+ * The scanner is the one the sessions share. While discovery runs it has
+ * the scanner's callback and passes every advertisement on to the
+ * sessions too, so their presence and RSSI stay current; the first
+ * session update() after the scan ends starts their own scan again.
+ *
+ * Results are written on the NimBLE host task and copied out under a lock
+ * on the loop task; generation() moves when the list visibly changes, for
+ * a partial repaint.
+ */
+
+#ifndef FOSSIBOT_DISCOVERY_H
+#define FOSSIBOT_DISCOVERY_H
+
+#include <Arduino.h>
+
+class NimBLEAdvertisedDevice;
+
+class FossibotDiscovery {
+public:
+  static const uint32_t SCAN_MS = 20000;
+  static const int MAX_RESULTS = 8;
+  static const int RSSI_STEP = 4; // dB an entry moves before it repaints
+
+  struct Result {
+    char mac[18];     // "AA:BB:CC:DD:EE:FF"
+    uint8_t addrType; // BLE_ADDR_PUBLIC or BLE_ADDR_RANDOM
+    int8_t rssi;      // Last advertisement, dBm
+    char name[20];    // From the scan response, "" if none
+  };
+
+  FossibotDiscovery();
+
+  /**
+   * Start (or restart) a scan of SCAN_MS with an empty list
+   * @return false if the scanner would not start
+   */
+  bool start();
+
+  /**
+   * End the scan early; the list stays
+   */
+  void stop();
+
+  /**
+   * End the scan when its time is up, or start it again if a session
+   * stopped it to connect. Call from the main loop.
+   */
+  void update();
+
+  bool isRunning() const { return _running; }
+  uint32_t msLeft() const;
+
+  /**
+   * Time until update() has a scan to end, UINT32_MAX if none runs
+   */
+  uint32_t msUntilDue() const;
+
+  /**
+   * Changes when a unit is found or one's RSSI moves by RSSI_STEP
+   */
+  uint32_t generation() const { return _generation; }
+
+  /**
+   * Copy the list, strongest signal first
+   * @return Entries copied
+   */
+  int results(Result *out, int max) const;
+
+  // NimBLE host task: one advertisement from the scan
+  void onResult(NimBLEAdvertisedDevice *device);
+
+private:
+  static const int SLOTS = 16; // Hash set: a power of two, 2x the results
+
+  Result _results[MAX_RESULTS];
+  uint8_t _addr[MAX_RESULTS][6]; // Native address bytes, the set's keys
+  int8_t _slots[SLOTS];          // Index into _results, -1 = empty
+  int _count;
+  volatile uint32_t _generation;
+  mutable portMUX_TYPE _mux;
+  bool _running;
+  uint32_t _startedMs;
+  uint32_t _lastRestart;
+
+  bool startScan(uint32_t ms);
+};
+
+extern FossibotDiscovery *discovery;
+
+#endif // FOSSIBOT_DISCOVERY_H
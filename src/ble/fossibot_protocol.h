@@ -9,6 +9,8 @@
 #ifndef FOSSIBOT_PROTOCOL_H
 #define FOSSIBOT_PROTOCOL_H
 
+#include "../utils/fixed_point.h"
+#include "../utils/fixed_string.h"
 #include <Arduino.h>
 
 namespace Fossibot {
@@ -21,6 +23,13 @@ static const char *NOTIFY_CHAR_UUID = "0000c305-0000-1000-8000-00805f9b34fb";
 // OpCodes
 static const uint16_t OPCODE_STATUS = 0x1104;   // Real-time telemetry
 static const uint16_t OPCODE_SETTINGS = 0x1103; // Device configuration
+static const uint16_t OPCODE_WRITE_MULTI = 0x1110; // Echo of a 0x10 write
+static const uint16_t OPCODE_WRITE_MULTI_ERROR = 0x1190; // Its exception
+
+// Each poll reads registers 0-79; the response is a 6-byte header, 2 bytes
+// per register and the CRC
+static const uint16_t POLL_REGS = 80;
+static const size_t POLL_FRAME_LEN = 6 + POLL_REGS * 2 + 2;
 
 // STATUS Registers (OpCode 0x1104) - Read only
 namespace StatusReg {
@@ -28,10 +37,13 @@ static const uint8_t AC_INPUT_WATTS = 3;    // AC Input power (W)
 static const uint8_t DC_INPUT_WATTS = 4;    // Solar/DC Input (W)
 static const uint8_t TOTAL_INPUT_WATTS = 6; // Sum of AC + DC (W) - Max 1100W
 static const uint8_t TOTAL_OUTPUT_POWER =
-    20;                                    // Sum of all outputs (W) - Max 3000W
+    20; // Outputs + system draw (W) - use OUTPUT_WATTS for display
 static const uint8_t BATTERY_VOLTAGE = 22; // V × 100 (4900 = 49.00V)
+static const uint8_t OUTPUT_WATTS = 39;    // Sum of all outputs (W) - Max 3000W
 static const uint8_t ACTIVE_OUTPUTS = 41;  // Bitmask for USB/DC/AC states
 static const uint8_t MAIN_SOC = 56;        // State of Charge (0.1%)
+static const uint8_t TIME_TO_FULL = 58;    // Minutes (device estimate)
+static const uint8_t TIME_TO_EMPTY = 59;   // Minutes (device estimate)
 } // namespace StatusReg
 
 // State flag bit masks for register 41 (Active Outputs)
@@ -71,15 +83,16 @@ struct PowerBankData {
   // Connection
   bool connected = false;
 
-  // Battery
-  float batteryPercent = 0.0f; // 0-100%
-  float batteryVoltage = 0.0f; // Volts
+  // Battery, in the registers' own scales
+  Fixed::Permille socPermille = 0;        // 0-1000
+  Fixed::Centivolts batteryCentivolts = 0;
 
-  // Power
-  float inputPower = 0.0f;   // Input watts (0-1100W)
-  float outputPower = 0.0f;  // Output watts (0-3000W)
-  float acInputPower = 0.0f; // AC input component
-  float dcInputPower = 0.0f; // DC/Solar input component
+  // Power, W x 10 (the registers are whole watts; the filter's averages
+  // keep the tenth)
+  Fixed::Deciwatts inputDeciwatts = 0;   // Input (0-1100W)
+  Fixed::Deciwatts outputDeciwatts = 0;  // Output (0-3000W)
+  Fixed::Deciwatts acInputDeciwatts = 0; // AC input component
+  Fixed::Deciwatts dcInputDeciwatts = 0; // DC/Solar input component
 
   // Output states
   bool usbActive = false;
@@ -105,32 +118,25 @@ struct PowerBankData {
   int scheduleCharge = 0;        // Minutes remaining (reg 63)
 
   // For change detection
-  float lastBatteryPercent = -1.0f;
-  float lastInputPower = -1.0f;
-  float lastOutputPower = -1.0f;
+  Fixed::Permille lastSocPermille = -1;
+  Fixed::Deciwatts lastInputDeciwatts = -1;
+  Fixed::Deciwatts lastOutputDeciwatts = -1;
 
   /**
    * Calculate time remaining
    * @param capacityWh Total battery capacity in Wh
    */
-  void calculateTimes(float capacityWh = 3600.0f) {
-    // Time to full (charging)
-    if (inputPower > outputPower && inputPower > 0) {
-      float netPower = inputPower - outputPower;
-      float remainingCapacity = capacityWh * (1.0f - batteryPercent / 100.0f);
-      minutesToFull = (int)(remainingCapacity / netPower * 60.0f);
-    } else {
-      minutesToFull = -1;
-    }
-
-    // Time to empty (discharging)
-    if (outputPower > inputPower && outputPower > 0) {
-      float netDraw = outputPower - inputPower;
-      float currentCapacity = capacityWh * batteryPercent / 100.0f;
-      minutesToEmpty = (int)(currentCapacity / netDraw * 60.0f);
-    } else {
-      minutesToEmpty = -1;
-    }
+  void calculateTimes(int32_t capacityWh = 3600) {
+    // Minutes are Wh left x 60 / net W: capacity x permille / 1000 over
+    // deciwatts / 10, kept whole until the last division
+    int32_t net = inputDeciwatts - outputDeciwatts;
+    int64_t toFill = (int64_t)capacityWh * (Fixed::FULL - socPermille);
+    int64_t toDrain = (int64_t)capacityWh * socPermille;
+    minutesToFull =
+        net > 0 && inputDeciwatts > 0 ? (int)(toFill * 600 / net / 1000) : -1;
+    minutesToEmpty = net < 0 && outputDeciwatts > 0
+                         ? (int)(toDrain * 600 / -net / 1000)
+                         : -1;
   }
 
   /**
@@ -140,14 +146,18 @@ struct PowerBankData {
    */
   bool hasSignificantChange(int socThreshold = 1,
                             int powerThreshold = 5) const {
-    if (lastBatteryPercent < 0)
+    if (lastSocPermille < 0)
       return true; // First data
 
-    if (abs(batteryPercent - lastBatteryPercent) >= socThreshold)
+    // Exact integer deltas: 1% is 10 permille, 5W is 50 deciwatts
+    if (abs(socPermille - lastSocPermille) >=
+        Fixed::fromPercent(socThreshold))
       return true;
-    if (abs(inputPower - lastInputPower) >= powerThreshold)
+    if (abs(inputDeciwatts - lastInputDeciwatts) >=
+        Fixed::fromWatts(powerThreshold))
       return true;
-    if (abs(outputPower - lastOutputPower) >= powerThreshold)
+    if (abs(outputDeciwatts - lastOutputDeciwatts) >=
+        Fixed::fromWatts(powerThreshold))
       return true;
 
     return false;
@@ -157,24 +167,21 @@ struct PowerBankData {
    * Update "last" values after refresh
    */
   void markRefreshed() {
-    lastBatteryPercent = batteryPercent;
-    lastInputPower = inputPower;
-    lastOutputPower = outputPower;
+    lastSocPermille = socPermille;
+    lastInputDeciwatts = inputDeciwatts;
+    lastOutputDeciwatts = outputDeciwatts;
   }
 };
 
 /**
- * Format minutes as "Xh Ym" string
+ * Format minutes as "Xh Ym" (drawn every dashboard frame: no heap)
  */
-inline String formatTime(int minutes) {
+inline FixedString<16> formatTime(int minutes) {
   if (minutes < 0)
     return "--";
   if (minutes < 60)
-    return String(minutes) + "m";
-
-  int hours = minutes / 60;
-  int mins = minutes % 60;
-  return String(hours) + "h " + String(mins) + "m";
+    return FixedString<16>::format("%dm", minutes);
+  return FixedString<16>::format("%dh %dm", minutes / 60, minutes % 60);
 }
 
 } // namespace Fossibot
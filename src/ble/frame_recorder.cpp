@@ -0,0 +1,327 @@
+/**
+ * Frame Recorder Implementation
+ */
+
+#include "frame_recorder.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include "../utils/storage_worker.h"
+#include "ble_client.h"
+#include <esp_heap_caps.h>
+#include <time.h>
+
+extern SDManager *sdManager;
+extern StorageWorker *storage;
+
+const char *const FrameRecorder::DIR = "/debug";
+const char *const FrameRecorder::PATH = "/debug/frames.bin";
+
+static const time_t VALID_TIME = 1700000000; // Clock set (2023+)
+
+FrameRecorder::FrameRecorder()
+    : _enabled(false), _dropped(0), _staging(nullptr), _staged(0),
+      _writing(nullptr), _writeCount(0), _busy(false), _firstStaged(0),
+      _recorded(0), _opened(false), _next(0), _replay(Replay::OFF),
+      _speed(1), _replaySeq(0), _replayEnd(0), _played(0), _lastMs(0),
+      _playedAt(0), _resumeRecording(false) {}
+
+bool FrameRecorder::allocate() {
+  if (_staging)
+    return true;
+  // Two batches, about 12 KB, in PSRAM
+  _staging = (Record *)heap_caps_malloc(2 * BATCH * sizeof(Record),
+                                        MALLOC_CAP_SPIRAM);
+  if (!_staging) {
+    LOG_E("Recorder", "No memory for the frame buffers");
+    return false;
+  }
+  _writing = _staging + BATCH;
+  return true;
+}
+
+void FrameRecorder::setEnabled(bool enabled) {
+  if (enabled && !allocate())
+    return;
+  if (enabled != _enabled)
+    LOG_I("Recorder", "Recording %s", enabled ? "on" : "off");
+  _enabled = enabled;
+}
+
+void FrameRecorder::capture(uint8_t session, uint8_t firstReg,
+                            const uint8_t *data, size_t length) {
+  if (!_enabled)
+    return;
+  Record r;
+  r.ms = millis();
+  time_t now = time(nullptr);
+  r.time = now >= VALID_TIME ? now : 0;
+  r.session = session;
+  r.firstReg = firstReg;
+  r.length = length;
+  size_t kept = length < MAX_FRAME ? length : MAX_FRAME;
+  memcpy(r.bytes, data, kept);
+  memset(r.bytes + kept, 0, MAX_FRAME - kept);
+  if (!_queue.push(r))
+    _dropped++;
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+void FrameRecorder::service() {
+  if (_replay != Replay::OFF) {
+    serviceReplay();
+    return;
+  }
+
+  // Staged even when just turned off, so the tail still reaches the card
+  Record r;
+  while (_staging && _staged < BATCH && _queue.pop(r)) {
+    if (_staged == 0)
+      _firstStaged = millis();
+    _staging[_staged++] = r;
+  }
+  if (_staged == 0 || _busy)
+    return;
+  if (_staged == BATCH || millis() - _firstStaged >= FLUSH_MS || !_enabled)
+    flush();
+}
+
+void FrameRecorder::flush() {
+  if (!storage || !sdManager || !sdManager->isAvailable()) {
+    _dropped += _staged;
+    _staged = 0;
+    return;
+  }
+  Record *swap = _writing;
+  _writing = _staging;
+  _writeCount = _staged;
+  _staging = swap;
+  _staged = 0;
+  _busy = storage->run(
+      PATH, [this](size_t &bytes) { return writeBatch(bytes); },
+      [this](const StorageResult &result) {
+        _busy = false;
+        if (result.ok) {
+          _recorded += _writeCount;
+        } else {
+          _dropped += _writeCount;
+          _opened = false; // Look at the file afresh next time
+          LOG_W("Recorder", "Writing %d frames failed", _writeCount);
+        }
+      });
+  if (!_busy)
+    _dropped += _writeCount; // Worker queue full
+}
+
+// Worker task, under SDAccess
+bool FrameRecorder::writeBatch(size_t &bytes) {
+  fs::FS &fs = sdFS();
+  FileHeader header;
+  if (!_opened) {
+    // Carry on with a ring of the same shape; start one otherwise
+    fs::File f = fs.open(PATH, FILE_READ);
+    bool valid = f && f.read((uint8_t *)&header, sizeof(header)) ==
+                          sizeof(header) &&
+                 header.magic == MAGIC && header.version == VERSION &&
+                 header.recordBytes == sizeof(Record) &&
+                 header.slots == SLOTS;
+    uint32_t kept = valid ? min(header.next, (uint32_t)SLOTS) : 0;
+    valid = valid && f.size() >= sizeof(header) + kept * sizeof(Record);
+    f.close();
+    _next = valid ? header.next : 0;
+    if (!valid) {
+      if (!fs.exists(DIR))
+        fs.mkdir(DIR);
+      memset(&header, 0, sizeof(header));
+      header.magic = MAGIC;
+      header.version = VERSION;
+      header.recordBytes = sizeof(Record);
+      header.slots = SLOTS;
+      f = fs.open(PATH, FILE_WRITE);
+      if (!f || f.write((const uint8_t *)&header, sizeof(header)) !=
+                    sizeof(header)) {
+        f.close();
+        return false;
+      }
+      f.close();
+      LOG_I("Recorder", "Started %s", PATH);
+    }
+    _opened = true;
+  }
+
+  fs::File f = fs.open(PATH, "r+");
+  if (!f || f.size() < sizeof(header) ||
+      f.read((uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+    f.close();
+    return false;
+  }
+  // Contiguous slots in one write: two when the batch wraps the ring
+  int done = 0;
+  while (done < _writeCount) {
+    uint32_t slot = _next % SLOTS;
+    int run = _writeCount - done;
+    if (run > (int)(SLOTS - slot))
+      run = SLOTS - slot;
+    size_t length = run * sizeof(Record);
+    if (!f.seek(sizeof(header) + slot * sizeof(Record)) ||
+        f.write((const uint8_t *)(_writing + done), length) != length) {
+      f.close();
+      return false;
+    }
+    _next += run;
+    done += run;
+    bytes += length;
+  }
+  header.next = _next;
+  bool ok = f.seek(0) && f.write((const uint8_t *)&header,
+                                 sizeof(header)) == sizeof(header);
+  f.close();
+  return ok;
+}
+
+int FrameRecorder::load(Record *out, int max) {
+  SDAccess access(sdManager);
+  if (!access || max <= 0)
+    return 0;
+  fs::File f = sdFS().open(PATH, FILE_READ);
+  FileHeader header;
+  if (!f || f.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+      header.magic != MAGIC || header.version != VERSION ||
+      header.recordBytes != sizeof(Record) || header.slots != SLOTS) {
+    f.close();
+    return 0;
+  }
+  uint32_t kept = min(header.next, (uint32_t)SLOTS);
+  uint32_t count = min((uint32_t)max, kept);
+  int read = 0;
+  for (uint32_t seq = header.next - count; seq != header.next; seq++) {
+    if (!f.seek(sizeof(header) + (seq % SLOTS) * sizeof(Record)) ||
+        f.read((uint8_t *)&out[read], sizeof(Record)) != sizeof(Record))
+      break;
+    read++;
+  }
+  f.close();
+  return read;
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+bool FrameRecorder::startReplay(float speed) {
+  if (_replay != Replay::OFF || _busy || !storage || !sdManager ||
+      !sdManager->isAvailable() || !allocate())
+    return false;
+  _speed = speed > 0 ? speed : 0;
+  _resumeRecording = _enabled;
+  _enabled = false;
+  _replay = Replay::HEADER;
+  _played = 0;
+  _writeCount = 0;
+  _lastMs = 0;
+  _playedAt = 0;
+  LOG_I("Recorder", "Replay at %.1fx", _speed);
+  return true;
+}
+
+void FrameRecorder::stopReplay() {
+  if (_replay != Replay::OFF)
+    endReplay("stopped");
+}
+
+void FrameRecorder::endReplay(const char *why) {
+  LOG_I("Recorder", "Replay %s", why);
+  _replay = Replay::OFF;
+  _writeCount = 0;
+  _enabled = _resumeRecording;
+}
+
+void FrameRecorder::serviceReplay() {
+  if (_busy)
+    return; // The last write, or the next chunk, is on the worker
+
+  switch (_replay) {
+  case Replay::HEADER:
+  case Replay::READING:
+    readChunk();
+    return;
+  case Replay::PLAYING:
+    break;
+  default:
+    return;
+  }
+
+  // Frames due now, a few per pass so the loop keeps drawing
+  for (int n = 0; n < 4 && _played < _writeCount; n++) {
+    const Record &r = _writing[_played];
+    if (_playedAt) {
+      uint32_t gap = r.ms - _lastMs; // Huge across a restart
+      if (gap > MAX_GAP_MS)
+        gap = 0;
+      if (_speed > 0 && millis() - _playedAt < gap / _speed)
+        return;
+    }
+    size_t length = r.length < MAX_FRAME ? r.length : MAX_FRAME;
+    FossibotBLE::replayFrame(r.session, r.firstReg, r.bytes, length);
+    _lastMs = r.ms;
+    _playedAt = millis();
+    _played++;
+  }
+  if (_played == _writeCount) {
+    if (_replaySeq == _replayEnd)
+      endReplay("done");
+    else
+      _replay = Replay::READING;
+  }
+}
+
+void FrameRecorder::readChunk() {
+  bool first = _replay == Replay::HEADER;
+  _busy = storage->run(
+      PATH,
+      [this, first](size_t &bytes) {
+        fs::File f = sdFS().open(PATH, FILE_READ);
+        if (!f)
+          return false;
+        if (first) {
+          FileHeader header;
+          if (f.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+              header.magic != MAGIC || header.version != VERSION ||
+              header.recordBytes != sizeof(Record) || header.slots != SLOTS) {
+            f.close();
+            return false;
+          }
+          _replayEnd = header.next;
+          _replaySeq = header.next > SLOTS ? header.next - SLOTS : 0;
+        }
+        uint32_t slot = _replaySeq % SLOTS;
+        uint32_t count = min(_replayEnd - _replaySeq, (uint32_t)BATCH);
+        if (count > SLOTS - slot)
+          count = SLOTS - slot;
+        size_t length = count * sizeof(Record);
+        bool ok = f.seek(sizeof(FileHeader) + slot * sizeof(Record)) &&
+                  f.read((uint8_t *)_writing, length) == length;
+        f.close();
+        bytes = ok ? length : 0;
+        if (ok) {
+          _writeCount = count;
+          _replaySeq += count;
+        }
+        return ok;
+      },
+      [this](const StorageResult &result) {
+        _busy = false;
+        if (_replay == Replay::OFF)
+          return; // Stopped meanwhile
+        if (!result.ok) {
+          endReplay("failed: no recording");
+        } else if (_writeCount == 0) {
+          endReplay("done");
+        } else {
+          _played = 0;
+          _replay = Replay::PLAYING;
+        }
+      });
+}
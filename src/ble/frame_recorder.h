@@ -0,0 +1,142 @@
+/**
+ * Frame Recorder
+ *
+ * Keeps the raw 0x1104 status and 0x1103 settings frames, all 80
+ * registers of each (the BLE client reads the whole status block while
+ * recording), for chasing firmware quirks the decoded fields hide.
+ * With recorder.enabled in the settings (or "REC ON" over USB serial)
+ * every frame any session receives is time-stamped and queued, CRC errors
+ * included, and written to PATH on the storage worker in batches.
+ *
+ * The file is a ring: a FileHeader, then SLOTS fixed-size Records, frame
+ * n in slot n % SLOTS. FileHeader::next counts the frames ever written,
+ * so the oldest one kept is next - SLOTS once the ring has wrapped, and
+ * recording after a restart carries on where it stopped.
+ *
+ * Replay ("REPLAY [speed]" over USB serial) reads the ring back oldest
+ * first and feeds each frame through the BLE client's receive path (CRC
+ * check and parser) of the session that recorded it, paced as recorded
+ * and sped up by speed (0: as fast as the loop goes). Sessions with a
+ * live link are left alone, and recording pauses meanwhile. LogicBench's
+ * recorded_decode case times the parser over the newest frames.
+ */
+
+#ifndef FRAME_RECORDER_H
+#define FRAME_RECORDER_H
+
+#include "../utils/spsc_ring.h"
+#include <Arduino.h>
+#include <atomic>
+
+class FrameRecorder {
+public:
+  static const size_t MAX_FRAME = 180;     // Bytes kept of a frame
+  static const uint32_t SLOTS = 4096;      // About 770 KB on the card
+  static const int QUEUE = 16;             // Frames from the BLE host task
+  static const int BATCH = 32;             // Frames per card write
+  static const uint32_t FLUSH_MS = 10000;  // Write a part batch this late
+  static const uint32_t MAX_GAP_MS = 60000; // Replay skips longer pauses
+  static const uint32_t MAGIC = 0x314D5246; // "FRM1"
+  static const uint16_t VERSION = 1;
+  static const char *const DIR;
+  static const char *const PATH;
+
+  struct Record {
+    uint32_t ms;   // millis() at arrival
+    uint32_t time; // UTC, 0 before the clock is set
+    uint8_t session;  // FossibotBLE session slot
+    uint8_t firstReg; // Register the data starts at (partial status reads)
+    uint16_t length; // Bytes of the frame received (more than MAX_FRAME:
+                     // cut short)
+    uint8_t bytes[MAX_FRAME];
+  };
+
+  struct FileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordBytes; // sizeof(Record)
+    uint32_t slots;
+    uint32_t next; // Frames written ever
+    uint32_t reserved[4];
+  };
+
+  FrameRecorder();
+
+  /**
+   * Start or stop recording (the queue is written out either way)
+   */
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return _enabled; }
+
+  /**
+   * Queue a received frame. Called from the BLE notification callback
+   * (the NimBLE host task, the only producer).
+   */
+  void capture(uint8_t session, uint8_t firstReg, const uint8_t *data,
+               size_t length);
+
+  /**
+   * Play the recording back through the parser
+   * @param speed Time scale; 0 sends as fast as the loop goes
+   * @return false without a card, while a batch is being written or
+   *         while already replaying
+   */
+  bool startReplay(float speed);
+  void stopReplay();
+  bool isReplaying() const { return _replay != Replay::OFF; }
+
+  /**
+   * Write queued frames out and pace a replay. Call from the main loop.
+   */
+  void service();
+
+  uint32_t recorded() const { return _recorded; } // Frames since boot
+  uint32_t dropped() const { return _dropped; }   // Queue or card full
+
+  /**
+   * Read the newest frames, oldest first, now (under SDAccess)
+   * @return Frames read
+   */
+  static int load(Record *out, int max);
+
+private:
+  enum class Replay : uint8_t { OFF, HEADER, READING, PLAYING };
+
+  SpscRing<Record, QUEUE> _queue;
+  std::atomic<bool> _enabled;
+  std::atomic<uint32_t> _dropped;
+
+  // Loop task; _writing belongs to the storage worker while _busy
+  Record *_staging;
+  int _staged;
+  Record *_writing;
+  int _writeCount;
+  bool _busy;
+  uint32_t _firstStaged; // millis() the oldest staged frame arrived
+  uint32_t _recorded;
+
+  // Storage worker, one job at a time
+  bool _opened; // Header checked since boot
+  uint32_t _next;
+
+  // Replay, through _writing
+  Replay _replay;
+  float _speed;
+  uint32_t _replaySeq; // Next frame to read
+  uint32_t _replayEnd;
+  int _played;         // Of _writeCount
+  uint32_t _lastMs;    // Recorded time of the frame last played
+  uint32_t _playedAt;  // millis() it was played
+  bool _resumeRecording;
+
+  bool allocate();
+  bool writeBatch(size_t &bytes);
+  void flush();
+  void serviceReplay();
+  void readChunk();
+  void endReplay(const char *why);
+};
+
+extern FrameRecorder *recorder;
+
+#endif // FRAME_RECORDER_H
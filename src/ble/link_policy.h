@@ -0,0 +1,106 @@
+/**
+ * BLE Link Policy
+ *
+ * Chooses connection parameters and TX power for an open link. Telemetry
+ * is a few hundred bytes every poll, so the link idles on a long interval
+ * with slave latency and only switches to a short interval for
+ * BURST_HOLD_MS after a command. TX power steps down while the smoothed
+ * RSSI is comfortably strong and back up when it weakens.
+ */
+
+#ifndef LINK_POLICY_H
+#define LINK_POLICY_H
+
+#include <Arduino.h>
+#include <esp_bt.h>
+
+struct ConnParams {
+  uint16_t minInterval; // 1.25 ms units
+  uint16_t maxInterval; // 1.25 ms units
+  uint16_t latency;     // Connection events the peripheral may skip
+  uint16_t timeout;     // Supervision timeout, 10 ms units
+};
+
+class LinkPolicy {
+public:
+  static const uint32_t BURST_HOLD_MS = 5000;
+  static const uint32_t RSSI_SAMPLE_MS = 5000;
+  static const int RSSI_STRONG_DBM = -55; // Above: step TX power down
+  static const int RSSI_WEAK_DBM = -75;   // Below: step TX power up
+  static const int LEVEL_COUNT = 8;
+
+  // 15-30 ms, no latency: commands and their readback turn around fast
+  static ConnParams burstParams() { return {12, 24, 0, 500}; }
+  // 400-500 ms, latency 4: at most 2.5 s between peripheral wakeups,
+  // supervision timeout 6 s (> 2 x (1 + latency) x max interval)
+  static ConnParams idleParams() { return {320, 400, 4, 600}; }
+
+  LinkPolicy()
+      : _burstUntil(0), _burst(true), _rssi(0), _level(LEVEL_COUNT - 1) {}
+
+  /**
+   * New link: start in burst (initial polls) at full power
+   */
+  void reset(uint32_t now) {
+    _burstUntil = now + BURST_HOLD_MS;
+    _burst = true;
+    _rssi = 0;
+    _level = LEVEL_COUNT - 1;
+  }
+
+  /**
+   * A command is about to be written
+   */
+  void onActivity(uint32_t now) { _burstUntil = now + BURST_HOLD_MS; }
+
+  /**
+   * Check whether the link should change profile
+   * @param burst Set to the profile to switch to
+   * @return true if the profile changed
+   */
+  bool profileChanged(uint32_t now, bool &burst) {
+    bool want = (int32_t)(_burstUntil - now) > 0;
+    if (want == _burst)
+      return false;
+    _burst = want;
+    burst = want;
+    return true;
+  }
+  bool isBurst() const { return _burst; }
+
+  /**
+   * Feed a link RSSI reading
+   * @return true if the TX power level changed (see txPower())
+   */
+  bool onRssi(int rssi) {
+    // EWMA (1/4) so single fades don't bounce the level
+    _rssi = _rssi == 0 ? rssi * 4 : _rssi - _rssi / 4 + rssi;
+    int smoothed = _rssi / 4;
+    if (smoothed > RSSI_STRONG_DBM && _level > 0) {
+      _level--;
+      return true;
+    }
+    if (smoothed < RSSI_WEAK_DBM && _level < LEVEL_COUNT - 1) {
+      _level++;
+      return true;
+    }
+    return false;
+  }
+
+  esp_power_level_t txPower() const {
+    // Levels every ESP32 target defines, lowest first
+    static const esp_power_level_t LEVELS[LEVEL_COUNT] = {
+        ESP_PWR_LVL_N12, ESP_PWR_LVL_N9, ESP_PWR_LVL_N6, ESP_PWR_LVL_N3,
+        ESP_PWR_LVL_N0,  ESP_PWR_LVL_P3, ESP_PWR_LVL_P6, ESP_PWR_LVL_P9};
+    return LEVELS[_level];
+  }
+  int txPowerDbm() const { return -12 + _level * 3; }
+
+private:
+  uint32_t _burstUntil;
+  bool _burst;
+  int _rssi; // Smoothed RSSI x 4, 0 = no reading yet
+  int _level;
+};
+
+#endif // LINK_POLICY_H
@@ -0,0 +1,197 @@
+/**
+ * BLE Link Statistics
+ *
+ * What a FossibotBLE session has seen of its link since boot (or the last
+ * reset()): how long connect attempts take and how many succeed, the link
+ * RSSI (with a per-minute mean for the last RSSI_MINUTES minutes), why
+ * links dropped, the time from a read request to its complete response as
+ * a histogram, and the responses that went wrong (CRC failures, frames cut
+ * short, reads that never got an answer).
+ *
+ * Plain counters, each written by one task: connects by the link task,
+ * RSSI by the loop task, drops and frames by the NimBLE host task. A copy
+ * taken on the loop task may be a frame behind, never torn in a way that
+ * matters. Copied as a whole onto the telemetry bus.
+ */
+
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <Arduino.h>
+
+struct LinkStats {
+  static const int LATENCY_BUCKETS = 8; // Under 16, 32 ... 1024 ms, later
+  static const int RSSI_MINUTES = 60;
+
+  // Why a link went down (from the HCI disconnect reason)
+  enum Drop : uint8_t {
+    DROP_TIMEOUT, // Supervision timeout: out of range, interference
+    DROP_REMOTE,  // The unit closed it
+    DROP_LOCAL,   // We closed it (fleet hand-over, stale handles)
+    DROP_FAILED,  // Never got established
+    DROP_OTHER,
+    DROP_KINDS
+  };
+
+  // Connect attempts, link task
+  uint32_t attempts;
+  uint32_t connects;
+  uint32_t lastAttemptMs; // Scan stopped to ready, or to giving up
+  uint32_t maxConnectMs;  // Of the successful ones
+  uint32_t totalConnectMs;
+
+  // Link RSSI, loop task (dBm, 0 = no reading)
+  int8_t rssi;
+  int8_t rssiMin;
+  int8_t rssiMax;
+  int32_t rssiSum;
+  uint32_t rssiSamples;
+  int8_t rssiMinutes[RSSI_MINUTES]; // Means, newest at rssiHead; 0 = none
+  uint8_t rssiHead;
+  uint8_t rssiCount;
+  uint32_t rssiMinute; // Minute (millis() / 60000) being summed
+  int32_t minuteSum;
+  uint16_t minuteSamples;
+
+  // Drops, host task
+  uint32_t drops[DROP_KINDS];
+  int lastReason; // NimBLE error code of the last drop, 0 = none yet
+
+  // Responses, host task
+  uint32_t frames;      // Complete responses
+  uint32_t crcErrors;   // Dropped for a bad CRC
+  uint32_t shortFrames; // Pieces that never made a whole frame
+  uint32_t missedReads; // Requests whose response never came
+  uint32_t latency[LATENCY_BUCKETS];
+  uint32_t latencySumMs;
+
+  LinkStats() { reset(); }
+
+  void reset() { memset(this, 0, sizeof(*this)); }
+
+  void onAttempt(uint32_t ms, bool connected) {
+    attempts++;
+    lastAttemptMs = ms;
+    if (!connected)
+      return;
+    connects++;
+    totalConnectMs += ms;
+    if (ms > maxConnectMs)
+      maxConnectMs = ms;
+  }
+
+  void onRssi(int dbm, uint32_t now) {
+    if (dbm == 0)
+      return;
+    if (!rssiSamples || dbm < rssiMin)
+      rssiMin = dbm;
+    if (!rssiSamples || dbm > rssiMax)
+      rssiMax = dbm;
+    rssi = dbm;
+    rssiSum += dbm;
+    rssiSamples++;
+
+    // Close the minute being summed, and one empty per minute skipped
+    uint32_t minute = now / 60000;
+    if (minuteSamples && minute != rssiMinute) {
+      closeMinute(minuteSum / minuteSamples);
+      uint32_t gap = minute - rssiMinute - 1;
+      for (uint32_t i = 0; i < gap && i < RSSI_MINUTES; i++)
+        closeMinute(0);
+      minuteSum = 0;
+      minuteSamples = 0;
+    }
+    rssiMinute = minute;
+    minuteSum += dbm;
+    minuteSamples++;
+  }
+
+  void onDisconnect(int reason) {
+    lastReason = reason;
+    drops[dropKind(reason)]++;
+  }
+
+  void onResponse(uint32_t ms) {
+    frames++;
+    latency[latencyBucket(ms)]++;
+    latencySumMs += ms;
+  }
+
+  uint32_t responses() const {
+    uint32_t n = 0;
+    for (uint32_t count : latency)
+      n += count;
+    return n;
+  }
+
+  /**
+   * Upper bound of the bucket holding the pct-th percentile latency
+   * @return 0 without responses, UINT32_MAX if it is in the last bucket
+   */
+  uint32_t latencyPercentile(int pct) const {
+    uint32_t n = responses();
+    if (!n)
+      return 0;
+    uint32_t want = (n * pct + 99) / 100, seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+      seen += latency[b];
+      if (seen >= want)
+        return latencyBound(b);
+    }
+    return UINT32_MAX;
+  }
+
+  /**
+   * Per-minute mean RSSI, age 0 the newest closed minute
+   */
+  int8_t rssiAt(int age) const {
+    return rssiMinutes[(rssiHead - age + RSSI_MINUTES) % RSSI_MINUTES];
+  }
+
+  static int latencyBucket(uint32_t ms) {
+    int b = 0;
+    while (b < LATENCY_BUCKETS - 1 && ms >= latencyBound(b))
+      b++;
+    return b;
+  }
+
+  // Exclusive upper bound of a bucket (the last has none)
+  static uint32_t latencyBound(int bucket) {
+    return bucket < LATENCY_BUCKETS - 1 ? 16UL << bucket : UINT32_MAX;
+  }
+
+  static Drop dropKind(int reason) {
+    // NimBLE reports HCI reasons as BLE_HS_ERR_HCI_BASE (0x200) + code
+    switch (reason - 0x200) {
+    case 0x08: // Connection timeout
+      return DROP_TIMEOUT;
+    case 0x13: // Remote user terminated
+    case 0x14: // Remote low resources
+    case 0x15: // Remote power off
+      return DROP_REMOTE;
+    case 0x16: // Terminated by local host
+      return DROP_LOCAL;
+    case 0x3E: // Failed to be established
+      return DROP_FAILED;
+    default:
+      return DROP_OTHER;
+    }
+  }
+
+  static const char *dropName(int kind) {
+    static const char *const NAMES[DROP_KINDS] = {"timeout", "remote",
+                                                  "local", "failed", "other"};
+    return kind < DROP_KINDS ? NAMES[kind] : "?";
+  }
+
+private:
+  void closeMinute(int8_t mean) {
+    if (rssiCount)
+      rssiHead = (rssiHead + 1) % RSSI_MINUTES;
+    if (rssiCount < RSSI_MINUTES)
+      rssiCount++;
+    rssiMinutes[rssiHead] = mean;
+  }
+};
+
+#endif // LINK_STATS_H
@@ -0,0 +1,230 @@
+/**
+ * BLE OTA Service Implementation
+ */
+
+#include "ota_service.h"
+#include "../ota_update.h"
+#include "../utils/log.h"
+#include "../utils/wake.h"
+#include <NimBLEDevice.h>
+#include <stdarg.h>
+
+static const char *OTA_SERVICE_UUID = "8f1c0010-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+static const char *OTA_CONTROL_UUID = "8f1c0011-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+static const char *OTA_DATA_UUID = "8f1c0012-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+static const char *OTA_STATUS_UUID = "8f1c0013-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+
+namespace {
+
+OtaService *service = nullptr;
+NimBLECharacteristic *statusChar = nullptr;
+
+class OtaControlCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  void onWrite(NimBLECharacteristic *characteristic) override {
+    if (!service)
+      return;
+    NimBLEAttValue value = characteristic->getValue();
+    service->onCommand((const char *)value.data(), value.length());
+  }
+};
+
+class OtaDataCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  void onWrite(NimBLECharacteristic *characteristic) override {
+    if (!service)
+      return;
+    NimBLEAttValue value = characteristic->getValue();
+    service->onData(value.data(), value.length());
+  }
+};
+
+OtaControlCallbacks controlCallbacks;
+OtaDataCallbacks dataCallbacks;
+
+} // namespace
+
+OtaService::OtaService()
+    : _hasPending(false), _mux(portMUX_INITIALIZER_UNLOCKED), _active(false),
+      _acked(0), _resyncSent(false) {
+  _pending[0] = '\0';
+}
+
+OtaService::~OtaService() {
+  if (_active && ota)
+    ota->abort("stopped");
+  if (service == this)
+    service = nullptr;
+}
+
+bool OtaService::begin() {
+  if (service)
+    return false;
+  if (!NimBLEDevice::getInitialized()) {
+    NimBLEDevice::init("M5PaperS3");
+    NimBLEDevice::setSecurityAuth(false, false, false);
+  }
+
+  // The export service owns the server callbacks; this one only adds
+  // characteristics (and is found by discovery, not advertised)
+  NimBLEServer *server = NimBLEDevice::createServer();
+  NimBLEService *gatt = server->createService(OTA_SERVICE_UUID);
+  gatt->createCharacteristic(OTA_CONTROL_UUID,
+                             NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR)
+      ->setCallbacks(&controlCallbacks);
+  gatt->createCharacteristic(OTA_DATA_UUID,
+                             NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR)
+      ->setCallbacks(&dataCallbacks);
+  statusChar = gatt->createCharacteristic(
+      OTA_STATUS_UUID, NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+  gatt->start();
+
+  service = this;
+  Serial.println("BLE: OTA service registered");
+  return true;
+}
+
+void OtaService::onCommand(const char *text, size_t length) {
+  if (length >= MAX_COMMAND)
+    length = MAX_COMMAND - 1;
+  portENTER_CRITICAL(&_mux);
+  memcpy(_pending, text, length);
+  _pending[length] = '\0';
+  _hasPending = true;
+  portEXIT_CRITICAL(&_mux);
+  Wake::signal(Wake::BLE);
+}
+
+void OtaService::onData(const uint8_t *data, size_t length) {
+  if (length <= 4 || length > 4 + PAYLOAD_MAX)
+    return;
+  Packet packet;
+  memcpy(&packet.offset, data, 4);
+  packet.length = length - 4;
+  memcpy(packet.data, data + 4, packet.length);
+  _queue.push(packet); // Full: dropped, and resent after the resync
+  Wake::signal(Wake::BLE);
+}
+
+void OtaService::update() {
+  if (_hasPending) {
+    char command[MAX_COMMAND];
+    portENTER_CRITICAL(&_mux);
+    memcpy(command, _pending, sizeof(command));
+    _hasPending = false;
+    portEXIT_CRITICAL(&_mux);
+    handle(command);
+  }
+
+  if (!_active) {
+    Packet packet;
+    while (_queue.pop(packet)) {
+    }
+    return;
+  }
+
+  // Abandoned: the host went away, or OtaUpdate gave up on a stall
+  NimBLEServer *server = NimBLEDevice::getServer();
+  if (!server || server->getConnectedCount() == 0) {
+    ota->abort("disconnected");
+    _active = false;
+    return;
+  }
+  if (!ota->isActive()) {
+    end(ota->error());
+    return;
+  }
+  writeQueued();
+}
+
+void OtaService::writeQueued() {
+  Packet packet;
+  while (_active && _queue.pop(packet)) {
+    if (packet.offset != ota->received()) {
+      if (!_resyncSent) {
+        send("OK %u", (unsigned)ota->received());
+        _acked = ota->received();
+        _resyncSent = true;
+      }
+      continue;
+    }
+    _resyncSent = false;
+    if (!ota->write(packet.data, packet.length)) {
+      end(ota->error());
+      return;
+    }
+    if (ota->received() - _acked >= ACK_BYTES ||
+        ota->received() == ota->size()) {
+      _acked = ota->received();
+      send("OK %u", (unsigned)_acked);
+    }
+  }
+}
+
+void OtaService::handle(char *command) {
+  char *save = nullptr;
+  char *verb = strtok_r(command, " ", &save);
+  if (!verb)
+    return;
+
+  if (strcmp(verb, "BEGIN") == 0) {
+    char *size = strtok_r(nullptr, " ", &save);
+    char *kindName = strtok_r(nullptr, " ", &save);
+    char *token = strtok_r(nullptr, " ", &save);
+    OtaUpdate::Kind kind;
+    if (_active) {
+      send("ERR busy");
+    } else if (!ota || !OtaUpdate::authorized(token)) {
+      send("ERR auth");
+    } else if (!size || !OtaUpdate::parseKind(kindName, kind)) {
+      send("ERR command");
+    } else if (!ota->begin(strtoul(size, nullptr, 10), kind, "ble")) {
+      send("ERR %s", ota->error());
+    } else {
+      Packet stale;
+      while (_queue.pop(stale)) {
+      }
+      _active = true;
+      _acked = 0;
+      _resyncSent = false;
+      send("OK 0");
+    }
+  } else if (strcmp(verb, "END") == 0 && _active) {
+    writeQueued(); // Whatever arrived just before the END
+    if (!_active)
+      return;
+    _active = false;
+    if (ota->finish())
+      send("DONE");
+    else
+      send("ERR %s", ota->error());
+  } else if (strcmp(verb, "ABORT") == 0 && _active) {
+    ota->abort("host");
+    _active = false;
+    send("ERR aborted");
+  } else {
+    send("ERR command");
+  }
+}
+
+void OtaService::end(const char *error) {
+  if (ota->isActive())
+    ota->abort(error);
+  _active = false;
+  send("ERR %s", error ? error : "failed");
+}
+
+void OtaService::send(const char *fmt, ...) {
+  if (!statusChar)
+    return;
+  char text[48];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(text, sizeof(text), fmt, args);
+  va_end(args);
+  if (n < 0)
+    return;
+  statusChar->setValue((const uint8_t *)text,
+                       n < (int)sizeof(text) ? n : sizeof(text) - 1);
+  statusChar->notify();
+}
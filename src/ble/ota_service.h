@@ -0,0 +1,81 @@
+/**
+ * BLE OTA Service
+ *
+ * A GATT service beside the history export's, on the same server, that
+ * feeds OtaUpdate from a phone or PC:
+ *
+ *   control (write)    "BEGIN <size> IMAGE|DELTA <token>", "END", "ABORT"
+ *   data (write, write without response)
+ *                      [offset u32 LE][bytes], the transfer in order
+ *   status (notify, read)
+ *                      "OK <offset>"  everything before offset is written
+ *                      "DONE"         image accepted, restarting
+ *                      "ERR <reason>" transfer over
+ *
+ * The host keeps at most WINDOW_BYTES past the last "OK". Packets that do
+ * not follow on from what is written (one was dropped, or arrived after
+ * the queue filled) are discarded and answered with an "OK" at the offset
+ * wanted, and the host sends again from there. A disconnect abandons the
+ * transfer.
+ *
+ * Writes arrive on the NimBLE host task and are queued; update() on the
+ * main loop does the flash writes.
+ */
+
+#ifndef OTA_SERVICE_H
+#define OTA_SERVICE_H
+
+#include "../utils/spsc_ring.h"
+#include <Arduino.h>
+
+class OtaService {
+public:
+  static const size_t PAYLOAD_MAX = 240;     // At the largest MTU
+  static const int QUEUE = 32;               // Data packets in flight
+  static const uint32_t WINDOW_BYTES = 4096; // Host sends ahead of "OK"
+  static const uint32_t ACK_BYTES = 1024;    // "OK" this often
+  static const int MAX_COMMAND = 80;
+
+  struct Packet {
+    uint32_t offset;
+    uint16_t length;
+    uint8_t data[PAYLOAD_MAX];
+  };
+
+  OtaService();
+  ~OtaService();
+
+  /**
+   * Register the service on the BLE server (NimBLE is initialized if
+   * nothing else has); call before the export service starts advertising
+   */
+  bool begin();
+
+  /**
+   * Handle commands, write queued data. Call from the main loop.
+   */
+  void update();
+
+  // From the NimBLE host task
+  void onCommand(const char *text, size_t length);
+  void onData(const uint8_t *data, size_t length);
+
+private:
+  SpscRing<Packet, QUEUE> _queue;
+  char _pending[MAX_COMMAND];
+  volatile bool _hasPending;
+  portMUX_TYPE _mux;
+
+  bool _active;       // ota holds a transfer of ours
+  uint32_t _acked;    // Last "OK" sent
+  bool _resyncSent;   // Since the last packet that fitted
+
+  void handle(char *command);
+  void writeQueued();
+  void send(const char *fmt, ...);
+  void end(const char *error);
+};
+
+extern OtaService *otaService;
+
+#endif // OTA_SERVICE_H
@@ -0,0 +1,208 @@
+/**
+ * Fossibot Register Map
+ *
+ * Compile-time schema for the 0x1104 (status) and 0x1103 (settings)
+ * responses. Each entry names a register, how to convert it and which
+ * PowerBankData field receives it. decode() walks the schema once, reading
+ * big-endian registers straight out of the notification buffer, so a new
+ * telemetry field is one more table row. encode() goes the other way, for
+ * frames made up on the device (the telemetry simulator).
+ */
+
+#ifndef REGISTER_MAP_H
+#define REGISTER_MAP_H
+
+#include "fossibot_protocol.h"
+#include <stddef.h>
+
+namespace Fossibot {
+
+// Register values start after the 6-byte response header
+static const size_t REG_DATA_OFFSET = 6;
+
+enum class FieldType : uint8_t {
+  FIXED, // value * mul -> int32_t (a Fixed:: unit)
+  INT,   // value / div -> int (integer division)
+  FLAG,  // value == 1 -> bool
+  BIT    // (value & mask) != 0 -> bool
+};
+
+struct RegField {
+  uint8_t reg;
+  FieldType type;
+  uint16_t offset; // offsetof(PowerBankData, field)
+  uint16_t arg;    // Multiplier for FIXED, divisor for INT, mask for BIT
+};
+
+#define FOSSIBOT_FIELD(reg, type, field, arg)                                  \
+  { (reg), FieldType::type, offsetof(PowerBankData, field), (arg) }
+
+// Status (0x1104), ordered by register so decode() reads the frame forward
+static constexpr RegField STATUS_MAP[] = {
+    FOSSIBOT_FIELD(StatusReg::AC_INPUT_WATTS, FIXED, acInputDeciwatts, 10),
+    FOSSIBOT_FIELD(StatusReg::DC_INPUT_WATTS, FIXED, dcInputDeciwatts, 10),
+    FOSSIBOT_FIELD(StatusReg::TOTAL_INPUT_WATTS, FIXED, inputDeciwatts, 10),
+    FOSSIBOT_FIELD(StatusReg::BATTERY_VOLTAGE, FIXED, batteryCentivolts, 1),
+    FOSSIBOT_FIELD(StatusReg::OUTPUT_WATTS, FIXED, outputDeciwatts, 10),
+    FOSSIBOT_FIELD(StatusReg::ACTIVE_OUTPUTS, BIT, usbActive,
+                   StateBits::USB_BIT),
+    FOSSIBOT_FIELD(StatusReg::ACTIVE_OUTPUTS, BIT, dcActive, StateBits::DC_BIT),
+    FOSSIBOT_FIELD(StatusReg::ACTIVE_OUTPUTS, BIT, acActive, StateBits::AC_BIT),
+    FOSSIBOT_FIELD(StatusReg::MAIN_SOC, FIXED, socPermille, 1),
+    FOSSIBOT_FIELD(StatusReg::TIME_TO_FULL, INT, minutesToFull, 1),
+    FOSSIBOT_FIELD(StatusReg::TIME_TO_EMPTY, INT, minutesToEmpty, 1),
+};
+
+// Settings (0x1103): holding registers read back at their write index
+static constexpr RegField SETTINGS_MAP[] = {
+    FOSSIBOT_FIELD(ControlReg::LIGHT_MODE, INT, lightMode, 1),
+    FOSSIBOT_FIELD(ControlReg::KEY_SOUND, FLAG, buzzerEnabled, 0),
+    FOSSIBOT_FIELD(ControlReg::SILENT_CHARGING, FLAG, silentCharging, 0),
+    FOSSIBOT_FIELD(ControlReg::SCREEN_TIMEOUT, INT, screenTimeout, 1),
+    FOSSIBOT_FIELD(ControlReg::AC_STANDBY, INT, acStandby, 1),
+    FOSSIBOT_FIELD(ControlReg::DC_STANDBY, INT, dcStandby, 1),
+    FOSSIBOT_FIELD(ControlReg::USB_STANDBY, INT, usbStandby, 1),
+    FOSSIBOT_FIELD(ControlReg::SCHEDULE_CHARGE, INT, scheduleCharge, 1),
+    FOSSIBOT_FIELD(ControlReg::DISCHARGE_LIMIT, INT, dischargeLimit, 10),
+    FOSSIBOT_FIELD(ControlReg::CHARGE_LIMIT, INT, chargeLimit, 10),
+    FOSSIBOT_FIELD(ControlReg::SYS_STANDBY, INT, sysStandby, 1),
+};
+
+#undef FOSSIBOT_FIELD
+
+// Status registers by how often they are wanted: power and charge for the
+// live view, then the outlet states. The full block (POLL_REGS from 0)
+// holds the rest, for the frame recorder.
+static constexpr uint8_t LIVE_REGS[] = {
+    StatusReg::AC_INPUT_WATTS,    StatusReg::DC_INPUT_WATTS,
+    StatusReg::TOTAL_INPUT_WATTS, StatusReg::BATTERY_VOLTAGE,
+    StatusReg::OUTPUT_WATTS,      StatusReg::MAIN_SOC,
+    StatusReg::TIME_TO_FULL,      StatusReg::TIME_TO_EMPTY,
+};
+static constexpr uint8_t STATE_REGS[] = {StatusReg::ACTIVE_OUTPUTS};
+
+// A run of registers read by one request
+struct RegRange {
+  uint8_t first;
+  uint8_t count;
+};
+
+// A request and its response cost about the airtime of this many
+// registers (the command, ATT and link-layer headers, the response header
+// and CRC, the gaps between packets), so shorter gaps are read through
+static const int RANGE_MERGE_GAP = 40;
+
+/**
+ * The fewest ranges worth requesting that cover the wanted registers
+ * @param wanted One flag per register from 0
+ * @return ranges written to out
+ */
+inline int coverRegisters(const bool (&wanted)[POLL_REGS], RegRange *out,
+                          int max) {
+  int count = 0;
+  int last = -1; // Last wanted register of the open range
+  for (int reg = 0; reg < POLL_REGS; reg++) {
+    if (!wanted[reg])
+      continue;
+    if (count && reg - last - 1 <= RANGE_MERGE_GAP) {
+      out[count - 1].count = reg - out[count - 1].first + 1;
+    } else {
+      if (count == max)
+        return count;
+      out[count++] = {(uint8_t)reg, 1};
+    }
+    last = reg;
+  }
+  return count;
+}
+
+/**
+ * Decode a response frame into PowerBankData using a register schema.
+ * Registers outside the frame are left unchanged.
+ * @param firstReg Register the frame's data starts at (a partial read)
+ * @return number of fields written
+ */
+template <size_t N>
+inline int decode(const RegField (&map)[N], const uint8_t *data,
+                  size_t length, PowerBankData &out, uint8_t firstReg = 0) {
+  uint8_t *base = reinterpret_cast<uint8_t *>(&out);
+  int written = 0;
+  for (size_t i = 0; i < N; i++) {
+    const RegField &f = map[i];
+    if (f.reg < firstReg)
+      continue;
+    size_t pos = REG_DATA_OFFSET + (f.reg - firstReg) * 2;
+    if (pos + 1 >= length)
+      continue;
+    uint16_t raw = (data[pos] << 8) | data[pos + 1];
+    void *field = base + f.offset;
+
+    switch (f.type) {
+    case FieldType::FIXED:
+      *static_cast<int32_t *>(field) = (int32_t)raw * f.arg;
+      break;
+    case FieldType::INT:
+      *static_cast<int *>(field) = raw / f.arg;
+      break;
+    case FieldType::FLAG:
+      *static_cast<bool *>(field) = raw == 1;
+      break;
+    case FieldType::BIT:
+      *static_cast<bool *>(field) = (raw & f.arg) != 0;
+      break;
+    }
+    written++;
+  }
+  return written;
+}
+
+/**
+ * Write PowerBankData fields into a response frame's registers using a
+ * register schema (the inverse of decode). Other registers are left as
+ * they are; BIT fields set or clear their bit of a shared register.
+ * @return number of fields written
+ */
+template <size_t N>
+inline int encode(const RegField (&map)[N], const PowerBankData &in,
+                  uint8_t *data, size_t length) {
+  const uint8_t *base = reinterpret_cast<const uint8_t *>(&in);
+  int written = 0;
+  for (size_t i = 0; i < N; i++) {
+    const RegField &f = map[i];
+    size_t pos = REG_DATA_OFFSET + f.reg * 2;
+    if (pos + 1 >= length)
+      continue;
+    uint16_t raw = (data[pos] << 8) | data[pos + 1];
+    const void *field = base + f.offset;
+
+    switch (f.type) {
+    case FieldType::FIXED: {
+      int32_t v = Fixed::divRound(*static_cast<const int32_t *>(field), f.arg);
+      raw = v <= 0 ? 0 : v >= 65535 ? 65535 : (uint16_t)v;
+      break;
+    }
+    case FieldType::INT: {
+      long v = (long)*static_cast<const int *>(field) * f.arg;
+      raw = v <= 0 ? 0 : v >= 65535 ? 65535 : (uint16_t)v;
+      break;
+    }
+    case FieldType::FLAG:
+      raw = *static_cast<const bool *>(field) ? 1 : 0;
+      break;
+    case FieldType::BIT:
+      if (*static_cast<const bool *>(field))
+        raw |= f.arg;
+      else
+        raw &= ~f.arg;
+      break;
+    }
+    data[pos] = raw >> 8;
+    data[pos + 1] = raw & 0xFF;
+    written++;
+  }
+  return written;
+}
+
+} // namespace Fossibot
+
+#endif // REGISTER_MAP_H
@@ -0,0 +1,123 @@
+/**
+ * Telemetry Beacon Implementation
+ */
+
+#include "telemetry_beacon.h"
+#include "../utils/log.h"
+#include <NimBLEDevice.h>
+
+static const uint32_t RESTART_MS = 5000; // Retry advertising this often
+
+TelemetryBeacon::TelemetryBeacon()
+    : _started(false), _enabled(false), _dirty(false), _seq(0), _lastPush(0),
+      _lastRestart(0), _service(nullptr) {
+  Fossibot::PowerBankData none;
+  encode(_payload, none, _seq);
+}
+
+void TelemetryBeacon::begin(const char *service) {
+  if (!NimBLEDevice::getInitialized()) {
+    NimBLEDevice::init("M5PaperS3");
+    NimBLEDevice::setSecurityAuth(false, false, false);
+  }
+  _service = service;
+  _started = true;
+  push();
+}
+
+void TelemetryBeacon::setEnabled(bool enabled) {
+  if (_enabled == enabled)
+    return;
+  _enabled = enabled;
+  _dirty = true;
+  LOG_I("Beacon", "Telemetry in the advertisement %s",
+        enabled ? "on" : "off");
+}
+
+void TelemetryBeacon::encode(uint8_t *out, const Fossibot::PowerBankData &data,
+                             uint8_t seq) {
+  auto watts = [](Fixed::Deciwatts dw) {
+    int32_t w = Fixed::watts(dw);
+    return (uint16_t)(w <= 0 ? 0 : (w >= 65535 ? 65535 : w));
+  };
+  uint16_t inW = watts(data.inputDeciwatts);
+  uint16_t outW = watts(data.outputDeciwatts);
+  out[0] = COMPANY_ID & 0xFF;
+  out[1] = COMPANY_ID >> 8;
+  out[2] = MAGIC;
+  out[3] = PAYLOAD_VERSION;
+  out[4] = seq;
+  out[5] = data.connected ? (uint8_t)Fixed::percent(data.socPermille)
+                        : 0xFF;
+  out[6] = inW & 0xFF;
+  out[7] = inW >> 8;
+  out[8] = outW & 0xFF;
+  out[9] = outW >> 8;
+  out[10] = (data.usbActive ? 1 : 0) | (data.dcActive ? 2 : 0) |
+            (data.acActive ? 4 : 0) | (data.connected ? 0x80 : 0);
+}
+
+void TelemetryBeacon::setData(const Fossibot::PowerBankData &data) {
+  // Only the readings count as a change, not the sequence number
+  uint8_t next[PAYLOAD_LEN];
+  encode(next, data, _seq);
+  if (memcmp(next + 5, _payload + 5, PAYLOAD_LEN - 5) == 0)
+    return;
+  memcpy(_payload, next, PAYLOAD_LEN);
+  _payload[4] = ++_seq;
+  if (_enabled)
+    _dirty = true;
+}
+
+uint32_t TelemetryBeacon::msUntilDue() const {
+  if (!_started || !_dirty)
+    return UINT32_MAX;
+  uint32_t since = millis() - _lastPush;
+  return since >= UPDATE_MS ? 0 : UPDATE_MS - since;
+}
+
+void TelemetryBeacon::update() {
+  if (!_started)
+    return;
+  if (msUntilDue() == 0) {
+    push();
+    return;
+  }
+
+  // A peer connecting stops the advertiser; listeners still want it
+  if (_enabled && !NimBLEDevice::getAdvertising()->isAdvertising() &&
+      millis() - _lastRestart >= RESTART_MS) {
+    _lastRestart = millis();
+    NimBLEDevice::startAdvertising();
+  }
+}
+
+void TelemetryBeacon::push() {
+  // Flags (3 bytes) and the summary (13) in the advertisement; the
+  // service (18) and name (11) in the scan response
+  NimBLEAdvertisementData adv;
+  adv.setFlags(BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP);
+  if (_enabled)
+    adv.setManufacturerData(std::string((const char *)_payload, PAYLOAD_LEN));
+  NimBLEAdvertisementData scan;
+  if (_service)
+    scan.setCompleteServices(NimBLEUUID(_service));
+  scan.setName("M5PaperS3");
+
+  NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
+  bool was = advertising->isAdvertising();
+  if (was)
+    advertising->stop();
+  advertising->setAdvertisementData(adv);
+  advertising->setScanResponseData(scan);
+  advertising->setScanResponse(true);
+  if (_enabled) { // 0.625 ms units; off, the stack's default stays
+    advertising->setMinInterval(ADV_INTERVAL_MS * 8 / 5);
+    advertising->setMaxInterval(ADV_INTERVAL_MS * 8 / 5);
+  }
+  if (was || _enabled)
+    advertising->start();
+
+  _dirty = false;
+  _lastPush = millis();
+}
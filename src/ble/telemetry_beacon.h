@@ -0,0 +1,97 @@
+/**
+ * Telemetry Beacon
+ *
+ * The power bank takes one central, and the panel is it; phones and other
+ * panels on site read the panel's own advertisement instead. With
+ * beacon.enabled the advertisement carries a summary of the dashboard
+ * frame as manufacturer data, so any number of passive scanners get the
+ * readings without connecting to anything:
+ *
+ *   [0xFF 0xFF]  company ID (none: the test ID)
+ *   [0xFB]       magic
+ *   [version]    PAYLOAD_VERSION
+ *   [seq]        bumped each time the readings in it change
+ *   [soc]        percent, 0xFF when no unit is connected
+ *   [in_w]       u16 LE
+ *   [out_w]      u16 LE
+ *   [outlets]    bit 0 USB, 1 DC, 2 AC; bit 7 connected
+ *
+ * It is the same connectable advertisement the history export (and OTA)
+ * service is found by: NimBLE as built here has legacy advertising only,
+ * one set, so the summary goes in the advertising data and the export
+ * service's UUID and the name move to the scan response. Advertising is
+ * started again after a peer connects, while NimBLE has a connection to
+ * spare.
+ *
+ * The advertisement is rebuilt at most every UPDATE_MS; a stopped and
+ * restarted advertiser is what NimBLE needs to change its data. Main loop
+ * task only.
+ */
+
+#ifndef TELEMETRY_BEACON_H
+#define TELEMETRY_BEACON_H
+
+#include "fossibot_protocol.h"
+#include <Arduino.h>
+
+class TelemetryBeacon {
+public:
+  static const uint16_t COMPANY_ID = 0xFFFF;
+  static const uint8_t MAGIC = 0xFB;
+  static const uint8_t PAYLOAD_VERSION = 1;
+  static const int PAYLOAD_LEN = 11; // Manufacturer data, company ID too
+  static const uint32_t UPDATE_MS = 2000;
+  static const uint16_t ADV_INTERVAL_MS = 500;
+
+  TelemetryBeacon();
+
+  /**
+   * Take over the advertisement (after the services have registered)
+   * @param service UUID the scan response names, or nullptr
+   */
+  void begin(const char *service);
+
+  /**
+   * Put the summary in the advertisement, or take it out
+   */
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return _enabled; }
+
+  /**
+   * Take a new dashboard frame
+   */
+  void setData(const Fossibot::PowerBankData &data);
+
+  /**
+   * Rebuild the advertisement when due, and restart advertising that a
+   * connection stopped. Call from the main loop.
+   */
+  void update();
+
+  /**
+   * Time until update() has a change to push, UINT32_MAX if none
+   */
+  uint32_t msUntilDue() const;
+
+  /**
+   * Fill a manufacturer data payload (PAYLOAD_LEN bytes) for data
+   */
+  static void encode(uint8_t *out, const Fossibot::PowerBankData &data,
+                     uint8_t seq);
+
+private:
+  bool _started;
+  bool _enabled;
+  bool _dirty;  // The advertisement is not what it should be
+  uint8_t _seq;
+  uint8_t _payload[PAYLOAD_LEN];
+  uint32_t _lastPush;
+  uint32_t _lastRestart;
+  const char *_service;
+
+  void push();
+};
+
+extern TelemetryBeacon *beacon;
+
+#endif // TELEMETRY_BEACON_H
@@ -0,0 +1,130 @@
+/**
+ * Adaptive Telemetry Scheduler
+ *
+ * Decides when to request the status (0x1104) and settings (0x1103)
+ * register groups. After a command or a large power swing it polls every
+ * FAST_INTERVAL_MS for a short window; while readings stay stable the
+ * status interval doubles up to MAX_INTERVAL_MS. Groups the UI is not
+ * subscribed to fall back to IDLE_INTERVAL_MS, saving radio wakeups. The
+ * power governor stretches every interval but the fast window by a scale.
+ */
+
+#ifndef TELEMETRY_SCHEDULER_H
+#define TELEMETRY_SCHEDULER_H
+
+#include <Arduino.h>
+
+namespace TelemetryGroup {
+static const uint8_t STATUS = 1 << 0;   // 0x1104 live telemetry
+static const uint8_t SETTINGS = 1 << 1; // 0x1103 device configuration
+} // namespace TelemetryGroup
+
+class TelemetryScheduler {
+public:
+  static const uint32_t FAST_INTERVAL_MS = 1500;
+  static const uint32_t FAST_WINDOW_MS = 15000;
+  static const uint32_t MIN_INTERVAL_MS = 3000; // First step after fast
+  static const uint32_t MAX_INTERVAL_MS = 30000;
+  static const uint32_t IDLE_INTERVAL_MS = 60000; // Unsubscribed groups
+  static const int BOOST_DELTA_W = 50;            // Power swing to boost on
+
+  TelemetryScheduler()
+      : _subscribed(TelemetryGroup::STATUS), _boosted(0), _fastUntil(0),
+        _interval(MIN_INTERVAL_MS), _nextStatus(0), _nextSettings(0),
+        _scale(1) {}
+
+  /**
+   * Set the register groups the visible screen needs. Newly subscribed
+   * groups are requested on the next due() call.
+   */
+  void subscribe(uint8_t groups, uint32_t now) {
+    uint8_t added = groups & ~_subscribed;
+    _subscribed = groups;
+    if (added & TelemetryGroup::STATUS)
+      _nextStatus = now;
+    if (added & TelemetryGroup::SETTINGS)
+      _nextSettings = now;
+  }
+  uint8_t getSubscribed() const { return _subscribed; }
+
+  /**
+   * Poll the given groups fast for FAST_WINDOW_MS (after a command, or
+   * when a reading jumps)
+   */
+  void boost(uint8_t groups, uint32_t now) {
+    _boosted = inFastWindow(now) ? (_boosted | groups) : groups;
+    _fastUntil = now + FAST_WINDOW_MS;
+    _interval = MIN_INTERVAL_MS;
+    if (groups & TelemetryGroup::STATUS)
+      _nextStatus = now + FAST_INTERVAL_MS;
+    if (groups & TelemetryGroup::SETTINGS)
+      _nextSettings = now + FAST_INTERVAL_MS;
+  }
+
+  /**
+   * Feed a decoded status frame
+   * @param deltaW Largest input/output power change since the last frame
+   * @param stable True if nothing changed beyond the display thresholds
+   */
+  void onStatus(int deltaW, bool stable, uint32_t now) {
+    if (deltaW >= BOOST_DELTA_W) {
+      boost(TelemetryGroup::STATUS, now);
+    } else if (stable) {
+      _interval = _interval * 2 < MAX_INTERVAL_MS ? _interval * 2
+                                                  : MAX_INTERVAL_MS;
+    } else {
+      _interval = MIN_INTERVAL_MS;
+    }
+  }
+
+  /**
+   * Groups whose request is due now; schedules their next request
+   */
+  uint8_t due(uint32_t now) {
+    uint8_t groups = 0;
+    if ((int32_t)(now - _nextStatus) >= 0) {
+      groups |= TelemetryGroup::STATUS;
+      _nextStatus = now + intervalFor(TelemetryGroup::STATUS, now);
+    }
+    if ((int32_t)(now - _nextSettings) >= 0) {
+      groups |= TelemetryGroup::SETTINGS;
+      _nextSettings = now + intervalFor(TelemetryGroup::SETTINGS, now);
+    }
+    return groups;
+  }
+
+  uint32_t getInterval() const { return _interval * _scale; }
+
+  /**
+   * Stretch the regular intervals (1 = as designed); command readback
+   * keeps the fast window
+   */
+  void setScale(uint8_t scale) { _scale = scale ? scale : 1; }
+
+private:
+  uint8_t _subscribed;
+  uint8_t _boosted;
+  uint32_t _fastUntil;
+  uint32_t _interval; // Current status backoff
+  uint32_t _nextStatus;
+  uint32_t _nextSettings;
+  uint8_t _scale;
+
+  bool inFastWindow(uint32_t now) const {
+    return (int32_t)(_fastUntil - now) > 0;
+  }
+
+  uint32_t intervalFor(uint8_t group, uint32_t now) const {
+    if ((_boosted & group) && inFastWindow(now))
+      return FAST_INTERVAL_MS;
+    if (!(_subscribed & group))
+      return IDLE_INTERVAL_MS * _scale;
+    // Settings rarely change on their own: never poll them faster than
+    // the slowest status step
+    if (group == TelemetryGroup::SETTINGS)
+      return MAX_INTERVAL_MS * _scale;
+    return _interval * _scale;
+  }
+};
+
+#endif // TELEMETRY_SCHEDULER_H
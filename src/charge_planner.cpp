@@ -0,0 +1,285 @@
+/**
+ * Charge Planner Implementation
+ */
+
+#include "charge_planner.h"
+#include "ble/ble_client.h"
+#include "utils/config.h"
+#include "utils/log.h"
+#include <math.h>
+
+extern Config *config;
+extern FossibotBLE *bleClient;
+
+static const time_t VALID_TIME = 1700000000; // Clock set (2023+)
+static const float MIN_WH = 1.0f;            // Less is "no charge"
+
+ChargePlanner::ChargePlanner()
+    : _folded(0), _seeded(false), _planStart(0), _planMade(0),
+      _capacityWh(0), _planned(false), _haveData(false), _lastCheck(0) {
+  for (int i = 0; i < WEEK_HOURS; i++) {
+    _loadW[i] = 0;
+    _loadWeeks[i] = 0;
+  }
+  for (int i = 0; i < HORIZON_HOURS; i++)
+    _chargeWh[i] = 0;
+  for (int i = 0; i <= HORIZON_HOURS; i++)
+    _pathWh[i] = 0;
+}
+
+bool ChargePlanner::enabled() const {
+  return config && config->getTariffCount() > 0;
+}
+
+void ChargePlanner::setData(const Fossibot::PowerBankData &data) {
+  _data = data;
+  _haveData = data.connected;
+}
+
+int ChargePlanner::hourOfWeek(time_t t) {
+  struct tm local;
+  localtime_r(&t, &local);
+  return local.tm_wday * 24 + local.tm_hour;
+}
+
+// Mean price over [from, to), sampled every quarter hour
+float ChargePlanner::price(time_t from, time_t to) const {
+  float sum = 0;
+  int samples = 0;
+  for (time_t t = from; t < to; t += 900) {
+    sum += config->getTariffPriceAt(t);
+    samples++;
+  }
+  return samples ? sum / samples : config->getTariffPrice();
+}
+
+float ChargePlanner::expectedLoadW(time_t hour) const {
+  int slot = hourOfWeek(hour);
+  if (_loadWeeks[slot])
+    return _loadW[slot];
+
+  // An hour not seen yet: the average of those that have been
+  float sum = 0;
+  int known = 0;
+  for (int i = 0; i < WEEK_HOURS; i++) {
+    if (_loadWeeks[i]) {
+      sum += _loadW[i];
+      known++;
+    }
+  }
+  if (known)
+    return sum / known;
+  return _haveData ? Fixed::toFloat(_data.outputDeciwatts, Fixed::DW_PER_W)
+                   : 0;
+}
+
+void ChargePlanner::fold(const RollupBucket &bucket) {
+  if (bucket.count < 30)
+    return; // Mostly asleep or disconnected that hour
+  int slot = hourOfWeek(bucket.start);
+  if (_loadWeeks[slot] == 0)
+    _loadW[slot] = bucket.meanOutW();
+  else
+    _loadW[slot] += PROFILE_ALPHA * (bucket.meanOutW() - _loadW[slot]);
+  if (_loadWeeks[slot] < 255)
+    _loadWeeks[slot]++;
+}
+
+void ChargePlanner::seed(const HistoryRollup &rollup) {
+  const RollupTier &tier = rollup.tier(HistoryRollup::HOUR);
+  // Age 0 is the hour still filling; oldest first so recent weeks weigh
+  // the most
+  int folded = 0;
+  for (int age = tier.size() - 1; age >= 1; age--) {
+    const RollupBucket *b = tier.get(age);
+    if (!b || b->count == 0)
+      continue;
+    fold(*b);
+    _folded = b->start;
+    folded++;
+  }
+  LOG_I("Charge", "Load profile from %d hours of history", folded);
+}
+
+void ChargePlanner::update(const PowerHistory *history, float capacityWh) {
+  if (!enabled() || !history)
+    return;
+
+  // Each completed hour joins the profile
+  if (!_seeded) {
+    seed(history->getRollup());
+    _seeded = true;
+  } else {
+    const RollupBucket *b =
+        history->getRollup().tier(HistoryRollup::HOUR).get(1);
+    if (b && b->start > _folded) {
+      fold(*b);
+      _folded = b->start;
+    }
+  }
+
+  time_t now = time(nullptr);
+  if (!_haveData || now < VALID_TIME || capacityWh <= 0)
+    return;
+
+  if (!_planned || now >= _planStart + 3600 ||
+      fabsf(capacityWh - _capacityWh) > 0.05f * capacityWh || offPlan(now)) {
+    _capacityWh = capacityWh;
+    plan(now);
+    _lastCheck = millis() - CHECK_MS; // Program right away
+  }
+  if (millis() - _lastCheck >= CHECK_MS) {
+    _lastCheck = millis();
+    program(now);
+  }
+}
+
+// The charge has strayed from the path planned for the current hour
+bool ChargePlanner::offPlan(time_t now) const {
+  time_t end = _planStart + 3600;
+  if (end <= _planMade)
+    return false;
+  float f = (float)(now - _planMade) / (end - _planMade);
+  float expected = _pathWh[0] + (_pathWh[1] - _pathWh[0]) * f;
+  float actual = _capacityWh * _data.socPermille / Fixed::FULL;
+  return fabsf(actual - expected) > _capacityWh * REPLAN_PCT / 100.0f;
+}
+
+void ChargePlanner::plan(time_t now) {
+  _planStart = now - now % 3600;
+  _planMade = now;
+
+  float fullWh = _capacityWh;
+  float reserveWh = _capacityWh * config->getReservePct() / 100.0f;
+  float loadWh[HORIZON_HOURS];
+  float maxWh[HORIZON_HOURS];
+  float cost[HORIZON_HOURS];
+  for (int h = 0; h < HORIZON_HOURS; h++) {
+    time_t start = _planStart + h * 3600;
+    time_t from = h == 0 ? now : start;
+    float hours = (start + 3600 - from) / 3600.0f;
+    loadWh[h] = expectedLoadW(start) * hours;
+    maxWh[h] = config->getChargeW() * hours;
+    cost[h] = price(from, start + 3600);
+    _chargeWh[h] = 0;
+  }
+
+  // Cover the first shortfall below the reserve from the cheapest hour
+  // before it, and repeat; each pass fills one hour or one shortfall. A
+  // shortfall nothing can cover (already below the reserve, charging as
+  // fast as it can) is let go, and the hours after it are planned on.
+  int uncovered = -1; // Shortfalls up to this hour are let go
+  for (int pass = 0; pass < 4 * HORIZON_HOURS; pass++) {
+    _pathWh[0] = _capacityWh * _data.socPermille / Fixed::FULL;
+    int deficitAt = -1;
+    float need = 0;
+    for (int h = 0; h < HORIZON_HOURS; h++) {
+      float e = _pathWh[h] + _chargeWh[h] - loadWh[h];
+      _pathWh[h + 1] = e > fullWh ? fullWh : (e < 0 ? 0 : e);
+      if (deficitAt < 0 && h > uncovered && e < reserveWh - MIN_WH) {
+        deficitAt = h;
+        need = reserveWh - e;
+      }
+    }
+    if (deficitAt < 0)
+      break;
+
+    // Scan back from the shortfall: energy bought in hour s raises the
+    // path up to the shortfall, so it needs room below full all the way
+    int best = -1;
+    float bestRoom = 0;
+    float room = fullWh;
+    for (int s = deficitAt; s >= 0; s--) {
+      float headroom = fullWh - _pathWh[s + 1];
+      if (headroom < room)
+        room = headroom;
+      if (room < MIN_WH)
+        break;
+      if (_chargeWh[s] < maxWh[s] - MIN_WH &&
+          (best < 0 || cost[s] < cost[best])) {
+        best = s;
+        bestRoom = room;
+      }
+    }
+    if (best < 0) {
+      uncovered = deficitAt;
+      continue;
+    }
+    float add = need;
+    if (add > maxWh[best] - _chargeWh[best])
+      add = maxWh[best] - _chargeWh[best];
+    if (add > bestRoom)
+      add = bestRoom;
+    _chargeWh[best] += add;
+  }
+
+  float totalWh = 0;
+  float totalCost = 0;
+  int firstHour = -1;
+  for (int h = 0; h < HORIZON_HOURS; h++) {
+    if (_chargeWh[h] < MIN_WH)
+      continue;
+    if (firstHour < 0)
+      firstHour = h;
+    totalWh += _chargeWh[h];
+    totalCost += _chargeWh[h] / 1000.0f * cost[h];
+  }
+  _planned = true;
+  LOG_I("Charge", "Plan: %.0f Wh for %.2f over %d h, first in hour %d%s",
+        totalWh, totalCost, HORIZON_HOURS, firstHour,
+        uncovered >= 0 ? " (below the reserve for a while)" : "");
+}
+
+void ChargePlanner::program(time_t now) {
+  if (!_planned || !_haveData || !_data.settingsReceived || !bleClient ||
+      !bleClient->isConnected() || bleClient->hasPendingCommands())
+    return;
+
+  int first = -1;
+  for (int h = 0; h < HORIZON_HOURS && first < 0; h++)
+    if (_chargeWh[h] >= MIN_WH)
+      first = h;
+
+  int scheduleMin;
+  int chargeLimit = MIN_CHARGE_LIMIT;
+  if (first < 0) {
+    // Nothing to buy: hold charging off past the horizon
+    scheduleMin = (_planStart + HORIZON_HOURS * 3600 - now) / 60;
+  } else {
+    // Stop at the charge planned for the end of that hour; the next hour
+    // is programmed when it comes (the unit cannot charge below 60%, so
+    // a small top-up buys more and the next plan needs less)
+    float target = _pathWh[first + 1] / _capacityWh * 100.0f;
+    chargeLimit = (int)ceilf(target / 5.0f) * 5;
+    chargeLimit = constrain(chargeLimit, MIN_CHARGE_LIMIT, 100);
+    time_t start = _planStart + first * 3600;
+    scheduleMin = first == 0 ? 0 : (start - now + 59) / 60;
+  }
+  int dischargeLimit =
+      constrain(config->getReservePct(), 0, MAX_DISCHARGE_LIMIT);
+
+  if (_data.chargeLimit != chargeLimit)
+    bleClient->setChargeLimit(chargeLimit);
+  if (_data.dischargeLimit != dischargeLimit)
+    bleClient->setDischargeLimit(dischargeLimit);
+  int running = _data.scheduleCharge;
+  if ((scheduleMin == 0) != (running == 0) ||
+      abs(running - scheduleMin) > SCHEDULE_SLACK_MIN)
+    bleClient->setScheduleCharge(scheduleMin);
+}
+
+time_t ChargePlanner::nextChange() const {
+  if (!_planned)
+    return 0;
+  time_t now = time(nullptr);
+  // Every hour that starts, continues or ends a run is programmed anew
+  for (int h = 1; h < HORIZON_HOURS; h++) {
+    bool was = _chargeWh[h - 1] >= MIN_WH;
+    bool is = _chargeWh[h] >= MIN_WH;
+    time_t at = _planStart + h * 3600;
+    if ((was || is) && at > now)
+      return at;
+  }
+  time_t refresh = _planMade + 86400;
+  return refresh > now ? refresh : now + 3600;
+}
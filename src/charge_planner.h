@@ -0,0 +1,110 @@
+/**
+ * Charge Planner
+ *
+ * Time-of-use charging for the primary power bank. The tariff in the
+ * settings gives a price for every quarter hour of the week; the load is
+ * an hour-of-week profile of the output power, seeded from the history's
+ * hourly rollups and folded forward as each hour completes. Solar is not
+ * subtracted (the history does not split it from mains), so plans err on
+ * the side of charging.
+ *
+ * Over the next HORIZON_HOURS the planner keeps the battery above
+ * tariff.reserve_pct at the lowest cost: wherever the projected charge
+ * would fall below the reserve, it buys the missing energy in the
+ * cheapest hour before that point that still has charge rate and room in
+ * the battery, latest first among equal prices, until the reserve holds.
+ *
+ * The plan is programmed with the registers the unit already has:
+ * SCHEDULE_CHARGE holds AC charging off until the next planned hour,
+ * CHARGE_LIMIT stops it at the charge planned for the end of that hour,
+ * DISCHARGE_LIMIT keeps the reserve. Writes go through the BLE command
+ * queue and only when the unit's readback differs. The plan is rebuilt
+ * at each hour boundary or when the charge strays from it, and the next
+ * hour that needs programming is a WakeSchedule event, so deep sleep
+ * wakes for it.
+ */
+
+#ifndef CHARGE_PLANNER_H
+#define CHARGE_PLANNER_H
+
+#include "ble/fossibot_protocol.h"
+#include "power_history.h"
+#include <Arduino.h>
+#include <time.h>
+
+class ChargePlanner {
+public:
+  static const int HORIZON_HOURS = 48;
+  static const int WEEK_HOURS = 7 * 24;
+  static const uint32_t CHECK_MS = 60000; // Compare the program this often
+  static const int SCHEDULE_SLACK_MIN = 3; // Countdown drift before a resend
+  static const int MIN_CHARGE_LIMIT = 60;  // Register ranges
+  static const int MAX_DISCHARGE_LIMIT = 30;
+  static constexpr float PROFILE_ALPHA = 0.3f;  // Weight of a new week
+  static constexpr float REPLAN_PCT = 5.0f;     // Off the plan by this
+
+  ChargePlanner();
+
+  /**
+   * A tariff is configured
+   */
+  bool enabled() const;
+
+  /**
+   * Take a new frame from the primary unit. Call from the main loop.
+   */
+  void setData(const Fossibot::PowerBankData &data);
+
+  /**
+   * Learn the load, re-plan when due and program the unit. Call from the
+   * main loop.
+   * @param history The loaded history, or nullptr (still loading, or a
+   *        fleet whose totals do not describe the primary unit)
+   * @param capacityWh Usable capacity of the primary unit
+   */
+  void update(const PowerHistory *history, float capacityWh);
+
+  /**
+   * Drop the plan so the next update() makes one at the new prices
+   */
+  void replan() { _planned = false; }
+
+  /**
+   * The next hour boundary that starts, continues or ends a planned run,
+   * or a day after the plan was made; 0 without a plan
+   */
+  time_t nextChange() const;
+
+private:
+  // Load profile: mean output power by local hour of the week
+  float _loadW[WEEK_HOURS];
+  uint8_t _loadWeeks[WEEK_HOURS];
+  uint32_t _folded; // Start of the newest hourly rollup folded in
+  bool _seeded;
+
+  // Plan: energy bought in each hour from _planStart (slot 0 is the
+  // current hour, partly gone), and the charge at the end of each hour
+  float _chargeWh[HORIZON_HOURS];
+  float _pathWh[HORIZON_HOURS + 1];
+  time_t _planStart;
+  time_t _planMade;
+  float _capacityWh;
+  bool _planned;
+
+  Fossibot::PowerBankData _data;
+  bool _haveData;
+  uint32_t _lastCheck; // millis()
+
+  static int hourOfWeek(time_t t);
+  float price(time_t from, time_t to) const;
+  float expectedLoadW(time_t hour) const;
+  void seed(const HistoryRollup &rollup);
+  void fold(const RollupBucket &bucket);
+  bool offPlan(time_t now) const;
+  void plan(time_t now);
+  void program(time_t now);
+};
+
+extern ChargePlanner *planner;
+
+#endif // CHARGE_PLANNER_H
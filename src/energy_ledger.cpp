@@ -0,0 +1,227 @@
+/**
+ * Energy Ledger Implementation
+ */
+
+#include "energy_ledger.h"
+#include "utils/config.h"
+#include "utils/log.h"
+#include "utils/sd_manager.h"
+
+extern Config *config;
+
+#define LEDGER_FILE_MAGIC 0x5244474C // "LGDR"
+#define LEDGER_FILE_VERSION 1
+
+EnergyLedger::EnergyLedger()
+    : _head(0), _count(0), _folded(0), _dirty(false), _totalsDate(0) {
+  memset(_days, 0, sizeof(_days));
+  memset(_split, 0, sizeof(_split));
+  memset(_totals, 0, sizeof(_totals));
+}
+
+bool EnergyLedger::enabled() const {
+  return config &&
+         (config->getTariffPrice() > 0 || config->getTariffCount() > 0);
+}
+
+uint32_t EnergyLedger::dateKey(time_t t) {
+  struct tm local;
+  localtime_r(&t, &local);
+  return (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 +
+         local.tm_mday;
+}
+
+void EnergyLedger::addMinute(uint32_t timestamp, float inW, float solarW) {
+  uint32_t hour = timestamp - timestamp % 3600;
+  HourSplit *slot = nullptr;
+  for (HourSplit &s : _split)
+    if (s.start == hour)
+      slot = &s;
+  if (!slot) { // A new hour takes the older slot
+    slot = _split[0].start < _split[1].start ? &_split[0] : &_split[1];
+    *slot = {hour, 0, 0};
+  }
+  slot->inWh += inW / 60.0f;
+  slot->solarWh += solarW / 60.0f;
+}
+
+EnergyLedger::Day *EnergyLedger::dayFor(uint32_t date) {
+  // Hours fold oldest first, so a day is the newest one or a new one
+  for (int i = 0; i < _count; i++) {
+    Day &d = _days[(_head - i + DAYS) % DAYS];
+    if (d.date == date)
+      return &d;
+    if (d.date < date)
+      break;
+  }
+  if (_count && _days[_head].date > date)
+    return nullptr; // Older than the newest day and not held
+  if (_count)
+    _head = (_head + 1) % DAYS;
+  if (_count < DAYS)
+    _count++;
+  Day &d = _days[_head];
+  memset(&d, 0, sizeof(d));
+  d.date = date;
+  return &d;
+}
+
+void EnergyLedger::fold(const RollupBucket &bucket) {
+  Day *day = dayFor(dateKey(bucket.start));
+  if (!day)
+    return;
+
+  // The hour's price: the mean of its quarters, as the planner buys
+  float price = 0;
+  for (int q = 0; q < 4; q++)
+    price += config->getTariffPriceAt(bucket.start + q * 900) / 4;
+
+  float inWh = bucket.energyInWh();
+  float solarWh = 0;
+  bool split = false;
+  for (const HourSplit &s : _split) {
+    if (s.start == bucket.start && s.inWh > 0) {
+      float share = s.solarWh / s.inWh;
+      solarWh = inWh * (share > 1 ? 1 : (share < 0 ? 0 : share));
+      split = true;
+    }
+  }
+
+  day->inWh += inWh;
+  day->solarWh += solarWh;
+  day->outWh += bucket.energyOutWh();
+  day->gridCost += (inWh - solarWh) / 1000.0f * price;
+  day->solarValue += solarWh / 1000.0f * price;
+  day->outValue += bucket.energyOutWh() / 1000.0f * price;
+  day->hours++;
+  if (!split && inWh > 0)
+    day->estimatedHours++;
+}
+
+void EnergyLedger::update(const HistoryRollup &rollup) {
+  if (!enabled())
+    return;
+
+  // Age 0 is the hour still filling; walk back to the first hour not
+  // priced yet (a whole tier on first use, usually one), then forward
+  const RollupTier &tier = rollup.tier(HistoryRollup::HOUR);
+  int age = 1;
+  for (const RollupBucket *b; (b = tier.get(age)) && b->start > _folded;)
+    age++;
+  int folded = 0;
+  for (age--; age >= 1; age--) {
+    const RollupBucket *b = tier.get(age);
+    if (b->count)
+      fold(*b);
+    _folded = b->start;
+    folded++;
+  }
+  if (!folded)
+    return;
+  _dirty = true;
+  _totalsDate = 0;
+  if (folded > 1)
+    LOG_I("Ledger", "Priced %d hours of history", folded);
+}
+
+void EnergyLedger::recount(uint32_t today) {
+  // The dates the periods start from, by the calendar
+  time_t now = time(nullptr);
+  struct tm local;
+  localtime_r(&now, &local);
+  local.tm_hour = 12; // Clear of DST shifts
+  local.tm_mday -= 1;
+  uint32_t yesterday = dateKey(mktime(&local));
+  local.tm_mday -= 5;
+  uint32_t weekStart = dateKey(mktime(&local));
+  uint32_t month = today / 100;
+  uint32_t lastMonth = month % 100 == 1 ? month - 100 + 11 : month - 1;
+
+  memset(_totals, 0, sizeof(_totals));
+  for (int i = 0; i < _count; i++) {
+    const Day &d = _days[(_head - i + DAYS) % DAYS];
+    bool in[PERIOD_COUNT] = {d.date == today, d.date == yesterday,
+                             d.date >= weekStart && d.date <= today,
+                             d.date / 100 == month,
+                             d.date / 100 == lastMonth};
+    for (int p = 0; p < PERIOD_COUNT; p++) {
+      if (!in[p])
+        continue;
+      Totals &t = _totals[p];
+      t.inWh += d.inWh;
+      t.solarWh += d.solarWh;
+      t.outWh += d.outWh;
+      t.gridCost += d.gridCost;
+      t.solarValue += d.solarValue;
+      t.outValue += d.outValue;
+      t.hours += d.hours;
+      t.estimatedHours += d.estimatedHours;
+    }
+  }
+  _totalsDate = today;
+}
+
+const EnergyLedger::Totals &EnergyLedger::totals(Period period) {
+  uint32_t today = dateKey(time(nullptr));
+  if (_totalsDate != today)
+    recount(today);
+  return _totals[period];
+}
+
+const char *EnergyLedger::periodName(Period period) {
+  static const char *const NAMES[PERIOD_COUNT] = {
+      "Today", "Yesterday", "7 days", "This month", "Last month"};
+  return NAMES[period];
+}
+
+bool EnergyLedger::saveToSD(const char *path) {
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("[Ledger] Failed to open %s\n", path);
+    return false;
+  }
+
+  uint32_t header[3] = {LEDGER_FILE_MAGIC,
+                        LEDGER_FILE_VERSION | (sizeof(Day) << 8), _folded};
+  bool ok = file.write((const uint8_t *)header, sizeof(header)) ==
+            sizeof(header);
+  // Oldest first
+  for (int i = _count - 1; ok && i >= 0; i--)
+    ok = file.write((const uint8_t *)&_days[(_head - i + DAYS) % DAYS],
+                    sizeof(Day)) == sizeof(Day);
+  file.close();
+
+  if (ok)
+    _dirty = false;
+  return ok;
+}
+
+bool EnergyLedger::loadFromSD(const char *path) {
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return false;
+
+  uint32_t header[3];
+  bool ok = file.read((uint8_t *)header, sizeof(header)) == sizeof(header) &&
+            header[0] == LEDGER_FILE_MAGIC &&
+            header[1] == (LEDGER_FILE_VERSION | (sizeof(Day) << 8));
+  if (ok) {
+    _head = 0;
+    _count = 0;
+    Day d;
+    while (file.read((uint8_t *)&d, sizeof(d)) == sizeof(d)) {
+      if (_count)
+        _head = (_head + 1) % DAYS;
+      _days[_head] = d;
+      if (_count < DAYS)
+        _count++;
+    }
+    _folded = header[2];
+    _totalsDate = 0;
+  }
+  file.close();
+
+  Serial.printf("[Ledger] %d days %s from %s\n", _count,
+                ok ? "loaded" : "not loaded", path);
+  return ok;
+}
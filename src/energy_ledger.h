@@ -0,0 +1,117 @@
+/**
+ * Energy Ledger
+ *
+ * What the energy through the power bank cost and what the solar input
+ * saved, priced at the tariff in the settings. Each hourly rollup is
+ * priced once, as it closes, into a per-day record (input, the solar
+ * part of it, output, and their value at that hour's price); a summary
+ * of today, yesterday, the last 7 days, this month and last month is
+ * kept over the day records, so the cost screen only reads totals and
+ * never walks the history.
+ *
+ * The rollups do not split solar from mains, so the split is taken live:
+ * each minute's input is divided by the frame's DC share and summed per
+ * hour. An hour closed without it (seeded at boot, drained after sleep)
+ * counts its whole input as mains and is marked estimated.
+ *
+ * Saved next to the history as ledger.bin, with the newest hour folded
+ * in, so a restart carries on from the rollups without counting an hour
+ * twice.
+ */
+
+#ifndef ENERGY_LEDGER_H
+#define ENERGY_LEDGER_H
+
+#include "history_rollup.h"
+#include <Arduino.h>
+#include <time.h>
+
+class EnergyLedger {
+public:
+  static const int DAYS = 62; // This month and the last
+
+  // One local day (packed: also the on-disk record)
+  struct __attribute__((packed)) Day {
+    uint32_t date; // YYYYMMDD, 0 = empty
+    float inWh;
+    float solarWh; // Of inWh
+    float outWh;
+    float gridCost;   // Mains input at the tariff
+    float solarValue; // Solar input at the tariff: the saving
+    float outValue;   // Output at the tariff: the load's cost from mains
+    uint8_t hours;
+    uint8_t estimatedHours; // Without the solar split
+  };
+
+  enum Period { TODAY, YESTERDAY, WEEK, MONTH, LAST_MONTH, PERIOD_COUNT };
+
+  struct Totals {
+    float inWh;
+    float solarWh;
+    float outWh;
+    float gridCost;
+    float solarValue;
+    float outValue;
+    uint16_t hours;
+    uint16_t estimatedHours;
+  };
+
+  EnergyLedger();
+
+  /**
+   * A tariff price is configured
+   */
+  bool enabled() const;
+
+  /**
+   * Split one minute of input (inW, of which solarW from DC) into the
+   * hour it belongs to
+   */
+  void addMinute(uint32_t timestamp, float inW, float solarW);
+
+  /**
+   * Price every hourly rollup closed since the last one folded in
+   * (oldest first), and refresh the summary
+   */
+  void update(const HistoryRollup &rollup);
+
+  /**
+   * Totals for a period, as of now; recounted from the day records only
+   * when an hour has closed or the date has moved on
+   */
+  const Totals &totals(Period period);
+
+  static const char *periodName(Period period);
+
+  // Start of the newest hour priced, 0 = none
+  uint32_t foldedUntil() const { return _folded; }
+
+  bool isDirty() const { return _dirty; }
+  bool saveToSD(const char *path);
+  bool loadFromSD(const char *path);
+
+private:
+  // Live split of the hours not closed yet (current and previous)
+  struct HourSplit {
+    uint32_t start;
+    float inWh;
+    float solarWh;
+  };
+
+  Day _days[DAYS]; // Ring, newest at _head
+  uint16_t _head;
+  uint16_t _count;
+  uint32_t _folded;
+  HourSplit _split[2];
+  bool _dirty;
+
+  Totals _totals[PERIOD_COUNT];
+  uint32_t _totalsDate; // Local date the totals were counted on, 0 = stale
+
+  static uint32_t dateKey(time_t t);
+  Day *dayFor(uint32_t date);
+  void fold(const RollupBucket &bucket);
+  void recount(uint32_t today);
+};
+
+#endif // ENERGY_LEDGER_H
@@ -0,0 +1,162 @@
+/**
+ * Battery Monitor Implementation
+ */
+
+#include "battery.h"
+#include <esp_adc/adc_cali.h>
+#include <esp_adc/adc_cali_scheme.h>
+#include <esp_adc/adc_oneshot.h>
+#include <esp_timer.h>
+
+namespace Battery {
+
+static const adc_channel_t CHANNEL = ADC_CHANNEL_2; // GPIO3 on ADC1
+static const adc_atten_t ATTEN = ADC_ATTEN_DB_12;   // Full range
+static const uint32_t FULL_SCALE_MV = 3100; // Chips without eFuse data
+
+// LiPo discharge curve (Calibrated: 3.93V+ = 100%)
+static const uint16_t CURVE[][2] = {
+    {3930, 100}, {3900, 95}, {3870, 90}, {3840, 85}, {3810, 80},
+    {3790, 75},  {3770, 70}, {3750, 65}, {3730, 60}, {3710, 55},
+    {3690, 50},  {3670, 45}, {3650, 40}, {3620, 35}, {3600, 30},
+    {3570, 25},  {3530, 20}, {3480, 15}, {3400, 10}, {3300, 5},
+    {3200, 0}};
+static const int CURVE_SIZE = sizeof(CURVE) / sizeof(CURVE[0]);
+
+static const uint16_t TABLE_TOP_MV = 3930;
+static const uint16_t TABLE_BOTTOM_MV = 3200;
+static const uint16_t TABLE_STEP_MV = 5;
+static const int TABLE_SIZE =
+    (TABLE_TOP_MV - TABLE_BOTTOM_MV) / TABLE_STEP_MV + 1;
+
+static uint8_t _table[TABLE_SIZE];
+static bool _tableBuilt = false;
+
+static adc_oneshot_unit_handle_t _adc = nullptr;
+static adc_cali_handle_t _cali = nullptr; // nullptr: no eFuse data
+static esp_timer_handle_t _timer = nullptr;
+static portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t _ema = 0; // Millivolts << EMA_SHIFT, 0 = no sample yet
+static volatile uint16_t _millivolts = 0;
+static volatile uint8_t _percent = 0;
+
+// Linear interpolation on the curve (only used to fill the table)
+static int interpolate(uint16_t mv) {
+  if (mv >= CURVE[0][0])
+    return 100;
+  if (mv <= CURVE[CURVE_SIZE - 1][0])
+    return 0;
+  for (int i = 0; i < CURVE_SIZE - 1; i++) {
+    if (mv >= CURVE[i + 1][0]) {
+      int v1 = CURVE[i][0], p1 = CURVE[i][1];
+      int v2 = CURVE[i + 1][0], p2 = CURVE[i + 1][1];
+      return p1 + (mv - v1) * (p2 - p1) / (v2 - v1);
+    }
+  }
+  return 0;
+}
+
+static void buildTable() {
+  for (int i = 0; i < TABLE_SIZE; i++)
+    _table[i] = interpolate(TABLE_BOTTOM_MV + i * TABLE_STEP_MV);
+  _tableBuilt = true;
+}
+
+static int lookup(uint32_t mv) {
+  if (mv >= TABLE_TOP_MV)
+    return 100;
+  if (mv <= TABLE_BOTTOM_MV)
+    return 0;
+  return _table[(mv - TABLE_BOTTOM_MV) / TABLE_STEP_MV];
+}
+
+// Runs on the esp_timer task (and once from init(), before the timer)
+static void takeSample() {
+  uint16_t raw[OVERSAMPLE];
+  for (int i = 0; i < OVERSAMPLE; i++) {
+    int r = 0;
+    if (adc_oneshot_read(_adc, CHANNEL, &r) != ESP_OK)
+      r = 0;
+    uint16_t v = r > 0 ? r : 0;
+    // Insertion sort as the reads come in
+    int j = i;
+    for (; j > 0 && raw[j - 1] > v; j--)
+      raw[j] = raw[j - 1];
+    raw[j] = v;
+  }
+
+  // Middle half only: EPD and radio bursts show up as outliers
+  uint32_t sum = 0;
+  for (int i = OVERSAMPLE / 4; i < OVERSAMPLE * 3 / 4; i++)
+    sum += raw[i];
+  uint32_t mid = sum / (OVERSAMPLE / 2);
+  int adcMv = mid * FULL_SCALE_MV / 4095;
+  if (_cali)
+    adc_cali_raw_to_voltage(_cali, mid, &adcMv);
+  uint32_t mv = (uint32_t)(adcMv * VOLTAGE_DIVIDER);
+
+  portENTER_CRITICAL(&_mux);
+  if (_ema == 0)
+    _ema = mv << EMA_SHIFT; // First sample seeds the filter
+  else
+    _ema = _ema + mv - (_ema >> EMA_SHIFT);
+  uint32_t filtered = _ema >> EMA_SHIFT;
+  portEXIT_CRITICAL(&_mux);
+
+  _millivolts = filtered;
+  _percent = lookup(filtered);
+}
+
+static void onTimer(void *) { takeSample(); }
+
+void init() {
+  if (_timer)
+    return;
+  if (!_tableBuilt)
+    buildTable();
+
+  adc_oneshot_unit_init_cfg_t unit = {};
+  unit.unit_id = ADC_UNIT_1;
+  adc_oneshot_chan_cfg_t channel = {};
+  channel.atten = ATTEN;
+  channel.bitwidth = ADC_BITWIDTH_12;
+  if (adc_oneshot_new_unit(&unit, &_adc) != ESP_OK ||
+      adc_oneshot_config_channel(_adc, CHANNEL, &channel) != ESP_OK) {
+    Serial.println("Battery: ADC1 unavailable, no battery readings");
+    return;
+  }
+  adc_cali_curve_fitting_config_t cali = {};
+  cali.unit_id = ADC_UNIT_1;
+  cali.chan = CHANNEL;
+  cali.atten = ATTEN;
+  cali.bitwidth = ADC_BITWIDTH_12;
+  if (adc_cali_create_scheme_curve_fitting(&cali, &_cali) != ESP_OK)
+    _cali = nullptr;
+  takeSample();
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTimer;
+  args.name = "battery";
+  if (esp_timer_create(&args, &_timer) != ESP_OK ||
+      esp_timer_start_periodic(_timer, SAMPLE_INTERVAL_MS * 1000ULL) !=
+          ESP_OK) {
+    Serial.println("Battery: Sampling timer failed, reading once");
+    return;
+  }
+  Serial.printf("Battery: %u mV (%d%%), %s calibration\n", _millivolts,
+                _percent, _cali ? "eFuse" : "no");
+}
+
+uint16_t getMillivolts() { return _millivolts; }
+
+int voltageToPercentage(float voltage) {
+  if (!_tableBuilt)
+    buildTable();
+  if (voltage <= 0)
+    return 0;
+  return lookup((uint32_t)(voltage * 1000.0f + 0.5f));
+}
+
+int getPercentage() { return _percent; }
+
+} // namespace Battery
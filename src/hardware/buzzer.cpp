@@ -0,0 +1,156 @@
+/**
+ * Buzzer Implementation
+ */
+
+#include "buzzer.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+namespace Buzzer {
+
+// Classic 8-bit victory climb, then the signature Mario-style ending
+static const Note VICTORY[] = {
+    {1319, 120}, {0, 20}, // E6
+    {1568, 120}, {0, 20}, // G6
+    {1760, 120}, {0, 20}, // A6
+    {2093, 180}, {0, 40}, // C7
+    {2637, 250}, {0, 30}, // E7
+    {2093, 400},          // C7 (final resolve)
+};
+static const uint8_t VICTORY_LEN = sizeof(VICTORY) / sizeof(VICTORY[0]);
+static const uint16_t ALARM_PAUSE_MS = 200; // Between repeats
+
+static const Note ERROR_TONE = {300, 200};
+static const Note CLICK_TONE = {800, 10};
+
+struct Command {
+  const Note *notes; // nullptr: play single
+  uint8_t count;     // 0: stop
+  uint8_t repeat;
+  uint16_t pauseMs;
+  Note single; // A one-off beep, carried by value
+};
+
+static QueueHandle_t _queue = nullptr; // Depth 1: the newest sound wins
+static TaskHandle_t _task = nullptr;
+static volatile bool _playing = false;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t _awakeLock = nullptr;
+#endif
+
+static void hold(bool on) {
+#if CONFIG_PM_ENABLE
+  static bool held = false;
+  if (!_awakeLock || on == held)
+    return;
+  held = on;
+  if (on)
+    esp_pm_lock_acquire(_awakeLock);
+  else
+    esp_pm_lock_release(_awakeLock);
+#endif
+}
+
+static void sequencerTask(void *) {
+  Command cmd = {};
+  int index = 0;
+  int pass = 0;
+  TickType_t wait = portMAX_DELAY;
+  for (;;) {
+    Command next;
+    if (xQueueReceive(_queue, &next, wait) == pdTRUE) {
+      // Cuts off whatever was playing
+      cmd = next;
+      if (!cmd.notes)
+        cmd.notes = &cmd.single;
+      index = 0;
+      pass = 0;
+    }
+
+    uint32_t ms;
+    if (index < cmd.count) {
+      const Note &note = cmd.notes[index++];
+      hold(true);
+      ledcWriteTone(PIN, note.hz);
+      ms = note.ms;
+    } else if (cmd.count && ++pass < cmd.repeat) {
+      index = 0;
+      ledcWriteTone(PIN, 0);
+      ms = cmd.pauseMs;
+    } else {
+      // Finished or stopped: sleep until the next sound
+      ledcWriteTone(PIN, 0);
+      cmd.count = 0;
+      _playing = uxQueueMessagesWaiting(_queue) > 0;
+      hold(false);
+      wait = portMAX_DELAY;
+      continue;
+    }
+    wait = ms ? pdMS_TO_TICKS(ms) : 0;
+    if (wait == 0)
+      wait = 1;
+  }
+}
+
+bool init() {
+  if (_task)
+    return true;
+
+  // Arduino-ESP32 3.x picks the LEDC channel itself and keys it by pin
+  if (!ledcAttach(PIN, 1000, LEDC_BITS)) {
+    Serial.println("Buzzer: Failed to attach LEDC");
+    return false;
+  }
+  ledcWriteTone(PIN, 0);
+
+#if CONFIG_PM_ENABLE
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "buzzer", &_awakeLock);
+#endif
+  _queue = xQueueCreate(1, sizeof(Command));
+  if (!_queue ||
+      xTaskCreatePinnedToCore(sequencerTask, "buzzer", TASK_STACK, nullptr,
+                              TASK_PRIORITY, &_task, TASK_CORE) != pdPASS) {
+    Serial.println("Buzzer: Failed to start sequencer task");
+    _task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+static void send(const Command &cmd) {
+  if (!_queue)
+    return;
+  _playing = cmd.count > 0;
+  xQueueOverwrite(_queue, &cmd);
+}
+
+void play(const Note *notes, uint8_t count, uint8_t repeat,
+          uint16_t pauseMs) {
+  send({notes, count, repeat ? repeat : (uint8_t)1, pauseMs, {0, 0}});
+}
+
+bool isPlaying() { return _playing; }
+
+void stop() { send({nullptr, 0, 0, 0, {0, 0}}); }
+
+void beep(int frequency, int duration) {
+  send({nullptr, 1, 1, 0, {(uint16_t)frequency, (uint16_t)duration}});
+}
+
+void success() { play(VICTORY, VICTORY_LEN); }
+
+void error() { beep(ERROR_TONE.hz, ERROR_TONE.ms); }
+
+void alarm(int count) {
+  if (count > 0)
+    play(VICTORY, VICTORY_LEN, min(count, 255), ALARM_PAUSE_MS);
+}
+
+void click() { beep(CLICK_TONE.hz, CLICK_TONE.ms); }
+
+} // namespace Buzzer
@@ -2,6 +2,13 @@
  * Buzzer Hardware Abstraction
  *
  * M5Paper S3 has a passive buzzer.
+ *
+ * Sounds are note tables played by a small sequencer task that drives the
+ * pin from an LEDC channel: play() queues a melody and returns at once, so
+ * feedback and alarms never hold up touch, BLE or rendering. A new sound
+ * cuts off the one playing, and stop() silences it. While a melody plays
+ * the task holds off automatic light sleep, which would stop the LEDC
+ * clock mid-note.
  */
 
 #ifndef BUZZER_H
@@ -14,80 +21,70 @@ namespace Buzzer {
 // Buzzer pin (GPIO 21 per M5Paper S3 schematic)
 static const int PIN = 21;
 
+// LEDC resolution for the tone (50% duty)
+static const uint8_t LEDC_BITS = 10;
+
+// Sequencer task: same core and priority as the Arduino loop task
+static const BaseType_t TASK_CORE = 1;
+static const UBaseType_t TASK_PRIORITY = 1;
+static const uint32_t TASK_STACK = 2048;
+
 /**
- * Initialize buzzer
+ * One step of a melody; hz 0 is a rest
  */
-inline void init() {
-  pinMode(PIN, OUTPUT);
-  digitalWrite(PIN, LOW);
-}
+struct Note {
+  uint16_t hz;
+  uint16_t ms;
+};
 
 /**
- * Play a beep
- * @param frequency Frequency in Hz
- * @param duration Duration in ms
+ * Attach the pin to LEDC and start the sequencer task
+ */
+bool init();
+
+/**
+ * Play count notes, repeat times over with pauseMs of silence between.
+ * notes must outlive the melody (tables are static). Returns at once.
  */
-inline void beep(int frequency = 1000, int duration = 100) {
-  tone(PIN, frequency, duration);
-}
+void play(const Note *notes, uint8_t count, uint8_t repeat = 1,
+          uint16_t pauseMs = 0);
 
 /**
- * Stop buzzer
+ * True until the last note of the last repeat has ended
+ */
+bool isPlaying();
+
+/**
+ * Silence the buzzer and drop the melody
+ */
+void stop();
+
+/**
+ * Play a beep
+ * @param frequency Frequency in Hz
+ * @param duration Duration in ms
  */
-inline void stop() { noTone(PIN); }
+void beep(int frequency = 1000, int duration = 100);
 
 /**
  * Play success sound
  */
-inline void success() {
-  // Classic 8-bit victory climb
-  beep(1319, 120); // E6
-  delay(20);
-  beep(1568, 120); // G6
-  delay(20);
-  beep(1760, 120); // A6
-  delay(20);
-  beep(2093, 180); // C7
-  delay(40);
-
-  // Signature Mario-style ending
-  beep(2637, 250); // E7
-  delay(30);
-  beep(2093, 400); // C7 (final resolve)
-}
+void success();
 
 /**
  * Play error sound
  */
-inline void error() { beep(300, 200); }
+void error();
 
 /**
- * Play alarm sound (Mario-style victory tune)
+ * Play alarm sound (Mario-style victory tune) count times
  */
-inline void alarm(int count = 1) {
-  for (int i = 0; i < count; i++) {
-    // Classic 8-bit victory climb
-    beep(1319, 120); // E6
-    delay(20);
-    beep(1568, 120); // G6
-    delay(20);
-    beep(1760, 120); // A6
-    delay(20);
-    beep(2093, 180); // C7
-    delay(40);
-    // Signature Mario-style ending
-    beep(2637, 250); // E7
-    delay(30);
-    beep(2093, 400); // C7 (final resolve)
-    if (i < count - 1)
-      delay(200);
-  }
-}
+void alarm(int count = 1);
 
 /**
  * Play click sound (for button feedback)
  */
-inline void click() { beep(800, 10); }
+void click();
 
 } // namespace Buzzer
 
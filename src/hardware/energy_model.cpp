@@ -0,0 +1,246 @@
+/**
+ * Energy Model Implementation
+ */
+
+#include "energy_model.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <sys/time.h>
+
+namespace EnergyModel {
+
+namespace {
+
+// Typical draw per state, mA at the battery
+const float MA[STATE_COUNT] = {
+    45.0f,  // CPU_ACTIVE: 240 MHz, both cores, PSRAM
+    8.0f,   // CPU_IDLE: 80 MHz, light sleep between events
+    0.2f,   // CPU_DEEP_SLEEP: board quiescent, RTC running
+    0.0f,   // BLE_IDLE
+    1.5f,   // BLE_ADVERTISING: 500 ms interval
+    22.0f,  // BLE_SCANNING: passive scan (connecting scans too)
+    3.0f,   // BLE_CONNECTED: modem sleep between connection events
+    0.0f,   // WIFI_OFF
+    70.0f,  // WIFI_RADIO: station up and listening, unjoined
+    20.0f,  // WIFI_JOINED: modem sleep between DTIM beacons
+    110.0f, // EPD_QUALITY: panel PMIC and source drivers
+    100.0f, // EPD_TEXT
+    100.0f, // EPD_FAST
+    90.0f,  // EPD_FASTEST
+    0.0f,   // SD_OFF
+    0.5f,   // SD_IDLE: card standby
+    40.0f,  // SD_ACTIVE: transfers
+};
+
+const char *const STATE_NAMES[STATE_COUNT] = {
+    "active",  "idle",        "deep sleep",              // CPU
+    "idle",    "advertising", "scanning",   "connected", // BLE
+    "off",     "radio",       "joined",                  // WiFi
+    "quality", "text",        "fast",       "fastest",   // EPD
+    "off",     "idle",        "active"};                 // SD
+
+const char *const SUBSYSTEM_NAMES[SUBSYSTEM_COUNT] = {"cpu", "ble", "wifi",
+                                                      "epd", "sd"};
+
+// Each subsystem's states start here, in State order
+const State FIRST[SUBSYSTEM_COUNT] = {State::CPU_ACTIVE, State::BLE_IDLE,
+                                      State::WIFI_OFF, State::EPD_QUALITY,
+                                      State::SD_OFF};
+
+const uint32_t RTC_MAGIC = 0x454E5247;               // "ENRG"
+const int64_t MAX_SLEEP_US = 30LL * 86400 * 1000000; // A clock jump beyond
+
+struct Totals {
+  uint32_t magic;
+  uint64_t us[STATE_COUNT];
+  uint32_t updates[EPD_MODES];
+  uint64_t elapsedUs; // Closed before the current boot's open stretch
+  int64_t sleptAt;    // Wall clock at deep sleep, 0 when awake
+};
+
+// Survives deep sleep and restarts; checked against the magic
+RTC_NOINIT_ATTR Totals _totals;
+
+State _current[SUBSYSTEM_COUNT]; // EPD's is unused: updates are charged
+int64_t _since[SUBSYSTEM_COUNT];
+int64_t _openSince = 0; // Start of the stretch not yet in elapsedUs
+bool _started = false;
+portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+int64_t wallUs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+bool timed(Subsystem subsystem) { return subsystem != Subsystem::EPD; }
+
+// Move the open intervals into the totals (lock held)
+void closeAll(int64_t now) {
+  for (int s = 0; s < SUBSYSTEM_COUNT; s++) {
+    if (!timed((Subsystem)s))
+      continue;
+    _totals.us[(int)_current[s]] += now - _since[s];
+    _since[s] = now;
+  }
+  _totals.elapsedUs += now - _openSince;
+  _openSince = now;
+}
+
+void clearTotals() {
+  memset(&_totals, 0, sizeof(_totals));
+  _totals.magic = RTC_MAGIC;
+}
+
+} // namespace
+
+void begin() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (_totals.magic != RTC_MAGIC || reason == ESP_RST_POWERON ||
+      reason == ESP_RST_BROWNOUT)
+    clearTotals();
+
+  // The sleep that ended with this boot, from the RTC clock
+  int64_t slept = _totals.sleptAt ? wallUs() - _totals.sleptAt : 0;
+  if (reason == ESP_RST_DEEPSLEEP && slept > 0 && slept < MAX_SLEEP_US) {
+    _totals.us[(int)State::CPU_DEEP_SLEEP] += slept;
+    _totals.elapsedUs += slept;
+  }
+  _totals.sleptAt = 0;
+
+  int64_t now = esp_timer_get_time();
+  for (int s = 0; s < SUBSYSTEM_COUNT; s++) {
+    _current[s] = FIRST[s]; // CPU_ACTIVE: boot runs flat out
+    _since[s] = now;
+  }
+  _openSince = now;
+  _started = true;
+}
+
+void set(State state) {
+  if (!_started || state >= State::COUNT)
+    return;
+  int s = (int)subsystemOf(state);
+  if (!timed((Subsystem)s))
+    return;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  if (_current[s] != state) {
+    _totals.us[(int)_current[s]] += now - _since[s];
+    _current[s] = state;
+    _since[s] = now;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+void charge(State state, uint32_t us) {
+  if (!_started || state >= State::COUNT)
+    return;
+  portENTER_CRITICAL(&_lock);
+  _totals.us[(int)state] += us;
+  int mode = (int)state - (int)State::EPD_QUALITY;
+  if (mode >= 0 && mode < EPD_MODES)
+    _totals.updates[mode]++;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void enterDeepSleep() {
+  if (!_started)
+    return;
+  portENTER_CRITICAL(&_lock);
+  closeAll(esp_timer_get_time());
+  portEXIT_CRITICAL(&_lock);
+  _totals.sleptAt = wallUs();
+}
+
+Subsystem subsystemOf(State state) {
+  int s = SUBSYSTEM_COUNT - 1;
+  while (s > 0 && state < FIRST[s])
+    s--;
+  return (Subsystem)s;
+}
+
+const char *subsystemName(Subsystem subsystem) {
+  return subsystem < Subsystem::COUNT ? SUBSYSTEM_NAMES[(int)subsystem] : "?";
+}
+
+const char *stateName(State state) {
+  return state < State::COUNT ? STATE_NAMES[(int)state] : "?";
+}
+
+float currentMa(State state) {
+  return state < State::COUNT ? MA[(int)state] : 0;
+}
+
+void report(Report &out) {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  memcpy(out.us, _totals.us, sizeof(out.us));
+  memcpy(out.updates, _totals.updates, sizeof(out.updates));
+  out.elapsedUs = _totals.elapsedUs;
+  if (_started) {
+    for (int s = 0; s < SUBSYSTEM_COUNT; s++) {
+      if (timed((Subsystem)s))
+        out.us[(int)_current[s]] += now - _since[s];
+    }
+    out.elapsedUs += now - _openSince;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+float mAh(const Report &report, State state) {
+  return report.us[(int)state] / 3.6e9f * MA[(int)state];
+}
+
+float mAh(const Report &report, Subsystem subsystem) {
+  float total = 0;
+  for (int i = 0; i < STATE_COUNT; i++) {
+    if (subsystemOf((State)i) == subsystem)
+      total += mAh(report, (State)i);
+  }
+  return total;
+}
+
+void reset() {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_lock);
+  clearTotals();
+  for (int s = 0; s < SUBSYSTEM_COUNT; s++)
+    _since[s] = now;
+  _openSince = now;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void dump(Print &out) {
+  Report r;
+  report(r);
+  float hours = r.elapsedUs / 3.6e9f;
+  float total = 0;
+  out.printf("Energy: %.2f h, %-6s %-11s %10s %6s %9s\n", hours, "system",
+             "state", "time s", "mA", "mAh");
+  for (int i = 0; i < STATE_COUNT; i++) {
+    State state = (State)i;
+    if (!r.us[i])
+      continue;
+    out.printf("Energy: %-6s %-11s %10.1f %6.1f %9.3f\n",
+               subsystemName(subsystemOf(state)), stateName(state),
+               r.us[i] / 1e6f, MA[i], mAh(r, state));
+  }
+  for (int s = 0; s < SUBSYSTEM_COUNT; s++) {
+    float used = mAh(r, (Subsystem)s);
+    total += used;
+    out.printf("Energy: %-6s %9.3f mAh, %7.3f mAh/h\n",
+               subsystemName((Subsystem)s), used,
+               hours > 0 ? used / hours : 0.0f);
+  }
+  out.printf("Energy: EPD updates %u quality, %u text, %u fast, %u fastest\n",
+             (unsigned)r.updates[0], (unsigned)r.updates[1],
+             (unsigned)r.updates[2], (unsigned)r.updates[3]);
+  if (hours > 0 && total > 0)
+    out.printf("Energy: %.2f mA average, %.0f h on a %d mAh charge\n",
+               total / hours, BATTERY_MAH / (total / hours), BATTERY_MAH);
+}
+
+} // namespace EnergyModel
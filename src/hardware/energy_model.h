@@ -0,0 +1,118 @@
+/**
+ * Energy Model
+ *
+ * Where the battery goes, estimated: the time each subsystem spends in
+ * each of its states, times a per-state current, gives mAh per subsystem
+ * and its average draw (mAh per hour). The subsystems report their own
+ * state changes with set():
+ *
+ *   CPU    full clock while interacting, DFS/light sleep between events
+ *          (PowerMode), deep sleep (enterDeepSleep() to the next boot)
+ *   BLE    idle, advertising, scanning/connecting, connected
+ *   WiFi   off, radio up without a network (mesh), joined
+ *   SD     not mounted, mounted and idle, inside an access
+ *
+ * The EPD only draws while a waveform runs, so each update is charged
+ * with charge() instead: its waveform's state for as long as the update
+ * takes (RefreshScheduler, from the EPD cost model when it is loaded).
+ *
+ * The totals are kept in RTC memory, so they run on across deep sleep
+ * (the time asleep is taken from the RTC clock at the next boot) and
+ * only start over after a power-on or reset(). The currents (in the
+ * table in energy_model.cpp) are typical figures for the parts at the
+ * battery, from datasheets and published M5PaperS3 measurements; a bench
+ * measurement of a state replaces its entry.
+ *
+ * set() and charge() are safe from any task. The numbers are on the
+ * Perf -> POWER screen and in "PROF".
+ */
+
+#ifndef ENERGY_MODEL_H
+#define ENERGY_MODEL_H
+
+#include <Arduino.h>
+
+namespace EnergyModel {
+
+enum class Subsystem : uint8_t { CPU, BLE, WIFI, EPD, SD, COUNT };
+
+enum class State : uint8_t {
+  CPU_ACTIVE,
+  CPU_IDLE,
+  CPU_DEEP_SLEEP,
+  BLE_IDLE,
+  BLE_ADVERTISING,
+  BLE_SCANNING,
+  BLE_CONNECTED,
+  WIFI_OFF,
+  WIFI_RADIO,
+  WIFI_JOINED,
+  EPD_QUALITY, // Waveforms in RefreshScheduler::MODE_ORDER
+  EPD_TEXT,
+  EPD_FAST,
+  EPD_FASTEST,
+  SD_OFF,
+  SD_IDLE,
+  SD_ACTIVE,
+  COUNT
+};
+
+static const int SUBSYSTEM_COUNT = (int)Subsystem::COUNT;
+static const int STATE_COUNT = (int)State::COUNT;
+static const int EPD_MODES = 4;      // EPD_QUALITY..EPD_FASTEST
+static const int BATTERY_MAH = 1800; // M5PaperS3 cell
+
+struct Report {
+  uint64_t us[STATE_COUNT];    // In each state (EPD: charged)
+  uint32_t updates[EPD_MODES]; // EPD updates per waveform
+  uint64_t elapsedUs;          // Since the start, asleep included
+};
+
+/**
+ * Start timing (early in setup()): adds the deep sleep that ended with
+ * this boot, or starts over after a power-on
+ */
+void begin();
+
+/**
+ * The subsystem the state belongs to is now in it
+ */
+void set(State state);
+
+/**
+ * Charge time in a state without entering it (an EPD update)
+ */
+void charge(State state, uint32_t us);
+
+/**
+ * Close the intervals and note the time, just before deep sleep
+ */
+void enterDeepSleep();
+
+Subsystem subsystemOf(State state);
+const char *subsystemName(Subsystem subsystem);
+const char *stateName(State state);
+
+/**
+ * The state's current, mA at the battery
+ */
+float currentMa(State state);
+
+/**
+ * The totals as of now, open intervals included
+ */
+void report(Report &out);
+
+/**
+ * mAh in a report: one state, or a whole subsystem
+ */
+float mAh(const Report &report, State state);
+float mAh(const Report &report, Subsystem subsystem);
+
+void reset();
+
+void dump(Print &out);
+
+} // namespace EnergyModel
+
+#endif // ENERGY_MODEL_H
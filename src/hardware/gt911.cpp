@@ -0,0 +1,269 @@
+/**
+ * GT911 Touch Controller Driver Implementation
+ */
+
+#include "gt911.h"
+#include "../utils/profiler.h"
+#include "../utils/spsc_ring.h"
+#include "../utils/wake.h"
+#include "i2c_bus.h"
+#include "power_mode.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace GT911 {
+
+static SpscRing<TouchSample, RING_SIZE> _ring;
+static TaskHandle_t _task = nullptr;
+static bool _touching = false;
+static TouchSample _lastPrimary = {};
+static uint32_t _dropped = 0;
+static volatile int64_t _irqUs = 0; // Last INT edge, for readUs
+
+// Configuration as last read or written, valid once the checksum matched
+static uint8_t _config[CONFIG_SIZE];
+static bool _configValid = false;
+
+static_assert(REG_CONFIG_FRESH == REG_CONFIG_CHECKSUM + 1,
+              "Checksum and fresh flag go out in one write");
+
+// Bus transactions stay well inside the Wire buffer
+static const int CONFIG_CHUNK = 32;
+
+struct ProfileFields {
+  uint8_t refreshRate; // Report every 5+N ms
+  uint8_t lowPowerS;   // Seconds without a touch before the low-power scan
+};
+static const ProfileFields PROFILES[] = {
+    {15, 1}, // IDLE
+    {0, 15}, // PEN
+};
+
+static void IRAM_ATTR onTouchInterrupt() {
+  _irqUs = esp_timer_get_time();
+  BaseType_t woken = pdFALSE;
+  if (_task)
+    vTaskNotifyGiveFromISR(_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void writeReg(uint16_t reg, uint8_t value) {
+  uint8_t tx[3] = {(uint8_t)(reg >> 8), (uint8_t)(reg & 0xFF), value};
+  I2CBus::transfer(ADDR, tx, 3, nullptr, 0);
+}
+
+static void clearStatus() { writeReg(REG_STATUS, 0x00); }
+
+// Two's complement of the byte sum, as the controller checks it
+static uint8_t configChecksum(const uint8_t *config) {
+  uint8_t sum = 0;
+  for (int i = 0; i < CONFIG_SIZE; i++)
+    sum += config[i];
+  return (uint8_t)(~sum + 1);
+}
+
+// Read the block and its checksum; keep it only if they agree
+static bool loadConfig() {
+  uint8_t raw[CONFIG_SIZE + 1];
+  I2CBus::Lock lock;
+  for (int off = 0; off < CONFIG_SIZE + 1; off += CONFIG_CHUNK) {
+    int len = min(CONFIG_CHUNK, CONFIG_SIZE + 1 - off);
+    uint16_t reg = REG_CONFIG + off;
+    const uint8_t addr[2] = {(uint8_t)(reg >> 8), (uint8_t)(reg & 0xFF)};
+    if (!I2CBus::transfer(ADDR, addr, 2, raw + off, len))
+      return false;
+  }
+  if (configChecksum(raw) != raw[CONFIG_SIZE]) {
+    Serial.printf("GT911: Config checksum mismatch (0x%02X, expected "
+                  "0x%02X), leaving it alone\n",
+                  raw[CONFIG_SIZE], configChecksum(raw));
+    return false;
+  }
+  memcpy(_config, raw, CONFIG_SIZE);
+  _configValid = true;
+  return true;
+}
+
+static void pushSample(const TouchSample &sample) {
+  if (!_ring.push(sample))
+    _dropped++;
+}
+
+// Read the controller once and push decoded samples; irqUs is the INT
+// edge that asked for the read, 0 for a watchdog read
+static void service(int64_t irqUs) {
+  TouchSample points[MAX_POINTS];
+  int count = readPoints(points);
+  if (count < 0)
+    return;
+  uint16_t readUs = 0;
+  if (irqUs) {
+    int64_t lag = esp_timer_get_time() - irqUs;
+    readUs = lag < 1 ? 1 : lag > UINT16_MAX ? UINT16_MAX : (uint16_t)lag;
+  }
+  for (int i = 0; i < count; i++)
+    points[i].readUs = readUs;
+
+  // Treat an edge-of-panel primary point as no touch (matches old filter)
+  if (count > 0) {
+    const TouchSample &p = points[0];
+    if (p.x <= 0 || p.x >= SCREEN_W || p.y <= 0 || p.y >= SCREEN_H)
+      count = 0;
+  }
+
+  if (count == 0) {
+    if (!_touching)
+      return;
+    TouchSample release = _lastPrimary;
+    release.pressed = false;
+    release.readUs = readUs;
+    release.timeUs = esp_timer_get_time();
+    pushSample(release);
+    _touching = false;
+    return;
+  }
+
+  for (int i = 0; i < count; i++)
+    pushSample(points[i]);
+
+  _touching = true;
+  _lastPrimary = points[0];
+}
+
+static void inputTask(void *) {
+  // Drain anything latched before the ISR was attached
+  service(0);
+
+  for (;;) {
+    // Idle: block until INT. While a finger is down, wake anyway after the
+    // watchdog period so a missed release report cannot stick the touch.
+    TickType_t wait = _touching ? pdMS_TO_TICKS(RELEASE_WATCHDOG_MS)
+                                : portMAX_DELAY;
+    bool irq = ulTaskNotifyTake(pdTRUE, wait) > 0;
+    PROFILE_ZONE(TOUCH_READ);
+    service(irq ? _irqUs : 0);
+    Wake::signal(Wake::TOUCH);
+  }
+}
+
+bool init() {
+  if (_task)
+    return true;
+
+  BaseType_t ok = xTaskCreatePinnedToCore(inputTask, "gt911_input",
+                                          INPUT_TASK_STACK, nullptr,
+                                          INPUT_TASK_PRIORITY, &_task,
+                                          INPUT_TASK_CORE);
+  if (ok != pdPASS) {
+    Serial.println("GT911: Failed to start input task");
+    _task = nullptr;
+    return false;
+  }
+
+  pinMode(INT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(INT_PIN), onTouchInterrupt, FALLING);
+  PowerMode::wakeOnLow(INT_PIN); // A touch wakes the chip from light sleep
+
+  Serial.printf("GT911: Input task on core %d, INT on GPIO %d\n",
+                INPUT_TASK_CORE, INT_PIN);
+  if (loadConfig())
+    Serial.printf("GT911: Config v%u, reports every %u ms\n", _config[0],
+                  5 + (_config[CFG_REFRESH_RATE] & 0x0F));
+  return true;
+}
+
+bool setProfile(Profile profile) {
+  if (!_configValid && !loadConfig())
+    return false;
+
+  const ProfileFields &f = PROFILES[(int)profile];
+  uint8_t config[CONFIG_SIZE];
+  memcpy(config, _config, CONFIG_SIZE);
+  config[CFG_REFRESH_RATE] = (config[CFG_REFRESH_RATE] & 0xF0) | f.refreshRate;
+  config[CFG_LOW_POWER] = (config[CFG_LOW_POWER] & 0xF0) | f.lowPowerS;
+  if (memcmp(config, _config, CONFIG_SIZE) == 0)
+    return true; // Already set
+
+  // The block, then checksum and fresh flag together: the controller only
+  // takes the new values once the flag is written and the sum matches
+  I2CBus::Lock lock;
+  uint8_t tx[2 + CONFIG_CHUNK];
+  for (int off = 0; off < CONFIG_SIZE; off += CONFIG_CHUNK) {
+    int len = min(CONFIG_CHUNK, CONFIG_SIZE - off);
+    uint16_t reg = REG_CONFIG + off;
+    tx[0] = reg >> 8;
+    tx[1] = reg & 0xFF;
+    memcpy(tx + 2, config + off, len);
+    if (!I2CBus::transfer(ADDR, tx, 2 + len, nullptr, 0))
+      return false;
+  }
+  const uint8_t tail[4] = {REG_CONFIG_CHECKSUM >> 8,
+                           REG_CONFIG_CHECKSUM & 0xFF, configChecksum(config),
+                           0x01};
+  if (!I2CBus::transfer(ADDR, tail, 4, nullptr, 0))
+    return false;
+
+  memcpy(_config, config, CONFIG_SIZE);
+  Serial.printf("GT911: %s profile, reports every %u ms\n",
+                profile == Profile::PEN ? "Pen" : "Idle", 5 + f.refreshRate);
+  return true;
+}
+
+void softReset() {
+  Serial.println("Attempting GT911 Soft Reset...");
+  writeReg(REG_COMMAND, 0x02); // 2 = Soft Reset
+  delay(50);
+  writeReg(REG_COMMAND, 0x00); // Back to coordinate reading mode
+  delay(100);
+}
+
+int readPoints(TouchSample *points) {
+  uint8_t raw[BURST_SIZE];
+  I2CBus::Lock lock; // Read and status clear back to back
+
+  // One burst: status byte followed by all five point records
+  const uint8_t reg[2] = {REG_STATUS >> 8, REG_STATUS & 0xFF};
+  if (!I2CBus::transfer(ADDR, reg, 2, raw, BURST_SIZE))
+    return -1;
+
+  uint8_t status = raw[0];
+
+  // Clear Status even if invalid to release INT line
+  clearStatus();
+
+  // Buffer-ready bit with zero points is the controller's release report
+  if (!(status & 0x80))
+    return 0;
+  int count = status & 0x0F;
+  if (count > MAX_POINTS)
+    count = MAX_POINTS;
+
+  int64_t now = esp_timer_get_time();
+  for (int i = 0; i < count; i++) {
+    const uint8_t *rec = &raw[1 + i * POINT_RECORD_SIZE];
+    int raw_x = rec[1] | (rec[2] << 8);
+    int raw_y = rec[3] | (rec[4] << 8);
+
+    // --- COORDINATE TRANSFORMATION ---
+    // M5Paper S3 Touch Panel is 540x960 (Portrait), screen is landscape.
+    // Screen X = Raw Y (Long Axis) - Low Y is Left (USB)
+    // Screen Y = 540 - Raw X (Inverted Short Axis) - Low X is Top
+    TouchSample &p = points[i];
+    p.x = constrain(raw_y, 0, SCREEN_W);
+    p.y = constrain(SCREEN_H - raw_x, 0, SCREEN_H);
+    p.size = rec[5] | (rec[6] << 8);
+    p.trackId = rec[0];
+    p.pressed = true;
+    p.primary = (i == 0);
+    p.readUs = 0; // service() knows the INT edge
+    p.timeUs = now;
+  }
+  return count;
+}
+
+bool popSample(TouchSample &sample) { return _ring.pop(sample); }
+
+uint32_t getDroppedCount() { return _dropped; }
+
+} // namespace GT911
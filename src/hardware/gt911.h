@@ -0,0 +1,136 @@
+/**
+ * GT911 Touch Controller Driver
+ *
+ * Interrupt-driven reader for the GT911 on the shared Wire bus
+ * (SDA=41, SCL=42). The controller pulls INT (GPIO 48) low whenever a new
+ * coordinate report is ready, so point registers are only read on demand
+ * instead of being polled from the main loop.
+ *
+ * Each report is fetched with a single burst read (status + all five point
+ * records) and decoded into timestamped samples on an SPSC ring, so the UI
+ * sees every sample even when a frame stalls on an EPD refresh.
+ *
+ * The GT911 is owned by a dedicated input task pinned to core 0. The ISR
+ * only notifies that task; the Arduino loop (core 1) just pops samples, so
+ * touch latency stays bounded while the EPD or SD card blocks the loop.
+ *
+ * The controller's configuration block (0x8047-0x80FE, checksummed) sets
+ * how often it reports and how soon it drops to its low-power scan. It is
+ * read and checked once at init; setProfile() then patches those two
+ * fields: fastest reports where the pen draws, slower ones and an early
+ * low-power scan everywhere else, deep sleep included.
+ */
+
+#ifndef GT911_H
+#define GT911_H
+
+#include <Arduino.h>
+
+namespace GT911 {
+
+// I2C address and INT line
+constexpr uint8_t ADDR = 0x5D;
+constexpr uint8_t INT_PIN = 48;
+
+// Register addresses
+constexpr uint16_t REG_COMMAND = 0x8040;
+constexpr uint16_t REG_CONFIG = 0x8047;          // Config_Version, first byte
+constexpr uint16_t REG_CONFIG_CHECKSUM = 0x80FF; // Over 0x8047-0x80FE
+constexpr uint16_t REG_CONFIG_FRESH = 0x8100;    // Host writes 1 to apply
+constexpr uint16_t REG_STATUS = 0x814E;
+constexpr uint16_t REG_POINT1 = 0x814F; // First point record (TrackID)
+
+// Configuration block and the fields the profiles set (bits 0-3 of each)
+constexpr int CONFIG_SIZE = REG_CONFIG_CHECKSUM - REG_CONFIG;
+constexpr int CFG_LOW_POWER = 0x8055 - REG_CONFIG;    // Idle s to low power
+constexpr int CFG_REFRESH_RATE = 0x8056 - REG_CONFIG; // Report every 5+N ms
+
+// Point record layout: TrackID, XL, XH, YL, YH, SizeL, SizeH, Reserved
+constexpr int MAX_POINTS = 5;
+constexpr int POINT_RECORD_SIZE = 8;
+constexpr int BURST_SIZE = 1 + MAX_POINTS * POINT_RECORD_SIZE;
+
+// Screen space after rotation (panel is 540x960 portrait)
+constexpr int SCREEN_W = 960;
+constexpr int SCREEN_H = 540;
+
+// While a finger is down, re-check the controller if INT has been quiet this
+// long (guards against a missed release report)
+constexpr uint32_t RELEASE_WATCHDOG_MS = 60;
+
+// Sample ring depth (must be a power of two)
+constexpr size_t RING_SIZE = 128;
+
+// Input task: core 0, above the Arduino loop task (priority 1, core 1)
+constexpr BaseType_t INPUT_TASK_CORE = 0;
+constexpr UBaseType_t INPUT_TASK_PRIORITY = 5;
+constexpr uint32_t INPUT_TASK_STACK = 4096;
+
+/**
+ * Configuration profiles
+ */
+enum class Profile : uint8_t {
+  IDLE, // Taps and swipes: 20 ms reports, low-power scan after 1 s idle
+  PEN,  // Drawing: 5 ms reports, low-power scan held off for 15 s
+};
+
+/**
+ * One decoded touch sample (screen coordinates)
+ *
+ * A report with N fingers down produces N samples sharing a timestamp; the
+ * first record is flagged primary. A release produces a single primary
+ * sample with pressed=false at the last known position.
+ */
+struct TouchSample {
+  int16_t x;
+  int16_t y;
+  uint16_t size;   // Contact area reported by the controller
+  uint8_t trackId; // Stable per finger for the life of the contact
+  bool pressed;
+  bool primary;
+  uint16_t readUs; // INT falling edge to read, 0 if read without one
+  int64_t timeUs;  // esp_timer_get_time() at read
+};
+
+/**
+ * Attach the INT interrupt and start the input task
+ * @return true on success
+ */
+bool init();
+
+/**
+ * Soft-reset the controller (0x8040 = 2, then 0)
+ */
+void softReset();
+
+/**
+ * Switch the controller's report rate and low-power timing. Writes the
+ * configuration only when those fields change; the controller keeps it
+ * across resets, so a profile that is already set costs nothing. Each
+ * change is a blocking write to that stored configuration: switch rarely
+ * (UIManager waits for a screen to settle), not on every navigation.
+ * @return false if the configuration could not be read, checked or written
+ */
+bool setProfile(Profile profile);
+
+/**
+ * Pop the oldest sample (single consumer)
+ * @return false if the ring is empty
+ */
+bool popSample(TouchSample &sample);
+
+/**
+ * Samples dropped because the ring was full
+ */
+uint32_t getDroppedCount();
+
+/**
+ * Burst-read and decode the current report (blocking)
+ * @param points Output array of at least MAX_POINTS samples
+ * @return number of fingers down, or -1 on bus error
+ */
+int readPoints(TouchSample *points);
+
+} // namespace GT911
+
+#endif // GT911_H
@@ -0,0 +1,116 @@
+/**
+ * Shared I2C Bus Implementation
+ */
+
+#include "i2c_bus.h"
+#include <Wire.h>
+#include <esp_timer.h>
+
+namespace I2CBus {
+
+// Wire::endTransmission() results that mean the device did not answer
+static const uint8_t ERR_ADDR_NACK = 2;
+static const uint8_t ERR_DATA_NACK = 3;
+
+static DeviceStats _stats[MAX_DEVICES];
+static int _devices = 0;
+
+// Caller holds the lock; nullptr once the table is full
+static DeviceStats *slot(uint8_t addr) {
+  for (int i = 0; i < _devices; i++) {
+    if (_stats[i].addr == addr)
+      return &_stats[i];
+  }
+  if (_devices >= MAX_DEVICES)
+    return nullptr;
+  DeviceStats &s = _stats[_devices++];
+  s = {};
+  s.addr = addr;
+  return &s;
+}
+
+static uint8_t attempt(uint8_t addr, const uint8_t *tx, size_t txLen,
+                       uint8_t *rx, size_t rxLen) {
+  Wire.beginTransmission(addr);
+  if (txLen)
+    Wire.write(tx, txLen);
+  // Keep the bus for a read (repeated start)
+  uint8_t err = Wire.endTransmission(rxLen == 0);
+  if (err != 0 || rxLen == 0)
+    return err;
+
+  if (Wire.requestFrom(addr, (uint8_t)rxLen) != rxLen)
+    return ERR_DATA_NACK; // Short read: the device stopped answering
+  for (size_t i = 0; i < rxLen; i++)
+    rx[i] = Wire.read();
+  return 0;
+}
+
+bool transfer(uint8_t addr, const uint8_t *tx, size_t txLen, uint8_t *rx,
+              size_t rxLen) {
+  Lock lock;
+  int64_t start = esp_timer_get_time();
+  DeviceStats *s = slot(addr);
+
+  bool ok = false;
+  for (int i = 0; i <= RETRIES && !ok; i++) {
+    if (i > 0 && s)
+      s->retries++;
+    uint8_t err = attempt(addr, tx, txLen, rx, rxLen);
+    ok = err == 0;
+    if (s && (err == ERR_ADDR_NACK || err == ERR_DATA_NACK))
+      s->nacks++;
+  }
+
+  if (s) {
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    s->transfers++;
+    s->totalUs += us;
+    if (us > s->maxUs)
+      s->maxUs = us;
+    if (!ok)
+      s->failures++;
+  }
+  return ok;
+}
+
+bool stats(uint8_t addr, DeviceStats &out) {
+  Lock lock;
+  for (int i = 0; i < _devices; i++) {
+    if (_stats[i].addr == addr) {
+      out = _stats[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void resetStats() {
+  Lock lock;
+  for (int i = 0; i < _devices; i++) {
+    uint8_t addr = _stats[i].addr;
+    _stats[i] = {};
+    _stats[i].addr = addr;
+  }
+}
+
+void dump(Print &out) {
+  DeviceStats copy[MAX_DEVICES];
+  int n;
+  {
+    Lock lock;
+    n = _devices;
+    memcpy(copy, _stats, sizeof(copy));
+  }
+  for (int i = 0; i < n; i++) {
+    const DeviceStats &s = copy[i];
+    out.printf("I2C 0x%02X: n=%u avg=%uus max=%uus nack=%u retry=%u "
+               "fail=%u\n",
+               s.addr, (unsigned)s.transfers,
+               (unsigned)(s.transfers ? s.totalUs / s.transfers : 0),
+               (unsigned)s.maxUs, (unsigned)s.nacks, (unsigned)s.retries,
+               (unsigned)s.failures);
+  }
+}
+
+} // namespace I2CBus
@@ -0,0 +1,80 @@
+/**
+ * Shared I2C Bus Lock
+ *
+ * GT911 touch (0x5D) and BM8563 RTC (0x51) share Wire (SDA=41, SCL=42).
+ * The touch input task runs on core 0 while the UI reads the RTC on core 1,
+ * so every Wire transaction must hold this lock.
+ *
+ * Waiters are served in task priority order, so a touch read (the GT911
+ * task, priority 5) goes ahead of any queued loop-task access, and a
+ * lower-priority holder inherits that priority until it lets go.
+ *
+ * transfer() is the one way drivers talk to a device: a write, optionally
+ * followed by a repeated-start read, retried once on a NACK or timeout,
+ * with per-device counts and latency kept for the Perf screen and "PROF".
+ */
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+namespace I2CBus {
+
+static const int MAX_DEVICES = 4; // Addresses with their own stats
+static const int RETRIES = 1;     // Extra attempts after a failure
+
+struct DeviceStats {
+  uint8_t addr;
+  uint32_t transfers; // Completed, successful or not
+  uint32_t nacks;     // Attempts the device did not acknowledge
+  uint32_t retries;
+  uint32_t failures; // Transfers that failed every attempt
+  uint32_t totalUs;  // Bus time, retries included
+  uint32_t maxUs;
+};
+
+/**
+ * Recursive mutex guarding Wire (created on first use)
+ */
+inline SemaphoreHandle_t mutex() {
+  static SemaphoreHandle_t m = xSemaphoreCreateRecursiveMutex();
+  return m;
+}
+
+/**
+ * RAII guard: holds the bus for the lifetime of the object
+ */
+class Lock {
+public:
+  Lock() { xSemaphoreTakeRecursive(mutex(), portMAX_DELAY); }
+  ~Lock() { xSemaphoreGiveRecursive(mutex()); }
+  Lock(const Lock &) = delete;
+  Lock &operator=(const Lock &) = delete;
+};
+
+/**
+ * Write tx, then read rxLen bytes after a repeated start (rxLen 0 = write
+ * only). Takes the lock.
+ * @return false if every attempt failed
+ */
+bool transfer(uint8_t addr, const uint8_t *tx, size_t txLen, uint8_t *rx,
+              size_t rxLen);
+
+/**
+ * @return false if nothing has talked to addr yet
+ */
+bool stats(uint8_t addr, DeviceStats &out);
+
+void resetStats();
+
+/**
+ * Print one line per device
+ */
+void dump(Print &out);
+
+} // namespace I2CBus
+
+#endif // I2C_BUS_H
@@ -0,0 +1,88 @@
+/**
+ * Power Governor Implementation
+ */
+
+#include "power_governor.h"
+#include "../utils/log.h"
+#include "battery.h"
+
+namespace PowerGovernor {
+
+// A divider reading this low means no cell (USB only) or a dead ADC, not
+// an empty battery
+static const uint16_t NO_BATTERY_MV = 2500;
+
+// name, poll x, refresh s, flush min, MHz, idle min, linked, cycle, through
+static const OperatingPoint POINTS[] = {
+    // The RTC tail holds what a flush has not: lower levels flush less
+    {"full", 1, 0, 30, 240, 30, true, true, false},
+    {"saver", 2, 30, 45, 160, 15, true, true, false},
+    {"reserve", 4, 60, 60, 160, 10, true, true, true},
+    // Flush every sample: a brown-out is close, and a battery that runs
+    // flat takes RTC memory with it
+    {"critical", 8, 120, 1, 80, 1, false, false, true},
+};
+
+static const int THRESHOLDS[] = {100, SAVER_PCT, RESERVE_PCT, CRITICAL_PCT};
+
+static Level _level = Level::FULL;
+static int _percent = -1;
+static uint32_t _lastSample = 0;
+static bool _sampled = false;
+
+static int readPercent(bool &charging) {
+  charging = Battery::isCharging();
+  if (Battery::getMillivolts() < NO_BATTERY_MV)
+    return -1;
+  return Battery::getPercentage(); // Cached by the battery sampler
+}
+
+Level classify(int percent, bool charging, Level current) {
+  if (charging || percent < 0)
+    return Level::FULL;
+
+  Level target = Level::FULL;
+  for (int i = (int)Level::CRITICAL; i > (int)Level::FULL; i--) {
+    if (percent <= THRESHOLDS[i]) {
+      target = (Level)i;
+      break;
+    }
+  }
+  // Draining moves down at once; recovering needs a margin
+  if (target < current && percent <= THRESHOLDS[(int)current] + HYSTERESIS)
+    return current;
+  return target;
+}
+
+Level sample() {
+  bool charging;
+  int pct = readPercent(charging);
+  return classify(pct, charging, _level);
+}
+
+bool update(uint32_t now) {
+  if (_sampled && now - _lastSample < SAMPLE_INTERVAL_MS)
+    return false;
+  _sampled = true;
+  _lastSample = now;
+
+  bool charging;
+  _percent = readPercent(charging);
+  Level next = classify(_percent, charging, _level);
+  if (next == _level)
+    return false;
+
+  LOG_I("Power", "Battery %d%%%s: %s -> %s", _percent,
+        charging ? " (charging)" : "", POINTS[(int)_level].name,
+        POINTS[(int)next].name);
+  _level = next;
+  return true;
+}
+
+Level level() { return _level; }
+
+const OperatingPoint &point() { return POINTS[(int)_level]; }
+
+int percent() { return _percent; }
+
+} // namespace PowerGovernor
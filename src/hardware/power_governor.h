@@ -0,0 +1,77 @@
+/**
+ * Power Governor
+ *
+ * Picks an operating point from the M5Paper's own battery so the device
+ * lasts longer on a charge as it drains: slower BLE polling, a floor under
+ * the display refresh rate, fewer history flushes, a lower top clock and a
+ * shorter idle time before deep sleep. The battery is read once a minute,
+ * not per frame; a level is only left again once the charge is HYSTERESIS
+ * points above its threshold, so a sagging reading does not flap.
+ *
+ * CRITICAL is the last stop: state is flushed when it is entered, the
+ * link no longer holds the device awake and it sleeps after a minute
+ * without input, waking on touch only (no sleep-cycle sampling).
+ *
+ * Charging, or no battery reading at all, is FULL.
+ */
+
+#ifndef POWER_GOVERNOR_H
+#define POWER_GOVERNOR_H
+
+#include <Arduino.h>
+
+namespace PowerGovernor {
+
+enum class Level : uint8_t {
+  FULL,
+  SAVER,   // <= SAVER_PCT
+  RESERVE, // <= RESERVE_PCT
+  CRITICAL // <= CRITICAL_PCT
+};
+
+static const int SAVER_PCT = 40;
+static const int RESERVE_PCT = 20;
+static const int CRITICAL_PCT = 5;
+static const int HYSTERESIS = 3;
+static const uint32_t SAMPLE_INTERVAL_MS = 60000;
+
+struct OperatingPoint {
+  const char *name;
+  uint8_t pollScale;       // BLE poll intervals are multiplied by this
+  uint16_t minRefreshSecs; // Floor under the refresh-rate setting
+  uint8_t flushMinutes;    // History journal flush interval
+  uint16_t maxMhz;         // Clock while interacting
+  uint16_t idleSleepMins;  // Idle time before deep sleep
+  bool holdWhileLinked;    // A BLE link keeps the device awake
+  bool wakeCycle;          // Sleep-cycle sampling allowed
+  bool writeThrough;       // SD writes are not deferred
+};
+
+/**
+ * Read the battery if SAMPLE_INTERVAL_MS has passed (or never read)
+ * @return True if the level changed; apply point() then
+ */
+bool update(uint32_t now);
+
+/**
+ * Read the battery now and return the level it maps to (sleep-cycle
+ * wakes, which do not run update())
+ */
+Level sample();
+
+/**
+ * Level for a reading, given the current one (hysteresis)
+ */
+Level classify(int percent, bool charging, Level current);
+
+Level level();
+const OperatingPoint &point();
+
+/**
+ * Battery percentage of the last reading, -1 before the first
+ */
+int percent();
+
+} // namespace PowerGovernor
+
+#endif // POWER_GOVERNOR_H
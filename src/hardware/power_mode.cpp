@@ -0,0 +1,150 @@
+/**
+ * Power Mode Implementation
+ */
+
+#include "power_mode.h"
+#include "energy_model.h"
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+namespace PowerMode {
+
+static bool _configured = false;
+static bool _lightSleep = false;
+static bool _active = true; // Boot runs at full speed
+static int _maxMhz = ACTIVE_MHZ;
+static int _wakePin = -1; // wakeOnLow(), armed while idle
+
+#if CONFIG_PM_ENABLE
+static bool _usbHeld = false;
+static esp_pm_lock_handle_t _cpuLock = nullptr;   // ESP_PM_CPU_FREQ_MAX
+static esp_pm_lock_handle_t _awakeLock = nullptr; // ESP_PM_NO_LIGHT_SLEEP
+static esp_pm_lock_handle_t _usbLock = nullptr;   // Host attached
+#endif
+
+bool begin() {
+  if (_configured)
+    return true;
+
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32s3_t pm = {};
+  pm.max_freq_mhz = _maxMhz;
+  pm.min_freq_mhz = IDLE_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  pm.light_sleep_enable = true;
+#endif
+  if (esp_pm_configure(&pm) != ESP_OK) {
+    Serial.println("Power: esp_pm_configure failed, staying at full speed");
+    return false;
+  }
+  _lightSleep = pm.light_sleep_enable;
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "ui_active", &_cpuLock);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ui_awake", &_awakeLock);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "usb_host", &_usbLock);
+  if (_cpuLock)
+    esp_pm_lock_acquire(_cpuLock);
+  if (_awakeLock)
+    esp_pm_lock_acquire(_awakeLock);
+  if (_lightSleep)
+    esp_sleep_enable_gpio_wakeup();
+  Serial.printf("Power: DFS %d-%d MHz, light sleep %s\n", IDLE_MHZ,
+                ACTIVE_MHZ, _lightSleep ? "on" : "off (no tickless idle)");
+#else
+  Serial.printf("Power: No PM in this SDK, idle clock %d MHz\n", IDLE_MHZ);
+#endif
+  _configured = true;
+  _active = true;
+  return true;
+}
+
+bool lightSleepEnabled() { return _lightSleep; }
+
+// Level wake while the chip may sleep, the ISR's falling edge otherwise
+static void armWake(bool armed) {
+  if (_wakePin < 0)
+    return;
+  gpio_num_t pin = (gpio_num_t)_wakePin;
+  if (armed) {
+    gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL);
+  } else {
+    gpio_wakeup_disable(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_NEGEDGE);
+  }
+}
+
+void setActive(bool active) {
+  if (!_configured)
+    return;
+
+#if CONFIG_PM_ENABLE
+  // Light sleep would drop the USB-Serial-JTAG link under a host
+  bool usb = (bool)Serial;
+  if (usb != _usbHeld && _usbLock) {
+    if (usb)
+      esp_pm_lock_acquire(_usbLock);
+    else
+      esp_pm_lock_release(_usbLock);
+    _usbHeld = usb;
+  }
+#endif
+
+  if (active == _active)
+    return;
+  _active = active;
+  EnergyModel::set(active ? EnergyModel::State::CPU_ACTIVE
+                          : EnergyModel::State::CPU_IDLE);
+  armWake(!active);
+
+#if CONFIG_PM_ENABLE
+  if (active) {
+    if (_cpuLock)
+      esp_pm_lock_acquire(_cpuLock);
+    if (_awakeLock)
+      esp_pm_lock_acquire(_awakeLock);
+  } else {
+    if (_awakeLock)
+      esp_pm_lock_release(_awakeLock);
+    if (_cpuLock)
+      esp_pm_lock_release(_cpuLock);
+  }
+#else
+  setCpuFrequencyMhz(active ? _maxMhz : IDLE_MHZ);
+#endif
+}
+
+void setMaxMhz(int mhz) {
+  mhz = constrain(mhz, IDLE_MHZ, ACTIVE_MHZ);
+  if (mhz == _maxMhz)
+    return;
+  _maxMhz = mhz;
+  if (!_configured)
+    return;
+
+#if CONFIG_PM_ENABLE
+  // The CPU_FREQ_MAX lock follows the configured maximum
+  esp_pm_config_esp32s3_t pm = {};
+  pm.max_freq_mhz = mhz;
+  pm.min_freq_mhz = IDLE_MHZ;
+  pm.light_sleep_enable = _lightSleep;
+  if (esp_pm_configure(&pm) != ESP_OK) {
+    Serial.printf("Power: Could not cap the clock at %d MHz\n", mhz);
+    return;
+  }
+#else
+  if (_active)
+    setCpuFrequencyMhz(mhz);
+#endif
+  Serial.printf("Power: Clock capped at %d MHz\n", mhz);
+}
+
+void wakeOnLow(int pin) {
+  if (!_lightSleep)
+    return; // Keep the edge trigger; nothing needs waking
+  _wakePin = pin;
+  armWake(!_active);
+}
+
+} // namespace PowerMode
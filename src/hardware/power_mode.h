@@ -0,0 +1,62 @@
+/**
+ * Power Mode
+ *
+ * ESP-IDF power management for the time between events. The main loop now
+ * blocks (see Wake), so the idle task gets most of the CPU time; with a PM
+ * config in place that becomes lower clocks and, where the SDK was built
+ * with tickless idle, automatic light sleep until the next timer or a GPIO
+ * wake. The NimBLE controller keeps its connection through light sleep
+ * with modem sleep (CONFIG_BT_CTRL_MODEM_SLEEP, main XTAL or 32 kHz low
+ * power clock), so being connected no longer means running flat out.
+ *
+ * setActive(true) holds the full clock and no light sleep while the user
+ * is interacting (stroke rendering, EPD pushes, touch latency). While a USB
+ * host is attached light sleep is also held off: it would drop the
+ * USB-Serial-JTAG link.
+ *
+ * Builds without CONFIG_PM_ENABLE (the stock Arduino core) fall back to
+ * setCpuFrequencyMhz() between ACTIVE_MHZ and IDLE_MHZ for the same
+ * decision; 80 MHz is the lowest clock the radio runs at.
+ */
+
+#ifndef POWER_MODE_H
+#define POWER_MODE_H
+
+#include <Arduino.h>
+
+namespace PowerMode {
+
+static const int ACTIVE_MHZ = 240;
+static const int IDLE_MHZ = 80;
+
+/**
+ * Configure DFS (and light sleep when available)
+ */
+bool begin();
+
+/**
+ * True when the SDK can light-sleep automatically
+ */
+bool lightSleepEnabled();
+
+/**
+ * Full speed while interacting; idle lets the clock drop and the chip sleep
+ */
+void setActive(bool active);
+
+/**
+ * Cap the clock used while active (power governor); IDLE_MHZ..ACTIVE_MHZ
+ */
+void setMaxMhz(int mhz);
+
+/**
+ * Let a low level on pin wake the chip from light sleep (touch INT). Call
+ * after attachInterrupt(). The level wake replaces the pin's edge trigger,
+ * and a finger held down would re-fire the ISR without end, so it is only
+ * armed while idle: setActive(true) puts the falling edge back.
+ */
+void wakeOnLow(int pin);
+
+} // namespace PowerMode
+
+#endif // POWER_MODE_H
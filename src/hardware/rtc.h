@@ -3,13 +3,24 @@
  *
  * Direct BM8563 RTC driver using Wire I2C on SDA=41, SCL=42.
  * M5Unified's RTC driver doesn't work when Wire is reconfigured.
+ *
+ * The time registers (0x02-0x08) are read and written as one
+ * auto-increment burst; the chip freezes its counters while addressed,
+ * so the fields always belong to the same second. The UI reads the
+ * system clock, synced from here at boot and hourly, not the bus.
+ *
+ * The alarm (hh:mm) and countdown timer raise the chip's INT line; the
+ * wake schedule programs them for the next event before deep sleep.
  */
 
 #ifndef RTC_H
 #define RTC_H
 
 #include <Arduino.h>
+#include "i2c_bus.h"
 #include <Wire.h>
+#include <sys/time.h>
+#include <time.h>
 
 namespace RTC {
 
@@ -26,6 +37,22 @@ constexpr uint8_t REG_DAYS = 0x05;
 constexpr uint8_t REG_WEEKDAYS = 0x06;
 constexpr uint8_t REG_MONTHS = 0x07;
 constexpr uint8_t REG_YEARS = 0x08;
+constexpr uint8_t TIME_REGS = REG_YEARS - REG_SECONDS + 1;
+constexpr uint8_t REG_ALARM_MINUTE = 0x09; // Then hour, day, weekday
+constexpr uint8_t REG_TIMER_CONTROL = 0x0E;
+constexpr uint8_t REG_TIMER = 0x0F;
+
+// CONTROL2 bits
+constexpr uint8_t CTRL2_TIE = 0x01; // Countdown raises INT
+constexpr uint8_t CTRL2_AIE = 0x02; // Alarm raises INT
+constexpr uint8_t CTRL2_TF = 0x04;  // Countdown reached zero
+constexpr uint8_t CTRL2_AF = 0x08;  // Alarm matched
+
+constexpr uint8_t ALARM_OFF = 0x80; // Alarm field not compared
+constexpr uint8_t TIMER_ON = 0x80;
+constexpr uint8_t TIMER_1HZ = 0x02;
+constexpr uint8_t TIMER_1_60HZ = 0x03;
+constexpr uint32_t COUNTDOWN_MAX_SECS = 255 * 60;
 
 // BCD conversion helpers
 inline uint8_t bcdToDec(uint8_t bcd) { return (bcd >> 4) * 10 + (bcd & 0x0F); }
@@ -34,19 +61,31 @@ inline uint8_t decToBcd(uint8_t dec) { return ((dec / 10) << 4) | (dec % 10); }
 
 // Read a single register
 inline uint8_t readReg(uint8_t reg) {
-  Wire.beginTransmission(BM8563_ADDR);
-  Wire.write(reg);
-  Wire.endTransmission();
-  Wire.requestFrom(BM8563_ADDR, (uint8_t)1);
-  return Wire.available() ? Wire.read() : 0;
+  uint8_t value = 0;
+  I2CBus::transfer(BM8563_ADDR, &reg, 1, &value, 1);
+  return value;
 }
 
 // Write a single register
 inline void writeReg(uint8_t reg, uint8_t value) {
-  Wire.beginTransmission(BM8563_ADDR);
-  Wire.write(reg);
-  Wire.write(value);
-  Wire.endTransmission();
+  uint8_t tx[2] = {reg, value};
+  I2CBus::transfer(BM8563_ADDR, tx, 2, nullptr, 0);
+}
+
+// Read consecutive registers in one transaction (the address
+// auto-increments)
+inline bool readRegs(uint8_t reg, uint8_t *buf, uint8_t len) {
+  return I2CBus::transfer(BM8563_ADDR, &reg, 1, buf, len);
+}
+
+// Write consecutive registers in one transaction
+inline bool writeRegs(uint8_t reg, const uint8_t *buf, uint8_t len) {
+  uint8_t tx[1 + TIME_REGS];
+  if (len > TIME_REGS)
+    return false;
+  tx[0] = reg;
+  memcpy(tx + 1, buf, len);
+  return I2CBus::transfer(BM8563_ADDR, tx, 1 + len, nullptr, 0);
 }
 
 /**
@@ -61,58 +100,173 @@ inline void init() {
  * Check if RTC is accessible
  */
 inline bool isPresent() {
+  I2CBus::Lock lock;
   Wire.beginTransmission(BM8563_ADDR);
   return Wire.endTransmission() == 0;
 }
 
+/**
+ * Read date and time in one burst (coherent: no rollover between fields)
+ * @param out Local time fields; tm_isdst is -1
+ * @return false on a bus error
+ */
+inline bool getDateTime(struct tm &out) {
+  uint8_t r[TIME_REGS];
+  if (!readRegs(REG_SECONDS, r, TIME_REGS))
+    return false;
+  out = {};
+  out.tm_sec = bcdToDec(r[0] & 0x7F);
+  out.tm_min = bcdToDec(r[1] & 0x7F);
+  out.tm_hour = bcdToDec(r[2] & 0x3F);
+  out.tm_mday = bcdToDec(r[3] & 0x3F);
+  out.tm_wday = r[4] & 0x07;
+  out.tm_mon = bcdToDec(r[5] & 0x1F) - 1;
+  out.tm_year = 100 + bcdToDec(r[6]);
+  out.tm_isdst = -1;
+  return true;
+}
+
 /**
  * Get current time components
  */
 inline void getTime(int &hours, int &minutes, int &seconds) {
-  seconds = bcdToDec(readReg(REG_SECONDS) & 0x7F);
-  minutes = bcdToDec(readReg(REG_MINUTES) & 0x7F);
-  hours = bcdToDec(readReg(REG_HOURS) & 0x3F);
+  struct tm t = {};
+  getDateTime(t);
+  hours = t.tm_hour;
+  minutes = t.tm_min;
+  seconds = t.tm_sec;
 }
 
 /**
  * Get current date components
  */
 inline void getDate(int &year, int &month, int &day, int &weekday) {
-  day = bcdToDec(readReg(REG_DAYS) & 0x3F);
-  weekday = readReg(REG_WEEKDAYS) & 0x07;
-  month = bcdToDec(readReg(REG_MONTHS) & 0x1F);
-  year = 2000 + bcdToDec(readReg(REG_YEARS));
+  struct tm t = {};
+  t.tm_mon = -1;
+  t.tm_year = -1900;
+  getDateTime(t);
+  year = t.tm_year + 1900;
+  month = t.tm_mon + 1;
+  day = t.tm_mday;
+  weekday = t.tm_wday;
+}
+
+/**
+ * Set date and time together (one burst, weekday included)
+ */
+inline void setDateTime(int year, int month, int day, int hours, int minutes,
+                        int seconds) {
+  struct tm t = {};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = 12; // Only for the weekday: clear of any DST edge
+  t.tm_isdst = -1;
+  mktime(&t);
+
+  uint8_t r[TIME_REGS];
+  r[0] = decToBcd(seconds);
+  r[1] = decToBcd(minutes);
+  r[2] = decToBcd(hours);
+  r[3] = decToBcd(day);
+  r[4] = t.tm_wday;
+  r[5] = decToBcd(month);
+  r[6] = decToBcd(year - 2000);
+  writeRegs(REG_SECONDS, r, TIME_REGS);
 }
 
 /**
  * Set time
  */
 inline void setTime(int hours, int minutes, int seconds) {
-  writeReg(REG_SECONDS, decToBcd(seconds));
-  writeReg(REG_MINUTES, decToBcd(minutes));
-  writeReg(REG_HOURS, decToBcd(hours));
+  uint8_t r[3] = {decToBcd(seconds), decToBcd(minutes), decToBcd(hours)};
+  writeRegs(REG_SECONDS, r, 3);
 }
 
 /**
  * Set date
  */
 inline void setDate(int year, int month, int day) {
-  writeReg(REG_DAYS, decToBcd(day));
-  writeReg(REG_MONTHS, decToBcd(month));
-  writeReg(REG_YEARS, decToBcd(year - 2000));
+  int hours, minutes, seconds;
+  getTime(hours, minutes, seconds);
+  setDateTime(year, month, day, hours, minutes, seconds);
 }
 
 /**
- * Set date and time together
+ * Set the system clock from RTC fields
+ * @return false if the RTC holds no valid date (never set, lost power)
  */
-inline void setDateTime(int year, int month, int day, int hours, int minutes,
-                        int seconds) {
-  writeReg(REG_SECONDS, decToBcd(seconds));
-  writeReg(REG_MINUTES, decToBcd(minutes));
-  writeReg(REG_HOURS, decToBcd(hours));
-  writeReg(REG_DAYS, decToBcd(day));
-  writeReg(REG_MONTHS, decToBcd(month));
-  writeReg(REG_YEARS, decToBcd(year - 2000));
+inline bool setSystemTime(const struct tm &rtc) {
+  // Month/Day = 0 would make mktime underflow to 1999
+  if (rtc.tm_year < 100 || rtc.tm_year >= 200 || rtc.tm_mon < 0 ||
+      rtc.tm_mday < 1)
+    return false;
+  struct tm t = rtc;
+  time_t epoch = mktime(&t);
+  if (epoch == (time_t)-1)
+    return false;
+  struct timeval tv = {.tv_sec = epoch, .tv_usec = 0};
+  settimeofday(&tv, NULL);
+  return true;
+}
+
+/**
+ * Pull the system clock back to the RTC (it drifts in light sleep)
+ */
+inline bool syncSystemTime() {
+  struct tm t;
+  return getDateTime(t) && setSystemTime(t);
+}
+
+/**
+ * Count down secs and raise INT: 1 Hz ticks up to 255 s, whole minutes
+ * (rounded down, so never late) up to COUNTDOWN_MAX_SECS
+ */
+inline bool setCountdown(uint32_t secs) {
+  if (secs == 0)
+    return false;
+  uint8_t control = TIMER_ON | TIMER_1HZ;
+  uint32_t ticks = secs;
+  if (secs > 255) {
+    control = TIMER_ON | TIMER_1_60HZ;
+    ticks = secs / 60 < 255 ? secs / 60 : 255;
+  }
+  writeReg(REG_TIMER_CONTROL, 0x00); // Stop while loading
+  writeReg(REG_TIMER, ticks);
+  writeReg(REG_TIMER_CONTROL, control);
+  // Writing 0 to the flags clears them; keep the alarm enable as it was
+  uint8_t c2 = readReg(REG_CONTROL2) & CTRL2_AIE;
+  writeReg(REG_CONTROL2, c2 | CTRL2_TIE);
+  return true;
+}
+
+/**
+ * Raise INT when the clock reaches hh:mm
+ */
+inline bool setAlarm(int hour, int minute) {
+  uint8_t r[4] = {decToBcd(minute), decToBcd(hour), ALARM_OFF, ALARM_OFF};
+  if (!writeRegs(REG_ALARM_MINUTE, r, 4))
+    return false;
+  uint8_t c2 = readReg(REG_CONTROL2) & CTRL2_TIE;
+  writeReg(REG_CONTROL2, c2 | CTRL2_AIE);
+  return true;
+}
+
+/**
+ * Stop the countdown and alarm and release INT
+ */
+inline void clearWake() {
+  writeReg(REG_CONTROL2, 0x00);
+  writeReg(REG_TIMER_CONTROL, 0x00);
+  uint8_t off[4] = {ALARM_OFF, ALARM_OFF, ALARM_OFF, ALARM_OFF};
+  writeRegs(REG_ALARM_MINUTE, off, 4);
+}
+
+/**
+ * CTRL2_AF and/or CTRL2_TF if the alarm or countdown has fired
+ */
+inline uint8_t firedFlags() {
+  return readReg(REG_CONTROL2) & (CTRL2_AF | CTRL2_TF);
 }
 
 /**
@@ -120,19 +274,8 @@ inline void setDateTime(int year, int month, int day, int hours, int minutes,
  */
 inline void getTimeString(char *buffer, size_t size,
                           const char *format = "%H:%M") {
-  int hours, minutes, seconds;
-  getTime(hours, minutes, seconds);
-
-  int year, month, day, weekday;
-  getDate(year, month, day, weekday);
-
   struct tm timeinfo = {0};
-  timeinfo.tm_year = year - 1900;
-  timeinfo.tm_mon = month - 1;
-  timeinfo.tm_mday = day;
-  timeinfo.tm_hour = hours;
-  timeinfo.tm_min = minutes;
-  timeinfo.tm_sec = seconds;
+  getDateTime(timeinfo);
   strftime(buffer, size, format, &timeinfo);
 }
 
@@ -0,0 +1,283 @@
+/**
+ * History Archive Implementation
+ */
+
+#include "history_archive.h"
+#include "utils/crc16.h"
+#include "utils/sd_manager.h"
+#include <esp_heap_caps.h>
+
+namespace HistoryArchive {
+
+// Worst case per sample: slot gap, mask, five-byte time, six fields
+static const size_t MAX_SAMPLE_BYTES = 3 + 1 + 5 + 6 * 3;
+static const size_t MAX_BLOCK = SAMPLES_PER_DAY * MAX_SAMPLE_BYTES;
+
+// Appends to out[n..cap); false once it runs out of room
+static bool putVarint(uint8_t *out, size_t cap, size_t &n, uint32_t value) {
+  do {
+    if (n >= cap)
+      return false;
+    uint8_t b = value & 0x7F;
+    value >>= 7;
+    out[n++] = b | (value ? 0x80 : 0);
+  } while (value);
+  return true;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+// Reads from in[n..length); false at the end or past 32 bits
+static bool getVarint(const uint8_t *in, size_t length, size_t &n,
+                      uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (n >= length)
+      return false;
+    uint8_t b = in[n++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static void fields(const PowerSample &s, uint32_t v[FIELD_COUNT]) {
+  v[TIME] = s.timestamp;
+  v[BATTERY] = s.batteryPct;
+  v[IN_W] = s.inputW;
+  v[OUT_W] = s.outputW;
+  v[DC_IN_W] = s.dcInputW;
+  v[VOLTAGE_CV] = s.voltageCv;
+  v[OUTLETS] = s.outlets;
+}
+
+size_t encodeDay(const PowerSample *day, uint8_t *out, size_t cap,
+                 uint16_t &count) {
+  uint32_t prev[FIELD_COUNT] = {};
+  int prevSlot = -1;
+  size_t n = 0;
+  count = 0;
+  for (int slot = 0; slot < SAMPLES_PER_DAY; slot++) {
+    if (day[slot].timestamp == 0)
+      continue; // Empty minute
+    uint32_t v[FIELD_COUNT];
+    fields(day[slot], v);
+    uint32_t gap = slot - prevSlot;
+    prev[TIME] += gap * 60; // Expected: a minute per slot
+    uint8_t mask = 0;
+    for (int k = 0; k < FIELD_COUNT; k++) {
+      if (v[k] != prev[k])
+        mask |= 1 << k;
+    }
+    if (!putVarint(out, cap, n, gap) || n >= cap)
+      return 0;
+    out[n++] = mask;
+    for (int k = 0; k < FIELD_COUNT; k++) {
+      if ((mask & (1 << k)) &&
+          !putVarint(out, cap, n, zigzag((int32_t)(v[k] - prev[k]))))
+        return 0;
+      prev[k] = v[k];
+    }
+    prevSlot = slot;
+    count++;
+  }
+  return n;
+}
+
+int decodeDay(const uint8_t *in, size_t length, PowerSample *day) {
+  memset(day, 0, SAMPLES_PER_DAY * sizeof(PowerSample));
+  uint32_t v[FIELD_COUNT] = {};
+  int slot = -1;
+  int count = 0;
+  size_t n = 0;
+  while (n < length) {
+    uint32_t gap;
+    if (!getVarint(in, length, n, gap) || gap == 0 || n >= length ||
+        gap > (uint32_t)(SAMPLES_PER_DAY - 1 - slot))
+      return -1;
+    slot += gap;
+    v[TIME] += gap * 60;
+    uint8_t mask = in[n++];
+    if (mask >> FIELD_COUNT)
+      return -1;
+    for (int k = 0; k < FIELD_COUNT; k++) {
+      uint32_t change;
+      if (!(mask & (1 << k)))
+        continue;
+      if (!getVarint(in, length, n, change))
+        return -1;
+      v[k] += unzigzag(change);
+    }
+    day[slot] = PowerSample{v[TIME],
+                            (uint8_t)v[BATTERY],
+                            (uint16_t)v[IN_W],
+                            (uint16_t)v[OUT_W],
+                            (uint16_t)v[DC_IN_W],
+                            (uint16_t)v[VOLTAGE_CV],
+                            (uint8_t)v[OUTLETS]};
+    count++;
+  }
+  return count;
+}
+
+// Header and index of a month's archive, created empty the first time
+static bool openMonth(const char *path, int year, int month, File &file,
+                      ArchiveEntry index[MAX_DAYS]) {
+  ArchiveHeader header;
+  if (sdFS().exists(path)) {
+    file = sdFS().open(path, "r+");
+    if (file &&
+        file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+        header.magic == MAGIC && header.version == VERSION &&
+        file.read((uint8_t *)index, MAX_DAYS * sizeof(ArchiveEntry)) ==
+            MAX_DAYS * sizeof(ArchiveEntry))
+      return true;
+    if (file)
+      file.close();
+    Serial.printf("[Archive] %s is unreadable, leaving it\n", path);
+    return false;
+  }
+
+  file = sdFS().open(path, FILE_WRITE);
+  if (!file)
+    return false;
+  header = {MAGIC, VERSION, 0, (uint16_t)year, (uint8_t)month, {}};
+  memset(index, 0, MAX_DAYS * sizeof(ArchiveEntry));
+  bool ok = file.write((const uint8_t *)&header, sizeof(header)) ==
+                sizeof(header) &&
+            file.write((const uint8_t *)index,
+                       MAX_DAYS * sizeof(ArchiveEntry)) ==
+                MAX_DAYS * sizeof(ArchiveEntry);
+  if (!ok)
+    file.close();
+  return ok;
+}
+
+// Fold one day file into its month; the day file goes once the block
+// reads back intact
+static bool archiveDay(const char *dir, uint32_t date, PowerSample *day,
+                       PowerSample *check, uint8_t *block) {
+  int year = date / 10000, month = date / 100 % 100, dom = date % 100;
+  char dayPath[48], monthPath[48];
+  snprintf(dayPath, sizeof(dayPath), "%s/%04d-%02d-%02d.bin", dir, year,
+           month, dom);
+  snprintf(monthPath, sizeof(monthPath), "%s/%04d-%02d.arc", dir, year,
+           month);
+  if (dom < 1 || dom > MAX_DAYS)
+    return false;
+
+  memset(day, 0, SAMPLES_PER_DAY * sizeof(PowerSample));
+  if (!PowerHistory::readDayFile(dayPath, day))
+    return false;
+  uint16_t count;
+  size_t length = encodeDay(day, block, MAX_BLOCK, count);
+  if (decodeDay(block, length, check) != count ||
+      memcmp(day, check, SAMPLES_PER_DAY * sizeof(PowerSample)) != 0) {
+    Serial.printf("[Archive] %s does not round-trip, kept\n", dayPath);
+    return false;
+  }
+
+  File file;
+  ArchiveEntry index[MAX_DAYS];
+  if (!openMonth(monthPath, year, month, file, index))
+    return false;
+  ArchiveEntry &entry = index[dom - 1];
+  bool ok = true;
+  if (entry.offset == 0) {
+    // Block first, then its index entry: a day is only listed once whole
+    entry = {(uint32_t)file.size(), (uint32_t)length, count,
+             CRC16::modbus(block, length)};
+    ok = file.seek(entry.offset) &&
+         file.write(block, length) == length &&
+         file.seek(sizeof(ArchiveHeader) + (dom - 1) * sizeof(ArchiveEntry)) &&
+         file.write((const uint8_t *)&entry, sizeof(entry)) == sizeof(entry);
+  }
+  file.close();
+
+  // Read back what the index now points at (also a block an earlier run
+  // wrote before it could remove the day file)
+  if (ok) {
+    file = sdFS().open(monthPath, FILE_READ);
+    ok = file && entry.length <= MAX_BLOCK && file.seek(entry.offset) &&
+         file.read(block, entry.length) == entry.length &&
+         CRC16::modbus(block, entry.length) == entry.crc &&
+         decodeDay(block, entry.length, check) == entry.count &&
+         memcmp(day, check, SAMPLES_PER_DAY * sizeof(PowerSample)) == 0;
+    if (file)
+      file.close();
+  }
+  if (!ok) {
+    Serial.printf("[Archive] Failed to archive %s\n", dayPath);
+    return false;
+  }
+  sdFS().remove(dayPath);
+  Serial.printf("[Archive] %s -> %s (%u samples, %u bytes)\n", dayPath,
+                monthPath, count, (unsigned)length);
+  return true;
+}
+
+int compact(const char *dir, uint32_t beforeDate) {
+  // The oldest closed days first, a few at a time
+  uint32_t dates[DAYS_PER_RUN];
+  int found = 0;
+  File root = sdFS().open(dir);
+  if (!root || !root.isDirectory())
+    return 0;
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    const char *name = f.name();
+    const char *slash = strrchr(name, '/');
+    if (slash)
+      name = slash + 1;
+    int y, m, d;
+    char ext[4];
+    uint32_t date = 0;
+    if (!f.isDirectory() &&
+        sscanf(name, "%4d-%2d-%2d.%3s", &y, &m, &d, ext) == 4 &&
+        strcmp(ext, "bin") == 0)
+      date = y * 10000 + m * 100 + d;
+    f.close();
+    if (date == 0 || date >= beforeDate)
+      continue;
+    // Keep the DAYS_PER_RUN smallest, sorted
+    int at = found < DAYS_PER_RUN ? found++ : DAYS_PER_RUN;
+    if (at == DAYS_PER_RUN && date >= dates[DAYS_PER_RUN - 1])
+      continue;
+    if (at == DAYS_PER_RUN)
+      at--;
+    while (at > 0 && dates[at - 1] > date) {
+      dates[at] = dates[at - 1];
+      at--;
+    }
+    dates[at] = date;
+  }
+  root.close();
+  if (found == 0)
+    return 0;
+
+  // Two day buffers and a block, in PSRAM; the worker stack stays small
+  size_t daySize = SAMPLES_PER_DAY * sizeof(PowerSample);
+  uint8_t *work = (uint8_t *)heap_caps_malloc(2 * daySize + MAX_BLOCK,
+                                              MALLOC_CAP_SPIRAM);
+  if (!work)
+    return 0;
+  PowerSample *day = (PowerSample *)work;
+  PowerSample *check = (PowerSample *)(work + daySize);
+  uint8_t *block = work + 2 * daySize;
+
+  int archived = 0;
+  for (int i = 0; i < found; i++) {
+    if (archiveDay(dir, dates[i], day, check, block))
+      archived++;
+  }
+  free(work);
+  return archived;
+}
+
+} // namespace HistoryArchive
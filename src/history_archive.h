@@ -0,0 +1,95 @@
+/**
+ * History Archive
+ *
+ * Day files that have left the 7-day ring are never read again by the
+ * dashboard, but one more lands in the history directory every day. The
+ * compaction job folds them into one file per month, <dir>/YYYY-MM.arc,
+ * and removes them, so the directory holds the ring plus a file a month
+ * however many years are kept.
+ *
+ *   ArchiveHeader               magic, version, year, month
+ *   ArchiveEntry index[31]      per day of the month: where its block is
+ *   day blocks                  appended in the order days are archived
+ *
+ * The index sits at a fixed place at the front, so finding a day is one
+ * read. A block holds the day's recorded minutes, each as changes from
+ * the one before (the first from an all-zero sample at slot -1):
+ *
+ *   varint   slots after the previous sample
+ *   byte     mask of the fields that changed, bit n = Field n
+ *   zigzag varint per set bit, lowest first: new value minus old (for
+ *            TIME, minus old + 60 s per slot moved)
+ *
+ * Varints are 7 bits per byte, low first, high bit set on all but the
+ * last, as in telemetry_delta.h. A steady minute costs two bytes against
+ * 14 in the day file.
+ *
+ * compact() runs on the storage worker (sdFS() only) and archives a few
+ * days per call; each block is decoded and compared with its day before
+ * the day file is removed.
+ */
+
+#ifndef HISTORY_ARCHIVE_H
+#define HISTORY_ARCHIVE_H
+
+#include "power_history.h"
+#include <Arduino.h>
+
+namespace HistoryArchive {
+
+static const uint32_t MAGIC = 0x41525750; // "PWRA"
+static const uint8_t VERSION = 1;
+static const int MAX_DAYS = 31;
+static const int DAYS_PER_RUN = 4; // Keeps the worker free for the UI
+
+struct __attribute__((packed)) ArchiveHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t year;
+  uint8_t month;
+  uint8_t pad[7];
+};
+static_assert(sizeof(ArchiveHeader) == 16, "Header layout is on disk");
+
+struct __attribute__((packed)) ArchiveEntry {
+  uint32_t offset; // Of the block in the file, 0 = day not archived
+  uint32_t length; // Block bytes
+  uint16_t count;  // Samples in the block
+  uint16_t crc;    // CRC-16/MODBUS of the block
+};
+
+enum Field : uint8_t {
+  TIME,
+  BATTERY,
+  IN_W,
+  OUT_W,
+  DC_IN_W,
+  VOLTAGE_CV,
+  OUTLETS,
+  FIELD_COUNT
+};
+
+/**
+ * Encode the recorded slots of day (SAMPLES_PER_DAY of them) into out
+ * @return Bytes written, 0 if they do not fit in cap
+ */
+size_t encodeDay(const PowerSample *day, uint8_t *out, size_t cap,
+                 uint16_t &count);
+
+/**
+ * Decode a block into day (SAMPLES_PER_DAY slots, cleared first)
+ * @return Samples decoded, -1 if the block is malformed
+ */
+int decodeDay(const uint8_t *in, size_t length, PowerSample *day);
+
+/**
+ * Archive up to DAYS_PER_RUN day files under dir dated before
+ * beforeDate (YYYYMMDD)
+ * @return Days archived (DAYS_PER_RUN: there may be more)
+ */
+int compact(const char *dir, uint32_t beforeDate);
+
+} // namespace HistoryArchive
+
+#endif // HISTORY_ARCHIVE_H
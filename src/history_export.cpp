@@ -0,0 +1,359 @@
+/**
+ * History Export Implementation
+ */
+
+#include "history_export.h"
+#include "utils/crc16.h"
+#include "utils/sd_manager.h"
+#include <NimBLEDevice.h>
+#include <SD.h>
+
+extern SDManager *sdManager;
+
+// GATT service for the BLE transport
+const char *const HistoryExporter::BLE_SERVICE_UUID =
+    "8f1c0001-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+static const char *EXPORT_CONTROL_UUID = "8f1c0002-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+static const char *EXPORT_DATA_UUID = "8f1c0003-5d6e-4c3a-9b1e-3f0a7c2d4e10";
+
+static const size_t BLE_HEADER = 5; // Type + offset
+static const uint16_t ATT_OVERHEAD = 3;
+
+namespace {
+
+HistoryExporter *bleExporter = nullptr;
+NimBLECharacteristic *dataChar = nullptr;
+volatile uint16_t peerMTU = 23;
+volatile bool peerConnected = false;
+
+class ExportServerCallbacks : public NimBLEServerCallbacks {
+public:
+  void onConnect(NimBLEServer *server, ble_gap_conn_desc *desc) override {
+    peerConnected = true;
+    peerMTU = 23;
+    Serial.println("BLE: Export client connected");
+  }
+  void onDisconnect(NimBLEServer *server, ble_gap_conn_desc *desc) override {
+    peerConnected = false;
+    Serial.println("BLE: Export client disconnected");
+    if (bleExporter)
+      bleExporter->onCommand("STOP", 4);
+    NimBLEDevice::startAdvertising();
+  }
+  void onMTUChange(uint16_t mtu, ble_gap_conn_desc *desc) override {
+    peerMTU = mtu;
+  }
+};
+
+class ExportControlCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  void onWrite(NimBLECharacteristic *characteristic) override {
+    if (!bleExporter)
+      return;
+    NimBLEAttValue value = characteristic->getValue();
+    bleExporter->onCommand((const char *)value.data(), value.length());
+  }
+};
+
+ExportServerCallbacks serverCallbacks;
+ExportControlCallbacks controlCallbacks;
+
+// Only the history directories may be read, and nothing outside them
+// The history, and the frame recorder's ring
+bool isExportable(const char *path) {
+  return (strncmp(path, "/history", 8) == 0 ||
+          strncmp(path, "/debug", 6) == 0) &&
+         !strstr(path, "..");
+}
+
+} // namespace
+
+HistoryExporter::HistoryExporter(ExportTransport transport)
+    : _transport(transport), _state(State::IDLE), _hasPending(false),
+      _mux(portMUX_INITIALIZER_UNLOCKED), _size(0), _offset(0), _acked(0),
+      _mountGeneration(0), _listed(0) {
+  _pending[0] = '\0';
+  _path[0] = '\0';
+}
+
+HistoryExporter::~HistoryExporter() {
+  stop();
+  if (bleExporter == this)
+    bleExporter = nullptr;
+}
+
+bool HistoryExporter::begin() {
+  if (_transport == ExportTransport::USB)
+    return true;
+
+  if (bleExporter) {
+    Serial.println("BLE: Export service already running");
+    return false;
+  }
+  if (!NimBLEDevice::getInitialized()) {
+    NimBLEDevice::init("M5PaperS3");
+    NimBLEDevice::setSecurityAuth(false, false, false);
+  }
+
+  NimBLEServer *server = NimBLEDevice::createServer();
+  server->setCallbacks(&serverCallbacks, false);
+  NimBLEService *service = server->createService(BLE_SERVICE_UUID);
+  NimBLECharacteristic *control = service->createCharacteristic(
+      EXPORT_CONTROL_UUID, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR);
+  control->setCallbacks(&controlCallbacks);
+  dataChar =
+      service->createCharacteristic(EXPORT_DATA_UUID, NIMBLE_PROPERTY::NOTIFY);
+  service->start();
+
+  NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
+  advertising->addServiceUUID(BLE_SERVICE_UUID);
+  advertising->start();
+
+  bleExporter = this;
+  Serial.println("BLE: History export service advertising");
+  return true;
+}
+
+void HistoryExporter::onCommand(const char *text, size_t length) {
+  if (length >= MAX_COMMAND)
+    length = MAX_COMMAND - 1;
+  portENTER_CRITICAL(&_mux);
+  memcpy(_pending, text, length);
+  _pending[length] = '\0';
+  _hasPending = true;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void HistoryExporter::update() {
+  if (_hasPending) {
+    char command[MAX_COMMAND];
+    portENTER_CRITICAL(&_mux);
+    memcpy(command, _pending, sizeof(command));
+    _hasPending = false;
+    portEXIT_CRITICAL(&_mux);
+    handle(command);
+  }
+
+  if (_state == State::IDLE)
+    return;
+
+  // An SD recovery invalidates open handles: resume the file where the
+  // host left off, but a half-walked directory cannot be resumed
+  if (!sdManager || !sdManager->isAvailable()) {
+    sendStatus('X', 0, "sd");
+    stop();
+    return;
+  }
+  if (sdManager->getMountGeneration() != _mountGeneration) {
+    if (_state == State::LISTING || !openFile()) {
+      sendStatus('X', 0, "remount");
+      stop();
+      return;
+    }
+  }
+
+  if (_state == State::LISTING)
+    serviceList();
+  else
+    serviceSend();
+}
+
+void HistoryExporter::handle(char *command) {
+  char *save = nullptr;
+  char *verb = strtok_r(command, " ", &save);
+  char *arg = strtok_r(nullptr, " ", &save);
+  char *arg2 = strtok_r(nullptr, " ", &save);
+  if (!verb)
+    return;
+
+  if (strcmp(verb, "LIST") == 0) {
+    startList(arg ? arg : "/history");
+  } else if (strcmp(verb, "GET") == 0 && arg) {
+    startGet(arg, arg2 ? strtoul(arg2, nullptr, 10) : 0);
+  } else if (strcmp(verb, "ACK") == 0 && arg) {
+    uint32_t offset = strtoul(arg, nullptr, 10);
+    if (_state == State::SENDING && offset > _acked && offset <= _offset)
+      _acked = offset;
+  } else if (strcmp(verb, "STOP") == 0) {
+    stop();
+  } else {
+    sendStatus('X', 0, "command");
+  }
+}
+
+void HistoryExporter::startList(const char *dir) {
+  stop();
+  if (!isExportable(dir) || !sdManager || !sdManager->isAvailable()) {
+    sendStatus('X', 0, "path");
+    return;
+  }
+  _dir = sdFS().open(dir);
+  if (!_dir || !_dir.isDirectory()) {
+    _dir.close();
+    sendStatus('X', 0, "path");
+    return;
+  }
+  _mountGeneration = sdManager->getMountGeneration();
+  _listed = 0;
+  _state = State::LISTING;
+}
+
+void HistoryExporter::startGet(const char *path, uint32_t offset) {
+  stop();
+  if (!isExportable(path) || strlen(path) >= MAX_PATH || !sdManager ||
+      !sdManager->isAvailable()) {
+    sendStatus('X', 0, "path");
+    return;
+  }
+  strcpy(_path, path);
+  _offset = offset;
+  _acked = offset;
+  if (!openFile()) {
+    sendStatus('X', 0, "path");
+    return;
+  }
+  if (_offset > _size) {
+    _file.close();
+    sendStatus('X', _size, "offset");
+    return;
+  }
+  Serial.printf("[HistoryExport] Sending %s from %u (%u bytes)\n", _path,
+                (unsigned)_offset, (unsigned)_size);
+  _state = State::SENDING;
+}
+
+bool HistoryExporter::openFile() {
+  _file.close();
+  _file = sdFS().open(_path, FILE_READ);
+  if (!_file || _file.isDirectory()) {
+    _file.close();
+    return false;
+  }
+  _size = _file.size();
+  _mountGeneration = sdManager->getMountGeneration();
+  return _offset > _size || _file.seek(_offset);
+}
+
+void HistoryExporter::stop() {
+  _dir.close();
+  _file.close();
+  _state = State::IDLE;
+}
+
+void HistoryExporter::serviceList() {
+  for (int i = 0; i < CHUNKS_PER_UPDATE; i++) {
+    if (!canSend(MAX_PATH + 12))
+      return;
+    File entry = _dir.openNextFile();
+    if (!entry) {
+      sendStatus('L', _listed);
+      stop();
+      return;
+    }
+    if (!entry.isDirectory()) {
+      sendEntry(entry.path(), entry.size());
+      _listed++;
+    }
+    entry.close();
+  }
+}
+
+void HistoryExporter::serviceSend() {
+  uint8_t buffer[BLE_CHUNK_MAX];
+  int chunk = chunkSize();
+
+  for (int i = 0; i < CHUNKS_PER_UPDATE; i++) {
+    if (_offset >= _size) {
+      if (canSend(16)) {
+        sendStatus('E', _size);
+        stop();
+      }
+      return;
+    }
+
+    uint32_t left = _size - _offset;
+    size_t n = left < (uint32_t)chunk ? left : chunk;
+    // Flow control: never run more than the window ahead of the host
+    if (_offset + n - _acked > WINDOW_BYTES || !canSend(n))
+      return;
+
+    if (_file.read(buffer, n) != n) {
+      Serial.printf("[HistoryExport] Read failed at %u\n", (unsigned)_offset);
+      sendStatus('X', _offset, "read");
+      stop();
+      return;
+    }
+    sendData(_offset, buffer, n);
+    _offset += n;
+  }
+}
+
+int HistoryExporter::chunkSize() const {
+  if (_transport == ExportTransport::USB)
+    return USB_CHUNK;
+  int chunk = (int)peerMTU - ATT_OVERHEAD - BLE_HEADER;
+  return chunk > BLE_CHUNK_MAX ? BLE_CHUNK_MAX : chunk;
+}
+
+bool HistoryExporter::canSend(size_t bytes) const {
+  if (_transport == ExportTransport::BLE)
+    return peerConnected && dataChar;
+  // Hex doubles the payload; the rest is prefix, offset and CRC. Writing
+  // only what fits keeps Serial from blocking the loop.
+  return Serial.availableForWrite() >= (int)(bytes * 2 + 32);
+}
+
+void HistoryExporter::sendEntry(const char *path, uint32_t size) {
+  if (_transport == ExportTransport::USB) {
+    Serial.printf("#EXP F %s %u\n", path, (unsigned)size);
+    return;
+  }
+  char text[MAX_PATH + 12];
+  snprintf(text, sizeof(text), "%s %u", path, (unsigned)size);
+  sendStatus('F', 0, text);
+}
+
+void HistoryExporter::sendData(uint32_t offset, const uint8_t *data,
+                               size_t length) {
+  if (_transport == ExportTransport::USB) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    char hex[USB_CHUNK * 2 + 1];
+    for (size_t i = 0; i < length; i++) {
+      hex[i * 2] = HEX_DIGITS[data[i] >> 4];
+      hex[i * 2 + 1] = HEX_DIGITS[data[i] & 0x0F];
+    }
+    hex[length * 2] = '\0';
+    Serial.printf("#EXP D %u %s %04x\n", (unsigned)offset, hex,
+                  CRC16::modbus(data, length));
+    return;
+  }
+
+  uint8_t packet[BLE_HEADER + BLE_CHUNK_MAX];
+  packet[0] = 'D';
+  memcpy(packet + 1, &offset, sizeof(offset));
+  memcpy(packet + BLE_HEADER, data, length);
+  dataChar->setValue(packet, BLE_HEADER + length);
+  dataChar->notify();
+}
+
+void HistoryExporter::sendStatus(char type, uint32_t value, const char *text) {
+  if (_transport == ExportTransport::USB) {
+    if (text)
+      Serial.printf("#EXP %c %s\n", type, text);
+    else
+      Serial.printf("#EXP %c %u\n", type, (unsigned)value);
+    return;
+  }
+  if (!peerConnected || !dataChar)
+    return;
+
+  uint8_t packet[BLE_HEADER + MAX_PATH + 12];
+  size_t length = text ? strlen(text) : 0;
+  if (length > sizeof(packet) - BLE_HEADER)
+    length = sizeof(packet) - BLE_HEADER;
+  packet[0] = type;
+  memcpy(packet + 1, &value, sizeof(value));
+  memcpy(packet + BLE_HEADER, text, length);
+  dataChar->setValue(packet, BLE_HEADER + length);
+  dataChar->notify();
+}
@@ -0,0 +1,117 @@
+/**
+ * History Export
+ *
+ * Streams the files under the history directories (day files, journal,
+ * rollups, energy totals) and /debug (the frame recorder) to a host over
+ * USB serial or over a BLE GATT service, reading SD in small chunks so
+ * memory use does not depend on how much history is stored. Both
+ * transports share one text command set:
+ *
+ *   LIST [dir]        list files under dir (default /history)
+ *   GET <path> [off]  stream a file starting at byte off
+ *   ACK <off>         host has everything before off; opens the window
+ *   STOP              abandon the current listing or transfer
+ *
+ * Over USB the serial console (serial_console.h) reads the lines and
+ * hands these over; the port's other commands are its own.
+ *
+ * At most WINDOW_BYTES are sent past the last ACK, so a slow host throttles
+ * the device instead of losing data. A transfer that breaks off is resumed
+ * with GET at the last offset the host verified; a gap in the offsets (a
+ * dropped notification) is recovered the same way.
+ *
+ * USB replies are lines prefixed with "#EXP " so they can be picked out of
+ * the debug log:
+ *   #EXP F <path> <size>          list entry
+ *   #EXP L <count>                end of list
+ *   #EXP D <off> <hex> <crc16>    data chunk (CRC-16/MODBUS of the bytes)
+ *   #EXP E <size>                 end of file
+ *   #EXP X <reason>               error
+ *
+ * BLE replies are notifications on the data characteristic:
+ *   [type][offset u32 LE][payload], with the same type letters; F carries
+ *   "<path> <size>" as payload, L/E carry the count/size in the offset
+ *   field and X carries the reason as payload.
+ */
+
+#ifndef HISTORY_EXPORT_H
+#define HISTORY_EXPORT_H
+
+#include <Arduino.h>
+#undef min
+#undef max
+#include <FS.h>
+
+enum class ExportTransport { USB, BLE };
+
+class HistoryExporter {
+public:
+  static const uint32_t WINDOW_BYTES = 4096; // Sent ahead of the last ACK
+  static const int USB_CHUNK = 48;           // Bytes per hex line
+  static const int BLE_CHUNK_MAX = 244;      // Payload at the largest MTU
+  static const int CHUNKS_PER_UPDATE = 4;    // Keeps the loop responsive
+  static const int MAX_COMMAND = 64;
+  static const int MAX_PATH = 48;
+  static const char *const BLE_SERVICE_UUID; // The GATT service
+
+  explicit HistoryExporter(ExportTransport transport);
+  ~HistoryExporter();
+
+  /**
+   * Start the transport (the BLE transport registers its GATT service and
+   * advertises; NimBLE is initialized if no power bank session did so)
+   */
+  bool begin();
+
+  /**
+   * Read commands and send the next chunks. Call from the main loop, which
+   * also owns every other SD access.
+   */
+  void update();
+
+  /**
+   * Queue a command line (safe from the NimBLE host task and the serial
+   * console's)
+   */
+  void onCommand(const char *text, size_t length);
+
+  bool isBusy() const { return _state != State::IDLE; }
+
+private:
+  enum class State { IDLE, LISTING, SENDING };
+
+  ExportTransport _transport;
+  State _state;
+
+  // Command handed over from the serial console or the GATT write
+  // callback
+  char _pending[MAX_COMMAND];
+  volatile bool _hasPending;
+  portMUX_TYPE _mux;
+
+  // Current transfer
+  File _dir;
+  File _file;
+  char _path[MAX_PATH];
+  uint32_t _size;
+  uint32_t _offset; // Next byte to send
+  uint32_t _acked;  // Host has everything before this
+  uint32_t _mountGeneration;
+  int _listed;
+
+  void handle(char *command);
+  void startList(const char *dir);
+  void startGet(const char *path, uint32_t offset);
+  void stop();
+  bool openFile();
+  void serviceList();
+  void serviceSend();
+
+  int chunkSize() const;
+  bool canSend(size_t bytes) const;
+  void sendEntry(const char *path, uint32_t size);
+  void sendData(uint32_t offset, const uint8_t *data, size_t length);
+  void sendStatus(char type, uint32_t value, const char *text = nullptr);
+};
+
+#endif // HISTORY_EXPORT_H
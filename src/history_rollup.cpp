@@ -0,0 +1,170 @@
+#include "history_rollup.h"
+#include "utils/sd_manager.h"
+#include <esp_heap_caps.h>
+
+#define ROLLUP_FILE_MAGIC 0x4C525750 // "PWRL"
+#define ROLLUP_FILE_VERSION 1
+
+void RollupBucket::reset(uint32_t startTime) {
+  memset(this, 0, sizeof(*this));
+  start = startTime;
+  minPct = 0xFF;
+  minInW = 0xFFFF;
+  minOutW = 0xFFFF;
+}
+
+void RollupBucket::add(uint8_t pct, uint16_t inW, uint16_t outW) {
+  count++;
+  if (pct < minPct)
+    minPct = pct;
+  if (pct > maxPct)
+    maxPct = pct;
+  if (inW < minInW)
+    minInW = inW;
+  if (inW > maxInW)
+    maxInW = inW;
+  if (outW < minOutW)
+    minOutW = outW;
+  if (outW > maxOutW)
+    maxOutW = outW;
+  sumPct += pct;
+  sumInW += inW;
+  sumOutW += outW;
+}
+
+RollupTier::RollupTier()
+    : _buckets(nullptr), _span(60), _capacity(0), _head(0), _count(0) {}
+
+bool RollupTier::begin(uint32_t spanSecs, uint16_t capacity) {
+  _span = spanSecs;
+  _buckets = (RollupBucket *)heap_caps_calloc(capacity, sizeof(RollupBucket),
+                                              MALLOC_CAP_SPIRAM);
+  if (!_buckets)
+    _buckets = (RollupBucket *)calloc(capacity, sizeof(RollupBucket));
+  _capacity = _buckets ? capacity : 0;
+  return _buckets != nullptr;
+}
+
+RollupTier::~RollupTier() { free(_buckets); }
+
+bool RollupTier::add(uint32_t timestamp, uint8_t pct, uint16_t inW,
+                     uint16_t outW) {
+  if (!_buckets || timestamp == 0)
+    return false;
+
+  uint32_t start = timestamp - timestamp % _span;
+  RollupBucket *b = &_buckets[_head];
+  bool started = false;
+  if (_count == 0 || b->start != start) {
+    if (_count > 0 && start < b->start)
+      return false; // Clock went backwards; don't reopen old buckets
+    if (_count > 0)
+      _head = (_head + 1) % _capacity;
+    if (_count < _capacity)
+      _count++;
+    b = &_buckets[_head];
+    b->reset(start);
+    started = true;
+  }
+
+  b->add(pct, inW, outW);
+  return started;
+}
+
+const RollupBucket *RollupTier::get(uint16_t age) const {
+  if (!_buckets || age >= _count)
+    return nullptr;
+  return &_buckets[(_head + _capacity - age) % _capacity];
+}
+
+const RollupBucket *RollupTier::find(uint32_t timestamp) const {
+  const RollupBucket *newest = get(0);
+  if (!newest)
+    return nullptr;
+  uint32_t start = timestamp - timestamp % _span;
+  if (start > newest->start)
+    return nullptr;
+  uint32_t age = (newest->start - start) / _span;
+  const RollupBucket *b = age < _count ? get(age) : nullptr;
+  return b && b->start == start ? b : nullptr; // Gaps leave no bucket
+}
+
+bool RollupTier::save(fs::File &file) const {
+  if (!_buckets)
+    return false;
+  uint16_t meta[2] = {_head, _count};
+  size_t bytes = _capacity * sizeof(RollupBucket);
+  return file.write((const uint8_t *)meta, sizeof(meta)) == sizeof(meta) &&
+         file.write((const uint8_t *)_buckets, bytes) == bytes;
+}
+
+bool RollupTier::load(fs::File &file) {
+  uint16_t meta[2];
+  size_t bytes = _capacity * sizeof(RollupBucket);
+  if (!_buckets)
+    return false;
+  if (file.read((uint8_t *)meta, sizeof(meta)) != sizeof(meta) ||
+      meta[0] >= _capacity || meta[1] > _capacity ||
+      file.read((uint8_t *)_buckets, bytes) != bytes) {
+    memset(_buckets, 0, bytes);
+    _head = 0;
+    _count = 0;
+    return false;
+  }
+  _head = meta[0];
+  _count = meta[1];
+  return true;
+}
+
+HistoryRollup::HistoryRollup() : _dirty(false) {
+  _tiers[QUARTER_HOUR].begin(15 * 60, 7 * 96);
+  _tiers[HOUR].begin(3600, 60 * 24);
+  _tiers[DAY].begin(86400, 730);
+}
+
+void HistoryRollup::add(uint32_t timestamp, uint8_t pct, uint16_t inW,
+                        uint16_t outW) {
+  // Every tier folds the raw sample, so coarse means stay exact
+  for (int t = 0; t < TIER_COUNT; t++) {
+    if (_tiers[t].add(timestamp, pct, inW, outW) && t == HOUR)
+      _dirty = true;
+  }
+}
+
+bool HistoryRollup::saveToSD(const char *path) {
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("[PowerHistory] Failed to open %s\n", path);
+    return false;
+  }
+
+  uint32_t header[2] = {ROLLUP_FILE_MAGIC,
+                        ROLLUP_FILE_VERSION | (sizeof(RollupBucket) << 8)};
+  bool ok = file.write((const uint8_t *)header, sizeof(header)) ==
+            sizeof(header);
+  for (int t = 0; ok && t < TIER_COUNT; t++)
+    ok = _tiers[t].save(file);
+  file.close();
+
+  if (ok)
+    _dirty = false;
+  return ok;
+}
+
+bool HistoryRollup::loadFromSD(const char *path) {
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return false;
+
+  uint32_t header[2];
+  bool ok = file.read((uint8_t *)header, sizeof(header)) == sizeof(header) &&
+            header[0] == ROLLUP_FILE_MAGIC &&
+            header[1] == (ROLLUP_FILE_VERSION | (sizeof(RollupBucket) << 8));
+  for (int t = 0; ok && t < TIER_COUNT; t++)
+    ok = _tiers[t].load(file);
+  file.close();
+
+  Serial.printf("[PowerHistory] Rollups %s from %s\n",
+                ok ? "loaded" : "not loaded", path);
+  return ok;
+}
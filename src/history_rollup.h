@@ -0,0 +1,96 @@
+#ifndef HISTORY_ROLLUP_H
+#define HISTORY_ROLLUP_H
+
+#include <Arduino.h>
+
+// Forward declaration for SD File class
+namespace fs {
+class File;
+}
+
+// One downsampled interval (packed: also the on-disk record)
+struct __attribute__((packed)) RollupBucket {
+  uint32_t start; // Unix time the interval begins, 0 = empty
+  uint16_t count; // 1-minute samples folded in
+  uint8_t minPct;
+  uint8_t maxPct;
+  uint16_t minInW;
+  uint16_t maxInW;
+  uint16_t minOutW;
+  uint16_t maxOutW;
+  uint32_t sumPct;  // mean = sum / count
+  uint32_t sumInW;  // mean = sum / count; Wh = sum / 60
+  uint32_t sumOutW; // mean = sum / count; Wh = sum / 60
+
+  float meanInW() const { return count ? (float)sumInW / count : 0.0f; }
+  float meanOutW() const { return count ? (float)sumOutW / count : 0.0f; }
+  float meanPct() const { return count ? (float)sumPct / count : 0.0f; }
+  float energyInWh() const { return sumInW / 60.0f; }
+  float energyOutWh() const { return sumOutW / 60.0f; }
+
+  // Empty the bucket and start it at a new interval
+  void reset(uint32_t startTime);
+
+  // Fold one 1-minute sample in
+  void add(uint8_t pct, uint16_t inW, uint16_t outW);
+};
+
+// Ring of fixed-span buckets, newest last; storage lives in PSRAM
+class RollupTier {
+public:
+  RollupTier();
+  ~RollupTier();
+  RollupTier(const RollupTier &) = delete;
+  RollupTier &operator=(const RollupTier &) = delete;
+
+  // Allocate the ring (zeroed; PSRAM when available)
+  bool begin(uint32_t spanSecs, uint16_t capacity);
+
+  // Fold a 1-minute sample into the bucket covering its timestamp
+  // @return true if a new bucket was started
+  bool add(uint32_t timestamp, uint8_t pct, uint16_t inW, uint16_t outW);
+
+  // Bucket by age: 0 = current, 1 = the one before, ...
+  // Returns nullptr past the oldest bucket
+  const RollupBucket *get(uint16_t age) const;
+
+  // Bucket covering a timestamp, if still held
+  const RollupBucket *find(uint32_t timestamp) const;
+
+  uint16_t size() const { return _count; }
+  uint16_t capacity() const { return _capacity; }
+  uint32_t span() const { return _span; }
+
+  bool save(fs::File &file) const;
+  bool load(fs::File &file);
+
+private:
+  RollupBucket *_buckets;
+  uint32_t _span;
+  uint16_t _capacity;
+  uint16_t _head; // Index of the current bucket
+  uint16_t _count;
+};
+
+// 15 min for 7 days, 1 hour for 60 days, 1 day for 2 years (~80 KB)
+class HistoryRollup {
+public:
+  enum Tier { QUARTER_HOUR, HOUR, DAY, TIER_COUNT };
+
+  HistoryRollup();
+
+  void add(uint32_t timestamp, uint8_t pct, uint16_t inW, uint16_t outW);
+  const RollupTier &tier(Tier t) const { return _tiers[t]; }
+
+  // True once an hour has closed since the last save
+  bool isDirty() const { return _dirty; }
+
+  bool saveToSD(const char *path);
+  bool loadFromSD(const char *path);
+
+private:
+  RollupTier _tiers[TIER_COUNT];
+  bool _dirty;
+};
+
+#endif // HISTORY_ROLLUP_H
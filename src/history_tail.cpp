@@ -0,0 +1,133 @@
+/**
+ * History Tail Implementation
+ */
+
+#include "history_tail.h"
+#include "utils/crc16.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+
+namespace HistoryTail {
+
+static const uint32_t MAGIC = 0x4854414C; // "HTAL"
+
+struct __attribute__((packed)) Record {
+  uint16_t stream;
+  PowerSample sample; // timestamp 0: a free record
+  uint16_t crc;       // CRC-16/Modbus of the fields above
+};
+
+struct Ring {
+  uint32_t magic;
+  Record records[TAIL_RECORDS];
+};
+
+// Survives resets and deep sleep; a power-on leaves it random
+RTC_NOINIT_ATTR static Ring _ring;
+
+static portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+static bool _checked = false;
+
+static uint16_t crcOf(const Record &r) {
+  return CRC16::modbus((const uint8_t *)&r, sizeof(r) - sizeof(r.crc));
+}
+
+static bool live(const Record &r) {
+  return r.sample.timestamp != 0 && r.crc == crcOf(r);
+}
+
+// First use this boot: a ring power-on garbage could pass record by
+// record is wiped (lock held)
+static void check() {
+  if (_checked)
+    return;
+  _checked = true;
+  if (_ring.magic != MAGIC || esp_reset_reason() == ESP_RST_POWERON) {
+    memset(&_ring, 0, sizeof(_ring));
+    _ring.magic = MAGIC;
+  }
+}
+
+uint16_t streamOf(const char *dir) {
+  return CRC16::modbus((const uint8_t *)dir, strlen(dir));
+}
+
+void add(uint16_t stream, const PowerSample &sample) {
+  portENTER_CRITICAL(&_lock);
+  check();
+
+  // A free record, else the oldest (or the one with the same minute)
+  int slot = -1;
+  for (int i = 0; i < TAIL_RECORDS; i++) {
+    const Record &r = _ring.records[i];
+    if (!live(r) || (r.stream == stream &&
+                     r.sample.timestamp / 60 == sample.timestamp / 60)) {
+      slot = i;
+      break;
+    }
+    if (slot < 0 ||
+        r.sample.timestamp < _ring.records[slot].sample.timestamp)
+      slot = i;
+  }
+  Record &r = _ring.records[slot];
+  r.stream = stream;
+  r.sample = sample;
+  r.crc = crcOf(r);
+  portEXIT_CRITICAL(&_lock);
+}
+
+int collect(uint16_t stream, PowerSample *out, int maxOut) {
+  int n = 0;
+  portENTER_CRITICAL(&_lock);
+  check();
+  for (int i = 0; i < TAIL_RECORDS && n < maxOut; i++) {
+    const Record &r = _ring.records[i];
+    if (!live(r) || r.stream != stream)
+      continue;
+    // Insertion sort: a few dozen records at most
+    int j = n++;
+    for (; j > 0 && out[j - 1].timestamp > r.sample.timestamp; j--)
+      out[j] = out[j - 1];
+    out[j] = r.sample;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return n;
+}
+
+int count(uint16_t stream) {
+  int n = 0;
+  portENTER_CRITICAL(&_lock);
+  check();
+  for (int i = 0; i < TAIL_RECORDS; i++) {
+    if (live(_ring.records[i]) && _ring.records[i].stream == stream)
+      n++;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return n;
+}
+
+void release(uint16_t stream) {
+  portENTER_CRITICAL(&_lock);
+  check();
+  for (int i = 0; i < TAIL_RECORDS; i++) {
+    Record &r = _ring.records[i];
+    if (r.stream == stream || !live(r))
+      memset(&r, 0, sizeof(r));
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+bool nearlyFull() {
+  int used = 0;
+  portENTER_CRITICAL(&_lock);
+  check();
+  for (int i = 0; i < TAIL_RECORDS; i++) {
+    if (live(_ring.records[i]))
+      used++;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return used * 4 >= TAIL_RECORDS * 3;
+}
+
+} // namespace HistoryTail
@@ -0,0 +1,62 @@
+/**
+ * History Tail
+ *
+ * Samples a PowerHistory has taken but not yet flushed, kept in RTC slow
+ * memory so a reset, a panic or a brown-out the RTC domain rides out
+ * loses none of them. The journal only becomes durable at a flush, which
+ * made the flush interval a trade between lost minutes and SD power
+ * cycles; with the tail replayed at boot the interval can stretch to
+ * half an hour or more.
+ *
+ * One ring of TAIL_RECORDS, shared by every history (each tags its
+ * records with a stream id) and checked record by record against a CRC:
+ * the memory is never initialised by the boot, so garbage after a
+ * power-on and a record torn by the reset are both simply skipped. A full
+ * ring drops its oldest record; nearlyFull() asks for a flush first.
+ */
+
+#ifndef HISTORY_TAIL_H
+#define HISTORY_TAIL_H
+
+#include "power_history.h"
+#include <Arduino.h>
+
+namespace HistoryTail {
+
+static const int TAIL_RECORDS = 64;
+
+/**
+ * Stream id of a history directory
+ */
+uint16_t streamOf(const char *dir);
+
+/**
+ * Keep a sample until release() (any task)
+ */
+void add(uint16_t stream, const PowerSample &sample);
+
+/**
+ * Intact records of stream, oldest first
+ * @return Samples written to out
+ */
+int collect(uint16_t stream, PowerSample *out, int maxOut);
+
+/**
+ * Records held for stream
+ */
+int count(uint16_t stream);
+
+/**
+ * Forget stream's records (they are durable on a card or flash)
+ */
+void release(uint16_t stream);
+
+/**
+ * Three quarters of the ring in use: time to flush rather than lose the
+ * oldest
+ */
+bool nearlyFull();
+
+} // namespace HistoryTail
+
+#endif // HISTORY_TAIL_H
@@ -0,0 +1,149 @@
+/**
+ * Load Forecaster Implementation
+ */
+
+#include "load_forecast.h"
+
+LoadForecaster::LoadForecaster()
+    : _netW(0), _samples(0), _capacityWh(DEFAULT_CAPACITY_WH), _binStart(0),
+      _binSum(0), _binCount(0), _minutesToEmpty(-1), _minutesToFull(-1) {
+  for (int i = 0; i < PROFILE_BINS; i++) {
+    _profileW[i] = 0;
+    _profileDays[i] = 0;
+  }
+}
+
+void LoadForecaster::foldBin(int bin, float netW) {
+  if (_profileDays[bin] == 0)
+    _profileW[bin] = netW;
+  else
+    _profileW[bin] += PROFILE_ALPHA * (netW - _profileW[bin]);
+  if (_profileDays[bin] < 255)
+    _profileDays[bin]++;
+}
+
+void LoadForecaster::seed(const HistoryRollup &rollup, uint32_t now) {
+  const RollupTier &tier = rollup.tier(HistoryRollup::QUARTER_HOUR);
+  int seeded = 0;
+  // Age 0 is the bucket still filling; the live bin covers it
+  for (int age = tier.size() - 1; age >= 1; age--) {
+    const RollupBucket *b = tier.get(age);
+    if (!b || b->count == 0)
+      continue;
+    foldBin(binFor(b->start), b->meanOutW() - b->meanInW());
+    seeded++;
+  }
+
+  const RollupBucket *latest = tier.get(0);
+  if (latest && latest->count > 0 && now >= latest->start &&
+      now - latest->start < 2 * BIN_SECS) {
+    _netW = latest->meanOutW() - latest->meanInW();
+    _samples = WARMUP_MINUTES;
+  }
+
+  Serial.printf("[Forecast] Profile seeded from %d buckets\n", seeded);
+}
+
+void LoadForecaster::addSample(uint32_t timestamp,
+                               const Fossibot::PowerBankData &data) {
+  float net = Fixed::toFloat(data.outputDeciwatts - data.inputDeciwatts,
+                             Fixed::DW_PER_W);
+
+  if (_samples == 0)
+    _netW = net;
+  else
+    _netW += SHORT_ALPHA * (net - _netW);
+  if (_samples < WARMUP_MINUTES)
+    _samples++;
+
+  // Close the previous bin when the quarter hour changes
+  uint32_t binStart = timestamp - timestamp % BIN_SECS;
+  if (binStart != _binStart) {
+    if (_binCount > 0)
+      foldBin(binFor(_binStart), _binSum / _binCount);
+    _binStart = binStart;
+    _binSum = 0;
+    _binCount = 0;
+  }
+  _binSum += net;
+  _binCount++;
+
+  forecast(timestamp, data);
+}
+
+void LoadForecaster::forecast(uint32_t now,
+                              const Fossibot::PowerBankData &data) {
+  _minutesToEmpty = -1;
+  _minutesToFull = -1;
+  bool draining = _netW > IDLE_NET_W;
+  bool charging = _netW < -IDLE_NET_W;
+  if (!draining && !charging)
+    return;
+
+  // Stop where the device stops, not at 0/100%
+  float floorPct = data.settingsReceived ? data.dischargeLimit : 0;
+  float ceilPct = data.settingsReceived ? data.chargeLimit : 100;
+  float energy = _capacityWh * data.socPermille / Fixed::FULL;
+  float floorWh = _capacityWh * floorPct / 100.0f;
+  float fullWh = _capacityWh * ceilPct / 100.0f;
+
+  if (draining && energy <= floorWh) {
+    _minutesToEmpty = 0;
+    return;
+  }
+  if (charging && energy >= fullWh) {
+    _minutesToFull = 0;
+    return;
+  }
+
+  // Charge above the limit (or below the floor) is still there to use
+  float upperWh = energy > fullWh ? energy : fullWh;
+  float lowerWh = energy < floorWh ? energy : floorWh;
+  float weight = 1.0f; // Share of the EWMA in the expected load
+  for (int m = 1; m <= HORIZON_MINUTES; m++) {
+    int bin = binFor(now + m * 60);
+    float expected = _netW;
+    if (_profileDays[bin])
+      expected = weight * _netW + (1.0f - weight) * _profileW[bin];
+    weight *= HANDOVER_DECAY;
+
+    energy -= expected / 60.0f;
+    if (draining && energy <= floorWh) {
+      _minutesToEmpty = m;
+      return;
+    }
+    if (charging && energy >= fullWh) {
+      _minutesToFull = m;
+      return;
+    }
+    // The battery cannot hold more than full or less than empty
+    if (energy > upperWh)
+      energy = upperWh;
+    else if (energy < lowerWh)
+      energy = lowerWh;
+  }
+}
+
+void LoadForecaster::calibrate(const Fossibot::PowerBankData &data) {
+  float net = Fixed::toFloat(data.outputDeciwatts - data.inputDeciwatts,
+                             Fixed::DW_PER_W);
+  float pct = Fixed::toFloat(data.socPermille, Fixed::PERMILLE_PER_PCT);
+  float estimate = 0;
+
+  // Capacity implied by the device's estimate at the current net power
+  if (data.minutesToEmpty > 0 && net > 50 && pct > 5)
+    estimate = data.minutesToEmpty / 60.0f * net / (pct / 100.0f);
+  else if (data.minutesToFull > 0 && net < -50 && pct < 95)
+    estimate = data.minutesToFull / 60.0f * -net / ((100.0f - pct) / 100.0f);
+
+  if (estimate < 200 || estimate > 20000)
+    return; // No estimate, or a register glitch
+  _capacityWh += CAPACITY_ALPHA * (estimate - _capacityWh);
+}
+
+void LoadForecaster::apply(Fossibot::PowerBankData &data) const {
+  if (!isReady())
+    return;
+  data.minutesToEmpty = _minutesToEmpty;
+  data.minutesToFull = _minutesToFull;
+}
@@ -0,0 +1,88 @@
+/**
+ * Load Forecaster
+ *
+ * Predicts time to empty / full from expected load instead of the
+ * instantaneous one, so a cycling fridge compressor does not swing the
+ * dashboard between hours and days. Each minute it folds the net draw into
+ * a ~30 minute EWMA and into a 15-minute time-of-day profile (itself an
+ * EWMA across days, seeded from the rollup tiers at boot). The forecast
+ * integrates expected net power minute by minute: the EWMA for the near
+ * term, handing over to the profile over about an hour. Usable capacity is
+ * learned from the power bank's own time estimates.
+ */
+
+#ifndef LOAD_FORECAST_H
+#define LOAD_FORECAST_H
+
+#include "ble/fossibot_protocol.h"
+#include "history_rollup.h"
+#include <Arduino.h>
+
+class LoadForecaster {
+public:
+  static const int PROFILE_BINS = 96;      // 15 minutes of the day each
+  static const uint32_t BIN_SECS = 900;
+  static const int WARMUP_MINUTES = 10;    // Live samples before forecasting
+  static const int HORIZON_MINUTES = 72 * 60;
+  static const int IDLE_NET_W = 5;         // Net power treated as idle
+  static constexpr float DEFAULT_CAPACITY_WH = 3600.0f;
+  static constexpr float SHORT_ALPHA = 1.0f / 30;   // ~30 min EWMA
+  static constexpr float PROFILE_ALPHA = 0.3f;      // Weight of a new day
+  static constexpr float HANDOVER_DECAY = 0.9835f;  // exp(-1/60) per minute
+  static constexpr float CAPACITY_ALPHA = 0.02f;
+
+  LoadForecaster();
+
+  /**
+   * Build the time-of-day profile from the 15-minute rollups (oldest
+   * first). A bucket from the last half hour also primes the EWMA, so the
+   * forecast is available right after a reboot.
+   */
+  void seed(const HistoryRollup &rollup, uint32_t now);
+
+  /**
+   * Fold one 1-minute sample in and recompute the forecast
+   */
+  void addSample(uint32_t timestamp, const Fossibot::PowerBankData &data);
+
+  /**
+   * Refine the usable capacity from the device's own time estimates
+   * (registers 58/59) while it is clearly charging or discharging
+   */
+  void calibrate(const Fossibot::PowerBankData &data);
+
+  void setCapacityWh(float wh) { _capacityWh = wh; }
+  float getCapacityWh() const { return _capacityWh; }
+
+  bool isReady() const { return _samples >= WARMUP_MINUTES; }
+  float getExpectedNetW() const { return _netW; }
+
+  /**
+   * Replace minutesToEmpty/minutesToFull with the forecast, once warm
+   */
+  void apply(Fossibot::PowerBankData &data) const;
+
+private:
+  float _netW;   // Smoothed out - in
+  int _samples;  // Live samples folded into _netW (capped)
+  float _capacityWh;
+
+  float _profileW[PROFILE_BINS]; // Expected net power per bin
+  uint8_t _profileDays[PROFILE_BINS];
+
+  // Bin being accumulated
+  uint32_t _binStart;
+  float _binSum;
+  uint16_t _binCount;
+
+  int _minutesToEmpty;
+  int _minutesToFull;
+
+  static int binFor(uint32_t timestamp) {
+    return (timestamp % 86400) / BIN_SECS;
+  }
+  void foldBin(int bin, float netW);
+  void forecast(uint32_t now, const Fossibot::PowerBankData &data);
+};
+
+#endif // LOAD_FORECAST_H
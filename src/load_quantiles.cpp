@@ -0,0 +1,172 @@
+/**
+ * Load Quantiles Implementation
+ */
+
+#include "load_quantiles.h"
+#include "power_history.h"
+#include "utils/mem_telemetry.h"
+#include "utils/sd_manager.h"
+#include <esp_heap_caps.h>
+
+#define LOAD_FILE_MAGIC 0x44414F4C // "LOAD"
+#define LOAD_FILE_VERSION 1
+
+LoadQuantiles::LoadQuantiles() : _head(0), _count(0), _dirty(false) {
+  // 20 KB: keep it out of internal SRAM (zeroed)
+  _days = (Day *)heap_caps_calloc(DAYS, sizeof(Day), MALLOC_CAP_SPIRAM);
+  if (!_days)
+    _days = (Day *)calloc(DAYS, sizeof(Day));
+  if (_days)
+    MemTelemetry::track(MemTelemetry::Tag::HISTORY, DAYS * sizeof(Day));
+}
+
+LoadQuantiles::~LoadQuantiles() { free(_days); }
+
+int LoadQuantiles::bucketOf(uint16_t watts) {
+  if (watts < 16)
+    return watts;
+  int e = 31 - __builtin_clz(watts); // 4..15
+  return 16 + (e - 4) * 8 + ((watts >> (e - 3)) & 7);
+}
+
+uint16_t LoadQuantiles::bucketValue(int bucket) {
+  if (bucket < 16)
+    return bucket;
+  int e = 4 + (bucket - 16) / 8;
+  uint32_t low = (uint32_t)(8 + (bucket - 16) % 8) << (e - 3);
+  uint32_t mid = low + (1u << (e - 3)) / 2;
+  return mid > 0xFFFF ? 0xFFFF : mid;
+}
+
+const LoadQuantiles::Day &LoadQuantiles::day(int age) const {
+  return _days[(_head - age + DAYS) % DAYS];
+}
+
+void LoadQuantiles::startDay(uint32_t date) {
+  if (_count)
+    _head = (_head + 1) % DAYS;
+  if (_count < DAYS)
+    _count++;
+  Day &d = _days[_head];
+  memset(&d, 0, sizeof(d));
+  d.date = date;
+}
+
+void LoadQuantiles::add(const PowerSample &sample) {
+  if (!_days)
+    return;
+  time_t t = sample.timestamp;
+  struct tm local;
+  localtime_r(&t, &local);
+  uint32_t date = (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 +
+                  local.tm_mday;
+  if (!_count || date > _days[_head].date)
+    startDay(date);
+  else if (date < _days[_head].date)
+    return; // Clock went back
+
+  Day &d = _days[_head];
+  int b = bucketOf(sample.outputW);
+  if (d.samples < 0xFFFF) {
+    d.samples++;
+    d.counts[b]++;
+  }
+  if (d.hours[local.tm_hour][b] < 0xFF)
+    d.hours[local.tm_hour][b]++;
+  if (sample.outputW > d.maxW)
+    d.maxW = sample.outputW;
+  _dirty = true;
+}
+
+template <typename T>
+uint16_t LoadQuantiles::percentile(const T *counts, uint32_t total, float q) {
+  if (!total)
+    return 0;
+  if (q < 0)
+    q = 0;
+  // The sample at rank ceil(q * total), counting from 1
+  uint32_t rank = (uint32_t)(q * total + 0.999f);
+  if (rank < 1)
+    rank = 1;
+  if (rank > total)
+    rank = total;
+  uint32_t seen = 0;
+  for (int b = 0; b < BUCKETS; b++) {
+    seen += counts[b];
+    if (seen >= rank)
+      return bucketValue(b);
+  }
+  return bucketValue(BUCKETS - 1);
+}
+
+uint16_t LoadQuantiles::dayPercentile(int age, float q) const {
+  if (age < 0 || age >= dayCount())
+    return 0;
+  const Day &d = day(age);
+  uint16_t w = percentile(d.counts, d.samples, q);
+  return w > d.maxW ? d.maxW : w; // The top bucket's midpoint can overshoot
+}
+
+uint16_t LoadQuantiles::hourPercentile(int age, int hour, float q) const {
+  if (age < 0 || age >= dayCount() || hour < 0 || hour >= HOURS)
+    return 0;
+  const uint8_t *counts = day(age).hours[hour];
+  uint32_t total = 0;
+  for (int b = 0; b < BUCKETS; b++)
+    total += counts[b];
+  return percentile(counts, total, q);
+}
+
+bool LoadQuantiles::saveToSD(const char *path) {
+  if (!_days)
+    return false;
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("[Load] Failed to open %s\n", path);
+    return false;
+  }
+
+  uint32_t header[2] = {LOAD_FILE_MAGIC,
+                        LOAD_FILE_VERSION | (sizeof(Day) << 8)};
+  bool ok = file.write((const uint8_t *)header, sizeof(header)) ==
+            sizeof(header);
+  // Oldest first
+  for (int age = _count - 1; ok && age >= 0; age--)
+    ok = file.write((const uint8_t *)&day(age), sizeof(Day)) == sizeof(Day);
+  file.close();
+
+  if (ok)
+    _dirty = false;
+  return ok;
+}
+
+bool LoadQuantiles::loadFromSD(const char *path) {
+  if (!_days)
+    return false;
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return false;
+
+  uint32_t header[2];
+  bool ok = file.read((uint8_t *)header, sizeof(header)) == sizeof(header) &&
+            header[0] == LOAD_FILE_MAGIC &&
+            header[1] == (LOAD_FILE_VERSION | (sizeof(Day) << 8));
+  if (ok) {
+    _head = 0;
+    _count = 0;
+    // Straight into the ring slot that comes next
+    for (;;) {
+      uint16_t next = _count ? (_head + 1) % DAYS : _head;
+      if (file.read((uint8_t *)&_days[next], sizeof(Day)) != sizeof(Day))
+        break;
+      _head = next;
+      if (_count < DAYS)
+        _count++;
+    }
+  }
+  file.close();
+
+  Serial.printf("[Load] %d days %s from %s\n", _count,
+                ok ? "loaded" : "not loaded", path);
+  return ok;
+}
@@ -0,0 +1,82 @@
+/**
+ * Load Quantiles
+ *
+ * Output power percentiles (p50, p95, p99...) per day and per hour, for
+ * sizing an inverter or battery by what the load usually draws rather
+ * than its single worst minute. Each sample is counted in one bucket of a
+ * log-scaled histogram in O(1): watts below 16 get a bucket each, above
+ * that a doubling is split into 8 (the value's top four bits), so a
+ * percentile comes out within 1/16 of the true value up to 65535 W in
+ * BUCKETS counters. A day keeps 16-bit counters, each of its hours 8-bit
+ * ones (at most 60 samples); a query walks the counters, never the raw
+ * minutes.
+ *
+ * DAYS local days are kept in a ring, newest first, in PSRAM when there
+ * is some. Saved next to the history as load.bin with the rollups.
+ */
+
+#ifndef LOAD_QUANTILES_H
+#define LOAD_QUANTILES_H
+
+#include <Arduino.h>
+
+struct PowerSample;
+
+class LoadQuantiles {
+public:
+  static const int DAYS = 7;
+  static const int BUCKETS = 112; // 16 exact + 8 per doubling to 2^16
+  static const int HOURS = 24;
+
+  // One local day, also the on-disk record. Laid out without padding, so
+  // it needs no packing (which would misalign counts for percentile())
+  struct Day {
+    uint32_t date; // YYYYMMDD, 0 = empty
+    uint16_t samples;
+    uint16_t maxW;
+    uint16_t counts[BUCKETS];
+    uint8_t hours[HOURS][BUCKETS];
+  };
+  static_assert(sizeof(Day) == 8 + BUCKETS * 2 + HOURS * BUCKETS,
+                "Day layout is on disk");
+
+  LoadQuantiles();
+  ~LoadQuantiles();
+
+  /**
+   * Count one sample's output power (called for every history sample)
+   */
+  void add(const PowerSample &sample);
+
+  /**
+   * Days held, newest first: 0 is the current day
+   */
+  int dayCount() const { return _days ? _count : 0; }
+  const Day &day(int age) const;
+
+  /**
+   * Output watts at or below which a share q (0..1) of the day's, or of
+   * one of its hours', samples fell; 0 without samples
+   */
+  uint16_t dayPercentile(int age, float q) const;
+  uint16_t hourPercentile(int age, int hour, float q) const;
+
+  bool isDirty() const { return _dirty; }
+  bool saveToSD(const char *path);
+  bool loadFromSD(const char *path);
+
+  static int bucketOf(uint16_t watts);
+  static uint16_t bucketValue(int bucket); // Midpoint of its range
+
+private:
+  Day *_days; // Ring, newest at _head
+  uint16_t _head;
+  uint16_t _count;
+  bool _dirty;
+
+  void startDay(uint32_t date);
+  template <typename T>
+  static uint16_t percentile(const T *counts, uint32_t total, float q);
+};
+
+#endif // LOAD_QUANTILES_H
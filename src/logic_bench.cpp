@@ -0,0 +1,224 @@
+/**
+ * Logic Benchmarks Implementation
+ */
+
+#include "logic_bench.h"
+#include "ble/frame_recorder.h"
+#include "ble/register_map.h"
+#include "history_rollup.h"
+#include "ui/game2048.h"
+#include "utils/crc16.h"
+#include "utils/fixed_string.h"
+#include "utils/loop_monitor.h"
+#include <esp_heap_caps.h>
+
+namespace LogicBench {
+
+// Results are folded in here so the work cannot be optimised away
+static volatile uint32_t _sink = 0;
+
+// A response frame: opcode, the rest of the header, 80 registers, CRC
+static const size_t FRAME_REGS = 80;
+static const size_t FRAME_LEN = Fossibot::REG_DATA_OFFSET + FRAME_REGS * 2;
+
+static size_t buildFrame(uint16_t opcode, uint8_t *frame) {
+  memset(frame, 0, FRAME_LEN + 2);
+  frame[0] = opcode >> 8;
+  frame[1] = opcode & 0xFF;
+  for (size_t r = 0; r < FRAME_REGS; r++) {
+    uint16_t value = (r * 37 + 11) & 0x3FF;
+    frame[Fossibot::REG_DATA_OFFSET + r * 2] = value >> 8;
+    frame[Fossibot::REG_DATA_OFFSET + r * 2 + 1] = value & 0xFF;
+  }
+  return CRC16::seal(frame, FRAME_LEN);
+}
+
+static void benchStatusDecode(State &state) {
+  uint8_t frame[FRAME_LEN + 2];
+  size_t len = buildFrame(Fossibot::OPCODE_STATUS, frame);
+  Fossibot::PowerBankData data;
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++) {
+    if (CRC16::verify(frame, len))
+      _sink += Fossibot::decode(Fossibot::STATUS_MAP, frame, len, data);
+  }
+  state.stop();
+}
+
+static void benchSettingsDecode(State &state) {
+  uint8_t frame[FRAME_LEN + 2];
+  size_t len = buildFrame(Fossibot::OPCODE_SETTINGS, frame);
+  Fossibot::PowerBankData data;
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++) {
+    if (CRC16::verify(frame, len))
+      _sink += Fossibot::decode(Fossibot::SETTINGS_MAP, frame, len, data);
+  }
+  state.stop();
+}
+
+// The newest frames the recorder kept, through the same checks and maps
+// as on arrival: real register values, status and settings interleaved
+static void benchRecordedDecode(State &state) {
+  static const int FRAMES = 256;
+  FrameRecorder::Record *frames = (FrameRecorder::Record *)heap_caps_malloc(
+      FRAMES * sizeof(FrameRecorder::Record), MALLOC_CAP_SPIRAM);
+  if (!frames) {
+    state.skip("no memory");
+    return;
+  }
+  int count = FrameRecorder::load(frames, FRAMES);
+  if (count == 0) {
+    free(frames);
+    state.skip("no recording");
+    return;
+  }
+  Fossibot::PowerBankData data;
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++) {
+    const FrameRecorder::Record &r = frames[i % count];
+    size_t len = min((size_t)r.length, (size_t)FrameRecorder::MAX_FRAME);
+    if (!CRC16::verify(r.bytes, len))
+      continue;
+    uint16_t opcode = (r.bytes[0] << 8) | r.bytes[1];
+    if (opcode == Fossibot::OPCODE_STATUS)
+      _sink += Fossibot::decode(Fossibot::STATUS_MAP, r.bytes, len, data,
+                                r.firstReg);
+    else
+      _sink += Fossibot::decode(Fossibot::SETTINGS_MAP, r.bytes, len, data);
+  }
+  state.stop();
+  free(frames);
+}
+
+static void benchCsvParse(State &state) {
+  static const char LINE[] = "1718236800,87,245,132\r";
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++) {
+    StrView fields[4];
+    uint32_t timestamp, battery, input, output;
+    if (StrView(LINE, sizeof(LINE) - 1).split(',', fields, 4) == 4 &&
+        fields[0].toUInt(timestamp) && fields[1].toUInt(battery) &&
+        fields[2].toUInt(input) && fields[3].toUInt(output))
+      _sink += timestamp + battery + input + output;
+  }
+  state.stop();
+}
+
+static void benchRollupAdd(State &state) {
+  HistoryRollup rollup; // About 80 KB of PSRAM
+  if (!rollup.tier(HistoryRollup::DAY).capacity()) {
+    state.skip("no memory");
+    return;
+  }
+  uint32_t t = 1718236800;
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++, t += 60)
+    rollup.add(t, i % 101, i % 800, (i * 7) % 600);
+  state.stop();
+  _sink += rollup.tier(HistoryRollup::QUARTER_HOUR).size();
+}
+
+static void benchFormatTime(State &state) {
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++)
+    _sink += Fossibot::formatTime(i % 2000).length();
+  state.stop();
+}
+
+static void benchGame2048Slide(State &state) {
+  // A busy mid-game board: most moves merge something
+  static const int START[Game2048::SIZE][Game2048::SIZE] = {
+      {2, 2, 4, 8}, {4, 0, 4, 16}, {8, 8, 2, 0}, {2, 4, 4, 2}};
+  Game2048::Board start = 0;
+  for (int r = 0; r < Game2048::SIZE; r++)
+    for (int c = 0; c < Game2048::SIZE; c++)
+      Game2048::setTile(start, r, c, START[r][c]);
+
+  // With the row table, as the game runs; freed again unless it is open
+  bool own = !Game2048::prepared();
+  if (!Game2048::prepare()) {
+    state.skip("no memory");
+    return;
+  }
+  int score = 0;
+  state.start();
+  for (uint32_t i = 0; i < state.iterations(); i++) {
+    Game2048::Board board = start;
+    _sink += Game2048::slide(board, i & 3, score);
+    _sink += Game2048::isOver(board);
+  }
+  state.stop();
+  if (own)
+    Game2048::release();
+  _sink += score;
+}
+
+struct Case {
+  const char *name;
+  void (*fn)(State &);
+};
+
+static const Case CASES[] = {
+    {"status_decode", benchStatusDecode},
+    {"settings_decode", benchSettingsDecode},
+    {"recorded_decode", benchRecordedDecode},
+    {"csv_parse", benchCsvParse},
+    {"rollup_add", benchRollupAdd},
+    {"format_time", benchFormatTime},
+    {"2048_slide", benchGame2048Slide},
+};
+
+// Batches double until one is long enough; false if the case skipped
+static bool timeCase(const Case &c, uint32_t &iterations, float &nsPerOp,
+                     const char *&skipped) {
+  for (iterations = 1;; iterations *= 2) {
+    State state(iterations);
+    c.fn(state);
+    if (state.skipped()) {
+      skipped = state.skipped();
+      return false;
+    }
+    if (state.elapsedUs() >= MIN_BATCH_US || iterations >= MAX_ITERATIONS) {
+      nsPerOp = state.elapsedUs() * 1000.0f / iterations;
+      return true;
+    }
+    yield(); // Let other tasks on this core run between batches
+    LoopMonitor::feed();
+  }
+}
+
+static void runCase(Print &out, const Case &c) {
+  uint32_t iterations;
+  float nsPerOp;
+  const char *skipped;
+  if (timeCase(c, iterations, nsPerOp, skipped))
+    out.printf("#BENCH %s %u %.1f\n", c.name, (unsigned)iterations,
+               nsPerOp);
+  else
+    out.printf("#BENCH %s skipped: %s\n", c.name, skipped);
+}
+
+bool measure(const char *name, float &nsPerOp) {
+  for (const Case &c : CASES) {
+    uint32_t iterations;
+    const char *skipped;
+    if (strcmp(c.name, name) == 0)
+      return timeCase(c, iterations, nsPerOp, skipped);
+  }
+  return false;
+}
+
+void run(Print &out, const char *filter) {
+  size_t filterLen = filter ? strlen(filter) : 0;
+  int ran = 0;
+  for (const Case &c : CASES) {
+    if (filterLen && strncmp(c.name, filter, filterLen) != 0)
+      continue;
+    runCase(out, c);
+    ran++;
+  }
+  out.printf("#BENCH done %d\n", ran);
+}
+
+} // namespace LogicBench
@@ -0,0 +1,68 @@
+/**
+ * Logic Benchmarks
+ *
+ * Micro-benchmarks for the pure-logic paths that run per packet, per
+ * sample or per move: the status and settings frame decoders, the legacy
+ * history CSV parser, the history rollup that downsamples every sample,
+ * the runtime formatter and the 2048 slide. Started with "BENCH [name]"
+ * over USB serial; nothing is drawn and nothing is written (recorded_decode
+ * reads the frame recorder's newest frames from the card).
+ *
+ * Each case runs in Google Benchmark fashion: the iteration count doubles
+ * until a batch takes at least MIN_BATCH_US, and the time inside the
+ * case's measured section is divided by the iterations of that batch.
+ * Cases set their data up before start(), so only the loop is timed.
+ * Results go out as "#BENCH <name> <iterations> <ns/op>" lines so a host
+ * script can compare builds.
+ */
+
+#ifndef LOGIC_BENCH_H
+#define LOGIC_BENCH_H
+
+#include <Arduino.h>
+
+namespace LogicBench {
+
+static const uint32_t MIN_BATCH_US = 200000;
+static const uint32_t MAX_ITERATIONS = 1UL << 22;
+
+class State {
+public:
+  explicit State(uint32_t iterations)
+      : _iterations(iterations), _startUs(0), _elapsedUs(0),
+        _skipped(nullptr) {}
+
+  uint32_t iterations() const { return _iterations; }
+
+  // Bracket the measured loop
+  void start() { _startUs = micros(); }
+  void stop() { _elapsedUs += micros() - _startUs; }
+
+  // Give up on the case (e.g. no memory for its data)
+  void skip(const char *reason) { _skipped = reason; }
+
+  uint32_t elapsedUs() const { return _elapsedUs; }
+  const char *skipped() const { return _skipped; }
+
+private:
+  uint32_t _iterations;
+  uint32_t _startUs;
+  uint32_t _elapsedUs;
+  const char *_skipped;
+};
+
+/**
+ * Run every case whose name starts with filter (all of them if null).
+ * Blocks for about MIN_BATCH_US per case, times two.
+ */
+void run(Print &out, const char *filter = nullptr);
+
+/**
+ * Time one case by its full name, printing nothing (the self-test)
+ * @return false if there is no such case or it skipped
+ */
+bool measure(const char *name, float &nsPerOp);
+
+} // namespace LogicBench
+
+#endif // LOGIC_BENCH_H
@@ -14,13 +14,47 @@
  */
 
 #include "ble/ble_client.h"
+#include "ble/fleet_manager.h"
+#include "ble/fossibot_discovery.h"
+#include "ble/frame_recorder.h"
+#include "ble/ota_service.h"
+#include "ble/telemetry_beacon.h"
+#include "charge_planner.h"
+#include "hardware/battery.h"
 #include "hardware/buzzer.h"
 #include "hardware/display.h"
+#include "hardware/energy_model.h"
+#include "hardware/gt911.h"
+#include "hardware/i2c_bus.h"
+#include "hardware/power_mode.h"
 #include "hardware/rtc.h"
 #include "hardware/touch.h"
+#include "history_export.h"
+#include "net/api_server.h"
+#include "net/mqtt_bridge.h"
+#include "net/panel_mesh.h"
+#include "net/weather.h"
+#include "ota_update.h"
+#include "pre_sleep.h"
+#include "resume_state.h"
+#include "rule_engine.h"
+#include "serial_console.h"
+#include "sleep_cycle.h"
+#include "telemetry_bus.h"
+#include "telemetry_filter.h"
+#include "telemetry_simulator.h"
+#include "wake_schedule.h"
+#include "ui/note_paths.h"
 #include "ui/ui_manager.h"
 #include "utils/config.h"
+#include "utils/config_service.h"
+#include "utils/flash_store.h"
+#include "utils/log.h"
+#include "utils/loop_monitor.h"
 #include "utils/sd_manager.h"
+#include "utils/storage_worker.h"
+#include "utils/timer_wheel.h"
+#include "utils/wake.h"
 #include <M5Unified.h>
 #include <SD.h>
 #include <sys/time.h>
@@ -30,19 +64,70 @@
 void initHardware();
 void initSD();
 void initBLE();
+void startStorageBoot(bool mountCard);
 void mainLoop();
 
+static const char *CONFIG_PATH = "/config/settings.json";
+
+// Diagnostic builds (-DBOOT_DIAGNOSTICS) wait for a USB host and scan the
+// I2C bus at boot; normal builds go straight to the first frame
+#ifdef BOOT_DIAGNOSTICS
+static const bool BOOT_DIAG = true;
+#else
+static const bool BOOT_DIAG = false;
+#endif
+static const uint32_t STORAGE_BOOT_STACK = 8192;
+
 // Global instances
 UIManager *uiManager = nullptr;
-FossibotBLE *bleClient = nullptr;
+FossibotBLE *bleClient = nullptr; // Primary unit (fleet unit 0)
+FleetManager *fleet = nullptr;
 SDManager *sdManager = nullptr;
+FlashStore *flashStore = nullptr;
+StorageWorker *storage = nullptr;
 Config *config = nullptr;
+ConfigService *configService = nullptr;
+HistoryExporter *usbExport = nullptr;
+HistoryExporter *bleExport = nullptr;
+SerialConsole *console = nullptr;
+WeatherService *weather = nullptr;
+MqttBridge *mqtt = nullptr;
+ApiServer *api = nullptr;
+RuleEngine *rules = nullptr;
+ChargePlanner *planner = nullptr;
+FrameRecorder *recorder = nullptr;
+TelemetrySimulator *simulator = nullptr;
+TelemetryFilter *telemetryFilter = nullptr;
+TelemetryBus *telemetryBus = nullptr;
+OtaUpdate *ota = nullptr;
+OtaService *otaService = nullptr;
+TelemetryBeacon *beacon = nullptr;
+FossibotDiscovery *discovery = nullptr;
+PanelMesh *mesh = nullptr;
+TimerWheel *timers = nullptr;
 
 void setup() {
+  // A sleep-cycle wake has seconds to spend, and a wake with saved state
+  // should be usable at once: no waiting for a host either way
+  bool timerWake = SleepCycle::isTimerWake();
+  const ResumeSnapshot *resume = ResumeState::load();
+  bool diagnostics = BOOT_DIAG && !timerWake && !resume;
+
   // Wait for serial to be ready (important for S3 USB CDC)
-  delay(1000);
+  if (diagnostics)
+    delay(1000);
   Serial.begin(115200);
-  delay(500);
+  if (diagnostics)
+    delay(500);
+
+  // Buffered log output from here on; hot paths never wait on the UART
+  Log::begin();
+  // Before any task that wakes the main loop starts
+  Wake::begin();
+  // DFS, and light sleep between events where the SDK supports it
+  PowerMode::begin();
+  // Before a sleep-cycle wake goes back to sleep: it counts the sleep
+  EnergyModel::begin();
 
   Serial.println(" Booting M5Paper S3...");
 
@@ -55,9 +140,18 @@ void setup() {
   cfg.internal_imu = false;
   cfg.internal_spk = true; // Enable Speaker for Beep Feedback
   cfg.internal_mic = false;
+  // The panel kept its image through deep sleep; a wake repaints only
+  // what changed, which a clear here would undo with a full white flash
+  cfg.clear_display = !timerWake && !resume;
 
   M5.begin(cfg);
 
+  // Battery sampling timer; readers only see the cached value
+  Battery::init();
+
+  // Tone sequencer; sounds play without blocking the loop
+  Buzzer::init();
+
   // OPTION 1: Disable Auto-Sleep to prevent "stuck in sleep" issue
   // M5Unified doesn't have setAutoSleep directly exposed in Power_Class in some
   // versions. We can try to just not engage it or set it to 0. However, since
@@ -72,49 +166,35 @@ void setup() {
   // --- I2C Configuration ---
   // Both BM8563 RTC (0x51) and GT911 touch (0x5D) are on the SAME I2C bus
   // M5Paper S3 external I2C: SDA=41, SCL=42
-  Wire.end(); // End any M5Unified default Wire config
-  delay(10);
+  Wire.end();            // End any M5Unified default Wire config
   Wire.begin(41, 42);    // Initialize Wire on the correct pins
   Wire.setClock(400000); // 400kHz
-  delay(10);
 
   // Power up peripherals (if needed)
   M5.Power.setExtOutput(true);
   delay(100);
 
   // Scan I2C bus (SDA:41, SCL:42) - should find RTC (0x51) and GT911 (0x5D)
-  Serial.println("--- I2C Scan (SDA:41, SCL:42) ---");
+  // Diagnostic builds only
   int i2c_devices = 0;
-  for (byte address = 1; address < 127; ++address) {
-    Wire.beginTransmission(address);
-    if (Wire.endTransmission() == 0) {
-      Serial.printf("Device at 0x%02X\n", address);
-      i2c_devices++;
+  if (diagnostics) {
+    I2CBus::Lock lock;
+    Serial.println("--- I2C Scan (SDA:41, SCL:42) ---");
+    for (byte address = 1; address < 127; ++address) {
+      Wire.beginTransmission(address);
+      if (Wire.endTransmission() == 0) {
+        Serial.printf("Device at 0x%02X\n", address);
+        i2c_devices++;
+      }
     }
   }
 
   // --- GT911 SOFTWARE RESET ---
-  Serial.println("Attempting GT911 Soft Reset...");
-  Wire.beginTransmission(0x5D);
-  Wire.write(0x80);
-  Wire.write(0x40);
-  Wire.write(0x02); // 2 = Soft Reset
-  Wire.endTransmission();
-  delay(50);
-
-  // Reset Configuration (0x8040 = 0)
-  Wire.beginTransmission(0x5D);
-  Wire.write(0x80);
-  Wire.write(0x40);
-  Wire.write(0x00);
-  Wire.endTransmission();
-  delay(100);
+  GT911::softReset();
 
-  if (i2c_devices == 0) {
-    Serial.println("No I2C devices found.");
-  } else {
-    Serial.println("--- I2C Scan Complete ---");
-  }
+  if (diagnostics)
+    Serial.println(i2c_devices == 0 ? "No I2C devices found."
+                                    : "--- I2C Scan Complete ---");
 
   Serial.printf("Touch Enabled: %s\n", M5.Touch.isEnabled() ? "YES" : "NO");
   if (!M5.Touch.isEnabled()) {
@@ -125,235 +205,429 @@ void setup() {
   Serial.printf("RTC Enabled: %s\n", M5.Rtc.isEnabled() ? "YES" : "NO");
 
   // Check if BM8563 (0x51) is on the internal I2C bus (Wire)
-  Wire.beginTransmission(0x51);
-  if (Wire.endTransmission() == 0) {
+  if (RTC::isPresent()) {
     Serial.println("BM8563 RTC found at 0x51 (Wire)");
   } else {
     Serial.println("BM8563 RTC NOT found at 0x51 on Wire!");
   }
 
-  // RTC time is battery-backed - use existing time
-  int year = 0, month = 0, day = 0, dow = 0;
-  int hour = 0, min = 0, sec = 0;
-
-  // Try reading multiple times if it returns 0 (bus might be busy)
-  for (int retry = 0; retry < 3; retry++) {
-    RTC::getDate(year, month, day, dow);
-    RTC::getTime(hour, min, sec);
-    if (year >= 2000 && month >= 1 && day >= 1)
-      break;
-    delay(100);
+  // RTC time is battery-backed - use existing time. One burst read,
+  // retried if the bus is busy; the UI reads the system clock from here on
+  struct tm rtcTime = {};
+  bool read = false;
+  for (int retry = 0; retry < 3 && !read; retry++) {
+    read = RTC::getDateTime(rtcTime);
+    if (!read)
+      delay(100);
   }
 
-  Serial.printf("RTC time (Direct): %04d-%02d-%02d %02d:%02d:%02d\n", year,
-                month, day, hour, min, sec);
+  Serial.printf("RTC time (Direct): %04d-%02d-%02d %02d:%02d:%02d\n",
+                rtcTime.tm_year + 1900, rtcTime.tm_mon + 1, rtcTime.tm_mday,
+                rtcTime.tm_hour, rtcTime.tm_min, rtcTime.tm_sec);
 
   // Sync system time from RTC
   // CRITICAL: Only sync if we have a valid date!
-  // (Month/Day = 0 causes mktime to underflow to 1999)
-  if (year >= 2000 && year < 2100 && month >= 1 && day >= 1) {
-    struct tm tm;
-    tm.tm_year = year - 1900;
-    tm.tm_mon = month - 1;
-    tm.tm_mday = day;
-    tm.tm_hour = hour;
-    tm.tm_min = min;
-    tm.tm_sec = sec;
-    tm.tm_isdst = -1;
-    time_t t = mktime(&tm);
-    if (t != (time_t)-1) {
-      struct timeval now_tv = {.tv_sec = t, .tv_usec = 0};
-      settimeofday(&now_tv, NULL);
-      Serial.printf("System time synced from RTC: %ld\n", (long)t);
-    } else {
-      Serial.println("Error: mktime failed!");
-    }
+  if (read && RTC::setSystemTime(rtcTime)) {
+    Serial.printf("System time synced from RTC: %ld\n", (long)time(nullptr));
   } else {
-    Serial.printf("Warning: RTC date invalid or not set yet: %d-%d-%d\n", year,
-                  month, day);
+    Serial.println(read ? "Warning: RTC date invalid or not set yet"
+                        : "Warning: RTC not readable");
     Serial.println("System time NOT synced. Using epoch.");
   }
+  WakeSchedule::disarm();
+
+  // Sample, repaint and sleep again; only returns if a touch is waiting
+  if (timerWake)
+    SleepCycle::runTimerWake();
+
+  if (resume) {
+    // Settings, link handles and the last screen from RTC memory: the
+    // panel is usable before the card is up
+    config = new Config();
+    config->restore(resume->config);
+    FossibotBLE::primeLinkCache(config->getFossibotMAC(), resume->link);
+    uiManager = new UIManager();
+    uiManager->resume(*resume);
+  } else {
+    // Initialize hardware components
+    initHardware();
+  }
 
-  // Initialize hardware components
-  initHardware();
+  // Hot small files live in flash, so settings and saves load without
+  // the card
+  flashStore = new FlashStore();
+  flashStore->begin();
+
+  // Settings as parsed last time, from NVS: nothing to open or parse, and
+  // the file is compared with them from the loop
+  bool parsed = false;
+  if (!config) {
+    config = new Config();
+    if (!ConfigService::loadCached(*config)) {
+      delete config;
+      config = nullptr;
+    }
+  }
 
-  // Initialize SD card
-  initSD();
+  // The card (mount probing, directories) and the history come up on a
+  // boot task after the first frame; only settings with no NVS or flash
+  // copy still need it first
+  bool cardFirst = !config && !flashStore->isAvailable();
+  if (cardFirst)
+    initSD();
+  storage = new StorageWorker();
+  storage->begin();
 
   // Load configuration
-  config = new Config();
-  if (!config->load("/config/settings.json")) {
-    Serial.println("Using default configuration");
-    config->setDefaults();
+  if (!config) {
+    config = new Config();
+    if (!config->load(CONFIG_PATH)) {
+      Serial.println("Using default configuration");
+      config->setDefaults();
+    }
+    parsed = true;
   }
+  // Settings screens save through it; changes to the file apply in place
+  configService = new ConfigService(config, CONFIG_PATH);
+  configService->begin(parsed);
+
+  // Cached forecast for the home panel; fetching waits for the loop
+  weather = new WeatherService();
+  weather->begin();
+  mqtt = new MqttBridge();
+  api = new ApiServer();
+  // Firmware updates from the API or BLE; also confirms this image once
+  // it has run long enough
+  ota = new OtaUpdate();
+
+  // Outlet automation, compiled once; actions queue on the primary unit
+  rules = new RuleEngine();
+  rules->compile(config->getRules());
+  rules->setActuator([](RuleEngine::Output output, bool on) {
+    if (!bleClient)
+      return;
+    switch (output) {
+    case RuleEngine::Output::USB:
+      bleClient->setUSB(on);
+      break;
+    case RuleEngine::Output::DC:
+      bleClient->setDC(on);
+      break;
+    case RuleEngine::Output::AC:
+      bleClient->setAC(on);
+      break;
+    }
+  });
+
+  // Time-of-use charging (needs a tariff; plans once the history is up)
+  planner = new ChargePlanner();
+
+  // Smoothing and spike rejection between the BLE client and the
+  // dashboard, MQTT, the API and the history's minute samples
+  telemetryFilter = new TelemetryFilter();
+  telemetryFilter->configure(
+      TelemetryFilter::parseMode(config->getTelemetryFilter().c_str()),
+      config->getFilterAlpha(), config->getFilterMedianN(),
+      config->getFilterSpikeW());
+
+  // Periodic and one-shot jobs; the loop sleeps until the next is due
+  timers = new TimerWheel();
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+  timers->start(timers->create([] {
+    LOG_V("Main", "--- System Alive (Heartbeat) ---");
+  }), 5000, 5000);
+#endif
 
   // Initialize UI
-  uiManager = new UIManager();
+  if (!uiManager)
+    uiManager = new UIManager();
   uiManager->init();
 
+  // Start touch input once the UI can consume events
+  GT911::init();
+
+  // Raw frames to the card when debugging the protocol; before BLE so
+  // the first frames are kept
+  recorder = new FrameRecorder();
+  recorder->setEnabled(config->getRecordFrames());
+
+  // Made-up frames for trying the dashboard and history without a unit
+  simulator = new TelemetrySimulator();
+
+  // Changed settings reach what was set up from them at boot; the radio
+  // links are not brought up again, so those take a restart
+  configService->subscribe(
+      Config::TELEMETRY_SETTINGS, [](const Config &c, uint32_t) {
+        telemetryFilter->configure(
+            TelemetryFilter::parseMode(c.getTelemetryFilter().c_str()),
+            c.getFilterAlpha(), c.getFilterMedianN(), c.getFilterSpikeW());
+      });
+  configService->subscribe(Config::RULES_SETTINGS,
+                           [](const Config &c, uint32_t) {
+                             rules->compile(c.getRules());
+                           });
+  configService->subscribe(Config::RECORDER_SETTINGS,
+                           [](const Config &c, uint32_t) {
+                             recorder->setEnabled(c.getRecordFrames());
+                           });
+  configService->subscribe(Config::TARIFF_SETTINGS,
+                           [](const Config &, uint32_t) { planner->replan(); });
+  configService->subscribe(
+      Config::WIFI_SETTINGS | Config::FOSSIBOT_SETTINGS |
+          Config::MESH_SETTINGS,
+      [](const Config &, uint32_t) {
+        LOG_I("Boot", "Radio or power bank settings changed, restarting");
+        Log::flush();
+        esp_restart();
+      });
+
+  // Telemetry bus: the loop publishes each frame once, these take it
+  telemetryBus = new TelemetryBus();
+  telemetryBus->dashboard.subscribe(
+      Bus::FRAME, [](const Fossibot::PowerBankData &data, uint8_t) {
+        uiManager->updatePowerBankData(data);
+        mqtt->record(data);
+        api->setData(data);
+      });
+  telemetryBus->minute.subscribe(
+      Bus::FRAME, [](const TelemetryFilter::Minute &minute, uint8_t) {
+        uiManager->recordMinute(minute);
+      });
+  // Rules and the charge plan act on the primary unit, so they take its
+  // own frame; rules only look again when a field they test has moved
+  telemetryBus->primary.subscribe(
+      Bus::BATTERY | Bus::POWER | Bus::OUTLETS | Bus::TIMES,
+      [](const Fossibot::PowerBankData &data, uint8_t) {
+        rules->evaluate(data);
+      });
+  telemetryBus->primary.subscribe(
+      Bus::FRAME, [](const Fossibot::PowerBankData &data, uint8_t) {
+        planner->setData(data);
+      });
+  telemetryBus->link.subscribe(
+      Bus::FRAME,
+      [](const LinkStats &stats, uint8_t) { api->setLinkStats(stats); });
+
   // Initialize BLE client for Fossibot
   initBLE();
+  timers->start(timers->create([] {
+    if (bleClient)
+      telemetryBus->link.publish(bleClient->getLinkStats());
+  }), TelemetryBus::LINK_PUBLISH_MS, TelemetryBus::LINK_PUBLISH_MS);
+
+  // History export over USB serial and the BLE export service, and the
+  // OTA service beside it (registered before the server advertises)
+  usbExport = new HistoryExporter(ExportTransport::USB);
+  usbExport->begin();
+  console = new SerialConsole(usbExport);
+  console->begin();
+  otaService = new OtaService();
+  otaService->begin();
+  bleExport = new HistoryExporter(ExportTransport::BLE);
+  if (!bleExport->begin()) {
+    delete bleExport;
+    bleExport = nullptr;
+  }
 
-  // Show home screen
-  uiManager->showHomeScreen();
+  // Readings in that advertisement for phones and other panels, which
+  // cannot connect to the power bank while the panel holds it
+  beacon = new TelemetryBeacon();
+  beacon->setEnabled(config->getBeaconEnabled());
+  beacon->begin(bleExport ? HistoryExporter::BLE_SERVICE_UUID : nullptr);
+  telemetryBus->dashboard.subscribe(
+      Bus::BATTERY | Bus::POWER | Bus::OUTLETS | Bus::LINK,
+      [](const Fossibot::PowerBankData &data, uint8_t) {
+        beacon->setData(data);
+      });
+  configService->subscribe(Config::BEACON_SETTINGS,
+                           [](const Config &c, uint32_t) {
+                             beacon->setEnabled(c.getBeaconEnabled());
+                           });
+
+  // Other panels on the same unit share one link: the one that holds it
+  // passes its frames on, the rest take them instead of connecting
+  if (config->getMeshEnabled() && config->getFossibotCount() == 1) {
+    mesh = new PanelMesh();
+    if (mesh->begin(config->getFossibotMAC(), config->getMeshChannel(),
+                    config->getMeshKey())) {
+      telemetryBus->primary.subscribe(
+          Bus::FRAME, [](const Fossibot::PowerBankData &data, uint8_t) {
+            mesh->setFrame(data);
+          });
+    } else {
+      delete mesh;
+      mesh = nullptr;
+    }
+  }
+
+  // Power banks in range, for the setup screen
+  discovery = new FossibotDiscovery();
+
+  // Show home screen (a resume stays on the screen it restored); with no
+  // unit set up yet, the list of those in range instead
+  if (!resume && fleet->count() == 0)
+    uiManager->navigateTo(ScreenID::DISCOVERY);
+  else if (!resume)
+    uiManager->showHomeScreen();
 
   // Force immediate UI update (don't wait for loop)
   uiManager->update();
+  LOG_I("Boot", "First frame at %lu ms", millis());
+
+  startStorageBoot(!cardFirst);
+
+  // Every pass of loop() from here on is timed, and watched for a hang
+  LoopMonitor::begin();
 
   Serial.println("Initialization complete!");
 }
 
-// Manual GT911 Reader (Wire on SDA:41, SCL:42 - shared with RTC)
-bool readTouchManual(int *x, int *y) {
-  uint8_t raw[7];
-
-  // Read Status Register 0x814E
-  Wire.beginTransmission(0x5D);
-  Wire.write(0x81);
-  Wire.write(0x4E);
-  if (Wire.endTransmission() != 0)
-    return false;
-
-  if (Wire.requestFrom(0x5D, 1) != 1)
-    return false;
-  uint8_t status = Wire.read();
-
-  // Debug: Print status if it's not 0 (idle) or 0x80 (touched but 0 points?
-  // unlikely)
-  if (status != 0) {
-    Serial.printf("GT911 Status: 0x%02X\n", status);
+// What the BLE radio is busiest with, for the energy model: scanning (or
+// connecting) before a link, a link before advertising
+static EnergyModel::State bleEnergyState() {
+  if (!NimBLEDevice::getInitialized())
+    return EnergyModel::State::BLE_IDLE;
+  bool connected = false;
+  for (int i = 0; i < fleet->count(); i++) {
+    LinkState state = fleet->unit(i)->getLinkStatus().state;
+    if (state == LinkState::CONNECTING || state == LinkState::DISCOVERING)
+      return EnergyModel::State::BLE_SCANNING;
+    if (state == LinkState::READY)
+      connected = true;
   }
-
-  if ((status & 0x80) && (status & 0x07) > 0) {
-    // Touch detected, read point 1 (starts at 0x8150)
-    Wire.beginTransmission(0x5D);
-    Wire.write(0x81);
-    Wire.write(0x50);
-    Wire.endTransmission();
-
-    // Read 7 bytes (TrackID, XL, XH, YL, YH, SizeL, SizeH)
-    Wire.requestFrom(0x5D, 7);
-    for (int i = 0; i < 7; i++)
-      raw[i] = Wire.read();
-
-    // Parse Raw GT911 Data
-    // Offset 0 is XL, Offset 1 is XH
-    int raw_x = raw[0] + (raw[1] << 8);
-    // Offset 2 is YL, Offset 3 is YH
-    int raw_y = raw[2] + (raw[3] << 8);
-
-    // --- COORDINATE TRANSFORMATION ---
-    // M5Paper S3 Touch Panel is 540x960 (Portrait)
-    // Screen is 960x540 (Landscape)
-    // Mapping derived from logs:
-    // Screen X = Raw Y (Long Axis) - Low Y is Left (USB), High Y is Right
-    // (Menu) Screen Y = 540 - Raw X (Inverted Short Axis) - Low X is Top, High
-    // X is Bottom
-
-    *x = raw_y;
-    *y = 540 - raw_x;
-
-    // Clamp to boundaries
-    if (*x < 0)
-      *x = 0;
-    if (*x > 960)
-      *x = 960;
-    if (*y < 0)
-      *y = 0;
-    if (*y > 540)
-      *y = 540;
-
-    Serial.printf("TOUCH: Mapped(%d, %d) Raw(%d, %d)\n", *x, *y, raw_x, raw_y);
-
-    // Clear Status Register
-    Wire.beginTransmission(0x5D);
-    Wire.write(0x81);
-    Wire.write(0x4E);
-    Wire.write(0x00);
-    Wire.endTransmission();
-    return true;
-  }
-
-  // Clear Status even if invalid to release INT line
-  Wire.beginTransmission(0x5D);
-  Wire.write(0x81);
-  Wire.write(0x4E);
-  Wire.write(0x00);
-  Wire.endTransmission();
-
-  return false;
+  if (NimBLEDevice::getScan()->isScanning())
+    return EnergyModel::State::BLE_SCANNING;
+  if (connected)
+    return EnergyModel::State::BLE_CONNECTED;
+  return NimBLEDevice::getAdvertising()->isAdvertising()
+             ? EnergyModel::State::BLE_ADVERTISING
+             : EnergyModel::State::BLE_IDLE;
 }
 
 void loop() {
-  // Heartbeat every 5 seconds
-  static unsigned long lastHeartbeat = 0;
-  if (millis() - lastHeartbeat > 5000) {
-    Serial.println("--- System Alive (Heartbeat) ---");
-    // Serial.printf("Raw INT Pin (48): %d\n", digitalRead(48));
-    lastHeartbeat = millis();
-  }
+  LoopMonitor::startIteration();
 
   // Update M5 (buttons, touch, etc.)
   M5.update();
 
-  // --- TOUCH POLLING MODE (Bypass INT pin) ---
-  // Try to read touch every ~15ms for smooth drawing
-  static unsigned long lastTouchPoll = 0;
-  static bool wasTouching = false;
-  static int lastTouchX = 0;
-  static int lastTouchY = 0;
-
-  if (millis() - lastTouchPoll > 15) {
-    lastTouchPoll = millis();
+  // --- TOUCH ---
+  // GT911 is serviced by its own input task on core 0; just drain samples
+  uiManager->processTouchQueue();
 
-    int tx, ty;
-    bool touching = readTouchManual(&tx, &ty);
-
-    // Feed raw touch state to UI Manager for continuous drawing
-    if (touching && tx > 0 && tx < 960 && ty > 0 && ty < 540) {
-      uiManager->setTouchState(tx, ty, true);
-    } else {
-      uiManager->setTouchState(lastTouchX, lastTouchY, false);
-    }
-
-    if (touching && tx > 0 && tx < 960 && ty > 0 && ty < 540) {
-      // Serial.printf("POLL TOUCH: %d, %d (INT Pin: %d)\n", tx, ty,
-      //               digitalRead(48));
-
-      if (!wasTouching) {
-        // New touch started - send PRESS
-        uiManager->handleTouch(tx, ty, TouchEvent::PRESS);
-        Serial.println("EVENT: PRESS");
+  // Update BLE data (handles reconnection)
+  LoopMonitor::stage(LoopMonitor::Stage::BLE);
+  if (fleet) {
+    fleet->update();
+
+    // Publish only when a new frame has arrived (fleet totals when there
+    // are several units), built and filtered in the bus's own snapshot
+    static uint32_t lastGeneration = 0;
+    uint32_t generation = fleet->getDataGeneration();
+    if (generation != lastGeneration) {
+      lastGeneration = generation;
+      Fossibot::PowerBankData &frame = telemetryBus->dashboard.draft();
+      bool have = false;
+      if (fleet->count() > 1) {
+        have = fleet->aggregate(frame);
+      } else if (bleClient && bleClient->getData().connected) {
+        // Live, or fed in by a frame recorder replay or the simulator
+        frame = bleClient->getData();
+        have = true;
       }
-      wasTouching = true;
-      lastTouchX = tx;
-      lastTouchY = ty;
-    } else {
-      // No touch detected
-      if (wasTouching) {
-        // Touch just ended - send RELEASE (this triggers the action!)
-        uiManager->handleTouch(lastTouchX, lastTouchY, TouchEvent::RELEASE);
-        Serial.println("EVENT: RELEASE");
+      if (have) {
+        TelemetryFilter::Minute minute;
+        if (telemetryFilter->apply(frame, time(nullptr)) &&
+            telemetryFilter->lastMinute(minute))
+          telemetryBus->minute.publish(minute);
+        telemetryBus->dashboard.publish();
+      } else {
+        telemetryFilter->reset(); // The next source starts afresh
       }
-      wasTouching = false;
+
+      // Relayed frames are the owning panel's to act on
+      if (bleClient && bleClient->isConnected() && !bleClient->isRelayed())
+        telemetryBus->primary.publish(bleClient->getData());
     }
+    rules->service(bleClient && bleClient->isConnected() &&
+                   !bleClient->isRelayed());
+    EnergyModel::set(bleEnergyState());
+
+    // The dashboard's history is the fleet total with several units, which
+    // says nothing about the primary unit's own load
+    planner->update(fleet->count() > 1 ? nullptr : uiManager->history(),
+                    uiManager->capacityWh());
   }
 
-  // Update BLE data (handles reconnection)
-  if (bleClient) {
-    bleClient->update();
-
-    // Update UI data if connected
-    if (bleClient->isConnected()) {
-      uiManager->updatePowerBankData(bleClient->getData());
-    }
+  // Completion callbacks for background reads/writes, then any deferred
+  // writes and flash mirrors that have waited out their interval
+  LoopMonitor::stage(LoopMonitor::Stage::STORAGE);
+  storage->service();
+  if (sdManager) // Still mounting on the boot task
+    sdManager->service();
+  flashStore->service();
+  configService->service();
+  recorder->service();
+  simulator->service();
+
+  // Forecast refresh and telemetry publishing over WiFi, kept off the
+  // radio while BLE sets up a link
+  LoopMonitor::stage(LoopMonitor::Stage::NETWORK);
+  LinkState link =
+      bleClient ? bleClient->getLinkStatus().state : LinkState::IDLE;
+  bool radioBusy =
+      link == LinkState::CONNECTING || link == LinkState::DISCOVERING;
+  weather->service(radioBusy);
+  mqtt->service(radioBusy);
+
+  // Serial console commands, and history files to a host if one asked
+  // for them, over USB, BLE or the LAN API
+  LoopMonitor::stage(LoopMonitor::Stage::EXPORT);
+  console->service();
+  usbExport->update();
+  if (bleExport)
+    bleExport->update();
+  api->update(uiManager->history());
+
+  // Firmware transfer over BLE; a finished one restarts into the new image
+  // once the reply is out
+  LoopMonitor::stage(LoopMonitor::Stage::OTA);
+  otaService->update();
+  beacon->update();
+  discovery->update();
+  if (mesh)
+    mesh->update();
+  ota->update();
+  if (ota->restartDue()) {
+    uiManager->flushStorage();
+    Log::flush();
+    esp_restart();
   }
 
+  // Timer wheel jobs that have come due (heartbeat, link statistics, the
+  // UI's clock resync, history sample, countdowns and alarm minute)
+  LoopMonitor::stage(LoopMonitor::Stage::TIMERS);
+  timers->service(millis());
+
   // Update UI (handles its own refresh timing)
+  LoopMonitor::stage(LoopMonitor::Stage::UI);
   uiManager->update();
-
-  // Small delay to prevent tight loop
-  delay(10);
+  LoopMonitor::endIteration();
+
+  // Sleep until there is something to do: touch, BLE and storage wake the
+  // loop themselves, the timeout is the next timer or UI deadline. A
+  // transfer in flight keeps the old 10 ms pace.
+  uint32_t budget = uiManager->sleepBudgetMs();
+  if (usbExport->isBusy() || (bleExport && bleExport->isBusy()) ||
+      api->isBusy() || ota->isActive() || recorder->isReplaying())
+    budget = UIManager::ACTIVE_WAIT_MS;
+  budget = min(budget, timers->msUntilDue(millis()));
+  budget = min(budget, rules->msUntilDue());
+  budget = min(budget, simulator->msUntilDue());
+  budget = min(budget, beacon->msUntilDue());
+  budget = min(budget, discovery->msUntilDue());
+  if (mesh)
+    budget = min(budget, mesh->msUntilDue());
+  Wake::wait(budget);
 }
 
 void initHardware() {
@@ -378,8 +652,11 @@ void initHardware() {
 void initSD() {
   Serial.println("Initializing SD card...");
 
-  sdManager = new SDManager();
-  if (sdManager->init()) {
+  // Published once mounted: the loop and the UI test sdManager for null
+  SDManager *sd = new SDManager();
+  bool mounted = sd->init();
+  sdManager = sd;
+  if (mounted) {
     Serial.println("SD card initialized successfully");
 
     // Create required directories if they don't exist
@@ -398,18 +675,79 @@ void initSD() {
 void initBLE() {
   Serial.println("Initializing BLE...");
 
-  bleClient = new FossibotBLE();
+  fleet = new FleetManager();
 
-  // Get MAC address from config
-  String macAddress = config->getFossibotMAC();
-
-  if (macAddress.length() > 0) {
+  // Get MAC addresses from config
+  for (int i = 0; i < config->getFossibotCount(); i++) {
+    String macAddress = config->getFossibotMAC(i);
     Serial.printf("Fossibot MAC: %s\n", macAddress.c_str());
-    bleClient->setTargetMAC(macAddress);
-    bleClient->init();
-    bleClient->startScan();
+    fleet->addUnit(macAddress);
+  }
+
+  if (fleet->count() > 0) {
+    bleClient = fleet->unit(0);
+    for (int i = 0; i < fleet->count(); i++) {
+      fleet->unit(i)->onLinkChange([](const LinkStatus &) {
+        if (uiManager)
+          uiManager->onLinkStateChanged();
+      });
+    }
+    fleet->begin();
+
+    // Before deep sleep: a toggle tapped just before still reaches the
+    // power bank (the loop services the links while it waits), and each
+    // unit's history is written beside the dashboard's
+    PreSleep::add("ble commands", PreSleep::Priority::NORMAL, 1500,
+                  PreSleep::Lane::LOOP, [](uint32_t deadline) {
+                    while (fleet->hasPendingCommands()) {
+                      if ((int32_t)(millis() - deadline) >= 0)
+                        return false;
+                      for (int i = 0; i < fleet->count(); i++)
+                        fleet->unit(i)->update();
+                      Wake::wait(20);
+                    }
+                    return true;
+                  });
+    PreSleep::add("fleet history", PreSleep::Priority::NORMAL, 300,
+                  PreSleep::Lane::WORKER,
+                  [](uint32_t) { return fleet->flushHistories(); });
   } else {
+    bleClient = new FossibotBLE(); // Idle session so the UI has a target
     Serial.println("No Fossibot MAC configured. BLE disabled.");
-    Serial.println("Configure MAC address in /config/settings.json");
+    Serial.println("Pick one on the Find Power Bank screen, or set "
+                   "fossibot_mac in /config/settings.json");
+  }
+}
+
+// Card mount and history load, off the loop task so the first frame and
+// the BLE connect do not wait for them
+static void storageBootTask(void *arg) {
+  bool mountCard = (bool)arg;
+  if (mountCard) {
+    initSD();
+
+    // The settings were read from flash before the card was up; if the
+    // card's copy was edited on a PC it wins, and the loop's config
+    // service loads it from flash
+    if (flashStore->sync(CONFIG_PATH))
+      LOG_I("Boot", "Settings changed on the card");
+
+    // Notes saved before the month directories move into them, once
+    NotePaths::migrate();
+  }
+
+  uiManager->loadHistory();
+  if (fleet)
+    fleet->loadHistories();
+  LOG_I("Boot", "Storage ready at %lu ms", millis());
+  vTaskDelete(nullptr);
+}
+
+void startStorageBoot(bool mountCard) {
+  if (xTaskCreatePinnedToCore(storageBootTask, "boot_storage",
+                              STORAGE_BOOT_STACK, (void *)mountCard, 1,
+                              nullptr, 0) != pdPASS) {
+    Serial.println("Boot: Storage task failed to start, loading inline");
+    storageBootTask((void *)mountCard); // Does not return
   }
 }
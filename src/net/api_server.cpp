@@ -0,0 +1,880 @@
+/**
+ * API Server Implementation
+ */
+
+#include "api_server.h"
+#include "../ota_update.h"
+#include "../telemetry_filter.h"
+#include "../utils/config.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include "../utils/wake.h"
+#include "wifi_link.h"
+#include <WiFi.h>
+#include <stdarg.h>
+#include <time.h>
+
+extern Config *config;
+extern SDManager *sdManager;
+
+// Only the history directories are served, and nothing outside them
+static bool isServable(const char *path) {
+  return strncmp(path, "/history", 8) == 0 &&
+         (path[8] == '\0' || path[8] == '/') && !strstr(path, "..");
+}
+
+static const char *reason(int code) {
+  switch (code) {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 403:
+    return "Forbidden";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 408:
+    return "Request Timeout";
+  case 409:
+    return "Conflict";
+  case 411:
+    return "Length Required";
+  case 413:
+    return "Content Too Large";
+  case 414:
+    return "URI Too Long";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Error";
+  }
+}
+
+// Unsigned query parameter, or fallback if absent or not a number
+static uint32_t queryValue(const char *query, const char *name,
+                           uint32_t fallback) {
+  size_t n = strlen(name);
+  for (const char *p = query; p && *p; p = strchr(p, '&')) {
+    if (*p == '&')
+      p++;
+    if (strncmp(p, name, n) == 0 && p[n] == '=') {
+      char *end;
+      unsigned long value = strtoul(p + n + 1, &end, 10);
+      return end != p + n + 1 ? value : fallback;
+    }
+  }
+  return fallback;
+}
+
+// Text query parameter (no percent decoding), or "" if absent
+static void queryText(const char *query, const char *name, char *out,
+                      size_t size) {
+  size_t n = strlen(name);
+  out[0] = '\0';
+  for (const char *p = query; p && *p; p = strchr(p, '&')) {
+    if (*p == '&')
+      p++;
+    if (strncmp(p, name, n) == 0 && p[n] == '=') {
+      const char *value = p + n + 1;
+      size_t length = strcspn(value, "&");
+      if (length >= size)
+        length = size - 1;
+      memcpy(out, value, length);
+      out[length] = '\0';
+      return;
+    }
+  }
+}
+
+ApiServer::ApiServer()
+    : _task(nullptr), _wanted(false), _linkUp(false), _credentials(0),
+      _mux(portMUX_INITIALIZER_UNLOCKED), _listening(false), _port(0),
+      _lastCheck(0), _state(State::IDLE), _started(0), _requestLength(0),
+      _lineDone(false), _newlines(0), _headerLength(0),
+      _contentLength(-1), _chunkLength(0), _firstRow(true),
+      _frameSeq(0), _frameCount(0), _passBytes(0), _pos(0), _to(0),
+      _bucket(0), _mountGeneration(0) {
+  _ssid[0] = '\0';
+  _password[0] = '\0';
+}
+
+// ============================================================================
+// WiFi (worker task)
+// ============================================================================
+
+void ApiServer::taskEntry(void *arg) {
+  ApiServer *self = static_cast<ApiServer *>(arg);
+  WifiLink &wifi = WifiLink::instance();
+  bool holding = false;
+  uint32_t joined = 0; // _credentials the link was joined with
+  uint32_t retryMs = 0;
+  for (;;) {
+    TickType_t wait = holding  ? pdMS_TO_TICKS(LINK_CHECK_MS)
+                      : retryMs ? pdMS_TO_TICKS(retryMs)
+                                : portMAX_DELAY;
+    ulTaskNotifyTake(pdTRUE, wait);
+    bool wanted = self->_wanted;
+
+    // Off, another network, or dropped by the access point
+    if (holding && (!wanted || joined != self->_credentials ||
+                    WiFi.status() != WL_CONNECTED)) {
+      self->_linkUp = false;
+      Wake::signal(Wake::NETWORK);
+      wifi.release();
+      holding = false;
+    }
+    if (!wanted) {
+      retryMs = 0;
+      continue;
+    }
+    if (holding)
+      continue;
+
+    char ssid[sizeof(self->_ssid)];
+    char password[sizeof(self->_password)];
+    portENTER_CRITICAL(&self->_mux);
+    strcpy(ssid, self->_ssid);
+    strcpy(password, self->_password);
+    joined = self->_credentials;
+    portEXIT_CRITICAL(&self->_mux);
+
+    holding = wifi.acquire(ssid, password);
+    if (holding) {
+      retryMs = 0;
+      self->_linkUp = true;
+      Wake::signal(Wake::NETWORK);
+    } else if (retryMs >= RETRY_MAX_MS / 2) {
+      retryMs = RETRY_MAX_MS;
+    } else {
+      retryMs = retryMs ? retryMs * 2 : RETRY_MIN_MS;
+    }
+  }
+}
+
+// ============================================================================
+// Connections (loop task)
+// ============================================================================
+
+void ApiServer::follow() {
+  bool enabled = config && config->getApiEnabled() &&
+                 config->getWiFiSSID().length() > 0;
+  uint16_t port = config ? config->getApiPort() : 80;
+
+  bool changed = false;
+  if (enabled) {
+    String ssid = config->getWiFiSSID();
+    String password = config->getWiFiPassword();
+    if (strcmp(ssid.c_str(), _ssid) != 0 ||
+        strcmp(password.c_str(), _password) != 0) {
+      portENTER_CRITICAL(&_mux);
+      strlcpy(_ssid, ssid.c_str(), sizeof(_ssid));
+      strlcpy(_password, password.c_str(), sizeof(_password));
+      portEXIT_CRITICAL(&_mux);
+      _credentials++;
+      changed = true;
+    }
+    if (!_task && xTaskCreatePinnedToCore(taskEntry, "api", TASK_STACK, this,
+                                          1, &_task, 0) != pdPASS) {
+      LOG_E("API", "Link task failed to start");
+      _task = nullptr;
+      return;
+    }
+  }
+
+  if (port != _port && _listening) {
+    close();
+    _server.end();
+    _listening = false;
+  }
+  _port = port;
+
+  if (enabled != _wanted || changed) {
+    _wanted = enabled;
+    if (_task)
+      xTaskNotifyGive(_task);
+  }
+}
+
+void ApiServer::setData(const Fossibot::PowerBankData &data) {
+  _data = data;
+  if (!data.connected)
+    return;
+  if (_frameCount == FRAME_RING) {
+    memmove(_frames, _frames + 1, sizeof(_frames[0]) * (FRAME_RING - 1));
+    _frameCount--;
+  }
+  TelemetryDelta::capture(_frames[_frameCount++], data, _frameSeq++,
+                          time(nullptr));
+}
+
+void ApiServer::update(const PowerHistory *history) {
+  if (millis() - _lastCheck >= CHECK_MS || !_lastCheck) {
+    _lastCheck = millis();
+    follow();
+  }
+
+  bool up = _linkUp;
+  if (up && !_listening) {
+    _server.begin(_port);
+    _server.setNoDelay(true);
+    _listening = true;
+    LOG_I("API", "Listening on %s:%u", WiFi.localIP().toString().c_str(),
+          _port);
+  } else if (!up && _listening) {
+    close();
+    _server.end();
+    _listening = false;
+  }
+  if (!_listening)
+    return;
+
+  _passBytes = 0;
+  switch (_state) {
+  case State::IDLE:
+    accept();
+    break;
+  case State::REQUEST:
+    readRequest(history);
+    break;
+  case State::HISTORY:
+    serviceHistory(history);
+    break;
+  case State::LISTING:
+    serviceList();
+    break;
+  case State::SENDING:
+    serviceFile();
+    break;
+  case State::UPLOAD:
+    serviceUpload();
+    break;
+  }
+}
+
+void ApiServer::accept() {
+  WiFiClient client = _server.available();
+  if (!client)
+    return;
+  _client = client;
+  _client.setNoDelay(true);
+  _state = State::REQUEST;
+  _started = millis();
+  _requestLength = 0;
+  _lineDone = false;
+  _newlines = 0;
+  _headerLength = 0;
+  _contentLength = -1;
+}
+
+void ApiServer::readRequest(const PowerHistory *history) {
+  // The request line is kept; headers are skipped up to the blank line,
+  // apart from Content-Length
+  while (_client.available() > 0) {
+    int c = _client.read();
+    if (c == '\r')
+      continue;
+    if (!_lineDone) {
+      if (c == '\n')
+        _lineDone = true;
+      else if (_requestLength < MAX_REQUEST_LINE - 1)
+        _request[_requestLength++] = c;
+      else
+        _requestLength = MAX_REQUEST_LINE; // Too long, answered below
+      _newlines = _lineDone ? 1 : 0;
+      continue;
+    }
+    if (c == '\n') {
+      _header[_headerLength] = '\0';
+      if (strncasecmp(_header, "Content-Length:", 15) == 0)
+        _contentLength = strtol(_header + 15, nullptr, 10);
+      _headerLength = 0;
+      _newlines++;
+    } else {
+      if (_headerLength < MAX_HEADER - 1)
+        _header[_headerLength++] = c;
+      _newlines = 0;
+    }
+    if (_newlines == 2)
+      break;
+  }
+
+  if (_newlines < 2) {
+    if (millis() - _started > REQUEST_TIMEOUT_MS || !_client.connected())
+      close();
+    return;
+  }
+  if (_requestLength >= MAX_REQUEST_LINE) {
+    sendError(414, "request line too long");
+    return;
+  }
+  _request[_requestLength] = '\0';
+
+  // "GET <target> HTTP/1.1"
+  char *target = strchr(_request, ' ');
+  char *version = target ? strchr(target + 1, ' ') : nullptr;
+  if (!version) {
+    sendError(400, "bad request line");
+    return;
+  }
+  *target++ = '\0';
+  *version = '\0';
+  if (strcmp(_request, "POST") == 0) {
+    startUpload(target);
+    return;
+  }
+  if (strcmp(_request, "GET") != 0) {
+    sendError(405, "only GET");
+    return;
+  }
+  LOG_D("API", "GET %s", target);
+  route(target, history);
+}
+
+void ApiServer::route(char *target, const PowerHistory *history) {
+  char *query = strchr(target, '?');
+  if (query)
+    *query++ = '\0';
+
+  if (strcmp(target, "/api/status") == 0) {
+    sendStatus(history);
+  } else if (strcmp(target, "/api/settings") == 0) {
+    sendSettings();
+  } else if (strcmp(target, "/api/link") == 0) {
+    sendLink();
+  } else if (strcmp(target, "/api/history") == 0) {
+    startHistory(query ? query : "", history);
+  } else if (strcmp(target, "/api/load") == 0) {
+    sendLoad(query ? query : "", history);
+  } else if (strcmp(target, "/api/frame") == 0) {
+    sendFrames(query ? query : "");
+  } else if (strncmp(target, "/api/files/", 11) == 0) {
+    startFiles(target + 10);
+  } else {
+    sendError(404, "no such endpoint");
+  }
+}
+
+// ============================================================================
+// Responses
+// ============================================================================
+
+void ApiServer::sendHead(int code, const char *type) {
+  char head[192];
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "Transfer-Encoding: chunked\r\n"
+                   "Cache-Control: no-store\r\n"
+                   "Access-Control-Allow-Origin: *\r\n"
+                   "Connection: close\r\n\r\n",
+                   code, reason(code), type);
+  _client.write((const uint8_t *)head, n);
+  _chunkLength = 0;
+  _firstRow = true;
+}
+
+void ApiServer::sendError(int code, const char *message) {
+  sendHead(code, "application/json");
+  put("{\"error\":\"%s\"}", message);
+  finish();
+}
+
+void ApiServer::sendDocument(const JsonDocument &doc) {
+  // Small documents only: one chunk
+  if (measureJson(doc) >= sizeof(_chunk)) {
+    sendError(500, "response too large");
+    return;
+  }
+  sendHead(200, "application/json");
+  _chunkLength = serializeJson(doc, (char *)_chunk, sizeof(_chunk));
+  finish();
+}
+
+void ApiServer::sendStatus(const PowerHistory *history) {
+  const Fossibot::PowerBankData &d = _data;
+  JsonDocument doc;
+  doc["time"] = (uint32_t)time(nullptr);
+  doc["uptime_s"] = millis() / 1000;
+  doc["connected"] = d.connected;
+  doc["battery_pct"] =
+      Fixed::toFloat(d.socPermille, Fixed::PERMILLE_PER_PCT);
+  doc["battery_v"] = Fixed::toFloat(d.batteryCentivolts, Fixed::CV_PER_V);
+  doc["input_w"] = Fixed::toFloat(d.inputDeciwatts, Fixed::DW_PER_W);
+  doc["output_w"] = Fixed::toFloat(d.outputDeciwatts, Fixed::DW_PER_W);
+  doc["ac_input_w"] = Fixed::toFloat(d.acInputDeciwatts, Fixed::DW_PER_W);
+  doc["dc_input_w"] = Fixed::toFloat(d.dcInputDeciwatts, Fixed::DW_PER_W);
+  doc["usb"] = d.usbActive;
+  doc["dc"] = d.dcActive;
+  doc["ac"] = d.acActive;
+  doc["minutes_to_full"] = d.minutesToFull;
+  doc["minutes_to_empty"] = d.minutesToEmpty;
+  TelemetryFilter::Minute m;
+  if (telemetryFilter && telemetryFilter->lastMinute(m)) {
+    // The last whole minute, raw: what the smoothed figures above hide
+    JsonObject minute = doc["minute"].to<JsonObject>();
+    minute["start"] = m.start;
+    minute["frames"] = m.frames;
+    minute["spikes"] = m.rejected;
+    minute["input_w_min"] = Fixed::toFloat(m.minIn, Fixed::DW_PER_W);
+    minute["input_w_max"] = Fixed::toFloat(m.maxIn, Fixed::DW_PER_W);
+    minute["input_w_mean"] = Fixed::toFloat(m.meanIn(), Fixed::DW_PER_W);
+    minute["output_w_min"] = Fixed::toFloat(m.minOut, Fixed::DW_PER_W);
+    minute["output_w_max"] = Fixed::toFloat(m.maxOut, Fixed::DW_PER_W);
+    minute["output_w_mean"] = Fixed::toFloat(m.meanOut(), Fixed::DW_PER_W);
+  }
+  if (history) {
+    const EnergyTotals &e = history->getEnergy();
+    doc["today_in_wh"] = e.todayInWh;
+    doc["today_out_wh"] = e.todayOutWh;
+    doc["lifetime_in_wh"] = e.lifetimeInWh;
+    doc["lifetime_out_wh"] = e.lifetimeOutWh;
+  }
+  doc["wifi_rssi"] = WiFi.RSSI();
+  doc["wifi_on_s"] = WifiLink::instance().radioMs() / 1000;
+  sendDocument(doc);
+}
+
+void ApiServer::sendSettings() {
+  const Fossibot::PowerBankData &d = _data;
+  JsonDocument doc;
+  if (d.settingsReceived) {
+    JsonObject unit = doc["device"].to<JsonObject>();
+    unit["buzzer"] = d.buzzerEnabled;
+    unit["silent_charging"] = d.silentCharging;
+    unit["light_mode"] = d.lightMode;
+    unit["discharge_limit_pct"] = d.dischargeLimit;
+    unit["charge_limit_pct"] = d.chargeLimit;
+    unit["screen_timeout_min"] = d.screenTimeout;
+    unit["system_standby_min"] = d.sysStandby;
+    unit["ac_standby_min"] = d.acStandby;
+    unit["dc_standby_min"] = d.dcStandby;
+    unit["usb_standby_s"] = d.usbStandby;
+    unit["schedule_charge_min"] = d.scheduleCharge;
+  }
+  if (config) {
+    // Keys and passwords stay on the device
+    JsonObject panel = doc["panel"].to<JsonObject>();
+    panel["theme"] = config->getTheme();
+    panel["auto_sleep_min"] = config->getAutoSleepMinutes();
+    panel["sleep_wake_min"] = config->getSleepWakeMinutes();
+    panel["timezone_offset_h"] = config->getTimezoneOffset();
+    panel["weather_city"] = config->getWeatherCity();
+    panel["weather_units"] = config->getWeatherUnits();
+    panel["mqtt_host"] = config->getMqttHost();
+    panel["mqtt_topic"] = config->getMqttTopic();
+    panel["mqtt_interval_s"] = config->getMqttIntervalSeconds();
+    panel["mqtt_format"] = config->getMqttDelta() ? "delta" : "msgpack";
+  }
+  sendDocument(doc);
+}
+
+void ApiServer::sendLoad(const char *query, const PowerHistory *history) {
+  if (!history) {
+    sendError(503, "history loading");
+    return;
+  }
+  // Straight from the sketches: no minutes are read
+  const LoadQuantiles &load = history->getLoad();
+  int age = queryValue(query, "day", 0);
+  if (age >= load.dayCount()) {
+    sendError(404, "no such day");
+    return;
+  }
+  const LoadQuantiles::Day &d = load.day(age);
+  JsonDocument doc;
+  doc["date"] = d.date;
+  doc["samples"] = d.samples;
+  doc["max_w"] = d.maxW;
+  doc["p50_w"] = load.dayPercentile(age, 0.50f);
+  doc["p95_w"] = load.dayPercentile(age, 0.95f);
+  doc["p99_w"] = load.dayPercentile(age, 0.99f);
+  JsonArray hours = doc["hours"].to<JsonArray>();
+  for (int h = 0; h < LoadQuantiles::HOURS; h++) {
+    JsonArray row = hours.add<JsonArray>();
+    row.add(load.hourPercentile(age, h, 0.50f));
+    row.add(load.hourPercentile(age, h, 0.95f));
+    row.add(load.hourPercentile(age, h, 0.99f));
+  }
+  sendDocument(doc);
+}
+
+void ApiServer::sendLink() {
+  const LinkStats &s = _link;
+  JsonDocument doc;
+  JsonObject connect = doc["connect"].to<JsonObject>();
+  connect["attempts"] = s.attempts;
+  connect["connects"] = s.connects;
+  connect["last_ms"] = s.lastAttemptMs;
+  connect["mean_ms"] = s.connects ? s.totalConnectMs / s.connects : 0;
+  connect["max_ms"] = s.maxConnectMs;
+
+  JsonObject rssi = doc["rssi"].to<JsonObject>();
+  rssi["last"] = s.rssi;
+  rssi["min"] = s.rssiMin;
+  rssi["max"] = s.rssiMax;
+  rssi["mean"] = s.rssiSamples ? s.rssiSum / (int32_t)s.rssiSamples : 0;
+  // Oldest first; 0 marks a minute without a reading
+  JsonArray minutes = rssi["minutes"].to<JsonArray>();
+  for (int age = s.rssiCount - 1; age >= 0; age--)
+    minutes.add(s.rssiAt(age));
+
+  JsonObject drops = doc["drops"].to<JsonObject>();
+  for (int k = 0; k < LinkStats::DROP_KINDS; k++)
+    drops[LinkStats::dropName(k)] = s.drops[k];
+  drops["last_reason"] = s.lastReason;
+
+  JsonObject frames = doc["frames"].to<JsonObject>();
+  frames["complete"] = s.frames;
+  frames["crc_errors"] = s.crcErrors;
+  frames["short"] = s.shortFrames;
+  frames["missed_reads"] = s.missedReads;
+
+  // [upper bound in ms (0: none), count] per bucket
+  JsonObject latency = doc["latency"].to<JsonObject>();
+  uint32_t timed = s.responses();
+  latency["mean_ms"] = timed ? s.latencySumMs / timed : 0;
+  JsonArray buckets = latency["buckets"].to<JsonArray>();
+  for (int b = 0; b < LinkStats::LATENCY_BUCKETS; b++) {
+    JsonArray bucket = buckets.add<JsonArray>();
+    bucket.add(b < LinkStats::LATENCY_BUCKETS - 1 ? LinkStats::latencyBound(b)
+                                                  : 0);
+    bucket.add(s.latency[b]);
+  }
+  sendDocument(doc);
+}
+
+void ApiServer::sendFrames(const char *query) {
+  if (_frameCount == 0) {
+    sendError(503, "no frames yet");
+    return;
+  }
+  // A client polling with the last sequence number it has gets just the
+  // changes; one that is new, too far behind or from before a restart
+  // gets a keyframe
+  uint32_t oldest = _frameSeq - _frameCount;
+  uint32_t since = queryValue(query, "since", UINT32_MAX);
+  size_t length = 0;
+  if (since - oldest < (uint32_t)_frameCount) {
+    int next = since - oldest + 1;
+    length = TelemetryDelta::encode(&_frames[next - 1], _frames + next,
+                                    _frameCount - next, _chunk,
+                                    sizeof(_chunk));
+  }
+  // As many of the newest frames as fit in one chunk
+  for (int n = _frameCount; !length && n > 0; n--)
+    length = TelemetryDelta::encode(nullptr, _frames + _frameCount - n, n,
+                                    _chunk, sizeof(_chunk));
+  if (!length) {
+    sendError(500, "response too large");
+    return;
+  }
+  sendHead(200, "application/octet-stream");
+  _chunkLength = length;
+  finish();
+}
+
+void ApiServer::startHistory(const char *query, const PowerHistory *history) {
+  if (!history) {
+    sendError(503, "history loading");
+    return;
+  }
+  uint32_t now = time(nullptr);
+  uint32_t to = queryValue(query, "to", now + 60);
+  uint32_t from = queryValue(query, "from", to > 86400 ? to - 86400 : 0);
+  uint32_t bucket = queryValue(query, "bucket", 0);
+  if (from >= to || (bucket && (bucket < 60 || bucket > MAX_BUCKET_S))) {
+    sendError(400, "need from < to and bucket 60..86400");
+    return;
+  }
+  _pos = from - from % 60;
+  _to = to;
+  _bucket = bucket;
+
+  sendHead(200, "application/json");
+  bool ok = put("{\"from\":%lu,\"to\":%lu,\"bucket\":%lu,\"fields\":",
+                (unsigned long)from, (unsigned long)to, (unsigned long)bucket);
+  ok = ok && put(bucket ? "[\"t\",\"count\",\"pct\",\"min_pct\",\"max_pct\","
+                          "\"in_w\",\"max_in_w\",\"out_w\",\"max_out_w\"]"
+                        : "[\"t\",\"pct\",\"in_w\",\"out_w\"]");
+  ok = ok && put(",\"rows\":[");
+  if (!ok) {
+    close();
+    return;
+  }
+  _state = State::HISTORY;
+}
+
+void ApiServer::serviceHistory(const PowerHistory *history) {
+  if (!history) {
+    close();
+    return;
+  }
+  const size_t budget = CHUNKS_PER_UPDATE * CHUNK_BYTES;
+
+  if (!_bucket) {
+    // Minutes straight out of the ring, resumed at _pos on the next pass
+    for (const HistorySpan &span : history->range(_pos, _to)) {
+      for (uint16_t i = 0; i < span.count; i++) {
+        uint32_t t = span.start + i * 60;
+        if (t < _pos)
+          continue;
+        if (t >= _to)
+          break;
+        // The DC split, volts and outlets follow where recorded
+        const PowerSample &s = span.samples[i];
+        bool ok;
+        if (s.outlets & PowerSample::DETAIL)
+          ok = put("%s[%lu,%u,%u,%u,%u,%u.%02u,%u]", _firstRow ? "" : ",",
+                   (unsigned long)t, s.batteryPct, s.inputW, s.outputW,
+                   s.dcInputW, s.voltageCv / 100, s.voltageCv % 100,
+                   s.outlets & ~PowerSample::DETAIL);
+        else
+          ok = put("%s[%lu,%u,%u,%u]", _firstRow ? "" : ",",
+                   (unsigned long)t, s.batteryPct, s.inputW, s.outputW);
+        if (!ok) {
+          close();
+          return;
+        }
+        _firstRow = false;
+        _pos = t + 60;
+        if (_passBytes >= budget)
+          return;
+      }
+    }
+  } else {
+    // A few buckets per aggregate() call; empty buckets are left out
+    while (_pos < _to) {
+      uint32_t end = _pos + _bucket * BUCKETS_PER_STEP;
+      if (end > _to || end < _pos)
+        end = _to;
+      RollupBucket buckets[BUCKETS_PER_STEP];
+      int n =
+          history->aggregate(_pos, end, _bucket, buckets, BUCKETS_PER_STEP);
+      for (int i = 0; i < n; i++) {
+        const RollupBucket &b = buckets[i];
+        if (!b.count)
+          continue;
+        if (!put("%s[%lu,%u,%.1f,%u,%u,%.0f,%u,%.0f,%u]", _firstRow ? "" : ",",
+                 (unsigned long)b.start, b.count, b.meanPct(), b.minPct,
+                 b.maxPct, b.meanInW(), b.maxInW, b.meanOutW(), b.maxOutW)) {
+          close();
+          return;
+        }
+        _firstRow = false;
+      }
+      _pos = end;
+      if (_passBytes >= budget)
+        return;
+    }
+  }
+
+  if (put("]}"))
+    finish();
+  else
+    close();
+}
+
+void ApiServer::startFiles(const char *path) {
+  if (!isServable(path) || strlen(path) >= MAX_PATH) {
+    sendError(404, "not under /history");
+    return;
+  }
+  if (!sdManager || !sdManager->isAvailable()) {
+    sendError(503, "no card");
+    return;
+  }
+  _file = sdFS().open(path, FILE_READ);
+  if (!_file) {
+    sendError(404, "no such file");
+    return;
+  }
+  _mountGeneration = sdManager->getMountGeneration();
+  if (_file.isDirectory()) {
+    sendHead(200, "application/json");
+    if (!put("[")) {
+      close();
+      return;
+    }
+    _state = State::LISTING;
+  } else {
+    sendHead(200, "application/octet-stream");
+    _state = State::SENDING;
+  }
+}
+
+void ApiServer::serviceList() {
+  if (!sdManager || sdManager->getMountGeneration() != _mountGeneration) {
+    close(); // Card gone: cut short, without the final chunk
+    return;
+  }
+  for (int i = 0; i < CHUNKS_PER_UPDATE * 8; i++) {
+    File entry = _file.openNextFile();
+    if (!entry) {
+      if (put("]"))
+        finish();
+      else
+        close();
+      return;
+    }
+    bool ok = put("%s{\"name\":\"%s\",\"size\":%lu,\"dir\":%s}",
+                  _firstRow ? "" : ",", entry.name(),
+                  (unsigned long)entry.size(),
+                  entry.isDirectory() ? "true" : "false");
+    entry.close();
+    if (!ok) {
+      close();
+      return;
+    }
+    _firstRow = false;
+  }
+}
+
+void ApiServer::serviceFile() {
+  if (!sdManager || sdManager->getMountGeneration() != _mountGeneration) {
+    close();
+    return;
+  }
+  for (int i = 0; i < CHUNKS_PER_UPDATE; i++) {
+    int n = _file.read(_chunk, sizeof(_chunk));
+    if (n <= 0) {
+      finish();
+      return;
+    }
+    _chunkLength = n;
+    if (!flush()) {
+      close();
+      return;
+    }
+  }
+}
+
+// ============================================================================
+// Firmware upload
+// ============================================================================
+
+void ApiServer::startUpload(char *target) {
+  char *query = strchr(target, '?');
+  if (query)
+    *query++ = '\0';
+  if (strcmp(target, "/api/ota") != 0) {
+    sendError(405, "only GET");
+    return;
+  }
+
+  char token[48];
+  char kindName[8];
+  queryText(query, "token", token, sizeof(token));
+  queryText(query, "kind", kindName, sizeof(kindName));
+  OtaUpdate::Kind kind;
+  if (!ota || !OtaUpdate::authorized(token)) {
+    sendError(403, "ota disabled or bad token");
+    return;
+  }
+  if (!OtaUpdate::parseKind(kindName[0] ? kindName : nullptr, kind)) {
+    sendError(400, "kind is image or delta");
+    return;
+  }
+  if (_contentLength <= 0) {
+    sendError(411, "no Content-Length");
+    return;
+  }
+  if (!ota->begin(_contentLength, kind, "api")) {
+    const char *error = ota->error();
+    if (strcmp(error, "busy") == 0)
+      sendError(409, error);
+    else if (strcmp(error, "too large") == 0)
+      sendError(413, error);
+    else
+      sendError(500, error);
+    return;
+  }
+  _state = State::UPLOAD;
+}
+
+void ApiServer::serviceUpload() {
+  // OtaUpdate gives up on its own once the bytes stop
+  if (!ota->isActive()) {
+    sendError(408, ota->error());
+    return;
+  }
+  for (int i = 0; i < CHUNKS_PER_UPDATE && ota->received() < ota->size();
+       i++) {
+    size_t want = ota->size() - ota->received();
+    int n = _client.read(_chunk, want < sizeof(_chunk) ? want : sizeof(_chunk));
+    if (n <= 0)
+      break;
+    if (!ota->write(_chunk, n)) {
+      sendError(400, ota->error());
+      return;
+    }
+  }
+
+  if (ota->received() == ota->size()) {
+    if (!ota->finish()) {
+      sendError(500, ota->error());
+      return;
+    }
+    sendHead(200, "application/json");
+    put("{\"ok\":true,\"restarting\":true}");
+    finish();
+  } else if (!_client.connected() && !_client.available()) {
+    ota->abort("disconnected");
+    close();
+  }
+}
+
+// ============================================================================
+// Chunked encoding
+// ============================================================================
+
+bool ApiServer::put(const char *fmt, ...) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    va_list args;
+    va_start(args, fmt);
+    size_t room = sizeof(_chunk) - _chunkLength;
+    int n = vsnprintf((char *)_chunk + _chunkLength, room, fmt, args);
+    va_end(args);
+    if (n < 0)
+      return false;
+    if ((size_t)n < room) {
+      _chunkLength += n;
+      _passBytes += n;
+      return true;
+    }
+    // Did not fit: send what there is and start the next chunk with it
+    if (!_chunkLength || !flush())
+      return false;
+  }
+  return false;
+}
+
+bool ApiServer::flush() {
+  if (!_chunkLength)
+    return true;
+  char size[12];
+  int n = snprintf(size, sizeof(size), "%x\r\n", (unsigned)_chunkLength);
+  bool ok = _client.write((const uint8_t *)size, n) == (size_t)n &&
+            _client.write(_chunk, _chunkLength) == _chunkLength &&
+            _client.write((const uint8_t *)"\r\n", 2) == 2;
+  _chunkLength = 0;
+  return ok;
+}
+
+void ApiServer::finish() {
+  if (flush())
+    _client.write((const uint8_t *)"0\r\n\r\n", 5);
+  close();
+}
+
+void ApiServer::close() {
+  if (_state == State::UPLOAD && ota && ota->isActive())
+    ota->abort("closed");
+  _file.close();
+  _client.stop();
+  _chunkLength = 0;
+  _state = State::IDLE;
+}
@@ -0,0 +1,177 @@
+/**
+ * API Server
+ *
+ * A small HTTP/JSON API on the LAN (api.enabled in the config), read-only
+ * apart from firmware updates:
+ *
+ *   GET /api/status                   the latest frame, today's energy
+ *   GET /api/settings                 device and panel settings (no secrets)
+ *   GET /api/link                     BLE link statistics (LinkStats) as of
+ *                                     the last telemetry bus publish
+ *   GET /api/history?from=&to=&bucket=
+ *       minutes in [from, to) (Unix time, default the last 24 h) as rows
+ *       of [t, pct, in_w, out_w]; with bucket (seconds, >= 60) as rows of
+ *       [t, count, pct, min_pct, max_pct, in_w, max_in_w, out_w, max_out_w]
+ *   GET /api/load?day=                output watts p50/p95/p99 and max for
+ *                                     a day (0 today, up to 6 back) and
+ *                                     [p50, p95, p99] for each of its hours
+ *   GET /api/files/history[/...]      list a history directory, or a file's
+ *                                     bytes as stored on the card
+ *   GET /api/frame?since=<seq>        the frames after since as a
+ *                                     TelemetryDelta message; a keyframe of
+ *                                     the recent frames without since or
+ *                                     when it is no longer held
+ *   POST /api/ota?token=&kind=image|delta
+ *       a firmware image or delta as the body (with Content-Length), see
+ *       ota_update.h; the unit restarts into it after the reply
+ *
+ * Everything is served from the main loop, which owns the history and the
+ * card, one connection at a time. Responses are chunk-encoded and produced
+ * CHUNKS_PER_UPDATE chunks per pass: history rows come straight from
+ * PowerHistory's range and aggregate queries and files are read a chunk at
+ * a time, so a week of minutes costs one CHUNK_BYTES buffer however long
+ * it is, and the loop stays responsive while it streams.
+ *
+ * The server needs WiFi for as long as it is on: a worker task holds
+ * WifiLink (modem sleep keeps that cheap), joining again if the network
+ * drops.
+ */
+
+#ifndef API_SERVER_H
+#define API_SERVER_H
+
+#include "../ble/fossibot_protocol.h"
+#include "../ble/link_stats.h"
+#include "../power_history.h"
+#include "telemetry_delta.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class ApiServer {
+public:
+  static const uint32_t TASK_STACK = 3072;
+  static const uint32_t LINK_CHECK_MS = 10000; // Worker: link still up?
+  static const uint32_t RETRY_MIN_MS = 30 * 1000;
+  static const uint32_t RETRY_MAX_MS = 10 * 60 * 1000;
+  static const uint32_t CHECK_MS = 5000;           // Looking at the config
+  static const uint32_t REQUEST_TIMEOUT_MS = 3000; // Request headers
+  static const size_t CHUNK_BYTES = 1024;
+  static const int CHUNKS_PER_UPDATE = 4;
+  static const int MAX_REQUEST_LINE = 160;
+  static const int MAX_HEADER = 32; // Of a header line, enough for a length
+  static const int MAX_PATH = 48;
+  static const uint32_t MAX_BUCKET_S = 86400;
+  static const int BUCKETS_PER_STEP = 8;
+  static const int FRAME_RING = 32; // Recent frames for /api/frame
+
+  ApiServer();
+
+  /**
+   * Take a new telemetry frame for /api/status and /api/frame. Call from
+   * the main loop.
+   */
+  void setData(const Fossibot::PowerBankData &data);
+
+  /**
+   * Take the link statistics for /api/link. Call from the main loop.
+   */
+  void setLinkStats(const LinkStats &stats) { _link = stats; }
+
+  /**
+   * Follow the config, accept a connection and send the next chunks. Call
+   * from the main loop.
+   * @param history The loaded history, or nullptr while it loads
+   */
+  void update(const PowerHistory *history);
+
+  /**
+   * A request is being read or answered: the loop should not sleep long
+   */
+  bool isBusy() const { return _state != State::IDLE; }
+
+private:
+  enum class State : uint8_t {
+    IDLE,
+    REQUEST,
+    HISTORY,
+    LISTING,
+    SENDING,
+    UPLOAD
+  };
+
+  // Link worker; the credentials are written by the loop task and read
+  // by the worker under _mux, and each change bumps _credentials
+  TaskHandle_t _task;
+  std::atomic<bool> _wanted;
+  std::atomic<bool> _linkUp;
+  std::atomic<uint32_t> _credentials;
+  portMUX_TYPE _mux;
+  char _ssid[33];
+  char _password[65];
+
+  // Loop task
+  WiFiServer _server;
+  WiFiClient _client;
+  bool _listening;
+  uint16_t _port;
+  uint32_t _lastCheck;
+  State _state;
+  uint32_t _started; // millis() the request arrived
+  char _request[MAX_REQUEST_LINE];
+  int _requestLength;
+  bool _lineDone; // Request line read, skipping headers
+  int _newlines;  // Consecutive line ends seen (2: headers done)
+  char _header[MAX_HEADER]; // Header line being skipped
+  int _headerLength;
+  long _contentLength; // -1: none given
+  Fossibot::PowerBankData _data;
+  LinkStats _link;
+  TelemetryDelta::Frame _frames[FRAME_RING]; // Oldest at _frameSeq - count
+  uint32_t _frameSeq; // Of the next frame
+  int _frameCount;
+
+  // Response in progress
+  uint8_t _chunk[CHUNK_BYTES];
+  size_t _chunkLength;
+  bool _firstRow;
+  size_t _passBytes; // Produced this update()
+  uint32_t _pos; // History: next time; file: next byte
+  uint32_t _to;
+  uint32_t _bucket;
+  fs::File _file;
+  uint32_t _mountGeneration;
+
+  static void taskEntry(void *arg);
+  void follow();
+  void accept();
+  void readRequest(const PowerHistory *history);
+  void route(char *target, const PowerHistory *history);
+  void sendHead(int code, const char *type);
+  void sendError(int code, const char *message);
+  void sendStatus(const PowerHistory *history);
+  void sendSettings();
+  void sendLink();
+  void sendLoad(const char *query, const PowerHistory *history);
+  void sendFrames(const char *query);
+  void startHistory(const char *query, const PowerHistory *history);
+  void startFiles(const char *path);
+  void sendDocument(const JsonDocument &doc);
+  void serviceHistory(const PowerHistory *history);
+  void serviceList();
+  void serviceFile();
+  void startUpload(char *target);
+  void serviceUpload();
+  bool put(const char *fmt, ...);
+  bool flush();
+  void finish();
+  void close();
+};
+
+extern ApiServer *api;
+
+#endif // API_SERVER_H
@@ -0,0 +1,382 @@
+/**
+ * MQTT Bridge Implementation
+ */
+
+#include "mqtt_bridge.h"
+#include "../utils/config.h"
+#include "../utils/log.h"
+#include "../utils/wake.h"
+#include "wifi_link.h"
+#include <ArduinoJson.h>
+#include <time.h>
+
+extern Config *config;
+
+// MQTT 3.1.1 control packet types (high nibble of the first byte)
+static const uint8_t MQTT_CONNECT = 0x10;
+static const uint8_t MQTT_CONNACK = 0x20;
+static const uint8_t MQTT_PUBLISH = 0x30; // QoS 0, no retain
+static const uint8_t MQTT_PINGREQ = 0xC0;
+static const uint8_t MQTT_DISCONNECT = 0xE0;
+
+// Anything earlier means the clock has not been set yet
+static const time_t VALID_TIME = 1700000000;
+
+MqttBridge::MqttBridge()
+    : _task(nullptr), _state(IDLE_TASK), _ok(false), _count(0), _sending(0),
+      _seq(0), _haveAcked(false), _sendingDelta(false),
+      _sendingKeyframe(false), _sinceKeyframe(0),
+      _enabled(false), _lingering(false), _lastCheck(0), _lastSample(0),
+      _lastBurst(0), _retryMs(0), _published(0), _failures(0),
+      _holding(false), _session(false) {
+  memset(&_job, 0, sizeof(_job));
+}
+
+uint32_t MqttBridge::intervalMs() const {
+  uint32_t s = config ? config->getMqttIntervalSeconds() : 0;
+  if (s < MIN_INTERVAL_S)
+    s = MIN_INTERVAL_S;
+  else if (s > MAX_INTERVAL_S)
+    s = MAX_INTERVAL_S;
+  return s * 1000;
+}
+
+// ============================================================================
+// Batching (loop task)
+// ============================================================================
+
+void MqttBridge::record(const Fossibot::PowerBankData &data) {
+  time_t now = time(nullptr);
+  if (!_enabled || !data.connected || now < VALID_TIME)
+    return;
+
+  // Long cadences space their samples out so one batch covers them
+  uint32_t spacing = intervalMs() / BATCH_MAX;
+  if (spacing < SAMPLE_MS)
+    spacing = SAMPLE_MS;
+  if (_lastSample && millis() - _lastSample < spacing)
+    return;
+
+  if (_count == BATCH_MAX) {
+    // Broker out of reach for a while: the oldest sample goes, unless it
+    // is in flight
+    if (_sending > 0)
+      return;
+    memmove(_batch, _batch + 1, sizeof(Sample) * (BATCH_MAX - 1));
+    _count--;
+  }
+  _lastSample = millis();
+
+  TelemetryDelta::capture(_batch[_count++], data, _seq++, now);
+}
+
+size_t MqttBridge::encode(uint8_t *out, size_t cap, int count) const {
+  // Columns rather than one map per sample: each key is sent once and
+  // small integers pack into a byte or two
+  JsonDocument doc;
+  uint32_t t0 = _batch[0].time;
+  doc["t"] = t0;
+  JsonArray dt = doc["dt"].to<JsonArray>();
+  JsonArray soc = doc["soc"].to<JsonArray>();
+  JsonArray mv = doc["mv"].to<JsonArray>();
+  JsonArray in = doc["in"].to<JsonArray>();
+  JsonArray outW = doc["out"].to<JsonArray>();
+  JsonArray ac = doc["ac"].to<JsonArray>();
+  JsonArray dc = doc["dc"].to<JsonArray>();
+  JsonArray outputs = doc["o"].to<JsonArray>();
+  for (int i = 0; i < count; i++) {
+    const int32_t *v = _batch[i].v;
+    dt.add(_batch[i].time - t0);
+    soc.add(v[TelemetryDelta::SOC10]);
+    mv.add(v[TelemetryDelta::MV]);
+    in.add(v[TelemetryDelta::IN_W]);
+    outW.add(v[TelemetryDelta::OUT_W]);
+    ac.add(v[TelemetryDelta::AC_IN_W]);
+    dc.add(v[TelemetryDelta::DC_IN_W]);
+    outputs.add(v[TelemetryDelta::OUTPUTS]);
+  }
+  if (doc.overflowed() || measureMsgPack(doc) > cap)
+    return 0;
+  return serializeMsgPack(doc, out, cap);
+}
+
+size_t MqttBridge::encodeDelta(uint8_t *out, size_t cap, int count) {
+  _sendingKeyframe = !_haveAcked || _sinceKeyframe >= KEYFRAME_BURSTS;
+  return TelemetryDelta::encode(_sendingKeyframe ? nullptr : &_acked, _batch,
+                                count, out, cap);
+}
+
+void MqttBridge::service(bool radioBusy) {
+  if (_state == DONE) {
+    adopt();
+    _state = IDLE_TASK;
+  }
+  if (_state != IDLE_TASK)
+    return;
+
+  if (millis() - _lastCheck >= CHECK_MS) {
+    _lastCheck = millis();
+    bool enabled = config && config->getMqttHost().length() > 0 &&
+                   config->getWiFiSSID().length() > 0;
+    if (enabled != _enabled) {
+      _enabled = enabled;
+      LOG_I("MQTT", "Bridge %s", enabled ? "on" : "off");
+    }
+  }
+
+  // Turned off with the link held: let it go
+  if (!_enabled) {
+    _count = 0;
+    _haveAcked = false;
+    if (_lingering)
+      start(0, 0);
+    return;
+  }
+
+  uint32_t wait = _retryMs ? _retryMs : intervalMs();
+  if (_lastBurst && millis() - _lastBurst < wait)
+    return;
+  // Nothing to send and no session to keep alive
+  if (radioBusy || (_count == 0 && !_lingering))
+    return;
+
+  size_t length = 0;
+  if (_count > 0) {
+    _sendingDelta = config->getMqttDelta();
+    length = _sendingDelta
+                 ? encodeDelta(_job.payload, sizeof(_job.payload), _count)
+                 : encode(_job.payload, sizeof(_job.payload), _count);
+    if (!length) {
+      LOG_E("MQTT", "Batch of %d does not fit, dropped", _count);
+      _count = 0;
+      return;
+    }
+  }
+  start(length, _count);
+}
+
+void MqttBridge::start(size_t length, int samples) {
+  if (!_task && xTaskCreatePinnedToCore(taskEntry, "mqtt", TASK_STACK, this,
+                                        1, &_task, 0) != pdPASS) {
+    LOG_E("MQTT", "Publish task failed to start");
+    _task = nullptr;
+    return;
+  }
+
+  // The worker gets its own copy: the config may change meanwhile
+  uint32_t interval = intervalMs() / 1000;
+  strlcpy(_job.host, config->getMqttHost().c_str(), sizeof(_job.host));
+  _job.port = config->getMqttPort();
+  strlcpy(_job.user, config->getMqttUser().c_str(), sizeof(_job.user));
+  strlcpy(_job.password, config->getMqttPassword().c_str(),
+          sizeof(_job.password));
+  strlcpy(_job.topic, config->getMqttTopic().c_str(), sizeof(_job.topic));
+  strlcpy(_job.ssid, config->getWiFiSSID().c_str(), sizeof(_job.ssid));
+  strlcpy(_job.wifiPassword, config->getWiFiPassword().c_str(),
+          sizeof(_job.wifiPassword));
+  _job.linger = _enabled && interval <= LINGER_S;
+  // A burst a cadence apart counts as activity; the broker gives up at
+  // 1.5x this
+  _job.keepAlive = _job.linger ? interval * 2 + 30 : 60;
+  _job.length = length;
+
+  _sending = samples;
+  _lingering = _job.linger;
+  _lastBurst = millis();
+  if (!_lastBurst)
+    _lastBurst = 1; // 0 means never
+  _state = RUNNING;
+  xTaskNotifyGive(_task);
+}
+
+void MqttBridge::adopt() {
+  if (_ok) {
+    if (_sending > 0) {
+      // Switching to deltas starts with a keyframe
+      _acked = _batch[_sending - 1];
+      _haveAcked = _sendingDelta;
+      _sinceKeyframe = _sendingKeyframe ? 1 : _sinceKeyframe + 1;
+      memmove(_batch, _batch + _sending, sizeof(Sample) * (_count - _sending));
+      _count -= _sending;
+      _published++;
+    }
+    _failures = 0;
+    _retryMs = 0;
+  } else {
+    // The samples stay for the next burst, which starts over with a
+    // keyframe: the subscriber may have missed part of this one
+    _failures++;
+    _haveAcked = false;
+    if (_retryMs >= RETRY_MAX_MS / 2)
+      _retryMs = RETRY_MAX_MS;
+    else
+      _retryMs = _retryMs ? _retryMs * 2 : RETRY_MIN_MS;
+    _lingering = false; // The worker has let the link go
+    LOG_W("MQTT", "Publish failed (%lu in a row), retry in %lu s",
+          (unsigned long)_failures, (unsigned long)(_retryMs / 1000));
+  }
+  _sending = 0;
+}
+
+// ============================================================================
+// Publishing (worker task)
+// ============================================================================
+
+void MqttBridge::taskEntry(void *arg) {
+  MqttBridge *self = static_cast<MqttBridge *>(arg);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (self->_state != RUNNING)
+      continue;
+    self->_ok = self->burst();
+    self->_state = DONE;
+    Wake::signal(Wake::NETWORK);
+  }
+}
+
+bool MqttBridge::burst() {
+  // Keep-alive with no session, or the close after turning off
+  if (_job.length == 0 && !_session) {
+    if (!_job.linger)
+      disconnect();
+    return true;
+  }
+
+  uint32_t start = millis();
+  bool ok = false;
+  // A reused session may have been dropped by the broker or the access
+  // point meanwhile: one fresh connection before giving up
+  for (int attempt = 0; attempt < 2 && !ok; attempt++) {
+    if (_session && !_client.connected())
+      closeSession();
+    if (!_session && !connect())
+      break;
+    drain();
+    ok = _job.length ? sendPublish() : send(MQTT_PINGREQ, nullptr, 0);
+    if (!ok)
+      closeSession();
+  }
+  if (!ok || !_job.linger)
+    disconnect();
+  LOG_D("MQTT", "%s %u bytes in %lu ms", ok ? "Sent" : "Failed to send",
+        (unsigned)_job.length, millis() - start);
+  return ok;
+}
+
+// Strings in MQTT are a 16-bit big-endian length and the bytes
+static size_t putString(uint8_t *out, const char *s) {
+  size_t n = strlen(s);
+  out[0] = n >> 8;
+  out[1] = n & 0xFF;
+  memcpy(out + 2, s, n);
+  return n + 2;
+}
+
+bool MqttBridge::connect() {
+  if (!_holding) {
+    _holding = WifiLink::instance().acquire(_job.ssid, _job.wifiPassword);
+    if (!_holding)
+      return false;
+  }
+  if (!_client.connect(_job.host, _job.port, IO_TIMEOUT_MS)) {
+    LOG_W("MQTT", "%s:%u not reachable", _job.host, _job.port);
+    return false;
+  }
+  _client.setNoDelay(true); // Each packet is written whole
+
+  char clientId[24];
+  snprintf(clientId, sizeof(clientId), "m5paper-%012llx",
+           (unsigned long long)ESP.getEfuseMac());
+
+  uint8_t body[8 + 2 + sizeof(clientId) + 2 + sizeof(_job.user) + 2 +
+               sizeof(_job.password)];
+  size_t n = putString(body, "MQTT");
+  body[n++] = 4; // Protocol level 3.1.1
+  uint8_t flags = 0x02; // Clean session
+  if (_job.user[0])
+    flags |= 0x80 | (_job.password[0] ? 0x40 : 0);
+  body[n++] = flags;
+  body[n++] = _job.keepAlive >> 8;
+  body[n++] = _job.keepAlive & 0xFF;
+  n += putString(body + n, clientId);
+  if (flags & 0x80)
+    n += putString(body + n, _job.user);
+  if (flags & 0x40)
+    n += putString(body + n, _job.password);
+  if (!send(MQTT_CONNECT, body, n)) {
+    closeSession();
+    return false;
+  }
+
+  // CONNACK: type, length 2, session present, return code
+  uint8_t ack[4];
+  size_t got = 0;
+  uint32_t start = millis();
+  while (got < sizeof(ack) && millis() - start < IO_TIMEOUT_MS &&
+         _client.connected()) {
+    int c = _client.read();
+    if (c >= 0)
+      ack[got++] = c;
+    else
+      vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  if (got < sizeof(ack) || ack[0] != MQTT_CONNACK || ack[3] != 0) {
+    LOG_W("MQTT", "Broker refused the connection (code %d)",
+          got == sizeof(ack) ? ack[3] : -1);
+    closeSession();
+    return false;
+  }
+  _session = true;
+  return true;
+}
+
+bool MqttBridge::send(uint8_t type, const uint8_t *body, size_t length) {
+  if (length + 5 > sizeof(_packet))
+    return false;
+  size_t n = 0;
+  _packet[n++] = type;
+  // Remaining length: 7 bits per byte, low first
+  size_t rest = length;
+  do {
+    uint8_t b = rest & 0x7F;
+    rest >>= 7;
+    _packet[n++] = b | (rest ? 0x80 : 0);
+  } while (rest);
+  if (length && body != _packet + n)
+    memmove(_packet + n, body, length);
+  n += length;
+  return _client.write(_packet, n) == n;
+}
+
+bool MqttBridge::sendPublish() {
+  // Topic and payload are laid out behind the longest fixed header so
+  // the packet goes out in one write
+  const size_t at = 4;
+  size_t n = putString(_packet + at, _job.topic);
+  memcpy(_packet + at + n, _job.payload, _job.length);
+  n += _job.length;
+  size_t header = 2 + (n >= 128) + (n >= 16384); // 1 + remaining length
+  memmove(_packet + header, _packet + at, n);
+  return send(MQTT_PUBLISH, _packet + header, n);
+}
+
+void MqttBridge::drain() {
+  // PINGRESPs and anything else the broker volunteers
+  while (_client.available() > 0)
+    _client.read();
+}
+
+void MqttBridge::closeSession() {
+  _client.stop();
+  _session = false;
+}
+
+void MqttBridge::disconnect() {
+  if (_session)
+    send(MQTT_DISCONNECT, nullptr, 0);
+  closeSession();
+  if (_holding) {
+    WifiLink::instance().release();
+    _holding = false;
+  }
+}
@@ -0,0 +1,146 @@
+/**
+ * MQTT Bridge
+ *
+ * Publishes the power bank telemetry to an MQTT broker over WiFi, for
+ * Home Assistant or anything else that listens. Frames are sampled at most
+ * every SAMPLE_MS (further apart for long cadences, so a batch always
+ * fits) and published together every mqtt.interval_s as one MessagePack
+ * document, column by column:
+ *
+ *   {"t": first sample (UTC s), "dt": [s after t], "soc": [tenths of %],
+ *    "mv": [battery mV], "in": [W], "out": [W], "ac": [W], "dc": [W],
+ *    "o": [outputs, bit 0 USB, 1 DC, 2 AC]}
+ *
+ * With mqtt.format "delta" the burst is a TelemetryDelta message instead:
+ * the changes since the last sample of the previous successful burst,
+ * and a keyframe (everything) for the first burst, after a failure and
+ * every KEYFRAME_BURSTS, so a subscriber that joins or misses one is back
+ * in step soon. QoS 0 has no acknowledgement, so a burst the broker took
+ * stands in for one.
+ *
+ * Publishing runs on a worker task with a minimal MQTT 3.1.1 client (QoS
+ * 0, clean session). For cadences up to LINGER_S the WiFi link and the
+ * broker connection stay up between bursts in modem sleep, and each burst
+ * is a single write; longer cadences join, publish and switch WiFi off
+ * again. A failed burst keeps its samples for the next one and backs off
+ * from RETRY_MIN_MS to RETRY_MAX_MS. As with the weather, no burst starts
+ * while BLE is setting up a link on the shared radio.
+ */
+
+#ifndef MQTT_BRIDGE_H
+#define MQTT_BRIDGE_H
+
+#include "../ble/fossibot_protocol.h"
+#include "telemetry_delta.h"
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class MqttBridge {
+public:
+  static const uint32_t TASK_STACK = 4096;
+  static const int BATCH_MAX = 64;           // Samples per publish
+  static const uint32_t SAMPLE_MS = 10000;   // Closest sample spacing
+  static const uint32_t MIN_INTERVAL_S = 10; // Publish cadence bounds
+  static const uint32_t MAX_INTERVAL_S = 3600;
+  static const uint32_t LINGER_S = 120; // Keep the link up up to this
+  static const uint32_t RETRY_MIN_MS = 30 * 1000;
+  static const uint32_t RETRY_MAX_MS = 30 * 60 * 1000;
+  static const uint32_t IO_TIMEOUT_MS = 5000;
+  static const uint32_t CHECK_MS = 5000; // Looking at the config
+  static const size_t PAYLOAD_MAX = 2048; // Encoded batch
+  static const size_t TOPIC_MAX = 64;
+  static const int KEYFRAME_BURSTS = 10; // Delta format: resync this often
+
+  using Sample = TelemetryDelta::Frame;
+
+  MqttBridge();
+
+  /**
+   * Take a new telemetry frame (the fleet total with several units). Call
+   * from the main loop.
+   */
+  void record(const Fossibot::PowerBankData &data);
+
+  /**
+   * Hand a due batch to the worker and take back its result. Call from
+   * the main loop.
+   * @param radioBusy BLE is connecting: wait
+   */
+  void service(bool radioBusy);
+
+  /**
+   * A broker is configured (looked at every CHECK_MS)
+   */
+  bool enabled() const { return _enabled; }
+
+  uint32_t published() const { return _published; } // Batches since boot
+  uint32_t failures() const { return _failures; }    // In a row
+
+private:
+  enum State : uint8_t { IDLE_TASK, RUNNING, DONE };
+
+  struct Job {
+    char host[64];
+    uint16_t port;
+    char user[32];
+    char password[64];
+    char topic[TOPIC_MAX];
+    char ssid[33];
+    char wifiPassword[65];
+    bool linger;        // Keep WiFi and the session for the next burst
+    uint16_t keepAlive; // Seconds, for CONNECT
+    size_t length;      // Payload bytes, 0: keep-alive only
+    uint8_t payload[PAYLOAD_MAX];
+  };
+
+  TaskHandle_t _task;
+  std::atomic<uint8_t> _state;
+  Job _job;  // Written by the loop task before RUNNING
+  bool _ok;  // Outcome of the finished burst
+
+  // Loop task only
+  Sample _batch[BATCH_MAX];
+  int _count;
+  int _sending; // Samples in the job, removed on success
+  uint32_t _seq; // Of the next sample
+  Sample _acked; // Last sample of the last successful delta burst
+  bool _haveAcked;
+  bool _sendingDelta; // Format of the burst in flight
+  bool _sendingKeyframe;
+  int _sinceKeyframe; // Delta bursts since the last keyframe
+  bool _enabled;
+  bool _lingering; // The last job kept the link up
+  uint32_t _lastCheck;  // millis()
+  uint32_t _lastSample; // millis()
+  uint32_t _lastBurst;  // millis(), 0: never
+  uint32_t _retryMs;    // Back-off after a failure, 0 after a success
+  uint32_t _published;
+  uint32_t _failures;
+
+  // Worker task only
+  WiFiClient _client;
+  bool _holding; // WifiLink acquired
+  bool _session; // CONNACK received on _client
+  uint8_t _packet[PAYLOAD_MAX + TOPIC_MAX + 8];
+
+  uint32_t intervalMs() const;
+  size_t encode(uint8_t *out, size_t cap, int count) const;
+  size_t encodeDelta(uint8_t *out, size_t cap, int count);
+  void start(size_t length, int samples);
+  void adopt();
+  static void taskEntry(void *arg);
+  bool burst();
+  bool connect();
+  void closeSession();
+  void disconnect();
+  bool send(uint8_t type, const uint8_t *body, size_t length);
+  bool sendPublish();
+  void drain();
+};
+
+extern MqttBridge *mqtt;
+
+#endif // MQTT_BRIDGE_H
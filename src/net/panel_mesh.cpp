@@ -0,0 +1,538 @@
+/**
+ * Panel Mesh Implementation
+ */
+
+#include "panel_mesh.h"
+#include "../ble/ble_client.h"
+#include "../utils/log.h"
+#include "../utils/wake.h"
+#include "wifi_link.h"
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <mbedtls/md.h>
+
+extern FossibotBLE *bleClient;
+
+static const uint8_t MAGIC = 0xA7;
+static const uint8_t VERSION = 1;
+static const uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint32_t CHANNEL_CHECK_MS = 5000;
+
+PanelMesh::PanelMesh()
+    : _role(Role::OFF), _roleSince(0), _group(0), _session(0), _counter(0),
+      _channel(1), _lastChannelCheck(0), _haveSent(false), _keyframeDue(false),
+      _lastKeyframe(0), _lastSend(0), _frameDirty(false), _settingsDue(false),
+      _usedHead(0), _ownerCounter(0), _lastOwnerMs(0), _haveRef(false),
+      _needKeyframe(false), _lastHello(0), _ownerLinked(false) {
+  memset(_self, 0, sizeof(_self));
+  memset(_key, 0, sizeof(_key));
+  memset(&_sent, 0, sizeof(_sent));
+  memset(&_sentSettings, 0, sizeof(_sentSettings));
+  memset(_peers, 0, sizeof(_peers));
+  memset(_usedTags, 0, sizeof(_usedTags));
+  memset(_owner, 0, sizeof(_owner));
+  memset(&_ref, 0, sizeof(_ref));
+}
+
+bool PanelMesh::begin(const String &unitMAC, int channel, const String &key) {
+  if (unitMAC.length() == 0)
+    return false;
+  if (!WifiLink::instance().holdRadio())
+    return false;
+
+  // One mesh per unit, however its MAC was written in each panel's config
+  String mac = unitMAC;
+  mac.toUpperCase();
+  _group = 2166136261u; // FNV-1a
+  for (size_t i = 0; i < mac.length(); i++)
+    _group = (_group ^ (uint8_t)mac[i]) * 16777619u;
+  _channel = channel;
+  strlcpy(_key, key.c_str(), sizeof(_key));
+  esp_wifi_get_mac(WIFI_IF_STA, _self);
+  syncChannel();
+
+  if (esp_now_init() != ESP_OK) {
+    LOG_W("Mesh", "ESP-NOW did not start");
+    WifiLink::instance().releaseRadio();
+    return false;
+  }
+  esp_now_register_recv_cb(onReceive);
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, BROADCAST, sizeof(BROADCAST));
+  peer.ifidx = WIFI_IF_STA;
+  esp_now_add_peer(&peer);
+
+  // No link of our own until the election says so
+  _role = Role::LISTENING;
+  _roleSince = millis();
+  if (bleClient)
+    bleClient->setRelay([this](uint8_t reg, uint16_t value) {
+      return relayCommand(reg, value);
+    });
+  LOG_I("Mesh", "Listening on channel %d for a panel holding %s%s", channel,
+        unitMAC.c_str(), _key[0] ? "" : " (unsigned)");
+  return true;
+}
+
+void PanelMesh::onReceive(const esp_now_recv_info_t *info,
+                          const uint8_t *data, int length) {
+  // WiFi task: copy and hand over
+  if (!mesh || length <= 0 || length > MAX_MESSAGE)
+    return;
+  Packet packet;
+  memcpy(packet.mac, info->src_addr, sizeof(packet.mac));
+  packet.length = length;
+  memcpy(packet.data, data, length);
+  if (mesh->_rx.push(packet))
+    Wake::signal(Wake::NETWORK);
+}
+
+void PanelMesh::setFrame(const Fossibot::PowerBankData &data) {
+  _frame = data;
+  _frameDirty = true;
+  if (data.settingsReceived) {
+    Settings now = settingsOf(data);
+    if (memcmp(&now, &_sentSettings, sizeof(now)) != 0)
+      _settingsDue = true;
+  }
+}
+
+void PanelMesh::syncChannel() {
+  // Joined, the radio follows the network's channel
+  if (WiFi.status() == WL_CONNECTED)
+    return;
+  uint8_t primary = 0;
+  wifi_second_chan_t second;
+  if (esp_wifi_get_channel(&primary, &second) == ESP_OK &&
+      primary != _channel)
+    esp_wifi_set_channel(_channel, WIFI_SECOND_CHAN_NONE);
+}
+
+uint32_t PanelMesh::takeoverMs() const {
+  return OWNER_TIMEOUT_MS + (_self[5] % 8) * STAGGER_MS;
+}
+
+void PanelMesh::update() {
+  if (_role == Role::OFF)
+    return;
+
+  Packet packet;
+  while (_rx.pop(packet))
+    handle(packet);
+
+  uint32_t now = millis();
+  if (now - _lastChannelCheck >= CHANNEL_CHECK_MS) {
+    _lastChannelCheck = now;
+    syncChannel();
+  }
+
+  switch (_role) {
+  case Role::LISTENING:
+    if (now - _roleSince >= ELECTION_MS)
+      becomeOwner();
+    break;
+
+  case Role::PEER:
+    if (now - _lastOwnerMs >= takeoverMs()) {
+      LOG_W("Mesh", "Owner silent for %lu ms, taking the link",
+            (unsigned long)(now - _lastOwnerMs));
+      becomeOwner();
+      break;
+    }
+    if (now - _lastHello >= (_needKeyframe ? HELLO_RETRY_MS : HELLO_MS))
+      sendHello();
+    break;
+
+  case Role::OWNER: {
+    if (_settingsDue)
+      sendSettings();
+    bool pending = _frameDirty || _keyframeDue;
+    if (now - _lastSend >= (pending ? SEND_MS : HEARTBEAT_MS))
+      sendTelemetry();
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+uint32_t PanelMesh::msUntilDue() const {
+  if (_role == Role::OFF)
+    return UINT32_MAX;
+  if (!_rx.empty() || _settingsDue)
+    return 0;
+  uint32_t now = millis();
+  auto left = [now](uint32_t since, uint32_t period) {
+    uint32_t elapsed = now - since;
+    return elapsed >= period ? 0 : period - elapsed;
+  };
+
+  switch (_role) {
+  case Role::LISTENING:
+    return left(_roleSince, ELECTION_MS);
+  case Role::PEER:
+    return min(left(_lastOwnerMs, takeoverMs()),
+               left(_lastHello, _needKeyframe ? HELLO_RETRY_MS : HELLO_MS));
+  case Role::OWNER:
+    return left(_lastSend,
+                _frameDirty || _keyframeDue ? SEND_MS : HEARTBEAT_MS);
+  default:
+    return UINT32_MAX;
+  }
+}
+
+// ============================================================
+// Election
+// ============================================================
+
+void PanelMesh::becomeOwner() {
+  _role = Role::OWNER;
+  _roleSince = millis();
+  _session = esp_random();
+  _counter = 0;
+  _haveSent = false;
+  _keyframeDue = true;
+  _lastSend = 0;
+  _settingsDue = _frame.settingsReceived;
+  memset(_peers, 0, sizeof(_peers));
+  memset(_usedTags, 0, sizeof(_usedTags));
+  _usedHead = 0;
+  if (bleClient)
+    bleClient->setRelay(nullptr);
+  LOG_I("Mesh", "Holding the link for the panels on channel %u", _channel);
+}
+
+void PanelMesh::becomePeer(const uint8_t *owner, uint32_t session) {
+  bool wasOwner = _role == Role::OWNER;
+  _role = Role::PEER;
+  _roleSince = millis();
+  memcpy(_owner, owner, sizeof(_owner));
+  _session = session;
+  _ownerCounter = 0;
+  _lastOwnerMs = millis();
+  _haveRef = false;
+  _needKeyframe = true;
+  _lastHello = 0;
+  _ownerLinked = false;
+  _data = Fossibot::PowerBankData();
+  if (bleClient && (wasOwner || !bleClient->isRelayed()))
+    bleClient->setRelay([this](uint8_t reg, uint16_t value) {
+      return relayCommand(reg, value);
+    });
+  LOG_I("Mesh", "%s %02X:%02X:%02X:%02X:%02X:%02X",
+        wasOwner ? "Yielding the link to" : "Readings from", owner[0],
+        owner[1], owner[2], owner[3], owner[4], owner[5]);
+}
+
+// ============================================================
+// Receiving
+// ============================================================
+
+void PanelMesh::handle(const Packet &packet) {
+  size_t tagLen = _key[0] ? TAG_LEN : 0;
+  if (packet.length < sizeof(Header) + tagLen)
+    return;
+  Header h;
+  memcpy(&h, packet.data, sizeof(h));
+  if (h.magic != MAGIC || (h.versionType >> 4) != VERSION ||
+      h.group != _group)
+    return;
+
+  if (tagLen) {
+    uint8_t tag[TAG_LEN];
+    sign(packet.data, packet.length - tagLen, tag);
+    uint8_t diff = 0; // Same time whichever byte differs
+    for (int i = 0; i < TAG_LEN; i++)
+      diff |= tag[i] ^ packet.data[packet.length - tagLen + i];
+    if (diff)
+      return;
+  }
+
+  const uint8_t *body = packet.data + sizeof(Header);
+  size_t length = packet.length - sizeof(Header) - tagLen;
+  uint8_t type = h.versionType & 0x0F;
+
+  if (type == HELLO || type == COMMAND) {
+    if (_role == Role::OWNER)
+      handleOwner(packet, h, body, length);
+    return;
+  }
+  if (type != TELEMETRY && type != SETTINGS)
+    return;
+
+  // From an owner: follow it, or the lower addressed of two
+  switch (_role) {
+  case Role::LISTENING:
+    becomePeer(packet.mac, h.session);
+    break;
+  case Role::OWNER:
+    if (memcmp(packet.mac, _self, sizeof(_self)) > 0)
+      return; // It yields to us when it hears us
+    becomePeer(packet.mac, h.session);
+    break;
+  case Role::PEER:
+    if (memcmp(packet.mac, _owner, sizeof(_owner)) > 0)
+      return;
+    if (memcmp(packet.mac, _owner, sizeof(_owner)) < 0)
+      becomePeer(packet.mac, h.session);
+    break;
+  default:
+    return;
+  }
+  handlePeer(packet, h, body, length);
+}
+
+void PanelMesh::handlePeer(const Packet &, const Header &h,
+                           const uint8_t *body, size_t length) {
+  if (h.session != _session) {
+    // The owner restarted: nothing it sent before counts
+    _session = h.session;
+    _ownerCounter = 0;
+    _haveRef = false;
+    _needKeyframe = true;
+  } else if (h.counter <= _ownerCounter) {
+    return; // Seen, or played back
+  }
+  _ownerCounter = h.counter;
+  _lastOwnerMs = millis();
+
+  uint8_t type = h.versionType & 0x0F;
+  if (type == TELEMETRY) {
+    if (length < 1)
+      return;
+    _ownerLinked = body[0] & LINKED;
+    TelemetryDelta::Frame frame;
+    int n = TelemetryDelta::decode(body + 1, length - 1,
+                                   _haveRef ? &_ref : nullptr, &frame, 1);
+    if (n < 0) {
+      _needKeyframe = true; // Missed one: ask for a fresh start
+      return;
+    }
+    if (n == 1) {
+      _ref = frame;
+      _haveRef = true;
+      _needKeyframe = false;
+      TelemetryDelta::apply(frame, _data);
+    }
+  } else if (type == SETTINGS) {
+    if (length != sizeof(Settings))
+      return;
+    Settings settings;
+    memcpy(&settings, body, sizeof(settings));
+    applySettings(settings, _data);
+  }
+
+  if (_ownerLinked && _haveRef && bleClient)
+    bleClient->feedRelayed(_data);
+}
+
+void PanelMesh::handleOwner(const Packet &packet, const Header &h,
+                            const uint8_t *body, size_t length) {
+  if (h.session != _session)
+    return; // Following an owner from before
+  notePeer(packet.mac);
+
+  if ((h.versionType & 0x0F) == HELLO) {
+    if (length >= 1 && (body[0] & WANT_KEYFRAME))
+      _keyframeDue = true;
+    return;
+  }
+
+  // A write: signed, naming one of our last counters, and new
+  if (!_key[0] || length != sizeof(Command))
+    return;
+  Command command;
+  memcpy(&command, body, sizeof(command));
+  if (_counter - command.ownerCounter >= COMMAND_WINDOW) {
+    LOG_W("Mesh", "Stale write for reg %u dropped", command.reg);
+    return;
+  }
+  const uint8_t *tag = packet.data + packet.length - TAG_LEN;
+  for (const auto &used : _usedTags)
+    if (memcmp(used, tag, TAG_LEN) == 0)
+      return; // The second copy, or played back
+  memcpy(_usedTags[_usedHead], tag, TAG_LEN);
+  _usedHead = (_usedHead + 1) % 8;
+
+  if (!bleClient || !bleClient->isConnected() || bleClient->isRelayed()) {
+    LOG_W("Mesh", "Write for reg %u with no link", command.reg);
+    return;
+  }
+  bleClient->writeRelayed(command.reg, command.value);
+}
+
+void PanelMesh::notePeer(const uint8_t *mac) {
+  uint32_t now = millis();
+  Peer *slot = nullptr;
+  for (auto &peer : _peers) {
+    if (peer.seenMs && memcmp(peer.mac, mac, sizeof(peer.mac)) == 0) {
+      slot = &peer;
+      break;
+    }
+    if (!slot || !peer.seenMs ||
+        (slot->seenMs && now - peer.seenMs > now - slot->seenMs))
+      slot = &peer; // Free, or heard from longest ago
+  }
+  memcpy(slot->mac, mac, sizeof(slot->mac));
+  slot->seenMs = now ? now : 1;
+}
+
+int PanelMesh::peerCount() const {
+  if (_role != Role::OWNER)
+    return 0;
+  int n = 0;
+  for (const auto &peer : _peers)
+    if (peer.seenMs && millis() - peer.seenMs < PEER_TIMEOUT_MS)
+      n++;
+  return n;
+}
+
+// ============================================================
+// Sending
+// ============================================================
+
+void PanelMesh::sign(const uint8_t *data, size_t length, uint8_t *tag) const {
+  uint8_t full[32];
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                  (const uint8_t *)_key, strlen(_key), data, length, full);
+  memcpy(tag, full, TAG_LEN);
+}
+
+bool PanelMesh::send(Type type, const void *body, size_t length,
+                     int copies) {
+  size_t tagLen = _key[0] ? TAG_LEN : 0;
+  size_t total = sizeof(Header) + length + tagLen;
+  if (total > MAX_MESSAGE)
+    return false;
+  uint8_t message[MAX_MESSAGE];
+  Header h = {MAGIC, (uint8_t)(VERSION << 4 | type), _group, _session,
+              ++_counter};
+  memcpy(message, &h, sizeof(h));
+  memcpy(message + sizeof(h), body, length);
+  if (tagLen)
+    sign(message, total - tagLen, message + total - tagLen);
+
+  bool ok = true;
+  for (int i = 0; i < copies; i++)
+    ok = esp_now_send(BROADCAST, message, total) == ESP_OK && ok;
+  return ok;
+}
+
+void PanelMesh::sendTelemetry() {
+  uint32_t now = millis();
+  _lastSend = now;
+  bool linked =
+      bleClient && bleClient->isConnected() && !bleClient->isRelayed();
+  bool keyframe =
+      !_haveSent || _keyframeDue || now - _lastKeyframe >= KEYFRAME_MS;
+
+  uint8_t body[1 + 64];
+  body[0] = linked ? LINKED : 0;
+  size_t n;
+  if (_frameDirty || keyframe) {
+    TelemetryDelta::Frame next;
+    TelemetryDelta::capture(next, _frame, _haveSent ? _sent.seq + 1 : 1,
+                            time(nullptr));
+    if (next.time < _sent.time)
+      keyframe = true; // The clock was set back
+    n = TelemetryDelta::encode(keyframe ? nullptr : &_sent, &next, 1,
+                               body + 1, sizeof(body) - 1);
+    if (!n)
+      return;
+    _sent = next;
+    _haveSent = true;
+  } else {
+    n = TelemetryDelta::encode(&_sent, &_sent, 0, body + 1,
+                               sizeof(body) - 1); // Heartbeat
+    if (!n)
+      return;
+  }
+  _frameDirty = false;
+  if (keyframe) {
+    _keyframeDue = false;
+    _lastKeyframe = now;
+    _settingsDue = _frame.settingsReceived; // For any peer that is new
+  }
+  send(TELEMETRY, body, 1 + n);
+}
+
+void PanelMesh::sendSettings() {
+  _settingsDue = false;
+  if (!_frame.settingsReceived)
+    return;
+  Settings settings = settingsOf(_frame);
+  if (send(SETTINGS, &settings, sizeof(settings)))
+    _sentSettings = settings;
+}
+
+void PanelMesh::sendHello() {
+  _lastHello = millis();
+  uint8_t flags = _needKeyframe ? WANT_KEYFRAME : 0;
+  send(HELLO, &flags, sizeof(flags));
+}
+
+bool PanelMesh::relayCommand(uint8_t reg, uint16_t value) {
+  if (_role != Role::PEER || !_key[0] || !_ownerCounter) {
+    LOG_W("Mesh", "No owner to take the write for reg %u%s", reg,
+          _key[0] ? "" : " (mesh.key unset)");
+    return false;
+  }
+  // Sent twice as one message: broadcasts are not acknowledged, and the
+  // owner drops the copy by its tag
+  Command command = {_ownerCounter, reg, value};
+  return send(COMMAND, &command, sizeof(command), 2);
+}
+
+// ============================================================
+// Settings frame
+// ============================================================
+
+PanelMesh::Settings
+PanelMesh::settingsOf(const Fossibot::PowerBankData &data) {
+  auto u16 = [](int v) {
+    return (uint16_t)(v < 0 ? 0 : (v > 65535 ? 65535 : v));
+  };
+  Settings s;
+  s.flags = (data.settingsReceived ? 1 : 0) | (data.buzzerEnabled ? 2 : 0) |
+            (data.silentCharging ? 4 : 0);
+  s.lightMode = data.lightMode;
+  s.dischargeLimit = data.dischargeLimit;
+  s.chargeLimit = data.chargeLimit;
+  s.screenTimeout = u16(data.screenTimeout);
+  s.sysStandby = u16(data.sysStandby);
+  s.acStandby = u16(data.acStandby);
+  s.dcStandby = u16(data.dcStandby);
+  s.usbStandby = u16(data.usbStandby);
+  s.scheduleCharge = u16(data.scheduleCharge);
+  return s;
+}
+
+void PanelMesh::applySettings(const Settings &s,
+                              Fossibot::PowerBankData &data) {
+  data.settingsReceived = s.flags & 1;
+  data.buzzerEnabled = s.flags & 2;
+  data.silentCharging = s.flags & 4;
+  data.lightMode = s.lightMode;
+  data.dischargeLimit = s.dischargeLimit;
+  data.chargeLimit = s.chargeLimit;
+  data.screenTimeout = s.screenTimeout;
+  data.sysStandby = s.sysStandby;
+  data.acStandby = s.acStandby;
+  data.dcStandby = s.dcStandby;
+  data.usbStandby = s.usbStandby;
+  data.scheduleCharge = s.scheduleCharge;
+}
+
+const char *PanelMesh::roleName(Role role) {
+  switch (role) {
+  case Role::LISTENING:
+    return "listening";
+  case Role::OWNER:
+    return "owner";
+  case Role::PEER:
+    return "peer";
+  default:
+    return "off";
+  }
+}
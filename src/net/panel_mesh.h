@@ -0,0 +1,201 @@
+/**
+ * Panel Mesh
+ *
+ * Several panels watching one power bank share a single BLE link over
+ * ESP-NOW (mesh.enabled, every panel on the same mesh.channel). One panel,
+ * the owner, holds the link and broadcasts the readings; the others, the
+ * peers, never scan or connect (FossibotBLE::setRelay()) and send their
+ * register writes to the owner instead.
+ *
+ * Election: a panel listens for ELECTION_MS at boot and becomes a peer of
+ * the first owner it hears, or the owner itself. A peer that hears nothing
+ * from its owner for OWNER_TIMEOUT_MS (plus a stagger by its own address,
+ * so they do not all claim at once) takes over. Two owners that hear each
+ * other settle on the lower address; the other becomes a peer.
+ *
+ * Messages are broadcast, one per ESP-NOW frame:
+ *
+ *   Header     magic, version and type, the group (a hash of the power
+ *              bank's MAC: one mesh per unit), the owner's session (a
+ *              random number from its boot) and the sender's counter
+ *   TELEMETRY  owner: a flags byte (LINKED), then one TelemetryDelta
+ *              frame from the last one sent (a keyframe every KEYFRAME_MS
+ *              or when a peer asks), or none as a heartbeat
+ *   SETTINGS   owner: the unit's settings frame, when it changes
+ *   HELLO      peer: here, and whether it needs a keyframe
+ *   COMMAND    peer: a register write, naming an owner counter it heard
+ *
+ * With mesh.key every message ends in a truncated HMAC-SHA256 under that
+ * key and unsigned ones are dropped. Commands are only taken when signed,
+ * naming one of the owner's last COMMAND_WINDOW counters, and not seen
+ * before, so a recorded one cannot be played back later. Without a key
+ * peers only watch.
+ *
+ * ESP-NOW needs the radio in station mode (WifiLink::holdRadio()); while
+ * another feature has joined a network the radio is on that network's
+ * channel, so panels using WiFi should set mesh.channel to it.
+ *
+ * Main loop task, apart from the receive callback, which queues.
+ */
+
+#ifndef PANEL_MESH_H
+#define PANEL_MESH_H
+
+#include "../ble/fossibot_protocol.h"
+#include "../utils/spsc_ring.h"
+#include "telemetry_delta.h"
+#include <Arduino.h>
+#include <esp_now.h>
+
+class PanelMesh {
+public:
+  static const uint32_t ELECTION_MS = 3000;      // Listen before claiming
+  static const uint32_t HEARTBEAT_MS = 2000;     // Owner: at least this often
+  static const uint32_t SEND_MS = 500;           // Owner: least between frames
+  static const uint32_t KEYFRAME_MS = 30000;
+  static const uint32_t OWNER_TIMEOUT_MS = 8000; // Peer: owner gone
+  static const uint32_t STAGGER_MS = 500;        // Per step of the address
+  static const uint32_t HELLO_MS = 30000;        // Peer: still here
+  static const uint32_t HELLO_RETRY_MS = 1000;   // Peer: keyframe asks
+  static const uint32_t PEER_TIMEOUT_MS = 75000; // Owner: peer gone
+  static const uint32_t COMMAND_WINDOW = 16;     // Owner counters accepted
+  static const int TAG_LEN = 8;
+  static const int MAX_MESSAGE = 250; // ESP-NOW payload
+  static const int MAX_PEERS = 8;
+
+  enum class Role : uint8_t { OFF, LISTENING, OWNER, PEER };
+
+  PanelMesh();
+
+  /**
+   * Bring the radio up and start listening for an owner
+   * @param unitMAC The power bank's MAC (the mesh group)
+   * @param key Signs the messages; empty for none
+   * @return false if ESP-NOW could not start
+   */
+  bool begin(const String &unitMAC, int channel, const String &key);
+
+  /**
+   * The unit's own frame, while this panel holds the link
+   */
+  void setFrame(const Fossibot::PowerBankData &data);
+
+  /**
+   * Handle what came in, run the election and send what is due. Call
+   * from the main loop.
+   */
+  void update();
+
+  /**
+   * Time until update() has something to send or time out
+   */
+  uint32_t msUntilDue() const;
+
+  Role role() const { return _role; }
+  int peerCount() const; // Owner: panels heard from within the timeout
+  static const char *roleName(Role role);
+
+private:
+  enum Type : uint8_t { TELEMETRY = 1, SETTINGS, HELLO, COMMAND };
+  enum Flag : uint8_t { LINKED = 1 << 0, WANT_KEYFRAME = 1 << 0 };
+
+  struct __attribute__((packed)) Header {
+    uint8_t magic;
+    uint8_t versionType; // VERSION << 4 | Type
+    uint32_t group;
+    uint32_t session;
+    uint32_t counter;
+  };
+
+  struct __attribute__((packed)) Settings {
+    uint8_t flags; // Bit 0 received, 1 buzzer, 2 silent charging
+    uint8_t lightMode;
+    uint8_t dischargeLimit;
+    uint8_t chargeLimit;
+    uint16_t screenTimeout;
+    uint16_t sysStandby;
+    uint16_t acStandby;
+    uint16_t dcStandby;
+    uint16_t usbStandby;
+    uint16_t scheduleCharge;
+  };
+
+  struct __attribute__((packed)) Command {
+    uint32_t ownerCounter; // A recent one the peer heard
+    uint8_t reg;
+    uint16_t value;
+  };
+
+  struct Packet {
+    uint8_t mac[6];
+    uint8_t length;
+    uint8_t data[MAX_MESSAGE];
+  };
+
+  struct Peer {
+    uint8_t mac[6];
+    uint32_t seenMs; // 0 = free
+  };
+
+  Role _role;
+  uint32_t _roleSince;
+  uint8_t _self[6];
+  uint32_t _group;
+  uint32_t _session; // Ours as owner, else the owner's
+  uint32_t _counter; // Of our messages
+  uint8_t _channel;
+  char _key[33];
+  uint32_t _lastChannelCheck;
+
+  // Owner
+  TelemetryDelta::Frame _sent; // Last frame sent, the peers' reference
+  bool _haveSent;
+  bool _keyframeDue;
+  uint32_t _lastKeyframe;
+  uint32_t _lastSend;
+  Fossibot::PowerBankData _frame;
+  bool _frameDirty;
+  Settings _sentSettings;
+  bool _settingsDue;
+  Peer _peers[MAX_PEERS];
+  uint8_t _usedTags[8][TAG_LEN]; // Commands already applied
+  int _usedHead;
+
+  // Peer
+  uint8_t _owner[6];
+  uint32_t _ownerCounter; // Last heard
+  uint32_t _lastOwnerMs;
+  TelemetryDelta::Frame _ref; // Last frame decoded
+  bool _haveRef;
+  bool _needKeyframe;
+  uint32_t _lastHello;
+  bool _ownerLinked; // The owner has the unit
+  Fossibot::PowerBankData _data;
+
+  SpscRing<Packet, 8> _rx;
+
+  static void onReceive(const esp_now_recv_info_t *info, const uint8_t *data,
+                        int length);
+  void handle(const Packet &packet);
+  void handleOwner(const Packet &packet, const Header &h, const uint8_t *body,
+                   size_t length);
+  void handlePeer(const Packet &packet, const Header &h, const uint8_t *body,
+                  size_t length);
+  void becomeOwner();
+  void becomePeer(const uint8_t *owner, uint32_t session);
+  bool send(Type type, const void *body, size_t length, int copies = 1);
+  void sendTelemetry();
+  void sendSettings();
+  void sendHello();
+  bool relayCommand(uint8_t reg, uint16_t value);
+  void notePeer(const uint8_t *mac);
+  void syncChannel();
+  void sign(const uint8_t *data, size_t length, uint8_t *tag) const;
+  uint32_t takeoverMs() const;
+  static Settings settingsOf(const Fossibot::PowerBankData &data);
+  static void applySettings(const Settings &s, Fossibot::PowerBankData &data);
+};
+
+extern PanelMesh *mesh;
+
+#endif // PANEL_MESH_H
@@ -0,0 +1,157 @@
+/**
+ * Telemetry Delta Implementation
+ */
+
+#include "telemetry_delta.h"
+
+namespace TelemetryDelta {
+
+void capture(Frame &frame, const Fossibot::PowerBankData &data, uint32_t seq,
+             uint32_t time) {
+  frame.seq = seq;
+  frame.time = time;
+  int32_t *v = frame.v;
+  auto watts = [](Fixed::Deciwatts dw) {
+    return constrain(Fixed::watts(dw), 0, 65535);
+  };
+  v[SOC10] = constrain(data.socPermille, 0, Fixed::FULL);
+  v[MV] = constrain(data.batteryCentivolts, 0, 6500) * 10;
+  v[IN_W] = watts(data.inputDeciwatts);
+  v[OUT_W] = watts(data.outputDeciwatts);
+  v[AC_IN_W] = watts(data.acInputDeciwatts);
+  v[DC_IN_W] = watts(data.dcInputDeciwatts);
+  v[TO_EMPTY_MIN] = data.minutesToEmpty;
+  v[TO_FULL_MIN] = data.minutesToFull;
+  v[OUTPUTS] = (data.usbActive ? 1 : 0) | (data.dcActive ? 2 : 0) |
+               (data.acActive ? 4 : 0);
+}
+
+// Appends to out[n..cap); false once it runs out of room
+static bool putVarint(uint8_t *out, size_t cap, size_t &n, uint32_t value) {
+  do {
+    if (n >= cap)
+      return false;
+    uint8_t b = value & 0x7F;
+    value >>= 7;
+    out[n++] = b | (value ? 0x80 : 0);
+  } while (value);
+  return true;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+// Reads from in[n..length); false at the end or past 32 bits
+static bool getVarint(const uint8_t *in, size_t length, size_t &n,
+                      uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (n >= length)
+      return false;
+    uint8_t b = in[n++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+size_t encode(const Frame *ref, const Frame *frames, int count, uint8_t *out,
+              size_t cap) {
+  if (cap == 0 || count < 0 || (!ref && count == 0))
+    return 0;
+  size_t n = 0;
+  out[n++] = (VERSION << 4) | (ref ? 0 : FLAG_KEYFRAME);
+  uint32_t first = count ? frames[0].seq : ref->seq + 1;
+  bool ok = putVarint(out, cap, n, first);
+  if (ref)
+    ok = ok && putVarint(out, cap, n, ref->seq);
+  uint32_t time = count ? frames[0].time : 0;
+  if (ref)
+    time = count ? time - ref->time : 0;
+  ok = ok && putVarint(out, cap, n, time) && putVarint(out, cap, n, count);
+
+  static const Frame zero = {};
+  const Frame *prev = ref ? ref : &zero;
+  for (int i = 0; i < count && ok; i++) {
+    const Frame &f = frames[i];
+    if (i > 0)
+      ok = putVarint(out, cap, n, f.time - prev->time);
+    uint32_t mask = 0;
+    for (int k = 0; k < FIELD_COUNT; k++)
+      if (f.v[k] != prev->v[k])
+        mask |= 1u << k;
+    ok = ok && putVarint(out, cap, n, mask);
+    for (int k = 0; k < FIELD_COUNT && ok; k++)
+      if (mask & (1u << k))
+        ok = putVarint(out, cap, n, zigzag(f.v[k] - prev->v[k]));
+    prev = &f;
+  }
+  return ok ? n : 0;
+}
+
+int decode(const uint8_t *in, size_t length, const Frame *ref, Frame *frames,
+           int max) {
+  if (length < 1 || in[0] >> 4 != VERSION)
+    return -1;
+  bool keyframe = in[0] & FLAG_KEYFRAME;
+  size_t n = 1;
+  uint32_t first, refSeq = 0, time, count;
+  if (!getVarint(in, length, n, first) ||
+      (!keyframe && !getVarint(in, length, n, refSeq)) ||
+      !getVarint(in, length, n, time) || !getVarint(in, length, n, count))
+    return -1;
+  if (!keyframe && (!ref || ref->seq != refSeq))
+    return -1;
+  if (count > (uint32_t)max)
+    return -1;
+
+  static const Frame zero = {};
+  const Frame *prev = keyframe ? &zero : ref;
+  for (uint32_t i = 0; i < count; i++) {
+    Frame &f = frames[i];
+    uint32_t dt = 0, mask;
+    if (i > 0 && !getVarint(in, length, n, dt))
+      return -1;
+    if (!getVarint(in, length, n, mask))
+      return -1;
+    f.seq = first + i;
+    if (i > 0)
+      f.time = prev->time + dt;
+    else
+      f.time = keyframe ? time : ref->time + time;
+    for (int k = 0; k < FIELD_COUNT; k++) {
+      f.v[k] = prev->v[k];
+      uint32_t change;
+      if (!(mask & (1u << k)))
+        continue;
+      if (!getVarint(in, length, n, change))
+        return -1;
+      f.v[k] += unzigzag(change);
+    }
+    prev = &f;
+  }
+  return n == length ? (int)count : -1;
+}
+
+void apply(const Frame &frame, Fossibot::PowerBankData &data) {
+  const int32_t *v = frame.v;
+  data.socPermille = v[SOC10];
+  data.batteryCentivolts = Fixed::divRound(v[MV], 10);
+  data.inputDeciwatts = Fixed::fromWatts(v[IN_W]);
+  data.outputDeciwatts = Fixed::fromWatts(v[OUT_W]);
+  data.acInputDeciwatts = Fixed::fromWatts(v[AC_IN_W]);
+  data.dcInputDeciwatts = Fixed::fromWatts(v[DC_IN_W]);
+  data.minutesToEmpty = v[TO_EMPTY_MIN];
+  data.minutesToFull = v[TO_FULL_MIN];
+  data.usbActive = v[OUTPUTS] & 1;
+  data.dcActive = v[OUTPUTS] & 2;
+  data.acActive = v[OUTPUTS] & 4;
+}
+
+} // namespace TelemetryDelta
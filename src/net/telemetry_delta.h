@@ -0,0 +1,90 @@
+/**
+ * Telemetry Delta
+ *
+ * A compact on-wire form for runs of telemetry frames, shared by the MQTT
+ * bridge, the LAN API and the panel mesh. Each frame holds the fields the
+ * bridges carry as integers; a message sends only what changed since a
+ * reference frame the receiver already has:
+ *
+ *   byte     VERSION << 4, | FLAG_KEYFRAME when there is no reference
+ *   varint   sequence number of the first frame (the rest follow on)
+ *   varint   reference sequence number (not in a keyframe)
+ *   varint   time of the first frame: UTC seconds in a keyframe, seconds
+ *            after the reference otherwise
+ *   varint   frame count
+ *   per frame:
+ *     varint seconds after the previous frame (not for the first)
+ *     varint mask of the fields that changed, bit n = Field n
+ *     zigzag varint per set bit, lowest first: new value minus old
+ *
+ * The first frame is compared with the reference (all zeros in a
+ * keyframe), each later one with the frame before it. Varints are 7 bits
+ * per byte, low first, high bit set on all but the last; zigzag maps
+ * 0, -1, 1, -2... to 0, 1, 2, 3... A frame where nothing but the time
+ * moved costs two bytes.
+ */
+
+#ifndef TELEMETRY_DELTA_H
+#define TELEMETRY_DELTA_H
+
+#include "../ble/fossibot_protocol.h"
+#include <Arduino.h>
+
+namespace TelemetryDelta {
+
+static const uint8_t VERSION = 1;
+static const uint8_t FLAG_KEYFRAME = 0x01;
+
+// The busiest fields first: with up to seven changed the mask is one byte
+enum Field : uint8_t {
+  SOC10,   // Tenths of a percent
+  MV,      // Battery mV
+  IN_W,
+  OUT_W,
+  AC_IN_W,
+  DC_IN_W,
+  TO_EMPTY_MIN, // -1: not discharging
+  TO_FULL_MIN,  // -1: not charging
+  OUTPUTS,      // Bit 0 USB, 1 DC, 2 AC
+  FIELD_COUNT
+};
+
+struct Frame {
+  uint32_t seq;
+  uint32_t time; // UTC
+  int32_t v[FIELD_COUNT];
+};
+
+/**
+ * Fill a frame from a reading
+ */
+void capture(Frame &frame, const Fossibot::PowerBankData &data, uint32_t seq,
+             uint32_t time);
+
+/**
+ * Encode frames[0..count), consecutive sequence numbers, as changes from
+ * ref (nullptr: a keyframe). A delta may have no frames.
+ * @return Bytes written, 0 if they do not fit in cap
+ */
+size_t encode(const Frame *ref, const Frame *frames, int count, uint8_t *out,
+              size_t cap);
+
+/**
+ * Decode a message into frames[0..max). A delta is only decoded against
+ * the reference it was encoded from.
+ * @param ref The last frame the receiver holds, or nullptr
+ * @return Frames decoded, -1 if the message is malformed, does not fit
+ *         in max, or is a delta from another reference than ref
+ */
+int decode(const uint8_t *in, size_t length, const Frame *ref, Frame *frames,
+           int max);
+
+/**
+ * Write a frame's fields back into a reading (the rest are left as they
+ * were)
+ */
+void apply(const Frame &frame, Fossibot::PowerBankData &data);
+
+} // namespace TelemetryDelta
+
+#endif // TELEMETRY_DELTA_H
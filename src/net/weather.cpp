@@ -0,0 +1,323 @@
+/**
+ * Weather Service Implementation
+ */
+
+#include "weather.h"
+#include "../utils/config.h"
+#include "../utils/log.h"
+#include "../utils/record_file.h"
+#include "../utils/wake.h"
+#include "wifi_link.h"
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <math.h>
+#include <time.h>
+
+extern Config *config;
+
+static const char *WEATHER_RECORD = "/config/weather.rec";
+static const char *FORECAST_URL =
+    "https://api.openweathermap.org/data/2.5/forecast";
+
+// Anything earlier means the clock has not been set yet
+static const time_t VALID_TIME = 1700000000;
+
+WeatherService::WeatherService()
+    : _task(nullptr), _state(IDLE_TASK), _outcome(Status::IDLE),
+      _outcomeCode(0), _status(Status::IDLE), _httpCode(0), _generation(0),
+      _forced(false), _lastCheck(0), _lastAttempt(0), _retryMs(0) {
+  memset(&_job, 0, sizeof(_job));
+  memset(&_fetched, 0, sizeof(_fetched));
+  memset(&_report, 0, sizeof(_report));
+}
+
+void WeatherService::begin() {
+  Report cached;
+  if (RecordFile::load(WEATHER_RECORD, cached) && cached.count <= SLOTS) {
+    _report = cached;
+    LOG_I("Weather", "Cached report for %s, %lu s old", _report.place,
+          (unsigned long)(time(nullptr) - _report.fetched));
+  }
+  if (!configured())
+    _status = Status::NOT_SET_UP;
+  _generation++;
+}
+
+bool WeatherService::configured() const {
+  return config && config->getWeatherAPIKey().length() > 0 &&
+         config->getWeatherCity().length() > 0 &&
+         config->getWiFiSSID().length() > 0;
+}
+
+bool WeatherService::matchesConfig() const {
+  return config && config->getWeatherCity() == _report.city &&
+         config->getWeatherUnits() == _report.units;
+}
+
+bool WeatherService::isFresh() const {
+  time_t now = time(nullptr);
+  return hasReport() && matchesConfig() && now >= VALID_TIME &&
+         (uint32_t)now - _report.fetched < FRESH_S;
+}
+
+const WeatherService::Slot *WeatherService::current() const {
+  if (!hasReport())
+    return nullptr;
+  uint32_t now = time(nullptr);
+  const Slot *slot = &_report.slots[0];
+  for (int i = 1; i < _report.count && _report.slots[i].time <= now; i++)
+    slot = &_report.slots[i];
+  return slot;
+}
+
+const char *WeatherService::tempUnit() const {
+  if (strcmp(_report.units, "imperial") == 0)
+    return "F";
+  if (strcmp(_report.units, "standard") == 0)
+    return "K";
+  return "C";
+}
+
+const char *WeatherService::condition(uint16_t code) {
+  switch (code / 100) {
+  case 2:
+    return "Thunder";
+  case 3:
+    return "Drizzle";
+  case 5:
+    return "Rain";
+  case 6:
+    return "Snow";
+  case 7:
+    return code == 781 ? "Tornado" : "Fog";
+  case 8:
+    return code == 800 ? "Clear" : code <= 802 ? "Fair" : "Clouds";
+  default:
+    return "--";
+  }
+}
+
+// ============================================================================
+// Scheduling (loop task)
+// ============================================================================
+
+bool WeatherService::due() const {
+  if (!configured() || time(nullptr) < VALID_TIME)
+    return false;
+  uint32_t since = millis() - _lastAttempt;
+  if (_lastAttempt && (since < MIN_GAP_MS || since < _retryMs))
+    return false;
+  return _forced || !isFresh();
+}
+
+void WeatherService::service(bool radioBusy) {
+  if (_state == DONE) {
+    adopt();
+    _state = IDLE_TASK;
+  }
+  // The config is looked at every few seconds, not every pass
+  if (_state != IDLE_TASK || millis() - _lastCheck < CHECK_MS)
+    return;
+  _lastCheck = millis();
+
+  bool ready = configured();
+  if (ready == (_status == Status::NOT_SET_UP)) {
+    _status = ready ? Status::IDLE : Status::NOT_SET_UP;
+    _generation++;
+  }
+  if (ready && !radioBusy && due())
+    start();
+}
+
+void WeatherService::start() {
+  if (!_task && xTaskCreatePinnedToCore(taskEntry, "weather", TASK_STACK,
+                                        this, 1, &_task, 0) != pdPASS) {
+    LOG_E("Weather", "Fetch task failed to start");
+    _task = nullptr;
+    return;
+  }
+
+  // The worker gets its own copy: the config may change meanwhile
+  String city = config->getWeatherCity();
+  String units = config->getWeatherUnits();
+  if (units.length() == 0)
+    units = "metric";
+  String query;
+  for (size_t i = 0; i < city.length(); i++) {
+    char c = city[i];
+    if (isalnum((unsigned char)c) || strchr("-_.~,", c)) {
+      query += c;
+    } else {
+      char hex[4];
+      snprintf(hex, sizeof(hex), "%%%02X", (uint8_t)c);
+      query += hex;
+    }
+  }
+  snprintf(_job.url, sizeof(_job.url), "%s?q=%s&units=%s&cnt=%d&appid=%s",
+           FORECAST_URL, query.c_str(), units.c_str(), SLOTS,
+           config->getWeatherAPIKey().c_str());
+  strlcpy(_job.ssid, config->getWiFiSSID().c_str(), sizeof(_job.ssid));
+  strlcpy(_job.password, config->getWiFiPassword().c_str(),
+          sizeof(_job.password));
+
+  // Validators only for the same query: anything else is a new document
+  bool same = hasReport() && matchesConfig();
+  strlcpy(_job.etag, same ? _report.etag : "", sizeof(_job.etag));
+  strlcpy(_job.lastModified, same ? _report.lastModified : "",
+          sizeof(_job.lastModified));
+  memset(&_fetched, 0, sizeof(_fetched));
+  strlcpy(_fetched.city, city.c_str(), sizeof(_fetched.city));
+  strlcpy(_fetched.units, config->getWeatherUnits().c_str(),
+          sizeof(_fetched.units));
+
+  _forced = false;
+  _lastAttempt = millis();
+  if (!_lastAttempt)
+    _lastAttempt = 1; // 0 means never
+  _status = Status::FETCHING;
+  _generation++;
+  _state = RUNNING;
+  xTaskNotifyGive(_task);
+}
+
+void WeatherService::adopt() {
+  _status = _outcome;
+  _httpCode = _outcomeCode;
+  _generation++;
+  uint32_t now = time(nullptr);
+
+  if (_outcome == Status::OK) {
+    if (_outcomeCode == 304) {
+      _report.fetched = now; // Same forecast, checked again
+    } else {
+      _report = _fetched;
+      _report.fetched = now;
+    }
+    _retryMs = 0;
+    RecordFile::saveDeferred(WEATHER_RECORD, _report);
+    LOG_I("Weather", "%s: %s, %d slot(s)", _report.place,
+          _outcomeCode == 304 ? "not modified" : "updated", _report.count);
+    return;
+  }
+
+  // A rejected key or city will not fix itself soon
+  bool permanent = _outcome == Status::HTTP_ERROR &&
+                   (_outcomeCode == 401 || _outcomeCode == 404);
+  if (permanent || _retryMs >= RETRY_MAX_MS / 2)
+    _retryMs = RETRY_MAX_MS;
+  else
+    _retryMs = _retryMs ? _retryMs * 2 : RETRY_MIN_MS;
+  LOG_W("Weather", "Fetch failed (status %d, HTTP %d), retry in %lu min",
+        (int)_outcome, _outcomeCode, (unsigned long)(_retryMs / 60000));
+}
+
+// ============================================================================
+// Fetch (worker task)
+// ============================================================================
+
+void WeatherService::taskEntry(void *arg) {
+  WeatherService *self = static_cast<WeatherService *>(arg);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (self->_state != RUNNING)
+      continue;
+    WifiLink &wifi = WifiLink::instance();
+    if (wifi.acquire(self->_job.ssid, self->_job.password)) {
+      self->fetch();
+      wifi.release(); // Radio off before the result is even looked at
+    } else {
+      self->_outcome = Status::NO_WIFI;
+      self->_outcomeCode = 0;
+    }
+    self->_state = DONE;
+    Wake::signal(Wake::NETWORK);
+  }
+}
+
+void WeatherService::fetch() {
+  uint32_t start = millis();
+  // No CA bundle in this build: encrypted (the key is in the URL) but the
+  // server is not authenticated
+  WiFiClientSecure client;
+  client.setInsecure();
+  client.setHandshakeTimeout(HTTP_TIMEOUT_MS / 1000);
+  HTTPClient http;
+  http.useHTTP10(true); // No chunked encoding: the body parses off the socket
+  http.setReuse(false);
+  http.setConnectTimeout(HTTP_TIMEOUT_MS);
+  http.setTimeout(HTTP_TIMEOUT_MS);
+
+  _outcome = Status::HTTP_ERROR;
+  _outcomeCode = 0;
+  if (!http.begin(client, _job.url))
+    return;
+  const char *keep[] = {"ETag", "Last-Modified"};
+  http.collectHeaders(keep, 2);
+  if (_job.etag[0])
+    http.addHeader("If-None-Match", _job.etag);
+  if (_job.lastModified[0])
+    http.addHeader("If-Modified-Since", _job.lastModified);
+
+  int code = http.GET();
+  _outcomeCode = code;
+  if (code == HTTP_CODE_NOT_MODIFIED) {
+    _outcome = Status::OK;
+  } else if (code == HTTP_CODE_OK) {
+    if (parse(http.getStream())) {
+      strlcpy(_fetched.etag, http.header("ETag").c_str(),
+              sizeof(_fetched.etag));
+      strlcpy(_fetched.lastModified, http.header("Last-Modified").c_str(),
+              sizeof(_fetched.lastModified));
+      _outcome = Status::OK;
+    } else {
+      _outcome = Status::BAD_DATA;
+    }
+  }
+  http.end();
+  LOG_D("Weather", "HTTP %d in %lu ms", code, millis() - start);
+}
+
+bool WeatherService::parse(Stream &body) {
+  // Only the fields drawn are kept; the rest of the document is skipped
+  // as it streams past
+  JsonDocument filter;
+  filter["city"]["name"] = true;
+  filter["city"]["timezone"] = true;
+  JsonObject item = filter["list"].add<JsonObject>();
+  item["dt"] = true;
+  item["main"]["temp"] = true;
+  item["main"]["humidity"] = true;
+  item["weather"][0]["id"] = true;
+  item["wind"]["speed"] = true;
+  item["pop"] = true;
+
+  JsonDocument doc;
+  DeserializationError error =
+      deserializeJson(doc, body, DeserializationOption::Filter(filter));
+  if (error) {
+    LOG_W("Weather", "Forecast unreadable: %s", error.c_str());
+    return false;
+  }
+
+  Report &r = _fetched;
+  strlcpy(r.place, doc["city"]["name"] | (const char *)r.city,
+          sizeof(r.place));
+  r.tzOffset = doc["city"]["timezone"] | 0;
+  r.count = 0;
+  for (JsonObject entry : doc["list"].as<JsonArray>()) {
+    if (r.count >= SLOTS)
+      break;
+    Slot &s = r.slots[r.count];
+    s.time = entry["dt"] | 0;
+    if (!s.time)
+      continue;
+    s.temp10 = lroundf((entry["main"]["temp"] | 0.0f) * 10);
+    s.wind10 = lroundf((entry["wind"]["speed"] | 0.0f) * 10);
+    s.code = entry["weather"][0]["id"] | 0;
+    s.humidity = entry["main"]["humidity"] | 0;
+    s.pop = lroundf((entry["pop"] | 0.0f) * 100);
+    r.count++;
+  }
+  return r.count > 0;
+}
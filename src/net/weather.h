@@ -0,0 +1,162 @@
+/**
+ * Weather Service
+ *
+ * Keeps the next 24 hours of forecast (OpenWeatherMap, 3-hour steps) for
+ * the configured city in /config/weather.rec, so the home panel and the
+ * weather screen draw from the cache and never wait on the network.
+ *
+ * Once the report is FRESH_S old, the main loop hands a fetch to a worker
+ * task. The worker holds WifiLink just long enough to make one request.
+ * That request is conditional (If-None-Match / If-Modified-Since with the
+ * cached validators), and the body is parsed straight off the socket
+ * through a filter that keeps only the fields drawn. A failed fetch backs
+ * off from RETRY_MIN_MS to RETRY_MAX_MS, and each attempt is bounded by
+ * the connect and HTTP timeouts, so radio time stays a few seconds an hour.
+ * No fetch starts while BLE is setting up a link on the shared radio.
+ */
+
+#ifndef WEATHER_H
+#define WEATHER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class WeatherService {
+public:
+  static const uint32_t TASK_STACK = 8192; // TLS handshake
+  static const uint32_t FRESH_S = 30 * 60;
+  static const uint32_t RETRY_MIN_MS = 5 * 60 * 1000;
+  static const uint32_t RETRY_MAX_MS = 2 * 60 * 60 * 1000;
+  static const uint32_t MIN_GAP_MS = 60 * 1000; // Between any two fetches
+  static const uint32_t CHECK_MS = 5000;        // Looking for a due fetch
+  static const uint32_t HTTP_TIMEOUT_MS = 6000;
+  static const int SLOTS = 8; // 3-hour steps
+
+  struct Slot {
+    uint32_t time;  // UTC
+    int16_t temp10; // Tenths of a degree in the report's units
+    int16_t wind10; // Tenths of m/s (mph in imperial)
+    uint16_t code;  // OpenWeatherMap condition id
+    uint8_t humidity;
+    uint8_t pop; // Chance of precipitation, %
+  };
+
+  struct Report {
+    static const uint16_t RECORD_TYPE = 0x3EA7;
+    static const uint16_t RECORD_VERSION = 1;
+    uint32_t fetched; // UTC of the last 200 or 304
+    int32_t tzOffset; // Seconds east of UTC at the city
+    char city[32];    // As configured (the query), not as reported
+    char units[12];
+    char place[32]; // As the service names it
+    char etag[48];
+    char lastModified[40];
+    uint8_t count;
+    uint8_t reserved[3];
+    Slot slots[SLOTS];
+  };
+
+  enum class Status : uint8_t {
+    NOT_SET_UP, // No API key, city or WiFi network
+    IDLE,
+    FETCHING,
+    OK,
+    NO_WIFI,
+    HTTP_ERROR,
+    BAD_DATA
+  };
+
+  WeatherService();
+
+  /**
+   * Load the cached report; call once the config is loaded
+   */
+  void begin();
+
+  /**
+   * Take over a finished fetch and start one when the report is stale.
+   * Call from the main loop.
+   * @param radioBusy BLE is connecting: wait
+   */
+  void service(bool radioBusy);
+
+  /**
+   * Fetch at the next service(), fresh or not (MIN_GAP_MS still applies)
+   */
+  void refresh() {
+    _forced = true;
+    _lastCheck = 0;
+  }
+
+  const Report &report() const { return _report; }
+  bool hasReport() const { return _report.count > 0; }
+
+  /**
+   * The report answers the configured city and units and is FRESH_S old
+   * at most
+   */
+  bool isFresh() const;
+
+  /**
+   * The slot covering now (the last one not in the future), or nullptr
+   */
+  const Slot *current() const;
+
+  /**
+   * Bumps whenever the report or status changes
+   */
+  uint32_t generation() const { return _generation; }
+  Status status() const { return _status; }
+  int httpCode() const { return _httpCode; }
+
+  /**
+   * "Clear", "Clouds", "Rain"... for a condition id
+   */
+  static const char *condition(uint16_t code);
+
+  /**
+   * "C", "F" or "K" for the report's units
+   */
+  const char *tempUnit() const;
+
+private:
+  enum State : uint8_t { IDLE_TASK, RUNNING, DONE };
+
+  struct Job {
+    char url[256];
+    char ssid[33];
+    char password[65];
+    char etag[48];
+    char lastModified[40];
+  };
+
+  TaskHandle_t _task;
+  std::atomic<uint8_t> _state;
+  Job _job;            // Written by the loop task before RUNNING
+  Report _fetched;     // Written by the worker while RUNNING
+  Status _outcome;     // Of the finished fetch
+  int _outcomeCode;    // HTTP status of the finished fetch
+  Report _report;      // Loop task only
+  Status _status;
+  int _httpCode;
+  uint32_t _generation;
+  bool _forced;
+  uint32_t _lastCheck;   // millis()
+  uint32_t _lastAttempt; // millis(), 0: never
+  uint32_t _retryMs;     // Back-off after a failure, 0 after a success
+
+  bool configured() const;
+  bool matchesConfig() const;
+  bool due() const;
+  void start();
+  void adopt();
+  static void taskEntry(void *arg);
+  void fetch();
+  bool parse(Stream &body);
+};
+
+extern WeatherService *weather;
+
+#endif // WEATHER_H
@@ -0,0 +1,124 @@
+/**
+ * WiFi Link Implementation
+ */
+
+#include "wifi_link.h"
+#include "../hardware/energy_model.h"
+#include "../utils/log.h"
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+
+WifiLink &WifiLink::instance() {
+  static WifiLink link;
+  return link;
+}
+
+WifiLink::WifiLink()
+    : _lock(xSemaphoreCreateMutex()), _users(0), _held(false), _upSince(0),
+      _radioMs(0) {}
+
+bool WifiLink::acquire(const char *ssid, const char *password,
+                       uint32_t timeoutMs) {
+  if (!ssid || !ssid[0])
+    return false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_users > 0 && WiFi.status() == WL_CONNECTED) {
+    _users++;
+    xSemaphoreGive(_lock);
+    return true;
+  }
+  if (_users > 0) {
+    // Dropped under another holder: theirs fails on its own
+    xSemaphoreGive(_lock);
+    return false;
+  }
+
+  if (heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) <
+      MIN_INTERNAL_HEAP) {
+    LOG_W("WiFi", "Not enough internal RAM to bring WiFi up");
+    xSemaphoreGive(_lock);
+    return false;
+  }
+
+  uint32_t start = millis();
+  if (!_held)
+    _upSince = start;
+  WiFi.persistent(false); // The credentials live in the config, not NVS
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(true); // Modem sleep: required alongside BLE
+  EnergyModel::set(EnergyModel::State::WIFI_RADIO);
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs)
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+  bool ok = WiFi.status() == WL_CONNECTED;
+  if (ok) {
+    _users = 1;
+    EnergyModel::set(EnergyModel::State::WIFI_JOINED);
+    LOG_I("WiFi", "Joined %s in %lu ms (RSSI %d)", ssid, millis() - start,
+          WiFi.RSSI());
+  } else {
+    LOG_W("WiFi", "%s not joined within %lu ms", ssid,
+          (unsigned long)timeoutMs);
+    radioOff();
+  }
+  xSemaphoreGive(_lock);
+  return ok;
+}
+
+void WifiLink::release() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_users > 0 && --_users == 0)
+    radioOff();
+  xSemaphoreGive(_lock);
+}
+
+bool WifiLink::holdRadio() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  bool ok = true;
+  if (!_held && _users == 0) {
+    ok = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) >=
+         MIN_INTERNAL_HEAP;
+    if (ok) {
+      _upSince = millis();
+      WiFi.persistent(false);
+      WiFi.mode(WIFI_STA);
+      WiFi.setSleep(true);
+      EnergyModel::set(EnergyModel::State::WIFI_RADIO);
+    } else {
+      LOG_W("WiFi", "Not enough internal RAM to bring the radio up");
+    }
+  }
+  _held = ok;
+  xSemaphoreGive(_lock);
+  return ok;
+}
+
+void WifiLink::releaseRadio() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_held) {
+    _held = false;
+    if (_users == 0)
+      radioOff();
+  }
+  xSemaphoreGive(_lock);
+}
+
+void WifiLink::radioOff() {
+  if (_held) {
+    WiFi.disconnect(false); // Leave the network, keep the radio
+    EnergyModel::set(EnergyModel::State::WIFI_RADIO);
+    return;
+  }
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  EnergyModel::set(EnergyModel::State::WIFI_OFF);
+  uint32_t session = millis() - _upSince;
+  _radioMs += session;
+  LOG_D("WiFi", "Off after %lu ms (%lu ms since boot)", (unsigned long)session,
+        (unsigned long)_radioMs);
+}
+
+uint32_t WifiLink::radioMs() const {
+  return _radioMs + (_users > 0 || _held ? millis() - _upSince : 0);
+}
@@ -0,0 +1,71 @@
+/**
+ * WiFi Link
+ *
+ * Station-mode WiFi on demand for the network features. The radio is off
+ * unless a feature holds the link: acquire() joins the configured network
+ * (blocking, from the feature's own task) and release() switches WiFi off
+ * again once the last holder lets go, so it never idles between bursts.
+ * Modem sleep stays on while connected: the ESP32-S3 has one radio for
+ * WiFi and the NimBLE link, and the coexistence scheduler needs it.
+ *
+ * The panel mesh needs the radio without a network: holdRadio() keeps
+ * station mode up, unjoined, and the last release() then only leaves the
+ * network.
+ *
+ * Radio-on time is summed for the diagnostics.
+ */
+
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+class WifiLink {
+public:
+  static const uint32_t CONNECT_TIMEOUT_MS = 8000;
+  static const size_t MIN_INTERNAL_HEAP = 48 * 1024; // WiFi and TLS buffers
+
+  static WifiLink &instance();
+
+  /**
+   * Join ssid, or share the link if it is up already. Call from a worker
+   * task, never the loop task.
+   * @return false without credentials, internal RAM or a connection
+   *         within timeoutMs; only a true return is release()d
+   */
+  bool acquire(const char *ssid, const char *password,
+               uint32_t timeoutMs = CONNECT_TIMEOUT_MS);
+
+  /**
+   * Let go of the link; the last holder switches WiFi off
+   */
+  void release();
+
+  bool isUp() const { return _users > 0; }
+
+  /**
+   * Keep the radio on in station mode without joining a network (ESP-NOW)
+   * @return false without the internal RAM for WiFi
+   */
+  bool holdRadio();
+  void releaseRadio();
+
+  /**
+   * Time WiFi has been on since boot, the current session included
+   */
+  uint32_t radioMs() const;
+
+private:
+  SemaphoreHandle_t _lock;
+  volatile int _users;
+  bool _held; // holdRadio()
+  uint32_t _upSince;
+  uint32_t _radioMs; // Finished sessions
+
+  WifiLink();
+  void radioOff();
+};
+
+#endif // WIFI_LINK_H
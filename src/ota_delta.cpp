@@ -0,0 +1,140 @@
+/**
+ * OTA Delta Implementation
+ */
+
+#include "ota_delta.h"
+
+static const uint8_t OP_END = 0x00;
+static const uint8_t OP_COPY = 0x01;
+static const uint8_t OP_DATA = 0x02;
+
+static uint32_t getLE32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+OtaDelta::OtaDelta(Source source, Sink sink, Check check)
+    : _source(source), _sink(sink), _check(check), _state(State::HEADER),
+      _error(nullptr), _header(), _headLen(0), _op(0), _argIndex(0),
+      _argCount(0), _shift(0), _remaining(0), _written(0) {
+  _args[0] = _args[1] = 0;
+}
+
+bool OtaDelta::fail(const char *error) {
+  if (_state != State::FAILED)
+    _error = error;
+  _state = State::FAILED;
+  return false;
+}
+
+bool OtaDelta::parseHeader() {
+  if (memcmp(_head, "M5DL", 4) != 0 || _head[4] != VERSION)
+    return fail("not a delta");
+  _header.baseSize = getLE32(_head + 8);
+  memcpy(_header.baseSha, _head + 12, sizeof(_header.baseSha));
+  _header.targetSize = getLE32(_head + 44);
+  if (_check && !_check(_header))
+    return fail("wrong base");
+  _state = State::OP;
+  return true;
+}
+
+bool OtaDelta::put(const uint8_t *data, size_t len) {
+  if (_written + len > _header.targetSize)
+    return fail("too long");
+  if (!_sink(data, len))
+    return fail("write");
+  _written += len;
+  return true;
+}
+
+bool OtaDelta::run() {
+  if (_op == OP_COPY) {
+    uint32_t offset = _args[0];
+    uint32_t length = _args[1];
+    if (offset > _header.baseSize || length > _header.baseSize - offset)
+      return fail("copy range");
+    while (length) {
+      size_t n = length < COPY_BLOCK ? length : COPY_BLOCK;
+      if (!_source(offset, _block, n))
+        return fail("read");
+      if (!put(_block, n))
+        return false;
+      offset += n;
+      length -= n;
+    }
+    _state = State::OP;
+    return true;
+  }
+  // DATA: its bytes follow
+  _remaining = _args[0];
+  _state = _remaining ? State::DATA : State::OP;
+  return true;
+}
+
+bool OtaDelta::feed(const uint8_t *data, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    switch (_state) {
+    case State::HEADER: {
+      size_t n = HEADER_SIZE - _headLen;
+      if (n > len - i)
+        n = len - i;
+      memcpy(_head + _headLen, data + i, n);
+      _headLen += n;
+      i += n;
+      if (_headLen == HEADER_SIZE && !parseHeader())
+        return false;
+      break;
+    }
+
+    case State::OP:
+      _op = data[i++];
+      if (_op == OP_END) {
+        if (_written != _header.targetSize)
+          return fail("too short");
+        _state = State::DONE;
+        break;
+      }
+      if (_op != OP_COPY && _op != OP_DATA)
+        return fail("bad op");
+      _argCount = _op == OP_COPY ? 2 : 1;
+      _argIndex = 0;
+      _args[0] = _args[1] = 0;
+      _shift = 0;
+      _state = State::VARINT;
+      break;
+
+    case State::VARINT: {
+      uint8_t b = data[i++];
+      if (_shift > 28)
+        return fail("bad varint");
+      _args[_argIndex] |= (uint32_t)(b & 0x7F) << _shift;
+      _shift += 7;
+      if (b & 0x80)
+        break;
+      _shift = 0;
+      if (++_argIndex == _argCount && !run())
+        return false;
+      break;
+    }
+
+    case State::DATA: {
+      size_t n = _remaining < len - i ? _remaining : len - i;
+      if (!put(data + i, n))
+        return false;
+      i += n;
+      _remaining -= n;
+      if (!_remaining)
+        _state = State::OP;
+      break;
+    }
+
+    case State::DONE:
+      return fail("data after end");
+
+    case State::FAILED:
+      return false;
+    }
+  }
+  return _state != State::FAILED;
+}
@@ -0,0 +1,90 @@
+/**
+ * OTA Delta
+ *
+ * Rebuilds a new firmware image from the one that is running and a delta
+ * made on a PC (tools/make_delta.py), so a small change sends a small
+ * file. The delta is consumed as it arrives, in pieces of any size, and
+ * the rebuilt image is handed on in order; nothing is buffered beyond one
+ * copy block.
+ *
+ * Layout (integers little-endian, varints LEB128):
+ *
+ *   "M5DL" u8 version(1) u8[3] 0
+ *   u32 base size, u8[32] SHA-256 of the base image
+ *   u32 target size
+ *   ops until END:
+ *     0x00 END
+ *     0x01 COPY   varint offset, varint length   bytes of the base
+ *     0x02 DATA   varint length, then the bytes  new bytes
+ *
+ * The base is named by its hash, so a delta is refused by any unit not
+ * running exactly that build. The rebuilt image is checked by the caller
+ * (esp_ota_end() verifies its own checksum and hash).
+ */
+
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <Arduino.h>
+#include <functional>
+
+class OtaDelta {
+public:
+  static const uint8_t VERSION = 1;
+  static const size_t HEADER_SIZE = 48;
+  static const size_t COPY_BLOCK = 512;
+
+  struct Header {
+    uint32_t baseSize;
+    uint8_t baseSha[32];
+    uint32_t targetSize;
+  };
+
+  // Read len bytes of the base at offset
+  using Source =
+      std::function<bool(uint32_t offset, uint8_t *out, size_t len)>;
+  // Take the next bytes of the target
+  using Sink = std::function<bool(const uint8_t *data, size_t len)>;
+  // Accept the header (is this our base?) before any op runs
+  using Check = std::function<bool(const Header &header)>;
+
+  OtaDelta(Source source, Sink sink, Check check);
+
+  /**
+   * Consume the next bytes of the delta
+   * @return false once the delta is bad or the source or sink failed
+   */
+  bool feed(const uint8_t *data, size_t len);
+
+  bool isDone() const { return _state == State::DONE; }
+  const char *error() const { return _error; }
+  const Header &header() const { return _header; }
+  uint32_t written() const { return _written; }
+
+private:
+  enum class State : uint8_t { HEADER, OP, VARINT, DATA, DONE, FAILED };
+
+  Source _source;
+  Sink _sink;
+  Check _check;
+  State _state;
+  const char *_error;
+  Header _header;
+  uint8_t _head[HEADER_SIZE];
+  size_t _headLen;
+  uint8_t _op;
+  uint32_t _args[2];
+  int _argIndex;
+  int _argCount;
+  int _shift;
+  uint32_t _remaining; // DATA bytes still to come
+  uint32_t _written;
+  uint8_t _block[COPY_BLOCK];
+
+  bool fail(const char *error);
+  bool parseHeader();
+  bool run(); // The op whose arguments are complete
+  bool put(const uint8_t *data, size_t len);
+};
+
+#endif // OTA_DELTA_H
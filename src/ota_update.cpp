@@ -0,0 +1,215 @@
+/**
+ * OTA Update Implementation
+ */
+
+#include "ota_update.h"
+#include "utils/config.h"
+#include "utils/log.h"
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+
+extern Config *config;
+
+// Arduino's startup marks the running image good unless this says the
+// application will (see OtaUpdate::update())
+extern "C" bool verifyRollbackLater() { return true; }
+
+OtaUpdate::OtaUpdate()
+    : _running(esp_ota_get_running_partition()), _target(nullptr),
+      _handle(0), _delta(nullptr), _kind(Kind::IMAGE), _size(0),
+      _received(0), _written(0), _lastData(0), _restartAt(0),
+      _confirmed(false), _error(nullptr) {}
+
+OtaUpdate::~OtaUpdate() { abort("shutdown"); }
+
+bool OtaUpdate::authorized(const char *token) {
+  if (!config || !config->getOtaEnabled() || !token)
+    return false;
+  String expected = config->getOtaToken();
+  if (expected.length() == 0 || strlen(token) != expected.length())
+    return false;
+  // Every byte, so the time taken says nothing about where they differ
+  uint8_t diff = 0;
+  for (size_t i = 0; i < expected.length(); i++)
+    diff |= token[i] ^ expected[i];
+  return diff == 0;
+}
+
+bool OtaUpdate::parseKind(const char *name, Kind &kind) {
+  if (!name || strcasecmp(name, "image") == 0)
+    kind = Kind::IMAGE;
+  else if (strcasecmp(name, "delta") == 0)
+    kind = Kind::DELTA;
+  else
+    return false;
+  return true;
+}
+
+bool OtaUpdate::fail(const char *error) {
+  abort(error);
+  return false;
+}
+
+bool OtaUpdate::begin(uint32_t size, Kind kind, const char *from) {
+  if (isActive() || _restartAt) {
+    _error = "busy";
+    return false;
+  }
+  _error = nullptr;
+  _target = esp_ota_get_next_update_partition(nullptr);
+  if (!_target) {
+    _error = "no OTA slot";
+    return false;
+  }
+  if (kind == Kind::IMAGE && size > _target->size) {
+    _error = "too large";
+    return false;
+  }
+  // Sectors are erased as the writes reach them, not all up front
+  esp_err_t err =
+      esp_ota_begin(_target, OTA_WITH_SEQUENTIAL_WRITES, &_handle);
+  if (err != ESP_OK) {
+    LOG_E("OTA", "Cannot open %s: %s", _target->label, esp_err_to_name(err));
+    _handle = 0;
+    _error = "slot";
+    return false;
+  }
+
+  _kind = kind;
+  _size = size;
+  _received = 0;
+  _written = 0;
+  _lastData = millis();
+  if (kind == Kind::DELTA) {
+    _delta = new OtaDelta(
+        [this](uint32_t offset, uint8_t *out, size_t len) {
+          return esp_partition_read(_running, offset, out, len) == ESP_OK;
+        },
+        [this](const uint8_t *data, size_t len) {
+          return writeSlot(data, len);
+        },
+        [this](const OtaDelta::Header &header) {
+          return baseMatches(header);
+        });
+  }
+  LOG_I("OTA", "Receiving %u byte %s over %s into %s", (unsigned)size,
+        kind == Kind::DELTA ? "delta" : "image", from, _target->label);
+  return true;
+}
+
+// The running slot holds the base the delta was made against: its first
+// baseSize bytes hash the same
+bool OtaUpdate::baseMatches(const OtaDelta::Header &header) {
+  if (header.baseSize > _running->size ||
+      header.targetSize > _target->size)
+    return false;
+  static const size_t BLOCK = 1024;
+  uint8_t *block = (uint8_t *)malloc(BLOCK);
+  if (!block)
+    return false;
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  bool ok = true;
+  for (uint32_t at = 0; ok && at < header.baseSize; at += BLOCK) {
+    size_t n = header.baseSize - at < BLOCK ? header.baseSize - at : BLOCK;
+    ok = esp_partition_read(_running, at, block, n) == ESP_OK;
+    if (ok)
+      mbedtls_sha256_update(&ctx, block, n);
+  }
+  uint8_t sha[32];
+  mbedtls_sha256_finish(&ctx, sha);
+  mbedtls_sha256_free(&ctx);
+  free(block);
+  if (ok && memcmp(sha, header.baseSha, sizeof(sha)) != 0) {
+    LOG_W("OTA", "Delta was made against another build");
+    ok = false;
+  }
+  return ok;
+}
+
+bool OtaUpdate::writeSlot(const uint8_t *data, size_t len) {
+  if (esp_ota_write(_handle, data, len) != ESP_OK)
+    return false;
+  _written += len;
+  return true;
+}
+
+bool OtaUpdate::write(const uint8_t *data, size_t len) {
+  if (!isActive())
+    return false;
+  if (_received + len > _size)
+    return fail("too long");
+  _received += len;
+  _lastData = millis();
+  if (_delta) {
+    if (!_delta->feed(data, len))
+      return fail(_delta->error());
+  } else if (!writeSlot(data, len)) {
+    return fail("write");
+  }
+  return true;
+}
+
+bool OtaUpdate::finish() {
+  if (!isActive())
+    return false;
+  if (_received != _size)
+    return fail("incomplete");
+  if (_delta && !_delta->isDone())
+    return fail("delta incomplete");
+
+  // esp_ota_end() checks the image's header, checksum and hash
+  esp_err_t err = esp_ota_end(_handle);
+  _handle = 0;
+  delete _delta;
+  _delta = nullptr;
+  if (err != ESP_OK) {
+    LOG_E("OTA", "Image rejected: %s", esp_err_to_name(err));
+    _error = "invalid image";
+    return false;
+  }
+  err = esp_ota_set_boot_partition(_target);
+  if (err != ESP_OK) {
+    LOG_E("OTA", "Cannot boot %s: %s", _target->label, esp_err_to_name(err));
+    _error = "boot";
+    return false;
+  }
+  LOG_I("OTA", "%u bytes written to %s, restarting", (unsigned)_written,
+        _target->label);
+  _restartAt = millis() + RESTART_MS;
+  if (!_restartAt)
+    _restartAt = 1;
+  return true;
+}
+
+void OtaUpdate::abort(const char *reason) {
+  if (!isActive())
+    return;
+  esp_ota_abort(_handle);
+  _handle = 0;
+  delete _delta;
+  _delta = nullptr;
+  _error = reason;
+  LOG_W("OTA", "Transfer abandoned at %u/%u: %s", (unsigned)_received,
+        (unsigned)_size, reason ? reason : "?");
+}
+
+void OtaUpdate::update() {
+  if (isActive() && millis() - _lastData > STALL_MS)
+    abort("stalled");
+
+  if (!_confirmed && millis() > CONFIRM_MS) {
+    _confirmed = true;
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(_running, &state) == ESP_OK &&
+        state == ESP_OTA_IMG_PENDING_VERIFY) {
+      esp_ota_mark_app_valid_cancel_rollback();
+      LOG_I("OTA", "Image in %s confirmed", _running->label);
+    }
+  }
+}
+
+bool OtaUpdate::restartDue() const {
+  return _restartAt && (long)(millis() - _restartAt) >= 0;
+}
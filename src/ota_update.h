@@ -0,0 +1,106 @@
+/**
+ * OTA Update
+ *
+ * Writes new firmware into the app slot that is not running (partitions.csv
+ * has two, ota_0 and ota_1) while the current one keeps working, then
+ * boots it. The bytes come from a transport (POST /api/ota on the LAN API,
+ * the BLE OTA service) as either:
+ *
+ *   IMAGE  a firmware.bin as built
+ *   DELTA  a delta against the running image (see ota_delta.h), rebuilt
+ *          into the slot as it arrives; the base is read straight from
+ *          the running slot
+ *
+ * Rollback: a new image boots unconfirmed. Once it has run CONFIRM_MS it
+ * is marked good; if it resets or crashes before that, the bootloader goes
+ * back to the previous slot on the next boot (when it is built with
+ * CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE; otherwise the new image stays).
+ *
+ * Settings (the "ota" section): enabled (default false) and token, which
+ * every transfer must present. One transfer at a time. Main loop task only.
+ */
+
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include "ota_delta.h"
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+
+class OtaUpdate {
+public:
+  enum class Kind : uint8_t { IMAGE, DELTA };
+  static const uint32_t CONFIRM_MS = 60 * 1000;  // Run this long: keep it
+  static const uint32_t RESTART_MS = 2000;       // Reply before rebooting
+  static const uint32_t STALL_MS = 20 * 1000;    // No bytes: give up
+
+  OtaUpdate();
+  ~OtaUpdate();
+
+  /**
+   * OTA is enabled and token is the configured one
+   */
+  static bool authorized(const char *token);
+
+  // "image" or "delta" (any case)
+  static bool parseKind(const char *name, Kind &kind);
+
+  /**
+   * Start a transfer of size bytes (the image, or the delta)
+   * @param from Transport name, for the log
+   * @return false if one is already running or the slot cannot be opened
+   */
+  bool begin(uint32_t size, Kind kind, const char *from);
+
+  /**
+   * Take the next bytes of the transfer, in order
+   * @return false once the transfer has failed (see error())
+   */
+  bool write(const uint8_t *data, size_t len);
+
+  /**
+   * All bytes are in: check the image and boot it after RESTART_MS
+   */
+  bool finish();
+
+  void abort(const char *reason);
+
+  /**
+   * Confirm this image once it has proved itself, give up on a transfer
+   * whose bytes have stopped
+   */
+  void update();
+
+  /**
+   * finish() succeeded and the reply has had time to go out: the caller
+   * saves what it must and restarts
+   */
+  bool restartDue() const;
+
+  bool isActive() const { return _handle != 0; }
+  uint32_t received() const { return _received; }
+  uint32_t size() const { return _size; }
+  const char *error() const { return _error; }
+
+private:
+  const esp_partition_t *_running;
+  const esp_partition_t *_target;
+  esp_ota_handle_t _handle;
+  OtaDelta *_delta;
+  Kind _kind;
+  uint32_t _size;
+  uint32_t _received;
+  uint32_t _written; // To the slot
+  uint32_t _lastData; // millis()
+  uint32_t _restartAt; // 0 = none
+  bool _confirmed;
+  const char *_error;
+
+  bool fail(const char *error);
+  bool baseMatches(const OtaDelta::Header &header);
+  bool writeSlot(const uint8_t *data, size_t len);
+};
+
+extern OtaUpdate *ota;
+
+#endif // OTA_UPDATE_H
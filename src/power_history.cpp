@@ -1,18 +1,106 @@
 #include "power_history.h"
+#include "history_archive.h"
+#include "history_tail.h"
+#include "utils/crc16.h"
+#include "utils/flash_store.h"
+#include "utils/mem_telemetry.h"
 #include "utils/sd_manager.h" // Include SDManager
+#include "utils/storage_worker.h"
 #include <Arduino.h>
 #include <M5Unified.h>
 #include <SD.h>
+#include <esp_heap_caps.h>
 #include <time.h>
 
 // Global SDManager instance
 extern SDManager *sdManager;
+extern StorageWorker *storage;
+
+// Version 1 records (day files and journals from older builds), widened
+// to PowerSample as they are read
+struct __attribute__((packed)) PowerSampleV1 {
+  uint32_t timestamp;
+  uint8_t batteryPct;
+  uint16_t inputW;
+  uint16_t outputW;
+};
+
+struct __attribute__((packed)) JournalRecordV1 {
+  uint32_t date;
+  uint16_t slot;
+  PowerSampleV1 sample;
+  uint16_t crc;
+};
+
+static PowerSample widen(const PowerSampleV1 &v1) {
+  return PowerSample{v1.timestamp, v1.batteryPct, v1.inputW, v1.outputW,
+                     0, 0, 0};
+}
+
+static uint32_t dateKey(time_t t) {
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  return (timeinfo.tm_year + 1900) * 10000 + (timeinfo.tm_mon + 1) * 100 +
+         timeinfo.tm_mday;
+}
 
 PowerHistory::PowerHistory()
-    : _currentDayIndex(0), _currentSampleIndex(0), _lastFlushTime(0),
-      _lastFlushedSample(0) {
-  // Initialize buffer to zero
-  memset(_historyData, 0, sizeof(_historyData));
+    : _page(nullptr), _pageDay(-1), _currentDayIndex(0),
+      _currentSampleIndex(0), _dayNumber(0), _revision(0),
+      _pendingDays(0), _wantedDays(0), _loadingDay(-1), _loadAll(false),
+      _compacting(false), _compactedDay(0),
+      _journalOpen(false), _journalGen(0), _journalGap(false),
+      _lastCheckpoint(0), _lastEnergyTime(0), _lastInW(0), _lastOutW(0),
+      _lastFlushTime(0), _flushMins(FLUSH_INTERVAL_MINS),
+      _lastFlushedSample(0), _tailStream(0), _tailOn(true) {
+  setDirectory("/history");
+  memset(&_energy, 0, sizeof(_energy));
+  memset(_present, 0, sizeof(_present));
+
+  // Touched once a minute: keep it out of internal SRAM (zeroed)
+  _historyData = (DayBuffer *)heap_caps_calloc(HISTORY_DAYS, sizeof(DayBuffer),
+                                               MALLOC_CAP_SPIRAM);
+  if (!_historyData) {
+    Serial.println("[PowerHistory] No PSRAM, using internal RAM");
+    _historyData = (DayBuffer *)calloc(HISTORY_DAYS, sizeof(DayBuffer));
+  }
+  if (_historyData)
+    MemTelemetry::track(MemTelemetry::Tag::HISTORY,
+                        HISTORY_DAYS * sizeof(DayBuffer));
+}
+
+PowerHistory::~PowerHistory() {
+  free(_historyData);
+  free(_page);
+}
+
+const PowerSample *PowerHistory::page(uint8_t dayIndex) {
+  if (!_page) {
+    _page = (PowerSample *)heap_caps_malloc(
+        sizeof(DayBuffer), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!_page)
+      return _historyData[dayIndex]; // Read straight from PSRAM
+    MemTelemetry::track(MemTelemetry::Tag::HISTORY, sizeof(DayBuffer));
+    _pageDay = -1;
+  }
+  if (_pageDay != dayIndex) {
+    memcpy(_page, _historyData[dayIndex], sizeof(DayBuffer));
+    _pageDay = dayIndex;
+  }
+  return _page;
+}
+
+void PowerHistory::releaseView() {
+  if (_page)
+    MemTelemetry::track(MemTelemetry::Tag::HISTORY, -(long)sizeof(DayBuffer));
+  free(_page);
+  _page = nullptr;
+  _pageDay = -1;
+}
+
+void PowerHistory::setDirectory(const char *dir) {
+  strlcpy(_dir, dir, sizeof(_dir));
+  _tailStream = HistoryTail::streamOf(_dir);
 }
 
 void PowerHistory::init() {
@@ -25,6 +113,7 @@ void PowerHistory::init() {
 
   // Calculate which day of week (0-6)
   _currentDayIndex = timeinfo.tm_wday;
+  _dayNumber = now / 86400;
 
   // Calculate minute of day (0-1439)
   _currentSampleIndex = timeinfo.tm_hour * 60 + timeinfo.tm_min;
@@ -32,80 +121,371 @@ void PowerHistory::init() {
   Serial.printf("[PowerHistory] Day index: %d, Sample index: %d\n",
                 _currentDayIndex, _currentSampleIndex);
 
-  // Try to load existing history from SD card
+  // Try to load today from SD card, then anything only the journal or
+  // the RTC tail has (reset since the last flush); older days follow later
   loadFromSD();
+  replayJournal();
+  loadRollup();
+  loadEnergy();
+  char path[48];
+  snprintf(path, sizeof(path), "%s/solar.bin", _dir);
+  _solar.loadFromSD(path);
+  snprintf(path, sizeof(path), "%s/load.bin", _dir);
+  _load.loadFromSD(path);
+}
+
+void PowerHistory::accumulateEnergy(uint32_t now, uint16_t inW,
+                                    uint16_t outW) {
+  uint32_t today = dateKey(now);
+  if (_energy.date != today) {
+    _energy.date = today;
+    _energy.todayInWh = 0.0f;
+    _energy.todayOutWh = 0.0f;
+  }
+
+  // Area under the line between this sample and the previous one; a
+  // long gap (device off, clock jump) starts a new baseline instead
+  uint32_t dt = now - _lastEnergyTime;
+  if (_lastEnergyTime != 0 && now > _lastEnergyTime &&
+      dt <= FLUSH_INTERVAL_MINS * 60) {
+    float inWh = (_lastInW + inW) * 0.5f * dt / 3600.0f;
+    float outWh = (_lastOutW + outW) * 0.5f * dt / 3600.0f;
+    _energy.todayInWh += inWh;
+    _energy.todayOutWh += outWh;
+    _energy.lifetimeInWh += inWh;
+    _energy.lifetimeOutWh += outWh;
+  }
+  _lastEnergyTime = now;
+  _lastInW = inW;
+  _lastOutW = outW;
+}
+
+void PowerHistory::loadEnergy() {
+  char path[48];
+  snprintf(path, sizeof(path), "%s/energy.bin", _dir);
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return;
+  EnergyTotals saved;
+  if (file.read((uint8_t *)&saved, sizeof(saved)) == sizeof(saved))
+    _energy = saved;
+  file.close();
+
+  // Lifetime carries over; "today" only if it is still the same day
+  if (_energy.date != dateKey(time(nullptr))) {
+    _energy.todayInWh = 0.0f;
+    _energy.todayOutWh = 0.0f;
+  }
+  Serial.printf("[PowerHistory] Energy today %.0f/%.0f Wh, lifetime "
+                "%.1f/%.1f kWh (in/out)\n",
+                _energy.todayInWh, _energy.todayOutWh,
+                _energy.lifetimeInWh / 1000.0, _energy.lifetimeOutWh / 1000.0);
+}
+
+bool PowerHistory::saveEnergy() {
+  char path[48];
+  snprintf(path, sizeof(path), "%s/energy.bin", _dir);
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file)
+    return false;
+  bool ok = file.write((const uint8_t *)&_energy, sizeof(_energy)) ==
+            sizeof(_energy);
+  file.close();
+  return ok;
+}
+
+bool PowerHistory::saveSolar() {
+  if (!_solar.isDirty())
+    return true;
+  char path[48];
+  snprintf(path, sizeof(path), "%s/solar.bin", _dir);
+  return _solar.saveToSD(path);
+}
+
+void PowerHistory::loadRollup() {
+  char path[48];
+  snprintf(path, sizeof(path), "%s/rollup.bin", _dir);
+  if (_rollup.loadFromSD(path))
+    return;
+
+  // First boot with rollups: seed them from the raw days, oldest first
+  // (read now, the seed needs them all)
+  for (int dayOffset = HISTORY_DAYS - 1; dayOffset >= 0; dayOffset--) {
+    ensureDay(dayOffset);
+    uint8_t dayIndex = dayIndexFor(dayOffset);
+    for (uint16_t i = 0; i < SAMPLES_PER_DAY; i++) {
+      const PowerSample &s = _historyData[dayIndex][i];
+      if (s.timestamp > 0)
+        _rollup.add(s.timestamp, s.batteryPct, s.inputW, s.outputW);
+    }
+  }
+}
+
+uint16_t PowerHistory::getDayPeakW(uint8_t dayOffset) const {
+  const RollupTier &tier = _rollup.tier(HistoryRollup::QUARTER_HOUR);
+  uint32_t dayStart = (_dayNumber - dayOffset) * 86400UL;
+
+  uint16_t peak = 0;
+  for (uint32_t t = dayStart; t < dayStart + 86400; t += tier.span()) {
+    const RollupBucket *b = tier.find(t);
+    if (!b)
+      continue;
+    if (b->maxInW > peak)
+      peak = b->maxInW;
+    if (b->maxOutW > peak)
+      peak = b->maxOutW;
+  }
+  return peak;
 }
 
 void PowerHistory::addSample(uint8_t batteryPct, uint16_t inputW,
                              uint16_t outputW) {
-  time_t now = time(nullptr);
+  addSampleAt(time(nullptr), batteryPct, inputW, outputW);
+}
+
+void PowerHistory::addSampleAt(time_t now, uint8_t batteryPct, uint16_t inputW,
+                               uint16_t outputW) {
+  addSampleAt(
+      PowerSample{(uint32_t)now, batteryPct, inputW, outputW, 0, 0, 0});
+}
+
+// Into the sample's fields, rounded and clamped rather than cast
+static uint8_t pct(Fixed::Permille pm) {
+  return constrain(Fixed::percent(pm), 0, 100);
+}
+static uint16_t watts(Fixed::Deciwatts dw) {
+  return constrain(Fixed::watts(dw), 0, 65535);
+}
+static uint16_t centivolts(Fixed::Centivolts cv) {
+  return constrain(cv, 0, 65535);
+}
 
-  // Store sample in current day/minute slot
-  PowerSample &sample = _historyData[_currentDayIndex][_currentSampleIndex];
-  sample.timestamp = now;
-  sample.batteryPct = batteryPct;
-  sample.inputW = inputW;
-  sample.outputW = outputW;
+PowerSample PowerHistory::sampleOf(time_t when,
+                                   const Fossibot::PowerBankData &data) {
+  uint8_t outlets = PowerSample::DETAIL;
+  if (data.usbActive)
+    outlets |= PowerSample::USB_ON;
+  if (data.dcActive)
+    outlets |= PowerSample::DC_ON;
+  if (data.acActive)
+    outlets |= PowerSample::AC_ON;
+  return PowerSample{(uint32_t)when, pct(data.socPermille),
+                     watts(data.inputDeciwatts), watts(data.outputDeciwatts),
+                     watts(data.dcInputDeciwatts),
+                     centivolts(data.batteryCentivolts), outlets};
+}
 
-  // Advance to next minute
-  _currentSampleIndex++;
+PowerSample PowerHistory::sampleOf(const TelemetryFilter::Minute &minute) {
+  uint8_t outlets = PowerSample::DETAIL;
+  if (minute.usbActive)
+    outlets |= PowerSample::USB_ON;
+  if (minute.dcActive)
+    outlets |= PowerSample::DC_ON;
+  if (minute.acActive)
+    outlets |= PowerSample::AC_ON;
+  return PowerSample{minute.start, pct(minute.socPermille),
+                     watts(minute.meanIn()), watts(minute.meanOut()),
+                     watts(minute.meanDcIn()), centivolts(minute.centivolts),
+                     outlets};
+}
 
-  // Check if we've rolled over to a new day
-  if (_currentSampleIndex >= SAMPLES_PER_DAY) {
+void PowerHistory::addSampleAt(const PowerSample &in) {
+  // The wall clock picks the day and slot, so sleep, stalls and reboots
+  // leave gaps instead of shifting later samples
+  time_t now = in.timestamp;
+  uint32_t dayNumber = now / 86400;
+  if (dayNumber < _dayNumber) {
+    Serial.println("[PowerHistory] Clock went back a day, sample dropped");
+    return;
+  }
+  for (int i = 0; dayNumber > _dayNumber && i < HISTORY_DAYS; i++)
     advanceToNextDay();
+  _dayNumber = dayNumber; // Gaps longer than the ring skip ahead
+  uint16_t slot = (now % 86400) / 60;
+
+  // Store sample in its minute slot
+  PowerSample &sample = _historyData[_currentDayIndex][slot];
+  sample = in;
+  markPresent(_currentDayIndex, slot);
+  _revision++;
+  if (_page && _pageDay == _currentDayIndex)
+    _page[slot] = sample; // Keep the viewed copy current
+  _rollup.add(now, in.batteryPct, in.inputW, in.outputW);
+  accumulateEnergy(now, in.inputW, in.outputW);
+  _solar.add(in);
+  _load.add(in);
+  journalSample(slot, sample);
+  if (_tailOn)
+    HistoryTail::add(_tailStream, sample);
+
+  if (slot >= _currentSampleIndex)
+    _currentSampleIndex = slot + 1;
+}
+
+void PowerHistory::rebuildPresence(uint8_t dayIndex) {
+  memset(_present[dayIndex], 0, sizeof(_present[dayIndex]));
+  for (uint16_t i = 0; i < SAMPLES_PER_DAY; i++) {
+    if (_historyData[dayIndex][i].timestamp > 0)
+      markPresent(dayIndex, i);
+  }
+}
+
+HistoryRange::iterator HistoryRange::begin() const {
+  iterator it;
+  it._history = _history;
+  it._pos = _t0 / 60;
+  it._end = _t1 / 60 + (_t1 % 60 != 0); // Round up without overflow
+  it.advance();
+  return it;
+}
+
+HistoryRange::iterator HistoryRange::end() const {
+  iterator it;
+  it._history = nullptr;
+  return it;
+}
+
+void HistoryRange::iterator::advance() {
+  if (_history && !_history->nextSpan(_pos, _end, _span))
+    _history = nullptr;
+}
+
+bool PowerHistory::nextSpan(uint32_t &pos, uint32_t end,
+                            HistorySpan &span) const {
+  // Clamp to the minutes the ring holds
+  uint32_t first = (_dayNumber - (HISTORY_DAYS - 1)) * SAMPLES_PER_DAY;
+  uint32_t last = (_dayNumber + 1) * SAMPLES_PER_DAY;
+  if (pos < first)
+    pos = first;
+  if (end > last)
+    end = last;
+
+  while (pos < end) {
+    uint32_t day = pos / SAMPLES_PER_DAY;
+    uint32_t dayEnd = (day + 1) * SAMPLES_PER_DAY;
+    uint32_t stop = end < dayEnd ? end : dayEnd;
+    uint8_t dayIndex = dayIndexFor(_dayNumber - day);
+    const uint32_t *bits = _present[dayIndex];
+
+    // Skip empty minutes a word at a time
+    uint16_t slot = pos % SAMPLES_PER_DAY;
+    uint16_t stopSlot = stop - day * SAMPLES_PER_DAY;
+    while (slot < stopSlot) {
+      uint32_t word = bits[slot / 32] >> (slot % 32);
+      if (word) {
+        slot += __builtin_ctz(word);
+        break;
+      }
+      slot = (slot / 32 + 1) * 32;
+    }
+    if (slot >= stopSlot) {
+      pos = stop;
+      continue;
+    }
+
+    // Extend over consecutive recorded minutes
+    uint16_t runEnd = slot;
+    while (runEnd < stopSlot &&
+           (bits[runEnd / 32] & (1UL << (runEnd % 32))))
+      runEnd++;
+
+    span.start = (day * SAMPLES_PER_DAY + slot) * 60;
+    span.count = runEnd - slot;
+    span.samples = &_historyData[dayIndex][slot];
+    pos = day * SAMPLES_PER_DAY + runEnd;
+    return true;
+  }
+  return false;
+}
+
+int PowerHistory::aggregate(uint32_t t0, uint32_t t1, uint32_t bucketSecs,
+                            RollupBucket *out, int maxOut) const {
+  if (t1 <= t0 || maxOut <= 0)
+    return 0;
+  if (bucketSecs == 0)
+    bucketSecs = t1 - t0;
+  int buckets = (t1 - t0 + bucketSecs - 1) / bucketSecs;
+  if (buckets > maxOut)
+    buckets = maxOut;
+  for (int b = 0; b < buckets; b++)
+    out[b].reset(t0 + b * bucketSecs);
+
+  for (const HistorySpan &span : range(t0, t1)) {
+    for (uint16_t i = 0; i < span.count; i++) {
+      uint32_t t = span.start + i * 60;
+      if (t < t0)
+        continue; // t0 inside the first minute
+      uint32_t b = (t - t0) / bucketSecs;
+      if (b >= (uint32_t)buckets)
+        break;
+      const PowerSample &s = span.samples[i];
+      out[b].add(s.batteryPct, s.inputW, s.outputW);
+    }
   }
+  return buckets;
+}
+
+bool PowerHistory::hasSample(uint8_t dayOffset, uint16_t slot) const {
+  if (slot >= SAMPLES_PER_DAY)
+    return false;
+  return _present[dayIndexFor(dayOffset)][slot / 32] & (1UL << (slot % 32));
 }
 
 PowerSample PowerHistory::getSample(uint8_t dayOffset, uint16_t sampleIndex) {
   // dayOffset: 0 = today, 1 = yesterday, etc.
-  uint8_t dayIndex =
-      (_currentDayIndex - dayOffset + HISTORY_DAYS) % HISTORY_DAYS;
+  uint8_t dayIndex = dayIndexFor(dayOffset);
 
   if (sampleIndex >= SAMPLES_PER_DAY) {
-    return PowerSample{0, 0, 0, 0};
+    return PowerSample{};
   }
 
-  return _historyData[dayIndex][sampleIndex];
+  return page(dayIndex)[sampleIndex];
 }
 
 const PowerSample *PowerHistory::getDaySamples(uint8_t dayOffset) {
-  uint8_t dayIndex =
-      (_currentDayIndex - dayOffset + HISTORY_DAYS) % HISTORY_DAYS;
-  return _historyData[dayIndex];
+  uint8_t dayIndex = dayIndexFor(dayOffset);
+  return page(dayIndex);
 }
 
 uint16_t PowerHistory::getSampleCount(uint8_t dayOffset) {
-  // For today (dayOffset=0), return actual count
-  // For past days, return full day (1440) or count non-zero timestamps
-  if (dayOffset == 0) {
-    return _currentSampleIndex;
-  }
-
-  // For past days, count valid samples
-  uint8_t dayIndex =
-      (_currentDayIndex - dayOffset + HISTORY_DAYS) % HISTORY_DAYS;
+  const uint32_t *bits = _present[dayIndexFor(dayOffset)];
   uint16_t count = 0;
-  for (uint16_t i = 0; i < SAMPLES_PER_DAY; i++) {
-    if (_historyData[dayIndex][i].timestamp > 0) {
-      count++;
-    }
-  }
+  for (int w = 0; w < PRESENCE_WORDS; w++)
+    count += __builtin_popcount(bits[w]);
   return count;
 }
 
 bool PowerHistory::shouldFlush() {
-  // Flush every 5 minutes
   time_t now = time(nullptr);
-  return (now - _lastFlushTime) >= (FLUSH_INTERVAL_MINS * 60);
+  if (_tailOn && HistoryTail::nearlyFull() &&
+      HistoryTail::count(_tailStream) > 0)
+    return true; // Before the tail drops samples of ours
+  return (now - _lastFlushTime) >= (_flushMins * 60);
 }
 
 bool PowerHistory::flushToSD() {
-  Serial.println("[PowerHistory] Flushing to SD...");
+  // Routine flush: make the journal durable. Day files are only
+  // rewritten at checkpoints.
+  SDAccess sd(sdManager); // Waits for the panel; remounts after a failure
+  if (_journalGap || !journalReady())
+    return checkpoint(); // Journal lost: write the day file directly
+
+  _journal.flush();
+  HistoryTail::release(_tailStream);
+  saveEnergy();
+  saveSolar();
+  _lastFlushTime = time(nullptr);
 
-  // CRITICAL: Power cycle SD card before write to ensure reliability (The
-  // "Reset Trick")
+  if (_lastFlushTime - _lastCheckpoint >= CHECKPOINT_MINS * 60)
+    return checkpoint();
+  return true;
+}
+
+bool PowerHistory::recoverSD() {
+  // Only needed when a plain open/write has failed: probe, remount and
+  // power cycle as a last resort
   if (sdManager) {
-    if (!sdManager->powerCycleAndReinit()) {
+    if (!sdManager->recover()) {
       Serial.println("[PowerHistory] SD Reset Failed! Aborting flush.");
       return false;
     }
@@ -113,136 +493,615 @@ bool PowerHistory::flushToSD() {
     Serial.println("[PowerHistory] Warning: sdManager is NULL");
   }
 
-  // Create /history directory if it doesn't exist
-  if (!SD.exists("/history")) {
-    SD.mkdir("/history");
+  // Create history directory if it doesn't exist
+  if (!sdFS().exists(_dir)) {
+    sdFS().mkdir(_dir);
   }
+  return true;
+}
 
-  // Get filename for today
-  String filename = getFilenameForDay(0);
+// The journal takes a write a minute: keep it in flash when the tier is
+// mounted, so the card can stay idle between checkpoints
+fs::FS &PowerHistory::journalFS() {
+  if (flashStore && flashStore->isAvailable())
+    return flashStore->fs();
+  return sdFS();
+}
 
-  // Open file in append mode
-  File file = SD.open(filename, FILE_APPEND);
-  if (!file) {
-    Serial.printf("[PowerHistory] Failed to open %s\n", filename.c_str());
+bool PowerHistory::journalReady() {
+  bool onFlash = flashStore && flashStore->isAvailable();
+  uint32_t gen = !onFlash && sdManager ? sdManager->getMountGeneration() : 0;
+  if (_journalOpen && gen == _journalGen)
+    return true;
+  // A card switched off while idle is not woken every minute: the RTC
+  // tail keeps the samples until the flush
+  if (!onFlash && sdManager && sdManager->isAsleep())
     return false;
+
+  // Closed, failed, or the card was remounted under us: reopen
+  _journal = File();
+  _journalOpen = false;
+  if (!journalFS().exists(_dir))
+    journalFS().mkdir(_dir);
+  char path[48];
+  snprintf(path, sizeof(path), "%s/journal.bin", _dir);
+  _journal = journalFS().open(path, FILE_APPEND);
+  _journalOpen = (bool)_journal;
+  _journalGen = gen;
+  return _journalOpen;
+}
+
+void PowerHistory::journalSample(uint16_t slot, const PowerSample &sample) {
+  if (!journalReady()) {
+    _journalGap = true; // The next flush writes the day file instead
+    return;
   }
 
-  // If file is new, write CSV header
-  if (file.size() == 0) {
-    file.println("timestamp,battery,input,output");
+  JournalRecord record;
+  record.date = dateKey(sample.timestamp);
+  record.slot = slot;
+  record.sample = sample;
+  record.crc = CRC16::modbus((const uint8_t *)&record,
+                             sizeof(record) - sizeof(record.crc));
+  if (_journal.write((const uint8_t *)&record, sizeof(record)) !=
+      sizeof(record)) {
+    Serial.println("[PowerHistory] Journal write failed");
+    _journalOpen = false;
   }
+}
 
-  // Write all samples since last flush
+bool PowerHistory::checkpoint() {
+  Serial.println("[PowerHistory] Checkpoint to SD...");
   uint16_t samplesToWrite = _currentSampleIndex - _lastFlushedSample;
-  for (uint16_t i = 0; i < samplesToWrite; i++) {
-    uint16_t sampleIdx = _lastFlushedSample + i;
-    if (sampleIdx < SAMPLES_PER_DAY) {
-      const PowerSample &sample = _historyData[_currentDayIndex][sampleIdx];
-      if (sample.timestamp > 0) { // Only write valid samples
-        writeSampleToCSV(file, sample);
-      }
-    }
+
+  // Write all samples since the last checkpoint; on failure recover the
+  // card once and retry
+  if (!writeDay(0, _lastFlushedSample, _currentSampleIndex) &&
+      !(recoverSD() && writeDay(0, _lastFlushedSample, _currentSampleIndex)))
+    return false;
+
+  saveEnergy();
+  saveSolar();
+  if (_rollup.isDirty()) {
+    char path[48];
+    snprintf(path, sizeof(path), "%s/rollup.bin", _dir);
+    _rollup.saveToSD(path);
+  }
+  if (_load.isDirty()) {
+    char path[48];
+    snprintf(path, sizeof(path), "%s/load.bin", _dir);
+    _load.saveToSD(path);
   }
 
-  file.close();
+  // Everything journaled is now in the day file: start the journal over
+  _journal = File();
+  _journalOpen = false;
+  _journalGap = false;
+  char path[48];
+  snprintf(path, sizeof(path), "%s/journal.bin", _dir);
+  journalFS().remove(path);
 
-  // Update flush tracking
   _lastFlushTime = time(nullptr);
+  _lastCheckpoint = _lastFlushTime;
   _lastFlushedSample = _currentSampleIndex;
+  HistoryTail::release(_tailStream);
 
-  Serial.printf("[PowerHistory] Flushed %d samples to %s\n", samplesToWrite,
-                filename.c_str());
+  Serial.printf("[PowerHistory] Checkpointed %d samples\n", samplesToWrite);
+  return true;
+}
+
+int PowerHistory::replayFile(fs::FS &fs, const char *path,
+                             uint16_t &touched) {
+  File file = fs.open(path, FILE_READ);
+  if (!file)
+    return 0;
+
+  // Map each journaled date to the day it belongs to in the ring
+  uint32_t dates[HISTORY_DAYS];
+  for (int d = 0; d < HISTORY_DAYS; d++)
+    dates[d] = dateKey((time_t)(_dayNumber - d) * 86400);
+
+  // The journal left by a build with 9-byte samples (the boot after an
+  // update) checks out in the old layout only
+  uint8_t buf[sizeof(JournalRecord)];
+  size_t got = file.read(buf, sizeof(buf));
+  JournalRecordV1 old;
+  memcpy(&old, buf, sizeof(old));
+  JournalRecord record;
+  memcpy(&record, buf, sizeof(record));
+  bool v2 = got == sizeof(record) &&
+            CRC16::modbus(buf, sizeof(record) - sizeof(record.crc)) ==
+                record.crc;
+  bool v1 = !v2 && got >= sizeof(old) &&
+            CRC16::modbus(buf, sizeof(old) - sizeof(old.crc)) == old.crc;
+  size_t size = v1 ? sizeof(JournalRecordV1) : sizeof(JournalRecord);
+  file.seek(0);
+
+  int replayed = 0;
+  while (file.read(buf, size) == size) {
+    // Torn tail from the brown-out: nothing valid follows
+    if (v1) {
+      memcpy(&old, buf, size);
+      if (CRC16::modbus(buf, size - sizeof(old.crc)) != old.crc)
+        break;
+      record.date = old.date;
+      record.slot = old.slot;
+      record.sample = widen(old.sample);
+    } else {
+      memcpy(&record, buf, size);
+      if (CRC16::modbus(buf, size - sizeof(record.crc)) != record.crc)
+        break;
+    }
+    if (replaySample(dates, record.date, record.slot, record.sample,
+                     touched))
+      replayed++;
+  }
+  file.close();
+  return replayed;
+}
+
+bool PowerHistory::replaySample(const uint32_t *dates, uint32_t date,
+                                uint16_t slot, const PowerSample &sample,
+                                uint16_t &touched) {
+  if (slot >= SAMPLES_PER_DAY)
+    return false;
+  for (int d = 0; d < HISTORY_DAYS; d++) {
+    if (date != dates[d])
+      continue;
+    ensureDay(d); // Folded into the day file below: read it first
+    uint8_t dayIndex = dayIndexFor(d);
+    _historyData[dayIndex][slot] = sample;
+    markPresent(dayIndex, slot);
+    if (d == 0 && slot >= _currentSampleIndex)
+      _currentSampleIndex = slot + 1;
+    touched |= 1 << d;
+    return true;
+  }
+  return false; // Older than the ring
+}
+
+int PowerHistory::replayTail(uint16_t &touched) {
+  if (!_tailOn)
+    return 0;
+  PowerSample samples[HistoryTail::TAIL_RECORDS];
+  int n = HistoryTail::collect(_tailStream, samples,
+                               HistoryTail::TAIL_RECORDS);
+  uint32_t dates[HISTORY_DAYS];
+  for (int d = 0; d < HISTORY_DAYS; d++)
+    dates[d] = dateKey((time_t)(_dayNumber - d) * 86400);
+
+  int replayed = 0;
+  for (int i = 0; i < n; i++) {
+    uint32_t t = samples[i].timestamp;
+    if (replaySample(dates, dateKey(t), (t % 86400) / 60, samples[i],
+                     touched))
+      replayed++;
+  }
+  if (replayed)
+    Serial.printf("[PowerHistory] Recovered %d unflushed samples from RTC "
+                  "memory\n",
+                  replayed);
+  return replayed;
+}
+
+void PowerHistory::replayJournal() {
+  char path[48];
+  snprintf(path, sizeof(path), "%s/journal.bin", _dir);
+
+  // A journal left on the card by a build without the flash tier (or from
+  // a boot where it failed to mount) is replayed as well
+  bool legacy = &journalFS() != &sdFS() && sdFS().exists(path);
+  uint16_t touched = 0; // Bit per day offset
+  int recovered = replayTail(touched);
+  int replayed = replayFile(journalFS(), path, touched);
+  if (legacy)
+    replayed += replayFile(sdFS(), path, touched);
+  _pageDay = -1;
+  _revision++;
+
+  if (replayed + recovered == 0) {
+    journalFS().remove(path);
+    if (legacy)
+      sdFS().remove(path);
+    return;
+  }
+  if (replayed)
+    Serial.printf("[PowerHistory] Replayed %d journaled samples\n",
+                  replayed);
+
+  // Fold them into the day files now so the journal can start empty
+  for (int d = 1; d < HISTORY_DAYS; d++) {
+    if (touched & (1 << d))
+      writeDay(d, 0, SAMPLES_PER_DAY);
+  }
+  _lastFlushedSample = 0; // Today's file is rewritten by the checkpoint
+  if (checkpoint() && legacy)
+    sdFS().remove(path);
+}
+
+bool PowerHistory::writeDay(uint8_t dayOffset, uint16_t from, uint16_t to) {
+  if (to > SAMPLES_PER_DAY)
+    to = SAMPLES_PER_DAY;
+  if (to == 0)
+    return true; // Nothing recorded yet: don't create an empty file
+  uint8_t dayIndex = dayIndexFor(dayOffset);
+  Path filename = getFilenameForDay(dayOffset);
+
+  // Records sit at fixed slots and the file is created at its full size:
+  // a flush patches its range in place, never growing the file, so FAT
+  // allocates no clusters and the header is left alone
+  HistoryFileHeader header;
+  File file;
+  bool exists = sdFS().exists(filename);
+  if (exists) {
+    file = sdFS().open(filename, "r+");
+    if (!file || file.read((uint8_t *)&header, sizeof(header)) !=
+                     sizeof(header) ||
+        header.magic != HISTORY_FILE_MAGIC ||
+        header.version != HISTORY_FILE_VERSION ||
+        header.recordSize != sizeof(PowerSample) ||
+        header.sampleCount > SAMPLES_PER_DAY) {
+      if (file)
+        file.close();
+      exists = false; // Unreadable: rewrite it from memory
+    }
+  }
+  if (!exists) {
+    file = sdFS().open(filename, FILE_WRITE);
+    time_t day = (time_t)(_dayNumber - dayOffset) * 86400;
+    struct tm timeinfo;
+    localtime_r(&day, &timeinfo);
+    header = {HISTORY_FILE_MAGIC, HISTORY_FILE_VERSION, sizeof(PowerSample),
+              0, (uint16_t)(timeinfo.tm_year + 1900),
+              (uint8_t)(timeinfo.tm_mon + 1), (uint8_t)timeinfo.tm_mday, 0};
+  }
+  if (!file) {
+    Serial.printf("[PowerHistory] Failed to open %s\n", filename.c_str());
+    return false;
+  }
+
+  // New files, and ones an older build grew slot by slot, are filled out
+  // to every slot once (empty slots are zero in memory)
+  bool full = header.sampleCount == SAMPLES_PER_DAY;
+  if (!full) {
+    if (header.sampleCount < from)
+      from = header.sampleCount;
+    to = SAMPLES_PER_DAY;
+    header.sampleCount = SAMPLES_PER_DAY;
+  }
+  if (to > from) {
+    file.seek(sizeof(header) + from * sizeof(PowerSample));
+    file.write((const uint8_t *)&_historyData[dayIndex][from],
+               (to - from) * sizeof(PowerSample));
+  }
+  if (!full) {
+    file.seek(0);
+    file.write((const uint8_t *)&header, sizeof(header));
+  }
+  file.close();
   return true;
 }
 
 bool PowerHistory::loadFromSD() {
   Serial.println("[PowerHistory] Loading history from SD...");
+  _pendingDays = 0;
 
-  if (!SD.exists("/history")) {
+  if (!sdFS().exists(_dir)) {
     Serial.println("[PowerHistory] No history directory found");
     return false;
   }
 
-  // Load last 7 days
-  int samplesLoaded = 0;
-  for (uint8_t dayOffset = 0; dayOffset < HISTORY_DAYS; dayOffset++) {
-    String filename = getFilenameForDay(dayOffset);
+  // Today now, sampling continues from its tail; the 6 days before it
+  // are only needed once something looks back at them
+  for (uint8_t dayOffset = 1; dayOffset < HISTORY_DAYS; dayOffset++)
+    _pendingDays |= 1 << dayIndexFor(dayOffset);
+  bool loaded = loadDay(0) || loadLegacyCSV(0);
 
-    if (!SD.exists(filename)) {
-      continue;
-    }
+  Serial.printf("[PowerHistory] Loaded today from SD (%d days deferred)\n",
+                HISTORY_DAYS - 1);
+  return loaded;
+}
+
+void PowerHistory::loadPastDays(std::function<void(uint32_t)> loaded) {
+  if (loaded)
+    _onDayLoaded = loaded;
+  _loadAll = true;
+  loadNextDay();
+}
+
+void PowerHistory::requestRange(uint32_t t0, uint32_t t1) {
+  for (uint8_t d = 1; d < HISTORY_DAYS; d++) {
+    uint32_t dayStart = (_dayNumber - d) * 86400UL;
+    if (dayStart < t1 && dayStart + 86400UL > t0)
+      _wantedDays |= 1 << dayIndexFor(d);
+  }
+  loadNextDay();
+}
+
+bool PowerHistory::isDayLoaded(uint8_t dayOffset) const {
+  return dayOffset < HISTORY_DAYS &&
+         !(_pendingDays & (1 << dayIndexFor(dayOffset)));
+}
 
-    File file = SD.open(filename, FILE_READ);
-    if (!file) {
+// Read a day now if it is still pending (boot task, or a rare fallback)
+bool PowerHistory::ensureDay(uint8_t dayOffset) {
+  uint8_t bit = 1 << dayIndexFor(dayOffset);
+  if (!(_pendingDays & bit))
+    return true;
+  _pendingDays &= ~bit;
+  _wantedDays &= ~bit;
+  return loadDay(dayOffset) || loadLegacyCSV(dayOffset);
+}
+
+void PowerHistory::loadNextDay() {
+  if (_loadingDay >= 0)
+    return; // One read at a time: a wanted day can still go next
+
+  // Nearest first: the days a view asked for, then the rest
+  uint8_t pick = _pendingDays & _wantedDays;
+  if (!pick && _loadAll)
+    pick = _pendingDays;
+  for (uint8_t d = 1; pick && d < HISTORY_DAYS; d++) {
+    uint8_t dayIndex = dayIndexFor(d);
+    if (!(pick & (1 << dayIndex)))
       continue;
+    Path filename = getFilenameForDay(d);
+    uint32_t dayNumber = _dayNumber - d;
+    _loadingDay = dayIndex;
+    if (storage &&
+        storage->read(filename.c_str(), sizeof(HistoryFileHeader),
+                      StorageWorker::REST,
+                      [this, dayIndex, dayNumber](const StorageResult &r) {
+                        finishDayRead(dayIndex, dayNumber, r);
+                      }))
+      return;
+
+    // Worker queue full (or no worker): read it here instead
+    _loadingDay = -1;
+    ensureDay(d);
+    if (_onDayLoaded)
+      _onDayLoaded(dayNumber);
+    pick &= ~(1 << dayIndex);
+  }
+}
+
+void PowerHistory::finishDayRead(uint8_t dayIndex, uint32_t dayNumber,
+                                 const StorageResult &result) {
+  _loadingDay = -1;
+
+  // The ring may have moved on while the read was queued
+  uint32_t dayOffset = _dayNumber - dayNumber;
+  uint8_t bit = 1 << dayIndex;
+  if (dayOffset > 0 && dayOffset < HISTORY_DAYS &&
+      dayIndexFor(dayOffset) == dayIndex && (_pendingDays & bit)) {
+    _pendingDays &= ~bit;
+    _wantedDays &= ~bit;
+    HistoryFileHeader header;
+    bool ok = result.ok && result.headLen == sizeof(header);
+    if (ok) {
+      memcpy(&header, result.head, sizeof(header));
+      ok = parseDay(dayIndex, header, result.data, result.dataLen);
     }
+    if (!ok)
+      loadLegacyCSV(dayOffset); // Missing, bad, or never converted
+    if (_onDayLoaded)
+      _onDayLoaded(dayNumber);
+  }
+  loadNextDay();
+}
 
-    // Skip CSV header
-    file.readStringUntil('\n');
+// Magic, a sane count and a record layout this build reads
+static bool checkHeader(const HistoryFileHeader &header, bool &v1) {
+  bool ok = header.magic == HISTORY_FILE_MAGIC &&
+            header.sampleCount <= SAMPLES_PER_DAY;
+  v1 = ok && header.version == 1 &&
+       header.recordSize == sizeof(PowerSampleV1);
+  return ok && (v1 || (header.version == HISTORY_FILE_VERSION &&
+                       header.recordSize == sizeof(PowerSample)));
+}
 
-    // Read samples
-    uint8_t dayIndex =
-        (_currentDayIndex - dayOffset + HISTORY_DAYS) % HISTORY_DAYS;
-    uint16_t sampleIdx = 0;
+bool PowerHistory::loadDay(uint8_t dayOffset) {
+  Path filename = getFilenameForDay(dayOffset);
+  uint8_t dayIndex = dayIndexFor(dayOffset);
+  _pageDay = -1; // Page may no longer match
+  bool ok = readDayFile(filename.c_str(), _historyData[dayIndex]);
+  rebuildPresence(dayIndex);
+  _revision++;
+  return ok;
+}
 
-    while (file.available() && sampleIdx < SAMPLES_PER_DAY) {
-      String line = file.readStringUntil('\n');
-      if (line.length() == 0)
-        break;
+bool PowerHistory::readDayFile(const char *path, PowerSample *day) {
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return false;
 
-      // Parse CSV: timestamp,battery,input,output
-      int comma1 = line.indexOf(',');
-      int comma2 = line.indexOf(',', comma1 + 1);
-      int comma3 = line.indexOf(',', comma2 + 1);
-
-      if (comma1 > 0 && comma2 > 0 && comma3 > 0) {
-        PowerSample &sample = _historyData[dayIndex][sampleIdx];
-        sample.timestamp = line.substring(0, comma1).toInt();
-        sample.batteryPct = line.substring(comma1 + 1, comma2).toInt();
-        sample.inputW = line.substring(comma2 + 1, comma3).toInt();
-        sample.outputW = line.substring(comma3 + 1).toInt();
-        sampleIdx++;
-        samplesLoaded++;
-      }
+  HistoryFileHeader header;
+  bool v1 = false;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            checkHeader(header, v1);
+  if (ok && v1) {
+    // A chunk at a time, widened into place
+    PowerSampleV1 chunk[64];
+    for (uint16_t i = 0; ok && i < header.sampleCount; i += 64) {
+      uint16_t n = header.sampleCount - i < 64 ? header.sampleCount - i : 64;
+      size_t bytes = n * sizeof(PowerSampleV1);
+      ok = file.read((uint8_t *)chunk, bytes) == bytes;
+      for (uint16_t j = 0; ok && j < n; j++)
+        day[i + j] = widen(chunk[j]);
+    }
+  } else if (ok) {
+    size_t bytes = header.sampleCount * sizeof(PowerSample);
+    ok = file.read((uint8_t *)day, bytes) == bytes;
+  }
+  file.close();
+
+  if (!ok)
+    Serial.printf("[PowerHistory] Ignoring bad file %s\n", path);
+  return ok;
+}
+
+// A day file the storage worker read whole: header, then the records
+bool PowerHistory::parseDay(uint8_t dayIndex, const HistoryFileHeader &header,
+                            const uint8_t *records, size_t len) {
+  bool v1 = false;
+  if (!checkHeader(header, v1) ||
+      len < header.sampleCount * (size_t)header.recordSize)
+    return false;
+  _pageDay = -1; // Page may no longer match
+  if (v1) {
+    for (uint16_t i = 0; i < header.sampleCount; i++) {
+      PowerSampleV1 old;
+      memcpy(&old, records + i * sizeof(old), sizeof(old));
+      _historyData[dayIndex][i] = widen(old);
     }
+  } else {
+    memcpy(_historyData[dayIndex], records,
+           header.sampleCount * sizeof(PowerSample));
+  }
+  rebuildPresence(dayIndex);
+  _revision++;
+  return true;
+}
+
+bool PowerHistory::loadLegacyCSV(uint8_t dayOffset) {
+  // Files from before the binary format: parse once, then convert
+  Path filename = getFilenameForDay(dayOffset, "csv");
+  if (!sdFS().exists(filename)) {
+    return false;
+  }
+
+  File file = sdFS().open(filename, FILE_READ);
+  if (!file) {
+    return false;
+  }
+
+  // Lines are read into one buffer and parsed in place
+  char line[64];
+
+  // Skip CSV header
+  file.readBytesUntil('\n', line, sizeof(line));
+  _pageDay = -1; // Page may no longer match
+
+  // Read samples into the minute slot of their timestamp
+  uint8_t dayIndex = dayIndexFor(dayOffset);
+  uint16_t sampleIdx = 0;
+  uint16_t lastSlot = 0;
+
+  while (file.available() && sampleIdx < SAMPLES_PER_DAY) {
+    size_t len = file.readBytesUntil('\n', line, sizeof(line));
+    if (len == 0)
+      break;
+
+    // Parse CSV: timestamp,battery,input,output
+    StrView fields[4];
+    uint32_t timestamp, battery, input, output;
+    if (StrView(line, len).split(',', fields, 4) != 4 ||
+        !fields[0].toUInt(timestamp) || !fields[1].toUInt(battery) ||
+        !fields[2].toUInt(input) || !fields[3].toUInt(output))
+      continue;
+    if (timestamp / 86400 != _dayNumber - dayOffset)
+      continue; // Not this day (clock was wrong when it was written)
+
+    uint16_t slot = (timestamp % 86400) / 60;
+    _historyData[dayIndex][slot] =
+        PowerSample{timestamp, (uint8_t)battery, (uint16_t)input,
+                    (uint16_t)output, 0, 0, 0};
+    markPresent(dayIndex, slot);
+    _revision++;
+    if (slot >= lastSlot)
+      lastSlot = slot + 1;
+    sampleIdx++;
+  }
+
+  file.close();
+
+  // Today's file is written by the next flush; past days convert now
+  if (sampleIdx > 0 && dayOffset > 0 && writeDay(dayOffset, 0, lastSlot))
+    Serial.printf("[PowerHistory] Converted %s\n", filename.c_str());
+  return sampleIdx > 0;
+}
 
-    file.close();
+void PowerHistory::compactArchive() {
+  if (_compacting || _compactedDay == _dayNumber || _dayNumber == 0 ||
+      !storage)
+    return;
+
+  // Everything before the oldest day in the ring is closed
+  uint32_t before =
+      dateKey((time_t)(_dayNumber - (HISTORY_DAYS - 1)) * 86400);
+  uint32_t dayNumber = _dayNumber;
+  _compacting = true;
+  if (!storage->run(
+          _dir,
+          [this, before](size_t &bytes) {
+            bytes = HistoryArchive::compact(_dir, before);
+            return true;
+          },
+          [this, dayNumber](const StorageResult &result) {
+            _compacting = false;
+            if (result.bytes < (size_t)HistoryArchive::DAYS_PER_RUN)
+              _compactedDay = dayNumber; // Nothing left before tomorrow
+          }))
+    _compacting = false;
+}
+
+bool PowerHistory::exportCSV(uint8_t dayOffset) {
+  if (dayOffset >= HISTORY_DAYS)
+    return false;
+  ensureDay(dayOffset);
+
+  Path filename = getFilenameForDay(dayOffset, "csv");
+  File file = sdFS().open(filename, FILE_WRITE);
+  if (!file) {
+    Serial.printf("[PowerHistory] Failed to open %s\n", filename.c_str());
+    return false;
+  }
+
+  file.println("timestamp,battery,input,output");
+  uint32_t dayStart = (_dayNumber - dayOffset) * 86400;
+  for (const HistorySpan &span : range(dayStart, dayStart + 86400)) {
+    for (uint16_t i = 0; i < span.count; i++)
+      writeSampleToCSV(file, span.samples[i]);
   }
+  file.close();
 
-  Serial.printf("[PowerHistory] Loaded %d samples from SD\n", samplesLoaded);
-  return samplesLoaded > 0;
+  Serial.printf("[PowerHistory] Exported %s\n", filename.c_str());
+  return true;
 }
 
 void PowerHistory::advanceToNextDay() {
   Serial.println("[PowerHistory] Advancing to next day");
 
-  // Flush any remaining samples from today
-  flushToSD();
+  // Fold today's journal into its day file
+  checkpoint();
 
   // Move to next day
   _currentDayIndex = (_currentDayIndex + 1) % HISTORY_DAYS;
   _currentSampleIndex = 0;
   _lastFlushedSample = 0;
+  _dayNumber++;
 
   // Clear the new day's buffer (we'll overwrite it)
-  memset(_historyData[_currentDayIndex], 0,
-         sizeof(_historyData[_currentDayIndex]));
+  memset(_historyData[_currentDayIndex], 0, sizeof(DayBuffer));
+  memset(_present[_currentDayIndex], 0, sizeof(_present[_currentDayIndex]));
+  _pendingDays &= ~(1 << _currentDayIndex); // Evicted before it was read
+  _wantedDays &= ~(1 << _currentDayIndex);
+  _revision++;
+  if (_pageDay == _currentDayIndex)
+    _pageDay = -1;
 }
 
-String PowerHistory::getFilenameForDay(uint8_t dayOffset) {
-  // Calculate date for the day
-  time_t now = time(nullptr);
-  time_t targetDay = now - (dayOffset * 86400); // Subtract days in seconds
+PowerHistory::Path PowerHistory::getFilenameForDay(uint8_t dayOffset,
+                                                   const char *ext) {
+  // Calculate date for the day (from the ring's day, not the clock, so a
+  // file is named for the day its samples belong to)
+  time_t targetDay = (time_t)(_dayNumber - dayOffset) * 86400;
 
   struct tm timeinfo;
   localtime_r(&targetDay, &timeinfo);
 
-  char filename[32];
-  snprintf(filename, sizeof(filename), "/history/%04d-%02d-%02d.csv",
-           timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
-
-  return String(filename);
+  return Path::format("%s/%04d-%02d-%02d.%s", _dir, timeinfo.tm_year + 1900,
+                      timeinfo.tm_mon + 1, timeinfo.tm_mday, ext);
 }
 
 bool PowerHistory::writeSampleToCSV(fs::File &file, const PowerSample &sample) {
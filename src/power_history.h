@@ -1,30 +1,143 @@
 #ifndef POWER_HISTORY_H
 #define POWER_HISTORY_H
 
+#include "ble/fossibot_protocol.h"
+#include "history_rollup.h"
+#include "load_quantiles.h"
+#include "solar_analytics.h"
+#include "telemetry_filter.h"
+#include "utils/fixed_string.h"
 #include <Arduino.h>
+#undef min
+#undef max
+#include <FS.h>
+#include <functional>
 #include <time.h>
 
-// Forward declaration for SD File class
-namespace fs {
-class File;
-}
+struct StorageResult;
+
+// Power sample structure (14 bytes, packed: also the on-disk record)
+struct __attribute__((packed)) PowerSample {
+  // outlets bits
+  enum : uint8_t { USB_ON = 0x01, DC_ON = 0x02, AC_ON = 0x04, DETAIL = 0x80 };
 
-// Power sample structure (9 bytes)
-struct PowerSample {
   uint32_t timestamp; // Unix time (4 bytes)
   uint8_t batteryPct; // 0-100 (1 byte)
   uint16_t inputW;    // 0-2000W (2 bytes)
   uint16_t outputW;   // 0-2000W (2 bytes)
+  uint16_t dcInputW;  // DC/solar part of inputW, AC is the rest (2 bytes)
+  uint16_t voltageCv; // Battery volts x 100 (2 bytes)
+  uint8_t outlets;    // *_ON while on; DETAIL: the three fields above are
+                      // recorded (not in samples from version 1 files)
+};
+static_assert(sizeof(PowerSample) == 14, "PowerSample is a 14-byte record");
+
+// Daily history file (.bin): this header, then SAMPLES_PER_DAY records,
+// one per minute slot, so a day loads with a single read(). Files are
+// created at full size and patched in place (empty slots are zero).
+// Version 1 files (9-byte records, no DETAIL fields) still load; today's
+// is rewritten as version 2 at the next checkpoint.
+#define HISTORY_FILE_MAGIC 0x48525750 // "PWRH"
+#define HISTORY_FILE_VERSION 2
+
+struct __attribute__((packed)) HistoryFileHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t recordSize;   // sizeof(PowerSample)
+  uint16_t sampleCount; // Slots in the file: SAMPLES_PER_DAY (builds
+                        // that grew the file: highest minute + 1)
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint32_t reserved;
+};
+static_assert(sizeof(HistoryFileHeader) == 16, "Header layout is on disk");
+
+// Journal record (<dir>/journal.bin, in the flash tier when it is mounted):
+// every sample is appended as it is taken and replayed at boot if the day
+// file was not checkpointed
+struct __attribute__((packed)) JournalRecord {
+  uint32_t date; // YYYYMMDD of the sample's day
+  uint16_t slot; // Minute slot within that day
+  PowerSample sample;
+  uint16_t crc; // CRC-16/Modbus of the fields above
 };
 
 // History buffer configuration
 #define SAMPLES_PER_DAY 1440  // 1 minute intervals = 1440 samples/day
 #define HISTORY_DAYS 7        // Keep 7 days of history
-#define FLUSH_INTERVAL_MINS 5 // Flush to SD every 5 minutes
+#define FLUSH_INTERVAL_MINS 30 // Flush to SD every 30 minutes (the RTC
+                               // tail covers a reset in between)
+#define CHECKPOINT_MINS 60    // Fold the journal into the day file hourly
+#define PRESENCE_WORDS ((SAMPLES_PER_DAY + 31) / 32)
+
+// Energy counters, integrated sample to sample (persisted as energy.bin)
+struct __attribute__((packed)) EnergyTotals {
+  uint32_t date; // YYYYMMDD the "today" counters belong to
+  float todayInWh;
+  float todayOutWh;
+  double lifetimeInWh;
+  double lifetimeOutWh;
+};
+
+class PowerHistory;
+
+// Run of consecutive recorded minutes, pointing into the history arena
+struct HistorySpan {
+  uint32_t start; // Unix time of the first sample's minute
+  uint16_t count;
+  const PowerSample *samples;
+};
+
+// Forward range over the recorded minutes in [t0, t1), one span at a time
+class HistoryRange {
+public:
+  class iterator {
+  public:
+    const HistorySpan &operator*() const { return _span; }
+    const HistorySpan *operator->() const { return &_span; }
+    iterator &operator++() {
+      advance();
+      return *this;
+    }
+    bool operator!=(const iterator &other) const {
+      return _history != other._history ||
+             (_history && _span.start != other._span.start);
+    }
+
+  private:
+    friend class HistoryRange;
+    const PowerHistory *_history; // nullptr = end
+    uint32_t _pos;                // Next minute to look at (since 1970)
+    uint32_t _end;
+    HistorySpan _span;
+    void advance();
+  };
+
+  iterator begin() const;
+  iterator end() const;
+
+private:
+  friend class PowerHistory;
+  HistoryRange(const PowerHistory *history, uint32_t t0, uint32_t t1)
+      : _history(history), _t0(t0), _t1(t1) {}
+  const PowerHistory *_history;
+  uint32_t _t0;
+  uint32_t _t1;
+};
 
 class PowerHistory {
 public:
   PowerHistory();
+  ~PowerHistory();
+
+  // Directory for the daily files (default /history); call before init()
+  void setDirectory(const char *dir);
+
+  // Keep unflushed samples in the RTC tail (default on; see
+  // history_tail.h). Off for histories that need not survive a reset.
+  void setRtcTail(bool keep) { _tailOn = keep; }
+  const char *getDirectory() const { return _dir; }
 
   // Initialize history system
   void init();
@@ -32,45 +145,211 @@ public:
   // Add a new sample (called every minute)
   void addSample(uint8_t batteryPct, uint16_t inputW, uint16_t outputW);
 
-  // Get sample for specific day and index (not minute!)
+  // Add a sample at the wall-clock minute it was taken (slots between two
+  // samples stay empty: gaps are explicit, not squeezed out)
+  void addSampleAt(time_t when, uint8_t batteryPct, uint16_t inputW,
+                   uint16_t outputW);
+  void addSampleAt(const PowerSample &sample); // At sample.timestamp
+
+  // A frame, or the filter's summary of a minute, as a sample with the
+  // DETAIL fields
+  static PowerSample sampleOf(time_t when,
+                              const Fossibot::PowerBankData &data);
+  static PowerSample sampleOf(const TelemetryFilter::Minute &minute);
+
+  // Get sample for specific day and minute slot (0-1439)
   PowerSample getSample(uint8_t dayOffset, uint16_t sampleIndex);
 
-  // Get samples for a specific day (returns pointer to day array)
+  // True if the minute slot holds a sample (presence bitmap)
+  bool hasSample(uint8_t dayOffset, uint16_t slot) const;
+
+  // Get samples for a specific day (returns pointer to day array). The
+  // day is paged into internal RAM; the pointer is valid until another
+  // day is requested or releaseView() is called.
   const PowerSample *getDaySamples(uint8_t dayOffset);
 
-  // Get number of samples for a specific day
+  // Free the internal-RAM page (when the history screen closes)
+  void releaseView();
+
+  // Get number of samples for a specific day (popcount of the bitmap)
   uint16_t getSampleCount(uint8_t dayOffset);
 
-  // Should we flush to SD? (every 5 minutes)
+  // Recorded samples in [t0, t1) as spans of consecutive minutes (no
+  // copies). Only the days still in the ring are covered.
+  HistoryRange range(uint32_t t0, uint32_t t1) const {
+    return HistoryRange(this, t0, t1);
+  }
+
+  // Fold [t0, t1) into buckets of bucketSecs (0 = one bucket for the
+  // whole range): min/max, means and energy per bucket
+  // @return number of buckets written to out
+  int aggregate(uint32_t t0, uint32_t t1, uint32_t bucketSecs,
+                RollupBucket *out, int maxOut) const;
+
+  // Downsampled 15 min / 1 hour / 1 day history, updated by addSample()
+  const HistoryRollup &getRollup() const { return _rollup; }
+
+  // Highest input or output watts on a day (from the 15-minute rollup)
+  uint16_t getDayPeakW(uint8_t dayOffset) const;
+
+  // Wh in/out today and since first boot (O(1), kept by addSample())
+  const EnergyTotals &getEnergy() const { return _energy; }
+
+  // Daily solar peak, production window and trend (kept by addSample())
+  const SolarAnalytics &getSolar() const { return _solar; }
+
+  // Output power percentiles per day and hour (kept by addSample())
+  const LoadQuantiles &getLoad() const { return _load; }
+
+  // Should we flush to SD? (every FLUSH_INTERVAL_MINS unless changed, or
+  // sooner when the RTC tail is filling up)
   bool shouldFlush();
+  void setFlushInterval(uint8_t minutes) { _flushMins = minutes; }
 
-  // Flush pending samples to SD card
+  // Make journaled samples durable (cheap); checkpoints hourly
   bool flushToSD();
 
-  // Load history from SD card on boot
+  // Load history from SD card on boot: today only, the days before it
+  // are left to loadPastDays()
   bool loadFromSD();
 
+  // Read the days before today in the background, one storage worker
+  // read at a time, nearest first; loaded runs on the loop task after
+  // each. Call from the loop task; calling again is cheap.
+  void loadPastDays(std::function<void(uint32_t dayNumber)> loaded = nullptr);
+
+  // Read the days overlapping [t0, t1) ahead of the others (a view is
+  // showing them), starting the reads if loadPastDays() has not
+  void requestRange(uint32_t t0, uint32_t t1);
+
+  // False while a day before today still waits to be read
+  bool isDayLoaded(uint8_t dayOffset) const;
+
+  // Fold day files older than the ring into monthly archives on the
+  // storage worker (see history_archive.h). Cheap to call again: once a
+  // run finds nothing left it waits for the next day.
+  void compactArchive();
+
+  // Write one day as CSV (timestamp,battery,input,output) next to its
+  // binary file, for reading on a computer
+  bool exportCSV(uint8_t dayOffset);
+
+  // Read a day file's records into day (SAMPLES_PER_DAY slots; those
+  // past its count are left alone). Any task, sdFS() only.
+  static bool readDayFile(const char *path, PowerSample *day);
+
   // Get current day index (0-6, circular)
   uint8_t getCurrentDayIndex() const { return _currentDayIndex; }
 
-  // Get total samples collected today
+  // Slots of today up to the newest sample (minute of day + 1)
   uint16_t getTodaySampleCount() const { return _currentSampleIndex; }
 
+  // Today as days since 1970; day offset d is getDayNumber() - d
+  uint32_t getDayNumber() const { return _dayNumber; }
+
+  // Bumped whenever any stored sample changes (for caches)
+  uint32_t getRevision() const { return _revision; }
+
 private:
-  // 7 days × 1440 samples = 91 KB RAM buffer
-  PowerSample _historyData[HISTORY_DAYS][SAMPLES_PER_DAY];
+  typedef PowerSample DayBuffer[SAMPLES_PER_DAY];
+
+  // 7 days × 1440 samples × 9 bytes = 89 KB, in PSRAM when available
+  DayBuffer *_historyData;
+
+  // The day being viewed, copied into internal RAM on demand
+  PowerSample *_page;
+  int8_t _pageDay; // Day index held in _page, -1 = none
+  const PowerSample *page(uint8_t dayIndex);
 
   // Current position in circular buffer
   uint8_t _currentDayIndex;     // 0-6 (today)
-  uint16_t _currentSampleIndex; // 0-1439 (minute of day)
+  uint16_t _currentSampleIndex; // Slots before this may hold samples
+  uint32_t _dayNumber;          // Today as days since 1970 (local clock)
+  uint32_t _revision;
+
+  // Bit per minute slot that holds a sample
+  uint32_t _present[HISTORY_DAYS][PRESENCE_WORDS];
+  void markPresent(uint8_t dayIndex, uint16_t slot) {
+    _present[dayIndex][slot / 32] |= 1UL << (slot % 32);
+  }
+  void rebuildPresence(uint8_t dayIndex);
+  uint8_t dayIndexFor(uint8_t dayOffset) const {
+    return (_currentDayIndex - dayOffset + HISTORY_DAYS) % HISTORY_DAYS;
+  }
+  friend class HistoryRange;
+  bool nextSpan(uint32_t &pos, uint32_t end, HistorySpan &span) const;
+
+  // SD directory for this stream's daily files
+  char _dir[24];
+
+  // Coarser tiers, saved to <dir>/rollup.bin when an hour closes
+  HistoryRollup _rollup;
+  void loadRollup();
+
+  // Days not read yet (bit per day index), the ones a view asked for
+  // first, and the one the storage worker is reading (-1: none)
+  uint8_t _pendingDays;
+  uint8_t _wantedDays;
+  int8_t _loadingDay;
+  bool _loadAll; // loadPastDays() has been called
+  std::function<void(uint32_t dayNumber)> _onDayLoaded;
+  void loadNextDay();
+  void finishDayRead(uint8_t dayIndex, uint32_t dayNumber,
+                     const StorageResult &result);
+  bool ensureDay(uint8_t dayOffset);
+
+  // Archive compaction: a run on the worker, and the day the last one
+  // left nothing behind (0: none yet)
+  bool _compacting;
+  uint32_t _compactedDay;
+
+  // Write-ahead journal, kept open between flushes
+  File _journal;
+  bool _journalOpen;
+  uint32_t _journalGen; // SD mount generation the handle belongs to
+  bool _journalGap;     // Samples went unjournaled since the checkpoint
+  uint32_t _lastCheckpoint;
+  fs::FS &journalFS();
+  bool journalReady();
+  void journalSample(uint16_t slot, const PowerSample &sample);
+  bool checkpoint();
+  bool recoverSD();
+  void replayJournal();
+  int replayFile(fs::FS &fs, const char *path, uint16_t &touched);
+  int replayTail(uint16_t &touched);
+  bool replaySample(const uint32_t *dates, uint32_t date, uint16_t slot,
+                    const PowerSample &sample, uint16_t &touched);
+
+  // Trapezoidal integration state: the previous sample
+  EnergyTotals _energy;
+  SolarAnalytics _solar;
+  LoadQuantiles _load;
+  uint32_t _lastEnergyTime; // 0 = no previous sample
+  uint16_t _lastInW;
+  uint16_t _lastOutW;
+  void accumulateEnergy(uint32_t now, uint16_t inW, uint16_t outW);
+  void loadEnergy();
+  bool saveEnergy();
+  bool saveSolar();
 
   // Last flush timestamp
   uint32_t _lastFlushTime;
-  uint16_t _lastFlushedSample; // Last sample index flushed to SD
+  uint8_t _flushMins;
+  uint16_t _lastFlushedSample; // Slots before this are in the day file
+
+  // Samples since the last flush, in RTC memory (released by a flush)
+  uint16_t _tailStream;
+  bool _tailOn;
 
   // Helper functions
   void advanceToNextDay();
-  String getFilenameForDay(uint8_t dayOffset);
+  typedef FixedString<48> Path;
+  Path getFilenameForDay(uint8_t dayOffset, const char *ext = "bin");
+  bool writeDay(uint8_t dayOffset, uint16_t from, uint16_t to);
+  bool loadDay(uint8_t dayOffset);
+  bool parseDay(uint8_t dayIndex, const HistoryFileHeader &header,
+                const uint8_t *records, size_t len);
+  bool loadLegacyCSV(uint8_t dayOffset);
   bool writeSampleToCSV(fs::File &file, const PowerSample &sample);
 };
 
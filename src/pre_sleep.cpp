@@ -0,0 +1,156 @@
+/**
+ * Pre-Sleep Flush Implementation
+ */
+
+#include "pre_sleep.h"
+#include "utils/log.h"
+#include "utils/storage_worker.h"
+#include "utils/wake.h"
+#include <algorithm>
+
+extern StorageWorker *storage;
+
+namespace PreSleep {
+
+enum class State : uint8_t { IDLE, QUEUED, DONE, FAILED, SKIPPED };
+
+struct Entry {
+  const char *name;
+  Priority priority;
+  uint16_t costMs;
+  Lane lane;
+  Hook hook;
+  volatile State state; // The worker sets it for its hooks
+};
+
+static Entry _hooks[MAX_HOOKS];
+static int _count = 0;
+static uint32_t _deadline = 0;
+static volatile bool _late = false; // Past the deadline
+
+bool add(const char *name, Priority priority, uint16_t costMs, Lane lane,
+         Hook hook) {
+  if (_count >= MAX_HOOKS) {
+    LOG_W("Sleep", "No room for flush hook %s", name);
+    return false;
+  }
+  Entry &e = _hooks[_count++];
+  e.name = name;
+  e.priority = priority;
+  e.costMs = costMs;
+  e.lane = lane;
+  e.hook = hook;
+  e.state = State::IDLE;
+  return true;
+}
+
+static bool essential(const Entry &e) {
+  return e.priority == Priority::ESSENTIAL;
+}
+
+static void runHere(Entry &e) {
+  bool ok = e.hook(_deadline);
+  e.state = ok ? State::DONE : State::FAILED;
+  LOG_D("Sleep", "%s %s", e.name, ok ? "done" : "failed");
+}
+
+Report run(uint32_t budgetMs) {
+  uint32_t start = millis();
+  _deadline = start + budgetMs;
+  _late = false;
+
+  // Priority order; registration order within a priority
+  int order[MAX_HOOKS];
+  for (int i = 0; i < _count; i++)
+    order[i] = i;
+  std::stable_sort(order, order + _count, [](int a, int b) {
+    return _hooks[a].priority < _hooks[b].priority;
+  });
+
+  // Each lane's estimates add up; what would run past the budget is left
+  uint32_t planned[2] = {0, 0};
+  for (int k = 0; k < _count; k++) {
+    Entry &e = _hooks[order[k]];
+    uint32_t &lane = planned[(int)e.lane];
+    if (!essential(e) && lane + e.costMs > budgetMs) {
+      e.state = State::SKIPPED;
+      continue;
+    }
+    lane += e.costMs;
+    e.state = State::IDLE;
+  }
+
+  // The worker's share first, so the card is busy while the loop does its
+  // own; without the worker (or room in its queue) they run here after
+  for (int k = 0; k < _count; k++) {
+    Entry *e = &_hooks[order[k]];
+    if (e->lane != Lane::WORKER || e->state != State::IDLE || !storage)
+      continue;
+    bool queued = storage->run(
+        e->name,
+        [e](size_t &bytes) {
+          bytes = 0;
+          if (_late && !essential(*e)) {
+            e->state = State::SKIPPED;
+            return true;
+          }
+          bool ok = e->hook(_deadline);
+          e->state = ok ? State::DONE : State::FAILED;
+          return ok;
+        },
+        nullptr);
+    if (queued)
+      e->state = State::QUEUED;
+  }
+  for (int k = 0; k < _count; k++) {
+    Entry &e = _hooks[order[k]];
+    if (e.lane == Lane::LOOP && e.state == State::IDLE)
+      runHere(e);
+  }
+  for (int k = 0; k < _count; k++) {
+    Entry &e = _hooks[order[k]];
+    if (e.lane == Lane::WORKER && e.state == State::IDLE)
+      runHere(e);
+  }
+
+  // Ours, and whatever was queued before them
+  while (storage && storage->busy()) {
+    uint32_t elapsed = millis() - start;
+    if (!_late && elapsed >= budgetMs) {
+      _late = true;
+      LOG_W("Sleep", "Flush budget of %lu ms spent, finishing the write "
+                     "in progress",
+            (unsigned long)budgetMs);
+    }
+    if (elapsed >= HARD_LIMIT_MS) {
+      LOG_W("Sleep", "Storage still busy after %lu ms, sleeping anyway",
+            (unsigned long)elapsed);
+      break;
+    }
+    storage->service();
+    Wake::wait(20); // The worker signals each completion
+  }
+
+  Report report = {0, 0, 0, (uint32_t)(millis() - start)};
+  for (int i = 0; i < _count; i++) {
+    switch (_hooks[i].state) {
+    case State::SKIPPED:
+      report.skipped++;
+      LOG_W("Sleep", "Flush hook %s skipped", _hooks[i].name);
+      break;
+    case State::DONE:
+      report.ran++;
+      break;
+    default: // Failed, or still queued at the hard limit
+      report.ran++;
+      report.failed++;
+      LOG_W("Sleep", "Flush hook %s did not finish", _hooks[i].name);
+      break;
+    }
+  }
+  LOG_I("Sleep", "Flushed in %lu ms: %u hooks, %u failed, %u skipped",
+        (unsigned long)report.ms, report.ran, report.failed, report.skipped);
+  return report;
+}
+
+} // namespace PreSleep
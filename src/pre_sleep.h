@@ -0,0 +1,64 @@
+/**
+ * Pre-Sleep Flush
+ *
+ * Everything that has to reach the card, the flash or the power bank
+ * before deep sleep, in one pipeline: subsystems add() a hook with a
+ * priority, what it usually costs and the task it runs on, and the sleep
+ * path calls run() once, with a time budget.
+ *
+ * Worker hooks (file writes that need nothing from the UI) are queued on
+ * the storage worker in priority order and run there while the loop task
+ * runs its own hooks (encoding a note, waiting for a BLE readback), so the
+ * two overlap. run() then waits for the worker to go idle, which also
+ * covers writes queued before it, and returns as soon as it is.
+ *
+ * The estimates divide the budget: a hook that would not fit behind the
+ * ones before it in its lane is skipped up front, and at the deadline the
+ * worker hooks not yet started are dropped. ESSENTIAL hooks run either
+ * way. A write the worker has started is always waited for, up to
+ * HARD_LIMIT_MS: the card must not lose power halfway through it.
+ */
+
+#ifndef PRE_SLEEP_H
+#define PRE_SLEEP_H
+
+#include <Arduino.h>
+#include <functional>
+
+namespace PreSleep {
+
+static const int MAX_HOOKS = 12;
+static const uint32_t BUDGET_MS = 3000;
+static const uint32_t HARD_LIMIT_MS = 10000;
+
+enum class Priority : uint8_t { ESSENTIAL, NORMAL, OPTIONAL };
+enum class Lane : uint8_t { LOOP, WORKER };
+
+// deadline is the millis() the flush should be done by; a hook that waits
+// for something stops there. Returns false if it failed.
+using Hook = std::function<bool(uint32_t deadline)>;
+
+/**
+ * Register a hook (during setup)
+ * @param name Static string, for the log
+ * @param costMs What it usually takes
+ * @return false if MAX_HOOKS are registered already
+ */
+bool add(const char *name, Priority priority, uint16_t costMs, Lane lane,
+         Hook hook);
+
+struct Report {
+  uint8_t ran;
+  uint8_t failed;  // Of those that ran, or never finished
+  uint8_t skipped; // Did not fit the budget
+  uint32_t ms;
+};
+
+/**
+ * Run every hook that fits the budget, then wait for the storage worker
+ */
+Report run(uint32_t budgetMs = BUDGET_MS);
+
+} // namespace PreSleep
+
+#endif // PRE_SLEEP_H
@@ -0,0 +1,859 @@
+/**
+ * Book Search Implementation
+ */
+
+#include "book_search.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include "page_index.h"
+#include "page_layout.h"
+#include <algorithm>
+#include <esp_heap_caps.h>
+
+extern SDManager *sdManager;
+
+#define SEGMENT_MAGIC 0x31535446 // "FTS1"
+#define SEGMENT_VERSION 1
+
+static const char *BOOKS_DIR = "/books";
+static const char *CACHE_DIR = "/books/.cache";
+static const char *TEMP_PATH = "/books/.cache/search.tmp";
+static const char *DICT_PATH = "/books/.cache/search.dic";
+
+static const int RANKS = 36;             // '0'-'9', then 'a'-'z'
+static const size_t RAW_WORD = 48;       // Bytes of a word read at a time
+static const size_t HASH_SLOTS = 32768;  // Filled to 3/4 at most
+static const size_t CHUNK_BYTES = 12;    // Postings bytes per arena chunk
+static const uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+struct SegmentHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t cut; // Terms were left out for memory
+  uint8_t reserved;
+  uint32_t bookSize;
+  uint32_t blocks;
+  uint32_t terms;
+  uint32_t postings; // File offsets of the parts
+  uint32_t blockTable;
+  uint32_t dictionary;
+  uint32_t dictBlocks;
+};
+
+// A term being collected, in the arena; text runs on past the struct
+struct Term {
+  uint32_t head, tail; // First and last postings chunks
+  uint32_t last;       // Last block added
+  uint32_t count;      // Blocks it is in
+  uint8_t used;        // Bytes in the tail chunk
+  uint8_t len;
+  char text[1];
+};
+
+struct Chunk {
+  uint32_t next;
+  uint8_t bytes[CHUNK_BYTES];
+};
+
+static int rankOf(char c) { return c <= '9' ? c - '0' : c - 'a' + 10; }
+
+static size_t putVarint(uint8_t *out, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  out[n++] = v;
+  return n;
+}
+
+static bool getVarint(const uint8_t *in, size_t len, size_t &p,
+                      uint32_t &v) {
+  v = 0;
+  for (int shift = 0; shift <= 28 && p < len; shift += 7) {
+    uint8_t b = in[p++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+// The next word of the book, a run without white space cut at RAW_WORD
+// bytes; bytes counts what was read, spaces included
+// @return its length, 0 at the end of the book
+static size_t readWord(BookSource &src, char *raw, BookSource::Pos &pos,
+                       uint32_t &bytes) {
+  int c;
+  while ((c = src.peek()) == ' ' || c == '\n') {
+    src.next();
+    bytes++;
+  }
+  pos = src.tell();
+  size_t len = 0;
+  while (len < RAW_WORD && (c = src.peek()) != BookSource::END && c != ' ' &&
+         c != '\n')
+    raw[len++] = src.next();
+  bytes += len;
+  return len;
+}
+
+// Each term of some text: its letter and digit runs, folded to lower-case
+// ASCII and cut to MAX_TERM
+template <typename F>
+static void eachTerm(const char *text, size_t len, F each) {
+  char folded[RAW_WORD * 3 + 8];
+  size_t n = PageLayout::fold(text, len, folded, sizeof(folded));
+  char term[BookSearch::MAX_TERM + 1];
+  int t = 0;
+  for (size_t i = 0; i <= n; i++) {
+    char c = i < n ? folded[i] : 0;
+    if (isalnum((unsigned char)c)) {
+      if (t < BookSearch::MAX_TERM)
+        term[t++] = tolower((unsigned char)c);
+    } else {
+      if (t >= BookSearch::MIN_TERM) {
+        term[t] = 0;
+        each(term, t);
+      }
+      t = 0;
+    }
+  }
+}
+
+BookSearch::BookSearch()
+    : _scanned(false), _indexed(0), _building(false), _generation(0),
+      _phase(Phase::READ), _lo(0), _hi(RANKS), _blocksDone(false),
+      _cut(false), _block(NO_BLOCK), _blockBytes(0), _arena(nullptr),
+      _arenaUsed(0), _table(nullptr), _terms(0), _written(0), _termCount(0),
+      _postings(0), _dictUsed(0), _dictBlocks(0), _dictOffset(0) {
+  _dictTerm[0] = 0;
+}
+
+BookSearch::~BookSearch() {
+  if (_building)
+    finish(false);
+}
+
+void BookSearch::segmentPath(char *path, size_t cap, uint32_t key) {
+  snprintf(path, cap, "%s/%08lx.fts", CACHE_DIR, (unsigned long)key);
+}
+
+bool BookSearch::validSegment(uint32_t key, uint32_t bookSize) {
+  char path[40];
+  segmentPath(path, sizeof(path), key);
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return false;
+  SegmentHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == SEGMENT_MAGIC &&
+            header.version == SEGMENT_VERSION &&
+            header.bookSize == bookSize &&
+            header.dictionary + header.dictBlocks * DICT_BLOCK == file.size();
+  file.close();
+  return ok;
+}
+
+// ============================================================================
+// Which books need indexing
+// ============================================================================
+
+void BookSearch::scan() {
+  _scanned = true;
+  _books.clear();
+  _queue.clear();
+  _indexed = 0;
+  SDAccess sd(sdManager);
+  if (!sd)
+    return;
+
+  std::vector<String> files;
+  sdManager->listFiles(BOOKS_DIR, files, "txt,epub");
+  std::sort(files.begin(), files.end(), [](const String &a, const String &b) {
+    return strcasecmp(a.c_str(), b.c_str()) < 0;
+  });
+  for (String &name : files) {
+    // As the library lists them
+    if (name.startsWith(".") || name.length() >= Reader::MAX_NAME)
+      continue;
+    String path = String(BOOKS_DIR) + "/" + name;
+    File file = sdFS().open(path.c_str(), FILE_READ);
+    if (!file)
+      continue;
+    uint32_t size = file.size();
+    file.close();
+    Book book = {name, PageIndex::key(name.c_str(), size)};
+    if (validSegment(book.key, size))
+      _indexed++;
+    else if (!_building || book.key != _book.key) // Unless under way
+      _queue.push_back(_books.size());
+    _books.push_back(book);
+  }
+  std::reverse(_queue.begin(), _queue.end()); // Taken from the back
+  if (!_queue.empty())
+    LOG_I("Search", "%u of %u books to index", (unsigned)_queue.size(),
+          (unsigned)_books.size());
+
+  // Segments of books that were removed or have changed
+  if (!sdFS().exists(CACHE_DIR))
+    return;
+  std::vector<String> segments;
+  sdManager->listFiles(CACHE_DIR, segments, "fts");
+  for (String &name : segments) {
+    uint32_t key = strtoul(name.c_str(), nullptr, 16);
+    bool used = std::any_of(_books.begin(), _books.end(),
+                            [key](const Book &b) { return b.key == key; });
+    if (!used) {
+      String path = String(CACHE_DIR) + "/" + name;
+      sdFS().remove(path.c_str());
+    }
+  }
+}
+
+// ============================================================================
+// Building
+// ============================================================================
+
+bool BookSearch::step(uint32_t budgetMs) {
+  uint32_t start = millis();
+  if (!_scanned) {
+    scan(); // A slice of its own
+    return pending();
+  }
+  SDAccess sd(sdManager);
+  if (!sd) {
+    if (_building)
+      finish(false);
+    return pending();
+  }
+  if (_building && sdManager->getMountGeneration() != _generation) {
+    finish(false); // The card was remounted, maybe swapped
+    _scanned = false;
+    return true;
+  }
+  if (!_building) {
+    if (_queue.empty())
+      return false;
+    size_t book = _queue.back();
+    _queue.pop_back();
+    begin(book);
+    return pending();
+  }
+
+  bool ok = true;
+  switch (_phase) {
+  case Phase::READ:
+    readSlice(start, budgetMs);
+    break;
+  case Phase::WRITE:
+    ok = writeSlice(start, budgetMs);
+    break;
+  case Phase::BLOCKS: {
+    size_t bytes = _blocks.size() * sizeof(BookSource::Pos);
+    ok = _out.write((const uint8_t *)_blocks.data(), bytes) == bytes &&
+         flushDict();
+    _dict.close();
+    _dict = sdFS().open(DICT_PATH, FILE_READ);
+    ok = ok && _dict;
+    _written = 0;
+    _phase = Phase::APPEND;
+    break;
+  }
+  case Phase::APPEND:
+    ok = appendSlice(start, budgetMs);
+    break;
+  }
+  if (!ok) {
+    Serial.printf("Search: Failed to write the index of %s\n",
+                  _book.name.c_str());
+    sd.fail();
+    finish(false);
+  }
+  return pending();
+}
+
+void BookSearch::begin(size_t book) {
+  _book = _books[book];
+  String path = String(BOOKS_DIR) + "/" + _book.name;
+  if (!_source.open(path.c_str()) ||
+      PageIndex::key(_book.name.c_str(), _source.fileSize()) != _book.key) {
+    Serial.printf("Search: Cannot read %s\n", _book.name.c_str());
+    _source.close();
+    return;
+  }
+  if (!_arena)
+    _arena = (uint8_t *)heap_caps_malloc(BUILD_BUDGET, MALLOC_CAP_SPIRAM);
+  if (!_table)
+    _table = (uint32_t *)heap_caps_malloc(HASH_SLOTS * sizeof(uint32_t),
+                                          MALLOC_CAP_SPIRAM);
+  if (!_arena || !_table || !sdManager->ensureDirectory(CACHE_DIR)) {
+    Serial.println("Search: No memory for the index");
+    _building = true;
+    finish(false);
+    return;
+  }
+  _out = sdFS().open(TEMP_PATH, FILE_WRITE);
+  _dict = sdFS().open(DICT_PATH, FILE_WRITE);
+  SegmentHeader header = {}; // Written for real once the rest is
+  _building = true;
+  _generation = sdManager->getMountGeneration();
+  if (!_out || !_dict ||
+      _out.write((const uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+    finish(false);
+    return;
+  }
+  _lo = 0;
+  _hi = RANKS;
+  _blocksDone = false;
+  _cut = false;
+  _blocks.clear();
+  _termCount = 0;
+  _postings = 0;
+  _dictUsed = 0;
+  _dictBlocks = 0;
+  restartPass();
+  _phase = Phase::READ;
+}
+
+void BookSearch::finish(bool ok) {
+  if (_out)
+    _out.close();
+  if (_dict)
+    _dict.close();
+  _source.close();
+  if (ok) {
+    char path[40];
+    segmentPath(path, sizeof(path), _book.key);
+    sdFS().remove(path);
+    ok = sdFS().rename(TEMP_PATH, path);
+  }
+  if (ok) {
+    _indexed++;
+    LOG_I("Search", "%s: %u terms in %u blocks%s", _book.name.c_str(),
+          (unsigned)_termCount, (unsigned)_blocks.size(),
+          _cut ? " (some left out)" : "");
+  } else {
+    sdFS().remove(TEMP_PATH);
+  }
+  sdFS().remove(DICT_PATH);
+  free(_arena);
+  free(_table);
+  _arena = nullptr;
+  _table = nullptr;
+  std::vector<BookSource::Pos>().swap(_blocks);
+  _building = false;
+}
+
+// The book again from the start, collecting the terms of [_lo, _hi)
+void BookSearch::restartPass() {
+  memset(_table, 0, HASH_SLOTS * sizeof(uint32_t));
+  _arenaUsed = 4; // Offset 0 is an empty slot
+  _terms = 0;
+  if (!_blocksDone)
+    _blocks.clear();
+  _block = NO_BLOCK;
+  _blockBytes = 0;
+  _source.seek(BookSource::Pos{0, 0, 0});
+}
+
+// Note term in the current block
+// @return false if the arena or table is full
+bool BookSearch::addTerm(const char *text, int len) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (int i = 0; i < len; i++)
+    h = (h ^ (uint8_t)text[i]) * 16777619u;
+  size_t slot = h & (HASH_SLOTS - 1);
+  Term *term = nullptr;
+  while (_table[slot]) {
+    Term *t = (Term *)(_arena + _table[slot]);
+    if (t->len == len && !memcmp(t->text, text, len)) {
+      term = t;
+      break;
+    }
+    slot = (slot + 1) & (HASH_SLOTS - 1);
+  }
+
+  auto alloc = [this](size_t bytes) -> uint32_t {
+    bytes = (bytes + 3) & ~(size_t)3;
+    if (_arenaUsed + bytes > BUILD_BUDGET)
+      return 0;
+    uint32_t at = _arenaUsed;
+    _arenaUsed += bytes;
+    return at;
+  };
+
+  if (!term) {
+    if (_terms >= HASH_SLOTS * 3 / 4)
+      return false;
+    uint32_t at = alloc(offsetof(Term, text) + len + 1);
+    uint32_t chunk = at ? alloc(sizeof(Chunk)) : 0;
+    if (!chunk)
+      return false;
+    term = (Term *)(_arena + at);
+    term->head = term->tail = chunk;
+    term->count = 0;
+    term->used = 0;
+    term->len = len;
+    memcpy(term->text, text, len);
+    term->text[len] = 0;
+    ((Chunk *)(_arena + chunk))->next = 0;
+    _table[slot] = at;
+    _terms++;
+  } else if (term->last == _block) {
+    return true; // Once a block
+  }
+
+  uint8_t bytes[5];
+  size_t n = putVarint(bytes, term->count ? _block - term->last : _block);
+  if (term->used + n > CHUNK_BYTES) {
+    uint32_t chunk = alloc(sizeof(Chunk));
+    if (!chunk)
+      return false;
+    // Spill what does not fit into the new chunk
+    Chunk *tail = (Chunk *)(_arena + term->tail);
+    Chunk *next = (Chunk *)(_arena + chunk);
+    next->next = 0;
+    size_t fit = CHUNK_BYTES - term->used;
+    memcpy(tail->bytes + term->used, bytes, fit);
+    memcpy(next->bytes, bytes + fit, n - fit);
+    tail->next = chunk;
+    term->tail = chunk;
+    term->used = n - fit;
+  } else {
+    Chunk *tail = (Chunk *)(_arena + term->tail);
+    memcpy(tail->bytes + term->used, bytes, n);
+    term->used += n;
+  }
+  term->last = _block;
+  term->count++;
+  return true;
+}
+
+void BookSearch::readSlice(uint32_t start, uint32_t budgetMs) {
+  char raw[RAW_WORD];
+  BookSource::Pos pos;
+  while (millis() - start < budgetMs) {
+    bool fresh = _block == NO_BLOCK || _blockBytes >= BLOCK_TEXT;
+    size_t len = readWord(_source, raw, pos, _blockBytes);
+    if (!len) {
+      // The end of the book: the range is collected
+      _blocksDone = true;
+      sortTerms();
+      _written = 0;
+      _phase = Phase::WRITE;
+      return;
+    }
+    if (fresh) {
+      _block++; // From NO_BLOCK to 0
+      _blockBytes = len;
+      if (!_blocksDone)
+        _blocks.push_back(pos);
+    }
+
+    bool full = false;
+    eachTerm(raw, len, [&](const char *term, int n) {
+      int rank = rankOf(term[0]);
+      if (!full && rank >= _lo && rank < _hi && !addTerm(term, n))
+        full = true;
+    });
+    if (!full)
+      continue;
+    if (_hi - _lo > 1) {
+      // Fewer first letters at a time
+      _hi = _lo + (_hi - _lo) / 2;
+      restartPass();
+    } else if (!_cut) {
+      Serial.printf("Search: %s has too many terms, some left out\n",
+                    _book.name.c_str());
+      _cut = true;
+    }
+  }
+}
+
+// The table's terms to its front, in order
+void BookSearch::sortTerms() {
+  size_t n = 0;
+  for (size_t i = 0; i < HASH_SLOTS; i++) {
+    if (_table[i])
+      _table[n++] = _table[i];
+  }
+  const uint8_t *arena = _arena;
+  std::sort(_table, _table + n, [arena](uint32_t a, uint32_t b) {
+    return strcmp(((const Term *)(arena + a))->text,
+                  ((const Term *)(arena + b))->text) < 0;
+  });
+  _terms = n;
+}
+
+bool BookSearch::writeSlice(uint32_t start, uint32_t budgetMs) {
+  while (_written < _terms && millis() - start < budgetMs) {
+    const Term *term = (const Term *)(_arena + _table[_written]);
+    uint32_t offset = _postings;
+    for (uint32_t at = term->head; at;) {
+      const Chunk *chunk = (const Chunk *)(_arena + at);
+      size_t n = at == term->tail ? term->used : CHUNK_BYTES;
+      if (_out.write(chunk->bytes, n) != n)
+        return false;
+      _postings += n;
+      at = at == term->tail ? 0 : chunk->next;
+    }
+    if (!writeEntry(term->text, term->len, term->count, offset))
+      return false;
+    _written++;
+  }
+  if (_written < _terms)
+    return true;
+
+  _termCount += _terms;
+  if (_hi < RANKS) {
+    _lo = _hi;
+    _hi = RANKS;
+    restartPass();
+    _phase = Phase::READ;
+  } else {
+    _phase = Phase::BLOCKS;
+  }
+  return true;
+}
+
+bool BookSearch::writeEntry(const char *term, int len, uint32_t count,
+                            uint32_t offset) {
+  uint8_t entry[2 + MAX_TERM + 10];
+  for (int pass = 0; pass < 2; pass++) {
+    // Front-coded against the last term, unless it opens a block
+    int shared = 0;
+    if (_dictUsed) {
+      while (shared < len && _dictTerm[shared] == term[shared])
+        shared++;
+    }
+    size_t n = 0;
+    entry[n++] = shared;
+    entry[n++] = len - shared;
+    memcpy(entry + n, term + shared, len - shared);
+    n += len - shared;
+    n += putVarint(entry + n, count);
+    n += putVarint(entry + n, _dictUsed ? offset - _dictOffset : offset);
+    if (_dictUsed + n <= DICT_BLOCK) {
+      memcpy(_dictBuf + _dictUsed, entry, n);
+      _dictUsed += n;
+      _dictOffset = offset;
+      memcpy(_dictTerm, term, len);
+      _dictTerm[len] = 0;
+      return true;
+    }
+    if (!flushDict())
+      return false;
+  }
+  return false;
+}
+
+bool BookSearch::flushDict() {
+  if (!_dictUsed)
+    return true;
+  memset(_dictBuf + _dictUsed, 0, DICT_BLOCK - _dictUsed); // Ends the block
+  _dictUsed = 0;
+  _dictBlocks++;
+  return _dict.write(_dictBuf, DICT_BLOCK) == DICT_BLOCK;
+}
+
+// The dictionary onto the segment, then its header
+bool BookSearch::appendSlice(uint32_t start, uint32_t budgetMs) {
+  size_t total = _dictBlocks * DICT_BLOCK;
+  while (_written < total && millis() - start < budgetMs) {
+    if (_dict.read(_dictBuf, DICT_BLOCK) != DICT_BLOCK ||
+        _out.write(_dictBuf, DICT_BLOCK) != DICT_BLOCK)
+      return false;
+    _written += DICT_BLOCK;
+  }
+  if (_written < total)
+    return true;
+
+  SegmentHeader header = {};
+  header.magic = SEGMENT_MAGIC;
+  header.version = SEGMENT_VERSION;
+  header.cut = _cut;
+  header.bookSize = _source.fileSize();
+  header.blocks = _blocks.size();
+  header.terms = _termCount;
+  header.postings = sizeof(header);
+  header.blockTable = header.postings + _postings;
+  header.dictionary =
+      header.blockTable + _blocks.size() * sizeof(BookSource::Pos);
+  header.dictBlocks = _dictBlocks;
+  if (!_out.seek(0) ||
+      _out.write((const uint8_t *)&header, sizeof(header)) != sizeof(header))
+    return false;
+  finish(true);
+  return true;
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+// One term's postings, read a few bytes at a time
+struct Cursor {
+  fs::File *file;
+  uint32_t at;    // File offset of the bytes after the buffer
+  uint32_t left;  // Postings not yet decoded
+  uint32_t value; // Block of the last one
+  bool started;
+  uint8_t buf[32];
+  uint8_t pos, len;
+
+  int byte() {
+    if (pos == len) {
+      if (!file->seek(at)) // The cursors share the file
+        return -1;
+      len = file->read(buf, sizeof(buf));
+      if (!len)
+        return -1;
+      at += len;
+      pos = 0;
+    }
+    return buf[pos++];
+  }
+
+  bool next() {
+    if (!left)
+      return false;
+    uint32_t delta = 0;
+    for (int shift = 0;; shift += 7) {
+      int b = byte();
+      if (b < 0 || shift > 28)
+        return false;
+      delta |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+    value = started ? value + delta : delta;
+    started = true;
+    left--;
+    return true;
+  }
+};
+
+// First term of the dictionary block at offset
+static bool firstTerm(fs::File &file, uint32_t offset, char *term) {
+  uint8_t head[2 + BookSearch::MAX_TERM];
+  if (!file.seek(offset) || file.read(head, sizeof(head)) != sizeof(head) ||
+      head[0] != 0 || !head[1] || head[1] > BookSearch::MAX_TERM)
+    return false;
+  memcpy(term, head + 2, head[1]);
+  term[head[1]] = 0;
+  return true;
+}
+
+// Block count and postings offset of a term
+static bool lookup(fs::File &file, const SegmentHeader &header,
+                   const char *term, uint32_t &count, uint32_t &offset) {
+  if (!header.dictBlocks)
+    return false;
+  // The last block whose first term is not after it
+  uint32_t lo = 0, hi = header.dictBlocks;
+  char first[BookSearch::MAX_TERM + 1];
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (!firstTerm(file, header.dictionary + mid * BookSearch::DICT_BLOCK,
+                   first))
+      return false;
+    if (strcmp(first, term) <= 0)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  uint8_t block[BookSearch::DICT_BLOCK];
+  if (!file.seek(header.dictionary + lo * BookSearch::DICT_BLOCK) ||
+      file.read(block, sizeof(block)) != sizeof(block))
+    return false;
+  char entry[BookSearch::MAX_TERM + 1];
+  uint32_t at = 0;
+  for (size_t p = 0; p + 2 <= sizeof(block);) {
+    uint8_t shared = block[p], n = block[p + 1];
+    if (!n)
+      break; // Padding
+    if (shared + n > BookSearch::MAX_TERM || p + 2 + n > sizeof(block))
+      return false;
+    memcpy(entry + shared, block + p + 2, n);
+    entry[shared + n] = 0;
+    p += 2 + n;
+    uint32_t blocks, delta;
+    if (!getVarint(block, sizeof(block), p, blocks) ||
+        !getVarint(block, sizeof(block), p, delta))
+      return false;
+    at += delta;
+    int cmp = strcmp(entry, term);
+    if (cmp == 0) {
+      count = blocks;
+      offset = at;
+      return true;
+    }
+    if (cmp > 0)
+      break;
+  }
+  return false;
+}
+
+int BookSearch::search(const char *query, Hit *hits, int max) {
+  if (!_scanned)
+    scan();
+  char words[MAX_WORDS][MAX_TERM + 1];
+  int count = 0;
+  eachTerm(query, strlen(query), [&](const char *term, int) {
+    for (int i = 0; i < count; i++) {
+      if (!strcmp(words[i], term))
+        return;
+    }
+    if (count < MAX_WORDS)
+      strcpy(words[count++], term);
+  });
+  if (!count)
+    return 0;
+
+  int found = 0;
+  for (const Book &book : _books) {
+    if (found >= max)
+      break;
+    int n = searchBook(book, words, count, hits + found,
+                       std::min(max - found, (int)HITS_PER_BOOK));
+    if (n)
+      snippets(book, hits + found, n, words[0]);
+    found += n;
+  }
+  return found;
+}
+
+int BookSearch::searchBook(const Book &book, char words[][MAX_TERM + 1],
+                           int count, Hit *hits, int max) {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return 0;
+  char path[40];
+  segmentPath(path, sizeof(path), book.key);
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return 0; // Not indexed yet
+  SegmentHeader header;
+  if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+      header.magic != SEGMENT_MAGIC || header.version != SEGMENT_VERSION ||
+      !header.blocks)
+    return 0;
+
+  Cursor cursors[MAX_WORDS];
+  for (int i = 0; i < count; i++) {
+    Cursor &c = cursors[i];
+    c = Cursor{&file, 0, 0, 0, false, {0}, 0, 0};
+    if (!lookup(file, header, words[i], c.left, c.at))
+      return 0; // A word the book does not have
+    c.at += header.postings;
+  }
+  // The rarest word leads
+  std::sort(cursors, cursors + count, [](const Cursor &a, const Cursor &b) {
+    return a.left < b.left;
+  });
+
+  // Leapfrog: every cursor up to the furthest, until they agree
+  int found = 0;
+  for (int i = 0; i < count; i++) {
+    if (!cursors[i].next())
+      return 0;
+  }
+  while (found < max) {
+    uint32_t target = cursors[0].value;
+    bool agree = true;
+    for (int i = 1; i < count; i++) {
+      while (cursors[i].value < target) {
+        if (!cursors[i].next())
+          goto done;
+      }
+      if (cursors[i].value > target) {
+        target = cursors[i].value;
+        agree = false;
+      }
+    }
+    if (agree) {
+      Hit &hit = hits[found++];
+      strlcpy(hit.book, book.name.c_str(), sizeof(hit.book));
+      hit.percent = (uint64_t)target * 100 / header.blocks;
+      hit.snippet[0] = 0;
+      if (target >= header.blocks || !file.seek(header.blockTable +
+                                                target * sizeof(hit.pos)) ||
+          file.read((uint8_t *)&hit.pos, sizeof(hit.pos)) != sizeof(hit.pos))
+        return found - 1;
+      if (!cursors[0].next())
+        break;
+    } else {
+      while (cursors[0].value < target) {
+        if (!cursors[0].next())
+          goto done;
+      }
+    }
+  }
+done:
+  return found;
+}
+
+// Find word in each hit's block: the hit moves to it, with some text
+// around it for the list
+void BookSearch::snippets(const Book &book, Hit *hits, int count,
+                          const char *word) {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return;
+  BookSource *source = new BookSource();
+  String path = String(BOOKS_DIR) + "/" + book.name;
+  if (!source->open(path.c_str())) {
+    delete source;
+    return;
+  }
+  for (int h = 0; h < count; h++) {
+    Hit &hit = hits[h];
+    if (!source->seek(hit.pos))
+      continue;
+    char raw[RAW_WORD];
+    char folded[RAW_WORD * 3 + 8];
+    char *text = hit.snippet;
+    size_t used = 0;
+    bool found = false;
+    uint32_t bytes = 0;
+    BookSource::Pos pos;
+    while (bytes < 2 * BLOCK_TEXT) {
+      size_t len = readWord(*source, raw, pos, bytes);
+      if (!len)
+        break;
+      size_t n = PageLayout::fold(raw, len, folded, sizeof(folded));
+      bool match = false;
+      if (!found) {
+        eachTerm(raw, len, [&](const char *term, int) {
+          match = match || !strcmp(term, word);
+        });
+        if (match) {
+          found = true;
+          hit.pos = pos;
+          // Keep the last words before it, a third of the snippet
+          while (used > SNIPPET / 3) {
+            char *space = strchr(text, ' ');
+            if (!space)
+              break;
+            used -= space + 1 - text;
+            memmove(text, space + 1, used + 1);
+          }
+        }
+      }
+      if (used + n + 1 >= SNIPPET) {
+        if (found && !match)
+          break; // Full
+        used = 0;  // The words before give way
+        n = std::min(n, SNIPPET - 1);
+      }
+      if (used)
+        text[used++] = ' ';
+      memcpy(text + used, folded, n);
+      used += n;
+      text[used] = 0;
+    }
+  }
+  delete source;
+}
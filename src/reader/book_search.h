@@ -0,0 +1,156 @@
+/**
+ * Book Search
+ *
+ * Full-text search over /books from an inverted index on the card, built
+ * a slice at a time while the device has nothing better to do. Each book
+ * has a segment, /books/.cache/<book>.fts (named by PageIndex::key()):
+ *
+ *   header      counts and where the parts below start
+ *   postings    per term, the blocks it occurs in: rising block numbers,
+ *               each a varint of its difference from the one before
+ *   blocks      where each block starts (BookSource::Pos)
+ *   dictionary  the terms in order, in DICT_BLOCK-byte blocks that each
+ *               open with a whole term; the rest share the previous
+ *               term's prefix. An entry has its term's block count and
+ *               postings offset
+ *
+ * A block is about BLOCK_TEXT bytes of text, starting at a word. A term is
+ * a run of letters and digits, folded to lower-case ASCII (PageLayout::
+ * fold(), so "Café" is "cafe"), MIN_TERM to MAX_TERM long.
+ *
+ * Building reads the book once per pass and keeps the terms of one range
+ * of first letters, with their postings, in a PSRAM arena of BUILD_BUDGET
+ * bytes; a range that overflows it is halved and the pass starts over.
+ * Each pass appends its range's postings to the segment, and dictionary
+ * blocks to a second file that goes on the end once the last range is
+ * done. A segment that is there is complete: it is written under a
+ * temporary name and renamed.
+ *
+ * A query is the words that must all occur in one block. Per book, each
+ * word is a binary search of the dictionary blocks (one short read per
+ * probe) and one block scan; their postings are then read through small
+ * buffers and intersected as they stream. Memory stays the same whatever
+ * the size of the book or index.
+ *
+ * Call from the loop task; SD access is taken as needed.
+ */
+
+#ifndef BOOK_SEARCH_H
+#define BOOK_SEARCH_H
+
+#include "book_source.h"
+#include "reader.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+
+class BookSearch {
+public:
+  static const size_t BLOCK_TEXT = 1024; // Text per block (to a word start)
+  static const int MIN_TERM = 2;
+  static const int MAX_TERM = 24;        // Longer runs are cut
+  static const int MAX_WORDS = 4;        // Query words used
+  static const int HITS_PER_BOOK = 5;
+  static const size_t DICT_BLOCK = 512;
+  static const size_t BUILD_BUDGET = 1024 * 1024; // Terms and postings
+  static const size_t SNIPPET = 60;
+
+  struct Hit {
+    char book[Reader::MAX_NAME];
+    BookSource::Pos pos; // First query word in the block
+    uint8_t percent;     // How far into the book
+    char snippet[SNIPPET]; // Folded text from a little before it
+  };
+
+  BookSearch();
+  ~BookSearch();
+  BookSearch(const BookSearch &) = delete;
+  BookSearch &operator=(const BookSearch &) = delete;
+
+  /**
+   * Look at /books again before the next step or query: new and changed
+   * books get segments, segments of books that went go
+   */
+  void rescan() { _scanned = false; }
+
+  /**
+   * There is indexing to do (or /books to look at)
+   */
+  bool pending() const { return !_scanned || _building || !_queue.empty(); }
+
+  /**
+   * Index for up to budgetMs
+   * @return pending()
+   */
+  bool step(uint32_t budgetMs);
+
+  size_t books() const { return _books.size(); }
+  size_t indexed() const { return _indexed; }
+
+  /**
+   * Blocks of the indexed books that hold every word of query, in library
+   * order, up to HITS_PER_BOOK a book
+   * @return number of hits written (at most max)
+   */
+  int search(const char *query, Hit *hits, int max);
+
+private:
+  struct Book {
+    String name;
+    uint32_t key; // PageIndex::key()
+  };
+
+  enum class Phase : uint8_t { READ, WRITE, BLOCKS, APPEND };
+
+  bool _scanned;
+  std::vector<Book> _books;  // /books at the last scan, by name
+  std::vector<size_t> _queue; // Of _books, to index
+  size_t _indexed;
+
+  // The book being indexed
+  bool _building;
+  Book _book;
+  uint32_t _generation; // SD mount its files were opened on
+  BookSource _source;
+  fs::File _out;  // Segment, under TEMP_PATH
+  fs::File _dict; // Dictionary blocks, under DICT_PATH
+  Phase _phase;
+  uint8_t _lo, _hi;  // Pass: terms whose first character's rank is in here
+  bool _blocksDone;  // A pass has read the whole book: _blocks is full
+  bool _cut;         // Terms were dropped: one character overflowed
+  std::vector<BookSource::Pos> _blocks;
+  uint32_t _block;      // Number of the block being read
+  uint32_t _blockBytes; // Read since it started
+  uint8_t *_arena;      // Terms and postings chunks (PSRAM)
+  size_t _arenaUsed;
+  uint32_t *_table; // Hash of the terms to their arena offsets (PSRAM)
+  size_t _terms;    // In _table; sorted to its front for WRITE
+  size_t _written;  // WRITE: terms written; APPEND: bytes copied
+  uint32_t _termCount;   // All passes
+  uint32_t _postings;    // Bytes of postings written
+  uint8_t _dictBuf[DICT_BLOCK];
+  size_t _dictUsed;
+  uint32_t _dictBlocks;
+  uint32_t _dictOffset;  // Last entry's postings offset
+  char _dictTerm[MAX_TERM + 1]; // and its term
+
+  void scan();
+  void begin(size_t book);
+  void finish(bool ok);
+  bool addTerm(const char *term, int len);
+  void restartPass();
+  void readSlice(uint32_t start, uint32_t budgetMs);
+  void sortTerms();
+  bool writeSlice(uint32_t start, uint32_t budgetMs);
+  bool writeEntry(const char *term, int len, uint32_t count,
+                  uint32_t offset);
+  bool flushDict();
+  bool appendSlice(uint32_t start, uint32_t budgetMs);
+  static void segmentPath(char *path, size_t cap, uint32_t key);
+  static bool validSegment(uint32_t key, uint32_t bookSize);
+  int searchBook(const Book &book, char words[][MAX_TERM + 1], int count,
+                 Hit *hits, int max);
+  void snippets(const Book &book, Hit *hits, int count, const char *word);
+};
+
+#endif // BOOK_SEARCH_H
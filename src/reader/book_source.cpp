@@ -0,0 +1,689 @@
+/**
+ * Book Source Implementation
+ */
+
+#include "book_source.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include <esp_heap_caps.h>
+
+#define ZIP_LOCAL_SIG 0x04034B50
+#define ZIP_CENTRAL_SIG 0x02014B50
+#define ZIP_END_SIG 0x06054B50
+
+static const size_t ZIP_END_SEARCH = 4096; // Tail scanned for the directory
+static const size_t MAX_CONTAINER = 8192;
+static const size_t MAX_PATH = 256;
+
+static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// FNV-1a: zip entries are looked up by the hash of their path
+static uint32_t hashPath(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ (uint8_t)s[i]) * 16777619u;
+  return h;
+}
+
+static bool isSpace(int c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+static uint8_t *allocBuffer(size_t len) {
+  uint8_t *p = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+  return p ? p : (uint8_t *)malloc(len);
+}
+
+BookSource::BookSource()
+    : _open(false), _epub(false), _fileSize(0), _bufPos(0), _bufLen(0),
+      _bufStart(0), _entryLeft(0), _deflated(false), _ahead(END),
+      _aheadPos{0, 0, 0}, _chapter(0), _produced(0), _lastOut('\n'),
+      _hardWrap(false), _mode(Mode::TEXT), _tagLen(0), _tagClose(false),
+      _tagNamed(false), _tagSelfClose(false), _quote(0), _entityLen(0),
+      _dashes(0), _skip(0), _pendingSpace(false), _pendingBreak(false),
+      _queueHead(0), _queueLen(0) {}
+
+bool BookSource::open(const char *path) {
+  close();
+  _file = sdFS().open(path, FILE_READ);
+  if (!_file)
+    return false;
+  _fileSize = _file.size();
+  const char *dot = strrchr(path, '.');
+  _epub = dot && strcasecmp(dot, ".epub") == 0;
+
+  bool ok = _epub ? openEpub() : sniffHardWrap();
+  if (!ok) {
+    LOG_W("Reader", "%s has no readable text", path);
+    close();
+    return false;
+  }
+  _open = true;
+  return seek({0, 0, 0});
+}
+
+void BookSource::close() {
+  if (_file)
+    _file.close();
+  _inflater.end();
+  std::vector<ZipEntry>().swap(_spine);
+  _open = false;
+  _ahead = END;
+}
+
+// ============================================================================
+// Raw bytes
+// ============================================================================
+
+int BookSource::rawGet() {
+  if (_bufPos == _bufLen) {
+    size_t n;
+    if (!_epub) {
+      _bufStart += _bufLen;
+      n = _file.read(_buf, BUFFER);
+    } else if (_deflated) {
+      n = _inflater.read(_buf, BUFFER);
+    } else {
+      size_t want = _entryLeft < BUFFER ? _entryLeft : BUFFER;
+      n = want ? _file.read(_buf, want) : 0;
+      _entryLeft -= n;
+    }
+    _bufPos = 0;
+    _bufLen = n;
+    if (n == 0)
+      return END;
+  }
+  return _buf[_bufPos++];
+}
+
+// Only straight after a rawGet() that returned a byte
+void BookSource::rawUnget() { _bufPos--; }
+
+// ============================================================================
+// Positions
+// ============================================================================
+
+bool BookSource::seek(Pos pos) {
+  if (!_open)
+    return false;
+
+  if (!_epub) {
+    if (pos.offset > _fileSize || !_file.seek(pos.offset))
+      return false;
+    _bufStart = pos.offset;
+    _bufPos = _bufLen = 0;
+    _lastOut = '\n';
+    fill();
+    return true;
+  }
+
+  if (pos.chapter >= _spine.size())
+    return false;
+  // Forward within the chapter just reads on; anything else replays it
+  if (pos.chapter != _aheadPos.chapter || pos.offset < _aheadPos.offset ||
+      _ahead == END) {
+    openChapter(pos.chapter);
+    fill();
+  }
+  while (_ahead != END && _aheadPos.chapter == pos.chapter &&
+         _aheadPos.offset < pos.offset)
+    next();
+  return true;
+}
+
+int BookSource::next() {
+  int c = _ahead;
+  if (c != END)
+    fill();
+  return c;
+}
+
+void BookSource::fill() {
+  for (;;) {
+    int c = _epub ? fillEpub() : fillTxt();
+    if (c != END || !_epub || _chapter + 1 >= (int)_spine.size()) {
+      _ahead = c;
+      return;
+    }
+    openChapter(_chapter + 1); // Runs on into the next chapter
+  }
+}
+
+// ============================================================================
+// TXT
+// ============================================================================
+
+bool BookSource::sniffHardWrap() {
+  // Hard-wrapped text (Project Gutenberg and the like) has short lines and
+  // blank lines between paragraphs; there a single newline is a space
+  int lines = 0, blanks = 0, lineLen = 0, longest = 0;
+  for (int chunk = 0; chunk < 8; chunk++) {
+    size_t n = _file.read(_buf, BUFFER);
+    for (size_t i = 0; i < n; i++) {
+      if (_buf[i] == '\n') {
+        if (lineLen == 0)
+          blanks++;
+        else
+          lines++;
+        if (lineLen > longest)
+          longest = lineLen;
+        lineLen = 0;
+      } else if (_buf[i] != '\r') {
+        lineLen++;
+      }
+    }
+    if (n < BUFFER)
+      break;
+  }
+  _hardWrap = lines >= 4 && blanks > 0 && longest <= 100;
+  return true;
+}
+
+int BookSource::fillTxt() {
+  for (;;) {
+    uint32_t start = _bufStart + (uint32_t)_bufPos;
+    int c = rawGet();
+    if (c == END || !isSpace(c)) {
+      _aheadPos = {0, 0, start};
+      if (c != END)
+        _lastOut = c;
+      return c;
+    }
+
+    // A run of white space: one space, or a paragraph break
+    int newlines = 0;
+    while (c != END && isSpace(c)) {
+      if (c == '\n')
+        newlines++;
+      c = rawGet();
+    }
+    if (c == END) {
+      _aheadPos = {0, 0, (uint32_t)(_bufStart + _bufPos)};
+      return END; // Trailing space
+    }
+    rawUnget();
+    if (_lastOut == '\n')
+      continue; // Leading space of a paragraph
+    bool paragraph = _hardWrap ? newlines >= 2 : newlines >= 1;
+    _lastOut = paragraph ? '\n' : ' ';
+    _aheadPos = {0, 0, start};
+    return _lastOut;
+  }
+}
+
+// ============================================================================
+// EPUB container
+// ============================================================================
+
+bool BookSource::readCentralDirectory(std::vector<ZipEntry> &entries) {
+  if (_fileSize < 22)
+    return false;
+  size_t tail = _fileSize < ZIP_END_SEARCH ? _fileSize : ZIP_END_SEARCH;
+  uint8_t *buf = (uint8_t *)malloc(tail);
+  if (!buf)
+    return false;
+  bool ok = _file.seek(_fileSize - tail) && _file.read(buf, tail) == tail;
+  int end = -1;
+  for (int i = (int)tail - 22; ok && i >= 0; i--) {
+    if (le32(buf + i) == ZIP_END_SIG) {
+      end = i;
+      break;
+    }
+  }
+  uint16_t count = end >= 0 ? le16(buf + end + 10) : 0;
+  uint32_t offset = end >= 0 ? le32(buf + end + 16) : 0;
+  free(buf);
+  if (end < 0 || !_file.seek(offset))
+    return false;
+
+  entries.reserve(count);
+  uint8_t header[46];
+  char name[MAX_PATH];
+  for (uint16_t i = 0; i < count; i++) {
+    if (_file.read(header, sizeof(header)) != sizeof(header) ||
+        le32(header) != ZIP_CENTRAL_SIG)
+      return false;
+    uint16_t nameLen = le16(header + 28);
+    uint32_t skip = le16(header + 30) + le16(header + 32);
+    size_t keep = nameLen < MAX_PATH ? nameLen : MAX_PATH;
+    if (_file.read((uint8_t *)name, keep) != keep)
+      return false;
+    skip += nameLen - keep;
+    if (skip && !_file.seek(_file.position() + skip))
+      return false;
+    entries.push_back({hashPath(name, keep), le32(header + 42),
+                       le32(header + 20), le32(header + 24),
+                       le16(header + 10)});
+  }
+  return true;
+}
+
+const BookSource::ZipEntry *
+BookSource::findEntry(const std::vector<ZipEntry> &entries, const char *path) {
+  uint32_t hash = hashPath(path, strlen(path));
+  for (const ZipEntry &entry : entries) {
+    if (entry.nameHash == hash)
+      return &entry;
+  }
+  return nullptr;
+}
+
+bool BookSource::beginEntry(const ZipEntry &entry) {
+  _bufPos = _bufLen = 0;
+  _entryLeft = 0;
+  _deflated = false;
+  uint8_t header[30];
+  if (!_file.seek(entry.offset) ||
+      _file.read(header, sizeof(header)) != sizeof(header) ||
+      le32(header) != ZIP_LOCAL_SIG)
+    return false;
+  uint32_t data = entry.offset + 30 + le16(header + 26) + le16(header + 28);
+  if (!_file.seek(data))
+    return false;
+  if (entry.method == 8) {
+    _deflated = _inflater.begin(&_file, entry.compressed);
+    return _deflated;
+  }
+  if (entry.method != 0)
+    return false; // Neither stored nor deflated
+  _entryLeft = entry.size;
+  return true;
+}
+
+// Whole (small) entry into a null-terminated buffer; the caller frees it
+uint8_t *BookSource::readEntry(const ZipEntry &entry, size_t limit,
+                               size_t &len) {
+  if (entry.size > limit || !beginEntry(entry))
+    return nullptr;
+  uint8_t *data = allocBuffer(entry.size + 1);
+  if (!data)
+    return nullptr;
+  len = 0;
+  int c;
+  while (len < entry.size && (c = rawGet()) != END)
+    data[len++] = c;
+  data[len] = 0;
+  return data;
+}
+
+// Value of attribute name in the tag [tag, end), into out
+static bool attribute(const char *tag, const char *end, const char *name,
+                      char *out, size_t outLen) {
+  size_t nameLen = strlen(name);
+  for (const char *p = tag; p + nameLen + 2 < end; p++) {
+    if (!isSpace(p[-1]) || strncmp(p, name, nameLen) != 0 ||
+        p[nameLen] != '=')
+      continue;
+    char quote = p[nameLen + 1];
+    if (quote != '"' && quote != '\'')
+      continue;
+    const char *v = p + nameLen + 2;
+    size_t n = 0;
+    while (v < end && *v != quote && n + 1 < outLen)
+      out[n++] = *v++;
+    out[n] = 0;
+    return true;
+  }
+  return false;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c |= 0x20;
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Join an href to the directory of the package document: percent escapes
+// decoded, the fragment dropped, "." and ".." segments resolved
+static void resolvePath(const char *base, size_t baseLen, const char *href,
+                        char *out, size_t outLen) {
+  char joined[MAX_PATH];
+  size_t n = baseLen < MAX_PATH - 1 ? baseLen : MAX_PATH - 1;
+  memcpy(joined, base, n);
+  for (const char *p = href; *p && *p != '#' && n + 1 < MAX_PATH; p++) {
+    if (*p == '%' && hexValue(p[1]) >= 0 && hexValue(p[2]) >= 0) {
+      joined[n++] = hexValue(p[1]) << 4 | hexValue(p[2]);
+      p += 2;
+    } else {
+      joined[n++] = *p;
+    }
+  }
+  joined[n] = 0;
+
+  size_t o = 0;
+  const char *seg = joined;
+  while (*seg) {
+    const char *slash = strchr(seg, '/');
+    size_t len = slash ? (size_t)(slash - seg) : strlen(seg);
+    if (len == 2 && seg[0] == '.' && seg[1] == '.') {
+      while (o > 0 && out[--o] != '/') {
+      }
+    } else if (len > 0 && !(len == 1 && seg[0] == '.')) {
+      if (o > 0 && o + 1 < outLen)
+        out[o++] = '/';
+      for (size_t i = 0; i < len && o + 1 < outLen; i++)
+        out[o++] = seg[i];
+    }
+    seg += len + (slash ? 1 : 0);
+  }
+  out[o] = 0;
+}
+
+bool BookSource::parsePackage(const std::vector<ZipEntry> &entries,
+                              const char *opfPath, const char *opf,
+                              size_t len) {
+  const char *slash = strrchr(opfPath, '/');
+  size_t baseLen = slash ? slash - opfPath + 1 : 0;
+
+  // Manifest items with (X)HTML content; the spine refers to them by id
+  struct Item {
+    uint32_t idHash;
+    const ZipEntry *entry;
+  };
+  std::vector<Item> items;
+  char id[64], href[MAX_PATH], type[48], path[MAX_PATH];
+
+  const char *end = opf + len;
+  for (const char *p = opf; p < end;) {
+    const char *open = (const char *)memchr(p, '<', end - p);
+    if (!open)
+      break;
+    const char *close = (const char *)memchr(open, '>', end - open);
+    if (!close)
+      break;
+    p = close + 1;
+
+    // Tag name, without a namespace prefix
+    const char *name = open + 1;
+    const char *nameEnd = name;
+    while (nameEnd < close && !isSpace(*nameEnd) && *nameEnd != '/')
+      nameEnd++;
+    const char *colon = (const char *)memchr(name, ':', nameEnd - name);
+    if (colon)
+      name = colon + 1;
+    size_t nameLen = nameEnd - name;
+
+    if (nameLen == 4 && strncmp(name, "item", 4) == 0) {
+      if (!attribute(nameEnd, close, "id", id, sizeof(id)) ||
+          !attribute(nameEnd, close, "href", href, sizeof(href)) ||
+          !attribute(nameEnd, close, "media-type", type, sizeof(type)) ||
+          !strstr(type, "html"))
+        continue;
+      resolvePath(opfPath, baseLen, href, path, sizeof(path));
+      const ZipEntry *entry = findEntry(entries, path);
+      if (entry)
+        items.push_back({hashPath(id, strlen(id)), entry});
+    } else if (nameLen == 7 && strncmp(name, "itemref", 7) == 0) {
+      if (!attribute(nameEnd, close, "idref", id, sizeof(id)))
+        continue;
+      uint32_t hash = hashPath(id, strlen(id));
+      for (const Item &item : items) {
+        if (item.idHash == hash) {
+          _spine.push_back(*item.entry);
+          break;
+        }
+      }
+    }
+  }
+  return !_spine.empty();
+}
+
+bool BookSource::openEpub() {
+  std::vector<ZipEntry> entries;
+  if (!readCentralDirectory(entries))
+    return false;
+
+  // META-INF/container.xml names the package document
+  const ZipEntry *container = findEntry(entries, "META-INF/container.xml");
+  size_t len;
+  uint8_t *xml = container ? readEntry(*container, MAX_CONTAINER, len)
+                           : nullptr;
+  if (!xml)
+    return false;
+  char opfPath[MAX_PATH] = "";
+  const char *rootfile = strstr((const char *)xml, "<rootfile");
+  while (rootfile && !isSpace(rootfile[9])) // Not <rootfiles>
+    rootfile = strstr(rootfile + 9, "<rootfile");
+  if (rootfile) {
+    const char *close = strchr(rootfile, '>');
+    attribute(rootfile + 9, close ? close : rootfile + strlen(rootfile),
+              "full-path", opfPath, sizeof(opfPath));
+  }
+  free(xml);
+
+  const ZipEntry *package = opfPath[0] ? findEntry(entries, opfPath) : nullptr;
+  uint8_t *opf = package ? readEntry(*package, MAX_OPF, len) : nullptr;
+  if (!opf)
+    return false;
+  bool ok = parsePackage(entries, opfPath, (const char *)opf, len);
+  free(opf);
+  LOG_I("Reader", "EPUB: %u entries, %u chapters", (unsigned)entries.size(),
+        (unsigned)_spine.size());
+  return ok;
+}
+
+// ============================================================================
+// EPUB text
+// ============================================================================
+
+bool BookSource::openChapter(uint16_t chapter) {
+  _chapter = chapter;
+  _produced = 0;
+  _lastOut = '\n';
+  _mode = Mode::TEXT;
+  _skip = 0;
+  _pendingSpace = _pendingBreak = false;
+  _queueHead = _queueLen = 0;
+  if (beginEntry(_spine[chapter]))
+    return true;
+  // Unreadable: an empty chapter
+  _bufPos = _bufLen = 0;
+  _entryLeft = 0;
+  _deflated = false;
+  return false;
+}
+
+void BookSource::push(uint8_t c) {
+  _queue[(_queueHead + _queueLen++) % sizeof(_queue)] = c;
+  _lastOut = c;
+}
+
+// A byte of text, after the break or space the markup before it left
+void BookSource::emit(uint8_t c) {
+  if (_pendingBreak) {
+    if (_lastOut != '\n')
+      push('\n');
+  } else if (_pendingSpace && _lastOut != '\n' && _lastOut != ' ') {
+    push(' ');
+  }
+  _pendingBreak = _pendingSpace = false;
+  push(c);
+}
+
+void BookSource::emitCodepoint(uint32_t cp) {
+  if (cp == 0 || cp > 0x10FFFF)
+    return;
+  if (cp < 0x80 && isSpace(cp)) {
+    _pendingSpace = true;
+    return;
+  }
+  if (cp < 0x80) {
+    emit(cp);
+  } else if (cp < 0x800) {
+    emit(0xC0 | cp >> 6);
+    push(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    emit(0xE0 | cp >> 12);
+    push(0x80 | (cp >> 6 & 0x3F));
+    push(0x80 | (cp & 0x3F));
+  } else {
+    emit(0xF0 | cp >> 18);
+    push(0x80 | (cp >> 12 & 0x3F));
+    push(0x80 | (cp >> 6 & 0x3F));
+    push(0x80 | (cp & 0x3F));
+  }
+}
+
+void BookSource::emitEntity() {
+  static const struct {
+    const char *name;
+    uint16_t cp;
+  } NAMED[] = {{"amp", '&'},       {"lt", '<'},         {"gt", '>'},
+               {"quot", '"'},      {"apos", '\''},      {"nbsp", 0xA0},
+               {"shy", 0xAD},      {"copy", 0xA9},      {"ndash", 0x2013},
+               {"mdash", 0x2014},  {"lsquo", 0x2018},   {"rsquo", 0x2019},
+               {"ldquo", 0x201C},  {"rdquo", 0x201D},   {"hellip", 0x2026}};
+  _entity[_entityLen] = 0;
+  if (_entity[0] == '#') {
+    bool hex = _entity[1] == 'x' || _entity[1] == 'X';
+    emitCodepoint(strtoul(_entity + (hex ? 2 : 1), nullptr, hex ? 16 : 10));
+    return;
+  }
+  for (const auto &named : NAMED) {
+    if (strcmp(_entity, named.name) == 0) {
+      emitCodepoint(named.cp);
+      return;
+    }
+  }
+  // Unknown: keep it as written
+  emit('&');
+  for (uint8_t i = 0; i < _entityLen; i++)
+    push(_entity[i]);
+  push(';');
+}
+
+void BookSource::endTag() {
+  _tag[_tagLen] = 0;
+  const char *colon = strchr(_tag, ':');
+  const char *name = colon ? colon + 1 : _tag;
+
+  static const char *const SKIPPED[] = {"head", "style", "script"};
+  for (const char *skipped : SKIPPED) {
+    if (strcmp(name, skipped) == 0) {
+      if (_tagClose) {
+        if (_skip)
+          _skip--;
+      } else if (!_tagSelfClose) {
+        _skip++;
+      }
+      return;
+    }
+  }
+
+  static const char *const BLOCKS[] = {
+      "p",  "div", "br", "h1", "h2", "h3", "h4", "h5", "h6", "li",
+      "tr", "hr",  "dt", "dd", "ul", "ol", "pre", "table", "blockquote",
+      "section", "article", "aside", "header", "footer", "figure",
+      "figcaption"};
+  for (const char *block : BLOCKS) {
+    if (strcmp(name, block) == 0) {
+      _pendingBreak = true;
+      return;
+    }
+  }
+}
+
+int BookSource::fillEpub() {
+  while (_queueLen == 0) {
+    int c = rawGet();
+    if (c == END) {
+      _aheadPos = {_chapter, 0, _produced};
+      return END;
+    }
+
+    switch (_mode) {
+    case Mode::TEXT:
+      if (c == '<') {
+        _mode = Mode::TAG;
+        _tagLen = 0;
+        _tagClose = _tagNamed = _tagSelfClose = false;
+        _quote = 0;
+      } else if (_skip) {
+        // Inside <head>, <style> or <script>
+      } else if (c == '&') {
+        _mode = Mode::ENTITY;
+        _entityLen = 0;
+      } else if (isSpace(c)) {
+        _pendingSpace = true;
+      } else {
+        emit(c);
+      }
+      break;
+
+    case Mode::ENTITY:
+      if (c == ';') {
+        if (!_skip)
+          emitEntity();
+        _mode = Mode::TEXT;
+      } else if ((isalnum(c) || c == '#') &&
+                 _entityLen < sizeof(_entity) - 1) {
+        _entity[_entityLen++] = c;
+      } else {
+        // A bare '&': keep the text as written, then look at c again
+        emit('&');
+        for (uint8_t i = 0; i < _entityLen; i++)
+          push(_entity[i]);
+        _mode = Mode::TEXT;
+        rawUnget();
+      }
+      break;
+
+    case Mode::TAG:
+      if (_quote) {
+        if (c == _quote)
+          _quote = 0;
+      } else if (c == '>') {
+        endTag();
+        _mode = Mode::TEXT;
+      } else if (!_tagNamed && _tagLen == 0 && c == '/') {
+        _tagClose = true;
+      } else if (!_tagNamed && _tagLen == 0 && (c == '!' || c == '?')) {
+        _mode = Mode::DECL;
+        _dashes = c == '!' ? 0 : 2; // Only "<!--" opens a comment
+      } else if (!_tagNamed && (isalnum(c) || c == ':')) {
+        if (_tagLen < sizeof(_tag) - 1)
+          _tag[_tagLen++] = tolower(c);
+      } else {
+        _tagNamed = true;
+        _tagSelfClose = c == '/';
+        if (c == '"' || c == '\'')
+          _quote = c;
+      }
+      break;
+
+    case Mode::DECL:
+      if (c == '>') {
+        _mode = Mode::TEXT;
+      } else if (c == '-' && _dashes < 2) {
+        if (++_dashes == 2) {
+          _mode = Mode::COMMENT;
+          _dashes = 0;
+        }
+      } else {
+        _dashes = 2; // <!DOCTYPE ...>, <![CDATA[...]]>, <?xml ...?>
+      }
+      break;
+
+    case Mode::COMMENT:
+      if (c == '-') {
+        _dashes++;
+      } else {
+        if (c == '>' && _dashes >= 2)
+          _mode = Mode::TEXT;
+        _dashes = 0;
+      }
+      break;
+    }
+  }
+
+  uint8_t c = _queue[_queueHead];
+  _queueHead = (_queueHead + 1) % sizeof(_queue);
+  _queueLen--;
+  _aheadPos = {_chapter, 0, _produced++};
+  return c;
+}
@@ -0,0 +1,159 @@
+/**
+ * Book Source
+ *
+ * The text of a book on the card as one stream of UTF-8: runs of white
+ * space come out as a single space and paragraph breaks as '\n'. Only the
+ * current chapter's decoder state is held in RAM.
+ *
+ * - TXT is read in place. Hard-wrapped files (short lines with blank lines
+ *   between paragraphs) are recognised on open and their lines rejoined.
+ * - EPUB is a zip. The central directory is read once for the entries'
+ *   offsets, container.xml and the OPF give the reading order (spine), and
+ *   each chapter's XHTML is inflated and tokenized as it is read: markup,
+ *   <head>, <style> and <script> are dropped, block elements end
+ *   paragraphs and entities are decoded.
+ *
+ * A Pos names a chapter (spine item; TXT has one) and an offset the source
+ * can restart from: the byte offset in a TXT file, or for EPUB the count
+ * of text bytes the chapter has produced, which re-inflating replays
+ * exactly. Seeking back within an EPUB chapter re-inflates it from the
+ * start.
+ *
+ * Call under SDAccess; after a remount the caller reopens the book.
+ */
+
+#ifndef BOOK_SOURCE_H
+#define BOOK_SOURCE_H
+
+#include "inflate.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+
+class BookSource {
+public:
+  static const int END = -1;
+  static const size_t BUFFER = 512;
+  static const size_t MAX_OPF = 128 * 1024; // Largest package document
+
+  struct Pos {
+    uint16_t chapter;
+    uint16_t reserved;
+    uint32_t offset;
+
+    bool operator==(const Pos &o) const {
+      return chapter == o.chapter && offset == o.offset;
+    }
+    bool operator!=(const Pos &o) const { return !(*this == o); }
+    bool operator<(const Pos &o) const {
+      return chapter != o.chapter ? chapter < o.chapter : offset < o.offset;
+    }
+  };
+
+  BookSource();
+  ~BookSource() { close(); }
+  BookSource(const BookSource &) = delete;
+  BookSource &operator=(const BookSource &) = delete;
+
+  /**
+   * Open a .txt or .epub file and position at its start
+   * @return false if it cannot be read or has no text chapters
+   */
+  bool open(const char *path);
+  void close();
+  bool isOpen() const { return _open; }
+
+  uint32_t fileSize() const { return _fileSize; }
+  uint16_t chapters() const { return _epub ? _spine.size() : 1; }
+  bool isEpub() const { return _epub; }
+
+  /**
+   * Continue from pos (a value tell() returned for this book)
+   */
+  bool seek(Pos pos);
+
+  /**
+   * Next byte without consuming it, or END
+   */
+  int peek() const { return _ahead; }
+  int next();
+
+  /**
+   * Position of the byte peek() returns
+   */
+  Pos tell() const { return _aheadPos; }
+
+private:
+  // One zip entry, named by the hash of its full path
+  struct ZipEntry {
+    uint32_t nameHash;
+    uint32_t offset; // Local header
+    uint32_t compressed;
+    uint32_t size;
+    uint16_t method; // 0 stored, 8 deflate
+  };
+
+  enum class Mode : uint8_t { TEXT, TAG, ENTITY, COMMENT, DECL };
+
+  fs::File _file;
+  bool _open;
+  bool _epub;
+  uint32_t _fileSize;
+
+  // Raw bytes of the current chapter
+  uint8_t _buf[BUFFER];
+  size_t _bufPos, _bufLen;
+  uint32_t _bufStart;   // TXT: file offset of _buf[0]
+  uint32_t _entryLeft;  // EPUB stored entry: bytes not yet buffered
+  bool _deflated;
+  Inflater _inflater;
+
+  // Next byte out
+  int _ahead;
+  Pos _aheadPos;
+  uint16_t _chapter;
+  uint32_t _produced; // EPUB: text bytes the chapter has handed out
+  char _lastOut;      // Last byte decoded, '\n' at a paragraph start
+
+  // TXT
+  bool _hardWrap;
+
+  // EPUB
+  std::vector<ZipEntry> _spine; // Entry of each chapter, in reading order
+  Mode _mode;
+  char _tag[16];
+  uint8_t _tagLen;
+  bool _tagClose, _tagNamed, _tagSelfClose;
+  char _quote;
+  char _entity[12];
+  uint8_t _entityLen;
+  uint8_t _dashes; // Comment: run of '-' just seen, for "-->"
+  uint8_t _skip;   // Inside <head>, <style> or <script>
+  bool _pendingSpace, _pendingBreak;
+  uint8_t _queue[16]; // Bytes decoded but not yet handed out
+  uint8_t _queueHead, _queueLen;
+
+  int rawGet();
+  void rawUnget();
+  bool openChapter(uint16_t chapter);
+  void fill();
+  int fillTxt();
+  int fillEpub();
+  void endTag();
+  void emit(uint8_t c);
+  void emitCodepoint(uint32_t cp);
+  void emitEntity();
+  void push(uint8_t c);
+
+  bool openEpub();
+  bool readCentralDirectory(std::vector<ZipEntry> &entries);
+  static const ZipEntry *findEntry(const std::vector<ZipEntry> &entries,
+                                   const char *path);
+  uint8_t *readEntry(const ZipEntry &entry, size_t limit, size_t &len);
+  bool beginEntry(const ZipEntry &entry);
+  bool parsePackage(const std::vector<ZipEntry> &entries,
+                    const char *opfPath, const char *opf, size_t len);
+  bool sniffHardWrap();
+};
+
+#endif // BOOK_SOURCE_H
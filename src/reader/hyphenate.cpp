@@ -0,0 +1,98 @@
+/**
+ * Hyphenation Implementation
+ */
+
+#include "hyphenate.h"
+#include "hyphen_patterns.h"
+
+static const size_t TABLE_LEN = sizeof(HYPHEN_PATTERNS) - 1;
+
+static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Letters of the pattern at p (digits skipped) against key[0..len):
+// below zero if the pattern sorts first, zero if they are equal
+static int compare(const char *p, const char *key, size_t len) {
+  size_t k = 0;
+  for (; *p && *p != ' '; p++) {
+    if (isDigit(*p))
+      continue;
+    if (k == len)
+      return 1; // Longer, key is a prefix
+    if (*p != key[k])
+      return (uint8_t)*p < (uint8_t)key[k] ? -1 : 1;
+    k++;
+  }
+  return k == len ? 0 : -1;
+}
+
+// The pattern's letters start with key[0..len)
+static bool extends(const char *p, const char *key, size_t len) {
+  size_t k = 0;
+  for (; k < len && *p && *p != ' '; p++) {
+    if (isDigit(*p))
+      continue;
+    if (*p != key[k])
+      return false;
+    k++;
+  }
+  return k == len;
+}
+
+// Start of the first pattern not below key[0..len), or TABLE_LEN
+static size_t lowerBound(const char *key, size_t len) {
+  size_t lo = 0, hi = TABLE_LEN; // Both pattern starts (or the end)
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    while (mid > lo && HYPHEN_PATTERNS[mid - 1] != ' ')
+      mid--;
+    if (compare(HYPHEN_PATTERNS + mid, key, len) < 0) {
+      while (mid < TABLE_LEN && HYPHEN_PATTERNS[mid] != ' ')
+        mid++;
+      lo = mid < TABLE_LEN ? mid + 1 : TABLE_LEN;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+int Hyphenate::points(const char *word, size_t len, uint8_t *out, int cap) {
+  if (len < (size_t)(LEFT_MIN + RIGHT_MIN) || len > (size_t)MAX_LETTERS)
+    return 0;
+
+  // ".word." in lower case; value[i] is the digit before w[i]
+  char w[MAX_LETTERS + 2];
+  uint8_t value[MAX_LETTERS + 3] = {0};
+  const size_t n = len + 2;
+  w[0] = w[n - 1] = '.';
+  for (size_t i = 0; i < len; i++)
+    w[i + 1] = word[i] | 0x20;
+
+  for (size_t i = 0; i < n; i++) {
+    for (size_t l = 1; i + l <= n; l++) {
+      size_t at = lowerBound(w + i, l);
+      if (at == TABLE_LEN || !extends(HYPHEN_PATTERNS + at, w + i, l))
+        break; // No pattern goes on with these letters
+      if (compare(HYPHEN_PATTERNS + at, w + i, l) != 0)
+        continue;
+      size_t k = i;
+      for (const char *p = HYPHEN_PATTERNS + at; *p && *p != ' '; p++) {
+        if (isDigit(*p)) {
+          uint8_t d = *p - '0';
+          if (d > value[k])
+            value[k] = d;
+        } else {
+          k++;
+        }
+      }
+    }
+  }
+
+  // An odd value between letters j - 1 and j allows a break there
+  int count = 0;
+  for (size_t j = LEFT_MIN; j + RIGHT_MIN <= len && count < cap; j++) {
+    if (value[j + 1] & 1)
+      out[count++] = j;
+  }
+  return count;
+}
@@ -0,0 +1,36 @@
+/**
+ * Hyphenation
+ *
+ * Liang's algorithm (as in TeX) over the US English patterns of
+ * hyphen_patterns.h. The patterns stay in flash as one sorted string and
+ * each substring of the word is a binary search of it; a substring that
+ * no pattern starts with ends the search for longer ones, so a word costs
+ * a few dozen lookups and no RAM beyond the stack.
+ *
+ * The page layout offers the points as extra line breaks, with a penalty,
+ * to words that are ASCII letters throughout (punctuation around them
+ * aside).
+ */
+
+#ifndef HYPHENATE_H
+#define HYPHENATE_H
+
+#include <Arduino.h>
+
+namespace Hyphenate {
+
+static const int LEFT_MIN = 2;     // Letters kept before a break
+static const int RIGHT_MIN = 3;    // and after one
+static const int MAX_LETTERS = 48; // Longer words are not broken
+
+/**
+ * Where a word may break, as the number of letters before each point,
+ * rising
+ * @param word ASCII letters, either case
+ * @return number of points written (at most cap)
+ */
+int points(const char *word, size_t len, uint8_t *out, int cap);
+
+} // namespace Hyphenate
+
+#endif // HYPHENATE_H
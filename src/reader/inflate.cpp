@@ -0,0 +1,321 @@
+/**
+ * Streaming Inflate Implementation
+ */
+
+#include "inflate.h"
+#include <esp_heap_caps.h>
+
+// Base values and extra bits of the length (257..285) and distance codes
+static const uint16_t LEN_BASE[29] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                      11, 13, 15, 17,  19,  23,  27,  31,
+                                      35, 43, 51, 59,  67,  83,  99,  115,
+                                      131, 163, 195, 227, 258};
+static const uint8_t LEN_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                      1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                      4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                       4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order the code length code lengths are sent in
+static const uint8_t CL_ORDER[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                     11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+Inflater::Inflater()
+    : _file(nullptr), _remaining(0), _inPos(0), _inLen(0), _bitBuf(0),
+      _bitCount(0), _state(State::DONE), _lastBlock(true), _stored(0),
+      _copyLen(0), _copyDist(0), _window(nullptr), _total(0) {}
+
+bool Inflater::begin(fs::File *file, uint32_t length) {
+  if (!_window) {
+    _window = (uint8_t *)heap_caps_malloc(WINDOW, MALLOC_CAP_SPIRAM);
+    if (!_window)
+      _window = (uint8_t *)malloc(WINDOW);
+    if (!_window) {
+      _state = State::FAILED;
+      return false;
+    }
+  }
+  _file = file;
+  _remaining = length;
+  _inPos = _inLen = 0;
+  _bitBuf = 0;
+  _bitCount = 0;
+  _state = State::HEADER;
+  _lastBlock = false;
+  _stored = 0;
+  _copyLen = 0;
+  _total = 0;
+  return true;
+}
+
+void Inflater::end() {
+  free(_window); // heap_caps_malloc memory is freed the same way
+  _window = nullptr;
+  _file = nullptr;
+  _state = State::DONE;
+}
+
+int Inflater::nextByte() {
+  if (_inPos == _inLen) {
+    size_t want = _remaining < INPUT_CHUNK ? _remaining : INPUT_CHUNK;
+    _inLen = want ? _file->read(_in, want) : 0;
+    _inPos = 0;
+    if (_inLen == 0) {
+      fail(); // Truncated entry or read error
+      return -1;
+    }
+    _remaining -= _inLen;
+  }
+  return _in[_inPos++];
+}
+
+uint32_t Inflater::bits(int need) {
+  while (_bitCount < need) {
+    int b = nextByte();
+    if (b < 0)
+      return 0;
+    _bitBuf |= (uint32_t)b << _bitCount;
+    _bitCount += 8;
+  }
+  uint32_t value = _bitBuf & ((1UL << need) - 1);
+  _bitBuf >>= need;
+  _bitCount -= need;
+  return value;
+}
+
+// Canonical decode: codes of each length are consecutive integers
+int Inflater::decode(const Huffman &h) {
+  int code = 0, first = 0, index = 0;
+  for (int len = 1; len <= MAX_BITS; len++) {
+    code |= bits(1);
+    int count = h.count[len];
+    if (code - count < first)
+      return h.symbol[index + (code - first)];
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+    if (_state == State::FAILED)
+      break;
+  }
+  return -1;
+}
+
+// Build the canonical tables from code lengths
+// @return 0 if complete, > 0 if incomplete, < 0 if over-subscribed
+int Inflater::construct(Huffman &h, const uint8_t *length, int n) {
+  memset(h.count, 0, sizeof(h.count));
+  for (int s = 0; s < n; s++)
+    h.count[length[s]]++;
+  if (h.count[0] == n)
+    return 0; // No codes: complete, but every decode fails
+
+  int left = 1;
+  for (int len = 1; len <= MAX_BITS; len++) {
+    left = (left << 1) - h.count[len];
+    if (left < 0)
+      return left;
+  }
+
+  uint16_t offs[MAX_BITS + 1];
+  offs[1] = 0;
+  for (int len = 1; len < MAX_BITS; len++)
+    offs[len + 1] = offs[len] + h.count[len];
+  for (int s = 0; s < n; s++) {
+    if (length[s])
+      h.symbol[offs[length[s]]++] = s;
+  }
+  return left;
+}
+
+bool Inflater::buildFixed() {
+  uint8_t lengths[FIX_LCODES];
+  int s = 0;
+  for (; s < 144; s++)
+    lengths[s] = 8;
+  for (; s < 256; s++)
+    lengths[s] = 9;
+  for (; s < 280; s++)
+    lengths[s] = 7;
+  for (; s < FIX_LCODES; s++)
+    lengths[s] = 8;
+  construct(_lencode, lengths, FIX_LCODES);
+  for (s = 0; s < MAX_DCODES; s++)
+    lengths[s] = 5;
+  construct(_distcode, lengths, MAX_DCODES);
+  return true;
+}
+
+bool Inflater::buildDynamic() {
+  uint8_t lengths[MAX_LCODES + MAX_DCODES];
+  int nlen = bits(5) + 257;
+  int ndist = bits(5) + 1;
+  int ncode = bits(4) + 4;
+  if (nlen > MAX_LCODES || ndist > MAX_DCODES)
+    return false;
+
+  int index = 0;
+  for (; index < ncode; index++)
+    lengths[CL_ORDER[index]] = bits(3);
+  for (; index < 19; index++)
+    lengths[CL_ORDER[index]] = 0;
+  if (construct(_lencode, lengths, 19) != 0)
+    return false; // The code length code must be complete
+
+  index = 0;
+  while (index < nlen + ndist) {
+    int symbol = decode(_lencode);
+    if (symbol < 0)
+      return false;
+    if (symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+    uint8_t len = 0;
+    int repeat;
+    if (symbol == 16) {
+      if (index == 0)
+        return false; // Nothing to repeat
+      len = lengths[index - 1];
+      repeat = 3 + bits(2);
+    } else if (symbol == 17) {
+      repeat = 3 + bits(3);
+    } else {
+      repeat = 11 + bits(7);
+    }
+    if (index + repeat > nlen + ndist || _state == State::FAILED)
+      return false;
+    while (repeat--)
+      lengths[index++] = len;
+  }
+  if (lengths[256] == 0)
+    return false; // No end-of-block code
+
+  // Incomplete codes are only allowed for a single length
+  int err = construct(_lencode, lengths, nlen);
+  if (err < 0 || (err > 0 && nlen - _lencode.count[0] != 1))
+    return false;
+  err = construct(_distcode, lengths + nlen, ndist);
+  if (err < 0 || (err > 0 && ndist - _distcode.count[0] != 1))
+    return false;
+  return _state != State::FAILED;
+}
+
+bool Inflater::beginBlock() {
+  if (_lastBlock) {
+    _state = State::DONE;
+    return true;
+  }
+  // A short read sets FAILED under us; the state only moves on at the end
+  _lastBlock = bits(1);
+  State next = State::CODES;
+  bool ok;
+  switch (bits(2)) {
+  case 0: {
+    // Stored: drop to the byte boundary, then LEN and its complement
+    _bitBuf = 0;
+    _bitCount = 0;
+    int b0 = nextByte(), b1 = nextByte(), b2 = nextByte(), b3 = nextByte();
+    if (b0 < 0 || b1 < 0 || b2 < 0 || b3 < 0) {
+      ok = false; // Truncated header
+      break;
+    }
+    uint16_t len = b0 | (b1 << 8);
+    ok = len == (uint16_t) ~(b2 | (b3 << 8));
+    _stored = len;
+    next = State::STORED;
+    break;
+  }
+  case 1:
+    ok = buildFixed();
+    break;
+  case 2:
+    ok = buildDynamic();
+    break;
+  default:
+    ok = false;
+    break;
+  }
+  if (!ok || _state == State::FAILED)
+    return false;
+  _state = next;
+  return true;
+}
+
+size_t Inflater::read(uint8_t *out, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    if (_copyLen) {
+      uint8_t b = _window[(_total - _copyDist) & (WINDOW - 1)];
+      _window[_total++ & (WINDOW - 1)] = b;
+      out[n++] = b;
+      _copyLen--;
+      continue;
+    }
+
+    int b;
+    switch (_state) {
+    case State::HEADER:
+      if (!beginBlock())
+        fail();
+      continue;
+
+    case State::STORED:
+      if (_stored == 0) {
+        _state = State::HEADER;
+        continue;
+      }
+      b = nextByte();
+      if (b < 0)
+        return n;
+      _stored--;
+      break;
+
+    case State::CODES: {
+      int symbol = decode(_lencode);
+      if (symbol < 0) {
+        fail();
+        return n;
+      }
+      if (symbol < 256) {
+        b = symbol;
+        break;
+      }
+      if (symbol == 256) {
+        _state = State::HEADER;
+        continue;
+      }
+      symbol -= 257;
+      if (symbol >= 29) {
+        fail();
+        return n;
+      }
+      uint16_t length = LEN_BASE[symbol] + bits(LEN_EXTRA[symbol]);
+      symbol = decode(_distcode);
+      if (symbol < 0 || symbol >= MAX_DCODES) {
+        fail();
+        return n;
+      }
+      uint32_t dist = DIST_BASE[symbol] + bits(DIST_EXTRA[symbol]);
+      if (dist > _total || _state == State::FAILED) {
+        fail(); // Reaches back before the start of the entry
+        return n;
+      }
+      _copyLen = length;
+      _copyDist = dist;
+      continue;
+    }
+
+    default: // DONE, FAILED
+      return n;
+    }
+
+    _window[_total++ & (WINDOW - 1)] = b;
+    out[n++] = b;
+  }
+  return n;
+}
@@ -0,0 +1,88 @@
+/**
+ * Streaming Inflate
+ *
+ * Raw deflate (RFC 1951) decoder for the entries of a zip archive, read
+ * straight from an open file. Output comes out in caller-sized pieces, so
+ * an entry is never held whole. Between pieces it keeps the 32 KB history
+ * window back references need (in PSRAM), a small input buffer and the
+ * current block's code tables. Codes are decoded canonically a bit at a
+ * time, as in zlib's puff, which keeps the tables to a few hundred bytes.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+class Inflater {
+public:
+  static const size_t WINDOW = 32768; // Farthest deflate back reference
+  static const size_t INPUT_CHUNK = 512;
+
+  Inflater();
+  ~Inflater() { end(); }
+  Inflater(const Inflater &) = delete;
+  Inflater &operator=(const Inflater &) = delete;
+
+  /**
+   * Decode length compressed bytes from the file's current position. The
+   * file must not be read or moved by anyone else until the entry ends.
+   * @return false if the window could not be allocated
+   */
+  bool begin(fs::File *file, uint32_t length);
+
+  /**
+   * Decode up to len bytes
+   * @return bytes produced; 0 at the end of the stream or on bad data
+   */
+  size_t read(uint8_t *out, size_t len);
+
+  bool failed() const { return _state == State::FAILED; }
+
+  /**
+   * Free the window (begin() allocates it again)
+   */
+  void end();
+
+private:
+  static const int MAX_BITS = 15;
+  static const int MAX_LCODES = 286;
+  static const int MAX_DCODES = 30;
+  static const int FIX_LCODES = 288;
+
+  struct Huffman {
+    uint16_t count[MAX_BITS + 1]; // Codes of each length
+    uint16_t symbol[FIX_LCODES];  // Symbols in canonical order
+  };
+
+  enum class State : uint8_t { HEADER, STORED, CODES, DONE, FAILED };
+
+  fs::File *_file;
+  uint32_t _remaining; // Compressed bytes not yet read from the file
+  uint8_t _in[INPUT_CHUNK];
+  size_t _inPos, _inLen;
+  uint32_t _bitBuf;
+  int _bitCount;
+
+  State _state;
+  bool _lastBlock;
+  uint32_t _stored;   // Bytes left in a stored block
+  uint16_t _copyLen;  // Back reference still being copied
+  uint16_t _copyDist;
+  Huffman _lencode, _distcode;
+
+  uint8_t *_window; // Ring of the last WINDOW bytes of output
+  uint32_t _total;  // Bytes produced (window position)
+
+  int nextByte();
+  uint32_t bits(int need);
+  int decode(const Huffman &h);
+  static int construct(Huffman &h, const uint8_t *length, int n);
+  bool beginBlock();
+  bool buildFixed();
+  bool buildDynamic();
+  void fail() { _state = State::FAILED; }
+};
+
+#endif // INFLATE_H
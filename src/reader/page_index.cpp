@@ -0,0 +1,163 @@
+/**
+ * Page Index Implementation
+ */
+
+#include "page_index.h"
+#include "../utils/crc16.h"
+#include "../utils/sd_manager.h"
+#include <algorithm>
+
+extern SDManager *sdManager;
+
+#define PAGE_INDEX_MAGIC 0x58444750 // "PGDX"
+#define PAGE_INDEX_VERSION 2 // 1: greedy line wrap
+
+static const char *CACHE_DIR = "/books/.cache";
+
+struct PageIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t font;
+  uint8_t complete;
+  uint32_t bookSize;
+  uint16_t width, height; // Text area
+  uint32_t count;
+  BookSource::Pos position;
+  uint16_t crc; // CRC16 of the starts
+  uint16_t reserved;
+};
+
+PageIndex::PageIndex()
+    : _complete(false), _dirty(false), _unsaved(0), _position{0, 0, 0},
+      _bookSize(0), _font(0), _width(0), _height(0) {
+  _path[0] = 0;
+}
+
+uint32_t PageIndex::key(const char *name, uint32_t size) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (const char *p = name; *p; p++)
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  for (int i = 0; i < 4; i++)
+    h = (h ^ (uint8_t)(size >> (i * 8))) * 16777619u;
+  return h;
+}
+
+void PageIndex::open(uint32_t bookKey, uint32_t bookSize, uint8_t font,
+                     int width, int height) {
+  close();
+  snprintf(_path, sizeof(_path), "%s/%08lx_%u.pgx", CACHE_DIR,
+           (unsigned long)bookKey, font);
+  _bookSize = bookSize;
+  _font = font;
+  _width = width;
+  _height = height;
+  if (!read()) {
+    _starts.assign(1, BookSource::Pos{0, 0, 0}); // Page 1 starts the book
+    _complete = false;
+    _position = {0, 0, 0};
+  }
+}
+
+bool PageIndex::read() {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  File file = sdFS().open(_path, FILE_READ);
+  if (!file)
+    return false;
+
+  PageIndexHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == PAGE_INDEX_MAGIC &&
+            header.version == PAGE_INDEX_VERSION && header.font == _font &&
+            header.bookSize == _bookSize && header.width == _width &&
+            header.height == _height && header.count > 0 &&
+            file.size() ==
+                sizeof(header) + header.count * sizeof(BookSource::Pos);
+  if (ok) {
+    _starts.resize(header.count);
+    size_t bytes = header.count * sizeof(BookSource::Pos);
+    ok = file.read((uint8_t *)_starts.data(), bytes) == bytes &&
+         CRC16::modbus((const uint8_t *)_starts.data(), bytes) == header.crc;
+  }
+  file.close();
+  if (!ok) {
+    Serial.printf("Reader: Page index %s invalid, starting over\n", _path);
+    return false;
+  }
+  _complete = header.complete;
+  _position = header.position;
+  return true;
+}
+
+bool PageIndex::flush() {
+  if (!_dirty || !_path[0])
+    return true;
+
+  PageIndexHeader header = {};
+  header.magic = PAGE_INDEX_MAGIC;
+  header.version = PAGE_INDEX_VERSION;
+  header.font = _font;
+  header.complete = _complete;
+  header.bookSize = _bookSize;
+  header.width = _width;
+  header.height = _height;
+  header.count = _starts.size();
+  header.position = _position;
+  size_t bytes = _starts.size() * sizeof(BookSource::Pos);
+  header.crc = CRC16::modbus((const uint8_t *)_starts.data(), bytes);
+
+  SDAccess sd(sdManager);
+  if (!sd || !sdManager->ensureDirectory(CACHE_DIR))
+    return false;
+  File file = sdFS().open(_path, FILE_WRITE);
+  if (!file) {
+    sd.fail();
+    return false;
+  }
+  size_t written = file.write((const uint8_t *)&header, sizeof(header));
+  written += file.write((const uint8_t *)_starts.data(), bytes);
+  file.close();
+  if (written != sizeof(header) + bytes) {
+    Serial.println("Reader: Failed to write page index");
+    sd.fail();
+    return false;
+  }
+  _dirty = false;
+  _unsaved = 0;
+  return true;
+}
+
+void PageIndex::close() {
+  flush();
+  std::vector<BookSource::Pos>().swap(_starts);
+  _complete = false;
+  _dirty = false;
+  _unsaved = 0;
+  _path[0] = 0;
+}
+
+size_t PageIndex::pageOf(BookSource::Pos pos) const {
+  // Starts are in reading order
+  auto it = std::upper_bound(_starts.begin(), _starts.end(), pos);
+  return it == _starts.begin() ? 0 : it - _starts.begin() - 1;
+}
+
+void PageIndex::add(size_t page, BookSource::Pos end, bool last) {
+  if (_complete || page + 1 != _starts.size())
+    return; // Only the last known page extends the index
+  if (last)
+    _complete = true;
+  else
+    _starts.push_back(end);
+  _dirty = true;
+  if (++_unsaved >= FLUSH_PAGES || last)
+    flush();
+}
+
+void PageIndex::setPosition(BookSource::Pos pos) {
+  if (pos != _position) {
+    _position = pos;
+    _dirty = true; // Saved with the next batch, or on close
+  }
+}
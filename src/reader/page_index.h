@@ -0,0 +1,84 @@
+/**
+ * Page Index
+ *
+ * Where each page of a book starts, for one font and text area, kept on
+ * the card as /books/.cache/<book>_<font>.pgx so that reopening a book or
+ * jumping to a page needs no layout. The reader adds pages as it lays them
+ * out (turning pages, and a few at a time while idle), and they are written
+ * back in batches and on close. The file also holds the reading position.
+ *
+ * The book is named by a hash of its file name and size; a file of another
+ * version, layout or size is ignored and the index starts over.
+ */
+
+#ifndef PAGE_INDEX_H
+#define PAGE_INDEX_H
+
+#include "book_source.h"
+#include <Arduino.h>
+#include <vector>
+
+class PageIndex {
+public:
+  static const size_t FLUSH_PAGES = 32; // Unsaved pages before a write
+
+  PageIndex();
+
+  /**
+   * Load the index of a book (or start an empty one)
+   * @param bookKey From key()
+   */
+  void open(uint32_t bookKey, uint32_t bookSize, uint8_t font, int width,
+            int height);
+
+  /**
+   * Write back what is unsaved, then forget the book
+   */
+  void close();
+
+  /**
+   * Identify a book by file name and size
+   */
+  static uint32_t key(const char *name, uint32_t size);
+
+  size_t pages() const { return _starts.size(); } // Known so far
+  bool complete() const { return _complete; }     // pages() is all of them
+  BookSource::Pos start(size_t page) const { return _starts[page]; }
+
+  /**
+   * Page that shows pos (the last starting at or before it)
+   */
+  size_t pageOf(BookSource::Pos pos) const;
+
+  /**
+   * Page n has been laid out; record where page n + 1 starts, or that
+   * the book ends on page n
+   */
+  void add(size_t page, BookSource::Pos end, bool last);
+
+  /**
+   * Reading position, saved with the index
+   */
+  BookSource::Pos position() const { return _position; }
+  void setPosition(BookSource::Pos pos);
+
+  /**
+   * Write the index now if anything changed
+   */
+  bool flush();
+
+private:
+  std::vector<BookSource::Pos> _starts;
+  bool _complete;
+  bool _dirty;
+  size_t _unsaved; // Pages added since the last write
+  BookSource::Pos _position;
+  char _path[48];
+  uint32_t _bookSize;
+  uint8_t _font;
+  uint16_t _width, _height;
+
+  bool read();
+};
+
+#endif // PAGE_INDEX_H
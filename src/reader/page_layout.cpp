@@ -0,0 +1,547 @@
+/**
+ * Page Layout Implementation
+ */
+
+#include "page_layout.h"
+#include "hyphenate.h"
+#include <esp_heap_caps.h>
+
+// Line breaking, in TeX's units: demerits of a line are
+// (LINE_PENALTY + badness)^2 + penalty^2, badness 100 r^3 for a line whose
+// spaces stretch (to half as wide again) or shrink (by a third) by r
+static const float LINE_PENALTY = 10;
+static const float MAX_BADNESS = 10000;   // Underfull without spaces too
+static const float HYPHEN_PENALTY = 50;   // Breaking at a hyphenation point
+static const float DASH_PENALTY = 50;     // After a dash, or a long word's cut
+static const float DOUBLE_HYPHEN = 10000; // Two lines running end broken
+static const float FINAL_HYPHEN = 5000;   // The last line starts mid-word
+static const float OVERFULL = 1e9f;       // A piece wider than the line
+
+// U+00C0..U+00FF without accents
+static const char LATIN1[] =
+    "AAAAAAACEEEEIIIIDNOOOOOxOUUUUYTsaaaaaaaceeeeiiiidnooooo/ouuuuyty";
+
+PageLayout::PageLayout()
+    : _gfx(nullptr), _width(0), _height(0), _lineHeight(1), _spaceWidth(0),
+      _hyphenWidth(0), _unicode(false), _carried(false), _midWord(false),
+      _para(nullptr) {}
+
+PageLayout::Page *PageLayout::allocPage() {
+  void *p = heap_caps_malloc(sizeof(Page), MALLOC_CAP_SPIRAM);
+  if (!p)
+    p = malloc(sizeof(Page));
+  return (Page *)p;
+}
+
+void PageLayout::begin(LovyanGFX *gfx, int width, int height,
+                       bool unicode) {
+  _gfx = gfx;
+  _width = width;
+  _height = height;
+  _unicode = unicode;
+  _lineHeight = gfx->fontHeight();
+  _spaceWidth = gfx->textWidth(" ");
+  _hyphenWidth = gfx->textWidth("-");
+  if (!_para) {
+    _para = (Para *)heap_caps_malloc(sizeof(Para), MALLOC_CAP_SPIRAM);
+    if (!_para)
+      _para = (Para *)malloc(sizeof(Para));
+  }
+  reset();
+}
+
+void PageLayout::reset() {
+  _carried = false;
+  if (_para) {
+    _para->count = 0;
+    _para->full = false;
+  }
+}
+
+size_t PageLayout::fold(const char *in, size_t len, char *out, size_t cap,
+                        bool unicode) {
+  size_t o = 0;
+  for (size_t i = 0; i < len && o + 4 < cap;) {
+    uint8_t c = in[i];
+    uint32_t cp;
+    size_t n;
+    if (c < 0x80) {
+      cp = c;
+      n = 1;
+    } else if ((c & 0xE0) == 0xC0) {
+      cp = c & 0x1F;
+      n = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+      cp = c & 0x0F;
+      n = 3;
+    } else if ((c & 0xF8) == 0xF0) {
+      cp = c & 0x07;
+      n = 4;
+    } else {
+      cp = '?'; // Stray continuation byte
+      n = 1;
+    }
+    bool whole = i + n <= len;
+    if (!whole)
+      n = len - i; // Cut short; shows as '?'
+    for (size_t k = 1; k < n; k++)
+      cp = cp << 6 | (in[i + k] & 0x3F);
+    i += n;
+
+    const char *s = nullptr;
+    char ch;
+    if (unicode && cp >= 0x80 && cp <= 0xFFFF && whole && cp != 0xA0 &&
+        cp != 0xAD && cp != 0x200B && cp != 0xFEFF) {
+      memcpy(out + o, in + i - n, n);
+      o += n;
+      continue;
+    } else if (cp >= 0x20 && cp < 0x7F) {
+      ch = cp;
+    } else if (cp >= 0xC0 && cp <= 0xFF) {
+      ch = LATIN1[cp - 0xC0];
+    } else {
+      switch (cp) {
+      case 0xAD:   // Soft hyphen
+      case 0x200B: // Zero-width space
+      case 0xFEFF: // Byte order mark
+        continue;
+      case 0xA0:
+        ch = ' ';
+        break;
+      case 0x2018:
+      case 0x2019:
+      case 0x201A:
+      case 0x2032:
+        ch = '\'';
+        break;
+      case 0xAB:
+      case 0xBB:
+      case 0x201C:
+      case 0x201D:
+      case 0x201E:
+      case 0x2033:
+        ch = '"';
+        break;
+      case 0x2010:
+      case 0x2011:
+      case 0x2012:
+      case 0x2013:
+      case 0x2014:
+      case 0x2015:
+      case 0x2212:
+        ch = '-';
+        break;
+      case 0xB7:
+      case 0x2022:
+        ch = '*';
+        break;
+      case 0x2026:
+        s = "...";
+        ch = 0;
+        break;
+      default:
+        ch = cp < 0x20 ? 0 : '?';
+        break;
+      }
+    }
+    if (s) {
+      while (*s)
+        out[o++] = *s++;
+    } else if (ch) {
+      out[o++] = ch;
+    }
+  }
+  out[o] = 0;
+  return o;
+}
+
+int PageLayout::measure(const char *text, size_t len, char *folded,
+                        size_t cap) {
+  fold(text, len, folded, cap, _unicode);
+  return _gfx->textWidth(folded);
+}
+
+void PageLayout::readWord(BookSource &book, Word &w) {
+  w.para = false;
+  w.end = false;
+  w.joined = _midWord;
+  w.len = 0;
+
+  int c;
+  while ((c = book.peek()) == ' ' || c == '\n') {
+    if (c == '\n')
+      w.para = true;
+    w.joined = false;
+    book.next();
+  }
+  w.pos = book.tell();
+  if (c == BookSource::END) {
+    w.end = true;
+    _midWord = false;
+    return;
+  }
+
+  // Up to white space or the end of the chapter
+  auto inWord = [&](int c) {
+    return c != BookSource::END && c != ' ' && c != '\n' &&
+           book.tell().chapter == w.pos.chapter;
+  };
+  while (w.len < MAX_WORD - 4 && inWord(c = book.peek()))
+    w.text[w.len++] = book.next();
+  // Don't cut a UTF-8 sequence at the length limit
+  while (w.len < MAX_WORD && inWord(c = book.peek()) && (c & 0xC0) == 0x80)
+    w.text[w.len++] = book.next();
+  _midWord = inWord(book.peek());
+}
+
+// Letters of a word that may be hyphenated: ASCII, with a capital only
+// leading, and nothing around them but ASCII punctuation and typographic
+// (U+2000..U+203F). Sets [from, to) to them.
+static bool hyphenable(const char *t, size_t len, size_t &from, size_t &to) {
+  auto letter = [](char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; };
+  // Past punctuation from i; false at a letter or any other character
+  auto skip = [&](size_t &i, bool stopAtLetter) {
+    while (i < len) {
+      uint8_t c = t[i];
+      if (letter(c))
+        return stopAtLetter;
+      if (c < 0x80)
+        i++;
+      else if (c == 0xE2 && i + 2 < len && (uint8_t)t[i + 1] == 0x80)
+        i += 3;
+      else
+        return false;
+    }
+    return true;
+  };
+  size_t i = 0;
+  if (!skip(i, true))
+    return false;
+  from = i;
+  for (; i < len && letter(t[i]); i++) {
+    if (i > from && t[i] < 'a')
+      return false;
+  }
+  to = i;
+  return skip(i, false) && to - from >= (size_t)(Hyphenate::LEFT_MIN +
+                                                 Hyphenate::RIGHT_MIN);
+}
+
+void PageLayout::addPiece(const char *raw, size_t len, BookSource::Pos pos,
+                          uint8_t gap) {
+  Para &p = *_para;
+  char *out = p.text + p.used;
+  const size_t cap = PARA_TEXT - p.used;
+  size_t n = fold(raw, len, out, cap, _unicode);
+  int width = _gfx->textWidth(out);
+  if (width > _width) {
+    // Wider than a whole line: what fits (a character at least), then the
+    // rest
+    size_t cut = 0;
+    for (size_t i = 0; i < len;) {
+      size_t m = i + 1;
+      while (m < len && (raw[m] & 0xC0) == 0x80)
+        m++;
+      if (cut > 0 && measure(raw, m, out, cap) > _width)
+        break;
+      cut = i = m;
+    }
+    if (cut < len) {
+      addPiece(raw, cut, pos, gap);
+      pos.offset += cut;
+      addPiece(raw + cut, len - cut, pos, GAP_JOIN);
+      return;
+    }
+    n = fold(raw, len, out, cap, _unicode); // Measuring wrote over it
+  }
+  Piece &piece = p.pieces[p.count++];
+  piece.pos = pos;
+  piece.text = p.used;
+  piece.len = n;
+  piece.gap = gap;
+  piece.width = width;
+  p.used += n + 1;
+}
+
+// Split a word at its hyphenation points, or after its dashes. A word cut
+// at MAX_WORD (joined, or the stream stopped inside it) is left whole.
+void PageLayout::addWord(const Word &w) {
+  uint8_t cuts[MAX_WORD];
+  int count = 0;
+  uint8_t cutGap = GAP_HYPHEN;
+  size_t from, to;
+  if (!w.joined && !_midWord && hyphenable(w.text, w.len, from, to)) {
+    count = Hyphenate::points(w.text + from, to - from, cuts, MAX_WORD);
+    for (int k = 0; k < count; k++)
+      cuts[k] += from;
+  } else {
+    cutGap = GAP_JOIN;
+    for (size_t i = 2; i < w.len; i++) {
+      bool dash = w.text[i - 1] == '-' && w.text[i] != '-';
+      bool wide = i >= 4 && (uint8_t)w.text[i - 3] == 0xE2 &&
+                  (uint8_t)w.text[i - 2] == 0x80 &&
+                  ((uint8_t)w.text[i - 1] == 0x93 ||
+                   (uint8_t)w.text[i - 1] == 0x94); // En and em dashes
+      if (dash || wide)
+        cuts[count++] = i;
+    }
+  }
+
+  uint8_t gap = w.joined ? GAP_JOIN : GAP_SPACE;
+  size_t a = 0;
+  for (int k = 0; k <= count; k++) {
+    size_t b = k < count ? cuts[k] : w.len;
+    BookSource::Pos pos = w.pos;
+    pos.offset += a;
+    addPiece(w.text + a, b - a, pos, gap);
+    gap = cutGap;
+    a = b;
+  }
+}
+
+// Read the next paragraph into _para, up to the first word after it (of
+// the next paragraph or chapter), which stays carried
+// @return false if the book has ended
+bool PageLayout::readPara(BookSource &book) {
+  Para &p = *_para;
+  p.count = 0;
+  p.used = 0;
+  p.para = false;
+  p.full = false;
+  for (;;) {
+    if (!_carried)
+      readWord(book, _carry);
+    _carried = true;
+    const Word &w = _carry;
+    if (w.end)
+      break;
+    if (p.count > 0 &&
+        (w.para || w.pos.chapter != p.pieces[0].pos.chapter))
+      break;
+    if (p.count + MAX_WORD + 1 > MAX_PIECES ||
+        p.used + 2 * MAX_WORD > PARA_TEXT) {
+      p.full = true;
+      break;
+    }
+    if (p.count == 0)
+      p.para = w.para;
+    addWord(w); // _midWord still tells of w: nothing was read since
+    _carried = false;
+  }
+  return p.count > 0;
+}
+
+// Piece of the kept paragraph that a page starting at start begins with,
+// if a fresh read from there would give the same pieces: it starts a word
+// (not a part of one, which may hyphenate otherwise on its own), and the
+// paragraph was read to its end. Else -1.
+int PageLayout::resume(BookSource::Pos start) const {
+  const Para &p = *_para;
+  if (p.full)
+    return -1;
+  for (int i = 0; i < p.count; i++) {
+    if (p.pieces[i].pos == start)
+      return p.pieces[i].gap == GAP_SPACE ? i : -1;
+  }
+  return -1;
+}
+
+// Total-fit breaking of pieces first.. into lines (breaks, lines)
+void PageLayout::breakLines(int first) {
+  Para &p = *_para;
+  const int n = p.count;
+  const float stretch = _spaceWidth / 2.0f; // Per space
+  const float shrink = _spaceWidth / 3.0f;
+
+  p.sum[first] = 0;
+  p.spaces[first] = 0;
+  for (int i = first; i < n; i++) {
+    p.sum[i + 1] = p.sum[i] + p.pieces[i].width;
+    p.spaces[i + 1] =
+        p.spaces[i] + (i > first && p.pieces[i].gap == GAP_SPACE ? 1 : 0);
+  }
+
+  p.cost[first] = 0;
+  int lo = first; // Lines from before lo are too long to end here or later
+  for (int b = first + 1; b <= n; b++) {
+    const bool last = b == n;
+    const uint8_t end = last ? GAP_SPACE : p.pieces[b].gap;
+    const int hyphen = end == GAP_HYPHEN ? _hyphenWidth : 0;
+    for (;;) {
+      int spaces = p.spaces[b] - p.spaces[lo + 1];
+      float tight = p.sum[b] - p.sum[lo] + spaces * (_spaceWidth - shrink);
+      if (lo + 1 >= b || tight <= _width)
+        break;
+      lo++;
+    }
+
+    float best = 0;
+    int from = -1;
+    for (int a = lo; a < b; a++) {
+      int spaces = p.spaces[b] - p.spaces[a + 1];
+      int natural = p.sum[b] - p.sum[a] + spaces * _spaceWidth + hyphen;
+      float badness;
+      if (natural > _width) {
+        float r = spaces ? (natural - _width) / (spaces * shrink) : 2;
+        badness = r > 1 ? -1 : 100 * r * r * r;
+      } else if (last) {
+        badness = 0;
+      } else if (spaces) {
+        float r = (_width - natural) / (spaces * stretch);
+        badness = min(100 * r * r * r, MAX_BADNESS);
+      } else {
+        badness = natural == _width ? 0 : MAX_BADNESS;
+      }
+
+      float demerits;
+      if (badness < 0) {
+        demerits = OVERFULL; // Only when nothing else ends here
+      } else {
+        demerits = (LINE_PENALTY + badness) * (LINE_PENALTY + badness);
+        if (end != GAP_SPACE) {
+          float penalty = end == GAP_HYPHEN ? HYPHEN_PENALTY : DASH_PENALTY;
+          demerits += penalty * penalty;
+        }
+        bool broken = a > first && p.pieces[a].gap != GAP_SPACE;
+        if (broken && end != GAP_SPACE)
+          demerits += DOUBLE_HYPHEN;
+        if (broken && last)
+          demerits += FINAL_HYPHEN;
+      }
+      float cost = p.cost[a] + demerits;
+      if (from < 0 || cost < best) {
+        best = cost;
+        from = a;
+      }
+    }
+    p.cost[b] = best;
+    p.from[b] = from;
+  }
+
+  int lines = 0;
+  for (int b = n; b > first; b = p.from[b])
+    lines++;
+  p.lines = lines;
+  p.breaks[lines] = n;
+  for (int b = n, k = lines; k > 0;)
+    p.breaks[--k] = b = p.from[b];
+}
+
+bool PageLayout::layout(BookSource &book, BookSource::Pos start, Page &page) {
+  if (!_para)
+    return false;
+  Para &p = *_para;
+  int at = resume(start); // Into the kept paragraph, else -1: the next one
+  if (at < 0) {
+    p.count = 0;
+    if (!_carried || _carry.pos != start) {
+      if (!book.seek(start))
+        return false;
+      _carried = false;
+      _midWord = false;
+    }
+  }
+  page.start = start;
+  page.last = false;
+  page.lineCount = 0;
+
+  const int gap = _lineHeight / 3; // After a paragraph
+  size_t used = 0;
+  int y = 0;
+  uint16_t chapter = start.chapter;
+
+  for (;;) {
+    if (at < 0) {
+      if (!readPara(book)) {
+        page.last = true;
+        page.end = _carry.pos;
+        return true;
+      }
+      if (page.lineCount == 0) {
+        chapter = p.pieces[0].pos.chapter;
+      } else if (p.pieces[0].pos.chapter != chapter) {
+        page.end = p.pieces[0].pos; // Chapters start on a new page
+        return true;
+      }
+      if (page.lineCount > 0 && p.para)
+        y += gap;
+      at = 0;
+    }
+
+    breakLines(at);
+    for (int l = 0; l < p.lines; l++) {
+      const int a = p.breaks[l], b = p.breaks[l + 1];
+      const bool hyphen = b < p.count && p.pieces[b].gap == GAP_HYPHEN;
+      size_t len = hyphen ? 1 : 0;
+      for (int i = a; i < b; i++)
+        len += p.pieces[i].len + 1; // With a space, or the terminator
+
+      if (y + _lineHeight > _height || page.lineCount >= MAX_LINES ||
+          used + len > MAX_TEXT) {
+        // Page full. Rather than split a word across pages, the line with
+        // its first part moves over too (unless it is all there is).
+        int next = a;
+        while (next > 0 && p.pieces[next].gap != GAP_SPACE && l > 0 &&
+               page.lineCount > 1) {
+          page.lineCount--;
+          next = p.breaks[--l];
+        }
+        page.end = p.pieces[next].pos;
+        return true;
+      }
+
+      Line &line = page.lines[page.lineCount++];
+      line.start = used;
+      line.y = y;
+      for (int i = a; i < b; i++) {
+        const Piece &piece = p.pieces[i];
+        if (i > a && piece.gap == GAP_SPACE)
+          page.text[used++] = ' ';
+        memcpy(page.text + used, p.text + piece.text, piece.len);
+        used += piece.len;
+      }
+      if (hyphen)
+        page.text[used++] = '-';
+      page.text[used++] = 0;
+      int spaces = p.spaces[b] - p.spaces[a + 1];
+      int natural = p.sum[b] - p.sum[a] + spaces * _spaceWidth +
+                    (hyphen ? _hyphenWidth : 0);
+      line.extra = b == p.count || !spaces ? 0 : _width - natural;
+      y += _lineHeight;
+    }
+    at = -1;
+  }
+}
+
+void PageLayout::drawLine(LovyanGFX &gfx, const Page &page, int i, int x,
+                          int y) {
+  const Line &line = page.lines[i];
+  const char *text = page.text + line.start;
+  y += line.y;
+  int spaces = 0;
+  for (const char *s = text; *s; s++)
+    spaces += *s == ' ';
+  if (!line.extra || !spaces) {
+    gfx.drawString(text, x, y);
+    return;
+  }
+
+  // Word by word, the extra shared out over the spaces
+  const int space = gfx.textWidth(" ");
+  char word[2 * MAX_WORD];
+  for (int k = 0;; k++) {
+    const char *next = strchr(text, ' ');
+    size_t len = next ? next - text : strlen(text);
+    if (len >= sizeof(word)) {
+      gfx.drawString(text, x, y); // The rest set as it is
+      return;
+    }
+    memcpy(word, text, len);
+    word[len] = 0;
+    x += gfx.drawString(word, x, y);
+    if (!next)
+      return;
+    x += space + line.extra * (k + 1) / spaces - line.extra * k / spaces;
+    text = next + 1;
+  }
+}
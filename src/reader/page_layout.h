@@ -0,0 +1,170 @@
+/**
+ * Page Layout
+ *
+ * Fills one reader page from a BookSource: lines measured with the page
+ * font, a gap after each paragraph, and a fresh page at every chapter.
+ *
+ * A paragraph is read whole and broken into lines all at once, in the
+ * manner of Knuth and Plass: of every way to break it, the one whose
+ * lines' summed demerits are least, a line's badness growing with the
+ * cube of how far its spaces must stretch or shrink to fill the width.
+ * English words may also break at their hyphenation points (hyphenate.h)
+ * and any word after a dash, each at a penalty, and two hyphens in a row
+ * cost more. Lines are justified but for a paragraph's last. A word too
+ * wide for a line is split across lines.
+ *
+ * A page ends before the first line that does not fit, and where that
+ * line starts is where the next page starts; rather than split a word
+ * across pages, a hyphenated line moves over too. The next page is broken
+ * afresh from its start, which gives the lines the paragraph's breaking
+ * gave them (the best breaks of a tail are the tail of the best breaks).
+ * The layout keeps the paragraph, so that page carries on without a seek
+ * or a second read, as it does from the next paragraph's first word.
+ * Layout depends only on where the page starts, so the page index stays
+ * valid whichever way a page was reached. A paragraph of more than
+ * MAX_PIECES is set in parts, and a page starting inside one is read
+ * again from there.
+ *
+ * The built-in page fonts are the GFX free fonts, which cover printable
+ * ASCII: text is folded on the way in (typographic quotes and dashes,
+ * Latin-1 letters without their accents, '?' for the rest). A font from the
+ * card takes the UTF-8 as is, less the invisible characters.
+ */
+
+#ifndef PAGE_LAYOUT_H
+#define PAGE_LAYOUT_H
+
+#include "book_source.h"
+#include <Arduino.h>
+#include <M5Unified.h>
+
+class PageLayout {
+public:
+  static const int MAX_TEXT = 3072; // Folded text on one page
+  static const int MAX_LINES = 48;
+  static const int MAX_WORD = 64; // Longer runs are set as joined pieces
+  static const int MAX_PIECES = 1024; // Of a paragraph set at once
+  static const int PARA_TEXT = 12288; // Folded text of a paragraph
+
+  struct Line {
+    uint16_t start; // Into Page::text, null-terminated
+    int16_t y;      // Top of the line, from the top of the text area
+    int16_t extra;  // Pixels to spread over its spaces (below zero to
+                    // take away) to justify it; 0 sets it ragged
+  };
+
+  struct Page {
+    BookSource::Pos start;
+    BookSource::Pos end; // Where the next page starts
+    bool last;           // The book ends on this page
+    uint8_t lineCount;
+    Line lines[MAX_LINES];
+    char text[MAX_TEXT];
+  };
+
+  PageLayout();
+  ~PageLayout() { free(_para); }
+  PageLayout(const PageLayout &) = delete;
+  PageLayout &operator=(const PageLayout &) = delete;
+
+  /**
+   * A page in PSRAM (or internal RAM without it); free() it
+   */
+  static Page *allocPage();
+
+  /**
+   * Measure with gfx, which has the page font set; the text area is
+   * width x height pixels
+   * @param unicode The font draws UTF-8: keep the text unfolded
+   */
+  void begin(LovyanGFX *gfx, int width, int height, bool unicode = false);
+
+  /**
+   * Forget the carried word and paragraph (after the book or font changed)
+   */
+  void reset();
+
+  /**
+   * Lay out the page starting at start
+   * @return false if the book cannot seek there
+   */
+  bool layout(BookSource &book, BookSource::Pos start, Page &page);
+
+  int lineHeight() const { return _lineHeight; }
+
+  /**
+   * Draw line i of a page at (x, y + its y) in the font it was laid out
+   * with, spreading a justified line's extra pixels over its spaces
+   */
+  static void drawLine(LovyanGFX &gfx, const Page &page, int i, int x,
+                       int y);
+
+  /**
+   * Fold UTF-8 to the page fonts' ASCII range, null-terminated; with
+   * unicode, only drop control and zero-width characters (and a code point
+   * past U+FFFF, which the fonts cannot hold, becomes '?')
+   * @return length of out
+   */
+  static size_t fold(const char *in, size_t len, char *out, size_t cap,
+                     bool unicode = false);
+
+private:
+  // Before a piece: where it may break from the last and what that costs
+  enum Gap : uint8_t { GAP_SPACE, GAP_JOIN, GAP_HYPHEN };
+
+  struct Word {
+    BookSource::Pos pos; // Of its first byte
+    bool para;   // A paragraph break comes before it
+    bool joined; // Continues the previous word, no space between
+    bool end;    // No word: the book has ended at pos
+    uint8_t len;
+    char text[MAX_WORD];
+  };
+
+  // A run of a paragraph no line break falls inside: a word, or the part
+  // of one between hyphenation points
+  struct Piece {
+    BookSource::Pos pos; // Of its first byte
+    uint16_t text;       // Folded, null-terminated, in Para::text
+    uint8_t len;
+    uint8_t gap;         // Gap before it
+    int16_t width;
+  };
+
+  // The paragraph being set, read whole from the stream, and the working
+  // of its line breaking (per boundary between pieces)
+  struct Para {
+    int count;   // Pieces
+    size_t used; // Of text
+    bool para;   // A paragraph break comes before it
+    bool full;   // Out of room: the paragraph goes on
+    Piece pieces[MAX_PIECES];
+    char text[PARA_TEXT];
+    int32_t sum[MAX_PIECES + 1];    // Widths of the pieces before
+    int16_t spaces[MAX_PIECES + 1]; // Spaces before
+    float cost[MAX_PIECES + 1];     // Least demerits of lines up to here
+    int16_t from[MAX_PIECES + 1];   // Start of the last of those lines
+    int lines;
+    int16_t breaks[MAX_PIECES + 1]; // First piece of each line, then count
+  };
+
+  LovyanGFX *_gfx;
+  int _width, _height;
+  int _lineHeight, _spaceWidth, _hyphenWidth;
+  bool _unicode;
+  Word _carry;
+  bool _carried;  // _carry is the next word of the stream
+  bool _midWord;  // The stream stopped inside an over-long word
+  Para *_para;    // PSRAM
+
+  void readWord(BookSource &book, Word &word);
+  int measure(const char *text, size_t len, char *folded, size_t cap);
+  bool readPara(BookSource &book);
+  void addWord(const Word &w);
+  void addPiece(const char *raw, size_t len, BookSource::Pos pos,
+                uint8_t gap);
+  int resume(BookSource::Pos start) const;
+  void breakLines(int first);
+};
+
+#endif // PAGE_LAYOUT_H
@@ -0,0 +1,174 @@
+/**
+ * Page Renderer Implementation
+ */
+
+#include "page_renderer.h"
+#include "../ui/raster4.h"
+#include "../utils/log.h"
+
+// Colors for eInk (grayscale) - same values as ui_manager.cpp
+#define COLOR_BLACK 0x0000
+
+PageRenderer::PageRenderer() : _task(nullptr), _epoch(1) {
+  for (Slot &slot : _slots) {
+    slot.state = FREE;
+    slot.epoch = 0;
+    slot.number = 0;
+    slot.font = nullptr;
+    slot.page = nullptr;
+    slot.canvas = nullptr;
+  }
+}
+
+bool PageRenderer::begin(int width, int height) {
+  if (_slots[0].canvas && _slots[0].canvas->width() == width &&
+      _slots[0].canvas->height() == height)
+    return true;
+  end();
+
+  for (Slot &slot : _slots) {
+    slot.page = PageLayout::allocPage();
+    slot.canvas = new M5Canvas(&M5.Display);
+    slot.canvas->setColorDepth(4);
+    slot.canvas->setPsram(true);
+    if (!slot.page || !slot.canvas->createSprite(width, height)) {
+      LOG_W("Reader", "No PSRAM for pre-rendered pages");
+      end();
+      return false;
+    }
+  }
+
+  // Core 0 at the storage worker's priority, below touch and BLE
+  if (xTaskCreatePinnedToCore(taskEntry, "pages", TASK_STACK, this, 1, &_task,
+                              0) != pdPASS) {
+    LOG_E("Reader", "Page render task failed to start");
+    _task = nullptr;
+    end();
+    return false;
+  }
+  return true;
+}
+
+void PageRenderer::end() {
+  // Nothing new starts, then the page being drawn finishes
+  clear();
+  for (Slot &slot : _slots) {
+    uint8_t queued = QUEUED;
+    slot.state.compare_exchange_strong(queued, FREE);
+  }
+  for (Slot &slot : _slots) {
+    while (slot.state == RENDERING)
+      vTaskDelay(1);
+  }
+  if (_task) {
+    vTaskDelete(_task);
+    _task = nullptr;
+  }
+
+  for (Slot &slot : _slots) {
+    free(slot.page);
+    delete slot.canvas; // Frees its sprite buffer
+    slot.page = nullptr;
+    slot.canvas = nullptr;
+    slot.state = FREE;
+  }
+}
+
+bool PageRenderer::live(const Slot &slot) const {
+  uint8_t state = slot.state;
+  return (state == QUEUED || state == RENDERING || state == READY) &&
+         slot.epoch == _epoch;
+}
+
+const PageLayout::Page *PageRenderer::find(size_t n) const {
+  for (const Slot &slot : _slots)
+    if (live(slot) && slot.number == n)
+      return slot.page;
+  return nullptr;
+}
+
+M5Canvas *PageRenderer::canvas(size_t n) {
+  for (Slot &slot : _slots)
+    if (slot.state == READY && slot.epoch == _epoch && slot.number == n)
+      return slot.canvas;
+  return nullptr;
+}
+
+PageLayout::Page *PageRenderer::acquire(size_t n, size_t keepFrom,
+                                        size_t keepTo) {
+  for (Slot &slot : _slots) {
+    if (!slot.page)
+      return nullptr; // Not allocated
+    uint8_t state = slot.state;
+    if (state == FILLING || state == RENDERING)
+      continue;
+    bool kept = state != FREE && slot.epoch == _epoch &&
+                slot.number >= keepFrom && slot.number <= keepTo;
+    // A queued page may be taken back from the worker, a drawn one is idle
+    if (kept || !slot.state.compare_exchange_strong(state, FILLING))
+      continue;
+    slot.epoch = _epoch;
+    slot.number = n;
+    return slot.page;
+  }
+  return nullptr;
+}
+
+PageRenderer::Slot *PageRenderer::slotOf(const PageLayout::Page *page) {
+  for (Slot &slot : _slots)
+    if (slot.page == page)
+      return &slot;
+  return nullptr;
+}
+
+void PageRenderer::submit(PageLayout::Page *page, const lgfx::IFont *font) {
+  Slot *slot = slotOf(page);
+  if (!slot)
+    return;
+  slot->font = font;
+  slot->state = QUEUED;
+  xTaskNotifyGive(_task);
+}
+
+void PageRenderer::cancel(PageLayout::Page *page) {
+  Slot *slot = slotOf(page);
+  if (slot)
+    slot->state = FREE;
+}
+
+void PageRenderer::taskEntry(void *arg) {
+  PageRenderer *self = static_cast<PageRenderer *>(arg);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    self->drain();
+  }
+}
+
+void PageRenderer::drain() {
+  bool found = true;
+  while (found) {
+    found = false;
+    for (Slot &slot : _slots) {
+      uint8_t queued = QUEUED;
+      if (!slot.state.compare_exchange_strong(queued, RENDERING))
+        continue;
+      found = true;
+      render(slot);
+      slot.state = READY;
+    }
+  }
+}
+
+void PageRenderer::render(Slot &slot) {
+  uint32_t start = millis();
+  M5Canvas &canvas = *slot.canvas;
+  const PageLayout::Page &page = *slot.page;
+  Raster4::clear(canvas);
+  canvas.setFont(slot.font);
+  canvas.setTextColor(COLOR_BLACK);
+  canvas.setTextDatum(top_left);
+  for (int i = 0; i < page.lineCount; i++)
+    PageLayout::drawLine(canvas, page, i, 0, 0);
+  LOG_D("Reader", "Page %u drawn in %u ms", (unsigned)slot.number,
+        (unsigned)(millis() - start));
+}
@@ -0,0 +1,104 @@
+/**
+ * Page Renderer
+ *
+ * Keeps the reader's page on screen and the pages either side of it
+ * rasterized ahead of time, so a page turn is one pushSprite and the EPD
+ * update. Each slot holds a laid-out page and a 4-bit canvas of the text
+ * area in PSRAM. The loop task lays a page out into a slot (the book and
+ * layout are its alone) and submits it; a low-priority worker on core 0
+ * draws the text into the slot's canvas.
+ *
+ * A slot moves FREE -> FILLING (loop task) -> QUEUED -> RENDERING (worker)
+ * -> READY. The loop task only reuses a slot the worker is not drawing.
+ * clear() forgets every page at once (another book or font): slots of an
+ * older epoch count as free.
+ */
+
+#ifndef PAGE_RENDERER_H
+#define PAGE_RENDERER_H
+
+#include "page_layout.h"
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class PageRenderer {
+public:
+  static const int SLOTS = 3; // The page on screen and one either side
+  static const uint32_t TASK_STACK = 4096;
+
+  PageRenderer();
+  ~PageRenderer() { end(); }
+  PageRenderer(const PageRenderer &) = delete;
+  PageRenderer &operator=(const PageRenderer &) = delete;
+
+  /**
+   * Allocate the slots for a width x height text area and start the
+   * worker (once)
+   * @return false without PSRAM for them: pages are drawn on demand
+   */
+  bool begin(int width, int height);
+
+  /**
+   * Wait for the worker, stop it and free the slots
+   */
+  void end();
+
+  /**
+   * Forget every page (the book or the font changed)
+   */
+  void clear() { _epoch++; }
+
+  /**
+   * Page n, laid out (maybe still being drawn), or nullptr
+   */
+  const PageLayout::Page *find(size_t n) const;
+
+  /**
+   * Canvas of page n once it is drawn, or nullptr. Call from the loop task.
+   */
+  M5Canvas *canvas(size_t n);
+
+  /**
+   * A slot to lay page n out into, reusing one whose page is outside
+   * [keepFrom, keepTo]. Follow with submit() or cancel().
+   * @return nullptr if every slot is kept or being drawn
+   */
+  PageLayout::Page *acquire(size_t n, size_t keepFrom, size_t keepTo);
+
+  /**
+   * The acquired page is laid out: draw it in font in the background
+   */
+  void submit(PageLayout::Page *page, const lgfx::IFont *font);
+
+  /**
+   * Give an acquired slot back unused (the layout failed)
+   */
+  void cancel(PageLayout::Page *page);
+
+private:
+  enum State : uint8_t { FREE, FILLING, QUEUED, RENDERING, READY };
+
+  struct Slot {
+    std::atomic<uint8_t> state;
+    uint32_t epoch;
+    size_t number;
+    const lgfx::IFont *font;
+    PageLayout::Page *page; // PSRAM
+    M5Canvas *canvas;       // 4-bit, PSRAM
+  };
+
+  TaskHandle_t _task;
+  Slot _slots[SLOTS];
+  std::atomic<uint32_t> _epoch;
+
+  bool live(const Slot &slot) const;
+  Slot *slotOf(const PageLayout::Page *page);
+  static void taskEntry(void *arg);
+  void drain();
+  void render(Slot &slot);
+};
+
+#endif // PAGE_RENDERER_H
@@ -0,0 +1,198 @@
+/**
+ * Reader Implementation
+ */
+
+#include "reader.h"
+#include "../ui/font_manager.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+
+extern SDManager *sdManager;
+
+static const char *BOOKS_DIR = "/books";
+
+const int Reader::SD_SIZES[FONTS] = {24, 32, 44};
+
+Reader::Reader()
+    : _font(1), _face(nullptr), _sdFace(false), _key(0), _generation(0), _prerender(false),
+      _current(nullptr), _scratch(nullptr), _page(0) {
+  _name[0] = 0;
+}
+
+void Reader::setFace() {
+  _face = FontManager::instance().get("serif", SD_SIZES[_font]);
+  _sdFace = _face != nullptr;
+  if (!_sdFace) {
+    switch (_font) {
+    case 0:
+      _face = &fonts::FreeSerif9pt7b;
+      break;
+    case 2:
+      _face = &fonts::FreeSerif18pt7b;
+      break;
+    default:
+      _face = &fonts::FreeSerif12pt7b;
+      break;
+    }
+  }
+  _measure.setFont(_face);
+  _layout.begin(&_measure, TEXT_WIDTH, TEXT_HEIGHT, _sdFace);
+}
+
+uint8_t Reader::layoutId() const { return _font | (_sdFace ? 0x80 : 0); }
+
+bool Reader::open(const char *name, uint8_t font, const BookSource::Pos *pos) {
+  close();
+  if (!sdManager)
+    return false;
+  if (!_current)
+    _current = PageLayout::allocPage();
+  if (!_scratch)
+    _scratch = PageLayout::allocPage();
+  if (!_current || !_scratch)
+    return false;
+
+  char path[16 + MAX_NAME];
+  snprintf(path, sizeof(path), "%s/%s", BOOKS_DIR, name);
+  {
+    SDAccess sd(sdManager);
+    if (!sd || !_source.open(path))
+      return false;
+    _generation = sdManager->getMountGeneration();
+  }
+  _prerender = _renderer.begin(TEXT_WIDTH, TEXT_HEIGHT);
+  _renderer.clear();
+  strlcpy(_name, name, sizeof(_name));
+  _font = font < FONTS ? font : 1;
+  _key = PageIndex::key(name, _source.fileSize());
+  setFace();
+  _index.open(_key, _source.fileSize(), layoutId(), TEXT_WIDTH, TEXT_HEIGHT);
+  LOG_I("Reader", "%s: %u pages indexed%s", name, (unsigned)_index.pages(),
+        _index.complete() ? " (all)" : "");
+  return show(pos ? *pos : _index.position());
+}
+
+void Reader::close() {
+  if (_source.isOpen()) {
+    _index.close(); // Writes back the position with the pages
+    _source.close();
+  }
+  _renderer.clear();
+  free(_current);
+  free(_scratch);
+  _current = _scratch = nullptr;
+  _name[0] = 0;
+  _page = 0;
+}
+
+bool Reader::reopen() {
+  if (sdManager->getMountGeneration() == _generation)
+    return true;
+  // The card was remounted (maybe swapped): old handles are dead
+  char path[16 + MAX_NAME];
+  snprintf(path, sizeof(path), "%s/%s", BOOKS_DIR, _name);
+  _layout.reset();
+  _generation = sdManager->getMountGeneration();
+  return _source.open(path) &&
+         PageIndex::key(_name, _source.fileSize()) == _key;
+}
+
+// Lay out a page whose start is known, extending the index past it
+bool Reader::layoutKnown(size_t n, PageLayout::Page &page) {
+  SDAccess sd(sdManager);
+  if (!sd || !reopen())
+    return false;
+  if (!_layout.layout(_source, _index.start(n), page)) {
+    sd.fail();
+    return false;
+  }
+  _index.add(n, page.end, page.last);
+  return true;
+}
+
+bool Reader::go(size_t n) {
+  if (!_current)
+    return false;
+  while (n >= _index.pages() && !_index.complete()) {
+    if (!layoutKnown(_index.pages() - 1, *_scratch))
+      return false;
+  }
+  if (n >= _index.pages())
+    n = _index.pages() - 1;
+  // A page laid out ahead is taken as it is
+  const PageLayout::Page *ahead = _renderer.find(n);
+  if (ahead)
+    memcpy(_current, ahead, sizeof(PageLayout::Page));
+  else if (!layoutKnown(n, *_current))
+    return false;
+  _page = n;
+  _index.setPosition(_current->start);
+  return true;
+}
+
+bool Reader::show(BookSource::Pos pos) {
+  // Index far enough to know which page pos is on
+  while (!_index.complete() && _index.start(_index.pages() - 1) < pos) {
+    if (!layoutKnown(_index.pages() - 1, *_scratch))
+      return false;
+  }
+  return go(_index.pageOf(pos));
+}
+
+bool Reader::setFont(uint8_t font) {
+  if (!isOpen() || font >= FONTS || font == _font)
+    return false;
+  BookSource::Pos pos = position();
+  _index.close();
+  _renderer.clear();
+  _font = font;
+  setFace();
+  _index.open(_key, _source.fileSize(), layoutId(), TEXT_WIDTH, TEXT_HEIGHT);
+  return show(pos);
+}
+
+bool Reader::extend(uint32_t budgetMs) {
+  if (!isOpen())
+    return false;
+  uint32_t start = millis();
+  while (!_index.complete() && millis() - start < budgetMs) {
+    if (!layoutKnown(_index.pages() - 1, *_scratch))
+      return false;
+  }
+  return !_index.complete();
+}
+
+void Reader::prepare(size_t n) {
+  size_t from = _page > 0 ? _page - 1 : 0;
+  PageLayout::Page *page = _renderer.acquire(n, from, _page + 1);
+  if (!page)
+    return; // Every slot is kept or being drawn; next pass
+  if (n == _page) {
+    memcpy(page, _current, sizeof(PageLayout::Page));
+  } else if (!layoutKnown(n, *page)) {
+    _renderer.cancel(page);
+    return;
+  }
+  _renderer.submit(page, _face);
+}
+
+void Reader::prefetch() {
+  if (!isOpen() || !_prerender)
+    return;
+  // Forward first: its layout carries on from the stream, and the page
+  // behind is usually the one that was on screen
+  if (!_renderer.find(_page))
+    prepare(_page);
+  if (_page + 1 < _index.pages() && !_renderer.find(_page + 1))
+    prepare(_page + 1);
+  if (_page > 0 && !_renderer.find(_page - 1))
+    prepare(_page - 1);
+}
+
+bool Reader::prefetched() const {
+  if (!isOpen() || !_prerender)
+    return true;
+  return _renderer.find(_page) &&
+         (_page + 1 >= _index.pages() || _renderer.find(_page + 1)) &&
+         (_page == 0 || _renderer.find(_page - 1));
+}
@@ -0,0 +1,131 @@
+/**
+ * Reader
+ *
+ * One open book: its source, page layout and page index, and the page on
+ * screen. Pages are numbered from 0 in reading order. A page can be shown
+ * once the index knows where it starts; going past the known pages lays
+ * them out one after another to find out. While the user reads, extend()
+ * spends idle time laying out the pages after the known ones, so the page
+ * count fills in and later jumps are lookups.
+ *
+ * prefetch() lays out the pages either side of the one on screen and has
+ * the PageRenderer draw them in the background: turning to one of them
+ * takes its layout as is, and the screen pushes its canvas.
+ *
+ * The page font is /fonts/serif-<px>.fnt from the card when it has one
+ * for the size (anti-aliased, any character the file covers), otherwise
+ * the built-in FreeSerif. The two lay out differently, so each keeps its
+ * own page index.
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include "book_source.h"
+#include "page_index.h"
+#include "page_layout.h"
+#include "page_renderer.h"
+#include <Arduino.h>
+#include <M5Unified.h>
+
+class Reader {
+public:
+  static const int FONTS = 3; // Small, medium, large serif
+  static const int SD_SIZES[FONTS]; // Line heights of the card fonts
+  static const int TEXT_WIDTH = 880;
+  static const int TEXT_HEIGHT = 440;
+  static const int MAX_NAME = 64;
+
+  Reader();
+  ~Reader() { close(); }
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  /**
+   * Open a book in /books and show the page at pos, or where it was last
+   * read
+   * @param name File name within /books
+   */
+  bool open(const char *name, uint8_t font,
+            const BookSource::Pos *pos = nullptr);
+
+  /**
+   * Save the page index and position, then release the book
+   */
+  void close();
+
+  bool isOpen() const { return _source.isOpen(); }
+  const char *name() const { return _name; }
+
+  uint8_t font() const { return _font; }
+  const lgfx::IFont *face() const { return _face; } // For font()
+
+  /**
+   * Lay the book out again in another font, keeping the position
+   */
+  bool setFont(uint8_t font);
+
+  /**
+   * Show page n, laying out the pages before it that the index lacks
+   * (clamped to the last page)
+   */
+  bool go(size_t n);
+
+  /**
+   * Show the page that holds pos
+   */
+  bool show(BookSource::Pos pos);
+
+  size_t page() const { return _page; }
+  size_t knownPages() const { return _index.pages(); }
+  bool complete() const { return _index.complete(); }
+  const PageLayout::Page &current() const { return *_current; }
+  BookSource::Pos position() const { return _current->start; }
+
+  /**
+   * Canvas of the page on screen, if it has been drawn ahead
+   */
+  M5Canvas *rendered() { return _renderer.canvas(_page); }
+
+  /**
+   * Lay out the pages next to the one on screen and queue them for
+   * drawing; call from the loop task between page turns
+   */
+  void prefetch();
+
+  /**
+   * The pages next to the one on screen are laid out (or cannot be)
+   */
+  bool prefetched() const;
+
+  /**
+   * Lay out pages past the known ones for up to budgetMs
+   * @return true while the index is still incomplete
+   */
+  bool extend(uint32_t budgetMs);
+
+private:
+  char _name[MAX_NAME];
+  uint8_t _font;
+  const lgfx::IFont *_face;
+  bool _sdFace;           // _face is from the card
+  uint32_t _key;          // PageIndex::key() of the open book
+  uint32_t _generation;   // SD mount the source was opened on
+  BookSource _source;
+  PageLayout _layout;
+  PageIndex _index;
+  PageRenderer _renderer;
+  bool _prerender;        // The renderer has its slots
+  M5Canvas _measure;      // No pixels: font metrics for the layout
+  PageLayout::Page *_current; // On screen (PSRAM)
+  PageLayout::Page *_scratch; // Pages laid out only to index them
+  size_t _page;
+
+  bool reopen(); // After a remount
+  bool layoutKnown(size_t n, PageLayout::Page &page);
+  void prepare(size_t n); // Into a renderer slot
+  void setFace();
+  uint8_t layoutId() const; // Page index font: the size and its source
+};
+
+#endif // READER_H
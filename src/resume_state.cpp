@@ -0,0 +1,78 @@
+/**
+ * Resume State Implementation
+ */
+
+#include "resume_state.h"
+#include "utils/crc16.h"
+#include <algorithm>
+#include <esp_sleep.h>
+
+namespace ResumeState {
+
+static const uint32_t MAGIC = 0x52534D31; // "RSM1"
+
+struct Sealed {
+  uint32_t magic;
+  uint16_t length; // sizeof(ResumeSnapshot) when sealed
+  uint16_t crc;    // CRC-16/Modbus of state
+  ResumeSnapshot state;
+};
+
+// Raw bytes: PowerBankData has member initializers, and a constructor run
+// at boot would wipe what deep sleep kept
+RTC_DATA_ATTR alignas(Sealed) static uint8_t _storage[sizeof(Sealed)];
+static Sealed &_rtc = *reinterpret_cast<Sealed *>(_storage);
+
+static uint16_t checksum() {
+  return CRC16::modbus((const uint8_t *)&_rtc.state, sizeof(_rtc.state));
+}
+
+ResumeSnapshot &snapshot() {
+  _rtc.magic = 0; // Open until sealed again
+  return _rtc.state;
+}
+
+void save() {
+  _rtc.length = sizeof(ResumeSnapshot);
+  _rtc.crc = checksum();
+  _rtc.magic = MAGIC;
+}
+
+const ResumeSnapshot *load() {
+  static int cached = -1;
+  if (cached < 0) {
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    bool woke = cause == ESP_SLEEP_WAKEUP_EXT0 ||
+                cause == ESP_SLEEP_WAKEUP_EXT1 || // RTC INT
+                cause == ESP_SLEEP_WAKEUP_TIMER;
+    cached = woke && _rtc.magic == MAGIC &&
+             _rtc.length == sizeof(ResumeSnapshot) && _rtc.crc == checksum() &&
+             _rtc.state.configValid;
+    if (woke && !cached)
+      Serial.println("Resume: No valid state, full boot");
+  }
+  return cached ? &_rtc.state : nullptr;
+}
+
+void updateData(const Fossibot::PowerBankData &data) {
+  if (_rtc.magic != MAGIC)
+    return;
+  _rtc.state.data = data;
+  save();
+}
+
+void panelChanged(int x, int y, int w, int h) {
+  if (_rtc.magic != MAGIC || !_rtc.state.panelKept || w <= 0 || h <= 0)
+    return;
+  const int across = 960 / FrameBuffer::TILE_W;
+  const int down = 540 / FrameBuffer::TILE_H;
+  int tx1 = std::min((x + w - 1) / FrameBuffer::TILE_W, across - 1);
+  int ty1 = std::min((y + h - 1) / FrameBuffer::TILE_H, down - 1);
+  for (int ty = std::max(y, 0) / FrameBuffer::TILE_H; ty <= ty1; ty++) {
+    for (int tx = std::max(x, 0) / FrameBuffer::TILE_W; tx <= tx1; tx++)
+      _rtc.state.panelTiles[ty * across + tx] = FrameBuffer::NO_TILE;
+  }
+  save();
+}
+
+} // namespace ResumeState
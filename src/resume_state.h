@@ -0,0 +1,73 @@
+/**
+ * Resume State
+ *
+ * What the UI needs to come back from deep sleep without the slow part of
+ * boot, kept in RTC slow memory: the screen that was showing, the last
+ * power bank frame, today's energy counters, every setting, the primary
+ * unit's GATT handles, any running countdown or pomodoro, and a hash of
+ * each tile of the frame the panel kept through the sleep. A wake with
+ * a valid snapshot restores the config from it instead of the file, draws
+ * the screen from it before the card and history are brought up, and
+ * primes the BLE reconnect.
+ *
+ * The snapshot is written just before deep sleep and only trusted on a
+ * deep-sleep wake; a power-on or reset boots the slow way.
+ */
+
+#ifndef RESUME_STATE_H
+#define RESUME_STATE_H
+
+#include "ble/ble_client.h"
+#include "power_history.h"
+#include "ui/frame_buffer.h"
+#include "utils/config.h"
+#include <Arduino.h>
+
+struct ResumeSnapshot {
+  uint8_t screen; // ScreenID
+  bool configValid;
+  Fossibot::PowerBankData data;
+  EnergyTotals energy;
+  Config::Snapshot config;
+  FossibotBLE::LinkCache link; // For config.fossibotMACs[0]
+  uint8_t clockMode;           // ClockMode
+  uint8_t pomodoroSession;     // PomodoroSession
+  uint32_t timerDue;           // Unix time a running countdown ends, 0 = none
+  uint32_t pomodoroDue;        // Same for a running pomodoro
+  bool panelKept;              // Home is on the panel, as hashed below
+  uint32_t panelTiles[FrameBuffer::MAX_TILES];
+};
+
+namespace ResumeState {
+
+/**
+ * The RTC copy, to fill in before save()
+ */
+ResumeSnapshot &snapshot();
+
+/**
+ * Seal the snapshot for the next wake
+ */
+void save();
+
+/**
+ * The snapshot if this boot is a deep-sleep wake and it is intact with
+ * a config, otherwise nullptr (decided once per boot)
+ */
+const ResumeSnapshot *load();
+
+/**
+ * Replace the power bank frame in a sealed snapshot (sleep-cycle wakes
+ * keep it current)
+ */
+void updateData(const Fossibot::PowerBankData &data);
+
+/**
+ * Pixels in this area of the panel were painted after the snapshot (a
+ * sleep-cycle wake's readout); the tiles under it no longer match
+ */
+void panelChanged(int x, int y, int w, int h);
+
+} // namespace ResumeState
+
+#endif // RESUME_STATE_H
@@ -0,0 +1,501 @@
+/**
+ * Rule Engine Implementation
+ */
+
+#include "rule_engine.h"
+#include "utils/log.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int MAX_RULE_TEXT = 160;
+
+// Indexed by Field
+static const char *const FIELD_NAMES[] = {
+    "soc", "volts", "in_w", "out_w",       "ac_in_w",     "dc_in_w",
+    "usb", "dc",    "ac",   "to_full_min", "to_empty_min"};
+
+static const char *const OUTPUT_NAMES[] = {"usb", "dc", "ac"};
+
+RuleEngine::RuleEngine()
+    : _ruleCount(0), _codeLength(0), _constCount(0), _holdCount(0),
+      _valid(false) {
+  for (int i = 0; i < FIELD_COUNT; i++)
+    _fields[i] = 0;
+}
+
+// ============================================================
+// Compiler
+// ============================================================
+
+static void skipSpace(const char *&pos) {
+  while (*pos == ' ' || *pos == '\t')
+    pos++;
+}
+
+static bool isWordChar(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+// Length of the identifier at pos (after spaces), 0 if none
+static int wordAt(const char *&pos) {
+  skipSpace(pos);
+  int n = 0;
+  if (!isalpha((unsigned char)pos[0]))
+    return 0;
+  while (isWordChar(pos[n]))
+    n++;
+  return n;
+}
+
+// Consume the keyword if it is next (case-insensitive)
+static bool acceptWord(const char *&pos, const char *word) {
+  int n = wordAt(pos);
+  if (n == 0 || (int)strlen(word) != n || strncasecmp(pos, word, n) != 0)
+    return false;
+  pos += n;
+  return true;
+}
+
+static bool acceptSymbol(const char *&pos, const char *symbol) {
+  skipSpace(pos);
+  size_t n = strlen(symbol);
+  if (strncmp(pos, symbol, n) != 0)
+    return false;
+  pos += n;
+  return true;
+}
+
+static bool parseNumber(const char *&pos, float &value) {
+  skipSpace(pos);
+  char *end;
+  value = strtof(pos, &end);
+  if (end == pos)
+    return false;
+  pos = end;
+  if (*pos == '%')
+    pos++;
+  return true;
+}
+
+int RuleEngine::compile(const String &source) {
+  _ruleCount = 0;
+  _codeLength = 0;
+  _constCount = 0;
+  _holdCount = 0;
+
+  const char *text = source.c_str();
+  int number = 0;
+  while (*text) {
+    const char *end = strchr(text, '\n');
+    int length = end ? end - text : strlen(text);
+    number++;
+    if (length > 0 && !compileRule(text, length, number))
+      LOG_W("Rules", "Rule %d skipped", number);
+    text += length;
+    if (*text == '\n')
+      text++;
+  }
+
+  if (_ruleCount > 0)
+    LOG_I("Rules", "%d rules, %d bytes of code", _ruleCount, _codeLength);
+  return _ruleCount;
+}
+
+bool RuleEngine::compileRule(const char *text, int length, int number) {
+  if (_ruleCount >= MAX_RULES) {
+    LOG_W("Rules", "Rule %d: more than %d rules", number, MAX_RULES);
+    return false;
+  }
+  if (length >= MAX_RULE_TEXT) {
+    LOG_W("Rules", "Rule %d: longer than %d characters", number,
+          MAX_RULE_TEXT - 1);
+    return false;
+  }
+  char line[MAX_RULE_TEXT];
+  memcpy(line, text, length);
+  line[length] = '\0';
+
+  // Undone if the rule does not compile
+  int codeLength = _codeLength;
+  int constCount = _constCount;
+  int holdCount = _holdCount;
+
+  Rule &rule = _rules[_ruleCount];
+  rule.code = _codeLength;
+  rule.due = 0;
+  rule.number = number;
+  rule.actionCount = 0;
+  rule.active = false;
+
+  Parser p = {line, line, nullptr, 0, 0, 0};
+  bool ok = acceptWord(p.pos, "if");
+  if (!ok)
+    p.error = "expected 'if'";
+  ok = ok && parseOr(p);
+  if (ok && !acceptWord(p.pos, "then")) {
+    p.error = "expected 'then'";
+    ok = false;
+  }
+  ok = ok && emit(p, OP_END) && parseActions(p, rule);
+  if (ok) {
+    skipSpace(p.pos);
+    if (*p.pos) {
+      p.error = "unexpected text";
+      ok = false;
+    }
+  }
+  if (ok && p.maxDepth > STACK_DEPTH) {
+    p.error = "condition nested too deep";
+    ok = false;
+  }
+
+  if (!ok) {
+    LOG_W("Rules", "Rule %d: %s at '%.16s'", number,
+          p.error ? p.error : "syntax error", p.pos);
+    _codeLength = codeLength;
+    _constCount = constCount;
+    _holdCount = holdCount;
+    return false;
+  }
+
+  rule.fields = p.fields;
+  _ruleCount++;
+  return true;
+}
+
+bool RuleEngine::emit(Parser &p, uint8_t op, int arg) {
+  int size = arg >= 0 ? 2 : 1;
+  if (_codeLength + size > CODE_BYTES) {
+    p.error = "rules too long";
+    return false;
+  }
+  _code[_codeLength++] = op;
+  if (arg >= 0)
+    _code[_codeLength++] = (uint8_t)arg;
+
+  switch (op) {
+  case OP_FIELD:
+  case OP_CONST:
+    p.depth++;
+    break;
+  case OP_NOT:
+  case OP_HOLD:
+  case OP_END:
+    break;
+  default: // Binary
+    p.depth--;
+    break;
+  }
+  if (p.depth > p.maxDepth)
+    p.maxDepth = p.depth;
+  return true;
+}
+
+// or := and {"or" and}
+bool RuleEngine::parseOr(Parser &p) {
+  if (!parseAnd(p))
+    return false;
+  while (acceptWord(p.pos, "or"))
+    if (!parseAnd(p) || !emit(p, OP_OR))
+      return false;
+  return true;
+}
+
+// and := unary {"and" unary}
+bool RuleEngine::parseAnd(Parser &p) {
+  if (!parseUnary(p))
+    return false;
+  while (acceptWord(p.pos, "and"))
+    if (!parseUnary(p) || !emit(p, OP_AND))
+      return false;
+  return true;
+}
+
+// unary := "not" unary | primary {"for" duration}
+bool RuleEngine::parseUnary(Parser &p) {
+  if (acceptWord(p.pos, "not"))
+    return parseUnary(p) && emit(p, OP_NOT);
+  if (!parsePrimary(p))
+    return false;
+  while (acceptWord(p.pos, "for")) {
+    uint32_t ms;
+    if (!parseDuration(p, ms))
+      return false;
+    if (_holdCount >= MAX_HOLDS) {
+      p.error = "too many 'for' clauses";
+      return false;
+    }
+    _holds[_holdCount] = {ms, 0};
+    if (!emit(p, OP_HOLD, _holdCount++))
+      return false;
+  }
+  return true;
+}
+
+// primary := "(" or ")" | field [comparison number]
+bool RuleEngine::parsePrimary(Parser &p) {
+  if (acceptSymbol(p.pos, "(")) {
+    if (!parseOr(p))
+      return false;
+    if (!acceptSymbol(p.pos, ")")) {
+      p.error = "expected ')'";
+      return false;
+    }
+    return true;
+  }
+
+  int field = -1;
+  for (int i = 0; i < FIELD_COUNT && field < 0; i++)
+    if (acceptWord(p.pos, FIELD_NAMES[i]))
+      field = i;
+  if (field < 0) {
+    p.error = "expected a field";
+    return false;
+  }
+  p.fields |= 1 << field;
+  if (!emit(p, OP_FIELD, field))
+    return false;
+
+  // Longer symbols first so "<=" is not read as "<"
+  static const struct {
+    const char *symbol;
+    Op op;
+  } COMPARISONS[] = {{"<=", OP_LE}, {">=", OP_GE}, {"==", OP_EQ},
+                     {"!=", OP_NE}, {"<", OP_LT},  {">", OP_GT},
+                     {"=", OP_EQ}};
+  for (const auto &c : COMPARISONS) {
+    if (!acceptSymbol(p.pos, c.symbol))
+      continue;
+    float value;
+    if (!parseNumber(p.pos, value)) {
+      p.error = "expected a number";
+      return false;
+    }
+    if (_constCount >= MAX_CONSTS) {
+      p.error = "too many numbers";
+      return false;
+    }
+    _consts[_constCount] = value;
+    return emit(p, OP_CONST, _constCount++) && emit(p, c.op);
+  }
+  return true; // Bare field: true while non-zero
+}
+
+// duration := [">" | ">="] number ("s" | "min" | "h")
+bool RuleEngine::parseDuration(Parser &p, uint32_t &ms) {
+  if (!acceptSymbol(p.pos, ">="))
+    acceptSymbol(p.pos, ">");
+  float value;
+  if (!parseNumber(p.pos, value) || value < 0) {
+    p.error = "expected a duration";
+    return false;
+  }
+
+  static const struct {
+    const char *unit;
+    uint32_t ms;
+  } UNITS[] = {{"s", 1000},     {"sec", 1000},    {"secs", 1000},
+               {"m", 60000},    {"min", 60000},   {"mins", 60000},
+               {"h", 3600000},  {"hour", 3600000}, {"hours", 3600000}};
+  for (const auto &u : UNITS) {
+    if (acceptWord(p.pos, u.unit)) {
+      if (value * u.ms > 7 * 24 * 3600000.0f) {
+        p.error = "duration over a week";
+        return false;
+      }
+      ms = (uint32_t)(value * u.ms);
+      return true;
+    }
+  }
+  p.error = "duration needs s, min or h";
+  return false;
+}
+
+// actions := output ("on" | "off") {("," | "and") output ("on" | "off")}
+bool RuleEngine::parseActions(Parser &p, Rule &rule) {
+  do {
+    int output = -1;
+    for (int i = 0; i < 3 && output < 0; i++)
+      if (acceptWord(p.pos, OUTPUT_NAMES[i]))
+        output = i;
+    if (output < 0) {
+      p.error = "expected usb, dc or ac";
+      return false;
+    }
+    bool on;
+    if (acceptWord(p.pos, "on")) {
+      on = true;
+    } else if (acceptWord(p.pos, "off")) {
+      on = false;
+    } else {
+      p.error = "expected on or off";
+      return false;
+    }
+    if (rule.actionCount >= MAX_ACTIONS) {
+      p.error = "too many actions";
+      return false;
+    }
+    rule.actions[rule.actionCount++] = {(Output)output, on};
+  } while (acceptSymbol(p.pos, ",") || acceptWord(p.pos, "and"));
+  return true;
+}
+
+// ============================================================
+// Evaluation
+// ============================================================
+
+void RuleEngine::evaluate(const Fossibot::PowerBankData &data) {
+  if (_ruleCount == 0)
+    return;
+
+  // Rules are written in percent, volts and watts
+  float fields[FIELD_COUNT];
+  fields[SOC] = Fixed::toFloat(data.socPermille, Fixed::PERMILLE_PER_PCT);
+  fields[VOLTS] = Fixed::toFloat(data.batteryCentivolts, Fixed::CV_PER_V);
+  fields[IN_W] = Fixed::toFloat(data.inputDeciwatts, Fixed::DW_PER_W);
+  fields[OUT_W] = Fixed::toFloat(data.outputDeciwatts, Fixed::DW_PER_W);
+  fields[AC_IN_W] = Fixed::toFloat(data.acInputDeciwatts, Fixed::DW_PER_W);
+  fields[DC_IN_W] = Fixed::toFloat(data.dcInputDeciwatts, Fixed::DW_PER_W);
+  fields[USB] = data.usbActive ? 1 : 0;
+  fields[DC] = data.dcActive ? 1 : 0;
+  fields[AC] = data.acActive ? 1 : 0;
+  fields[TO_FULL] = data.minutesToFull;
+  fields[TO_EMPTY] = data.minutesToEmpty;
+
+  uint16_t changed = 0;
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    if (!_valid || fields[i] != _fields[i])
+      changed |= 1 << i;
+    _fields[i] = fields[i];
+  }
+  _valid = true;
+  if (changed == 0)
+    return;
+
+  uint32_t now = millis();
+  for (int i = 0; i < _ruleCount; i++)
+    if (_rules[i].fields & changed)
+      run(_rules[i], now);
+}
+
+void RuleEngine::service(bool connected) {
+  if (!connected) {
+    if (_valid)
+      forget();
+    return;
+  }
+  if (!_valid)
+    return;
+
+  uint32_t now = millis();
+  for (int i = 0; i < _ruleCount; i++) {
+    Rule &rule = _rules[i];
+    if (rule.due && (int32_t)(now - rule.due) >= 0)
+      run(rule, now);
+  }
+}
+
+uint32_t RuleEngine::msUntilDue() const {
+  if (!_valid)
+    return UINT32_MAX;
+  uint32_t now = millis();
+  uint32_t soonest = UINT32_MAX;
+  for (int i = 0; i < _ruleCount; i++) {
+    const Rule &rule = _rules[i];
+    if (!rule.due)
+      continue;
+    int32_t left = (int32_t)(rule.due - now);
+    uint32_t ms = left > 0 ? left : 0;
+    if (ms < soonest)
+      soonest = ms;
+  }
+  return soonest;
+}
+
+void RuleEngine::run(Rule &rule, uint32_t now) {
+  float stack[STACK_DEPTH];
+  int sp = 0;
+  uint32_t due = 0;
+
+  // Every clause is evaluated (no short circuit) so the "for" timers see
+  // each frame
+  const uint8_t *pc = _code + rule.code;
+  for (;;) {
+    uint8_t op = *pc++;
+    if (op == OP_END)
+      break;
+    switch (op) {
+    case OP_FIELD:
+      stack[sp++] = _fields[*pc++];
+      break;
+    case OP_CONST:
+      stack[sp++] = _consts[*pc++];
+      break;
+    case OP_NOT:
+      stack[sp - 1] = stack[sp - 1] == 0 ? 1 : 0;
+      break;
+    case OP_HOLD: {
+      Hold &hold = _holds[*pc++];
+      if (stack[sp - 1] == 0) {
+        hold.since = 0;
+        break;
+      }
+      if (hold.since == 0)
+        hold.since = now ? now : 1;
+      uint32_t end = hold.since + hold.durationMs;
+      if ((int32_t)(now - end) >= 0) {
+        stack[sp - 1] = 1;
+      } else {
+        stack[sp - 1] = 0;
+        if (due == 0 || (int32_t)(end - due) < 0)
+          due = end ? end : 1;
+      }
+      break;
+    }
+    default: {
+      float b = stack[--sp];
+      float a = stack[sp - 1];
+      bool r;
+      switch (op) {
+      case OP_LT: r = a < b; break;
+      case OP_LE: r = a <= b; break;
+      case OP_GT: r = a > b; break;
+      case OP_GE: r = a >= b; break;
+      case OP_EQ: r = a == b; break;
+      case OP_NE: r = a != b; break;
+      case OP_AND: r = a != 0 && b != 0; break;
+      default: r = a != 0 || b != 0; break; // OP_OR
+      }
+      stack[sp - 1] = r ? 1 : 0;
+      break;
+    }
+    }
+  }
+  rule.due = due;
+
+  bool result = stack[0] != 0;
+  bool fire = result && !rule.active;
+  rule.active = result;
+  if (!fire)
+    return;
+
+  for (int i = 0; i < rule.actionCount; i++) {
+    const Action &action = rule.actions[i];
+    bool isOn = _fields[USB + (int)action.output] != 0;
+    if (isOn == action.on)
+      continue;
+    LOG_I("Rules", "Rule %d: %s %s", rule.number,
+          OUTPUT_NAMES[(int)action.output], action.on ? "on" : "off");
+    if (_actuator)
+      _actuator(action.output, action.on);
+  }
+}
+
+void RuleEngine::forget() {
+  // Conditions keep their last state, so a rule that already acted does
+  // not act again just because the link came back
+  _valid = false;
+  for (int i = 0; i < _holdCount; i++)
+    _holds[i].since = 0;
+  for (int i = 0; i < _ruleCount; i++)
+    _rules[i].due = 0;
+}
@@ -0,0 +1,163 @@
+/**
+ * Rule Engine
+ *
+ * Local automation for the primary power bank's outlets. Rules come from
+ * the "rules" list in the settings, one per string:
+ *
+ *   if soc < 20 and ac for 10 min then ac off
+ *   if in_w > 200 then dc on
+ *   if (out_w < 5 or soc <= 15) for 30 s then usb off, dc off
+ *
+ * Conditions compare telemetry fields (soc, volts, in_w, out_w, ac_in_w,
+ * dc_in_w, to_full_min, to_empty_min; usb, dc and ac are 1 while on) with
+ * numbers, joined by and/or/not and parentheses. "X for D" is true once
+ * the term or bracketed group X has held for D (s, min or h).
+ *
+ * Each rule is compiled once at load time into a few bytes of stack
+ * bytecode and a mask of the fields it reads. A frame only runs the rules
+ * whose fields changed, and a rule with a "for" runs again when its timer
+ * is due. A rule acts when its condition becomes true (not while it stays
+ * true, so a manual override sticks), and only on outlets not already in
+ * the wanted state; the writes go through the BLE command queue.
+ */
+
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include "ble/fossibot_protocol.h"
+#include <Arduino.h>
+#include <functional>
+
+class RuleEngine {
+public:
+  static const int MAX_RULES = 16;
+  static const int MAX_ACTIONS = 3; // Per rule
+  static const int CODE_BYTES = 384; // All rules
+  static const int MAX_CONSTS = 48;
+  static const int MAX_HOLDS = 16; // "for" clauses, all rules
+  static const int STACK_DEPTH = 8;
+
+  enum class Output : uint8_t { USB, DC, AC };
+
+  using Actuator = std::function<void(Output output, bool on)>;
+
+  RuleEngine();
+
+  void setActuator(Actuator actuator) { _actuator = actuator; }
+
+  /**
+   * Compile the rules (newline separated), replacing any loaded before. A
+   * rule that does not parse is logged and skipped.
+   * @return Rules compiled
+   */
+  int compile(const String &source);
+
+  /**
+   * Take a new frame from the primary unit and run the rules that read a
+   * field it changed. Call from the main loop.
+   */
+  void evaluate(const Fossibot::PowerBankData &data);
+
+  /**
+   * Run rules whose "for" timer is due; without a link, forget the fields
+   * and timers so the next frame starts over. Call from the main loop.
+   */
+  void service(bool connected);
+
+  /**
+   * Milliseconds until a "for" timer is due (UINT32_MAX: none)
+   */
+  uint32_t msUntilDue() const;
+
+  int count() const { return _ruleCount; }
+
+private:
+  enum Field : uint8_t {
+    SOC,
+    VOLTS,
+    IN_W,
+    OUT_W,
+    AC_IN_W,
+    DC_IN_W,
+    USB,
+    DC,
+    AC,
+    TO_FULL,
+    TO_EMPTY,
+    FIELD_COUNT
+  };
+
+  enum Op : uint8_t {
+    OP_FIELD, // Field index follows
+    OP_CONST, // Constant index follows
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_AND,
+    OP_OR,
+    OP_NOT,
+    OP_HOLD, // Hold index follows
+    OP_END
+  };
+
+  struct Action {
+    Output output;
+    bool on;
+  };
+
+  struct Rule {
+    uint16_t code;      // Offset in _code
+    uint16_t fields;    // Field bits the condition reads
+    uint32_t due;       // millis() a "for" timer expires, 0: none
+    uint8_t number;     // Line in the settings, for the log
+    uint8_t actionCount;
+    Action actions[MAX_ACTIONS];
+    bool active; // Condition true at the last run
+  };
+
+  struct Hold {
+    uint32_t durationMs;
+    uint32_t since; // millis() the inner condition became true, 0: false
+  };
+
+  // Compiler state for the rule being parsed
+  struct Parser {
+    const char *text;
+    const char *pos;
+    const char *error;
+    int depth; // Stack depth the code so far leaves
+    int maxDepth;
+    uint16_t fields;
+  };
+
+  Rule _rules[MAX_RULES];
+  int _ruleCount;
+  uint8_t _code[CODE_BYTES];
+  int _codeLength;
+  float _consts[MAX_CONSTS];
+  int _constCount;
+  Hold _holds[MAX_HOLDS];
+  int _holdCount;
+
+  float _fields[FIELD_COUNT];
+  bool _valid; // _fields hold a frame
+  Actuator _actuator;
+
+  bool compileRule(const char *text, int length, int number);
+  bool parseOr(Parser &p);
+  bool parseAnd(Parser &p);
+  bool parseUnary(Parser &p);
+  bool parsePrimary(Parser &p);
+  bool parseDuration(Parser &p, uint32_t &ms);
+  bool parseActions(Parser &p, Rule &rule);
+  bool emit(Parser &p, uint8_t op, int arg = -1);
+  void run(Rule &rule, uint32_t now);
+  void forget();
+};
+
+extern RuleEngine *rules;
+
+#endif // RULE_ENGINE_H
@@ -0,0 +1,367 @@
+/**
+ * Performance Self-Test Implementation
+ */
+
+#include "self_test.h"
+#include "logic_bench.h"
+#include "power_history.h"
+#include "ui/note_codec.h"
+#include "ui/ui_manager.h"
+#include "utils/fixed_string.h"
+#include "utils/flash_store.h"
+#include "utils/loop_monitor.h"
+#include "utils/sd_benchmark.h"
+#include "utils/sd_manager.h"
+#include <algorithm>
+#include <esp_heap_caps.h>
+
+extern SDManager *sdManager;
+extern UIManager *uiManager;
+
+namespace SelfTest {
+
+typedef FixedString<48> Path;
+
+// As the Notes canvas: left of the toolbar, 1 bpp
+static const uint16_t NOTE_W = 860;
+static const uint16_t NOTE_H = 540;
+static const uint8_t NOTE_DEPTH = 1;
+
+struct Sample {
+  float runs[RUNS];
+  int count;
+};
+
+static float median(Sample &s) {
+  std::sort(s.runs, s.runs + s.count);
+  return s.runs[s.count / 2];
+}
+
+const char *verdictName(Verdict verdict) {
+  switch (verdict) {
+  case Verdict::NEW:
+    return "new";
+  case Verdict::SAME:
+    return "ok";
+  case Verdict::FASTER:
+    return "faster";
+  case Verdict::SLOWER:
+    return "SLOWER";
+  default:
+    return "skipped";
+  }
+}
+
+static void add(Report &report, const char *name, const char *unit,
+                float value) {
+  if (report.count >= MAX_RESULTS)
+    return;
+  Result &r = report.results[report.count++];
+  strlcpy(r.name, name, sizeof(r.name));
+  r.unit = unit;
+  r.value = value;
+  r.baseline = 0;
+  r.verdict = value > 0 ? Verdict::NEW : Verdict::SKIPPED;
+}
+
+// ============================================================================
+// Workloads
+// ============================================================================
+
+static void testDecode(Report &report) {
+  // Recorded frames when there are any: they keep their own baseline
+  const char *name = "recorded_decode";
+  Sample s = {{}, 0};
+  float ns;
+  if (!LogicBench::measure(name, ns)) {
+    name = "status_decode";
+    if (!LogicBench::measure(name, ns)) {
+      add(report, name, "ns", 0);
+      return;
+    }
+  }
+  s.runs[s.count++] = ns;
+  while (s.count < RUNS && LogicBench::measure(name, ns))
+    s.runs[s.count++] = ns;
+  add(report, name, "ns", median(s));
+}
+
+// Remove the scratch history's files (under SDAccess)
+static void clearScratch() {
+  fs::FS &fs = sdFS();
+  if (!fs.exists(SCRATCH_DIR))
+    fs.mkdir(SCRATCH_DIR);
+  Path names[16];
+  int found;
+  do {
+    found = 0;
+    fs::File d = fs.open(SCRATCH_DIR);
+    for (fs::File f = d.openNextFile(); f && found < 16;
+         f = d.openNextFile()) {
+      if (!f.isDirectory())
+        names[found++] = Path::format("%s/%s", SCRATCH_DIR, f.name());
+      f.close();
+    }
+    d.close();
+    for (int i = 0; i < found; i++)
+      fs.remove(names[i].c_str());
+  } while (found == 16);
+
+  // The journal lives in the flash tier when it is mounted
+  if (flashStore && flashStore->isAvailable())
+    flashStore->fs().remove(Path::format("%s/journal.bin", SCRATCH_DIR));
+}
+
+static void testHistory(Report &report) {
+  Sample flush = {{}, 0}, load = {{}, 0};
+  uint32_t dayStart = time(nullptr) / 86400 * 86400;
+  for (int run = 0; run < RUNS; run++) {
+    clearScratch();
+    PowerHistory *history = new PowerHistory();
+    history->setDirectory(SCRATCH_DIR);
+    history->setRtcTail(false);
+    history->init();
+
+    // An hour of today, then its first flush: the day file checkpoint
+    for (int m = 0; m < 60; m++) {
+      PowerSample s = {dayStart + m * 60U, (uint8_t)(80 - m / 6),
+                       (uint16_t)(300 + m * 5), (uint16_t)(150 + m * 3),
+                       (uint16_t)(200 + m * 4), 1320, PowerSample::DETAIL};
+      history->addSampleAt(s);
+    }
+    uint32_t start = micros();
+    bool ok = history->flushToSD();
+    uint32_t flushUs = micros() - start;
+    delete history;
+
+    history = new PowerHistory();
+    history->setDirectory(SCRATCH_DIR);
+    history->setRtcTail(false);
+    start = micros();
+    history->init();
+    uint32_t loadUs = micros() - start;
+    ok = ok && history->getSampleCount(0) == 60;
+    delete history;
+    LoopMonitor::feed();
+    if (!ok)
+      break;
+    flush.runs[flush.count++] = flushUs;
+    load.runs[load.count++] = loadUs;
+  }
+  clearScratch();
+  add(report, "history_flush", "us", flush.count ? median(flush) : 0);
+  add(report, "history_load", "us", load.count ? median(load) : 0);
+}
+
+// Strokes across a blank page, about what a written note holds
+static void inkPage(uint8_t *pixels) {
+  size_t rowBytes = (NOTE_W * NOTE_DEPTH + 7) / 8;
+  memset(pixels, 0xFF, rowBytes * NOTE_H);
+  for (int line = 0; line < 10; line++) {
+    for (int x = 40; x < NOTE_W - 40; x++) {
+      int y = 40 + line * 48 + (x * 7 + line * 13) % 24;
+      for (int dy = 0; dy < 3; dy++)
+        pixels[(y + dy) * rowBytes + x / 8] &= ~(0x80 >> (x % 8));
+    }
+  }
+}
+
+static void testNote(Report &report) {
+  Sample save = {{}, 0}, load = {{}, 0};
+  size_t rawLen = (NOTE_W * NOTE_DEPTH + 7) / 8 * NOTE_H;
+  uint8_t *page = (uint8_t *)heap_caps_malloc(rawLen, MALLOC_CAP_SPIRAM);
+  uint8_t *back = (uint8_t *)heap_caps_malloc(rawLen, MALLOC_CAP_SPIRAM);
+  Path path = Path::format("%s/note.bin", SCRATCH_DIR);
+  if (page && back) {
+    inkPage(page);
+    for (int run = 0; run < RUNS; run++) {
+      // As a note is saved: encode, then one write
+      uint32_t start = micros();
+      size_t len = 0;
+      uint8_t *file = NoteCodec::encode(page, NOTE_W, NOTE_H, NOTE_DEPTH, len);
+      File out = file ? sdFS().open(path, FILE_WRITE) : File();
+      bool ok = out && out.write(file, len) == len;
+      if (out)
+        out.close();
+      uint32_t saveUs = micros() - start;
+      free(file);
+
+      // And opened: one read, then the decode
+      start = micros();
+      File in = ok ? sdFS().open(path, FILE_READ) : File();
+      file = in ? (uint8_t *)heap_caps_malloc(in.size(), MALLOC_CAP_SPIRAM)
+                : nullptr;
+      ok = file && in.read(file, in.size()) == in.size() &&
+           NoteCodec::decode(file, in.size(), back, NOTE_W, NOTE_H,
+                             NOTE_DEPTH);
+      if (in)
+        in.close();
+      uint32_t loadUs = micros() - start;
+      free(file);
+      LoopMonitor::feed();
+      if (!ok || memcmp(page, back, rawLen) != 0)
+        break;
+      save.runs[save.count++] = saveUs;
+      load.runs[load.count++] = loadUs;
+    }
+    sdFS().remove(path);
+  }
+  free(page);
+  free(back);
+  add(report, "note_save", "us", save.count ? median(save) : 0);
+  add(report, "note_load", "us", load.count ? median(load) : 0);
+}
+
+static void testHome(Report &report) {
+  Sample s = {{}, 0};
+  for (int run = 0; uiManager && run < RUNS; run++) {
+    uint32_t us = uiManager->timeHomeCompose();
+    if (!us)
+      break;
+    s.runs[s.count++] = us;
+  }
+  add(report, "home_compose", "us", s.count ? median(s) : 0);
+}
+
+static void testSd(Report &report) {
+  SDBench::Results r;
+  bool ok = SDBench::run(sdManager, r) && r.seqWriteMBps > 0 &&
+            r.seqReadMBps > 0;
+  add(report, "sd_seq_write", "ms/MB", ok ? 1000.0f / r.seqWriteMBps : 0);
+  add(report, "sd_seq_read", "ms/MB", ok ? 1000.0f / r.seqReadMBps : 0);
+  add(report, "sd_4k_read", "ms", ok ? r.randRead.p50Ms : 0);
+  add(report, "sd_4k_write", "ms", ok ? r.randWrite.p50Ms : 0);
+}
+
+// ============================================================================
+// Baseline
+// ============================================================================
+
+// Rows of BASELINE_FILE (under SDAccess)
+static int loadRows(Result *rows, int max) {
+  File file = sdFS().open(BASELINE_FILE, FILE_READ);
+  if (!file)
+    return 0;
+  int n = 0;
+  char line[64];
+  while (file.available() && n < max) {
+    size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[len] = '\0';
+    Result &r = rows[n];
+    if (sscanf(line, "%15[^,],%f", r.name, &r.value) != 2 || r.value <= 0)
+      continue; // Header, or a line cut short
+    n++;
+  }
+  file.close();
+  return n;
+}
+
+static void compare(Report &report) {
+  Result base[MAX_RESULTS * 2];
+  int rows = loadRows(base, MAX_RESULTS * 2);
+  report.baselineLoaded = rows > 0;
+  for (int i = 0; i < report.count; i++) {
+    Result &r = report.results[i];
+    for (int b = 0; b < rows; b++) {
+      if (strcmp(base[b].name, r.name) != 0)
+        continue;
+      r.baseline = base[b].value;
+      if (r.verdict == Verdict::SKIPPED)
+        break;
+      float limit = r.baseline * TOLERANCE_PCT / 100.0f;
+      r.verdict = r.value > r.baseline + limit   ? Verdict::SLOWER
+                  : r.value < r.baseline - limit ? Verdict::FASTER
+                                                 : Verdict::SAME;
+      if (r.verdict == Verdict::SLOWER)
+        report.regressions++;
+      break;
+    }
+  }
+}
+
+bool saveBaseline(const Report &report) {
+  SDAccess access(sdManager);
+  if (!access || !sdManager->ensureDirectory("/diag"))
+    return false;
+
+  // Workloads this run skipped (a QUICK run: the SD suite) keep theirs
+  Result rows[MAX_RESULTS * 2];
+  int n = loadRows(rows, MAX_RESULTS * 2);
+  for (int i = 0; i < report.count; i++) {
+    const Result &r = report.results[i];
+    if (r.verdict == Verdict::SKIPPED)
+      continue;
+    int b = 0;
+    while (b < n && strcmp(rows[b].name, r.name) != 0)
+      b++;
+    if (b == n && n == MAX_RESULTS * 2)
+      continue;
+    if (b == n)
+      n++;
+    rows[b] = r;
+  }
+
+  File file = sdFS().open(BASELINE_FILE, FILE_WRITE);
+  if (!file) {
+    access.fail();
+    return false;
+  }
+  file.print("name,value\n");
+  for (int b = 0; b < n; b++)
+    file.printf("%s,%.3f\n", rows[b].name, rows[b].value);
+  file.close();
+  Serial.printf("SelfTest: Baseline written to %s\n", BASELINE_FILE);
+  return true;
+}
+
+// ============================================================================
+// Run
+// ============================================================================
+
+void run(Report &report, bool withSd) {
+  report.count = 0;
+  report.regressions = 0;
+  report.baselineLoaded = false;
+  report.baselineSaved = false;
+
+  testDecode(report);
+  LoopMonitor::feed();
+  testHome(report);
+  {
+    SDAccess access(sdManager);
+    if (access) {
+      testHistory(report);
+      testNote(report);
+    } else {
+      add(report, "history_flush", "us", 0);
+      add(report, "history_load", "us", 0);
+      add(report, "note_save", "us", 0);
+      add(report, "note_load", "us", 0);
+    }
+  }
+  LoopMonitor::feed();
+  if (withSd && sdManager)
+    testSd(report);
+  LoopMonitor::feed();
+
+  {
+    SDAccess access(sdManager);
+    if (access)
+      compare(report);
+  }
+  if (!report.baselineLoaded)
+    report.baselineSaved = saveBaseline(report);
+}
+
+void print(Print &out, const Report &report) {
+  for (int i = 0; i < report.count; i++) {
+    const Result &r = report.results[i];
+    out.printf("#TEST %s %.1f %s base %.1f %s\n", r.name, r.value, r.unit,
+               r.baseline, verdictName(r.verdict));
+  }
+  if (report.baselineSaved)
+    out.printf("#TEST baseline %s\n", BASELINE_FILE);
+  out.printf("#TEST done %d %d\n", report.count, report.regressions);
+}
+
+} // namespace SelfTest
@@ -0,0 +1,84 @@
+/**
+ * Performance Self-Test
+ *
+ * A fixed set of workloads timed on the device and compared with the
+ * timings a known-good build left in BASELINE_FILE, so a firmware update
+ * that slows something down shows up on real hardware:
+ *
+ *   decode        the status frame decode of FossibotBLE::parseStatusData,
+ *                 over the frame recorder's newest frames (synthetic ones
+ *                 when nothing is recorded: logic_bench.h)
+ *   history_*     a scratch PowerHistory in SCRATCH_DIR: an hour of
+ *                 samples flushed (the day file checkpoint), then a fresh
+ *                 one loading them back
+ *   note_*        an inked 860x540 canvas encoded and written as a note,
+ *                 then read and decoded
+ *   home_compose  the dashboard composed off-screen (nothing is pushed)
+ *   sd_*          sequential and 4 KB random transfers from the SD suite
+ *                 (sd_benchmark.h; about a minute, and a card power cycle)
+ *
+ * Each timing is the median of RUNS (lower is better). A timing more
+ * than TOLERANCE_PCT over the baseline is a regression; one that far
+ * under is reported as faster. The first run with no baseline writes
+ * one; a run can also be made the new baseline on purpose once a
+ * slowdown is understood.
+ *
+ * Started with "TEST [QUICK] [SAVE]" over USB serial or from the profiler
+ * screen; it blocks the loop throughout.
+ */
+
+#ifndef SELF_TEST_H
+#define SELF_TEST_H
+
+#include <Arduino.h>
+
+namespace SelfTest {
+
+static const char *const BASELINE_FILE = "/diag/selftest.csv";
+static const char *const SCRATCH_DIR = "/selftest";
+static const int RUNS = 5;
+static const int TOLERANCE_PCT = 15;
+static const int MAX_RESULTS = 12;
+static const int NAME_LEN = 16;
+
+enum class Verdict : uint8_t { NEW, SAME, FASTER, SLOWER, SKIPPED };
+
+struct Result {
+  char name[NAME_LEN];
+  const char *unit;
+  float value;    // Median of the runs
+  float baseline; // 0: not in the baseline
+  Verdict verdict;
+};
+
+struct Report {
+  Result results[MAX_RESULTS];
+  int count;
+  int regressions;
+  bool baselineLoaded;
+  bool baselineSaved;
+};
+
+const char *verdictName(Verdict verdict);
+
+/**
+ * Run the workloads and compare them with the baseline. Writes the
+ * baseline when there is none yet.
+ * @param withSd Include the SD suite
+ */
+void run(Report &report, bool withSd);
+
+/**
+ * Make a report the baseline, replacing the file
+ */
+bool saveBaseline(const Report &report);
+
+/**
+ * "#TEST <name> <value> <unit> base <baseline> <verdict>" lines, then
+ * "#TEST done <results> <regressions>"
+ */
+void print(Print &out, const Report &report);
+
+} // namespace SelfTest
+
+#endif // SELF_TEST_H
@@ -0,0 +1,418 @@
+/**
+ * Serial Console Implementation
+ */
+
+#include "serial_console.h"
+#include "ble/ble_client.h"
+#include "ble/fleet_manager.h"
+#include "ble/frame_recorder.h"
+#include "hardware/energy_model.h"
+#include "hardware/i2c_bus.h"
+#include "history_export.h"
+#include "logic_bench.h"
+#include "self_test.h"
+#include "telemetry_simulator.h"
+#include "ui/screenshot.h"
+#include "ui/ui_manager.h"
+#include "utils/buffer_pool.h"
+#include "utils/log.h"
+#include "utils/loop_monitor.h"
+#include "utils/mem_telemetry.h"
+#include "utils/profiler.h"
+#include "utils/sd_benchmark.h"
+#include "utils/sd_manager.h"
+#include "utils/wake.h"
+
+extern UIManager *uiManager;
+extern FleetManager *fleet;
+extern FossibotBLE *bleClient;
+extern SDManager *sdManager;
+
+namespace {
+
+const char LEVEL_LETTERS[] = "NEWIDV"; // LOG_LEVEL_NONE .. VERBOSE
+
+bool is(const char *arg, const char *word) {
+  return arg && strcasecmp(arg, word) == 0;
+}
+
+void formatBound(char *out, size_t size, uint32_t ms) {
+  if (ms == UINT32_MAX)
+    snprintf(out, size, ">=%u", (unsigned)LinkStats::latencyBound(
+                                    LinkStats::LATENCY_BUCKETS - 2));
+  else
+    snprintf(out, size, "<%u", (unsigned)ms);
+}
+
+} // namespace
+
+SerialConsole::SerialConsole(HistoryExporter *exporter)
+    : _exporter(exporter), _task(nullptr), _queue(nullptr), _lineLength(0) {
+}
+
+SerialConsole::~SerialConsole() {
+  if (_task)
+    vTaskDelete(_task);
+  if (_queue)
+    vQueueDelete(_queue);
+}
+
+bool SerialConsole::begin() {
+  if (_task)
+    return true;
+  if (!_queue)
+    _queue = xQueueCreate(QUEUE_DEPTH, sizeof(Command));
+  // Just above idle: parsing never holds up the loop or the radio
+  if (!_queue || xTaskCreate(taskEntry, "console", TASK_STACK, this, 1,
+                             &_task) != pdPASS) {
+    _task = nullptr;
+    LOG_W("Console", "No console task, reading from the loop");
+  }
+#if ARDUINO_USB_MODE && ARDUINO_USB_CDC_ON_BOOT
+  Serial.onEvent(ARDUINO_HW_CDC_RX_EVENT, onReceive);
+#endif
+  return _task != nullptr;
+}
+
+void SerialConsole::onReceive(void *, esp_event_base_t, int32_t, void *) {
+  // Bytes in: the console task reads them, or the loop without it
+  if (console && console->_task)
+    xTaskNotifyGive(console->_task);
+  else
+    Wake::signal(Wake::SERIAL_RX);
+}
+
+void SerialConsole::taskEntry(void *arg) {
+  SerialConsole *self = (SerialConsole *)arg;
+  for (;;) {
+    while (self->readLine())
+      self->parse();
+#if ARDUINO_USB_MODE && ARDUINO_USB_CDC_ON_BOOT
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+    vTaskDelay(pdMS_TO_TICKS(POLL_MS));
+#endif
+  }
+}
+
+bool SerialConsole::readLine() {
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (_lineLength == 0)
+        continue;
+      _line[_lineLength] = '\0';
+      _lineLength = 0;
+      return true;
+    }
+    if (_lineLength < MAX_LINE - 1)
+      _line[_lineLength++] = (char)c;
+  }
+  return false;
+}
+
+void SerialConsole::parse() {
+  struct Entry {
+    const char *name;
+    Verb verb;
+  };
+  static const Entry VERBS[] = {
+      {"HELP", Verb::HELP},     {"PROF", Verb::PROF},
+      {"MEM", Verb::MEM},       {"LINK", Verb::LINK},
+      {"LOOP", Verb::LOOP},     {"LOG", Verb::LOG},
+      {"FLUSH", Verb::FLUSH},   {"SHOT", Verb::SHOT},
+      {"BENCH", Verb::BENCH},   {"TEST", Verb::TEST},
+      {"REC", Verb::REC},       {"REPLAY", Verb::REPLAY},
+      {"SIM", Verb::SIM},
+      {"LIST", Verb::EXPORT},   {"GET", Verb::EXPORT},
+      {"ACK", Verb::EXPORT},    {"STOP", Verb::EXPORT},
+  };
+
+  Command command;
+  memcpy(command.text, _line, sizeof(command.text));
+  command.argc = 0;
+  char *save = nullptr;
+  char *verb = strtok_r(command.text, " ", &save);
+  if (!verb)
+    return;
+  const Entry *found = nullptr;
+  for (const Entry &entry : VERBS) {
+    if (strcasecmp(verb, entry.name) == 0)
+      found = &entry;
+  }
+  if (!found) {
+    Serial.printf("#ERR unknown command %s (HELP lists them)\n", verb);
+    return;
+  }
+  command.verb = found->verb;
+
+  // Answered here, so they work while the loop is busy or stuck
+  if (command.verb == Verb::HELP) {
+    help();
+    return;
+  }
+  if (command.verb == Verb::LOOP) {
+    LoopMonitor::dump(Serial);
+    return;
+  }
+  // The exporter queues its own commands (safe from any task)
+  if (command.verb == Verb::EXPORT) {
+    for (char *p = _line; *p && *p != ' '; p++)
+      *p = toupper(*p); // Its verbs are upper case; paths are left alone
+    if (_exporter)
+      _exporter->onCommand(_line, strlen(_line));
+    Wake::signal(Wake::SERIAL_RX);
+    return;
+  }
+
+  for (char *arg; command.argc < MAX_ARGS &&
+                  (arg = strtok_r(nullptr, " ", &save)) != nullptr;)
+    command.args[command.argc++] = arg - command.text;
+
+  if (!_task)
+    run(command);
+  else if (xQueueSend(_queue, &command, 0) == pdTRUE)
+    Wake::signal(Wake::SERIAL_RX);
+  else
+    Serial.println("#ERR busy");
+}
+
+void SerialConsole::service() {
+  if (!_task) {
+    while (readLine())
+      parse(); // Runs each command as it parses it
+    return;
+  }
+  Command command;
+  if (xQueueReceive(_queue, &command, 0) == pdTRUE)
+    run(command);
+}
+
+void SerialConsole::help() {
+  Serial.print(
+      "#HELP PROF [RESET]   profiler, I2C, loop, energy, memory\n"
+      "#HELP MEM            heap and PSRAM by tag, buffer pools\n"
+      "#HELP LINK [RESET]   BLE link statistics per power bank\n"
+      "#HELP LOOP           loop stage times and stalls\n"
+      "#HELP LOG [N|E|W|I|D|V] log level, N for none\n"
+      "#HELP FLUSH          write history and deferred card writes\n"
+      "#HELP SHOT [PNG|PBM] screenshot to /debug\n"
+      "#HELP BENCH [SD|EPD|name] benchmarks\n"
+      "#HELP TEST [QUICK] [SAVE] self-test against the baseline\n"
+      "#HELP REC [ON|OFF]   raw frame recorder\n"
+      "#HELP REPLAY [speed|STOP] replay recorded frames\n"
+      "#HELP SIM LIVE|RUN|STOP [profile] [speed|days] simulator\n"
+      "#HELP LIST GET ACK STOP history export\n");
+}
+
+void SerialConsole::run(const Command &command) {
+  const char *arg = command.arg(0);
+  switch (command.verb) {
+  case Verb::PROF:
+    if (is(arg, "RESET")) {
+      Profiler::reset();
+      I2CBus::resetStats();
+      LoopMonitor::reset();
+      Serial.println("#PROF reset");
+      break;
+    }
+    Profiler::dump(Serial);
+    I2CBus::dump(Serial);
+    LoopMonitor::dump(Serial);
+    EnergyModel::dump(Serial);
+    BufferPool::dump(Serial);
+    MemTelemetry::dump(Serial);
+    break;
+
+  case Verb::MEM:
+    BufferPool::dump(Serial);
+    MemTelemetry::dump(Serial);
+    break;
+
+  case Verb::LINK:
+    dumpLinks(is(arg, "RESET"));
+    break;
+
+  case Verb::LOG:
+    if (arg) {
+      const char *level = strchr(LEVEL_LETTERS, toupper(arg[0]));
+      if (!level || !arg[0]) {
+        Serial.println("#ERR usage LOG [N|E|W|I|D|V]");
+        break;
+      }
+      Log::setLevel(level - LEVEL_LETTERS);
+    }
+    Serial.printf("#LOG %c (build %c)\n", LEVEL_LETTERS[Log::level()],
+                  LEVEL_LETTERS[LOG_LEVEL]);
+    break;
+
+  case Verb::FLUSH: {
+    uint32_t start = millis();
+    if (uiManager)
+      uiManager->flushStorage();
+    Serial.printf("#FLUSH %lu ms\n", (unsigned long)(millis() - start));
+    break;
+  }
+
+  case Verb::SHOT:
+    // Completion is reported as #SHOT <path> <bytes>
+    Screenshot::capture(M5.Display, is(arg, "PBM")
+                                        ? NoteExport::Format::PBM
+                                        : NoteExport::Format::PNG);
+    break;
+
+  case Verb::BENCH:
+    runBench(arg);
+    break;
+
+  case Verb::TEST: {
+    bool quick = false, save = false;
+    for (int i = 0; i < command.argc; i++) {
+      quick |= is(command.arg(i), "QUICK");
+      save |= is(command.arg(i), "SAVE");
+    }
+    SelfTest::Report *report = new SelfTest::Report(); // About 400 bytes
+    SelfTest::run(*report, !quick);
+    if (save && !report->baselineSaved)
+      report->baselineSaved = SelfTest::saveBaseline(*report);
+    SelfTest::print(Serial, *report);
+    delete report;
+    break;
+  }
+
+  case Verb::REC:
+    if (!recorder) {
+      Serial.println("#ERR no recorder");
+      break;
+    }
+    if (arg)
+      recorder->setEnabled(is(arg, "ON"));
+    Serial.printf("#REC %s %u recorded %u dropped\n",
+                  recorder->isEnabled() ? "ON" : "OFF",
+                  (unsigned)recorder->recorded(),
+                  (unsigned)recorder->dropped());
+    break;
+
+  case Verb::REPLAY: {
+    if (!recorder) {
+      Serial.println("#ERR no recorder");
+      break;
+    }
+    bool ok = true;
+    if (is(arg, "STOP"))
+      recorder->stopReplay();
+    else
+      ok = recorder->startReplay(arg ? atof(arg) : 1.0f);
+    Serial.printf("#REPLAY %s\n", !ok                      ? "busy"
+                                   : recorder->isReplaying() ? "started"
+                                                             : "stopped");
+    break;
+  }
+
+  case Verb::SIM:
+    runSim(command);
+    break;
+
+  default:
+    break;
+  }
+}
+
+void SerialConsole::runBench(const char *what) {
+  if (is(what, "EPD")) {
+    if (uiManager)
+      Serial.printf("#BENCH epd %s\n", uiManager->benchEpd());
+    return;
+  }
+  if (!is(what, "SD")) {
+    LogicBench::run(Serial, what);
+    return;
+  }
+
+  SDBench::Results r;
+  if (!sdManager || !SDBench::run(sdManager, r)) {
+    Serial.println("#ERR bench sd failed");
+    return;
+  }
+  char path[32] = "";
+  bool saved = SDBench::save(sdManager, r, path, sizeof(path));
+  Serial.printf("#BENCH sd seq MB/s write %.2f read %.2f\n", r.seqWriteMBps,
+                r.seqReadMBps);
+  Serial.printf("#BENCH sd 4k_read iops %.0f p50 %.1f p99 %.1f ms\n",
+                r.randRead.iops, r.randRead.p50Ms, r.randRead.p99Ms);
+  Serial.printf("#BENCH sd 4k_write iops %.0f p50 %.1f p99 %.1f ms\n",
+                r.randWrite.iops, r.randWrite.p50Ms, r.randWrite.p99Ms);
+  Serial.printf("#BENCH sd files create %.1f/s delete %.1f/s\n",
+                r.createPerSec, r.deletePerSec);
+  for (int i = 0; i < SDBench::LIST_POINTS; i++)
+    Serial.printf("#BENCH sd list %d files %.0f ms\n", r.listFiles[i],
+                  r.listMs[i]);
+  Serial.printf("#BENCH sd power_cycle %lu ms\n",
+                (unsigned long)r.powerCycleMs);
+  Serial.printf("#BENCH sd saved %s\n", saved ? path : "-");
+}
+
+void SerialConsole::runSim(const Command &command) {
+  // SIM LIVE [profile] [speed] | SIM RUN [profile] [days] | SIM STOP
+  if (!simulator) {
+    Serial.println("#ERR no simulator");
+    return;
+  }
+  const char *mode = command.arg(0);
+  const char *amount = command.arg(2);
+  TelemetrySimulator::Profile profile;
+  const PowerHistory *history = uiManager ? uiManager->history() : nullptr;
+  if (is(mode, "STOP")) {
+    simulator->stop();
+    Serial.println("#SIM stopped");
+  } else if (!mode ||
+             !TelemetrySimulator::parseProfile(command.arg(1), profile)) {
+    Serial.println("#SIM ERROR usage");
+  } else if (is(mode, "LIVE")) {
+    bool ok = simulator->startLive(profile, amount ? atof(amount) : 1440.0f,
+                                   history);
+    Serial.printf("#SIM %s\n", ok ? "started" : "busy");
+  } else if (is(mode, "RUN")) {
+    TelemetrySimulator::run(Serial, profile, amount ? atoi(amount) : 1,
+                            history);
+  } else {
+    Serial.println("#SIM ERROR usage");
+  }
+}
+
+void SerialConsole::dumpLinks(bool reset) {
+  int units = fleet ? fleet->count() : bleClient ? 1 : 0;
+  for (int i = 0; i < units; i++) {
+    FossibotBLE *unit = fleet ? fleet->unit(i) : bleClient;
+    if (!unit)
+      continue;
+    if (reset) {
+      unit->resetLinkStats();
+      continue;
+    }
+    LinkStats s = unit->getLinkStats(); // Copied: other tasks write it
+    Serial.printf("#LINK %d connect %u/%u last %u max %u mean %u ms\n", i,
+                  (unsigned)s.connects, (unsigned)s.attempts,
+                  (unsigned)s.lastAttemptMs, (unsigned)s.maxConnectMs,
+                  (unsigned)(s.connects ? s.totalConnectMs / s.connects : 0));
+    Serial.printf("#LINK %d rssi %d min %d max %d mean %d dBm\n", i, s.rssi,
+                  s.rssiMin, s.rssiMax,
+                  s.rssiSamples ? (int)(s.rssiSum / (int32_t)s.rssiSamples)
+                                : 0);
+    Serial.printf("#LINK %d frames %u crc %u short %u missed %u\n", i,
+                  (unsigned)s.frames, (unsigned)s.crcErrors,
+                  (unsigned)s.shortFrames, (unsigned)s.missedReads);
+    // Percentiles as bucket bounds; the last bucket has none
+    char p50[12], p99[12];
+    formatBound(p50, sizeof(p50), s.latencyPercentile(50));
+    formatBound(p99, sizeof(p99), s.latencyPercentile(99));
+    Serial.printf("#LINK %d latency mean %u p50 %s p99 %s ms\n", i,
+                  (unsigned)(s.frames ? s.latencySumMs / s.frames : 0), p50,
+                  p99);
+    Serial.printf("#LINK %d drops", i);
+    for (int k = 0; k < LinkStats::DROP_KINDS; k++)
+      Serial.printf(" %s %u", LinkStats::dropName(k), (unsigned)s.drops[k]);
+    Serial.printf(" last reason %d\n", s.lastReason);
+  }
+  Serial.printf("#LINK %s %d\n", reset ? "reset" : "units", units);
+}
@@ -0,0 +1,125 @@
+/**
+ * Serial Console
+ *
+ * Line commands on the USB CDC port, for looking into and steering the
+ * running firmware without reflashing it for a Serial.printf. A
+ * low-priority task reads and parses the lines; each parsed command goes
+ * through a queue to the main loop (service()), which owns the card, the
+ * display and the telemetry source, so the loop pays only for running
+ * it. HELP and LOOP are answered from the console task itself: a loop
+ * that has stopped coming round can still be asked where it is stuck.
+ *
+ *   HELP                  list the commands
+ *   PROF [RESET]          profiler, I2C, loop, energy, pools and memory
+ *   MEM                   heap and PSRAM by tag, buffer pools
+ *   LINK [RESET]          BLE link statistics of each power bank
+ *   LOOP                  loop stage times, stalls, the stage it is in
+ *   LOG [N|E|W|I|D|V]     report or set the log level (up to the build's)
+ *   FLUSH                 write the history and deferred card writes now
+ *   SHOT [PNG|PBM]        save the screen to /debug (see ui/screenshot.h)
+ *   BENCH [SD|EPD|name]   the SD suite, the EPD waveform matrix, or the
+ *                         logic micro-benchmarks (see logic_bench.h)
+ *   TEST [QUICK] [SAVE]   time the self-test workloads against the
+ *                         stored baseline, QUICK without the SD suite,
+ *                         SAVE to make this run the baseline (see
+ *                         self_test.h)
+ *   REC [ON|OFF]          switch the raw frame recorder, or report
+ *   REPLAY [speed|STOP]   play the recorded frames back
+ *   SIM LIVE|RUN|STOP [profile] [speed|days]  feed simulated frames to
+ *                         the dashboard, or time them through the
+ *                         pipeline (see telemetry_simulator.h)
+ *   LIST GET ACK STOP     history export, handed to the USB exporter
+ *                         (see history_export.h)
+ *
+ * Replies are lines starting "#<command>", errors "#ERR <reason>", so a
+ * host script can pick them out of the log. The task sleeps until the USB
+ * CDC port has received bytes (polling every POLL_MS where the port has
+ * no receive event) and wakes the loop only for a command. Without the
+ * task (no memory) the receive event wakes the loop and service() reads
+ * the port itself.
+ */
+
+#ifndef SERIAL_CONSOLE_H
+#define SERIAL_CONSOLE_H
+
+#include <Arduino.h>
+#include <esp_event.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+class HistoryExporter;
+
+class SerialConsole {
+public:
+  static const int MAX_LINE = 64; // As HistoryExporter::MAX_COMMAND
+  static const int MAX_ARGS = 3;
+  static const int QUEUE_DEPTH = 4;
+  static const uint32_t POLL_MS = 20; // Without a receive event
+  static const uint32_t TASK_STACK = 4096;
+
+  /**
+   * @param exporter Gets the history export lines (LIST, GET, ACK, STOP)
+   */
+  explicit SerialConsole(HistoryExporter *exporter);
+  ~SerialConsole();
+
+  /**
+   * Start the console task
+   */
+  bool begin();
+
+  /**
+   * Run the commands that have come in. Call from the main loop.
+   */
+  void service();
+
+private:
+  enum class Verb : uint8_t {
+    HELP,
+    PROF,
+    MEM,
+    LINK,
+    LOOP,
+    LOG,
+    FLUSH,
+    SHOT,
+    BENCH,
+    TEST,
+    REC,
+    REPLAY,
+    SIM,
+    EXPORT, // A history export line, passed on whole
+    COUNT
+  };
+
+  struct Command {
+    Verb verb;
+    uint8_t argc;
+    char text[MAX_LINE]; // The line, split in place
+    uint8_t args[MAX_ARGS]; // Offsets of the arguments in text
+    const char *arg(int i) const {
+      return i < argc ? text + args[i] : nullptr;
+    }
+  };
+
+  HistoryExporter *_exporter;
+  TaskHandle_t _task;
+  QueueHandle_t _queue;
+  char _line[MAX_LINE]; // Being assembled (console task, or service())
+  int _lineLength;
+
+  bool readLine();
+  void parse();
+  void run(const Command &command);
+  void runBench(const char *what);
+  void runSim(const Command &command);
+  void dumpLinks(bool reset);
+  static void help();
+  static void taskEntry(void *arg);
+  static void onReceive(void *, esp_event_base_t, int32_t, void *);
+};
+
+extern SerialConsole *console;
+
+#endif // SERIAL_CONSOLE_H
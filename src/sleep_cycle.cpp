@@ -0,0 +1,189 @@
+/**
+ * Deep Sleep Wake Cycle Implementation
+ */
+
+#include "sleep_cycle.h"
+#include "ble/ble_client.h"
+#include "hardware/energy_model.h"
+#include "hardware/gt911.h"
+#include "hardware/power_governor.h"
+#include "resume_state.h"
+#include "ui/ui_manager.h"
+#include "utils/log.h"
+#include "utils/wake.h"
+#include "wake_schedule.h"
+#include <M5Unified.h>
+#include <esp_sleep.h>
+
+namespace SleepCycle {
+
+static const uint32_t MAGIC = 0x534C4359; // "SLCY"
+static const uint32_t POLL_MS = 50;
+
+// Everything here lives in RTC slow memory and outlasts deep sleep
+struct CycleState {
+  uint32_t magic; // MAGIC while a cycle is armed
+  uint16_t intervalMin;
+  uint16_t wakes; // Timer wakes since the last full boot
+  bool escalate;  // Next timer wake is a full boot
+  time_t dueAt; // Next event needing a full boot, 0 = none
+  char mac[18];
+  uint16_t head; // Next ring slot to write
+  uint16_t count;
+  PowerSample ring[RING_SAMPLES];
+};
+
+RTC_DATA_ATTR static CycleState _state;
+
+static volatile bool _touched = false;
+
+static void IRAM_ATTR onTouch() { _touched = true; }
+
+static bool eventDue(time_t now) {
+  return _state.dueAt && now + EVENT_LEAD_SECS >= _state.dueAt;
+}
+
+static void push(const Fossibot::PowerBankData &d, time_t now) {
+  _state.ring[_state.head] = PowerHistory::sampleOf(now, d);
+  _state.head = (_state.head + 1) % RING_SAMPLES;
+  if (_state.count < RING_SAMPLES)
+    _state.count++;
+}
+
+static uint32_t armTimer() {
+  esp_sleep_enable_ext0_wakeup((gpio_num_t)GT911::INT_PIN, 0);
+
+  time_t now = time(nullptr);
+  uint32_t secs = _state.magic == MAGIC ? _state.intervalMin * 60 : 0;
+  if (_state.dueAt > now &&
+      (secs == 0 || (uint32_t)(_state.dueAt - now) < secs))
+    secs = _state.dueAt - now;
+  if (secs)
+    esp_sleep_enable_timer_wakeup((uint64_t)secs * 1000000ULL);
+  return secs;
+}
+
+bool isTimerWake() {
+  static int cached = -1;
+  if (cached < 0) {
+    cached = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER &&
+             _state.magic == MAGIC && !_state.escalate &&
+             !eventDue(time(nullptr));
+    _state.escalate = false;
+  }
+  return cached;
+}
+
+void runTimerWake() {
+  pinMode(GT911::INT_PIN, INPUT);
+  if (digitalRead(GT911::INT_PIN) == LOW) {
+    LOG_I("Sleep", "Touch pending, full boot");
+    return;
+  }
+  attachInterrupt(GT911::INT_PIN, onTouch, FALLING);
+
+  _state.wakes++;
+  LOG_I("Sleep", "Timer wake %u, sampling %s", _state.wakes, _state.mac);
+  uint32_t started = millis();
+
+  FossibotBLE *ble = new FossibotBLE();
+  ble->init();
+  ble->setTargetMAC(_state.mac);
+  ble->startScan();
+
+  uint32_t generation = ble->getDataGeneration();
+  bool fresh = false;
+  while (!_touched && millis() - started < WAKE_BUDGET_MS) {
+    ble->update();
+    // Only a status frame carries the numbers, not the settings one
+    if (ble->getDataGeneration() != generation &&
+        ble->getData().batteryCentivolts > 0) {
+      fresh = true;
+      break;
+    }
+    Wake::wait(POLL_MS);
+  }
+
+  if (fresh) {
+    push(ble->getData(), time(nullptr));
+    ResumeState::updateData(ble->getData());
+  } else {
+    LOG_W("Sleep", "No status frame in %u ms", (unsigned)WAKE_BUDGET_MS);
+  }
+
+  if (_touched) {
+    // NimBLE is up with a half-open session; a clean boot is simpler than
+    // handing it over. A 1 ms sleep rather than a restart keeps this a
+    // deep-sleep wake, so the resume state still applies.
+    LOG_I("Sleep", "Touched during wake, full boot");
+    _state.escalate = true;
+    Log::flush();
+    EnergyModel::enterDeepSleep();
+    esp_sleep_enable_timer_wakeup(1000);
+    esp_deep_sleep_start();
+  }
+
+  // Numbers only when a frame arrived; clock and link state either way
+  UIManager *ui = new UIManager();
+  Fossibot::PowerBankData none;
+  ui->showWakeReadout(fresh ? ble->getData() : none,
+                      _state.wakes % WAKES_PER_CLEAN == 0);
+
+  // A nearly empty battery stops the cycle (samples so far are kept);
+  // touch still wakes it
+  if (PowerGovernor::sample() == PowerGovernor::Level::CRITICAL) {
+    LOG_W("Sleep", "Battery critical, no more timer wakes");
+    _state.intervalMin = 0;
+  }
+
+  M5.Display.sleep();
+  uint32_t secs = armTimer();
+  LOG_I("Sleep", "Awake %lu ms, next wake in %u s", millis() - started,
+        (unsigned)secs);
+  Log::flush();
+  Serial.flush();
+  EnergyModel::enterDeepSleep();
+  esp_deep_sleep_start();
+}
+
+uint32_t arm(const char *mac, uint16_t intervalMin, uint32_t eventSecs) {
+  time_t now = time(nullptr);
+  _state.dueAt = eventSecs ? now + eventSecs : 0;
+  if (mac && *mac && intervalMin > 0) {
+    if (_state.magic != MAGIC) {
+      _state.head = 0;
+      _state.count = 0;
+    }
+    _state.magic = MAGIC;
+    _state.intervalMin = intervalMin;
+    _state.wakes = 0;
+    _state.escalate = false;
+    strlcpy(_state.mac, mac, sizeof(_state.mac));
+    WakeSchedule::set(WakeSchedule::Event::SAMPLE, now + intervalMin * 60);
+  } else {
+    _state.magic = 0;
+    WakeSchedule::set(WakeSchedule::Event::SAMPLE, 0);
+  }
+  return armTimer();
+}
+
+int drain(PowerHistory &history) {
+  if (_state.magic != MAGIC)
+    return 0;
+
+  // Oldest first, so the history sees them in the order they were taken
+  int start = (_state.head + RING_SAMPLES - _state.count) % RING_SAMPLES;
+  for (int i = 0; i < _state.count; i++) {
+    const PowerSample &s = _state.ring[(start + i) % RING_SAMPLES];
+    history.addSampleAt(s);
+  }
+  int added = _state.count;
+  LOG_I("Sleep", "%d sample(s) from %u timer wake(s) added to history", added,
+        _state.wakes);
+  _state.magic = 0;
+  _state.count = 0;
+  _state.head = 0;
+  return added;
+}
+
+} // namespace SleepCycle
@@ -0,0 +1,69 @@
+/**
+ * Deep Sleep Wake Cycle
+ *
+ * Keeps the dashboard and history going while the device is in deep
+ * sleep. An RTC timer wakes it every few minutes (display.sleep_wake_minutes
+ * in the config, 0 = touch only) into a short path at the top of setup():
+ * connect to the primary power bank with the cached GATT handles, wait for
+ * one status frame, repaint the dashboard numbers with a partial update
+ * and sleep again. The card, the config and the history are not loaded.
+ *
+ * Samples wait in RTC slow memory until the next full boot, which adds
+ * them to PowerHistory before taking its own. RTC memory survives deep
+ * sleep and resets but not a power loss; the ring holds a day of samples
+ * at the default interval and overwrites the oldest after that.
+ *
+ * A touch (before or during the wake) or an event coming due (alarm,
+ * countdown timer, pomodoro; see WakeSchedule) turns a timer wake into a
+ * normal boot. A critical battery (PowerGovernor) ends
+ * the timer wakes.
+ */
+
+#ifndef SLEEP_CYCLE_H
+#define SLEEP_CYCLE_H
+
+#include "power_history.h"
+#include <Arduino.h>
+
+namespace SleepCycle {
+
+static const int RING_SAMPLES = 288;
+static const uint32_t WAKE_BUDGET_MS = 12000; // Connect + one status frame
+static const uint16_t WAKES_PER_CLEAN = 12;   // Quality readout this often
+static const int EVENT_LEAD_SECS = 60;        // Boot fully this close to it
+
+/**
+ * True if this boot is a cycle timer wake that should take the short path
+ * (not a touch, not a due event, not a power-on)
+ */
+bool isTimerWake();
+
+/**
+ * Sample, repaint the dashboard and go back to deep sleep. Returns only
+ * when a touch was already pending, so setup() continues with a full boot;
+ * a touch during the wake sleeps for 1 ms and boots fully after that.
+ * Needs M5.begin(), Wire and the system time.
+ */
+void runTimerWake();
+
+/**
+ * Configure the deep sleep wake sources: touch, plus the timer for the
+ * next cycle wake or the next event, whichever is sooner
+ * @param mac Power bank to sample; empty disables the cycle
+ * @param intervalMin Minutes between wakes, 0 disables the cycle
+ * @param eventSecs Seconds until the next event that needs a full boot
+ *        (WakeSchedule::next() without the sample), 0 = none
+ * @return Seconds until the timer wake, 0 if only touch wakes
+ */
+uint32_t arm(const char *mac, uint16_t intervalMin, uint32_t eventSecs);
+
+/**
+ * Move the samples taken by cycle wakes into history (full boot, after
+ * the history is loaded) and end the cycle
+ * @return Samples added
+ */
+int drain(PowerHistory &history);
+
+} // namespace SleepCycle
+
+#endif // SLEEP_CYCLE_H
@@ -0,0 +1,165 @@
+/**
+ * Solar Analytics Implementation
+ */
+
+#include "solar_analytics.h"
+#include "power_history.h"
+#include "utils/sd_manager.h"
+
+#define SOLAR_FILE_MAGIC 0x52414C53 // "SLAR"
+#define SOLAR_FILE_VERSION 1
+
+SolarAnalytics::SolarAnalytics()
+    : _head(0), _count(0), _lastAt(0), _trend{0, 0}, _dirty(false) {
+  memset(_days, 0, sizeof(_days));
+}
+
+const SolarAnalytics::Day &SolarAnalytics::day(int age) const {
+  return _days[(_head - age + DAYS) % DAYS];
+}
+
+void SolarAnalytics::startDay(uint32_t date) {
+  if (_count)
+    _head = (_head + 1) % DAYS;
+  if (_count < DAYS)
+    _count++;
+  Day &d = _days[_head];
+  memset(&d, 0, sizeof(d));
+  d.date = date;
+  d.peakMin = NO_MINUTE;
+  d.firstMin = NO_MINUTE;
+  d.lastMin = NO_MINUTE;
+}
+
+void SolarAnalytics::add(const PowerSample &sample) {
+  if (!(sample.outlets & PowerSample::DETAIL))
+    return;
+
+  time_t t = sample.timestamp;
+  struct tm local;
+  localtime_r(&t, &local);
+  uint32_t date = (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 +
+                  local.tm_mday;
+  uint16_t minute = local.tm_hour * 60 + local.tm_min;
+
+  if (!_count || date > _days[_head].date) {
+    bool closed = _count > 0;
+    startDay(date);
+    if (closed)
+      fitTrend(); // Over the finished days only
+  } else if (date < _days[_head].date) {
+    return; // Clock went back
+  }
+
+  // Energy over the time since the previous sample (sleep-cycle samples
+  // are minutes apart), a lone one as a minute
+  uint32_t dt = sample.timestamp - _lastAt;
+  if (!_lastAt || sample.timestamp <= _lastAt || dt > MAX_GAP_SECS)
+    dt = 60;
+  _lastAt = sample.timestamp;
+
+  Day &d = _days[_head];
+  uint16_t w = sample.dcInputW;
+  d.wh += w * dt / 3600.0f;
+  if (w > d.peakW) {
+    d.peakW = w;
+    d.peakMin = minute;
+  }
+  if (w >= PRODUCING_W) {
+    if (d.firstMin == NO_MINUTE)
+      d.firstMin = minute;
+    d.lastMin = minute;
+    d.minutes += dt / 60;
+  }
+  _dirty = true;
+}
+
+void SolarAnalytics::fitTrend() {
+  // x in days before today (the gaps between days count), y the peak
+  float sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int n = 0;
+  time_t now = time(nullptr);
+  for (int age = 1; age < _count; age++) {
+    const Day &d = day(age);
+    if (d.minutes < TREND_MIN_MINUTES)
+      continue;
+    struct tm local = {};
+    local.tm_year = d.date / 10000 - 1900;
+    local.tm_mon = d.date / 100 % 100 - 1;
+    local.tm_mday = d.date % 100;
+    local.tm_hour = 12;
+    float x = -(float)((now - mktime(&local)) / 86400);
+    sx += x;
+    sy += d.peakW;
+    sxx += x * x;
+    sxy += x * d.peakW;
+    n++;
+  }
+  float denom = n * sxx - sx * sx;
+  if (n < 3 || denom <= 0) {
+    _trend = {0, 0};
+    return;
+  }
+  _trend = {n, (n * sxy - sx * sy) / denom * 30};
+}
+
+bool SolarAnalytics::efficiencyPct(float ratedW, float &pct) const {
+  uint16_t best = 0;
+  for (int age = 0; age < 7 && age < _count; age++)
+    if (day(age).peakW > best)
+      best = day(age).peakW;
+  if (ratedW <= 0 || !best)
+    return false;
+  pct = best * 100.0f / ratedW;
+  return true;
+}
+
+bool SolarAnalytics::saveToSD(const char *path) {
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("[Solar] Failed to open %s\n", path);
+    return false;
+  }
+
+  uint32_t header[2] = {SOLAR_FILE_MAGIC,
+                        SOLAR_FILE_VERSION | (sizeof(Day) << 8)};
+  bool ok = file.write((const uint8_t *)header, sizeof(header)) ==
+            sizeof(header);
+  // Oldest first
+  for (int age = _count - 1; ok && age >= 0; age--)
+    ok = file.write((const uint8_t *)&day(age), sizeof(Day)) == sizeof(Day);
+  file.close();
+
+  if (ok)
+    _dirty = false;
+  return ok;
+}
+
+bool SolarAnalytics::loadFromSD(const char *path) {
+  File file = sdFS().open(path, FILE_READ);
+  if (!file)
+    return false;
+
+  uint32_t header[2];
+  bool ok = file.read((uint8_t *)header, sizeof(header)) == sizeof(header) &&
+            header[0] == SOLAR_FILE_MAGIC &&
+            header[1] == (SOLAR_FILE_VERSION | (sizeof(Day) << 8));
+  if (ok) {
+    _head = 0;
+    _count = 0;
+    Day d;
+    while (file.read((uint8_t *)&d, sizeof(d)) == sizeof(d)) {
+      if (_count)
+        _head = (_head + 1) % DAYS;
+      _days[_head] = d;
+      if (_count < DAYS)
+        _count++;
+    }
+    fitTrend();
+  }
+  file.close();
+
+  Serial.printf("[Solar] %d days %s from %s\n", _count,
+                ok ? "loaded" : "not loaded", path);
+  return ok;
+}
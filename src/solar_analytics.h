@@ -0,0 +1,91 @@
+/**
+ * Solar Analytics
+ *
+ * Per-day solar harvest from the DC input of each history sample: the
+ * peak and when it came, the production window (first to last minute at
+ * PRODUCING_W or more) and the energy. Each sample updates the current
+ * day in O(1); when a sample opens a new day the finished one joins a
+ * ring of DAYS days and the trend is refitted over those records, so
+ * nothing ever walks the raw minutes.
+ *
+ * The trend is a least-squares line through the daily peaks of days that
+ * produced for at least TREND_MIN_MINUTES. With the panels' rated power
+ * in the settings (solar.panel_w) the best peak of the last week over
+ * that rating estimates how well the panels are doing, and the trend is
+ * read in percent of the rating per 30 days; a slow fall is dirt, shade
+ * or ageing.
+ *
+ * Only samples with the DC split (PowerSample::DETAIL) count. Saved next
+ * to the history as solar.bin, the current day included.
+ */
+
+#ifndef SOLAR_ANALYTICS_H
+#define SOLAR_ANALYTICS_H
+
+#include <Arduino.h>
+#include <time.h>
+
+struct PowerSample;
+
+class SolarAnalytics {
+public:
+  static const int DAYS = 30;
+  static const uint16_t PRODUCING_W = 10;      // DC input that counts
+  static const uint16_t TREND_MIN_MINUTES = 60; // Days the trend takes
+  static const uint32_t MAX_GAP_SECS = 900;    // Longer: counted as a minute
+  static const uint16_t NO_MINUTE = 0xFFFF;
+
+  // One local day (packed: also the on-disk record)
+  struct __attribute__((packed)) Day {
+    uint32_t date;     // YYYYMMDD, 0 = empty
+    uint16_t peakW;
+    uint16_t peakMin;  // Local minute of the day, NO_MINUTE = none
+    uint16_t firstMin; // Production window, NO_MINUTE = none
+    uint16_t lastMin;
+    uint16_t minutes;  // Minutes at PRODUCING_W or more
+    float wh;
+  };
+
+  struct Trend {
+    int days;        // Days fitted; 0 = not enough to tell
+    float wPerMonth; // Slope of the daily peak, per 30 days
+  };
+
+  SolarAnalytics();
+
+  /**
+   * Fold one sample in (called for every sample the history takes)
+   */
+  void add(const PowerSample &sample);
+
+  /**
+   * Days held, newest first: 0 is the current day
+   */
+  int dayCount() const { return _count; }
+  const Day &day(int age) const;
+
+  const Trend &trend() const { return _trend; }
+
+  /**
+   * Best peak of the last 7 days as a percentage of the rated panel power
+   * @return false without a rating or a peak
+   */
+  bool efficiencyPct(float ratedW, float &pct) const;
+
+  bool isDirty() const { return _dirty; }
+  bool saveToSD(const char *path);
+  bool loadFromSD(const char *path);
+
+private:
+  Day _days[DAYS]; // Ring, newest at _head
+  uint16_t _head;
+  uint16_t _count;
+  uint32_t _lastAt; // Previous sample, for its share of the energy
+  Trend _trend;
+  bool _dirty;
+
+  void startDay(uint32_t date);
+  void fitTrend();
+};
+
+#endif // SOLAR_ANALYTICS_H
@@ -0,0 +1,38 @@
+/**
+ * Telemetry Bus Implementation
+ */
+
+#include "telemetry_bus.h"
+
+uint8_t Bus::frameChanges(const Fossibot::PowerBankData &was,
+                          const Fossibot::PowerBankData &now) {
+  uint8_t changed = 0;
+  if (now.socPermille != was.socPermille ||
+      now.batteryCentivolts != was.batteryCentivolts)
+    changed |= BATTERY;
+  if (now.inputDeciwatts != was.inputDeciwatts ||
+      now.outputDeciwatts != was.outputDeciwatts ||
+      now.acInputDeciwatts != was.acInputDeciwatts ||
+      now.dcInputDeciwatts != was.dcInputDeciwatts)
+    changed |= POWER;
+  if (now.usbActive != was.usbActive || now.dcActive != was.dcActive ||
+      now.acActive != was.acActive)
+    changed |= OUTLETS;
+  if (now.minutesToFull != was.minutesToFull ||
+      now.minutesToEmpty != was.minutesToEmpty)
+    changed |= TIMES;
+  if (now.settingsReceived != was.settingsReceived ||
+      now.buzzerEnabled != was.buzzerEnabled ||
+      now.silentCharging != was.silentCharging ||
+      now.lightMode != was.lightMode ||
+      now.dischargeLimit != was.dischargeLimit ||
+      now.chargeLimit != was.chargeLimit ||
+      now.screenTimeout != was.screenTimeout ||
+      now.sysStandby != was.sysStandby || now.acStandby != was.acStandby ||
+      now.dcStandby != was.dcStandby || now.usbStandby != was.usbStandby ||
+      now.scheduleCharge != was.scheduleCharge)
+    changed |= SETTINGS;
+  if (now.connected != was.connected)
+    changed |= LINK;
+  return changed;
+}
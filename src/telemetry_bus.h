@@ -0,0 +1,130 @@
+/**
+ * Telemetry Bus
+ *
+ * Typed publish/subscribe between what produces telemetry (the BLE client
+ * and the fleet, the telemetry filter) and what consumes it (the
+ * dashboard, the history, the rule engine, the charge planner, MQTT and
+ * the LAN API), so the main loop publishes each frame once instead of
+ * handing it to every consumer by name.
+ *
+ * Each topic keeps two snapshots. A producer builds the next one in place
+ * (draft()) and publish() makes it current; subscribers get a const
+ * reference to it, so nothing is copied per subscriber. A topic with a
+ * differ works out what changed from the snapshot before (Change bits),
+ * and a subscriber is only called when a bit it asked for is set; FRAME
+ * is set on every publish.
+ *
+ * Topics:
+ *   dashboard  what the screen, MQTT and the API show: the fleet total or
+ *              the primary unit, filtered
+ *   primary    the primary unit's own frame, raw, while it is connected
+ *   minute     each wall-clock minute the filter closes
+ *   link       the primary unit's link statistics, every LINK_PUBLISH_MS
+ *
+ * Main loop task only; publish() calls the subscribers before it returns.
+ */
+
+#ifndef TELEMETRY_BUS_H
+#define TELEMETRY_BUS_H
+
+#include "ble/fossibot_protocol.h"
+#include "ble/link_stats.h"
+#include "telemetry_filter.h"
+#include <Arduino.h>
+#include <functional>
+
+namespace Bus {
+
+// What a publish changed from the snapshot before
+enum Change : uint8_t {
+  FRAME = 1 << 0,    // Every publish
+  BATTERY = 1 << 1,  // SOC, voltage
+  POWER = 1 << 2,    // Input, output and its parts
+  OUTLETS = 1 << 3,  // USB, DC, AC
+  TIMES = 1 << 4,    // To full, to empty
+  SETTINGS = 1 << 5, // The unit's settings frame
+  LINK = 1 << 6,     // Connected
+  ALL = 0xFF
+};
+
+template <typename T> class Topic {
+public:
+  using Handler = std::function<void(const T &value, uint8_t changed)>;
+  using Differ = uint8_t (*)(const T &was, const T &now);
+  static const int MAX_SUBSCRIBERS = 4;
+
+  explicit Topic(Differ differ = nullptr)
+      : _differ(differ), _current(0), _sequence(0), _count(0) {}
+
+  /**
+   * Call handler on each publish that changes something in mask
+   * @return false if the topic has no room left
+   */
+  bool subscribe(uint8_t mask, Handler handler) {
+    if (_count >= MAX_SUBSCRIBERS)
+      return false;
+    _subscribers[_count++] = {mask, handler};
+    return true;
+  }
+
+  /**
+   * The next snapshot, to fill in place. It holds an old one: write all
+   * of it.
+   */
+  T &draft() { return _slots[_current ^ 1]; }
+
+  // Make the draft current and tell the subscribers
+  void publish() {
+    _current ^= 1;
+    uint8_t changed = FRAME;
+    if (_sequence == 0)
+      changed = ALL;
+    else if (_differ)
+      changed |= _differ(_slots[_current ^ 1], _slots[_current]);
+    _sequence++;
+    for (int i = 0; i < _count; i++) {
+      if (_subscribers[i].mask & changed)
+        _subscribers[i].handler(_slots[_current], changed);
+    }
+  }
+
+  void publish(const T &value) {
+    draft() = value;
+    publish();
+  }
+
+  const T &latest() const { return _slots[_current]; }
+  uint32_t sequence() const { return _sequence; } // Publishes so far
+
+private:
+  struct Subscriber {
+    uint8_t mask;
+    Handler handler;
+  };
+
+  Differ _differ;
+  T _slots[2];
+  uint8_t _current;
+  uint32_t _sequence;
+  Subscriber _subscribers[MAX_SUBSCRIBERS];
+  int _count;
+};
+
+// Change bits between two frames
+uint8_t frameChanges(const Fossibot::PowerBankData &was,
+                     const Fossibot::PowerBankData &now);
+
+} // namespace Bus
+
+struct TelemetryBus {
+  Bus::Topic<Fossibot::PowerBankData> dashboard{Bus::frameChanges};
+  Bus::Topic<Fossibot::PowerBankData> primary{Bus::frameChanges};
+  Bus::Topic<TelemetryFilter::Minute> minute;
+  Bus::Topic<LinkStats> link;
+
+  static const uint32_t LINK_PUBLISH_MS = 60000;
+};
+
+extern TelemetryBus *telemetryBus;
+
+#endif // TELEMETRY_BUS_H
@@ -0,0 +1,187 @@
+/**
+ * Telemetry Filter Implementation
+ */
+
+#include "telemetry_filter.h"
+
+TelemetryFilter::TelemetryFilter() : _rejected(0) {
+  configure(Mode::EWMA, 0.3f, 5, 500);
+  reset();
+}
+
+void TelemetryFilter::configure(Mode mode, float alpha, int medianN,
+                                float spikeW) {
+  _mode = mode;
+  if (!(alpha > 0 && alpha <= 1))
+    alpha = 0.3f;
+  _alphaQ8 = max((int32_t)1, Fixed::fromFloat(alpha, 256));
+  _medianN = constrain(medianN, 1, MAX_MEDIAN) | 1; // Odd: a middle reading
+  _spike = spikeW > 0 ? Fixed::fromFloat(spikeW, Fixed::DW_PER_W) : 0;
+}
+
+TelemetryFilter::Mode TelemetryFilter::parseMode(const char *name) {
+  if (name && strcasecmp(name, "median") == 0)
+    return Mode::MEDIAN;
+  if (name && strcasecmp(name, "off") == 0)
+    return Mode::OFF;
+  return Mode::EWMA;
+}
+
+const char *TelemetryFilter::modeName(Mode mode) {
+  switch (mode) {
+  case Mode::OFF:
+    return "off";
+  case Mode::MEDIAN:
+    return "median";
+  case Mode::EWMA:
+  default:
+    return "ewma";
+  }
+}
+
+void TelemetryFilter::reset() {
+  memset(_channels, 0, sizeof(_channels));
+  memset(&_current, 0, sizeof(_current));
+  memset(&_last, 0, sizeof(_last));
+}
+
+bool TelemetryFilter::lastMinute(Minute &out) const {
+  if (!_last.start)
+    return false;
+  out = _last;
+  return true;
+}
+
+Fixed::Deciwatts &TelemetryFilter::field(Fossibot::PowerBankData &data,
+                                         Field f) {
+  switch (f) {
+  case IN_W:
+    return data.inputDeciwatts;
+  case OUT_W:
+    return data.outputDeciwatts;
+  case AC_IN_W:
+    return data.acInputDeciwatts;
+  case DC_IN_W:
+  default:
+    return data.dcInputDeciwatts;
+  }
+}
+
+void TelemetryFilter::restart(Channel &c, Fixed::Deciwatts reading) {
+  c.level = reading;
+  c.primed = true;
+  c.held = false;
+  c.window[0] = reading;
+  c.filled = 1;
+  c.next = 1 % _medianN;
+}
+
+Fixed::Deciwatts TelemetryFilter::median(const Channel &c) const {
+  Fixed::Deciwatts sorted[MAX_MEDIAN];
+  int n = c.filled;
+  memcpy(sorted, c.window, n * sizeof(sorted[0]));
+  // Insertion sort: nine at most
+  for (int i = 1; i < n; i++) {
+    Fixed::Deciwatts v = sorted[i];
+    int j = i - 1;
+    while (j >= 0 && sorted[j] > v) {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+  return (n & 1) ? sorted[n / 2]
+                 : Fixed::divRound(sorted[n / 2 - 1] + sorted[n / 2], 2);
+}
+
+bool TelemetryFilter::condition(Channel &c, Fixed::Deciwatts reading,
+                                Fixed::Deciwatts &out, bool &spike) {
+  if (!c.primed) {
+    restart(c, reading);
+    out = reading;
+    return true;
+  }
+
+  // A jump past the spike band waits a frame for a second opinion
+  if (_spike > 0 && abs(reading - c.level) > _spike) {
+    if (!c.held) {
+      c.held = true;
+      out = c.level;
+      return false;
+    }
+    restart(c, reading); // Confirmed: a step, not a spike
+    out = reading;
+    return true;
+  }
+  if (c.held)
+    spike = true; // Back where it was: the held reading was a glitch
+  c.held = false;
+
+  switch (_mode) {
+  case Mode::EWMA:
+    c.level += Fixed::divRound(_alphaQ8 * (reading - c.level), 256);
+    break;
+  case Mode::MEDIAN:
+    c.window[c.next] = reading;
+    c.next = (c.next + 1) % _medianN;
+    if (c.filled < _medianN)
+      c.filled++;
+    c.level = median(c);
+    break;
+  case Mode::OFF:
+  default:
+    c.level = reading;
+    break;
+  }
+  out = c.level;
+  return true;
+}
+
+bool TelemetryFilter::count(const Fossibot::PowerBankData &reading,
+                            uint32_t now, int spikes) {
+  uint32_t minute = now - now % 60;
+  bool closed = false;
+  if (minute != _current.start) {
+    if (_current.start && _current.frames) {
+      _last = _current;
+      closed = true;
+    }
+    memset(&_current, 0, sizeof(_current));
+    _current.start = minute;
+    _current.minIn = reading.inputDeciwatts;
+    _current.maxIn = reading.inputDeciwatts;
+    _current.minOut = reading.outputDeciwatts;
+    _current.maxOut = reading.outputDeciwatts;
+  }
+  _current.frames++;
+  _current.rejected += spikes;
+  _current.socPermille = reading.socPermille;
+  _current.centivolts = reading.batteryCentivolts;
+  _current.usbActive = reading.usbActive;
+  _current.dcActive = reading.dcActive;
+  _current.acActive = reading.acActive;
+  _current.minIn = min(_current.minIn, reading.inputDeciwatts);
+  _current.maxIn = max(_current.maxIn, reading.inputDeciwatts);
+  _current.sumIn += reading.inputDeciwatts;
+  _current.minOut = min(_current.minOut, reading.outputDeciwatts);
+  _current.maxOut = max(_current.maxOut, reading.outputDeciwatts);
+  _current.sumOut += reading.outputDeciwatts;
+  _current.sumDcIn += reading.dcInputDeciwatts;
+  return closed;
+}
+
+bool TelemetryFilter::apply(Fossibot::PowerBankData &data, uint32_t now) {
+  // The minute takes the raw readings, a held spike replaced by the level
+  // it jumped from
+  Fossibot::PowerBankData accepted = data;
+  bool spike = false;
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    Field f = (Field)i;
+    Fixed::Deciwatts &v = field(data, f);
+    if (!condition(_channels[f], v, v, spike))
+      field(accepted, f) = v;
+  }
+  if (spike)
+    _rejected++;
+  return count(accepted, now, spike ? 1 : 0);
+}
@@ -0,0 +1,132 @@
+/**
+ * Telemetry Filter
+ *
+ * Conditions the power readings between the BLE client and everything
+ * that shows or stores them (dashboard, MQTT, LAN API, history). The unit
+ * reports its input and output watts straight off the meter, so they
+ * jitter from one frame to the next; each power field here goes through:
+ *
+ * - Spike rejection: a reading more than spike_w away from the filtered
+ *   level is held back for one frame. If the next frame agrees, it was a
+ *   real step (a kettle, the charger) and the filter restarts at the new
+ *   level instead of smearing it; if not, it is dropped as a glitch.
+ * - Smoothing: an EWMA (level += alpha * (reading - level)) or the median
+ *   of the last median_n readings, or none.
+ *
+ * Every reading, before smoothing (a dropped spike as the level it jumped
+ * from), is also folded into a summary of its wall-clock minute (min, max
+ * and mean of input and output, mean DC input, the last SOC, voltage and
+ * outlet states). When a frame of the next
+ * minute arrives the summary is closed, and the history takes that instead
+ * of whichever frame happened to be current at its minute tick.
+ *
+ * Settings (the "telemetry" section): filter "ewma", "median" or "off",
+ * alpha, median_n, spike_w. Main loop task only.
+ */
+
+#ifndef TELEMETRY_FILTER_H
+#define TELEMETRY_FILTER_H
+
+#include "ble/fossibot_protocol.h"
+#include <Arduino.h>
+
+class TelemetryFilter {
+public:
+  enum class Mode : uint8_t { OFF, EWMA, MEDIAN };
+  static const int MAX_MEDIAN = 9;
+
+  // One closed minute of readings, in the frame's fixed-point units
+  struct Minute {
+    uint32_t start;    // UTC of the minute, 0 = none yet
+    uint16_t frames;   // Readings folded in
+    uint16_t rejected; // Spikes dropped
+    Fixed::Deciwatts minIn;
+    Fixed::Deciwatts maxIn;
+    int32_t sumIn;
+    Fixed::Deciwatts minOut;
+    Fixed::Deciwatts maxOut;
+    int32_t sumOut;
+    int32_t sumDcIn;
+    Fixed::Permille socPermille; // Last reading
+    Fixed::Centivolts centivolts;
+    bool usbActive;
+    bool dcActive;
+    bool acActive;
+
+    Fixed::Deciwatts meanIn() const { return mean(sumIn); }
+    Fixed::Deciwatts meanOut() const { return mean(sumOut); }
+    Fixed::Deciwatts meanDcIn() const { return mean(sumDcIn); }
+
+  private:
+    int32_t mean(int32_t sum) const {
+      return frames ? Fixed::divRound(sum, frames) : 0;
+    }
+  };
+
+  TelemetryFilter();
+
+  /**
+   * @param alpha EWMA weight of a new reading (0..1]
+   * @param medianN Readings the median is taken over (odd, up to MAX_MEDIAN)
+   * @param spikeW Jump from the level held back as a possible spike (0: off)
+   */
+  void configure(Mode mode, float alpha, int medianN, float spikeW);
+  static Mode parseMode(const char *name);
+  static const char *modeName(Mode mode);
+
+  /**
+   * Condition a frame's power fields in place and count it into its
+   * minute
+   * @param now UTC seconds the frame arrived
+   * @return true if it closed a minute (lastMinute() has a new one)
+   */
+  bool apply(Fossibot::PowerBankData &data, uint32_t now);
+
+  /**
+   * Start over (the source changed: a new unit, a replay)
+   */
+  void reset();
+
+  /**
+   * The newest closed minute
+   * @return false before the first one has closed
+   */
+  bool lastMinute(Minute &out) const;
+
+  uint32_t rejected() const { return _rejected; } // Spikes since boot
+
+private:
+  enum Field : uint8_t { IN_W, OUT_W, AC_IN_W, DC_IN_W, FIELD_COUNT };
+
+  struct Channel {
+    Fixed::Deciwatts level; // Filter output
+    bool primed;            // level holds a reading
+    bool held; // The last reading was held back as a possible spike
+    Fixed::Deciwatts window[MAX_MEDIAN];
+    uint8_t filled;
+    uint8_t next;
+  };
+
+  Mode _mode;
+  int32_t _alphaQ8; // alpha x 256: the EWMA step is integer arithmetic
+  int _medianN;
+  Fixed::Deciwatts _spike;
+  Channel _channels[FIELD_COUNT];
+  Minute _current;
+  Minute _last;
+  uint32_t _rejected;
+
+  static Fixed::Deciwatts &field(Fossibot::PowerBankData &data, Field f);
+  // @return false if the reading is held back (the level stands); spike
+  // is set when the one held before turns out to have been a glitch
+  bool condition(Channel &c, Fixed::Deciwatts reading, Fixed::Deciwatts &out,
+                 bool &spike);
+  void restart(Channel &c, Fixed::Deciwatts reading);
+  Fixed::Deciwatts median(const Channel &c) const;
+  bool count(const Fossibot::PowerBankData &reading, uint32_t now,
+             int spikes);
+};
+
+extern TelemetryFilter *telemetryFilter;
+
+#endif // TELEMETRY_FILTER_H
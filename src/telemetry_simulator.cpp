@@ -0,0 +1,456 @@
+/**
+ * Telemetry Simulator Implementation
+ */
+
+#include "telemetry_simulator.h"
+#include "ble/ble_client.h"
+#include "ble/register_map.h"
+#include "power_history.h"
+#include "telemetry_filter.h"
+#include "ui/refresh_policy.h"
+#include "ui/refresh_scheduler.h"
+#include "utils/config.h"
+#include "utils/crc16.h"
+#include "utils/flash_store.h"
+#include "utils/log.h"
+#include "utils/sd_manager.h"
+
+extern Config *config;
+extern FossibotBLE *bleClient;
+extern SDManager *sdManager;
+
+const char *const TelemetrySimulator::SCRATCH_DIR = "/sim";
+
+static const time_t VALID_TIME = 1700000000; // Clock set (2023+)
+
+// Status frame: the 6-byte header, 80 registers, CRC
+static const size_t FRAME_REGS = 80;
+static const size_t FRAME_LEN = Fossibot::REG_DATA_OFFSET + FRAME_REGS * 2;
+
+static const float CHARGER_W = 600;    // Mains charger
+static const float SOLAR_PEAK_W = 420; // Panel at noon, clear sky
+static const float KETTLE_W = 1800;
+static const float INVERTER_LOSS = 1.08f; // Battery W per output W
+
+TelemetrySimulator::TelemetrySimulator()
+    : _profile(Profile::HOME), _time(0), _soc(50), _charging(false),
+      _cloud(1), _rng(1), _kettle(0), _inW(0), _outW(0), _acInW(0),
+      _dcInW(0), _haveHour(0), _live(false), _speed(1), _lastFrameMs(0),
+      _carry(0) {}
+
+bool TelemetrySimulator::parseProfile(const char *name, Profile &out) {
+  if (!name || strcasecmp(name, "home") == 0)
+    out = Profile::HOME;
+  else if (strcasecmp(name, "solar") == 0)
+    out = Profile::SOLAR;
+  else if (strcasecmp(name, "history") == 0)
+    out = Profile::HISTORY;
+  else
+    return false;
+  return true;
+}
+
+const char *TelemetrySimulator::profileName(Profile profile) {
+  switch (profile) {
+  case Profile::SOLAR:
+    return "solar";
+  case Profile::HISTORY:
+    return "history";
+  case Profile::HOME:
+  default:
+    return "home";
+  }
+}
+
+// ============================================================================
+// Load model
+// ============================================================================
+
+void TelemetrySimulator::reset(Profile profile, time_t start,
+                               const PowerHistory *history) {
+  _profile = profile;
+  _time = start;
+  _soc = 60;
+  _charging = false;
+  _cloud = 1;
+  _rng = 0x9E3779B9u ^ (uint32_t)start;
+  if (!_rng)
+    _rng = 1;
+  _kettle = 0;
+  _haveHour = 0;
+  if (profile == Profile::HISTORY)
+    learnHours(history);
+  step(0);
+}
+
+void TelemetrySimulator::learnHours(const PowerHistory *history) {
+  float sumIn[24] = {0};
+  float sumOut[24] = {0};
+  uint16_t count[24] = {0};
+  if (history) {
+    // The newest week of hourly means, folded by hour of day
+    const RollupTier &tier = history->getRollup().tier(HistoryRollup::HOUR);
+    for (uint16_t age = 0; age < tier.size() && age < 24 * 7; age++) {
+      const RollupBucket *b = tier.get(age);
+      if (!b || !b->count)
+        continue;
+      time_t t = b->start;
+      struct tm tm;
+      localtime_r(&t, &tm);
+      sumIn[tm.tm_hour] += b->meanInW();
+      sumOut[tm.tm_hour] += b->meanOutW();
+      count[tm.tm_hour]++;
+    }
+  }
+  for (int h = 0; h < 24; h++) {
+    if (!count[h])
+      continue;
+    _hourIn[h] = sumIn[h] / count[h];
+    _hourOut[h] = sumOut[h] / count[h];
+    _haveHour |= 1UL << h;
+  }
+  if (!_haveHour)
+    LOG_W("Sim", "No hourly history yet, using the home profile");
+}
+
+float TelemetrySimulator::random01() {
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return (_rng >> 8) * (1.0f / 16777216.0f);
+}
+
+// Bell-shaped bump centred on hour c, about w hours either side
+static float peak(float hour, float c, float w) {
+  float x = (hour - c) / w;
+  return expf(-x * x);
+}
+
+void TelemetrySimulator::loads(float hour, uint32_t seconds) {
+  float noise = 0.97f + 0.06f * random01();
+  int h = (int)hour % 24;
+
+  if (_profile == Profile::HISTORY && (_haveHour & (1UL << h))) {
+    _outW = _hourOut[h] * noise;
+    _dcInW = _hourIn[h] * (0.97f + 0.06f * random01());
+  } else {
+    _outW = (35 + 180 * peak(hour, 7.5f, 1) + 420 * peak(hour, 19.5f, 2)) *
+            noise;
+    _dcInW = 0;
+    // The odd kettle while people are up: a short spike worth filtering
+    if (_kettle) {
+      _kettle = seconds < _kettle ? _kettle - seconds : 0;
+      _outW += KETTLE_W;
+    } else if (hour >= 6 && hour < 22 &&
+               random01() < seconds / 3600.0f * 0.4f) {
+      _kettle = 180;
+    }
+  }
+
+  if (_profile == Profile::SOLAR) {
+    _cloud += (random01() - 0.5f) * 0.1f * (seconds / 60.0f);
+    _cloud = constrain(_cloud, 0.3f, 1.0f);
+    if (hour > 6 && hour < 19)
+      _dcInW = SOLAR_PEAK_W * sinf(PI * (hour - 6) / 13) * _cloud;
+  }
+
+  // Mains top-up with hysteresis, as a timer-plug charger would
+  if (_soc < 20)
+    _charging = true;
+  else if (_soc >= 90)
+    _charging = false;
+  _acInW = _charging ? CHARGER_W : 0;
+
+  // A full battery takes no more than the outputs draw, an empty one
+  // drops them
+  if (_soc >= 100) {
+    _acInW = 0;
+    _dcInW = min(_dcInW, _outW * INVERTER_LOSS);
+  }
+  _inW = _acInW + _dcInW;
+  if (_soc <= 0 && _inW < _outW)
+    _outW = 0;
+}
+
+void TelemetrySimulator::step(uint32_t seconds) {
+  do {
+    uint32_t dt = seconds < 60 ? seconds : 60;
+    seconds -= dt;
+    _time += dt;
+    struct tm tm;
+    localtime_r(&_time, &tm);
+    loads(tm.tm_hour + tm.tm_min / 60.0f, dt);
+    float netW = _inW - _outW * INVERTER_LOSS;
+    _soc += netW * dt / 3600.0f / CAPACITY_WH * 100;
+    _soc = constrain(_soc, 0.0f, 100.0f);
+  } while (seconds);
+}
+
+void TelemetrySimulator::reading(Fossibot::PowerBankData &out) const {
+  out.socPermille = Fixed::fromFloat(_soc, Fixed::PERMILLE_PER_PCT);
+  out.batteryCentivolts =
+      Fixed::fromFloat(46 + _soc * 0.08f - _outW * 0.0005f, Fixed::CV_PER_V);
+  out.inputDeciwatts = Fixed::fromFloat(_inW, Fixed::DW_PER_W);
+  out.acInputDeciwatts = Fixed::fromFloat(_acInW, Fixed::DW_PER_W);
+  out.dcInputDeciwatts = Fixed::fromFloat(_dcInW, Fixed::DW_PER_W);
+  out.outputDeciwatts = Fixed::fromFloat(_outW, Fixed::DW_PER_W);
+  // Switched by the household, not by the load
+  struct tm tm;
+  localtime_r(&_time, &tm);
+  out.usbActive = true;
+  out.dcActive = tm.tm_hour >= 17 && tm.tm_hour < 23;
+  out.acActive = tm.tm_hour >= 6 && tm.tm_hour < 23 && _outW > 0;
+
+  // Minutes at the present rate, 0 when not going that way (as the unit)
+  float netW = _inW - _outW * INVERTER_LOSS;
+  float storedWh = _soc / 100 * CAPACITY_WH;
+  out.minutesToEmpty = netW < -1 ? (int)(storedWh / -netW * 60) : 0;
+  out.minutesToFull =
+      netW > 1 ? (int)((CAPACITY_WH - storedWh) / netW * 60) : 0;
+}
+
+size_t TelemetrySimulator::buildFrame(const Fossibot::PowerBankData &data,
+                                      uint8_t *frame, size_t cap) {
+  if (cap < FRAME_LEN + 2)
+    return 0;
+  memset(frame, 0, FRAME_LEN);
+  frame[0] = Fossibot::OPCODE_STATUS >> 8;
+  frame[1] = Fossibot::OPCODE_STATUS & 0xFF;
+  Fossibot::encode(Fossibot::STATUS_MAP, data, frame, FRAME_LEN);
+  return CRC16::seal(frame, FRAME_LEN);
+}
+
+// ============================================================================
+// Live
+// ============================================================================
+
+bool TelemetrySimulator::startLive(Profile profile, float speed,
+                                   const PowerHistory *history) {
+  if (bleClient && bleClient->isConnected())
+    return false;
+  time_t now = time(nullptr);
+  reset(profile, now >= VALID_TIME ? now : VALID_TIME, history);
+  _speed = speed > 0 ? speed : 1;
+  _carry = 0;
+  _lastFrameMs = millis() - LIVE_FRAME_MS; // First frame straight away
+  _live = true;
+  LOG_I("Sim", "Live %s profile at %.0fx", profileName(profile), _speed);
+  return true;
+}
+
+void TelemetrySimulator::stop() {
+  if (_live)
+    LOG_I("Sim", "Live simulation stopped");
+  _live = false;
+}
+
+uint32_t TelemetrySimulator::msUntilDue() const {
+  if (!_live)
+    return UINT32_MAX;
+  uint32_t since = millis() - _lastFrameMs;
+  return since < LIVE_FRAME_MS ? LIVE_FRAME_MS - since : 0;
+}
+
+void TelemetrySimulator::service() {
+  if (!_live)
+    return;
+  uint32_t now = millis();
+  uint32_t elapsed = now - _lastFrameMs;
+  if (elapsed < LIVE_FRAME_MS)
+    return;
+  _lastFrameMs = now;
+
+  _carry += elapsed * _speed / 1000.0f;
+  uint32_t seconds = (uint32_t)_carry;
+  _carry -= seconds;
+  step(seconds);
+
+  Fossibot::PowerBankData data;
+  reading(data);
+  uint8_t frame[FRAME_LEN + 2];
+  size_t length = buildFrame(data, frame, sizeof(frame));
+  if (!FossibotBLE::replayFrame(0, 0, frame, length)) {
+    LOG_I("Sim", "A unit is connected, live simulation stopped");
+    _live = false;
+  }
+}
+
+// ============================================================================
+// Stress run
+// ============================================================================
+
+// Empty the scratch history so a run starts from nothing (under SDAccess)
+static void clearScratch() {
+  typedef FixedString<48> Path;
+  const char *dir = TelemetrySimulator::SCRATCH_DIR;
+  fs::FS &fs = sdFS();
+  if (!fs.exists(dir))
+    fs.mkdir(dir);
+  Path names[24];
+  int found;
+  do {
+    found = 0;
+    fs::File d = fs.open(dir);
+    for (fs::File f = d.openNextFile(); f && found < 24;
+         f = d.openNextFile()) {
+      if (!f.isDirectory())
+        names[found++] = Path::format("%s/%s", dir, f.name());
+      f.close();
+    }
+    d.close();
+    for (int i = 0; i < found; i++)
+      fs.remove(names[i].c_str());
+  } while (found == 24);
+
+  // The journal lives in the flash tier when it is mounted
+  if (flashStore && flashStore->isAvailable()) {
+    Path journal = Path::format("%s/journal.bin", dir);
+    flashStore->fs().remove(journal.c_str());
+  }
+}
+
+void TelemetrySimulator::run(Print &out, Profile profile, int days,
+                             const PowerHistory *history) {
+  days = constrain(days, 1, MAX_DAYS);
+  SDAccess access(sdManager);
+  if (!access) {
+    out.println("#SIM ERROR no card");
+    return;
+  }
+  clearScratch();
+  PowerHistory *scratch = new PowerHistory();
+  scratch->setDirectory(SCRATCH_DIR);
+  scratch->setRtcTail(false); // Simulated days would flood the real one
+  scratch->init();
+
+  // On a minute, so every sixth frame is a history sample
+  time_t start = time(nullptr);
+  if (start < VALID_TIME)
+    start = VALID_TIME;
+  start -= start % 60;
+  TelemetrySimulator sim;
+  sim.reset(profile, start, history);
+
+  Fossibot::PowerBankData data;
+  Fossibot::PowerBankData parsed;
+  Fossibot::PowerBankData shown;
+  uint8_t frame[FRAME_LEN + 2];
+  uint32_t frames = days * 86400UL / FRAME_S;
+  uint64_t frameUs = 0, filterUs = 0, dashUs = 0, sampleUs = 0, flushUs = 0,
+           queryUs = 0;
+  uint32_t worstSampleUs = 0, worstFlushUs = 0;
+  uint32_t samples = 0, flushes = 0, queries = 0;
+  uint32_t refreshes = 0, urgent = 0, cleans = 0, badFrames = 0;
+  int debt = 0;
+  TelemetryFilter filter;
+  RefreshPolicy policy;
+  if (config) {
+    filter.configure(
+        TelemetryFilter::parseMode(config->getTelemetryFilter().c_str()),
+        config->getFilterAlpha(), config->getFilterMedianN(),
+        config->getFilterSpikeW());
+    policy.configure(config->getSOCChangeThreshold(),
+                     config->getPowerChangeThreshold(),
+                     config->getPowerRefreshSecs() * 1000UL);
+  }
+  uint32_t startMs = millis();
+
+  for (uint32_t i = 0; i < frames; i++) {
+    sim.step(FRAME_S);
+    sim.reading(data);
+
+    uint32_t t0 = micros();
+    size_t length = buildFrame(data, frame, sizeof(frame));
+    if (CRC16::verify(frame, length))
+      Fossibot::decode(Fossibot::STATUS_MAP, frame, length, parsed);
+    else
+      badFrames++;
+    uint32_t t1 = micros();
+    filter.apply(parsed, sim._time);
+    uint32_t t2 = micros();
+    RefreshPolicy::Result result =
+        policy.apply(parsed, shown, (sim._time - start) * 1000UL);
+    uint32_t t3 = micros();
+    frameUs += t1 - t0;
+    filterUs += t2 - t1;
+    dashUs += t3 - t2;
+
+    // Each repaint spends the ghosting budget as the home widgets do: a
+    // text push for the numbers, a graphic one for bars and toggles
+    if (result.regions) {
+      refreshes++;
+      if (result.priority)
+        urgent++;
+      const uint8_t numbers =
+          (1 << RefreshPolicy::POWER_IN) | (1 << RefreshPolicy::POWER_OUT);
+      if (result.regions & numbers)
+        debt += RefreshScheduler::costOf(RegionKind::TEXT);
+      debt += RefreshScheduler::costOf(RegionKind::GRAPHIC);
+      if (debt >= RefreshScheduler::GHOST_BUDGET) {
+        debt = 0;
+        cleans++;
+      }
+    }
+
+    // This frame opened a minute and closed the last one, which the
+    // history takes as the dashboard does
+    TelemetryFilter::Minute minute;
+    if (sim._time % 60 == 0 && filter.lastMinute(minute)) {
+      uint32_t t = micros();
+      scratch->addSampleAt(PowerHistory::sampleOf(minute));
+      uint32_t us = micros() - t;
+      sampleUs += us;
+      worstSampleUs = max(worstSampleUs, us);
+      samples++;
+
+      if (sim._time % (FLUSH_INTERVAL_MINS * 60) == 0) {
+        t = micros();
+        scratch->flushToSD();
+        us = micros() - t;
+        flushUs += us;
+        worstFlushUs = max(worstFlushUs, us);
+        flushes++;
+      }
+
+      // The history screen's day chart, once a simulated day
+      if (sim._time % 86400 == 0) {
+        RollupBucket buckets[96];
+        t = micros();
+        scratch->aggregate(sim._time - 86400, sim._time, 900, buckets, 96);
+        queryUs += micros() - t;
+        queries++;
+      }
+    }
+    if (i % 1024 == 1023)
+      yield();
+  }
+
+  uint32_t hours = days * 24;
+  const HistoryRollup &rollup = scratch->getRollup();
+  const EnergyTotals &energy = scratch->getEnergy();
+  out.printf("#SIM run %s %d days %u frames %lu ms\n", profileName(profile),
+             days, (unsigned)frames, (unsigned long)(millis() - startMs));
+  out.printf("#SIM frame %u ns/op %u bad\n",
+             (unsigned)(frameUs * 1000 / frames), (unsigned)badFrames);
+  out.printf("#SIM filter %u ns/op %u spikes\n",
+             (unsigned)(filterUs * 1000 / frames), (unsigned)filter.rejected());
+  out.printf("#SIM dashboard %u ns/op %u refreshes %.1f/h %u priority "
+             "%u cleans\n",
+             (unsigned)(dashUs * 1000 / frames), (unsigned)refreshes,
+             (float)refreshes / hours, (unsigned)urgent, (unsigned)cleans);
+  out.printf("#SIM sample %u us/op %u worst %u samples\n",
+             (unsigned)(samples ? sampleUs / samples : 0),
+             (unsigned)worstSampleUs, (unsigned)samples);
+  out.printf("#SIM flush %u us/op %u worst %u flushes\n",
+             (unsigned)(flushes ? flushUs / flushes : 0),
+             (unsigned)worstFlushUs, (unsigned)flushes);
+  out.printf("#SIM query %u us/op %u queries\n",
+             (unsigned)(queries ? queryUs / queries : 0), (unsigned)queries);
+  out.printf("#SIM rollup %u %u %u buckets\n",
+             rollup.tier(HistoryRollup::QUARTER_HOUR).size(),
+             rollup.tier(HistoryRollup::HOUR).size(),
+             rollup.tier(HistoryRollup::DAY).size());
+  out.printf("#SIM energy %.0f Wh in %.0f Wh out\n", energy.lifetimeInWh,
+             energy.lifetimeOutWh);
+  delete scratch;
+}
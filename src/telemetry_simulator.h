@@ -0,0 +1,121 @@
+/**
+ * Telemetry Simulator
+ *
+ * Stands in for a Fossibot when none is in range. A load model makes up
+ * readings from a profile:
+ *
+ *   home     a base draw, a morning and an evening peak, the odd kettle,
+ *            and the mains charger topping up below 20% (to 90%)
+ *   solar    the same loads with a panel curve peaking at midday under
+ *            drifting cloud
+ *   history  each hour of the day's mean input and output from the
+ *            history's hourly rollup, home where an hour has no data
+ *
+ * and encodes each reading as the 0x1104 status frame the unit would send
+ * (register map, CRC). Recorded frames are the frame recorder's part
+ * ("REPLAY").
+ *
+ * "SIM LIVE [profile] [speed]" over USB serial feeds a frame a second
+ * through the primary session's receive path, as a replay does, with the
+ * model's clock running speed times real time (1440: a day a minute), so
+ * the dashboard and everything downstream of the BLE client run as if a
+ * unit were connected. Refused, or ended, while a real one is.
+ *
+ * "SIM RUN [profile] [days]" drives days of frames through the same steps
+ * as fast as they go and times each: frame encode and decode, the
+ * telemetry filter, the dashboard's refresh policy (with the refresh
+ * scheduler's ghosting budget) and a scratch PowerHistory in SCRATCH_DIR
+ * taking each simulated minute's summary, with its rollups, journal,
+ * flushes and day rollovers on the real storage, and a day's query as the
+ * history screen makes it. Results go out as "#SIM <stage> ..." lines. It
+ * blocks the loop meanwhile.
+ */
+
+#ifndef TELEMETRY_SIMULATOR_H
+#define TELEMETRY_SIMULATOR_H
+
+#include "ble/fossibot_protocol.h"
+#include <Arduino.h>
+#include <time.h>
+
+class PowerHistory;
+
+class TelemetrySimulator {
+public:
+  enum class Profile : uint8_t { HOME, SOLAR, HISTORY };
+
+  static const uint32_t FRAME_S = 10;       // Simulated seconds per frame
+  static const uint32_t LIVE_FRAME_MS = 1000; // Real time between frames
+  static const uint32_t CAPACITY_WH = 2048;  // Simulated battery
+  static const int MAX_DAYS = 7;             // A SIM RUN fills the ring
+  static const char *const SCRATCH_DIR;
+
+  TelemetrySimulator();
+
+  /**
+   * Profile by name ("home", "solar", "history")
+   * @return false if there is none of that name
+   */
+  static bool parseProfile(const char *name, Profile &out);
+  static const char *profileName(Profile profile);
+
+  /**
+   * Feed simulated frames to the primary session
+   * @param history Source of the history profile (nullptr: home)
+   * @return false while a unit is connected
+   */
+  bool startLive(Profile profile, float speed, const PowerHistory *history);
+  void stop();
+  bool isRunning() const { return _live; }
+
+  /**
+   * Send the frame due now. Call from the main loop.
+   */
+  void service();
+
+  // How long the loop may sleep before the next frame is due
+  uint32_t msUntilDue() const;
+
+  /**
+   * Run days of simulated frames through the pipeline and print the cost
+   * of each stage (blocks)
+   */
+  static void run(Print &out, Profile profile, int days,
+                  const PowerHistory *history);
+
+private:
+  // Model
+  Profile _profile;
+  time_t _time; // Simulated clock
+  float _soc;   // %
+  bool _charging;
+  float _cloud;   // 0.3..1 of the panel's clear-sky output
+  uint32_t _rng;  // xorshift32 state
+  uint16_t _kettle; // Seconds of kettle left
+  float _inW;
+  float _outW;
+  float _acInW;
+  float _dcInW;
+  float _hourIn[24];
+  float _hourOut[24];
+  uint32_t _haveHour; // Bit per hour with rollup data
+
+  // Live
+  bool _live;
+  float _speed;
+  uint32_t _lastFrameMs;
+  float _carry; // Simulated seconds not yet stepped
+
+  void reset(Profile profile, time_t start, const PowerHistory *history);
+  void learnHours(const PowerHistory *history);
+  float random01();
+  void loads(float hour, uint32_t seconds);
+  void step(uint32_t seconds);
+  void reading(Fossibot::PowerBankData &out) const;
+  static size_t buildFrame(const Fossibot::PowerBankData &data,
+                           uint8_t *frame, size_t cap);
+};
+
+extern TelemetrySimulator *simulator;
+
+#endif // TELEMETRY_SIMULATOR_H
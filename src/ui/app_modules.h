@@ -0,0 +1,46 @@
+/**
+ * App Modules
+ *
+ * Which apps are built in. Each is a switch set to 1 or 0 from the build
+ * flags (-DAPP_GAMES=0); an app that is off leaves out its screens' code,
+ * its state in UIManager and its buttons, and its screen IDs show the
+ * home screen instead. The dashboard, clock, history, settings and
+ * diagnostics are always there.
+ *
+ *   APP_GAMES       Games menu, 2048, Sudoku, Wordle
+ *   APP_NOTES       Notes, their browser and export, the to-do list
+ *   APP_READER      Books from /books, and their search index
+ *   APP_CALCULATOR  Calculator
+ *   APP_PHOTOS      Picture frame over /photos
+ *
+ * -DDASHBOARD_ONLY turns them all off by default, for units that only
+ * show a power bank; a switch given as well still wins
+ * (-DDASHBOARD_ONLY -DAPP_PHOTOS=1).
+ */
+
+#ifndef APP_MODULES_H
+#define APP_MODULES_H
+
+#ifdef DASHBOARD_ONLY
+#define APP_DEFAULT 0
+#else
+#define APP_DEFAULT 1
+#endif
+
+#ifndef APP_GAMES
+#define APP_GAMES APP_DEFAULT
+#endif
+#ifndef APP_NOTES
+#define APP_NOTES APP_DEFAULT
+#endif
+#ifndef APP_READER
+#define APP_READER APP_DEFAULT
+#endif
+#ifndef APP_CALCULATOR
+#define APP_CALCULATOR APP_DEFAULT
+#endif
+#ifndef APP_PHOTOS
+#define APP_PHOTOS APP_DEFAULT
+#endif
+
+#endif // APP_MODULES_H
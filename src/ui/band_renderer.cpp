@@ -0,0 +1,217 @@
+/**
+ * Band Renderer Implementation
+ */
+
+#include "band_renderer.h"
+#include "../utils/log.h"
+#include "../utils/mem_telemetry.h"
+#include <esp_heap_caps.h>
+
+static const int DEPTH = 4; // Shadow, band views and background alike
+
+BandRenderer::BandRenderer()
+    : _display(nullptr), _shadow(nullptr), _views{nullptr, nullptr},
+      _background(nullptr), _key(0), _previousKey(0), _x(0), _y(0), _w(0),
+      _h(0), _shadowX(0), _shadowY(0), _recording(false), _direct(true),
+      _shadowValid(false), _task(nullptr), _done(nullptr), _nextBand(0),
+      _lastRenderUs(0) {
+  _list.onFull([this] { flush(); });
+}
+
+BandRenderer::~BandRenderer() {
+  release();
+  delete _views[0];
+  delete _views[1];
+  if (_task)
+    vTaskDelete(_task);
+  if (_done)
+    vSemaphoreDelete(_done);
+}
+
+bool BandRenderer::allocate(int w, int h) {
+  for (M5Canvas *&view : _views) {
+    if (!view)
+      view = new M5Canvas(_display);
+  }
+  if (_shadow && _shadow->width() == w && _shadow->height() == h)
+    return true;
+
+  _shadowValid = false;
+  if (_shadow) {
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)_shadow->bufferLength());
+    delete _shadow;
+  }
+  _shadow = new M5Canvas(_display);
+  _shadow->setColorDepth(DEPTH);
+  _shadow->setPsram(true);
+  if (!_shadow->createSprite(w, h)) {
+    Serial.printf("UI: Band shadow %dx%d allocation failed\n", w, h);
+    delete _shadow;
+    _shadow = nullptr;
+    return false;
+  }
+  MemTelemetry::track(MemTelemetry::Tag::UI, _shadow->bufferLength());
+  return true;
+}
+
+bool BandRenderer::startTask() {
+  if (_task)
+    return true;
+  if (!_done)
+    _done = xSemaphoreCreateBinary();
+  // Low priority on core 0: NimBLE keeps the core when it needs it
+  if (!_done || xTaskCreatePinnedToCore(taskEntry, "bands", TASK_STACK, this,
+                                        1, &_task, 0) != pdPASS) {
+    _task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void BandRenderer::taskEntry(void *arg) {
+  BandRenderer *self = (BandRenderer *)arg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    self->runBands(1);
+    xSemaphoreGive(self->_done);
+  }
+}
+
+void BandRenderer::begin(LovyanGFX &display, int x, int y, int w, int h,
+                         M5Canvas *background, uint32_t key) {
+  _display = &display;
+  _x = x;
+  _y = y;
+  _w = w;
+  _h = h;
+  _key = key;
+  _lastRenderUs = 0;
+  _list.clear();
+  _list.setMetrics(&display);
+  _background = background && background->width() == w &&
+                        background->height() == h &&
+                        background->getColorDepth() == DEPTH
+                    ? background
+                    : nullptr;
+  _direct = !_background || !allocate(w, h);
+  if (!_direct)
+    startTask(); // Without it the loop task takes every band
+  if (_direct && background)
+    background->pushSprite(&display, x, y);
+  for (int b = 0; b < BANDS; b++)
+    _restored[b] = false;
+  _recording = true;
+}
+
+void BandRenderer::flush() {
+  if (_direct) {
+    _list.replay(*_display, 0, 0, _y, _y + _h);
+    return;
+  }
+  // Into the whole shadow: the frame is then redrawn in full
+  for (int b = 0; b < BANDS; b++)
+    _dirty[b] = true;
+  rasterize();
+}
+
+void BandRenderer::drawBand(M5Canvas &view, int band) {
+  int top = bandTop(band);
+  int bottom = bandTop(band + 1);
+  if (top >= bottom)
+    return;
+  int stride = _shadow->bufferLength() / _h;
+  uint8_t *rows = (uint8_t *)_shadow->getBuffer() + top * stride;
+  if (!_restored[band]) {
+    memcpy(rows, (const uint8_t *)_background->getBuffer() + top * stride,
+           (bottom - top) * stride);
+    _restored[band] = true;
+  }
+  // Same width and depth, so the band's rows line up with the shadow's
+  view.setBuffer(rows, _w, bottom - top, (lgfx::color_depth_t)DEPTH);
+  _list.replay(view, -_x, -(_y + top), _y + top, _y + bottom);
+}
+
+void BandRenderer::runBands(int core) {
+  for (int band; (band = _nextBand.fetch_add(1)) < BANDS;) {
+    if (_dirty[band])
+      drawBand(*_views[core], band);
+  }
+}
+
+void BandRenderer::rasterize() {
+  uint32_t start = micros();
+  _nextBand.store(0);
+  if (_task)
+    xTaskNotifyGive(_task);
+  runBands(0);
+  if (_task)
+    xSemaphoreTake(_done, portMAX_DELAY);
+  _lastRenderUs += micros() - start;
+}
+
+void BandRenderer::end() {
+  if (!_recording)
+    return;
+  _recording = false;
+  if (_direct) {
+    _list.replay(*_display, 0, 0, _y, _y + _h);
+    _shadowValid = false;
+    return;
+  }
+
+  // What changed since the frame on the display, or all of it
+  DamageTracker damage;
+  bool whole = !_shadowValid || _key != _previousKey || _x != _shadowX ||
+               _y != _shadowY || _list.overflowed() ||
+               _previous.overflowed() || !_list.diff(_previous, damage);
+  if (whole) {
+    damage.clear();
+    damage.add(_x, _y, _x + _w - 1, _y + _h - 1);
+  }
+
+  for (int b = 0; b < BANDS; b++) {
+    int top = _y + bandTop(b), bottom = _y + bandTop(b + 1);
+    _dirty[b] = false;
+    for (int i = 0; i < damage.count(); i++) {
+      const DamageRect &r = damage.rect(i);
+      if (r.y0 < bottom && r.y1 >= top)
+        _dirty[b] = true;
+    }
+  }
+  if (!damage.empty())
+    rasterize();
+
+  _display->startWrite();
+  for (int i = 0; i < damage.count(); i++) {
+    const DamageRect &r = damage.rect(i);
+    int x0 = max((int)r.x0, _x), y0 = max((int)r.y0, _y);
+    int x1 = min((int)r.x1, _x + _w - 1), y1 = min((int)r.y1, _y + _h - 1);
+    if (x1 < x0 || y1 < y0)
+      continue;
+    _display->setClipRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    _shadow->pushSprite(_display, _x, _y);
+    _display->clearClipRect();
+  }
+  _display->endWrite();
+  LOG_D("UI", "Bands: %d commands, %d damage rects, %lu us",
+        _list.size(), damage.count(), (unsigned long)_lastRenderUs);
+
+  _previous.swap(_list);
+  _previousKey = _key;
+  _shadowX = _x;
+  _shadowY = _y;
+  _shadowValid = true;
+}
+
+void BandRenderer::release() {
+  if (_shadow) {
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)_shadow->bufferLength());
+    delete _shadow;
+    _shadow = nullptr;
+  }
+  _list.release();
+  _previous.release();
+  _shadowValid = false;
+}
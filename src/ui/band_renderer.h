@@ -0,0 +1,103 @@
+/**
+ * Band Renderer
+ *
+ * Rasterizes a heavy region (the history plot: a few thousand trace
+ * rectangles per repaint) on both cores, and only where it changed.
+ * Drawing between begin() and end() goes into a DisplayList (list());
+ * end() diffs it against the previous frame's list for the damaged
+ * rectangles, then the loop task and a helper task on core 0 take the
+ * region's BANDS horizontal bands in turn. A band the damage reaches is
+ * restored from the background and gets the commands that reach its rows
+ * replayed into it, through that core's view of the rows of the 4-bit
+ * shadow canvas. Bands are disjoint rows of the shadow, so the two never
+ * touch the same byte. Only the damaged rectangles go to the display.
+ *
+ * The background is a canvas of the region's size (a StaticLayer with the
+ * frame and grid) and its key; a new key, a new region, invalidate() or a
+ * list that filled up (and was rasterized there and then) redraws it all.
+ * Without a background, PSRAM for the shadow, or the helper task, the
+ * list is replayed straight to the display as before.
+ */
+
+#ifndef BAND_RENDERER_H
+#define BAND_RENDERER_H
+
+#include "display_list.h"
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+class BandRenderer {
+public:
+  static const int BANDS = 8; // Taken in turn, so a busy band evens out
+  static const uint32_t TASK_STACK = 3072;
+
+  BandRenderer();
+  ~BandRenderer();
+
+  /**
+   * Start recording for the screen region (x, y, w, h). background, the
+   * same size, is what the region shows under the list; key stands for
+   * its contents.
+   */
+  void begin(LovyanGFX &display, int x, int y, int w, int h,
+             M5Canvas *background, uint32_t key);
+
+  /**
+   * The frame's commands, in screen coordinates
+   */
+  DisplayList &list() { return _list; }
+
+  /**
+   * Rasterize the damaged bands and push the damaged rectangles
+   */
+  void end();
+
+  /**
+   * The display no longer shows the last frame (the screen was redrawn)
+   */
+  void invalidate() { _shadowValid = false; }
+
+  /**
+   * Free the shadow (the screen using it closed)
+   */
+  void release();
+
+  uint32_t getLastRenderUs() const { return _lastRenderUs; }
+
+private:
+  LovyanGFX *_display;
+  M5Canvas *_shadow;
+  M5Canvas *_views[2]; // Per core: a band's rows of the shadow
+  M5Canvas *_background;
+  DisplayList _list;
+  DisplayList _previous; // What the shadow and the display show
+  uint32_t _key, _previousKey;
+  int _x, _y, _w, _h;
+  int _shadowX, _shadowY;
+  bool _recording;
+  bool _direct;      // No shadow: the list is replayed on the display
+  bool _shadowValid; // Shadow and display hold _previous
+  bool _dirty[BANDS];    // To be rasterized
+  bool _restored[BANDS]; // Background already back in the band
+
+  TaskHandle_t _task;
+  SemaphoreHandle_t _done;
+  std::atomic<int> _nextBand;
+  uint32_t _lastRenderUs;
+
+  bool allocate(int w, int h);
+  bool startTask();
+  void flush();
+  void rasterize();
+  void runBands(int core);
+  void drawBand(M5Canvas &view, int band);
+  int bandTop(int band) const { return band * _h / BANDS; }
+
+  static void taskEntry(void *arg);
+};
+
+#endif // BAND_RENDERER_H
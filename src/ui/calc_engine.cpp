@@ -0,0 +1,177 @@
+/**
+ * Calculator Engine Implementation
+ */
+
+#include "calc_engine.h"
+#include <string.h>
+
+namespace {
+
+const char *SYNTAX = "Syntax error";
+const char *DIVIDE_BY_ZERO = "Divide by zero";
+const char *OVERFLOW_ERROR = "Overflow";
+const char *TOO_COMPLEX = "Too complex";
+
+const char NEGATE = 'n'; // Unary minus on the operator stack
+
+int precedence(char op) {
+  switch (op) {
+  case '+':
+  case '-':
+    return 1;
+  case '*':
+  case '/':
+    return 2;
+  case NEGATE:
+    return 3;
+  default: // '('
+    return 0;
+  }
+}
+
+struct Stacks {
+  Decimal values[CalcEngine::MAX_DEPTH];
+  char ops[CalcEngine::MAX_DEPTH];
+  int valueCount = 0;
+  int opCount = 0;
+
+  // Apply the operator on top to the values on top
+  const char *apply() {
+    char op = ops[--opCount];
+    if (op == NEGATE) {
+      if (valueCount < 1)
+        return SYNTAX;
+      values[valueCount - 1] = values[valueCount - 1].negated();
+      return nullptr;
+    }
+    if (valueCount < 2)
+      return SYNTAX;
+    const Decimal &a = values[valueCount - 2];
+    const Decimal &b = values[valueCount - 1];
+    Decimal r;
+    bool ok;
+    switch (op) {
+    case '+':
+      ok = Decimal::add(a, b, r);
+      break;
+    case '-':
+      ok = Decimal::sub(a, b, r);
+      break;
+    case '*':
+      ok = Decimal::mul(a, b, r);
+      break;
+    default:
+      if (b.isZero())
+        return DIVIDE_BY_ZERO;
+      ok = Decimal::div(a, b, r);
+      break;
+    }
+    if (!ok)
+      return OVERFLOW_ERROR;
+    valueCount--;
+    values[valueCount - 1] = r;
+    return nullptr;
+  }
+};
+
+} // namespace
+
+CalcEngine::CalcEngine() : _next(0), _count(0) {}
+
+const char *CalcEngine::evaluate(const char *expression,
+                                 Decimal &result) const {
+  Stacks s;
+  // An operand is expected at the start, after an operator and after '(';
+  // a '-' there is unary
+  bool expectOperand = true;
+  const char *error = nullptr;
+
+  for (const char *p = expression; *p;) {
+    char c = *p;
+    if (c == ' ') {
+      p++;
+    } else if ((c >= '0' && c <= '9') || c == '.') {
+      if (!expectOperand)
+        return SYNTAX;
+      const char *start = p;
+      while ((*p >= '0' && *p <= '9') || *p == '.')
+        p++;
+      // A chained result may carry an exponent ("1.5e-20")
+      if (*p == 'e' && (p[1] == '-' || (p[1] >= '0' && p[1] <= '9'))) {
+        p += p[1] == '-' ? 2 : 1;
+        while (*p >= '0' && *p <= '9')
+          p++;
+      }
+      if (s.valueCount == MAX_DEPTH)
+        return TOO_COMPLEX;
+      if (!Decimal::parse(start, p - start, s.values[s.valueCount]))
+        return SYNTAX;
+      s.valueCount++;
+      expectOperand = false;
+    } else if (c == '(') {
+      if (!expectOperand)
+        return SYNTAX;
+      if (s.opCount == MAX_DEPTH)
+        return TOO_COMPLEX;
+      s.ops[s.opCount++] = '(';
+      p++;
+    } else if (c == ')') {
+      if (expectOperand)
+        return SYNTAX;
+      while (s.opCount > 0 && s.ops[s.opCount - 1] != '(')
+        if ((error = s.apply()))
+          return error;
+      if (s.opCount == 0)
+        return SYNTAX; // No '(' to close
+      s.opCount--;
+      p++;
+    } else if (c == '+' || c == '-' || c == '*' || c == '/') {
+      p++;
+      if (expectOperand) {
+        if (c == '+')
+          continue; // Unary plus changes nothing
+        if (c != '-')
+          return SYNTAX;
+        c = NEGATE;
+      } else {
+        // Left to right: first apply what binds at least as tightly
+        while (s.opCount > 0 &&
+               precedence(s.ops[s.opCount - 1]) >= precedence(c))
+          if ((error = s.apply()))
+            return error;
+        expectOperand = true;
+      }
+      if (s.opCount == MAX_DEPTH)
+        return TOO_COMPLEX;
+      s.ops[s.opCount++] = c;
+    } else {
+      return SYNTAX;
+    }
+  }
+
+  if (expectOperand)
+    return SYNTAX;
+  while (s.opCount > 0) {
+    if (s.ops[s.opCount - 1] == '(')
+      return SYNTAX; // Unclosed
+    if ((error = s.apply()))
+      return error;
+  }
+  if (s.valueCount != 1)
+    return SYNTAX;
+  result = s.values[0];
+  return nullptr;
+}
+
+void CalcEngine::record(const char *expression, const char *result) {
+  Entry &entry = _history[_next];
+  strlcpy(entry.expression, expression, sizeof(entry.expression));
+  strlcpy(entry.result, result, sizeof(entry.result));
+  _next = (_next + 1) % HISTORY;
+  if (_count < HISTORY)
+    _count++;
+}
+
+const CalcEngine::Entry &CalcEngine::historyEntry(int index) const {
+  return _history[(_next - 1 - index + 2 * HISTORY) % HISTORY];
+}
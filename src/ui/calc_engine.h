@@ -0,0 +1,57 @@
+/**
+ * Calculator Engine
+ *
+ * Evaluates what was typed on the calculator keypad: numbers, + - * /,
+ * parentheses and unary minus, with the usual precedence (* and / before
+ * + and -, left to right). The expression is read once, left to right,
+ * by a shunting-yard pass that applies each operator as soon as its
+ * operands are known, so no token list or RPN queue is kept. Arithmetic
+ * is in Decimal, so results are exact where a decimal answer exists.
+ *
+ * Also keeps the last HISTORY evaluations, newest first, for the
+ * calculator's history list.
+ */
+
+#ifndef CALC_ENGINE_H
+#define CALC_ENGINE_H
+
+#include "../utils/decimal.h"
+#include <Arduino.h>
+
+class CalcEngine {
+public:
+  static const int MAX_EXPRESSION = 64;
+  static const int MAX_RESULT = 48;
+  static const int MAX_DEPTH = 16; // Pending operators and operands
+  static const int HISTORY = 32;
+
+  struct Entry {
+    char expression[MAX_EXPRESSION];
+    char result[MAX_RESULT]; // The number, or the error
+  };
+
+  CalcEngine();
+
+  /**
+   * Evaluate an expression
+   * @return nullptr, or what is wrong ("Syntax error", "Divide by zero",
+   *         "Overflow", "Too complex")
+   */
+  const char *evaluate(const char *expression, Decimal &result) const;
+
+  /**
+   * Keep an evaluation (the result as it was shown)
+   */
+  void record(const char *expression, const char *result);
+
+  int historyCount() const { return _count; }
+  const Entry &historyEntry(int index) const; // 0 = newest
+  void clearHistory() { _count = 0; }
+
+private:
+  Entry _history[HISTORY];
+  int _next; // Slot the next entry goes in
+  int _count;
+};
+
+#endif // CALC_ENGINE_H
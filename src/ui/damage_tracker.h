@@ -0,0 +1,93 @@
+/**
+ * Damage Tracker
+ *
+ * Accumulates the bounding boxes of changed pixels for one frame and merges
+ * overlapping (or nearly touching) regions so the panel receives a few
+ * coalesced updates instead of one per primitive.
+ */
+
+#ifndef DAMAGE_TRACKER_H
+#define DAMAGE_TRACKER_H
+
+#include <Arduino.h>
+
+struct DamageRect {
+  int16_t x0, y0, x1, y1; // Inclusive bounds
+
+  int width() const { return x1 - x0 + 1; }
+  int height() const { return y1 - y0 + 1; }
+  int32_t area() const { return (int32_t)width() * height(); }
+};
+
+class DamageTracker {
+public:
+  static const int MAX_RECTS = 8;
+  static const int MERGE_GAP = 8; // Rects closer than this are joined
+
+  DamageTracker() : _count(0) {}
+
+  /**
+   * Add a damaged area (clipped later by the consumer)
+   */
+  void add(int x0, int y0, int x1, int y1) {
+    if (x1 < x0 || y1 < y0)
+      return;
+    DamageRect r = {(int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)y1};
+
+    // Absorb every rect this one touches, repeating as it grows
+    bool merged = true;
+    while (merged) {
+      merged = false;
+      for (int i = 0; i < _count; i++) {
+        if (near(r, _rects[i])) {
+          r = unite(r, _rects[i]);
+          _rects[i] = _rects[--_count];
+          merged = true;
+          break;
+        }
+      }
+    }
+
+    if (_count < MAX_RECTS) {
+      _rects[_count++] = r;
+      return;
+    }
+
+    // Full: fold into the rect whose union grows the least
+    int best = 0;
+    int32_t bestGrowth = INT32_MAX;
+    for (int i = 0; i < _count; i++) {
+      int32_t growth = unite(r, _rects[i]).area() - _rects[i].area();
+      if (growth < bestGrowth) {
+        bestGrowth = growth;
+        best = i;
+      }
+    }
+    _rects[best] = unite(r, _rects[best]);
+  }
+
+  int count() const { return _count; }
+  const DamageRect &rect(int i) const { return _rects[i]; }
+  bool empty() const { return _count == 0; }
+  void clear() { _count = 0; }
+
+private:
+  DamageRect _rects[MAX_RECTS];
+  int _count;
+
+  static bool near(const DamageRect &a, const DamageRect &b) {
+    return a.x0 <= b.x1 + MERGE_GAP && b.x0 <= a.x1 + MERGE_GAP &&
+           a.y0 <= b.y1 + MERGE_GAP && b.y0 <= a.y1 + MERGE_GAP;
+  }
+
+  static DamageRect unite(const DamageRect &a, const DamageRect &b) {
+    DamageRect r;
+    r.x0 = a.x0 < b.x0 ? a.x0 : b.x0;
+    r.y0 = a.y0 < b.y0 ? a.y0 : b.y0;
+    r.x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+    r.y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+    return r;
+  }
+};
+
+#endif // DAMAGE_TRACKER_H
@@ -0,0 +1,287 @@
+/**
+ * Display List Implementation
+ */
+
+#include "display_list.h"
+#include <algorithm>
+#include <cstddef>
+#include <esp_heap_caps.h>
+
+static const int FIRST_COMMANDS = 256;
+static const size_t FIRST_TEXT = 1024;
+
+// FNV-1a, folded in a field at a time
+static inline uint32_t mix(uint32_t hash, const void *data, size_t n) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < n; i++)
+    hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+DisplayList::DisplayList()
+    : _commands(nullptr), _count(0), _capacity(0), _text(nullptr),
+      _textUsed(0), _textCapacity(0), _overflowed(false),
+      _metrics(nullptr) {}
+
+DisplayList::~DisplayList() {
+  free(_commands);
+  free(_text);
+}
+
+void DisplayList::clear() {
+  _count = 0;
+  _textUsed = 0;
+  _overflowed = false;
+}
+
+void DisplayList::release() {
+  free(_commands);
+  free(_text);
+  _commands = nullptr;
+  _text = nullptr;
+  _capacity = 0;
+  _textCapacity = 0;
+  clear();
+}
+
+void DisplayList::flush() {
+  if (_onFull)
+    _onFull();
+  _count = 0;
+  _textUsed = 0;
+  _overflowed = true;
+}
+
+bool DisplayList::reserveText(size_t bytes) {
+  if (_textUsed + bytes <= _textCapacity)
+    return true;
+  size_t want = _textCapacity ? _textCapacity * 2 : FIRST_TEXT;
+  while (want < _textUsed + bytes)
+    want *= 2;
+  if (want > MAX_TEXT)
+    want = MAX_TEXT;
+  if (_textUsed + bytes > want)
+    return false;
+  char *grown = (char *)heap_caps_realloc(_text, want, MALLOC_CAP_SPIRAM);
+  if (!grown)
+    return false;
+  _text = grown;
+  _textCapacity = want;
+  return true;
+}
+
+DisplayList::Command *DisplayList::add(Op op, int x0, int y0, int x1, int y1,
+                                       uint16_t color) {
+  if (_count == _capacity) {
+    int want = _capacity ? _capacity * 2 : FIRST_COMMANDS;
+    if (want > MAX_COMMANDS)
+      want = MAX_COMMANDS;
+    Command *grown =
+        want > _capacity
+            ? (Command *)heap_caps_realloc(_commands, want * sizeof(Command),
+                                           MALLOC_CAP_SPIRAM)
+            : nullptr;
+    if (grown) {
+      _commands = grown;
+      _capacity = want;
+    } else {
+      flush(); // Full (or no memory): draw what is there, start over
+      if (_count == _capacity)
+        return nullptr;
+    }
+  }
+  Command &c = _commands[_count++];
+  c.op = op;
+  c.size = 0;
+  c.color = color;
+  c.x0 = x0;
+  c.y0 = y0;
+  c.x1 = x1;
+  c.y1 = y1;
+  c.arg = 0;
+  c.hash = mix(2166136261u, &c, offsetof(Command, arg));
+  return &c;
+}
+
+void DisplayList::fillRect(int x, int y, int w, int h, uint16_t color) {
+  if (w > 0 && h > 0)
+    add(Op::FILL_RECT, x, y, x + w - 1, y + h - 1, color);
+}
+
+void DisplayList::drawRect(int x, int y, int w, int h, uint16_t color) {
+  if (w > 0 && h > 0)
+    add(Op::RECT, x, y, x + w - 1, y + h - 1, color);
+}
+
+void DisplayList::drawLine(int x0, int y0, int x1, int y1, uint16_t color) {
+  if (x1 < x0) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+  bool rises = y1 < y0;
+  Command *c = add(Op::LINE, x0, rises ? y1 : y0, x1, rises ? y0 : y1, color);
+  if (c && rises) {
+    c->arg = 1;
+    c->hash = mix(c->hash, &c->arg, sizeof(c->arg));
+  }
+}
+
+void DisplayList::drawPixel(int x, int y, uint16_t color) {
+  add(Op::PIXEL, x, y, x, y, color);
+}
+
+void DisplayList::drawText(int x, int y, const char *text, uint8_t textSize,
+                           uint16_t color, const lgfx::IFont *font) {
+  size_t len = strlen(text);
+  size_t bytes = sizeof(font) + len + 1;
+  if (bytes > MAX_TEXT)
+    return;
+
+  int w, h;
+  if (!font) { // Built-in 6x8 cells
+    w = 6 * textSize * len;
+    h = 8 * textSize;
+  } else if (_metrics) {
+    _metrics->setFont(font);
+    _metrics->setTextSize(1);
+    w = _metrics->textWidth(text);
+    h = _metrics->fontHeight();
+    _metrics->setFont(&fonts::Font0);
+  } else { // Unmeasured: to the right edge
+    w = INT16_MAX - x;
+    h = INT16_MAX - y;
+  }
+  if (w <= 0 || h <= 0)
+    return;
+
+  // Text first: a flush for room would take a command already added
+  if (!reserveText(bytes)) {
+    flush();
+    if (!reserveText(bytes))
+      return;
+  }
+  Command *c = add(Op::TEXT, x, y, x + w - 1, y + h - 1, color);
+  if (!c)
+    return;
+  if (_textUsed + bytes > _textCapacity) // add() flushed the arena
+    return;
+  c->size = textSize;
+  c->arg = _textUsed;
+  memcpy(_text + _textUsed, &font, sizeof(font));
+  memcpy(_text + _textUsed + sizeof(font), text, len + 1);
+  _textUsed += bytes;
+  c->hash = mix(c->hash, &textSize, 1);
+  c->hash = mix(c->hash, &font, sizeof(font));
+  c->hash = mix(c->hash, text, len);
+}
+
+void DisplayList::pushSprite(M5Canvas *sprite, int x, int y, uint32_t key) {
+  if (!sprite || !reserveText(sizeof(sprite))) {
+    flush();
+    if (!sprite || !reserveText(sizeof(sprite)))
+      return;
+  }
+  Command *c = add(Op::SPRITE, x, y, x + sprite->width() - 1,
+                   y + sprite->height() - 1, 0);
+  if (!c || _textUsed + sizeof(sprite) > _textCapacity)
+    return;
+  c->arg = _textUsed;
+  memcpy(_text + _textUsed, &sprite, sizeof(sprite));
+  _textUsed += sizeof(sprite);
+  c->hash = mix(c->hash, &sprite, sizeof(sprite));
+  c->hash = mix(c->hash, &key, sizeof(key));
+}
+
+void DisplayList::replay(LovyanGFX &g, int ox, int oy, int top,
+                         int bottom) const {
+  for (int i = 0; i < _count; i++) {
+    const Command &c = _commands[i];
+    if (c.y1 < top || c.y0 >= bottom)
+      continue; // Culled: nothing in these rows
+    int x = c.x0 + ox, y = c.y0 + oy;
+    int w = c.x1 - c.x0 + 1, h = c.y1 - c.y0 + 1;
+    switch (c.op) {
+    case Op::FILL_RECT:
+      g.fillRect(x, y, w, h, c.color);
+      break;
+    case Op::RECT:
+      g.drawRect(x, y, w, h, c.color);
+      break;
+    case Op::LINE:
+      if (c.arg)
+        g.drawLine(x, c.y1 + oy, c.x1 + ox, y, c.color);
+      else
+        g.drawLine(x, y, c.x1 + ox, c.y1 + oy, c.color);
+      break;
+    case Op::PIXEL:
+      g.drawPixel(x, y, c.color);
+      break;
+    case Op::TEXT: {
+      const lgfx::IFont *font;
+      memcpy(&font, _text + c.arg, sizeof(font));
+      g.setFont(font ? font : &fonts::Font0);
+      g.setTextSize(font ? 1 : c.size);
+      g.setTextColor(c.color);
+      g.setTextDatum(top_left);
+      g.drawString(_text + c.arg + sizeof(font), x, y);
+      g.setFont(&fonts::Font0); // The rest of the UI uses the default
+      break;
+    }
+    case Op::SPRITE: {
+      M5Canvas *sprite;
+      memcpy(&sprite, _text + c.arg, sizeof(sprite));
+      sprite->pushSprite(&g, x, y);
+      break;
+    }
+    }
+  }
+}
+
+bool DisplayList::diff(const DisplayList &previous,
+                       DamageTracker &damage) const {
+  struct Entry {
+    uint32_t hash;
+    uint16_t index;
+    bool operator<(const Entry &o) const { return hash < o.hash; }
+  };
+  int n = _count, m = previous._count;
+  Entry *entries = (Entry *)heap_caps_malloc((n + m) * sizeof(Entry) + 1,
+                                             MALLOC_CAP_SPIRAM);
+  if (!entries)
+    return false;
+  Entry *now = entries, *then = entries + n;
+  for (int i = 0; i < n; i++)
+    now[i] = {_commands[i].hash, (uint16_t)i};
+  for (int i = 0; i < m; i++)
+    then[i] = {previous._commands[i].hash, (uint16_t)i};
+  std::sort(now, now + n);
+  std::sort(then, then + m);
+
+  // Merge the two: a hash left over on either side is a change
+  auto damaged = [&](const Command &c) {
+    damage.add(c.x0, c.y0, c.x1, c.y1);
+  };
+  int i = 0, j = 0;
+  while (i < n || j < m) {
+    if (j == m || (i < n && now[i].hash < then[j].hash)) {
+      damaged(_commands[now[i++].index]);
+    } else if (i == n || then[j].hash < now[i].hash) {
+      damaged(previous._commands[then[j++].index]);
+    } else {
+      i++;
+      j++;
+    }
+  }
+  free(entries);
+  return true;
+}
+
+void DisplayList::swap(DisplayList &other) {
+  std::swap(_commands, other._commands);
+  std::swap(_count, other._count);
+  std::swap(_capacity, other._capacity);
+  std::swap(_text, other._text);
+  std::swap(_textUsed, other._textUsed);
+  std::swap(_textCapacity, other._textCapacity);
+  std::swap(_overflowed, other._overflowed);
+}
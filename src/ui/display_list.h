@@ -0,0 +1,140 @@
+/**
+ * Display List
+ *
+ * Draw calls recorded as compact commands (filled and outlined rects,
+ * lines, pixels, text, sprites) instead of going to a surface at once.
+ * Each command keeps its screen bounds and a hash of everything that
+ * decides its pixels, so the list can be:
+ *
+ *   - replayed into any surface, only the commands that reach a given
+ *     band of rows (culling), in the order they were recorded;
+ *   - diffed against the previous frame's list: a command found in only
+ *     one of the two damages its bounds, which gives the changed regions
+ *     without comparing a pixel. Diffing matches commands by hash, not
+ *     position, so the same commands in a new order are not seen.
+ *
+ * Commands and text live in PSRAM arrays that grow as needed, up to
+ * MAX_COMMANDS and MAX_TEXT. When one is full the onFull callback (the
+ * band renderer's flush) gets to draw what is there before the list
+ * empties and recording goes on; the frame then counts as overflowed and
+ * cannot be diffed.
+ *
+ * Text is measured when recorded: the built-in font from its fixed cell,
+ * card fonts through the metrics surface (setMetrics()). A sprite is kept
+ * by pointer with a caller's key for its contents; it must outlive the
+ * replay.
+ */
+
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include "damage_tracker.h"
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <functional>
+
+class DisplayList {
+public:
+  static const int MAX_COMMANDS = 8192;
+  static const size_t MAX_TEXT = 16384;
+
+  enum class Op : uint8_t { FILL_RECT, RECT, LINE, PIXEL, TEXT, SPRITE };
+
+  struct Command {
+    Op op;
+    uint8_t size;   // TEXT: text size
+    uint16_t color; // RGB565
+    int16_t x0, y0, x1, y1; // Bounds, inclusive
+    uint32_t arg;  // TEXT/SPRITE: arena offset; LINE: 1 if it rises
+    uint32_t hash; // Of everything that decides the pixels
+  };
+
+  DisplayList();
+  ~DisplayList();
+
+  /**
+   * Empty the list for a new frame (keeps its memory)
+   */
+  void clear();
+
+  /**
+   * Free the arrays (they grow again on the next frame)
+   */
+  void release();
+
+  /**
+   * Surface used to measure card fonts (the display)
+   */
+  void setMetrics(LovyanGFX *metrics) { _metrics = metrics; }
+
+  /**
+   * Called when the list is full, before it empties
+   */
+  void onFull(std::function<void()> flush) { _onFull = flush; }
+
+  void fillRect(int x, int y, int w, int h, uint16_t color);
+  void drawRect(int x, int y, int w, int h, uint16_t color);
+  void drawLine(int x0, int y0, int x1, int y1, uint16_t color);
+  void drawPixel(int x, int y, uint16_t color);
+  void drawFastHLine(int x, int y, int w, uint16_t color) {
+    fillRect(x, y, w, 1, color);
+  }
+  void drawFastVLine(int x, int y, int h, uint16_t color) {
+    fillRect(x, y, 1, h, color);
+  }
+
+  /**
+   * Text with its top-left at (x, y); font nullptr is the built-in font
+   * at textSize, a card font is drawn at size 1
+   */
+  void drawText(int x, int y, const char *text, uint8_t textSize,
+                uint16_t color, const lgfx::IFont *font = nullptr);
+
+  /**
+   * Push sprite at (x, y); key stands for its contents in the diff
+   */
+  void pushSprite(M5Canvas *sprite, int x, int y, uint32_t key);
+
+  int size() const { return _count; }
+  const Command &at(int i) const { return _commands[i]; }
+
+  /**
+   * Commands were lost to a flush this frame (no diff possible)
+   */
+  bool overflowed() const { return _overflowed; }
+
+  /**
+   * Draw the commands that reach rows [top, bottom) into g, each moved
+   * by (ox, oy)
+   */
+  void replay(LovyanGFX &g, int ox, int oy, int top, int bottom) const;
+
+  /**
+   * Add to damage the bounds of every command in only one of this list
+   * and previous
+   * @return false without memory to sort them (treat all as changed)
+   */
+  bool diff(const DisplayList &previous, DamageTracker &damage) const;
+
+  /**
+   * Trade contents with other (this frame becomes the previous one)
+   */
+  void swap(DisplayList &other);
+
+private:
+  Command *_commands;
+  int _count;
+  int _capacity;
+  char *_text;
+  size_t _textUsed;
+  size_t _textCapacity;
+  bool _overflowed;
+  LovyanGFX *_metrics;
+  std::function<void()> _onFull;
+
+  Command *add(Op op, int x0, int y0, int x1, int y1, uint16_t color);
+  bool reserveText(size_t bytes);
+  void flush();
+};
+
+#endif // DISPLAY_LIST_H
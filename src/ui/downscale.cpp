@@ -0,0 +1,93 @@
+/**
+ * Downscaler Implementation
+ */
+
+#include "downscale.h"
+#include "../utils/buffer_pool.h"
+
+namespace Downscale {
+
+static inline uint8_t nibble(const uint8_t *row, int x) {
+  return x & 1 ? row[x >> 1] & 0x0F : row[x >> 1] >> 4;
+}
+
+// Source rows are (srcW * depth + 7) / 8 bytes; 1-bit pixels count as
+// level 0 or 15 so both depths average to the same 4-bit scale
+static bool box(const uint8_t *src, int srcW, int srcH, int depth,
+                uint8_t *dst, int dstW, int dstH) {
+  if (dstW <= 0 || dstH <= 0 || dstW > srcW || dstH > srcH)
+    return false;
+
+  // Column sums over the source rows of one output row: at most
+  // ceil(srcH / dstH) * 15 each
+  BufferPool::Buffer block(srcW * sizeof(uint16_t));
+  uint16_t *sums = (uint16_t *)block.get();
+  if (!sums)
+    return false;
+
+  size_t srcRow = ((size_t)srcW * depth + 7) / 8;
+  size_t dstRow = (dstW + 1) / 2;
+  uint32_t stepX = ((uint32_t)srcW << 16) / dstW;
+  uint32_t stepY = ((uint32_t)srcH << 16) / dstH;
+
+  uint32_t fy = 0;
+  for (int dy = 0; dy < dstH; dy++) {
+    int y0 = fy >> 16;
+    fy += stepY;
+    int y1 = dy == dstH - 1 ? srcH : (int)(fy >> 16);
+    if (y1 <= y0)
+      y1 = y0 + 1;
+
+    memset(sums, 0, srcW * sizeof(uint16_t));
+    for (int y = y0; y < y1; y++) {
+      const uint8_t *row = src + y * srcRow;
+      if (depth == 1) {
+        // Left pixel in the top bit; set bits are white
+        for (int x = 0; x < srcW; x++)
+          if (row[x >> 3] & (0x80 >> (x & 7)))
+            sums[x] += 15;
+        continue;
+      }
+      for (int x = 0; x + 1 < srcW; x += 2) {
+        sums[x] += row[x >> 1] >> 4;
+        sums[x + 1] += row[x >> 1] & 0x0F;
+      }
+      if (srcW & 1)
+        sums[srcW - 1] += nibble(row, srcW - 1);
+    }
+
+    uint8_t *out = dst + dy * dstRow;
+    int rows = y1 - y0;
+    uint32_t fx = 0;
+    for (int dx = 0; dx < dstW; dx++) {
+      int x0 = fx >> 16;
+      fx += stepX;
+      int x1 = dx == dstW - 1 ? srcW : (int)(fx >> 16);
+      if (x1 <= x0)
+        x1 = x0 + 1;
+
+      uint32_t total = 0;
+      for (int x = x0; x < x1; x++)
+        total += sums[x];
+      uint32_t count = rows * (x1 - x0);
+      uint8_t v = (total + count / 2) / count;
+      if (dx & 1)
+        out[dx >> 1] = (out[dx >> 1] & 0xF0) | v;
+      else
+        out[dx >> 1] = (out[dx >> 1] & 0x0F) | (v << 4);
+    }
+  }
+  return true;
+}
+
+bool box4(const uint8_t *src, int srcW, int srcH, uint8_t *dst, int dstW,
+          int dstH) {
+  return box(src, srcW, srcH, 4, dst, dstW, dstH);
+}
+
+bool box1(const uint8_t *src, int srcW, int srcH, uint8_t *dst, int dstW,
+          int dstH) {
+  return box(src, srcW, srcH, 1, dst, dstW, dstH);
+}
+
+} // namespace Downscale
@@ -0,0 +1,36 @@
+/**
+ * Downscaler
+ *
+ * Box-filter (area-averaging) reduction of packed grayscale buffers into
+ * a 4 bpp one, as used by M5Canvas sprites: 4-bit rows are (width + 1) / 2
+ * bytes with the left pixel in the high nibble, 1-bit rows (width + 7) / 8
+ * bytes with the left pixel in the top bit. Works on the buffers directly
+ * with integer 16.16 stepping, so thin pen lines fade to grey instead of
+ * vanishing as they do with nearest-pixel sampling.
+ */
+
+#ifndef DOWNSCALE_H
+#define DOWNSCALE_H
+
+#include <Arduino.h>
+
+namespace Downscale {
+
+/**
+ * Shrink src (srcW x srcH) into dst (dstW x dstH). Each output pixel is
+ * the rounded mean of the source pixels it covers. dst must not be larger
+ * than src in either direction.
+ * @return false if the column buffer could not be allocated
+ */
+bool box4(const uint8_t *src, int srcW, int srcH, uint8_t *dst, int dstW,
+          int dstH);
+
+/**
+ * As box4, from a 1 bpp source (the notes ink layer)
+ */
+bool box1(const uint8_t *src, int srcW, int srcH, uint8_t *dst, int dstW,
+          int dstH);
+
+} // namespace Downscale
+
+#endif // DOWNSCALE_H
@@ -0,0 +1,192 @@
+/**
+ * EPD Refresh Benchmark Implementation
+ */
+
+#include "epd_bench.h"
+#include "../utils/loop_monitor.h"
+#include <esp_timer.h>
+
+namespace EpdBench {
+
+const Size SIZES[SIZE_COUNT] = {
+    {"digit", 60, 80},   // One clock digit
+    {"panel", 300, 200}, // A home screen panel
+    {"half", 480, 540},
+    {"full", 960, 540},
+};
+
+const char *modeName(epd_mode_t mode) {
+  switch (mode) {
+  case epd_mode_t::epd_quality:
+    return "quality";
+  case epd_mode_t::epd_text:
+    return "text";
+  case epd_mode_t::epd_fast:
+    return "fast";
+  case epd_mode_t::epd_fastest:
+    return "fastest";
+  default:
+    return "?";
+  }
+}
+
+bool run(Results &r, void (*progress)(int done, int total)) {
+  memset(&r, 0, sizeof(r));
+
+  // From a clean white panel, so the first cell starts like the rest
+  M5.Display.setEpdMode(epd_mode_t::epd_quality);
+  M5.Display.fillScreen(TFT_WHITE);
+  M5.Display.display();
+  M5.Display.waitDisplay();
+  uint16_t sinceClean = 0;
+
+  for (int m = 0; m < MODE_COUNT; m++) {
+    epd_mode_t mode = RefreshScheduler::MODE_ORDER[m];
+    for (int s = 0; s < SIZE_COUNT; s++) {
+      if (progress)
+        progress(m * SIZE_COUNT + s, MODE_COUNT * SIZE_COUNT);
+      LoopMonitor::feed(); // The matrix outlasts the watchdog timeout
+      const Size &size = SIZES[s];
+      Cell &cell = r.cells[m][s];
+      cell.sinceClean = sinceClean;
+
+      uint64_t displaySum = 0, waitSum = 0;
+      for (int rep = 0; rep < REPS; rep++) {
+        M5.Display.setEpdMode(mode);
+        M5.Display.startWrite();
+        M5.Display.fillRect(0, 0, size.w, size.h,
+                            rep % 2 ? TFT_WHITE : TFT_BLACK);
+        M5.Display.endWrite();
+
+        int64_t t0 = esp_timer_get_time();
+        M5.Display.display();
+        int64_t t1 = esp_timer_get_time();
+        M5.Display.waitDisplay();
+        int64_t t2 = esp_timer_get_time();
+
+        uint32_t wait = (uint32_t)(t2 - t0);
+        displaySum += (uint32_t)(t1 - t0);
+        waitSum += wait;
+        if (wait > cell.maxWaitUs)
+          cell.maxWaitUs = wait;
+        r.updates++;
+        sinceClean = mode == epd_mode_t::epd_quality ? 0 : sinceClean + 1;
+      }
+      cell.displayUs = displaySum / REPS;
+      cell.waitUs = waitSum / REPS;
+      Serial.printf("EpdBench: %-7s %-5s display %6lu us, done %7lu us\n",
+                    modeName(mode), size.name, (unsigned long)cell.displayUs,
+                    (unsigned long)cell.waitUs);
+    }
+  }
+
+  // Powering the driver up again, as the refresh scheduler's idle() leaves
+  // it between updates
+  uint64_t wakeSum = 0;
+  for (int rep = 0; rep < WAKE_REPS; rep++) {
+    M5.Display.waitDisplay();
+    M5.Display.powerSaveOn();
+    int64_t t0 = esp_timer_get_time();
+    M5.Display.powerSaveOff();
+    uint32_t wake = (uint32_t)(esp_timer_get_time() - t0);
+    wakeSum += wake;
+    if (wake > r.maxWakeUs)
+      r.maxWakeUs = wake;
+  }
+  M5.Display.powerSaveOn();
+  r.wakeUs = wakeSum / WAKE_REPS;
+  Serial.printf("EpdBench: wake            %7lu us (max %lu)\n",
+                (unsigned long)r.wakeUs, (unsigned long)r.maxWakeUs);
+
+  if (progress)
+    progress(MODE_COUNT * SIZE_COUNT, MODE_COUNT * SIZE_COUNT);
+  r.ok = true;
+  return true;
+}
+
+bool save(SDManager *sd, const Results &r) {
+  SDAccess access(sd);
+  if (!access || !sd->ensureDirectory("/diag"))
+    return false;
+
+  File file = sdFS().open(COST_FILE, FILE_WRITE);
+  if (!file) {
+    access.fail();
+    return false;
+  }
+  file.print("mode,size,w,h,display_us,wait_us,max_wait_us,since_clean\n");
+  char line[96];
+  for (int m = 0; m < MODE_COUNT; m++) {
+    for (int s = 0; s < SIZE_COUNT; s++) {
+      const Cell &c = r.cells[m][s];
+      snprintf(line, sizeof(line), "%s,%s,%d,%d,%lu,%lu,%lu,%u\n",
+               modeName(RefreshScheduler::MODE_ORDER[m]), SIZES[s].name,
+               SIZES[s].w, SIZES[s].h, (unsigned long)c.displayUs,
+               (unsigned long)c.waitUs, (unsigned long)c.maxWaitUs,
+               (unsigned)c.sinceClean);
+      file.print(line);
+    }
+  }
+  snprintf(line, sizeof(line), "wake,driver,0,0,0,%lu,%lu,0\n",
+           (unsigned long)r.wakeUs, (unsigned long)r.maxWakeUs);
+  file.print(line);
+  file.close();
+  Serial.printf("EpdBench: Cost model written to %s\n", COST_FILE);
+  return true;
+}
+
+bool loadCostModel(RefreshScheduler::CostModel &model) {
+  File file = sdFS().open(COST_FILE, FILE_READ);
+  if (!file)
+    return false;
+
+  // Every mode x size cell must be there; rows may come in any order
+  bool seen[MODE_COUNT][SIZE_COUNT] = {};
+  int cells = 0;
+  model.wakeUs = 0;
+  char line[96];
+  while (file.available()) {
+    size_t n = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[n] = '\0';
+    char mode[12], size[12];
+    int w, h;
+    unsigned long displayUs, waitUs;
+    if (sscanf(line, "%11[^,],%11[^,],%d,%d,%lu,%lu", mode, size, &w, &h,
+               &displayUs, &waitUs) != 6)
+      continue; // Header, or a line cut short
+    if (strcmp(mode, "wake") == 0) {
+      model.wakeUs = waitUs;
+      continue;
+    }
+    int m = 0, s = 0;
+    while (m < MODE_COUNT &&
+           strcmp(modeName(RefreshScheduler::MODE_ORDER[m]), mode) != 0)
+      m++;
+    while (s < SIZE_COUNT && strcmp(SIZES[s].name, size) != 0)
+      s++;
+    if (m == MODE_COUNT || s == SIZE_COUNT || seen[m][s])
+      continue;
+    seen[m][s] = true;
+    cells++;
+    model.area[s] = (uint32_t)w * h;
+    model.waitUs[m][s] = waitUs;
+  }
+  file.close();
+
+  model.loaded = cells == MODE_COUNT * SIZE_COUNT;
+  if (model.loaded)
+    Serial.printf("EpdBench: Cost model from %s\n", COST_FILE);
+  return model.loaded;
+}
+
+void toCostModel(const Results &r, RefreshScheduler::CostModel &model) {
+  for (int s = 0; s < SIZE_COUNT; s++)
+    model.area[s] = (uint32_t)SIZES[s].w * SIZES[s].h;
+  for (int m = 0; m < MODE_COUNT; m++)
+    for (int s = 0; s < SIZE_COUNT; s++)
+      model.waitUs[m][s] = r.cells[m][s].waitUs;
+  model.wakeUs = r.wakeUs;
+  model.loaded = r.ok;
+}
+
+} // namespace EpdBench
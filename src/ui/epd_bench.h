@@ -0,0 +1,84 @@
+/**
+ * EPD Refresh Benchmark
+ *
+ * Times every waveform the refresh scheduler uses (epd_quality, epd_text,
+ * epd_fast, epd_fastest) over four region sizes, from a clock digit to the
+ * whole panel. Each cell flips its region black and white REPS times,
+ * timing display() (handing the update over) and waitDisplay() (the panel
+ * done) separately, and counts the partial updates since the last
+ * epd_quality one, the updates that leave ghosting behind. Last it times
+ * the panel driver's power-up after a sleep, WAKE_REPS times.
+ *
+ * The results go to COST_FILE, one row per cell and a "wake" row (its
+ * wait_us the power-up; files without it still load), which the refresh
+ * scheduler loads at boot as its cost model
+ * (RefreshScheduler::setCostModel).
+ */
+
+#ifndef EPD_BENCH_H
+#define EPD_BENCH_H
+
+#include "refresh_scheduler.h"
+#include "../utils/sd_manager.h"
+#include <M5Unified.h>
+
+namespace EpdBench {
+
+static const int MODE_COUNT = RefreshScheduler::CostModel::MODES;
+static const int SIZE_COUNT = RefreshScheduler::CostModel::SIZES;
+static const int REPS = 4; // Black, white, black, white: ends as it began
+static const int WAKE_REPS = 8;
+static const char *const COST_FILE = "/diag/epd_costs.csv";
+
+struct Size {
+  const char *name;
+  int16_t w;
+  int16_t h;
+};
+
+// Ascending area, all at the top left corner
+extern const Size SIZES[SIZE_COUNT];
+
+const char *modeName(epd_mode_t mode);
+
+struct Cell {
+  uint32_t displayUs;  // Mean display() call
+  uint32_t waitUs;     // Mean display() until waitDisplay() returns
+  uint32_t maxWaitUs;  // Slowest of the REPS
+  uint16_t sinceClean; // Partial updates since epd_quality, at the start
+};
+
+struct Results {
+  bool ok;
+  Cell cells[MODE_COUNT][SIZE_COUNT]; // RefreshScheduler::MODE_ORDER
+  uint32_t updates;                   // Panel updates in the run
+  uint32_t wakeUs;                    // Mean driver power-up
+  uint32_t maxWakeUs;
+};
+
+/**
+ * Run the matrix over the whole panel. Blocks for up to a minute and
+ * leaves the screen white; the caller redraws.
+ * @param progress Called before each cell with cells done and the total
+ */
+bool run(Results &results, void (*progress)(int done, int total) = nullptr);
+
+/**
+ * Write the results to COST_FILE, replacing the last run
+ */
+bool save(SDManager *sd, const Results &results);
+
+/**
+ * Read COST_FILE into a cost model (no SD access taken: boot storage task)
+ * @return false if the file is missing or incomplete
+ */
+bool loadCostModel(RefreshScheduler::CostModel &model);
+
+/**
+ * A run's results as a cost model
+ */
+void toCostModel(const Results &results, RefreshScheduler::CostModel &model);
+
+} // namespace EpdBench
+
+#endif // EPD_BENCH_H
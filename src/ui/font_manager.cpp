@@ -0,0 +1,324 @@
+/**
+ * Font Manager Implementation
+ *
+ * File layout (little-endian):
+ *   FontFileHeader
+ *   PageEntry[pages], by page number
+ *   Page blocks: Glyph[PAGE_GLYPHS], then the bitmaps. A bitmap is height
+ *   rows of width pixels, 4 bits each (high nibble first, 15 = ink), each
+ *   row padded to a whole byte.
+ */
+
+#include "font_manager.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include <algorithm>
+#include <esp_heap_caps.h>
+
+extern SDManager *sdManager;
+
+#define FONT_MAGIC 0x31544E46 // "FNT1"
+#define FONT_VERSION 1
+
+struct FontFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t bpp;      // 4
+  uint8_t pageBits; // FontManager::PAGE_BITS
+  int16_t lineHeight;
+  int16_t ascent; // Baseline from the top of the line
+  uint16_t pages;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(FontFileHeader) == 16, "font file header layout");
+static_assert(sizeof(SdFont::Glyph) == 12, "font file glyph layout");
+
+static const size_t GLYPH_TABLE =
+    FontManager::PAGE_GLYPHS * sizeof(SdFont::Glyph);
+
+// ============================================================================
+// SdFont
+// ============================================================================
+
+bool SdFont::open(const char *family, int size) {
+  strlcpy(_family, family, sizeof(_family));
+  _size = size;
+  snprintf(_path, sizeof(_path), "/fonts/%s-%d.fnt", family, size);
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  File file = sdFS().open(_path, FILE_READ);
+  if (!file)
+    return false;
+
+  FontFileHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == FONT_MAGIC && header.version == FONT_VERSION &&
+            header.bpp == 4 && header.pageBits == FontManager::PAGE_BITS &&
+            header.lineHeight > 0 && header.pages > 0 &&
+            header.pages <= 0x10000 >> FontManager::PAGE_BITS;
+  if (ok) {
+    _pages.resize(header.pages);
+    size_t bytes = header.pages * sizeof(PageEntry);
+    ok = file.read((uint8_t *)_pages.data(), bytes) == bytes;
+  }
+  size_t fileSize = file.size();
+  file.close();
+
+  // Pages in order, each inside the file and big enough for its glyphs
+  for (size_t i = 0; ok && i < _pages.size(); i++) {
+    const PageEntry &p = _pages[i];
+    ok = (i == 0 || p.page > _pages[i - 1].page) && p.size >= GLYPH_TABLE &&
+         p.offset <= fileSize && p.size <= fileSize - p.offset;
+  }
+  if (!ok) {
+    LOG_W("Font", "%s is not a usable font file", _path);
+    std::vector<PageEntry>().swap(_pages);
+    return false;
+  }
+  _lineHeight = header.lineHeight;
+  _ascent = header.ascent;
+  LOG_I("Font", "%s: %u pages, line %d px", _path, (unsigned)_pages.size(),
+        _lineHeight);
+  return true;
+}
+
+const SdFont::PageEntry *SdFont::entry(uint16_t page) const {
+  auto it = std::lower_bound(
+      _pages.begin(), _pages.end(), page,
+      [](const PageEntry &e, uint16_t page) { return e.page < page; });
+  return it != _pages.end() && it->page == page ? &*it : nullptr;
+}
+
+void SdFont::prepare(uint16_t c) const {
+  FontManager &fonts = FontManager::instance();
+  fonts.load(*this, c >> FontManager::PAGE_BITS);
+  fonts.load(*this, '?' >> FontManager::PAGE_BITS); // Stands in for the rest
+}
+
+const SdFont::Glyph *SdFont::glyph(uint16_t c, const uint8_t **bitmap) const {
+  const uint8_t *data =
+      FontManager::instance().cached(*this, c >> FontManager::PAGE_BITS);
+  const Glyph *g =
+      data ? (const Glyph *)data + (c & (FontManager::PAGE_GLYPHS - 1))
+           : nullptr;
+  if (!g || !g->advance)
+    return c == '?' ? nullptr : glyph('?', bitmap);
+  *bitmap = data + GLYPH_TABLE + g->offset;
+  return g;
+}
+
+void SdFont::getDefaultMetric(lgfx::FontMetrics *metrics) const {
+  metrics->width = metrics->x_advance = _lineHeight / 4;
+  metrics->x_offset = 0;
+  metrics->y_offset = 0;
+  metrics->height = metrics->y_advance = _lineHeight;
+  metrics->baseline = _ascent;
+}
+
+bool SdFont::updateFontMetric(lgfx::FontMetrics *metrics,
+                              uint16_t uniCode) const {
+  prepare(uniCode);
+  FontManager::Lock lock;
+  const uint8_t *bitmap;
+  const Glyph *g = glyph(uniCode, &bitmap);
+  if (!g) {
+    metrics->width = metrics->x_advance = _lineHeight / 4;
+    metrics->x_offset = 0;
+    return false;
+  }
+  metrics->width = g->width;
+  metrics->x_advance = g->advance;
+  metrics->x_offset = g->left;
+  return true;
+}
+
+size_t SdFont::drawChar(lgfx::LGFXBase *gfx, int32_t x, int32_t y,
+                        uint16_t c, const lgfx::TextStyle *style,
+                        lgfx::FontMetrics *metrics, int32_t &filled_x) const {
+  int32_t sx = 65536 * style->size_x;
+  int32_t sy = 65536 * style->size_y;
+  y += (metrics->y_offset * sy) >> 16;
+
+  // The page is read before the lock: the card is never touched under it
+  prepare(c);
+  FontManager::Lock lock;
+  const uint8_t *bitmap;
+  const Glyph *g = glyph(c, &bitmap);
+  if (!g)
+    return drawCharDummy(gfx, x, y, _lineHeight / 4, metrics->height, style,
+                         filled_x);
+
+  int32_t advance = (g->advance * sx) >> 16;
+  int32_t left = (g->left * sx) >> 16;
+  bool fillbg = style->back_rgb888 != style->fore_rgb888;
+  uint32_t back = fillbg ? style->back_rgb888 : 0xFFFFFF; // Paper
+
+  // The 15 inked shades, blended from the background to the foreground
+  uint32_t shades[16];
+  for (int v = 1; v < 16; v++) {
+    uint32_t rgb = 0;
+    for (int shift = 0; shift <= 16; shift += 8) {
+      int f = (style->fore_rgb888 >> shift) & 0xFF;
+      int b = (back >> shift) & 0xFF;
+      rgb |= (uint32_t)((f * v + b * (15 - v)) / 15) << shift;
+    }
+    shades[v] = rgb;
+  }
+
+  gfx->startWrite();
+  if (fillbg) {
+    int32_t from = std::max(filled_x, x + std::min<int32_t>(left, 0));
+    int32_t to = x + std::max(left + ((g->width * sx) >> 16), advance);
+    if (from < to) {
+      gfx->setColor(back);
+      gfx->writeFillRect(from, y, to - from, (metrics->height * sy) >> 16);
+    }
+    filled_x = to;
+  }
+
+  // Runs of one shade along each row
+  size_t stride = (g->width + 1) / 2;
+  for (int row = 0; row < g->height; row++) {
+    int32_t y0 = y + (((g->top + row) * sy) >> 16);
+    int32_t y1 = y + (((g->top + row + 1) * sy) >> 16);
+    const uint8_t *p = bitmap + row * stride;
+    int col = 0;
+    while (col < g->width) {
+      uint8_t v = col & 1 ? p[col / 2] & 0x0F : p[col / 2] >> 4;
+      int end = col + 1;
+      while (end < g->width &&
+             (end & 1 ? p[end / 2] & 0x0F : p[end / 2] >> 4) == v)
+        end++;
+      if (v) {
+        int32_t x0 = x + left + ((col * sx) >> 16);
+        int32_t x1 = x + left + ((end * sx) >> 16);
+        gfx->setColor(shades[v]);
+        gfx->writeFillRect(x0, y0, x1 - x0, y1 - y0);
+      }
+      col = end;
+    }
+  }
+  gfx->endWrite();
+  return advance;
+}
+
+// ============================================================================
+// FontManager
+// ============================================================================
+
+FontManager &FontManager::instance() {
+  static FontManager manager;
+  return manager;
+}
+
+FontManager::FontManager()
+    : _lock(xSemaphoreCreateRecursiveMutex()), _bytes(0), _clock(0) {}
+
+const SdFont *FontManager::get(const char *family, int px) {
+  if (!sdManager || !sdManager->isAvailable())
+    return nullptr;
+  uint32_t generation = sdManager->getCardGeneration();
+  Lock lock;
+  Known *known = nullptr;
+  for (Known &k : _fonts) {
+    if (k.size == px && strcmp(k.family, family) == 0) {
+      known = &k;
+      break;
+    }
+  }
+  if (known && (known->font || known->generation == generation))
+    return known->font; // A miss is looked for again on another card
+
+  if (!known) {
+    if (_fonts.size() >= MAX_FONTS)
+      return nullptr;
+    _fonts.push_back({});
+    known = &_fonts.back();
+    strlcpy(known->family, family, sizeof(known->family));
+    known->size = px;
+  }
+  known->generation = generation;
+  SdFont *font = new SdFont();
+  if (font->open(family, px)) {
+    known->font = font;
+  } else {
+    delete font;
+    known->font = nullptr;
+  }
+  return known->font;
+}
+
+const uint8_t *FontManager::cached(const SdFont &font, uint16_t number) {
+  for (Page &p : _pages) {
+    if (p.font == &font && p.number == number) {
+      p.used = ++_clock;
+      return p.data;
+    }
+  }
+  return nullptr;
+}
+
+void FontManager::evict(size_t need) {
+  while (!_pages.empty() && _bytes + need > CACHE_BYTES) {
+    auto oldest = std::min_element(
+        _pages.begin(), _pages.end(),
+        [](const Page &a, const Page &b) { return a.used < b.used; });
+    _bytes -= oldest->size;
+    free(oldest->data);
+    _pages.erase(oldest);
+  }
+}
+
+bool FontManager::load(const SdFont &font, uint16_t number) {
+  {
+    Lock lock;
+    if (cached(font, number))
+      return true;
+  }
+  const SdFont::PageEntry *entry = font.entry(number);
+  if (!entry)
+    return false; // Not in the font
+
+  uint8_t *data = (uint8_t *)heap_caps_malloc(entry->size, MALLOC_CAP_SPIRAM);
+  if (!data)
+    return false;
+  bool ok;
+  {
+    // Without the cache lock: a draw on the other task goes on meanwhile
+    SDAccess sd(sdManager);
+    File file = sd ? sdFS().open(font._path, FILE_READ) : File();
+    ok = file && file.seek(entry->offset) &&
+         file.read(data, entry->size) == entry->size;
+    if (file)
+      file.close();
+    if (!ok && sd)
+      sd.fail();
+  }
+
+  // Every bitmap inside the page
+  const SdFont::Glyph *glyphs = (const SdFont::Glyph *)data;
+  for (int i = 0; ok && i < PAGE_GLYPHS; i++) {
+    const SdFont::Glyph &g = glyphs[i];
+    ok = !g.advance || GLYPH_TABLE + g.offset +
+                               (size_t)(g.width + 1) / 2 * g.height <=
+                           entry->size;
+  }
+  if (!ok) {
+    LOG_W("Font", "%s: page %u unreadable", font._path, number);
+    free(data);
+    return false;
+  }
+
+  Lock lock;
+  if (cached(font, number)) {
+    free(data); // The other task read it too
+    return true;
+  }
+  evict(entry->size);
+  _pages.push_back({&font, number, ++_clock, entry->size, data});
+  _bytes += entry->size;
+  return true;
+}
@@ -0,0 +1,145 @@
+/**
+ * Font Manager
+ *
+ * Proportional, anti-aliased fonts from /fonts on the card. A font file
+ * (<family>-<px>.fnt, made by tools/make_font.py; px is its line height)
+ * holds 4-bit glyph bitmaps in pages of 128 code points. Opening a font
+ * reads only its header and page table. A page is read whole the first
+ * time one of its characters is measured or drawn, into a glyph cache in
+ * PSRAM shared by every font, and the least recently used pages make room
+ * once the cache is full. Latin text needs a page or two per font.
+ *
+ * SdFont is an lgfx::IFont, so setFont() takes it like a built-in font
+ * and drawString()/textWidth() decode UTF-8 as usual. Characters a font
+ * lacks show as '?'. Without a background colour, text is blended into
+ * white paper.
+ *
+ * Glyphs are measured and drawn from the loop task and the reader's render
+ * task. A glyph is looked up and drawn under the cache lock; the page is
+ * read from the card before taking it, so a task holding the card never
+ * waits on a draw that is waiting for the card.
+ */
+
+#ifndef FONT_MANAGER_H
+#define FONT_MANAGER_H
+
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+
+class SdFont : public lgfx::IFont {
+public:
+  struct Glyph {
+    uint32_t offset; // Bitmap, from the start of its page
+    uint8_t width, height;
+    int8_t left;     // Bitmap from the pen position
+    int8_t top;      // Bitmap from the top of the line
+    uint8_t advance; // 0: no glyph
+    uint8_t reserved[3];
+  };
+
+  int lineHeight() const { return _lineHeight; }
+  int size() const { return _size; }
+  const char *family() const { return _family; }
+
+  // lgfx::IFont
+  void getDefaultMetric(lgfx::FontMetrics *metrics) const override;
+  bool updateFontMetric(lgfx::FontMetrics *metrics,
+                        uint16_t uniCode) const override;
+  size_t drawChar(lgfx::LGFXBase *gfx, int32_t x, int32_t y, uint16_t c,
+                  const lgfx::TextStyle *style, lgfx::FontMetrics *metrics,
+                  int32_t &filled_x) const override;
+
+private:
+  friend class FontManager;
+
+  struct PageEntry {
+    uint16_t page; // Code point >> PAGE_BITS
+    uint16_t reserved;
+    uint32_t offset; // In the file
+    uint32_t size;
+  };
+
+  char _family[16];
+  char _path[40];
+  int _size;
+  int16_t _lineHeight;
+  int16_t _ascent;
+  std::vector<PageEntry> _pages; // By page number
+
+  SdFont() : _size(0), _lineHeight(0), _ascent(0) {}
+  bool open(const char *family, int size);
+  const PageEntry *entry(uint16_t page) const;
+
+  // Without the cache lock: load the pages of c and of '?'
+  void prepare(uint16_t c) const;
+
+  // With the cache lock held: the glyph of c (or of '?'), and its bitmap
+  // while the lock stays held
+  const Glyph *glyph(uint16_t c, const uint8_t **bitmap) const;
+};
+
+class FontManager {
+public:
+  static const int PAGE_BITS = 7; // 128 code points a page
+  static const int PAGE_GLYPHS = 1 << PAGE_BITS;
+  static const size_t CACHE_BYTES = 384 * 1024;
+  static const int MAX_FONTS = 12;
+
+  static FontManager &instance();
+
+  /**
+   * The font /fonts/<family>-<px>.fnt, opened on first use
+   * @return nullptr if the card has no such font
+   */
+  const SdFont *get(const char *family, int px);
+
+  size_t cachedBytes() const { return _bytes; }
+
+  /**
+   * Holds the cache: pages stay put while it lives
+   */
+  class Lock {
+  public:
+    Lock() { xSemaphoreTakeRecursive(instance()._lock, portMAX_DELAY); }
+    ~Lock() { xSemaphoreGiveRecursive(instance()._lock); }
+    Lock(const Lock &) = delete;
+    Lock &operator=(const Lock &) = delete;
+  };
+
+private:
+  struct Page {
+    const SdFont *font;
+    uint16_t number;
+    uint32_t used; // _clock at the last lookup
+    size_t size;
+    uint8_t *data; // PAGE_GLYPHS glyphs, then their bitmaps
+  };
+
+  struct Known {
+    char family[16];
+    int size;
+    SdFont *font;        // nullptr: not on the card
+    uint32_t generation; // Card the miss was seen on (getCardGeneration)
+  };
+
+  SemaphoreHandle_t _lock;
+  std::vector<Known> _fonts;
+  std::vector<Page> _pages;
+  size_t _bytes;
+  uint32_t _clock;
+
+  FontManager();
+  friend class SdFont;
+
+  // With the lock held: a cached page, marked as just used, or nullptr
+  const uint8_t *cached(const SdFont &font, uint16_t number);
+
+  // Without the lock: read a page into the cache unless it is there
+  bool load(const SdFont &font, uint16_t number);
+  void evict(size_t need);
+};
+
+#endif // FONT_MANAGER_H
@@ -0,0 +1,224 @@
+/**
+ * Off-Screen Frame Buffer Implementation
+ */
+
+#include "frame_buffer.h"
+#include "raster4.h"
+#include "../utils/mem_telemetry.h"
+#include <lgfx/v1/panel/Panel_HasBuffer.hpp>
+
+// M5GFX's EPD panel refreshes, on display(), the bounding box of all that
+// was written to its copy since the last refresh. The box is protected;
+// forgetting it writes pixels into the copy without refreshing them.
+struct PanelDirtyRange : lgfx::Panel_HasBuffer {
+  static void forget(lgfx::Panel_Device *panel) {
+    lgfx::range_rect_t &range = static_cast<lgfx::Panel_HasBuffer *>(panel)->*
+                                &PanelDirtyRange::_range_mod;
+    range.top = INT16_MAX;
+    range.left = INT16_MAX;
+    range.right = 0;
+    range.bottom = 0;
+  }
+};
+
+FrameBuffer::FrameBuffer()
+    : _display(nullptr), _back(nullptr), _front(nullptr), _width(0),
+      _height(0), _stride(0), _frontValid(false), _lastChangedTiles(0) {}
+
+FrameBuffer::~FrameBuffer() {
+  delete _back;
+  delete _front;
+}
+
+bool FrameBuffer::begin(LovyanGFX *display, int width, int height) {
+  _display = display;
+  _width = width;
+  _height = height;
+
+  _back = new M5Canvas(display);
+  _front = new M5Canvas(display);
+  _back->setColorDepth(4);
+  _front->setColorDepth(4);
+  _back->setPsram(true);
+  _front->setPsram(true);
+
+  if (!_back->createSprite(width, height) ||
+      !_front->createSprite(width, height)) {
+    Serial.println("UI: Frame buffer allocation failed, drawing direct");
+    delete _back;
+    delete _front;
+    _back = nullptr;
+    _front = nullptr;
+    return false;
+  }
+
+  _stride = _back->bufferLength() / height;
+  Raster4::clear(*_back);
+  Raster4::clear(*_front);
+  _frontValid = false;
+
+  MemTelemetry::track(MemTelemetry::Tag::UI, 2 * _back->bufferLength());
+  Serial.printf("UI: Frame buffers in PSRAM (2 x %u bytes)\n",
+                (unsigned)_back->bufferLength());
+  return true;
+}
+
+LovyanGFX &FrameBuffer::target() {
+  if (_back)
+    return *_back;
+  return *_display;
+}
+
+void FrameBuffer::adoptFront(const M5Canvas &shown) {
+  if (!_front || shown.width() != _width || shown.height() != _height ||
+      shown.getColorDepth() != _front->getColorDepth()) {
+    _frontValid = false;
+    return;
+  }
+  memcpy(_front->getBuffer(), shown.getBuffer(), _front->bufferLength());
+  _frontValid = true;
+}
+
+bool FrameBuffer::tileChanged(const uint8_t *back, const uint8_t *front,
+                              int tx, int ty, int tw, int th) const {
+  // 2 pixels per byte; tiles start on even x so nibbles never straddle
+  int offset = tx / 2;
+  int bytes = (tw + 1) / 2;
+  for (int y = ty; y < ty + th; y++) {
+    if (Raster4::differs(back + y * _stride + offset,
+                         front + y * _stride + offset, bytes))
+      return true;
+  }
+  return false;
+}
+
+void FrameBuffer::copyToFront(const DamageRect &r) {
+  const uint8_t *back = (const uint8_t *)_back->getBuffer();
+  uint8_t *front = (uint8_t *)_front->getBuffer();
+  int offset = r.x0 / 2;
+  int bytes = (r.x1 - r.x0 + 2) / 2;
+  for (int y = r.y0; y <= r.y1; y++)
+    memcpy(front + y * _stride + offset, back + y * _stride + offset, bytes);
+}
+
+int FrameBuffer::present() {
+  if (!_back)
+    return 0;
+
+  const uint8_t *back = (const uint8_t *)_back->getBuffer();
+  const uint8_t *front = (const uint8_t *)_front->getBuffer();
+  DamageTracker damage;
+  int changed = 0;
+
+  if (!_frontValid) {
+    damage.add(0, 0, _width - 1, _height - 1);
+    changed = ((_width + TILE_W - 1) / TILE_W) *
+              ((_height + TILE_H - 1) / TILE_H);
+  } else {
+    for (int ty = 0; ty < _height; ty += TILE_H) {
+      int th = _height - ty < TILE_H ? _height - ty : TILE_H;
+      for (int tx = 0; tx < _width; tx += TILE_W) {
+        int tw = _width - tx < TILE_W ? _width - tx : TILE_W;
+        if (tileChanged(back, front, tx, ty, tw, th)) {
+          damage.add(tx, ty, tx + tw - 1, ty + th - 1);
+          changed++;
+        }
+      }
+    }
+  }
+
+  _lastChangedTiles = changed;
+  if (changed == 0)
+    return 0;
+
+  _display->startWrite();
+  for (int i = 0; i < damage.count(); i++) {
+    const DamageRect &r = damage.rect(i);
+    _display->setClipRect(r.x0, r.y0, r.x1 - r.x0 + 1, r.y1 - r.y0 + 1);
+    _back->pushSprite(_display, 0, 0);
+    _display->clearClipRect();
+    copyToFront(r);
+  }
+  _display->endWrite();
+
+  _frontValid = true;
+  return damage.count();
+}
+
+int FrameBuffer::tileCount() const {
+  return ((_width + TILE_W - 1) / TILE_W) * ((_height + TILE_H - 1) / TILE_H);
+}
+
+uint32_t FrameBuffer::tileHash(const uint8_t *pixels, int tx, int ty) const {
+  // FNV-1a over the tile's packed rows
+  int tw = _width - tx < TILE_W ? _width - tx : TILE_W;
+  int th = _height - ty < TILE_H ? _height - ty : TILE_H;
+  int offset = tx / 2;
+  int bytes = (tw + 1) / 2;
+  uint32_t hash = 2166136261u;
+  for (int y = ty; y < ty + th; y++) {
+    const uint8_t *row = pixels + y * _stride + offset;
+    for (int i = 0; i < bytes; i++)
+      hash = (hash ^ row[i]) * 16777619u;
+  }
+  return hash != NO_TILE ? hash : 1;
+}
+
+bool FrameBuffer::hashFront(uint32_t hashes[MAX_TILES]) const {
+  if (!_front || !_frontValid || tileCount() > MAX_TILES)
+    return false;
+  const uint8_t *front = (const uint8_t *)_front->getBuffer();
+  int i = 0;
+  for (int ty = 0; ty < _height; ty += TILE_H) {
+    for (int tx = 0; tx < _width; tx += TILE_W)
+      hashes[i++] = tileHash(front, tx, ty);
+  }
+  return true;
+}
+
+int FrameBuffer::presentRetained(const uint32_t shown[MAX_TILES]) {
+  // Only the EPD panel's copy can be written without a refresh
+  if (!_back || _display != &M5.Display || tileCount() > MAX_TILES ||
+      M5.getBoard() != m5::board_t::board_M5PaperS3) {
+    present();
+    M5.Display.display();
+    return _lastChangedTiles;
+  }
+
+  const uint8_t *back = (const uint8_t *)_back->getBuffer();
+  DamageTracker damage;
+  int changed = 0;
+  int i = 0;
+  for (int ty = 0; ty < _height; ty += TILE_H) {
+    int th = _height - ty < TILE_H ? _height - ty : TILE_H;
+    for (int tx = 0; tx < _width; tx += TILE_W, i++) {
+      int tw = _width - tx < TILE_W ? _width - tx : TILE_W;
+      if (tileHash(back, tx, ty) != shown[i]) {
+        damage.add(tx, ty, tx + tw - 1, ty + th - 1);
+        changed++;
+      }
+    }
+  }
+
+  // The whole frame into the copy, as the panel already shows it
+  bool autoDisplay = M5.Display.getPanel()->getAutoDisplay();
+  M5.Display.setAutoDisplay(false);
+  _back->pushSprite(_display, 0, 0);
+  PanelDirtyRange::forget(M5.Display.getPanel());
+
+  // Then each changed area again, refreshed by itself: one box around
+  // them all would drive every pixel in between
+  for (int r = 0; r < damage.count(); r++) {
+    const DamageRect &d = damage.rect(r);
+    _display->setClipRect(d.x0, d.y0, d.width(), d.height());
+    _back->pushSprite(_display, 0, 0);
+    _display->clearClipRect();
+    M5.Display.display();
+  }
+  M5.Display.setAutoDisplay(autoDisplay);
+
+  memcpy(_front->getBuffer(), back, _front->bufferLength());
+  _frontValid = true;
+  _lastChangedTiles = changed;
+  return changed;
+}
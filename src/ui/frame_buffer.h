@@ -0,0 +1,104 @@
+/**
+ * Off-Screen Frame Buffer
+ *
+ * Two 4-bit grayscale canvases in PSRAM: the back buffer screens draw into,
+ * and the front buffer holding what was last pushed to the panel.
+ * present() compares them tile by tile (Raster4::differs()), pushes
+ * only the tiles that changed (merged through a DamageTracker), and copies
+ * those tiles to the front buffer. M5GFX then refreshes just that area of
+ * the EPD instead of the whole 960x540 frame.
+ *
+ * If PSRAM allocation fails, target() falls back to the display itself and
+ * present() does nothing, so callers never need a second code path.
+ *
+ * The panel keeps its image through deep sleep, but M5GFX's copy of it
+ * starts out white at boot. hashFront() records the frame before sleep,
+ * one hash per tile, small enough for RTC memory; presentRetained() fills
+ * M5GFX's copy with the new frame after the wake and refreshes only the
+ * tiles whose hash differs.
+ */
+
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include "damage_tracker.h"
+#include <M5Unified.h>
+
+class FrameBuffer {
+public:
+  // 64 px = 32 bytes = 8 words per tile row at 4 bpp; 15x18 tiles
+  static const int TILE_W = 64;
+  static const int TILE_H = 30;
+  static const int MAX_TILES = 270; // Of a 960x540 frame
+  static const uint32_t NO_TILE = 0; // Matches no tile's hash
+
+  FrameBuffer();
+  ~FrameBuffer();
+
+  /**
+   * Allocate both canvases in PSRAM
+   * @return false if allocation failed (drawing goes direct to display)
+   */
+  bool begin(LovyanGFX *display, int width, int height);
+  bool isReady() const { return _back != nullptr; }
+
+  /**
+   * Surface to draw the next frame into
+   */
+  LovyanGFX &target();
+
+  /**
+   * The panel was changed outside this buffer (another screen drew on it);
+   * the next present() pushes the whole frame
+   */
+  void invalidate() { _frontValid = false; }
+
+  /**
+   * The panel now shows shown (a cached screen pushed back whole); it
+   * becomes the front buffer so the next present() diffs against it
+   */
+  void adoptFront(const M5Canvas &shown);
+
+  /**
+   * Push changed tiles of the back buffer to the display.
+   * Caller still calls display() to start the EPD update.
+   * @return number of regions pushed
+   */
+  int present();
+
+  int getLastChangedTiles() const { return _lastChangedTiles; }
+
+  bool isFrontValid() const { return _frontValid; }
+
+  /**
+   * Hash each tile of the front buffer (what the panel shows), by rows
+   * @return false if the front buffer does not match the panel
+   */
+  bool hashFront(uint32_t hashes[MAX_TILES]) const;
+
+  /**
+   * The panel still shows the frame hashed into shown (a deep-sleep wake):
+   * write the back buffer into M5GFX's copy of the panel and refresh only
+   * the tiles that differ, each area on its own. Starts the EPD updates.
+   * @return number of changed tiles
+   */
+  int presentRetained(const uint32_t shown[MAX_TILES]);
+
+private:
+  LovyanGFX *_display;
+  M5Canvas *_back;
+  M5Canvas *_front;
+  int _width;
+  int _height;
+  int _stride; // Bytes per canvas row
+  bool _frontValid;
+  int _lastChangedTiles;
+
+  bool tileChanged(const uint8_t *back, const uint8_t *front, int tx, int ty,
+                   int tw, int th) const;
+  void copyToFront(const DamageRect &r);
+  uint32_t tileHash(const uint8_t *pixels, int tx, int ty) const;
+  int tileCount() const;
+};
+
+#endif // FRAME_BUFFER_H
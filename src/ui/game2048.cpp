@@ -0,0 +1,155 @@
+/**
+ * 2048 Rules Implementation
+ */
+
+#include "game2048.h"
+#include <esp_heap_caps.h>
+#include <stdlib.h>
+
+namespace Game2048 {
+
+static const uint32_t ROW_COUNT = 65536;
+
+// A row after sliding left; every merge scores a multiple of 4, and at
+// most two 16384 merges fit in a row, so score / 4 fits in 16 bits
+struct RowMove {
+  uint16_t row;
+  uint16_t quarterScore;
+};
+
+static RowMove *_rows = nullptr;
+
+static RowMove slideRowLeft(uint16_t row) {
+  int line[SIZE];
+  for (int i = 0; i < SIZE; i++)
+    line[i] = (row >> (4 * i)) & 0xF;
+
+  int result[SIZE] = {0, 0, 0, 0};
+  int pos = 0;
+  bool lastMerged = false; // A tile merges at most once per slide
+  uint32_t score = 0;
+  for (int i = 0; i < SIZE; i++) {
+    int e = line[i];
+    if (e == 0)
+      continue;
+    if (pos > 0 && result[pos - 1] == e && !lastMerged &&
+        e < MAX_EXPONENT) {
+      result[pos - 1]++;
+      score += 1u << result[pos - 1];
+      lastMerged = true;
+    } else {
+      result[pos++] = e;
+      lastMerged = false;
+    }
+  }
+
+  RowMove move = {0, (uint16_t)(score / 4)};
+  for (int i = 0; i < SIZE; i++)
+    move.row |= result[i] << (4 * i);
+  return move;
+}
+
+static inline RowMove rowLeft(uint16_t row) {
+  return _rows ? _rows[row] : slideRowLeft(row);
+}
+
+static inline uint16_t reverseRow(uint16_t row) {
+  return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) |
+         (row << 12);
+}
+
+Board transpose(Board b) {
+  Board a1 = b & 0xF0F00F0FF0F00F0FULL;
+  Board a2 = b & 0x0000F0F00000F0F0ULL;
+  Board a3 = b & 0x0F0F00000F0F0000ULL;
+  Board a = a1 | (a2 << 12) | (a3 >> 12);
+  Board b1 = a & 0xFF00FF0000FF00FFULL;
+  Board b2 = a & 0x00FF00FF00000000ULL;
+  Board b3 = a & 0x00000000FF00FF00ULL;
+  return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+void setTile(Board &board, int r, int c, int value) {
+  int e = 0;
+  while (e < MAX_EXPONENT && (1 << (e + 1)) <= value)
+    e++;
+  int shift = 16 * r + 4 * c;
+  board = (board & ~((Board)0xF << shift)) | ((Board)e << shift);
+}
+
+int emptyCount(Board board) {
+  // Fold each cell onto its low bit: set when the cell holds a tile
+  board |= board >> 2;
+  board |= board >> 1;
+  board &= 0x1111111111111111ULL;
+  return SIZE * SIZE - __builtin_popcountll(board);
+}
+
+int maxTile(Board board) {
+  int best = 0;
+  for (; board; board >>= 4) {
+    if ((int)(board & 0xF) > best)
+      best = board & 0xF;
+  }
+  return best ? 1 << best : 0;
+}
+
+bool prepare() {
+  if (_rows)
+    return true;
+  _rows = (RowMove *)heap_caps_malloc(ROW_COUNT * sizeof(RowMove),
+                                      MALLOC_CAP_SPIRAM);
+  if (!_rows)
+    return false;
+  for (uint32_t row = 0; row < ROW_COUNT; row++)
+    _rows[row] = slideRowLeft(row);
+  return true;
+}
+
+bool prepared() { return _rows != nullptr; }
+
+void release() {
+  free(_rows);
+  _rows = nullptr;
+}
+
+bool slide(Board &board, int direction, int &score) {
+  bool vertical = direction == UP || direction == DOWN;
+  bool reversed = direction == RIGHT || direction == DOWN;
+
+  // Up and down are left and right on the transposed board
+  Board from = vertical ? transpose(board) : board;
+  Board to = 0;
+  uint32_t quarters = 0;
+  for (int r = 0; r < SIZE; r++) {
+    uint16_t row = from >> (16 * r);
+    RowMove move = rowLeft(reversed ? reverseRow(row) : row);
+    to |= (Board)(reversed ? reverseRow(move.row) : move.row) << (16 * r);
+    quarters += move.quarterScore;
+  }
+  if (vertical)
+    to = transpose(to);
+
+  if (to == board)
+    return false;
+  board = to;
+  score += quarters * 4;
+  return true;
+}
+
+bool isOver(Board board) {
+  if (emptyCount(board))
+    return false;
+
+  // Full rows change on a slide only if two neighbours can merge
+  Board columns = transpose(board);
+  for (int r = 0; r < SIZE; r++) {
+    uint16_t row = board >> (16 * r);
+    uint16_t column = columns >> (16 * r);
+    if (rowLeft(row).row != row || rowLeft(column).row != column)
+      return false;
+  }
+  return true;
+}
+
+} // namespace Game2048
@@ -0,0 +1,88 @@
+/**
+ * 2048 Rules
+ *
+ * The board logic of the 2048 game, kept apart from UIManager: slides
+ * with their merges and score, and the game-over test. Drawing, touch,
+ * spawning and saving stay in the UI.
+ *
+ * The board is a 64-bit bitboard of 4-bit cells, each holding the log2 of
+ * its tile (0 = empty, so 32768 is the largest tile). A slide looks every
+ * row up in a 65,536-entry table of row-after-sliding-left and its score;
+ * right slides reverse the row around the lookup and vertical ones
+ * transpose the board first. prepare() builds the table (256 KB of PSRAM)
+ * when the game opens; without it each row is worked out as it comes, so
+ * moves still work, only slower.
+ */
+
+#ifndef GAME_2048_H
+#define GAME_2048_H
+
+#include <stdint.h>
+
+namespace Game2048 {
+
+static const int SIZE = 4;
+static const int MAX_EXPONENT = 15; // 32768: two of them do not merge
+
+// Cell (r, c) is the 4 bits at 16 * r + 4 * c
+typedef uint64_t Board;
+
+enum Direction { UP, RIGHT, DOWN, LEFT };
+
+inline uint16_t row(Board board, int r) { return board >> (16 * r); }
+
+inline int exponent(Board board, int r, int c) {
+  return (board >> (16 * r + 4 * c)) & 0xF;
+}
+
+/**
+ * Tile value at (r, c): 0 when empty, else 2, 4, 8, ...
+ */
+inline int tile(Board board, int r, int c) {
+  int e = exponent(board, r, c);
+  return e ? 1 << e : 0;
+}
+
+/**
+ * Place a tile (0 empties the cell; other values round down to a power
+ * of two)
+ */
+void setTile(Board &board, int r, int c, int value);
+
+int emptyCount(Board board);
+
+/**
+ * Swap rows and columns: cell (r, c) moves to (c, r)
+ */
+Board transpose(Board board);
+
+int maxTile(Board board);
+
+/**
+ * Build the row table
+ * @return false if there was no memory for it
+ */
+bool prepare();
+bool prepared();
+
+/**
+ * Free the row table (when the game closes)
+ */
+void release();
+
+/**
+ * Slide every row or column towards direction, merging equal neighbours
+ * once each
+ * @param score Increased by the value of each merged tile
+ * @return true if any tile moved or merged
+ */
+bool slide(Board &board, int direction, int &score);
+
+/**
+ * No empty cell and no mergeable neighbours left
+ */
+bool isOver(Board board);
+
+} // namespace Game2048
+
+#endif // GAME_2048_H
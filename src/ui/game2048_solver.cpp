@@ -0,0 +1,288 @@
+/**
+ * 2048 Solver Implementation
+ */
+
+#include "game2048_solver.h"
+#include "../utils/log.h"
+#include "../utils/mem_telemetry.h"
+#include "../utils/wake.h"
+#include <esp_heap_caps.h>
+
+using Game2048::Board;
+
+static const uint32_t ROW_COUNT = 65536;
+static const uint32_t TABLE_SIZE = 1UL << Game2048Solver::TABLE_BITS;
+static const float MIN_PROBABILITY = 0.0001f;
+
+// Heuristic weights (per row and per column)
+static const float LOST_PENALTY = 200000.0f; // Keeps every score positive
+static const float EMPTY_WEIGHT = 270.0f;
+static const float MERGE_WEIGHT = 700.0f;
+static const float MONOTONIC_POWER = 4.0f;
+static const float MONOTONIC_WEIGHT = 47.0f;
+static const float SUM_POWER = 3.5f;
+static const float SUM_WEIGHT = 11.0f;
+
+static float rowHeuristic(uint16_t row, const float *sumPow,
+                          const float *monoPow) {
+  int line[Game2048::SIZE];
+  for (int i = 0; i < Game2048::SIZE; i++)
+    line[i] = (row >> (4 * i)) & 0xF;
+
+  float sum = 0;
+  int empty = 0;
+  int merges = 0;
+  int previous = 0;
+  int run = 0; // Equal tiles in a row so far, beyond the first
+  for (int i = 0; i < Game2048::SIZE; i++) {
+    int rank = line[i];
+    sum += sumPow[rank];
+    if (rank == 0) {
+      empty++;
+      continue;
+    }
+    if (previous == rank) {
+      run++;
+    } else if (run > 0) {
+      merges += 1 + run;
+      run = 0;
+    }
+    previous = rank;
+  }
+  if (run > 0)
+    merges += 1 + run;
+
+  // Penalise the smaller of the two directions the row fails to sort in
+  float left = 0, right = 0;
+  for (int i = 1; i < Game2048::SIZE; i++) {
+    if (line[i - 1] > line[i])
+      left += monoPow[line[i - 1]] - monoPow[line[i]];
+    else
+      right += monoPow[line[i]] - monoPow[line[i - 1]];
+  }
+
+  return LOST_PENALTY + EMPTY_WEIGHT * empty + MERGE_WEIGHT * merges -
+         MONOTONIC_WEIGHT * (left < right ? left : right) - SUM_WEIGHT * sum;
+}
+
+// Fibonacci hashing of the whole board
+static inline uint32_t slotFor(Board board) {
+  return (uint32_t)((board * 0x9E3779B97F4A7C15ULL) >>
+                    (64 - Game2048Solver::TABLE_BITS));
+}
+
+Game2048Solver::Game2048Solver()
+    : _requests(nullptr), _results(nullptr), _task(nullptr), _busy(false),
+      _generation(0), _pollGeneration(0), _table(nullptr),
+      _heuristic(nullptr), _searchGeneration(0), _deadline(0), _nodes(0),
+      _aborted(false) {}
+
+bool Game2048Solver::begin() {
+  if (_task)
+    return true;
+  _requests = xQueueCreate(1, sizeof(Request));
+  _results = xQueueCreate(1, sizeof(Result));
+  if (!_requests || !_results) {
+    LOG_E("2048", "Solver queue allocation failed");
+    return false;
+  }
+
+  // Core 0 at the storage worker's priority, below touch and BLE
+  if (xTaskCreatePinnedToCore(taskEntry, "solver", TASK_STACK, this, 1,
+                              &_task, 0) != pdPASS) {
+    LOG_E("2048", "Solver task failed to start");
+    _task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool Game2048Solver::request(Board board, uint32_t budgetMs) {
+  if (!_task || _busy)
+    return false;
+  Result stale;
+  xQueueReceive(_results, &stale, 0);
+
+  Request r = {board, budgetMs, ++_generation};
+  _pollGeneration = r.generation;
+  _busy = true;
+  if (xQueueSend(_requests, &r, 0) != pdTRUE) {
+    _busy = false;
+    return false;
+  }
+  return true;
+}
+
+bool Game2048Solver::poll(Result &out) {
+  if (!_results || xQueueReceive(_results, &out, 0) != pdTRUE)
+    return false;
+  // A cancelled search still reports; its generation has moved on
+  return _pollGeneration == _generation;
+}
+
+void Game2048Solver::stop() {
+  cancel();
+  while (_busy)
+    vTaskDelay(1); // The search checks for cancellation every few nodes
+  if (_results)
+    xQueueReset(_results);
+
+  if (_table) {
+    heap_caps_free(_table);
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)(TABLE_SIZE * sizeof(Entry)));
+    _table = nullptr;
+  }
+  if (_heuristic) {
+    heap_caps_free(_heuristic);
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)(ROW_COUNT * sizeof(float)));
+    _heuristic = nullptr;
+  }
+}
+
+void Game2048Solver::taskEntry(void *arg) {
+  Game2048Solver *self = static_cast<Game2048Solver *>(arg);
+  Request request;
+  for (;;) {
+    if (xQueueReceive(self->_requests, &request, portMAX_DELAY) != pdTRUE)
+      continue;
+    Result result;
+    self->search(request, result);
+    xQueueOverwrite(self->_results, &result);
+    self->_busy = false;
+    Wake::signal(Wake::COMPUTE);
+  }
+}
+
+bool Game2048Solver::allocate() {
+  if (!_heuristic) {
+    _heuristic = (float *)heap_caps_malloc(ROW_COUNT * sizeof(float),
+                                           MALLOC_CAP_SPIRAM);
+    if (!_heuristic)
+      return false;
+    MemTelemetry::track(MemTelemetry::Tag::UI, ROW_COUNT * sizeof(float));
+    float sumPow[16], monoPow[16];
+    for (int rank = 0; rank < 16; rank++) {
+      sumPow[rank] = powf(rank, SUM_POWER);
+      monoPow[rank] = powf(rank, MONOTONIC_POWER);
+    }
+    for (uint32_t row = 0; row < ROW_COUNT; row++)
+      _heuristic[row] = rowHeuristic(row, sumPow, monoPow);
+  }
+  if (!_table) {
+    _table = (Entry *)heap_caps_calloc(TABLE_SIZE, sizeof(Entry),
+                                       MALLOC_CAP_SPIRAM);
+    if (!_table)
+      return false;
+    MemTelemetry::track(MemTelemetry::Tag::UI, TABLE_SIZE * sizeof(Entry));
+  }
+  return true;
+}
+
+void Game2048Solver::search(const Request &request, Result &result) {
+  uint32_t start = millis();
+  result.board = request.board;
+  result.direction = -1;
+  result.depth = 0;
+  result.nodes = 0;
+  if (!allocate()) {
+    LOG_W("2048", "No memory for the solver tables");
+    result.elapsedMs = 0;
+    return;
+  }
+
+  _searchGeneration = request.generation;
+  _deadline = start + request.budgetMs;
+  _nodes = 0;
+  _aborted = false;
+
+  for (int depth = 1; depth <= MAX_DEPTH; depth++) {
+    int best = -1;
+    float bestValue = -1;
+    for (int dir = 0; dir < 4 && !_aborted; dir++) {
+      Board next = request.board;
+      int score = 0;
+      if (!Game2048::slide(next, dir, score))
+        continue;
+      float value = chanceNode(next, depth - 1, 1.0f);
+      if (value > bestValue) {
+        bestValue = value;
+        best = dir;
+      }
+    }
+    if (_aborted)
+      break; // An unfinished pass could favour whichever move went first
+    result.direction = best;
+    result.depth = depth;
+    if (best < 0)
+      break; // No move left
+  }
+
+  result.elapsedMs = millis() - start;
+  result.nodes = _nodes;
+  LOG_D("2048", "Solver: dir=%d depth=%d %u nodes in %u ms",
+        result.direction, result.depth, (unsigned)result.nodes,
+        (unsigned)result.elapsedMs);
+}
+
+float Game2048Solver::maxNode(Board board, int depth, float probability) {
+  if ((++_nodes & 0xFF) == 0 &&
+      (_generation != _searchGeneration ||
+       (int32_t)(millis() - _deadline) >= 0))
+    _aborted = true;
+  if (_aborted)
+    return 0;
+
+  float best = 0; // No move: the game is lost here
+  for (int dir = 0; dir < 4; dir++) {
+    Board next = board;
+    int score = 0;
+    if (!Game2048::slide(next, dir, score))
+      continue;
+    float value = chanceNode(next, depth - 1, probability);
+    if (value > best)
+      best = value;
+  }
+  return best;
+}
+
+float Game2048Solver::chanceNode(Board board, int depth, float probability) {
+  if (depth <= 0 || probability < MIN_PROBABILITY)
+    return evaluate(board);
+
+  Entry &entry = _table[slotFor(board)];
+  if (entry.depth >= depth && entry.board == board)
+    return entry.value;
+
+  int empty = Game2048::emptyCount(board);
+  if (empty == 0)
+    return evaluate(board);
+  probability /= empty;
+  float total = 0;
+  for (int shift = 0; shift < 64; shift += 4) {
+    if ((board >> shift) & 0xF)
+      continue;
+    total += 0.9f * maxNode(board | ((Board)1 << shift), depth,
+                            probability * 0.9f);
+    total += 0.1f * maxNode(board | ((Board)2 << shift), depth,
+                            probability * 0.1f);
+  }
+  float value = total / empty;
+
+  if (!_aborted) {
+    entry.board = board;
+    entry.value = value;
+    entry.depth = depth;
+  }
+  return value;
+}
+
+float Game2048Solver::evaluate(Board board) const {
+  Board columns = Game2048::transpose(board);
+  float value = 0;
+  for (int r = 0; r < Game2048::SIZE; r++)
+    value += _heuristic[Game2048::row(board, r)] +
+             _heuristic[Game2048::row(columns, r)];
+  return value;
+}
@@ -0,0 +1,111 @@
+/**
+ * 2048 Solver
+ *
+ * Depth-limited expectimax over the bitboard engine, for the game's HINT
+ * button and autoplay. A search runs on its own low-priority task on core
+ * 0, so the UI keeps drawing and taking touches; its result is picked up
+ * with poll() on the loop task, which the worker wakes (Wake::COMPUTE).
+ *
+ * The search deepens one move at a time until the time budget runs out
+ * and answers with the best move of the deepest pass it finished. Chance
+ * nodes place a 2 (90%) or a 4 (10%) in every empty cell; branches less
+ * likely than MIN_PROBABILITY are cut and scored by the heuristic, which
+ * rewards empty cells, mergeable neighbours and monotonic rows, looked up
+ * per row in a 65,536-entry table. A transposition table keeps chance-node
+ * values by board and depth. Both tables sit in PSRAM (768 KB together)
+ * from the first search until stop().
+ */
+
+#ifndef GAME_2048_SOLVER_H
+#define GAME_2048_SOLVER_H
+
+#include "game2048.h"
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+class Game2048Solver {
+public:
+  static const uint32_t TASK_STACK = 4096;
+  static const int MAX_DEPTH = 6;        // Moves looked ahead
+  static const int TABLE_BITS = 15;      // Transposition entries, log2
+  static const uint32_t HINT_BUDGET_MS = 400;
+  static const uint32_t AUTO_BUDGET_MS = 150;
+
+  struct Result {
+    Game2048::Board board; // The position searched
+    int direction;         // Game2048::Direction, -1 if no move is left
+    int depth;             // Deepest pass finished
+    uint32_t elapsedMs;
+    uint32_t nodes;
+  };
+
+  Game2048Solver();
+
+  /**
+   * Start the worker task (once)
+   */
+  bool begin();
+
+  /**
+   * Search a position in the background; a result for an earlier request
+   * that has not been polled yet is dropped
+   * @return false if a search is already running or the task is down
+   */
+  bool request(Game2048::Board board, uint32_t budgetMs);
+
+  /**
+   * Take the finished result, if any. Call from the loop task.
+   */
+  bool poll(Result &out);
+
+  /**
+   * Abandon the running search (its result is dropped)
+   */
+  void cancel() { _generation++; }
+
+  /**
+   * Cancel, wait for the worker to go idle and free the tables
+   */
+  void stop();
+
+  bool busy() const { return _busy; }
+
+private:
+  struct Request {
+    Game2048::Board board;
+    uint32_t budgetMs;
+    uint32_t generation;
+  };
+
+  struct Entry {
+    Game2048::Board board;
+    float value;
+    uint8_t depth; // 0 = unused
+  };
+
+  QueueHandle_t _requests;
+  QueueHandle_t _results;
+  TaskHandle_t _task;
+  std::atomic<bool> _busy;
+  std::atomic<uint32_t> _generation;
+  uint32_t _pollGeneration; // Generation of the last request
+
+  // Worker only (stop() frees them once the worker is idle)
+  Entry *_table;
+  float *_heuristic;
+  uint32_t _searchGeneration;
+  uint32_t _deadline;
+  uint32_t _nodes;
+  bool _aborted;
+
+  static void taskEntry(void *arg);
+  bool allocate();
+  void search(const Request &request, Result &result);
+  float maxNode(Game2048::Board board, int depth, float probability);
+  float chanceNode(Game2048::Board board, int depth, float probability);
+  float evaluate(Game2048::Board board) const;
+};
+
+#endif // GAME_2048_SOLVER_H
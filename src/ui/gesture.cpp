@@ -0,0 +1,173 @@
+/**
+ * Gesture Recognizer Implementation
+ */
+
+#include "gesture.h"
+
+GestureRecognizer::GestureRecognizer() { reset(); }
+
+void GestureRecognizer::reset() {
+  _state = State::IDLE;
+  _down = false;
+  _startX = _startY = _lastX = _lastY = 0;
+  _startUs = _lastUs = 0;
+  _vx = _vy = 0;
+}
+
+GestureDir GestureRecognizer::dominantDir(int dx, int dy) {
+  if (dx == 0 && dy == 0)
+    return GestureDir::NONE;
+  if (abs(dx) > abs(dy))
+    return dx > 0 ? GestureDir::RIGHT : GestureDir::LEFT;
+  return dy > 0 ? GestureDir::DOWN : GestureDir::UP;
+}
+
+void GestureRecognizer::fill(Gesture &out, GestureType type,
+                             int64_t nowUs) const {
+  out.type = type;
+  out.dir = dominantDir(_lastX - _startX, _lastY - _startY);
+  out.x = _lastX;
+  out.y = _lastY;
+  out.startX = _startX;
+  out.startY = _startY;
+  out.vx = _vx;
+  out.vy = _vy;
+  out.durationMs = (uint32_t)((nowUs - _startUs) / 1000);
+}
+
+bool GestureRecognizer::feed(const GT911::TouchSample &sample, Gesture &out) {
+  if (!sample.pressed) {
+    if (!_down)
+      return false;
+    _down = false;
+    int64_t now = sample.timeUs;
+    State state = _state;
+    _state = State::IDLE;
+
+    uint32_t heldMs = (uint32_t)((now - _startUs) / 1000);
+    if (state == State::PENDING && heldMs < TAP_MAX_MS) {
+      fill(out, GestureType::TAP, now);
+      return true;
+    }
+    if (state == State::DRAGGING) {
+      fill(out, GestureType::DRAG_END, now);
+      return true;
+    }
+    return false;
+  }
+
+  // Touch down
+  if (!_down) {
+    _down = true;
+    _state = State::PENDING;
+    _startX = _lastX = sample.x;
+    _startY = _lastY = sample.y;
+    _startUs = _lastUs = sample.timeUs;
+    _vx = _vy = 0;
+    return false;
+  }
+
+  // Motion: update smoothed velocity from the previous sample
+  int64_t dtUs = sample.timeUs - _lastUs;
+  if (dtUs > 0) {
+    float ivx = (sample.x - _lastX) * 1e6f / dtUs;
+    float ivy = (sample.y - _lastY) * 1e6f / dtUs;
+    _vx = _vx * 0.5f + ivx * 0.5f;
+    _vy = _vy * 0.5f + ivy * 0.5f;
+  }
+  _lastX = sample.x;
+  _lastY = sample.y;
+  _lastUs = sample.timeUs;
+
+  int dx = _lastX - _startX;
+  int dy = _lastY - _startY;
+  int dist2 = dx * dx + dy * dy;
+
+  switch (_state) {
+  case State::PENDING:
+    if (abs(dx) < TAP_SLOP && abs(dy) < TAP_SLOP)
+      return false;
+    // Left the tap zone: no longer a tap, track as a drag
+    _state = State::DRAGGING;
+    // fall through
+  case State::DRAGGING: {
+    // Fast enough and far enough: swipe now, mid-motion
+    float elapsedS = (_lastUs - _startUs) / 1e6f;
+    float avgSpeed = elapsedS > 0 ? sqrtf((float)dist2) / elapsedS : 0;
+    if (dist2 >= SWIPE_MIN_DIST * SWIPE_MIN_DIST &&
+        avgSpeed >= SWIPE_MIN_SPEED) {
+      _state = State::SWIPED;
+      fill(out, GestureType::SWIPE, sample.timeUs);
+      return true;
+    }
+    fill(out, GestureType::DRAG, sample.timeUs);
+    return true;
+  }
+  case State::SWIPED:
+  case State::LONG_PRESSED:
+  case State::IDLE:
+    break;
+  }
+  return false;
+}
+
+bool GestureRecognizer::poll(int64_t nowUs, Gesture &out) {
+  if (!_down || _state != State::PENDING)
+    return false;
+  if ((nowUs - _startUs) / 1000 < (int64_t)LONG_PRESS_MS)
+    return false;
+
+  _state = State::LONG_PRESSED;
+  fill(out, GestureType::LONG_PRESS, nowUs);
+  return true;
+}
+
+PinchRecognizer::PinchRecognizer() { reset(); }
+
+void PinchRecognizer::reset() {
+  _active = false;
+  _second = false;
+  _burstUs = 0;
+  _x = _y = 0;
+  _startSpread = 0;
+  _scale = 1.0f;
+  _centerX = _centerY = 0;
+}
+
+PinchEvent PinchRecognizer::feed(const GT911::TouchSample &sample) {
+  if (sample.primary) {
+    // A new burst; the last one had no second finger if none was seen
+    bool ended = _active && (!sample.pressed || !_second);
+    _second = false;
+    _burstUs = sample.timeUs;
+    _x = sample.x;
+    _y = sample.y;
+    if (ended) {
+      _active = false;
+      return PinchEvent::END;
+    }
+    return PinchEvent::NONE;
+  }
+  if (sample.timeUs != _burstUs || _second)
+    return PinchEvent::NONE; // Not with this primary, or a third finger
+
+  _second = true;
+  float dx = sample.x - _x;
+  float dy = sample.y - _y;
+  float spread = sqrtf(dx * dx + dy * dy);
+  if (!_active) {
+    if (spread < MIN_SPREAD)
+      return PinchEvent::NONE;
+    _active = true;
+    _startSpread = spread;
+    _scale = 1.0f;
+    _centerX = (_x + sample.x) / 2;
+    _centerY = (_y + sample.y) / 2;
+    return PinchEvent::START;
+  }
+  float scale = spread / _startSpread;
+  if (scale == _scale)
+    return PinchEvent::NONE;
+  _scale = scale;
+  return PinchEvent::MOVE;
+}
@@ -0,0 +1,112 @@
+/**
+ * Gesture Recognizer
+ *
+ * Classifies the sampled touch stream incrementally into taps, long presses,
+ * swipes and drags. Swipes are reported mid-motion as soon as distance and
+ * speed cross their thresholds, not on release.
+ *
+ * Pinches are a second recognizer fed every finger: the GT911 reports all
+ * contacts in one burst, primary first, and a finger that lifts simply
+ * stops appearing, so the pinch ends on the first burst without one.
+ */
+
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include "../hardware/gt911.h"
+#include <Arduino.h>
+
+enum class GestureType { NONE, TAP, LONG_PRESS, SWIPE, DRAG, DRAG_END };
+
+enum class GestureDir { NONE, LEFT, RIGHT, UP, DOWN };
+
+/**
+ * One recognised gesture
+ */
+struct Gesture {
+  GestureType type;
+  GestureDir dir;     // Dominant axis of motion (SWIPE/DRAG)
+  int16_t x, y;       // Current (or release) position
+  int16_t startX;     // Position at touch down
+  int16_t startY;
+  float vx, vy;       // Velocity in px/s
+  uint32_t durationMs; // Time since touch down
+};
+
+class GestureRecognizer {
+public:
+  // Tuning (screen pixels / milliseconds)
+  static const int TAP_SLOP = 20;            // Max travel for tap/long press
+  static const uint32_t TAP_MAX_MS = 800;    // Longer holds are not taps
+  static const uint32_t LONG_PRESS_MS = 800; // Hold time for long press
+  static const int SWIPE_MIN_DIST = 50;      // Travel before a swipe fires
+  static constexpr float SWIPE_MIN_SPEED = 250.0f; // Average px/s
+
+  GestureRecognizer();
+
+  /**
+   * Feed one primary-finger sample
+   * @return true if a gesture was recognised (written to out)
+   */
+  bool feed(const GT911::TouchSample &sample, Gesture &out);
+
+  /**
+   * Check time-based gestures (long press) without a new sample
+   * @return true if a gesture was recognised
+   */
+  bool poll(int64_t nowUs, Gesture &out);
+
+  /**
+   * Forget the current contact (e.g. on screen change)
+   */
+  void reset();
+
+  bool isTracking() const { return _down; }
+
+private:
+  enum class State { IDLE, PENDING, LONG_PRESSED, SWIPED, DRAGGING };
+
+  State _state;
+  bool _down;
+  int16_t _startX, _startY;
+  int16_t _lastX, _lastY;
+  int64_t _startUs;
+  int64_t _lastUs;
+  float _vx, _vy; // Smoothed instantaneous velocity
+
+  void fill(Gesture &out, GestureType type, int64_t nowUs) const;
+  static GestureDir dominantDir(int dx, int dy);
+};
+
+enum class PinchEvent { NONE, START, MOVE, END };
+
+class PinchRecognizer {
+public:
+  static const int MIN_SPREAD = 40; // px between fingers to start a pinch
+
+  PinchRecognizer();
+
+  /**
+   * Feed one sample of any finger
+   * @return what the pinch did (MOVE: scale() changed)
+   */
+  PinchEvent feed(const GT911::TouchSample &sample);
+
+  void reset();
+
+  bool isActive() const { return _active; }
+  float scale() const { return _scale; } // Spread now / spread at START
+  int16_t centerX() const { return _centerX; } // Midpoint at START
+  int16_t centerY() const { return _centerY; }
+
+private:
+  bool _active;
+  bool _second;      // A second finger in the current burst
+  int64_t _burstUs;  // Time of the current burst's primary sample
+  int16_t _x, _y;    // Primary finger
+  float _startSpread;
+  float _scale;
+  int16_t _centerX, _centerY;
+};
+
+#endif // GESTURE_H
@@ -0,0 +1,233 @@
+/**
+ * Glyph Atlas Implementation
+ */
+
+#include "glyph_atlas.h"
+#include "raster4.h"
+
+// Colors for eInk (grayscale) - same values as ui_manager.cpp
+#define COLOR_BLACK 0x0000
+
+const char *const GlyphAtlas::CHARSET = "0123456789W%:hm-. ";
+
+// Glyphs are outlined on a grid 16 units tall (the cell height); widths
+// are the advance, side bearings included
+static const uint8_t UNITS_HIGH = 16;
+static const float STROKE_UNITS = 1.1f; // Stroke radius
+
+namespace {
+
+struct Pen {
+  M5Canvas *canvas;
+  float ox; // Glyph origin in the sheet
+  float scale;
+  float radius;
+
+  void line(float x0, float y0, float x1, float y1) {
+    canvas->drawWideLine(ox + x0 * scale, y0 * scale, ox + x1 * scale,
+                         y1 * scale, radius, COLOR_BLACK);
+  }
+
+  // Elliptical arc, angles in degrees clockwise from 3 o'clock
+  void arc(float cx, float cy, float rx, float ry, float from, float to) {
+    int steps = max(8, (int)(fabsf(to - from) / 10));
+    float px = cx + rx * cosf(from * DEG_TO_RAD);
+    float py = cy + ry * sinf(from * DEG_TO_RAD);
+    for (int i = 1; i <= steps; i++) {
+      float a = (from + (to - from) * i / steps) * DEG_TO_RAD;
+      float x = cx + rx * cosf(a);
+      float y = cy + ry * sinf(a);
+      line(px, py, x, y);
+      px = x;
+      py = y;
+    }
+  }
+
+  void dot(float x, float y, float r) {
+    canvas->fillSmoothCircle(ox + x * scale, y * scale, r * scale,
+                             COLOR_BLACK);
+  }
+};
+
+// Advance in units
+int glyphUnits(char c) {
+  switch (c) {
+  case 'W':
+  case '%':
+    return 12;
+  case 'm':
+    return 14;
+  case ':':
+  case '.':
+    return 4;
+  case ' ':
+    return 6;
+  default:
+    return 10;
+  }
+}
+
+void outline(Pen &p, char c) {
+  switch (c) {
+  case '0':
+    p.arc(5, 8, 4, 7, 0, 360);
+    break;
+  case '1':
+    p.line(5.5f, 1, 5.5f, 15);
+    p.line(5.5f, 1, 2.5f, 3.5f);
+    break;
+  case '2':
+    p.arc(5, 5, 4, 4, 180, 405);
+    p.line(7.83f, 7.83f, 1, 15);
+    p.line(1, 15, 9, 15);
+    break;
+  case '3':
+    p.arc(5, 4.5f, 3.5f, 3.5f, 200, 450);
+    p.arc(5, 11.5f, 4, 3.5f, 270, 520);
+    break;
+  case '4':
+    p.line(7, 15, 7, 1);
+    p.line(7, 1, 1, 11);
+    p.line(1, 11, 9.5f, 11);
+    break;
+  case '5':
+    p.line(8.5f, 1, 2, 1);
+    p.line(2, 1, 2.17f, 7.3f);
+    p.arc(5, 10.5f, 4, 4.5f, 225, 510);
+    break;
+  case '6':
+    p.arc(5, 10.5f, 4, 4.5f, 0, 360);
+    p.arc(8, 10, 7, 9, 180, 245);
+    p.line(5.04f, 1.84f, 7.5f, 1);
+    break;
+  case '7':
+    p.line(1, 1, 9, 1);
+    p.line(9, 1, 3.5f, 15);
+    break;
+  case '8':
+    p.arc(5, 4.5f, 3.5f, 3.5f, 0, 360);
+    p.arc(5, 11.5f, 4, 3.5f, 0, 360);
+    break;
+  case '9':
+    p.arc(5, 5.5f, 4, 4.5f, 0, 360);
+    p.arc(2, 6, 7, 9, 0, 65);
+    p.line(4.96f, 14.16f, 2.5f, 15);
+    break;
+  case 'W':
+    p.line(0.75f, 1, 3.25f, 15);
+    p.line(3.25f, 15, 6, 5);
+    p.line(6, 5, 8.75f, 15);
+    p.line(8.75f, 15, 11.25f, 1);
+    break;
+  case '%':
+    p.arc(3, 3.5f, 2, 2.5f, 0, 360);
+    p.arc(9, 12.5f, 2, 2.5f, 0, 360);
+    p.line(10, 1, 2, 15);
+    break;
+  case ':':
+    p.dot(2, 5, 1.5f);
+    p.dot(2, 12, 1.5f);
+    break;
+  case 'h':
+    p.line(1.5f, 1, 1.5f, 15);
+    p.arc(5, 9, 3.5f, 3, 180, 360);
+    p.line(8.5f, 9, 8.5f, 15);
+    break;
+  case 'm':
+    p.line(1.5f, 6, 1.5f, 15);
+    p.arc(4.25f, 8.5f, 2.75f, 2.5f, 180, 360);
+    p.line(7, 8.5f, 7, 15);
+    p.arc(9.75f, 8.5f, 2.75f, 2.5f, 180, 360);
+    p.line(12.5f, 8.5f, 12.5f, 15);
+    break;
+  case '-':
+    p.line(2, 9, 8, 9);
+    break;
+  case '.':
+    p.dot(2, 14.5f, 1.5f);
+    break;
+  default: // Space
+    break;
+  }
+}
+
+} // namespace
+
+GlyphAtlas::~GlyphAtlas() { delete _sheet; }
+
+int GlyphAtlas::indexOf(char c) {
+  const char *at = c ? strchr(CHARSET, c) : nullptr;
+  return at ? at - CHARSET : -1;
+}
+
+bool GlyphAtlas::build(uint8_t textSize) {
+  int height = textSize * 8;
+  if (_sheet && _height == height)
+    return true;
+  delete _sheet;
+  _sheet = nullptr;
+
+  float scale = (float)height / UNITS_HIGH;
+  int n = strlen(CHARSET);
+  int width = 0;
+  for (int i = 0; i < n; i++) {
+    _offset[i] = width;
+    _advance[i] = (int)(glyphUnits(CHARSET[i]) * scale + 0.5f);
+    width += _advance[i];
+  }
+
+  M5Canvas *sheet = new M5Canvas(&M5.Display);
+  sheet->setColorDepth(4);
+  sheet->setPsram(true);
+  if (!sheet->createSprite(width, height)) {
+    Serial.println("UI: Glyph atlas allocation failed");
+    delete sheet;
+    return false;
+  }
+  Raster4::clear(*sheet);
+  for (int i = 0; i < n; i++) {
+    Pen pen = {sheet, (float)_offset[i], scale, STROKE_UNITS * scale};
+    outline(pen, CHARSET[i]);
+  }
+  _sheet = sheet;
+  _height = height;
+  Serial.printf("UI: Glyph atlas %dx%d for text size %d\n", width, height,
+                textSize);
+  return true;
+}
+
+bool GlyphAtlas::covers(const char *text) const {
+  if (!_sheet)
+    return false;
+  for (const char *c = text; *c; c++) {
+    if (indexOf(*c) < 0)
+      return false;
+  }
+  return true;
+}
+
+int GlyphAtlas::textWidth(const char *text) const {
+  int width = 0;
+  for (const char *c = text; *c; c++) {
+    int i = indexOf(*c);
+    if (i >= 0)
+      width += _advance[i];
+  }
+  return width;
+}
+
+bool GlyphAtlas::draw(LovyanGFX &g, int x, int y, const char *text) const {
+  if (!covers(text))
+    return false;
+  for (const char *c = text; *c; c++) {
+    int i = indexOf(*c);
+    if (*c != ' ') {
+      // The glyph's own column of the sheet
+      g.setClipRect(x, y, _advance[i], _height);
+      _sheet->pushSprite(&g, x - _offset[i], y);
+      g.clearClipRect();
+    }
+    x += _advance[i];
+  }
+  return true;
+}
@@ -0,0 +1,60 @@
+/**
+ * Glyph Atlas
+ *
+ * Large dashboard numerals, rendered once and then copied. Scaling the
+ * built-in 6x8 font to size 5 gives blocky digits and a slow per-pixel
+ * scaled blit; instead each glyph of CHARSET is drawn from a stroke
+ * outline with anti-aliased wide lines into one 4-bit sheet in PSRAM, and
+ * text is a row of clipped sprite pushes from that sheet.
+ *
+ * An atlas matches one setTextSize() cell height (8 px per size) so it can
+ * stand in for the built-in font without moving layouts. Text containing a
+ * character outside CHARSET is left to the built-in font.
+ */
+
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <Arduino.h>
+#include <M5Unified.h>
+
+class GlyphAtlas {
+public:
+  static const char *const CHARSET; // Digits, W % : h m - . and space
+
+  GlyphAtlas() : _sheet(nullptr), _height(0) {}
+  ~GlyphAtlas();
+
+  /**
+   * Render the sheet for a built-in text size (idempotent)
+   */
+  bool build(uint8_t textSize);
+
+  bool isReady() const { return _sheet != nullptr; }
+  uint8_t textSize() const { return _height / 8; }
+
+  /**
+   * True if every character of text is in the atlas
+   */
+  bool covers(const char *text) const;
+
+  int textWidth(const char *text) const;
+
+  /**
+   * Draw text with its cell's top-left at x, y
+   * @return false (nothing drawn) unless covers(text)
+   */
+  bool draw(LovyanGFX &g, int x, int y, const char *text) const;
+
+private:
+  static const int MAX_GLYPHS = 20;
+
+  M5Canvas *_sheet;
+  int _height;
+  int16_t _offset[MAX_GLYPHS]; // Glyph x within the sheet
+  int16_t _advance[MAX_GLYPHS];
+
+  static int indexOf(char c);
+};
+
+#endif // GLYPH_ATLAS_H
@@ -0,0 +1,121 @@
+/**
+ * Graph Cache Implementation
+ */
+
+#include "graph_cache.h"
+#include "../utils/mem_telemetry.h"
+#include "note_codec.h"
+#include <esp_heap_caps.h>
+
+static const int MAX_WIDTH = 960;
+
+GraphCache::~GraphCache() { clear(); }
+
+bool GraphCache::allocate(int w, int h) {
+  if (_canvas && _canvas->width() == w && _canvas->height() == h)
+    return true;
+  release();
+  _canvas = new M5Canvas(&M5.Display);
+  _canvas->setColorDepth(4);
+  _canvas->setPsram(true);
+  if (!_canvas->createSprite(w, h)) {
+    Serial.printf("UI: Graph cache %dx%d allocation failed\n", w, h);
+    delete _canvas;
+    _canvas = nullptr;
+    return false;
+  }
+  MemTelemetry::track(MemTelemetry::Tag::HISTORY, _canvas->bufferLength());
+  return true;
+}
+
+void GraphCache::drop(Entry &entry) {
+  if (entry.file)
+    MemTelemetry::track(MemTelemetry::Tag::HISTORY, -(long)entry.len);
+  free(entry.file);
+  entry = Entry();
+}
+
+bool GraphCache::store(uint32_t key, LovyanGFX &display, int x, int y,
+                       int w, int h) {
+  if (w > MAX_WIDTH || !allocate(w, h))
+    return false;
+
+  // readRect() gives RGB565 with its bytes swapped; the panel is grey, so
+  // the top four bits of green are the 4-bit level (as Screenshot reads it)
+  uint8_t *pixels = (uint8_t *)_canvas->getBuffer();
+  int stride = _canvas->bufferLength() / h;
+  uint16_t row[MAX_WIDTH];
+  for (int r = 0; r < h; r++) {
+    display.readRect(x, y + r, w, 1, row);
+    uint8_t *out = pixels + r * stride;
+    for (int c = 0; c < w; c++) {
+      uint16_t rgb = (uint16_t)(row[c] << 8 | row[c] >> 8);
+      uint8_t level = (rgb >> 7) & 0x0F;
+      if (c & 1)
+        out[c / 2] |= level;
+      else
+        out[c / 2] = level << 4;
+    }
+  }
+
+  size_t len = 0;
+  uint8_t *file = NoteCodec::encode(pixels, w, h, 4, len, false);
+  if (!file)
+    return false;
+  // encode() sized the buffer for the worst case
+  uint8_t *fit = (uint8_t *)heap_caps_realloc(file, len, MALLOC_CAP_SPIRAM);
+  if (fit)
+    file = fit;
+
+  // The key's own slot, else a free one, else the least recently used
+  Entry *slot = &_entries[0];
+  for (Entry &e : _entries) {
+    if (e.file && e.key == key) {
+      slot = &e;
+      break;
+    }
+    if (!e.file || (slot->file && e.lastUse < slot->lastUse))
+      slot = &e;
+  }
+  drop(*slot);
+  slot->key = key;
+  slot->file = file;
+  slot->len = len;
+  slot->lastUse = ++_clock;
+  MemTelemetry::track(MemTelemetry::Tag::HISTORY, len);
+  return true;
+}
+
+bool GraphCache::draw(uint32_t key, LovyanGFX &display, int x, int y, int w,
+                      int h) {
+  for (Entry &e : _entries) {
+    if (!e.file || e.key != key)
+      continue;
+    if (!allocate(w, h))
+      return false;
+    if (!NoteCodec::decode(e.file, e.len, (uint8_t *)_canvas->getBuffer(), w,
+                           h, 4)) {
+      drop(e); // Fails its CRC: drawn live and stored again
+      return false;
+    }
+    _canvas->pushSprite(&display, x, y);
+    e.lastUse = ++_clock;
+    return true;
+  }
+  return false;
+}
+
+void GraphCache::release() {
+  if (!_canvas)
+    return;
+  MemTelemetry::track(MemTelemetry::Tag::HISTORY,
+                      -(long)_canvas->bufferLength());
+  delete _canvas;
+  _canvas = nullptr;
+}
+
+void GraphCache::clear() {
+  for (Entry &e : _entries)
+    drop(e);
+  release();
+}
@@ -0,0 +1,69 @@
+/**
+ * Graph Cache
+ *
+ * Rendered history plots of windows that can no longer change (days
+ * before today, with every day they cover read in), kept compressed in
+ * PSRAM. Paging back through past days then costs one decode and one
+ * block copy instead of the scaling scan, the envelope and the traces.
+ *
+ * An entry is the plot region read back from the panel once it has been
+ * drawn, as a 4-bit NoteCodec file without a thumbnail: the plot is
+ * mostly paper, so a day takes tens of KB rather than the region's
+ * 220 KB. Entries are keyed by everything the pixels depend on (see
+ * UIManager::historyGraphKey); the least recently used is evicted first.
+ * One 4-bit canvas of the region's size is kept for decoding until
+ * release().
+ */
+
+#ifndef GRAPH_CACHE_H
+#define GRAPH_CACHE_H
+
+#include <M5Unified.h>
+
+class GraphCache {
+public:
+  static const int CAPACITY = 16; // A week of days under two filters
+
+  GraphCache() : _canvas(nullptr), _clock(0) {}
+  ~GraphCache();
+
+  /**
+   * Read the region (x, y, w, h) back from display and keep it under
+   * key, replacing the least recently used entry when full
+   * @return false without PSRAM for it
+   */
+  bool store(uint32_t key, LovyanGFX &display, int x, int y, int w, int h);
+
+  /**
+   * Push the entry for key to display at (x, y)
+   * @return false if there is none (or no PSRAM to decode it)
+   */
+  bool draw(uint32_t key, LovyanGFX &display, int x, int y, int w, int h);
+
+  /**
+   * Free the decode canvas; the entries stay
+   */
+  void release();
+
+  /**
+   * Drop every entry and the canvas
+   */
+  void clear();
+
+private:
+  struct Entry {
+    uint32_t key = 0;
+    uint8_t *file = nullptr; // NoteCodec v2, in PSRAM
+    size_t len = 0;
+    uint32_t lastUse = 0;
+  };
+
+  Entry _entries[CAPACITY];
+  M5Canvas *_canvas;
+  uint32_t _clock; // Use counter for LRU
+
+  bool allocate(int w, int h);
+  void drop(Entry &entry);
+};
+
+#endif // GRAPH_CACHE_H
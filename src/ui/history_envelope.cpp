@@ -0,0 +1,193 @@
+/**
+ * History Graph Envelope Implementation
+ */
+
+#include "history_envelope.h"
+
+HistoryEnvelope::HistoryEnvelope()
+    : _cols(nullptr), _width(0), _t0(0), _t1(0),
+      _source(HistorySource::MINUTES), _revision(0), _folded(0), _peakW(0),
+      _filled(0) {}
+
+HistoryEnvelope::~HistoryEnvelope() { release(); }
+
+void HistoryEnvelope::release() {
+  delete[] _cols;
+  _cols = nullptr;
+  _width = 0;
+}
+
+void HistoryEnvelope::clear() {
+  for (int x = 0; x < _width; x++)
+    _cols[x] = EnvelopeColumn();
+  _folded = _t0;
+  _peakW = 0;
+  _filled = 0;
+}
+
+uint32_t HistoryEnvelope::secondsOf(HistorySource source) {
+  switch (source) {
+  case HistorySource::QUARTER_HOURS:
+    return 900;
+  case HistorySource::HOURS:
+    return 3600;
+  case HistorySource::DAYS:
+    return 86400;
+  case HistorySource::MINUTES:
+  default:
+    return 60;
+  }
+}
+
+// A tier reaches back to t if its oldest bucket does, or it has never
+// wrapped (then it holds everything there is)
+static bool reaches(const RollupTier &tier, uint32_t t) {
+  const RollupBucket *oldest = tier.get(tier.size() - 1);
+  return tier.size() < tier.capacity() || (oldest && oldest->start <= t);
+}
+
+HistorySource HistoryEnvelope::pick(const PowerHistory &history, uint32_t t0,
+                                    uint32_t t1, int width) {
+  uint32_t perColumn = width > 0 ? (t1 - t0) / width : t1 - t0;
+  int s = (int)HistorySource::DAYS;
+  while (s > 0 && secondsOf((HistorySource)s) > perColumn)
+    s--;
+
+  // Coarser where the finer source has already let go of t0
+  const HistoryRollup &rollup = history.getRollup();
+  const RollupTier &quarters = rollup.tier(HistoryRollup::QUARTER_HOUR);
+  uint32_t ringStart =
+      (history.getDayNumber() - (HISTORY_DAYS - 1)) * 86400UL;
+  if (s == (int)HistorySource::MINUTES && t0 < ringStart &&
+      !(quarters.size() < quarters.capacity()))
+    s++;
+  if (s == (int)HistorySource::QUARTER_HOURS && !reaches(quarters, t0))
+    s++;
+  if (s == (int)HistorySource::HOURS &&
+      !reaches(rollup.tier(HistoryRollup::HOUR), t0))
+    s++;
+  return (HistorySource)s;
+}
+
+void HistoryEnvelope::update(const PowerHistory &history, uint32_t t0,
+                             uint32_t t1, int width, HistorySource finest) {
+  if (width > MAX_COLUMNS)
+    width = MAX_COLUMNS;
+  if (t1 <= t0)
+    t1 = t0 + 60;
+  HistorySource source = pick(history, t0, t1, width);
+  if (source < finest)
+    source = finest;
+  uint32_t revision = history.getRevision();
+  uint32_t newest = history.getDayNumber() * 86400UL +
+                    history.getTodaySampleCount() * 60UL;
+
+  bool rebuild = !_cols || width != _width || t0 != _t0 || t1 != _t1 ||
+                 source != _source;
+  if (!rebuild && revision == _revision)
+    return; // Nothing new
+
+  if (!_cols) {
+    _cols = new EnvelopeColumn[MAX_COLUMNS];
+    rebuild = true;
+  }
+  // Rollup buckets are refolded whole. A window reaching the newest sample
+  // only grows at the end; older minutes only change on load: redo them.
+  if (source != HistorySource::MINUTES || t1 < newest)
+    rebuild = true;
+
+  if (rebuild) {
+    _width = width;
+    _t0 = t0;
+    _t1 = t1;
+    _source = source;
+    clear();
+  }
+
+  switch (source) {
+  case HistorySource::MINUTES: {
+    // Re-fold the newest folded minute too: it may have been overwritten
+    uint32_t from = _folded > _t0 ? _folded - 60 : _t0;
+    uint32_t to = newest < _t1 ? newest : _t1;
+    if (to > from)
+      foldMinutes(history, from, to);
+    if (to > _folded)
+      _folded = to;
+    break;
+  }
+  case HistorySource::QUARTER_HOURS:
+    foldTier(history.getRollup().tier(HistoryRollup::QUARTER_HOUR));
+    break;
+  case HistorySource::HOURS:
+    foldTier(history.getRollup().tier(HistoryRollup::HOUR));
+    break;
+  case HistorySource::DAYS:
+    foldTier(history.getRollup().tier(HistoryRollup::DAY));
+    break;
+  }
+  _revision = revision;
+}
+
+void HistoryEnvelope::foldMinutes(const PowerHistory &history, uint32_t from,
+                                  uint32_t to) {
+  for (const HistorySpan &span : history.range(from, to)) {
+    for (uint16_t i = 0; i < span.count; i++) {
+      const PowerSample &s = span.samples[i];
+      foldSpan(span.start + i * 60, 60, s.batteryPct, s.batteryPct, s.inputW,
+               s.inputW, s.outputW, s.outputW);
+    }
+  }
+}
+
+void HistoryEnvelope::foldTier(const RollupTier &tier) {
+  // Newest first: stop at the first bucket wholly before the window
+  for (uint16_t age = 0; age < tier.size(); age++) {
+    const RollupBucket *b = tier.get(age);
+    if (!b->start || !b->count || b->start >= _t1)
+      continue;
+    if (b->start + tier.span() <= _t0)
+      break;
+    foldSpan(b->start, tier.span(), b->minPct, b->maxPct, b->minInW,
+             b->maxInW, b->minOutW, b->maxOutW);
+  }
+}
+
+void HistoryEnvelope::foldSpan(uint32_t start, uint32_t secs, uint8_t minPct,
+                               uint8_t maxPct, uint16_t minInW,
+                               uint16_t maxInW, uint16_t minOutW,
+                               uint16_t maxOutW) {
+  // Every column the interval covers
+  uint32_t window = _t1 - _t0;
+  uint32_t from = start > _t0 ? start - _t0 : 0;
+  uint32_t to = start + secs - _t0;
+  if (to > window)
+    to = window;
+  int first = (uint64_t)from * _width / window;
+  int last = ((uint64_t)to * _width + window - 1) / window - 1;
+  if (last < first || (uint64_t)secs * _width < window)
+    last = first; // Narrower than a column: just the one it starts in
+  if (last >= _width)
+    last = _width - 1;
+
+  for (int x = first; x <= last; x++) {
+    EnvelopeColumn &c = _cols[x];
+    if (c.empty())
+      _filled++;
+    if (minPct < c.minPct)
+      c.minPct = minPct;
+    if (maxPct > c.maxPct)
+      c.maxPct = maxPct;
+    if (minInW < c.minInW)
+      c.minInW = minInW;
+    if (maxInW > c.maxInW)
+      c.maxInW = maxInW;
+    if (minOutW < c.minOutW)
+      c.minOutW = minOutW;
+    if (maxOutW > c.maxOutW)
+      c.maxOutW = maxOutW;
+  }
+  if (maxInW > _peakW)
+    _peakW = maxInW;
+  if (maxOutW > _peakW)
+    _peakW = maxOutW;
+}
@@ -0,0 +1,88 @@
+/**
+ * History Graph Envelope
+ *
+ * Per-pixel-column min/max of battery, input and output over a window of
+ * PowerHistory. The data comes from the coarsest source whose buckets are
+ * still no wider than a column (the minute ring, or the 15 minute, hour or
+ * day rollup), falling back to a coarser one where the finer no longer
+ * reaches back to the window's start, so any zoom folds at least one
+ * bucket into each column and never plots more than one span per column.
+ * A bucket wider than a column fills every column it covers.
+ *
+ * Minute windows reaching the newest sample fold only the slots added
+ * since the last update; other windows are refolded when the history
+ * changes (a week of minutes or a few hundred buckets at most).
+ */
+
+#ifndef HISTORY_ENVELOPE_H
+#define HISTORY_ENVELOPE_H
+
+#include "../power_history.h"
+#include <Arduino.h>
+
+struct EnvelopeColumn {
+  uint8_t minPct = 0xFF; // 0xFF = no sample in this column
+  uint8_t maxPct = 0;
+  uint16_t minInW = 0xFFFF;
+  uint16_t maxInW = 0;
+  uint16_t minOutW = 0xFFFF;
+  uint16_t maxOutW = 0;
+
+  bool empty() const { return minPct == 0xFF; }
+};
+
+// Where the columns' data comes from, finest first
+enum class HistorySource : uint8_t { MINUTES, QUARTER_HOURS, HOURS, DAYS };
+
+class HistoryEnvelope {
+public:
+  static const int MAX_COLUMNS = 960;
+
+  HistoryEnvelope();
+  ~HistoryEnvelope();
+
+  /**
+   * Bring the envelope up to date for the window [t0, t1) and graph width,
+   * drawing from finest or anything coarser
+   */
+  void update(const PowerHistory &history, uint32_t t0, uint32_t t1,
+              int width, HistorySource finest = HistorySource::MINUTES);
+
+  /**
+   * Free the columns (when the history screen closes)
+   */
+  void release();
+
+  /**
+   * The source a window of this width would be drawn from
+   */
+  static HistorySource pick(const PowerHistory &history, uint32_t t0,
+                            uint32_t t1, int width);
+  static uint32_t secondsOf(HistorySource source); // One bucket
+
+  int width() const { return _width; }
+  const EnvelopeColumn &column(int x) const { return _cols[x]; }
+  uint16_t getPeakW() const { return _peakW; }
+  HistorySource source() const { return _source; }
+  bool isEmpty() const { return _filled == 0; }
+
+private:
+  EnvelopeColumn *_cols;
+  int _width;
+  uint32_t _t0;       // Window the columns describe
+  uint32_t _t1;
+  HistorySource _source;
+  uint32_t _revision; // PowerHistory revision they were built at
+  uint32_t _folded;   // Minutes: samples before this time are folded in
+  uint16_t _peakW;
+  uint16_t _filled;   // Columns holding data
+
+  void clear();
+  void foldMinutes(const PowerHistory &history, uint32_t from, uint32_t to);
+  void foldTier(const RollupTier &tier);
+  void foldSpan(uint32_t start, uint32_t secs, uint8_t minPct,
+                uint8_t maxPct, uint16_t minInW, uint16_t maxInW,
+                uint16_t minOutW, uint16_t maxOutW);
+};
+
+#endif // HISTORY_ENVELOPE_H
@@ -0,0 +1,86 @@
+/**
+ * History Graph View Implementation
+ */
+
+#include "history_view.h"
+#include "../power_history.h"
+
+const uint32_t HistoryView::LEVELS[LEVEL_COUNT] = {
+    3600,     3 * 3600,  6 * 3600,  12 * 3600,  DAY,       2 * DAY,  7 * DAY,
+    14 * DAY, 30 * DAY,  60 * DAY,  180 * DAY,  365 * DAY, 730 * DAY};
+
+HistoryView::HistoryView()
+    : _start(0), _span(DAY), _oldest(0), _latest(0xFFFFFFFF) {}
+
+void HistoryView::showDay(uint32_t dayNumber) {
+  _span = DAY;
+  _start = dayNumber * DAY;
+  clamp();
+}
+
+void HistoryView::setBounds(const PowerHistory &history) {
+  _latest = (history.getDayNumber() + 1) * DAY;
+  _oldest = (history.getDayNumber() - (HISTORY_DAYS - 1)) * DAY;
+  const RollupTier &days = history.getRollup().tier(HistoryRollup::DAY);
+  const RollupBucket *oldest = days.get(days.size() - 1);
+  if (oldest && oldest->start && oldest->start < _oldest)
+    _oldest = oldest->start - oldest->start % DAY;
+  clamp();
+}
+
+void HistoryView::clamp() {
+  if (_span < MIN_SPAN)
+    _span = MIN_SPAN;
+  if (_span > MAX_SPAN)
+    _span = MAX_SPAN;
+  if (_start < _oldest)
+    _start = _oldest;
+  // Right edge last: a window wider than the data ends at today
+  if (_latest >= _span && _start > _latest - _span)
+    _start = _latest - _span;
+}
+
+void HistoryView::moveTo(int64_t t) {
+  _start = t < 0 ? 0 : (t > 0xFFFFFFFFLL ? 0xFFFFFFFF : (uint32_t)t);
+  clamp();
+}
+
+void HistoryView::zoomTo(uint32_t span, float anchor) {
+  anchor = constrain(anchor, 0.0f, 1.0f);
+  int64_t pivot = _start + (int64_t)(anchor * _span);
+  _span = span;
+  clamp(); // The span's bounds
+  moveTo(pivot - (int64_t)(anchor * _span));
+}
+
+void HistoryView::zoomStep(int steps, float anchor) {
+  int level = 0;
+  while (level < LEVEL_COUNT - 1 && LEVELS[level] < _span)
+    level++;
+  // Between levels (after a pinch): the level above is the first step out
+  if (steps > 0 && LEVELS[level] > _span)
+    steps--;
+  level = constrain(level + steps, 0, LEVEL_COUNT - 1);
+  zoomTo(LEVELS[level], anchor);
+}
+
+void HistoryView::snap(float anchor) {
+  int best = 0;
+  for (int i = 1; i < LEVEL_COUNT; i++) {
+    // Nearest by ratio, so 5h goes to 6h rather than 3h
+    float ratio = (float)LEVELS[i] / _span;
+    float bestRatio = (float)LEVELS[best] / _span;
+    if (fabsf(logf(ratio)) < fabsf(logf(bestRatio)))
+      best = i;
+  }
+  zoomTo(LEVELS[best], anchor);
+}
+
+void HistoryView::spanLabel(char *out, size_t size) const {
+  if (_span < DAY)
+    snprintf(out, size, "%luh", (unsigned long)(_span / 3600));
+  else if (_span < 365 * DAY)
+    snprintf(out, size, "%lud", (unsigned long)(_span / DAY));
+  else
+    snprintf(out, size, "%luy", (unsigned long)(_span / (365 * DAY)));
+}
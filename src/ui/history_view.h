@@ -0,0 +1,80 @@
+/**
+ * History Graph View
+ *
+ * The time window the history graph shows: its span (zoom) and where it
+ * ends (pan). Zooming keeps the time under an anchor point where it is,
+ * as a pinch does about the fingers' midpoint; a pinch's span is snapped
+ * to the nearest of LEVELS when the fingers lift, and the zoom buttons
+ * step through them. The window is kept between the oldest rollup bucket
+ * and the end of today.
+ */
+
+#ifndef HISTORY_VIEW_H
+#define HISTORY_VIEW_H
+
+#include <Arduino.h>
+
+class PowerHistory;
+
+class HistoryView {
+public:
+  static const uint32_t DAY = 86400;
+  static const uint32_t MIN_SPAN = 3600;      // An hour
+  static const uint32_t MAX_SPAN = 730 * DAY; // The daily rollup's reach
+  static const int LEVEL_COUNT = 13;
+  static const uint32_t LEVELS[LEVEL_COUNT]; // 1h .. 2 years
+
+  HistoryView();
+
+  /**
+   * Show one whole day (days since 1970)
+   */
+  void showDay(uint32_t dayNumber);
+
+  /**
+   * Change the span keeping the time at anchor (0 = left edge, 1 = right)
+   * where it is
+   */
+  void zoomTo(uint32_t span, float anchor);
+
+  /**
+   * Step to the next wider (steps > 0) or narrower level
+   */
+  void zoomStep(int steps, float anchor);
+
+  /**
+   * Snap the span to the nearest level
+   */
+  void snap(float anchor);
+
+  /**
+   * Start the window at t (kept within bounds)
+   */
+  void moveTo(int64_t t);
+  void pan(int64_t seconds) { moveTo((int64_t)_start + seconds); }
+
+  /**
+   * Bounds from what the history holds: today's end, the oldest bucket
+   */
+  void setBounds(const PowerHistory &history);
+
+  uint32_t start() const { return _start; }
+  uint32_t end() const { return _start + _span; }
+  uint32_t span() const { return _span; }
+  bool atLatest() const { return end() >= _latest; } // Ends with today
+
+  /**
+   * Short name of the span ("6h", "7d", "1y")
+   */
+  void spanLabel(char *out, size_t size) const;
+
+private:
+  uint32_t _start;
+  uint32_t _span;
+  uint32_t _oldest; // Earliest start worth showing
+  uint32_t _latest; // Latest end
+
+  void clamp();
+};
+
+#endif // HISTORY_VIEW_H
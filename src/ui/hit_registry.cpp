@@ -0,0 +1,95 @@
+/**
+ * Hit-Test Registry Implementation
+ */
+
+#include "hit_registry.h"
+
+HitRegistry::HitRegistry() : _count(0), _overflowCount(0) { clear(); }
+
+void HitRegistry::clear() {
+  for (int i = 0; i < _count; i++)
+    _regions[i].callback = nullptr;
+  _count = 0;
+  _overflowCount = 0;
+  memset(_cellCount, 0, sizeof(_cellCount));
+}
+
+int HitRegistry::add(int x, int y, int w, int h, Callback callback) {
+  if (_count >= MAX_REGIONS || w <= 0 || h <= 0) {
+    Serial.println("UI: Hit registry full, region dropped");
+    return -1;
+  }
+
+  int id = _count++;
+  Region &r = _regions[id];
+  r.x = x;
+  r.y = y;
+  r.w = w;
+  r.h = h;
+  r.callback = callback;
+
+  int c0 = constrain(x / CELL_SIZE, 0, GRID_COLS - 1);
+  int c1 = constrain((x + w - 1) / CELL_SIZE, 0, GRID_COLS - 1);
+  int r0 = constrain(y / CELL_SIZE, 0, GRID_ROWS - 1);
+  int r1 = constrain((y + h - 1) / CELL_SIZE, 0, GRID_ROWS - 1);
+
+  bool overflowed = false;
+  for (int row = r0; row <= r1; row++) {
+    for (int col = c0; col <= c1; col++) {
+      uint8_t &n = _cellCount[row][col];
+      if (n < MAX_PER_CELL) {
+        _cells[row][col][n++] = id;
+      } else {
+        overflowed = true;
+      }
+    }
+  }
+  if (overflowed)
+    _overflow[_overflowCount++] = id;
+
+  return id;
+}
+
+int HitRegistry::hitTest(int x, int y) const {
+  if (x < 0 || y < 0)
+    return -1;
+  int col = x / CELL_SIZE;
+  int row = y / CELL_SIZE;
+  if (col >= GRID_COLS || row >= GRID_ROWS)
+    return -1;
+
+  int best = -1;
+  for (int i = 0; i < _cellCount[row][col]; i++) {
+    int id = _cells[row][col][i];
+    if (id > best && contains(_regions[id], x, y))
+      best = id;
+  }
+  for (int i = 0; i < _overflowCount; i++) {
+    int id = _overflow[i];
+    if (id > best && contains(_regions[id], x, y))
+      best = id;
+  }
+  return best;
+}
+
+bool HitRegistry::bounds(int id, int &x, int &y, int &w, int &h) const {
+  if (id < 0 || id >= _count)
+    return false;
+  const Region &r = _regions[id];
+  x = r.x;
+  y = r.y;
+  w = r.w;
+  h = r.h;
+  return true;
+}
+
+bool HitRegistry::dispatch(int x, int y) {
+  int id = hitTest(x, y);
+  if (id < 0 || !_regions[id].callback)
+    return false;
+
+  // Copy first: the callback may navigate and clear the registry
+  Callback cb = _regions[id].callback;
+  cb(x, y);
+  return true;
+}
@@ -0,0 +1,79 @@
+/**
+ * Hit-Test Registry
+ *
+ * Screens register their touch targets while they draw. Regions are
+ * bucketed into a uniform grid so a tap only checks the handful of regions
+ * overlapping its cell, keeping dispatch cost flat as screens grow.
+ */
+
+#ifndef HIT_REGISTRY_H
+#define HIT_REGISTRY_H
+
+#include <Arduino.h>
+#include <functional>
+
+class HitRegistry {
+public:
+  using Callback = std::function<void(int x, int y)>;
+
+  // 60 px cells over 960x540 -> 16x9 grid
+  static const int CELL_SIZE = 60;
+  static const int GRID_COLS = 16;
+  static const int GRID_ROWS = 9;
+  static const int MAX_REGIONS = 64;
+  static const int MAX_PER_CELL = 6;
+
+  HitRegistry();
+
+  /**
+   * Remove all regions (call when a screen starts a full draw)
+   */
+  void clear();
+
+  /**
+   * Register a rectangular touch target
+   * @return region id, or -1 if the registry is full
+   */
+  int add(int x, int y, int w, int h, Callback callback);
+
+  /**
+   * Find the region under (x, y); later registrations win on overlap
+   * @return region id or -1
+   */
+  int hitTest(int x, int y) const;
+
+  /**
+   * Rectangle of a region returned by add() or hitTest()
+   * @return false if id is not a region
+   */
+  bool bounds(int id, int &x, int &y, int &w, int &h) const;
+
+  /**
+   * Run the callback for the region under (x, y)
+   * @return true if a region handled the tap
+   */
+  bool dispatch(int x, int y);
+
+  int count() const { return _count; }
+
+private:
+  struct Region {
+    int16_t x, y, w, h;
+    Callback callback;
+  };
+
+  Region _regions[MAX_REGIONS];
+  int _count;
+
+  // Per-cell region ids; regions that overflow a cell go to _overflow
+  uint8_t _cells[GRID_ROWS][GRID_COLS][MAX_PER_CELL];
+  uint8_t _cellCount[GRID_ROWS][GRID_COLS];
+  uint8_t _overflow[MAX_REGIONS];
+  int _overflowCount;
+
+  bool contains(const Region &r, int x, int y) const {
+    return x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h;
+  }
+};
+
+#endif // HIT_REGISTRY_H
@@ -0,0 +1,272 @@
+/**
+ * Home Layout Tables
+ */
+
+#include "home_layout.h"
+#include "widgets.h"
+
+namespace HomeLayout {
+
+// Common to every theme: the battery bar across the top
+#define BATTERY_PLACE {{5, 5, 950, 70}, 0}
+#define PANEL(x, y, w, h) {DecorKind::PANEL, {x, y, w, h}, nullptr}
+#define RULE(x, y, w, h) {DecorKind::RULE, {x, y, w, h}, nullptr}
+#define CAPTION(x, y, text)                                                  \
+  {DecorKind::CAPTION, {x, y, (int16_t)(18 * (sizeof(text) - 1)), 24}, text}
+
+constexpr Theme THEMES[] = {
+    // 1A classic_grid: four panels, power on top, status and clock below
+    {"classic_grid",
+     {BATTERY_PLACE,
+      {{50, 145, 205, 40}, 5},  // IN_POWER
+      {{275, 140, 180, 40}, 0}, // IN_SPARK
+      {{30, 185, 425, 16}, 0},  // IN_BAR
+      {{30, 215, 425, 24}, 3},  // IN_TIME
+      {{30, 245, 425, 16}, 2},  // IN_ENERGY
+      {{525, 145, 205, 40}, 5}, // OUT_POWER
+      {{750, 140, 180, 40}, 0}, // OUT_SPARK
+      {{505, 185, 425, 16}, 0}, // OUT_BAR
+      {{505, 215, 425, 24}, 3}, // OUT_TIME
+      {{505, 245, 425, 16}, 2}, // OUT_ENERGY
+      {{30, 295, 425, 24}, 3},  // LINK
+      {{30, 350, 100, 70}, 0},  // USB
+      {{171, 350, 100, 70}, 0}, // DC
+      {{312, 350, 100, 70}, 0}, // AC
+      {{505, 295, 425, 40}, 5}, // CLOCK
+      {{505, 355, 425, 16}, 2}, // DATE
+      {{505, 383, 425, 16}, 2}},
+     {PANEL(10, 90, 465, 180), CAPTION(30, 105, "IN"),
+      PANEL(485, 90, 465, 180), CAPTION(505, 105, "OUT"),
+      PANEL(10, 280, 465, 180), RULE(30, 335, 425, 1),
+      PANEL(485, 280, 465, 180)},
+     {{30, 350, 131, 110},   // TOGGLE_USB
+      {171, 350, 131, 110},  // TOGGLE_DC
+      {312, 350, 163, 110},  // TOGGLE_AC
+      {485, 280, 465, 65},   // OPEN_PHOTOS: the time
+      {485, 375, 465, 35},   // OPEN_WEATHER
+      {495, 415, 90, 35}}},  // OPEN_HISTORY
+
+    // 1B horizontal_stacks: power side by side in one wide panel, status
+    // and clock in another
+    {"horizontal_stacks",
+     {BATTERY_PLACE,
+      {{30, 140, 200, 40}, 5},
+      {{250, 140, 180, 40}, 0},
+      {{30, 190, 420, 16}, 0},
+      {{30, 215, 420, 24}, 3},
+      {{30, 248, 420, 16}, 2},
+      {{500, 140, 200, 40}, 5},
+      {{720, 140, 180, 40}, 0},
+      {{500, 190, 420, 16}, 0},
+      {{500, 215, 420, 24}, 3},
+      {{500, 248, 420, 16}, 2},
+      {{30, 305, 430, 24}, 3},
+      {{30, 350, 100, 70}, 0},
+      {{170, 350, 100, 70}, 0},
+      {{310, 350, 100, 70}, 0},
+      {{500, 305, 430, 40}, 5},
+      {{500, 360, 430, 16}, 2},
+      {{500, 388, 430, 16}, 2}},
+     {PANEL(10, 90, 940, 190), CAPTION(30, 105, "IN"),
+      CAPTION(500, 105, "OUT"), RULE(480, 105, 1, 160),
+      PANEL(10, 290, 940, 170), RULE(30, 340, 430, 1),
+      RULE(480, 305, 1, 140)},
+     {{30, 345, 130, 110},
+      {170, 345, 130, 110},
+      {310, 345, 160, 110},
+      {490, 290, 460, 65},
+      {490, 380, 460, 35},
+      {490, 420, 100, 35}}},
+
+    // 1C gauge_meters: three boxes (in, out, time), outlets in a row below
+    {"gauge_meters",
+     {BATTERY_PLACE,
+      {{30, 135, 266, 40}, 5},
+      {{30, 185, 180, 40}, 0},
+      {{30, 240, 266, 16}, 0},
+      {{30, 270, 266, 16}, 2},
+      {{30, 300, 266, 16}, 2},
+      {{347, 135, 266, 40}, 5},
+      {{347, 185, 180, 40}, 0},
+      {{347, 240, 266, 16}, 0},
+      {{347, 270, 266, 16}, 2},
+      {{347, 300, 266, 16}, 2},
+      {{664, 300, 266, 16}, 2},
+      {{120, 370, 100, 70}, 0},
+      {{420, 370, 100, 70}, 0},
+      {{720, 370, 100, 70}, 0},
+      {{664, 105, 266, 40}, 5},
+      {{664, 160, 266, 16}, 2},
+      {{664, 188, 266, 16}, 2}},
+     {PANEL(10, 90, 306, 250), CAPTION(30, 100, "IN"),
+      PANEL(327, 90, 306, 250), CAPTION(347, 100, "OUT"),
+      PANEL(644, 90, 306, 250), RULE(30, 355, 900, 1)},
+     {{100, 365, 200, 100},
+      {400, 365, 200, 100},
+      {700, 365, 200, 100},
+      {644, 90, 306, 65},
+      {644, 180, 306, 35},
+      {654, 220, 100, 35}}},
+
+    // 1D data_table: a row per direction and one of outlets, link and
+    // clock underneath
+    {"data_table",
+     {BATTERY_PLACE,
+      {{110, 110, 220, 40}, 5},
+      {{350, 128, 180, 40}, 0},
+      {{350, 108, 180, 16}, 0},
+      {{570, 110, 360, 24}, 3},
+      {{570, 142, 360, 16}, 2},
+      {{110, 190, 220, 40}, 5},
+      {{350, 208, 180, 40}, 0},
+      {{350, 188, 180, 16}, 0},
+      {{570, 190, 360, 24}, 3},
+      {{570, 222, 360, 16}, 2},
+      {{30, 375, 440, 24}, 3},
+      {{150, 270, 100, 70}, 0},
+      {{390, 270, 100, 70}, 0},
+      {{630, 270, 100, 70}, 0},
+      {{500, 365, 440, 40}, 5},
+      {{500, 415, 440, 16}, 2},
+      {{500, 440, 440, 16}, 2}},
+     {PANEL(10, 90, 940, 260), CAPTION(30, 120, "IN"),
+      RULE(20, 175, 920, 1), CAPTION(30, 200, "OUT"),
+      RULE(20, 255, 920, 1)},
+     {{140, 265, 230, 85},
+      {380, 265, 230, 85},
+      {620, 265, 230, 85},
+      {490, 360, 460, 50},
+      {490, 435, 460, 30},
+      {30, 410, 100, 35}}},
+
+    // 1E asymmetric_focus: charging large on the left, discharging and
+    // the clock stacked on the right, outlets under the large panel
+    {"asymmetric_focus",
+     {BATTERY_PLACE,
+      {{150, 140, 200, 40}, 5},
+      {{370, 140, 180, 40}, 0},
+      {{30, 200, 520, 16}, 0},
+      {{30, 230, 520, 24}, 3},
+      {{30, 262, 520, 16}, 2},
+      {{680, 105, 250, 40}, 5},
+      {{600, 150, 180, 40}, 0},
+      {{600, 198, 330, 16}, 0},
+      {{600, 220, 330, 16}, 2},
+      {{600, 244, 330, 16}, 2},
+      {{30, 320, 520, 24}, 3},
+      {{60, 385, 100, 70}, 0},
+      {{240, 385, 100, 70}, 0},
+      {{420, 385, 100, 70}, 0},
+      {{600, 295, 330, 40}, 5},
+      {{600, 350, 330, 16}, 2},
+      {{600, 378, 330, 16}, 2}},
+     {PANEL(10, 90, 560, 280), CAPTION(30, 105, "IN"),
+      RULE(30, 305, 520, 1), PANEL(580, 90, 370, 180),
+      CAPTION(600, 115, "OUT"), PANEL(580, 280, 370, 180)},
+     {{40, 380, 170, 90},
+      {220, 380, 170, 90},
+      {400, 380, 170, 90},
+      {580, 280, 370, 65},
+      {580, 370, 370, 35},
+      {590, 415, 100, 35}}},
+
+    // 1F compact_blocks: eight small blocks, link and weather on a line
+    // underneath
+    {"compact_blocks",
+     {BATTERY_PLACE,
+      {{30, 140, 190, 40}, 5},
+      {{506, 165, 180, 40}, 0},
+      {{30, 190, 186, 16}, 0},
+      {{506, 140, 186, 16}, 2},
+      {{506, 220, 186, 16}, 2},
+      {{268, 140, 190, 40}, 5},
+      {{744, 165, 180, 40}, 0},
+      {{268, 190, 186, 16}, 0},
+      {{744, 140, 196, 16}, 2},
+      {{744, 220, 196, 16}, 2},
+      {{20, 425, 440, 24}, 3},
+      {{70, 300, 100, 70}, 0},
+      {{308, 300, 100, 70}, 0},
+      {{546, 300, 100, 70}, 0},
+      {{744, 285, 186, 40}, 5},
+      {{744, 340, 196, 16}, 2},
+      {{500, 430, 440, 16}, 2}},
+     {PANEL(10, 90, 226, 170), CAPTION(30, 100, "IN"),
+      PANEL(248, 90, 226, 170), CAPTION(268, 100, "OUT"),
+      PANEL(486, 90, 226, 170), CAPTION(506, 100, "FULL"),
+      PANEL(724, 90, 226, 170), CAPTION(744, 100, "EMPTY"),
+      PANEL(10, 270, 226, 130), PANEL(248, 270, 226, 130),
+      PANEL(486, 270, 226, 130), PANEL(724, 270, 226, 130)},
+     {{10, 270, 226, 130},
+      {248, 270, 226, 130},
+      {486, 270, 226, 130},
+      {724, 270, 226, 65},
+      {490, 410, 460, 45},
+      {734, 360, 100, 35}}},
+};
+
+constexpr int THEME_COUNT = sizeof(THEMES) / sizeof(THEMES[0]);
+
+// ============================================================================
+// Compile-time checks
+// ============================================================================
+
+constexpr Box ABOVE_MENU = {0, 0, 960, 480};
+
+constexpr bool within(const Box &inner, const Box &outer) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.w <= outer.x + outer.w &&
+         inner.y + inner.h <= outer.y + outer.h;
+}
+
+constexpr bool slotsFit(const Theme &t, int i) {
+  return i == SLOT_COUNT ||
+         (within(t.slots[i].box, ABOVE_MENU) && slotsFit(t, i + 1));
+}
+
+constexpr bool decorFits(const Theme &t, int i) {
+  return i == MAX_DECOR ||
+         ((t.decor[i].kind == DecorKind::NONE ||
+           within(t.decor[i].box, BACKGROUND)) &&
+          decorFits(t, i + 1));
+}
+
+constexpr bool targetsFit(const Theme &t, int i) {
+  return i == TARGET_COUNT ||
+         (within(t.targets[i], ABOVE_MENU) && targetsFit(t, i + 1));
+}
+
+// Toggles are fixed-size widgets, each inside its own target
+constexpr bool toggleFits(const Theme &t, Slot slot, Target target) {
+  return t.slots[slot].box.w == TOGGLE_W && t.slots[slot].box.h == TOGGLE_H &&
+         within(t.slots[slot].box, t.targets[target]);
+}
+
+constexpr bool sparkFits(const Theme &t, Slot slot) {
+  return t.slots[slot].box.w % SparklineWidget::COLUMNS == 0;
+}
+
+constexpr bool valid(const Theme &t) {
+  return slotsFit(t, 0) && decorFits(t, 0) && targetsFit(t, 0) &&
+         toggleFits(t, USB, TOGGLE_USB) && toggleFits(t, DC, TOGGLE_DC) &&
+         toggleFits(t, AC, TOGGLE_AC) && sparkFits(t, IN_SPARK) &&
+         sparkFits(t, OUT_SPARK);
+}
+
+constexpr bool allValid(int i) {
+  return i == THEME_COUNT || (valid(THEMES[i]) && allValid(i + 1));
+}
+
+static_assert(THEME_COUNT == 6, "classic_grid and designs 1B-1F");
+static_assert(allValid(0), "A theme places a box off the screen, a toggle "
+                           "outside its target or an uneven sparkline");
+
+int find(const char *name) {
+  for (int i = 0; i < THEME_COUNT; i++) {
+    if (strcmp(THEMES[i].name, name) == 0)
+      return i;
+  }
+  return 0;
+}
+
+} // namespace HomeLayout
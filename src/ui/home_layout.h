@@ -0,0 +1,99 @@
+/**
+ * Home Layout
+ *
+ * Where each home-screen widget sits, per dashboard theme, as constant
+ * descriptor tables: one box per widget slot, the frames, rules and
+ * captions that never change, and the tap targets. The tables are fixed
+ * at compile time (static_asserts check every box against the screen), so
+ * building the dashboard, caching its background and hit-testing it are
+ * lookups rather than layout arithmetic, and a theme switch is an index.
+ *
+ * Themes follow docs/implementation_plan.md: classic_grid (1A), then the
+ * alternatives 1B-1F. Config's display.theme picks one by name.
+ */
+
+#ifndef HOME_LAYOUT_H
+#define HOME_LAYOUT_H
+
+#include <Arduino.h>
+
+namespace HomeLayout {
+
+struct Box {
+  int16_t x, y, w, h;
+};
+
+// Widget slots, one widget each
+enum Slot : uint8_t {
+  BATTERY,
+  IN_POWER,
+  IN_SPARK,
+  IN_BAR,
+  IN_TIME,
+  IN_ENERGY,
+  OUT_POWER,
+  OUT_SPARK,
+  OUT_BAR,
+  OUT_TIME,
+  OUT_ENERGY,
+  LINK,
+  USB,
+  DC,
+  AC,
+  CLOCK,
+  DATE,
+  WEATHER,
+  SLOT_COUNT
+};
+
+// Tap targets, each larger than what it acts on
+enum Target : uint8_t {
+  TOGGLE_USB,
+  TOGGLE_DC,
+  TOGGLE_AC,
+  OPEN_PHOTOS,
+  OPEN_WEATHER,
+  OPEN_HISTORY,
+  TARGET_COUNT
+};
+
+struct Place {
+  Box box;
+  uint8_t textSize; // Built-in text size of a label slot, else 0
+};
+
+enum class DecorKind : uint8_t { NONE, PANEL, RULE, CAPTION };
+
+// Painted once into the background layer
+struct Decor {
+  DecorKind kind;
+  Box box;          // A caption uses x and y only
+  const char *text; // Caption, size 3
+};
+
+static const int MAX_DECOR = 12;
+static const int TOGGLE_W = 100; // ToggleWidget's fixed bounds
+static const int TOGGLE_H = 70;
+
+// The background layer covers the screen between the battery bar and the
+// menu bar; every theme keeps those two
+constexpr Box BACKGROUND = {0, 80, 960, 400};
+
+struct Theme {
+  const char *name;
+  Place slots[SLOT_COUNT];
+  Decor decor[MAX_DECOR]; // Unused entries are NONE
+  Box targets[TARGET_COUNT];
+};
+
+extern const Theme THEMES[];
+extern const int THEME_COUNT;
+
+/**
+ * Index of the theme called name; 0 (classic_grid) if there is none
+ */
+int find(const char *name);
+
+} // namespace HomeLayout
+
+#endif // HOME_LAYOUT_H
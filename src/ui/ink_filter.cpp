@@ -0,0 +1,92 @@
+/**
+ * Ink Filter Implementation
+ */
+
+#include "ink_filter.h"
+
+void InkFilter::reset() {
+  _track = -1;
+  _palmTrack = -1;
+  _lastSeenUs = 0;
+  _hasPending = false;
+  _accepted = 0;
+  _rejected = 0;
+}
+
+bool InkFilter::isNear(const GT911::TouchSample &a,
+                       const GT911::TouchSample &b) {
+  int dx = a.x - b.x;
+  int dy = a.y - b.y;
+  return dx * dx + dy * dy <= OUTLIER_PX * OUTLIER_PX;
+}
+
+void InkFilter::accept(const GT911::TouchSample &sample,
+                       GT911::TouchSample *out, int &count, int max) {
+  _last = sample;
+  _accepted++;
+  if (count < max)
+    out[count++] = sample;
+}
+
+// End the stroke: the held sample stands if it follows on from the ink
+void InkFilter::finish(GT911::TouchSample *out, int &count, int max) {
+  if (_hasPending && _accepted > 0 && isNear(_pending, _last))
+    accept(_pending, out, count, max);
+  else if (_hasPending)
+    _rejected++;
+  if (_accepted > 0 && count < max) {
+    GT911::TouchSample end = _last;
+    end.pressed = false;
+    out[count++] = end;
+  }
+  _track = -1;
+  _hasPending = false;
+  _accepted = 0;
+}
+
+void InkFilter::feed(const GT911::TouchSample &sample, GT911::TouchSample *out,
+                     int &count, int max) {
+  if (!sample.pressed) {
+    // Every finger is up
+    if (_track >= 0)
+      finish(out, count, max);
+    _palmTrack = -1;
+    return;
+  }
+
+  if (sample.size > PALM_SIZE || sample.trackId == _palmTrack) {
+    if (sample.trackId == _track)
+      finish(out, count, max);
+    _palmTrack = sample.trackId;
+    _rejected++;
+    return;
+  }
+
+  if (_track >= 0 && sample.trackId != _track) {
+    // A second finger: ignored, unless the ink finger lifted on its own
+    if (sample.timeUs - _lastSeenUs < TRACK_LOST_US)
+      return;
+    finish(out, count, max);
+  }
+
+  if (_track < 0) {
+    _track = sample.trackId;
+    _pending = sample;
+    _hasPending = true;
+    _lastSeenUs = sample.timeUs;
+    return;
+  }
+  _lastSeenUs = sample.timeUs;
+
+  // Judge the held sample now that its successor is known
+  if (_hasPending) {
+    bool spike = _accepted > 0 ? !isNear(_pending, _last) && isNear(sample, _last)
+                               : !isNear(_pending, sample);
+    if (spike)
+      _rejected++;
+    else
+      accept(_pending, out, count, max);
+  }
+  _pending = sample;
+  _hasPending = true;
+}
@@ -0,0 +1,61 @@
+/**
+ * Ink Filter
+ *
+ * Cleans the touch stream before it becomes ink on the notes canvas:
+ *  - contacts larger than PALM_SIZE are a palm or the side of the hand,
+ *    and a stroke that grows into one is ended there;
+ *  - a stroke follows the finger that started it, other tracks are ignored
+ *    until it lifts;
+ *  - a single sample that jumps away and straight back is dropped, and so
+ *    is a stroke of one sample (a stray dot).
+ *
+ * Samples are held back by one so each can be judged against the next.
+ * Accepted samples come out in order; pressed=false marks a stroke's end.
+ */
+
+#ifndef INK_FILTER_H
+#define INK_FILTER_H
+
+#include "../hardware/gt911.h"
+#include <Arduino.h>
+
+class InkFilter {
+public:
+  static const uint16_t PALM_SIZE = 48;   // Contact size of a palm
+  static const int OUTLIER_PX = 40;       // Jump from both neighbours
+  static const int64_t TRACK_LOST_US = 50000; // Ink finger gone this long
+
+  InkFilter() { reset(); }
+
+  /**
+   * Feed one sample of any finger
+   * @param out Accepted samples are appended here, up to max
+   */
+  void feed(const GT911::TouchSample &sample, GT911::TouchSample *out,
+            int &count, int max);
+
+  /**
+   * Forget the stroke in progress (screen change)
+   */
+  void reset();
+
+  bool isDown() const { return _track >= 0; }
+  uint32_t rejected() const { return _rejected; }
+
+private:
+  int _track;     // Finger drawing the stroke, -1 if none
+  int _palmTrack; // Finger rejected as a palm, until everything lifts
+  int64_t _lastSeenUs;
+  bool _hasPending;
+  GT911::TouchSample _pending; // Newest sample, not yet judged
+  GT911::TouchSample _last;    // Last accepted sample of the stroke
+  int _accepted;               // Samples accepted in this stroke
+  uint32_t _rejected;
+
+  static bool isNear(const GT911::TouchSample &a, const GT911::TouchSample &b);
+  void accept(const GT911::TouchSample &sample, GT911::TouchSample *out,
+              int &count, int max);
+  void finish(GT911::TouchSample *out, int &count, int max);
+};
+
+#endif // INK_FILTER_H
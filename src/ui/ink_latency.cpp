@@ -0,0 +1,154 @@
+/**
+ * Touch-to-Ink Latency Implementation
+ */
+
+#include "ink_latency.h"
+#include <time.h>
+
+const char *InkLatency::stageName(Stage stage) {
+  switch (stage) {
+  case INPUT_LAG:
+    return "input";
+  case QUEUE_LAG:
+    return "queue";
+  case PANEL_LAG:
+    return "panel";
+  default:
+    return "?";
+  }
+}
+
+uint32_t InkLatency::binUpperUs(int bin) {
+  return bin >= BINS - 1 ? UINT32_MAX : BIN0_US << bin;
+}
+
+void InkLatency::reset() {
+  memset(_hist, 0, sizeof(_hist));
+  _batchCount = 0;
+  _inFlightCount = 0;
+  _droppedDots = 0;
+  _generation++;
+}
+
+void InkLatency::add(Stage stage, uint32_t us) {
+  Histogram &h = _hist[stage];
+  int bin = 0;
+  while (bin < BINS - 1 && us > binUpperUs(bin))
+    bin++;
+  h.bins[bin]++;
+  h.count++;
+  h.sumUs += us;
+  if (us > h.maxUs)
+    h.maxUs = us;
+}
+
+void InkLatency::dispatched(const GT911::TouchSample &sample, int64_t nowUs,
+                            bool ink) {
+  if (sample.readUs) // Watchdog reads had no INT to time from
+    add(INPUT_LAG, sample.readUs);
+  add(QUEUE_LAG, (uint32_t)(nowUs - sample.timeUs));
+  _generation++;
+
+  if (!ink || !sample.pressed || !sample.primary)
+    return;
+  if (_batchCount >= BATCH) {
+    _droppedDots++;
+    return;
+  }
+  _batch[_batchCount++] = {sample.x, sample.y, nowUs};
+}
+
+void InkLatency::pushed() {
+  for (int i = 0; i < _batchCount; i++)
+    _inFlight[i] = _batch[i].dispatchUs;
+  _inFlightCount = _batchCount;
+  _batchCount = 0;
+}
+
+void InkLatency::panelDone(int64_t nowUs) {
+  for (int i = 0; i < _inFlightCount; i++)
+    add(PANEL_LAG, (uint32_t)(nowUs - _inFlight[i]));
+  _inFlightCount = 0;
+  _generation++;
+}
+
+uint32_t InkLatency::percentileUs(Stage stage, int pct) const {
+  const Histogram &h = _hist[stage];
+  if (!h.count)
+    return 0;
+  uint32_t rank = ((uint64_t)h.count * pct + 99) / 100;
+  uint32_t seen = 0;
+  for (int bin = 0; bin < BINS; bin++) {
+    seen += h.bins[bin];
+    if (seen >= rank)
+      return bin == BINS - 1 ? h.maxUs : binUpperUs(bin);
+  }
+  return h.maxUs;
+}
+
+bool InkLatency::save(SDManager *sd, char *path, size_t pathLen) const {
+  time_t now = time(nullptr);
+  struct tm ti;
+  localtime_r(&now, &ti);
+  char stamp[20];
+  if (ti.tm_year + 1900 >= 2024) {
+    strftime(path, pathLen, "/diag/ink_%Y%m%d.csv", &ti);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &ti);
+  } else {
+    snprintf(path, pathLen, "/diag/ink_unset.csv"); // Clock not set yet
+    snprintf(stamp, sizeof(stamp), "uptime %lu", (unsigned long)millis());
+  }
+
+  SDAccess access(sd);
+  if (!access || !sd->ensureDirectory("/diag"))
+    return false;
+
+  bool fresh = !sdFS().exists(path);
+  File file = sdFS().open(path, FILE_APPEND);
+  if (!file) {
+    access.fail();
+    return false;
+  }
+  if (fresh)
+    file.print("time,build,metric,value,unit\n");
+
+  // Same prefix on every row so runs from several files concatenate
+  char prefix[48];
+  snprintf(prefix, sizeof(prefix), "%s,%s %s", stamp, __DATE__, __TIME__);
+  char line[112];
+  auto row = [&](const char *stage, const char *metric, float value,
+                 const char *unit) {
+    snprintf(line, sizeof(line), "%s,%s_%s,%.3f,%s\n", prefix, stage, metric,
+             value, unit);
+    file.print(line);
+  };
+
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    const Histogram &h = _hist[s];
+    const char *name = stageName((Stage)s);
+    row(name, "n", h.count, "samples");
+    if (!h.count)
+      continue;
+    row(name, "mean", h.sumUs / 1000.0f / h.count, "ms");
+    row(name, "p50", percentileUs((Stage)s, 50) / 1000.0f, "ms");
+    row(name, "p95", percentileUs((Stage)s, 95) / 1000.0f, "ms");
+    row(name, "max", h.maxUs / 1000.0f, "ms");
+    // The histogram itself, one row per bin that has anything
+    for (int bin = 0; bin < BINS; bin++) {
+      if (!h.bins[bin])
+        continue;
+      char metric[16];
+      if (bin == BINS - 1)
+        snprintf(metric, sizeof(metric), "gt%luus",
+                 (unsigned long)binUpperUs(bin - 1));
+      else
+        snprintf(metric, sizeof(metric), "le%luus",
+                 (unsigned long)binUpperUs(bin));
+      row(name, metric, h.bins[bin], "samples");
+    }
+  }
+  row("ink", "dropped", _droppedDots, "dots");
+  file.close();
+  Serial.printf("InkLatency: Results appended to %s\n", path);
+  return true;
+}
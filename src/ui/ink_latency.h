@@ -0,0 +1,113 @@
+/**
+ * Touch-to-Ink Latency
+ *
+ * Splits the time from a finger landing to its ink being on the panel into
+ * three stages, each with its own histogram:
+ *
+ *   input  INT edge to the GT911 read (TouchSample::readUs)
+ *   queue  read to the UI taking the sample off the ring
+ *   panel  UI dispatch to the end of the partial update that showed it
+ *
+ * The ink benchmark screen feeds it: every sample is stamped as it is
+ * dispatched, dots wait in a batch for the next push, and the batch in
+ * flight gets its panel time once the EPD is no longer busy. Bins double
+ * from 250 us, so one table covers a fast I2C read and a slow refresh.
+ *
+ * save() appends the run to /diag/ink_<date>.csv in the SD benchmark's
+ * row format, so builds and touch profiles can be compared.
+ */
+
+#ifndef INK_LATENCY_H
+#define INK_LATENCY_H
+
+#include "../hardware/gt911.h"
+#include "../utils/sd_manager.h"
+#include <Arduino.h>
+
+class InkLatency {
+public:
+  enum Stage : uint8_t { INPUT_LAG, QUEUE_LAG, PANEL_LAG, STAGE_COUNT };
+
+  static const int BINS = 14;         // Last bin holds everything slower
+  static const uint32_t BIN0_US = 250; // Upper edge of the first bin
+  static const int BATCH = 64;        // Dots waiting for one push
+
+  struct Histogram {
+    uint32_t bins[BINS];
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+  };
+
+  struct Dot {
+    int16_t x;
+    int16_t y;
+    int64_t dispatchUs;
+  };
+
+  InkLatency() : _generation(0) { reset(); }
+
+  static const char *stageName(Stage stage);
+
+  /**
+   * Upper edge of a bin, UINT32_MAX for the last
+   */
+  static uint32_t binUpperUs(int bin);
+
+  void reset();
+
+  /**
+   * A sample as the UI takes it: records input and queue time, and keeps
+   * a pressed primary sample as a dot for the next push
+   * @param ink false for samples that draw nothing (outside the pad)
+   */
+  void dispatched(const GT911::TouchSample &sample, int64_t nowUs, bool ink);
+
+  int pending() const { return _batchCount; }
+  const Dot &dot(int i) const { return _batch[i]; }
+
+  /**
+   * The batch went out in one partial update
+   */
+  void pushed();
+
+  bool awaitingPanel() const { return _inFlightCount > 0; }
+
+  /**
+   * The update in flight finished: panel time for each of its dots
+   */
+  void panelDone(int64_t nowUs);
+
+  const Histogram &histogram(Stage stage) const { return _hist[stage]; }
+
+  /**
+   * Upper edge of the bin holding the pct-th percentile, 0 if empty
+   */
+  uint32_t percentileUs(Stage stage, int pct) const;
+
+  /**
+   * Moves with every sample recorded, for repainting the figures
+   */
+  uint32_t generation() const { return _generation; }
+
+  uint32_t droppedDots() const { return _droppedDots; }
+
+  /**
+   * Append the histograms to /diag/ink_<YYYYMMDD>.csv
+   * @param path Receives the file written (at least 32 bytes)
+   */
+  bool save(SDManager *sd, char *path, size_t pathLen) const;
+
+private:
+  Histogram _hist[STAGE_COUNT];
+  Dot _batch[BATCH];
+  int _batchCount;
+  int64_t _inFlight[BATCH]; // Dispatch times of the dots being shown
+  int _inFlightCount;
+  uint32_t _generation;
+  uint32_t _droppedDots; // Batch full: drawn late or not at all
+
+  void add(Stage stage, uint32_t us);
+};
+
+#endif // INK_LATENCY_H
@@ -0,0 +1,93 @@
+/**
+ * Note Cache Implementation
+ */
+
+#include "note_cache.h"
+
+NoteCache::Entry *NoteCache::find(const String &name) {
+  for (int i = 0; i < _count; i++) {
+    if (_entries[i].name == name) {
+      _entries[i].lastUse = ++_clock;
+      return &_entries[i];
+    }
+  }
+  return nullptr;
+}
+
+void NoteCache::release(Entry &entry) {
+  free(entry.pixels);
+  entry.pixels = nullptr;
+  free(entry.page);
+  entry.page = nullptr;
+  entry.pageLen = 0;
+  entry.name = "";
+  entry.strokes.clear();
+  entry.strokes.shrink_to_fit();
+}
+
+// The name's own entry, else a free one, else the least recently used;
+// emptied and named
+NoteCache::Entry *NoteCache::slotFor(const String &name) {
+  Entry *slot = find(name);
+  if (!slot && _count < CAPACITY)
+    slot = &_entries[_count++];
+  if (!slot) {
+    slot = &_entries[0];
+    for (int i = 1; i < _count; i++) {
+      if (_entries[i].lastUse < slot->lastUse)
+        slot = &_entries[i];
+    }
+  }
+  release(*slot);
+  slot->name = name;
+  slot->lastUse = ++_clock;
+  return slot;
+}
+
+NoteCache::Entry *NoteCache::insert(const String &name, uint8_t *pixels,
+                                    uint16_t rasterCrc,
+                                    std::vector<uint8_t> &&strokes) {
+  Entry *slot = slotFor(name);
+  slot->pixels = pixels;
+  slot->rasterCrc = rasterCrc;
+  slot->strokes = std::move(strokes);
+  return slot;
+}
+
+NoteCache::Entry *NoteCache::insertPage(const String &name, uint8_t *file,
+                                        size_t len) {
+  Entry *slot = slotFor(name);
+  slot->page = file;
+  slot->pageLen = len;
+  return slot;
+}
+
+void NoteCache::remove(const String &name) {
+  for (int i = 0; i < _count; i++) {
+    if (_entries[i].name != name)
+      continue;
+    release(_entries[i]);
+    // Keep the used slots packed at the front
+    if (i != _count - 1) {
+      Entry &last = _entries[_count - 1];
+      _entries[i].name = last.name;
+      _entries[i].pixels = last.pixels;
+      _entries[i].rasterCrc = last.rasterCrc;
+      _entries[i].strokes = std::move(last.strokes);
+      _entries[i].page = last.page;
+      _entries[i].pageLen = last.pageLen;
+      _entries[i].lastUse = last.lastUse;
+      last.pixels = nullptr;
+      last.page = nullptr;
+      release(last);
+    }
+    _count--;
+    return;
+  }
+}
+
+void NoteCache::clear() {
+  for (int i = 0; i < _count; i++)
+    release(_entries[i]);
+  _count = 0;
+}
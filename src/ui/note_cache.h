@@ -0,0 +1,69 @@
+/**
+ * Note Cache
+ *
+ * The last few notes opened or prefetched, already decoded, in PSRAM.
+ * PREV/NEXT through cached notes is a memcpy instead of an SD read and a
+ * decode. Least recently used entries are evicted first.
+ *
+ * A page larger than the screen is kept as its file instead: decoded, it
+ * would be megabytes of mostly paper, and SparsePage reads the file back
+ * tile by tile.
+ */
+
+#ifndef NOTE_CACHE_H
+#define NOTE_CACHE_H
+
+#include <Arduino.h>
+#include <vector>
+
+class NoteCache {
+public:
+  static const int CAPACITY = 3; // The open note and its two neighbours
+
+  struct Entry {
+    String name;               // File name within /notes
+    uint8_t *pixels = nullptr; // Decoded canvas (PSRAM), null if unreadable
+    uint16_t rasterCrc = 0;
+    std::vector<uint8_t> strokes; // The .stk file, empty if there is none
+    uint8_t *page = nullptr; // A large page's file (PSRAM), else null
+    size_t pageLen = 0;
+    uint32_t lastUse = 0;
+  };
+
+  NoteCache() : _count(0), _clock(0) {}
+  ~NoteCache() { clear(); }
+
+  /**
+   * Look a note up, marking it most recently used
+   */
+  Entry *find(const String &name);
+
+  /**
+   * Add a note, taking ownership of pixels; replaces an entry of the same
+   * name and evicts the least recently used one when full
+   */
+  Entry *insert(const String &name, uint8_t *pixels, uint16_t rasterCrc,
+                std::vector<uint8_t> &&strokes);
+
+  /**
+   * Add a page larger than the screen as its file, taking ownership of it
+   */
+  Entry *insertPage(const String &name, uint8_t *file, size_t len);
+
+  /**
+   * Drop a note after it has been deleted
+   */
+  void remove(const String &name);
+
+  void clear();
+
+private:
+  Entry _entries[CAPACITY];
+  int _count;
+  uint32_t _clock; // Use counter for LRU
+
+  Entry *slotFor(const String &name);
+  void release(Entry &entry);
+};
+
+#endif // NOTE_CACHE_H
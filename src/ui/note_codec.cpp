@@ -0,0 +1,391 @@
+/**
+ * Note File Codec Implementation
+ */
+
+#include "note_codec.h"
+#include "../utils/crc16.h"
+#include "downscale.h"
+#include "raster4.h"
+#include <esp_heap_caps.h>
+
+namespace NoteCodec {
+
+static const char *MAGIC_V1 = "M5NOTE";
+static const char *MAGIC_V2 = "M5NOT2";
+static const size_t V1_HEADER = 11; // magic + w + h + depth
+
+struct Layout {
+  size_t rowBytes;  // One canvas row
+  size_t tileBytes; // One tile row
+  int cols, rows;   // Tiles across and down
+  int tiles;
+  size_t bitmapLen;
+};
+
+static Layout layout(uint16_t width, uint16_t height, uint8_t depth) {
+  Layout l;
+  l.rowBytes = ((size_t)width * depth + 7) / 8;
+  l.tileBytes = (size_t)TILE * depth / 8;
+  l.cols = (l.rowBytes + l.tileBytes - 1) / l.tileBytes;
+  l.rows = (height + TILE - 1) / TILE;
+  l.tiles = l.cols * l.rows;
+  l.bitmapLen = (l.tiles + 7) / 8;
+  return l;
+}
+
+// Copy tile (tx, ty) to or from a contiguous scratch buffer
+static size_t tileSpan(const Layout &l, uint16_t height, int tx, int ty,
+                       size_t &bytes, int &lines) {
+  size_t x = tx * l.tileBytes;
+  bytes = min(l.tileBytes, l.rowBytes - x);
+  lines = min((int)TILE, height - ty * TILE);
+  return (size_t)ty * TILE * l.rowBytes + x;
+}
+
+// PackBits: n < 128 is followed by n+1 literal bytes, n > 128 by one byte
+// repeated 257-n times
+static size_t pack(const uint8_t *in, size_t n, uint8_t *out) {
+  size_t o = 0, i = 0;
+  while (i < n) {
+    size_t run = 1;
+    while (i + run < n && run < 128 && in[i + run] == in[i])
+      run++;
+    if (run >= 2) {
+      out[o++] = 257 - run;
+      out[o++] = in[i];
+      i += run;
+      continue;
+    }
+    size_t start = i, lit = 0;
+    while (i < n && lit < 128 && !(i + 1 < n && in[i] == in[i + 1])) {
+      i++;
+      lit++;
+    }
+    out[o++] = lit - 1;
+    memcpy(out + o, in + start, lit);
+    o += lit;
+  }
+  return o;
+}
+
+// @return bytes of packed input consumed, or 0 if it is malformed
+static size_t unpack(const uint8_t *in, size_t avail, uint8_t *out,
+                     size_t n) {
+  size_t i = 0, o = 0;
+  while (o < n) {
+    if (i >= avail)
+      return 0;
+    uint8_t c = in[i++];
+    if (c < 128) {
+      size_t lit = c + 1;
+      if (o + lit > n || i + lit > avail)
+        return 0;
+      memcpy(out + o, in + i, lit);
+      i += lit;
+      o += lit;
+    } else if (c > 128) {
+      size_t run = 257 - c;
+      if (o + run > n || i >= avail)
+        return 0;
+      memset(out + o, in[i++], run);
+      o += run;
+    }
+  }
+  return i;
+}
+
+// Write the header over the front of a file of len bytes
+static void seal(uint8_t *file, size_t len, uint16_t width, uint16_t height,
+                 uint8_t depth, uint8_t fill, bool thumb) {
+  Header header;
+  memcpy(header.magic, MAGIC_V2, 6);
+  header.width = width;
+  header.height = height;
+  header.depth = depth;
+  header.fill = fill;
+  header.tile = TILE;
+  header.flags = thumb ? FLAG_THUMB : 0;
+  header.crc = CRC16::modbus(file + sizeof(Header), len - sizeof(Header));
+  memcpy(file, &header, sizeof(header));
+}
+
+uint8_t *encode(const uint8_t *pixels, uint16_t width, uint16_t height,
+                uint8_t depth, size_t &len, bool thumbnail) {
+  Layout l = layout(width, height, depth);
+  size_t raw = l.rowBytes * height;
+
+  // The blank fill is whatever byte the page is mostly made of
+  uint32_t counts[256] = {0};
+  for (size_t i = 0; i < raw; i++)
+    counts[pixels[i]]++;
+  uint8_t fill = 0;
+  for (int b = 1; b < 256; b++) {
+    if (counts[b] > counts[fill])
+      fill = b;
+  }
+
+  // Worst case: every tile is stored and PackBits adds a byte per 128
+  size_t tileMax = l.tileBytes * TILE;
+  size_t cap = sizeof(Header) + THUMB_LEN + l.bitmapLen +
+               l.tiles * (tileMax + tileMax / 128 + 1);
+  uint8_t *file = (uint8_t *)heap_caps_malloc(cap, MALLOC_CAP_SPIRAM);
+  uint8_t *scratch = (uint8_t *)malloc(tileMax);
+  if (!file || !scratch) {
+    free(file);
+    free(scratch);
+    return nullptr;
+  }
+
+  uint8_t *thumbAt = file + sizeof(Header);
+  bool thumb = false;
+  if (thumbnail && depth == 4)
+    thumb = Downscale::box4(pixels, width, height, thumbAt, THUMB_W, THUMB_H);
+  else if (thumbnail && depth == 1)
+    thumb = Downscale::box1(pixels, width, height, thumbAt, THUMB_W, THUMB_H);
+  size_t thumbLen = thumb ? THUMB_LEN : 0;
+  uint8_t *bitmap = file + sizeof(Header) + thumbLen;
+  memset(bitmap, 0, l.bitmapLen);
+  size_t o = sizeof(Header) + thumbLen + l.bitmapLen;
+  for (int t = 0; t < l.tiles; t++) {
+    size_t bytes;
+    int lines;
+    size_t at = tileSpan(l, height, t % l.cols, t / l.cols, bytes, lines);
+    bool blank = true;
+    for (int y = 0; y < lines; y++) {
+      const uint8_t *row = pixels + at + y * l.rowBytes;
+      memcpy(scratch + y * bytes, row, bytes);
+      for (size_t x = 0; blank && x < bytes; x++)
+        blank = row[x] == fill;
+    }
+    if (blank)
+      continue;
+    bitmap[t / 8] |= 1 << (t % 8);
+    o += pack(scratch, bytes * lines, file + o);
+  }
+  free(scratch);
+  seal(file, o, width, height, depth, fill, thumbLen != 0);
+  len = o;
+  return file;
+}
+
+uint8_t *encodeTiles(uint16_t width, uint16_t height,
+                     const TileSource &tileAt, const uint8_t *thumbnail,
+                     size_t &len) {
+  if (width % TILE || height % TILE)
+    return nullptr;
+  Layout l = layout(width, height, 1);
+  int stored = 0;
+  for (int t = 0; t < l.tiles; t++) {
+    if (tileAt(t))
+      stored++;
+  }
+
+  // Sized by the inked tiles alone: a sparse page stays a small file
+  size_t tileMax = l.tileBytes * TILE;
+  size_t thumbLen = thumbnail ? THUMB_LEN : 0;
+  size_t cap = sizeof(Header) + thumbLen + l.bitmapLen +
+               stored * (tileMax + tileMax / 128 + 1);
+  uint8_t *file = (uint8_t *)heap_caps_malloc(cap, MALLOC_CAP_SPIRAM);
+  if (!file)
+    return nullptr;
+  if (thumbLen)
+    memcpy(file + sizeof(Header), thumbnail, thumbLen);
+  uint8_t *bitmap = file + sizeof(Header) + thumbLen;
+  memset(bitmap, 0, l.bitmapLen);
+  size_t o = sizeof(Header) + thumbLen + l.bitmapLen;
+  for (int t = 0; t < l.tiles; t++) {
+    const uint8_t *tile = tileAt(t);
+    if (!tile)
+      continue;
+    bitmap[t / 8] |= 1 << (t % 8);
+    o += pack(tile, tileMax, file + o);
+  }
+  seal(file, o, width, height, 1, 0xFF, thumbLen != 0);
+  len = o;
+  return file;
+}
+
+bool decodeTiles(const uint8_t *file, size_t len, const TileSink &put) {
+  Header header;
+  if (len < sizeof(Header) || memcmp(file, MAGIC_V2, 6) != 0)
+    return false;
+  memcpy(&header, file, sizeof(header));
+  Layout l = layout(header.width, header.height, header.depth);
+  size_t start = sizeof(Header) + thumbnailLen(header);
+  if (header.depth != 1 || header.fill != 0xFF || header.tile != TILE ||
+      header.width % TILE || header.height % TILE ||
+      len < start + l.bitmapLen ||
+      CRC16::modbus(file + sizeof(Header), len - sizeof(Header)) !=
+          header.crc) {
+    Serial.println("Notes: Not an intact tiled page");
+    return false;
+  }
+
+  size_t tileMax = l.tileBytes * TILE;
+  uint8_t *scratch = (uint8_t *)malloc(tileMax);
+  if (!scratch)
+    return false;
+  const uint8_t *bitmap = file + start;
+  size_t i = start + l.bitmapLen;
+  bool ok = true;
+  for (int t = 0; ok && t < l.tiles; t++) {
+    if (!(bitmap[t / 8] & (1 << (t % 8))))
+      continue;
+    size_t used = unpack(file + i, len - i, scratch, tileMax);
+    ok = used > 0 && put(t, scratch);
+    i += used;
+  }
+  free(scratch);
+  return ok;
+}
+
+size_t dataOffset(const uint8_t *file, size_t len) {
+  if (len >= sizeof(Header) && memcmp(file, MAGIC_V2, 6) == 0) {
+    Header header;
+    memcpy(&header, file, sizeof(header));
+    return sizeof(Header) + thumbnailLen(header);
+  }
+  return V1_HEADER;
+}
+
+bool peek(const uint8_t *file, size_t len, uint16_t &width, uint16_t &height,
+          uint8_t &depth) {
+  if (len >= sizeof(Header) && memcmp(file, MAGIC_V2, 6) == 0) {
+    Header header;
+    memcpy(&header, file, sizeof(header));
+    width = header.width;
+    height = header.height;
+    depth = header.depth;
+    return true;
+  }
+  if (len >= V1_HEADER && memcmp(file, MAGIC_V1, 6) == 0) {
+    memcpy(&width, file + 6, 2);
+    memcpy(&height, file + 8, 2);
+    depth = file[10];
+    return true;
+  }
+  return false;
+}
+
+// Decode at the file's own depth
+static bool decodeNative(const uint8_t *file, size_t len, uint8_t *pixels,
+                         uint16_t w, uint16_t h, uint8_t d) {
+  if (memcmp(file, MAGIC_V1, 6) == 0) {
+    size_t raw = layout(w, h, d).rowBytes * h;
+    if (len != V1_HEADER + raw) {
+      Serial.println("Notes: v1 file has the wrong size");
+      return false;
+    }
+    memcpy(pixels, file + V1_HEADER, raw);
+    return true;
+  }
+
+  Header header;
+  memcpy(&header, file, sizeof(header));
+  Layout l = layout(w, h, d);
+  size_t start = sizeof(Header) + thumbnailLen(header);
+  if (header.tile != TILE || len < start + l.bitmapLen ||
+      CRC16::modbus(file + sizeof(Header), len - sizeof(Header)) !=
+          header.crc) {
+    Serial.println("Notes: v2 file is corrupt");
+    return false;
+  }
+
+  uint8_t *scratch = (uint8_t *)malloc(l.tileBytes * TILE);
+  if (!scratch)
+    return false;
+  Raster4::fill(pixels, header.fill, l.rowBytes * h);
+  const uint8_t *bitmap = file + start;
+  size_t i = start + l.bitmapLen;
+  bool ok = true;
+  for (int t = 0; ok && t < l.tiles; t++) {
+    if (!(bitmap[t / 8] & (1 << (t % 8))))
+      continue;
+    size_t bytes;
+    int lines;
+    size_t at = tileSpan(l, h, t % l.cols, t / l.cols, bytes, lines);
+    size_t used = unpack(file + i, len - i, scratch, bytes * lines);
+    ok = used > 0;
+    for (int y = 0; ok && y < lines; y++)
+      memcpy(pixels + at + y * l.rowBytes, scratch + y * bytes, bytes);
+    i += used;
+  }
+  free(scratch);
+  if (!ok)
+    Serial.println("Notes: v2 tile data is truncated");
+  return ok;
+}
+
+// 4-bit levels 8 and up are paper, the rest ink
+static void to1(const uint8_t *in, uint8_t *out, uint16_t w, uint16_t h) {
+  size_t inRow = layout(w, h, 4).rowBytes;
+  size_t outRow = layout(w, h, 1).rowBytes;
+  for (int y = 0; y < h; y++) {
+    const uint8_t *src = in + y * inRow;
+    uint8_t *dst = out + y * outRow;
+    memset(dst, 0xFF, outRow); // Padding bits stay white, as when filled
+    for (int x = 0; x < w; x++) {
+      uint8_t v = x & 1 ? src[x >> 1] & 0x0F : src[x >> 1] >> 4;
+      if (v < 8)
+        dst[x >> 3] &= ~(0x80 >> (x & 7));
+    }
+  }
+}
+
+// Each 1-bit byte becomes four 4-bit bytes, 0 or 15 per pixel
+static void to4(const uint8_t *in, uint8_t *out, uint16_t w, uint16_t h) {
+  static uint32_t lut[256];
+  if (!lut[1]) {
+    for (int b = 0; b < 256; b++) {
+      uint32_t v = 0;
+      for (int i = 0; i < 8; i++) {
+        if (b & (0x80 >> i))
+          v |= 0x0Fu << ((i ^ 1) * 4); // Byte order matches memory
+      }
+      lut[b] = v;
+    }
+  }
+  size_t inRow = layout(w, h, 1).rowBytes;
+  size_t outRow = layout(w, h, 4).rowBytes;
+  uint8_t quad[4];
+  for (int y = 0; y < h; y++) {
+    const uint8_t *src = in + y * inRow;
+    uint8_t *dst = out + y * outRow;
+    for (size_t i = 0; i < inRow; i++) {
+      memcpy(quad, &lut[src[i]], 4);
+      size_t at = i * 4;
+      memcpy(dst + at, quad, min((size_t)4, outRow - at));
+    }
+  }
+}
+
+bool decode(const uint8_t *file, size_t len, uint8_t *pixels, uint16_t width,
+            uint16_t height, uint8_t depth) {
+  uint16_t w, h;
+  uint8_t d;
+  if (!peek(file, len, w, h, d)) {
+    Serial.println("Notes: Invalid file header");
+    return false;
+  }
+  bool convert = (d == 1 && depth == 4) || (d == 4 && depth == 1);
+  if (w != width || h != height || (d != depth && !convert)) {
+    Serial.printf("Notes: File is %dx%d depth=%d, expected %dx%d depth=%d\n",
+                  w, h, d, width, height, depth);
+    return false;
+  }
+  if (!convert)
+    return decodeNative(file, len, pixels, w, h, d);
+
+  // Through a scratch page at the file's depth
+  size_t native = layout(w, h, d).rowBytes * h;
+  uint8_t *page = (uint8_t *)heap_caps_malloc(native, MALLOC_CAP_SPIRAM);
+  bool ok = page && decodeNative(file, len, page, w, h, d);
+  if (ok && d == 4)
+    to1(page, pixels, w, h);
+  else if (ok)
+    to4(page, pixels, w, h);
+  free(page);
+  return ok;
+}
+
+} // namespace NoteCodec
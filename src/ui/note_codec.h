@@ -0,0 +1,114 @@
+/**
+ * Note File Codec
+ *
+ * Notes are mostly blank paper, so v2 note files store the canvas as
+ * 32x32-pixel tiles: a bitmap marks the tiles that differ from the blank
+ * fill byte, and only those are written, each PackBits-compressed.
+ *
+ *   v1: "M5NOTE" w h depth, then the raw canvas buffer
+ *   v2: Header below, [thumbnail], tile bitmap, then the packed tiles
+ *
+ * Both versions are decoded straight into a canvas buffer. v2 files also
+ * carry a 200x125 4-bit thumbnail right after the header, so the browser
+ * can show a preview with a single small read.
+ *
+ * Notes are drawn at 1 bpp; older 4-bit files still open (levels of 8 and
+ * up become paper) and either depth decodes to 4-bit for export.
+ *
+ * A page larger than the view (SparsePage) is never laid out as one
+ * buffer: encodeTiles() and decodeTiles() move its tiles one at a time,
+ * into and out of the same v2 layout.
+ */
+
+#ifndef NOTE_CODEC_H
+#define NOTE_CODEC_H
+
+#include <Arduino.h>
+#include <functional>
+
+namespace NoteCodec {
+
+static const uint8_t TILE = 32; // Tile edge in pixels
+static const uint16_t THUMB_W = 200;
+static const uint16_t THUMB_H = 125;
+static const size_t THUMB_LEN = THUMB_W * THUMB_H / 2; // 4 bpp
+static const uint8_t FLAG_THUMB = 0x01; // Header::flags
+
+struct __attribute__((packed)) Header {
+  char magic[6]; // "M5NOT2"
+  uint16_t width;
+  uint16_t height;
+  uint8_t depth;
+  uint8_t fill;  // Byte value of a blank tile
+  uint8_t tile;  // Tile edge in pixels
+  uint8_t flags; // FLAG_THUMB
+  uint16_t crc;  // CRC16 of everything after the header
+};
+static_assert(sizeof(Header) == 16, "Header layout is on disk");
+
+/**
+ * Compress a canvas buffer into a complete v2 file
+ * @param len Set to the file length
+ * @param thumbnail Include the browser's preview
+ * @return Buffer in PSRAM for the caller to free, or nullptr without memory
+ */
+uint8_t *encode(const uint8_t *pixels, uint16_t width, uint16_t height,
+                uint8_t depth, size_t &len, bool thumbnail = true);
+
+/**
+ * Tile t of a 1-bit page, row-major: TILE rows of TILE / 8 bytes, or
+ * nullptr for a blank one
+ */
+typedef std::function<const uint8_t *(int tile)> TileSource;
+
+/**
+ * Take one stored tile of a page (laid out as TileSource gives it)
+ * @return false to stop the decode
+ */
+typedef std::function<bool(int tile, const uint8_t *pixels)> TileSink;
+
+/**
+ * Compress a 1-bit page held tile by tile into a v2 file (blank tiles
+ * are paper). Both sides must be whole tiles.
+ * @param thumbnail THUMB_LEN bytes of preview, or nullptr for none
+ * @return Buffer in PSRAM for the caller to free, or nullptr
+ */
+uint8_t *encodeTiles(uint16_t width, uint16_t height,
+                     const TileSource &tileAt, const uint8_t *thumbnail,
+                     size_t &len);
+
+/**
+ * Hand each stored tile of a file encodeTiles() wrote to put; the tiles
+ * it skips are blank
+ */
+bool decodeTiles(const uint8_t *file, size_t len, const TileSink &put);
+
+/**
+ * Bytes of thumbnail following a v2 header (0 if it has none)
+ */
+inline size_t thumbnailLen(const Header &header) {
+  return header.flags & FLAG_THUMB ? THUMB_LEN : 0;
+}
+
+/**
+ * Where the pixels (v1) or the tile bitmap (v2) start
+ */
+size_t dataOffset(const uint8_t *file, size_t len);
+
+/**
+ * Read the dimensions of a v1 or v2 file
+ */
+bool peek(const uint8_t *file, size_t len, uint16_t &width, uint16_t &height,
+          uint8_t &depth);
+
+/**
+ * Decode a v1 or v2 file into a canvas buffer of the given size. The
+ * buffer is only written once the header (and the v2 CRC) check out.
+ * A 1-bit file decodes into a 4-bit buffer and the other way round.
+ */
+bool decode(const uint8_t *file, size_t len, uint8_t *pixels, uint16_t width,
+            uint16_t height, uint8_t depth);
+
+} // namespace NoteCodec
+
+#endif // NOTE_CODEC_H
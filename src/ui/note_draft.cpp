@@ -0,0 +1,189 @@
+/**
+ * Note Draft Implementation
+ */
+
+#include "note_draft.h"
+#include "../utils/crc16.h"
+#include "../utils/sd_manager.h"
+#include "../utils/storage_worker.h"
+
+extern SDManager *sdManager;
+extern StorageWorker *storage;
+
+const char *NoteDraft::PATH = "/notes/draft.ntd";
+
+static const size_t ZERO_CHUNK = 1024;
+
+void NoteDraft::begin(int width, int height, int tiles) {
+  _width = width;
+  _height = height;
+  _tiles = tiles;
+  _bitmap.assign((tiles + 7) / 8, 0);
+  _held = 0;
+}
+
+// The CRC is the header's last field
+uint16_t NoteDraft::crcOf(const Header &h) {
+  return CRC16::modbus((const uint8_t *)&h, sizeof(h) - sizeof(h.crc));
+}
+
+NoteDraft::Header NoteDraft::header(const Source &source) const {
+  Header h = {};
+  memcpy(h.magic, "M5DRF1", 6);
+  h.width = _width;
+  h.height = _height;
+  h.tile = TileUndo::TILE;
+  h.view = source.view;
+  h.page = source.page;
+  strncpy(h.source, source.name, NAME_LEN - 1);
+  h.crc = crcOf(h);
+  return h;
+}
+
+bool NoteDraft::load(Source &source) {
+  SDAccess sd(sdManager);
+  if (!sd || _bitmap.empty())
+    return false;
+  File file = sdFS().open(PATH, FILE_READ);
+  if (!file)
+    return false;
+
+  Header h;
+  std::vector<uint8_t> bitmap(_bitmap.size());
+  bool ok = file.read((uint8_t *)&h, sizeof(h)) == sizeof(h) &&
+            memcmp(h.magic, "M5DRF1", 6) == 0 &&
+            h.crc == crcOf(h) && h.width == _width &&
+            h.height == _height && h.tile == TileUndo::TILE &&
+            file.read(bitmap.data(), bitmap.size()) == bitmap.size() &&
+            file.size() >= slotOffset(_tiles);
+  file.close();
+  if (!ok)
+    return false;
+
+  _bitmap = bitmap;
+  _held = 0;
+  for (int tile = 0; tile < _tiles; tile++) {
+    if (_bitmap[tile >> 3] & (1 << (tile & 7)))
+      _held++;
+  }
+  memcpy(source.name, h.source, NAME_LEN);
+  source.name[NAME_LEN - 1] = '\0';
+  source.page = h.page;
+  source.view = h.view;
+  return _held > 0;
+}
+
+int NoteDraft::restore(TileUndo &canvas) {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return 0;
+  File file = sdFS().open(PATH, FILE_READ);
+  if (!file)
+    return 0;
+  uint8_t pixels[TILE_BYTES];
+  int restored = 0;
+  for (int tile = 0; tile < _tiles; tile++) {
+    if (!(_bitmap[tile >> 3] & (1 << (tile & 7))))
+      continue;
+    if (!file.seek(slotOffset(tile)) ||
+        file.read(pixels, TILE_BYTES) != TILE_BYTES)
+      break;
+    canvas.writeTile(tile, pixels);
+    restored++;
+  }
+  file.close();
+  return restored;
+}
+
+bool NoteDraft::reset(const Source &source) {
+  if (!storage || _bitmap.empty())
+    return false;
+  std::fill(_bitmap.begin(), _bitmap.end(), 0);
+  _held = 0;
+
+  // Bitmap first: until the header is replaced it still names the old
+  // source, and an empty bitmap over that is only a lost draft
+  Header h = header(source);
+  size_t bitmapLen = _bitmap.size();
+  size_t fileLen = slotOffset(_tiles);
+  return storage->run(
+      PATH,
+      [h, bitmapLen, fileLen](size_t &bytes) {
+        bytes = 0;
+        File file = sdFS().open(PATH, sdFS().exists(PATH) ? "r+" : "w");
+        if (!file)
+          return false;
+        std::vector<uint8_t> zeros(max(ZERO_CHUNK, bitmapLen), 0);
+        bool ok = file.seek(sizeof(Header)) &&
+                  file.write(zeros.data(), bitmapLen) == bitmapLen;
+
+        // The slots are laid out once, so a tile write is always in place
+        if (ok && file.size() < fileLen) {
+          ok = file.seek(file.size());
+          while (ok && file.size() < fileLen)
+            ok = file.write(zeros.data(),
+                            min(ZERO_CHUNK, fileLen - file.size())) > 0;
+        }
+        if (ok) {
+          file.flush();
+          ok = file.seek(0) &&
+               file.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+        }
+        bytes = file.size();
+        file.close();
+        return ok;
+      },
+      nullptr);
+}
+
+bool NoteDraft::save(TileUndo &canvas) {
+  if (!storage || _bitmap.empty() || !canvas.hasChanges())
+    return true;
+
+  std::vector<uint16_t> tiles = canvas.takeChanged();
+  std::vector<uint8_t> pixels(tiles.size() * TILE_BYTES);
+  for (size_t i = 0; i < tiles.size(); i++) {
+    canvas.readTile(tiles[i], &pixels[i * TILE_BYTES]);
+    if (!(_bitmap[tiles[i] >> 3] & (1 << (tiles[i] & 7))))
+      _held++;
+    _bitmap[tiles[i] >> 3] |= 1 << (tiles[i] & 7);
+  }
+
+  // The tiles, then the bitmap that says they are there
+  std::vector<uint8_t> bitmap = _bitmap;
+  size_t base = slotOffset(0);
+  TileUndo *target = &canvas;
+  auto retry = [target, tiles](const StorageResult &result) {
+    if (result.ok)
+      return;
+    Serial.println("Notes: Draft autosave failed");
+    for (uint16_t tile : tiles)
+      target->markChanged(tile);
+  };
+  bool queued = storage->run(
+      PATH,
+      [tiles, pixels, bitmap, base](size_t &bytes) {
+        bytes = 0;
+        File file = sdFS().open(PATH, "r+");
+        if (!file)
+          return false;
+        bool ok = true;
+        for (size_t i = 0; ok && i < tiles.size(); i++)
+          ok = file.seek(base + (size_t)tiles[i] * TILE_BYTES) &&
+               file.write(&pixels[i * TILE_BYTES], TILE_BYTES) == TILE_BYTES;
+        if (ok) {
+          file.flush();
+          ok = file.seek(sizeof(Header)) &&
+               file.write(bitmap.data(), bitmap.size()) == bitmap.size();
+        }
+        file.close();
+        bytes = pixels.size() + bitmap.size();
+        return ok;
+      },
+      retry);
+  if (!queued) {
+    for (uint16_t tile : tiles)
+      canvas.markChanged(tile);
+  }
+  return queued;
+}
@@ -0,0 +1,102 @@
+/**
+ * Note Draft
+ *
+ * The Notes canvas as it is drawn, kept on the card so ink outlives a
+ * sleep or a reset before it is saved. Encoded notes are compressed and
+ * can only be rewritten whole, so the draft is a file of its own,
+ * /notes/draft.ntd, addressed by tile:
+ *
+ *   Header (the note the canvas came from), a bitmap of the tiles held,
+ *   then one fixed TILE_BYTES slot per 32x32 tile, row-major
+ *
+ * An autosave seeks to the slots of the tiles changed since the last one
+ * and writes only those, then the bitmap, on the storage worker: its cost
+ * follows the new ink rather than the page, and the canvas is copied out
+ * first so drawing goes on. Loading or saving a note starts the draft
+ * over against it (a new header, an empty bitmap); restoring puts the
+ * held tiles back over that note once it is on the canvas again.
+ */
+
+#ifndef NOTE_DRAFT_H
+#define NOTE_DRAFT_H
+
+#include "tile_undo.h"
+#include <Arduino.h>
+#include <vector>
+
+class NoteDraft {
+public:
+  static const char *PATH;
+  static const uint32_t AUTOSAVE_MS = 10000;
+  static const int NAME_LEN = 40;
+  static const int TILE_BYTES = TileUndo::TILE_BYTES;
+
+  // What the held tiles go over: a note or notebook under /notes ("" for
+  // a blank page) and, for a notebook, the page. On a page larger than
+  // the screen the tiles are those of the view in front.
+  struct Source {
+    char name[NAME_LEN];
+    int16_t page; // -1 for a single note
+    uint8_t view; // Column << 4 | row of the view (0: the top left)
+  };
+
+  NoteDraft() : _width(0), _height(0), _tiles(0), _held(0) {}
+
+  /**
+   * Size the tile bitmap for the canvas
+   */
+  void begin(int width, int height, int tiles);
+
+  /**
+   * Read the header and bitmap left on the card (on the loop: a few
+   * hundred bytes)
+   * @return true if it holds tiles for a canvas of this size
+   */
+  bool load(Source &source);
+
+  /**
+   * Copy the held tiles into the canvas (on the loop, one read per tile)
+   * @return Tiles restored
+   */
+  int restore(TileUndo &canvas);
+
+  /**
+   * Start over against source: the bitmap is cleared, then the header is
+   * replaced (queued on the storage worker)
+   */
+  bool reset(const Source &source);
+
+  /**
+   * Copy the tiles changed since the last autosave and queue their write.
+   * Tiles that fail to reach the card are flagged changed again.
+   * @return false if the worker queue was full (the tiles stay flagged)
+   */
+  bool save(TileUndo &canvas);
+
+  int heldTiles() const { return _held; }
+
+private:
+  struct __attribute__((packed)) Header {
+    char magic[6]; // "M5DRF1"
+    uint16_t width;
+    uint16_t height;
+    uint8_t tile;
+    uint8_t view; // Source::view (zero in drafts from before pages)
+    int16_t page;
+    char source[NAME_LEN];
+    uint16_t crc; // CRC16 of the bytes before it
+  };
+
+  int _width, _height;
+  int _tiles;
+  std::vector<uint8_t> _bitmap; // Tiles held in the file, as queued
+  int _held;
+
+  size_t slotOffset(int tile) const {
+    return sizeof(Header) + _bitmap.size() + (size_t)tile * TILE_BYTES;
+  }
+  Header header(const Source &source) const;
+  static uint16_t crcOf(const Header &h);
+};
+
+#endif // NOTE_DRAFT_H
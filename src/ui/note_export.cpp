@@ -0,0 +1,342 @@
+/**
+ * Note Export Implementation
+ */
+
+#include "note_export.h"
+#include "../utils/sd_manager.h"
+#include "note_codec.h"
+#include "note_paths.h"
+#include "notebook.h"
+#include <esp_heap_caps.h>
+
+extern SDManager *sdManager;
+
+namespace NoteExport {
+
+static const char *EXPORT_DIR = "/export";
+static const size_t IDAT_CHUNK = 4096; // Deflate output per IDAT chunk
+static const uint32_t ADLER_MOD = 65521;
+static const int ADLER_BLOCK = 5552; // Sums fit 32 bits this long
+
+// CRC-32 (PNG chunks), half a byte at a time
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len) {
+  static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+      0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = table[crc & 0x0F] ^ (crc >> 4);
+    crc = table[crc & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+static void putBE32(uint8_t *out, uint32_t v) {
+  out[0] = v >> 24;
+  out[1] = v >> 16;
+  out[2] = v >> 8;
+  out[3] = v;
+}
+
+static bool writeChunk(File &file, const char *type, const uint8_t *data,
+                       size_t len, size_t &bytes) {
+  uint8_t head[8];
+  putBE32(head, len);
+  memcpy(head + 4, type, 4);
+  uint8_t tail[4];
+  putBE32(tail, crc32(crc32(0, head + 4, 4), data, len));
+  bool ok = file.write(head, 8) == 8 &&
+            (len == 0 || file.write(data, len) == len) &&
+            file.write(tail, 4) == 4;
+  bytes += 12 + len;
+  return ok;
+}
+
+// zlib stream of one fixed-Huffman deflate block, written out as IDAT
+// chunks. The only matches are runs (distance 1), which is what filtered
+// rows of mostly blank paper are made of.
+class Deflater {
+public:
+  Deflater(File &file, uint8_t *buffer)
+      : _file(file), _buffer(buffer), _used(0), _bits(0), _bitCount(0),
+        _prev(-1), _run(0), _a(1), _b(0), _adlerCount(0), _ok(true),
+        _bytes(0) {
+    putByte(0x78); // zlib: deflate, 32K window
+    putByte(0x01);
+    putBits(1, 1); // Final block
+    putBits(1, 2); // Fixed Huffman codes
+  }
+
+  void put(uint8_t v) {
+    _a += v;
+    _b += _a;
+    if (++_adlerCount == ADLER_BLOCK) {
+      _a %= ADLER_MOD;
+      _b %= ADLER_MOD;
+      _adlerCount = 0;
+    }
+
+    if (_prev == v) {
+      if (++_run == 258)
+        flushRun();
+      return;
+    }
+    flushRun();
+    literal(v);
+    _prev = v;
+  }
+
+  bool finish(size_t &bytes) {
+    flushRun();
+    symbol(256); // End of block
+    if (_bitCount)
+      putBits(0, 8 - _bitCount);
+    uint8_t adler[4];
+    putBE32(adler, (_b % ADLER_MOD) << 16 | (_a % ADLER_MOD));
+    for (uint8_t v : adler)
+      putByte(v);
+    flushChunk();
+    bytes += _bytes;
+    return _ok;
+  }
+
+private:
+  File &_file;
+  uint8_t *_buffer; // IDAT_CHUNK bytes
+  size_t _used;
+  uint32_t _bits;
+  int _bitCount;
+  int _prev; // Last byte, -1 before the first
+  int _run;  // Repeats of _prev not yet coded
+  uint32_t _a, _b;
+  int _adlerCount;
+  bool _ok;
+  size_t _bytes;
+
+  void flushChunk() {
+    if (_used && !writeChunk(_file, "IDAT", _buffer, _used, _bytes))
+      _ok = false;
+    _used = 0;
+  }
+
+  void putByte(uint8_t v) {
+    _buffer[_used++] = v;
+    if (_used == IDAT_CHUNK)
+      flushChunk();
+  }
+
+  void putBits(uint32_t value, int count) {
+    _bits |= value << _bitCount;
+    _bitCount += count;
+    while (_bitCount >= 8) {
+      putByte(_bits & 0xFF);
+      _bits >>= 8;
+      _bitCount -= 8;
+    }
+  }
+
+  // Huffman codes go most significant bit first
+  void putCode(uint32_t code, int count) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < count; i++)
+      reversed |= ((code >> i) & 1) << (count - 1 - i);
+    putBits(reversed, count);
+  }
+
+  void symbol(int s) {
+    if (s < 144)
+      putCode(0x30 + s, 8);
+    else if (s < 256)
+      putCode(0x190 + s - 144, 9);
+    else if (s < 280)
+      putCode(s - 256, 7);
+    else
+      putCode(0xC0 + s - 280, 8);
+  }
+
+  void literal(uint8_t v) { symbol(v); }
+
+  void match(int length) {
+    static const uint16_t base[] = {3,  4,  5,  6,  7,  8,  9,  10,
+                                    11, 13, 15, 17, 19, 23, 27, 31,
+                                    35, 43, 51, 59, 67, 83, 99, 115,
+                                    131, 163, 195, 227};
+    if (length == 258) {
+      symbol(285);
+    } else {
+      int i = 27;
+      while (base[i] > length)
+        i--;
+      symbol(257 + i);
+      int extra = i < 8 ? 0 : (i - 4) / 4;
+      if (extra)
+        putBits(length - base[i], extra);
+    }
+    putCode(0, 5); // Distance 1
+  }
+
+  void flushRun() {
+    if (_run >= 3)
+      match(_run);
+    else
+      for (int i = 0; i < _run; i++)
+        literal(_prev);
+    _run = 0;
+  }
+};
+
+static bool writePng(File &file, const uint8_t *pixels, int width, int height,
+                     size_t &bytes) {
+  static const uint8_t SIGNATURE[8] = {0x89, 'P',  'N',  'G',
+                                       0x0D, 0x0A, 0x1A, 0x0A};
+  bool ok = file.write(SIGNATURE, 8) == 8;
+  bytes += 8;
+
+  uint8_t ihdr[13];
+  putBE32(ihdr, width);
+  putBE32(ihdr + 4, height);
+  ihdr[8] = 4;  // Bits per pixel
+  ihdr[9] = 0;  // Greyscale
+  ihdr[10] = 0; // Deflate
+  ihdr[11] = 0; // Adaptive filtering
+  ihdr[12] = 0; // Not interlaced
+  ok = ok && writeChunk(file, "IHDR", ihdr, sizeof(ihdr), bytes);
+
+  uint8_t *buffer = (uint8_t *)malloc(IDAT_CHUNK);
+  if (!ok || !buffer) {
+    free(buffer);
+    return false;
+  }
+
+  // Up filter: a row repeating the one above becomes zeros
+  size_t rowBytes = (width + 1) / 2;
+  Deflater deflater(file, buffer);
+  for (int y = 0; y < height; y++) {
+    const uint8_t *row = pixels + y * rowBytes;
+    const uint8_t *above = y ? row - rowBytes : nullptr;
+    deflater.put(2);
+    for (size_t x = 0; x < rowBytes; x++)
+      deflater.put(above ? row[x] - above[x] : row[x]);
+  }
+  ok = deflater.finish(bytes);
+  free(buffer);
+  return ok && writeChunk(file, "IEND", nullptr, 0, bytes);
+}
+
+static bool writePbm(File &file, const uint8_t *pixels, int width, int height,
+                     size_t &bytes) {
+  char header[24];
+  int headerLen = snprintf(header, sizeof(header), "P4\n%d %d\n", width,
+                           height);
+  bool ok = file.write((const uint8_t *)header, headerLen) == (size_t)headerLen;
+  bytes += headerLen;
+
+  size_t outBytes = (width + 7) / 8;
+  uint8_t *out = (uint8_t *)malloc(outBytes);
+  if (!out)
+    return false;
+  size_t rowBytes = (width + 1) / 2;
+  for (int y = 0; ok && y < height; y++) {
+    const uint8_t *row = pixels + y * rowBytes;
+    memset(out, 0, outBytes);
+    for (int x = 0; x < width; x++) {
+      uint8_t v = x & 1 ? row[x >> 1] & 0x0F : row[x >> 1] >> 4;
+      if (v < 8)
+        out[x >> 3] |= 0x80 >> (x & 7); // 1 is black
+    }
+    ok = file.write(out, outBytes) == outBytes;
+    bytes += outBytes;
+  }
+  free(out);
+  return ok;
+}
+
+bool writeImage(const uint8_t *pixels, int width, int height, Format format,
+                const char *path, size_t &bytes) {
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("Export: Cannot create %s\n", path);
+    return false;
+  }
+  size_t written = 0;
+  bool ok = format == Format::PNG
+                ? writePng(file, pixels, width, height, written)
+                : writePbm(file, pixels, width, height, written);
+  file.close();
+  if (!ok) {
+    Serial.printf("Export: Writing %s failed\n", path);
+    sdFS().remove(path);
+    return false;
+  }
+  bytes += written;
+  Serial.printf("Export: %s (%u bytes)\n", path, (unsigned)written);
+  return true;
+}
+
+// Decode one note file (v1 or v2) and write it as an image
+static bool exportPage(const uint8_t *file, size_t len, Format format,
+                       const char *path, size_t &bytes) {
+  uint16_t width, height;
+  uint8_t depth;
+  if (!NoteCodec::peek(file, len, width, height, depth)) {
+    Serial.printf("Export: %s is not a note\n", path);
+    return false;
+  }
+  uint8_t *pixels = (uint8_t *)heap_caps_malloc((width + 1) / 2 * height,
+                                                MALLOC_CAP_SPIRAM);
+  bool ok = pixels && NoteCodec::decode(file, len, pixels, width, height, 4) &&
+            writeImage(pixels, width, height, format, path, bytes);
+  free(pixels);
+  return ok;
+}
+
+static uint8_t *readAt(File &file, uint32_t offset, size_t len) {
+  uint8_t *data = (uint8_t *)heap_caps_malloc(len ? len : 1,
+                                              MALLOC_CAP_SPIRAM);
+  if (data && file.seek(offset) && file.read(data, len) == len)
+    return data;
+  free(data);
+  return nullptr;
+}
+
+bool exportNote(const char *name, Format format, size_t &bytes) {
+  bytes = 0;
+  if (!sdManager || !sdManager->ensureDirectory(EXPORT_DIR))
+    return false;
+
+  String source = NotePaths::resolve(name).c_str();
+  String base = String(EXPORT_DIR) + "/" + name;
+  base = base.substring(0, base.lastIndexOf('.'));
+  const char *ext = format == Format::PNG ? "png" : "pbm";
+
+  File file = sdFS().open(source, FILE_READ);
+  if (!file)
+    return false;
+
+  if (!Notebook::isNotebook(name)) {
+    uint8_t *data = readAt(file, 0, file.size());
+    size_t len = file.size();
+    file.close();
+    String path = base + "." + ext;
+    bool ok = data && exportPage(data, len, format, path.c_str(), bytes);
+    free(data);
+    return ok;
+  }
+
+  Notebook book;
+  bool ok = book.open(source.c_str()) && book.pageCount() > 0;
+  for (int p = 0; ok && p < book.pageCount(); p++) {
+    const Notebook::PageRef &page = book.page(p);
+    uint8_t *data = readAt(file, page.offset, page.length);
+    String path = base + "_p" + String(p + 1) + "." + ext;
+    ok = data && Notebook::verify(page, data, page.length) &&
+         exportPage(data, page.length, format, path.c_str(), bytes);
+    free(data);
+  }
+  file.close();
+  return ok;
+}
+
+} // namespace NoteExport
@@ -0,0 +1,43 @@
+/**
+ * Note Export
+ *
+ * Writes notes out as ordinary images that open on any computer:
+ *
+ *   PBM: 1-bit P4 bitmap, ink below mid-grey is black
+ *   PNG: 4-bit greyscale, Up-filtered rows, deflate with fixed Huffman
+ *        codes and run-length matches (blank paper packs to almost
+ *        nothing)
+ *
+ * Both stream one row at a time through a small buffer. Exports go to
+ * /export/<note>.<ext>; a notebook gives one file per page
+ * (<book>_p<n>.<ext>). The file work does not touch the UI, so it runs as
+ * a StorageWorker job.
+ */
+
+#ifndef NOTE_EXPORT_H
+#define NOTE_EXPORT_H
+
+#include <Arduino.h>
+
+namespace NoteExport {
+
+enum class Format { PBM, PNG };
+
+/**
+ * Write a 4-bit canvas buffer (left pixel in the high nibble) to path on
+ * the SD card. The caller holds SDAccess.
+ * @param bytes Set to the file length
+ */
+bool writeImage(const uint8_t *pixels, int width, int height, Format format,
+                const char *path, size_t &bytes);
+
+/**
+ * Decode a note or notebook under /notes and write each page to /export
+ * @param name File name within /notes
+ * @param bytes Total bytes written
+ */
+bool exportNote(const char *name, Format format, size_t &bytes);
+
+} // namespace NoteExport
+
+#endif // NOTE_EXPORT_H
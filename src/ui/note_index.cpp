@@ -0,0 +1,220 @@
+/**
+ * Note Index Implementation
+ */
+
+#include "note_index.h"
+#include "note_codec.h"
+#include "note_paths.h"
+#include "../utils/crc16.h"
+#include "../utils/sd_manager.h"
+#include <algorithm>
+
+extern SDManager *sdManager;
+
+#define NOTE_INDEX_MAGIC 0x5844494E // "NIDX"
+#define NOTE_INDEX_VERSION 1
+
+static const char *NOTES_DIR = NotePaths::DIR;
+static const char *INDEX_PATH = "/notes/.index";
+
+struct IndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entrySize; // Catches a layout change without a version bump
+  uint32_t count;
+  uint16_t crc; // CRC16 of the entries
+  uint16_t reserved;
+};
+
+// Days from 1970-01-01 to a civil date (proleptic Gregorian)
+static int32_t daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  int32_t era = (y >= 0 ? y : y - 399) / 400;
+  int32_t yoe = y - era * 400;
+  int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+uint32_t NoteIndex::parseTimestamp(const char *name, uint32_t fallback) {
+  // note_YYYYMMDD_HHMMSS.bin, or book_... for a notebook
+  int y, mo, d, h, mi, s;
+  if ((strncmp(name, "note_", 5) != 0 && strncmp(name, "book_", 5) != 0) ||
+      sscanf(name + 5, "%4d%2d%2d_%2d%2d%2d", &y, &mo, &d, &h, &mi, &s) != 6 ||
+      y < 1970 || mo < 1 || mo > 12 || d < 1 || d > 31)
+    return fallback;
+  return (uint32_t)daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s;
+}
+
+void NoteIndex::insertSorted(const Entry &entry) {
+  // Newest first; equal timestamps fall back to the name, like the old
+  // descending name sort
+  auto newer = [](const Entry &a, const Entry &b) {
+    if (a.timestamp != b.timestamp)
+      return a.timestamp > b.timestamp;
+    return strcmp(a.name, b.name) > 0;
+  };
+  _entries.insert(
+      std::upper_bound(_entries.begin(), _entries.end(), entry, newer), entry);
+}
+
+bool NoteIndex::read() {
+  File file = sdFS().open(INDEX_PATH, FILE_READ);
+  if (!file)
+    return false;
+
+  IndexHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == NOTE_INDEX_MAGIC &&
+            header.version == NOTE_INDEX_VERSION &&
+            header.entrySize == sizeof(Entry) &&
+            file.size() == sizeof(header) + header.count * sizeof(Entry);
+  if (ok) {
+    _entries.resize(header.count);
+    size_t bytes = header.count * sizeof(Entry);
+    ok = file.read((uint8_t *)_entries.data(), bytes) == bytes &&
+         CRC16::modbus((const uint8_t *)_entries.data(), bytes) == header.crc;
+  }
+  file.close();
+  if (!ok) {
+    Serial.println("Notes: Index invalid, rebuilding");
+    _entries.clear();
+  }
+  return ok;
+}
+
+void NoteIndex::addFile(File &file) {
+  const char *name = NotePaths::nameOf(file.name()); // Older cores: paths
+  size_t len = strlen(name);
+  if (file.isDirectory() || len <= 4 || len >= MAX_NAME ||
+      (strcmp(name + len - 4, ".bin") != 0 &&
+       strcmp(name + len - 4, ".nbk") != 0))
+    return;
+  Entry entry = {};
+  strcpy(entry.name, name);
+  entry.timestamp = parseTimestamp(name, (uint32_t)file.getLastWrite());
+  entry.size = file.size();
+  if (strcmp(name + len - 4, ".bin") == 0) {
+    uint8_t header[sizeof(NoteCodec::Header)] = {0};
+    size_t got = file.read(header, sizeof(header));
+    entry.dataOffset = NoteCodec::dataOffset(header, got);
+  } // A notebook's pages each have their own header
+  insertSorted(entry);
+}
+
+// The month directories (/notes/YYYY/MM), and any note still directly in
+// /notes
+bool NoteIndex::rebuild() {
+  _entries.clear();
+  if (!sdFS().exists(NOTES_DIR))
+    return true; // Nothing saved yet
+
+  File root = sdFS().open(NOTES_DIR);
+  if (!root || !root.isDirectory()) {
+    Serial.println("Notes: Failed to open /notes directory");
+    return false;
+  }
+
+  for (File year = root.openNextFile(); year; year = root.openNextFile()) {
+    if (!year.isDirectory()) {
+      addFile(year);
+      year.close();
+      continue;
+    }
+    for (File month = year.openNextFile(); month;
+         month = year.openNextFile()) {
+      if (month.isDirectory()) {
+        for (File file = month.openNextFile(); file;
+             file = month.openNextFile()) {
+          addFile(file);
+          file.close();
+        }
+      }
+      month.close();
+    }
+    year.close();
+  }
+  root.close();
+
+  Serial.printf("Notes: Indexed %d files\n", _entries.size());
+  return persist();
+}
+
+bool NoteIndex::persist() {
+  IndexHeader header = {};
+  header.magic = NOTE_INDEX_MAGIC;
+  header.version = NOTE_INDEX_VERSION;
+  header.entrySize = sizeof(Entry);
+  header.count = _entries.size();
+  size_t bytes = _entries.size() * sizeof(Entry);
+  header.crc = CRC16::modbus((const uint8_t *)_entries.data(), bytes);
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  File file = sdFS().open(INDEX_PATH, FILE_WRITE);
+  if (!file) {
+    sd.fail();
+    return false;
+  }
+  size_t written = file.write((const uint8_t *)&header, sizeof(header));
+  if (bytes)
+    written += file.write((const uint8_t *)_entries.data(), bytes);
+  file.close();
+  if (written != sizeof(header) + bytes) {
+    Serial.println("Notes: Failed to write index");
+    sd.fail();
+    return false;
+  }
+  return true;
+}
+
+bool NoteIndex::load() {
+  if (!sdManager)
+    return false;
+  if (_loaded && _generation == sdManager->getMountGeneration())
+    return true;
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  // Recovery inside SDAccess may itself have remounted: take the
+  // generation after it
+  _generation = sdManager->getMountGeneration();
+  _loaded = read() || rebuild();
+  return _loaded;
+}
+
+void NoteIndex::insert(const char *name, uint32_t size, uint16_t dataOffset) {
+  if (strlen(name) >= MAX_NAME)
+    return;
+  if (!_loaded && !load())
+    return;
+
+  Entry entry = {};
+  strcpy(entry.name, name);
+  entry.timestamp = parseTimestamp(name, 0);
+  entry.size = size;
+  entry.dataOffset = dataOffset;
+
+  // Saving within the same second replaces the file
+  for (size_t i = 0; i < _entries.size(); i++) {
+    if (strcmp(_entries[i].name, name) == 0) {
+      _entries.erase(_entries.begin() + i);
+      break;
+    }
+  }
+  insertSorted(entry);
+  persist();
+}
+
+bool NoteIndex::remove(const char *name) {
+  for (size_t i = 0; i < _entries.size(); i++) {
+    if (strcmp(_entries[i].name, name) == 0) {
+      _entries.erase(_entries.begin() + i);
+      persist();
+      return true;
+    }
+  }
+  return false;
+}
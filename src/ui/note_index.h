@@ -0,0 +1,68 @@
+/**
+ * Note Index
+ *
+ * Persisted, newest-first list of the note files and notebooks under
+ * /notes (/notes/.index), by bare name: NotePaths says where each one is.
+ * Loaded with one read instead of walking the directories, and kept in
+ * order by inserting each save at its timestamp. It is rebuilt from the
+ * directories only when the file is missing or fails its CRC.
+ */
+
+#ifndef NOTE_INDEX_H
+#define NOTE_INDEX_H
+
+#include "../utils/fixed_string.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+
+class NoteIndex {
+public:
+  static const int MAX_NAME = 32;
+  typedef FixedString<MAX_NAME> Name; // A file name, without the heap
+
+  struct Entry {
+    char name[MAX_NAME]; // File name, without its directory
+    uint32_t timestamp;  // Unix time, from the note_YYYYMMDD_HHMMSS name
+    uint32_t size;       // Header + pixels, in bytes
+    uint16_t dataOffset; // Where the pixels (v1) or tile bitmap (v2) start
+  };
+
+  NoteIndex() : _loaded(false), _generation(0) {}
+
+  /**
+   * Make the index available, reading it (or rebuilding it) on first use
+   * and after a remount, which may be a different card. Otherwise the copy
+   * in RAM is used as is.
+   * @return false if the card is unavailable
+   */
+  bool load();
+
+  /**
+   * Add or update a note after it has been written
+   * @param dataOffset Length of the file's header
+   */
+  void insert(const char *name, uint32_t size, uint16_t dataOffset);
+
+  /**
+   * Drop a note after it has been deleted
+   */
+  bool remove(const char *name);
+
+  size_t size() const { return _entries.size(); }
+  const Entry &operator[](size_t i) const { return _entries[i]; }
+
+private:
+  std::vector<Entry> _entries; // Newest first
+  bool _loaded;
+  uint32_t _generation; // SD mount the RAM copy was read from
+
+  bool read();
+  bool rebuild();
+  void addFile(File &file); // One file found by rebuild()
+  bool persist();
+  void insertSorted(const Entry &entry);
+  static uint32_t parseTimestamp(const char *name, uint32_t fallback);
+};
+
+#endif // NOTE_INDEX_H
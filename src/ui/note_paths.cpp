@@ -0,0 +1,87 @@
+/**
+ * Note Paths Implementation
+ */
+
+#include "note_paths.h"
+#include "note_index.h"
+#include "../utils/sd_manager.h"
+#include <vector>
+
+extern SDManager *sdManager;
+
+namespace NotePaths {
+
+static int _shardMade = 0; // YYYYMM of the last directory made
+
+bool dateOf(const char *name, int &year, int &month) {
+  if (strncmp(name, "note_", 5) != 0 && strncmp(name, "book_", 5) != 0)
+    return false;
+  return sscanf(name + 5, "%4d%2d", &year, &month) == 2 && year >= 1970 &&
+         month >= 1 && month <= 12;
+}
+
+Path resolve(const char *name) {
+  int year, month;
+  if (!dateOf(name, year, month))
+    return Path::format("%s/%s", DIR, name);
+  return Path::format("%s/%04d/%02d/%s", DIR, year, month, name);
+}
+
+const char *nameOf(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+bool makeShard(const char *name) {
+  int year, month;
+  if (!dateOf(name, year, month) || year * 100 + month == _shardMade)
+    return true;
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  Path dir = Path::format("%s/%04d", DIR, year);
+  if (!sdFS().exists(dir) && !sdFS().mkdir(dir))
+    return false;
+  dir.appendf("/%02d", month);
+  if (!sdFS().exists(dir) && !sdFS().mkdir(dir))
+    return false;
+  _shardMade = year * 100 + month;
+  return true;
+}
+
+int migrate() {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return 0;
+  File root = sdFS().open(DIR);
+  if (!root || !root.isDirectory())
+    return 0;
+
+  // Names first: the directory is not walked while it changes
+  std::vector<NoteIndex::Name> flat;
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    const char *name = nameOf(f.name()); // Older cores return full paths
+    int year, month;
+    if (!f.isDirectory() && dateOf(name, year, month) &&
+        strlen(name) < NoteIndex::MAX_NAME)
+      flat.emplace_back(name);
+    f.close();
+  }
+  root.close();
+
+  int moved = 0;
+  for (const NoteIndex::Name &name : flat) {
+    Path from = Path::format("%s/%s", DIR, name.c_str());
+    Path to = resolve(name);
+    if (makeShard(name) && sdFS().rename(from, to))
+      moved++;
+    else
+      Serial.printf("Notes: Could not move %s to %s\n", from.c_str(),
+                    to.c_str());
+  }
+  if (moved)
+    Serial.printf("Notes: Moved %d files into month directories\n", moved);
+  return moved;
+}
+
+} // namespace NotePaths
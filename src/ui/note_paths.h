@@ -0,0 +1,60 @@
+/**
+ * Note Paths
+ *
+ * Where a note lives on the card. Notes are named for the time they were
+ * made (note_YYYYMMDD_HHMMSS.bin, book_... for a notebook, .stk for a
+ * stroke log) and kept one directory per month, /notes/YYYY/MM/, so no
+ * directory grows past a month of notes: FAT looks names up by walking
+ * the directory, and an open() or exists() in a flat /notes slowed down
+ * with every note ever saved.
+ *
+ * Everything else names notes as the bare file name (the index, the
+ * browser, the draft); resolve() turns one into its path. Names without
+ * a date stay directly in /notes.
+ */
+
+#ifndef NOTE_PATHS_H
+#define NOTE_PATHS_H
+
+#include "../utils/fixed_string.h"
+#include <Arduino.h>
+
+namespace NotePaths {
+
+static const char *const DIR = "/notes";
+
+typedef FixedString<64> Path;
+
+/**
+ * Year and month a note's name carries
+ * @return false if it has none (not a note_/book_ name)
+ */
+bool dateOf(const char *name, int &year, int &month);
+
+/**
+ * /notes/YYYY/MM/name, or /notes/name for a name without a date
+ */
+Path resolve(const char *name);
+
+/**
+ * The bare file name of a note path (everything after the last '/')
+ */
+const char *nameOf(const char *path);
+
+/**
+ * Create the month directory name belongs in (under SDAccess). Remembers
+ * the last one made, so repeated saves cost nothing.
+ */
+bool makeShard(const char *name);
+
+/**
+ * Move notes still in the flat /notes into their month directories, once
+ * after an update (a pass over /notes finds nothing to move after that).
+ * Runs at boot, before the index or the UI look at the card.
+ * @return Files moved
+ */
+int migrate();
+
+} // namespace NotePaths
+
+#endif // NOTE_PATHS_H
@@ -0,0 +1,224 @@
+/**
+ * Notebook Implementation
+ */
+
+#include "notebook.h"
+#include "../utils/crc16.h"
+#include "../utils/sd_manager.h"
+
+extern SDManager *sdManager;
+
+#define NOTEBOOK_MAGIC 0x4B42544E // "NTBK"
+#define NOTEBOOK_VERSION 1
+
+struct __attribute__((packed)) NotebookHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t pages;
+  uint32_t tableOffset;
+  uint16_t tableCrc; // CRC16 of the page table
+  uint16_t reserved;
+};
+static_assert(sizeof(NotebookHeader) == 16, "Header layout is on disk");
+
+static const size_t COPY_CHUNK = 4096;
+
+static uint32_t liveBytes(const std::vector<Notebook::PageRef> &pages) {
+  uint32_t bytes = sizeof(NotebookHeader) +
+                   pages.size() * sizeof(Notebook::PageRef);
+  for (const Notebook::PageRef &page : pages)
+    bytes += page.length;
+  return bytes;
+}
+
+bool Notebook::open(const char *path) {
+  close();
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+
+  // A compaction interrupted between remove and rename leaves the temp file
+  String tempPath = String(path) + ".tmp";
+  File file = sdFS().open(path, FILE_READ);
+  if (!file && sdFS().exists(tempPath.c_str()))
+    file = sdFS().open(tempPath.c_str(), FILE_READ);
+  if (!file)
+    return false;
+
+  NotebookHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == NOTEBOOK_MAGIC &&
+            header.version == NOTEBOOK_VERSION &&
+            header.pages <= MAX_PAGES &&
+            header.tableOffset + header.pages * sizeof(PageRef) <=
+                file.size() &&
+            file.seek(header.tableOffset);
+  if (ok) {
+    _pages.resize(header.pages);
+    size_t bytes = header.pages * sizeof(PageRef);
+    ok = file.read((uint8_t *)_pages.data(), bytes) == bytes &&
+         CRC16::modbus((const uint8_t *)_pages.data(), bytes) ==
+             header.tableCrc;
+  }
+  file.close();
+  if (!ok) {
+    Serial.printf("Notes: Notebook %s is invalid\n", path);
+    _pages.clear();
+    return false;
+  }
+  _path = path;
+  _liveBytes = liveBytes(_pages);
+  return true;
+}
+
+bool Notebook::create(const char *path) {
+  close();
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  File file = sdFS().open(path, FILE_WRITE);
+  if (!file) {
+    sd.fail();
+    return false;
+  }
+  NotebookHeader header = {};
+  header.magic = NOTEBOOK_MAGIC;
+  header.version = NOTEBOOK_VERSION;
+  header.tableOffset = sizeof(header);
+  header.tableCrc = CRC16::modbus(nullptr, 0);
+  bool ok = file.write((const uint8_t *)&header, sizeof(header)) ==
+            sizeof(header);
+  file.close();
+  if (!ok) {
+    sd.fail();
+    return false;
+  }
+  _path = path;
+  _liveBytes = sizeof(header);
+  return true;
+}
+
+void Notebook::close() {
+  _path = "";
+  _pages.clear();
+  _liveBytes = 0;
+}
+
+bool Notebook::verify(const PageRef &page, const uint8_t *data, size_t len) {
+  return data && len == page.length && CRC16::modbus(data, len) == page.crc;
+}
+
+bool Notebook::writePage(int index, const uint8_t *data, size_t len) {
+  if (!isOpen() || index < 0 || index > pageCount() || index >= MAX_PAGES)
+    return false;
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  File file = sdFS().open(_path.c_str(), "r+");
+  if (!file) {
+    sd.fail();
+    return false;
+  }
+
+  // New page, then the new table after it; the header still points at
+  // the old table until both are down
+  std::vector<PageRef> pages = _pages;
+  PageRef ref = {(uint32_t)file.size(), (uint32_t)len,
+                 CRC16::modbus(data, len), 0};
+  if (index == pageCount())
+    pages.push_back(ref);
+  else
+    pages[index] = ref;
+
+  size_t tableBytes = pages.size() * sizeof(PageRef);
+  NotebookHeader header = {};
+  header.magic = NOTEBOOK_MAGIC;
+  header.version = NOTEBOOK_VERSION;
+  header.pages = pages.size();
+  header.tableOffset = ref.offset + len;
+  header.tableCrc = CRC16::modbus((const uint8_t *)pages.data(), tableBytes);
+
+  bool ok = file.seek(ref.offset) && file.write(data, len) == len &&
+            file.write((const uint8_t *)pages.data(), tableBytes) ==
+                tableBytes;
+  if (ok) {
+    file.flush();
+    ok = file.seek(0) && file.write((const uint8_t *)&header,
+                                    sizeof(header)) == sizeof(header);
+  }
+  uint32_t fileBytes = file.size();
+  file.close();
+  if (!ok) {
+    Serial.printf("Notes: Failed to write page %d of %s\n", index + 1,
+                  _path.c_str());
+    sd.fail();
+    return false;
+  }
+
+  _pages = pages;
+  _liveBytes = liveBytes(_pages);
+  if (fileBytes > 2 * _liveBytes)
+    compact();
+  return true;
+}
+
+// Rewrite the file with only the current pages
+bool Notebook::compact() {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  String tempPath = _path + ".tmp";
+  File in = sdFS().open(_path.c_str(), FILE_READ);
+  File out = sdFS().open(tempPath.c_str(), FILE_WRITE);
+  uint8_t *chunk = (uint8_t *)malloc(COPY_CHUNK);
+  bool ok = in && out && chunk;
+
+  std::vector<PageRef> pages = _pages;
+  NotebookHeader header = {};
+  if (ok)
+    ok = out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  uint32_t at = sizeof(header);
+  for (size_t p = 0; ok && p < pages.size(); p++) {
+    ok = in.seek(pages[p].offset);
+    for (uint32_t done = 0; ok && done < pages[p].length;) {
+      size_t n = min((size_t)(pages[p].length - done), COPY_CHUNK);
+      ok = in.read(chunk, n) == n && out.write(chunk, n) == n;
+      done += n;
+    }
+    pages[p].offset = at;
+    at += pages[p].length;
+  }
+
+  size_t tableBytes = pages.size() * sizeof(PageRef);
+  header.magic = NOTEBOOK_MAGIC;
+  header.version = NOTEBOOK_VERSION;
+  header.pages = pages.size();
+  header.tableOffset = at;
+  header.tableCrc = CRC16::modbus((const uint8_t *)pages.data(), tableBytes);
+  if (ok)
+    ok = out.write((const uint8_t *)pages.data(), tableBytes) == tableBytes &&
+         out.seek(0) &&
+         out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  free(chunk);
+  if (in)
+    in.close();
+  if (out)
+    out.close();
+
+  if (!ok) {
+    Serial.printf("Notes: Compacting %s failed\n", _path.c_str());
+    sdFS().remove(tempPath.c_str());
+    return false;
+  }
+  // FAT cannot rename over a file; open() falls back to the temp file
+  sdFS().remove(_path.c_str());
+  if (!sdFS().rename(tempPath.c_str(), _path.c_str())) {
+    sd.fail();
+    return false;
+  }
+  _pages = pages;
+  Serial.printf("Notes: Compacted %s to %u bytes\n", _path.c_str(),
+                (unsigned)_liveBytes);
+  return true;
+}
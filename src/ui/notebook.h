@@ -0,0 +1,71 @@
+/**
+ * Notebook
+ *
+ * Multi-page note container (/notes/book_YYYYMMDD_HHMMSS.nbk). Each page
+ * is a complete v2 note (NoteCodec, tile-compressed with a thumbnail)
+ * stored back to back; a page table at the end of the file gives each
+ * page's offset, length and CRC. Pages are read one at a time with a
+ * ranged read, so opening a notebook costs the header and table only.
+ *
+ * A page write appends the new page and a new table, then repoints the
+ * header: the old table stays valid until that last 16-byte write. The
+ * file is compacted once superseded pages make up half of it.
+ */
+
+#ifndef NOTEBOOK_H
+#define NOTEBOOK_H
+
+#include <Arduino.h>
+#include <vector>
+
+class Notebook {
+public:
+  static const int MAX_PAGES = 64;
+
+  struct __attribute__((packed)) PageRef {
+    uint32_t offset;
+    uint32_t length;
+    uint16_t crc; // CRC16 of the page
+    uint16_t reserved;
+  };
+
+  Notebook() : _liveBytes(0) {}
+
+  /**
+   * Read the header and page table
+   */
+  bool open(const char *path);
+
+  /**
+   * Start an empty notebook at path
+   */
+  bool create(const char *path);
+
+  void close();
+  bool isOpen() const { return _path.length() > 0; }
+  const String &path() const { return _path; }
+
+  int pageCount() const { return _pages.size(); }
+  const PageRef &page(int index) const { return _pages[index]; }
+
+  /**
+   * Replace page index, or append it when index == pageCount()
+   */
+  bool writePage(int index, const uint8_t *data, size_t len);
+
+  /**
+   * Check a page read back with a ranged read against its table entry
+   */
+  static bool verify(const PageRef &page, const uint8_t *data, size_t len);
+
+  static bool isNotebook(const String &name) { return name.endsWith(".nbk"); }
+
+private:
+  String _path;
+  std::vector<PageRef> _pages;
+  uint32_t _liveBytes; // Header, current pages and table
+
+  bool compact();
+};
+
+#endif // NOTEBOOK_H
@@ -0,0 +1,50 @@
+/**
+ * Pen Width
+ *
+ * Maps the GT911 contact size of a touch sample to a line width around
+ * the selected pen size: a light touch draws thinner, a firm or broad one
+ * thicker. The curve is worked out once per pen change into a table, so a
+ * sample costs one clamp and one lookup.
+ */
+
+#ifndef PEN_WIDTH_H
+#define PEN_WIDTH_H
+
+#include <Arduino.h>
+
+class PenWidth {
+public:
+  static const int LEVELS = 64;      // Contact sizes above this clamp
+  static const int REFERENCE = 16;   // Contact size that draws the pen size
+  static const int MAX_WIDTH = 24;
+
+  PenWidth() { set(2, false); }
+
+  /**
+   * Rebuild the table for a pen
+   * @param varying false draws every sample at size (the eraser)
+   */
+  void set(int size, bool varying) {
+    _varying = varying;
+    int lo = max(1, size / 2);
+    int hi = size * 2 < MAX_WIDTH ? size * 2 : MAX_WIDTH;
+    for (int i = 0; i < LEVELS; i++) {
+      // Contact 0 is "not reported": the pen size itself
+      float scale = 0.5f + 0.5f * i / REFERENCE;
+      int w = (varying && i > 0) ? (int)(size * scale + 0.5f) : size;
+      _table[i] = constrain(w, lo, hi);
+    }
+  }
+
+  bool isVarying() const { return _varying; }
+
+  uint8_t width(uint16_t contact) const {
+    return _table[contact < LEVELS ? contact : LEVELS - 1];
+  }
+
+private:
+  uint8_t _table[LEVELS];
+  bool _varying;
+};
+
+#endif // PEN_WIDTH_H
@@ -0,0 +1,158 @@
+/**
+ * Photo Cache Implementation
+ */
+
+#include "photo_cache.h"
+#include "../utils/log.h"
+#include "../utils/loop_monitor.h"
+#include "../utils/mem_telemetry.h"
+#include "../utils/sd_manager.h"
+
+extern SDManager *sdManager;
+
+namespace PhotoCache {
+
+static const uint32_t RENDITION_MAGIC = 0x31523450; // "P4R1"
+static const uint16_t RENDITION_VERSION = 1;
+
+struct RenditionHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t width;
+  uint16_t height;
+  uint16_t stride; // Bytes per row of packed pixels
+  uint32_t sourceSize;
+  uint32_t sourceTime; // Modification time of the photo
+};
+
+static bool isPng(const char *name) {
+  const char *dot = strrchr(name, '.');
+  return dot && strcasecmp(dot, ".png") == 0;
+}
+
+bool dither(const uint8_t *grey, int w, int h, uint8_t *out, int stride) {
+  // Error carried to this row and the next, in 16ths of a grey step, with
+  // a pixel of margin either side
+  int16_t *rows = (int16_t *)calloc(2 * (w + 2), sizeof(int16_t));
+  if (!rows)
+    return false;
+  int16_t *current = rows + 1;
+  int16_t *next = rows + w + 3;
+
+  for (int y = 0; y < h; y++) {
+    // Serpentine: odd rows run right to left, so errors do not all lean
+    // the same way
+    int step = y & 1 ? -1 : 1;
+    int x = y & 1 ? w - 1 : 0;
+    const uint8_t *src = grey + (size_t)y * w;
+    uint8_t *row = out + (size_t)y * stride;
+    for (int i = 0; i < w; i++, x += step) {
+      int v = src[x] + ((current[x] + 8) >> 4);
+      v = v < 0 ? 0 : v > 255 ? 255 : v;
+      int level = (v * 15 + 127) / 255;
+      int error = v - level * 17;
+      current[x + step] += error * 7;
+      next[x - step] += error * 3;
+      next[x] += error * 5;
+      next[x + step] += error;
+      uint8_t &pair = row[x >> 1];
+      pair = x & 1 ? (pair & 0xF0) | level : (pair & 0x0F) | level << 4;
+    }
+    int16_t *done = current;
+    current = next;
+    next = done;
+    memset(next - 1, 0, (w + 2) * sizeof(int16_t));
+  }
+  free(rows);
+  return true;
+}
+
+Source render(const char *name, M5Canvas &out) {
+  int w = out.width();
+  int h = out.height();
+  uint8_t *pixels = (uint8_t *)out.getBuffer();
+  if (!pixels || h <= 0 || !sdManager)
+    return Source::FAILED;
+  int stride = out.bufferLength() / h;
+  size_t bytes = (size_t)stride * h;
+  char path[16 + MAX_NAME];
+  char cached[24 + MAX_NAME];
+  snprintf(path, sizeof(path), "%s/%s", DIR, name);
+  snprintf(cached, sizeof(cached), "%s/%s.p4", CACHE_DIR, name);
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return Source::FAILED;
+  File source = sdFS().open(path, FILE_READ);
+  if (!source) {
+    sd.fail();
+    return Source::FAILED;
+  }
+  uint32_t sourceSize = source.size();
+  uint32_t sourceTime = (uint32_t)source.getLastWrite();
+  source.close();
+
+  // The rendition, if it is of this version of the photo at this size
+  RenditionHeader header;
+  File file = sdFS().open(cached, FILE_READ);
+  if (file &&
+      file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+      header.magic == RENDITION_MAGIC &&
+      header.version == RENDITION_VERSION && header.width == w &&
+      header.height == h && header.stride == stride &&
+      header.sourceSize == sourceSize && header.sourceTime == sourceTime &&
+      file.read(pixels, bytes) == bytes)
+    return Source::CACHE;
+  file.close();
+
+  // Decode to 8-bit grey in PSRAM, fitted and centred on white
+  uint32_t start = millis();
+  LoopMonitor::tag("photo decode");
+  M5Canvas grey;
+  grey.setColorDepth(lgfx::grayscale_8bit);
+  grey.setPsram(true);
+  if (!grey.createSprite(w, h)) {
+    LOG_W("Photo", "No memory to decode %dx%d", w, h);
+    return Source::FAILED;
+  }
+  MemTelemetry::track(MemTelemetry::Tag::UI, grey.bufferLength());
+  grey.fillScreen(TFT_WHITE);
+  // A scale of 0 fits the photo to the canvas, keeping its shape
+  bool decoded =
+      isPng(name)
+          ? grey.drawPngFile(sdFS(), path, 0, 0, w, h, 0, 0, 0.0f, 0.0f,
+                             lgfx::datum_t::middle_center)
+          : grey.drawJpgFile(sdFS(), path, 0, 0, w, h, 0, 0, 0.0f, 0.0f,
+                             lgfx::datum_t::middle_center);
+  bool ok = decoded &&
+            dither((const uint8_t *)grey.getBuffer(), w, h, pixels, stride);
+  MemTelemetry::track(MemTelemetry::Tag::UI, -(long)grey.bufferLength());
+  grey.deleteSprite();
+  if (!ok) {
+    LOG_W("Photo", "Cannot decode %s", path);
+    return Source::FAILED;
+  }
+  uint32_t decodeMs = millis() - start;
+
+  // Kept for next time; without it the next showing decodes again
+  header = {RENDITION_MAGIC, RENDITION_VERSION, (uint16_t)w, (uint16_t)h,
+            (uint16_t)stride, sourceSize, sourceTime};
+  bool written = false;
+  if (sdManager->ensureDirectory(CACHE_DIR)) {
+    file = sdFS().open(cached, FILE_WRITE);
+    written = file &&
+              file.write((const uint8_t *)&header, sizeof(header)) ==
+                  sizeof(header) &&
+              file.write(pixels, bytes) == bytes;
+    file.close();
+  }
+  if (!written) {
+    sdFS().remove(cached); // Never a short rendition
+    sd.fail();
+    LOG_W("Photo", "Could not cache %s", cached);
+  }
+  LOG_I("Photo", "%s decoded in %u ms", name, (unsigned)decodeMs);
+  return Source::DECODED;
+}
+
+} // namespace PhotoCache
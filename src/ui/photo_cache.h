@@ -0,0 +1,52 @@
+/**
+ * Photo Cache
+ *
+ * Photos from /photos on the card (JPEG or PNG) as 16-level grey
+ * renditions for the panel. The first time a photo is shown at a size it
+ * is decoded and dithered, and the result is kept on the card as
+ * /photos/.cache/<photo>.p4 beside its source; later showings are one read
+ * of the packed 4-bpp rows straight into the canvas, then one push.
+ *
+ * Decoding uses M5GFX's JPEG and PNG decoders, which read the file in
+ * small blocks (MCU blocks for JPEG, scanlines for PNG) and scale the
+ * photo to fit, centred, on white. They land in an 8-bit grey canvas in
+ * PSRAM; Floyd-Steinberg error diffusion, serpentine, takes that to the 16
+ * levels the panel shows, which keeps gradients (skies, skin) free of the
+ * bands that rounding leaves.
+ *
+ * A rendition names the source's size and modification time and its own
+ * width and height; any difference and the photo is decoded again.
+ */
+
+#ifndef PHOTO_CACHE_H
+#define PHOTO_CACHE_H
+
+#include <Arduino.h>
+#include <M5Unified.h>
+
+namespace PhotoCache {
+
+static const char *const DIR = "/photos";
+static const char *const CACHE_DIR = "/photos/.cache";
+static const char *const EXTENSIONS = "jpg,jpeg,png";
+static const int MAX_NAME = 64;
+
+enum class Source { CACHE, DECODED, FAILED };
+
+/**
+ * Fill out (a 4-bit canvas, already created at the size wanted) with the
+ * rendition of the photo DIR/name, from the cache or decoded and then
+ * cached. Loop task: reads and writes the card.
+ */
+Source render(const char *name, M5Canvas &out);
+
+/**
+ * Error-diffuse w x h 8-bit grey pixels (stride w) into 4-bpp rows of
+ * stride bytes, left pixel in the high nibble, level 15 white
+ * @return false if the error rows could not be allocated
+ */
+bool dither(const uint8_t *grey, int w, int h, uint8_t *out, int stride);
+
+} // namespace PhotoCache
+
+#endif // PHOTO_CACHE_H
@@ -0,0 +1,66 @@
+/**
+ * Press Highlight Implementation
+ */
+
+#include "press_highlight.h"
+#include "raster4.h"
+#include "../utils/mem_telemetry.h"
+#include <esp_heap_caps.h>
+
+PressHighlight::~PressHighlight() {
+  if (_saved) {
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)(MAX_AREA * sizeof(uint16_t)));
+    free(_saved);
+  }
+}
+
+bool PressHighlight::show(LovyanGFX &display, int x, int y, int w, int h) {
+  _w = 0;
+  // Clip to the panel; the menu bar's targets run to its edges
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    h += y;
+    y = 0;
+  }
+  if (x + w > display.width())
+    w = display.width() - x;
+  if (y + h > display.height())
+    h = display.height() - y;
+  if (w <= 0 || h <= 0 || w > MAX_WIDTH || w * h > MAX_AREA)
+    return false;
+
+  if (!_saved) {
+    _saved = (uint16_t *)heap_caps_malloc(MAX_AREA * sizeof(uint16_t),
+                                          MALLOC_CAP_SPIRAM);
+    if (!_saved)
+      return false;
+    MemTelemetry::track(MemTelemetry::Tag::UI, MAX_AREA * sizeof(uint16_t));
+  }
+
+  // Both directions use readRect()'s byte order, and inverting every bit
+  // inverts the grey level whichever byte it sits in
+  display.readRect(x, y, w, h, _saved);
+  uint16_t row[MAX_WIDTH];
+  for (int r = 0; r < h; r++) {
+    memcpy(row, _saved + r * w, w * sizeof(uint16_t));
+    Raster4::invert((uint8_t *)row, w * sizeof(uint16_t));
+    display.pushImage(x, y + r, w, 1, row);
+  }
+
+  _x = x;
+  _y = y;
+  _w = w;
+  _h = h;
+  return true;
+}
+
+void PressHighlight::restore(LovyanGFX &display) {
+  if (!isShown())
+    return;
+  display.pushImage(_x, _y, _w, _h, _saved);
+  _w = 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * Press Highlight
+ *
+ * Shows a finger landing on a touch target before it lifts: the target's
+ * rectangle is read back from the panel, written back inverted and pushed
+ * with epd_fastest, which the panel finishes in a few tens of ms. On
+ * release the saved pixels go back; whatever the tap changes is drawn
+ * over them, so the undo costs an update of its own only when the tap
+ * leaves the screen as it was.
+ *
+ * The saved pixels live in one PSRAM buffer, allocated on first use and
+ * kept. Targets over MAX_AREA (whole panels, the notes canvas) are not
+ * inverted: a flash that large reads as a glitch, not feedback.
+ */
+
+#ifndef PRESS_HIGHLIGHT_H
+#define PRESS_HIGHLIGHT_H
+
+#include <M5Unified.h>
+
+class PressHighlight {
+public:
+  static const int MAX_AREA = 320 * 200; // Pixels; 125 KB saved
+  static const int MAX_WIDTH = 960;
+
+  PressHighlight() : _saved(nullptr), _x(0), _y(0), _w(0), _h(0) {}
+  ~PressHighlight();
+
+  /**
+   * Invert (x, y, w, h) on the display, keeping what was there. The caller
+   * picks the waveform and calls display().
+   * @return false if the rectangle is too large or there is no PSRAM
+   */
+  bool show(LovyanGFX &display, int x, int y, int w, int h);
+
+  bool isShown() const { return _w > 0; }
+
+  bool contains(int x, int y) const {
+    return x >= _x && x < _x + _w && y >= _y && y < _y + _h;
+  }
+
+  /**
+   * Write the saved pixels back (caller calls display() if nothing else
+   * will)
+   */
+  void restore(LovyanGFX &display);
+
+  /**
+   * Forget the highlight without touching the display (a full redraw
+   * covers it)
+   */
+  void discard() { _w = 0; }
+
+private:
+  uint16_t *_saved; // readRect() pixels of the rectangle, row by row
+  int16_t _x, _y, _w, _h;
+};
+
+#endif // PRESS_HIGHLIGHT_H
@@ -0,0 +1,233 @@
+/**
+ * 4-bpp Raster Kernels Implementation
+ */
+
+#include "raster4.h"
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(RASTER4_NO_PIE)
+#define RASTER4_PIE 1
+#else
+#define RASTER4_PIE 0
+#endif
+
+namespace Raster4 {
+
+static const size_t VEC = 16; // Bytes per PIE q register
+
+#if RASTER4_PIE
+// Bytes before p reaches a 16-byte boundary (PIE loads and stores ignore
+// the low four address bits)
+static inline size_t lead(const void *p) {
+  return (VEC - ((uintptr_t)p & (VEC - 1))) & (VEC - 1);
+}
+#endif
+
+static inline bool wordAligned(const void *p) {
+  return ((uintptr_t)p & 3) == 0;
+}
+
+// Portable paths: bytes up to a word boundary, then 32-bit words
+
+static bool wordDiffers(const uint8_t *a, const uint8_t *b, size_t n) {
+  while (n && !wordAligned(a)) {
+    if (*a++ != *b++)
+      return true;
+    n--;
+  }
+  if (wordAligned(b)) {
+    const uint32_t *aw = (const uint32_t *)a;
+    const uint32_t *bw = (const uint32_t *)b;
+    for (; n >= 4; n -= 4) {
+      if (*aw++ ^ *bw++)
+        return true;
+    }
+    a = (const uint8_t *)aw;
+    b = (const uint8_t *)bw;
+  }
+  while (n--) {
+    if (*a++ != *b++)
+      return true;
+  }
+  return false;
+}
+
+static void wordInvert(uint8_t *p, size_t n) {
+  while (n && !wordAligned(p)) {
+    *p = ~*p;
+    p++;
+    n--;
+  }
+  uint32_t *w = (uint32_t *)p;
+  for (; n >= 4; n -= 4, w++)
+    *w = ~*w;
+  p = (uint8_t *)w;
+  while (n--) {
+    *p = ~*p;
+    p++;
+  }
+}
+
+static void wordBlit(uint8_t *d, const uint8_t *s, const uint8_t *m,
+                     size_t n) {
+  while (n && !wordAligned(d)) {
+    *d = *d ^ ((*d ^ *s++) & *m++);
+    d++;
+    n--;
+  }
+  if (wordAligned(s) && wordAligned(m)) {
+    uint32_t *dw = (uint32_t *)d;
+    const uint32_t *sw = (const uint32_t *)s;
+    const uint32_t *mw = (const uint32_t *)m;
+    for (; n >= 4; n -= 4, dw++)
+      *dw = *dw ^ ((*dw ^ *sw++) & *mw++);
+    d = (uint8_t *)dw;
+    s = (const uint8_t *)sw;
+    m = (const uint8_t *)mw;
+  }
+  while (n--) {
+    *d = *d ^ ((*d ^ *s++) & *m++);
+    d++;
+  }
+}
+
+void fill(uint8_t *dst, uint8_t value, size_t n) {
+#if RASTER4_PIE
+  size_t head = lead(dst);
+  if (n >= head + VEC) {
+    memset(dst, value, head);
+    dst += head;
+    n -= head;
+    size_t blocks = n / VEC;
+    n &= VEC - 1;
+    asm volatile("ee.vldbc.8 q0, %[v]\n"
+                 "1:\n"
+                 "ee.vst.128.ip q0, %[d], 16\n"
+                 "addi %[k], %[k], -1\n"
+                 "bnez %[k], 1b\n"
+                 : [d] "+r"(dst), [k] "+r"(blocks)
+                 : [v] "r"(&value)
+                 : "memory");
+  }
+#endif
+  memset(dst, value, n);
+}
+
+void fillSpan(uint8_t *row, int x, int w, uint8_t level) {
+  if (w <= 0)
+    return;
+  level &= 0x0F;
+  if (x & 1) { // Right nibble of the first byte
+    row[x >> 1] = (row[x >> 1] & 0xF0) | level;
+    x++;
+    w--;
+  }
+  uint8_t *at = row + (x >> 1);
+  fill(at, level * 0x11, w >> 1);
+  if (w & 1) // Left nibble of the last
+    at[w >> 1] = (at[w >> 1] & 0x0F) | level << 4;
+}
+
+void fillRect(uint8_t *pixels, int stride, int x, int y, int w, int h,
+              uint8_t level) {
+  for (int r = 0; r < h; r++)
+    fillSpan(pixels + (y + r) * stride, x, w, level);
+}
+
+void invert(uint8_t *dst, size_t n) {
+#if RASTER4_PIE
+  size_t head = lead(dst);
+  if (n >= head + VEC) {
+    wordInvert(dst, head);
+    dst += head;
+    n -= head;
+    size_t blocks = n / VEC;
+    n &= VEC - 1;
+    asm volatile("1:\n"
+                 "ee.vld.128.ip q0, %[d], 0\n"
+                 "ee.notq q0, q0\n"
+                 "ee.vst.128.ip q0, %[d], 16\n"
+                 "addi %[k], %[k], -1\n"
+                 "bnez %[k], 1b\n"
+                 : [d] "+r"(dst), [k] "+r"(blocks)
+                 :
+                 : "memory");
+  }
+#endif
+  wordInvert(dst, n);
+}
+
+bool differs(const uint8_t *a, const uint8_t *b, size_t n) {
+#if RASTER4_PIE
+  size_t head = lead(a);
+  if (lead(b) == head && n >= head + VEC) {
+    if (wordDiffers(a, b, head))
+      return true;
+    a += head;
+    b += head;
+    n -= head;
+    uint32_t acc[4] __attribute__((aligned(16)));
+    while (n >= VEC) {
+      // OR of the XORs, checked every 256 bytes so a change ends it early
+      size_t blocks = n / VEC < 16 ? n / VEC : 16;
+      n -= blocks * VEC;
+      uint32_t *out = acc;
+      asm volatile("ee.zero.q q2\n"
+                   "1:\n"
+                   "ee.vld.128.ip q0, %[a], 16\n"
+                   "ee.vld.128.ip q1, %[b], 16\n"
+                   "ee.xorq q0, q0, q1\n"
+                   "ee.orq q2, q2, q0\n"
+                   "addi %[k], %[k], -1\n"
+                   "bnez %[k], 1b\n"
+                   "ee.vst.128.ip q2, %[o], 0\n"
+                   : [a] "+r"(a), [b] "+r"(b), [k] "+r"(blocks),
+                     [o] "+r"(out)
+                   :
+                   : "memory");
+      if (acc[0] | acc[1] | acc[2] | acc[3])
+        return true;
+    }
+  }
+#endif
+  return wordDiffers(a, b, n);
+}
+
+void blitMasked(uint8_t *dst, const uint8_t *src, const uint8_t *mask,
+                size_t n) {
+#if RASTER4_PIE
+  size_t head = lead(dst);
+  if (lead(src) == head && lead(mask) == head && n >= head + VEC) {
+    wordBlit(dst, src, mask, head);
+    dst += head;
+    src += head;
+    mask += head;
+    n -= head;
+    size_t blocks = n / VEC;
+    n &= VEC - 1;
+    // dst ^ ((dst ^ src) & mask)
+    asm volatile("1:\n"
+                 "ee.vld.128.ip q0, %[d], 0\n"
+                 "ee.vld.128.ip q1, %[s], 16\n"
+                 "ee.vld.128.ip q2, %[m], 16\n"
+                 "ee.xorq q1, q1, q0\n"
+                 "ee.andq q1, q1, q2\n"
+                 "ee.xorq q0, q0, q1\n"
+                 "ee.vst.128.ip q0, %[d], 16\n"
+                 "addi %[k], %[k], -1\n"
+                 "bnez %[k], 1b\n"
+                 : [d] "+r"(dst), [s] "+r"(src), [m] "+r"(mask),
+                   [k] "+r"(blocks)
+                 :
+                 : "memory");
+  }
+#endif
+  wordBlit(dst, src, mask, n);
+}
+
+void clear(M5Canvas &canvas) {
+  uint8_t *pixels = (uint8_t *)canvas.getBuffer();
+  if (pixels)
+    fill(pixels, 0xFF, canvas.bufferLength());
+}
+
+} // namespace Raster4
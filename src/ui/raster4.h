@@ -0,0 +1,68 @@
+/**
+ * 4-bpp Raster Kernels
+ *
+ * Bulk operations on packed grayscale buffers as M5Canvas holds them at
+ * 4 bpp: rows of (width + 1) / 2 bytes, left pixel in the high nibble,
+ * level 15 white. Canvas clears, the frame buffer's tile diff, the press
+ * highlight and the note decoder run through these instead of LovyanGFX's
+ * per-pixel paths.
+ *
+ * On the ESP32-S3 the bulk of each run goes through the PIE 128-bit
+ * vector unit (EE.VLD/VST.128, ANDQ/ORQ/XORQ/NOTQ), 16 bytes per step;
+ * the unaligned head and tail, and runs whose pointers do not share their
+ * alignment, use 32-bit words. Build with -DRASTER4_NO_PIE for the
+ * portable path only. Kernels are for the loop task (not ISRs).
+ */
+
+#ifndef RASTER4_H
+#define RASTER4_H
+
+#include <Arduino.h>
+#include <M5Unified.h>
+
+namespace Raster4 {
+
+static const uint8_t WHITE = 15;
+
+/**
+ * Set n bytes to value (two pixels of value & 0x0F each: level * 0x11)
+ */
+void fill(uint8_t *dst, uint8_t value, size_t n);
+
+/**
+ * Set w pixels of a 4-bpp row from pixel x to level, keeping the other
+ * nibble of an edge byte
+ */
+void fillSpan(uint8_t *row, int x, int w, uint8_t level);
+
+/**
+ * fillSpan() over h rows of stride bytes (no clipping)
+ */
+void fillRect(uint8_t *pixels, int stride, int x, int y, int w, int h,
+              uint8_t level);
+
+/**
+ * Invert n bytes in place (at 4 bpp, level l becomes 15 - l)
+ */
+void invert(uint8_t *dst, size_t n);
+
+/**
+ * True if any of n bytes differ (XOR of the two, reduced)
+ */
+bool differs(const uint8_t *a, const uint8_t *b, size_t n);
+
+/**
+ * Copy the bits of src that are set in mask over dst (a nibble mask of
+ * 0x0F or 0xF0 copies one pixel)
+ */
+void blitMasked(uint8_t *dst, const uint8_t *src, const uint8_t *mask,
+                size_t n);
+
+/**
+ * Fill a whole unpaletted canvas with white (every bit set, at any depth)
+ */
+void clear(M5Canvas &canvas);
+
+} // namespace Raster4
+
+#endif // RASTER4_H
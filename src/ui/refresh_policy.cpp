@@ -0,0 +1,160 @@
+/**
+ * Dashboard Refresh Policy Implementation
+ */
+
+#include "refresh_policy.h"
+
+RefreshPolicy::RefreshPolicy() : _primed(false), _taken(0), _held(0) {
+  memset(_shownAt, 0, sizeof(_shownAt));
+  memset(_driftSince, 0, sizeof(_driftSince));
+  configure(1, 5, 10000);
+}
+
+void RefreshPolicy::configure(float socBand, float powerBand,
+                              uint32_t powerIntervalMs) {
+  _band[SOC] = Fixed::fromFloat(socBand > 0 ? socBand : 1,
+                                Fixed::PERMILLE_PER_PCT);
+  _band[IN_W] = Fixed::fromFloat(powerBand > 0 ? powerBand : 5,
+                                 Fixed::DW_PER_W);
+  _band[OUT_W] = _band[IN_W];
+  _band[TO_FULL] = TIME_BAND_MIN;
+  _band[TO_EMPTY] = TIME_BAND_MIN;
+  _interval[BATTERY] = BATTERY_INTERVAL_MS;
+  _interval[POWER_IN] = powerIntervalMs;
+  _interval[POWER_OUT] = powerIntervalMs;
+  _interval[OUTLETS] = 0;
+}
+
+int32_t RefreshPolicy::value(const Fossibot::PowerBankData &d, Field f) {
+  switch (f) {
+  case SOC:
+    return d.socPermille;
+  case IN_W:
+    return d.inputDeciwatts;
+  case OUT_W:
+    return d.outputDeciwatts;
+  case TO_FULL:
+    return d.minutesToFull;
+  case TO_EMPTY:
+  default:
+    return d.minutesToEmpty;
+  }
+}
+
+RefreshPolicy::Region RefreshPolicy::regionOf(Field f) {
+  switch (f) {
+  case SOC:
+    return BATTERY;
+  case IN_W:
+  case TO_FULL:
+    return POWER_IN;
+  case OUT_W:
+  case TO_EMPTY:
+  default:
+    return POWER_OUT;
+  }
+}
+
+void RefreshPolicy::take(const Fossibot::PowerBankData &frame,
+                         Fossibot::PowerBankData &shown, Region r) {
+  switch (r) {
+  case BATTERY:
+    shown.socPermille = frame.socPermille;
+    break;
+  case POWER_IN:
+    shown.inputDeciwatts = frame.inputDeciwatts;
+    shown.acInputDeciwatts = frame.acInputDeciwatts;
+    shown.dcInputDeciwatts = frame.dcInputDeciwatts;
+    shown.minutesToFull = frame.minutesToFull;
+    break;
+  case POWER_OUT:
+    shown.outputDeciwatts = frame.outputDeciwatts;
+    shown.minutesToEmpty = frame.minutesToEmpty;
+    break;
+  case OUTLETS:
+  default:
+    shown.usbActive = frame.usbActive;
+    shown.dcActive = frame.dcActive;
+    shown.acActive = frame.acActive;
+    break;
+  }
+}
+
+// A power starting from nothing (under a watt), or dropping to nothing
+static bool startedOrStopped(Fixed::Deciwatts now, Fixed::Deciwatts shown,
+                             Fixed::Deciwatts band) {
+  const Fixed::Deciwatts none = Fixed::DW_PER_W;
+  return (shown < none && now >= band) || (shown >= band && now < none);
+}
+
+RefreshPolicy::Result RefreshPolicy::apply(const Fossibot::PowerBankData &frame,
+                                           Fossibot::PowerBankData &shown,
+                                           uint32_t now) {
+  const uint8_t all = (1 << REGION_COUNT) - 1;
+  uint8_t urgent = _primed ? 0 : all;
+
+  // Priority channel: what the user acts on, or is waiting for
+  if (frame.usbActive != shown.usbActive ||
+      frame.dcActive != shown.dcActive || frame.acActive != shown.acActive)
+    urgent |= 1 << OUTLETS;
+  if (startedOrStopped(frame.inputDeciwatts, shown.inputDeciwatts,
+                       _band[IN_W]))
+    urgent |= 1 << POWER_IN;
+  if (startedOrStopped(frame.outputDeciwatts, shown.outputDeciwatts,
+                       _band[OUT_W]))
+    urgent |= 1 << POWER_OUT;
+  if ((frame.socPermille >= Fixed::FULL) !=
+          (shown.socPermille >= Fixed::FULL) ||
+      (frame.socPermille <= 0) != (shown.socPermille <= 0))
+    urgent |= 1 << BATTERY;
+
+  // Deadbands, drift and age
+  uint8_t want = urgent;
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    Field f = (Field)i;
+    Region r = regionOf(f);
+    int32_t was = value(shown, f);
+    int32_t delta = abs(value(frame, f) - was);
+    int32_t band = _band[f];
+    if (f == TO_FULL || f == TO_EMPTY)
+      band = max(band, was / TIME_BAND_DIVISOR); // "9h 40m" moves slowly
+    if (delta * 2 < band)
+      _driftSince[f] = 0;
+    else if (!_driftSince[f])
+      _driftSince[f] = now ? now : 1;
+    bool drifted = _driftSince[f] && now - _driftSince[f] >= SETTLE_MS;
+    bool stale = delta > 0 && now - _shownAt[r] >= MAX_AGE_MS;
+    if (delta >= band || drifted || stale)
+      want |= 1 << r;
+  }
+
+  // Rate limit per region, the priority channel excepted
+  uint8_t due = urgent;
+  for (int r = 0; r < REGION_COUNT; r++) {
+    if ((want & (1 << r)) && now - _shownAt[r] >= _interval[r])
+      due |= 1 << r;
+  }
+
+  // The frame's values for the regions that are due, the rest as shown
+  Fossibot::PowerBankData old = shown;
+  shown = frame;
+  for (int r = 0; r < REGION_COUNT; r++) {
+    if (!(due & (1 << r))) {
+      take(old, shown, (Region)r);
+      continue;
+    }
+    _shownAt[r] = now;
+    for (int f = 0; f < FIELD_COUNT; f++) {
+      if (regionOf((Field)f) == r)
+        _driftSince[f] = 0;
+    }
+  }
+  _primed = true;
+
+  if (due)
+    _taken++;
+  else if (want)
+    _held++;
+  Result result = {due, urgent != 0};
+  return result;
+}
@@ -0,0 +1,92 @@
+/**
+ * Dashboard Refresh Policy
+ *
+ * Decides which parts of the dashboard a new frame is worth repainting
+ * for, so a noisy load does not keep the panel flashing while real
+ * changes still show. The frame's fields are grouped into regions (the
+ * battery bar, the input panel, the output panel, the outlet toggles) and
+ * the numbers a region shows only move when:
+ *
+ * - a field has left its deadband around the value on screen (band), or
+ * - it has stayed more than half a band away for SETTLE_MS (a slow drift
+ *   the band would otherwise hide for good), or
+ * - it has differed at all for MAX_AGE_MS
+ *
+ * and then the whole region takes the frame's values, so the next update
+ * needs another full band from there (hysteresis: noise around a value
+ * never flips it back and forth). A region repaints at most once per its
+ * minimum interval, except on the priority channel: an outlet switching, a
+ * power starting or stopping, the battery reaching full or empty, and the
+ * first frame. Those show at once and are reported so the caller can skip
+ * its own refresh rate limit too.
+ *
+ * Bands come from the eink section of the settings (soc_change_threshold,
+ * power_change_threshold, power_interval); the time estimates' bands grow
+ * with the estimate, which the unit recomputes on every swing of the load.
+ */
+
+#ifndef REFRESH_POLICY_H
+#define REFRESH_POLICY_H
+
+#include "../ble/fossibot_protocol.h"
+#include <Arduino.h>
+
+class RefreshPolicy {
+public:
+  enum Region : uint8_t { BATTERY, POWER_IN, POWER_OUT, OUTLETS, REGION_COUNT };
+  enum Field : uint8_t { SOC, IN_W, OUT_W, TO_FULL, TO_EMPTY, FIELD_COUNT };
+
+  static const uint32_t SETTLE_MS = 60000;   // Half a band, held this long
+  static const uint32_t MAX_AGE_MS = 600000; // Any difference, this old
+  static const uint32_t BATTERY_INTERVAL_MS = 60000;
+  static const int TIME_BAND_MIN = 10; // Minutes, to full and to empty,
+  static const int TIME_BAND_DIVISOR = 10; // or a tenth of them
+
+  struct Result {
+    uint8_t regions; // Bit per Region that took the frame's values
+    bool priority;   // Show now, past the caller's rate limit
+  };
+
+  RefreshPolicy();
+
+  /**
+   * Set the bands and the input/output panels' minimum interval
+   * @param socBand Percent
+   * @param powerBand Watts
+   */
+  void configure(float socBand, float powerBand, uint32_t powerIntervalMs);
+
+  /**
+   * Fold a frame into what is on screen: regions that are due take its
+   * values, the rest keep theirs. Fields the policy does not cover
+   * (voltage, settings, link) are always taken.
+   */
+  Result apply(const Fossibot::PowerBankData &frame,
+               Fossibot::PowerBankData &shown, uint32_t now);
+
+  /**
+   * Everything is about to be drawn anyway (screen change, first frame):
+   * the next apply() takes all regions
+   */
+  void reset() { _primed = false; }
+
+  uint32_t framesTaken() const { return _taken; } // At least one region
+  uint32_t framesHeld() const { return _held; }   // Changed but held back
+
+private:
+  int32_t _band[FIELD_COUNT]; // In each field's own unit
+  uint32_t _interval[REGION_COUNT];
+  uint32_t _shownAt[REGION_COUNT];
+  uint32_t _driftSince[FIELD_COUNT]; // Past half a band since, 0 = not
+  bool _primed;
+  uint32_t _taken;
+  uint32_t _held;
+
+  // Permille, deciwatts or minutes: compared as integers
+  static int32_t value(const Fossibot::PowerBankData &d, Field f);
+  static Region regionOf(Field f);
+  static void take(const Fossibot::PowerBankData &frame,
+                   Fossibot::PowerBankData &shown, Region r);
+};
+
+#endif // REFRESH_POLICY_H
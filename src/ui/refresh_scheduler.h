@@ -0,0 +1,266 @@
+/**
+ * EPD Refresh Scheduler
+ *
+ * Picks the panel waveform for each kind of update and keeps a ghosting
+ * budget: every partial update adds its cost, and a full epd_quality clean
+ * is only issued once the budget is spent (at a screen change, or when the
+ * user has been idle for a moment).
+ *
+ * It can also hold a cost model: how long each waveform takes over a
+ * few region sizes, as measured by the EPD benchmark (epd_bench.h) and
+ * loaded from its CSV at boot. expectedUs() reads it for any region.
+ *
+ * Every update is also charged to the energy model, for as long as its
+ * waveform takes over the kind's typical region (nominal times without a
+ * cost model).
+ *
+ * Between updates the panel driver is powered down: idle(), called every
+ * loop pass, waits for the updates handed over to have run and puts it to
+ * sleep. Nothing wakes it ahead of time; the driver raises the panel's
+ * rails itself as the next update is handed over (display()), so they are
+ * up only while a waveform runs. The cost model's wakeUs, measured by the
+ * EPD benchmark, is that power-up, charged to the first update after a
+ * sleep.
+ */
+
+#ifndef REFRESH_SCHEDULER_H
+#define REFRESH_SCHEDULER_H
+
+#include "../hardware/energy_model.h"
+#include <M5Unified.h>
+#include <esp_timer.h>
+
+enum class RegionKind {
+  INK,     // Pen strokes: epd_fastest
+  PRESS,   // Press highlight and its undo: epd_fastest
+  TEXT,    // Numbers, clock digits: epd_text
+  GRAPHIC, // Bars, toggles, buttons: epd_fast
+  SCREEN   // Whole-screen redraw without a clean: epd_fast
+};
+
+class RefreshScheduler {
+public:
+  static const int GHOST_BUDGET = 40; // Cost units between quality cleans
+  static const uint32_t IDLE_CLEAN_MS = 3000;
+  // Past an update's expected end before the driver is powered down: the
+  // screen is drawn between apply() and display()
+  static const uint32_t SLEEP_AFTER_US = 500000;
+  static const uint32_t WAKE_US = 1200; // Driver power-up, unmeasured
+
+  // Measured update times by waveform and region area
+  struct CostModel {
+    static const int MODES = 4; // MODE_ORDER
+    static const int SIZES = 4; // Ascending area
+    uint32_t area[SIZES];       // Pixels
+    uint32_t waitUs[MODES][SIZES]; // display() until waitDisplay() returns
+    uint32_t wakeUs; // Driver power-up after a sleep, 0 if not measured
+    bool loaded;
+  };
+
+  // The model's waveform order
+  static constexpr epd_mode_t MODE_ORDER[CostModel::MODES] = {
+      epd_mode_t::epd_quality, epd_mode_t::epd_text, epd_mode_t::epd_fast,
+      epd_mode_t::epd_fastest};
+
+  RefreshScheduler()
+      : _debt(0), _cleanPending(false), _cleans(0), _asleep(false),
+        _sleeps(0), _doneAtUs(0) {
+    _model.wakeUs = 0;
+    _model.loaded = false;
+  }
+
+  /**
+   * Set the waveform for an update of this kind and charge its cost
+   */
+  void apply(RegionKind kind) {
+    epd_mode_t mode = modeFor(kind);
+    M5.Display.setEpdMode(mode);
+    _debt += costOf(kind);
+    int w, h;
+    typicalSize(kind, w, h);
+    chargeUpdate(mode, w, h);
+  }
+
+  /**
+   * Choose the mode for a screen transition: quality clean if the budget is
+   * spent (or a clean was requested), otherwise a fast full redraw
+   * @return true if this transition is a quality clean
+   */
+  bool beginScreenChange() {
+    if (_cleanPending || _debt >= GHOST_BUDGET) {
+      forceClean();
+      return true;
+    }
+    apply(RegionKind::SCREEN);
+    return false;
+  }
+
+  /**
+   * Use epd_quality now and reset the budget (explicit clean)
+   */
+  void forceClean() {
+    M5.Display.setEpdMode(epd_mode_t::epd_quality);
+    _debt = 0;
+    _cleanPending = false;
+    _cleans++;
+    chargeUpdate(epd_mode_t::epd_quality, M5.Display.width(),
+                 M5.Display.height());
+  }
+
+  /**
+   * Power the panel driver down once the updates handed over should have
+   * run (a loop pass with nothing to draw). One still running past its
+   * expected end is waited out.
+   */
+  void idle() {
+    if (_asleep || esp_timer_get_time() < _doneAtUs)
+      return;
+    M5.Display.waitDisplay();
+    M5.Display.powerSaveOn();
+    _asleep = true;
+    _sleeps++;
+  }
+
+  bool isAsleep() const { return _asleep; }
+  uint32_t getSleepCount() const { return _sleeps; }
+
+  /**
+   * Milliseconds until idle() would power the driver down (0: now, or it
+   * is asleep)
+   */
+  uint32_t msUntilIdle() const {
+    int64_t left = _doneAtUs - esp_timer_get_time();
+    return _asleep || left <= 0 ? 0 : (uint32_t)(left / 1000) + 1;
+  }
+
+  uint32_t wakeUs() const {
+    return _model.loaded && _model.wakeUs ? _model.wakeUs : WAKE_US;
+  }
+
+  /**
+   * Ask for a quality clean on the next full draw
+   */
+  void requestClean() { _cleanPending = true; }
+  bool isCleanPending() const { return _cleanPending; }
+
+  bool budgetExhausted() const { return _debt >= GHOST_BUDGET; }
+  int getDebt() const { return _debt; }
+  uint32_t getCleanCount() const { return _cleans; }
+
+  void setCostModel(const CostModel &model) { _model = model; }
+  const CostModel &costModel() const { return _model; }
+
+  static int modeIndex(epd_mode_t mode) {
+    for (int i = 0; i < CostModel::MODES; i++)
+      if (MODE_ORDER[i] == mode)
+        return i;
+    return -1;
+  }
+
+  /**
+   * Time an update in this waveform over w x h pixels should take, linear
+   * in area between the measured sizes
+   * @return 0 without a model
+   */
+  uint32_t expectedUs(epd_mode_t mode, int w, int h) const {
+    int m = modeIndex(mode);
+    if (!_model.loaded || m < 0)
+      return 0;
+    uint32_t area = (uint32_t)w * h;
+    const uint32_t *a = _model.area;
+    const uint32_t *t = _model.waitUs[m];
+    int i = 1;
+    while (i < CostModel::SIZES - 1 && area > a[i])
+      i++;
+    if (area <= a[0] || a[i] == a[i - 1])
+      return area <= a[0] ? t[0] : t[i];
+    int64_t dt = (int64_t)t[i] - t[i - 1];
+    int64_t us = t[i - 1] + dt * ((int64_t)area - a[i - 1]) / (a[i] - a[i - 1]);
+    return us > 0 ? (uint32_t)us : 0;
+  }
+
+  static epd_mode_t modeFor(RegionKind kind) {
+    switch (kind) {
+    case RegionKind::INK:
+    case RegionKind::PRESS:
+      return epd_mode_t::epd_fastest;
+    case RegionKind::TEXT:
+      return epd_mode_t::epd_text;
+    case RegionKind::GRAPHIC:
+    case RegionKind::SCREEN:
+    default:
+      return epd_mode_t::epd_fast;
+    }
+  }
+
+  // Region an update of this kind usually covers, for the energy model
+  static void typicalSize(RegionKind kind, int &w, int &h) {
+    switch (kind) {
+    case RegionKind::INK:
+    case RegionKind::PRESS:
+      w = h = 120;
+      break;
+    case RegionKind::TEXT:
+      w = 400;
+      h = 80;
+      break;
+    case RegionKind::GRAPHIC:
+      w = M5.Display.width() / 2;
+      h = M5.Display.height() / 2;
+      break;
+    case RegionKind::SCREEN:
+    default:
+      w = M5.Display.width();
+      h = M5.Display.height();
+      break;
+    }
+  }
+
+  // Ghosting budget an update of this kind spends
+  static int costOf(RegionKind kind) {
+    switch (kind) {
+    case RegionKind::INK:
+      return 0; // Notes exit always cleans; strokes don't spend budget
+    case RegionKind::TEXT:
+    case RegionKind::PRESS: // Small, and put back as it was
+      return 1;
+    case RegionKind::GRAPHIC:
+      return 2;
+    case RegionKind::SCREEN:
+    default:
+      return 8;
+    }
+  }
+
+private:
+  void chargeUpdate(epd_mode_t mode, int w, int h) {
+    // Waveform times without a cost model (MODE_ORDER), full panel
+    static const uint32_t NOMINAL_US[CostModel::MODES] = {1500000, 600000,
+                                                          300000, 150000};
+    int m = modeIndex(mode);
+    if (m < 0)
+      return;
+    uint32_t us = expectedUs(mode, w, h);
+    if (!us)
+      us = NOMINAL_US[m];
+    int64_t doneAt = esp_timer_get_time() + us + SLEEP_AFTER_US;
+    if (doneAt > _doneAtUs)
+      _doneAtUs = doneAt;
+    if (_asleep) {
+      us += wakeUs(); // The driver powers up as the update goes out
+      _asleep = false;
+    }
+    EnergyModel::charge(
+        (EnergyModel::State)((int)EnergyModel::State::EPD_QUALITY + m), us);
+  }
+
+  int _debt;
+  bool _cleanPending;
+  uint32_t _cleans;
+  CostModel _model;
+  bool _asleep;       // Driver powered down since the last update
+  uint32_t _sleeps;
+  int64_t _doneAtUs;  // When the updates handed over should have run
+};
+
+#endif // REFRESH_SCHEDULER_H
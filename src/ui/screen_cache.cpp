@@ -0,0 +1,119 @@
+/**
+ * Screen Cache Implementation
+ */
+
+#include "screen_cache.h"
+#include "../utils/mem_telemetry.h"
+
+static const int MAX_WIDTH = 960;
+
+ScreenCache::~ScreenCache() { clear(); }
+
+bool ScreenCache::allocate(Entry &entry, int w, int h) {
+  if (entry.canvas && entry.canvas->width() == w &&
+      entry.canvas->height() == h)
+    return true;
+  if (entry.canvas) {
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)entry.canvas->bufferLength());
+    delete entry.canvas;
+  }
+  entry.canvas = new M5Canvas(&M5.Display);
+  entry.canvas->setColorDepth(4);
+  entry.canvas->setPsram(true);
+  if (!entry.canvas->createSprite(w, h)) {
+    Serial.printf("UI: Screen cache %dx%d allocation failed\n", w, h);
+    delete entry.canvas;
+    entry.canvas = nullptr;
+    return false;
+  }
+  MemTelemetry::track(MemTelemetry::Tag::UI, entry.canvas->bufferLength());
+  return true;
+}
+
+bool ScreenCache::store(int screen, uint32_t key, LovyanGFX &display,
+                        const HitRegistry &hits) {
+  // The screen's own slot, else a free one, else the least recently used
+  Entry *slot = nullptr;
+  for (Entry &e : _entries) {
+    if (e.screen == screen) {
+      slot = &e;
+      break;
+    }
+  }
+  if (!slot) {
+    slot = &_entries[0];
+    for (Entry &e : _entries) {
+      if (e.screen < 0) {
+        slot = &e;
+        break;
+      }
+      if (e.lastUse < slot->lastUse)
+        slot = &e;
+    }
+  }
+  slot->screen = -1;
+
+  int width = display.width();
+  int height = display.height();
+  if (width > MAX_WIDTH || !allocate(*slot, width, height))
+    return false;
+
+  // readRect() gives RGB565 with its bytes swapped; the panel is grey, so
+  // the top four bits of green are the 4-bit level (as Screenshot reads it)
+  uint8_t *pixels = (uint8_t *)slot->canvas->getBuffer();
+  int stride = slot->canvas->bufferLength() / height;
+  uint16_t row[MAX_WIDTH];
+  for (int y = 0; y < height; y++) {
+    display.readRect(0, y, width, 1, row);
+    uint8_t *out = pixels + y * stride;
+    for (int x = 0; x < width; x++) {
+      uint16_t c = (uint16_t)(row[x] << 8 | row[x] >> 8);
+      uint8_t level = (c >> 7) & 0x0F;
+      if (x & 1)
+        out[x / 2] |= level;
+      else
+        out[x / 2] = level << 4;
+    }
+  }
+
+  slot->screen = screen;
+  slot->key = key;
+  slot->hits = hits;
+  slot->lastUse = ++_clock;
+  return true;
+}
+
+const ScreenCache::Entry *ScreenCache::find(int screen, uint32_t key) {
+  for (Entry &e : _entries) {
+    if (e.screen != screen)
+      continue;
+    if (e.key != key) {
+      e.screen = -1; // Stale: the canvas stays for the next store
+      return nullptr;
+    }
+    e.lastUse = ++_clock;
+    return &e;
+  }
+  return nullptr;
+}
+
+void ScreenCache::invalidate(int screen) {
+  for (Entry &e : _entries) {
+    if (e.screen == screen)
+      e.screen = -1;
+  }
+}
+
+void ScreenCache::clear() {
+  for (Entry &e : _entries) {
+    if (e.canvas) {
+      MemTelemetry::track(MemTelemetry::Tag::UI,
+                          -(long)e.canvas->bufferLength());
+      delete e.canvas;
+      e.canvas = nullptr;
+    }
+    e.screen = -1;
+    e.hits.clear();
+  }
+}
@@ -0,0 +1,67 @@
+/**
+ * Screen Cache
+ *
+ * Snapshots of the last few screens left, as 4-bit canvases in PSRAM with
+ * the touch targets they had registered. Going back to a cached screen is
+ * one block copy and one EPD update instead of a clear and a full redraw.
+ *
+ * A snapshot is read back from the panel as the screen is left, so it
+ * holds exactly what was shown. Each is stored under a key of what the
+ * screen's pixels depend on (see UIManager::screenKey); a snapshot taken
+ * under another key is stale and dropped. Least recently used entries are
+ * evicted first.
+ */
+
+#ifndef SCREEN_CACHE_H
+#define SCREEN_CACHE_H
+
+#include "hit_registry.h"
+#include <M5Unified.h>
+
+class ScreenCache {
+public:
+  static const int CAPACITY = 3; // 3 x 253 KB of PSRAM at 960x540
+
+  struct Entry {
+    int screen = -1;             // ScreenID, -1 if the slot is free
+    uint32_t key = 0;
+    M5Canvas *canvas = nullptr; // Kept across reuse of the slot
+    HitRegistry hits;
+    uint32_t lastUse = 0;
+  };
+
+  ScreenCache() : _clock(0) {}
+  ~ScreenCache();
+
+  /**
+   * Read the panel back into the slot for screen, replacing any snapshot
+   * it had and evicting the least recently used one when full
+   * @return false without PSRAM for the snapshot
+   */
+  bool store(int screen, uint32_t key, LovyanGFX &display,
+             const HitRegistry &hits);
+
+  /**
+   * The snapshot of screen if it was taken under key, marking it most
+   * recently used; one under another key is dropped
+   */
+  const Entry *find(int screen, uint32_t key);
+
+  /**
+   * Drop a screen's snapshot (its content changed outside the key)
+   */
+  void invalidate(int screen);
+
+  /**
+   * Drop every snapshot and free the canvases
+   */
+  void clear();
+
+private:
+  Entry _entries[CAPACITY];
+  uint32_t _clock; // Use counter for LRU
+
+  bool allocate(Entry &entry, int w, int h);
+};
+
+#endif // SCREEN_CACHE_H
@@ -0,0 +1,83 @@
+/**
+ * Screenshot Implementation
+ */
+
+#include "screenshot.h"
+#include "../utils/sd_manager.h"
+#include "../utils/storage_worker.h"
+#include <esp_heap_caps.h>
+#include <time.h>
+
+extern SDManager *sdManager;
+extern StorageWorker *storage;
+
+namespace Screenshot {
+
+static const char *SHOT_DIR = "/debug";
+static const int MAX_WIDTH = 960;
+
+bool capture(LovyanGFX &display, NoteExport::Format format) {
+  if (!storage)
+    return false;
+  int width = display.width();
+  int height = display.height();
+  if (width > MAX_WIDTH)
+    width = MAX_WIDTH;
+  int stride = (width + 1) / 2;
+  uint8_t *pixels =
+      (uint8_t *)heap_caps_malloc(stride * height, MALLOC_CAP_SPIRAM);
+  if (!pixels) {
+    Serial.println("#SHOT ERROR memory");
+    return false;
+  }
+
+  // readRect() gives RGB565 with its bytes swapped; the panel is grey, so
+  // the top four bits of green are the 4-bit level
+  uint16_t row[MAX_WIDTH];
+  for (int y = 0; y < height; y++) {
+    display.readRect(0, y, width, 1, row);
+    uint8_t *out = pixels + y * stride;
+    for (int x = 0; x < width; x++) {
+      uint16_t c = (uint16_t)(row[x] << 8 | row[x] >> 8);
+      uint8_t level = (c >> 7) & 0x0F;
+      if (x & 1)
+        out[x / 2] |= level;
+      else
+        out[x / 2] = level << 4;
+    }
+  }
+
+  time_t now = time(nullptr);
+  struct tm t;
+  localtime_r(&now, &t);
+  char path[48];
+  snprintf(path, sizeof(path), "%s/shot_%04d%02d%02d_%02d%02d%02d.%s",
+           SHOT_DIR, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour,
+           t.tm_min, t.tm_sec,
+           format == NoteExport::Format::PNG ? "png" : "pbm");
+  String file = path;
+
+  bool queued = storage->run(
+      path,
+      [pixels, width, height, format, file](size_t &bytes) {
+        bytes = 0;
+        return sdManager && sdManager->ensureDirectory(SHOT_DIR) &&
+               NoteExport::writeImage(pixels, width, height, format,
+                                      file.c_str(), bytes);
+      },
+      [pixels, file](const StorageResult &result) {
+        free(pixels);
+        if (result.ok)
+          Serial.printf("#SHOT %s %u\n", file.c_str(),
+                        (unsigned)result.bytes);
+        else
+          Serial.printf("#SHOT ERROR %s\n", file.c_str());
+      });
+  if (!queued) {
+    free(pixels);
+    Serial.println("#SHOT ERROR busy");
+  }
+  return queued;
+}
+
+} // namespace Screenshot
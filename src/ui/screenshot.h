@@ -0,0 +1,32 @@
+/**
+ * Screenshot
+ *
+ * Saves what the panel shows to /debug/shot_<date>_<time>.png (or .pbm),
+ * for bug reports and for comparing refresh artefacts. The panel is read
+ * back one row at a time through a small stack buffer into a 4-bit
+ * snapshot in PSRAM, on the loop task so nothing draws halfway through;
+ * the storage worker then encodes the snapshot row by row (NoteExport)
+ * and frees it. No full-screen buffer is taken from internal RAM.
+ *
+ * /debug is exportable, so a host can fetch the file with GET over USB or
+ * BLE (see history_export.h). Completion is logged as
+ *   #SHOT <path> <bytes>    or    #SHOT ERROR <path>
+ */
+
+#ifndef SCREENSHOT_H
+#define SCREENSHOT_H
+
+#include "note_export.h"
+#include <M5Unified.h>
+
+namespace Screenshot {
+
+/**
+ * Snapshot display and queue it for writing
+ * @return false without PSRAM for the snapshot or room in the worker queue
+ */
+bool capture(LovyanGFX &display, NoteExport::Format format);
+
+} // namespace Screenshot
+
+#endif // SCREENSHOT_H
@@ -0,0 +1,61 @@
+/**
+ * Settings Shadow
+ *
+ * The Fossibot settings screens show a tapped value at once, before the
+ * unit has taken it. Each setting on them shadows its register: a tap
+ * marks it pending and queues the write; settings readbacks (0x1103)
+ * refresh every setting that is not pending and leave the pending ones as
+ * tapped; the write's outcome settles the mark. Confirmed (or sent, for
+ * writes with no readback) clears it; failed, after the command queue's
+ * own retries, clears it and tells the screen to show what the unit last
+ * reported instead.
+ *
+ * Writes to one register coalesce in the queue, so an earlier tap ends
+ * SUPERSEDED and leaves the mark to the later one.
+ */
+
+#ifndef SETTINGS_SHADOW_H
+#define SETTINGS_SHADOW_H
+
+#include "../ble/command_queue.h"
+#include <Arduino.h>
+
+class SettingsShadow {
+public:
+  enum Field : uint8_t {
+    BUZZER,
+    SILENT_CHARGING,
+    LIGHT_MODE,
+    CHARGE_LIMIT,
+    DISCHARGE_LIMIT,
+    AC_STANDBY,
+    DC_STANDBY,
+    USB_STANDBY,
+    SCREEN_TIMEOUT,
+    SYS_STANDBY,
+    SCHEDULE_CHARGE,
+    FIELD_COUNT
+  };
+
+  static uint16_t bit(Field field) { return 1u << field; }
+
+  void mark(Field field) { _pending |= bit(field); }
+  bool pending(Field field) const { return _pending & bit(field); }
+  uint16_t pendingMask() const { return _pending; }
+
+  /**
+   * A write's outcome
+   * @return true if the setting should go back to the unit's value
+   */
+  bool settle(Field field, CommandResult result) {
+    if (result == CommandResult::SUPERSEDED)
+      return false; // A later write holds the mark
+    _pending &= ~bit(field);
+    return result == CommandResult::FAILED;
+  }
+
+private:
+  uint16_t _pending = 0;
+};
+
+#endif // SETTINGS_SHADOW_H
@@ -0,0 +1,271 @@
+/**
+ * Sparse Page Implementation
+ */
+
+#include "sparse_page.h"
+#include "../utils/mem_telemetry.h"
+#include "note_codec.h"
+#include <esp_heap_caps.h>
+
+static const int ROW_BYTES = SparsePage::TILE / 8; // One row of a tile
+
+// Bits of each byte of a tile row that lie within the first pixels
+// pixels (left pixel in the top bit)
+static void masks(int pixels, uint8_t *mask) {
+  for (int b = 0; b < ROW_BYTES; b++) {
+    int n = pixels - b * 8;
+    mask[b] = n >= 8 ? 0xFF : n <= 0 ? 0 : (uint8_t)(0xFF << (8 - n));
+  }
+}
+
+SparsePage::SparsePage()
+    : _width(0), _height(0), _cols(0), _rows(0), _map(nullptr), _slots(0),
+      _inked(0) {}
+
+SparsePage::~SparsePage() {
+  for (uint8_t *block : _blocks) {
+    MemTelemetry::track(MemTelemetry::Tag::NOTES,
+                        -(long)(BLOCK_TILES * TILE_BYTES));
+    free(block);
+  }
+  if (_map)
+    MemTelemetry::track(MemTelemetry::Tag::NOTES,
+                        -(long)(_cols * _rows * sizeof(uint16_t)));
+  free(_map);
+}
+
+bool SparsePage::begin(int width, int height) {
+  if (width % TILE || height % TILE)
+    return false;
+  if (_map && width == _width && height == _height) {
+    clear();
+    return true;
+  }
+  if (_map)
+    MemTelemetry::track(MemTelemetry::Tag::NOTES,
+                        -(long)(_cols * _rows * sizeof(uint16_t)));
+  free(_map);
+  _width = width;
+  _height = height;
+  _cols = width / TILE;
+  _rows = height / TILE;
+  size_t mapLen = _cols * _rows * sizeof(uint16_t);
+  _map = (uint16_t *)heap_caps_malloc(mapLen, MALLOC_CAP_SPIRAM);
+  if (!_map) {
+    Serial.printf("Notes: Page map %dx%d allocation failed\n", width,
+                  height);
+    return false;
+  }
+  MemTelemetry::track(MemTelemetry::Tag::NOTES, mapLen);
+  clear();
+  return true;
+}
+
+void SparsePage::clear() {
+  if (_map)
+    memset(_map, 0, _cols * _rows * sizeof(uint16_t));
+  _free.clear();
+  _slots = 0;
+  _inked = 0;
+}
+
+// A pool slot: one handed back, else the next of the blocks, growing them
+// @return -1 without memory
+int SparsePage::take() {
+  if (!_free.empty()) {
+    int index = _free.back();
+    _free.pop_back();
+    return index;
+  }
+  if (_slots == (int)_blocks.size() * BLOCK_TILES) {
+    if (_slots + BLOCK_TILES > UINT16_MAX)
+      return -1;
+    uint8_t *block = (uint8_t *)heap_caps_malloc(BLOCK_TILES * TILE_BYTES,
+                                                 MALLOC_CAP_SPIRAM);
+    if (!block)
+      return -1;
+    MemTelemetry::track(MemTelemetry::Tag::NOTES, BLOCK_TILES * TILE_BYTES);
+    _blocks.push_back(block);
+  }
+  return _slots++;
+}
+
+void SparsePage::blank(int tile) {
+  _free.push_back(_map[tile] - 1);
+  _map[tile] = 0;
+  _inked--;
+}
+
+bool SparsePage::store(const uint8_t *view, int viewW, int viewH, int ox,
+                       int oy) {
+  if (!_map || ox % TILE || oy % TILE)
+    return false;
+  const int stride = (viewW + 7) / 8;
+  bool ok = true;
+  for (int vr = 0; vr * TILE < viewH && oy / TILE + vr < _rows; vr++) {
+    int lines = min((int)TILE, viewH - vr * TILE);
+    for (int vc = 0; vc * TILE < viewW && ox / TILE + vc < _cols; vc++) {
+      int tile = (oy / TILE + vr) * _cols + ox / TILE + vc;
+      uint8_t mask[ROW_BYTES];
+      masks(viewW - vc * TILE, mask);
+      const uint8_t *src =
+          view + (size_t)vr * TILE * stride + vc * ROW_BYTES;
+
+      bool ink = false;
+      for (int y = 0; !ink && y < lines; y++) {
+        for (int b = 0; b < ROW_BYTES; b++) {
+          if (mask[b] && (src[y * stride + b] & mask[b]) != mask[b])
+            ink = true;
+        }
+      }
+      if (!_map[tile]) {
+        if (!ink)
+          continue; // Paper over paper
+        int index = take();
+        if (index < 0) {
+          ok = false;
+          continue;
+        }
+        memset(slot(index), 0xFF, TILE_BYTES);
+        _map[tile] = index + 1;
+        _inked++;
+      }
+
+      uint8_t *dst = slot(_map[tile] - 1);
+      for (int y = 0; y < lines; y++) {
+        for (int b = 0; b < ROW_BYTES; b++) {
+          if (mask[b])
+            dst[y * ROW_BYTES + b] = (dst[y * ROW_BYTES + b] & ~mask[b]) |
+                                     (src[y * stride + b] & mask[b]);
+        }
+      }
+      // Erased: the tile goes back unless the part outside the view is
+      // still inked
+      if (!ink) {
+        bool paper = true;
+        for (int i = 0; paper && i < TILE_BYTES; i++)
+          paper = dst[i] == 0xFF;
+        if (paper)
+          blank(tile);
+      }
+    }
+  }
+  if (!ok)
+    Serial.println("Notes: Page pool full, ink outside the view lost");
+  return ok;
+}
+
+void SparsePage::load(uint8_t *view, int viewW, int viewH, int ox,
+                      int oy) const {
+  const int stride = (viewW + 7) / 8;
+  memset(view, 0xFF, (size_t)stride * viewH);
+  if (!_map || ox % TILE || oy % TILE)
+    return;
+  for (int vr = 0; vr * TILE < viewH && oy / TILE + vr < _rows; vr++) {
+    int lines = min((int)TILE, viewH - vr * TILE);
+    for (int vc = 0; vc * TILE < viewW && ox / TILE + vc < _cols; vc++) {
+      uint16_t index = _map[(oy / TILE + vr) * _cols + ox / TILE + vc];
+      if (!index)
+        continue;
+      uint8_t mask[ROW_BYTES];
+      masks(viewW - vc * TILE, mask);
+      const uint8_t *src = slot(index - 1);
+      uint8_t *dst = view + (size_t)vr * TILE * stride + vc * ROW_BYTES;
+      for (int y = 0; y < lines; y++) {
+        for (int b = 0; b < ROW_BYTES; b++) {
+          if (mask[b])
+            dst[y * stride + b] = (dst[y * stride + b] & ~mask[b]) |
+                                  (src[y * ROW_BYTES + b] & mask[b]);
+        }
+      }
+    }
+  }
+}
+
+// How many of size source pixels map to pixel i of n (floor(p * n / size))
+static int spanOf(int i, int n, int size) {
+  return ((i + 1) * size + n - 1) / n - (i * size + n - 1) / n;
+}
+
+// Box-filtered 4-bit preview from the inked tiles alone: the ink under
+// each thumbnail pixel is counted, paper is everything else
+void SparsePage::thumbnail(uint8_t *out) const {
+  const int tw = NoteCodec::THUMB_W;
+  const int th = NoteCodec::THUMB_H;
+  uint16_t *ink = (uint16_t *)heap_caps_calloc(tw * th, sizeof(uint16_t),
+                                               MALLOC_CAP_SPIRAM);
+  if (!ink) {
+    memset(out, 0xFF, NoteCodec::THUMB_LEN);
+    return;
+  }
+  for (int t = 0; t < _cols * _rows; t++) {
+    if (!_map[t])
+      continue;
+    const uint8_t *pixels = slot(_map[t] - 1);
+    int x0 = t % _cols * TILE;
+    int y0 = t / _cols * TILE;
+    for (int y = 0; y < TILE; y++) {
+      int row = (y0 + y) * th / _height * tw;
+      for (int x = 0; x < TILE; x++) {
+        if (!(pixels[y * ROW_BYTES + x / 8] & (0x80 >> (x % 8))))
+          ink[row + (x0 + x) * tw / _width]++;
+      }
+    }
+  }
+  for (int ty = 0; ty < th; ty++) {
+    int rows = spanOf(ty, th, _height);
+    for (int tx = 0; tx < tw; tx++) {
+      int area = rows * spanOf(tx, tw, _width);
+      int level = 15 - (15 * ink[ty * tw + tx] + area / 2) / area;
+      if (level < 0)
+        level = 0;
+      uint8_t &byte = out[(ty * tw + tx) / 2];
+      if (tx & 1)
+        byte = (byte & 0xF0) | level;
+      else
+        byte = (byte & 0x0F) | level << 4;
+    }
+  }
+  free(ink);
+}
+
+uint8_t *SparsePage::encode(size_t &len) const {
+  if (!_map)
+    return nullptr;
+  uint8_t *thumb =
+      (uint8_t *)heap_caps_malloc(NoteCodec::THUMB_LEN, MALLOC_CAP_SPIRAM);
+  if (thumb)
+    thumbnail(thumb);
+  uint8_t *file = NoteCodec::encodeTiles(
+      _width, _height,
+      [this](int tile) -> const uint8_t * {
+        return _map[tile] ? slot(_map[tile] - 1) : nullptr;
+      },
+      thumb, len);
+  free(thumb);
+  return file;
+}
+
+bool SparsePage::decode(const uint8_t *file, size_t len) {
+  uint16_t width, height;
+  uint8_t depth;
+  if (!_map || !NoteCodec::peek(file, len, width, height, depth) ||
+      width != _width || height != _height)
+    return false;
+  clear();
+  bool ok = NoteCodec::decodeTiles(
+      file, len, [this](int tile, const uint8_t *pixels) {
+        if (tile >= _cols * _rows)
+          return false;
+        int index = take();
+        if (index < 0)
+          return false;
+        memcpy(slot(index), pixels, TILE_BYTES);
+        _map[tile] = index + 1;
+        _inked++;
+        return true;
+      });
+  if (!ok)
+    clear();
+  return ok;
+}
@@ -0,0 +1,96 @@
+/**
+ * Sparse Page
+ *
+ * A Notes page larger than the screen, held as a map of 32x32 1-bit
+ * tiles of which only the inked ones exist: they come from a PSRAM pool
+ * that grows BLOCK_TILES at a time, so blank paper costs two bytes of
+ * map per tile and nothing else.
+ *
+ * The Notes canvas stays the view: drawing, undo and the draft work on
+ * it as before. store() folds the view back into the page at its origin
+ * and load() fills it from another, so the page behind the view is only
+ * touched when the view moves or the page is saved. Origins are whole
+ * tiles; a view that ends part-way through a tile leaves the rest of the
+ * tile alone. Tiles that come back blank return to the pool.
+ *
+ * The page is saved as a v2 note file of its full size (NoteCodec's
+ * encodeTiles(), only the inked tiles stored, with a thumbnail) and read
+ * back from one tile by tile.
+ */
+
+#ifndef SPARSE_PAGE_H
+#define SPARSE_PAGE_H
+
+#include "tile_undo.h"
+#include <Arduino.h>
+#include <vector>
+
+class SparsePage {
+public:
+  static const int TILE = TileUndo::TILE;
+  static const int TILE_BYTES = TileUndo::TILE_BYTES;
+  static const int BLOCK_TILES = 64; // 8 KB of pool per allocation
+
+  SparsePage();
+  ~SparsePage();
+
+  /**
+   * Size the map for a blank page (both sides whole tiles)
+   * @return false without memory for the map
+   */
+  bool begin(int width, int height);
+
+  /**
+   * Blank every tile; the pool is kept for the next ink
+   */
+  void clear();
+
+  /**
+   * Copy a 1-bit view (viewW x viewH, rows of (viewW + 7) / 8 bytes) into
+   * the page with its top left at (ox, oy)
+   * @return false if the pool could not grow (those tiles are lost)
+   */
+  bool store(const uint8_t *view, int viewW, int viewH, int ox, int oy);
+
+  /**
+   * Fill a view from the page at (ox, oy); beyond the page is paper
+   */
+  void load(uint8_t *view, int viewW, int viewH, int ox, int oy) const;
+
+  /**
+   * The whole page as a v2 note file
+   * @return Buffer in PSRAM for the caller to free, or nullptr
+   */
+  uint8_t *encode(size_t &len) const;
+
+  /**
+   * Replace the page with a file encode() wrote at this size
+   */
+  bool decode(const uint8_t *file, size_t len);
+
+  bool isReady() const { return _map != nullptr; }
+  int width() const { return _width; }
+  int height() const { return _height; }
+  int inkedTiles() const { return _inked; }
+  size_t poolBytes() const {
+    return _blocks.size() * BLOCK_TILES * TILE_BYTES;
+  }
+
+private:
+  int _width, _height;
+  int _cols, _rows;
+  uint16_t *_map; // Per tile: 0 blank, else its pool slot + 1 (PSRAM)
+  std::vector<uint8_t *> _blocks;
+  std::vector<uint16_t> _free; // Slots handed back
+  int _slots;                  // Slots handed out from the blocks so far
+  int _inked;
+
+  uint8_t *slot(uint16_t index) const {
+    return _blocks[index / BLOCK_TILES] + index % BLOCK_TILES * TILE_BYTES;
+  }
+  int take();
+  void blank(int tile);
+  void thumbnail(uint8_t *out) const;
+};
+
+#endif // SPARSE_PAGE_H
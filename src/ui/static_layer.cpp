@@ -0,0 +1,49 @@
+/**
+ * Static Layer Implementation
+ */
+
+#include "static_layer.h"
+#include "raster4.h"
+
+bool StaticLayer::allocate(int w, int h) {
+  if (_canvas && _canvas->width() == w && _canvas->height() == h)
+    return true;
+  delete _canvas;
+  _canvas = new M5Canvas(&M5.Display);
+  _canvas->setColorDepth(4);
+  _canvas->setPsram(true);
+  if (!_canvas->createSprite(w, h)) {
+    Serial.printf("UI: Static layer %dx%d allocation failed\n", w, h);
+    delete _canvas;
+    _canvas = nullptr;
+    return false;
+  }
+  return true;
+}
+
+M5Canvas *StaticLayer::prepare(int x, int y, int w, int h, uint32_t key,
+                               const Painter &paint) {
+  bool fresh = _valid && _canvas && _key == key && _x == x && _y == y &&
+               _canvas->width() == w && _canvas->height() == h;
+  if (!fresh) {
+    _valid = false;
+    if (!allocate(w, h))
+      return nullptr;
+    Raster4::clear(*_canvas);
+    paint(*_canvas, -x, -y);
+    _x = x;
+    _y = y;
+    _key = key;
+    _valid = true;
+  }
+  return _canvas;
+}
+
+void StaticLayer::draw(LovyanGFX &g, int x, int y, int w, int h,
+                       uint32_t key, const Painter &paint) {
+  M5Canvas *canvas = prepare(x, y, w, h, key, paint);
+  if (canvas)
+    canvas->pushSprite(&g, x, y);
+  else
+    paint(g, 0, 0); // No PSRAM: paint direct, every time
+}
@@ -0,0 +1,62 @@
+/**
+ * Static Layer
+ *
+ * The unchanging part of a screen region (frames, axes, grid dots, fixed
+ * labels) rendered once into a 4-bit canvas in PSRAM. A redraw pushes the
+ * cached pixels in one block copy and paints only the live content on top.
+ *
+ * The layer is keyed by whatever its contents depend on (a graph scale, a
+ * layout id); a different key repaints it. Paint callbacks draw in screen
+ * coordinates, shifted by the layer's origin.
+ *
+ * If PSRAM allocation fails, draw() paints straight to the target instead,
+ * so callers never need a second code path.
+ */
+
+#ifndef STATIC_LAYER_H
+#define STATIC_LAYER_H
+
+#include <M5Unified.h>
+#include <functional>
+
+class StaticLayer {
+public:
+  /**
+   * Paint into g; add (ox, oy) to every screen coordinate
+   */
+  typedef std::function<void(LovyanGFX &g, int ox, int oy)> Painter;
+
+  StaticLayer() : _canvas(nullptr), _x(0), _y(0), _key(0), _valid(false) {}
+  ~StaticLayer() { delete _canvas; }
+
+  /**
+   * Push the layer for key to g at (x, y), repainting it first if the key
+   * or size changed
+   */
+  void draw(LovyanGFX &g, int x, int y, int w, int h, uint32_t key,
+            const Painter &paint);
+
+  /**
+   * Bring the layer up to date for key without pushing it
+   * @return The layer's canvas, or nullptr without PSRAM for it
+   */
+  M5Canvas *prepare(int x, int y, int w, int h, uint32_t key,
+                    const Painter &paint);
+
+  /**
+   * Repaint on the next draw (e.g. after a layout or theme change)
+   */
+  void invalidate() { _valid = false; }
+
+  bool isValid() const { return _valid; }
+
+private:
+  M5Canvas *_canvas;
+  int _x, _y;
+  uint32_t _key;
+  bool _valid;
+
+  bool allocate(int w, int h);
+};
+
+#endif // STATIC_LAYER_H
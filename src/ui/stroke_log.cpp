@@ -0,0 +1,235 @@
+/**
+ * Stroke Log Implementation
+ */
+
+#include "stroke_log.h"
+#include "../utils/crc16.h"
+
+#define STROKE_LOG_MAGIC 0x4B54534E // "NSTK"
+#define STROKE_LOG_VERSION 2 // 1: no varying strokes
+
+// Per stroke: size, colour, point count, first point; then the deltas
+static const size_t STROKE_HEAD = 9;
+
+// Set on the size byte: each point is followed by a width delta
+static const uint8_t SIZE_VARYING = 0x80;
+
+static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (v >> 31); }
+static int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+StrokeLog::StrokeLog()
+    : _complete(true), _open(false), _lastX(0), _lastY(0), _lastSize(0),
+      _varying(false), _points(0) {}
+
+void StrokeLog::clear() {
+  _data.clear();
+  _starts.clear();
+  _undone.clear();
+  _complete = true;
+  _open = false;
+}
+
+void StrokeLog::putVarint(uint32_t value) {
+  while (value >= 0x80) {
+    _data.push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  _data.push_back(value);
+}
+
+bool StrokeLog::getVarint(const uint8_t *data, size_t len, size_t &i,
+                          uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (i >= len)
+      return false;
+    uint8_t b = data[i++];
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+void StrokeLog::overflow() {
+  // Too much ink to keep as vectors: the raster alone describes the page
+  Serial.println("Notes: Stroke log full, undo disabled for this page");
+  _data.clear();
+  _data.shrink_to_fit();
+  _starts.clear();
+  _undone.clear();
+  _complete = false;
+  _open = false;
+}
+
+void StrokeLog::begin(int size, uint16_t color, int x, int y, bool varying) {
+  _open = false;
+  _undone.clear(); // New ink ends redo
+  if (!_complete)
+    return;
+  if (_data.size() + STROKE_HEAD > MAX_BYTES) {
+    overflow();
+    return;
+  }
+
+  _starts.push_back(_data.size());
+  uint8_t head[STROKE_HEAD];
+  head[0] = (size & ~SIZE_VARYING) | (varying ? SIZE_VARYING : 0);
+  memcpy(head + 1, &color, 2);
+  _points = 1;
+  memcpy(head + 3, &_points, 2);
+  int16_t px = x, py = y;
+  memcpy(head + 5, &px, 2);
+  memcpy(head + 7, &py, 2);
+  _data.insert(_data.end(), head, head + STROKE_HEAD);
+  _lastX = x;
+  _lastY = y;
+  _lastSize = size & ~SIZE_VARYING;
+  _varying = varying;
+  _open = true;
+}
+
+void StrokeLog::add(int x, int y, int size) {
+  if (!_open || (x == _lastX && y == _lastY))
+    return;
+  if (_points == 0xFFFF) {
+    // Point count is 16 bits: carry on as a new stroke from here
+    const uint8_t *head = _data.data() + _starts.back();
+    uint16_t color;
+    memcpy(&color, head + 1, 2);
+    begin(_lastSize, color, _lastX, _lastY, _varying);
+    add(x, y, size);
+    return;
+  }
+  if (_data.size() + 15 > MAX_BYTES) { // Three varints of up to 5 bytes
+    overflow();
+    return;
+  }
+
+  putVarint(zigzag(x - _lastX));
+  putVarint(zigzag(y - _lastY));
+  if (_varying) {
+    putVarint(zigzag(size - _lastSize));
+    _lastSize = size;
+  }
+  _lastX = x;
+  _lastY = y;
+  _points++;
+  memcpy(_data.data() + _starts.back() + 3, &_points, 2);
+}
+
+void StrokeLog::end() { _open = false; }
+
+bool StrokeLog::undo() {
+  if (_starts.empty() || !_complete)
+    return false;
+  _undone.emplace_back(_data.begin() + _starts.back(), _data.end());
+  _data.resize(_starts.back());
+  _starts.pop_back();
+  _open = false;
+  return true;
+}
+
+bool StrokeLog::redo() {
+  if (_undone.empty() || !_complete)
+    return false;
+  _starts.push_back(_data.size());
+  _data.insert(_data.end(), _undone.back().begin(), _undone.back().end());
+  _undone.pop_back();
+  _open = false;
+  return true;
+}
+
+void StrokeLog::replay(StrokeRenderer &renderer) const {
+  const uint8_t *data = _data.data();
+  size_t len = _data.size();
+  for (size_t s = 0; s < _starts.size(); s++) {
+    size_t i = _starts[s];
+    uint16_t color, points;
+    int16_t x, y;
+    memcpy(&color, data + i + 1, 2);
+    memcpy(&points, data + i + 3, 2);
+    memcpy(&x, data + i + 5, 2);
+    memcpy(&y, data + i + 7, 2);
+    bool varying = data[i] & SIZE_VARYING;
+    int size = data[i] & ~SIZE_VARYING;
+    renderer.setPen(size, color);
+    renderer.begin(x, y);
+    int cx = x, cy = y;
+    i += STROKE_HEAD;
+    for (uint16_t p = 1; p < points; p++) {
+      uint32_t dx, dy, dw;
+      if (!getVarint(data, len, i, dx) || !getVarint(data, len, i, dy))
+        break;
+      if (varying) {
+        if (!getVarint(data, len, i, dw))
+          break;
+        size += unzigzag(dw);
+        renderer.setPen(size, color);
+      }
+      cx += unzigzag(dx);
+      cy += unzigzag(dy);
+      renderer.addPoint(cx, cy);
+    }
+    renderer.end();
+  }
+}
+
+void StrokeLog::seal(Header &header, uint16_t rasterCrc) const {
+  header.magic = STROKE_LOG_MAGIC;
+  header.version = STROKE_LOG_VERSION;
+  header.strokes = _starts.size();
+  header.length = _data.size();
+  header.crc = CRC16::modbus(_data.data(), _data.size());
+  header.rasterCrc = rasterCrc;
+}
+
+bool StrokeLog::parse() {
+  _starts.clear();
+  const uint8_t *data = _data.data();
+  size_t len = _data.size();
+  size_t i = 0;
+  while (i < len) {
+    if (i + STROKE_HEAD > len)
+      return false;
+    _starts.push_back(i);
+    uint16_t points;
+    memcpy(&points, data + i + 3, 2);
+    bool varying = data[i] & SIZE_VARYING;
+    i += STROKE_HEAD;
+    for (uint16_t p = 1; p < points; p++) {
+      uint32_t dx, dy, dw;
+      if (!getVarint(data, len, i, dx) || !getVarint(data, len, i, dy) ||
+          (varying && !getVarint(data, len, i, dw)))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool StrokeLog::load(const uint8_t *file, size_t len, uint16_t &rasterCrc) {
+  clear();
+  Header header;
+  if (len < sizeof(header))
+    return false;
+  memcpy(&header, file, sizeof(header));
+  const uint8_t *body = file + sizeof(header);
+  if (header.magic != STROKE_LOG_MAGIC || header.version < 1 ||
+      header.version > STROKE_LOG_VERSION ||
+      header.length != len - sizeof(header) || header.length > MAX_BYTES ||
+      CRC16::modbus(body, header.length) != header.crc) {
+    Serial.println("Notes: Stroke log invalid");
+    return false;
+  }
+
+  _data.assign(body, body + header.length);
+  if (!parse() || _starts.size() != header.strokes) {
+    Serial.println("Notes: Stroke log invalid");
+    clear();
+    return false;
+  }
+  rasterCrc = header.rasterCrc;
+  return true;
+}
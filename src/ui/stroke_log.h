@@ -0,0 +1,110 @@
+/**
+ * Stroke Log
+ *
+ * Vector record of the ink on the notes canvas: every stroke's pen size,
+ * colour and points, the points delta-encoded as zigzag varints (one byte
+ * per axis for normal handwriting). Strokes drawn with a varying width
+ * also carry a width delta per point. Replaying the log through a
+ * StrokeRenderer redraws the page; undo drops the last stroke (kept for
+ * redo until the next one) so what is saved matches the canvas.
+ *
+ * Saved as <note>.stk next to the note's raster, which acts as its cache:
+ * the header records the CRC of the raster it was saved with.
+ */
+
+#ifndef STROKE_LOG_H
+#define STROKE_LOG_H
+
+#include "stroke_renderer.h"
+#include <Arduino.h>
+#include <vector>
+
+class StrokeLog {
+public:
+  static const size_t MAX_BYTES = 262144; // Beyond this, recording stops
+
+  struct __attribute__((packed)) Header {
+    uint32_t magic; // "NSTK"
+    uint16_t version;
+    uint16_t strokes;
+    uint32_t length;    // Bytes of stroke data that follow
+    uint16_t crc;       // CRC16 of the stroke data
+    uint16_t rasterCrc; // CRC of the v2 note raster saved alongside
+  };
+  static_assert(sizeof(Header) == 16, "Header layout is on disk");
+
+  StrokeLog();
+
+  /**
+   * Forget every stroke and start recording again
+   */
+  void clear();
+
+  /**
+   * @param varying Points carry their own width (see add())
+   */
+  void begin(int size, uint16_t color, int x, int y, bool varying = false);
+
+  /**
+   * @param size Width at this point, for a varying stroke
+   */
+  void add(int x, int y, int size = 0);
+  void end();
+
+  /**
+   * Drop the newest stroke
+   * @return false if there is none
+   */
+  bool undo();
+
+  /**
+   * Put back the stroke undo() dropped last
+   * @return false if there is none, or a stroke was drawn since
+   */
+  bool redo();
+
+  /**
+   * Draw every stroke through the renderer, as it was first drawn
+   */
+  void replay(StrokeRenderer &renderer) const;
+
+  /**
+   * Fill a header for saving the log with the given raster
+   */
+  void seal(Header &header, uint16_t rasterCrc) const;
+
+  /**
+   * Replace the log with a saved one (header followed by stroke data)
+   * @return false if the file is not a valid log; the log is then empty
+   */
+  bool load(const uint8_t *file, size_t len, uint16_t &rasterCrc);
+
+  /**
+   * False once the log overflowed MAX_BYTES: it no longer describes the
+   * page and is neither replayed for undo nor saved
+   */
+  bool isComplete() const { return _complete; }
+
+  size_t strokeCount() const { return _starts.size(); }
+  const uint8_t *data() const { return _data.data(); }
+  size_t size() const { return _data.size(); }
+
+private:
+  std::vector<uint8_t> _data;
+  std::vector<uint32_t> _starts; // Offset of each stroke in _data
+  std::vector<std::vector<uint8_t>> _undone; // Newest last, for redo
+  bool _complete;
+  bool _open; // A stroke is being recorded
+  int _lastX, _lastY;
+  int _lastSize;    // Width of the open stroke's last point
+  bool _varying;    // The open stroke records widths
+  uint16_t _points; // In the open stroke
+
+  void overflow();
+  void putVarint(uint32_t value);
+  static bool getVarint(const uint8_t *data, size_t len, size_t &i,
+                        uint32_t &value);
+  bool parse(); // Rebuild _starts from _data
+};
+
+#endif // STROKE_LOG_H
@@ -0,0 +1,223 @@
+/**
+ * Stroke Renderer Implementation
+ */
+
+#include "stroke_renderer.h"
+#include "tile_undo.h"
+
+StrokeRenderer::StrokeRenderer()
+    : _display(nullptr), _canvas(nullptr), _undo(nullptr), _penSize(2),
+      _penColor(0),
+      _active(false), _count(0), _hasPrediction(false), _predX0(0),
+      _predY0(0), _predX1(0), _predY1(0) {}
+
+void StrokeRenderer::attach(LovyanGFX *display, M5Canvas *canvas) {
+  _display = display;
+  _canvas = canvas;
+}
+
+void StrokeRenderer::setPen(int size, uint16_t color) {
+  _penSize = size > 0 ? size : 1;
+  _penColor = color;
+}
+
+void StrokeRenderer::begin(int x, int y) {
+  if (_active)
+    end();
+
+  Pt p = {(float)x, (float)y};
+  for (int i = 0; i < 4; i++)
+    _p[i] = p;
+  _count = 1;
+  _active = true;
+
+  // Start dot
+  drawSpan(p, p);
+}
+
+void StrokeRenderer::addPoint(int x, int y) {
+  if (!_active) {
+    begin(x, y);
+    return;
+  }
+
+  // Sub-pixel jitter adds nothing but overdraw
+  float dx = x - _p[3].x;
+  float dy = y - _p[3].y;
+  if (dx * dx + dy * dy < 1.0f)
+    return;
+
+  clearPrediction();
+
+  _p[0] = _p[1];
+  _p[1] = _p[2];
+  _p[2] = _p[3];
+  _p[3] = {(float)x, (float)y};
+  _count++;
+
+  // The curve p1->p2 is now fully constrained: commit it
+  drawCurveSegment();
+}
+
+void StrokeRenderer::end() {
+  if (!_active)
+    return;
+
+  clearPrediction();
+
+  // Flush the last pending segment by repeating the final point
+  _p[0] = _p[1];
+  _p[1] = _p[2];
+  _p[2] = _p[3];
+  drawCurveSegment();
+
+  _active = false;
+  _count = 0;
+}
+
+StrokeRenderer::Pt StrokeRenderer::catmullRom(float t) const {
+  float t2 = t * t;
+  float t3 = t2 * t;
+  Pt r;
+  r.x = 0.5f * ((2 * _p[1].x) + (-_p[0].x + _p[2].x) * t +
+                (2 * _p[0].x - 5 * _p[1].x + 4 * _p[2].x - _p[3].x) * t2 +
+                (-_p[0].x + 3 * _p[1].x - 3 * _p[2].x + _p[3].x) * t3);
+  r.y = 0.5f * ((2 * _p[1].y) + (-_p[0].y + _p[2].y) * t +
+                (2 * _p[0].y - 5 * _p[1].y + 4 * _p[2].y - _p[3].y) * t2 +
+                (-_p[0].y + 3 * _p[1].y - 3 * _p[2].y + _p[3].y) * t3);
+  return r;
+}
+
+void StrokeRenderer::drawCurveSegment() {
+  float dx = _p[2].x - _p[1].x;
+  float dy = _p[2].y - _p[1].y;
+  float len = sqrtf(dx * dx + dy * dy);
+  if (len < 0.5f)
+    return;
+
+  // One sub-span per ~pen width keeps curves round without overdraw
+  int step = _penSize < 4 ? 4 : _penSize;
+  int steps = (int)(len / step) + 1;
+  if (steps > 16)
+    steps = 16;
+
+  Pt prev = _p[1];
+  for (int i = 1; i <= steps; i++) {
+    Pt cur = catmullRom((float)i / steps);
+    drawSpan(prev, cur);
+    prev = cur;
+  }
+}
+
+void StrokeRenderer::drawSpan(const Pt &a, const Pt &b) {
+  float r = _penSize / 2.0f;
+  if (r < 0.5f)
+    r = 0.5f;
+
+  // Without a canvas there is nothing to push from: draw straight through
+  if (!_canvas) {
+    if (_display)
+      _display->drawWideLine(a.x, a.y, b.x, b.y, r, _penColor);
+    return;
+  }
+
+  if (_undo) {
+    int pad = (int)r + 1;
+    _undo->capture((int)min(a.x, b.x) - pad, (int)min(a.y, b.y) - pad,
+                   (int)max(a.x, b.x) + pad, (int)max(a.y, b.y) + pad);
+  }
+  _canvas->drawWideLine(a.x, a.y, b.x, b.y, r, _penColor);
+  addDamage(a, b);
+}
+
+void StrokeRenderer::addDamage(const Pt &a, const Pt &b) {
+  int pad = _penSize / 2 + 2;
+  _damage.add((int)min(a.x, b.x) - pad, (int)min(a.y, b.y) - pad,
+              (int)max(a.x, b.x) + pad, (int)max(a.y, b.y) + pad);
+}
+
+int StrokeRenderer::flush() {
+  int pushed = 0;
+  if (_display && _canvas) {
+    int cw = _canvas->width();
+    int ch = _canvas->height();
+    for (int i = 0; i < _damage.count(); i++) {
+      const DamageRect &r = _damage.rect(i);
+      int x0 = max((int)r.x0, 0);
+      int y0 = max((int)r.y0, 0);
+      int x1 = min((int)r.x1, cw - 1);
+      int y1 = min((int)r.y1, ch - 1);
+      if (x1 < x0 || y1 < y0)
+        continue;
+
+      // One coalesced region: copy committed ink from the canvas
+      _display->setClipRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+      _canvas->pushSprite(_display, 0, 0);
+      _display->clearClipRect();
+      pushed++;
+    }
+  }
+  _damage.clear();
+
+  // Re-draw the guess only after new ink replaced the previous one
+  if (_active && !_hasPrediction)
+    drawPrediction();
+  return pushed;
+}
+
+void StrokeRenderer::growPrediction(const Pt &a, const Pt &b) {
+  int pad = _penSize / 2 + 2;
+  int x0 = (int)min(a.x, b.x) - pad;
+  int y0 = (int)min(a.y, b.y) - pad;
+  int x1 = (int)max(a.x, b.x) + pad;
+  int y1 = (int)max(a.y, b.y) + pad;
+  if (!_hasPrediction) {
+    _predX0 = x0;
+    _predY0 = y0;
+    _predX1 = x1;
+    _predY1 = y1;
+    _hasPrediction = true;
+    return;
+  }
+  _predX0 = min(_predX0, x0);
+  _predY0 = min(_predY0, y0);
+  _predX1 = max(_predX1, x1);
+  _predY1 = max(_predY1, y1);
+}
+
+void StrokeRenderer::drawPrediction() {
+  // Prediction is only safe when the canvas can restore it
+  if (!_display || !_canvas)
+    return;
+
+  // Extrapolate one sample ahead from the latest velocity
+  float vx = _p[3].x - _p[2].x;
+  float vy = _p[3].y - _p[2].y;
+  float len = sqrtf(vx * vx + vy * vy);
+  if (len > MAX_PREDICT_PX) {
+    vx = vx * MAX_PREDICT_PX / len;
+    vy = vy * MAX_PREDICT_PX / len;
+  }
+  Pt ahead = {_p[3].x + vx, _p[3].y + vy};
+
+  // Keep predicted ink inside the canvas so restoring covers all of it
+  _display->setClipRect(0, 0, _canvas->width(), _canvas->height());
+  float r = _penSize / 2.0f;
+  if (r < 0.5f)
+    r = 0.5f;
+  _display->drawWideLine(_p[2].x, _p[2].y, _p[3].x, _p[3].y, r, _penColor);
+  _display->drawWideLine(_p[3].x, _p[3].y, ahead.x, ahead.y, r, _penColor);
+  _display->clearClipRect();
+
+  growPrediction(_p[2], _p[3]);
+  growPrediction(_p[3], ahead);
+}
+
+void StrokeRenderer::clearPrediction() {
+  if (!_hasPrediction)
+    return;
+  _hasPrediction = false;
+
+  // The next flush() repaints this area from the canvas
+  _damage.add(_predX0, _predY0, _predX1, _predY1);
+}
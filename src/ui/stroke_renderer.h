@@ -0,0 +1,89 @@
+/**
+ * Stroke Renderer
+ *
+ * Smooth ink for the Notes canvas. Sampled points are joined with
+ * Catmull-Rom curves and each segment is rasterized once as a thick span
+ * (round-capped wide lines) into the backing canvas. The bounds of new ink
+ * go to a DamageTracker, and flush() pushes each merged region from the
+ * canvas to the display once per frame.
+ *
+ * To hide touch latency the tail of the stroke is drawn ahead of the last
+ * confirmed segment on the display only: the pending segment plus a short
+ * linear extrapolation. Its area is marked damaged on the next frame, so
+ * the push from the canvas replaces the guess with the real curve.
+ *
+ * With a TileUndo attached, canvas tiles are captured before each span is
+ * drawn into them.
+ */
+
+#ifndef STROKE_RENDERER_H
+#define STROKE_RENDERER_H
+
+#include "damage_tracker.h"
+#include <M5Unified.h>
+
+class TileUndo;
+
+class StrokeRenderer {
+public:
+  // Max length of the extrapolated tail in pixels
+  static const int MAX_PREDICT_PX = 24;
+
+  StrokeRenderer();
+
+  /**
+   * Set draw targets. Canvas must share the display's coordinate origin.
+   */
+  void attach(LovyanGFX *display, M5Canvas *canvas);
+
+  /**
+   * Capture canvas tiles into undo before drawing (null: none)
+   */
+  void setUndo(TileUndo *undo) { _undo = undo; }
+
+  void setPen(int size, uint16_t color);
+
+  void begin(int x, int y);
+  void addPoint(int x, int y);
+  void end();
+
+  /**
+   * Push this frame's damaged regions from the canvas to the display, then
+   * draw the predicted tail. Call inside startWrite()/endWrite().
+   * @return number of regions pushed
+   */
+  int flush();
+
+  bool isActive() const { return _active; }
+
+private:
+  struct Pt {
+    float x, y;
+  };
+
+  LovyanGFX *_display;
+  M5Canvas *_canvas;
+  TileUndo *_undo;
+  int _penSize;
+  uint16_t _penColor;
+  bool _active;
+
+  Pt _p[4]; // Control points, _p[3] is the newest sample
+  int _count;
+
+  DamageTracker _damage;
+
+  // Display-only predicted ink awaiting replacement
+  bool _hasPrediction;
+  int _predX0, _predY0, _predX1, _predY1;
+
+  Pt catmullRom(float t) const;
+  void drawCurveSegment();
+  void drawSpan(const Pt &a, const Pt &b);
+  void drawPrediction();
+  void clearPrediction();
+  void growPrediction(const Pt &a, const Pt &b);
+  void addDamage(const Pt &a, const Pt &b);
+};
+
+#endif // STROKE_RENDERER_H
@@ -0,0 +1,337 @@
+/**
+ * Sudoku Rules Implementation
+ */
+
+#include "sudoku.h"
+#include <string.h>
+
+namespace Sudoku {
+
+static const int UNITS = 3 * SIZE; // Rows, then columns, then boxes
+static const int MAX_ATTEMPTS = 100;
+
+// Givens each grade keeps at least, so the easier ones look easier too
+static const int MIN_GIVENS[] = {18, 12, 0};
+
+struct Masks {
+  uint8_t row[SIZE];
+  uint8_t col[SIZE];
+  uint8_t box[SIZE];
+};
+
+static inline uint8_t candidates(const Masks &m, int r, int c) {
+  return ALL_DIGITS & ~(m.row[r] | m.col[c] | m.box[boxOf(r, c)]);
+}
+
+static inline void place(Masks &m, int r, int c, int digit) {
+  uint8_t bit = digitBit(digit);
+  m.row[r] |= bit;
+  m.col[c] |= bit;
+  m.box[boxOf(r, c)] |= bit;
+}
+
+static inline void unplace(Masks &m, int r, int c, int digit) {
+  uint8_t bit = ~digitBit(digit);
+  m.row[r] &= bit;
+  m.col[c] &= bit;
+  m.box[boxOf(r, c)] &= bit;
+}
+
+static inline int bitCount(uint8_t v) { return __builtin_popcount(v); }
+
+static inline int lowestDigit(uint8_t v) { return __builtin_ctz(v) + 1; }
+
+// The masks of the givens; false if two of them clash
+static bool buildMasks(const Grid grid, Masks &m) {
+  memset(&m, 0, sizeof(m));
+  for (int r = 0; r < SIZE; r++) {
+    for (int c = 0; c < SIZE; c++) {
+      int digit = grid[r][c];
+      if (!digit)
+        continue;
+      if (digit > SIZE || !(candidates(m, r, c) & digitBit(digit)))
+        return false;
+      place(m, r, c, digit);
+    }
+  }
+  return true;
+}
+
+// xorshift32: small, and the same on the device and a host build
+static inline uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+struct Search {
+  Grid grid;
+  Masks masks;
+  Grid *solution;
+  int found;
+  int limit;
+  uint32_t *random; // Shuffle the candidates (filling a fresh grid)
+};
+
+static void solve(Search &s) {
+  // The empty cell with the fewest candidates
+  int bestR = -1, bestC = -1, bestCount = SIZE + 1;
+  uint8_t bestMask = 0;
+  for (int r = 0; r < SIZE && bestCount > 1; r++) {
+    for (int c = 0; c < SIZE; c++) {
+      if (s.grid[r][c])
+        continue;
+      uint8_t mask = candidates(s.masks, r, c);
+      int count = bitCount(mask);
+      if (count < bestCount) {
+        bestR = r;
+        bestC = c;
+        bestCount = count;
+        bestMask = mask;
+        if (count <= 1)
+          break;
+      }
+    }
+  }
+
+  if (bestR < 0) { // Full
+    if (s.found++ == 0 && s.solution)
+      memcpy(*s.solution, s.grid, sizeof(Grid));
+    return;
+  }
+
+  uint8_t order[SIZE];
+  int n = 0;
+  for (uint8_t mask = bestMask; mask; mask &= mask - 1)
+    order[n++] = lowestDigit(mask);
+  if (s.random) {
+    for (int i = n - 1; i > 0; i--) {
+      int j = nextRandom(*s.random) % (i + 1);
+      uint8_t t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+  }
+
+  for (int i = 0; i < n && s.found < s.limit; i++) {
+    s.grid[bestR][bestC] = order[i];
+    place(s.masks, bestR, bestC, order[i]);
+    solve(s);
+    unplace(s.masks, bestR, bestC, order[i]);
+  }
+  s.grid[bestR][bestC] = 0;
+}
+
+int countSolutions(const Grid puzzle, Grid solution, int limit) {
+  Search s;
+  memcpy(s.grid, puzzle, sizeof(Grid));
+  if (!buildMasks(s.grid, s.masks))
+    return 0;
+  s.solution = (Grid *)solution;
+  s.found = 0;
+  s.limit = limit;
+  s.random = nullptr;
+  solve(s);
+  return s.found;
+}
+
+// Cells of unit u: rows 0-5, columns 6-11, boxes 12-17
+static inline void unitCell(int u, int i, int &r, int &c) {
+  if (u < SIZE) {
+    r = u;
+    c = i;
+  } else if (u < 2 * SIZE) {
+    r = i;
+    c = u - SIZE;
+  } else {
+    int b = u - 2 * SIZE;
+    r = (b / BOX_ROWS) * BOX_ROWS + i / BOX_COLS;
+    c = (b % BOX_ROWS) * BOX_COLS + i % BOX_COLS;
+  }
+}
+
+Grade grade(const Grid puzzle) {
+  Grid grid;
+  Masks m;
+  memcpy(grid, puzzle, sizeof(Grid));
+  if (!buildMasks(grid, m))
+    return HARD;
+
+  Grade needed = EASY;
+  int empty = CELLS - givens(grid);
+  while (empty > 0) {
+    // Naked singles first: every one the grid has, in one sweep
+    bool progress = false;
+    for (int r = 0; r < SIZE; r++) {
+      for (int c = 0; c < SIZE; c++) {
+        if (grid[r][c])
+          continue;
+        uint8_t mask = candidates(m, r, c);
+        if (!mask)
+          return HARD; // A dead end: the givens have no solution
+        if (bitCount(mask) == 1) {
+          grid[r][c] = lowestDigit(mask);
+          place(m, r, c, grid[r][c]);
+          empty--;
+          progress = true;
+        }
+      }
+    }
+    if (progress)
+      continue;
+
+    // Then one hidden single, and back to the cheaper technique
+    for (int u = 0; u < UNITS && !progress; u++) {
+      for (int digit = 1; digit <= SIZE && !progress; digit++) {
+        int places = 0, atR = 0, atC = 0;
+        for (int i = 0; i < SIZE && places < 2; i++) {
+          int r, c;
+          unitCell(u, i, r, c);
+          if (grid[r][c] == digit) {
+            places = 2; // Already placed in this unit
+          } else if (!grid[r][c] &&
+                     (candidates(m, r, c) & digitBit(digit))) {
+            places++;
+            atR = r;
+            atC = c;
+          }
+        }
+        if (places == 1) {
+          grid[atR][atC] = digit;
+          place(m, atR, atC, digit);
+          empty--;
+          progress = true;
+        }
+      }
+    }
+    if (!progress)
+      return HARD;
+    needed = MEDIUM;
+  }
+  return needed;
+}
+
+int givens(const Grid puzzle) {
+  int count = 0;
+  for (int r = 0; r < SIZE; r++)
+    for (int c = 0; c < SIZE; c++)
+      count += puzzle[r][c] != 0;
+  return count;
+}
+
+// Remove givens in random order while the puzzle stays unique and no
+// harder than target
+static Grade dig(Grade target, uint32_t &random, Grid puzzle) {
+  uint8_t order[CELLS];
+  for (int i = 0; i < CELLS; i++)
+    order[i] = i;
+  for (int i = CELLS - 1; i > 0; i--) {
+    int j = nextRandom(random) % (i + 1);
+    uint8_t t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+
+  Grade current = EASY;
+  int left = CELLS;
+  for (int i = 0; i < CELLS; i++) {
+    if (left <= MIN_GIVENS[target])
+      break;
+    int r = order[i] / SIZE, c = order[i] % SIZE;
+    uint8_t digit = puzzle[r][c];
+    puzzle[r][c] = 0;
+    Grade g = grade(puzzle);
+    bool keep = g <= target &&
+                (g < HARD || countSolutions(puzzle, nullptr, 2) == 1);
+    if (keep) {
+      current = g;
+      left--;
+    } else {
+      puzzle[r][c] = digit;
+    }
+  }
+  return current;
+}
+
+void Board::clear() {
+  memset(_cells, 0, sizeof(_cells));
+  memset(_count, 0, sizeof(_count));
+  memset(_mask, 0, sizeof(_mask));
+  _filled = 0;
+  _clashes = 0;
+}
+
+void Board::load(const Grid grid) {
+  clear();
+  for (int r = 0; r < SIZE; r++)
+    for (int c = 0; c < SIZE; c++)
+      set(r, c, grid[r][c]);
+}
+
+void Board::count(int r, int c, int digit, int delta) {
+  int unit[3] = {r, c, boxOf(r, c)};
+  for (int k = 0; k < 3; k++) {
+    uint8_t &n = _count[k][unit[k]][digit - 1];
+    if (delta > 0) {
+      if (n++ == 1)
+        _clashes++;
+      _mask[k][unit[k]] |= digitBit(digit);
+    } else {
+      if (--n == 1)
+        _clashes--;
+      else if (n == 0)
+        _mask[k][unit[k]] &= ~digitBit(digit);
+    }
+  }
+}
+
+void Board::set(int r, int c, int digit) {
+  if (digit < 0 || digit > SIZE || _cells[r][c] == digit)
+    return;
+  if (_cells[r][c]) {
+    count(r, c, _cells[r][c], -1);
+    _filled--;
+  }
+  _cells[r][c] = digit;
+  if (digit) {
+    count(r, c, digit, 1);
+    _filled++;
+  }
+}
+
+bool Board::conflicts(int r, int c) const {
+  int digit = _cells[r][c];
+  if (!digit)
+    return false;
+  return _count[0][r][digit - 1] > 1 || _count[1][c][digit - 1] > 1 ||
+         _count[2][boxOf(r, c)][digit - 1] > 1;
+}
+
+bool generate(Grade target, uint32_t seed, Grid puzzle, Grid solution) {
+  uint32_t random = seed ? seed : 0x5D0C5D0C; // xorshift is stuck at 0
+  int bestGrade = -1;
+  for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+    Search s;
+    memset(&s, 0, sizeof(s));
+    s.limit = 1;
+    s.random = &random;
+    Grid full;
+    s.solution = &full;
+    solve(s);
+
+    Grid candidate;
+    memcpy(candidate, full, sizeof(Grid));
+    Grade g = dig(target, random, candidate);
+    if ((int)g > bestGrade) {
+      bestGrade = g;
+      memcpy(puzzle, candidate, sizeof(Grid));
+      memcpy(solution, full, sizeof(Grid));
+    }
+    if (g == target)
+      return true;
+  }
+  return false;
+}
+
+} // namespace Sudoku
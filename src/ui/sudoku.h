@@ -0,0 +1,125 @@
+/**
+ * Sudoku Rules
+ *
+ * Solving, grading and generating the 6x6 puzzles (2x3 boxes) the Sudoku
+ * game plays, kept apart from UIManager like the 2048 rules.
+ *
+ * Each row, column and box keeps a 6-bit mask of the digits it holds, so
+ * a cell's candidates are one AND of three masks. The solver fills the
+ * empty cell with the fewest candidates first and stops counting at a
+ * limit, which makes "exactly one solution" a two-solution search.
+ *
+ * grade() plays the puzzle the way a person would: naked singles (a cell
+ * with one candidate left) make it EASY, needing hidden singles (a digit
+ * with one place left in a row, column or box) makes it MEDIUM, and a
+ * puzzle neither technique finishes is HARD.
+ *
+ * Board is the grid being played, with a count of each digit in every
+ * row, column and box kept up to date as cells change, so conflicts, a
+ * cell's candidates and the win test never rescan the grid.
+ *
+ * generate() fills a random grid and removes givens in random order,
+ * keeping each removal only while the solution stays unique and the grade
+ * stays at or below the target. It takes its own seed, so the same seed
+ * always gives the same puzzle.
+ */
+
+#ifndef SUDOKU_H
+#define SUDOKU_H
+
+#include <stdint.h>
+
+namespace Sudoku {
+
+static const int SIZE = 6;
+static const int BOX_ROWS = 2;
+static const int BOX_COLS = 3;
+static const int CELLS = SIZE * SIZE;
+
+// 0 = empty, 1-6 = a digit
+typedef uint8_t Grid[SIZE][SIZE];
+
+enum Grade { EASY, MEDIUM, HARD };
+
+// Candidate and digit masks: bit d - 1 stands for digit d
+static const uint8_t ALL_DIGITS = (1 << SIZE) - 1;
+
+inline uint8_t digitBit(int digit) { return 1 << (digit - 1); }
+
+inline int boxOf(int r, int c) {
+  return (r / BOX_ROWS) * BOX_ROWS + c / BOX_COLS;
+}
+
+class Board {
+public:
+  Board() { clear(); }
+
+  void clear();
+  void load(const Grid grid);
+
+  /**
+   * Write a cell (0 empties it); out-of-range digits are ignored
+   */
+  void set(int r, int c, int digit);
+
+  int digit(int r, int c) const { return _cells[r][c]; }
+  const Grid &grid() const { return _cells; }
+
+  /**
+   * Digits the row, column and box do not hold yet (for an empty cell)
+   */
+  uint8_t candidates(int r, int c) const {
+    return ALL_DIGITS & ~(rowMask(r) | colMask(c) | boxMask(boxOf(r, c)));
+  }
+
+  /**
+   * The cell's digit also appears in its row, column or box
+   */
+  bool conflicts(int r, int c) const;
+
+  bool full() const { return _filled == CELLS; }
+
+  /**
+   * Every cell filled and no digit repeated
+   */
+  bool solved() const { return full() && _clashes == 0; }
+
+private:
+  Grid _cells;
+  uint8_t _count[3][SIZE][SIZE]; // [row/col/box][unit][digit - 1]
+  uint8_t _mask[3][SIZE];        // Digits present in each unit
+  uint8_t _filled;
+  uint8_t _clashes; // (unit, digit) pairs holding the digit twice or more
+
+  uint8_t rowMask(int r) const { return _mask[0][r]; }
+  uint8_t colMask(int c) const { return _mask[1][c]; }
+  uint8_t boxMask(int b) const { return _mask[2][b]; }
+  void count(int r, int c, int digit, int delta);
+};
+
+/**
+ * Count solutions, stopping at limit
+ * @param solution Receives the first solution found (may be nullptr)
+ * @return 0 when the givens conflict or nothing fits, else up to limit
+ */
+int countSolutions(const Grid puzzle, Grid solution = nullptr,
+                   int limit = 2);
+
+/**
+ * Techniques the puzzle needs; HARD also covers puzzles that have no
+ * unique solution
+ */
+Grade grade(const Grid puzzle);
+
+int givens(const Grid puzzle);
+
+/**
+ * A puzzle of the given grade with a unique solution
+ * @return false if no attempt reached the grade (puzzle and solution
+ *         then hold the closest one found, graded below the target)
+ */
+bool generate(Grade target, uint32_t seed, Grid puzzle, Grid solution);
+
+} // namespace Sudoku
+
+#endif // SUDOKU_H
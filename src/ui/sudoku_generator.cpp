@@ -0,0 +1,68 @@
+/**
+ * Sudoku Generator Implementation
+ */
+
+#include "sudoku_generator.h"
+#include "../utils/log.h"
+#include <esp_random.h>
+#include <string.h>
+
+SudokuGenerator::SudokuGenerator() : _task(nullptr) {
+  for (int g = 0; g < GRADES; g++)
+    _slots[g].ready = false;
+}
+
+bool SudokuGenerator::begin() {
+  if (!_task) {
+    // Core 0 at the storage worker's priority, below touch and BLE
+    if (xTaskCreatePinnedToCore(taskEntry, "sudoku", TASK_STACK, this, 1,
+                                &_task, 0) != pdPASS) {
+      LOG_E("Sudoku", "Generator task failed to start");
+      _task = nullptr;
+      return false;
+    }
+  }
+  xTaskNotifyGive(_task);
+  return true;
+}
+
+bool SudokuGenerator::ready(Sudoku::Grade grade) const {
+  return _slots[grade].ready;
+}
+
+bool SudokuGenerator::take(Sudoku::Grade grade, Sudoku::Grid puzzle,
+                           Sudoku::Grid solution) {
+  Slot &slot = _slots[grade];
+  if (!slot.ready)
+    return false;
+  // The worker leaves a ready slot alone until it is cleared
+  memcpy(puzzle, slot.puzzle, sizeof(Sudoku::Grid));
+  memcpy(solution, slot.solution, sizeof(Sudoku::Grid));
+  slot.ready = false;
+  if (_task)
+    xTaskNotifyGive(_task);
+  return true;
+}
+
+void SudokuGenerator::taskEntry(void *arg) {
+  SudokuGenerator *self = static_cast<SudokuGenerator *>(arg);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    self->fill();
+  }
+}
+
+void SudokuGenerator::fill() {
+  for (int g = 0; g < GRADES; g++) {
+    Slot &slot = _slots[g];
+    if (slot.ready)
+      continue;
+    uint32_t start = millis();
+    bool exact = Sudoku::generate((Sudoku::Grade)g, esp_random(),
+                                  slot.puzzle, slot.solution);
+    slot.ready = true;
+    LOG_D("Sudoku", "Generated grade %d%s: %d givens in %u ms", g,
+          exact ? "" : " (closest)", Sudoku::givens(slot.puzzle),
+          (unsigned)(millis() - start));
+  }
+}
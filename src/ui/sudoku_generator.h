@@ -0,0 +1,55 @@
+/**
+ * Sudoku Generator
+ *
+ * Keeps one freshly generated puzzle of each grade ready for the Sudoku
+ * game. The worker runs on its own low-priority task on core 0 while the
+ * current puzzle is on screen; take() hands out the ready puzzle of a
+ * grade and wakes the worker to make the next one. Until a puzzle is
+ * ready the game falls back to its built-in ones.
+ */
+
+#ifndef SUDOKU_GENERATOR_H
+#define SUDOKU_GENERATOR_H
+
+#include "sudoku.h"
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class SudokuGenerator {
+public:
+  static const uint32_t TASK_STACK = 4096;
+  static const int GRADES = 3;
+
+  SudokuGenerator();
+
+  /**
+   * Start the worker task (once) and have it fill the empty slots
+   */
+  bool begin();
+
+  /**
+   * Take the ready puzzle of a grade. Call from the loop task.
+   * @return false if it is still being generated
+   */
+  bool take(Sudoku::Grade grade, Sudoku::Grid puzzle,
+            Sudoku::Grid solution);
+
+  bool ready(Sudoku::Grade grade) const;
+
+private:
+  struct Slot {
+    Sudoku::Grid puzzle;
+    Sudoku::Grid solution;
+    std::atomic<bool> ready; // Set by the worker, cleared by take()
+  };
+
+  TaskHandle_t _task;
+  Slot _slots[GRADES];
+
+  static void taskEntry(void *arg);
+  void fill();
+};
+
+#endif // SUDOKU_GENERATOR_H
@@ -0,0 +1,195 @@
+/**
+ * Tile Undo Implementation
+ */
+
+#include "tile_undo.h"
+#include <esp_heap_caps.h>
+
+TileUndo::TileUndo()
+    : _pixels(nullptr), _width(0), _height(0), _tilesX(0), _tilesY(0),
+      _slots(nullptr), _oldest(0), _records(0), _undoable(0), _usedSlots(0),
+      _open(false), _openSlot(0), _openCount(0), _lost(false) {}
+
+TileUndo::~TileUndo() { free(_slots); }
+
+bool TileUndo::begin(uint8_t *pixels, int width, int height) {
+  // Change tracking works without the ring
+  _pixels = pixels;
+  _width = width;
+  _height = height;
+  _tilesX = (width + TILE - 1) / TILE;
+  _tilesY = (height + TILE - 1) / TILE;
+  _touched.assign((_tilesX * _tilesY + 31) / 32, 0);
+  _changed.assign(_touched.size(), 0);
+  clear();
+
+  if (!_slots)
+    _slots = (Slot *)heap_caps_malloc(MAX_SLOTS * sizeof(Slot),
+                                      MALLOC_CAP_SPIRAM);
+  if (!_slots) {
+    Serial.println("Notes: No PSRAM for the undo ring");
+    return false;
+  }
+  return true;
+}
+
+void TileUndo::clear() {
+  _oldest = 0;
+  _records = 0;
+  _undoable = 0;
+  _usedSlots = 0;
+  _open = false;
+}
+
+void TileUndo::beginStroke() {
+  if (!_slots)
+    return;
+
+  // A new stroke ends redo: the undone records' slots are reused
+  for (int i = _undoable; i < _records; i++)
+    _usedSlots -= record(i).count;
+  _records = _undoable;
+
+  if (_records > 0) {
+    const Record &newest = record(_records - 1);
+    _openSlot = (newest.first + newest.count) % MAX_SLOTS;
+  } else {
+    _openSlot = 0;
+  }
+  _openCount = 0;
+  _lost = false;
+  _open = true;
+  std::fill(_touched.begin(), _touched.end(), 0);
+}
+
+void TileUndo::dropOldest() {
+  _usedSlots -= record(0).count;
+  _oldest = (_oldest + 1) % MAX_RECORDS;
+  _records--;
+  _undoable--;
+}
+
+void TileUndo::capture(int x0, int y0, int x1, int y1) {
+  x0 = max(x0, 0);
+  y0 = max(y0, 0);
+  x1 = min(x1, _width - 1);
+  y1 = min(y1, _height - 1);
+  if (x1 < x0 || y1 < y0)
+    return;
+
+  for (int ty = y0 / TILE; ty <= y1 / TILE; ty++) {
+    for (int tx = x0 / TILE; tx <= x1 / TILE; tx++) {
+      int tile = ty * _tilesX + tx;
+      uint32_t bit = 1u << (tile & 31);
+      _changed[tile >> 5] |= bit;
+      if (!_open || _lost || (_touched[tile >> 5] & bit))
+        continue;
+
+      // Older strokes make room, this one cannot
+      while (_usedSlots + _openCount >= MAX_SLOTS && _records > 0)
+        dropOldest();
+      if (_usedSlots + _openCount >= MAX_SLOTS) {
+        _lost = true;
+        continue;
+      }
+      Slot &slot = _slots[(_openSlot + _openCount) % MAX_SLOTS];
+      slot.tile = tile;
+      copyTile(tile, slot.pixels, false);
+      _touched[tile >> 5] |= bit;
+      _openCount++;
+    }
+  }
+}
+
+void TileUndo::endStroke() {
+  if (!_open)
+    return;
+  _open = false;
+  if (_lost) {
+    Serial.println("Notes: Stroke too large to undo");
+    clear();
+    return;
+  }
+  if (_openCount == 0)
+    return;
+
+  if (_records == MAX_RECORDS)
+    dropOldest();
+  record(_records) = {(uint16_t)_openSlot, (uint16_t)_openCount};
+  _records++;
+  _undoable = _records;
+  _usedSlots += _openCount;
+}
+
+bool TileUndo::undo() {
+  if (_open || _undoable == 0)
+    return false;
+  swap(record(_undoable - 1));
+  _undoable--;
+  return true;
+}
+
+bool TileUndo::redo() {
+  if (_open || _undoable == _records)
+    return false;
+  swap(record(_undoable));
+  _undoable++;
+  return true;
+}
+
+void TileUndo::markAllChanged() {
+  std::fill(_changed.begin(), _changed.end(), 0xFFFFFFFFu);
+}
+
+void TileUndo::clearChanged() {
+  std::fill(_changed.begin(), _changed.end(), 0);
+}
+
+bool TileUndo::hasChanges() const {
+  for (uint32_t word : _changed) {
+    if (word)
+      return true;
+  }
+  return false;
+}
+
+std::vector<uint16_t> TileUndo::takeChanged() {
+  std::vector<uint16_t> tiles;
+  int count = tileCount();
+  for (int tile = 0; tile < count; tile++) {
+    if (_changed[tile >> 5] & (1u << (tile & 31)))
+      tiles.push_back(tile);
+  }
+  clearChanged();
+  return tiles;
+}
+
+void TileUndo::swap(const Record &r) {
+  uint8_t current[TILE_BYTES];
+  for (int i = 0; i < r.count; i++) {
+    Slot &slot = _slots[(r.first + i) % MAX_SLOTS];
+    markChanged(slot.tile);
+    copyTile(slot.tile, current, false);
+    copyTile(slot.tile, slot.pixels, true);
+    memcpy(slot.pixels, current, TILE_BYTES);
+  }
+}
+
+// Tiles start on byte boundaries, so rows copy as whole bytes; edge tiles
+// keep only the part inside the canvas
+void TileUndo::copyTile(int tile, uint8_t *buf, bool toCanvas) {
+  int x0 = (tile % _tilesX) * TILE;
+  int y0 = (tile / _tilesX) * TILE;
+  int rows = _height - y0 < TILE ? _height - y0 : TILE;
+  int cols = _width - x0 < TILE ? _width - x0 : TILE;
+  size_t rowBytes = (cols + 7) / 8;
+  size_t stride = (_width + 7) / 8;
+  for (int r = 0; r < rows; r++) {
+    uint8_t *pixels = _pixels + (y0 + r) * stride + x0 / 8;
+    uint8_t *saved = buf + r * (TILE / 8);
+    if (toCanvas)
+      memcpy(pixels, saved, rowBytes);
+    else
+      memcpy(saved, pixels, rowBytes);
+  }
+}
@@ -0,0 +1,124 @@
+/**
+ * Tile Undo
+ *
+ * Copy-on-write undo for the 1-bit notes canvas. Before a stroke first
+ * draws into a 32x32 tile, the tile's pixels are copied into a ring in
+ * PSRAM; the tiles a stroke touched make up its record. Undo swaps a
+ * record's tiles with the canvas, which leaves the record holding the
+ * stroke's ink, so redo is the same swap again. Either costs the area of
+ * one stroke instead of a replay of the page.
+ *
+ * The oldest records are dropped when the ring is full. A stroke too big
+ * for the ring empties it, since older records only apply on top of it.
+ *
+ * Every tile a stroke, undo or redo changes is also flagged until
+ * takeChanged(), which is how the note draft knows what to autosave.
+ */
+
+#ifndef TILE_UNDO_H
+#define TILE_UNDO_H
+
+#include <Arduino.h>
+#include <vector>
+
+class TileUndo {
+public:
+  static const int TILE = 32;
+  static const int TILE_BYTES = TILE * TILE / 8;
+  static const int MAX_SLOTS = 1024; // 128 KB ring
+  static const int MAX_RECORDS = 64;
+
+  TileUndo();
+  ~TileUndo();
+
+  /**
+   * Allocate the ring for a canvas (left pixel in the top bit)
+   */
+  bool begin(uint8_t *pixels, int width, int height);
+
+  /**
+   * Forget every record, for when the canvas is replaced or cleared
+   */
+  void clear();
+
+  void beginStroke();
+
+  /**
+   * Save the tiles under this box that the open stroke has not drawn on
+   * yet. Call before drawing into it.
+   */
+  void capture(int x0, int y0, int x1, int y1);
+
+  void endStroke();
+
+  /**
+   * Put back the canvas as it was before the newest stroke
+   * @return false if there is no record of it
+   */
+  bool undo();
+
+  /**
+   * Put the last undone stroke back
+   */
+  bool redo();
+
+  bool canUndo() const { return _undoable > 0; }
+  bool canRedo() const { return _records > _undoable; }
+
+  int tileCount() const { return _tilesX * _tilesY; }
+
+  /**
+   * Flag every tile changed, for when the whole canvas was replaced
+   */
+  void markAllChanged();
+  void markChanged(int tile) { _changed[tile >> 5] |= 1u << (tile & 31); }
+  void clearChanged();
+  bool hasChanges() const;
+
+  /**
+   * Tiles changed since the last call, in row-major order; clears the flags
+   */
+  std::vector<uint16_t> takeChanged();
+
+  /**
+   * Copy one tile out of (or into) the canvas, TILE_BYTES packed rows
+   */
+  void readTile(int tile, uint8_t *out) { copyTile(tile, out, false); }
+  void writeTile(int tile, const uint8_t *in) {
+    copyTile(tile, (uint8_t *)in, true);
+  }
+
+private:
+  struct Slot {
+    uint16_t tile; // Index in row-major tile order
+    uint8_t pixels[TILE_BYTES];
+  };
+  struct Record {
+    uint16_t first; // Slot of its first tile
+    uint16_t count;
+  };
+
+  uint8_t *_pixels;
+  int _width, _height;
+  int _tilesX, _tilesY;
+  Slot *_slots; // Ring, PSRAM
+  std::vector<uint32_t> _touched; // Tiles of the open stroke, one bit each
+  std::vector<uint32_t> _changed; // Tiles changed since takeChanged()
+
+  Record _recordRing[MAX_RECORDS];
+  int _oldest;   // Ring index of the oldest record
+  int _records;  // Records held, undone ones included
+  int _undoable; // Records not undone, all older than the undone ones
+  int _usedSlots;
+  bool _open;    // A stroke is being captured
+  int _openSlot; // Next slot of the open stroke
+  int _openCount;
+  bool _lost; // The open stroke outgrew the ring
+
+  Record &record(int i) { return _recordRing[(_oldest + i) % MAX_RECORDS]; }
+  void dropOldest();
+  void swap(const Record &r);
+  void copyTile(int tile, uint8_t *out, bool toCanvas);
+};
+
+#endif // TILE_UNDO_H
@@ -0,0 +1,277 @@
+/**
+ * To-Do Log Implementation
+ */
+
+#include "todo_log.h"
+#include "../utils/crc16.h"
+#include "../utils/flash_store.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include <algorithm>
+
+extern SDManager *sdManager;
+
+const char *const TodoLog::PATH = "/todo/todo.log";
+static const char *const TODO_DIR = "/todo";
+static const char *const TODO_TEMP = "/todo/todo.log.tmp";
+
+static bool onFlash() { return flashStore && flashStore->isAvailable(); }
+
+static uint16_t recordCrc(const TodoLog::Record &record, const char *text) {
+  uint8_t buf[4 + TodoLog::MAX_TEXT];
+  memcpy(buf, &record, 4); // op, length, id
+  memcpy(buf + 4, text, record.length);
+  return CRC16::modbus(buf, 4 + record.length);
+}
+
+static void copyText(char *to, const char *from, size_t length) {
+  length = std::min(length, (size_t)TodoLog::MAX_TEXT);
+  memcpy(to, from, length);
+  to[length] = '\0';
+}
+
+TodoLog::TodoLog()
+    : _count(0), _nextId(1), _records(0), _loaded(false), _open(false),
+      _gen(0) {}
+
+// Small and changed a record at a time: flash when the tier is mounted
+fs::FS &TodoLog::logFS() { return onFlash() ? flashStore->fs() : sdFS(); }
+
+bool TodoLog::ready() {
+  uint32_t gen =
+      !onFlash() && sdManager ? sdManager->getMountGeneration() : 0;
+  if (_open && gen == _gen)
+    return true;
+
+  // Closed, failed, or the card was remounted under us: reopen
+  _file = File();
+  if (!logFS().exists(TODO_DIR))
+    logFS().mkdir(TODO_DIR);
+  _file = logFS().open(PATH, FILE_APPEND);
+  _open = (bool)_file;
+  _gen = gen;
+  return _open;
+}
+
+bool TodoLog::writeRecord(File &file, Op op, uint16_t id, const char *text) {
+  if (!text)
+    text = "";
+  Record record;
+  record.op = (uint8_t)op;
+  record.length = std::min(strlen(text), (size_t)MAX_TEXT);
+  record.id = id;
+  record.crc = recordCrc(record, text);
+  return file.write((const uint8_t *)&record, sizeof(record)) ==
+             sizeof(record) &&
+         file.write((const uint8_t *)text, record.length) == record.length;
+}
+
+bool TodoLog::append(Op op, uint16_t id, const char *text) {
+  bool flash = onFlash();
+  SDAccess sd(flash ? nullptr : sdManager);
+  if (!flash && !sd)
+    return false;
+  if (!ready() || !writeRecord(_file, op, id, text)) {
+    LOG_W("Todo", "Log append failed");
+    _file = File();
+    _open = false;
+    sd.fail();
+    return false;
+  }
+  _file.flush(); // One record is the whole cost of a change
+  _records++;
+  if (flash)
+    flashStore->mirror(PATH);
+  return true;
+}
+
+int TodoLog::find(uint16_t id) const {
+  for (int i = 0; i < _count; i++) {
+    if (_items[i].id == id)
+      return i;
+  }
+  return -1;
+}
+
+int TodoLog::replay(File &file, bool &torn) {
+  Record record;
+  char text[MAX_TEXT];
+  int replayed = 0;
+  size_t size = file.size();
+  size_t end = 0; // Of the last whole record
+  while (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record)) {
+    // Torn tail from a brown-out: nothing valid follows
+    if (record.length > MAX_TEXT ||
+        file.read((uint8_t *)text, record.length) != record.length ||
+        recordCrc(record, text) != record.crc)
+      break;
+    end += sizeof(record) + record.length;
+    replayed++;
+    _nextId = std::max(_nextId, (uint16_t)(record.id + 1));
+    int row = find(record.id);
+    switch ((Op)record.op) {
+    case Op::ADD:
+      if (row < 0 && _count < MAX_ITEMS) {
+        Item &item = _items[_count++];
+        item.id = record.id;
+        item.done = false;
+        copyText(item.text, text, record.length);
+      }
+      break;
+    case Op::CHECK:
+    case Op::UNCHECK:
+      if (row >= 0)
+        _items[row].done = (Op)record.op == Op::CHECK;
+      break;
+    case Op::EDIT:
+      if (row >= 0)
+        copyText(_items[row].text, text, record.length);
+      break;
+    case Op::DELETE:
+      if (row >= 0) {
+        memmove(&_items[row], &_items[row + 1],
+                (_count - row - 1) * sizeof(Item));
+        _count--;
+      }
+      break;
+    default:
+      break; // A newer build's operation
+    }
+  }
+  torn = end < size;
+  return replayed;
+}
+
+bool TodoLog::load() {
+  if (_loaded)
+    return true;
+  bool flash = onFlash();
+  if (flash)
+    flashStore->sync(PATH);
+  bool rewrite = false;
+  {
+    SDAccess sd(flash ? nullptr : sdManager);
+    if (!flash && !sd)
+      return false;
+
+    // A compaction interrupted between remove and rename leaves only the
+    // temp file
+    _count = 0;
+    _nextId = 1;
+    _records = 0;
+    bool temp = !logFS().exists(PATH) && logFS().exists(TODO_TEMP);
+    File file = logFS().open(temp ? TODO_TEMP : PATH, FILE_READ);
+    if (file) {
+      bool torn;
+      _records = replay(file, torn);
+      rewrite = temp || torn;
+      file.close();
+    }
+    _loaded = true;
+  }
+  LOG_I("Todo", "%d items from %d records", _count, _records);
+
+  // Appends must not land after a torn record
+  if (rewrite) {
+    LOG_W("Todo", "Log damaged or left mid-compaction, rewriting");
+    compact();
+  }
+  return true;
+}
+
+bool TodoLog::add(const char *text) {
+  if (_count >= MAX_ITEMS || !append(Op::ADD, _nextId, text))
+    return false;
+  Item &item = _items[_count++];
+  item.id = _nextId++;
+  item.done = false;
+  copyText(item.text, text, strlen(text));
+  return true;
+}
+
+bool TodoLog::setDone(int row, bool done) {
+  if (row < 0 || row >= _count)
+    return false;
+  if (_items[row].done == done)
+    return true;
+  if (!append(done ? Op::CHECK : Op::UNCHECK, _items[row].id, nullptr))
+    return false;
+  _items[row].done = done;
+  return true;
+}
+
+bool TodoLog::edit(int row, const char *text) {
+  if (row < 0 || row >= _count)
+    return false;
+  if (strncmp(_items[row].text, text, MAX_TEXT) == 0)
+    return true;
+  if (!append(Op::EDIT, _items[row].id, text))
+    return false;
+  copyText(_items[row].text, text, strlen(text));
+  return true;
+}
+
+bool TodoLog::remove(int row) {
+  if (row < 0 || row >= _count ||
+      !append(Op::DELETE, _items[row].id, nullptr))
+    return false;
+  memmove(&_items[row], &_items[row + 1], (_count - row - 1) * sizeof(Item));
+  _count--;
+  return true;
+}
+
+bool TodoLog::needsCompaction() const {
+  int live = _count;
+  for (int i = 0; i < _count; i++)
+    live += _items[i].done; // ADD, then CHECK
+  int dead = _records - live;
+  return _loaded && dead >= COMPACT_MIN_DEAD && dead > live;
+}
+
+bool TodoLog::compact() {
+  bool flash = onFlash();
+  SDAccess sd(flash ? nullptr : sdManager);
+  if (!flash && !sd)
+    return false;
+  fs::FS &fs = logFS();
+  if (!fs.exists(TODO_DIR))
+    fs.mkdir(TODO_DIR);
+
+  // Items are numbered afresh, so ids stay small however long the list
+  // has been in use
+  File file = fs.open(TODO_TEMP, FILE_WRITE);
+  bool ok = (bool)file;
+  int records = 0;
+  for (int i = 0; ok && i < _count; i++) {
+    uint16_t id = i + 1;
+    ok = writeRecord(file, Op::ADD, id, _items[i].text) &&
+         (!_items[i].done || writeRecord(file, Op::CHECK, id, nullptr));
+    records += _items[i].done ? 2 : 1;
+  }
+  file.close();
+
+  // LittleFS renames over the old log atomically; FAT cannot, so the old
+  // log goes first and load() covers the gap
+  _file = File();
+  _open = false;
+  if (ok && !flash)
+    fs.remove(PATH);
+  if (!ok || !fs.rename(TODO_TEMP, PATH)) {
+    LOG_W("Todo", "Compaction failed");
+    sd.fail();
+    return false;
+  }
+  LOG_I("Todo", "Compacted %d records to %d", _records, records);
+  for (int i = 0; i < _count; i++)
+    _items[i].id = i + 1;
+  _nextId = _count + 1;
+  _records = records;
+  if (flash)
+    flashStore->mirror(PATH);
+  return true;
+}
+
+void TodoLog::close() {
+  _file = File();
+  _open = false;
+}
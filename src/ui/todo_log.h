@@ -0,0 +1,102 @@
+/**
+ * To-Do Log
+ *
+ * The to-do list, stored as an append-only log of operations (add, check,
+ * uncheck, edit, delete) rather than as the list itself: each change is
+ * one record of a few bytes appended to the open file, never a rewrite.
+ * Loading replays the log into the items in RAM, stopping at a torn tail.
+ *
+ * Records for checked-and-unchecked, edited or deleted items pile up;
+ * compact() rewrites the log as one ADD (and CHECK) per live item, through
+ * a temp file, once the dead records outnumber them.
+ *
+ * Kept in the flash tier when it is mounted (mirrored to the card), on the
+ * card otherwise, at PATH.
+ */
+
+#ifndef TODO_LOG_H
+#define TODO_LOG_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+class TodoLog {
+public:
+  static const char *const PATH;
+  static const int MAX_ITEMS = 64;
+  static const int MAX_TEXT = 60;
+  static const int COMPACT_MIN_DEAD = 32; // Records not worth a rewrite
+
+  struct Item {
+    uint16_t id; // Names the item in the log
+    bool done;
+    char text[MAX_TEXT + 1];
+  };
+
+  enum class Op : uint8_t { ADD = 1, CHECK, UNCHECK, EDIT, DELETE };
+
+  // Log record: the header, then length bytes of text (ADD and EDIT)
+  struct __attribute__((packed)) Record {
+    uint8_t op;
+    uint8_t length;
+    uint16_t id;
+    uint16_t crc; // CRC-16/Modbus of the fields above and the text
+  };
+  static_assert(sizeof(Record) == 6, "Record layout is on disk");
+
+  TodoLog();
+
+  /**
+   * Replay the log, once (later calls return at once)
+   * @return false if there is no storage to keep it on
+   */
+  bool load();
+  bool isLoaded() const { return _loaded; }
+
+  int size() const { return _count; }
+  const Item &operator[](int row) const { return _items[row]; }
+
+  /**
+   * Each appends one record, then changes the item in RAM
+   * @return false if the list is full, the row is out of range or the
+   *         record could not be written
+   */
+  bool add(const char *text);
+  bool setDone(int row, bool done);
+  bool edit(int row, const char *text);
+  bool remove(int row);
+
+  /**
+   * Dead records outnumber the live items by enough to rewrite the log
+   */
+  bool needsCompaction() const;
+
+  /**
+   * Rewrite the log as the live items alone
+   */
+  bool compact();
+
+  /**
+   * Close the append handle (the list stays loaded)
+   */
+  void close();
+
+private:
+  Item _items[MAX_ITEMS];
+  int _count;
+  uint16_t _nextId;
+  int _records; // In the log, live or dead
+  bool _loaded;
+  File _file;   // Append handle, kept open between changes
+  bool _open;
+  uint32_t _gen; // SD mount generation the handle belongs to
+
+  fs::FS &logFS();
+  bool ready();
+  bool append(Op op, uint16_t id, const char *text);
+  static bool writeRecord(File &file, Op op, uint16_t id, const char *text);
+  int replay(File &file, bool &torn);
+  int find(uint16_t id) const;
+};
+
+#endif // TODO_LOG_H
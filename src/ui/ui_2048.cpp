@@ -0,0 +1,541 @@
+/**
+ * UI Manager - 2048
+ * Tiles slid on a 4x4 grid, with a solver for hints and autoplay
+ */
+
+#include "../hardware/buzzer.h"
+#include "../utils/log.h"
+#include "../utils/record_file.h"
+#include "../utils/sd_manager.h"
+#include "ui_manager.h"
+
+#if APP_GAMES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_LIGHT_GRAY 0xC618
+#define COLOR_WHITE 0xFFFF
+
+// ============================================================================
+// 2048 Game
+// ============================================================================
+
+// Left of the grid, above NEW GAME: HINT and AUTO. Right of it, above
+// HOME: the suggested move, repainted on its own as searches finish
+static const int GAME_2048_SIDE_BTN_X = 60;
+static const int GAME_2048_SIDE_BTN_W = 180;
+static const int GAME_2048_HINT_X = 750;
+static const int GAME_2048_HINT_Y = 110;
+static const int GAME_2048_HINT_SIZE = 150;
+
+// The 4x4 board, centred under the header
+static const int GAME_2048_GRID_Y = 80;
+static const int GAME_2048_TILE = 95;
+static const int GAME_2048_GAP = 5;
+
+void UIManager::drawGame2048Tile(int row, int col) {
+  int gridSize = Game2048::SIZE * (GAME_2048_TILE + GAME_2048_GAP);
+  int gridX = (SCREEN_WIDTH - gridSize) / 2;
+  int tileSize = GAME_2048_TILE;
+  int x = gridX + col * (tileSize + GAME_2048_GAP);
+  int y = GAME_2048_GRID_Y + row * (tileSize + GAME_2048_GAP);
+  int value = Game2048::tile(_game2048.board, row, col);
+
+  // Tile background (different shades for different values)
+  uint16_t bgColor;
+  if (value == 0)
+    bgColor = COLOR_LIGHT_GRAY;
+  else if (value == 2)
+    bgColor = COLOR_WHITE;
+  else if (value == 4)
+    bgColor = 0xEF7D; // Very light gray
+  else if (value <= 16)
+    bgColor = 0xDEFB;
+  else if (value <= 64)
+    bgColor = 0xCE79;
+  else
+    bgColor = COLOR_GRAY;
+
+  M5.Display.fillRect(x, y, tileSize, tileSize, bgColor);
+  M5.Display.drawRect(x, y, tileSize, tileSize, COLOR_BLACK);
+
+  // Tile value
+  if (value > 0) {
+    M5.Display.setTextSize(value >= 1000 ? 3 : 4); // Larger font (was 3/2)
+    M5.Display.setTextColor(COLOR_BLACK); // All numbers black for e-ink
+
+    char valueStr[8];
+    snprintf(valueStr, sizeof(valueStr), "%d", value);
+    int textW = M5.Display.textWidth(valueStr);
+    M5.Display.setCursor(x + (tileSize - textW) / 2,
+                         y + (value >= 1000 ? 35 : 28)); // Adjusted Y
+    M5.Display.print(valueStr);
+  }
+}
+
+void UIManager::drawGame2048Score() {
+  M5.Display.fillRect(SCREEN_WIDTH - 350, 15, 340, 30, COLOR_WHITE);
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(SCREEN_WIDTH - 350, 20);
+  M5.Display.printf("Score: %d", _game2048.score);
+  M5.Display.setCursor(SCREEN_WIDTH - 180, 20);
+  M5.Display.printf("Best: %d", _game2048.highScore);
+}
+
+void UIManager::repaintGame2048() {
+  Game2048::Board changed = _game2048.board ^ _game2048.shown;
+  bool scoreChanged = _game2048.score != _game2048.shownScore ||
+                      _game2048.highScore != _game2048.shownBest;
+  bool hintChanged = _game2048.hint != _game2048.shownHint;
+  if (!changed && !scoreChanged && !hintChanged)
+    return;
+
+  // Moves are input: they go out at once, tiles and score as separate
+  // pushes so the digits get epd_text and the tiles the faster epd_fast
+  int painted = 0;
+  if (changed || hintChanged) {
+    _refresh.apply(RegionKind::GRAPHIC);
+    M5.Display.startWrite();
+    if (hintChanged)
+      drawGame2048Hint(); // A move clears the last hint
+    for (int r = 0; r < Game2048::SIZE; r++) {
+      for (int c = 0; c < Game2048::SIZE; c++) {
+        if (Game2048::exponent(changed, r, c)) {
+          drawGame2048Tile(r, c);
+          painted++;
+        }
+      }
+    }
+    M5.Display.endWrite();
+    M5.Display.display();
+  }
+  if (scoreChanged) {
+    _refresh.apply(RegionKind::TEXT);
+    M5.Display.startWrite();
+    drawGame2048Score();
+    M5.Display.endWrite();
+    M5.Display.display();
+  }
+  LOG_D("UI", "2048: repainted %d tile(s)%s, ghost debt %d", painted,
+        scoreChanged ? " and score" : "", _refresh.getDebt());
+
+  _game2048.shown = _game2048.board;
+  _game2048.shownScore = _game2048.score;
+  _game2048.shownBest = _game2048.highScore;
+  _game2048.shownHint = _game2048.hint;
+  _lastRefresh = millis();
+}
+
+void UIManager::drawGame2048() {
+  // Use fast EPD mode for smooth updates (like Notes)
+  M5.Display.setEpdMode(epd_mode_t::epd_fastest);
+
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  // Header
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(20, 15);
+  M5.Display.print("2048");
+
+  drawGame2048Score();
+
+  // Draw grid (4x4)
+  for (int row = 0; row < Game2048::SIZE; row++) {
+    for (int col = 0; col < Game2048::SIZE; col++)
+      drawGame2048Tile(row, col);
+  }
+
+  // Later moves repaint only the tiles that differ from this
+  _game2048.shown = _game2048.board;
+  _game2048.shownScore = _game2048.score;
+  _game2048.shownBest = _game2048.highScore;
+  _game2048.shownHint = _game2048.hint;
+
+  // Buttons (above menu bar)
+  int btnY = SCREEN_HEIGHT - 140;
+  drawButton(60, btnY, 180, 50, "NEW GAME"); // Wider button
+  drawButton(SCREEN_WIDTH - 210, btnY, 150, 50, "HOME");
+  drawButton(GAME_2048_SIDE_BTN_X, btnY - 140, GAME_2048_SIDE_BTN_W, 50,
+             "HINT");
+  drawButton(GAME_2048_SIDE_BTN_X, btnY - 70, GAME_2048_SIDE_BTN_W, 50,
+             _game2048.autoplay ? "STOP" : "AUTO", _game2048.autoplay);
+  drawGame2048Hint();
+
+  // Game over overlay
+  if (_game2048.gameOver) {
+    int boxW = 400;
+    int boxH = 200;
+    int boxX = (SCREEN_WIDTH - boxW) / 2;
+    int boxY = (SCREEN_HEIGHT - boxH) / 2;
+
+    M5.Display.fillRect(boxX, boxY, boxW, boxH, COLOR_WHITE);
+    M5.Display.drawRect(boxX, boxY, boxW, boxH, COLOR_BLACK);
+    M5.Display.drawRect(boxX + 5, boxY + 5, boxW - 10, boxH - 10, COLOR_BLACK);
+
+    M5.Display.setTextSize(_game2048.won ? 4 : 3);
+    M5.Display.setTextColor(COLOR_BLACK);
+    const char *msg = _game2048.won ? "YOU WON!" : "GAME OVER!";
+    int msgW = M5.Display.textWidth(msg);
+    M5.Display.setCursor(boxX + (boxW - msgW) / 2, boxY + 60);
+    M5.Display.print(msg);
+
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(boxX + 80, boxY + 130);
+    M5.Display.print("Tap to continue");
+  }
+}
+
+void UIManager::drawGame2048Hint() {
+  int x = GAME_2048_HINT_X;
+  int y = GAME_2048_HINT_Y;
+  int size = GAME_2048_HINT_SIZE;
+  M5.Display.fillRect(x, y, size, size, COLOR_WHITE);
+
+  const char *label = nullptr;
+  if (_game2048.autoplay)
+    label = "AUTO";
+  else if (_game2048.solver.busy())
+    label = "...";
+  else if (_game2048.hint < 0)
+    return; // Nothing to suggest: leave the panel blank
+
+  M5.Display.drawRect(x, y, size, size, COLOR_BLACK);
+  M5.Display.setTextColor(COLOR_BLACK);
+  if (label) {
+    M5.Display.setTextSize(3);
+    int w = M5.Display.textWidth(label);
+    M5.Display.setCursor(x + (size - w) / 2, y + size / 2 - 12);
+    M5.Display.print(label);
+    return;
+  }
+
+  // Arrow towards the suggested direction
+  int cx = x + size / 2, cy = y + size / 2, r = size / 3;
+  switch (_game2048.hint) {
+  case Game2048::UP:
+    M5.Display.fillTriangle(cx, cy - r, cx - r, cy + r, cx + r, cy + r,
+                            COLOR_BLACK);
+    break;
+  case Game2048::RIGHT:
+    M5.Display.fillTriangle(cx + r, cy, cx - r, cy - r, cx - r, cy + r,
+                            COLOR_BLACK);
+    break;
+  case Game2048::DOWN:
+    M5.Display.fillTriangle(cx, cy + r, cx - r, cy - r, cx + r, cy - r,
+                            COLOR_BLACK);
+    break;
+  case Game2048::LEFT:
+    M5.Display.fillTriangle(cx - r, cy, cx + r, cy - r, cx + r, cy + r,
+                            COLOR_BLACK);
+    break;
+  }
+}
+
+void UIManager::handleGame2048Touch(int x, int y) {
+  // Taps only; moves arrive as swipe gestures (game2048HandleSwipe)
+
+  // Game over - any tap restarts
+  if (_game2048.gameOver) {
+    _game2048.autoplay = false;
+    game2048Init();
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    return;
+  }
+
+  // Check buttons (above menu bar)
+  int btnY = SCREEN_HEIGHT - 140;
+  if (y >= btnY && y < btnY + 50) {
+    if (x >= 60 && x < 240) { // Wider touch zone for NEW GAME
+      // New Game - do full quality refresh to clear ghosting
+      Buzzer::click();
+      _refresh.forceClean();
+      _game2048.solver.cancel();
+      _game2048.hint = -1;
+      game2048Init();
+      _needsRefresh = true;
+      _lastRefresh = 0;
+      return;
+    }
+    if (x >= SCREEN_WIDTH - 210 && x < SCREEN_WIDTH - 60) {
+      // Home
+      Buzzer::click();
+      game2048Save();
+      navigateTo(ScreenID::HOME);
+      return;
+    }
+  }
+
+  if (x < GAME_2048_SIDE_BTN_X ||
+      x >= GAME_2048_SIDE_BTN_X + GAME_2048_SIDE_BTN_W)
+    return;
+  if (y >= btnY - 140 && y < btnY - 90) {
+    // Hint: searched in the background, the arrow appears on its own
+    if (_game2048.autoplay || _game2048.solver.busy())
+      return;
+    Buzzer::click();
+    if (_game2048.solver.request(_game2048.board,
+                                 Game2048Solver::HINT_BUDGET_MS)) {
+      _game2048.hint = -1;
+      _refresh.apply(RegionKind::GRAPHIC);
+      M5.Display.startWrite();
+      drawGame2048Hint();
+      M5.Display.endWrite();
+      M5.Display.display();
+      _game2048.shownHint = _game2048.hint;
+    }
+  } else if (y >= btnY - 70 && y < btnY - 20) {
+    Buzzer::click();
+    _game2048.autoplay = !_game2048.autoplay;
+    _game2048.hint = -1;
+    if (!_game2048.autoplay)
+      _game2048.solver.cancel();
+    _game2048.lastAutoMove = 0;
+    _needsRefresh = true;
+    _lastRefresh = 0;
+  }
+}
+
+void UIManager::enterGame2048() {
+  // 256 KB of PSRAM, only while the game is up; moves work without it
+  if (!Game2048::prepare())
+    Serial.println("2048: No memory for the move table");
+  _game2048.solver.begin();
+  _game2048.hint = -1;
+  _game2048.autoplay = false;
+}
+
+void UIManager::exitGame2048() {
+  // The worker reads the move table: it has to be idle before the free
+  _game2048.autoplay = false;
+  _game2048.solver.stop();
+  Game2048::release();
+}
+
+void UIManager::updateGame2048() {
+  Game2048Solver::Result result;
+  if (_game2048.solver.poll(result) && result.board == _game2048.board) {
+    if (_game2048.autoplay) {
+      if (result.direction >= 0)
+        game2048Move(result.direction);
+      else
+        _game2048.autoplay = false;
+      _game2048.lastAutoMove = millis();
+    } else {
+      // Only the panel changes: a partial update, no full redraw
+      _game2048.hint = result.direction;
+      _refresh.apply(RegionKind::GRAPHIC);
+      M5.Display.startWrite();
+      drawGame2048Hint();
+      M5.Display.endWrite();
+      M5.Display.display();
+    }
+  }
+
+  if (_game2048.gameOver)
+    _game2048.autoplay = false; // Won or stuck: the overlay waits for a tap
+  if (_game2048.autoplay && !_game2048.solver.busy() && !_needsRefresh &&
+      millis() - _game2048.lastAutoMove >= GAME_2048_AUTO_STEP_MS)
+    _game2048.solver.request(_game2048.board, Game2048Solver::AUTO_BUDGET_MS);
+}
+
+void UIManager::game2048HandleSwipe(const Gesture &g) {
+  if (_game2048.gameOver)
+    return;
+
+  int direction;
+  switch (g.dir) {
+  case GestureDir::UP:
+    direction = 0;
+    break;
+  case GestureDir::RIGHT:
+    direction = 1;
+    break;
+  case GestureDir::DOWN:
+    direction = 2;
+    break;
+  case GestureDir::LEFT:
+    direction = 3;
+    break;
+  default:
+    return;
+  }
+
+  // A swipe takes over from autoplay
+  _game2048.autoplay = false;
+  if (game2048Move(direction))
+    Buzzer::click();
+}
+
+bool UIManager::game2048Move(int direction) {
+  // Any search under way is for the board before this move
+  _game2048.solver.cancel();
+  _game2048.hint = -1;
+  bool moved = game2048Slide(direction);
+  if (moved) {
+    game2048AddRandomTile();
+    game2048Save();
+
+    if (_game2048.score > _game2048.highScore) {
+      _game2048.highScore = _game2048.score;
+    }
+
+    // Check win/lose
+    if (!_game2048.won && Game2048::maxTile(_game2048.board) >= 2048) {
+      _game2048.won = true;
+      _game2048.gameOver = true;
+    }
+
+    if (game2048IsGameOver()) {
+      _game2048.gameOver = true;
+    }
+
+    // The idle hook repaints the changed tiles; the overlay needs a draw
+    if (_game2048.gameOver) {
+      _needsRefresh = true;
+      _lastRefresh = 0;
+    }
+  }
+  return moved;
+}
+
+// ============================================================================
+// 2048 Game Logic
+// ============================================================================
+
+void UIManager::game2048Init() {
+  // Clear grid
+  _game2048.board = 0;
+
+  _game2048.score = 0;
+  _game2048.gameOver = false;
+  _game2048.won = false;
+
+  // Add 2 starting tiles
+  game2048AddRandomTile();
+  game2048AddRandomTile();
+}
+
+void UIManager::game2048AddRandomTile() {
+  int emptyCount = Game2048::emptyCount(_game2048.board);
+  if (emptyCount == 0)
+    return;
+
+  // Pick random empty cell
+  int targetIndex = random(emptyCount);
+  int currentIndex = 0;
+
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 4; c++) {
+      if (Game2048::exponent(_game2048.board, r, c) == 0) {
+        if (currentIndex == targetIndex) {
+          // 90% chance of 2, 10% chance of 4
+          Game2048::setTile(_game2048.board, r, c, (random(10) < 9) ? 2 : 4);
+          return;
+        }
+        currentIndex++;
+      }
+    }
+  }
+}
+
+bool UIManager::game2048Slide(int direction) {
+  return Game2048::slide(_game2048.board, direction, _game2048.score);
+}
+
+bool UIManager::game2048IsGameOver() {
+  return Game2048::isOver(_game2048.board);
+}
+
+// Saved games (/games/saves is created at boot)
+static const char *GAME_2048_RECORD = "/games/saves/2048.rec";
+static const char *GAME_2048_LEGACY = "/games/2048_save.txt";
+
+struct Game2048Record {
+  static const uint16_t RECORD_TYPE = 0x2048;
+  static const uint16_t RECORD_VERSION = 1;
+  int32_t grid[4][4];
+  int32_t score;
+  int32_t highScore;
+  uint8_t gameOver;
+  uint8_t won;
+  uint8_t reserved[2];
+};
+
+
+void UIManager::game2048Save() {
+  extern SDManager *sdManager;
+  if (!sdManager || !sdManager->isAvailable())
+    return;
+
+  // Saves happen on every move: the write-back cache sends the latest to
+  // the card once per flush interval
+  Game2048Record record = {};
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++)
+      record.grid[r][c] = Game2048::tile(_game2048.board, r, c);
+  record.score = _game2048.score;
+  record.highScore = _game2048.highScore;
+  record.gameOver = _game2048.gameOver;
+  record.won = _game2048.won;
+  RecordFile::saveDeferred(GAME_2048_RECORD, record);
+}
+
+void UIManager::game2048Load() {
+  extern SDManager *sdManager;
+  if (!sdManager || !sdManager->isAvailable()) {
+    game2048Init();
+    return;
+  }
+
+  Game2048Record record;
+  if (RecordFile::load(GAME_2048_RECORD, record)) {
+    _game2048.board = 0;
+    for (int r = 0; r < 4; r++)
+      for (int c = 0; c < 4; c++)
+        Game2048::setTile(_game2048.board, r, c, record.grid[r][c]);
+    _game2048.score = record.score;
+    _game2048.highScore = record.highScore;
+    _game2048.gameOver = record.gameOver;
+    _game2048.won = record.won;
+    Serial.println("2048 game loaded");
+    return;
+  }
+
+  // Text save from older firmware; the next move rewrites it as a record
+  SDAccess sd(sdManager);
+  File file = sd ? sdFS().open(GAME_2048_LEGACY, FILE_READ) : File();
+  if (!file) {
+    Serial.println("No save file, starting new game");
+    game2048Init();
+    return;
+  }
+
+  // Read grid
+  _game2048.board = 0;
+  for (int r = 0; r < 4; r++) {
+    String line = file.readStringUntil('\n');
+    int colIdx = 0;
+    int startIdx = 0;
+    for (int c = 0; c < 4; c++) {
+      int commaIdx = line.indexOf(',', startIdx);
+      if (commaIdx == -1)
+        commaIdx = line.length();
+      String valStr = line.substring(startIdx, commaIdx);
+      Game2048::setTile(_game2048.board, r, c, valStr.toInt());
+      startIdx = commaIdx + 1;
+    }
+  }
+
+  _game2048.score = file.readStringUntil('\n').toInt();
+  _game2048.highScore = file.readStringUntil('\n').toInt();
+  _game2048.gameOver = file.readStringUntil('\n').toInt() == 1;
+  _game2048.won = file.readStringUntil('\n').toInt() == 1;
+
+  file.close();
+  Serial.println("2048 game loaded (legacy save)");
+}
+
+#endif // APP_GAMES
@@ -0,0 +1,379 @@
+/**
+ * UI Manager - Calculator
+ * Expressions typed on a keypad, with a history of results to recall
+ */
+
+#include "../hardware/buzzer.h"
+#include "ui_manager.h"
+
+#if APP_CALCULATOR
+
+#define COLOR_BLACK 0x0000
+#define COLOR_DARK_GRAY 0x4208
+#define COLOR_GRAY 0x8410
+#define COLOR_LIGHT_GRAY 0xC618
+#define COLOR_WHITE 0xFFFF
+
+// ============================================================================
+// Calculator Screen (Variation A: Balanced Split)
+// ============================================================================
+
+// Left half: expression, result, history, edit keys; keypad on the right
+static const int CALC_BOX_X = 20;
+static const int CALC_BOX_W = 440;
+static const int CALC_EXPR_Y = 60;
+static const int CALC_EXPR_H = 70;
+static const int CALC_RESULT_Y = 140;
+static const int CALC_RESULT_H = 70;
+static const int CALC_HIST_Y = 220;
+static const int CALC_HIST_H = 180;
+static const int CALC_HIST_LINE = 30;
+static const int CALC_HIST_LINES = CALC_HIST_H / CALC_HIST_LINE;
+static const int CALC_HIST_W = CALC_BOX_W - 60; // Scroll buttons beside
+static const int CALC_KEYS_Y = 410;
+static const int CALC_KEYS_H = 60;
+static const int CALC_EXPR_CHARS = (CALC_BOX_W - 20) / 18;   // Size 3
+static const int CALC_RESULT_CHARS = (CALC_BOX_W - 20) / 24; // Size 4
+static const int CALC_HIST_CHARS = (CALC_HIST_W - 20) / 12;  // Size 2
+
+// Edit keys under the history: C, <-, (, )
+static const char *const CALC_EDIT_KEYS[] = {"C", "<-", "(", ")"};
+static const int CALC_EDIT_W = 100;
+static const int CALC_EDIT_GAP = 10;
+
+void UIManager::drawCalculatorScreen() {
+  M5.Display.fillScreen(COLOR_WHITE);
+  drawMenuBar();
+
+  // Layout: Left (Display) | Right (Keypad)
+  const int DISPLAY_WIDTH = 480;
+  const int KEYPAD_X = DISPLAY_WIDTH;
+
+  // Exit button "X" (Top Left)
+  drawButton(20, 10, 60, 50, "X");
+
+  // --- Left Side: Display ---
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(100, 25); // Shifted right to avoid X button
+  M5.Display.print("Expression:");
+
+  M5.Display.drawRect(CALC_BOX_X, CALC_EXPR_Y, CALC_BOX_W, CALC_EXPR_H,
+                      COLOR_BLACK);
+  M5.Display.drawRect(CALC_BOX_X, CALC_RESULT_Y, CALC_BOX_W, CALC_RESULT_H,
+                      COLOR_BLACK);
+  M5.Display.drawRect(CALC_BOX_X, CALC_HIST_Y, CALC_HIST_W, CALC_HIST_H,
+                      COLOR_BLACK);
+  drawCalcDisplay();
+  drawCalcHistory();
+
+  // History scroll buttons
+  int scrollX = CALC_BOX_X + CALC_HIST_W + 10;
+  drawButton(scrollX, CALC_HIST_Y, 50, CALC_HIST_H / 2 - 5, "^");
+  drawButton(scrollX, CALC_HIST_Y + CALC_HIST_H / 2 + 5, 50,
+             CALC_HIST_H / 2 - 5, "v");
+
+  // C (Medium Gray), backspace and the parentheses
+  for (int i = 0; i < 4; i++) {
+    int bx = CALC_BOX_X + i * (CALC_EDIT_W + CALC_EDIT_GAP);
+    if (i == 0) {
+      M5.Display.fillRect(bx, CALC_KEYS_Y, CALC_EDIT_W, CALC_KEYS_H,
+                          COLOR_GRAY);
+      M5.Display.drawRect(bx, CALC_KEYS_Y, CALC_EDIT_W, CALC_KEYS_H,
+                          COLOR_BLACK);
+      M5.Display.setTextSize(3);
+      M5.Display.setTextColor(COLOR_WHITE);
+      M5.Display.setCursor(bx + 40, CALC_KEYS_Y + 18);
+      M5.Display.print("C");
+      M5.Display.setTextColor(COLOR_BLACK);
+    } else {
+      drawButton(bx, CALC_KEYS_Y, CALC_EDIT_W, CALC_KEYS_H,
+                 CALC_EDIT_KEYS[i]);
+    }
+  }
+
+  // --- Right Side: Keypad ---
+  const int BTN_W = 100;
+  const int BTN_H = 85;
+  const int BTN_GAP = 10;
+  const int START_X = KEYPAD_X + 20;
+  const int START_Y = 20;
+
+  // Button labels in 4x4 grid
+  const char *btnLabels[4][4] = {{"7", "8", "9", "/"},
+                                 {"4", "5", "6", "*"},
+                                 {"1", "2", "3", "-"},
+                                 {"0", ".", "+", "="}};
+
+  for (int row = 0; row < 4; row++) {
+    for (int col = 0; col < 4; col++) {
+      int bx = START_X + col * (BTN_W + BTN_GAP);
+      int by = START_Y + row * (BTN_H + BTN_GAP);
+      const char *label = btnLabels[row][col];
+
+      // Determine button style
+      bool isOperator = (col == 3 && row < 3); // /, *, -
+      bool isEquals = (strcmp(label, "=") == 0);
+
+      if (isEquals) {
+        // Dark gray for =
+        M5.Display.fillRect(bx, by, BTN_W, BTN_H, COLOR_DARK_GRAY);
+        M5.Display.drawRect(bx, by, BTN_W, BTN_H, COLOR_BLACK);
+        M5.Display.setTextColor(COLOR_WHITE);
+      } else if (isOperator || strcmp(label, "+") == 0) {
+        // Light gray for operators
+        M5.Display.fillRect(bx, by, BTN_W, BTN_H, COLOR_LIGHT_GRAY);
+        M5.Display.drawRect(bx, by, BTN_W, BTN_H, COLOR_BLACK);
+        M5.Display.setTextColor(COLOR_BLACK);
+      } else {
+        // White for numbers
+        M5.Display.fillRect(bx, by, BTN_W, BTN_H, COLOR_WHITE);
+        M5.Display.drawRect(bx, by, BTN_W, BTN_H, COLOR_BLACK);
+        M5.Display.setTextColor(COLOR_BLACK);
+      }
+
+      M5.Display.setTextSize(4);
+      int textW = strlen(label) * 24;
+      M5.Display.setCursor(bx + (BTN_W - textW) / 2, by + (BTN_H - 32) / 2);
+      M5.Display.print(label);
+    }
+  }
+}
+
+// Inside the expression and result boxes
+void UIManager::drawCalcDisplay() {
+  M5.Display.fillRect(CALC_BOX_X + 1, CALC_EXPR_Y + 1, CALC_BOX_W - 2,
+                      CALC_EXPR_H - 2, COLOR_WHITE);
+  M5.Display.fillRect(CALC_BOX_X + 1, CALC_RESULT_Y + 1, CALC_BOX_W - 2,
+                      CALC_RESULT_H - 2, COLOR_WHITE);
+  M5.Display.setTextColor(COLOR_BLACK);
+
+  // The end being typed stays in view
+  const char *shown = _calc.expression;
+  int len = strlen(shown);
+  M5.Display.setTextSize(3);
+  M5.Display.setCursor(CALC_BOX_X + 10, CALC_EXPR_Y + 24);
+  if (len > CALC_EXPR_CHARS) {
+    M5.Display.print("<");
+    shown += len - (CALC_EXPR_CHARS - 1);
+  }
+  M5.Display.print(shown);
+
+  // Right-aligned, as on a desk calculator
+  M5.Display.setTextSize(4);
+  int resultW = strlen(_calc.result) * 24;
+  M5.Display.setCursor(CALC_BOX_X + CALC_BOX_W - 10 - resultW,
+                       CALC_RESULT_Y + 19);
+  M5.Display.print(_calc.result);
+}
+
+// Newest evaluation at the top, _calc.scroll entries down
+void UIManager::drawCalcHistory() {
+  M5.Display.fillRect(CALC_BOX_X + 1, CALC_HIST_Y + 1, CALC_HIST_W - 2,
+                      CALC_HIST_H - 2, COLOR_WHITE);
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+  if (_calc.engine.historyCount() == 0) {
+    M5.Display.setTextColor(COLOR_GRAY);
+    M5.Display.setCursor(CALC_BOX_X + 10, CALC_HIST_Y + 10);
+    M5.Display.print("History");
+    return;
+  }
+
+  char line[CalcEngine::MAX_EXPRESSION + CalcEngine::MAX_RESULT + 4];
+  for (int i = 0; i < CALC_HIST_LINES; i++) {
+    int index = _calc.scroll + i;
+    if (index >= _calc.engine.historyCount())
+      break;
+    const CalcEngine::Entry &entry = _calc.engine.historyEntry(index);
+    int n = snprintf(line, sizeof(line), "%s = %s", entry.expression,
+                     entry.result);
+    const char *shown = line;
+    M5.Display.setCursor(CALC_BOX_X + 10,
+                         CALC_HIST_Y + 7 + i * CALC_HIST_LINE);
+    if (n > CALC_HIST_CHARS) { // Keep the result, cut the expression
+      M5.Display.print("<");
+      shown += n - (CALC_HIST_CHARS - 1);
+    }
+    M5.Display.print(shown);
+    if (i > 0)
+      M5.Display.drawFastHLine(CALC_BOX_X + 5, CALC_HIST_Y + i * CALC_HIST_LINE,
+                               CALC_HIST_W - 10, COLOR_LIGHT_GRAY);
+  }
+}
+
+// Only the display boxes (and the history list) change after a key
+void UIManager::repaintCalculator(bool history) {
+  _refresh.apply(RegionKind::TEXT);
+  M5.Display.startWrite();
+  drawCalcDisplay();
+  if (history)
+    drawCalcHistory();
+  M5.Display.endWrite();
+  M5.Display.display();
+  _lastRefresh = millis();
+}
+
+void UIManager::handleCalculatorTouch(int x, int y) {
+  // Exit button "X" (Top Left)
+  if (x >= 20 && x < 80 && y >= 10 && y < 60) {
+    Buzzer::click();
+    navigateTo(ScreenID::HOME);
+    return;
+  }
+
+  // C, backspace, parentheses
+  if (y >= CALC_KEYS_Y && y < CALC_KEYS_Y + CALC_KEYS_H) {
+    for (int i = 0; i < 4; i++) {
+      int bx = CALC_BOX_X + i * (CALC_EDIT_W + CALC_EDIT_GAP);
+      if (x < bx || x >= bx + CALC_EDIT_W)
+        continue;
+      Buzzer::click();
+      if (i == 0)
+        calcClear();
+      else if (i == 1)
+        calcBackspace();
+      else
+        calcInput(CALC_EDIT_KEYS[i][0]);
+      repaintCalculator(false);
+      return;
+    }
+  }
+
+  // History: scroll, or tap an entry to use its result
+  int scrollX = CALC_BOX_X + CALC_HIST_W + 10;
+  if (y >= CALC_HIST_Y && y < CALC_HIST_Y + CALC_HIST_H) {
+    if (x >= scrollX && x < scrollX + 50) {
+      int maxScroll = _calc.engine.historyCount() - CALC_HIST_LINES;
+      int scroll = _calc.scroll + (y < CALC_HIST_Y + CALC_HIST_H / 2
+                                       ? -CALC_HIST_LINES
+                                       : CALC_HIST_LINES);
+      if (scroll > maxScroll)
+        scroll = maxScroll;
+      if (scroll < 0)
+        scroll = 0;
+      if (scroll != _calc.scroll) {
+        Buzzer::click();
+        _calc.scroll = scroll;
+        _refresh.apply(RegionKind::TEXT);
+        M5.Display.startWrite();
+        drawCalcHistory();
+        M5.Display.endWrite();
+        M5.Display.display();
+      }
+      return;
+    }
+    if (x >= CALC_BOX_X && x < CALC_BOX_X + CALC_HIST_W) {
+      int index = _calc.scroll + (y - CALC_HIST_Y) / CALC_HIST_LINE;
+      if (index < _calc.engine.historyCount()) {
+        Buzzer::click();
+        calcRecall(index);
+        repaintCalculator(false);
+      }
+      return;
+    }
+  }
+
+  // Keypad
+  const int KEYPAD_X = 480;
+  const int BTN_W = 100;
+  const int BTN_H = 85;
+  const int BTN_GAP = 10;
+  const int START_X = KEYPAD_X + 20;
+  const int START_Y = 20;
+
+  const char *btnLabels[4][4] = {{"7", "8", "9", "/"},
+                                 {"4", "5", "6", "*"},
+                                 {"1", "2", "3", "-"},
+                                 {"0", ".", "+", "="}};
+
+  for (int row = 0; row < 4; row++) {
+    for (int col = 0; col < 4; col++) {
+      int bx = START_X + col * (BTN_W + BTN_GAP);
+      int by = START_Y + row * (BTN_H + BTN_GAP);
+
+      if (x >= bx && x < bx + BTN_W && y >= by && y < by + BTN_H) {
+        Buzzer::click();
+        const char *label = btnLabels[row][col];
+        if (label[0] == '=') {
+          calcCalculate();
+          repaintCalculator(true);
+        } else {
+          calcInput(label[0]);
+          repaintCalculator(false);
+        }
+        return;
+      }
+    }
+  }
+}
+
+void UIManager::calcInput(char key) {
+  bool isOperator = key == '+' || key == '-' || key == '*' || key == '/';
+  if (_calc.newInput) {
+    // After "=", an operator carries on from the answer; anything else
+    // starts over
+    if (isOperator && _calc.answer[0])
+      strlcpy(_calc.expression, _calc.answer, sizeof(_calc.expression));
+    else
+      _calc.expression[0] = '\0';
+    _calc.newInput = false;
+  }
+  int len = strlen(_calc.expression);
+  if (len < CalcEngine::MAX_EXPRESSION - 1) {
+    _calc.expression[len] = key;
+    _calc.expression[len + 1] = '\0';
+  }
+}
+
+void UIManager::calcRecall(int entry) {
+  const char *result = _calc.engine.historyEntry(entry).result;
+  if (_calc.newInput) {
+    _calc.expression[0] = '\0';
+    _calc.newInput = false;
+  }
+  // Only where a number can go; otherwise it replaces the expression
+  int len = strlen(_calc.expression);
+  char last = len ? _calc.expression[len - 1] : '\0';
+  if (len && !strchr("+-*/(", last))
+    _calc.expression[0] = '\0';
+  strlcat(_calc.expression, result, sizeof(_calc.expression));
+}
+
+void UIManager::calcCalculate() {
+  if (!_calc.expression[0])
+    return;
+  Decimal result;
+  const char *error = _calc.engine.evaluate(_calc.expression, result);
+  if (error) {
+    strlcpy(_calc.result, error, sizeof(_calc.result));
+    _calc.answer[0] = '\0';
+    _calc.newInput = false; // Leave the expression to be fixed
+    return;
+  }
+  result.format(_calc.result, sizeof(_calc.result), CALC_RESULT_CHARS);
+  // The full answer goes into the history and carries into the next
+  // expression, as long as it leaves room to type
+  result.format(_calc.answer, sizeof(_calc.answer),
+                CalcEngine::MAX_EXPRESSION / 2);
+  _calc.engine.record(_calc.expression, _calc.answer);
+  _calc.scroll = 0;
+  _calc.newInput = true;
+}
+
+void UIManager::calcClear() {
+  _calc.expression[0] = '\0';
+  strlcpy(_calc.result, "0", sizeof(_calc.result));
+  _calc.answer[0] = '\0';
+  _calc.newInput = true;
+}
+
+void UIManager::calcBackspace() {
+  _calc.newInput = false; // Editing what was evaluated
+  int len = strlen(_calc.expression);
+  if (len > 0) {
+    _calc.expression[len - 1] = '\0';
+  }
+}
+
+#endif // APP_CALCULATOR
@@ -0,0 +1,88 @@
+/**
+ * UI Manager - Games
+ * The menu the games are picked from
+ */
+
+#include "../hardware/buzzer.h"
+#include "ui_manager.h"
+
+#if APP_GAMES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_WHITE 0xFFFF
+
+// ============================================================================
+// Games Menu
+// ============================================================================
+
+void UIManager::drawGamesMenu() {
+  M5.Display.fillScreen(COLOR_WHITE);
+  drawMenuBar();
+
+  // Title
+  M5.Display.setTextSize(4);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(SCREEN_WIDTH / 2 - 80, 30);
+  M5.Display.print("GAMES");
+
+  // Game grid (2x2 for now)
+  int gridX = 200;
+  int gridY = 120;
+  int btnW = 240;
+  int btnH = 150;
+  int gap = 80;
+
+  // 2048 Button
+  drawButton(gridX, gridY, btnW, btnH, "2048", true);
+
+  // Sudoku Button (now enabled!)
+  drawButton(gridX + btnW + gap, gridY, btnW, btnH, "SUDOKU", true);
+
+  // Wordle Button
+  drawButton(gridX, gridY + btnH + 50, btnW, btnH, "WORDLE", true);
+}
+
+void UIManager::handleGamesMenuTouch(int x, int y) {
+  int gridX = 200;
+  int gridY = 120;
+  int btnW = 240;
+  int btnH = 150;
+  int gap = 80;
+
+  // 2048 button
+  if (x >= gridX && x < gridX + btnW && y >= gridY && y < gridY + btnH) {
+    Buzzer::click();
+    game2048Load(); // Load saved game or init new
+    // Full quality clear to remove ghosting (like Notes)
+    _refresh.forceClean();
+    M5.Display.fillScreen(COLOR_WHITE);
+    M5.Display.display();
+    navigateTo(ScreenID::GAME_2048);
+    return;
+  }
+
+  // Sudoku button
+  if (x >= gridX + btnW + gap && x < gridX + 2 * btnW + gap && y >= gridY &&
+      y < gridY + btnH) {
+    Buzzer::click();
+    // Full quality clear to remove ghosting (like Notes)
+    _refresh.forceClean();
+    M5.Display.fillScreen(COLOR_WHITE);
+    M5.Display.display();
+    navigateTo(ScreenID::GAME_SUDOKU);
+    return;
+  }
+
+  // Wordle button
+  if (x >= gridX && x < gridX + btnW && y >= gridY + btnH + 50 &&
+      y < gridY + 2 * btnH + 50) {
+    Buzzer::click();
+    _refresh.forceClean();
+    M5.Display.fillScreen(COLOR_WHITE);
+    M5.Display.display();
+    navigateTo(ScreenID::GAME_WORDLE);
+    return;
+  }
+}
+
+#endif // APP_GAMES
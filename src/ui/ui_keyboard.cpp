@@ -0,0 +1,360 @@
+/**
+ * UI Manager - Text Entry
+ * The Connect settings (power bank, WiFi, weather city) and the on-screen
+ * keyboard they, and to-do items, are typed on
+ */
+
+#include "../hardware/buzzer.h"
+#include "../utils/config.h"
+#include "../utils/config_service.h"
+#include "../utils/log.h"
+#include "ui_manager.h"
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+extern Config *config;
+
+// Four rows of ten character keys, then SHIFT, symbols, space and delete
+static const int KB_X = 30;
+static const int KB_KEYS_Y = 170;
+static const int KB_KEY_W = 84;
+static const int KB_KEY_H = 64;
+static const int KB_PITCH_X = 90;
+static const int KB_PITCH_Y = 70;
+static const int KB_BOTTOM_Y = KB_KEYS_Y + 4 * KB_PITCH_Y;
+static const int KB_FIELD_Y = 70;
+static const int KB_FIELD_W = 900;
+static const int KB_FIELD_H = 64;
+
+// Lower case, upper case (one letter, then back), symbols
+static const char *const KB_ROWS[3][4] = {
+    {"1234567890", "qwertyuiop", "asdfghjkl:", "zxcvbnm,.-"},
+    {"1234567890", "QWERTYUIOP", "ASDFGHJKL:", "ZXCVBNM,.-"},
+    {"1234567890", "!@#$%^&*()", "`~;:'\"<>/?", "-_=+[]{}\\|"}};
+
+struct TextFieldInfo {
+  const char *label;
+  const char *hint;
+  unsigned maxLength;
+};
+
+// Indexed by UIManager::TextField
+static const TextFieldInfo TEXT_FIELDS[] = {
+    {"Power bank", "Its MAC address, like AA:BB:CC:DD:EE:FF", 17},
+    {"WiFi network", "The network's name, as it is spelled", 32},
+    {"WiFi password", "Empty for an open network", 63},
+    {"Weather city", "City, or city and country code: Berlin,DE", 40},
+    {"To-do", "What needs doing; empty to drop it", TodoLog::MAX_TEXT},
+    {"Find in books", "Words that appear close together", 40}};
+
+static bool isMac(const String &text) {
+  if (text.length() != 17)
+    return false;
+  for (int i = 0; i < 17; i++) {
+    char c = text[i];
+    if (i % 3 == 2 ? c != ':' : !isxdigit((unsigned char)c))
+      return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// Connect settings
+// ============================================================================
+
+void UIManager::drawConnectScreen() {
+  M5.Display.fillScreen(COLOR_WHITE);
+  drawMenuBar();
+
+  M5.Display.setTextSize(4);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(SCREEN_WIDTH / 2 - 110, 20);
+  M5.Display.print("Connect");
+  if (!config)
+    return;
+
+  String values[] = {config->getFossibotMAC(), config->getWiFiSSID(),
+                     config->getWiFiPassword(), config->getWeatherCity()};
+  for (int i = 0; i < 4; i++) {
+    int y = 90 + i * 80;
+    M5.Display.setTextSize(3);
+    M5.Display.setTextColor(COLOR_BLACK);
+    M5.Display.setCursor(40, y + 18);
+    M5.Display.print(TEXT_FIELDS[i].label);
+
+    // The password only says whether there is one
+    String shown = values[i];
+    if ((TextField)i == TextField::WIFI_PASSWORD && shown.length())
+      shown = "********";
+    if (shown.length() > 36)
+      shown = shown.substring(0, 33) + "...";
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(shown.length() ? COLOR_BLACK : COLOR_GRAY);
+    M5.Display.setCursor(330, y + 22);
+    M5.Display.print(shown.length() ? shown.c_str() : "(not set)");
+
+    drawButton(780, y, 140, 60, "EDIT");
+    _hits.add(780, y, 140, 60, [this, i](int, int) {
+      Buzzer::click();
+      openKeyboard((TextField)i);
+    });
+  }
+
+  drawButton(780, 410, 140, 60, "Back");
+  _hits.add(780, 410, 140, 60, [this](int, int) {
+    Buzzer::click();
+    navigateTo(ScreenID::SETTINGS);
+  });
+}
+
+void UIManager::openKeyboard(TextField field) {
+  if (!config && field != TextField::TODO_ITEM &&
+      field != TextField::BOOK_SEARCH)
+    return;
+  _kbField = field;
+  switch (field) {
+  case TextField::FOSSIBOT_MAC:
+    _kbText = config->getFossibotMAC();
+    break;
+  case TextField::WIFI_SSID:
+    _kbText = config->getWiFiSSID();
+    break;
+  case TextField::WIFI_PASSWORD:
+    _kbText = config->getWiFiPassword();
+    break;
+  case TextField::WEATHER_CITY:
+    _kbText = config->getWeatherCity();
+    break;
+#if APP_NOTES
+  case TextField::TODO_ITEM:
+    _kbText = _todo.editing >= 0 ? _todo.log[_todo.editing].text : "";
+    break;
+#endif
+#if APP_READER
+  case TextField::BOOK_SEARCH:
+    _kbText = _reader.query;
+    break;
+#endif
+  default:
+    break;
+  }
+  _kbLayout = 0;
+  _kbMessage = nullptr;
+  navigateTo(ScreenID::KEYBOARD);
+}
+
+// ============================================================================
+// Keyboard input
+// ============================================================================
+
+void UIManager::keyboardKey(char key) {
+  bool relabel = false;
+  if (key == '\b') {
+    if (_kbText.length() == 0)
+      return;
+    _kbText.remove(_kbText.length() - 1);
+  } else if (key == '\t') {
+    _kbLayout = _kbLayout == 1 ? 0 : 1; // SHIFT
+    relabel = true;
+  } else if (key == '\v') {
+    _kbLayout = _kbLayout == 2 ? 0 : 2; // Symbols and back
+    relabel = true;
+  } else {
+    if (_kbText.length() >= TEXT_FIELDS[(int)_kbField].maxLength) {
+      Buzzer::error();
+      return;
+    }
+    _kbText += key;
+    if (_kbLayout == 1 && isalpha((unsigned char)key)) {
+      _kbLayout = 0; // One capital
+      relabel = true;
+    }
+  }
+  _kbMessage = nullptr;
+
+  // Only the field, and the keys if their labels changed, at the fastest
+  // waveform; the press highlight's undo goes out with them
+  _refresh.apply(RegionKind::PRESS);
+  M5.Display.startWrite();
+  drawKeyboardField();
+  if (relabel)
+    drawKeyboardKeys();
+  M5.Display.endWrite();
+  M5.Display.display();
+}
+
+void UIManager::keyboardSubmit() {
+#if APP_NOTES
+  if (_kbField == TextField::TODO_ITEM) {
+    todoSubmit(_kbText);
+    return;
+  }
+#endif
+#if APP_READER
+  if (_kbField == TextField::BOOK_SEARCH) {
+    readerFind(_kbText);
+    return;
+  }
+#endif
+  if (!config || !configService)
+    return;
+  String text = _kbText;
+  if (_kbField != TextField::WIFI_PASSWORD)
+    text.trim();
+
+  switch (_kbField) {
+  case TextField::FOSSIBOT_MAC:
+    text.toUpperCase();
+    if (text.length() && !isMac(text)) {
+      _kbMessage = "Six pairs of hex digits with colons between";
+      Buzzer::error();
+      _refresh.apply(RegionKind::TEXT);
+      M5.Display.startWrite();
+      drawKeyboardField();
+      M5.Display.endWrite();
+      M5.Display.display();
+      return;
+    }
+    config->setFossibotMAC(text);
+    break;
+  case TextField::WIFI_SSID:
+    config->setWiFi(text, config->getWiFiPassword());
+    break;
+  case TextField::WIFI_PASSWORD:
+    config->setWiFi(config->getWiFiSSID(), text);
+    break;
+  case TextField::WEATHER_CITY:
+    config->setWeather(config->getWeatherAPIKey(), text,
+                       config->getWeatherUnits());
+    break;
+  case TextField::TODO_ITEM:
+  case TextField::BOOK_SEARCH:
+    break; // Above
+  }
+  // Applied through the listeners; a new network or power bank restarts
+  if (!configService->commit())
+    LOG_W("UI", "%s not saved to the card", TEXT_FIELDS[(int)_kbField].label);
+  else
+    LOG_I("UI", "%s set", TEXT_FIELDS[(int)_kbField].label);
+  navigateTo(ScreenID::SETTINGS_CONNECT);
+}
+
+// ============================================================================
+// Keyboard drawing
+// ============================================================================
+
+void UIManager::drawKeyboardField() {
+  M5.Display.fillRect(KB_X, KB_FIELD_Y, KB_FIELD_W, KB_FIELD_H + 36,
+                      COLOR_WHITE);
+  M5.Display.drawRect(KB_X, KB_FIELD_Y, KB_FIELD_W, KB_FIELD_H,
+                      COLOR_BLACK);
+
+  // The tail of the text if it is longer than the box; a password shows
+  // only its last letter
+  String shown = _kbText;
+  if (_kbField == TextField::WIFI_PASSWORD && shown.length()) {
+    String masked;
+    for (unsigned i = 1; i < shown.length(); i++)
+      masked += '*';
+    shown = masked + shown[shown.length() - 1];
+  }
+  const unsigned visible = (KB_FIELD_W - 24) / 18 - 1;
+  if (shown.length() > visible)
+    shown = shown.substring(shown.length() - visible);
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(KB_X + 12, KB_FIELD_Y + 20);
+  M5.Display.print(shown);
+  M5.Display.fillRect(M5.Display.getCursorX() + 2, KB_FIELD_Y + 14, 3, 36,
+                      COLOR_BLACK);
+
+  const TextFieldInfo &info = TEXT_FIELDS[(int)_kbField];
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(_kbMessage ? COLOR_BLACK : COLOR_GRAY);
+  M5.Display.setCursor(KB_X, KB_FIELD_Y + KB_FIELD_H + 12);
+  M5.Display.printf("%s  %u/%u", _kbMessage ? _kbMessage : info.hint,
+                    _kbText.length(), info.maxLength);
+}
+
+void UIManager::drawKeyboardKey(int x, int y, int w, const char *label,
+                                bool selected) {
+  M5.Display.fillRect(x, y, w, KB_KEY_H,
+                      selected ? COLOR_BLACK : COLOR_WHITE);
+  M5.Display.drawRect(x, y, w, KB_KEY_H, COLOR_BLACK);
+  bool wide = strlen(label) > 1;
+  M5.Display.setTextSize(wide ? 2 : 3);
+  M5.Display.setTextColor(selected ? COLOR_WHITE : COLOR_BLACK);
+  int cw = wide ? 12 : 18, ch = wide ? 16 : 24;
+  M5.Display.setCursor(x + (w - cw * (int)strlen(label)) / 2,
+                       y + (KB_KEY_H - ch) / 2);
+  M5.Display.print(label);
+}
+
+void UIManager::drawKeyboardKeys() {
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 10; c++) {
+      char label[2] = {KB_ROWS[_kbLayout][r][c], '\0'};
+      drawKeyboardKey(KB_X + c * KB_PITCH_X, KB_KEYS_Y + r * KB_PITCH_Y,
+                      KB_KEY_W, label, false);
+    }
+  }
+  drawKeyboardKey(KB_X, KB_BOTTOM_Y, 174, "SHIFT", _kbLayout == 1);
+  drawKeyboardKey(KB_X + 180, KB_BOTTOM_Y, 174,
+                  _kbLayout == 2 ? "abc" : "#+=", false);
+}
+
+void UIManager::drawKeyboard() {
+  M5.Display.fillScreen(COLOR_WHITE);
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(KB_X, 20);
+  M5.Display.print(TEXT_FIELDS[(int)_kbField].label);
+
+  drawButton(700, 10, 110, 44, "CANCEL");
+  _hits.add(700, 10, 110, 44, [this](int, int) {
+    Buzzer::click();
+    ScreenID back = ScreenID::SETTINGS_CONNECT;
+    if (_kbField == TextField::TODO_ITEM)
+      back = ScreenID::TODO;
+    else if (_kbField == TextField::BOOK_SEARCH)
+      back = ScreenID::READER;
+    navigateTo(back);
+  });
+  drawButton(830, 10, 100, 44,
+             _kbField == TextField::BOOK_SEARCH ? "FIND" : "SAVE", true);
+  _hits.add(830, 10, 100, 44, [this](int, int) {
+    Buzzer::click();
+    keyboardSubmit();
+  });
+
+  drawKeyboardField();
+  drawKeyboardKeys();
+  drawKeyboardKey(KB_X + 360, KB_BOTTOM_Y, 354, "SPACE", false);
+  drawKeyboardKey(KB_X + 720, KB_BOTTOM_Y, 180, "DEL", false);
+
+  // Keys look up their character in the layout shown when tapped, so a
+  // layout change repaints labels without registering targets again
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 10; c++) {
+      _hits.add(KB_X + c * KB_PITCH_X, KB_KEYS_Y + r * KB_PITCH_Y, KB_KEY_W,
+                KB_KEY_H, [this, r, c](int, int) {
+                  Buzzer::click();
+                  keyboardKey(KB_ROWS[_kbLayout][r][c]);
+                });
+    }
+  }
+  const struct {
+    int x, w;
+    char key;
+  } bottom[] = {{0, 174, '\t'}, {180, 174, '\v'}, {360, 354, ' '},
+                {720, 180, '\b'}};
+  for (const auto &k : bottom) {
+    char key = k.key;
+    _hits.add(KB_X + k.x, KB_BOTTOM_Y, k.w, KB_KEY_H, [this, key](int, int) {
+      Buzzer::click();
+      keyboardKey(key);
+    });
+  }
+}
@@ -7,9 +7,56 @@
 #ifndef UI_MANAGER_H
 #define UI_MANAGER_H
 
+#include "../ble/fossibot_discovery.h"
 #include "../ble/fossibot_protocol.h"
+#include "../energy_ledger.h"
+#include "../hardware/gt911.h"
+#include "../load_forecast.h"
 #include "../power_history.h"
+#include "../telemetry_filter.h"
+#include "../reader/book_search.h"
+#include "../reader/reader.h"
+#include "../self_test.h"
+#include "app_modules.h"
+#include "band_renderer.h"
+#include "calc_engine.h"
+#include "epd_bench.h"
+#include "gesture.h"
+#include "frame_buffer.h"
+#include "game2048.h"
+#include "game2048_solver.h"
+#include "graph_cache.h"
+#include "history_envelope.h"
+#include "home_layout.h"
+#include "history_view.h"
+#include "hit_registry.h"
+#include "ink_filter.h"
+#include "note_cache.h"
+#include "note_draft.h"
+#include "note_export.h"
+#include "note_index.h"
+#include "notebook.h"
+#include "pen_width.h"
+#include "press_highlight.h"
+#include "refresh_policy.h"
+#include "refresh_scheduler.h"
+#include "screen_cache.h"
+#include "settings_shadow.h"
+#include "sparse_page.h"
+#include "static_layer.h"
+#include "stroke_log.h"
+#include "stroke_renderer.h"
+#include "sudoku_generator.h"
+#include "tile_undo.h"
+#include "todo_log.h"
+#include "virtual_list.h"
+#include "widgets.h"
+#include "wordle.h"
+#include "wordle_solver.h"
 #include <Arduino.h>
+
+class Config;
+class InkLatency;
 #include <M5Unified.h>
 #include <vector>
 
@@ -34,7 +81,22 @@ enum class ScreenID {
   SETTINGS_FOSSIBOT_TIMERS, // Fossibot timers sub-menu
   SD_DIAG,
   NOTES_BROWSE,
-  HISTORY
+  HISTORY,
+  PERF_DIAG,
+  COSTS,
+  SOLAR,
+  LINK_DIAG, // BLE link statistics, from the profiler screen
+  DISCOVERY, // Power banks in range, to pick the one to use
+  INK_BENCH, // Touch-to-ink latency, from the profiler screen
+  EPD_BENCH, // Waveform x region size timings, from the profiler screen
+  LOAD,      // Output power percentiles per day and hour, from Solar
+  ENERGY,    // Estimated battery use per subsystem, from the profiler screen
+  PHOTOS,    // Picture frame, from the home screen's clock
+  SETTINGS_CONNECT, // Power bank MAC, WiFi, weather city
+  KEYBOARD,         // Text entry for one of those
+  TODO,             // To-do list, from the notes browser
+  SELF_TEST,        // Timings against a baseline, from the profiler screen
+  COUNT // Number of screens (UIManager::SCREENS entries)
 };
 
 // Clock screen sub-modes (Side-Dock navigation)
@@ -57,6 +119,8 @@ struct MenuButton {
 
 #include "../ble/fossibot_protocol.h" // Needed for PowerBankData
 
+struct ResumeSnapshot;
+
 class UIManager {
 public:
   UIManager();
@@ -67,6 +131,20 @@ public:
    */
   void init();
 
+  /**
+   * Load the power history from flash and the card. May run on a boot
+   * task while the loop draws; history features wait until update() has
+   * seen it finish.
+   */
+  void loadHistory();
+
+  /**
+   * Back from deep sleep: take the saved frame and counters and draw the
+   * saved screen straight away. Call before init(), which then brings up
+   * the history without clearing the panel.
+   */
+  void resume(const ResumeSnapshot &state);
+
   /**
    * Update UI (call in main loop)
    */
@@ -77,11 +155,50 @@ public:
    */
   void setTouchState(int x, int y, bool pressed);
 
+  /**
+   * Drain GT911 samples into touch state and PRESS/DRAG/RELEASE events.
+   * Primary-finger samples are kept for the frame so ink sees all of them.
+   */
+  void processTouchQueue();
+
+  /**
+   * How long the main loop may block before update() has timed work to
+   * do (touch, BLE and storage wake it sooner on their own)
+   * @return 0 when update() should run again straight away
+   */
+  uint32_t sleepBudgetMs() const;
+  static const uint32_t ACTIVE_WAIT_MS = 10;  // Touch down, ringing, ink
+  static const uint32_t IDLE_WAIT_MS = 1000;  // Dashboard: minute clock
+  static const int ALARM_WINDOW_SECS = 3;     // Alarm fires if seen by :02
+
+  /**
+   * Write the history and deferred card writes now (before a restart)
+   */
+  void flushStorage();
+
+  /**
+   * Open the EPD benchmark screen and run the matrix there (serial
+   * console); blocks for up to a minute
+   * @return The outcome line the screen shows
+   */
+  const char *benchEpd();
+
+  /**
+   * Compose the dashboard off-screen without pushing it (the self-test)
+   * @return Microseconds it took, 0 without a frame buffer to draw in
+   */
+  uint32_t timeHomeCompose();
+
   /**
    * Handle touch event
    */
   void handleTouch(int x, int y, TouchEvent event);
 
+  /**
+   * Handle a recognised gesture (tap, swipe, drag, long press)
+   */
+  void handleGesture(const Gesture &gesture);
+
   /**
    * Show home screen
    */
@@ -123,6 +240,24 @@ public:
    */
   void updatePowerBankData(const Fossibot::PowerBankData &data);
 
+  /**
+   * A minute of readings closed: the history's sample for it
+   */
+  void recordMinute(const TelemetryFilter::Minute &minute);
+
+  /**
+   * Repaint only the dashboard numbers, bars and clock for a sleep-cycle
+   * wake (see SleepCycle). The rest of the home screen is still on the
+   * panel from before sleep; init() need not have run.
+   * @param clean Use epd_quality, clearing the ghosting of earlier wakes
+   */
+  void showWakeReadout(const Fossibot::PowerBankData &data, bool clean);
+
+  /**
+   * BLE link progressed (connecting, ready, lost); refresh the link label
+   */
+  void onLinkStateChanged();
+
   /**
    * Force full screen refresh
    */
@@ -133,6 +268,18 @@ public:
    */
   ScreenID getCurrentScreen() const { return _currentScreen; }
 
+  /**
+   * The power history once it has loaded, else nullptr (main loop only)
+   */
+  const PowerHistory *history() const {
+    return _historyReady ? &_powerHistory : nullptr;
+  }
+
+  /**
+   * Usable capacity learned from the device's time estimates (Wh)
+   */
+  float capacityWh() const { return _forecast.getCapacityWh(); }
+
 private:
   ScreenID _currentScreen;
   ScreenID _previousScreen;
@@ -148,12 +295,12 @@ private:
   // Layout constants
   static const int BATTERY_BAR_HEIGHT =
       80; // Increased height (approx 2x previous)
-  static const int POWER_BAR_HEIGHT = 16; // 2x thicker (2 lines)
   static const int MENU_BAR_HEIGHT = 60;  // Increased to match visual weight
-  static const int PANEL_MARGIN = 10;
+  static const int SCREENSHOT_CORNER = 80; // Long press here: screenshot
 
-  // Menu buttons
-  static const int NUM_MENU_BUTTONS = 6;
+  // Menu buttons: ALARM and MENU, and one per app built in
+  static const int NUM_MENU_BUTTONS =
+      2 + APP_READER + APP_GAMES + APP_CALCULATOR + APP_NOTES;
   MenuButton _menuButtons[NUM_MENU_BUTTONS];
 
   // --- Timer State ---
@@ -171,19 +318,56 @@ private:
   int _touchStartX, _touchStartY;
   unsigned long _touchStartTime;
   bool _isTouching;
+  GestureRecognizer _gestures;
 
   // eInk refresh tracking
   unsigned long _lastRefresh;
   bool _needsRefresh;
 
+  // Home screen retained widgets (built once, repainted per widget), laid
+  // out by the theme's HomeLayout table
+  WidgetTree _homeWidgets;
+  uint8_t _homeTheme = 0;      // Index into HomeLayout::THEMES
+  StaticLayer _homeBackground; // The theme's frames and captions
+  GlyphAtlas _numerals; // Size-5 dashboard digits
+  uint32_t _homeFontMount = 0; // Card the label fonts came from
+  CustomWidget *_wBattery = nullptr;
+  LabelWidget *_wInPower = nullptr;
+  ProgressWidget *_wInBar = nullptr;
+  LabelWidget *_wInTime = nullptr;
+  LabelWidget *_wInEnergy = nullptr;
+  LabelWidget *_wOutPower = nullptr;
+  ProgressWidget *_wOutBar = nullptr;
+  LabelWidget *_wOutTime = nullptr;
+  LabelWidget *_wOutEnergy = nullptr;
+  SparklineWidget *_wInSpark = nullptr; // Last hour, a column a minute
+  SparklineWidget *_wOutSpark = nullptr;
+  uint32_t _sparkMinute = 0; // Start of the newest column, 0 = none
+  LabelWidget *_wLink = nullptr;
+  ToggleWidget *_wUsb = nullptr;
+  ToggleWidget *_wDc = nullptr;
+  ToggleWidget *_wAc = nullptr;
+  LabelWidget *_wClock = nullptr;
+  LabelWidget *_wDate = nullptr;
+  LabelWidget *_wWeather = nullptr;
+  bool _homeWidgetsStale = false;  // Data changed, re-sync widget values
+  bool _homeWidgetsUrgent = false; // User action: skip the refresh-rate gate
+  unsigned long _lastWidgetSync = 0;
+  void composeHome(LovyanGFX &g); // Background and widgets, no targets
+  void buildHomeWidgets();
+  void dropHomeWidgets();
+  void paintHomeBackground(LovyanGFX &g, int ox, int oy);
+  void syncHomeWidgets();
+  void applyHomeFonts();
+  void updateHomeWidgets();
+  void pushSparklines(uint32_t minuteStart, float inW, float outW);
+  void seedSparklines();
+
   // Drawing methods
-  void drawBatteryBar(float percent);
-  void drawPowerPanel(int x, int y, int w, int h, const char *title,
-                      float power, float maxPower, const char *timeLabel,
-                      int minutes, bool isInput);
-  void drawStatusPanel(int x, int y, int w, int h);
-  void drawClockWeatherPanel(int x, int y, int w, int h);
+  void drawBatteryBar(LovyanGFX &g, Fixed::Permille soc);
   void drawMenuBar();
+  void drawMenuBar(LovyanGFX &g);
+  void paintMenuBar(LovyanGFX &g, int ox, int y);
   void drawButton(int x, int y, int w, int h, const char *label,
                   bool selected = false);
   void drawProgressBar(int x, int y, int w, int h, float percent,
@@ -194,9 +378,48 @@ private:
   void initMenuButtons();
   int hitTestMenuButton(int x, int y);
   void executeMenuButton(int index);
+  void dispatchTap(int x, int y); // Route a tap to the current screen
+  void showPress(int x, int y);   // Invert the target under a finger
+  void endPress(bool now);        // Undo it, pushed now or with the tap
+  void flushPress();              // Push an undo nothing else drew over
+
+  /**
+   * One screen's hooks, any of which may be null. SCREENS[] is indexed by
+   * ScreenID and constant-initialised, so dispatch is a table lookup.
+   */
+  struct Screen {
+    void (UIManager::*draw)();  // Full redraw (null: home screen)
+    void (UIManager::*tap)(int x, int y); // After registered targets miss
+    void (UIManager::*touch)(int x, int y, TouchEvent event); // Raw events
+    void (UIManager::*swipe)(const Gesture &g);
+    void (UIManager::*enter)(); // Navigated to, before the first draw
+    void (UIManager::*exit)();  // Navigated away: drop what it allocated
+    void (UIManager::*tick)();  // Every update() pass
+    void (UIManager::*idle)();  // Passes with no full redraw due
+    uint8_t telemetry;          // TelemetryGroup bits polled while shown
+    uint8_t flags;
+  };
+  static const uint8_t SCREEN_MENU_BAR = 1 << 0;  // Menu bar taps navigate
+  static const uint8_t SCREEN_RESUMABLE = 1 << 1; // Drawn from state alone
+  static const uint8_t SCREEN_PEN = 1 << 2;       // Touch reports at full rate
+  static const uint8_t SCREEN_CACHED = 1 << 3;    // Snapshot kept on leaving
+  static const Screen SCREENS[];
+  static const Screen &screenFor(ScreenID id);
+  HitRegistry _hits;              // Touch targets of the screen on display
+  PressHighlight _press;          // Target inverted while pressed
+  bool _pressUndone = false;      // Undo written, not yet pushed
+  RefreshScheduler _refresh;      // EPD waveform choice + ghosting budget
+  RefreshPolicy _refreshPolicy;   // Which numbers a frame may change
+  FrameBuffer _frame;             // PSRAM back/front frames for diffed pushes
+  StaticLayer _menuBarLayer;      // Menu bar, painted once
+  ScreenCache _screenCache;       // Snapshots of SCREEN_CACHED screens left
+
+  uint32_t screenKey(ScreenID screen); // What a snapshot's pixels depend on
+  bool restoreScreen(ScreenID screen); // Push a snapshot instead of drawing
 
   // Screen-specific handlers
-  void handleHomeTouch(int x, int y, TouchEvent event);
+  void homeTap(HomeLayout::Target target);        // Toggles, home shortcuts
+  void enterSettings();                           // Load the edit fields
   void handleSettingsTouch(int x, int y);         // Main settings menu touch
   void handleDeviceSettingsTouch(int x, int y);   // Device settings touch
   void handleFossibotSettingsTouch(int x, int y); // Fossibot settings touch
@@ -224,9 +447,17 @@ private:
   int _fossiScheduleChargeHour = -1;     // -1=off, 0-23 = target hour
   int _fossiScheduleChargeMin = 0;       // 0-59 = target minute
   int _fossiScheduleChargeRemaining = 0; // Read from Reg 63 (minutes)
-  unsigned long _lastTimerSetTime = 0;
   bool _showPowerOffConfirmation = false;
 
+  // Taps show at once; readbacks and write outcomes reconcile
+  SettingsShadow _shadow;
+  int fossiValue(SettingsShadow::Field field) const;
+  void setFossiValue(SettingsShadow::Field field, int value);
+  uint16_t syncFossiSettings(const Fossibot::PowerBankData &data);
+  void writeFossiSetting(SettingsShadow::Field field, int value);
+  void drawFossiRow(SettingsShadow::Field field); // On the screen showing it
+  void repaintFossiRows(uint16_t fields);         // In place, partial
+
   void handleFossibotTimersTouch(int x, int y); // Fossibot timers touch
 
   // Clock screen state
@@ -253,94 +484,289 @@ private:
   void drawTimerContent(int x, int y, int w, int h);
   void handleClockTouch(int x, int y, TouchEvent event = TouchEvent::RELEASE);
   void updatePomodoro();
-  void checkAlarm();
+
+  // Countdown digits on the Clock screen: a tick repaints only the glyph
+  // cells that changed
+  DigitsWidget _clockDigits;
+  void updateClockDigits();
+  bool countdownOnScreen() const;
+  void tickTimer();
+  void checkAlarmTime(); // Then again at the top of the next minute
+  void updateRinging();
+  void armCountdown(int job, bool running, unsigned long lastTick);
   void drawAlertScreen(const char *label);
 
-  // Calculator state
-  char _calcExpression[64] = "";
-  double _calcResult = 0;
-  double _calcOperand1 = 0;
-  char _calcOperator = 0;
-  bool _calcNewInput = true;
+#if APP_CALCULATOR
+  // Calculator state (the engine keeps the history)
+  struct CalcState {
+    CalcEngine engine;
+    char expression[CalcEngine::MAX_EXPRESSION] = "";
+    char result[CalcEngine::MAX_RESULT] = "0"; // As shown, or an error
+    char answer[CalcEngine::MAX_RESULT] = "";  // Last result, longer
+    bool newInput = true;
+    int scroll = 0; // History entries scrolled past
+  };
+  CalcState _calc;
 
   // Calculator methods
   void drawCalculatorScreen();
+  void drawCalcDisplay();
+  void drawCalcHistory();
+  void repaintCalculator(bool history);
   void handleCalculatorTouch(int x, int y);
-  void calcAppendDigit(char digit);
-  void calcSetOperator(char op);
+  void calcInput(char key); // Digit, '.', operator or parenthesis
+  void calcRecall(int entry);
   void calcCalculate();
   void calcClear();
   void calcBackspace();
-
-  // Notes state
-  int _lastDrawX = -1;
-  int _lastDrawY = -1;
-  bool _isDrawing = false;
-  int _penSize = 2;
-  uint16_t _penColor = 0; // BLACK (0) or WHITE (0xFFFF)
+#endif
 
   // Touch state from main loop
   int _currentTouchX = -1;
   int _currentTouchY = -1;
   bool _currentTouchPressed = false;
+  bool _queueTouching = false; // Last pressed state seen from the queue
 
-  M5Canvas *_notesCanvas = nullptr; // Pointer to dynamic canvas
-
-  // Note file browsing state
-  std::vector<String> _noteFileList; // List of note files
-  int _noteFileIndex = -1;      // Currently selected file index (-1 = none)
-  String _currentNoteFile = ""; // Current note filename
+#if APP_NOTES
+  // Notes state
+  struct NotesState {
+    bool drawing = false;
+    StrokeRenderer stroke; // Curve fitting + predicted ink
+    int penSize = 2;
+    uint16_t penColor = 0; // BLACK (0) or WHITE (0xFFFF)
+    PenWidth penWidth;     // Contact size -> width for the pen
+    int inkWidth = 2;      // Width of the stroke's last sample
+
+    // Every primary sample drained since the last update() (oldest first)
+    GT911::TouchSample samples[GT911::RING_SIZE]; // Filtered ink
+    int sampleCount = 0;
+    InkFilter inkFilter; // Palm, extra finger and outlier rejection
+
+    M5Canvas *canvas = nullptr; // Pointer to dynamic canvas
+    StrokeLog strokeLog; // Vector record of the ink, for undo
+    TileUndo tileUndo;   // Canvas tiles under recent strokes
+    uint8_t *base = nullptr; // Raster the log draws over (null: blank)
+    bool ioBusy = false;     // Canvas is being read/written by storage
+
+    // A single note can be a page larger than the screen, the canvas a
+    // view onto it panned a step at a time (steps are whole tiles)
+    SparsePage page;     // Inked tiles of the page (outside the view)
+    uint8_t viewCol = 0; // View origin, in steps
+    uint8_t viewRow = 0;
+    bool large = false; // The note is a page (panned, or opened as one)
+
+    // Note file browsing state
+    NoteIndex index;              // Persisted, sorted /notes listing
+    NoteCache cache;              // Decoded notes for PREV/NEXT
+    bool prefetching = false;     // A neighbour is being decoded
+    String browseStatus;          // Last export, shown in the browser
+    Notebook notebook;            // Open when the note is a notebook
+    int notebookPage = 0;         // Page on the canvas (may be new)
+    bool dirty = false;           // Ink since the last load or save
+    NoteDraft draft;              // Changed tiles, autosaved to card
+    bool restoring = false;       // Draft waits for its note to show
+    NoteDraft::Source restore = {}; // The note it waits for
+    std::vector<NoteIndex::Name> files; // List of note files
+    int fileIndex = -1;     // Currently selected file index (-1 = none)
+    String currentFile = ""; // Current note filename
+
+    // File browser
+    VirtualList list;       // File list: rows in view only
+    int selected = 0;       // Currently selected file for preview
+    int previewIndex = -1;  // Which file's preview is currently loaded
+    int deleteConfirm = -1; // Index of file to delete (-1 = no confirmation)
+    M5Canvas *preview = nullptr; // Preview thumbnail canvas
+  };
+  NotesState _notes;
+  static const int MAX_FRAME_SAMPLES = GT911::RING_SIZE;
+  static const uint8_t NOTES_DEPTH = 1; // Black ink on white: 1 bpp
+  static const int NOTES_PAGE_W = 2528; // Fits the view at every step
+  static const int NOTES_PAGE_H = 1568;
+  static const int NOTES_PAN_X = 416; // 13 tiles
+  static const int NOTES_PAN_Y = 256; // 8 tiles
+  static const int NOTES_PAN_STEPS = 4; // Steps from the top left, each way
 
   // Notes methods
   void drawNotesScreen();
   void handleNotesTouch(int x, int y);
   void updateNotes();
+  void notesInkSample(int x, int y, uint16_t contact); // Feed one sample
+  void notesInkEnd();                                  // Finish the stroke
+  void notesUndo();                  // Take the last stroke off the canvas
+  void notesRedo();                  // Put the last undone stroke back
+  void notesRedraw();                // Canvas = base + stroke log
+  void notesSetBase(const uint8_t *pixels); // Copy (or drop) the base
+  void notesClear();                        // Blank page, empty log
+  bool notesMoveView(int col, int row); // Page keeps the view, loads another
+  void notesPan(int dc, int dr);        // Arrow buttons: a step of the page
+  void notesPageReset();                // Screen-sized again, view at 0,0
   void notesSave();
   void notesLoad();
-  void notesScanFiles();   // Scan /notes/ directory for available files
-  void notesLoadByIndex(); // Load file at _noteFileIndex
+  void exitNotes();     // Autosave on the way out
+  void notesAutosave(); // Changed tiles into the draft
+  void notesDraftStart(const String &name, int page); // Draft against it
+  void notesDraftStart(); // Against the note (or page) on the canvas
+  void notesDraftRecover(); // Open the note a left draft goes over
+  void notesDraftApply();   // Put the draft's tiles on the canvas
+  void notesScanFiles();   // Refresh the file list from the note index
+  void notesLoadByIndex(); // Load file at _notes.fileIndex
+  bool notesFetch(const String &filename, bool show); // Into _notes.cache
+  void notesFetchStrokes(const String &filename, uint8_t *pixels,
+                         uint16_t rasterCrc, bool show);
+  void notesFetched(const String &filename, NoteCache::Entry *entry,
+                    bool show); // Cached: show, or prefetch on
+  void notesShow(const NoteCache::Entry &entry); // Cached note to canvas
+  void notesPrefetch(); // Decode the neighbours of the open note/page
+  void notesTimestampPath(char *out, size_t len, const char *prefix,
+                          const char *ext); // /notes/<prefix>_<time>.<ext>
+  String notesPageKey(int page) const; // Cache key of a notebook page
+  void notesOpenPage(int page);
+  bool notesFetchPage(int page, bool show);
+  bool notesSavePage();          // Canvas into the open notebook
+  void notesPageStep(int delta); // <PG / PG>: save, then turn the page
+  void notesExport(int index, NoteExport::Format format); // To /export
   void notesPrevFile();    // Navigate to previous file
   void notesNextFile();    // Navigate to next file
+  void notesOpenBrowser(); // FILES button: rescan and open the browser
+  void notesShowStatus(const char *text, bool busy); // Save/load status box
 
   // Notes file browser methods
   void drawNotesBrowseScreen();
   void handleNotesBrowseTouch(int x, int y);
   void notesDeleteFile(int index); // Delete file at index
   void loadNotePreview(int index); // Load note as preview thumbnail
-  int _notesBrowseScroll = 0;      // Scroll offset for file list
-  int _selectedFileIndex = 0;      // Currently selected file for preview
-  int _previewFileIndex = -1;      // Which file's preview is currently loaded
-  int _deleteConfirmIndex =
-      -1; // Index of file to delete (-1 = no confirmation)
-  M5Canvas *_previewCanvas = nullptr; // Preview thumbnail canvas
+  void exitNotesBrowse();          // Free the preview canvas
+  void notesBrowseListSetup();     // Lay out the list over _notes.files
+  void paintNoteRow(LovyanGFX &g, int index, int ox, int oy, int w, int h,
+                    bool selected);
+  void drawNotesScrollArrows();
+  void scrollNotesList(int delta); // Rows; repaints just the list
+  void notesBrowseSwipe(const Gesture &g);
+#endif
+  void endToast(); // A timed status box is over: redraw under it
 
   // SD Diagnostics methods
   void drawSDDiagScreen();
   void handleSDDiagTouch(int x, int y);
+  void drawPerfDiagScreen();
+  void handlePerfDiagTouch(int x, int y);
+  void tickPerfDiag(); // Keep the numbers current while shown
+  void drawLinkDiagScreen();
+  void handleLinkDiagTouch(int x, int y);
+  void drawEnergyScreen();
+  void handleEnergyTouch(int x, int y);
+  static const unsigned long PERF_REFRESH_MS = 5000; // Profiler screen
+
+  // Discovery: a scan while shown; the list repaints in place
+  void drawDiscoveryScreen();
+  void drawDiscoveryList(); // List and status line, from _discoveryList
+  void handleDiscoveryTouch(int x, int y);
+  void enterDiscovery();
+  void exitDiscovery();
+  void repaintDiscovery();
+  FossibotDiscovery::Result _discoveryList[FossibotDiscovery::MAX_RESULTS];
+  int _discoveryCount = 0;
+  char _discoveryPick[18] = "";  // MAC of the row tapped
+  uint32_t _discoveryGen = 0;    // Of the list on screen
+  uint32_t _discoveryShownS = 0; // Seconds left on screen, in steps
+
+  // Ink benchmark: dots pushed as they come, latency by stage alongside
+  void drawInkBenchScreen();
+  void drawInkBenchFigures(); // Right-hand panel, from _inkBench
+  void enterInkBench();
+  void exitInkBench();
+  void tickInkBench();
+  static const int INK_BENCH_PAD_W = 640; // Ink pad; figures to its right
+  InkLatency *_inkBench = nullptr;        // While the screen is shown
+  uint32_t _inkBenchShownGen = 0;        // Of the figures on screen
+  char _inkBenchNote[40] = "";            // Outcome of the last SAVE
+
+  // EPD benchmark: the waveform x region matrix, run on demand
+  void drawEpdBenchScreen();
+  void runEpdBench();
+  void exitEpdBench();
+  EpdBench::Results *_epdBench = nullptr; // Last run while shown
+  char _epdBenchNote[48] = "";
+  RefreshScheduler::CostModel _epdModel = {}; // Read at boot, see loadHistory
+
+  // Self-test: the workloads against the stored baseline, run on demand
+  void drawSelfTestScreen();
+  void runSelfTest(bool withSd);
+  void exitSelfTest();
+  SelfTest::Report *_selfTest = nullptr; // Last run while shown
+  char _selfTestNote[48] = "";
 
   // Power Management & Smart Refresh
-  unsigned long _lastDashboardUpdate = 0;
   unsigned long _lastActivityTime = 0; // Last user interaction time
-  bool shouldUpdateDashboard(const Fossibot::PowerBankData &newData);
+  unsigned long _lastInputTime = 0;    // Last touch (not reset by BLE)
+  int _autoSleepMinutes = 60;          // From the settings, 0 = off
+  static const unsigned long ACTIVE_HOLD_MS = 5000; // Full clock after touch
+
+  // GT911 report profile the screen wants. The controller stores its
+  // configuration, so the profile only follows a screen that has been up
+  // TOUCH_PROFILE_SETTLE_MS, not every pass through it.
+  static const unsigned long TOUCH_PROFILE_SETTLE_MS = 10000;
+  GT911::Profile _touchProfile = GT911::Profile::IDLE;
+  bool _touchProfileSet = false; // The controller has _touchProfile
+  unsigned long _touchProfileSince = 0;
+  void settleTouchProfile();
   void checkPowerManagement(); // Check idle time and CPU scaling
+  void applySettings(const Config &config, uint32_t changed);
+  void updatePowerMode();      // DFS / light sleep from recent input
+  void applyOperatingPoint();  // Power governor level changed
+  unsigned long refreshIntervalMs() const; // Setting or governor floor
   void enterDeepSleep();       // Enter deep sleep mode
+  void saveResumeState();      // Snapshot for resume() after the wake
+  void beginDisplay();         // Rotation, depth, frame buffers
+  void finishHistoryLoad();    // Loop-task half of loadHistory()
+  void compactHistory();       // Day files past the ring into archives
+  bool _resumed = false;       // resume() has set up the display
+  // Tile hashes of the frame the panel kept through deep sleep, until the
+  // first home draw refreshes just what differs from it
+  const uint32_t *_panelKept = nullptr;
+  // Counters shown until the history is up, and how far its load has got
+  EnergyTotals _resumeEnergy = {};
+  volatile bool _historyLoaded = false; // Set by loadHistory()
+  bool _historyReady = false;           // finishHistoryLoad() has run
   void runSDMountTest();
   void runSDWriteTest();
   void runSDReadTest();
   char _sdDiagResult[256] = ""; // Stores test result text
 
+#if APP_GAMES
   // 2048 Game state
-  int _game2048Grid[4][4]; // Tile values (0 = empty, 2, 4, 8, ...)
-  int _game2048Score;
-  int _game2048HighScore;
-  bool _game2048GameOver;
-  bool _game2048Won;
+  struct Game2048State {
+    Game2048::Board board;
+    Game2048::Board shown = 0; // As last painted
+    int shownScore = 0;
+    int shownBest = 0;
+    int shownHint = -1;
+    int score;
+    int highScore;
+    bool gameOver;
+    bool won;
+    Game2048Solver solver;
+    int hint = -1;         // Suggested direction, -1 = none shown
+    bool autoplay = false; // The solver makes every move
+    unsigned long lastAutoMove = 0;
+  };
+  Game2048State _game2048;
+  static const unsigned long GAME_2048_AUTO_STEP_MS = 600; // Per move
 
   // 2048 Game methods
   void drawGamesMenu();
   void handleGamesMenuTouch(int x, int y);
   void drawGame2048();
-  void handleGame2048Touch(int x, int y, TouchEvent event);
+  void handleGame2048Touch(int x, int y);
+  void game2048HandleSwipe(const Gesture &g);
+  void enterGame2048();  // Build the move table, start the solver
+  void exitGame2048();   // Stop the solver, free the tables
+  void updateGame2048(); // Solver results: hint or autoplay move
+  void drawGame2048Hint();
+  void drawGame2048Tile(int row, int col);
+  void drawGame2048Score();
+  void repaintGame2048(); // Idle: just the tiles and score that changed
+  bool game2048Move(int direction); // Slide, spawn, save; false if stuck
   void game2048Init();
   void game2048AddRandomTile();
   bool game2048Slide(int direction); // 0=up, 1=right, 2=down, 3=left
@@ -349,35 +775,238 @@ private:
   void game2048Load();
 
   // Sudoku Game state (6x6 grid)
-  byte _sudokuGrid[6][6];     // Current values (0-6, 0 = empty)
-  byte _sudokuSolution[6][6]; // Correct solution
-  bool _sudokuGiven[6][6];    // true = locked given number
-  int8_t _sudokuSelectedRow;  // Currently selected cell (-1 = none)
-  int8_t _sudokuSelectedCol;
-  byte _sudokuPuzzleNum;   // Current puzzle number (1-based)
-  byte _sudokuDifficulty;  // 0=easy, 1=medium, 2=hard
-  bool _sudokuShowConfirm; // Show "New puzzle?" confirmation
-  static const byte SUDOKU_PUZZLES_PER_DIFFICULTY =
-      10; // Start with 10, can expand via SD
+  struct SudokuState {
+    Sudoku::Board board; // Current values, with per-unit counts
+    byte solution[6][6]; // Correct solution
+    bool given[6][6];    // true = locked given number
+    int8_t selectedRow;  // Currently selected cell (-1 = none)
+    int8_t selectedCol;
+    byte puzzleNum;   // Built-in puzzle (1-based), 0 = generated
+    byte difficulty;  // 0=easy, 1=medium, 2=hard
+    bool showConfirm; // Show "New puzzle?" confirmation
+    bool pencil = false;     // Show the candidates in empty cells
+    uint32_t elapsedMs = 0;  // Time on this puzzle before clockFrom
+    unsigned long clockFrom = 0; // millis() the clock resumed, 0 = off
+    SudokuGenerator generator;
+  };
+  SudokuState _sudoku;
+  static const byte SUDOKU_BUILT_IN_PUZZLES = 3; // Per difficulty
 
   // Sudoku Game methods
   void drawSudokuGame();
-  void handleSudokuTouch(int x, int y, TouchEvent event);
+  void handleSudokuTouch(int x, int y);
   void sudokuLoadPuzzle(byte difficulty, byte num);
   void sudokuLoadRandomPuzzle(byte difficulty);
+  void sudokuSetPuzzle(const Sudoku::Grid puzzle,
+                       const Sudoku::Grid solution);
+  void enterSudoku(); // Resume the saved puzzle, start generating
+  void exitSudoku();  // Save, with the time played
+  uint32_t sudokuElapsedSecs() const;
   void sudokuInit();
+  void sudokuSave();      // Record the puzzle in progress
+  bool sudokuLoadSaved(); // Resume it; false if there is none
   bool sudokuValidateCell(byte row, byte col);
   bool sudokuCheckWin();
   void sudokuClearCell();
 
+  // Wordle state
+  struct WordleState {
+    Wordle::Dictionary dict;
+    char answer[Wordle::LENGTH + 1] = {}; // Empty without a game
+    char guesses[Wordle::MAX_GUESSES][Wordle::LENGTH + 1] = {};
+    Wordle::Mark marks[Wordle::MAX_GUESSES][Wordle::LENGTH] = {};
+    int rows = 0;  // Guesses submitted
+    int typed = 0; // Letters in the row being typed
+    bool over = false;
+    const char *message = nullptr; // Replaces the guess count
+    WordleSolver solver;
+    char hint[32] = {}; // The last hint, shown as the message
+    struct {
+      uint16_t played, won, streak, bestStreak;
+      uint16_t solvedIn[Wordle::MAX_GUESSES]; // Wins by guesses taken
+    } stats = {};
+  };
+  WordleState _wordle;
+
+  // Wordle methods
+  void drawWordle();
+  void enterWordle(); // Open the dictionary, resume the saved game
+  void exitWordle();  // Stop the solver, save, close the dictionary
+  void updateWordle(); // Solver results: the hint
+  void wordleRequestHint();
+  bool wordleLoad();
+  void wordleSave();
+  void wordleNewGame();
+  void wordleKey(char key); // a-z, '\b' delete, '\n' submit
+  void wordleShowMessage(const char *text);
+  void drawWordleTile(int row, int col);
+  void drawWordleMessage();
+  void drawWordleKey(int x, int y, int w, const char *label, char key);
+#endif
+
+#if APP_READER
+  // Reader state
+  struct ReaderState {
+    Reader *book = nullptr;    // On screen; null in the library
+    std::vector<String> books; // Library: /books, by name
+    int listPage = 0;
+    uint8_t font = 1;           // Reader::font() size
+    bool shownComplete = false; // Footer shows the final page count
+    BookSearch search; // Index of /books, built while idle or charging
+    String query;      // Library: showing the hits for it
+    std::vector<BookSearch::Hit> hits;
+  };
+  ReaderState _reader;
+  static const int READER_LIST_ROWS = 7;
+  static const int READER_MAX_HITS = 28;
+  static const unsigned long READER_INDEX_IDLE_MS = 2000; // After input
+  static const uint32_t READER_INDEX_SLICE_MS = 100;      // Per update()
+
+  // Reader methods
+  void drawReader();
+  void handleReaderTouch(int x, int y);
+  void readerHandleSwipe(const Gesture &g);
+  void enterReader();  // Reopen the last book, or list /books
+  void exitReader();   // Save the position, close the book
+  void updateReader(); // Draw the pages either side, then index ahead
+  void drawReaderLibrary();
+  void drawReaderFooter();
+  void drawReaderHits();
+  void drawReaderPager(int pages); // PREV / NEXT under a list
+  void readerScanBooks();
+  bool readerOpen(const char *name, const BookSource::Pos *pos = nullptr);
+  void readerFind(const String &query); // Then back to the library
+  void searchIdle(); // Index books for search a slice at a time
+  void readerCloseBook(); // Back to the library
+  void readerTurn(int pages);
+  void readerSetFont(int font);
+  void readerSave();
+  bool readerBusy() const; // Pages to draw or index, books to search-index
+#endif
+
+#if APP_PHOTOS
+  // Photos (picture frame over /photos)
+  struct PhotoState {
+    std::vector<String> files; // By name
+    int index = 0;             // Kept between visits
+    int shown = -1;            // Photo whose rendition is in the canvas
+    M5Canvas *canvas = nullptr;
+    unsigned long since = 0; // When it went up (the slideshow's beat)
+    long statusMinute = -1;  // Minute the status line shows
+  };
+  PhotoState _photos;
+  void drawPhotoScreen();
+  void enterPhotos();  // List /photos
+  void exitPhotos();   // Free the rendition
+  void updatePhotos(); // Status line each minute, next photo every ten
+  void drawPhotoStatus();
+  void photoStep(int delta);
+#endif
+
+  // Text entry: the Connect settings and to-do items, typed on an
+  // on-screen keyboard
+  enum class TextField : uint8_t {
+    FOSSIBOT_MAC,
+    WIFI_SSID,
+    WIFI_PASSWORD,
+    WEATHER_CITY,
+    TODO_ITEM,  // An item of the to-do list
+    BOOK_SEARCH // Words to find in /books
+  };
+  TextField _kbField = TextField::FOSSIBOT_MAC;
+  String _kbText;                   // As typed, saved by SAVE
+  uint8_t _kbLayout = 0;            // Lower case, one capital, symbols
+  const char *_kbMessage = nullptr; // Replaces the hint under the field
+  void drawConnectScreen();
+  void openKeyboard(TextField field);
+  void drawKeyboard();
+  void keyboardKey(char key); // Character, '\b' delete, '\t' shift,
+                              // '\v' symbols
+  void keyboardSubmit();
+  void drawKeyboardField();
+  void drawKeyboardKeys(); // The layout's labels and SHIFT's state
+  void drawKeyboardKey(int x, int y, int w, const char *label,
+                       bool selected);
+
+#if APP_NOTES
+  // To-do list, kept as a log of changes
+  struct TodoState {
+    TodoLog log;
+    int page = 0;
+    int editing = -1; // Row the keyboard is editing; -1 adds one
+  };
+  TodoState _todo;
+  void drawTodoScreen();
+  void enterTodo(); // Replay the log
+  void exitTodo();  // Compact it, if it is worth it
+  void todoIdle();  // Compact it after a quiet spell
+  void drawTodoRow(int slot);
+  void drawTodoFooter();
+  void todoRepaint(int fromSlot); // Rows from there down, and the footer
+  void todoSubmit(String text);   // From the keyboard
+#endif
+
+  // Weather (forecast from WeatherService's cache)
+  uint32_t _weatherShown = 0; // Service generation on screen
+  void drawWeatherScreen();
+  void updateWeatherScreen(); // Redraw when a fetch lands
+  void weatherSummary(char *buf, size_t len) const; // Home panel line
+
   // Power History (data collection active, UI Phase 3)
   PowerHistory _powerHistory;
+  LoadForecaster _forecast; // Stable time to empty/full for the dashboard
+  EnergyLedger _ledger;      // Cost and solar savings, priced hourly
+  void saveLedger();
+  void drawCostsScreen();
+  void handleCostsTouch(int x, int y);
+  void drawSolarScreen();
+  void handleSolarTouch(int x, int y);
+  void drawLoadScreen();
+  void handleLoadTouch(int x, int y);
   void drawHistoryScreen();
-  void handleHistoryTouch(int x, int y, TouchEvent event);
+  void drawHistoryHeader(); // Date range, span, zoom buttons
+  void drawHistoryPlot();   // The window's plot, from the cache if closed
+  void paintHistoryPlot();  // Frame, axes and traces of the window
+  bool historyWindowSettled() const; // Nothing in it can change now
+  uint32_t historyGraphKey() const;  // What a settled plot depends on
+  void drawHistoryTraces(int graphMax, int gapCols, uint16_t color);
+  void historyTouch(int x, int y, TouchEvent event); // Drag to pan
+  void historyPinch(const GT911::TouchSample &sample); // Every finger
+  void historyIdle(); // Repaint what a pan or zoom changed
+  void exitHistory(); // Release the paged-in day
 
   // History UI state
-  unsigned long _lastHistorySample = 0;
-  uint8_t _historyViewDay = 0;   // 0=today, 1=yesterday, etc.
+  uint32_t _lastMinuteSampled = 0; // Filter minute last put in history
+  void sampleHistory(const PowerSample &sample);
+  void sampleIdleHistory();
+
+  // Timer wheel jobs (-1 until init())
+  int _clockSyncJob = -1; // System clock pulled back to the RTC
+  int _historyJob = -1;   // Sample the reading on hand, a minute after the
+                          // last sample
+  int _alarmJob = -1;
+  int _timerJob = -1;    // Countdown seconds while running
+  int _pomodoroJob = -1;
+  int _archiveJob = -1; // compactHistory(): idle or charging
+#if APP_NOTES
+  int _notesAutosaveJob = -1;
+#endif
+  int _toastJob = -1; // Takes down a timed status box: endToast()
+  HistoryView _historyView;         // Window shown: span and position
+  bool _historyWeek = false;        // Its days overlaid on one 24h axis
+  HistoryEnvelope _historyEnvelope; // Per-column min/max of the window
+  PinchRecognizer _pinch;           // Two-finger zoom on the plot
+  bool _historyPanning = false;     // A drag that began on the plot
+  int16_t _panStartX = 0;
+  uint32_t _panStartT = 0;          // Window start when the drag began
+  uint32_t _pinchStartSpan = 0;
+  float _pinchAnchor = 0.5f;        // Fingers' midpoint across the plot
+  bool _historyViewDirty = false;   // Plot behind the window
+  bool _historyHeaderStale = false; // Header behind the window
+  unsigned long _historyPaintedAt = 0;
+  StaticLayer _historyLayer;        // Graph frame, grid and axis labels
+  BandRenderer _historyBands;       // Traces over it, on both cores
+  GraphCache _historyGraphs;        // Plots of settled windows
   uint8_t _historyFilter = 0x00; // Bitfield: 0=None (default for speed)
 };
 
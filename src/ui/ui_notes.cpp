@@ -0,0 +1,716 @@
+/**
+ * UI Manager - Notes
+ * A scribble pad: ink on a canvas that can pan over a larger page, saved
+ * as notes and notebook pages, with a draft autosaved to the card
+ */
+
+#include "../hardware/buzzer.h"
+#include "../utils/log.h"
+#include "../utils/mem_telemetry.h"
+#include "../utils/sd_manager.h"
+#include "../utils/storage_worker.h"
+#include "../utils/timer_wheel.h"
+#include "note_codec.h"
+#include "note_paths.h"
+#include "raster4.h"
+#include "ui_manager.h"
+#include <esp_heap_caps.h>
+#include <time.h>
+
+#if APP_NOTES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_LIGHT_GRAY 0xC618
+#define COLOR_WHITE 0xFFFF
+
+// ============================================================================
+// Notes (Scribble Pad)
+// ============================================================================
+
+void UIManager::drawNotesScreen() {
+  // Use Quality mode for drawing the UI
+  _refresh.forceClean();
+  M5.Display.setTextSize(2); // Set default size for buttons
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  // Toolbar Background (Right Side)
+  int toolbarW = 100;
+  int toolbarX = SCREEN_WIDTH - toolbarW;
+  M5.Display.fillRect(toolbarX, 0, toolbarW, SCREEN_HEIGHT, COLOR_LIGHT_GRAY);
+
+  // Initialize Canvas for scribbling (Left Side)
+  bool created = _notes.canvas == nullptr;
+  if (created) {
+    _notes.canvas = new M5Canvas(&M5.Display);
+    _notes.canvas->setColorDepth(NOTES_DEPTH); // Expanded as it is pushed
+    _notes.canvas->createSprite(toolbarX, SCREEN_HEIGHT);
+    MemTelemetry::track(MemTelemetry::Tag::NOTES,
+                        _notes.canvas->bufferLength()); // Kept after Notes
+    Raster4::clear(*_notes.canvas);
+    _notes.tileUndo.begin((uint8_t *)_notes.canvas->getBuffer(), toolbarX,
+                          SCREEN_HEIGHT);
+    _notes.draft.begin(toolbarX, SCREEN_HEIGHT, _notes.tileUndo.tileCount());
+    _notes.page.begin(NOTES_PAGE_W, NOTES_PAGE_H);
+  }
+  _notes.canvas->pushSprite(0, 0);
+
+  // Toolbar Buttons
+  int btnX = toolbarX + 10;
+  int btnW = 80;
+  int btnH = 50;
+  int gap = 10;
+  int y = 10;
+
+  drawButton(btnX, y, btnW, btnH, "THIN");
+  y += (btnH + gap);
+  drawButton(btnX, y, btnW, btnH, "MED");
+  y += (btnH + gap);
+  drawButton(btnX, y, btnW, btnH, "THICK");
+  y += (btnH + gap);
+  drawButton(btnX, y, btnW, btnH, "ERASE");
+  y += (btnH + gap);
+
+  y += 10; // Extra gap
+  drawButton(btnX, y, btnW, btnH, "SAVE");
+  y += (btnH + gap);
+
+  // File browser button
+  drawButton(btnX, y, btnW, btnH, "FILES");
+  y += (btnH + gap);
+
+  // Navigation buttons
+  drawButton(btnX, y, btnW, btnH, "< PREV");
+  y += (btnH + gap);
+  drawButton(btnX, y, btnW, btnH, "> NEXT");
+  y += (btnH + gap);
+
+  drawButton(btnX, y, btnW, btnH, "CLR");
+
+  // Toolbar touch targets: full toolbar width, one row per button
+  auto addTool = [&](int index, HitRegistry::Callback cb) {
+    int by = 10 + index * (btnH + gap);
+    if (index >= 4)
+      by += 10; // Extra gap after ERASE
+    _hits.add(toolbarX, by, toolbarW, btnH, cb);
+  };
+  auto setPen = [this](int size, uint16_t color) {
+    Buzzer::click();
+    _notes.penSize = size;
+    _notes.penColor = color;
+    _notes.penWidth.set(size, color == 0); // The eraser keeps its width
+  };
+  addTool(0, [setPen](int, int) { setPen(2, 0); });       // THIN
+  addTool(1, [setPen](int, int) { setPen(5, 0); });       // MED
+  addTool(2, [setPen](int, int) { setPen(10, 0); });      // THICK
+  addTool(3, [setPen](int, int) { setPen(10, 0xFFFF); }); // ERASE (White)
+  addTool(4, [this](int, int) {
+    Buzzer::click();
+    if (_notes.notebook.isOpen())
+      notesSavePage();
+    else
+      notesSave();
+  });
+  addTool(5, [this](int, int) { notesOpenBrowser(); });
+  addTool(6, [this](int, int) {
+    Buzzer::click();
+    notesPrevFile();
+  });
+  addTool(7, [this](int, int) {
+    Buzzer::click();
+    notesNextFile();
+  });
+  addTool(8, [this](int, int) {
+    Buzzer::click();
+    notesClear();
+    _needsRefresh = true;
+    _lastRefresh = 0;
+  });
+
+  // File count indicator (if files exist)
+  if (!_notes.files.empty() && _notes.fileIndex >= 0) {
+    y += (btnH + gap + 5);
+    M5.Display.setTextSize(1);
+    M5.Display.setTextColor(COLOR_BLACK);
+    char fileInfo[16];
+    snprintf(fileInfo, sizeof(fileInfo), "%d/%d", _notes.fileIndex + 1,
+             _notes.files.size());
+    M5.Display.setCursor(btnX + 25, y);
+    M5.Display.print(fileInfo);
+  }
+
+  // "X" Exit (Top Left)
+  drawButton(10, 10, 60, 50, "X");
+  _hits.add(10, 10, 60, 50, [this](int, int) {
+    Buzzer::click();
+    // Force clean exit to remove doodles
+    _refresh.forceClean();
+    M5.Display.fillScreen(COLOR_WHITE);
+    M5.Display.display();
+    navigateTo(ScreenID::HOME);
+  });
+
+  // Undo/redo, then notebook pages (next to Exit).
+  // notesInkSample() keeps ink out of this strip.
+  drawButton(80, 10, 80, 50, "UNDO");
+  _hits.add(80, 10, 80, 50, [this](int, int) { notesUndo(); });
+  drawButton(170, 10, 80, 50, "REDO");
+  _hits.add(170, 10, 80, 50, [this](int, int) { notesRedo(); });
+  drawButton(260, 10, 70, 50, "<PG");
+  _hits.add(260, 10, 70, 50, [this](int, int) { notesPageStep(-1); });
+  drawButton(340, 10, 70, 50, "PG>");
+  _hits.add(340, 10, 70, 50, [this](int, int) { notesPageStep(1); });
+
+  // A single note pans over its page (notesInkSample() skips these too)
+  if (!_notes.notebook.isOpen()) {
+    const char *arrows[] = {"<", "^", "v", ">"};
+    const int steps[][2] = {{-1, 0}, {0, -1}, {0, 1}, {1, 0}};
+    for (int i = 0; i < 4; i++) {
+      int dc = steps[i][0];
+      int dr = steps[i][1];
+      drawButton(600 + i * 60, 10, 50, 50, arrows[i]);
+      _hits.add(600 + i * 60, 10, 50, 50,
+                [this, dc, dr](int, int) { notesPan(dc, dr); });
+    }
+  }
+
+  // Hint: the page within a notebook, or the view within a large page
+  M5.Display.setTextSize(1);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(420, 20);
+  if (_notes.notebook.isOpen())
+    M5.Display.printf(
+        "Page %d/%d", _notes.notebookPage + 1,
+        max(_notes.notebook.pageCount(), _notes.notebookPage + 1));
+  else if (_notes.large)
+    M5.Display.printf("View %d,%d of %d,%d", _notes.viewCol + 1,
+                      _notes.viewRow + 1, NOTES_PAN_STEPS + 1,
+                      NOTES_PAN_STEPS + 1);
+  else
+    M5.Display.print("Draw Mode");
+
+  // Switch to Fastest mode for drawing responsiveness
+  M5.Display.setEpdMode(epd_mode_t::epd_fastest);
+
+  // Reset pen state if needed
+  if (_notes.penSize == 0)
+    _notes.penSize = 2;
+  _notes.penColor = 0; // Black
+  _notes.penWidth.set(_notes.penSize, true);
+
+  // Initial scan for files if list is empty
+  if (_notes.files.empty()) {
+    notesScanFiles();
+  }
+
+  // Ink left unsaved by the last session comes back on the new canvas
+  if (created)
+    notesDraftRecover();
+}
+
+void UIManager::exitNotes() { notesAutosave(); }
+
+void UIManager::handleNotesTouch(int x, int y) {
+  // Toolbar and Exit are registered in drawNotesScreen(); taps on the
+  // drawing area are ink, not commands.
+  (void)x;
+  (void)y;
+}
+
+void UIManager::notesOpenBrowser() {
+  Buzzer::click();
+
+  extern SDManager *sdManager;
+  {
+    SDAccess sd(sdManager);
+    if (!sd) {
+      Serial.println("FILES: SD unavailable");
+      return;
+    }
+    notesScanFiles(); // Refresh file list
+  }
+  notesBrowseListSetup();
+  navigateTo(ScreenID::NOTES_BROWSE);
+}
+
+void UIManager::updateNotes() {
+  if (_notes.sampleCount == 0 && (_notes.inkFilter.isDown() || !_notes.drawing))
+    return;
+
+  // Replay every sample since the last frame so strokes keep all points.
+  // Ink lands in the canvas first; the damaged regions are pushed once.
+  _notes.stroke.attach(&M5.Display, _notes.canvas);
+  _notes.stroke.setUndo(&_notes.tileUndo);
+  _notes.stroke.setPen(_notes.drawing ? _notes.inkWidth : _notes.penSize,
+                       _notes.penColor);
+  for (int i = 0; i < _notes.sampleCount; i++) {
+    if (_notes.samples[i].pressed)
+      notesInkSample(_notes.samples[i].x, _notes.samples[i].y,
+                     _notes.samples[i].size);
+    else
+      notesInkEnd();
+  }
+  _notes.sampleCount = 0;
+
+  if (!_notes.inkFilter.isDown() && _notes.drawing)
+    notesInkEnd();
+
+  _refresh.apply(RegionKind::INK);
+  M5.Display.startWrite();
+  _notes.stroke.flush();
+  M5.Display.endWrite();
+}
+
+void UIManager::notesInkSample(int x, int y, uint16_t contact) {
+  // Ignore touch on toolbar or Exit button
+  int toolbarX = SCREEN_WIDTH - 100;
+  bool inToolbar = (x > toolbarX);
+  bool inExit = (x >= 10 && x < 410 && y >= 10 && y < 60); // Exit to PG>
+  bool inPan = !_notes.notebook.isOpen() && x >= 600 && x < 830 && y >= 10 &&
+               y < 60;
+
+  // Also hold ink while the canvas itself is being loaded or saved
+  if (inToolbar || inExit || inPan || _notes.ioBusy) {
+    notesInkEnd();
+    return;
+  }
+
+  // Width follows the contact size, half-way per sample so it swells and
+  // thins smoothly
+  int width = _notes.penWidth.width(contact);
+  if (_notes.drawing) {
+    _notes.inkWidth = (_notes.inkWidth + width + 1) / 2;
+    _notes.stroke.setPen(_notes.inkWidth, _notes.penColor);
+    _notes.stroke.addPoint(x, y);
+    _notes.strokeLog.add(x, y, _notes.inkWidth);
+  } else {
+    _notes.inkWidth = width;
+    _notes.stroke.setPen(_notes.inkWidth, _notes.penColor);
+    _notes.tileUndo.beginStroke();
+    _notes.stroke.begin(x, y);
+    _notes.strokeLog.begin(_notes.inkWidth, _notes.penColor, x, y,
+                           _notes.penWidth.isVarying());
+    _notes.drawing = true;
+    _notes.dirty = true;
+  }
+}
+
+void UIManager::notesInkEnd() {
+  if (!_notes.drawing)
+    return;
+  _notes.stroke.end();
+  _notes.strokeLog.end();
+  _notes.tileUndo.endStroke();
+  _notes.drawing = false;
+}
+
+void UIManager::notesSetBase(const uint8_t *pixels) {
+  // The base only exists alongside the canvas, and always at its size
+  size_t len = _notes.canvas ? _notes.canvas->bufferLength() : 0;
+  if (_notes.base)
+    MemTelemetry::track(MemTelemetry::Tag::NOTES, -(long)len);
+  free(_notes.base);
+  _notes.base = nullptr;
+  if (!pixels || !_notes.canvas)
+    return;
+  _notes.base = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+  if (_notes.base) {
+    MemTelemetry::track(MemTelemetry::Tag::NOTES, len);
+    memcpy(_notes.base, pixels, len);
+  }
+}
+
+void UIManager::notesClear() {
+  notesPageReset();
+  if (_notes.canvas)
+    Raster4::clear(*_notes.canvas);
+  _notes.strokeLog.clear();
+  _notes.tileUndo.clear();
+  notesSetBase(nullptr);
+  _notes.dirty = true;
+
+  // A cleared notebook page differs from the saved one everywhere; a
+  // single note starts over as a new, blank one
+  if (_notes.notebook.isOpen())
+    _notes.tileUndo.markAllChanged();
+  else
+    notesDraftStart("", -1);
+}
+
+// Fold the view into the page and fill it from another origin. The
+// strokes and undo tiles are in view coordinates, so they start over with
+// the new view as their base.
+// @return false if the page could not take the view (it stays put)
+bool UIManager::notesMoveView(int col, int row) {
+  if (!_notes.canvas || !_notes.page.isReady())
+    return false;
+  uint8_t *view = (uint8_t *)_notes.canvas->getBuffer();
+  int w = _notes.canvas->width();
+  int h = _notes.canvas->height();
+  if (!_notes.page.store(view, w, h, _notes.viewCol * NOTES_PAN_X,
+                         _notes.viewRow * NOTES_PAN_Y))
+    return false;
+  _notes.page.load(view, w, h, col * NOTES_PAN_X, row * NOTES_PAN_Y);
+  _notes.viewCol = col;
+  _notes.viewRow = row;
+  _notes.large = true;
+  _notes.strokeLog.clear();
+  _notes.tileUndo.clear();
+  notesSetBase(view);
+  return true;
+}
+
+// A step across a single note's page; the first one makes the note a page
+// larger than the screen
+void UIManager::notesPan(int dc, int dr) {
+  if (_notes.ioBusy || _notes.drawing)
+    return;
+  int col = _notes.viewCol + dc;
+  int row = _notes.viewRow + dr;
+  if (_notes.notebook.isOpen() || col < 0 || row < 0 || col > NOTES_PAN_STEPS ||
+      row > NOTES_PAN_STEPS) {
+    Buzzer::error();
+    return;
+  }
+  if (!notesMoveView(col, row)) {
+    Buzzer::error();
+    notesShowStatus("No memory!", false);
+    return;
+  }
+  Buzzer::click();
+  // The draft follows the view; unsaved, all of it may differ from the note
+  notesDraftStart();
+  if (_notes.dirty)
+    _notes.tileUndo.markAllChanged();
+  _needsRefresh = true;
+  _lastRefresh = 0;
+}
+
+void UIManager::notesPageReset() {
+  _notes.page.clear();
+  _notes.viewCol = 0;
+  _notes.viewRow = 0;
+  _notes.large = false;
+}
+
+void UIManager::notesRedraw() {
+  if (!_notes.canvas)
+    return;
+  if (_notes.base)
+    memcpy(_notes.canvas->getBuffer(), _notes.base,
+           _notes.canvas->bufferLength());
+  else
+    Raster4::clear(*_notes.canvas);
+
+  // Canvas only: the caller refreshes the screen once
+  StrokeRenderer renderer;
+  renderer.attach(nullptr, _notes.canvas);
+  _notes.strokeLog.replay(renderer);
+  renderer.flush();
+}
+
+// The tile ring puts back just the stroke's area; past what it holds, the
+// page is replayed from the stroke log
+void UIManager::notesUndo() {
+  if (_notes.ioBusy || _notes.drawing)
+    return;
+  if (_notes.tileUndo.undo()) {
+    _notes.strokeLog.undo();
+  } else if (_notes.strokeLog.undo()) {
+    _notes.tileUndo.clear();
+    notesRedraw();
+  } else {
+    Buzzer::error();
+    return;
+  }
+  Buzzer::click();
+  _notes.dirty = true;
+  _needsRefresh = true;
+  _lastRefresh = 0;
+}
+
+void UIManager::notesRedo() {
+  if (_notes.ioBusy || _notes.drawing)
+    return;
+  if (_notes.tileUndo.redo()) {
+    _notes.strokeLog.redo();
+  } else if (_notes.strokeLog.redo()) {
+    notesRedraw();
+  } else {
+    Buzzer::error();
+    return;
+  }
+  Buzzer::click();
+  _notes.dirty = true;
+  _needsRefresh = true;
+  _lastRefresh = 0;
+}
+
+void UIManager::notesShowStatus(const char *text, bool busy) {
+  if (_currentScreen != ScreenID::NOTES)
+    return;
+  M5.Display.setEpdMode(epd_mode_t::epd_fast);
+  M5.Display.fillRect(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 30, 200, 60,
+                      busy ? COLOR_BLACK : COLOR_WHITE);
+  M5.Display.setTextColor(busy ? COLOR_WHITE : COLOR_BLACK);
+  M5.Display.setTextSize(2);
+  M5.Display.setCursor(SCREEN_WIDTH / 2 - 6 * (int)strlen(text),
+                       SCREEN_HEIGHT / 2 - 10);
+  M5.Display.print(text);
+  M5.Display.display();
+  // A final status stays up briefly, then the canvas is redrawn
+  if (busy)
+    timers->stop(_toastJob);
+  else
+    timers->start(_toastJob, 1500);
+}
+
+// In its month's directory, made here if this is the month's first note
+void UIManager::notesTimestampPath(char *out, size_t len, const char *prefix,
+                                   const char *ext) {
+  time_t now = time(nullptr);
+  struct tm t;
+  localtime_r(&now, &t);
+  char name[NoteIndex::MAX_NAME];
+  snprintf(name, sizeof(name), "%s_%04d%02d%02d_%02d%02d%02d.%s", prefix,
+           t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min,
+           t.tm_sec, ext);
+  NotePaths::makeShard(name);
+  strlcpy(out, NotePaths::resolve(name).c_str(), len);
+}
+
+void UIManager::notesSave() {
+  if (!_notes.canvas)
+    return;
+
+  extern StorageWorker *storage;
+  if (!storage || _notes.ioBusy)
+    return;
+
+  Serial.println("\n=== NOTES SAVE START ===");
+  Buzzer::click();
+  notesShowStatus("Saving...", true);
+
+  // Timestamped filename: /notes/note_YYYYMMDD_HHMMSS.bin
+  char filename[50];
+  notesTimestampPath(filename, sizeof(filename), "note", "bin");
+
+  uint16_t w = _notes.canvas->width();
+  uint16_t h = _notes.canvas->height();
+  uint8_t d = NOTES_DEPTH;
+
+  // Compress into a v2 file: that is also the snapshot, so drawing can go
+  // on while the card is written. A large page is its inked tiles.
+  size_t len = 0;
+  uint8_t *pixels;
+  if (_notes.large) {
+    _notes.page.store((const uint8_t *)_notes.canvas->getBuffer(), w, h,
+                      _notes.viewCol * NOTES_PAN_X,
+                      _notes.viewRow * NOTES_PAN_Y);
+    w = NOTES_PAGE_W;
+    h = NOTES_PAGE_H;
+    pixels = _notes.page.encode(len);
+    if (!pixels) {
+      notesShowStatus("No memory!", false);
+      Serial.println("=== NOTES SAVE END (FAILED) ===\n");
+      return;
+    }
+  } else {
+    pixels = NoteCodec::encode((const uint8_t *)_notes.canvas->getBuffer(), w,
+                               h, d, len);
+  }
+  bool snapshot = pixels != nullptr;
+  uint16_t rasterCrc = 0; // Ties the stroke log to this raster
+  uint16_t dataOffset = 11;
+  if (snapshot) {
+    NoteCodec::Header noteHeader;
+    memcpy(&noteHeader, pixels, sizeof(noteHeader));
+    rasterCrc = noteHeader.crc;
+    dataOffset = NoteCodec::dataOffset(pixels, len);
+  }
+  uint8_t header[11];
+  size_t headerLen = 0;
+  if (!snapshot) {
+    // Without PSRAM to spare, write a raw v1 file straight from the canvas
+    // and hold the ink until the write is done
+    memcpy(header, "M5NOTE", 6);
+    memcpy(header + 6, &w, 2);
+    memcpy(header + 8, &h, 2);
+    header[10] = d;
+    headerLen = sizeof(header);
+    len = _notes.canvas->bufferLength(); // Rows padded to whole bytes
+    pixels = (uint8_t *)_notes.canvas->getBuffer();
+  }
+  _notes.ioBusy = !snapshot;
+
+  Serial.printf("Queueing %s: %dx%d depth=%d, %d bytes\n", filename, w, h, d,
+                len);
+  String path = filename;
+  bool queued = storage->write(
+      filename, header, headerLen, pixels, len,
+      [this, path, snapshot, dataOffset](const StorageResult &result) {
+        if (!snapshot)
+          _notes.ioBusy = false;
+        if (result.ok) {
+          // Store as current file and add it to the index
+          _notes.currentFile = path;
+          _notes.index.insert(
+              path.substring(path.lastIndexOf('/') + 1).c_str(),
+              result.bytes, dataOffset);
+          _notes.dirty = false;
+          notesScanFiles();
+          Serial.println("Note saved successfully!");
+          notesShowStatus("Saved!", false);
+        } else {
+          Serial.printf("ERROR: Note write failed (%d bytes)\n",
+                        result.bytes);
+          notesShowStatus("SD Failed!", false);
+          _notes.tileUndo.markAllChanged(); // The draft is all there is of it
+        }
+        Serial.println("=== NOTES SAVE END ===\n");
+      },
+      snapshot);
+
+  if (!queued) {
+    if (snapshot)
+      free(pixels);
+    _notes.ioBusy = false;
+    notesShowStatus("SD Busy!", false);
+    Serial.println("=== NOTES SAVE END (FAILED) ===\n");
+    return;
+  }
+
+  // Queued behind the note: ink from here on is drafted against it
+  notesDraftStart(NotePaths::nameOf(path.c_str()), -1);
+
+  // The stroke log goes alongside, tied to this raster by its CRC. A log
+  // drawn over an older raster-only note cannot stand alone: the raster
+  // is all that is kept for those, and for a large page.
+  if (_notes.large || _notes.base || !_notes.strokeLog.isComplete())
+    return;
+  StrokeLog::Header stkHeader;
+  _notes.strokeLog.seal(stkHeader, rasterCrc);
+  uint8_t *strokes = (uint8_t *)malloc(
+      _notes.strokeLog.size() ? _notes.strokeLog.size() : 1);
+  if (!strokes)
+    return;
+  memcpy(strokes, _notes.strokeLog.data(), _notes.strokeLog.size());
+  String strokePath = path.substring(0, path.lastIndexOf('.')) + ".stk";
+  if (!storage->write(strokePath.c_str(), &stkHeader, sizeof(stkHeader),
+                      strokes, _notes.strokeLog.size(), nullptr, true))
+    free(strokes);
+}
+
+// The draft holds the canvas's tiles that differ from this note (or page):
+// none, now it is what is on the canvas. A draft waiting to be restored
+// over it is put back instead.
+void UIManager::notesDraftStart(const String &name, int page) {
+  if (_notes.restoring) {
+    if (name == _notes.restore.name && page == _notes.restore.page) {
+      notesDraftApply();
+      return;
+    }
+    Serial.println("Notes: Draft dropped, its note is not the one shown");
+    _notes.restoring = false;
+  }
+  NoteDraft::Source source = {};
+  strncpy(source.name, name.c_str(), NoteDraft::NAME_LEN - 1);
+  source.page = page;
+  source.view = _notes.viewCol << 4 | _notes.viewRow;
+  _notes.tileUndo.clearChanged();
+  _notes.draft.reset(source);
+}
+
+void UIManager::notesDraftStart() {
+  if (_notes.notebook.isOpen())
+    notesDraftStart(NotePaths::nameOf(_notes.notebook.path().c_str()),
+                    _notes.notebookPage);
+  else
+    notesDraftStart(_notes.currentFile, -1);
+}
+
+// Open the note the draft was drawn over; notesShow() (or the blank page)
+// then lands in notesDraftStart(), which puts the tiles back
+void UIManager::notesDraftRecover() {
+  if (!_notes.draft.load(_notes.restore)) {
+    notesDraftStart("", -1); // Nothing held: the blank canvas
+    return;
+  }
+  String name = _notes.restore.name;
+  Serial.printf("Notes: Restoring %d drafted tiles over %s\n",
+                _notes.draft.heldTiles(),
+                name.length() ? name.c_str() : "a blank page");
+  _notes.restoring = true;
+  if (name.length() == 0) {
+    notesDraftApply();
+    return;
+  }
+
+  _notes.currentFile = name;
+  if (Notebook::isNotebook(name)) {
+    if (_notes.notebook.open(NotePaths::resolve(name.c_str()))) {
+      _notes.restore.page = constrain(_notes.restore.page, 0,
+                                      _notes.notebook.pageCount());
+      notesOpenPage(_notes.restore.page);
+      return;
+    }
+  } else {
+    notesScanFiles();
+    if (_notes.currentFile == name) {
+      notesLoadByIndex();
+      return;
+    }
+  }
+  // The note is gone: the tiles go over a blank page as a new note
+  Serial.println("Notes: Drafted note missing, restoring over a blank page");
+  _notes.currentFile = "";
+  notesDraftApply();
+}
+
+// The restored ink has no strokes behind it, so it becomes the base that
+// new strokes (and undo) work over
+void UIManager::notesDraftApply() {
+  _notes.restoring = false;
+  // Drawn on a view away from the top left of a large page
+  int view = _notes.restore.view;
+  int dx = view >> 4 < NOTES_PAN_STEPS ? view >> 4 : NOTES_PAN_STEPS;
+  int dy = (view & 0x0F) < NOTES_PAN_STEPS ? view & 0x0F : NOTES_PAN_STEPS;
+  if (view && _notes.restore.page < 0 && notesMoveView(dx, dy)) {
+    _needsRefresh = true;
+    _lastRefresh = 0;
+  }
+  int tiles = _notes.draft.restore(_notes.tileUndo);
+  if (tiles == 0)
+    return;
+  _notes.strokeLog.clear();
+  _notes.tileUndo.clear();
+  notesSetBase((const uint8_t *)_notes.canvas->getBuffer());
+  _notes.dirty = true;
+  notesShowStatus("Restored", false);
+  _needsRefresh = true;
+  _lastRefresh = 0;
+}
+
+// Write the tiles changed since the last autosave into the draft. Runs
+// every NoteDraft::AUTOSAVE_MS, on leaving Notes and before sleep.
+void UIManager::notesAutosave() {
+  // Not over a canvas being loaded, or one the draft is not yet back on
+  if (!_notes.canvas || _notes.ioBusy || _notes.restoring)
+    return;
+  _notes.draft.save(_notes.tileUndo);
+}
+
+void UIManager::notesLoad() {
+  // Scan for files if list is empty
+  if (_notes.files.empty()) {
+    notesScanFiles();
+  }
+
+  // Load the file at current index
+  if (!_notes.files.empty()) {
+    notesLoadByIndex();
+  } else {
+    Serial.println("Notes: No saved notes found");
+  }
+}
+
+#endif // APP_NOTES
@@ -3,238 +3,1073 @@
  * File browsing and navigation for timestamped note files
  */
 
+#include "../hardware/buzzer.h"
+#include "../utils/buffer_pool.h"
+#include "../utils/log.h"
+#include "../utils/mem_telemetry.h"
 #include "../utils/sd_manager.h"
+#include "../utils/storage_worker.h"
+#include "downscale.h"
+#include "note_codec.h"
+#include "note_paths.h"
+#include "raster4.h"
 #include "ui_manager.h"
 #include <FS.h>
 #include <SD.h>
+#include <esp_heap_caps.h>
+
+#if APP_NOTES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_LIGHT_GRAY 0xC618
+#define COLOR_WHITE 0xFFFF
 
 // ============================================================================
 // Notes - File Browsing Functions
 // ============================================================================
 
-// Scan /notes/ directory for available note files
+// List the note files, newest first, from the index (one read, or none
+// once it is in RAM)
 void UIManager::notesScanFiles() {
-  _noteFileList.clear();
-  _noteFileIndex = -1;
+  _notes.files.clear();
+  _notes.fileIndex = -1;
 
-  if (!SD.exists("/notes")) {
-    Serial.println("Notes: /notes directory does not exist");
+  if (!_notes.index.load()) {
+    Serial.println("Notes: Index unavailable");
     return;
   }
+  _notes.files.reserve(_notes.index.size());
+  for (size_t i = 0; i < _notes.index.size(); i++)
+    _notes.files.emplace_back(_notes.index[i].name);
 
-  File root = SD.open("/notes");
-  if (!root || !root.isDirectory()) {
-    Serial.println("Notes: Failed to open /notes directory");
-    return;
-  }
-
-  // Scan all .bin files
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      String name = String(file.name());
-      // Filter for .bin files
-      if (name.endsWith(".bin")) {
-        _noteFileList.push_back(name);
-        Serial.printf("Found note: %s\n", name.c_str());
-      }
-    }
-    file = root.openNextFile();
-  }
-  root.close();
-
-  // Sort files descending (newest first) - simple bubble sort
-  for (size_t i = 0; i < _noteFileList.size(); i++) {
-    for (size_t j = i + 1; j < _noteFileList.size(); j++) {
-      if (_noteFileList[i] < _noteFileList[j]) {
-        String temp = _noteFileList[i];
-        _noteFileList[i] = _noteFileList[j];
-        _noteFileList[j] = temp;
-      }
-    }
-  }
-
-  Serial.printf("Found %d note files\n", _noteFileList.size());
+  Serial.printf("Found %d note files\n", _notes.files.size());
+  _notes.list.setCount(_notes.files.size()); // Rows may have shifted
 
   // Set index to current file or most recent
-  if (_currentNoteFile.length() > 0) {
-    for (size_t i = 0; i < _noteFileList.size(); i++) {
-      if (_noteFileList[i] == _currentNoteFile ||
-          _noteFileList[i].endsWith(_currentNoteFile)) {
-        _noteFileIndex = i;
-        Serial.printf("Current note index: %d\n", _noteFileIndex);
+  if (_notes.currentFile.length() > 0) {
+    for (size_t i = 0; i < _notes.files.size(); i++) {
+      if (_notes.files[i].view().endsWith(_notes.currentFile.c_str())) {
+        _notes.fileIndex = i;
+        Serial.printf("Current note index: %d\n", _notes.fileIndex);
         break;
       }
     }
   }
 
   // Default to most recent if not found
-  if (_noteFileIndex == -1 && !_noteFileList.empty()) {
-    _noteFileIndex = 0;
-    _currentNoteFile = _noteFileList[0];
+  if (_notes.fileIndex == -1 && !_notes.files.empty()) {
+    _notes.fileIndex = 0;
+    _notes.currentFile = _notes.files[0].c_str();
   }
 }
 
 // Load note file at current index
 void UIManager::notesLoadByIndex() {
-  if (_noteFileIndex < 0 || _noteFileIndex >= (int)_noteFileList.size()) {
+  if (_notes.fileIndex < 0 || _notes.fileIndex >= (int)_notes.files.size()) {
     Serial.println("Notes: Invalid file index");
     return;
   }
 
-  if (!_notesCanvas) {
+  if (!_notes.canvas) {
     Serial.println("Notes: Canvas not initialized");
     return;
   }
 
-  String filename = _noteFileList[_noteFileIndex];
-  _currentNoteFile = filename;
+  String filename = _notes.files[_notes.fileIndex].c_str();
+  _notes.currentFile = filename;
 
   Serial.printf("\n=== NOTES LOAD START ===\n");
   Serial.printf("Loading note: %s (%d/%d)\n", filename.c_str(),
-                _noteFileIndex + 1, _noteFileList.size());
+                _notes.fileIndex + 1, _notes.files.size());
 
-  // Show loading status
-  M5.Display.setEpdMode(epd_mode_t::epd_fast);
-  M5.Display.fillRect(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 30, 200, 60,
-                      0x0000);     // COLOR_BLACK
-  M5.Display.setTextColor(0xFFFF); // COLOR_WHITE
-  M5.Display.setTextSize(2);
-  M5.Display.setCursor(SCREEN_WIDTH / 2 - 60, SCREEN_HEIGHT / 2 - 10);
-  M5.Display.print("Loading...");
-  M5.Display.display();
+  extern StorageWorker *storage;
+  if (!storage || _notes.ioBusy)
+    return;
 
-  // === POWER CYCLE SD CARD ===
-  Serial.println("Stopping display for SD operations...");
-  M5.Display.waitDisplay();
-  M5.Display.endWrite();
+  // A notebook opens on its first page, read on its own
+  if (Notebook::isNotebook(filename)) {
+    if (!_notes.notebook.open(NotePaths::resolve(filename.c_str()))) {
+      notesShowStatus("Invalid!", false);
+      return;
+    }
+    notesOpenPage(0);
+    return;
+  }
+  _notes.notebook.close();
 
-  // Use global SDManager if available
-  extern SDManager *sdManager;
-  bool sdOk = false;
-  if (sdManager) {
-    sdOk = sdManager->powerCycleAndReinit();
-  } else {
-    Serial.println("No SDManager, using direct power cycle...");
-    SD.end();
-    M5.Power.setExtOutput(false);
-    delay(500);
-    M5.Power.setExtOutput(true);
-    delay(500);
-    sdOk = SD.begin(47);
-  }
-
-  if (!sdOk) {
-    Serial.println("ERROR: SD power cycle failed!");
-    M5.Display.fillRect(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 30, 200, 60,
-                        0xFFFF);     // COLOR_WHITE
-    M5.Display.setTextColor(0x0000); // COLOR_BLACK
-    M5.Display.setCursor(SCREEN_WIDTH / 2 - 60, SCREEN_HEIGHT / 2 - 10);
-    M5.Display.print("SD Failed!");
-    M5.Display.display();
-    delay(2000);
-    _needsRefresh = true;
-    _lastRefresh = 0;
-    Serial.println("=== NOTES LOAD END (FAILED) ===\n");
+  // Already decoded: no card access at all
+  NoteCache::Entry *cached = _notes.cache.find(filename);
+  if (cached) {
+    Serial.println("Notes: From cache");
+    notesShow(*cached);
     return;
   }
 
-  // Update status
-  M5.Display.fillRect(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 30, 200, 60,
-                      0x0000);     // COLOR_BLACK
-  M5.Display.setTextColor(0xFFFF); // COLOR_WHITE
-  M5.Display.setCursor(SCREEN_WIDTH / 2 - 40, SCREEN_HEIGHT / 2 - 10);
-  M5.Display.print("Loading...");
-  M5.Display.display();
+  notesShowStatus("Loading...", true);
+  _notes.ioBusy = true; // Ink now would be overwritten by the loaded page
+  if (!notesFetch(filename, true)) {
+    _notes.ioBusy = false;
+    notesShowStatus("SD Busy!", false);
+  }
+}
+
+// Read and decode a note and its stroke log into the cache, in the
+// background. With show set it is then put on the canvas; either way the
+// neighbours are prefetched next.
+bool UIManager::notesFetch(const String &filename, bool show) {
+  extern StorageWorker *storage;
+  if (!storage || !_notes.canvas)
+    return false;
+
+  // Canvas depth is NOTES_DEPTH (getColorDepth may be corrupted after
+  // power cycle); 4-bit files are converted as they decode
+  uint16_t cw = _notes.canvas->width();
+  uint16_t ch = _notes.canvas->height();
+  size_t len = _notes.canvas->bufferLength();
 
-  Serial.printf("Opening file for read: /notes/%s\n", filename.c_str());
-  String fullPath = "/notes/" + filename;
-  File file = SD.open(fullPath, FILE_READ);
-  if (file) {
-    char header[7];
-    file.read((uint8_t *)header, 6);
-    header[6] = 0;
-
-    Serial.printf("File header: %s\n", header);
-
-    if (strcmp(header, "M5NOTE") == 0) {
-      uint16_t w, h;
-      uint8_t d;
-      file.read((uint8_t *)&w, 2);
-      file.read((uint8_t *)&h, 2);
-      file.read(&d, 1);
-
-      Serial.printf("File dimensions: %dx%d, depth=%d\n", w, h, d);
-      Serial.printf("Canvas dimensions: %dx%d, depth=%d\n",
-                    _notesCanvas->width(), _notesCanvas->height(),
-                    _notesCanvas->getColorDepth());
-
-      // Canvas depth: Expected 4-bit grayscale (getColorDepth may be corrupted
-      // after power cycle)
-      const uint8_t EXPECTED_DEPTH = 4;
-
-      if (w == _notesCanvas->width() && h == _notesCanvas->height() &&
-          d == EXPECTED_DEPTH) {
-        size_t len = (w * h * d) / 8;
-        if (d < 8 && (w * h * d) % 8 != 0)
-          len++;
-
-        Serial.printf("Reading %d bytes of pixel data...\n", len);
-        size_t bytesRead = file.read((uint8_t *)_notesCanvas->getBuffer(), len);
-        Serial.printf("Read complete: %d/%d bytes\n", bytesRead, len);
-        if (bytesRead == len) {
-          Serial.println("Loaded note successfully!");
+  // The worker reads the whole file (v1 raw or v2 tiles) into its own
+  // buffer; it is decoded into a PSRAM page once the header checks out
+  String fullPath = NotePaths::resolve(filename.c_str()).c_str();
+  return storage->read(
+      fullPath.c_str(), 0, StorageWorker::REST,
+      [this, cw, ch, len, filename, show](const StorageResult &result) {
+        uint8_t *pixels = nullptr;
+        uint16_t rasterCrc = 0;
+        uint16_t fw, fh;
+        uint8_t fd;
+        if (!result.ok) {
+          Serial.printf("ERROR: Failed to read %s (missing or I/O error)\n",
+                        result.path);
+        } else if (NoteCodec::peek(result.data, result.dataLen, fw, fh, fd) &&
+                   fw == NOTES_PAGE_W && fh == NOTES_PAGE_H) {
+          // A large page is kept as its file (it has no stroke log);
+          // notesShow() reads it into the sparse page
+          uint8_t *file =
+              (uint8_t *)heap_caps_malloc(result.dataLen, MALLOC_CAP_SPIRAM);
+          if (file)
+            memcpy(file, result.data, result.dataLen);
+          else
+            Serial.printf("ERROR: No PSRAM for %s\n", result.path);
+          notesFetched(filename,
+                       _notes.cache.insertPage(filename, file,
+                                               file ? result.dataLen : 0),
+                       show);
+          return;
         } else {
-          Serial.println("WARNING: Incomplete read");
+          pixels = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+          if (pixels && NoteCodec::decode(result.data, result.dataLen, pixels,
+                                          cw, ch, NOTES_DEPTH)) {
+            Serial.printf("Decoded %s (%d bytes)\n", result.path,
+                          result.dataLen);
+            if (memcmp(result.data, "M5NOT2", 6) == 0) {
+              NoteCodec::Header header;
+              memcpy(&header, result.data, sizeof(header));
+              rasterCrc = header.crc;
+            }
+          } else {
+            free(pixels);
+            pixels = nullptr;
+          }
         }
-      } else {
-        Serial.printf("ERROR: Dimension mismatch (expected: %dx%d depth=%d)\n",
-                      _notesCanvas->width(), _notesCanvas->height(),
-                      EXPECTED_DEPTH);
+        notesFetchStrokes(filename, pixels, rasterCrc, show);
+      });
+}
+
+void UIManager::notesFetchStrokes(const String &filename, uint8_t *pixels,
+                                  uint16_t rasterCrc, bool show) {
+  extern StorageWorker *storage;
+  String strokePath = NotePaths::resolve(filename.c_str()).c_str();
+  strokePath = strokePath.substring(0, strokePath.lastIndexOf('.')) + ".stk";
+  auto done = [this, filename, pixels, rasterCrc,
+               show](const StorageResult &result) {
+    std::vector<uint8_t> strokes;
+    if (result.ok)
+      strokes.assign(result.data, result.data + result.dataLen);
+    notesFetched(filename,
+                 _notes.cache.insert(filename, pixels, rasterCrc,
+                                     std::move(strokes)),
+                 show);
+  };
+
+  if (!storage || !storage->read(strokePath.c_str(), 0, StorageWorker::REST,
+                                 done)) {
+    StorageResult none = {StorageOp::READ, false, strokePath.c_str(), 0,
+                          nullptr, 0, nullptr, 0};
+    done(none);
+  }
+}
+
+void UIManager::notesFetched(const String &filename, NoteCache::Entry *entry,
+                             bool show) {
+  if (show) {
+    _notes.ioBusy = false;
+    // Only if the user has not paged on meanwhile
+    if (filename == _notes.currentFile)
+      notesShow(*entry);
+  } else {
+    _notes.prefetching = false;
+    notesPrefetch();
+  }
+}
+
+// Put a decoded note on the canvas with its stroke log. The raster is the
+// log's cache: kept when its CRC matches the log's, else redrawn from it.
+// A large page opens at its top left, the view the base of new strokes.
+void UIManager::notesShow(const NoteCache::Entry &entry) {
+  if (!_notes.canvas)
+    return;
+  uint8_t *canvas = (uint8_t *)_notes.canvas->getBuffer();
+  notesPageReset();
+  notesSetBase(nullptr);
+  _notes.tileUndo.clear();
+  _notes.dirty = false;
+
+  uint16_t savedCrc = 0;
+  if (entry.page) {
+    if (!_notes.page.decode(entry.page, entry.pageLen))
+      Serial.println("Notes: Page unreadable, showing it blank");
+    _notes.page.load(canvas, _notes.canvas->width(),
+                     _notes.canvas->height(), 0, 0);
+    _notes.large = true;
+    _notes.strokeLog.clear();
+    notesSetBase(canvas);
+    Serial.printf("Notes: Page of %d tiles\n", _notes.page.inkedTiles());
+  } else {
+    if (entry.pixels)
+      memcpy(canvas, entry.pixels, _notes.canvas->bufferLength());
+    else
+      Raster4::clear(*_notes.canvas);
+
+    if (!entry.strokes.empty() &&
+        _notes.strokeLog.load(entry.strokes.data(), entry.strokes.size(),
+                              savedCrc)) {
+      Serial.printf("Notes: %d strokes\n", _notes.strokeLog.strokeCount());
+      if (!entry.pixels || savedCrc != entry.rasterCrc) {
+        Serial.println("Notes: Raster stale, drawing from strokes");
+        notesRedraw();
       }
     } else {
-      Serial.println("ERROR: Invalid file header");
+      // Raster only (older note, or the log is lost): new strokes are
+      // recorded over it
+      _notes.strokeLog.clear();
+      if (entry.pixels)
+        notesSetBase(entry.pixels);
     }
-    file.close();
-  } else {
-    Serial.printf("ERROR: Failed to open %s\n", filename.c_str());
   }
 
+  notesDraftStart();
+
   // Restore UI
   M5.Display.setEpdMode(epd_mode_t::epd_fastest);
   _needsRefresh = true;
   _lastRefresh = 0;
   Serial.println("=== NOTES LOAD END ===\n");
+
+  notesPrefetch();
+}
+
+// Decode the notes (or notebook pages) either side of the open one while
+// the user looks at it, one at a time so the worker queue stays free for
+// saves
+void UIManager::notesPrefetch() {
+  const int offsets[] = {1, -1}; // NEXT (older) first
+  if (_notes.prefetching)
+    return;
+  if (_notes.notebook.isOpen()) {
+    for (int offset : offsets) {
+      int page = _notes.notebookPage + offset;
+      if (page < 0 || page >= _notes.notebook.pageCount() ||
+          _notes.cache.find(notesPageKey(page)))
+        continue;
+      _notes.prefetching = notesFetchPage(page, false);
+      return;
+    }
+    return;
+  }
+
+  int count = _notes.files.size();
+  if (count < 2 || _notes.fileIndex < 0)
+    return;
+  for (int offset : offsets) {
+    const char *name =
+        _notes.files[(_notes.fileIndex + offset + count) % count];
+    if (_notes.cache.find(name))
+      continue;
+    _notes.prefetching = notesFetch(name, false);
+    return;
+  }
+}
+
+// ============================================================================
+// Notes - Notebook Pages
+// ============================================================================
+
+String UIManager::notesPageKey(int page) const {
+  return _notes.notebook.path() + "#" + String(page);
+}
+
+// Put a notebook page on the canvas; the page after the last is a new,
+// blank one that exists once it is saved
+void UIManager::notesOpenPage(int page) {
+  _notes.notebookPage = page;
+  Serial.printf("Notes: Page %d of %s\n", page + 1,
+                _notes.notebook.path().c_str());
+
+  if (page >= _notes.notebook.pageCount()) {
+    notesClear();
+    _notes.dirty = false;
+    notesDraftStart();
+    M5.Display.setEpdMode(epd_mode_t::epd_fastest);
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    notesPrefetch();
+    return;
+  }
+
+  NoteCache::Entry *cached = _notes.cache.find(notesPageKey(page));
+  if (cached) {
+    Serial.println("Notes: From cache");
+    notesShow(*cached);
+    return;
+  }
+
+  notesShowStatus("Loading...", true);
+  _notes.ioBusy = true;
+  if (!notesFetchPage(page, true)) {
+    _notes.ioBusy = false;
+    notesShowStatus("SD Busy!", false);
+  }
+}
+
+// Read one page of the open notebook with a ranged read and decode it into
+// the cache. Pages carry no stroke log: a shown page is the raster base
+// for the session's undo.
+bool UIManager::notesFetchPage(int page, bool show) {
+  extern StorageWorker *storage;
+  if (!storage || !_notes.canvas || page < 0 ||
+      page >= _notes.notebook.pageCount())
+    return false;
+
+  uint16_t cw = _notes.canvas->width();
+  uint16_t ch = _notes.canvas->height();
+  size_t len = _notes.canvas->bufferLength();
+  Notebook::PageRef ref = _notes.notebook.page(page);
+  String key = notesPageKey(page);
+  return storage->readRange(
+      _notes.notebook.path().c_str(), ref.offset, ref.length,
+      [this, cw, ch, len, ref, key, show](const StorageResult &result) {
+        uint8_t *pixels = nullptr;
+        uint16_t rasterCrc = 0;
+        if (!result.ok || !Notebook::verify(ref, result.data, result.dataLen)) {
+          Serial.printf("ERROR: Page %s unreadable\n", key.c_str());
+        } else {
+          pixels = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+          if (pixels && NoteCodec::decode(result.data, result.dataLen, pixels,
+                                          cw, ch, NOTES_DEPTH)) {
+            NoteCodec::Header header;
+            memcpy(&header, result.data, sizeof(header));
+            rasterCrc = header.crc;
+          } else {
+            free(pixels);
+            pixels = nullptr;
+          }
+        }
+        NoteCache::Entry *entry =
+            _notes.cache.insert(key, pixels, rasterCrc, std::vector<uint8_t>());
+        if (show) {
+          _notes.ioBusy = false;
+          if (_notes.notebook.isOpen() &&
+              key == notesPageKey(_notes.notebookPage))
+            notesShow(*entry);
+        } else {
+          _notes.prefetching = false;
+          notesPrefetch();
+        }
+      });
+}
+
+// Encode the canvas and write it as the current page. The page is a few KB,
+// so it is written here rather than queued: the next page can then be
+// loaded straight away.
+bool UIManager::notesSavePage() {
+  if (!_notes.canvas || !_notes.notebook.isOpen() || _notes.ioBusy)
+    return false;
+
+  notesShowStatus("Saving...", true);
+  size_t len = 0;
+  uint8_t *page = NoteCodec::encode(
+      (const uint8_t *)_notes.canvas->getBuffer(), _notes.canvas->width(),
+      _notes.canvas->height(), NOTES_DEPTH, len);
+  bool ok = page && _notes.notebook.writePage(_notes.notebookPage, page, len);
+  free(page);
+  if (!ok) {
+    Serial.println("ERROR: Notebook page write failed");
+    notesShowStatus("SD Failed!", false);
+    return false;
+  }
+
+  // The cached copy, if any, is the page as it was loaded
+  _notes.cache.remove(notesPageKey(_notes.notebookPage));
+  _notes.dirty = false;
+  notesDraftStart();
+  Serial.printf("Notes: Saved page %d/%d\n", _notes.notebookPage + 1,
+                _notes.notebook.pageCount());
+  notesShowStatus("Saved!", false);
+  return true;
+}
+
+void UIManager::notesPageStep(int delta) {
+  if (_notes.ioBusy || _notes.drawing)
+    return;
+
+  if (!_notes.notebook.isOpen()) {
+    // Turning the page of a single note starts a notebook, with the
+    // canvas as its first page; pages are the size of the screen
+    if (delta < 0 || _notes.large) {
+      Buzzer::error();
+      return;
+    }
+    char path[50];
+    notesTimestampPath(path, sizeof(path), "book", "nbk");
+    if (!_notes.notebook.create(path)) {
+      notesShowStatus("SD Failed!", false);
+      return;
+    }
+    _notes.notebookPage = 0;
+    if (!notesSavePage()) {
+      _notes.notebook.close();
+      return;
+    }
+    String name = NotePaths::nameOf(path);
+    const Notebook::PageRef &first = _notes.notebook.page(0);
+    _notes.index.insert(
+        name.c_str(), first.offset + first.length + sizeof(Notebook::PageRef),
+        0);
+    _notes.currentFile = name;
+    notesScanFiles();
+  }
+
+  // One blank page past the last at most
+  int target = _notes.notebookPage + delta;
+  if (target < 0 || target > _notes.notebook.pageCount() ||
+      target >= Notebook::MAX_PAGES) {
+    Buzzer::error();
+    return;
+  }
+  if (_notes.dirty && !notesSavePage())
+    return;
+  Buzzer::click();
+  notesOpenPage(target);
+}
+
+// Write a note (or each page of a notebook) to /export as an image, on
+// the storage worker so the browser stays responsive
+void UIManager::notesExport(int index, NoteExport::Format format) {
+  extern StorageWorker *storage;
+  if (index < 0 || index >= (int)_notes.files.size() || !storage)
+    return;
+
+  NoteIndex::Name name = _notes.files[index];
+  bool queued = storage->run(
+      name.c_str(),
+      [name, format](size_t &bytes) {
+        return NoteExport::exportNote(name.c_str(), format, bytes);
+      },
+      [this, name](const StorageResult &result) {
+        if (result.ok) {
+          _notes.browseStatus =
+              "Exported " + String((result.bytes + 1023) / 1024) + " KB";
+        } else {
+          Buzzer::error();
+          _notes.browseStatus = "Export failed";
+        }
+        Serial.printf("Notes: Export of %s %s\n", name.c_str(),
+                      result.ok ? "done" : "failed");
+        if (_currentScreen == ScreenID::NOTES_BROWSE) {
+          _needsRefresh = true;
+          _lastRefresh = 0;
+        }
+      });
+  _notes.browseStatus = queued ? "Exporting..." : "SD Busy!";
+  _needsRefresh = true;
+  _lastRefresh = 0;
 }
 
 // Navigate to previous (newer) note
 void UIManager::notesPrevFile() {
-  if (_noteFileList.empty()) {
+  if (_notes.files.empty()) {
     Serial.println("Notes: No files available");
     return;
   }
 
-  _noteFileIndex--;
-  if (_noteFileIndex < 0) {
-    _noteFileIndex = _noteFileList.size() - 1; // Wrap to last
+  _notes.fileIndex--;
+  if (_notes.fileIndex < 0) {
+    _notes.fileIndex = _notes.files.size() - 1; // Wrap to last
   }
 
-  Serial.printf("Navigating to previous note: %d\n", _noteFileIndex);
+  Serial.printf("Navigating to previous note: %d\n", _notes.fileIndex);
   notesLoadByIndex();
 }
 
 // Navigate to next (older) note
 void UIManager::notesNextFile() {
-  if (_noteFileList.empty()) {
+  if (_notes.files.empty()) {
     Serial.println("Notes: No files available");
     return;
   }
 
-  _noteFileIndex++;
-  if (_noteFileIndex >= (int)_noteFileList.size()) {
-    _noteFileIndex = 0; // Wrap to first
+  _notes.fileIndex++;
+  if (_notes.fileIndex >= (int)_notes.files.size()) {
+    _notes.fileIndex = 0; // Wrap to first
   }
 
-  Serial.printf("Navigating to next note: %d\n", _noteFileIndex);
+  Serial.printf("Navigating to next note: %d\n", _notes.fileIndex);
   notesLoadByIndex();
 }
+
+// ============================================================================
+// Notes File Browser Screen
+// ============================================================================
+
+// File list on the left, preview on the right, actions along the bottom.
+// Five rows fit between the header and the action buttons.
+static const int BROWSE_PANEL_W = 400;
+static const int BROWSE_CONTENT_Y = 70;
+static const int BROWSE_LIST_Y = BROWSE_CONTENT_Y + 30;
+static const int BROWSE_ROW_H = 60;
+static const int BROWSE_ROW_GAP = 5;
+static const int BROWSE_ROWS = 5;
+static const int BROWSE_ARROW_W = 80; // Scroll arrow touch targets
+static const int BROWSE_ARROW_H = 28;
+
+void UIManager::notesBrowseListSetup() {
+  _notes.list.layout(5, BROWSE_LIST_Y, BROWSE_PANEL_W - 10, BROWSE_ROW_H,
+                     BROWSE_ROW_GAP, BROWSE_ROWS);
+  _notes.list.setSource(
+      _notes.files.size(),
+      [this](LovyanGFX &g, int index, int ox, int oy, int w, int h,
+             bool selected) {
+        paintNoteRow(g, index, ox, oy, w, h, selected);
+      });
+}
+
+void UIManager::paintNoteRow(LovyanGFX &g, int index, int ox, int oy, int w,
+                             int h, bool selected) {
+  StrView filename = _notes.files[index].view();
+
+  // Highlight selected file
+  if (selected)
+    g.fillRect(ox, oy, w, h, COLOR_LIGHT_GRAY);
+  g.drawRect(ox, oy, w, h, COLOR_BLACK);
+
+  // Parse time from filename (note_YYYYMMDD_HHMMSS.bin)
+  char timeStr[6] = "??:??";
+  if (filename.startsWith("note_") && filename.size() >= 24)
+    snprintf(timeStr, sizeof(timeStr), "%c%c:%c%c", filename[14],
+             filename[15], filename[16], filename[17]);
+
+  g.setTextSize(2);
+  g.setTextColor(COLOR_BLACK);
+  g.setCursor(ox + 10, oy + 10);
+  g.printf("Note #%d", index + 1);
+  g.setTextSize(1);
+  g.setCursor(ox + 10, oy + 35);
+  g.print(timeStr);
+}
+
+// Up beside the "Files" heading, down under the last row
+void UIManager::drawNotesScrollArrows() {
+  int cx = BROWSE_PANEL_W / 2;
+  int upX = BROWSE_PANEL_W - BROWSE_ARROW_W;
+  int downY = _notes.list.bottom() + 3;
+  M5.Display.fillRect(upX, BROWSE_CONTENT_Y, BROWSE_ARROW_W - 2,
+                      BROWSE_ARROW_H, COLOR_WHITE);
+  M5.Display.fillRect(cx - BROWSE_ARROW_W / 2, downY, BROWSE_ARROW_W,
+                      BROWSE_ARROW_H, COLOR_WHITE);
+  if (_notes.list.canScrollUp()) {
+    int ux = upX + BROWSE_ARROW_W / 2;
+    M5.Display.fillTriangle(ux - 10, BROWSE_CONTENT_Y + 20, ux + 10,
+                            BROWSE_CONTENT_Y + 20, ux, BROWSE_CONTENT_Y + 5,
+                            COLOR_BLACK);
+  }
+  if (_notes.list.canScrollDown()) {
+    M5.Display.fillTriangle(cx - 10, downY + 5, cx + 10, downY + 5, cx,
+                            downY + 20, COLOR_BLACK);
+  }
+}
+
+// Scroll in place: only rows coming into view are painted, and only the
+// list's viewport is refreshed
+void UIManager::scrollNotesList(int delta) {
+  if (!_notes.list.scrollBy(delta))
+    return;
+  _refresh.apply(RegionKind::TEXT);
+  M5.Display.startWrite();
+  int painted = _notes.list.draw(M5.Display);
+  drawNotesScrollArrows();
+  M5.Display.endWrite();
+  M5.Display.display();
+  _lastRefresh = millis();
+  LOG_D("Notes", "List at %d, %d row(s) painted", _notes.list.first(),
+        painted);
+}
+
+void UIManager::notesBrowseSwipe(const Gesture &g) {
+  // A page at a time, keeping one row for context
+  if (g.startX >= BROWSE_PANEL_W)
+    return;
+  int page = _notes.list.rows() > 1 ? _notes.list.rows() - 1 : 1;
+  if (g.dir == GestureDir::UP)
+    scrollNotesList(page);
+  else if (g.dir == GestureDir::DOWN)
+    scrollNotesList(-page);
+}
+
+void UIManager::drawNotesBrowseScreen() {
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  // === HEADER ===
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(20, 15);
+  M5.Display.print("Notes File Browser");
+
+  // To-do list and close buttons
+  drawButton(SCREEN_WIDTH - 210, 10, 120, 40, "TO-DO");
+  drawButton(SCREEN_WIDTH - 80, 10, 70, 40, "X");
+
+  // Divider under header
+  M5.Display.drawLine(0, 60, SCREEN_WIDTH, 60, COLOR_BLACK);
+
+  // === LAYOUT CONSTANTS ===
+  const int LEFT_PANEL_W = BROWSE_PANEL_W;
+  const int RIGHT_PANEL_X = LEFT_PANEL_W;
+  const int CONTENT_Y = BROWSE_CONTENT_Y;
+
+  // Vertical divider between panels
+  M5.Display.drawLine(LEFT_PANEL_W, 60, LEFT_PANEL_W, SCREEN_HEIGHT - 80,
+                      COLOR_BLACK);
+
+  // === LEFT PANEL: FILE LIST ===
+  M5.Display.setTextSize(2);
+  M5.Display.setCursor(10, CONTENT_Y);
+  M5.Display.printf("Files (%d)", _notes.files.size());
+
+  // Rows still in their sprites are only pushed again
+  _notes.list.setSelected(_notes.selected);
+  _notes.list.draw(M5.Display);
+  drawNotesScrollArrows();
+
+  // === RIGHT PANEL: PREVIEW & METADATA ===
+  if (_notes.selected >= 0 &&
+      _notes.selected < (int)_notes.files.size()) {
+    StrView selectedFile = _notes.files[_notes.selected].view();
+
+    // Preview thumbnail area
+    int thumbX = RIGHT_PANEL_X + 80;
+    int thumbY = CONTENT_Y + 20;
+    int thumbW = 400;
+    int thumbH = 250;
+
+    M5.Display.drawRect(thumbX, thumbY, thumbW, thumbH, COLOR_BLACK);
+
+    // Show preview canvas if loaded, otherwise placeholder
+    if (_notes.preview != nullptr && _notes.previewIndex == _notes.selected) {
+      _notes.preview->pushSprite(thumbX + 1, thumbY + 1);
+    } else {
+      M5.Display.fillRect(thumbX + 1, thumbY + 1, thumbW - 2, thumbH - 2,
+                          COLOR_LIGHT_GRAY);
+      M5.Display.setTextSize(2);
+      M5.Display.setTextColor(COLOR_BLACK);
+      M5.Display.setCursor(thumbX + 100, thumbY + 110);
+      M5.Display.print("Tap file to preview");
+    }
+
+    // Metadata section
+    int metaY = thumbY + thumbH + 20;
+
+    // Parse filename for metadata
+    if (selectedFile.startsWith("note_") && selectedFile.size() >= 24) {
+      StrView dateStr = selectedFile.substr(5, 8);  // YYYYMMDD
+      StrView timeStr = selectedFile.substr(14, 6); // HHMMSS
+
+      M5.Display.setTextSize(2);
+      M5.Display.setCursor(RIGHT_PANEL_X + 20, metaY);
+      M5.Display.print("Created:");
+
+      M5.Display.setTextSize(2); // Increased from 1 to 2
+      M5.Display.setCursor(RIGHT_PANEL_X + 20, metaY + 30);
+      M5.Display.printf("%c%c%c%c-%c%c-%c%c  %c%c:%c%c", dateStr[0], dateStr[1],
+                        dateStr[2], dateStr[3], dateStr[4], dateStr[5],
+                        dateStr[6], dateStr[7], timeStr[0], timeStr[1],
+                        timeStr[2], timeStr[3]);
+    }
+  }
+
+  if (_notes.browseStatus.length()) {
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(COLOR_BLACK);
+    M5.Display.setCursor(RIGHT_PANEL_X + 20, SCREEN_HEIGHT - 110);
+    M5.Display.print(_notes.browseStatus);
+  }
+
+  // === BOTTOM: ACTION BUTTONS ===
+  int btnY = SCREEN_HEIGHT - 70;
+  int btnW = (SCREEN_WIDTH - 50) / 4;
+  int btnH = 60;
+
+  M5.Display.drawLine(0, btnY - 10, SCREEN_WIDTH, btnY - 10, COLOR_BLACK);
+
+  drawButton(10, btnY, btnW, btnH, "LOAD", true);
+  drawButton(20 + btnW, btnY, btnW, btnH, "PNG");
+  drawButton(30 + 2 * btnW, btnY, btnW, btnH, "PBM");
+  drawButton(40 + 3 * btnW, btnY, btnW, btnH, "DELETE");
+
+  // Delete confirmation popup
+  if (_notes.deleteConfirm >= 0) {
+    M5.Display.fillRect(200, 200, 560, 200, COLOR_WHITE);
+    M5.Display.drawRect(200, 200, 560, 200, COLOR_BLACK);
+    M5.Display.setTextSize(3);
+    M5.Display.setCursor(250, 230);
+    M5.Display.print("Delete this note?");
+    drawButton(260, 290, 200, 60, "YES");
+    drawButton(500, 290, 200, 60, "NO");
+  }
+}
+
+void UIManager::handleNotesBrowseTouch(int x, int y) {
+  auto isHit = [&](int bx, int by, int bw, int bh) {
+    if (x >= bx && x < bx + bw && y >= by && y < by + bh) {
+      Buzzer::click();
+      return true;
+    }
+    return false;
+  };
+
+  // Handle delete confirmation popup
+  if (_notes.deleteConfirm >= 0) {
+    if (isHit(260, 290, 200, 60)) {
+      // YES - delete file
+      notesDeleteFile(_notes.deleteConfirm);
+      _notes.deleteConfirm = -1;
+      _needsRefresh = true;
+      _lastRefresh = 0;
+    } else if (isHit(500, 290, 200, 60)) {
+      // NO - cancel
+      _notes.deleteConfirm = -1;
+      _needsRefresh = true;
+      _lastRefresh = 0;
+    }
+    return;
+  }
+
+  // Close button
+  if (isHit(SCREEN_WIDTH - 80, 10, 70, 40)) {
+    navigateTo(ScreenID::NOTES);
+    return;
+  }
+  if (isHit(SCREEN_WIDTH - 210, 10, 120, 40)) {
+    navigateTo(ScreenID::TODO);
+    return;
+  }
+
+  // === LEFT PANEL: FILE LIST SELECTION ===
+  int fileIdx = _notes.list.indexAt(x, y);
+  if (fileIdx >= 0) {
+    Buzzer::click();
+    _notes.selected = fileIdx;
+    // Load preview for selected file
+    loadNotePreview(fileIdx);
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    return;
+  }
+
+  // Scroll arrows: a row at a time
+  if (_notes.list.canScrollUp() &&
+      isHit(BROWSE_PANEL_W - BROWSE_ARROW_W, BROWSE_CONTENT_Y, BROWSE_ARROW_W,
+            BROWSE_ARROW_H)) {
+    scrollNotesList(-1);
+    return;
+  }
+  if (_notes.list.canScrollDown() &&
+      isHit(BROWSE_PANEL_W / 2 - BROWSE_ARROW_W / 2, _notes.list.bottom() + 3,
+            BROWSE_ARROW_W, BROWSE_ARROW_H)) {
+    scrollNotesList(1);
+    return;
+  }
+
+  // === BOTTOM: ACTION BUTTONS ===
+  int btnY = SCREEN_HEIGHT - 70;
+  int btnW = (SCREEN_WIDTH - 50) / 4;
+  int btnH = 60;
+
+  // LOAD button
+  if (isHit(10, btnY, btnW, btnH)) {
+    _notes.fileIndex = _notes.selected;
+    notesLoadByIndex();
+    navigateTo(ScreenID::NOTES);
+    return;
+  }
+
+  // Export buttons
+  if (isHit(20 + btnW, btnY, btnW, btnH)) {
+    notesExport(_notes.selected, NoteExport::Format::PNG);
+    return;
+  }
+  if (isHit(30 + 2 * btnW, btnY, btnW, btnH)) {
+    notesExport(_notes.selected, NoteExport::Format::PBM);
+    return;
+  }
+
+  // DELETE button
+  if (isHit(40 + 3 * btnW, btnY, btnW, btnH)) {
+    Serial.printf("DELETE button pressed for file index %d\n",
+                  _notes.selected);
+    _notes.deleteConfirm = _notes.selected;
+    // Force immediate redraw to show confirmation popup
+    M5.Display.setEpdMode(epd_mode_t::epd_fast);
+    drawNotesBrowseScreen();
+    M5.Display.display();
+    Serial.println("Delete confirmation shown");
+    return;
+  }
+}
+
+void UIManager::notesDeleteFile(int index) {
+  if (index < 0 || index >= (int)_notes.files.size()) {
+    Serial.println("Invalid file index for deletion");
+    return;
+  }
+
+  String filename = _notes.files[index].c_str();
+  String fullPath = NotePaths::resolve(filename.c_str()).c_str();
+
+  Serial.printf("Deleting file: %s\n", fullPath.c_str());
+
+  extern SDManager *sdManager;
+  SDAccess sd(sdManager);
+  if (!sd) {
+    Serial.println("DELETE: SD unavailable");
+    return;
+  }
+
+  // A file that is already gone only needs its index entry dropped
+  if (sdFS().remove(fullPath) || !sdFS().exists(fullPath)) {
+    Serial.println("File deleted successfully");
+    String strokePath =
+        fullPath.substring(0, fullPath.lastIndexOf('.')) + ".stk";
+    if (sdFS().exists(strokePath))
+      sdFS().remove(strokePath);
+
+    // Refresh file list
+    _notes.index.remove(filename.c_str());
+    _notes.cache.remove(filename);
+    if (Notebook::isNotebook(filename)) {
+      // Its pages are cached under the path
+      if (_notes.notebook.path() == fullPath)
+        _notes.notebook.close();
+      _notes.cache.clear();
+    }
+    notesScanFiles();
+
+    // Adjust current index if needed
+    if (_notes.fileIndex >= (int)_notes.files.size() && _notes.fileIndex > 0) {
+      _notes.fileIndex--;
+    }
+  } else {
+    Serial.println("Failed to delete file");
+    sd.fail();
+  }
+}
+
+// ============================================================================
+// Load Note Preview Thumbnail
+// ============================================================================
+
+// Pixel-double a 200x125 4-bit thumbnail into the 400x250 preview buffer
+// (left pixel in the high nibble)
+static void drawThumbnail2x(const uint8_t *thumb, uint8_t *preview) {
+  const int inRow = NoteCodec::THUMB_W / 2;
+  const int outRow = NoteCodec::THUMB_W;
+  for (int y = 0; y < NoteCodec::THUMB_H; y++) {
+    const uint8_t *in = thumb + y * inRow;
+    uint8_t *out = preview + 2 * y * outRow;
+    for (int x = 0; x < inRow; x++) {
+      uint8_t hi = in[x] >> 4, lo = in[x] & 0x0F;
+      out[2 * x] = hi << 4 | hi;
+      out[2 * x + 1] = lo << 4 | lo;
+    }
+    memcpy(out + outRow, out, outRow);
+  }
+}
+
+void UIManager::exitNotesBrowse() {
+  _notes.list.release();
+
+  // The 400x250 thumbnail is only worth its PSRAM while the list is up
+  if (_notes.preview) {
+    void *pixels = _notes.preview->getBuffer();
+    _notes.preview->deleteSprite();
+    delete _notes.preview;
+    _notes.preview = nullptr;
+    BufferPool::release(pixels);
+  }
+  _notes.previewIndex = -1;
+}
+
+void UIManager::loadNotePreview(int index) {
+  if (index < 0 || index >= (int)_notes.files.size()) {
+    Serial.println("Invalid preview index");
+    return;
+  }
+
+  // Skip if already loaded
+  if (index == _notes.previewIndex && _notes.preview != nullptr) {
+    return;
+  }
+
+  Serial.printf("Loading preview for file %d\n", index);
+
+  // Create preview canvas if needed (400x250 scaled preview, pooled)
+  if (_notes.preview == nullptr) {
+    void *pixels = BufferPool::acquire(400 * 250 / 2,
+                                        MemTelemetry::Tag::NOTES);
+    if (!pixels) {
+      Serial.println("Failed to create preview canvas");
+      return;
+    }
+    _notes.preview = new M5Canvas(&M5.Display);
+    _notes.preview->setBuffer(pixels, 400, 250, 4);
+  }
+
+  extern SDManager *sdManager;
+  SDAccess sd(sdManager);
+  if (!sd) {
+    Serial.println("Preview: SD unavailable");
+    return;
+  }
+
+  String filename = _notes.files[index].c_str();
+  String fullPath = NotePaths::resolve(filename.c_str()).c_str();
+
+  // A notebook is previewed by the thumbnail of its first page
+  uint32_t start = 0;
+  bool notebook = Notebook::isNotebook(filename);
+  if (notebook) {
+    Notebook book;
+    if (book.open(fullPath.c_str()) && book.pageCount() > 0)
+      start = book.page(0).offset;
+  }
+
+  File file = sdFS().open(fullPath, FILE_READ);
+  if (file && notebook && (!start || !file.seek(start))) {
+    file.close();
+    _notes.preview->fillSprite(COLOR_WHITE);
+    _notes.preview->setTextSize(2);
+    _notes.preview->setCursor(140, 100);
+    _notes.preview->print("Notebook");
+    _notes.previewIndex = index;
+    return;
+  }
+  if (!file) {
+    Serial.println("Cannot open file for preview");
+    _notes.preview->fillSprite(COLOR_WHITE);
+    _notes.preview->setTextSize(2);
+    _notes.preview->setCursor(100, 100);
+    _notes.preview->print("Cannot load");
+    _notes.previewIndex = index;
+    return;
+  }
+
+  // v2 notes carry a thumbnail after the header: one small read, drawn at
+  // twice its size
+  NoteCodec::Header header;
+  if (file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+      memcmp(header.magic, "M5NOT2", 6) == 0 &&
+      NoteCodec::thumbnailLen(header)) {
+    BufferPool::Buffer thumb(NoteCodec::THUMB_LEN, MemTelemetry::Tag::NOTES);
+    bool read = thumb && file.read(thumb.get(), NoteCodec::THUMB_LEN) ==
+                             NoteCodec::THUMB_LEN;
+    file.close();
+    if (read) {
+      drawThumbnail2x(thumb.get(), (uint8_t *)_notes.preview->getBuffer());
+      _notes.previewIndex = index;
+      Serial.println("Preview loaded from thumbnail");
+      return;
+    }
+    file = sdFS().open(fullPath, FILE_READ);
+    if (!file) {
+      _notes.previewIndex = index;
+      return;
+    }
+  }
+  if (notebook) {
+    // Pages are always written with a thumbnail
+    file.close();
+    _notes.preview->fillSprite(COLOR_WHITE);
+    _notes.preview->setTextSize(2);
+    _notes.preview->setCursor(140, 100);
+    _notes.preview->print("Notebook");
+    _notes.previewIndex = index;
+    return;
+  }
+  file.seek(0);
+
+  // Read the whole file (a v2 note is a few KB) and check its header
+  size_t fileLen = file.size();
+  BufferPool::Buffer data(fileLen, MemTelemetry::Tag::NOTES);
+  bool read = data && file.read(data.get(), fileLen) == fileLen;
+  file.close();
+
+  uint16_t origW, origH;
+  uint8_t origDepth;
+  if (!read ||
+      !NoteCodec::peek(data.get(), fileLen, origW, origH, origDepth)) {
+    Serial.println("Invalid note format");
+    _notes.preview->fillSprite(COLOR_WHITE);
+    _notes.preview->setTextSize(2);
+    _notes.preview->setCursor(80, 100);
+    _notes.preview->print("Invalid format");
+    _notes.previewIndex = index;
+    return;
+  }
+
+  Serial.printf("Preview: Original %dx%d depth=%d\n", origW, origH, origDepth);
+
+  // Decode the full page at its own depth into a pooled block (the same
+  // one every preview)
+  BufferPool::Buffer page(((size_t)origW * origDepth + 7) / 8 * origH,
+                          MemTelemetry::Tag::NOTES);
+  if (!page) {
+    Serial.println("Cannot create temp canvas for preview");
+    _notes.previewIndex = index;
+    return;
+  }
+
+  bool decoded =
+      NoteCodec::decode(data.get(), fileLen, page.get(), origW, origH,
+                        origDepth);
+  if (!decoded) {
+    _notes.preview->fillSprite(COLOR_WHITE);
+    _notes.preview->setTextSize(2);
+    _notes.preview->setCursor(80, 100);
+    _notes.preview->print("Invalid format");
+    _notes.previewIndex = index;
+    return;
+  }
+
+  // Area-average down to preview size, straight on the packed buffers
+  uint8_t *preview = (uint8_t *)_notes.preview->getBuffer();
+  bool scaled = origDepth == 1 ? Downscale::box1(page.get(), origW, origH,
+                                                 preview, 400, 250)
+                               : Downscale::box4(page.get(), origW, origH,
+                                                 preview, 400, 250);
+  if (!scaled)
+    _notes.preview->fillSprite(COLOR_WHITE);
+
+  _notes.previewIndex = index;
+  Serial.println("Preview loaded successfully");
+}
+
+#endif // APP_NOTES
@@ -0,0 +1,201 @@
+/**
+ * UI Manager - Photos
+ * A picture frame: photos from /photos above a line of power and time
+ */
+
+#include "../hardware/battery.h"
+#include "../hardware/buzzer.h"
+#include "../utils/mem_telemetry.h"
+#include "../utils/sd_manager.h"
+#include "photo_cache.h"
+#include "ui_manager.h"
+#include <algorithm>
+#include <time.h>
+
+#if APP_PHOTOS
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+extern SDManager *sdManager;
+
+// The photo fills the screen above the status line
+static const int PHOTO_STATUS_H = 44;
+static const int PHOTO_AREA_H = 540 - PHOTO_STATUS_H; // Of SCREEN_HEIGHT
+static const unsigned long PHOTO_SLIDE_MS = 10 * 60 * 1000UL;
+
+// ============================================================================
+// Screen hooks
+// ============================================================================
+
+void UIManager::enterPhotos() {
+  _photos.files.clear();
+  _photos.shown = -1;
+  if (!sdManager)
+    return;
+  std::vector<String> files;
+  {
+    SDAccess sd(sdManager);
+    if (!sd)
+      return;
+    sdManager->listFiles(PhotoCache::DIR, files, PhotoCache::EXTENSIONS);
+  }
+  for (String &name : files) {
+    if (name.startsWith(".") || name.length() >= PhotoCache::MAX_NAME)
+      continue;
+    _photos.files.push_back(name);
+  }
+  std::sort(_photos.files.begin(), _photos.files.end(),
+            [](const String &a, const String &b) {
+              return strcasecmp(a.c_str(), b.c_str()) < 0;
+            });
+  if (_photos.index >= (int)_photos.files.size())
+    _photos.index = 0;
+}
+
+void UIManager::exitPhotos() {
+  // 248 KB of PSRAM, only while the frame is up
+  if (_photos.canvas) {
+    MemTelemetry::track(MemTelemetry::Tag::UI,
+                        -(long)_photos.canvas->bufferLength());
+    delete _photos.canvas;
+    _photos.canvas = nullptr;
+  }
+  _photos.shown = -1;
+  _photos.files.clear();
+}
+
+void UIManager::updatePhotos() {
+  if (_needsRefresh)
+    return;
+  if (_photos.files.size() > 1 && millis() - _photos.since >= PHOTO_SLIDE_MS) {
+    photoStep(1);
+    return;
+  }
+
+  // The clock and power line, once a minute
+  time_t now = time(nullptr);
+  if (now / 60 != _photos.statusMinute) {
+    _refresh.apply(RegionKind::TEXT);
+    M5.Display.startWrite();
+    drawPhotoStatus();
+    M5.Display.endWrite();
+    M5.Display.display();
+  }
+}
+
+void UIManager::photoStep(int delta) {
+  int count = _photos.files.size();
+  if (count == 0)
+    return;
+  _photos.index = ((_photos.index + delta) % count + count) % count;
+  _photos.since = millis();
+  // 16 greys need the quality waveform, from a clean panel
+  _refresh.forceClean();
+  _needsRefresh = true;
+  _lastRefresh = 0;
+}
+
+// ============================================================================
+// Drawing
+// ============================================================================
+
+void UIManager::drawPhotoStatus() {
+  int y = SCREEN_HEIGHT - PHOTO_STATUS_H;
+  M5.Display.fillRect(0, y, SCREEN_WIDTH, PHOTO_STATUS_H, COLOR_WHITE);
+  M5.Display.drawFastHLine(0, y, SCREEN_WIDTH, COLOR_BLACK);
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+
+  time_t now = time(nullptr);
+  struct tm t;
+  localtime_r(&now, &t);
+  _photos.statusMinute = now / 60;
+  M5.Display.setCursor(15, y + 14);
+  M5.Display.printf("%02d:%02d", t.tm_hour, t.tm_min);
+
+  M5.Display.setCursor(110, y + 14);
+  if (_powerData.connected)
+    M5.Display.printf("Bank %ld%%  in %ldW  out %ldW",
+                      (long)Fixed::percent(_powerData.socPermille),
+                      (long)Fixed::watts(_powerData.inputDeciwatts),
+                      (long)Fixed::watts(_powerData.outputDeciwatts));
+  else
+    M5.Display.print("Power bank not connected");
+
+  M5.Display.setCursor(500, y + 14);
+  M5.Display.printf("Panel %d%%", Battery::getPercentage());
+  if (!_photos.files.empty()) {
+    M5.Display.setTextColor(COLOR_GRAY);
+    M5.Display.setCursor(640, y + 14);
+    M5.Display.printf("%d/%d", _photos.index + 1, (int)_photos.files.size());
+  }
+  drawButton(SCREEN_WIDTH - 110, y + 4, 100, PHOTO_STATUS_H - 8, "HOME");
+}
+
+void UIManager::drawPhotoScreen() {
+  M5.Display.setEpdMode(epd_mode_t::epd_quality);
+  M5.Display.fillScreen(COLOR_WHITE);
+  _hits.add(SCREEN_WIDTH - 110, SCREEN_HEIGHT - PHOTO_STATUS_H, 110,
+            PHOTO_STATUS_H, [this](int, int) {
+              Buzzer::click();
+              navigateTo(ScreenID::HOME);
+            });
+
+  const char *problem = nullptr;
+  if (_photos.files.empty()) {
+    problem = "Copy .jpg or .png photos to /photos on the card";
+  } else {
+    if (!_photos.canvas) {
+      _photos.canvas = new M5Canvas(&M5.Display);
+      _photos.canvas->setColorDepth(4);
+      _photos.canvas->setPsram(true);
+      if (_photos.canvas->createSprite(SCREEN_WIDTH, PHOTO_AREA_H)) {
+        MemTelemetry::track(MemTelemetry::Tag::UI,
+                            _photos.canvas->bufferLength());
+      } else {
+        delete _photos.canvas;
+        _photos.canvas = nullptr;
+      }
+    }
+    // Status redraws reuse the rendition already in the canvas
+    if (!_photos.canvas) {
+      problem = "No memory for the photo";
+    } else if (_photos.shown != _photos.index) {
+      const char *name = _photos.files[_photos.index].c_str();
+      _photos.shown = PhotoCache::render(name, *_photos.canvas) ==
+                            PhotoCache::Source::FAILED
+                        ? -1
+                        : _photos.index;
+      if (_photos.shown < 0)
+        problem = "This photo could not be read";
+    }
+  }
+
+  if (problem) {
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(COLOR_BLACK);
+    M5.Display.setCursor(40, PHOTO_AREA_H / 2 - 8);
+    M5.Display.print(problem);
+  } else {
+    _photos.canvas->pushSprite(&M5.Display, 0, 0);
+  }
+  drawPhotoStatus();
+
+  // Left half back, right half on
+  if (_photos.files.size() > 1) {
+    _hits.add(0, 0, SCREEN_WIDTH / 2, PHOTO_AREA_H, [this](int, int) {
+      Buzzer::click();
+      photoStep(-1);
+    });
+    _hits.add(SCREEN_WIDTH / 2, 0, SCREEN_WIDTH / 2, PHOTO_AREA_H,
+              [this](int, int) {
+                Buzzer::click();
+                photoStep(1);
+              });
+  }
+  _photos.since = millis();
+}
+
+#endif // APP_PHOTOS
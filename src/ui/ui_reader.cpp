@@ -0,0 +1,468 @@
+/**
+ * UI Manager - Reader
+ * The library of /books and the pages of the open book
+ */
+
+#include "../hardware/battery.h"
+#include "../hardware/buzzer.h"
+#include "../utils/log.h"
+#include "../utils/record_file.h"
+#include "../utils/sd_manager.h"
+#include "ui_manager.h"
+#include <algorithm>
+
+#if APP_READER
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+extern SDManager *sdManager;
+
+// Text area (Reader::TEXT_WIDTH x TEXT_HEIGHT) above a footer of controls
+static const int READER_TEXT_X = 40;
+static const int READER_TEXT_Y = 30;
+static const int READER_ROW_Y = 80; // Library: first book
+static const int READER_ROW_H = 50;
+
+// The book to reopen; its position is kept in the book's page index
+static const char *READER_RECORD = "/config/reader.rec";
+
+struct ReaderRecord {
+  static const uint16_t RECORD_TYPE = 0xB00C;
+  static const uint16_t RECORD_VERSION = 1;
+  char name[Reader::MAX_NAME]; // Empty: the library was on screen
+  uint8_t font;
+  uint8_t reserved[3];
+};
+
+// ============================================================================
+// Screen hooks
+// ============================================================================
+
+void UIManager::enterReader() {
+  if (_reader.query.length()) {
+    readerScanBooks(); // Back from the keyboard to the hits
+    return;
+  }
+  ReaderRecord record;
+  if (sdManager && sdManager->isAvailable() &&
+      RecordFile::load(READER_RECORD, record)) {
+    record.name[sizeof(record.name) - 1] = 0;
+    if (record.font < Reader::FONTS)
+      _reader.font = record.font;
+    if (record.name[0] && readerOpen(record.name))
+      return;
+  }
+  readerScanBooks();
+}
+
+void UIManager::exitReader() {
+  readerSave();
+  delete _reader.book; // Writes back the page index and position
+  _reader.book = nullptr;
+  _reader.books.clear();
+}
+
+void UIManager::updateReader() {
+  if (!_reader.book || !_reader.book->isOpen() || _isTouching)
+    return;
+
+  // The pages either side come first, once this one is up: the next turn
+  // is pushed from them
+  if (!_reader.book->prefetched()) {
+    if (!_needsRefresh)
+      _reader.book->prefetch();
+    return;
+  }
+
+  if (_reader.book->complete() ||
+      millis() - _lastInputTime < READER_INDEX_IDLE_MS)
+    return;
+  _reader.book->extend(READER_INDEX_SLICE_MS);
+
+  // Once the count is final the footer drops its "+"
+  if (_reader.book->complete() && !_reader.shownComplete && !_needsRefresh) {
+    _refresh.apply(RegionKind::TEXT);
+    M5.Display.startWrite();
+    drawReaderFooter();
+    M5.Display.endWrite();
+    M5.Display.display();
+  }
+}
+
+bool UIManager::readerBusy() const {
+  bool reading = _currentScreen == ScreenID::READER;
+  if (reading && _reader.book && _reader.book->isOpen() &&
+      (!_reader.book->prefetched() || !_reader.book->complete()))
+    return true;
+  // Then the books for search: here, or on any screen while charging
+  return _reader.search.pending() && (reading || Battery::isCharging());
+}
+
+void UIManager::searchIdle() {
+  if (_isTouching || _needsRefresh ||
+      millis() - _lastInputTime < READER_INDEX_IDLE_MS || !readerBusy())
+    return;
+  // The open book's pages and index go first
+  if (_currentScreen == ScreenID::READER && _reader.book &&
+      _reader.book->isOpen() &&
+      (!_reader.book->prefetched() || !_reader.book->complete()))
+    return;
+  _reader.search.step(READER_INDEX_SLICE_MS);
+}
+
+// ============================================================================
+// Drawing
+// ============================================================================
+
+void UIManager::drawReader() {
+  if (!_reader.book) {
+    drawReaderLibrary();
+    return;
+  }
+
+  // Page text wants the sharper waveform; ghosting goes on the budget
+  _refresh.apply(RegionKind::TEXT);
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  // Drawn ahead on the render task, or now if the turn outran it
+  M5Canvas *canvas = _reader.book->rendered();
+  if (canvas) {
+    canvas->pushSprite(&M5.Display, READER_TEXT_X, READER_TEXT_Y);
+  } else {
+    const PageLayout::Page &page = _reader.book->current();
+    M5.Display.setFont(_reader.book->face());
+    M5.Display.setTextSize(1);
+    M5.Display.setTextColor(COLOR_BLACK);
+    M5.Display.setTextDatum(top_left);
+    for (int i = 0; i < page.lineCount; i++)
+      PageLayout::drawLine(M5.Display, page, i, READER_TEXT_X,
+                           READER_TEXT_Y);
+    M5.Display.setFont(&fonts::Font0); // The rest of the UI uses the default
+  }
+
+  drawReaderFooter();
+
+  int y = SCREEN_HEIGHT - MENU_BAR_HEIGHT;
+  _hits.add(0, y, 120, MENU_BAR_HEIGHT, [this](int, int) {
+    Buzzer::click();
+    readerCloseBook();
+  });
+  _hits.add(130, y, 100, MENU_BAR_HEIGHT,
+            [this](int, int) { readerSetFont(_reader.book->font() - 1); });
+  _hits.add(240, y, 100, MENU_BAR_HEIGHT,
+            [this](int, int) { readerSetFont(_reader.book->font() + 1); });
+  _hits.add(350, y, 100, MENU_BAR_HEIGHT,
+            [this](int, int) { readerTurn(-10); });
+  _hits.add(460, y, 100, MENU_BAR_HEIGHT,
+            [this](int, int) { readerTurn(10); });
+}
+
+void UIManager::drawReaderFooter() {
+  int y = SCREEN_HEIGHT - MENU_BAR_HEIGHT;
+  M5.Display.fillRect(0, y, SCREEN_WIDTH, MENU_BAR_HEIGHT, COLOR_WHITE);
+  M5.Display.drawLine(0, y, SCREEN_WIDTH, y, COLOR_BLACK);
+  drawButton(5, y + 8, 110, MENU_BAR_HEIGHT - 16, "LIB");
+  drawButton(135, y + 8, 90, MENU_BAR_HEIGHT - 16, "A-");
+  drawButton(245, y + 8, 90, MENU_BAR_HEIGHT - 16, "A+");
+  drawButton(355, y + 8, 90, MENU_BAR_HEIGHT - 16, "-10");
+  drawButton(465, y + 8, 90, MENU_BAR_HEIGHT - 16, "+10");
+
+  // Until the index has reached the end, the count is a lower bound
+  _reader.shownComplete = _reader.book->complete();
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setTextDatum(top_right);
+  char label[32];
+  snprintf(label, sizeof(label), "%u / %u%s",
+           (unsigned)_reader.book->page() + 1,
+           (unsigned)_reader.book->knownPages(),
+           _reader.shownComplete ? "" : "+");
+  M5.Display.drawString(label, SCREEN_WIDTH - 20, y + 22);
+  M5.Display.setTextDatum(top_left);
+}
+
+void UIManager::drawReaderLibrary() {
+  M5.Display.setEpdMode(epd_mode_t::epd_fast);
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  drawButton(730, 10, 100, 40, "FIND");
+  _hits.add(730, 10, 100, 40, [this](int, int) {
+    Buzzer::click();
+    openKeyboard(TextField::BOOK_SEARCH);
+  });
+  if (_reader.query.length()) {
+    drawReaderHits();
+    return;
+  }
+
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(30, 20);
+  M5.Display.print("LIBRARY");
+  drawButton(850, 10, 100, 40, "HOME");
+  _hits.add(850, 10, 100, 40, [this](int, int) {
+    Buzzer::click();
+    navigateTo(ScreenID::HOME);
+  });
+
+  M5.Display.setTextSize(2);
+  if (_reader.books.empty()) {
+    M5.Display.setCursor(30, READER_ROW_Y + 20);
+    M5.Display.print("No books. Copy .txt or .epub files to /books");
+    return;
+  }
+  // As of the last look at /books
+  if (_reader.search.indexed() < _reader.search.books()) {
+    M5.Display.setTextColor(COLOR_GRAY);
+    M5.Display.setCursor(200, 28);
+    M5.Display.printf("%u of %u books indexed for FIND",
+                      (unsigned)_reader.search.indexed(),
+                      (unsigned)_reader.search.books());
+    M5.Display.setTextColor(COLOR_BLACK);
+  }
+
+  int pages = (_reader.books.size() + READER_LIST_ROWS - 1) / READER_LIST_ROWS;
+  if (_reader.listPage >= pages)
+    _reader.listPage = pages - 1;
+  int first = _reader.listPage * READER_LIST_ROWS;
+  for (int row = 0; row < READER_LIST_ROWS; row++) {
+    int i = first + row;
+    if (i >= (int)_reader.books.size())
+      break;
+    int y = READER_ROW_Y + row * READER_ROW_H;
+    M5.Display.drawLine(30, y + READER_ROW_H - 1, SCREEN_WIDTH - 30,
+                        y + READER_ROW_H - 1, COLOR_GRAY);
+    M5.Display.setCursor(40, y + 16);
+    M5.Display.print(_reader.books[i].c_str());
+    _hits.add(0, y, SCREEN_WIDTH, READER_ROW_H, [this, i](int, int) {
+      Buzzer::click();
+      String name = _reader.books[i]; // Opening clears the list
+      if (!readerOpen(name.c_str()))
+        readerScanBooks(); // Gone or unreadable: list what is there now
+      forceRefresh();
+    });
+  }
+
+  drawReaderPager(pages);
+}
+
+// Hits of the last search, a row each; one opens its book there
+void UIManager::drawReaderHits() {
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(30, 20);
+  M5.Display.print("FOUND");
+  M5.Display.setTextSize(2);
+  M5.Display.setCursor(150, 28);
+  String shown = _reader.query;
+  if (shown.length() > 40)
+    shown = shown.substring(0, 37) + "...";
+  M5.Display.printf("\"%s\"", shown.c_str());
+  drawButton(850, 10, 100, 40, "BACK");
+  _hits.add(850, 10, 100, 40, [this](int, int) {
+    Buzzer::click();
+    _reader.query = "";
+    _reader.hits.clear();
+    _reader.listPage = 0;
+    forceRefresh();
+  });
+
+  if (_reader.hits.empty()) {
+    M5.Display.setCursor(30, READER_ROW_Y + 20);
+    M5.Display.print("No page has all of these words");
+    if (_reader.search.indexed() < _reader.search.books()) {
+      M5.Display.setCursor(30, READER_ROW_Y + 50);
+      M5.Display.printf("(%u of %u books indexed so far)",
+                        (unsigned)_reader.search.indexed(),
+                        (unsigned)_reader.search.books());
+    }
+    return;
+  }
+
+  int pages = (_reader.hits.size() + READER_LIST_ROWS - 1) / READER_LIST_ROWS;
+  if (_reader.listPage >= pages)
+    _reader.listPage = pages - 1;
+  int first = _reader.listPage * READER_LIST_ROWS;
+  for (int row = 0; row < READER_LIST_ROWS; row++) {
+    int i = first + row;
+    if (i >= (int)_reader.hits.size())
+      break;
+    const BookSearch::Hit &hit = _reader.hits[i];
+    int y = READER_ROW_Y + row * READER_ROW_H;
+    M5.Display.drawLine(30, y + READER_ROW_H - 1, SCREEN_WIDTH - 30,
+                        y + READER_ROW_H - 1, COLOR_GRAY);
+    M5.Display.setTextColor(COLOR_BLACK);
+    M5.Display.setCursor(40, y + 5);
+    M5.Display.printf("%s  %u%%", hit.book, hit.percent);
+    M5.Display.setTextColor(COLOR_GRAY);
+    M5.Display.setCursor(40, y + 27);
+    M5.Display.print(hit.snippet);
+    _hits.add(0, y, SCREEN_WIDTH, READER_ROW_H, [this, i](int, int) {
+      Buzzer::click();
+      BookSearch::Hit hit = _reader.hits[i];
+      _reader.query = "";
+      _reader.hits.clear();
+      if (!readerOpen(hit.book, &hit.pos))
+        readerScanBooks();
+      forceRefresh();
+    });
+  }
+  M5.Display.setTextColor(COLOR_BLACK);
+  drawReaderPager(pages);
+}
+
+void UIManager::drawReaderPager(int pages) {
+  if (pages <= 1)
+    return;
+  int y = SCREEN_HEIGHT - MENU_BAR_HEIGHT;
+  drawButton(30, y + 5, 150, MENU_BAR_HEIGHT - 10, "< PREV");
+  drawButton(SCREEN_WIDTH - 180, y + 5, 150, MENU_BAR_HEIGHT - 10,
+             "NEXT >");
+  M5.Display.setCursor(SCREEN_WIDTH / 2 - 40, y + 22);
+  M5.Display.printf("%d / %d", _reader.listPage + 1, pages);
+  _hits.add(0, y, 200, MENU_BAR_HEIGHT, [this](int, int) {
+    if (_reader.listPage > 0) {
+      Buzzer::click();
+      _reader.listPage--;
+      forceRefresh();
+    }
+  });
+  _hits.add(SCREEN_WIDTH - 200, y, 200, MENU_BAR_HEIGHT,
+            [this, pages](int, int) {
+              if (_reader.listPage + 1 < pages) {
+                Buzzer::click();
+                _reader.listPage++;
+                forceRefresh();
+              }
+            });
+}
+
+// ============================================================================
+// Input
+// ============================================================================
+
+void UIManager::handleReaderTouch(int x, int y) {
+  // Page text: the left third goes back, the rest forward
+  if (!_reader.book || y >= SCREEN_HEIGHT - MENU_BAR_HEIGHT)
+    return;
+  readerTurn(x < SCREEN_WIDTH / 3 ? -1 : 1);
+}
+
+void UIManager::readerHandleSwipe(const Gesture &g) {
+  if (!_reader.book)
+    return;
+  if (g.dir == GestureDir::LEFT)
+    readerTurn(1);
+  else if (g.dir == GestureDir::RIGHT)
+    readerTurn(-1);
+}
+
+// ============================================================================
+// Books
+// ============================================================================
+
+void UIManager::readerScanBooks() {
+  _reader.books.clear();
+  _reader.search.rescan(); // Books copied in or removed since
+  if (!sdManager)
+    return;
+  std::vector<String> files;
+  {
+    SDAccess sd(sdManager);
+    if (!sd)
+      return;
+    sdManager->listFiles("/books", files, "txt,epub");
+  }
+  for (String &name : files) {
+    // Hidden files (macOS "._" forks) and names the index cannot hold
+    if (name.startsWith(".") || name.length() >= Reader::MAX_NAME)
+      continue;
+    _reader.books.push_back(name);
+  }
+  std::sort(_reader.books.begin(), _reader.books.end(),
+            [](const String &a, const String &b) {
+              return strcasecmp(a.c_str(), b.c_str()) < 0;
+            });
+}
+
+bool UIManager::readerOpen(const char *name, const BookSource::Pos *pos) {
+  if (!_reader.book)
+    _reader.book = new Reader();
+  if (!_reader.book->open(name, _reader.font, pos)) {
+    Serial.printf("Reader: Cannot open %s\n", name);
+    delete _reader.book;
+    _reader.book = nullptr;
+    return false;
+  }
+  _reader.books.clear();
+  readerSave();
+  return true;
+}
+
+void UIManager::readerCloseBook() {
+  delete _reader.book;
+  _reader.book = nullptr;
+  readerSave(); // The library comes back next time
+  readerScanBooks();
+  forceRefresh();
+}
+
+void UIManager::readerTurn(int pages) {
+  size_t page = _reader.book->page();
+  if (pages < 0 && page == 0)
+    return;
+  size_t target = pages < 0 && (size_t)-pages > page ? 0 : page + pages;
+  if (_reader.book->complete() && target >= _reader.book->knownPages())
+    target = _reader.book->knownPages() - 1;
+  if (target == page)
+    return;
+
+  Buzzer::click();
+  if (!_reader.book->go(target)) {
+    Serial.println("Reader: Page layout failed");
+    return;
+  }
+  forceRefresh();
+}
+
+void UIManager::readerSetFont(int font) {
+  if (font < 0 || font >= Reader::FONTS)
+    return;
+  Buzzer::click();
+  // Pages up to the position are laid out again, unless this font has an
+  // index already
+  if (_reader.book->setFont(font)) {
+    _reader.font = font;
+    readerSave();
+  }
+  forceRefresh();
+}
+
+void UIManager::readerFind(const String &query) {
+  _reader.query = query;
+  _reader.query.trim();
+  _reader.hits.clear();
+  _reader.listPage = 0;
+  if (_reader.query.length()) {
+    _reader.hits.resize(READER_MAX_HITS);
+    int found = _reader.search.search(_reader.query.c_str(),
+                                      _reader.hits.data(), READER_MAX_HITS);
+    _reader.hits.resize(found);
+    LOG_I("Reader", "\"%s\": %d hits", _reader.query.c_str(), found);
+  }
+  navigateTo(ScreenID::READER);
+}
+
+void UIManager::readerSave() {
+  if (!sdManager || !sdManager->isAvailable())
+    return;
+  ReaderRecord record = {};
+  if (_reader.book && _reader.book->isOpen())
+    strlcpy(record.name, _reader.book->name(), sizeof(record.name));
+  record.font = _reader.font;
+  RecordFile::saveDeferred(READER_RECORD, record);
+}
+
+#endif // APP_READER
@@ -0,0 +1,710 @@
+/**
+ * UI Manager - Sudoku
+ * 6x6 puzzles, generated at three difficulties, with pencil marks
+ */
+
+#include "../hardware/buzzer.h"
+#include "../utils/record_file.h"
+#include "../utils/sd_manager.h"
+#include "../utils/timer_wheel.h"
+#include "ui_manager.h"
+#include <esp_random.h>
+
+#if APP_GAMES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+// ============================================================================
+// SUDOKU GAME (6x6) - Optimized for M5Paper S3
+// ============================================================================
+
+// Saved puzzle (/games/saves is created at boot)
+static const char *SUDOKU_RECORD = "/games/saves/sudoku.rec";
+
+struct SudokuRecord {
+  static const uint16_t RECORD_TYPE = 0x5D0C;
+  static const uint16_t RECORD_VERSION = 3;
+  static const uint8_t FLAG_PENCIL = 1 << 0;
+  uint8_t difficulty;
+  uint8_t puzzleNum; // 0 = generated
+  uint8_t flags;
+  uint8_t reserved;
+  uint32_t elapsedSecs;
+  uint64_t givens;   // Bit 6 * r + c: the cell is a given
+  uint8_t cells[18]; // Two cells a byte, the even one in the low nibble
+  uint8_t reserved2[6];
+};
+static_assert(sizeof(SudokuRecord) == 40, "packed save layout");
+
+// Saves from before generated puzzles: built-in ones only
+struct SudokuRecordV1 {
+  static const uint16_t RECORD_TYPE = 0x5D0C;
+  static const uint16_t RECORD_VERSION = 1;
+  uint8_t difficulty; // The puzzle tables give the solution and givens
+  uint8_t puzzleNum;
+  uint8_t grid[6][6];
+  uint8_t reserved[2];
+};
+// Built-in 6x6 Sudoku Puzzles (3 per difficulty = 9 total); new games are
+// generated, these remain for saves made before that
+// Format: 0 = empty, 1-6 = given numbers
+
+// EASY PUZZLES (More given numbers)
+const byte sudoku_easy_puzzles[3][6][6] = {
+    // Easy #1 (Strictly Valid)
+    {{1, 2, 0, 4, 5, 0},
+     {0, 5, 6, 1, 0, 3},
+     {2, 0, 1, 5, 0, 4},
+     {5, 6, 4, 0, 3, 1},
+     {0, 1, 2, 6, 0, 0},
+     {6, 0, 5, 3, 1, 2}},
+
+    // Easy #2 (Strictly Valid)
+    {{3, 0, 1, 6, 0, 4},
+     {6, 5, 0, 3, 2, 1},
+     {0, 3, 2, 0, 6, 0},
+     {4, 6, 0, 1, 3, 2},
+     {2, 1, 3, 0, 4, 6},
+     {5, 0, 6, 2, 0, 3}},
+
+    // Easy #3 (Strictly Valid)
+    {{1, 0, 3, 4, 0, 6},
+     {4, 5, 0, 0, 2, 3},
+     {3, 1, 2, 6, 4, 0},
+     {0, 4, 5, 3, 1, 2},
+     {2, 3, 0, 0, 6, 4},
+     {5, 0, 4, 2, 0, 1}}};
+
+const byte sudoku_easy_solutions[3][6][6] = {{{1, 2, 3, 4, 5, 6},
+                                              {4, 5, 6, 1, 2, 3},
+                                              {2, 3, 1, 5, 6, 4},
+                                              {5, 6, 4, 2, 3, 1},
+                                              {3, 1, 2, 6, 4, 5},
+                                              {6, 4, 5, 3, 1, 2}},
+
+                                             {{3, 2, 1, 6, 5, 4},
+                                              {6, 5, 4, 3, 2, 1},
+                                              {1, 3, 2, 4, 6, 5},
+                                              {4, 6, 5, 1, 3, 2},
+                                              {2, 1, 3, 5, 4, 6},
+                                              {5, 4, 6, 2, 1, 3}},
+
+                                             {{1, 2, 3, 4, 5, 6},
+                                              {4, 5, 6, 1, 2, 3},
+                                              {3, 1, 2, 6, 4, 5},
+                                              {6, 4, 5, 3, 1, 2},
+                                              {2, 3, 1, 5, 6, 4},
+                                              {5, 6, 4, 2, 3, 1}}};
+
+// MEDIUM PUZZLES
+const byte sudoku_medium_puzzles[3][6][6] = {
+    // Medium #1
+    {{0, 2, 0, 0, 5, 0},
+     {0, 0, 6, 1, 0, 0},
+     {2, 0, 0, 0, 0, 4},
+     {5, 0, 0, 0, 0, 1},
+     {0, 0, 2, 6, 0, 0},
+     {0, 4, 0, 0, 1, 0}},
+
+    // Medium #2
+    {{0, 0, 1, 6, 0, 0},
+     {0, 5, 0, 0, 2, 0},
+     {1, 0, 0, 0, 0, 5},
+     {4, 0, 0, 0, 0, 2},
+     {0, 1, 0, 0, 4, 0},
+     {0, 0, 6, 2, 0, 0}},
+
+    // Medium #3
+    {{0, 0, 3, 4, 0, 0},
+     {4, 0, 0, 0, 0, 3},
+     {0, 1, 0, 0, 4, 0},
+     {0, 4, 0, 0, 1, 0},
+     {2, 0, 0, 0, 0, 4},
+     {0, 0, 4, 2, 0, 0}}};
+
+const byte sudoku_medium_solutions[3][6][6] = {{{1, 2, 3, 4, 5, 6},
+                                                {4, 5, 6, 1, 2, 3},
+                                                {2, 3, 1, 5, 6, 4},
+                                                {5, 6, 4, 2, 3, 1},
+                                                {3, 1, 2, 6, 4, 5},
+                                                {6, 4, 5, 3, 1, 2}},
+
+                                               {{3, 2, 1, 6, 5, 4},
+                                                {6, 5, 4, 3, 2, 1},
+                                                {1, 3, 2, 4, 6, 5},
+                                                {4, 6, 5, 1, 3, 2},
+                                                {2, 1, 3, 5, 4, 6},
+                                                {5, 4, 6, 2, 1, 3}},
+
+                                               {{1, 2, 3, 4, 5, 6},
+                                                {4, 5, 6, 1, 2, 3},
+                                                {3, 1, 2, 6, 4, 5},
+                                                {6, 4, 5, 3, 1, 2},
+                                                {2, 3, 1, 5, 6, 4},
+                                                {5, 6, 4, 2, 3, 1}}};
+
+// HARD PUZZLES
+const byte sudoku_hard_puzzles[3][6][6] = {
+    // Hard #1
+    {{0, 0, 0, 0, 5, 0},
+     {0, 5, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0, 4},
+     {5, 0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 4, 0},
+     {0, 4, 0, 0, 0, 0}},
+
+    // Hard #2
+    {{0, 0, 0, 6, 0, 0},
+     {0, 5, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0, 5},
+     {4, 0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 4, 0},
+     {0, 0, 6, 0, 0, 0}},
+
+    // Hard #3
+    {{0, 0, 0, 4, 0, 0},
+     {0, 5, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 6, 0},
+     {0, 0, 4, 0, 0, 0}}};
+
+const byte sudoku_hard_solutions[3][6][6] = {{{1, 2, 3, 4, 5, 6},
+                                              {4, 5, 6, 1, 2, 3},
+                                              {2, 3, 1, 5, 6, 4},
+                                              {5, 6, 4, 2, 3, 1},
+                                              {3, 1, 2, 6, 4, 5},
+                                              {6, 4, 5, 3, 1, 2}},
+
+                                             {{3, 2, 1, 6, 5, 4},
+                                              {6, 5, 4, 3, 2, 1},
+                                              {1, 3, 2, 4, 6, 5},
+                                              {4, 6, 5, 1, 3, 2},
+                                              {2, 1, 3, 5, 4, 6},
+                                              {5, 4, 6, 2, 1, 3}},
+
+                                             {{1, 2, 3, 4, 5, 6},
+                                              {4, 5, 6, 1, 2, 3},
+                                              {3, 1, 2, 6, 4, 5},
+                                              {6, 4, 5, 3, 1, 2},
+                                              {2, 3, 1, 5, 6, 4},
+                                              {5, 6, 4, 2, 3, 1}}};
+
+// Initialize Sudoku game
+void UIManager::sudokuInit() {
+  _sudoku.selectedRow = -1;
+  _sudoku.selectedCol = -1;
+  _sudoku.showConfirm = false; // No confirmation dialog
+  sudokuLoadRandomPuzzle(0);  // Start with Easy
+}
+
+// Load a puzzle
+void UIManager::sudokuLoadPuzzle(byte difficulty, byte num) {
+  _sudoku.difficulty = difficulty;
+  _sudoku.puzzleNum = num;
+
+  const byte(*puzzle)[6][6];
+  const byte(*solution)[6][6];
+
+  // Select difficulty
+  if (difficulty == 0) { // Easy
+    puzzle = &sudoku_easy_puzzles[num - 1];
+    solution = &sudoku_easy_solutions[num - 1];
+  } else if (difficulty == 1) { // Medium
+    puzzle = &sudoku_medium_puzzles[num - 1];
+    solution = &sudoku_medium_solutions[num - 1];
+  } else { // Hard
+    puzzle = &sudoku_hard_puzzles[num - 1];
+    solution = &sudoku_hard_solutions[num - 1];
+  }
+
+  sudokuSetPuzzle(*puzzle, *solution);
+}
+
+// Start a puzzle: its givens are locked, everything else is empty
+void UIManager::sudokuSetPuzzle(const Sudoku::Grid puzzle,
+                                const Sudoku::Grid solution) {
+  _sudoku.board.load(puzzle);
+  for (int r = 0; r < 6; r++) {
+    for (int c = 0; c < 6; c++) {
+      _sudoku.solution[r][c] = solution[r][c];
+      _sudoku.given[r][c] = (puzzle[r][c] != 0);
+    }
+  }
+
+  _sudoku.selectedRow = -1;
+  _sudoku.selectedCol = -1;
+
+  // A new puzzle starts its clock (if the game is up, it runs from now)
+  _sudoku.elapsedMs = 0;
+  if (_sudoku.clockFrom)
+    _sudoku.clockFrom = millis();
+}
+
+uint32_t UIManager::sudokuElapsedSecs() const {
+  uint32_t ms = _sudoku.elapsedMs;
+  if (_sudoku.clockFrom)
+    ms += millis() - _sudoku.clockFrom;
+  return ms / 1000;
+}
+
+void UIManager::enterSudoku() {
+  // The clock only runs while the puzzle is on screen
+  if (!sudokuLoadSaved())
+    sudokuInit(); // Nothing saved yet
+  _sudoku.clockFrom = millis();
+
+  // Puzzles of every grade get made while this one is played
+  _sudoku.generator.begin();
+}
+
+void UIManager::exitSudoku() {
+  sudokuSave(); // With the time played
+  _sudoku.elapsedMs += millis() - _sudoku.clockFrom;
+  _sudoku.clockFrom = 0;
+}
+
+// Save the puzzle in progress (through the write-back cache)
+void UIManager::sudokuSave() {
+  extern SDManager *sdManager;
+  if (!sdManager || !sdManager->isAvailable())
+    return;
+  SudokuRecord record = {};
+  record.difficulty = _sudoku.difficulty;
+  record.puzzleNum = _sudoku.puzzleNum;
+  record.flags = _sudoku.pencil ? SudokuRecord::FLAG_PENCIL : 0;
+  record.elapsedSecs = sudokuElapsedSecs();
+  for (int i = 0; i < Sudoku::CELLS; i++) {
+    int r = i / 6, c = i % 6;
+    if (_sudoku.given[r][c])
+      record.givens |= 1ULL << i;
+    record.cells[i / 2] |= _sudoku.board.digit(r, c) << (i % 2 * 4);
+  }
+  RecordFile::saveDeferred(SUDOKU_RECORD, record);
+}
+
+// Resume the saved puzzle
+bool UIManager::sudokuLoadSaved() {
+  extern SDManager *sdManager;
+  if (!sdManager || !sdManager->isAvailable())
+    return false;
+
+  SudokuRecord record;
+  SudokuRecordV1 legacy;
+  Sudoku::Grid grid, puzzle = {}, solution;
+  if (RecordFile::load(SUDOKU_RECORD, record)) {
+    for (int i = 0; i < Sudoku::CELLS; i++) {
+      int r = i / 6, c = i % 6;
+      grid[r][c] = (record.cells[i / 2] >> (i % 2 * 4)) & 0xF;
+      if (record.givens & (1ULL << i))
+        puzzle[r][c] = grid[r][c];
+    }
+    // The solver gives the solution back, and rejects a damaged puzzle
+    if (record.difficulty > 2 || record.puzzleNum > SUDOKU_BUILT_IN_PUZZLES ||
+        Sudoku::countSolutions(puzzle, solution) != 1)
+      return false;
+    sudokuSetPuzzle(puzzle, solution);
+    _sudoku.difficulty = record.difficulty;
+    _sudoku.puzzleNum = record.puzzleNum;
+    _sudoku.pencil = record.flags & SudokuRecord::FLAG_PENCIL;
+    _sudoku.elapsedMs = record.elapsedSecs * 1000UL;
+  } else if (RecordFile::load(SUDOKU_RECORD, legacy) &&
+             legacy.difficulty <= 2 && legacy.puzzleNum >= 1 &&
+             legacy.puzzleNum <= SUDOKU_BUILT_IN_PUZZLES) {
+    // Givens and solution come from the tables; the next save upgrades it
+    sudokuLoadPuzzle(legacy.difficulty, legacy.puzzleNum);
+    memcpy(grid, legacy.grid, sizeof(grid));
+  } else {
+    return false;
+  }
+
+  // Only the entries are the player's
+  for (int r = 0; r < 6; r++)
+    for (int c = 0; c < 6; c++)
+      if (!_sudoku.given[r][c])
+        _sudoku.board.set(r, c, grid[r][c]);
+  _sudoku.showConfirm = false;
+  Serial.println("Sudoku game loaded");
+  return true;
+}
+
+// Load a new puzzle for the given difficulty
+void UIManager::sudokuLoadRandomPuzzle(byte difficulty) {
+  Sudoku::Grid puzzle, solution;
+  Sudoku::Grade grade = (Sudoku::Grade)difficulty;
+  if (!_sudoku.generator.take(grade, puzzle, solution)) {
+    // Still generating: make one here, tens of milliseconds (the built-in
+    // medium and hard puzzles have more than one solution)
+    Sudoku::generate(grade, esp_random(), puzzle, solution);
+  }
+  sudokuSetPuzzle(puzzle, solution);
+  _sudoku.difficulty = difficulty;
+  _sudoku.puzzleNum = 0;
+  sudokuSave();
+}
+
+// Validate a cell (no duplicate in its row, column or block; empty is
+// valid). The board keeps per-unit digit counts, so this is a lookup.
+bool UIManager::sudokuValidateCell(byte row, byte col) {
+  return !_sudoku.board.conflicts(row, col);
+}
+
+// Check if puzzle is solved: all filled, nothing repeated
+bool UIManager::sudokuCheckWin() { return _sudoku.board.solved(); }
+
+// Clear selected cell
+void UIManager::sudokuClearCell() {
+  if (_sudoku.selectedRow >= 0 && _sudoku.selectedCol >= 0) {
+    if (!_sudoku.given[_sudoku.selectedRow][_sudoku.selectedCol]) {
+      _sudoku.board.set(_sudoku.selectedRow, _sudoku.selectedCol, 0);
+      sudokuSave();
+    }
+  }
+}
+
+// Pencil marks toggle, between the number pad and CLEAR/CHECK
+static const int SUDOKU_PENCIL_Y = 270;
+
+// Draw Sudoku game - ENHANCED with difficulty selector and better layout
+void UIManager::drawSudokuGame() {
+  M5.Display.setEpdMode(epd_mode_t::epd_fastest);
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  // Layout constants
+  const int GRID_X = 30;
+  const int GRID_Y = 80; // Moved down to make room for difficulty buttons
+  const int CELL_SIZE = 75;
+  const int BTN_X = 520;
+
+  // Title with puzzle number
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(30, 15);
+  const char *diff = (_sudoku.difficulty == 0)   ? "Easy"
+                     : (_sudoku.difficulty == 1) ? "Med"
+                                                : "Hard";
+  if (_sudoku.puzzleNum)
+    M5.Display.printf("SUDOKU  #%d/%d (%s)", _sudoku.puzzleNum,
+                      SUDOKU_BUILT_IN_PUZZLES, diff);
+  else
+    M5.Display.printf("SUDOKU  (%s)", diff);
+
+  // Time on this puzzle, as of this draw (it does not tick on its own)
+  uint32_t secs = sudokuElapsedSecs();
+  M5.Display.setCursor(30, 45);
+  M5.Display.printf("%u:%02u", (unsigned)(secs / 60), (unsigned)(secs % 60));
+
+  // HOME button (top right)
+  drawButton(850, 10, 100, 40, "HOME");
+
+  // ===== DIFFICULTY SELECTOR (top right, below title) =====
+  int diffY = 15;
+  int diffBtnW = 80;
+  int diffGap = 5;
+
+  // Draw difficulty buttons with highlight for current selection
+  bool isEasy = (_sudoku.difficulty == 0);
+  bool isMed = (_sudoku.difficulty == 1);
+  bool isHard = (_sudoku.difficulty == 2);
+
+  drawButton(BTN_X, diffY, diffBtnW, 40, "EASY", isEasy);
+  drawButton(BTN_X + diffBtnW + diffGap, diffY, diffBtnW, 40, "MED", isMed);
+  drawButton(BTN_X + 2 * (diffBtnW + diffGap), diffY, diffBtnW, 40, "HARD",
+             isHard);
+
+  // Draw grid (6x6, 75px cells)
+  for (int i = 0; i <= 6; i++) {
+    bool thickH = (i == 0 || i == 2 || i == 4 || i == 6);
+    bool thickV = (i == 0 || i == 3 || i == 6);
+
+    for (int t = 0; t < (thickH ? 3 : 1); t++) {
+      M5.Display.drawLine(GRID_X, GRID_Y + i * CELL_SIZE + t,
+                          GRID_X + 6 * CELL_SIZE, GRID_Y + i * CELL_SIZE + t,
+                          COLOR_BLACK);
+    }
+    for (int t = 0; t < (thickV ? 3 : 1); t++) {
+      M5.Display.drawLine(GRID_X + i * CELL_SIZE + t, GRID_Y,
+                          GRID_X + i * CELL_SIZE + t, GRID_Y + 6 * CELL_SIZE,
+                          COLOR_BLACK);
+    }
+  }
+
+  // Draw numbers - ALL BLACK for better e-ink visibility
+  M5.Display.setTextSize(4);
+  for (int r = 0; r < 6; r++) {
+    for (int c = 0; c < 6; c++) {
+      if (_sudoku.board.digit(r, c) != 0) {
+        int color = COLOR_BLACK; // All numbers black
+        if (!sudokuValidateCell(r, c))
+          color = 0xF800; // RED for errors
+
+        M5.Display.setTextColor(color);
+        M5.Display.setCursor(GRID_X + c * CELL_SIZE + 22,
+                             GRID_Y + r * CELL_SIZE + 18);
+        M5.Display.print(_sudoku.board.digit(r, c));
+      }
+    }
+  }
+
+  // Pencil marks: what each empty cell can still take, 3 over 3
+  if (_sudoku.pencil) {
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(COLOR_GRAY);
+    for (int r = 0; r < 6; r++) {
+      for (int c = 0; c < 6; c++) {
+        if (_sudoku.board.digit(r, c))
+          continue;
+        uint8_t marks = _sudoku.board.candidates(r, c);
+        for (int d = 1; d <= 6; d++) {
+          if (!(marks & Sudoku::digitBit(d)))
+            continue;
+          M5.Display.setCursor(GRID_X + c * CELL_SIZE + 10 + (d - 1) % 3 * 22,
+                               GRID_Y + r * CELL_SIZE + 14 + (d - 1) / 3 * 28);
+          M5.Display.print(d);
+        }
+      }
+    }
+    M5.Display.setTextSize(4);
+  }
+
+  // Highlight selected cell
+  if (_sudoku.selectedRow >= 0) {
+    int x = GRID_X + _sudoku.selectedCol * CELL_SIZE;
+    int y = GRID_Y + _sudoku.selectedRow * CELL_SIZE;
+    for (int t = 0; t < 3; t++) {
+      M5.Display.drawRect(x + 2 + t, y + 2 + t, CELL_SIZE - 4 - 2 * t,
+                          CELL_SIZE - 4 - 2 * t, 0x001F);
+    }
+  }
+
+  // ===== RIGHT SIDE CONTROLS =====
+
+  // Number buttons (1-6) in 2 rows of 3
+  int numY = 80;
+  int numBtnW = 85;
+  int numBtnH = 70;
+  int numGap = 5;
+
+  M5.Display.setTextSize(3);
+  for (int i = 0; i < 6; i++) {
+    int row = i / 3;
+    int col = i % 3;
+    int bx = BTN_X + col * (numBtnW + numGap);
+    int by = numY + row * (numBtnH + numGap);
+    char label[2] = {(char)('1' + i), '\0'};
+    drawButton(bx, by, numBtnW, numBtnH, label);
+  }
+
+  // Pencil marks toggle, under the numbers
+  M5.Display.setTextSize(2);
+  drawButton(BTN_X, SUDOKU_PENCIL_Y, 3 * numBtnW + 2 * numGap, 50, "NOTES",
+             _sudoku.pencil);
+
+  // Control buttons at BOTTOM of right panel (moved down significantly)
+  int ctrlY = 380; // Bottom of screen area
+  int ctrlBtnW = 130;
+
+  M5.Display.setTextSize(2);
+  drawButton(BTN_X, ctrlY, ctrlBtnW, 50, "CLEAR");
+  drawButton(BTN_X + ctrlBtnW + 10, ctrlY, ctrlBtnW, 50, "CHECK");
+
+  // NEW PUZZLE button (full width) at very bottom
+  int newY = ctrlY + 65;
+  drawButton(BTN_X, newY, 2 * ctrlBtnW + 10, 50, "NEW PUZZLE");
+
+  // Confirmation dialog overlay (if active)
+  if (_sudoku.showConfirm) {
+    // Semi-transparent background effect (just a white box for e-ink)
+    M5.Display.fillRoundRect(150, 200, 350, 160, 10, COLOR_WHITE);
+    M5.Display.drawRoundRect(150, 200, 350, 160, 10, COLOR_BLACK);
+    M5.Display.drawRoundRect(152, 202, 346, 156, 10, COLOR_BLACK);
+
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(COLOR_BLACK);
+    M5.Display.setCursor(180, 220);
+    M5.Display.print("Start new puzzle?");
+    M5.Display.setCursor(170, 250);
+    M5.Display.print("Progress will be lost");
+
+    // YES / NO buttons
+    drawButton(180, 300, 110, 45, "YES");
+    drawButton(310, 300, 110, 45, "NO");
+  }
+}
+
+// Handle Sudoku touch - ENHANCED
+void UIManager::handleSudokuTouch(int x, int y) {
+  const int GRID_X = 30;
+  const int GRID_Y = 80;
+  const int CELL_SIZE = 75;
+  const int BTN_X = 520;
+
+  Buzzer::click();
+
+  // Handle confirmation dialog FIRST (blocks all other input)
+  if (_sudoku.showConfirm) {
+    // YES button (180-290, 300-345)
+    if (x >= 180 && x < 290 && y >= 300 && y < 345) {
+      _sudoku.showConfirm = false;
+      sudokuLoadRandomPuzzle(
+          _sudoku.difficulty); // Load random puzzle of current difficulty
+      _refresh.forceClean();
+      _needsRefresh = true;
+      _lastRefresh = 0;
+      return;
+    }
+    // NO button (310-420, 300-345)
+    if (x >= 310 && x < 420 && y >= 300 && y < 345) {
+      _sudoku.showConfirm = false;
+      _needsRefresh = true;
+      _lastRefresh = 0;
+      return;
+    }
+    return; // Block all other touches when dialog is shown
+  }
+
+  // HOME button (850-950, 10-50)
+  if (x >= 850 && x < 950 && y >= 10 && y < 50) {
+    navigateTo(ScreenID::HOME);
+    return;
+  }
+
+  // Difficulty selector buttons (top right, below title)
+  int diffY = 15;
+  int diffBtnW = 80;
+  int diffGap = 5;
+
+  if (y >= diffY && y < diffY + 40) {
+    // EASY button
+    if (x >= BTN_X && x < BTN_X + diffBtnW) {
+      if (_sudoku.difficulty != 0) { // Only reload if changing
+        _sudoku.difficulty = 0;
+        sudokuLoadRandomPuzzle(0);
+        _refresh.forceClean();
+        _needsRefresh = true;
+        _lastRefresh = 0;
+      }
+      return;
+    }
+    // MED button
+    if (x >= BTN_X + diffBtnW + diffGap && x < BTN_X + 2 * diffBtnW + diffGap) {
+      if (_sudoku.difficulty != 1) {
+        _sudoku.difficulty = 1;
+        sudokuLoadRandomPuzzle(1);
+        _refresh.forceClean();
+        _needsRefresh = true;
+        _lastRefresh = 0;
+      }
+      return;
+    }
+    // HARD button
+    if (x >= BTN_X + 2 * (diffBtnW + diffGap) &&
+        x < BTN_X + 3 * diffBtnW + 2 * diffGap) {
+      if (_sudoku.difficulty != 2) {
+        _sudoku.difficulty = 2;
+        sudokuLoadRandomPuzzle(2);
+        _refresh.forceClean();
+        _needsRefresh = true;
+        _lastRefresh = 0;
+      }
+      return;
+    }
+  }
+
+  // Grid cell selection (30-480 x, 80-530 y)
+  if (x >= GRID_X && x < GRID_X + 6 * CELL_SIZE && y >= GRID_Y &&
+      y < GRID_Y + 6 * CELL_SIZE) {
+    int row = (y - GRID_Y) / CELL_SIZE;
+    int col = (x - GRID_X) / CELL_SIZE;
+    if (row >= 0 && row < 6 && col >= 0 && col < 6 &&
+        !_sudoku.given[row][col]) {
+      _sudoku.selectedRow = row;
+      _sudoku.selectedCol = col;
+      _needsRefresh = true;
+      _lastRefresh = 0;
+    }
+    return;
+  }
+
+  // Number buttons (1-6) in 2 rows of 3
+  int numY = 80;
+  int numBtnW = 85;
+  int numBtnH = 70;
+  int numGap = 5;
+
+  for (int i = 0; i < 6; i++) {
+    int row = i / 3;
+    int col = i % 3;
+    int bx = BTN_X + col * (numBtnW + numGap);
+    int by = numY + row * (numBtnH + numGap);
+    if (x >= bx && x < bx + numBtnW && y >= by && y < by + numBtnH) {
+      if (_sudoku.selectedRow >= 0) {
+        _sudoku.board.set(_sudoku.selectedRow, _sudoku.selectedCol, i + 1);
+        sudokuSave();
+        _needsRefresh = true;
+        _lastRefresh = 0;
+      }
+      return;
+    }
+  }
+
+  // NOTES toggle
+  if (x >= BTN_X && x < BTN_X + 3 * numBtnW + 2 * numGap &&
+      y >= SUDOKU_PENCIL_Y && y < SUDOKU_PENCIL_Y + 50) {
+    _sudoku.pencil = !_sudoku.pencil;
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    return;
+  }
+
+  // Control buttons at bottom
+  int ctrlY = 380;
+  int ctrlBtnW = 130;
+
+  // CLEAR button
+  if (x >= BTN_X && x < BTN_X + ctrlBtnW && y >= ctrlY && y < ctrlY + 50) {
+    sudokuClearCell();
+    _refresh.forceClean();
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    return;
+  }
+
+  // CHECK button
+  if (x >= BTN_X + ctrlBtnW + 10 && x < BTN_X + 2 * ctrlBtnW + 10 &&
+      y >= ctrlY && y < ctrlY + 50) {
+    if (sudokuCheckWin()) {
+      M5.Display.fillRoundRect(150, 220, 250, 80, 10, COLOR_WHITE);
+      M5.Display.drawRoundRect(150, 220, 250, 80, 10, COLOR_BLACK);
+      M5.Display.setTextSize(3);
+      M5.Display.setTextColor(0x07E0);
+      M5.Display.setCursor(180, 250);
+      M5.Display.print("SOLVED!");
+      uint32_t secs = sudokuElapsedSecs();
+      M5.Display.setTextSize(2);
+      M5.Display.setCursor(180, 280);
+      M5.Display.printf("in %u:%02u", (unsigned)(secs / 60),
+                        (unsigned)(secs % 60));
+      M5.Display.display();
+      timers->start(_toastJob, 2000); // Then the board comes back
+      return;
+    }
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    return;
+  }
+
+  // NEW PUZZLE button - show confirmation dialog
+  int newY = ctrlY + 65;
+  if (x >= BTN_X && x < BTN_X + 2 * ctrlBtnW + 10 && y >= newY &&
+      y < newY + 50) {
+    _sudoku.showConfirm = true; // Show confirmation dialog
+    _needsRefresh = true;
+    _lastRefresh = 0;
+    return;
+  }
+}
+
+#endif // APP_GAMES
@@ -0,0 +1,232 @@
+/**
+ * UI Manager - To-Do
+ * The to-do list, from the notes browser: a page of rows, each ticked,
+ * edited or deleted in place
+ */
+
+#include "../hardware/buzzer.h"
+#include "../utils/log.h"
+#include "ui_manager.h"
+#include <algorithm>
+
+#if APP_NOTES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+static const int TODO_ROW_Y = 70;
+static const int TODO_ROW_H = 56;
+static const int TODO_ROWS = 7; // A page
+static const int TODO_FOOTER_Y = TODO_ROW_Y + TODO_ROWS * TODO_ROW_H + 8;
+static const int TODO_TEXT_CHARS = 52; // Size 2, up to the buttons
+static const unsigned long TODO_COMPACT_IDLE_MS = 5000;
+
+static int todoPages(int count) {
+  return std::max(1, (count + TODO_ROWS - 1) / TODO_ROWS);
+}
+
+// ============================================================================
+// Screen hooks
+// ============================================================================
+
+void UIManager::enterTodo() {
+  _todo.log.load();
+  _todo.page = std::min(_todo.page, todoPages(_todo.log.size()) - 1);
+}
+
+void UIManager::exitTodo() {
+  if (_todo.log.needsCompaction())
+    _todo.log.compact();
+  _todo.log.close();
+}
+
+// Rewriting the log is a few KB: left for when nobody is tapping
+void UIManager::todoIdle() {
+  if (_todo.log.needsCompaction() &&
+      millis() - _lastInputTime > TODO_COMPACT_IDLE_MS)
+    _todo.log.compact();
+}
+
+// ============================================================================
+// Changes
+// ============================================================================
+
+void UIManager::todoRepaint(int fromSlot) {
+  _refresh.apply(RegionKind::TEXT);
+  M5.Display.startWrite();
+  for (int slot = fromSlot; slot < TODO_ROWS; slot++)
+    drawTodoRow(slot);
+  drawTodoFooter();
+  M5.Display.endWrite();
+  M5.Display.display();
+}
+
+void UIManager::todoSubmit(String text) {
+  text.trim();
+  bool ok = true;
+  if (_todo.editing >= 0) {
+    ok = text.length() ? _todo.log.edit(_todo.editing, text.c_str())
+                       : _todo.log.remove(_todo.editing);
+  } else if (text.length()) {
+    ok = _todo.log.add(text.c_str());
+    _todo.page = todoPages(_todo.log.size()) - 1; // Where it went
+  }
+  if (!ok)
+    LOG_W("UI", "To-do change not saved");
+  _todo.editing = -1;
+  navigateTo(ScreenID::TODO);
+}
+
+// ============================================================================
+// Drawing
+// ============================================================================
+
+void UIManager::drawTodoRow(int slot) {
+  int y = TODO_ROW_Y + slot * TODO_ROW_H;
+  int row = _todo.page * TODO_ROWS + slot;
+  M5.Display.fillRect(0, y, SCREEN_WIDTH, TODO_ROW_H, COLOR_WHITE);
+  if (row >= _todo.log.size())
+    return;
+  const TodoLog::Item &item = _todo.log[row];
+
+  M5.Display.drawRect(20, y + 10, 36, 36, COLOR_BLACK);
+  if (item.done)
+    M5.Display.fillRect(27, y + 17, 22, 22, COLOR_BLACK);
+
+  char shown[TODO_TEXT_CHARS + 1];
+  strlcpy(shown, item.text, sizeof(shown));
+  if (strlen(item.text) > TODO_TEXT_CHARS)
+    strcpy(shown + TODO_TEXT_CHARS - 3, "...");
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(item.done ? COLOR_GRAY : COLOR_BLACK);
+  M5.Display.setCursor(76, y + 20);
+  M5.Display.print(shown);
+  if (item.done)
+    M5.Display.drawFastHLine(76, y + 27, strlen(shown) * 12, COLOR_GRAY);
+
+  drawButton(720, y + 6, 100, 44, "EDIT");
+  drawButton(840, y + 6, 100, 44, "DEL");
+  M5.Display.drawFastHLine(0, y + TODO_ROW_H - 1, SCREEN_WIDTH, COLOR_GRAY);
+}
+
+void UIManager::drawTodoFooter() {
+  M5.Display.fillRect(0, TODO_FOOTER_Y, SCREEN_WIDTH,
+                      SCREEN_HEIGHT - TODO_FOOTER_Y, COLOR_WHITE);
+  M5.Display.drawFastHLine(0, TODO_FOOTER_Y, SCREEN_WIDTH, COLOR_BLACK);
+  int pages = todoPages(_todo.log.size());
+  if (pages > 1) {
+    drawButton(10, TODO_FOOTER_Y + 8, 100, 50, "<");
+    drawButton(SCREEN_WIDTH - 110, TODO_FOOTER_Y + 8, 100, 50, ">");
+  }
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(SCREEN_WIDTH / 2 - 110, TODO_FOOTER_Y + 26);
+  M5.Display.printf("Page %d/%d  %d items", _todo.page + 1, pages,
+                    _todo.log.size());
+}
+
+void UIManager::drawTodoScreen() {
+  M5.Display.fillScreen(COLOR_WHITE);
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(20, 15);
+  M5.Display.print("To-Do");
+
+  drawButton(SCREEN_WIDTH - 210, 10, 120, 40, "ADD", true);
+  _hits.add(SCREEN_WIDTH - 210, 10, 120, 40, [this](int, int) {
+    if (!_todo.log.isLoaded() || _todo.log.size() >= TodoLog::MAX_ITEMS) {
+      Buzzer::error();
+      return;
+    }
+    Buzzer::click();
+    _todo.editing = -1;
+    openKeyboard(TextField::TODO_ITEM);
+  });
+  drawButton(SCREEN_WIDTH - 80, 10, 70, 40, "X");
+  _hits.add(SCREEN_WIDTH - 80, 10, 70, 40, [this](int, int) {
+    Buzzer::click();
+    navigateTo(ScreenID::NOTES_BROWSE);
+  });
+  M5.Display.drawLine(0, 60, SCREEN_WIDTH, 60, COLOR_BLACK);
+
+  if (!_todo.log.isLoaded()) {
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(40, 200);
+    M5.Display.print("No storage for the list: insert the SD card");
+    return;
+  }
+  for (int slot = 0; slot < TODO_ROWS; slot++)
+    drawTodoRow(slot);
+  drawTodoFooter();
+  if (_todo.log.size() == 0) {
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(COLOR_GRAY);
+    M5.Display.setCursor(40, 200);
+    M5.Display.print("Nothing to do. ADD puts an item on the list.");
+  }
+
+  // Rows look up their item when tapped, so a tick or a delete repaints
+  // rows without registering targets again
+  for (int slot = 0; slot < TODO_ROWS; slot++) {
+    int y = TODO_ROW_Y + slot * TODO_ROW_H;
+    _hits.add(0, y, 710, TODO_ROW_H, [this, slot](int, int) {
+      int row = _todo.page * TODO_ROWS + slot;
+      if (row >= _todo.log.size())
+        return;
+      if (!_todo.log.setDone(row, !_todo.log[row].done)) {
+        Buzzer::error();
+        return;
+      }
+      Buzzer::click();
+      _refresh.apply(RegionKind::TEXT);
+      M5.Display.startWrite();
+      drawTodoRow(slot);
+      M5.Display.endWrite();
+      M5.Display.display();
+    });
+    _hits.add(720, y + 6, 100, 44, [this, slot](int, int) {
+      int row = _todo.page * TODO_ROWS + slot;
+      if (row >= _todo.log.size())
+        return;
+      Buzzer::click();
+      _todo.editing = row;
+      openKeyboard(TextField::TODO_ITEM);
+    });
+    _hits.add(840, y + 6, 100, 44, [this, slot](int, int) {
+      int row = _todo.page * TODO_ROWS + slot;
+      if (row >= _todo.log.size())
+        return;
+      if (!_todo.log.remove(row)) {
+        Buzzer::error();
+        return;
+      }
+      Buzzer::click();
+      // The page emptied: the one before it, drawn whole
+      if (_todo.page > 0 && _todo.page * TODO_ROWS >= _todo.log.size()) {
+        _todo.page--;
+        _needsRefresh = true;
+        _lastRefresh = 0;
+        return;
+      }
+      todoRepaint(slot); // The rows below move up one
+    });
+  }
+
+  if (todoPages(_todo.log.size()) > 1) {
+    _hits.add(10, TODO_FOOTER_Y + 8, 100, 50, [this](int, int) {
+      Buzzer::click();
+      int pages = todoPages(_todo.log.size());
+      _todo.page = (_todo.page + pages - 1) % pages;
+      todoRepaint(0);
+    });
+    _hits.add(SCREEN_WIDTH - 110, TODO_FOOTER_Y + 8, 100, 50,
+              [this](int, int) {
+                Buzzer::click();
+                _todo.page = (_todo.page + 1) % todoPages(_todo.log.size());
+                todoRepaint(0);
+              });
+  }
+}
+
+#endif // APP_NOTES
@@ -0,0 +1,169 @@
+/**
+ * UI Manager - Weather
+ * The next 24 hours for the configured city, drawn from the cached report
+ */
+
+#include "../hardware/buzzer.h"
+#include "../net/weather.h"
+#include "ui_manager.h"
+#include <time.h>
+
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+// Forecast strip: one column per 3-hour slot
+static const int WEATHER_STRIP_Y = 250;
+static const int WEATHER_STRIP_H = 180;
+
+// Tenths to the nearest whole unit
+static int whole(int tenths) {
+  return (tenths + (tenths >= 0 ? 5 : -5)) / 10;
+}
+
+// Wall time at the city for a UTC slot time
+static struct tm cityTime(uint32_t utc, int32_t tzOffset) {
+  time_t t = (time_t)utc + tzOffset;
+  struct tm out;
+  gmtime_r(&t, &out);
+  return out;
+}
+
+static const char *statusText(const WeatherService &w) {
+  static char buf[32];
+  switch (w.status()) {
+  case WeatherService::Status::NOT_SET_UP:
+    return "Set the API key, city and WiFi in the config";
+  case WeatherService::Status::FETCHING:
+    return "Updating...";
+  case WeatherService::Status::NO_WIFI:
+    return "WiFi not reachable";
+  case WeatherService::Status::HTTP_ERROR:
+    if (w.httpCode() <= 0)
+      return "Server not reachable";
+    snprintf(buf, sizeof(buf), "Server answered HTTP %d", w.httpCode());
+    return buf;
+  case WeatherService::Status::BAD_DATA:
+    return "Forecast unreadable";
+  default:
+    return nullptr;
+  }
+}
+
+// ============================================================================
+// Screen hooks
+// ============================================================================
+
+void UIManager::updateWeatherScreen() {
+  if (weather && weather->generation() != _weatherShown)
+    forceRefresh();
+}
+
+void UIManager::weatherSummary(char *buf, size_t len) const {
+  const WeatherService::Slot *now = weather ? weather->current() : nullptr;
+  if (!now) {
+    buf[0] = '\0';
+    return;
+  }
+  snprintf(buf, len, "%d%s %s, %d%% rain", whole(now->temp10),
+           weather->tempUnit(), WeatherService::condition(now->code),
+           now->pop);
+}
+
+// ============================================================================
+// Drawing
+// ============================================================================
+
+void UIManager::drawWeatherScreen() {
+  M5.Display.fillScreen(COLOR_WHITE);
+  drawMenuBar();
+  if (!weather)
+    return;
+  _weatherShown = weather->generation();
+  const WeatherService::Report &r = weather->report();
+
+  // Title: the place as the service names it
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setTextSize(4);
+  M5.Display.setCursor(20, 20);
+  M5.Display.print(weather->hasReport() ? r.place : "Weather");
+
+  bool fetching = weather->status() == WeatherService::Status::FETCHING;
+  drawButton(SCREEN_WIDTH - 220, 15, 200, 60,
+             fetching ? "Updating" : "Refresh", fetching);
+  _hits.add(SCREEN_WIDTH - 220, 15, 200, 60, [this](int, int) {
+    Buzzer::click();
+    weather->refresh();
+  });
+
+  // Status under the title: the last check, or what went wrong
+  M5.Display.setTextSize(2);
+  M5.Display.setCursor(20, 70);
+  const char *status = statusText(*weather);
+  if (status) {
+    M5.Display.print(status);
+  } else if (weather->hasReport()) {
+    struct tm t;
+    time_t fetched = r.fetched;
+    localtime_r(&fetched, &t);
+    M5.Display.printf("Updated %02d:%02d%s", t.tm_hour, t.tm_min,
+                      weather->isFresh() ? "" : " (old)");
+  }
+
+  const WeatherService::Slot *now = weather->current();
+  if (!now) {
+    M5.Display.setTextSize(3);
+    M5.Display.setCursor(20, 140);
+    M5.Display.print("No forecast yet");
+    return;
+  }
+
+  // Now: temperature large, the rest beside it
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%d%s", whole(now->temp10), weather->tempUnit());
+  M5.Display.setTextSize(8);
+  M5.Display.setCursor(40, 120);
+  M5.Display.print(buf);
+  M5.Display.setTextSize(4);
+  M5.Display.setCursor(360, 120);
+  M5.Display.print(WeatherService::condition(now->code));
+  M5.Display.setTextSize(2);
+  M5.Display.setCursor(360, 170);
+  M5.Display.printf("Humidity %d%%  Wind %d.%d %s", now->humidity,
+                    now->wind10 / 10, abs(now->wind10 % 10),
+                    strcmp(r.units, "imperial") == 0 ? "mph" : "m/s");
+  M5.Display.setCursor(360, 195);
+  M5.Display.printf("Rain %d%%", now->pop);
+
+  // Strip: time, temperature, condition, chance of rain
+  int colW = (SCREEN_WIDTH - 40) / WeatherService::SLOTS;
+  M5.Display.drawLine(20, WEATHER_STRIP_Y, SCREEN_WIDTH - 20, WEATHER_STRIP_Y,
+                      COLOR_GRAY);
+  for (int i = 0; i < r.count; i++) {
+    const WeatherService::Slot &s = r.slots[i];
+    int x = 20 + i * colW;
+    if (i > 0)
+      M5.Display.drawLine(x, WEATHER_STRIP_Y + 10, x,
+                          WEATHER_STRIP_Y + WEATHER_STRIP_H - 10, COLOR_GRAY);
+    if (&s == now)
+      M5.Display.drawRect(x + 2, WEATHER_STRIP_Y + 4, colW - 4,
+                          WEATHER_STRIP_H - 8, COLOR_BLACK);
+
+    struct tm t = cityTime(s.time, r.tzOffset);
+    M5.Display.setTextDatum(top_center);
+    M5.Display.setTextSize(2);
+    snprintf(buf, sizeof(buf), "%02d:00", t.tm_hour);
+    M5.Display.drawString(buf, x + colW / 2, WEATHER_STRIP_Y + 20);
+    M5.Display.setTextSize(3);
+    snprintf(buf, sizeof(buf), "%d", whole(s.temp10));
+    M5.Display.drawString(buf, x + colW / 2, WEATHER_STRIP_Y + 60);
+    M5.Display.setTextSize(2);
+    M5.Display.drawString(WeatherService::condition(s.code), x + colW / 2,
+                          WEATHER_STRIP_Y + 105);
+    snprintf(buf, sizeof(buf), "%d%%", s.pop);
+    M5.Display.drawString(buf, x + colW / 2, WEATHER_STRIP_Y + 140);
+    M5.Display.setTextDatum(top_left);
+  }
+  M5.Display.drawLine(20, WEATHER_STRIP_Y + WEATHER_STRIP_H, SCREEN_WIDTH - 20,
+                      WEATHER_STRIP_Y + WEATHER_STRIP_H, COLOR_GRAY);
+}
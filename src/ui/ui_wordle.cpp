@@ -0,0 +1,407 @@
+/**
+ * UI Manager - Wordle
+ * Six guesses at a five-letter word, typed on an on-screen keyboard
+ */
+
+#include "../hardware/buzzer.h"
+#include "../utils/record_file.h"
+#include "../utils/sd_manager.h"
+#include "../utils/log.h"
+#include "ui_manager.h"
+#include <algorithm>
+#include <esp_random.h>
+
+#if APP_GAMES
+
+#define COLOR_BLACK 0x0000
+#define COLOR_DARK_GRAY 0x4208
+#define COLOR_GRAY 0x8410
+#define COLOR_LIGHT_GRAY 0xC618
+#define COLOR_WHITE 0xFFFF
+
+extern SDManager *sdManager;
+
+// Guesses on the left, the keyboard under the messages on the right
+static const int WORDLE_GRID_X = 60;
+static const int WORDLE_GRID_Y = 100;
+static const int WORDLE_TILE = 62;
+static const int WORDLE_GAP = 8;
+static const int WORDLE_KEYS_X = 446;
+static const int WORDLE_KEYS_Y = 260;
+static const int WORDLE_KEY_W = 45;
+static const int WORDLE_KEY_H = 68;
+static const int WORDLE_KEY_GAP = 6;
+static const int WORDLE_WIDE_KEY_W = 72; // ENTER and DEL
+
+static const char *WORDLE_RECORD = "/games/saves/wordle.rec";
+
+struct WordleRecord {
+  static const uint16_t RECORD_TYPE = 0x5744; // "WD"
+  static const uint16_t RECORD_VERSION = 1;
+  uint32_t stamp; // Dictionary the answer came from
+  char answer[Wordle::LENGTH + 1];
+  char guesses[Wordle::MAX_GUESSES][Wordle::LENGTH + 1];
+  uint8_t rows;
+  uint8_t over;
+  uint16_t played;
+  uint16_t won;
+  uint16_t streak;
+  uint16_t bestStreak;
+  uint16_t solvedIn[Wordle::MAX_GUESSES];
+};
+
+// ============================================================================
+// Screen hooks
+// ============================================================================
+
+void UIManager::enterWordle() {
+  _wordle.message = nullptr;
+  _wordle.solver.begin();
+  if (!_wordle.dict.open()) {
+    _wordle.message = "No dictionary";
+    return;
+  }
+  if (!wordleLoad())
+    wordleNewGame();
+}
+
+void UIManager::exitWordle() {
+  // The worker reads the solver's tables: it has to be idle before the
+  // free
+  _wordle.solver.stop();
+  wordleSave();
+  _wordle.dict.close();
+}
+
+void UIManager::updateWordle() {
+  WordleSolver::Result result;
+  if (!_wordle.solver.poll(result) || result.rows != _wordle.rows ||
+      _wordle.over)
+    return;
+  if (!result.guess[0]) {
+    wordleShowMessage("No answer fits");
+    return;
+  }
+  char word[Wordle::LENGTH + 1];
+  for (int i = 0; i <= Wordle::LENGTH; i++)
+    word[i] = toupper(result.guess[i]);
+  snprintf(_wordle.hint, sizeof(_wordle.hint), "%s: %.1f bits, %d left",
+           word, result.bits, result.candidates);
+  wordleShowMessage(_wordle.hint);
+}
+
+void UIManager::wordleRequestHint() {
+  if (_wordle.over || _wordle.solver.busy())
+    return;
+  // The word list is read into PSRAM on the first hint of a visit
+  if (!_wordle.solver.load(_wordle.dict)) {
+    wordleShowMessage("No memory for hints");
+    return;
+  }
+  if (_wordle.solver.request(_wordle.guesses, _wordle.marks, _wordle.rows,
+                             WordleSolver::HINT_BUDGET_MS))
+    wordleShowMessage("Thinking...");
+}
+
+bool UIManager::wordleLoad() {
+  WordleRecord record;
+  if (!sdManager || !sdManager->isAvailable() ||
+      !RecordFile::load(WORDLE_RECORD, record))
+    return false;
+  _wordle.stats.played = record.played;
+  _wordle.stats.won = record.won;
+  _wordle.stats.streak = record.streak;
+  _wordle.stats.bestStreak = record.bestStreak;
+  memcpy(_wordle.stats.solvedIn, record.solvedIn, sizeof(record.solvedIn));
+
+  // A game from other word lists is not picked up again
+  if (record.stamp != _wordle.dict.stamp() ||
+      record.rows > Wordle::MAX_GUESSES)
+    return false;
+  record.answer[Wordle::LENGTH] = '\0';
+  memcpy(_wordle.answer, record.answer, sizeof(_wordle.answer));
+  _wordle.rows = 0;
+  _wordle.typed = 0;
+  _wordle.over = record.over;
+  for (int r = 0; r < record.rows; r++) {
+    memcpy(_wordle.guesses[r], record.guesses[r], Wordle::LENGTH);
+    Wordle::score(_wordle.guesses[r], _wordle.answer, _wordle.marks[r]);
+    _wordle.rows++;
+  }
+  return true;
+}
+
+void UIManager::wordleSave() {
+  if (!_wordle.answer[0] || !sdManager || !sdManager->isAvailable())
+    return;
+  WordleRecord record = {};
+  record.stamp = _wordle.dict.stamp();
+  memcpy(record.answer, _wordle.answer, sizeof(record.answer));
+  for (int r = 0; r < _wordle.rows; r++)
+    memcpy(record.guesses[r], _wordle.guesses[r], Wordle::LENGTH);
+  record.rows = _wordle.rows;
+  record.over = _wordle.over;
+  record.played = _wordle.stats.played;
+  record.won = _wordle.stats.won;
+  record.streak = _wordle.stats.streak;
+  record.bestStreak = _wordle.stats.bestStreak;
+  memcpy(record.solvedIn, _wordle.stats.solvedIn, sizeof(record.solvedIn));
+  RecordFile::saveDeferred(WORDLE_RECORD, record);
+}
+
+void UIManager::wordleNewGame() {
+  int n = esp_random() % _wordle.dict.answerCount();
+  if (!_wordle.dict.answer(n, _wordle.answer)) {
+    _wordle.answer[0] = '\0';
+    _wordle.message = "Dictionary unreadable";
+    return;
+  }
+  _wordle.solver.cancel();
+  memset(_wordle.guesses, 0, sizeof(_wordle.guesses));
+  _wordle.rows = 0;
+  _wordle.typed = 0;
+  _wordle.over = false;
+  _wordle.message = nullptr;
+  wordleSave();
+}
+
+// ============================================================================
+// Input
+// ============================================================================
+
+void UIManager::wordleKey(char key) {
+  if (_wordle.over || !_wordle.answer[0])
+    return;
+  char *row = _wordle.guesses[_wordle.rows];
+
+  // Letters and delete only touch the row being typed
+  if (key != '\n') {
+    if (key == '\b' && _wordle.typed > 0)
+      row[--_wordle.typed] = '\0';
+    else if (key >= 'a' && key <= 'z' && _wordle.typed < Wordle::LENGTH)
+      row[_wordle.typed++] = key;
+    else
+      return;
+    _refresh.apply(RegionKind::TEXT);
+    M5.Display.startWrite();
+    for (int c = 0; c < Wordle::LENGTH; c++)
+      drawWordleTile(_wordle.rows, c);
+    M5.Display.endWrite();
+    M5.Display.display();
+    return;
+  }
+
+  if (_wordle.typed < Wordle::LENGTH) {
+    wordleShowMessage("Not enough letters");
+    return;
+  }
+  uint32_t start = micros();
+  bool known = _wordle.dict.contains(row);
+  LOG_D("Wordle", "Lookup %s: %s, %lu us", row, known ? "found" : "missing",
+        (unsigned long)(micros() - start));
+  if (!known) {
+    wordleShowMessage("Not in word list");
+    return;
+  }
+
+  // Any hint under way is for the guesses before this one
+  _wordle.solver.cancel();
+  Wordle::score(row, _wordle.answer, _wordle.marks[_wordle.rows]);
+  bool won = Wordle::solved(_wordle.marks[_wordle.rows]);
+  _wordle.rows++;
+  _wordle.typed = 0;
+  if (won || _wordle.rows == Wordle::MAX_GUESSES) {
+    _wordle.over = true;
+    _wordle.stats.played++;
+    if (won) {
+      _wordle.stats.won++;
+      _wordle.stats.solvedIn[_wordle.rows - 1]++;
+      _wordle.stats.streak++;
+      _wordle.stats.bestStreak =
+          std::max(_wordle.stats.bestStreak, _wordle.stats.streak);
+    } else {
+      _wordle.stats.streak = 0;
+    }
+  }
+  _wordle.message = nullptr;
+  wordleSave();
+  _needsRefresh = true;
+  _lastRefresh = 0;
+}
+
+void UIManager::wordleShowMessage(const char *text) {
+  _wordle.message = text;
+  _refresh.apply(RegionKind::TEXT);
+  M5.Display.startWrite();
+  drawWordleMessage();
+  M5.Display.endWrite();
+  M5.Display.display();
+}
+
+// ============================================================================
+// Drawing
+// ============================================================================
+
+void UIManager::drawWordleTile(int row, int col) {
+  int x = WORDLE_GRID_X + col * (WORDLE_TILE + WORDLE_GAP);
+  int y = WORDLE_GRID_Y + row * (WORDLE_TILE + WORDLE_GAP);
+  char letter = _wordle.guesses[row][col];
+  Wordle::Mark mark = row < _wordle.rows ? _wordle.marks[row][col]
+                                        : Wordle::UNKNOWN;
+
+  // Black in place, dark gray elsewhere in the word, light gray absent;
+  // typed letters get a heavy outline
+  uint16_t fill = mark == Wordle::CORRECT   ? COLOR_BLACK
+                  : mark == Wordle::PRESENT ? COLOR_DARK_GRAY
+                  : mark == Wordle::ABSENT  ? COLOR_LIGHT_GRAY
+                                            : COLOR_WHITE;
+  M5.Display.fillRect(x, y, WORDLE_TILE, WORDLE_TILE, fill);
+  if (mark == Wordle::UNKNOWN) {
+    uint16_t edge = letter ? COLOR_BLACK : COLOR_GRAY;
+    for (int t = 0; t < (letter ? 3 : 2); t++)
+      M5.Display.drawRect(x + t, y + t, WORDLE_TILE - 2 * t,
+                          WORDLE_TILE - 2 * t, edge);
+  }
+  if (!letter)
+    return;
+  M5.Display.setTextSize(4);
+  M5.Display.setTextColor(mark == Wordle::CORRECT || mark == Wordle::PRESENT
+                              ? COLOR_WHITE
+                              : COLOR_BLACK);
+  M5.Display.setCursor(x + (WORDLE_TILE - 24) / 2, y + (WORDLE_TILE - 32) / 2);
+  M5.Display.print((char)toupper(letter));
+}
+
+void UIManager::drawWordleMessage() {
+  M5.Display.fillRect(WORDLE_KEYS_X, 70, SCREEN_WIDTH - WORDLE_KEYS_X, 170,
+                      COLOR_WHITE);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setTextSize(3);
+  M5.Display.setCursor(WORDLE_KEYS_X, 90);
+  if (_wordle.message) {
+    M5.Display.print(_wordle.message);
+  } else if (_wordle.over && Wordle::solved(_wordle.marks[_wordle.rows - 1])) {
+    M5.Display.printf("Solved in %d", _wordle.rows);
+  } else if (_wordle.over) {
+    M5.Display.printf("It was %c%c%c%c%c", toupper(_wordle.answer[0]),
+                      toupper(_wordle.answer[1]), toupper(_wordle.answer[2]),
+                      toupper(_wordle.answer[3]), toupper(_wordle.answer[4]));
+  } else {
+    M5.Display.printf("Guess %d of %d", _wordle.rows + 1,
+                      Wordle::MAX_GUESSES);
+  }
+
+  // Record: played, won, streaks, and how many guesses the wins took
+  M5.Display.setTextSize(2);
+  M5.Display.setTextColor(COLOR_DARK_GRAY);
+  M5.Display.setCursor(WORDLE_KEYS_X, 140);
+  M5.Display.printf("Played %u  won %u  streak %u  best %u",
+                    _wordle.stats.played, _wordle.stats.won,
+                    _wordle.stats.streak, _wordle.stats.bestStreak);
+  M5.Display.setCursor(WORDLE_KEYS_X, 170);
+  M5.Display.print("Solved in (guesses: games)");
+  M5.Display.setCursor(WORDLE_KEYS_X, 200);
+  for (int i = 0; i < Wordle::MAX_GUESSES; i++)
+    M5.Display.printf("%d: %u  ", i + 1, _wordle.stats.solvedIn[i]);
+}
+
+void UIManager::drawWordleKey(int x, int y, int w, const char *label,
+                              char key) {
+  // A letter key shows the best mark its letter has had
+  Wordle::Mark best = Wordle::UNKNOWN;
+  for (int r = 0; r < _wordle.rows && key >= 'a'; r++) {
+    for (int c = 0; c < Wordle::LENGTH; c++) {
+      if (_wordle.guesses[r][c] == key && _wordle.marks[r][c] > best)
+        best = _wordle.marks[r][c];
+    }
+  }
+  uint16_t fill = best == Wordle::CORRECT   ? COLOR_BLACK
+                  : best == Wordle::PRESENT ? COLOR_DARK_GRAY
+                  : best == Wordle::ABSENT  ? COLOR_LIGHT_GRAY
+                                            : COLOR_WHITE;
+  M5.Display.fillRect(x, y, w, WORDLE_KEY_H, fill);
+  M5.Display.drawRect(x, y, w, WORDLE_KEY_H, COLOR_BLACK);
+  bool wide = strlen(label) > 1;
+  M5.Display.setTextSize(wide ? 2 : 3);
+  M5.Display.setTextColor(best >= Wordle::PRESENT ? COLOR_WHITE
+                                                  : COLOR_BLACK);
+  int cw = wide ? 12 : 18, ch = wide ? 16 : 24;
+  M5.Display.setCursor(x + (w - cw * (int)strlen(label)) / 2,
+                       y + (WORDLE_KEY_H - ch) / 2);
+  M5.Display.print(label);
+  _hits.add(x, y, w, WORDLE_KEY_H, [this, key](int, int) {
+    Buzzer::click();
+    wordleKey(key);
+  });
+}
+
+void UIManager::drawWordle() {
+  M5.Display.setEpdMode(epd_mode_t::epd_fastest);
+  M5.Display.fillScreen(COLOR_WHITE);
+
+  M5.Display.setTextSize(3);
+  M5.Display.setTextColor(COLOR_BLACK);
+  M5.Display.setCursor(30, 20);
+  M5.Display.print("WORDLE");
+
+  drawButton(590, 10, 110, 40, "HINT");
+  drawButton(720, 10, 110, 40, "NEW");
+  drawButton(850, 10, 100, 40, "HOME");
+  _hits.add(850, 10, 100, 40, [this](int, int) {
+    Buzzer::click();
+    navigateTo(ScreenID::HOME);
+  });
+
+  if (!_wordle.dict.isOpen() || !_wordle.answer[0]) {
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(60, 120);
+    M5.Display.printf("%s. Make one with tools/make_wordle.py",
+                      _wordle.message ? _wordle.message : "No dictionary");
+    M5.Display.setCursor(60, 150);
+    M5.Display.printf("and copy it to %s on the card.", Wordle::CARD_PATH);
+    return;
+  }
+  _hits.add(590, 10, 110, 40, [this](int, int) {
+    Buzzer::click();
+    wordleRequestHint();
+  });
+  _hits.add(720, 10, 110, 40, [this](int, int) {
+    Buzzer::click();
+    // Giving up on a game in play counts as a loss
+    if (!_wordle.over && _wordle.rows > 0) {
+      _wordle.stats.played++;
+      _wordle.stats.streak = 0;
+    }
+    wordleNewGame();
+    _refresh.forceClean();
+    _needsRefresh = true;
+    _lastRefresh = 0;
+  });
+
+  for (int r = 0; r < Wordle::MAX_GUESSES; r++) {
+    for (int c = 0; c < Wordle::LENGTH; c++)
+      drawWordleTile(r, c);
+  }
+  drawWordleMessage();
+
+  // QWERTY, the middle row set in by half a key, ENTER and DEL either
+  // side of the bottom one
+  static const char *const ROWS[] = {"qwertyuiop", "asdfghjkl", "zxcvbnm"};
+  int pitch = WORDLE_KEY_W + WORDLE_KEY_GAP;
+  for (int r = 0; r < 3; r++) {
+    int x = WORDLE_KEYS_X + (r == 1 ? pitch / 2 : 0);
+    int y = WORDLE_KEYS_Y + r * (WORDLE_KEY_H + 8);
+    if (r == 2) {
+      drawWordleKey(x, y, WORDLE_WIDE_KEY_W, "ENTER", '\n');
+      x += WORDLE_WIDE_KEY_W + WORDLE_KEY_GAP;
+    }
+    for (const char *k = ROWS[r]; *k; k++, x += pitch) {
+      char label[2] = {(char)toupper(*k), '\0'};
+      drawWordleKey(x, y, WORDLE_KEY_W, label, *k);
+    }
+    if (r == 2)
+      drawWordleKey(x, y, WORDLE_WIDE_KEY_W, "DEL", '\b');
+  }
+}
+
+#endif // APP_GAMES
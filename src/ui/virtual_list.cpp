@@ -0,0 +1,139 @@
+/**
+ * Virtual List Implementation
+ */
+
+#include "virtual_list.h"
+#include "../utils/mem_telemetry.h"
+#include "raster4.h"
+
+// Colors for eInk (grayscale) - same values as ui_manager.cpp
+#define COLOR_WHITE 0xFFFF
+
+VirtualList::VirtualList()
+    : _x(0), _y(0), _w(0), _rowH(0), _gap(0), _rows(0), _count(0), _first(0),
+      _selected(-1) {
+  for (Slot &slot : _slots)
+    slot = {nullptr, -1, false};
+}
+
+void VirtualList::layout(int x, int y, int w, int rowH, int gap, int rows) {
+  if (rows > MAX_ROWS)
+    rows = MAX_ROWS;
+  if (w != _w || rowH != _rowH)
+    release(); // Sprites of the old size
+  _x = x;
+  _y = y;
+  _w = w;
+  _rowH = rowH;
+  _gap = gap;
+  _rows = rows;
+  invalidate();
+}
+
+void VirtualList::setSource(int count, const Painter &paint) {
+  _paint = paint;
+  setCount(count);
+}
+
+void VirtualList::setCount(int count) {
+  _count = count;
+  int last = _count > _rows ? _count - _rows : 0;
+  if (_first > last)
+    _first = last;
+  if (_selected >= _count)
+    _selected = _count - 1;
+  invalidate();
+}
+
+bool VirtualList::scrollBy(int delta) {
+  int last = _count > _rows ? _count - _rows : 0;
+  int first = _first + delta;
+  if (first > last)
+    first = last;
+  if (first < 0)
+    first = 0;
+  if (first == _first)
+    return false;
+  _first = first;
+  return true;
+}
+
+void VirtualList::scrollToShow(int index) {
+  if (index < _first)
+    scrollBy(index - _first);
+  else if (index >= _first + _rows)
+    scrollBy(index - _first - _rows + 1);
+}
+
+int VirtualList::indexAt(int x, int y) const {
+  if (x < _x || x >= _x + _w || y < _y)
+    return -1;
+  int row = (y - _y) / (_rowH + _gap);
+  if (row >= _rows || (y - _y) % (_rowH + _gap) >= _rowH)
+    return -1;
+  int index = _first + row;
+  return index < _count ? index : -1;
+}
+
+void VirtualList::invalidate() {
+  for (Slot &slot : _slots)
+    slot.index = -1;
+}
+
+bool VirtualList::allocate(Slot &slot) {
+  if (slot.canvas)
+    return true;
+  slot.canvas = new M5Canvas(&M5.Display);
+  slot.canvas->setColorDepth(4);
+  slot.canvas->setPsram(true);
+  if (!slot.canvas->createSprite(_w, _rowH)) {
+    Serial.printf("UI: List row %dx%d allocation failed\n", _w, _rowH);
+    delete slot.canvas;
+    slot.canvas = nullptr;
+    return false;
+  }
+  MemTelemetry::track(MemTelemetry::Tag::UI, slot.canvas->bufferLength());
+  return true;
+}
+
+int VirtualList::draw(LovyanGFX &g) {
+  int painted = 0;
+  for (int row = 0; row < _rows; row++) {
+    int index = _first + row;
+    int y = _y + row * (_rowH + _gap);
+    if (index >= _count || !_paint) {
+      g.fillRect(_x, y, _w, _rowH, COLOR_WHITE);
+      continue;
+    }
+
+    // An item keeps its slot while it stays in view
+    Slot &slot = _slots[index % _rows];
+    bool selected = index == _selected;
+    if (!allocate(slot)) {
+      g.fillRect(_x, y, _w, _rowH, COLOR_WHITE);
+      _paint(g, index, _x, y, _w, _rowH, selected); // No PSRAM: direct
+      painted++;
+      continue;
+    }
+    if (slot.index != index || slot.selected != selected) {
+      Raster4::clear(*slot.canvas);
+      _paint(*slot.canvas, index, 0, 0, _w, _rowH, selected);
+      slot.index = index;
+      slot.selected = selected;
+      painted++;
+    }
+    slot.canvas->pushSprite(&g, _x, y);
+  }
+  return painted;
+}
+
+void VirtualList::release() {
+  for (Slot &slot : _slots) {
+    if (slot.canvas) {
+      MemTelemetry::track(MemTelemetry::Tag::UI,
+                          -(long)slot.canvas->bufferLength());
+      delete slot.canvas;
+    }
+    slot = {nullptr, -1, false};
+  }
+}
@@ -0,0 +1,113 @@
+/**
+ * Virtual List
+ *
+ * A scrolling list that only ever draws the rows in view. Items come from
+ * a painter callback given an index, so a list of thousands costs no more
+ * than one screenful; the caller keeps the data (an index file, a vector
+ * of names) and tells the list how many items there are.
+ *
+ * Each visible row is rendered into a 4-bit row sprite in PSRAM. Sprites
+ * are slotted by item index modulo the rows shown, so scrolling by a row
+ * keeps every sprite still in view and paints just the one coming in;
+ * draw() then pushes the rows, and the caller's display() refreshes only
+ * the list's viewport.
+ *
+ * If PSRAM allocation fails, rows are painted straight to the target
+ * instead, so callers never need a second code path.
+ */
+
+#ifndef VIRTUAL_LIST_H
+#define VIRTUAL_LIST_H
+
+#include <M5Unified.h>
+#include <functional>
+
+class VirtualList {
+public:
+  /**
+   * Paint item index as a w x h row at (ox, oy) of g
+   */
+  typedef std::function<void(LovyanGFX &g, int index, int ox, int oy, int w,
+                             int h, bool selected)>
+      Painter;
+
+  static const int MAX_ROWS = 12;
+
+  VirtualList();
+  ~VirtualList() { release(); }
+
+  /**
+   * Place the viewport: rows of w x rowH at (x, y), gap pixels apart
+   */
+  void layout(int x, int y, int w, int rowH, int gap, int rows);
+
+  /**
+   * Items and how to paint them; every row repaints
+   */
+  void setSource(int count, const Painter &paint);
+
+  /**
+   * The item count changed (a delete, a rescan); keeps the scroll in range
+   */
+  void setCount(int count);
+
+  int count() const { return _count; }
+  int first() const { return _first; }
+  int rows() const { return _rows; }
+  int bottom() const { return _y + _rows * (_rowH + _gap) - _gap; }
+  bool canScrollUp() const { return _first > 0; }
+  bool canScrollDown() const { return _first + _rows < _count; }
+
+  /**
+   * Move the first visible item by delta, clamped to the list
+   * @return false if it did not move
+   */
+  bool scrollBy(int delta);
+
+  /**
+   * Scroll the least distance that brings index into view
+   */
+  void scrollToShow(int index);
+
+  int selected() const { return _selected; }
+  void setSelected(int index) { _selected = index; }
+
+  /**
+   * Item under (x, y), -1 for a gap, an empty row or outside the list
+   */
+  int indexAt(int x, int y) const;
+
+  /**
+   * Repaint every row on the next draw (the items' contents changed)
+   */
+  void invalidate();
+
+  /**
+   * Paint the rows that changed and push every row in view to g
+   * @return rows painted (the rest were already in their sprites)
+   */
+  int draw(LovyanGFX &g);
+
+  /**
+   * Free the row sprites (the screen was left)
+   */
+  void release();
+
+private:
+  struct Slot {
+    M5Canvas *canvas;
+    int index; // Item painted into the sprite, -1 if none
+    bool selected;
+  };
+
+  Slot _slots[MAX_ROWS];
+  Painter _paint;
+  int _x, _y, _w, _rowH, _gap, _rows;
+  int _count;
+  int _first;
+  int _selected;
+
+  bool allocate(Slot &slot);
+};
+
+#endif // VIRTUAL_LIST_H
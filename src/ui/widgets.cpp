@@ -0,0 +1,353 @@
+/**
+ * Retained-Mode Widgets Implementation
+ */
+
+#include "widgets.h"
+
+// Colors for eInk (grayscale) - same values as ui_manager.cpp
+#define COLOR_BLACK 0x0000
+#define COLOR_GRAY 0x8410
+#define COLOR_WHITE 0xFFFF
+
+// ============================================================================
+// Shared paint primitives
+// ============================================================================
+
+namespace Paint {
+
+void button(LovyanGFX &g, int x, int y, int w, int h, const char *label,
+            bool selected) {
+  if (selected) {
+    g.fillRect(x, y, w, h, COLOR_BLACK);
+    g.setTextColor(COLOR_WHITE);
+  } else {
+    g.drawRect(x, y, w, h, COLOR_BLACK);
+    g.setTextColor(COLOR_BLACK);
+  }
+
+  // Center text
+  int textLen = g.textWidth(label);
+  g.setCursor(x + (w - textLen) / 2,
+              y + (h - 24) / 2); // 24 is approx height for Size 3
+  g.print(label);
+}
+
+void progressBar(LovyanGFX &g, int x, int y, int w, int h, float percent,
+                 bool thick) {
+  if (percent < 0)
+    percent = 0;
+  if (percent > 1)
+    percent = 1;
+
+  // Border
+  g.drawRect(x, y, w, h, COLOR_BLACK);
+
+  // Fill
+  int fillWidth = (int)((w - 4) * percent);
+  if (fillWidth > 0) {
+    g.fillRect(x + 2, y + 2, fillWidth, h - 4, COLOR_BLACK);
+  }
+
+  // If thick, draw second line
+  if (thick && h >= 16) {
+    g.drawRect(x, y + h / 2, w, h / 2, COLOR_BLACK);
+    if (fillWidth > 0) {
+      g.fillRect(x + 2, y + h / 2 + 2, fillWidth, h / 2 - 4, COLOR_BLACK);
+    }
+  }
+}
+
+void toggle(LovyanGFX &g, int x, int y, const char *label, bool active) {
+  g.setTextColor(COLOR_BLACK);
+  g.setTextSize(4);
+  g.setCursor(x, y);
+  g.print(label);
+
+  // Simplified state indicator below; filled box = "Black when On"
+  int indY = y + 40;
+  int boxSize = 30;
+  g.drawRect(x, indY, boxSize, boxSize, COLOR_BLACK);
+  if (active) {
+    g.fillRect(x, indY, boxSize, boxSize, COLOR_BLACK);
+  }
+}
+
+void panelFrame(LovyanGFX &g, int x, int y, int w, int h) {
+  g.drawRect(x, y, w, h, COLOR_BLACK);
+  g.drawRect(x + 1, y + 1, w - 2, h - 2, COLOR_GRAY);
+}
+
+} // namespace Paint
+
+// ============================================================================
+// Widgets
+// ============================================================================
+
+void LabelWidget::setText(const char *text) {
+  if (strncmp(_text, text, sizeof(_text)) == 0)
+    return;
+  strlcpy(_text, text, sizeof(_text));
+  _dirty = true;
+}
+
+void LabelWidget::setFont(const lgfx::IFont *font) {
+  if (font == _font)
+    return;
+  _font = font;
+  _dirty = true;
+}
+
+void LabelWidget::paint(LovyanGFX &g) {
+  if (_atlas && _atlas->draw(g, _x, _y, _text))
+    return;
+  g.setTextColor(COLOR_BLACK);
+  if (_font) {
+    g.setFont(_font);
+    g.setTextSize(1);
+    g.setTextDatum(top_left);
+    g.drawString(_text, _x, _y);
+    g.setFont(&fonts::Font0); // The rest of the UI uses the default
+    return;
+  }
+  g.setTextSize(_textSize);
+  g.setCursor(_x, _y);
+  g.print(_text);
+}
+
+void DigitsWidget::place(int x, int y, uint8_t textSize) {
+  if (x == _x && y == _y && textSize == _textSize)
+    return;
+  _x = x;
+  _y = y;
+  _textSize = textSize;
+  _h = 8 * textSize;
+  _w = strlen(_text) * cellWidth();
+  _shown[0] = '\0';
+  _dirty = true;
+}
+
+void DigitsWidget::setText(const char *text) {
+  if (strncmp(_text, text, sizeof(_text)) == 0)
+    return;
+  strlcpy(_text, text, sizeof(_text));
+  _w = strlen(_text) * cellWidth();
+  _dirty = true;
+}
+
+uint32_t DigitsWidget::changedCells() const {
+  size_t len = strlen(_text);
+  if (len != strlen(_shown))
+    return RESIZED;
+  uint32_t cells = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (_text[i] != _shown[i])
+      cells |= 1UL << i;
+  }
+  return cells;
+}
+
+void DigitsWidget::paintCell(LovyanGFX &g, int i) {
+  int cx = _x + i * cellWidth();
+  g.fillRect(cx, _y, cellWidth(), _h, COLOR_WHITE);
+  g.setTextColor(COLOR_BLACK);
+  g.setTextSize(_textSize);
+  g.setCursor(cx, _y);
+  g.print(_text[i]);
+  _shown[i] = _text[i];
+  if (changedCells() == 0)
+    _dirty = false;
+}
+
+void DigitsWidget::paint(LovyanGFX &g) {
+  g.setTextColor(COLOR_BLACK);
+  g.setTextSize(_textSize);
+  g.setCursor(_x, _y);
+  g.print(_text);
+  strlcpy(_shown, _text, sizeof(_shown));
+  _dirty = false;
+}
+
+void ButtonWidget::setSelected(bool selected) {
+  if (selected == _selected)
+    return;
+  _selected = selected;
+  _dirty = true;
+}
+
+void ButtonWidget::paint(LovyanGFX &g) {
+  Paint::button(g, _x, _y, _w, _h, _label, _selected);
+}
+
+void ProgressWidget::setValue(float percent) {
+  _percent = percent;
+  float p = percent < 0 ? 0 : (percent > 1 ? 1 : percent);
+  int fill = (int)((_w - 4) * p);
+  if (fill == _fill)
+    return;
+  _fill = fill;
+  _dirty = true;
+}
+
+void ProgressWidget::paint(LovyanGFX &g) {
+  Paint::progressBar(g, _x, _y, _w, _h, _percent, _thick);
+}
+
+void ToggleWidget::setActive(bool active) {
+  if (active == _active)
+    return;
+  _active = active;
+  _dirty = true;
+}
+
+void ToggleWidget::paint(LovyanGFX &g) {
+  Paint::toggle(g, _x, _y, _label, _active);
+}
+
+void PanelWidget::paint(LovyanGFX &g) {
+  Paint::panelFrame(g, _x, _y, _w, _h);
+  if (_title) {
+    g.setTextColor(COLOR_BLACK);
+    g.setTextSize(3);
+    g.setCursor(_x + 20, _y + 15);
+    g.print(_title);
+  }
+}
+
+void CustomWidget::setKey(uint32_t key) {
+  if (_hasKey && key == _key)
+    return;
+  _key = key;
+  _hasKey = true;
+  _dirty = true;
+}
+
+SparklineWidget::SparklineWidget(int x, int y, int w, int h, float fullScale)
+    : Widget(x, y, w, h), _fullScale(fullScale), _head(0), _canvas(nullptr),
+      _canvasValid(false) {
+  for (int i = 0; i < COLUMNS; i++)
+    _values[i] = -1;
+}
+
+SparklineWidget::~SparklineWidget() { delete _canvas; }
+
+void SparklineWidget::drawColumn(LovyanGFX &g, int x0, int y0, int column,
+                                 int16_t bar) {
+  int cw = columnWidth();
+  int x = x0 + column * cw;
+  g.fillRect(x, y0, cw, _h, COLOR_WHITE);
+  g.drawFastHLine(x, y0 + _h - 1, cw, COLOR_GRAY); // Baseline
+  if (bar > 0) // One pixel between bars
+    g.fillRect(x, y0 + _h - 1 - bar, cw > 1 ? cw - 1 : 1, bar, COLOR_BLACK);
+}
+
+void SparklineWidget::redraw() {
+  if (!_canvas) {
+    _canvas = new M5Canvas(&M5.Display);
+    _canvas->setColorDepth(4);
+    _canvas->setPsram(true);
+    if (!_canvas->createSprite(_w, _h)) {
+      delete _canvas;
+      _canvas = nullptr;
+      return;
+    }
+  }
+  for (int c = 0; c < COLUMNS; c++)
+    drawColumn(*_canvas, 0, 0, c, _values[(_head + c) % COLUMNS]);
+  _canvasValid = true;
+}
+
+void SparklineWidget::push(float value) {
+  int16_t bar = -1;
+  if (value >= 0) {
+    float p = value / _fullScale;
+    bar = (int16_t)((_h - 1) * (p > 1 ? 1 : p) + 0.5f);
+  }
+  _values[_head] = bar; // Overwrites the oldest
+  _head = (_head + 1) % COLUMNS;
+
+  if (_canvasValid) {
+    _canvas->scroll(-columnWidth(), 0);
+    drawColumn(*_canvas, 0, 0, COLUMNS - 1, bar);
+  }
+  _dirty = true;
+}
+
+void SparklineWidget::reset() {
+  for (int i = 0; i < COLUMNS; i++)
+    _values[i] = -1;
+  _head = 0;
+  _canvasValid = false;
+  _dirty = true;
+}
+
+void SparklineWidget::paint(LovyanGFX &g) {
+  if (!_canvasValid)
+    redraw();
+  if (_canvasValid) {
+    _canvas->pushSprite(&g, _x, _y);
+    return;
+  }
+  for (int c = 0; c < COLUMNS; c++)
+    drawColumn(g, _x, _y, c, _values[(_head + c) % COLUMNS]);
+}
+
+// ============================================================================
+// Tree
+// ============================================================================
+
+void WidgetTree::clear() {
+  for (int i = 0; i < _count; i++)
+    delete _widgets[i];
+  _count = 0;
+}
+
+void WidgetTree::paintAll(LovyanGFX &g) {
+  for (int i = 0; i < _count; i++) {
+    _widgets[i]->paint(g);
+    _widgets[i]->clean();
+  }
+}
+
+int WidgetTree::paintDirty(LovyanGFX &g) {
+  int painted = 0;
+  for (int i = 0; i < _count; i++) {
+    Widget *w = _widgets[i];
+    if (!w->isDirty())
+      continue;
+    g.fillRect(w->x(), w->y(), w->w(), w->h(), COLOR_WHITE);
+    w->paint(g);
+    w->clean();
+    painted++;
+  }
+  return painted;
+}
+
+int WidgetTree::paintDirty(LovyanGFX &g, RegionKind kind) {
+  int painted = 0;
+  for (int i = 0; i < _count; i++) {
+    Widget *w = _widgets[i];
+    if (!w->isDirty() || w->kind() != kind)
+      continue;
+    g.fillRect(w->x(), w->y(), w->w(), w->h(), COLOR_WHITE);
+    w->paint(g);
+    w->clean();
+    painted++;
+  }
+  return painted;
+}
+
+bool WidgetTree::hasDirty() const {
+  for (int i = 0; i < _count; i++) {
+    if (_widgets[i]->isDirty())
+      return true;
+  }
+  return false;
+}
+
+bool WidgetTree::hasDirty(RegionKind kind) const {
+  for (int i = 0; i < _count; i++) {
+    if (_widgets[i]->isDirty() && _widgets[i]->kind() == kind)
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,289 @@
+/**
+ * Retained-Mode Widgets
+ *
+ * Small widget set (label, button, progress bar, toggle, panel, custom)
+ * that remembers what it last drew. Setters only mark a widget dirty when
+ * its visible state changes, and WidgetTree::paintDirty() repaints just
+ * those bounds so the EPD refreshes the smallest area it can.
+ *
+ * The Paint:: helpers are the same primitives UIManager::drawButton(),
+ * drawProgressBar() and drawToggle() use, so retained and immediate
+ * screens look identical.
+ */
+
+#ifndef WIDGETS_H
+#define WIDGETS_H
+
+#include <Arduino.h>
+#include <M5Unified.h>
+#include <functional>
+
+#include "glyph_atlas.h"
+#include "refresh_scheduler.h"
+
+namespace Paint {
+
+void button(LovyanGFX &g, int x, int y, int w, int h, const char *label,
+            bool selected);
+void progressBar(LovyanGFX &g, int x, int y, int w, int h, float percent,
+                 bool thick);
+void toggle(LovyanGFX &g, int x, int y, const char *label, bool active);
+void panelFrame(LovyanGFX &g, int x, int y, int w, int h);
+
+} // namespace Paint
+
+class Widget {
+public:
+  Widget(int x, int y, int w, int h)
+      : _x(x), _y(y), _w(w), _h(h), _dirty(true) {}
+  virtual ~Widget() {}
+
+  virtual void paint(LovyanGFX &g) = 0;
+
+  /**
+   * Waveform class used when this widget repaints on its own
+   */
+  virtual RegionKind kind() const { return RegionKind::GRAPHIC; }
+
+  void invalidate() { _dirty = true; }
+  bool isDirty() const { return _dirty; }
+  void clean() { _dirty = false; }
+
+  int x() const { return _x; }
+  int y() const { return _y; }
+  int w() const { return _w; }
+  int h() const { return _h; }
+
+protected:
+  int16_t _x, _y, _w, _h;
+  bool _dirty;
+};
+
+class LabelWidget : public Widget {
+public:
+  LabelWidget(int x, int y, int w, int h, uint8_t textSize)
+      : Widget(x, y, w, h), _textSize(textSize), _atlas(nullptr),
+        _font(nullptr) {
+    _text[0] = '\0';
+  }
+  void setText(const char *text);
+
+  /**
+   * Draw with pre-rendered glyphs when the atlas has every character
+   */
+  void setAtlas(const GlyphAtlas *atlas) { _atlas = atlas; }
+
+  /**
+   * Draw in a proportional font (one from the card) at size 1 in place of
+   * the built-in font; nullptr goes back to it
+   */
+  void setFont(const lgfx::IFont *font);
+  void paint(LovyanGFX &g) override;
+  RegionKind kind() const override { return RegionKind::TEXT; }
+
+private:
+  uint8_t _textSize;
+  const GlyphAtlas *_atlas; // Same text size, or null
+  const lgfx::IFont *_font; // Fits the widget's height, or null
+  char _text[48];
+};
+
+/**
+ * Fixed-pitch built-in-font text (countdown digits) that remembers what
+ * each character cell shows, so a tick repaints only the cells that
+ * changed instead of the whole string
+ */
+class DigitsWidget : public Widget {
+public:
+  static const int MAX_CELLS = 12;
+  static const uint32_t RESIZED = 0xFFFFFFFF; // changedCells(): length moved
+
+  DigitsWidget() : Widget(0, 0, 0, 0), _textSize(1) {
+    _text[0] = '\0';
+    _shown[0] = '\0';
+  }
+
+  /**
+   * Move the text; a new place or size forgets what the panel shows
+   */
+  void place(int x, int y, uint8_t textSize);
+  void setText(const char *text);
+
+  /**
+   * Bit i set when cell i differs from the panel; RESIZED when the length
+   * changed (the old text may reach past the new bounds: repaint the area)
+   */
+  uint32_t changedCells() const;
+
+  /**
+   * Erase and redraw one cell (same length as the panel's text)
+   */
+  void paintCell(LovyanGFX &g, int i);
+  int cellWidth() const { return 6 * _textSize; }
+
+  void paint(LovyanGFX &g) override;
+  RegionKind kind() const override { return RegionKind::TEXT; }
+
+private:
+  uint8_t _textSize;
+  char _text[MAX_CELLS + 1];
+  char _shown[MAX_CELLS + 1]; // What the panel has, per cell
+};
+
+class ButtonWidget : public Widget {
+public:
+  ButtonWidget(int x, int y, int w, int h, const char *label)
+      : Widget(x, y, w, h), _label(label), _selected(false) {}
+  void setSelected(bool selected);
+  void paint(LovyanGFX &g) override;
+
+private:
+  const char *_label;
+  bool _selected;
+};
+
+class ProgressWidget : public Widget {
+public:
+  ProgressWidget(int x, int y, int w, int h, bool thick)
+      : Widget(x, y, w, h), _thick(thick), _fill(-1), _percent(0) {}
+  void setValue(float percent);
+  void paint(LovyanGFX &g) override;
+
+private:
+  bool _thick;
+  int _fill; // Filled pixel width last requested (dirty only on change)
+  float _percent;
+};
+
+class ToggleWidget : public Widget {
+public:
+  // Bounds cover the label text and the 30px indicator below it
+  ToggleWidget(int x, int y, const char *label)
+      : Widget(x, y, 100, 70), _label(label), _active(false) {}
+  void setActive(bool active);
+  void paint(LovyanGFX &g) override;
+
+private:
+  const char *_label;
+  bool _active;
+};
+
+class PanelWidget : public Widget {
+public:
+  PanelWidget(int x, int y, int w, int h, const char *title = nullptr)
+      : Widget(x, y, w, h), _title(title) {}
+  void paint(LovyanGFX &g) override;
+
+private:
+  const char *_title;
+};
+
+/**
+ * Widget drawn by a callback, dirtied when its state key changes
+ */
+class CustomWidget : public Widget {
+public:
+  using Painter = std::function<void(LovyanGFX &g)>;
+  CustomWidget(int x, int y, int w, int h, Painter painter)
+      : Widget(x, y, w, h), _painter(painter), _key(0), _hasKey(false) {}
+  void setKey(uint32_t key);
+  void paint(LovyanGFX &g) override {
+    if (_painter)
+      _painter(g);
+  }
+
+private:
+  Painter _painter;
+  uint32_t _key;
+  bool _hasKey;
+};
+
+/**
+ * Bar sparkline of the last COLUMNS values, newest on the right. The bars
+ * are kept in a small sprite: push() scrolls it one column left and draws
+ * only the new column, so a minute costs one column of drawing and the
+ * frame diff sends just the sparkline's tiles. Without PSRAM it paints
+ * every column from the ring instead.
+ */
+class SparklineWidget : public Widget {
+public:
+  static const int COLUMNS = 60;
+
+  // w should be a multiple of COLUMNS; fullScale is the top of the bars
+  SparklineWidget(int x, int y, int w, int h, float fullScale);
+  ~SparklineWidget() override;
+
+  /**
+   * Append one value (negative: no data, an empty column)
+   */
+  void push(float value);
+
+  /**
+   * Forget every column
+   */
+  void reset();
+
+  void paint(LovyanGFX &g) override;
+
+private:
+  float _fullScale;
+  int16_t _values[COLUMNS]; // Ring, bar heights in pixels (-1: no data)
+  uint8_t _head;            // Oldest column
+  M5Canvas *_canvas;        // Columns as drawn, or null
+  bool _canvasValid;
+
+  int columnWidth() const { return _w / COLUMNS; }
+  void drawColumn(LovyanGFX &g, int x0, int y0, int column, int16_t bar);
+  void redraw();
+};
+
+class WidgetTree {
+public:
+  static const int MAX_WIDGETS = 32;
+
+  WidgetTree() : _count(0) {}
+  ~WidgetTree() { clear(); }
+
+  /**
+   * Take ownership of a widget; later widgets paint on top
+   */
+  template <typename T> T *add(T *widget) {
+    if (_count >= MAX_WIDGETS) {
+      delete widget;
+      return nullptr;
+    }
+    _widgets[_count++] = widget;
+    return widget;
+  }
+
+  void clear();
+  bool empty() const { return _count == 0; }
+
+  /**
+   * Paint everything (full-screen pass) and clear all dirty flags
+   */
+  void paintAll(LovyanGFX &g);
+
+  /**
+   * Erase and repaint only dirty widgets. Dynamic widgets must not overlap
+   * each other; panels only draw their frame, so children placed inside
+   * the frame can be erased without touching it.
+   * @return number of widgets repainted
+   */
+  int paintDirty(LovyanGFX &g);
+
+  /**
+   * Same as paintDirty(), limited to widgets of one refresh kind so text
+   * and graphics can be pushed with different waveforms
+   */
+  int paintDirty(LovyanGFX &g, RegionKind kind);
+
+  bool hasDirty() const;
+  bool hasDirty(RegionKind kind) const;
+
+private:
+  Widget *_widgets[MAX_WIDGETS];
+  int _count;
+};
+
+#endif // WIDGETS_H
@@ -0,0 +1,217 @@
+/**
+ * Wordle Rules and Dictionary Implementation
+ */
+
+#include "wordle.h"
+#include "../utils/flash_store.h"
+#include "../utils/log.h"
+#include "../utils/sd_manager.h"
+#include <algorithm>
+
+extern SDManager *sdManager;
+
+namespace Wordle {
+
+static const uint32_t DICT_MAGIC = 0x314C4457; // "WDL1"
+static const uint16_t DICT_VERSION = 1;
+static const uint16_t ANSWER = 0x8000;
+static const size_t COPY_CHUNK = 512;
+
+void score(const char *guess, const char *answer, Mark marks[LENGTH]) {
+  uint8_t left[26] = {}; // Answer letters not matched in place
+  for (int i = 0; i < LENGTH; i++) {
+    if (guess[i] == answer[i])
+      marks[i] = CORRECT;
+    else
+      left[answer[i] - 'a']++;
+  }
+  for (int i = 0; i < LENGTH; i++) {
+    if (guess[i] == answer[i])
+      continue;
+    uint8_t &n = left[guess[i] - 'a'];
+    marks[i] = n ? PRESENT : ABSENT;
+    if (n)
+      n--;
+  }
+}
+
+bool solved(const Mark marks[LENGTH]) {
+  for (int i = 0; i < LENGTH; i++) {
+    if (marks[i] != CORRECT)
+      return false;
+  }
+  return true;
+}
+
+Dictionary::Dictionary() : _header(), _index(nullptr) {}
+
+Dictionary::~Dictionary() { close(); }
+
+bool Dictionary::readHeader(File &file, Header &header) {
+  return file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+         header.magic == DICT_MAGIC && header.version == DICT_VERSION &&
+         header.answers > 0 && header.words <= 0xFFFF &&
+         file.size() == sizeof(header) + (2 * (BUCKETS + 1) +
+                                          header.words) * sizeof(uint16_t);
+}
+
+bool Dictionary::import() {
+  // The card's copy goes to a temporary file, renamed over the old one
+  // once whole
+  SDAccess sd(sdManager);
+  File from = sd ? sdFS().open(CARD_PATH, FILE_READ) : File();
+  Header header;
+  if (!from || !readHeader(from, header)) {
+    if (from)
+      LOG_W("Wordle", "%s is not a dictionary (tools/make_wordle.py)",
+            CARD_PATH);
+    return false;
+  }
+
+  // Same lists as the flash copy: nothing to do
+  fs::FS &flash = flashStore->fs();
+  File current = flash.open(FLASH_PATH, FILE_READ);
+  Header have;
+  bool same = current && readHeader(current, have) &&
+              have.stamp == header.stamp;
+  current.close();
+  if (same)
+    return true;
+
+  String temp = String(FLASH_PATH) + ".tmp";
+  File to = flash.open(temp.c_str(), FILE_WRITE);
+  uint8_t chunk[COPY_CHUNK];
+  bool ok = to && from.seek(0);
+  while (ok && from.available()) {
+    size_t n = from.read(chunk, sizeof(chunk));
+    ok = n > 0 && to.write(chunk, n) == n;
+  }
+  to.close();
+  from.close();
+  if (!ok || !flash.rename(temp.c_str(), FLASH_PATH)) {
+    flash.remove(temp.c_str());
+    LOG_E("Wordle", "Could not copy the dictionary to flash");
+    return false;
+  }
+  LOG_I("Wordle", "Dictionary copied to flash: %u answers, %u words",
+        (unsigned)header.answers, (unsigned)header.words);
+  return true;
+}
+
+bool Dictionary::open() {
+  if (isOpen())
+    return true;
+  if (!flashStore || !flashStore->isAvailable())
+    return false;
+  if (sdManager && sdManager->isAvailable())
+    import(); // Keeps the flash copy if the card has none
+
+  _file = flashStore->fs().open(FLASH_PATH, FILE_READ);
+  size_t bytes = 2 * (BUCKETS + 1) * sizeof(uint16_t);
+  _index = _file && readHeader(_file, _header)
+               ? (uint16_t *)malloc(bytes)
+               : nullptr;
+  if (!_index || _file.read((uint8_t *)_index, bytes) != bytes) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void Dictionary::close() {
+  free(_index);
+  _index = nullptr;
+  _file.close();
+}
+
+bool Dictionary::entry(uint32_t i, uint16_t &out) {
+  uint32_t offset = sizeof(Header) + (2 * (BUCKETS + 1) + i) * 2;
+  return _file.seek(offset) &&
+         _file.read((uint8_t *)&out, sizeof(out)) == sizeof(out);
+}
+
+bool Dictionary::contains(const char *word) {
+  if (!isOpen())
+    return false;
+  for (int i = 0; i < LENGTH; i++) {
+    if (word[i] < 'a' || word[i] > 'z')
+      return false;
+  }
+  int bucket = (word[0] - 'a') * 26 + (word[1] - 'a');
+  uint16_t want = (word[2] - 'a') << 10 | (word[3] - 'a') << 5 |
+                  (word[4] - 'a');
+
+  // Binary search of the bucket's entries, read as needed
+  uint32_t lo = starts()[bucket], hi = starts()[bucket + 1];
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    uint16_t e;
+    if (!entry(mid, e))
+      return false;
+    e &= ~ANSWER;
+    if (e == want)
+      return true;
+    if (e < want)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return false;
+}
+
+bool Dictionary::readAll(uint32_t *out) {
+  if (!isOpen() || !_file.seek(sizeof(Header) + 2 * (BUCKETS + 1) * 2))
+    return false;
+
+  // The entries in file order are the words in alphabetical order
+  uint16_t chunk[COPY_CHUNK / sizeof(uint16_t)];
+  uint32_t n = 0;
+  for (int bucket = 0; bucket < BUCKETS; bucket++) {
+    uint32_t prefix = (uint32_t)(bucket / 26) << 20 | (bucket % 26) << 15;
+    for (uint32_t i = starts()[bucket]; i < starts()[bucket + 1]; i++, n++) {
+      size_t at = n % (sizeof(chunk) / sizeof(chunk[0]));
+      if (at == 0) {
+        size_t want =
+            std::min(sizeof(chunk), (size_t)(_header.words - n) * 2);
+        if (_file.read((uint8_t *)chunk, want) != want)
+          return false;
+      }
+      uint16_t e = chunk[at];
+      out[n] = prefix | (e & ~ANSWER) | (e & ANSWER ? ANSWER_BIT : 0);
+    }
+  }
+  return n == _header.words;
+}
+
+bool Dictionary::answer(int n, char *out) {
+  if (!isOpen() || n < 0 || n >= _header.answers)
+    return false;
+
+  // The last bucket with fewer than n + 1 answers before it holds it
+  int lo = 0, hi = BUCKETS - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (ranks()[mid] <= n)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  int skip = n - ranks()[lo];
+  for (uint32_t i = starts()[lo]; i < starts()[lo + 1]; i++) {
+    uint16_t e;
+    if (!entry(i, e))
+      return false;
+    if (!(e & ANSWER) || skip-- > 0)
+      continue;
+    out[0] = 'a' + lo / 26;
+    out[1] = 'a' + lo % 26;
+    out[2] = 'a' + (e >> 10 & 0x1F);
+    out[3] = 'a' + (e >> 5 & 0x1F);
+    out[4] = 'a' + (e & 0x1F);
+    out[LENGTH] = '\0';
+    return true;
+  }
+  return false;
+}
+
+} // namespace Wordle
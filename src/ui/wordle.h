@@ -0,0 +1,130 @@
+/**
+ * Wordle Rules and Dictionary
+ *
+ * Marking a guess against the answer, and the word lists the game plays
+ * from, kept apart from UIManager like the 2048 and Sudoku rules.
+ *
+ * score() marks each letter of a guess CORRECT (right place), PRESENT
+ * (elsewhere in the answer) or ABSENT the way the original game does with
+ * repeated letters: exact places are taken first, and a letter is PRESENT
+ * only as many times as the answer has it left over.
+ *
+ * The dictionary is made on a PC by tools/make_wordle.py from a list of
+ * answers and a list of other allowed guesses, and copied to the card as
+ * CARD_PATH. Words are five letters a-z, 5 bits a letter. The first two
+ * letters pick one of 676 buckets; in a bucket each word is one 16-bit
+ * entry, the last three letters in 15 bits, sorted, with the top bit
+ * marking an answer. 13,000 words take 26 KB.
+ *
+ * open() copies the card's file into the flash store once (and again when
+ * the card's copy changes) and reads the flash copy from then on, so the
+ * game needs the card only the first time. Only the bucket index stays in
+ * RAM while the game is open (2.7 KB: where each bucket starts, and how
+ * many answers come before it, for picking one). contains() is a binary
+ * search of one bucket, a few 2-byte reads of the flash copy: some tens
+ * of microseconds, no card access per guess.
+ */
+
+#ifndef WORDLE_H
+#define WORDLE_H
+
+#include <Arduino.h>
+#undef min
+#undef max
+#include <FS.h>
+
+namespace Wordle {
+
+static const int LENGTH = 5;
+static const int MAX_GUESSES = 6;
+static const char *const CARD_PATH = "/games/wordle/words.wdl";
+static const char *const FLASH_PATH = "/wordle.wdl";
+
+enum Mark : uint8_t { UNKNOWN, ABSENT, PRESENT, CORRECT };
+
+// A word in 25 bits, first letter highest (a = 0), so packed words sort
+// alphabetically
+static const uint32_t ANSWER_BIT = 1UL << 31;
+
+inline int letter(uint32_t packed, int i) {
+  return (packed >> (5 * (LENGTH - 1 - i))) & 0x1F;
+}
+
+/**
+ * Mark guess against answer (both LENGTH lower-case letters)
+ */
+void score(const char *guess, const char *answer, Mark marks[LENGTH]);
+
+/**
+ * true if all marks are CORRECT
+ */
+bool solved(const Mark marks[LENGTH]);
+
+class Dictionary {
+public:
+  static const int BUCKETS = 26 * 26;
+
+  Dictionary();
+  ~Dictionary();
+
+  /**
+   * Bring the flash copy up to date with the card's and open it (loop
+   * task: may read the card)
+   * @return false without a dictionary file or the flash store
+   */
+  bool open();
+
+  /**
+   * Close the file and free the index (when the game closes)
+   */
+  void close();
+
+  bool isOpen() const { return _index != nullptr; }
+
+  /**
+   * word (LENGTH lower-case letters) is an answer or an allowed guess
+   */
+  bool contains(const char *word);
+
+  int answerCount() const { return isOpen() ? _header.answers : 0; }
+  int wordCount() const { return isOpen() ? _header.words : 0; }
+
+  /**
+   * The n-th answer in alphabetical order, into out (LENGTH + 1 bytes)
+   */
+  bool answer(int n, char *out);
+
+  /**
+   * Every word in alphabetical order into out (wordCount() entries),
+   * packed 5 bits a letter with ANSWER_BIT set on the answers
+   */
+  bool readAll(uint32_t *out);
+
+  /**
+   * Changes with the word lists (a saved game is for one set of them)
+   */
+  uint32_t stamp() const { return _header.stamp; }
+
+private:
+  struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t answers;
+    uint32_t words;
+    uint32_t stamp; // FNV-1a of the rest of the file
+  };
+
+  Header _header;
+  uint16_t *_index; // Bucket starts, then answers before each bucket
+  File _file;       // The flash copy
+
+  bool readHeader(File &file, Header &header);
+  bool import();
+  bool entry(uint32_t i, uint16_t &out);
+  const uint16_t *starts() const { return _index; }
+  const uint16_t *ranks() const { return _index + BUCKETS + 1; }
+};
+
+} // namespace Wordle
+
+#endif // WORDLE_H
@@ -0,0 +1,345 @@
+/**
+ * Wordle Solver Implementation
+ */
+
+#include "wordle_solver.h"
+#include "../utils/log.h"
+#include "../utils/mem_telemetry.h"
+#include "../utils/wake.h"
+#include <algorithm>
+#include <esp_heap_caps.h>
+
+using Wordle::LENGTH;
+
+static const int LETTERS = 26;
+static const uint32_t ALL_LETTERS = (1UL << LETTERS) - 1;
+static const uint32_t STRIDE = 7919; // Prime: visits every index of a list
+static const float TIE = 1e-4f;      // Rounding: the word ranked first wins
+
+// Base-3 colouring of guess against answer (2 in place, 1 elsewhere, 0
+// absent), by the same rules as Wordle::score()
+static int patternOf(const uint8_t *guess, uint32_t answer) {
+  uint8_t a[LENGTH];
+  uint8_t left[32];
+  for (int i = 0; i < LENGTH; i++) {
+    a[i] = Wordle::letter(answer, i);
+    left[a[i]] = 0;
+    left[guess[i]] = 0;
+  }
+  int digits[LENGTH];
+  for (int i = 0; i < LENGTH; i++) {
+    digits[i] = guess[i] == a[i] ? 2 : 0;
+    if (!digits[i])
+      left[a[i]]++;
+  }
+  int code = 0;
+  for (int i = 0, weight = 1; i < LENGTH; i++, weight *= 3) {
+    if (!digits[i] && left[guess[i]]) {
+      digits[i] = 1;
+      left[guess[i]]--;
+    }
+    code += digits[i] * weight;
+  }
+  return code;
+}
+
+static inline void andSet(uint32_t *into, const uint32_t *set, int words) {
+  for (int i = 0; i < words; i++)
+    into[i] &= set[i];
+}
+
+static inline void andNotSet(uint32_t *into, const uint32_t *set,
+                             int words) {
+  for (int i = 0; i < words; i++)
+    into[i] &= ~set[i];
+}
+
+WordleSolver::WordleSolver()
+    : _requests(nullptr), _results(nullptr), _task(nullptr), _busy(false),
+      _generation(0), _pollGeneration(0), _words(nullptr),
+      _answers(nullptr), _sets(nullptr), _candidates(nullptr),
+      _picked(nullptr), _spread(nullptr), _bytes(0), _wordCount(0),
+      _answerCount(0), _setWords(0) {}
+
+bool WordleSolver::begin() {
+  if (_task)
+    return true;
+  _requests = xQueueCreate(1, sizeof(Request));
+  _results = xQueueCreate(1, sizeof(Result));
+  if (!_requests || !_results) {
+    LOG_E("Wordle", "Solver queue allocation failed");
+    return false;
+  }
+
+  // Core 0 at the storage worker's priority, below touch and BLE
+  if (xTaskCreatePinnedToCore(taskEntry, "wordle", TASK_STACK, this, 1,
+                              &_task, 0) != pdPASS) {
+    LOG_E("Wordle", "Solver task failed to start");
+    _task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+uint32_t *WordleSolver::positionSet(int position, int letter) const {
+  return _sets + (position * LETTERS + letter) * _setWords;
+}
+
+uint32_t *WordleSolver::countSet(int letter, int atLeast) const {
+  return _sets +
+         (LENGTH * LETTERS + letter * LENGTH + atLeast - 1) * _setWords;
+}
+
+bool WordleSolver::load(Wordle::Dictionary &dictionary) {
+  if (_words)
+    return true;
+  if (_busy)
+    return false;
+  int words = dictionary.wordCount();
+  int answers = dictionary.answerCount();
+  if (words <= 0 || answers <= 0)
+    return false;
+
+  // One PSRAM block: words, answers, bitsets, scratch, c * log2(c)
+  int setWords = (answers + 31) / 32;
+  int sets = 2 * LENGTH * LETTERS;
+  size_t bytes = (words + answers + (sets + 1) * setWords + answers) *
+                     sizeof(uint32_t) +
+                 (answers + 1) * sizeof(float);
+  uint32_t *block =
+      (uint32_t *)heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM);
+  if (!block) {
+    LOG_W("Wordle", "No memory for the solver (%u bytes)", (unsigned)bytes);
+    return false;
+  }
+  if (!dictionary.readAll(block)) {
+    LOG_E("Wordle", "Could not read the word list");
+    heap_caps_free(block);
+    return false;
+  }
+  _wordCount = words;
+  _answerCount = answers;
+  _setWords = setWords;
+  _answers = block + words;
+  _sets = _answers + answers;
+  _candidates = _sets + sets * setWords;
+  _picked = _candidates + setWords;
+  _spread = (float *)(_picked + answers);
+
+  int a = 0;
+  for (int w = 0; w < words && a < answers; w++) {
+    if (block[w] & Wordle::ANSWER_BIT)
+      _answers[a++] = block[w] & ~Wordle::ANSWER_BIT;
+  }
+  for (int i = 0; i < a; i++) {
+    uint32_t bit = 1UL << (i % 32);
+    uint8_t copies[LETTERS] = {};
+    for (int p = 0; p < LENGTH; p++) {
+      int l = Wordle::letter(_answers[i], p);
+      positionSet(p, l)[i / 32] |= bit;
+      copies[l]++;
+    }
+    for (int l = 0; l < LETTERS; l++) {
+      for (int k = 1; k <= copies[l]; k++)
+        countSet(l, k)[i / 32] |= bit;
+    }
+  }
+  _answerCount = a;
+  for (int c = 1; c <= a; c++)
+    _spread[c] = c * log2f(c);
+
+  _bytes = bytes;
+  MemTelemetry::track(MemTelemetry::Tag::UI, bytes);
+  _words = block; // Last: loaded() now holds
+  LOG_I("Wordle", "Solver: %d words, %d answers, %u bytes", words, a,
+        (unsigned)bytes);
+  return true;
+}
+
+bool WordleSolver::request(const char guesses[][LENGTH + 1],
+                           const Wordle::Mark marks[][LENGTH], int rows,
+                           uint32_t budgetMs) {
+  if (!_task || _busy || !_words || rows < 0 ||
+      rows > Wordle::MAX_GUESSES)
+    return false;
+  Result stale;
+  xQueueReceive(_results, &stale, 0);
+
+  Request r = {};
+  for (int i = 0; i < rows; i++) {
+    memcpy(r.guesses[i], guesses[i], LENGTH);
+    memcpy(r.marks[i], marks[i], LENGTH);
+  }
+  r.rows = rows;
+  r.budgetMs = budgetMs;
+  r.generation = ++_generation;
+  _pollGeneration = r.generation;
+  _busy = true;
+  if (xQueueSend(_requests, &r, 0) != pdTRUE) {
+    _busy = false;
+    return false;
+  }
+  return true;
+}
+
+bool WordleSolver::poll(Result &out) {
+  if (!_results || xQueueReceive(_results, &out, 0) != pdTRUE)
+    return false;
+  // A cancelled search still reports; its generation has moved on
+  return _pollGeneration == _generation;
+}
+
+void WordleSolver::stop() {
+  cancel();
+  while (_busy)
+    vTaskDelay(1); // The ranking checks for cancellation every guess
+  if (_results)
+    xQueueReset(_results);
+
+  if (_words) {
+    heap_caps_free(_words);
+    MemTelemetry::track(MemTelemetry::Tag::UI, -(long)_bytes);
+    _words = nullptr;
+  }
+}
+
+void WordleSolver::taskEntry(void *arg) {
+  WordleSolver *self = static_cast<WordleSolver *>(arg);
+  Request request;
+  for (;;) {
+    if (xQueueReceive(self->_requests, &request, portMAX_DELAY) != pdTRUE)
+      continue;
+    Result result;
+    self->search(request, result);
+    xQueueOverwrite(self->_results, &result);
+    self->_busy = false;
+    Wake::signal(Wake::COMPUTE);
+  }
+}
+
+int WordleSolver::filter(const Request &request) {
+  // Fold the guesses into per-position letter masks and letter counts
+  uint32_t allowed[LENGTH];
+  uint8_t least[LETTERS] = {};
+  uint8_t most[LETTERS];
+  std::fill(allowed, allowed + LENGTH, ALL_LETTERS);
+  std::fill(most, most + LETTERS, (uint8_t)LENGTH);
+  for (int r = 0; r < request.rows; r++) {
+    uint8_t found[LETTERS] = {};
+    bool capped[LETTERS] = {};
+    for (int i = 0; i < LENGTH; i++) {
+      int l = request.guesses[r][i] - 'a';
+      if (l < 0 || l >= LETTERS)
+        return 0;
+      Wordle::Mark mark = request.marks[r][i];
+      if (mark == Wordle::CORRECT) {
+        allowed[i] = 1UL << l;
+      } else {
+        allowed[i] &= ~(1UL << l);
+        if (mark != Wordle::PRESENT)
+          capped[l] = true; // No more copies than were found
+      }
+      if (mark == Wordle::CORRECT || mark == Wordle::PRESENT)
+        found[l]++;
+    }
+    for (int l = 0; l < LETTERS; l++) {
+      least[l] = std::max(least[l], found[l]);
+      if (capped[l])
+        most[l] = std::min(most[l], found[l]);
+    }
+  }
+
+  // Every answer, then one AND per constraint, 32 answers a word
+  std::fill(_candidates, _candidates + _setWords, 0xFFFFFFFFUL);
+  if (_answerCount % 32)
+    _candidates[_setWords - 1] = (1UL << (_answerCount % 32)) - 1;
+  for (int p = 0; p < LENGTH; p++) {
+    for (int l = 0; l < LETTERS; l++) {
+      if (!(allowed[p] >> l & 1))
+        andNotSet(_candidates, positionSet(p, l), _setWords);
+    }
+  }
+  for (int l = 0; l < LETTERS; l++) {
+    if (least[l] > 0)
+      andSet(_candidates, countSet(l, least[l]), _setWords);
+    if (most[l] < LENGTH)
+      andNotSet(_candidates, countSet(l, most[l] + 1), _setWords);
+  }
+
+  int n = 0;
+  for (int w = 0; w < _setWords; w++) {
+    for (uint32_t bits = _candidates[w]; bits; bits &= bits - 1)
+      _picked[n++] = _answers[w * 32 + __builtin_ctz(bits)];
+  }
+  return n;
+}
+
+float WordleSolver::rank(uint32_t guess, int candidates,
+                         uint16_t *counts) const {
+  uint8_t g[LENGTH];
+  for (int i = 0; i < LENGTH; i++)
+    g[i] = Wordle::letter(guess, i);
+  memset(counts, 0, PATTERNS * sizeof(uint16_t));
+  for (int i = 0; i < candidates; i++)
+    counts[patternOf(g, _picked[i])]++;
+
+  // Entropy: log2(n) - sum(c log2 c) / n over the patterns
+  float spread = 0;
+  for (int p = 0; p < PATTERNS; p++)
+    spread += _spread[counts[p]];
+  return log2f(candidates) - spread / candidates;
+}
+
+void WordleSolver::search(const Request &request, Result &result) {
+  uint32_t start = millis();
+  uint32_t deadline = start + request.budgetMs;
+  result.rows = request.rows;
+  result.guess[0] = '\0';
+  result.bits = 0;
+  result.ranked = 0;
+  result.words = _wordCount;
+
+  int n = filter(request);
+  result.candidates = n;
+  uint32_t best = n > 0 ? _picked[0] : 0;
+  float bestBits = n > 1 ? -1 : 0;
+
+  // With one or two left, guessing one of them is best
+  if (n > 2) {
+    uint16_t counts[PATTERNS];
+    bool done = false;
+    for (int pass = 0; pass < 2 && !done; pass++) {
+      const uint32_t *list = pass == 0 ? _picked : _words;
+      int size = pass == 0 ? n : _wordCount;
+      uint32_t step = STRIDE % size ? STRIDE % size : 1;
+      uint32_t at = 0;
+      for (int i = 0; i < size; i++, at = (at + step) % size) {
+        if (_generation != request.generation ||
+            (int32_t)(millis() - deadline) >= 0) {
+          done = true;
+          break;
+        }
+        uint32_t word = list[at] & ~Wordle::ANSWER_BIT;
+        if (pass == 1 && std::binary_search(_picked, _picked + n, word))
+          continue; // Ranked with the candidates
+        float bits = rank(word, n, counts);
+        result.ranked++;
+        if (bits > bestBits + TIE) {
+          bestBits = bits;
+          best = word;
+        }
+      }
+    }
+  }
+  if (n > 0) {
+    for (int i = 0; i < LENGTH; i++)
+      result.guess[i] = 'a' + Wordle::letter(best, i);
+    result.guess[LENGTH] = '\0';
+    result.bits = n == 2 ? 1 : bestBits;
+  }
+
+  result.elapsedMs = millis() - start;
+  LOG_D("Wordle", "Hint: %s %.2f bits, %d left, %d/%d ranked in %u ms",
+        result.guess, result.bits, n, result.ranked, _wordCount,
+        (unsigned)result.elapsedMs);
+}
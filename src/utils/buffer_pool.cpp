@@ -0,0 +1,155 @@
+/**
+ * Buffer Pool Implementation
+ */
+
+#include "buffer_pool.h"
+#include "log.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+
+namespace BufferPool {
+
+static const uint32_t MAGIC = 0x504F4F4C; // "POOL"
+static const int8_t OVERSIZE = -1;        // Straight from the heap
+
+struct Header {
+  uint32_t magic;
+  int8_t cls;
+  MemTelemetry::Tag tag;
+  size_t len;
+  Header *next; // Free list link while cached
+};
+static_assert(sizeof(Header) % 8 == 0, "data keeps the heap's alignment");
+
+static portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+static Header *_free[CLASS_COUNT] = {};
+static uint8_t _freeCount[CLASS_COUNT] = {};
+static Stats _stats = {};
+
+static int classFor(size_t len) {
+  for (int i = 0; i < CLASS_COUNT; i++) {
+    if (len <= CLASS_SIZES[i])
+      return i;
+  }
+  return OVERSIZE;
+}
+
+static Header *allocate(size_t len) {
+  size_t bytes = sizeof(Header) + len;
+  void *p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+  if (!p)
+    p = malloc(bytes);
+  return (Header *)p;
+}
+
+void *acquire(size_t len, MemTelemetry::Tag tag) {
+  int cls = classFor(len ? len : 1);
+  size_t size = cls == OVERSIZE ? len : CLASS_SIZES[cls];
+
+  Header *h = nullptr;
+  if (cls != OVERSIZE) {
+    portENTER_CRITICAL(&_lock);
+    h = _free[cls];
+    if (h) {
+      _free[cls] = h->next;
+      _freeCount[cls]--;
+      _stats.cached -= size;
+      _stats.hits++;
+    }
+    portEXIT_CRITICAL(&_lock);
+  }
+
+  if (!h) {
+    h = allocate(size);
+    portENTER_CRITICAL(&_lock);
+    if (h)
+      _stats.misses++;
+    else
+      _stats.failures++;
+    portEXIT_CRITICAL(&_lock);
+    if (!h)
+      return nullptr;
+  }
+
+  h->magic = MAGIC;
+  h->cls = cls;
+  h->tag = tag;
+  h->len = size;
+  h->next = nullptr;
+  MemTelemetry::track(tag, size);
+
+  portENTER_CRITICAL(&_lock);
+  _stats.inUse += size;
+  if (_stats.inUse > _stats.highWater)
+    _stats.highWater = _stats.inUse;
+  portEXIT_CRITICAL(&_lock);
+  return h + 1;
+}
+
+void release(void *block) {
+  if (!block)
+    return;
+  Header *h = (Header *)block - 1;
+  if (h->magic != MAGIC) {
+    LOG_E("Pool", "Release of a block the pool does not own");
+    return;
+  }
+
+  MemTelemetry::track(h->tag, -(long)h->len);
+  bool cached = false;
+  portENTER_CRITICAL(&_lock);
+  _stats.inUse -= h->len;
+  if (h->cls != OVERSIZE && _freeCount[h->cls] < KEEP[h->cls]) {
+    h->next = _free[h->cls];
+    _free[h->cls] = h;
+    _freeCount[h->cls]++;
+    _stats.cached += h->len;
+    cached = true;
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  if (!cached) {
+    h->magic = 0; // A second release must not pass the check
+    free(h);
+  }
+}
+
+void trim() {
+  for (int i = 0; i < CLASS_COUNT; i++) {
+    portENTER_CRITICAL(&_lock);
+    Header *list = _free[i];
+    _free[i] = nullptr;
+    _stats.cached -= _freeCount[i] * CLASS_SIZES[i];
+    _freeCount[i] = 0;
+    portEXIT_CRITICAL(&_lock);
+
+    while (list) {
+      Header *next = list->next;
+      list->magic = 0;
+      free(list);
+      list = next;
+    }
+  }
+}
+
+void stats(Stats &out) {
+  portENTER_CRITICAL(&_lock);
+  out = _stats;
+  portEXIT_CRITICAL(&_lock);
+
+  out.psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  out.psramLargest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  out.fragmentation =
+      out.psramFree ? 100 - out.psramLargest * 100 / out.psramFree : 0;
+}
+
+void dump(Print &out) {
+  Stats s;
+  stats(s);
+  out.printf("Pool: use=%uK peak=%uK cached=%uK hit=%u miss=%u fail=%u\n",
+             (unsigned)(s.inUse / 1024), (unsigned)(s.highWater / 1024),
+             (unsigned)(s.cached / 1024), (unsigned)s.hits,
+             (unsigned)s.misses, (unsigned)s.failures);
+}
+
+} // namespace BufferPool
@@ -0,0 +1,84 @@
+/**
+ * Buffer Pool
+ *
+ * Size-classed PSRAM blocks for the large transient buffers (preview and
+ * decode canvases, note files, SD benchmark blocks). A released block is
+ * kept on its class's free list, up to KEEP[] of them, and handed out
+ * again whole, so a preview decoded every few seconds reuses the same
+ * 256 KB instead of carving a new hole in the heap each time. Requests
+ * beyond the largest class go to the heap directly.
+ *
+ * Blocks carry a small header (class, length and MemTelemetry tag), so
+ * release() needs only the pointer. acquire() and release() take a short
+ * spinlock and may be called from any task.
+ *
+ * stats() reports bytes in use, the high-water mark, cache hits and the
+ * PSRAM fragmentation (how far the largest free block falls short of the
+ * free total); "PROF" over serial prints the pool counters with dump().
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "mem_telemetry.h"
+#include <Arduino.h>
+
+namespace BufferPool {
+
+static const int CLASS_COUNT = 4;
+static const size_t CLASS_SIZES[CLASS_COUNT] = {4096, 16384, 65536, 262144};
+static const uint8_t KEEP[CLASS_COUNT] = {4, 2, 2, 1}; // Cached per class
+
+struct Stats {
+  size_t inUse;     // Bytes handed out (class sizes, headers excluded)
+  size_t highWater; // Largest inUse since boot
+  size_t cached;    // Bytes held on the free lists
+  uint32_t hits;    // Served from a free list
+  uint32_t misses;  // Needed a fresh heap block
+  uint32_t failures;
+  size_t psramFree;
+  size_t psramLargest;
+  uint8_t fragmentation; // 0-100: 100 - largest * 100 / free
+};
+
+/**
+ * Block of at least len bytes, PSRAM first, internal RAM if that fails
+ * @return nullptr when neither has room
+ */
+void *acquire(size_t len, MemTelemetry::Tag tag = MemTelemetry::Tag::OTHER);
+
+/**
+ * Hand a block back (nullptr is ignored)
+ */
+void release(void *block);
+
+/**
+ * Free every cached block (before a large one-off allocation)
+ */
+void trim();
+
+void stats(Stats &out);
+void dump(Print &out);
+
+/**
+ * RAII block: released when the object goes out of scope
+ */
+class Buffer {
+public:
+  explicit Buffer(size_t len,
+                  MemTelemetry::Tag tag = MemTelemetry::Tag::OTHER)
+      : _data((uint8_t *)acquire(len, tag)) {}
+  ~Buffer() { release(_data); }
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+
+  uint8_t *get() const { return _data; }
+  explicit operator bool() const { return _data != nullptr; }
+
+private:
+  uint8_t *_data;
+};
+
+} // namespace BufferPool
+
+#endif // BUFFER_POOL_H
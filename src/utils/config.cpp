@@ -3,8 +3,8 @@
  */
 
 #include "config.h"
+#include "flash_store.h"
 #include "sd_manager.h"
-#include <SD.h>
 
 extern SDManager *sdManager;
 
@@ -15,40 +15,192 @@ Config::~Config() {}
 void Config::setDefaults() {
   _wifiSSID = "";
   _wifiPassword = "";
+  for (int i = 0; i < MAX_FOSSIBOTS; i++)
+    _fossibotMACs[i] = "";
+  _fossibotCount = 0;
   _theme = "classic_grid";
   _autoSleepMinutes = 60; // Default to 60 minutes (User Request)
+  _sleepWakeMinutes = 5;
   _timezoneOffset = 0;
   _weatherAPIKey = "";
   _weatherCity = "London";
   _weatherUnits = "metric";
+  _mqttHost = "";
+  _mqttPort = 1883;
+  _mqttUser = "";
+  _mqttPassword = "";
+  _mqttTopic = "fossibot/telemetry";
+  _mqttIntervalSeconds = 60;
+  _mqttDelta = false;
+  _apiEnabled = false;
+  _apiPort = 80;
+  _recordFrames = false;
+  _beaconEnabled = false;
+  _meshEnabled = false;
+  _meshChannel = 1;
+  _meshKey = "";
+  _otaEnabled = false;
+  _otaToken = "";
+  _telemetryFilter = "ewma";
+  _filterAlpha = 0.3f;
+  _filterMedianN = 5;
+  _filterSpikeW = 500;
+  _rules = "";
+  _tariffCount = 0;
+  _tariffPrice = 0;
+  _reservePct = 20;
+  _chargeW = 500;
+  _solarPanelW = 0;
   _socChangeThreshold = 1;   // Refresh on 1% SOC change
   _powerChangeThreshold = 5; // Refresh on 5W power change
+  _powerRefreshSecs = 10;
 
   _alarmEnabled = false;
   _alarmHour = 7;
   _alarmMinute = 0;
 }
 
-bool Config::load(const char *path) {
-  if (!sdManager || !sdManager->isAvailable()) {
-    Serial.println("Config: SD card not available");
-    return false;
+// Only the keys load() reads are kept in the document; everything else in
+// the file is skipped while parsing
+static void buildLoadFilter(JsonDocument &filter) {
+  filter["wifi"]["ssid"] = true;
+  filter["wifi"]["password"] = true;
+  filter["bluetooth"]["fossibot_macs"] = true;
+  filter["bluetooth"]["fossibot_mac"] = true;
+  filter["display"]["theme"] = true;
+  filter["display"]["auto_sleep_minutes"] = true;
+  filter["display"]["sleep_wake_minutes"] = true;
+  filter["timezone"]["offset_hours"] = true;
+  filter["alarm"]["enabled"] = true;
+  filter["alarm"]["hour"] = true;
+  filter["alarm"]["minute"] = true;
+  filter["weather"]["api_key"] = true;
+  filter["weather"]["city"] = true;
+  filter["weather"]["units"] = true;
+  filter["mqtt"]["host"] = true;
+  filter["mqtt"]["port"] = true;
+  filter["mqtt"]["user"] = true;
+  filter["mqtt"]["password"] = true;
+  filter["mqtt"]["topic"] = true;
+  filter["mqtt"]["interval_s"] = true;
+  filter["mqtt"]["format"] = true;
+  filter["api"]["enabled"] = true;
+  filter["api"]["port"] = true;
+  filter["recorder"]["enabled"] = true;
+  filter["beacon"]["enabled"] = true;
+  filter["mesh"]["enabled"] = true;
+  filter["mesh"]["channel"] = true;
+  filter["mesh"]["key"] = true;
+  filter["ota"]["enabled"] = true;
+  filter["ota"]["token"] = true;
+  filter["telemetry"]["filter"] = true;
+  filter["telemetry"]["alpha"] = true;
+  filter["telemetry"]["median_n"] = true;
+  filter["telemetry"]["spike_w"] = true;
+  filter["rules"] = true;
+  filter["tariff"]["price"] = true;
+  filter["tariff"]["reserve_pct"] = true;
+  filter["tariff"]["charge_w"] = true;
+  filter["tariff"]["windows"][0]["days"] = true;
+  filter["tariff"]["windows"][0]["from"] = true;
+  filter["tariff"]["windows"][0]["to"] = true;
+  filter["tariff"]["windows"][0]["price"] = true;
+  filter["solar"]["panel_w"] = true;
+  filter["eink"]["soc_change_threshold"] = true;
+  filter["eink"]["power_change_threshold"] = true;
+  filter["eink"]["power_interval"] = true;
+}
+
+static const char *const DAY_NAMES[] = {"sun", "mon", "tue", "wed",
+                                        "thu", "fri", "sat"};
+
+static int dayIndex(const char *name, int length) {
+  for (int i = 0; i < 7; i++)
+    if (length == 3 && strncasecmp(name, DAY_NAMES[i], 3) == 0)
+      return i;
+  return -1;
+}
+
+// "mon-fri", "sat,sun", "fri-mon" or "daily" to a tm_wday mask, 0 if bad
+static uint8_t parseDays(const char *text) {
+  if (!text || !*text || strcasecmp(text, "daily") == 0)
+    return 0x7F;
+  uint8_t mask = 0;
+  while (*text) {
+    const char *dash = strchr(text, '-');
+    const char *comma = strchr(text, ',');
+    const char *end = comma ? comma : text + strlen(text);
+    int first = dayIndex(text, (dash && dash < end ? dash : end) - text);
+    int last = dash && dash < end ? dayIndex(dash + 1, end - dash - 1) : first;
+    if (first < 0 || last < 0)
+      return 0;
+    for (int d = first;; d = (d + 1) % 7) {
+      mask |= 1 << d;
+      if (d == last)
+        break;
+    }
+    text = comma ? comma + 1 : end;
   }
+  return mask;
+}
 
-  String content = sdManager->readFile(path);
-  if (content.isEmpty()) {
-    Serial.println("Config: File empty or not found");
-    return false;
+static String formatDays(uint8_t mask) {
+  if ((mask & 0x7F) == 0x7F)
+    return "daily";
+  String out;
+  for (int i = 0; i < 7; i++) {
+    if (!(mask & (1 << i)))
+      continue;
+    if (out.length() > 0)
+      out += ',';
+    out += DAY_NAMES[i];
   }
+  return out;
+}
 
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, content);
+// "HH:MM" to minutes after midnight (24:00 allowed), -1 if bad
+static int parseClock(const char *text) {
+  int h, m;
+  if (!text || sscanf(text, "%d:%d", &h, &m) != 2 || h < 0 || m < 0 ||
+      m > 59 || h * 60 + m > 24 * 60)
+    return -1;
+  return h * 60 + m;
+}
 
-  if (error) {
-    Serial.printf("Config: JSON parse error: %s\n", error.c_str());
+// A save interrupted between remove and rename leaves only the temp file
+static File openConfig(fs::FS &fs, const char *path) {
+  String tempPath = String(path) + ".tmp";
+  File file = fs.open(path, FILE_READ);
+  if (!file && fs.exists(tempPath.c_str())) {
+    Serial.println("Config: Recovering from interrupted save");
+    file = fs.open(tempPath.c_str(), FILE_READ);
+  }
+  return file;
+}
+
+// Serialize straight to a temp file, then swap it in. LittleFS renames
+// over the old file atomically; FAT cannot, so the old one goes first and
+// openConfig() falls back to the temp file if power is lost in between.
+static bool writeConfig(fs::FS &fs, bool renameReplaces, const char *path,
+                        const JsonDocument &doc) {
+  String tempPath = String(path) + ".tmp";
+  File file = fs.open(tempPath.c_str(), FILE_WRITE);
+  if (!file)
+    return false;
+  size_t expected = measureJson(doc);
+  size_t written = serializeJson(doc, file);
+  file.close();
+
+  if (written != expected) {
+    fs.remove(tempPath.c_str());
     return false;
   }
+  if (!renameReplaces)
+    fs.remove(path);
+  return fs.rename(tempPath.c_str(), path);
+}
 
+void Config::fromJson(JsonDocument &doc) {
   // WiFi
   if (doc["wifi"].is<JsonObject>()) {
     _wifiSSID = doc["wifi"]["ssid"].as<String>();
@@ -57,13 +209,26 @@ bool Config::load(const char *path) {
 
   // Bluetooth
   if (doc["bluetooth"].is<JsonObject>()) {
-    _fossibotMAC = doc["bluetooth"]["fossibot_mac"].as<String>();
+    _fossibotCount = 0;
+    if (doc["bluetooth"]["fossibot_macs"].is<JsonArray>()) {
+      JsonArray macs = doc["bluetooth"]["fossibot_macs"].as<JsonArray>();
+      for (JsonVariant mac : macs) {
+        if (_fossibotCount >= MAX_FOSSIBOTS)
+          break;
+        String value = mac.as<String>();
+        if (value.length() > 0)
+          _fossibotMACs[_fossibotCount++] = value;
+      }
+    } else {
+      setFossibotMAC(doc["bluetooth"]["fossibot_mac"].as<String>());
+    }
   }
 
   // Display
   if (doc["display"].is<JsonObject>()) {
     _theme = doc["display"]["theme"] | "classic_grid";
     _autoSleepMinutes = doc["display"]["auto_sleep_minutes"] | 5;
+    _sleepWakeMinutes = doc["display"]["sleep_wake_minutes"] | 5;
   }
 
   // Timezone
@@ -71,6 +236,13 @@ bool Config::load(const char *path) {
     _timezoneOffset = doc["timezone"]["offset_hours"] | 0;
   }
 
+  // Alarm
+  if (doc["alarm"].is<JsonObject>()) {
+    _alarmEnabled = doc["alarm"]["enabled"] | false;
+    _alarmHour = doc["alarm"]["hour"] | 7;
+    _alarmMinute = doc["alarm"]["minute"] | 0;
+  }
+
   // Weather
   if (doc["weather"].is<JsonObject>()) {
     _weatherAPIKey = doc["weather"]["api_key"].as<String>();
@@ -78,61 +250,496 @@ bool Config::load(const char *path) {
     _weatherUnits = doc["weather"]["units"] | "metric";
   }
 
+  // MQTT
+  if (doc["mqtt"].is<JsonObject>()) {
+    _mqttHost = doc["mqtt"]["host"] | "";
+    _mqttPort = doc["mqtt"]["port"] | 1883;
+    _mqttUser = doc["mqtt"]["user"] | "";
+    _mqttPassword = doc["mqtt"]["password"] | "";
+    _mqttTopic = doc["mqtt"]["topic"] | "fossibot/telemetry";
+    _mqttIntervalSeconds = doc["mqtt"]["interval_s"] | 60;
+    _mqttDelta = strcmp(doc["mqtt"]["format"] | "msgpack", "delta") == 0;
+  }
+
+  // HTTP API
+  if (doc["api"].is<JsonObject>()) {
+    _apiEnabled = doc["api"]["enabled"] | false;
+    _apiPort = doc["api"]["port"] | 80;
+  }
+
+  // Frame recorder
+  _recordFrames = doc["recorder"]["enabled"] | false;
+
+  // Telemetry beacon
+  _beaconEnabled = doc["beacon"]["enabled"] | false;
+
+  // Panel mesh
+  _meshEnabled = doc["mesh"]["enabled"] | false;
+  _meshChannel = constrain((int)(doc["mesh"]["channel"] | 1), 1, 13);
+  _meshKey = doc["mesh"]["key"] | "";
+
+  // Firmware updates
+  _otaEnabled = doc["ota"]["enabled"] | false;
+  _otaToken = doc["ota"]["token"] | "";
+
+  // Telemetry filter
+  if (doc["telemetry"].is<JsonObject>()) {
+    _telemetryFilter = doc["telemetry"]["filter"] | "ewma";
+    _filterAlpha = constrain((float)(doc["telemetry"]["alpha"] | 0.3f), 0.01f,
+                             1.0f);
+    _filterMedianN = constrain((int)(doc["telemetry"]["median_n"] | 5), 1, 9);
+    _filterSpikeW = constrain((int)(doc["telemetry"]["spike_w"] | 500), 0,
+                              3000);
+  }
+
+  // Automation rules
+  _rules = "";
+  for (JsonVariantConst rule : doc["rules"].as<JsonArrayConst>()) {
+    if (_rules.length() > 0)
+      _rules += '\n';
+    _rules += rule | "";
+  }
+
+  // Time-of-use tariff
+  _tariffCount = 0;
+  if (doc["tariff"].is<JsonObject>()) {
+    _tariffPrice = doc["tariff"]["price"] | 0.0f;
+    _reservePct = constrain((int)(doc["tariff"]["reserve_pct"] | 20), 0, 90);
+    _chargeW = constrain((int)(doc["tariff"]["charge_w"] | 500), 50, 3000);
+    for (JsonVariantConst window :
+         doc["tariff"]["windows"].as<JsonArrayConst>()) {
+      if (_tariffCount >= MAX_TARIFF_WINDOWS)
+        break;
+      uint8_t days = parseDays(window["days"] | "daily");
+      int from = parseClock(window["from"] | "");
+      int to = parseClock(window["to"] | "");
+      if (!days || from < 0 || to < 0 || !window["price"].is<float>()) {
+        Serial.println("Config: Tariff window skipped (days, from, to, price)");
+        continue;
+      }
+      _tariffWindows[_tariffCount++] = {days, (uint16_t)from, (uint16_t)to,
+                                        window["price"].as<float>()};
+    }
+  }
+
+  // Solar panels
+  _solarPanelW = constrain((int)(doc["solar"]["panel_w"] | 0), 0, 5000);
+
   // eInk thresholds
   if (doc["eink"].is<JsonObject>()) {
     _socChangeThreshold = doc["eink"]["soc_change_threshold"] | 1;
     _powerChangeThreshold = doc["eink"]["power_change_threshold"] | 5;
+    _powerRefreshSecs = doc["eink"]["power_interval"] | 10;
   }
-
-  Serial.println("Config: Loaded successfully");
-  return true;
 }
 
-bool Config::save(const char *path) {
-  if (!sdManager || !sdManager->isAvailable()) {
-    Serial.println("Config: SD card not available");
-    return false;
-  }
-
-  JsonDocument doc;
-
+void Config::toJson(JsonDocument &doc) const {
   // WiFi
   doc["wifi"]["ssid"] = _wifiSSID;
-  doc["wifi_ssid"] = _wifiSSID;
-  doc["wifi_pass"] = _wifiPassword;
+  doc["wifi"]["password"] = _wifiPassword;
 
   // Bluetooth
-  doc["fossibot_mac"] = _fossibotMAC;
+  doc["bluetooth"]["fossibot_mac"] = _fossibotMACs[0];
+  if (_fossibotCount > 1) {
+    JsonArray macs = doc["bluetooth"]["fossibot_macs"].to<JsonArray>();
+    for (int i = 0; i < _fossibotCount; i++)
+      macs.add(_fossibotMACs[i]);
+  }
 
   // Display
-  doc["theme"] = _theme;
-  doc["auto_sleep"] = _autoSleepMinutes;
+  doc["display"]["theme"] = _theme;
+  doc["display"]["auto_sleep_minutes"] = _autoSleepMinutes;
+  doc["display"]["sleep_wake_minutes"] = _sleepWakeMinutes;
 
   // Timezone
-  doc["timezone_offset"] = _timezoneOffset;
+  doc["timezone"]["offset_hours"] = _timezoneOffset;
 
   // Alarm
-  doc["alarm_enabled"] = _alarmEnabled;
-  doc["alarm_hour"] = _alarmHour;
-  doc["alarm_minute"] = _alarmMinute;
+  doc["alarm"]["enabled"] = _alarmEnabled;
+  doc["alarm"]["hour"] = _alarmHour;
+  doc["alarm"]["minute"] = _alarmMinute;
 
   // Weather
-  doc["weather_key"] = _weatherAPIKey;
-  doc["weather_city"] = _weatherCity;
-  doc["weather_units"] = _weatherUnits;
+  doc["weather"]["api_key"] = _weatherAPIKey;
+  doc["weather"]["city"] = _weatherCity;
+  doc["weather"]["units"] = _weatherUnits;
+
+  // MQTT
+  if (_mqttHost.length() > 0) {
+    doc["mqtt"]["host"] = _mqttHost;
+    doc["mqtt"]["port"] = _mqttPort;
+    doc["mqtt"]["user"] = _mqttUser;
+    doc["mqtt"]["password"] = _mqttPassword;
+    doc["mqtt"]["topic"] = _mqttTopic;
+    doc["mqtt"]["interval_s"] = _mqttIntervalSeconds;
+    doc["mqtt"]["format"] = _mqttDelta ? "delta" : "msgpack";
+  }
 
-  // eInk thresholds (removed as per instruction's implied flattening)
+  // HTTP API
+  doc["api"]["enabled"] = _apiEnabled;
+  doc["api"]["port"] = _apiPort;
+
+  // Frame recorder
+  doc["recorder"]["enabled"] = _recordFrames;
+
+  // Telemetry beacon
+  doc["beacon"]["enabled"] = _beaconEnabled;
+
+  // Panel mesh
+  doc["mesh"]["enabled"] = _meshEnabled;
+  doc["mesh"]["channel"] = _meshChannel;
+  doc["mesh"]["key"] = _meshKey;
+
+  // Firmware updates
+  doc["ota"]["enabled"] = _otaEnabled;
+  doc["ota"]["token"] = _otaToken;
+
+  // Telemetry filter
+  doc["telemetry"]["filter"] = _telemetryFilter;
+  doc["telemetry"]["alpha"] = _filterAlpha;
+  doc["telemetry"]["median_n"] = _filterMedianN;
+  doc["telemetry"]["spike_w"] = _filterSpikeW;
+
+  // Automation rules
+  if (_rules.length() > 0) {
+    JsonArray rules = doc["rules"].to<JsonArray>();
+    int start = 0;
+    while (start <= (int)_rules.length()) {
+      int end = _rules.indexOf('\n', start);
+      if (end < 0)
+        end = _rules.length();
+      rules.add(_rules.substring(start, end));
+      start = end + 1;
+    }
+  }
+
+  // Time-of-use tariff (a flat price alone still prices the cost screen)
+  if (_tariffCount > 0 || _tariffPrice > 0) {
+    doc["tariff"]["price"] = _tariffPrice;
+    doc["tariff"]["reserve_pct"] = _reservePct;
+    doc["tariff"]["charge_w"] = _chargeW;
+    JsonArray windows = doc["tariff"]["windows"].to<JsonArray>();
+    for (int i = 0; i < _tariffCount; i++) {
+      const TariffWindow &w = _tariffWindows[i];
+      JsonObject window = windows.add<JsonObject>();
+      char clock[6];
+      window["days"] = formatDays(w.days);
+      snprintf(clock, sizeof(clock), "%02d:%02d", w.fromMin / 60,
+               w.fromMin % 60);
+      window["from"] = clock;
+      snprintf(clock, sizeof(clock), "%02d:%02d", w.toMin / 60, w.toMin % 60);
+      window["to"] = clock;
+      window["price"] = w.price;
+    }
+  }
+
+  // Solar panels
+  if (_solarPanelW > 0)
+    doc["solar"]["panel_w"] = _solarPanelW;
+
+  // eInk refresh policy
+  doc["eink"]["soc_change_threshold"] = _socChangeThreshold;
+  doc["eink"]["power_change_threshold"] = _powerChangeThreshold;
+  doc["eink"]["power_interval"] = _powerRefreshSecs;
+}
+
+bool Config::readsBack(const JsonDocument &doc) {
+  String json;
+  serializeJson(doc, json);
+  JsonDocument filter;
+  buildLoadFilter(filter);
+  JsonDocument parsed;
+  if (deserializeJson(parsed, json, DeserializationOption::Filter(filter)))
+    return false;
+  Config copy;
+  copy.fromJson(parsed);
+  JsonDocument again;
+  copy.toJson(again);
+  // As text: the parser may land a float a bit off the one it printed
+  String rewritten;
+  serializeJson(again, rewritten);
+  return rewritten == json;
+}
+
+bool Config::load(const char *path) {
+  JsonDocument filter;
+  buildLoadFilter(filter);
+  JsonDocument doc;
+  DeserializationError error;
+
+  // Flash holds the working copy; the card's is adopted if it was edited
+  // on a PC
+  bool parsed = false;
+  if (flashStore && flashStore->isAvailable()) {
+    flashStore->sync(path);
+    File file = openConfig(flashStore->fs(), path);
+    if (file && file.size() > 0) {
+      error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
+      parsed = !error;
+      if (error)
+        Serial.printf("Config: Flash copy unreadable: %s\n", error.c_str());
+    }
+    if (file)
+      file.close();
+  }
+
+  if (!parsed) {
+    if (!sdManager || !sdManager->isAvailable()) {
+      Serial.println("Config: SD card not available");
+      return false;
+    }
+    SDAccess access(sdManager);
+    if (!access)
+      return false;
+
+    File file = openConfig(sdFS(), path);
+    if (!file || file.size() == 0) {
+      Serial.println("Config: File empty or not found");
+      return false;
+    }
+
+    // Parse straight from the file: no String copy of the whole config
+    error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
+    file.close();
+  }
+
+  if (error) {
+    Serial.printf("Config: JSON parse error: %s\n", error.c_str());
+    return false;
+  }
+
+  fromJson(doc);
+  Serial.println("Config: Loaded successfully");
+  return true;
+}
 
-  String output;
-  serializeJson(doc, output); // Changed to serializeJson as per instruction
+bool Config::save(const char *path) {
+  JsonDocument doc;
+
+  toJson(doc);
+  if (!readsBack(doc))
+    Serial.println("Config: Saved settings do not load back the same");
 
-  if (sdManager->writeFile(path, output)) { // Changed to use output string
+  if (flashStore && flashStore->isAvailable()) {
+    if (!writeConfig(flashStore->fs(), true, path, doc)) {
+      Serial.println("Config: Failed to save");
+      return false;
+    }
+    flashStore->mirror(path);
     Serial.println("Config: Saved successfully");
     return true;
   }
 
-  Serial.println("Config: Failed to save");
-  return false;
+  if (!sdManager || !sdManager->isAvailable()) {
+    Serial.println("Config: SD card not available");
+    return false;
+  }
+  SDAccess access(sdManager);
+  if (!access)
+    return false;
+  if (!writeConfig(sdFS(), false, path, doc)) {
+    Serial.println("Config: Failed to save");
+    access.fail();
+    return false;
+  }
+  Serial.println("Config: Saved successfully");
+  return true;
+}
+
+float Config::getTariffPriceAt(time_t t) const {
+  struct tm local;
+  localtime_r(&t, &local);
+  int minute = local.tm_hour * 60 + local.tm_min;
+  int yesterday = (local.tm_wday + 6) % 7;
+  float price = _tariffPrice;
+  for (int i = 0; i < _tariffCount; i++) {
+    const TariffWindow &w = _tariffWindows[i];
+    bool inside;
+    if (w.toMin > w.fromMin)
+      inside = (w.days & (1 << local.tm_wday)) && minute >= w.fromMin &&
+               minute < w.toMin;
+    else // Past midnight: the tail belongs to the day it started
+      inside = ((w.days & (1 << local.tm_wday)) && minute >= w.fromMin) ||
+               ((w.days & (1 << yesterday)) && minute < w.toMin);
+    if (inside)
+      price = w.price;
+  }
+  return price;
+}
+
+uint32_t Config::diff(const Config &o) const {
+  uint32_t changed = 0;
+  auto mark = [&](bool differs, uint32_t section) {
+    if (differs)
+      changed |= section;
+  };
+  mark(_wifiSSID != o._wifiSSID || _wifiPassword != o._wifiPassword,
+       WIFI_SETTINGS);
+  bool macs = _fossibotCount != o._fossibotCount;
+  for (int i = 0; i < _fossibotCount && !macs; i++)
+    macs = _fossibotMACs[i] != o._fossibotMACs[i];
+  mark(macs, FOSSIBOT_SETTINGS);
+  mark(_theme != o._theme || _autoSleepMinutes != o._autoSleepMinutes ||
+           _sleepWakeMinutes != o._sleepWakeMinutes,
+       DISPLAY_SETTINGS);
+  mark(_socChangeThreshold != o._socChangeThreshold ||
+           _powerChangeThreshold != o._powerChangeThreshold ||
+           _powerRefreshSecs != o._powerRefreshSecs,
+       EINK_SETTINGS);
+  mark(_timezoneOffset != o._timezoneOffset, TIMEZONE_SETTINGS);
+  mark(_alarmEnabled != o._alarmEnabled || _alarmHour != o._alarmHour ||
+           _alarmMinute != o._alarmMinute,
+       ALARM_SETTINGS);
+  mark(_weatherAPIKey != o._weatherAPIKey ||
+           _weatherCity != o._weatherCity ||
+           _weatherUnits != o._weatherUnits,
+       WEATHER_SETTINGS);
+  mark(_mqttHost != o._mqttHost || _mqttPort != o._mqttPort ||
+           _mqttUser != o._mqttUser || _mqttPassword != o._mqttPassword ||
+           _mqttTopic != o._mqttTopic ||
+           _mqttIntervalSeconds != o._mqttIntervalSeconds ||
+           _mqttDelta != o._mqttDelta,
+       MQTT_SETTINGS);
+  mark(_apiEnabled != o._apiEnabled || _apiPort != o._apiPort, API_SETTINGS);
+  mark(_recordFrames != o._recordFrames, RECORDER_SETTINGS);
+  mark(_beaconEnabled != o._beaconEnabled, BEACON_SETTINGS);
+  mark(_meshEnabled != o._meshEnabled || _meshChannel != o._meshChannel ||
+           _meshKey != o._meshKey,
+       MESH_SETTINGS);
+  mark(_otaEnabled != o._otaEnabled || _otaToken != o._otaToken,
+       OTA_SETTINGS);
+  mark(_telemetryFilter != o._telemetryFilter ||
+           _filterAlpha != o._filterAlpha ||
+           _filterMedianN != o._filterMedianN ||
+           _filterSpikeW != o._filterSpikeW,
+       TELEMETRY_SETTINGS);
+  mark(_rules != o._rules, RULES_SETTINGS);
+  bool tariff = _tariffCount != o._tariffCount ||
+                _tariffPrice != o._tariffPrice ||
+                _reservePct != o._reservePct || _chargeW != o._chargeW;
+  for (int i = 0; i < _tariffCount && !tariff; i++) {
+    const TariffWindow &a = _tariffWindows[i];
+    const TariffWindow &b = o._tariffWindows[i];
+    tariff = a.days != b.days || a.fromMin != b.fromMin ||
+             a.toMin != b.toMin || a.price != b.price;
+  }
+  mark(tariff, TARIFF_SETTINGS);
+  mark(_solarPanelW != o._solarPanelW, SOLAR_SETTINGS);
+  return changed;
+}
+
+// Copy into a fixed field; false (and truncated) if it does not fit
+static bool copyField(char *dest, size_t size, const String &value) {
+  strlcpy(dest, value.c_str(), size);
+  return value.length() < size;
+}
+
+bool Config::snapshot(Snapshot &out) const {
+  bool fits = copyField(out.wifiSSID, sizeof(out.wifiSSID), _wifiSSID) &&
+              copyField(out.wifiPassword, sizeof(out.wifiPassword),
+                        _wifiPassword) &&
+              copyField(out.theme, sizeof(out.theme), _theme) &&
+              copyField(out.weatherAPIKey, sizeof(out.weatherAPIKey),
+                        _weatherAPIKey) &&
+              copyField(out.weatherCity, sizeof(out.weatherCity),
+                        _weatherCity) &&
+              copyField(out.weatherUnits, sizeof(out.weatherUnits),
+                        _weatherUnits) &&
+              copyField(out.mqttHost, sizeof(out.mqttHost), _mqttHost) &&
+              copyField(out.mqttUser, sizeof(out.mqttUser), _mqttUser) &&
+              copyField(out.mqttPassword, sizeof(out.mqttPassword),
+                        _mqttPassword) &&
+              copyField(out.mqttTopic, sizeof(out.mqttTopic), _mqttTopic) &&
+              copyField(out.telemetryFilter, sizeof(out.telemetryFilter),
+                        _telemetryFilter) &&
+              copyField(out.otaToken, sizeof(out.otaToken), _otaToken) &&
+              copyField(out.meshKey, sizeof(out.meshKey), _meshKey) &&
+              copyField(out.rules, sizeof(out.rules), _rules);
+  for (int i = 0; i < MAX_FOSSIBOTS; i++)
+    fits = copyField(out.fossibotMACs[i], sizeof(out.fossibotMACs[i]),
+                     _fossibotMACs[i]) &&
+           fits;
+  out.fossibotCount = _fossibotCount;
+  out.autoSleepMinutes = _autoSleepMinutes;
+  out.sleepWakeMinutes = _sleepWakeMinutes;
+  out.timezoneOffset = _timezoneOffset;
+  out.alarmEnabled = _alarmEnabled;
+  out.alarmHour = _alarmHour;
+  out.alarmMinute = _alarmMinute;
+  out.socChangeThreshold = _socChangeThreshold;
+  out.powerChangeThreshold = _powerChangeThreshold;
+  out.powerRefreshSecs = _powerRefreshSecs;
+  out.mqttPort = _mqttPort;
+  out.mqttIntervalSeconds = _mqttIntervalSeconds;
+  out.mqttDelta = _mqttDelta;
+  out.apiEnabled = _apiEnabled;
+  out.apiPort = _apiPort;
+  out.recordFrames = _recordFrames;
+  out.otaEnabled = _otaEnabled;
+  out.filterAlpha = _filterAlpha;
+  out.filterMedianN = _filterMedianN;
+  out.filterSpikeW = _filterSpikeW;
+  for (int i = 0; i < MAX_TARIFF_WINDOWS; i++)
+    out.tariffWindows[i] = i < _tariffCount ? _tariffWindows[i]
+                                            : TariffWindow{0, 0, 0, 0};
+  out.tariffCount = _tariffCount;
+  out.tariffPrice = _tariffPrice;
+  out.reservePct = _reservePct;
+  out.chargeW = _chargeW;
+  out.solarPanelW = _solarPanelW;
+  out.beaconEnabled = _beaconEnabled;
+  out.meshEnabled = _meshEnabled;
+  out.meshChannel = _meshChannel;
+  return fits;
+}
+
+void Config::restore(const Snapshot &in) {
+  _wifiSSID = in.wifiSSID;
+  _wifiPassword = in.wifiPassword;
+  for (int i = 0; i < MAX_FOSSIBOTS; i++)
+    _fossibotMACs[i] = in.fossibotMACs[i];
+  _fossibotCount = constrain(in.fossibotCount, 0, MAX_FOSSIBOTS);
+  _theme = in.theme;
+  _autoSleepMinutes = in.autoSleepMinutes;
+  _sleepWakeMinutes = in.sleepWakeMinutes;
+  _timezoneOffset = in.timezoneOffset;
+  _alarmEnabled = in.alarmEnabled;
+  _alarmHour = in.alarmHour;
+  _alarmMinute = in.alarmMinute;
+  _weatherAPIKey = in.weatherAPIKey;
+  _weatherCity = in.weatherCity;
+  _weatherUnits = in.weatherUnits;
+  _socChangeThreshold = in.socChangeThreshold;
+  _powerChangeThreshold = in.powerChangeThreshold;
+  _powerRefreshSecs = in.powerRefreshSecs;
+  _mqttHost = in.mqttHost;
+  _mqttPort = in.mqttPort;
+  _mqttUser = in.mqttUser;
+  _mqttPassword = in.mqttPassword;
+  _mqttTopic = in.mqttTopic;
+  _mqttIntervalSeconds = in.mqttIntervalSeconds;
+  _mqttDelta = in.mqttDelta;
+  _apiEnabled = in.apiEnabled;
+  _apiPort = in.apiPort;
+  _recordFrames = in.recordFrames;
+  _otaEnabled = in.otaEnabled;
+  _otaToken = in.otaToken;
+  _telemetryFilter = in.telemetryFilter;
+  _filterAlpha = in.filterAlpha;
+  _filterMedianN = in.filterMedianN;
+  _filterSpikeW = in.filterSpikeW;
+  _rules = in.rules;
+  _tariffCount = constrain(in.tariffCount, 0, MAX_TARIFF_WINDOWS);
+  for (int i = 0; i < _tariffCount; i++)
+    _tariffWindows[i] = in.tariffWindows[i];
+  _tariffPrice = in.tariffPrice;
+  _reservePct = in.reservePct;
+  _chargeW = in.chargeW;
+  _solarPanelW = in.solarPanelW;
+  _beaconEnabled = in.beaconEnabled;
+  _meshEnabled = in.meshEnabled;
+  _meshChannel = in.meshChannel;
+  _meshKey = in.meshKey;
 }
 
 void Config::setWiFi(const String &ssid, const String &password) {
@@ -140,11 +747,16 @@ void Config::setWiFi(const String &ssid, const String &password) {
   _wifiPassword = password;
 }
 
-void Config::setFossibotMAC(const String &mac) { _fossibotMAC = mac; }
+void Config::setFossibotMAC(const String &mac) {
+  _fossibotMACs[0] = mac;
+  if (_fossibotCount == 0 && mac.length() > 0)
+    _fossibotCount = 1;
+}
 
 void Config::setTheme(const String &theme) { _theme = theme; }
 
 void Config::setAutoSleepMinutes(int minutes) { _autoSleepMinutes = minutes; }
+void Config::setSleepWakeMinutes(int minutes) { _sleepWakeMinutes = minutes; }
 
 void Config::setAlarmEnabled(bool enabled) { _alarmEnabled = enabled; }
 void Config::setAlarmHour(int hour) { _alarmHour = hour; }
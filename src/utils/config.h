@@ -9,6 +9,7 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <time.h>
 
 class Config {
 public:
@@ -34,20 +35,131 @@ public:
    */
   void setDefaults();
 
+  static const int MAX_FOSSIBOTS = 4;
+  static const int MAX_RULES_TEXT = 512; // All automation rules
+  static const int MAX_TARIFF_WINDOWS = 8;
+
+  // A time-of-use price: on the days in the mask (bit 0 Sunday, as
+  // tm_wday), local minutes [fromMin, toMin), past midnight if toMin is
+  // not after fromMin
+  struct TariffWindow {
+    uint8_t days;
+    uint16_t fromMin;
+    uint16_t toMin;
+    float price; // Per kWh
+  };
+
+  // Every setting in fixed-size fields, for keeping in RTC memory across
+  // deep sleep instead of parsing the file again
+  struct Snapshot {
+    char wifiSSID[33];
+    char wifiPassword[65];
+    char fossibotMACs[MAX_FOSSIBOTS][18];
+    int8_t fossibotCount;
+    char theme[24];
+    int16_t autoSleepMinutes;
+    int16_t sleepWakeMinutes;
+    int8_t timezoneOffset;
+    bool alarmEnabled;
+    int8_t alarmHour;
+    int8_t alarmMinute;
+    char weatherAPIKey[48];
+    char weatherCity[32];
+    char weatherUnits[12];
+    int16_t socChangeThreshold;
+    int16_t powerChangeThreshold;
+    int16_t powerRefreshSecs;
+    char mqttHost[64];
+    uint16_t mqttPort;
+    uint16_t mqttIntervalSeconds;
+    char mqttUser[32];
+    char mqttPassword[64];
+    char mqttTopic[64];
+    bool mqttDelta;
+    bool apiEnabled;
+    uint16_t apiPort;
+    bool recordFrames;
+    bool otaEnabled;
+    char otaToken[33];
+    char telemetryFilter[8];
+    float filterAlpha;
+    uint8_t filterMedianN;
+    uint16_t filterSpikeW;
+    char rules[MAX_RULES_TEXT];
+    TariffWindow tariffWindows[MAX_TARIFF_WINDOWS];
+    int8_t tariffCount;
+    float tariffPrice;
+    uint8_t reservePct;
+    uint16_t chargeW;
+    uint16_t solarPanelW;
+    bool beaconEnabled;
+    bool meshEnabled;
+    uint8_t meshChannel;
+    char meshKey[33];
+  };
+
+  /**
+   * Copy the settings into a snapshot
+   * @return false if a string setting is too long for its field
+   */
+  bool snapshot(Snapshot &out) const;
+
+  /**
+   * Replace the settings with a snapshot's
+   */
+  void restore(const Snapshot &in);
+
+  // Groups of settings, for telling listeners what a save or a reload
+  // changed (see ConfigService)
+  enum Section : uint32_t {
+    WIFI_SETTINGS = 1 << 0,
+    FOSSIBOT_SETTINGS = 1 << 1,
+    DISPLAY_SETTINGS = 1 << 2, // Theme, auto sleep, sleep-cycle wakes
+    EINK_SETTINGS = 1 << 3,    // Refresh thresholds
+    TIMEZONE_SETTINGS = 1 << 4,
+    ALARM_SETTINGS = 1 << 5,
+    WEATHER_SETTINGS = 1 << 6,
+    MQTT_SETTINGS = 1 << 7,
+    API_SETTINGS = 1 << 8,
+    RECORDER_SETTINGS = 1 << 9,
+    OTA_SETTINGS = 1 << 10,
+    TELEMETRY_SETTINGS = 1 << 11, // Filter
+    RULES_SETTINGS = 1 << 12,
+    TARIFF_SETTINGS = 1 << 13,
+    SOLAR_SETTINGS = 1 << 14,
+    BEACON_SETTINGS = 1 << 15,
+    MESH_SETTINGS = 1 << 16,
+    ALL_SETTINGS = 0xFFFFFFFF
+  };
+
+  /**
+   * The sections with a setting that differs from other's
+   */
+  uint32_t diff(const Config &other) const;
+
   // WiFi settings
   String getWiFiSSID() const { return _wifiSSID; }
   String getWiFiPassword() const { return _wifiPassword; }
   void setWiFi(const String &ssid, const String &password);
 
   // Bluetooth settings
-  String getFossibotMAC() const { return _fossibotMAC; }
+  String getFossibotMAC() const { return _fossibotMACs[0]; }
   void setFossibotMAC(const String &mac);
 
+  // Fleet: bluetooth.fossibot_macs lists extra units (first = primary)
+  int getFossibotCount() const { return _fossibotCount; }
+  String getFossibotMAC(int index) const {
+    return index >= 0 && index < _fossibotCount ? _fossibotMACs[index] : "";
+  }
+
   // Display settings
   String getTheme() const { return _theme; }
   void setTheme(const String &theme);
   int getAutoSleepMinutes() const { return _autoSleepMinutes; }
   void setAutoSleepMinutes(int minutes);
+  // Deep sleep wakes this often to sample the power bank (0 = touch only)
+  int getSleepWakeMinutes() const { return _sleepWakeMinutes; }
+  void setSleepWakeMinutes(int minutes);
 
   // Timezone
   int getTimezoneOffset() const { return _timezoneOffset; }
@@ -60,9 +172,65 @@ public:
   void setWeather(const String &apiKey, const String &city,
                   const String &units);
 
+  // MQTT telemetry (no host: off)
+  String getMqttHost() const { return _mqttHost; }
+  int getMqttPort() const { return _mqttPort; }
+  String getMqttUser() const { return _mqttUser; }
+  String getMqttPassword() const { return _mqttPassword; }
+  String getMqttTopic() const { return _mqttTopic; }
+  int getMqttIntervalSeconds() const { return _mqttIntervalSeconds; }
+  bool getMqttDelta() const { return _mqttDelta; } // format "delta"
+
+  // HTTP API on the LAN (read-only)
+  bool getApiEnabled() const { return _apiEnabled; }
+  int getApiPort() const { return _apiPort; }
+
+  // Raw BLE frames to the card for debugging (see FrameRecorder)
+  bool getRecordFrames() const { return _recordFrames; }
+
+  // Telemetry summary in the BLE advertisement (see TelemetryBeacon)
+  bool getBeaconEnabled() const { return _beaconEnabled; }
+
+  // Readings shared with other panels over ESP-NOW (see PanelMesh); the
+  // key signs the messages, and commands are only relayed with one
+  bool getMeshEnabled() const { return _meshEnabled; }
+  int getMeshChannel() const { return _meshChannel; }
+  String getMeshKey() const { return _meshKey; }
+
+  // Firmware updates over the API and BLE (see OtaUpdate); every transfer
+  // presents the token
+  bool getOtaEnabled() const { return _otaEnabled; }
+  String getOtaToken() const { return _otaToken; }
+
+  // Telemetry conditioning before display and history (TelemetryFilter):
+  // "ewma", "median" or "off"
+  String getTelemetryFilter() const { return _telemetryFilter; }
+  float getFilterAlpha() const { return _filterAlpha; }
+  int getFilterMedianN() const { return _filterMedianN; }
+  int getFilterSpikeW() const { return _filterSpikeW; } // 0 = no rejection
+
+  // Outlet automation rules, one per line (see RuleEngine)
+  String getRules() const { return _rules; }
+
+  // Time-of-use tariff for the charge planner (no windows: off) and the
+  // cost screen (no price at all: off); windows listed later win where
+  // they overlap
+  int getTariffCount() const { return _tariffCount; }
+  const TariffWindow &getTariffWindow(int index) const {
+    return _tariffWindows[index];
+  }
+  float getTariffPrice() const { return _tariffPrice; } // Outside windows
+  float getTariffPriceAt(time_t t) const;               // Per kWh, at t
+  int getReservePct() const { return _reservePct; }     // Keep at least
+  int getChargeW() const { return _chargeW; }           // AC charge rate
+
+  // Rated power of the solar panels (0: unknown), for the harvest screen
+  int getSolarPanelW() const { return _solarPanelW; }
+
   // Power bank thresholds for significant change detection
   int getSOCChangeThreshold() const { return _socChangeThreshold; }
   int getPowerChangeThreshold() const { return _powerChangeThreshold; }
+  int getPowerRefreshSecs() const { return _powerRefreshSecs; } // Per panel
 
   // Alarm settings
   bool getAlarmEnabled() const { return _alarmEnabled; }
@@ -73,17 +241,29 @@ public:
   void setAlarmMinute(int minute);
 
 private:
+  // The settings file's document: save() writes what toJson() fills,
+  // load() applies what it parsed through fromJson()
+  void toJson(JsonDocument &doc) const;
+  void fromJson(JsonDocument &doc);
+
+  // A document parsed as load() parses it, applied to a fresh Config and
+  // written again comes out as the same text: nothing save() writes is
+  // lost on the next load
+  static bool readsBack(const JsonDocument &doc);
+
   // Settings variables
   // WiFi
   String _wifiSSID;
   String _wifiPassword;
 
   // Bluetooth
-  String _fossibotMAC;
+  String _fossibotMACs[MAX_FOSSIBOTS];
+  int _fossibotCount;
 
   // Display
   String _theme;
   int _autoSleepMinutes;
+  int _sleepWakeMinutes;
 
   // Timezone
   int _timezoneOffset;
@@ -98,9 +278,57 @@ private:
   String _weatherCity;
   String _weatherUnits;
 
+  // MQTT
+  String _mqttHost;
+  int _mqttPort;
+  String _mqttUser;
+  String _mqttPassword;
+  String _mqttTopic;
+  int _mqttIntervalSeconds;
+  bool _mqttDelta;
+
+  // HTTP API
+  bool _apiEnabled;
+  int _apiPort;
+
+  // Frame recorder
+  bool _recordFrames;
+
+  // Telemetry beacon
+  bool _beaconEnabled;
+
+  // Panel mesh
+  bool _meshEnabled;
+  int _meshChannel;
+  String _meshKey;
+
+  // Firmware updates
+  bool _otaEnabled;
+  String _otaToken;
+
+  // Telemetry filter
+  String _telemetryFilter;
+  float _filterAlpha;
+  int _filterMedianN;
+  int _filterSpikeW;
+
+  // Automation rules, newline separated
+  String _rules;
+
+  // Tariff
+  TariffWindow _tariffWindows[MAX_TARIFF_WINDOWS];
+  int _tariffCount;
+  float _tariffPrice;
+  int _reservePct;
+  int _chargeW;
+
+  // Solar
+  int _solarPanelW;
+
   // eInk refresh thresholds
   int _socChangeThreshold;   // SOC change % to trigger refresh
   int _powerChangeThreshold; // Power change W to trigger refresh
+  int _powerRefreshSecs;     // Least time between power panel repaints
 };
 
 #endif // CONFIG_H
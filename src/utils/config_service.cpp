@@ -0,0 +1,175 @@
+/**
+ * Config Service Implementation
+ */
+
+#include "config_service.h"
+#include "crc16.h"
+#include "flash_store.h"
+#include "log.h"
+#include "sd_manager.h"
+#include <Preferences.h>
+
+extern SDManager *sdManager;
+
+static const char *CACHE_NS = "config";
+static const uint32_t CACHE_VERSION = 1; // Bump if a field changes meaning
+
+static uint32_t cacheLayout() {
+  return CACHE_VERSION | (sizeof(Config::Snapshot) << 8);
+}
+
+ConfigService::ConfigService(Config *config, const char *path)
+    : _config(config), _path(path), _stamp{0, 0, 0, false}, _lastCheck(0),
+      _count(0) {}
+
+bool ConfigService::loadCached(Config &config) {
+  Preferences prefs;
+  if (!prefs.begin(CACHE_NS, true))
+    return false;
+  Cached *cached = new Cached;
+  bool ok = prefs.getBytes("settings", cached, sizeof(Cached)) ==
+                sizeof(Cached) &&
+            cached->layout == cacheLayout();
+  prefs.end();
+  if (ok)
+    config.restore(cached->settings);
+  delete cached;
+  return ok;
+}
+
+void ConfigService::storeCache() {
+  Cached *cached = new Cached;
+  memset(cached, 0, sizeof(Cached));
+  cached->layout = cacheLayout();
+  cached->size = _stamp.size;
+  cached->crc = _stamp.crc;
+  bool fits = _stamp.valid && _config->snapshot(cached->settings);
+
+  Preferences prefs;
+  if (prefs.begin(CACHE_NS, false)) {
+    // A setting too long for the snapshot: boot parses the file instead
+    if (fits)
+      prefs.putBytes("settings", cached, sizeof(Cached));
+    else
+      prefs.remove("settings");
+    prefs.end();
+  }
+  delete cached;
+}
+
+void ConfigService::begin(bool parsed) {
+  _applied = *_config;
+  _lastCheck = millis();
+  if (parsed) {
+    readStamp(_stamp, true);
+    storeCache();
+    return;
+  }
+
+  // Only the tag: the first check reads the file's CRC and compares
+  _stamp.valid = false;
+  Preferences prefs;
+  if (!prefs.begin(CACHE_NS, true))
+    return;
+  Cached *cached = new Cached;
+  if (prefs.getBytes("settings", cached, sizeof(Cached)) == sizeof(Cached) &&
+      cached->layout == cacheLayout())
+    _stamp = {cached->size, 0, cached->crc, true};
+  prefs.end();
+  delete cached;
+}
+
+bool ConfigService::subscribe(uint32_t mask, Listener listener) {
+  if (_count >= MAX_LISTENERS)
+    return false;
+  _subscribers[_count++] = {mask, listener};
+  return true;
+}
+
+void ConfigService::notify(uint32_t changed) {
+  _applied = *_config;
+  if (!changed)
+    return;
+  LOG_I("Config", "Applying changes (sections 0x%04x)", (unsigned)changed);
+  for (int i = 0; i < _count; i++) {
+    if (_subscribers[i].mask & changed)
+      _subscribers[i].listener(*_config, changed);
+  }
+}
+
+bool ConfigService::commit() {
+  bool saved = _config->save(_path);
+  readStamp(_stamp, true); // Our own write is not a change to reload
+  storeCache();
+  notify(_config->diff(_applied));
+  return saved;
+}
+
+// The copy load() reads: flash when it is up, else the card
+bool ConfigService::readStamp(Stamp &out, bool withCrc) {
+  out.valid = false;
+  auto read = [&](fs::FS &fs) {
+    File file = fs.open(_path, FILE_READ);
+    if (!file)
+      return;
+    out.size = file.size();
+    out.modified = file.getLastWrite();
+    out.crc = 0;
+    if (withCrc && out.size <= FlashStore::MAX_HOT_FILE) {
+      uint8_t *data = (uint8_t *)malloc(out.size ? out.size : 1);
+      if (!data) {
+        file.close();
+        return;
+      }
+      if (file.read(data, out.size) == out.size)
+        out.crc = CRC16::modbus(data, out.size);
+      free(data);
+    }
+    file.close();
+    out.valid = true;
+  };
+
+  if (flashStore && flashStore->isAvailable()) {
+    read(flashStore->fs());
+  } else if (sdManager && sdManager->isAvailable()) {
+    SDAccess sd(sdManager);
+    if (sd)
+      read(sdFS());
+  }
+  return out.valid;
+}
+
+void ConfigService::service() {
+  if (millis() - _lastCheck < WATCH_MS)
+    return;
+  _lastCheck = millis();
+  // Not worth waking a card that is off to look: it is looked at again
+  // once something else has it on
+  if (!(flashStore && flashStore->isAvailable()) && sdManager &&
+      sdManager->isAsleep())
+    return;
+
+  Stamp now;
+  if (!readStamp(now, false))
+    return;
+  if (_stamp.valid && now.size == _stamp.size &&
+      now.modified == _stamp.modified)
+    return;
+  if (!readStamp(now, true))
+    return;
+  bool same = _stamp.valid && now.size == _stamp.size && now.crc == _stamp.crc;
+  _stamp = now;
+  if (same)
+    return; // Rewritten with the same contents, or as the NVS copy says
+
+  // Into a fresh copy, so settings taken out of the file go back to their
+  // defaults and a file that no longer parses changes nothing
+  Config fresh;
+  if (!fresh.load(_path)) {
+    LOG_W("Config", "%s changed but did not load, kept", _path);
+    return;
+  }
+  *_config = fresh;
+  storeCache();
+  notify(_config->diff(_applied));
+}
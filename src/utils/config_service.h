@@ -0,0 +1,108 @@
+/**
+ * Config Service
+ *
+ * Owns the settings file on behalf of the global Config: the settings
+ * screens write through commit(), and the loop's service() notices when
+ * the file changed under it (the card's copy adopted into flash, or the
+ * card swapped when there is no flash copy) and loads it again. Either
+ * way the listeners are told which sections (Config::Section) differ from
+ * what they last applied, so consumers keep their own copies of what they
+ * use and nothing polls the getters.
+ *
+ * A change is spotted by the file's size and modification time, then
+ * confirmed by its CRC (a save that wrote the same bytes is no change).
+ * Main loop task only.
+ *
+ * The parsed settings are also kept in NVS as a Config::Snapshot, tagged
+ * with the size and CRC of the file they came from. Boot restores that
+ * (loadCached()) instead of opening and parsing the JSON, so the BLE MAC
+ * is there at once; the first service() pass compares the file with the
+ * tag and loads it only if it differs.
+ */
+
+#ifndef CONFIG_SERVICE_H
+#define CONFIG_SERVICE_H
+
+#include "config.h"
+#include <Arduino.h>
+#include <functional>
+
+class ConfigService {
+public:
+  using Listener = std::function<void(const Config &config, uint32_t changed)>;
+  static const int MAX_LISTENERS = 8;
+  static const uint32_t WATCH_MS = 5000; // Look at the file this often
+
+  ConfigService(Config *config, const char *path);
+
+  /**
+   * Fill config from the NVS copy of the last settings parsed
+   * @return false if there is none, or it is from another build's layout
+   */
+  static bool loadCached(Config &config);
+
+  /**
+   * Take the settings as applied
+   * @param parsed They were just read from the file (which is then noted
+   *        as their source and cached); otherwise they came from the NVS
+   *        copy or the sleep snapshot, and the file is checked against
+   *        the NVS copy's tag on the first service() pass
+   */
+  void begin(bool parsed);
+
+  /**
+   * Call listener with the settings whenever a section in mask changes
+   * @return false if there is no room left
+   */
+  bool subscribe(uint32_t mask, Listener listener);
+
+  /**
+   * Save what the setters changed and tell the listeners
+   * @return false if the file could not be written (the change still
+   *         applies until the next boot)
+   */
+  bool commit();
+
+  /**
+   * Reload the file if it changed since it was last read or written.
+   * Call from the main loop.
+   */
+  void service();
+
+private:
+  struct Stamp {
+    size_t size;
+    time_t modified;
+    uint16_t crc;
+    bool valid;
+  };
+
+  struct Subscriber {
+    uint32_t mask;
+    Listener listener;
+  };
+
+  Config *_config;
+  const char *_path;
+  Config _applied; // What the listeners were last told about
+  Stamp _stamp;
+  unsigned long _lastCheck;
+  Subscriber _subscribers[MAX_LISTENERS];
+  int _count;
+
+  // NVS copy: the layout, the file's tag, then the snapshot
+  struct Cached {
+    uint32_t layout;
+    uint32_t size;
+    uint16_t crc;
+    Config::Snapshot settings;
+  };
+
+  bool readStamp(Stamp &out, bool withCrc);
+  void notify(uint32_t changed);
+  void storeCache();
+};
+
+extern ConfigService *configService;
+
+#endif // CONFIG_SERVICE_H
@@ -0,0 +1,60 @@
+/**
+ * CRC-16/Modbus Implementation
+ */
+
+#include "crc16.h"
+
+namespace {
+
+// C++11 constexpr: one function per step, expanded into the table below
+constexpr uint16_t step(uint16_t crc, int bits) {
+  return bits == 0 ? crc
+                   : step((crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1),
+                          bits - 1);
+}
+
+#define CRC_E(n) step((n), 8)
+#define CRC_E4(n) CRC_E(n), CRC_E(n + 1), CRC_E(n + 2), CRC_E(n + 3)
+#define CRC_E16(n) CRC_E4(n), CRC_E4(n + 4), CRC_E4(n + 8), CRC_E4(n + 12)
+#define CRC_E64(n)                                                             \
+  CRC_E16(n), CRC_E16(n + 16), CRC_E16(n + 32), CRC_E16(n + 48)
+
+constexpr uint16_t TABLE[256] = {CRC_E64(0), CRC_E64(64), CRC_E64(128),
+                                 CRC_E64(192)};
+
+#undef CRC_E64
+#undef CRC_E16
+#undef CRC_E4
+#undef CRC_E
+
+static_assert(TABLE[1] == 0xC0C1 && TABLE[255] == 0x4040,
+              "CRC-16/Modbus table mismatch");
+
+} // namespace
+
+namespace CRC16 {
+
+uint16_t modbus(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++)
+    crc = (crc >> 8) ^ TABLE[(crc ^ data[i]) & 0xFF];
+  return crc;
+}
+
+size_t seal(uint8_t *frame, size_t payloadLen) {
+  uint16_t crc = modbus(frame, payloadLen);
+  frame[payloadLen] = (crc >> 8) & 0xFF; // High byte first (Fossibot)
+  frame[payloadLen + 1] = crc & 0xFF;
+  return payloadLen + 2;
+}
+
+bool verify(const uint8_t *frame, size_t length) {
+  if (length < 3)
+    return false;
+  uint16_t crc = modbus(frame, length - 2);
+  uint16_t hiFirst = (frame[length - 2] << 8) | frame[length - 1];
+  uint16_t loFirst = (frame[length - 1] << 8) | frame[length - 2];
+  return crc == hiFirst || crc == loFirst;
+}
+
+} // namespace CRC16
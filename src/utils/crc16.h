@@ -0,0 +1,39 @@
+/**
+ * CRC-16/Modbus
+ *
+ * Table-driven CRC (poly 0xA001 reflected, init 0xFFFF) used for Fossibot
+ * BLE frames. The 256-entry table is generated at compile time and lives
+ * in flash; one lookup per byte replaces the 8-step bit loop.
+ *
+ * Fossibot puts the CRC high byte first, unlike standard Modbus RTU.
+ */
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <Arduino.h>
+
+namespace CRC16 {
+
+/**
+ * CRC-16/Modbus of a buffer
+ */
+uint16_t modbus(const uint8_t *data, size_t length);
+
+/**
+ * Append the CRC of the first payloadLen bytes (high byte first)
+ * @param frame Buffer with room for payloadLen + 2 bytes
+ * @return total frame length
+ */
+size_t seal(uint8_t *frame, size_t payloadLen);
+
+/**
+ * Check the trailing 2-byte CRC of a received frame.
+ * Accepts either byte order: the device firmware is not consistent
+ * between request and response frames.
+ */
+bool verify(const uint8_t *frame, size_t length);
+
+} // namespace CRC16
+
+#endif // CRC16_H
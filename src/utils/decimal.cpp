@@ -0,0 +1,339 @@
+/**
+ * Decimal Number Implementation
+ */
+
+#include "decimal.h"
+#include <string.h>
+
+bool Decimal::set(bool neg, const uint8_t *digits, int n, int exp,
+                  int precision) {
+  // Leading zeros only move the exponent
+  while (n > 0 && digits[0] == 0) {
+    digits++;
+    n--;
+    exp--;
+  }
+  _neg = neg;
+  _len = 0;
+  _exp = 0;
+  if (n == 0)
+    return true;
+
+  uint8_t buf[DIGITS];
+  int keep = n < precision ? n : precision;
+  memcpy(buf, digits, keep);
+  if (n > precision && digits[precision] >= 5) {
+    int i = precision - 1;
+    while (i >= 0 && buf[i] == 9)
+      buf[i--] = 0;
+    if (i >= 0) {
+      buf[i]++;
+    } else { // 999... rounded up to 1000...
+      buf[0] = 1;
+      keep = 1;
+      exp++;
+    }
+  }
+  while (keep > 0 && buf[keep - 1] == 0)
+    keep--;
+
+  if (exp > MAX_EXP)
+    return false;
+  if (exp < -MAX_EXP) // Too small to tell from zero
+    return true;
+  memcpy(_d, buf, keep);
+  _len = keep;
+  _exp = exp;
+  return true;
+}
+
+bool Decimal::parse(const char *text, size_t len, Decimal &out) {
+  const char *p = text;
+  const char *end = text + len;
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+
+  // Digits as typed: up to the point they set the exponent, after it they
+  // are fraction; only the first DIGITS + 1 matter for the rounding
+  uint8_t digits[DIGITS + 1];
+  int n = 0;
+  int intDigits = 0;
+  bool seenDigit = false;
+  bool seenPoint = false;
+  for (; p < end; p++) {
+    if (*p == '.') {
+      if (seenPoint)
+        return false;
+      seenPoint = true;
+    } else if (*p >= '0' && *p <= '9') {
+      seenDigit = true;
+      if (n == 0 && *p == '0') { // Leading zero
+        if (seenPoint)
+          intDigits--;
+        continue;
+      }
+      if (n < DIGITS + 1)
+        digits[n++] = *p - '0';
+      if (!seenPoint)
+        intDigits++;
+    } else {
+      break;
+    }
+  }
+  if (!seenDigit)
+    return false;
+
+  long exp10 = 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool expNeg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+      expNeg = *p++ == '-';
+    if (p == end || *p < '0' || *p > '9')
+      return false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+      if (exp10 < 100000)
+        exp10 = exp10 * 10 + (*p - '0');
+    if (expNeg)
+      exp10 = -exp10;
+  }
+  if (p != end)
+    return false;
+  if (n == 0) { // Zero, whatever the exponent
+    out = Decimal();
+    return true;
+  }
+  long exp = intDigits + exp10;
+  if (exp > MAX_EXP + 1)
+    return false;
+  if (exp < -MAX_EXP - DIGITS - 1) {
+    out = Decimal();
+    return true;
+  }
+  return out.set(neg, digits, n, (int)exp);
+}
+
+Decimal Decimal::negated() const {
+  Decimal d = *this;
+  if (_len)
+    d._neg = !_neg;
+  return d;
+}
+
+int Decimal::compareMagnitude(const Decimal &a, const Decimal &b) {
+  if (!a._len || !b._len)
+    return (a._len != 0) - (b._len != 0);
+  if (a._exp != b._exp)
+    return a._exp < b._exp ? -1 : 1;
+  int n = a._len > b._len ? a._len : b._len;
+  for (int i = 0; i < n; i++) {
+    int da = i < a._len ? a._d[i] : 0;
+    int db = i < b._len ? b._d[i] : 0;
+    if (da != db)
+      return da < db ? -1 : 1;
+  }
+  return 0;
+}
+
+// |a| >= |b| for both: a's digits with b's lined up under them
+bool Decimal::addMagnitudes(const Decimal &a, const Decimal &b, bool neg,
+                            Decimal &out) {
+  int shift = a._exp - b._exp;
+  if (!b._len || shift > DIGITS + 1) { // b is lost in the rounding
+    out = a;
+    out._neg = neg;
+    return true;
+  }
+  uint8_t sum[2 * DIGITS + 3] = {};
+  int n = 1 + (a._len > shift + b._len ? a._len : shift + b._len);
+  memcpy(sum + 1, a._d, a._len);
+  int carry = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    int j = i - 1 - shift; // b's digit in this column
+    int v = sum[i] + (j >= 0 && j < b._len ? b._d[j] : 0) + carry;
+    sum[i] = v % 10;
+    carry = v / 10;
+  }
+  return out.set(neg, sum, n, a._exp + 1);
+}
+
+bool Decimal::subMagnitudes(const Decimal &a, const Decimal &b, bool neg,
+                            Decimal &out) {
+  int shift = a._exp - b._exp;
+  if (!b._len || shift > DIGITS + 1) {
+    out = a;
+    out._neg = neg;
+    return true;
+  }
+  uint8_t diff[2 * DIGITS + 2] = {};
+  int n = a._len > shift + b._len ? a._len : shift + b._len;
+  memcpy(diff, a._d, a._len);
+  int borrow = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    int j = i - shift;
+    int v = diff[i] - (j >= 0 && j < b._len ? b._d[j] : 0) - borrow;
+    borrow = v < 0;
+    diff[i] = v + (borrow ? 10 : 0);
+  }
+  return out.set(neg, diff, n, a._exp);
+}
+
+bool Decimal::add(const Decimal &a, const Decimal &b, Decimal &out) {
+  bool bigA = compareMagnitude(a, b) >= 0;
+  const Decimal &big = bigA ? a : b;
+  const Decimal &small = bigA ? b : a;
+  if (a._neg == b._neg)
+    return addMagnitudes(big, small, big._neg, out);
+  return subMagnitudes(big, small, big._neg, out);
+}
+
+bool Decimal::sub(const Decimal &a, const Decimal &b, Decimal &out) {
+  return add(a, b.negated(), out);
+}
+
+bool Decimal::mul(const Decimal &a, const Decimal &b, Decimal &out) {
+  if (!a._len || !b._len) {
+    out = Decimal();
+    return true;
+  }
+  uint16_t acc[2 * DIGITS] = {};
+  int n = a._len + b._len;
+  for (int i = a._len - 1; i >= 0; i--) {
+    int carry = 0;
+    for (int j = b._len - 1; j >= 0; j--) {
+      int v = acc[i + j + 1] + a._d[i] * b._d[j] + carry;
+      acc[i + j + 1] = v % 10;
+      carry = v / 10;
+    }
+    acc[i] += carry;
+  }
+  uint8_t digits[2 * DIGITS];
+  for (int i = 0; i < n; i++)
+    digits[i] = acc[i];
+  return out.set(a._neg != b._neg, digits, n, a._exp + b._exp);
+}
+
+bool Decimal::div(const Decimal &a, const Decimal &b, Decimal &out) {
+  if (!b._len)
+    return false;
+  if (!a._len) {
+    out = Decimal();
+    return true;
+  }
+  // Long division of a's digits (then zeros) by b's as integers. The
+  // remainder stays below b, so it needs b's digits plus one.
+  const int steps = b._len + DIGITS + 1; // At least DIGITS + 1 significant
+  uint8_t quotient[2 * DIGITS + 1];
+  uint8_t rem[DIGITS + 1] = {};
+  uint8_t divisor[DIGITS + 1] = {};
+  int width = b._len + 1;
+  memcpy(divisor + 1, b._d, b._len);
+  for (int k = 0; k < steps; k++) {
+    memmove(rem, rem + 1, width - 1);
+    rem[width - 1] = k < a._len ? a._d[k] : 0;
+    int q = 0;
+    while (memcmp(rem, divisor, width) >= 0) {
+      int borrow = 0;
+      for (int i = width - 1; i >= 0; i--) {
+        int v = rem[i] - divisor[i] - borrow;
+        borrow = v < 0;
+        rem[i] = v + (borrow ? 10 : 0);
+      }
+      q++;
+    }
+    quotient[k] = q;
+  }
+  return out.set(a._neg != b._neg, quotient, steps,
+                 a._exp - b._exp + b._len);
+}
+
+Decimal Decimal::rounded(int digits) const {
+  Decimal d = *this;
+  if (digits < _len)
+    d.set(_neg, _d, _len, _exp, digits); // Can only carry within range
+  return d;
+}
+
+size_t Decimal::formatPlain(char *out, size_t size) const {
+  size_t n = 0;
+  auto put = [&](char c) {
+    if (n + 1 < size)
+      out[n] = c;
+    n++;
+  };
+  if (_neg)
+    put('-');
+  if (_exp <= 0) {
+    put('0');
+    put('.');
+    for (int i = 0; i < -_exp; i++)
+      put('0');
+    for (int i = 0; i < _len; i++)
+      put('0' + _d[i]);
+  } else {
+    for (int i = 0; i < _exp; i++)
+      put(i < _len ? '0' + _d[i] : '0');
+    if (_len > _exp) {
+      put('.');
+      for (int i = _exp; i < _len; i++)
+        put('0' + _d[i]);
+    }
+  }
+  if (size)
+    out[n < size ? n : size - 1] = '\0';
+  return n;
+}
+
+size_t Decimal::formatScientific(char *out, size_t size,
+                                 int maxChars) const {
+  char expText[8];
+  Decimal d = *this;
+  for (int pass = 0; pass < 2; pass++) { // Rounding can carry into exp
+    snprintf(expText, sizeof(expText), "e%d", d._exp - 1);
+    int room = maxChars - (_neg ? 1 : 0) - (int)strlen(expText) - 1;
+    d = rounded(room > 1 ? room : 1);
+  }
+  snprintf(expText, sizeof(expText), "e%d", d._exp - 1);
+  size_t n = 0;
+  auto put = [&](char c) {
+    if (n + 1 < size)
+      out[n] = c;
+    n++;
+  };
+  if (d._neg)
+    put('-');
+  put('0' + d._d[0]);
+  if (d._len > 1) {
+    put('.');
+    for (int i = 1; i < d._len; i++)
+      put('0' + d._d[i]);
+  }
+  for (const char *p = expText; *p; p++)
+    put(*p);
+  if (size)
+    out[n < size ? n : size - 1] = '\0';
+  return n;
+}
+
+size_t Decimal::format(char *out, size_t size, int maxChars) const {
+  if (!_len) {
+    snprintf(out, size, "0");
+    return 1;
+  }
+  // Plain, dropping fraction digits to fit: integer digits, or the zeros
+  // after the point, decide how many significant digits there is room
+  // for. Past PLAIN_ZEROS zeros after the point the exponent says it
+  // better.
+  int sign = _neg ? 1 : 0;
+  int room = _exp > 0 ? maxChars - sign - 1 : maxChars - sign - 2 + _exp;
+  if (_exp > 0 && _len <= _exp)
+    room = maxChars - sign; // An integer needs no point
+  if ((_exp > 0 ? _exp : 1) + sign <= maxChars && -_exp < PLAIN_ZEROS &&
+      room >= 1) {
+    Decimal d = rounded(room);
+    if ((int)d.formatPlain(nullptr, 0) <= maxChars)
+      return d.formatPlain(out, size);
+  }
+  return formatScientific(out, size, maxChars);
+}
@@ -0,0 +1,68 @@
+/**
+ * Decimal Number
+ *
+ * A base-10 floating-point number with DIGITS significant digits, for the
+ * calculator: 0.1 + 0.2 is exactly 0.3 and 1/3 is 0.333... to 40 places,
+ * where a double gives 0.30000000000000004 and 17 digits. The digits are
+ * kept one per byte, most significant first, with a decimal exponent; the
+ * value is 0.d0 d1 d2 ... x 10^exp. Results are rounded half-up to DIGITS.
+ *
+ * Operations are schoolbook (division is long division), which is
+ * plenty for numbers typed on a keypad.
+ */
+
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <Arduino.h>
+
+class Decimal {
+public:
+  static const int DIGITS = 40;    // Significant digits kept
+  static const int MAX_EXP = 9999; // Beyond: overflow; below -MAX_EXP: 0
+  static const int PLAIN_ZEROS = 4; // 0.0001 plain, 1e-5 not
+
+  Decimal() : _len(0), _exp(0), _neg(false) {}
+
+  /**
+   * Parse "123", "-0.5", "1.5e-7" (len characters of text)
+   * @return false if it is not a number or out of range
+   */
+  static bool parse(const char *text, size_t len, Decimal &out);
+
+  // false on overflow (or, for div, a zero divisor)
+  static bool add(const Decimal &a, const Decimal &b, Decimal &out);
+  static bool sub(const Decimal &a, const Decimal &b, Decimal &out);
+  static bool mul(const Decimal &a, const Decimal &b, Decimal &out);
+  static bool div(const Decimal &a, const Decimal &b, Decimal &out);
+
+  Decimal negated() const;
+  bool isZero() const { return _len == 0; }
+
+  /**
+   * Write the number in at most maxChars characters: plain where it fits
+   * (fraction digits rounded away as needed), otherwise as 1.234e56
+   * @return Characters written
+   */
+  size_t format(char *out, size_t size, int maxChars) const;
+
+private:
+  uint8_t _d[DIGITS]; // _d[0] != 0 unless zero; no trailing zeros
+  uint8_t _len;       // Digits used; 0 = zero
+  int16_t _exp;
+  bool _neg;
+
+  // Normalise n digits worth 0.digits x 10^exp, rounded to precision
+  bool set(bool neg, const uint8_t *digits, int n, int exp,
+           int precision = DIGITS);
+  Decimal rounded(int digits) const;
+  static int compareMagnitude(const Decimal &a, const Decimal &b);
+  static bool addMagnitudes(const Decimal &a, const Decimal &b, bool neg,
+                            Decimal &out);
+  static bool subMagnitudes(const Decimal &a, const Decimal &b, bool neg,
+                            Decimal &out);
+  size_t formatPlain(char *out, size_t size) const;
+  size_t formatScientific(char *out, size_t size, int maxChars) const;
+};
+
+#endif // DECIMAL_H
@@ -0,0 +1,80 @@
+/**
+ * Fixed-Point Telemetry Units
+ *
+ * The power bank reports integers: whole watts, volts x 100 and charge in
+ * tenths of a percent. Telemetry keeps them as integers in those scales
+ * (watts in tenths, so the filter's averages keep a digit), so comparing
+ * two frames is exact, a delta is a subtraction and nothing is truncated
+ * on the way into a uint16_t history sample. The float models (forecast,
+ * planner, rules) convert at their own edge with toFloat().
+ *
+ * Display values are rounded with divRound() and formatted here with
+ * integer printf only.
+ */
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include "fixed_string.h"
+#include <stdint.h>
+
+namespace Fixed {
+
+typedef int32_t Deciwatts;  // W x 10
+typedef int32_t Centivolts; // V x 100
+typedef int32_t Permille;   // Charge in 0.1 % steps, 1000 = full
+
+static const int32_t DW_PER_W = 10;
+static const int32_t CV_PER_V = 100;
+static const int32_t PERMILLE_PER_PCT = 10;
+static const Permille FULL = 1000;
+
+/**
+ * value / divisor, rounded half away from zero (divisor > 0)
+ */
+inline int32_t divRound(int32_t value, int32_t divisor) {
+  return value >= 0 ? (value + divisor / 2) / divisor
+                    : -((divisor / 2 - value) / divisor);
+}
+
+inline int32_t watts(Deciwatts dw) { return divRound(dw, DW_PER_W); }
+inline int32_t percent(Permille pm) { return divRound(pm, PERMILLE_PER_PCT); }
+inline Deciwatts fromWatts(int32_t w) { return w * DW_PER_W; }
+inline Permille fromPercent(int32_t pct) { return pct * PERMILLE_PER_PCT; }
+
+/**
+ * value / scale as a float, for the models that work in floats
+ */
+inline float toFloat(int32_t value, int32_t scale) {
+  return (float)value / scale;
+}
+
+/**
+ * value x scale, rounded (a float model's output back into telemetry)
+ */
+inline int32_t fromFloat(float value, int32_t scale) {
+  float scaled = value * scale;
+  return (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+/**
+ * value / scale with decimals fraction digits, rounded: "49.12", "-0.5",
+ * "87" (scale a power of ten, decimals no more than its zeros)
+ */
+inline FixedString<16> format(int32_t value, int32_t scale, int decimals) {
+  int32_t unit = scale;
+  for (int i = 0; i < decimals; i++)
+    unit /= 10;
+  int32_t q = divRound(value, unit < 1 ? 1 : unit);
+  if (decimals <= 0)
+    return FixedString<16>::format("%ld", (long)q);
+  int32_t step = scale / (unit < 1 ? 1 : unit);
+  int32_t mag = q < 0 ? -q : q;
+  return FixedString<16>::format("%s%ld.%0*ld", q < 0 ? "-" : "",
+                                 (long)(mag / step), decimals,
+                                 (long)(mag % step));
+}
+
+} // namespace Fixed
+
+#endif // FIXED_POINT_H
@@ -0,0 +1,228 @@
+/**
+ * Fixed Strings
+ *
+ * FixedString<N> holds up to N - 1 characters in place, for the names,
+ * paths and formatted values built on every draw or record, where an
+ * Arduino String would allocate and free each time and slowly fragment
+ * the heap. Appends truncate instead of growing; truncated() reports it.
+ * A FixedString is trivially copyable, so lambdas and vectors copy it
+ * without touching the heap.
+ *
+ * StrView is a pointer and a length into characters owned by someone else
+ * (a line buffer, a FixedString), with the std::string_view-style pieces
+ * the parsers here need: splitting into fields, prefix and suffix tests
+ * and integer conversion, none of which copy a substring.
+ */
+
+#ifndef FIXED_STRING_H
+#define FIXED_STRING_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+class StrView {
+public:
+  StrView() : _data(""), _len(0) {}
+  StrView(const char *s) : _data(s ? s : ""), _len(s ? strlen(s) : 0) {}
+  StrView(const char *s, size_t len) : _data(s), _len(len) {}
+
+  const char *data() const { return _data; }
+  size_t size() const { return _len; }
+  bool empty() const { return _len == 0; }
+  char operator[](size_t i) const { return _data[i]; }
+
+  bool operator==(StrView other) const {
+    return _len == other._len && memcmp(_data, other._data, _len) == 0;
+  }
+  bool operator!=(StrView other) const { return !(*this == other); }
+
+  bool startsWith(StrView prefix) const {
+    return prefix._len <= _len &&
+           memcmp(_data, prefix._data, prefix._len) == 0;
+  }
+  bool endsWith(StrView suffix) const {
+    return suffix._len <= _len &&
+           memcmp(_data + _len - suffix._len, suffix._data, suffix._len) == 0;
+  }
+
+  /**
+   * Position of the first c at or after from
+   * @return -1 if there is none
+   */
+  int indexOf(char c, size_t from = 0) const {
+    for (size_t i = from; i < _len; i++) {
+      if (_data[i] == c)
+        return (int)i;
+    }
+    return -1;
+  }
+
+  /**
+   * Up to len characters from pos, clamped to the view
+   */
+  StrView substr(size_t pos, size_t len = (size_t)-1) const {
+    if (pos > _len)
+      pos = _len;
+    if (len > _len - pos)
+      len = _len - pos;
+    return StrView(_data + pos, len);
+  }
+
+  /**
+   * Without leading and trailing spaces, tabs, CR and LF
+   */
+  StrView trimmed() const {
+    size_t start = 0, end = _len;
+    while (start < end && isSpace(_data[start]))
+      start++;
+    while (end > start && isSpace(_data[end - 1]))
+      end--;
+    return StrView(_data + start, end - start);
+  }
+
+  /**
+   * Split at each sep into at most max fields; the last one takes the
+   * rest of the view, separators included
+   * @return Number of fields written
+   */
+  int split(char sep, StrView *fields, int max) const {
+    int count = 0;
+    size_t start = 0;
+    while (count < max) {
+      int at = count < max - 1 ? indexOf(sep, start) : -1;
+      size_t end = at < 0 ? _len : (size_t)at;
+      fields[count++] = StrView(_data + start, end - start);
+      if (at < 0)
+        break;
+      start = end + 1;
+    }
+    return count;
+  }
+
+  /**
+   * Parse a decimal number, ignoring surrounding whitespace
+   * @return false if empty, not all digits or out of range
+   */
+  bool toUInt(uint32_t &out) const {
+    StrView t = trimmed();
+    if (t.empty())
+      return false;
+    uint32_t value = 0;
+    for (size_t i = 0; i < t._len; i++) {
+      char c = t._data[i];
+      if (c < '0' || c > '9')
+        return false;
+      uint32_t digit = c - '0';
+      if (value > (UINT32_MAX - digit) / 10)
+        return false;
+      value = value * 10 + digit;
+    }
+    out = value;
+    return true;
+  }
+
+  bool toInt(int32_t &out) const {
+    StrView t = trimmed();
+    bool negative = t.startsWith("-");
+    uint32_t magnitude;
+    if (!t.substr(negative || t.startsWith("+") ? 1 : 0).toUInt(magnitude) ||
+        magnitude > (uint32_t)INT32_MAX + (negative ? 1 : 0))
+      return false;
+    out = negative ? (int32_t)(0 - magnitude) : (int32_t)magnitude;
+    return true;
+  }
+
+private:
+  const char *_data;
+  size_t _len;
+
+  static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+};
+
+template <size_t N> class FixedString {
+  static_assert(N > 1 && N <= 65535, "a character, the terminator and a "
+                                     "16-bit length");
+
+public:
+  FixedString() : _len(0), _truncated(false) { _buf[0] = '\0'; }
+  FixedString(const char *s) : FixedString() { append(s); }
+  FixedString(StrView s) : FixedString() { append(s); }
+
+  /**
+   * Formatted like printf, truncated to the capacity
+   */
+  __attribute__((format(printf, 1, 2))) static FixedString
+  format(const char *fmt, ...) {
+    FixedString s;
+    va_list args;
+    va_start(args, fmt);
+    s.vappendf(fmt, args);
+    va_end(args);
+    return s;
+  }
+
+  FixedString &append(StrView s) {
+    size_t room = N - 1 - _len;
+    size_t n = s.size();
+    if (n > room) {
+      n = room;
+      _truncated = true;
+    }
+    memcpy(_buf + _len, s.data(), n);
+    _len += n;
+    _buf[_len] = '\0';
+    return *this;
+  }
+  FixedString &append(const char *s) { return append(StrView(s)); }
+  FixedString &append(char c) { return append(StrView(&c, 1)); }
+
+  __attribute__((format(printf, 2, 3))) FixedString &
+  appendf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vappendf(fmt, args);
+    va_end(args);
+    return *this;
+  }
+
+  FixedString &vappendf(const char *fmt, va_list args) {
+    size_t room = N - _len;
+    int n = vsnprintf(_buf + _len, room, fmt, args);
+    if (n < 0) {
+      _buf[_len] = '\0'; // Encoding error: keep what was there
+    } else if ((size_t)n >= room) {
+      _len = N - 1;
+      _truncated = true;
+    } else {
+      _len += n;
+    }
+    return *this;
+  }
+
+  void clear() {
+    _len = 0;
+    _truncated = false;
+    _buf[0] = '\0';
+  }
+
+  const char *c_str() const { return _buf; }
+  operator const char *() const { return _buf; }
+  StrView view() const { return StrView(_buf, _len); }
+  size_t length() const { return _len; }
+  static size_t capacity() { return N - 1; }
+  bool truncated() const { return _truncated; }
+
+  bool operator==(const char *s) const { return view() == StrView(s); }
+  bool operator!=(const char *s) const { return !(*this == s); }
+
+private:
+  char _buf[N];
+  uint16_t _len;
+  bool _truncated;
+};
+
+#endif // FIXED_STRING_H
@@ -0,0 +1,190 @@
+/**
+ * Flash Store Implementation
+ */
+
+#include "flash_store.h"
+#include "crc16.h"
+#include "sd_manager.h"
+#include "storage_worker.h"
+#include <LittleFS.h>
+#include <Preferences.h>
+
+extern SDManager *sdManager;
+extern StorageWorker *storage;
+
+// NVS namespace: CRC of each file as last mirrored to SD, to tell an
+// off-device edit from a card that is merely behind
+static const char *MIRROR_NS = "flashstore";
+
+// Directories the hot files live in
+static const char *FLASH_DIRS[] = {"/config", "/games", "/games/saves",
+                                   "/history"};
+
+FlashStore::FlashStore()
+    : _available(false), _syncedCount(0), _dirtyCount(0), _dirtySince(0) {}
+
+bool FlashStore::begin() {
+  if (!LittleFS.begin(true, "/littlefs", 5, "spiffs")) {
+    Serial.println("Storage: Flash partition mount failed");
+    return false;
+  }
+  for (const char *dir : FLASH_DIRS) {
+    if (!LittleFS.exists(dir))
+      LittleFS.mkdir(dir);
+  }
+  _available = true;
+  Serial.printf("Storage: Flash tier %u/%u KB used\n",
+                (unsigned)(LittleFS.usedBytes() / 1024),
+                (unsigned)(LittleFS.totalBytes() / 1024));
+  return true;
+}
+
+fs::FS &FlashStore::fs() { return LittleFS; }
+
+bool FlashStore::exists(const char *path) {
+  return _available && LittleFS.exists(path);
+}
+
+uint8_t *FlashStore::readAll(fs::FS &from, const char *path, size_t &len) {
+  File file = from.open(path, FILE_READ);
+  if (!file)
+    return nullptr;
+  len = file.size();
+  uint8_t *data = len <= MAX_HOT_FILE ? (uint8_t *)malloc(len ? len : 1)
+                                      : nullptr;
+  if (data && file.read(data, len) != len) {
+    free(data);
+    data = nullptr;
+  }
+  file.close();
+  return data;
+}
+
+bool FlashStore::writeAll(const char *path, const uint8_t *data, size_t len) {
+  // LittleFS renames over the old file atomically
+  String tempPath = String(path) + ".tmp";
+  File file = LittleFS.open(tempPath.c_str(), FILE_WRITE);
+  if (!file)
+    return false;
+  bool ok = file.write(data, len) == len;
+  file.close();
+  return ok && LittleFS.rename(tempPath.c_str(), path);
+}
+
+static void mirrorKey(const char *path, char *key, size_t len) {
+  snprintf(key, len, "m%04x", CRC16::modbus((const uint8_t *)path,
+                                            strlen(path)));
+}
+
+uint16_t FlashStore::mirroredCrc(const char *path) {
+  char key[8];
+  mirrorKey(path, key, sizeof(key));
+  Preferences prefs;
+  if (!prefs.begin(MIRROR_NS, true))
+    return 0;
+  uint16_t crc = prefs.getUShort(key, 0);
+  prefs.end();
+  return crc;
+}
+
+void FlashStore::setMirroredCrc(const char *path, uint16_t crc) {
+  if (mirroredCrc(path) == crc)
+    return; // Spare the NVS page
+  char key[8];
+  mirrorKey(path, key, sizeof(key));
+  Preferences prefs;
+  if (!prefs.begin(MIRROR_NS, false))
+    return;
+  prefs.putUShort(key, crc);
+  prefs.end();
+}
+
+bool FlashStore::sync(const char *path) {
+  if (!_available || !sdManager)
+    return false;
+  for (int i = 0; i < _syncedCount; i++) {
+    if (_synced[i] == path)
+      return false;
+  }
+  if (_syncedCount < MAX_TRACKED)
+    _synced[_syncedCount++] = path;
+
+  size_t flashLen = 0;
+  uint8_t *flashData = readAll(LittleFS, path, flashLen);
+  size_t sdLen = 0;
+  uint8_t *sdData = nullptr;
+  {
+    SDAccess sd(sdManager);
+    if (sd)
+      sdData = readAll(sdFS(), path, sdLen);
+  }
+
+  bool adopted = false;
+  uint16_t sdCrc = sdData ? CRC16::modbus(sdData, sdLen) : 0;
+  bool same = sdData && flashData && sdLen == flashLen &&
+              memcmp(sdData, flashData, sdLen) == 0;
+
+  if (same) {
+    setMirroredCrc(path, sdCrc);
+  } else if (sdData && (!flashData || sdCrc != mirroredCrc(path))) {
+    // First run with this file, or it was edited on a PC: the card wins
+    if (writeAll(path, sdData, sdLen)) {
+      setMirroredCrc(path, sdCrc);
+      Serial.printf("Storage: %s taken from SD\n", path);
+      adopted = true;
+    }
+  } else if (flashData) {
+    mirror(path); // The card is behind (it was absent or swapped)
+  }
+  free(flashData);
+  free(sdData);
+  return adopted;
+}
+
+void FlashStore::mirror(const char *path) {
+  for (int i = 0; i < _dirtyCount; i++) {
+    if (_dirty[i] == path)
+      return;
+  }
+  if (_dirtyCount >= MAX_TRACKED) {
+    Serial.printf("Storage: Too many files to mirror, %s skipped\n", path);
+    return;
+  }
+  if (_dirtyCount == 0)
+    _dirtySince = millis();
+  _dirty[_dirtyCount++] = path;
+}
+
+void FlashStore::service() {
+  if (!_dirtyCount || millis() - _dirtySince < MIRROR_INTERVAL_MS)
+    return;
+  if (!storage || !sdManager || !sdManager->isAvailable()) {
+    _dirtySince = millis(); // Try again next interval
+    return;
+  }
+
+  int kept = 0;
+  for (int i = 0; i < _dirtyCount; i++) {
+    String path = _dirty[i];
+    size_t len = 0;
+    uint8_t *data = readAll(LittleFS, path.c_str(), len);
+    if (!data)
+      continue; // Deleted or too large: nothing to mirror
+    uint16_t crc = CRC16::modbus(data, len);
+    bool queued = storage->write(
+        path.c_str(), nullptr, 0, data, len,
+        [this, path, crc](const StorageResult &result) {
+          if (result.ok)
+            setMirroredCrc(path.c_str(), crc);
+          else
+            mirror(path.c_str()); // Next pass
+        },
+        true, true);
+    if (!queued) {
+      free(data);
+      _dirty[kept++] = path; // Queue full: keep it for the next pass
+    }
+  }
+  _dirtyCount = kept;
+  _dirtySince = millis();
+}
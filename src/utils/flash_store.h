@@ -0,0 +1,74 @@
+/**
+ * Flash Store
+ *
+ * LittleFS tier in the internal flash for small, hot files (settings, game
+ * saves, the history journal). They are read and written here first, so
+ * they persist and boot without the SD card, and are mirrored to the
+ * same path on SD in the background for backup and editing on a PC.
+ *
+ * Uses the data partition of partitions.csv (label "spiffs", 3.9 MB).
+ */
+
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+class FlashStore {
+public:
+  static const uint32_t MIRROR_INTERVAL_MS = 60000;
+  static const int MAX_TRACKED = 8;       // Hot files mirrored to SD
+  static const size_t MAX_HOT_FILE = 16384; // Larger files are not synced
+
+  FlashStore();
+
+  /**
+   * Mount the partition, formatting it if it has never been used
+   */
+  bool begin();
+
+  bool isAvailable() const { return _available; }
+  fs::FS &fs();
+  bool exists(const char *path);
+
+  /**
+   * Reconcile a hot file with its SD copy, once per boot (later calls
+   * return at once). The SD copy is adopted when flash has none or it was
+   * changed off the device since the last mirror; a flash copy the card
+   * lacks is queued for mirroring. Before the card has been brought up at
+   * all (no SDManager yet) nothing is reconciled or recorded.
+   * @return true if the SD copy was adopted
+   */
+  bool sync(const char *path);
+
+  /**
+   * Note that path changed in flash; it is copied to SD at the next
+   * mirror pass
+   */
+  void mirror(const char *path);
+
+  /**
+   * Copy changed files to SD through the storage worker once the mirror
+   * interval has passed and the card is available. Call from the main
+   * loop.
+   */
+  void service();
+
+private:
+  bool _available;
+  String _synced[MAX_TRACKED]; // Reconciled this boot
+  int _syncedCount;
+  String _dirty[MAX_TRACKED];
+  int _dirtyCount;
+  unsigned long _dirtySince;
+
+  uint8_t *readAll(fs::FS &from, const char *path, size_t &len);
+  bool writeAll(const char *path, const uint8_t *data, size_t len);
+  uint16_t mirroredCrc(const char *path);
+  void setMirroredCrc(const char *path, uint16_t crc);
+};
+
+extern FlashStore *flashStore;
+
+#endif // FLASH_STORE_H
@@ -0,0 +1,162 @@
+/**
+ * Logging Implementation
+ */
+
+#include "log.h"
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdarg.h>
+
+namespace Log {
+
+static_assert((SLOTS & (SLOTS - 1)) == 0, "Log SLOTS must be a power of two");
+
+static const uint32_t DRAIN_TASK_STACK = 3072;
+static const UBaseType_t DRAIN_TASK_PRIORITY = 1; // Just above idle
+static const int FLUSH_TIMEOUT_MS = 500;
+
+namespace {
+
+// Bounded MPMC queue cell: seq == position when free for that producer,
+// position + 1 once the line is published
+struct Slot {
+  std::atomic<uint32_t> seq;
+  uint16_t length;
+  char text[LINE_BYTES];
+};
+
+Slot _slots[SLOTS];
+std::atomic<uint32_t> _enqueue{0};
+std::atomic<uint32_t> _dequeue{0}; // Advanced by the drain task only
+std::atomic<uint32_t> _dropped{0};
+std::atomic<uint8_t> _level{LOG_LEVEL};
+TaskHandle_t _task = nullptr;
+
+const char LEVEL_LETTERS[] = "-EWIDV";
+
+int format(char *out, uint8_t level, const char *tag, const char *fmt,
+           va_list args) {
+  int n = snprintf(out, LINE_BYTES, "%c %s: ",
+                   LEVEL_LETTERS[level <= LOG_LEVEL_VERBOSE ? level : 0],
+                   tag);
+  if (n < 0)
+    n = 0;
+  if (n < LINE_BYTES - 1) {
+    int m = vsnprintf(out + n, LINE_BYTES - 1 - n, fmt, args);
+    n += m < 0 ? 0 : m;
+  }
+  if (n > LINE_BYTES - 2)
+    n = LINE_BYTES - 2; // Cut short; keep room for the newline
+  out[n++] = '\n';
+  out[n] = '\0';
+  return n;
+}
+
+// Pop one published line and write it out
+bool drainOne() {
+  uint32_t pos = _dequeue.load(std::memory_order_relaxed);
+  Slot &slot = _slots[pos & (SLOTS - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+    return false;
+  Serial.write((const uint8_t *)slot.text, slot.length);
+  slot.seq.store(pos + SLOTS, std::memory_order_release);
+  _dequeue.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+void drainTask(void *) {
+  uint32_t reported = 0;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (drainOne()) {
+    }
+    uint32_t lost = _dropped.load(std::memory_order_relaxed);
+    if (lost != reported) {
+      Serial.printf("W Log: %u line(s) dropped\n", (unsigned)(lost - reported));
+      reported = lost;
+    }
+  }
+}
+
+} // namespace
+
+bool begin() {
+  if (_task)
+    return true;
+  for (int i = 0; i < SLOTS; i++)
+    _slots[i].seq.store(i, std::memory_order_relaxed);
+
+  if (xTaskCreate(drainTask, "log_drain", DRAIN_TASK_STACK, nullptr,
+                  DRAIN_TASK_PRIORITY, &_task) != pdPASS) {
+    _task = nullptr;
+    Serial.println("E Log: Failed to start drain task, writing direct");
+    return false;
+  }
+  return true;
+}
+
+void write(uint8_t level, const char *tag, const char *fmt, ...) {
+  if (level > _level.load(std::memory_order_relaxed))
+    return;
+  va_list args;
+  va_start(args, fmt);
+
+  if (!_task) {
+    char line[LINE_BYTES];
+    int n = format(line, level, tag, fmt, args);
+    va_end(args);
+    Serial.write((const uint8_t *)line, n);
+    return;
+  }
+
+  // Claim a slot; a full ring drops the line rather than blocking
+  uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+  Slot *slot;
+  for (;;) {
+    slot = &_slots[pos & (SLOTS - 1)];
+    int32_t diff =
+        (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (_enqueue.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      va_end(args);
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = _enqueue.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->length = format(slot->text, level, tag, fmt, args);
+  va_end(args);
+  slot->seq.store(pos + 1, std::memory_order_release);
+  xTaskNotifyGive(_task);
+}
+
+void flush() {
+  // The drain task stays the only consumer; just give it the CPU until it
+  // has caught up
+  if (!_task)
+    return;
+  uint32_t target = _enqueue.load(std::memory_order_acquire);
+  xTaskNotifyGive(_task);
+  for (int waited = 0; waited < FLUSH_TIMEOUT_MS; waited++) {
+    if ((int32_t)(_dequeue.load(std::memory_order_acquire) - target) >= 0)
+      return;
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+}
+
+uint32_t dropped() { return _dropped.load(std::memory_order_relaxed); }
+
+void setLevel(uint8_t level) {
+  _level.store(level < LOG_LEVEL ? level : LOG_LEVEL,
+               std::memory_order_relaxed);
+}
+
+uint8_t level() { return _level.load(std::memory_order_relaxed); }
+
+} // namespace Log
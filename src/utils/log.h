@@ -0,0 +1,104 @@
+/**
+ * Logging
+ *
+ * Levelled, tagged log lines that cost the caller a vsnprintf into RAM
+ * rather than a blocking serial write. Lines go into a lock-free ring of
+ * fixed slots (any task may log; the ring is a bounded multi-producer
+ * queue) and a low-priority task drains it to Serial. When the ring is
+ * full the line is dropped and counted, never waited on; the drain task
+ * reports how many went missing.
+ *
+ * Levels are filtered at compile time: a LOG_D() below LOG_LEVEL expands
+ * to nothing, arguments included, so debug lines in the touch and draw
+ * loops do not exist in a release build. The debug build sets
+ * -DLOG_LEVEL=4 in platformio.ini and the release build -DLOG_LEVEL=1;
+ * otherwise it defaults to INFO. setLevel() lowers the ceiling at run time
+ * (the serial console's LOG command); it cannot bring back a level the
+ * build compiled out.
+ *
+ *   LOG_E(tag, fmt, ...)  error      LOG_I  info (default ceiling)
+ *   LOG_W(tag, fmt, ...)  warning    LOG_D  debug    LOG_V  verbose
+ *
+ * Output is "<level> <tag>: <text>", e.g. "W BLE: Service not found!".
+ * Before begin() (early boot) lines are written straight to Serial.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+namespace Log {
+
+static const int SLOTS = 64;       // Lines buffered (power of two)
+static const int LINE_BYTES = 128; // Longer lines are cut short
+
+/**
+ * Start the drain task
+ */
+bool begin();
+
+void write(uint8_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Write out everything buffered from the calling task (before deep sleep
+ * or a restart, when the drain task will not run again)
+ */
+void flush();
+
+/**
+ * Lines lost to a full ring since boot
+ */
+uint32_t dropped();
+
+/**
+ * Drop lines above level from now on (LOG_LEVEL_NONE .. LOG_LEVEL)
+ */
+void setLevel(uint8_t level);
+uint8_t level();
+
+} // namespace Log
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(tag, ...) Log::write(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#else
+#define LOG_E(tag, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(tag, ...) Log::write(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define LOG_W(tag, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(tag, ...) Log::write(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define LOG_I(tag, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(tag, ...) Log::write(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_D(tag, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_V(tag, ...) Log::write(LOG_LEVEL_VERBOSE, tag, __VA_ARGS__)
+#else
+#define LOG_V(tag, ...) ((void)0)
+#endif
+
+#endif // LOG_H
@@ -0,0 +1,214 @@
+/**
+ * Loop Stall Monitor Implementation
+ */
+
+#include "loop_monitor.h"
+#include "log.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace LoopMonitor {
+
+namespace {
+
+const uint32_t RTC_MAGIC = 0x4C4F4F50; // "LOOP"
+
+const char *const NAMES[STAGE_COUNT] = {"touch",  "ble",    "storage",
+                                        "network", "export", "ota",
+                                        "timers", "ui"};
+
+TaskHandle_t _loopTask = nullptr;
+bool _watched = false;
+bool _inPass = false;
+int64_t _passStart = 0;
+int64_t _stageStart = 0;
+Stage _stage = Stage::TOUCH;
+const char *_tag = nullptr;
+Stage _slowStage = Stage::TOUCH; // Slowest stage of this pass so far
+const char *_slowTag = nullptr;
+uint32_t _slowUs = 0;
+
+Summary _summary;
+Stall _worst[WORST]; // Longest first
+int _worstCount = 0;
+
+// The stage in progress, for the boot after a watchdog restart
+RTC_NOINIT_ATTR uint32_t _rtcMagic;
+RTC_NOINIT_ATTR uint8_t _rtcStage;
+
+int bucketOf(uint32_t us) {
+  uint32_t ms = us / 1000;
+  int b = 0;
+  while (ms && b < BUCKETS - 1) {
+    ms >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void closeStage(int64_t now) {
+  uint32_t us = (uint32_t)(now - _stageStart);
+  int s = (int)_stage;
+  if (us > _summary.stageMaxUs[s])
+    _summary.stageMaxUs[s] = us;
+  _summary.stageTotalUs[s] += us;
+  if (us >= _slowUs) {
+    _slowUs = us;
+    _slowStage = _stage;
+    _slowTag = _tag;
+  }
+  _stageStart = now;
+}
+
+void keepWorst(const Stall &stall) {
+  if (_worstCount == WORST && stall.us <= _worst[WORST - 1].us)
+    return;
+  int i = _worstCount < WORST ? _worstCount++ : WORST - 1;
+  for (; i > 0 && _worst[i - 1].us < stall.us; i--)
+    _worst[i] = _worst[i - 1];
+  _worst[i] = stall;
+}
+
+} // namespace
+
+void begin() {
+  _loopTask = xTaskGetCurrentTaskHandle();
+  if (esp_reset_reason() == ESP_RST_TASK_WDT && _rtcMagic == RTC_MAGIC &&
+      _rtcStage < STAGE_COUNT)
+    LOG_E("Loop", "Restarted by the watchdog, loop stuck in %s",
+          NAMES[_rtcStage]);
+  _rtcMagic = RTC_MAGIC;
+  _rtcStage = (uint8_t)Stage::TOUCH;
+
+  // Updates the timeout if the SDK already started the watchdog, keeping
+  // the idle tasks it watches
+  esp_task_wdt_config_t wdt = {};
+  wdt.timeout_ms = WATCHDOG_S * 1000;
+  wdt.trigger_panic = true;
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+  wdt.idle_core_mask |= 1 << 0;
+#endif
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+  wdt.idle_core_mask |= 1 << 1;
+#endif
+  if (esp_task_wdt_reconfigure(&wdt) != ESP_OK)
+    esp_task_wdt_init(&wdt);
+  _watched = esp_task_wdt_add(_loopTask) == ESP_OK;
+  if (!_watched)
+    LOG_W("Loop", "Task watchdog unavailable");
+}
+
+void startIteration() {
+  if (_watched)
+    esp_task_wdt_reset();
+  _passStart = _stageStart = esp_timer_get_time();
+  _stage = Stage::TOUCH;
+  _tag = nullptr;
+  _slowUs = 0;
+  _slowTag = nullptr;
+  _rtcStage = (uint8_t)_stage;
+  _inPass = true;
+}
+
+void stage(Stage stage) {
+  if (!_inPass || stage >= Stage::COUNT)
+    return;
+  closeStage(esp_timer_get_time());
+  _stage = stage;
+  _tag = nullptr;
+  _rtcStage = (uint8_t)stage;
+}
+
+void tag(const char *what) {
+  if (_inPass && xTaskGetCurrentTaskHandle() == _loopTask)
+    _tag = what;
+}
+
+void endIteration() {
+  if (!_inPass)
+    return;
+  _inPass = false;
+  int64_t now = esp_timer_get_time();
+  closeStage(now);
+  uint32_t us = (uint32_t)(now - _passStart);
+
+  _summary.iterations++;
+  _summary.buckets[bucketOf(us)]++;
+  if (us > _summary.peakUs)
+    _summary.peakUs = us;
+  if (us < STALL_MS * 1000)
+    return;
+
+  _summary.stalls++;
+  keepWorst({us, millis(), _slowStage, _slowTag});
+  if (us >= LOG_MS * 1000)
+    LOG_W("Loop", "Stalled %lu ms in %s%s%s", (unsigned long)(us / 1000),
+          NAMES[(int)_slowStage], _slowTag ? ": " : "",
+          _slowTag ? _slowTag : "");
+}
+
+void feed() {
+  if (_watched && xTaskGetCurrentTaskHandle() == _loopTask)
+    esp_task_wdt_reset();
+}
+
+const Summary &summary() { return _summary; }
+
+int worst(Stall *out, int max) {
+  int n = _worstCount < max ? _worstCount : max;
+  memcpy(out, _worst, n * sizeof(Stall));
+  return n;
+}
+
+const char *stageName(Stage stage) {
+  return stage < Stage::COUNT ? NAMES[(int)stage] : "?";
+}
+
+void reset() {
+  memset(&_summary, 0, sizeof(_summary));
+  _worstCount = 0;
+}
+
+void dump(Print &out) {
+  out.printf("Loop: %lu passes, %lu stalls >= %lu ms, peak %lu us\n",
+             (unsigned long)_summary.iterations,
+             (unsigned long)_summary.stalls, (unsigned long)STALL_MS,
+             (unsigned long)_summary.peakUs);
+  for (int b = 0; b < BUCKETS; b++) {
+    if (!_summary.buckets[b])
+      continue;
+    if (b == 0)
+      out.printf("Loop:   < 1 ms %10lu\n", (unsigned long)_summary.buckets[b]);
+    else
+      out.printf("Loop: %s%5lu ms %10lu\n", b == BUCKETS - 1 ? ">=" : "< ",
+                 (unsigned long)(b == BUCKETS - 1 ? 1UL << (b - 1)
+                                                  : 1UL << b),
+                 (unsigned long)_summary.buckets[b]);
+  }
+  out.printf("Loop: %-8s %10s %12s\n", "stage", "max us", "total ms");
+  for (int s = 0; s < STAGE_COUNT; s++)
+    out.printf("Loop: %-8s %10lu %12llu\n", NAMES[s],
+               (unsigned long)_summary.stageMaxUs[s],
+               (unsigned long long)(_summary.stageTotalUs[s] / 1000));
+  // Asked from another task (the serial console): where the loop is now,
+  // which is the one place to look if it has stopped coming round
+  if (_inPass && xTaskGetCurrentTaskHandle() != _loopTask) {
+    const char *tag = _tag;
+    out.printf("Loop: now in %s%s%s for %lu ms\n", NAMES[(int)_stage],
+               tag ? ": " : "", tag ? tag : "",
+               (unsigned long)((esp_timer_get_time() - _stageStart) / 1000));
+  }
+  for (int i = 0; i < _worstCount; i++) {
+    const Stall &w = _worst[i];
+    out.printf("Loop: stall %lu ms in %s%s%s at %lu s\n",
+               (unsigned long)(w.us / 1000), NAMES[(int)w.stage],
+               w.tag ? ": " : "", w.tag ? w.tag : "",
+               (unsigned long)(w.at / 1000));
+  }
+}
+
+} // namespace LoopMonitor
@@ -0,0 +1,115 @@
+/**
+ * Loop Stall Monitor
+ *
+ * Times every pass of loop() and each of its stages (touch, BLE, storage,
+ * network, exports, OTA, timers, UI), not counting the sleep at the end.
+ * Pass durations go into a histogram of power-of-two millisecond buckets;
+ * a pass of STALL_MS or more is a stall, and the WORST longest are kept
+ * with the stage that took most of them, the tag that stage set (a known
+ * blocking call: "sd power cycle") and the uptime. A stall of LOG_MS or
+ * more is logged as it ends.
+ *
+ * begin() also puts the loop task under the task watchdog with a
+ * WATCHDOG_S timeout and startIteration() feeds it, so a loop that stops
+ * coming round panics and restarts instead of hanging with a frozen
+ * panel. The stage it hung in survives the restart (RTC memory) and is
+ * logged on the next boot.
+ *
+ * Only the loop task records; tag() from another task is ignored. The
+ * numbers are on the Perf screen and in "PROF" ("PROF RESET" clears them).
+ */
+
+#ifndef LOOP_MONITOR_H
+#define LOOP_MONITOR_H
+
+#include <Arduino.h>
+
+namespace LoopMonitor {
+
+enum class Stage : uint8_t {
+  TOUCH,
+  BLE,
+  STORAGE,
+  NETWORK,
+  EXPORT,
+  OTA,
+  TIMERS,
+  UI,
+  COUNT
+};
+
+static const int STAGE_COUNT = (int)Stage::COUNT;
+static const int BUCKETS = 16;         // <1 ms, <2 ms ... >= 16.4 s
+static const uint32_t STALL_MS = 100;  // A pass this long is a stall
+static const uint32_t LOG_MS = 1000;   // and logged from here
+static const int WORST = 8;
+static const uint32_t WATCHDOG_S = 60; // Well past any legitimate pass
+
+struct Stall {
+  uint32_t us;
+  uint32_t at; // millis() when it ended
+  Stage stage; // The slowest stage of the pass
+  const char *tag; // What that stage said it was doing, or nullptr
+};
+
+struct Summary {
+  uint32_t iterations;
+  uint32_t stalls;
+  uint32_t peakUs;
+  uint32_t buckets[BUCKETS];
+  uint32_t stageMaxUs[STAGE_COUNT];
+  uint64_t stageTotalUs[STAGE_COUNT];
+};
+
+/**
+ * Watch the calling (loop) task; logs a watchdog restart's stage
+ */
+void begin();
+
+/**
+ * Top of loop(): feeds the watchdog, first stage TOUCH
+ */
+void startIteration();
+
+/**
+ * The loop moves on to stage
+ */
+void stage(Stage stage);
+
+/**
+ * Name what the current stage is blocked in (a string literal)
+ */
+void tag(const char *what);
+
+/**
+ * Before loop() sleeps: the pass is over
+ */
+void endIteration();
+
+/**
+ * A long job on the loop task (a benchmark) is still making progress:
+ * feed the watchdog without ending the pass
+ */
+void feed();
+
+const Summary &summary();
+
+/**
+ * Copy the worst stalls, longest first
+ * @return How many there are
+ */
+int worst(Stall *out, int max);
+
+const char *stageName(Stage stage);
+
+void reset();
+
+/**
+ * Print the totals; from any task but the loop's, also the stage the
+ * loop is in now and for how long (a stuck loop can be asked)
+ */
+void dump(Print &out);
+
+} // namespace LoopMonitor
+
+#endif // LOOP_MONITOR_H
@@ -0,0 +1,154 @@
+/**
+ * Memory Telemetry Implementation
+ */
+
+#include "mem_telemetry.h"
+#include "log.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+
+namespace MemTelemetry {
+
+static portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+static size_t _tagged[TAG_COUNT] = {};
+static size_t _peak[TAG_COUNT] = {};
+
+static Snapshot _last = {0, -1, {}, {}};
+static bool _fragWarned[2] = {}; // Internal, PSRAM
+
+// Leak check: free total when each screen was last entered
+static size_t _baseline[MAX_SCREENS] = {};
+static uint8_t _declines[MAX_SCREENS] = {};
+
+static Heap readHeap(uint32_t caps) {
+  Heap h;
+  h.free = heap_caps_get_free_size(caps);
+  h.largest = heap_caps_get_largest_free_block(caps);
+  h.minFree = heap_caps_get_minimum_free_size(caps);
+  h.frag = h.free ? 100 - h.largest * 100 / h.free : 0;
+  return h;
+}
+
+void refresh() {
+  _last.at = millis();
+  _last.internal = readHeap(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  _last.psram = readHeap(MALLOC_CAP_SPIRAM);
+}
+
+const Snapshot &last() { return _last; }
+
+static void checkFragmentation(int which, const char *name, const Heap &h) {
+  if (!_fragWarned[which] && h.frag >= FRAG_WARN_PCT) {
+    _fragWarned[which] = true;
+    LOG_W("Mem", "%s fragmented: %u%% (largest %uK of %uK free)", name,
+          (unsigned)h.frag, (unsigned)(h.largest / 1024),
+          (unsigned)(h.free / 1024));
+  } else if (_fragWarned[which] && h.frag < FRAG_CLEAR_PCT) {
+    _fragWarned[which] = false;
+  }
+}
+
+static void checkLeak(int screen, size_t total) {
+  if (screen < 0 || screen >= MAX_SCREENS)
+    return;
+  size_t before = _baseline[screen];
+  _baseline[screen] = total;
+  if (!before)
+    return; // First visit
+
+  if (before > total && before - total > LEAK_MIN_BYTES) {
+    if (++_declines[screen] >= LEAK_VISITS) {
+      LOG_W("Mem", "Possible leak: screen %d entered with less free memory "
+                   "%d visits running (now %uK)",
+            screen, LEAK_VISITS, (unsigned)(total / 1024));
+      _declines[screen] = 0;
+    }
+  } else {
+    _declines[screen] = 0;
+  }
+}
+
+void sample(int screen) {
+  refresh();
+  _last.screen = screen;
+  const Heap &in = _last.internal;
+  const Heap &ps = _last.psram;
+  LOG_I("Mem",
+        "screen=%d int=%uK/%uK min=%uK frag=%u ps=%uK/%uK min=%uK frag=%u "
+        "ui=%uK notes=%uK hist=%uK sd=%uK",
+        screen, (unsigned)(in.free / 1024), (unsigned)(in.largest / 1024),
+        (unsigned)(in.minFree / 1024), (unsigned)in.frag,
+        (unsigned)(ps.free / 1024), (unsigned)(ps.largest / 1024),
+        (unsigned)(ps.minFree / 1024), (unsigned)ps.frag,
+        (unsigned)(tagged(Tag::UI) / 1024),
+        (unsigned)(tagged(Tag::NOTES) / 1024),
+        (unsigned)(tagged(Tag::HISTORY) / 1024),
+        (unsigned)(tagged(Tag::STORAGE) / 1024));
+
+  checkFragmentation(0, "Internal RAM", in);
+  checkFragmentation(1, "PSRAM", ps);
+  checkLeak(screen, in.free + ps.free);
+}
+
+void track(Tag tag, long bytes) {
+  int i = (int)tag;
+  if (i < 0 || i >= TAG_COUNT)
+    return;
+  portENTER_CRITICAL(&_lock);
+  if (bytes < 0 && (size_t)-bytes > _tagged[i])
+    _tagged[i] = 0; // Freed more than was tracked: a missed track()
+  else
+    _tagged[i] += bytes;
+  if (_tagged[i] > _peak[i])
+    _peak[i] = _tagged[i];
+  portEXIT_CRITICAL(&_lock);
+}
+
+size_t tagged(Tag tag) {
+  portENTER_CRITICAL(&_lock);
+  size_t bytes = _tagged[(int)tag];
+  portEXIT_CRITICAL(&_lock);
+  return bytes;
+}
+
+size_t taggedPeak(Tag tag) {
+  portENTER_CRITICAL(&_lock);
+  size_t bytes = _peak[(int)tag];
+  portEXIT_CRITICAL(&_lock);
+  return bytes;
+}
+
+const char *tagName(Tag tag) {
+  switch (tag) {
+  case Tag::UI:
+    return "ui";
+  case Tag::NOTES:
+    return "notes";
+  case Tag::HISTORY:
+    return "hist";
+  case Tag::STORAGE:
+    return "sd";
+  case Tag::OTHER:
+    return "other";
+  default:
+    return "?";
+  }
+}
+
+void dump(Print &out) {
+  refresh();
+  const Heap &in = _last.internal;
+  const Heap &ps = _last.psram;
+  out.printf("RAM: free=%uK largest=%uK min=%uK frag=%u%%\n",
+             (unsigned)(in.free / 1024), (unsigned)(in.largest / 1024),
+             (unsigned)(in.minFree / 1024), (unsigned)in.frag);
+  out.printf("PSRAM: free=%uK largest=%uK min=%uK frag=%u%%\n",
+             (unsigned)(ps.free / 1024), (unsigned)(ps.largest / 1024),
+             (unsigned)(ps.minFree / 1024), (unsigned)ps.frag);
+  for (int i = 0; i < TAG_COUNT; i++)
+    out.printf("Mem %-5s %6uK peak %6uK\n", tagName((Tag)i),
+               (unsigned)(tagged((Tag)i) / 1024),
+               (unsigned)(taggedPeak((Tag)i) / 1024));
+}
+
+} // namespace MemTelemetry
@@ -0,0 +1,75 @@
+/**
+ * Memory Telemetry
+ *
+ * Internal RAM and PSRAM free space, largest free block and low-water
+ * mark, sampled at every screen transition and logged as one key=value
+ * line ("I Mem: screen=3 int=142K/96K min=118K frag=32 ps=6020K/..."),
+ * with the latest figures on the Perf screen and in "PROF".
+ *
+ * Subsystems report their large buffers with track() under a Tag (the
+ * buffer pool does so for every block), so the totals say who holds the
+ * memory, not just how much is gone.
+ *
+ * Two warnings: fragmentation of either heap crossing FRAG_WARN_PCT (once
+ * per crossing, re-armed below FRAG_CLEAR_PCT), and a suspected leak when
+ * the free total on entering a screen has dropped by more than
+ * LEAK_MIN_BYTES on each of LEAK_VISITS visits in a row.
+ */
+
+#ifndef MEM_TELEMETRY_H
+#define MEM_TELEMETRY_H
+
+#include <Arduino.h>
+
+namespace MemTelemetry {
+
+enum class Tag : uint8_t { UI, NOTES, HISTORY, STORAGE, OTHER, COUNT };
+
+static const int TAG_COUNT = (int)Tag::COUNT;
+static const int MAX_SCREENS = 32;           // Screen ids with a baseline
+static const uint8_t FRAG_WARN_PCT = 60;
+static const uint8_t FRAG_CLEAR_PCT = 50;
+static const int LEAK_VISITS = 3;
+static const size_t LEAK_MIN_BYTES = 2048;
+
+struct Heap {
+  size_t free;
+  size_t largest;  // Largest free block
+  size_t minFree;  // Low-water mark since boot
+  uint8_t frag;    // 0-100: 100 - largest * 100 / free
+};
+
+struct Snapshot {
+  uint32_t at; // millis()
+  int screen;  // -1 before the first transition
+  Heap internal;
+  Heap psram;
+};
+
+/**
+ * Read both heaps, log them and check the warnings
+ * @param screen Screen being entered (the baseline for the leak check)
+ */
+void sample(int screen);
+
+/**
+ * Latest sample (read both heaps again with refresh)
+ */
+const Snapshot &last();
+void refresh();
+
+/**
+ * Account bytes to a subsystem: positive when allocated, negative when
+ * freed. Safe from any task.
+ */
+void track(Tag tag, long bytes);
+
+size_t tagged(Tag tag);
+size_t taggedPeak(Tag tag);
+const char *tagName(Tag tag);
+
+void dump(Print &out);
+
+} // namespace MemTelemetry
+
+#endif // MEM_TELEMETRY_H
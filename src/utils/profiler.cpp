@@ -0,0 +1,101 @@
+/**
+ * Frame-Time Profiler Implementation
+ */
+
+#include "profiler.h"
+#include <algorithm>
+#include <freertos/FreeRTOS.h>
+
+namespace Profiler {
+
+namespace {
+
+struct Accumulator {
+  uint32_t window[WINDOW];
+  uint8_t next;
+  uint8_t filled;
+  uint32_t count;
+  uint32_t peak;
+};
+
+Accumulator _zones[ZONE_COUNT];
+portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+const char *const NAMES[ZONE_COUNT] = {"draw", "epd push", "ble parse",
+                                       "sd ops", "touch read"};
+
+} // namespace
+
+const char *zoneName(Zone zone) {
+  return zone < Zone::COUNT ? NAMES[(int)zone] : "?";
+}
+
+bool isEnabled() {
+#ifdef FRAME_PROFILER
+  return true;
+#else
+  return false;
+#endif
+}
+
+void record(Zone zone, uint32_t micros) {
+  if (zone >= Zone::COUNT)
+    return;
+  Accumulator &a = _zones[(int)zone];
+  portENTER_CRITICAL(&_lock);
+  a.window[a.next] = micros;
+  a.next = (a.next + 1) % WINDOW;
+  if (a.filled < WINDOW)
+    a.filled++;
+  a.count++;
+  if (micros > a.peak)
+    a.peak = micros;
+  portEXIT_CRITICAL(&_lock);
+}
+
+bool stats(Zone zone, Stats &out) {
+  if (zone >= Zone::COUNT)
+    return false;
+  uint32_t sorted[WINDOW];
+  const Accumulator &a = _zones[(int)zone];
+  portENTER_CRITICAL(&_lock);
+  int n = a.filled;
+  memcpy(sorted, a.window, n * sizeof(uint32_t));
+  out.count = a.count;
+  out.peak = a.peak;
+  portEXIT_CRITICAL(&_lock);
+  if (n == 0)
+    return false;
+
+  // Order within the window does not matter once sorted
+  std::sort(sorted, sorted + n);
+  out.p50 = sorted[(n - 1) / 2];
+  out.p95 = sorted[(n - 1) * 95 / 100];
+  out.max = sorted[n - 1];
+  return true;
+}
+
+void reset() {
+  portENTER_CRITICAL(&_lock);
+  memset(_zones, 0, sizeof(_zones));
+  portEXIT_CRITICAL(&_lock);
+}
+
+void dump(Print &out) {
+  if (!isEnabled()) {
+    out.println("Profiler: not built in (add -DFRAME_PROFILER)");
+    return;
+  }
+  out.printf("Profiler: %-10s %8s %9s %8s %8s %8s\n", "zone", "count",
+             "p50 us", "p95 us", "max us", "peak us");
+  for (int z = 0; z < ZONE_COUNT; z++) {
+    Stats s;
+    if (!stats((Zone)z, s))
+      continue;
+    out.printf("Profiler: %-10s %8u %9u %8u %8u %8u\n", zoneName((Zone)z),
+               (unsigned)s.count, (unsigned)s.p50, (unsigned)s.p95,
+               (unsigned)s.max, (unsigned)s.peak);
+  }
+}
+
+} // namespace Profiler
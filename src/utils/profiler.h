@@ -0,0 +1,84 @@
+/**
+ * Frame-Time Profiler
+ *
+ * Scoped timers on esp_timer_get_time() feeding one accumulator per zone.
+ * Each zone keeps its last WINDOW durations for rolling p50/p95/max, plus
+ * a call count and the peak since the last reset. Zones are recorded from
+ * whichever task does the work (touch reads on the GT911 task, SD ops on
+ * the storage worker), so recording takes a short spinlock; percentiles
+ * are worked out only when someone asks.
+ *
+ * PROFILE_ZONE(DRAW) times the rest of the enclosing block. Without
+ * -DFRAME_PROFILER the macro compiles to nothing and the accumulators stay
+ * empty. Zones may nest: DRAW includes the home screen's frame push.
+ *
+ * Read the numbers on the Perf screen (Settings) or send "PROF" over USB
+ * serial ("PROF RESET" clears them). The debug build has it on; the
+ * m5paper_s3_release_prof environment is the release build with it, for
+ * comparing the two.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+namespace Profiler {
+
+enum class Zone : uint8_t { DRAW, EPD_PUSH, BLE_PARSE, SD_OPS, TOUCH_READ, COUNT };
+
+static const int ZONE_COUNT = (int)Zone::COUNT;
+static const int WINDOW = 64; // Samples per zone for the percentiles
+
+struct Stats {
+  uint32_t count; // Calls since reset
+  uint32_t p50;   // Microseconds, over the window
+  uint32_t p95;
+  uint32_t max;
+  uint32_t peak; // Longest since reset
+};
+
+const char *zoneName(Zone zone);
+
+/**
+ * True when this build records anything
+ */
+bool isEnabled();
+
+void record(Zone zone, uint32_t micros);
+
+/**
+ * @return false if the zone has no samples yet
+ */
+bool stats(Zone zone, Stats &out);
+
+void reset();
+
+/**
+ * Print a table of every zone
+ */
+void dump(Print &out);
+
+class Scope {
+public:
+  explicit Scope(Zone zone) : _zone(zone), _start(esp_timer_get_time()) {}
+  ~Scope() { record(_zone, (uint32_t)(esp_timer_get_time() - _start)); }
+
+private:
+  Zone _zone;
+  int64_t _start;
+};
+
+} // namespace Profiler
+
+#ifdef FRAME_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(zone)                                                     \
+  Profiler::Scope PROFILE_CONCAT(_profileScope, __LINE__)(Profiler::Zone::zone)
+#else
+#define PROFILE_ZONE(zone) ((void)0)
+#endif
+
+#endif // PROFILER_H
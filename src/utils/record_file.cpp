@@ -0,0 +1,187 @@
+/**
+ * Record Files Implementation
+ */
+
+#include "record_file.h"
+#include "crc16.h"
+#include "flash_store.h"
+#include "sd_manager.h"
+
+extern SDManager *sdManager;
+extern StorageWorker *storage;
+
+#define RECORD_MAGIC 0x44434552 // "RECD"
+
+namespace RecordFile {
+
+static_assert(sizeof(Header) <= StorageWorker::MAX_HEAD,
+              "record header must fit a storage request head");
+
+static void seal(Header &header, uint16_t type, uint16_t version,
+                 const void *data, size_t len) {
+  header.magic = RECORD_MAGIC;
+  header.type = type;
+  header.version = version;
+  header.length = len;
+  header.crc = CRC16::modbus((const uint8_t *)data, len);
+  header.reserved = 0;
+}
+
+// Write through <path>.tmp. LittleFS renames over the old file atomically;
+// FAT cannot, so the old file goes first and read() covers the gap.
+static bool writeTo(fs::FS &fs, bool renameReplaces, const char *path,
+                    const Header &header, const void *data, size_t len) {
+  String tempPath = String(path) + ".tmp";
+  File file = fs.open(tempPath.c_str(), FILE_WRITE);
+  if (!file)
+    return false;
+  size_t written = file.write((const uint8_t *)&header, sizeof(header));
+  written += file.write((const uint8_t *)data, len);
+  file.close();
+  if (written != sizeof(header) + len)
+    return false;
+  if (!renameReplaces)
+    fs.remove(path);
+  return fs.rename(tempPath.c_str(), path);
+}
+
+// Hot records live in flash and reach SD through the mirror
+static bool writeFlash(const char *path, const Header &header,
+                       const void *data, size_t len) {
+  if (!writeTo(flashStore->fs(), true, path, header, data, len)) {
+    Serial.printf("Storage: Record %s not saved to flash\n", path);
+    return false;
+  }
+  flashStore->mirror(path);
+  return true;
+}
+
+bool write(const char *path, uint16_t type, uint16_t version,
+           const void *data, size_t len) {
+  Header header;
+  seal(header, type, version, data, len);
+  if (flashStore && flashStore->isAvailable())
+    return writeFlash(path, header, data, len);
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  if (!writeTo(sdFS(), false, path, header, data, len)) {
+    Serial.printf("Storage: Record %s not saved\n", path);
+    sd.fail();
+    return false;
+  }
+  return true;
+}
+
+bool writeAsync(const char *path, uint16_t type, uint16_t version,
+                const void *data, size_t len, StorageCallback done) {
+  if (!storage)
+    return false;
+  uint8_t *copy = (uint8_t *)malloc(len);
+  if (!copy)
+    return false;
+  memcpy(copy, data, len);
+
+  Header header;
+  seal(header, type, version, copy, len);
+  if (storage->write(path, &header, sizeof(header), copy, len, done, true,
+                     true))
+    return true;
+  free(copy);
+  return false;
+}
+
+bool writeDeferred(const char *path, uint16_t type, uint16_t version,
+                   const void *data, size_t len) {
+  // Flash is fast enough to take every save; the mirror already batches
+  // the SD copies
+  if (flashStore && flashStore->isAvailable())
+    return write(path, type, version, data, len);
+  if (!sdManager)
+    return false;
+  uint8_t *record = (uint8_t *)malloc(sizeof(Header) + len);
+  if (!record)
+    return false;
+  Header header;
+  seal(header, type, version, data, len);
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), data, len);
+  bool ok = sdManager->deferWrite(path, record, sizeof(header) + len);
+  free(record);
+  return ok;
+}
+
+static bool check(const char *path, const Header &header, uint16_t type,
+                  uint16_t version, size_t len) {
+  if (header.magic == RECORD_MAGIC && header.type == type &&
+      header.version == version && header.length == len)
+    return true;
+  Serial.printf("Storage: Record %s is type %04x v%d, expected %04x v%d\n",
+                path, header.type, header.version, type, version);
+  return false;
+}
+
+static bool readFrom(fs::FS &fs, const char *path, uint16_t type,
+                     uint16_t version, void *data, size_t len) {
+  // A save interrupted between remove and rename leaves only the temp file
+  File file = fs.open(path, FILE_READ);
+  if (!file) {
+    String tempPath = String(path) + ".tmp";
+    if (fs.exists(tempPath.c_str()))
+      file = fs.open(tempPath.c_str(), FILE_READ);
+    if (!file)
+      return false;
+  }
+
+  Header header;
+  bool ok = file.size() == sizeof(header) + len &&
+            file.read((uint8_t *)&header, sizeof(header)) == sizeof(header);
+  if (ok && !check(path, header, type, version, len))
+    ok = false;
+
+  uint8_t *buffer = ok ? (uint8_t *)malloc(len) : nullptr;
+  ok = buffer && file.read(buffer, len) == len &&
+       CRC16::modbus(buffer, len) == header.crc;
+  file.close();
+  if (ok)
+    memcpy(data, buffer, len);
+  else if (buffer)
+    Serial.printf("Storage: Record %s is corrupt\n", path);
+  free(buffer);
+  return ok;
+}
+
+bool read(const char *path, uint16_t type, uint16_t version, void *data,
+          size_t len) {
+  if (flashStore && flashStore->isAvailable()) {
+    flashStore->sync(path);
+    if (flashStore->exists(path) ||
+        flashStore->exists((String(path) + ".tmp").c_str()))
+      return readFrom(flashStore->fs(), path, type, version, data, len);
+  }
+  if (!sdManager)
+    return false;
+
+  // Newer than the card while it waits in the write-back cache
+  size_t pendingLen;
+  const uint8_t *pending = sdManager->peekDeferred(path, pendingLen);
+  if (pending) {
+    Header header;
+    if (pendingLen != sizeof(header) + len)
+      return false;
+    memcpy(&header, pending, sizeof(header));
+    if (!check(path, header, type, version, len) ||
+        CRC16::modbus(pending + sizeof(header), len) != header.crc)
+      return false;
+    memcpy(data, pending + sizeof(header), len);
+    return true;
+  }
+
+  SDAccess sd(sdManager);
+  if (!sd)
+    return false;
+  return readFrom(sdFS(), path, type, version, data, len);
+}
+
+} // namespace RecordFile
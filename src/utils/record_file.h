@@ -0,0 +1,85 @@
+/**
+ * Record Files
+ *
+ * Versioned binary snapshots of a plain struct: a 16-byte header (magic,
+ * record type, schema version, length, CRC16 of the payload) followed by
+ * the struct bytes. Saves go to <path>.tmp and are then renamed over the
+ * old file, so a crash mid-save leaves the previous record intact. Loads
+ * reject anything with the wrong type, version, size or CRC, and the
+ * caller falls back to its defaults.
+ *
+ * A record struct declares its identity:
+ *   struct SaveData {
+ *     static const uint16_t RECORD_TYPE = 0x2048;
+ *     static const uint16_t RECORD_VERSION = 1; // Bump on layout change
+ *     ...
+ *   };
+ */
+
+#ifndef RECORD_FILE_H
+#define RECORD_FILE_H
+
+#include "storage_worker.h"
+#include <Arduino.h>
+
+namespace RecordFile {
+
+struct Header {
+  uint32_t magic;
+  uint16_t type;
+  uint16_t version;
+  uint32_t length;
+  uint16_t crc; // CRC16 of the payload
+  uint16_t reserved;
+};
+
+/**
+ * Write a record now, on the calling task (under SDAccess)
+ */
+bool write(const char *path, uint16_t type, uint16_t version,
+           const void *data, size_t len);
+
+/**
+ * Queue a record on the storage worker; data is copied, so the caller may
+ * change it straight away
+ */
+bool writeAsync(const char *path, uint16_t type, uint16_t version,
+                const void *data, size_t len, StorageCallback done = nullptr);
+
+/**
+ * Leave a record in the SDManager write-back cache: frequent saves reach
+ * the card once per flush interval
+ */
+bool writeDeferred(const char *path, uint16_t type, uint16_t version,
+                   const void *data, size_t len);
+
+/**
+ * Read a record into data (a deferred one still in the cache first); data
+ * is untouched unless the whole record checks out
+ */
+bool read(const char *path, uint16_t type, uint16_t version, void *data,
+          size_t len);
+
+template <typename T> bool save(const char *path, const T &record) {
+  return write(path, T::RECORD_TYPE, T::RECORD_VERSION, &record, sizeof(T));
+}
+
+template <typename T>
+bool saveAsync(const char *path, const T &record,
+               StorageCallback done = nullptr) {
+  return writeAsync(path, T::RECORD_TYPE, T::RECORD_VERSION, &record,
+                    sizeof(T), done);
+}
+
+template <typename T> bool saveDeferred(const char *path, const T &record) {
+  return writeDeferred(path, T::RECORD_TYPE, T::RECORD_VERSION, &record,
+                       sizeof(T));
+}
+
+template <typename T> bool load(const char *path, T &record) {
+  return read(path, T::RECORD_TYPE, T::RECORD_VERSION, &record, sizeof(T));
+}
+
+} // namespace RecordFile
+
+#endif // RECORD_FILE_H
@@ -0,0 +1,247 @@
+/**
+ * SD Benchmark Suite Implementation
+ */
+
+#include "sd_benchmark.h"
+#include "buffer_pool.h"
+#include "loop_monitor.h"
+#include <algorithm>
+#include <esp_timer.h>
+#include <time.h>
+
+namespace SDBench {
+
+static const char *TEST_FILE = "/diag/rand_test.bin";
+static const char *TEMP_DIR = "/diag/tmp";
+static const size_t BLOCK = 4096;
+static const size_t RAND_FILE = 1024 * 1024; // 256 blocks
+static const int RAND_OPS = 128;
+static const int SMALL_FILES = 100;
+static const size_t SMALL_SIZE = 1024; // About a compressed note
+static const int LIST_AT[LIST_POINTS] = {10, 50, SMALL_FILES};
+
+static inline uint32_t micros32() { return (uint32_t)esp_timer_get_time(); }
+
+static Latency summarize(uint32_t *us, int count, uint32_t totalUs) {
+  std::sort(us, us + count);
+  Latency l;
+  l.iops = totalUs ? count * 1e6f / totalUs : 0;
+  l.p50Ms = us[count / 2] / 1000.0f;
+  l.p99Ms = us[(count * 99) / 100] / 1000.0f;
+  return l;
+}
+
+static void tempName(char *out, size_t len, int i) {
+  snprintf(out, len, "%s/f%03d.bin", TEMP_DIR, i);
+}
+
+// Random 4 KB reads then flushed writes over a 1 MB file
+static bool randomIO(uint8_t *buf, Results &r) {
+  BufferPool::Buffer samples(RAND_OPS * sizeof(uint32_t),
+                             MemTelemetry::Tag::STORAGE);
+  uint32_t *us = (uint32_t *)samples.get();
+  if (!us)
+    return false;
+
+  File file = sdFS().open(TEST_FILE, FILE_WRITE);
+  bool ok = file;
+  for (size_t off = 0; ok && off < RAND_FILE; off += BLOCK)
+    ok = file.write(buf, BLOCK) == BLOCK;
+  if (file)
+    file.close();
+
+  if (ok) {
+    file = sdFS().open(TEST_FILE, FILE_READ);
+    ok = file;
+    uint32_t start = micros32();
+    for (int i = 0; ok && i < RAND_OPS; i++) {
+      uint32_t t = micros32();
+      ok = file.seek(random(RAND_FILE / BLOCK) * BLOCK) &&
+           file.read(buf, BLOCK) == BLOCK;
+      us[i] = micros32() - t;
+    }
+    if (ok)
+      r.randRead = summarize(us, RAND_OPS, micros32() - start);
+    if (file)
+      file.close();
+  }
+
+  if (ok) {
+    file = sdFS().open(TEST_FILE, "r+");
+    ok = file;
+    uint32_t start = micros32();
+    for (int i = 0; ok && i < RAND_OPS; i++) {
+      uint32_t t = micros32();
+      ok = file.seek(random(RAND_FILE / BLOCK) * BLOCK) &&
+           file.write(buf, BLOCK) == BLOCK;
+      file.flush(); // Time the card, not the FAT buffer
+      us[i] = micros32() - t;
+    }
+    if (ok)
+      r.randWrite = summarize(us, RAND_OPS, micros32() - start);
+    if (file)
+      file.close();
+  }
+
+  sdFS().remove(TEST_FILE);
+  return ok;
+}
+
+// Create files one by one, timing a listing at each checkpoint, then
+// delete them all
+static bool smallFiles(SDManager *sd, uint8_t *buf, Results &r) {
+  if (!sd->ensureDirectory(TEMP_DIR))
+    return false;
+
+  char name[32];
+  std::vector<String> names;
+  uint32_t createUs = 0;
+  int point = 0;
+  bool ok = true;
+  for (int i = 0; ok && i < SMALL_FILES; i++) {
+    tempName(name, sizeof(name), i);
+    uint32_t t = micros32();
+    File file = sdFS().open(name, FILE_WRITE);
+    ok = file && file.write(buf, SMALL_SIZE) == SMALL_SIZE;
+    if (file)
+      file.close();
+    createUs += micros32() - t;
+
+    if (ok && point < LIST_POINTS && i + 1 == LIST_AT[point]) {
+      t = micros32();
+      r.listFiles[point] = sd->listFiles(TEMP_DIR, names);
+      r.listMs[point] = (micros32() - t) / 1000.0f;
+      point++;
+    }
+    if ((i & 15) == 15) {
+      yield();
+      LoopMonitor::feed();
+    }
+  }
+  if (ok)
+    r.createPerSec = createUs ? SMALL_FILES * 1e6f / createUs : 0;
+
+  uint32_t t = micros32();
+  for (int i = 0; i < SMALL_FILES; i++) {
+    tempName(name, sizeof(name), i);
+    sdFS().remove(name);
+  }
+  uint32_t deleteUs = micros32() - t;
+  if (ok)
+    r.deletePerSec = deleteUs ? SMALL_FILES * 1e6f / deleteUs : 0;
+  sdFS().rmdir(TEMP_DIR);
+  return ok;
+}
+
+bool run(SDManager *sd, Results &r) {
+  memset(&r, 0, sizeof(r));
+  if (!sd)
+    return false;
+
+  BufferPool::Buffer block(BLOCK, MemTelemetry::Tag::STORAGE);
+  uint8_t *buf = block.get();
+  if (!buf) {
+    Serial.println("SDBench: Out of RAM");
+    return false;
+  }
+  for (size_t i = 0; i < BLOCK; i++)
+    buf[i] = i & 0xFF;
+
+  bool ok;
+  {
+    SDAccess access(sd);
+    ok = access && sd->ensureDirectory("/diag");
+    if (ok && !sd->runBenchmark(r.seqWriteMBps, r.seqReadMBps)) {
+      Serial.println("SDBench: Sequential stage failed");
+      ok = false;
+    }
+    if (ok && !randomIO(buf, r)) {
+      Serial.println("SDBench: Random 4K stage failed");
+      ok = false;
+    }
+    if (ok && !smallFiles(sd, buf, r)) {
+      Serial.println("SDBench: Small file stage failed");
+      ok = false;
+    }
+    if (access && !ok)
+      access.fail();
+  }
+
+  // Last: the recovery path everything else falls back on
+  if (ok) {
+    uint32_t start = millis();
+    if (sd->powerCycleAndReinit())
+      r.powerCycleMs = millis() - start;
+    else
+      ok = false;
+  }
+
+  r.ok = ok;
+  Serial.printf("SDBench: seq W %.2f R %.2f MB/s, 4K R %.0f W %.0f IOPS, "
+                "create %.1f/s, delete %.1f/s, power cycle %lu ms\n",
+                r.seqWriteMBps, r.seqReadMBps, r.randRead.iops,
+                r.randWrite.iops, r.createPerSec, r.deletePerSec,
+                (unsigned long)r.powerCycleMs);
+  return ok;
+}
+
+bool save(SDManager *sd, const Results &r, char *path, size_t pathLen) {
+  time_t now = time(nullptr);
+  struct tm ti;
+  localtime_r(&now, &ti);
+  char stamp[20];
+  if (ti.tm_year + 1900 >= 2024) {
+    strftime(path, pathLen, "/diag/bench_%Y%m%d.csv", &ti);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &ti);
+  } else {
+    snprintf(path, pathLen, "/diag/bench_unset.csv"); // Clock not set yet
+    snprintf(stamp, sizeof(stamp), "uptime %lu", (unsigned long)millis());
+  }
+
+  SDAccess access(sd);
+  if (!access || !sd->ensureDirectory("/diag"))
+    return false;
+
+  bool fresh = !sdFS().exists(path);
+  File file = sdFS().open(path, FILE_APPEND);
+  if (!file) {
+    access.fail();
+    return false;
+  }
+  if (fresh)
+    file.print("time,build,backend,clock_hz,card,metric,value,unit\n");
+
+  // Same prefix on every row so runs from several files concatenate
+  char prefix[96];
+  snprintf(prefix, sizeof(prefix), "%s,%s %s,%s,%lu,%s", stamp, __DATE__,
+           __TIME__, SDManager::backendName(sd->getBackend()),
+           (unsigned long)sd->getFrequency(), sd->getCardInfo().type.c_str());
+  char line[160];
+  auto row = [&](const char *metric, float value, const char *unit) {
+    snprintf(line, sizeof(line), "%s,%s,%.3f,%s\n", prefix, metric, value,
+             unit);
+    file.print(line);
+  };
+
+  row("seq_write", r.seqWriteMBps, "MB/s");
+  row("seq_read", r.seqReadMBps, "MB/s");
+  row("rand4k_read", r.randRead.iops, "IOPS");
+  row("rand4k_read_p50", r.randRead.p50Ms, "ms");
+  row("rand4k_read_p99", r.randRead.p99Ms, "ms");
+  row("rand4k_write", r.randWrite.iops, "IOPS");
+  row("rand4k_write_p50", r.randWrite.p50Ms, "ms");
+  row("rand4k_write_p99", r.randWrite.p99Ms, "ms");
+  row("file_create", r.createPerSec, "files/s");
+  row("file_delete", r.deletePerSec, "files/s");
+  for (int i = 0; i < LIST_POINTS; i++) {
+    char metric[16];
+    snprintf(metric, sizeof(metric), "list_%d", LIST_AT[i]);
+    row(metric, r.listMs[i], "ms");
+  }
+  row("power_cycle", (float)r.powerCycleMs, "ms");
+  file.close();
+  Serial.printf("SDBench: Results appended to %s\n", path);
+  return true;
+}
+
+} // namespace SDBench
@@ -0,0 +1,55 @@
+/**
+ * SD Benchmark Suite
+ *
+ * Measures the access patterns the firmware actually uses, not just bulk
+ * throughput: 4 KB random I/O (history day files), small-file create and
+ * delete (/notes/*.bin), directory listings as the file count grows, and
+ * the cost of the power-cycle recovery. Each run is appended to
+ * /diag/bench_<date>.csv so cards and firmware builds can be compared.
+ */
+
+#ifndef SD_BENCHMARK_H
+#define SD_BENCHMARK_H
+
+#include "sd_manager.h"
+#include <Arduino.h>
+
+namespace SDBench {
+
+static const int LIST_POINTS = 3; // Listing timed at 10, 50 and 100 files
+
+struct Latency {
+  float iops;
+  float p50Ms;
+  float p99Ms;
+};
+
+struct Results {
+  bool ok;
+  float seqWriteMBps;
+  float seqReadMBps;
+  Latency randRead;  // 4 KB random reads
+  Latency randWrite; // 4 KB random writes, flushed each time
+  float createPerSec;
+  float deletePerSec;
+  int listFiles[LIST_POINTS];
+  float listMs[LIST_POINTS];
+  uint32_t powerCycleMs; // 0 if the card did not come back
+};
+
+/**
+ * Run the whole suite on the active backend. Blocks for several seconds
+ * and power cycles the card (and the external rail) once at the end.
+ * @return false if the card was unavailable or a stage failed
+ */
+bool run(SDManager *sd, Results &results);
+
+/**
+ * Append results to /diag/bench_<YYYYMMDD>.csv, one row per metric
+ * @param path Receives the file written (at least 32 bytes)
+ */
+bool save(SDManager *sd, const Results &results, char *path, size_t pathLen);
+
+} // namespace SDBench
+
+#endif // SD_BENCHMARK_H
@@ -3,41 +3,222 @@
  */
 
 #include "sd_manager.h"
+#include "../hardware/energy_model.h"
+#include "buffer_pool.h"
+#include "crc16.h"
+#include "log.h"
+#include "loop_monitor.h"
 #include <Arduino.h>
 #include <M5Unified.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
 #include <SPI.h>
+#include <soc/soc_caps.h>
 #include <vector>
 
-SDManager::SDManager() : _available(false) {}
+#if SOC_SDMMC_HOST_SUPPORTED
+#include <SD_MMC.h>
+#define SD_HAS_SDMMC 1
+#else
+#define SD_HAS_SDMMC 0
+#endif
+
+// SPI clocks to try, slowest first (FSPI divides 80 MHz)
+static const uint32_t CLOCK_LADDER[] = {1000000,  4000000,  10000000,
+                                        20000000, 26666666, 40000000};
+static const int CLOCK_STEPS = sizeof(CLOCK_LADDER) / sizeof(CLOCK_LADDER[0]);
+static const int SAFE_STEPS = 3; // Plain mount attempts before giving up
+static const int VERIFY_SECTORS = 4;
+static const uint32_t POWER_UP_MS = 50; // Supply settles after switch-on
+
+// SDMMC host clocks in kHz, slowest first. The bus CRCs every command and
+// block, so a bad clock fails the mount instead of returning garbage: no
+// read-verify ramp, just take the fastest that mounts. Above 20 MHz the
+// driver switches the card to high speed when it supports it.
+static const int MMC_LADDER_KHZ[] = {10000, 20000, 40000};
+static const int MMC_STEPS = sizeof(MMC_LADDER_KHZ) / sizeof(MMC_LADDER_KHZ[0]);
+
+#ifdef SD_USE_SDMMC
+static const SDBackend DEFAULT_BACKEND = SDBackend::SDMMC;
+#else
+static const SDBackend DEFAULT_BACKEND = SDBackend::SPI;
+#endif
+
+// Filesystem of the mounted backend
+static fs::FS *activeFS = &SD;
+
+fs::FS &sdFS() { return *activeFS; }
+
+// NVS namespace for the best clock per card
+static const char *CLOCK_NS = "sdclock";
+
+SDManager::SDManager()
+    : _available(false), _suspect(false), _asleep(false), _sleeps(0),
+      _lastAccess(0), _mountGeneration(0), _cardGeneration(0),
+      _lock(xSemaphoreCreateRecursiveMutex()), _clockStep(0), _cardKey(0),
+      _backend(DEFAULT_BACKEND), _mmcStep(MMC_STEPS - 1), _accessDepth(0),
+      _deferredBytes(0),
+      _deferIntervalMs(DEFER_INTERVAL_SECS * 1000), _deferSince(0) {}
 
 SDManager::~SDManager() {
+  flushDeferred();
+  for (Deferred &entry : _deferred)
+    free(entry.data);
   if (_available) {
-    SD.end();
+    unmount();
   }
+  vSemaphoreDelete(_lock);
 }
 
 // Create dedicated SPI instance for SD card (FSPI - recommended for SD on S3)
 static SPIClass sdSPI(FSPI);
 
-bool SDManager::init() {
-  // Hardcoded pins from M5Paper S3 documentation
-  const int8_t SD_SCK = 39;
-  const int8_t SD_MISO = 40;
-  const int8_t SD_MOSI = 38;
-  const int8_t SD_CS = 47;
+// Hardcoded pins from M5Paper S3 documentation
+static const int8_t SD_SCK = 39;
+static const int8_t SD_MISO = 40;
+static const int8_t SD_MOSI = 38;
+static const int8_t SD_CS = 47;
+
+static const char *cardTypeName(uint8_t cardType) {
+  return cardType == CARD_MMC    ? "MMC"
+         : cardType == CARD_SD   ? "SDSC"
+         : cardType == CARD_SDHC ? "SDHC"
+                                 : "UNKNOWN";
+}
 
-  Serial.printf("SD SPI Pins: SCK=%d, MISO=%d, MOSI=%d, CS=%d\n", SD_SCK,
-                SD_MISO, SD_MOSI, SD_CS);
+void SDManager::unmount() {
+#if SD_HAS_SDMMC
+  if (_backend == SDBackend::SDMMC)
+    SD_MMC.end();
+  else
+#endif
+    SD.end();
+  _available = false;
+  trackPower();
+}
+
+void SDManager::trackPower() {
+  EnergyModel::State state = _accessDepth ? EnergyModel::State::SD_ACTIVE
+                             : _available ? EnergyModel::State::SD_IDLE
+                                          : EnergyModel::State::SD_OFF;
+#ifndef SD_POWER_PIN
+  // Nothing actually switched the card off: unmounted, it still draws
+  // its standby current
+  if (_asleep && state == EnergyModel::State::SD_OFF)
+    state = EnergyModel::State::SD_IDLE;
+#endif
+  EnergyModel::set(state);
+}
+
+uint8_t SDManager::cardType() const {
+#if SD_HAS_SDMMC
+  if (_backend == SDBackend::SDMMC)
+    return SD_MMC.cardType();
+#endif
+  return SD.cardType();
+}
 
+bool SDManager::mountAt(int step) {
+  activeFS = &SD;
+  if (SD.begin(SD_CS, sdSPI, CLOCK_LADDER[step]) &&
+      SD.cardType() != CARD_NONE)
+    return true;
+  SD.end();
+  delay(20);
+  return false;
+}
+
+uint32_t SDManager::readCardKey() {
+  // The Arduino SD driver does not expose the CID: identify the card by
+  // its boot sector and size instead, which also changes on a reformat
+  uint8_t sector[512];
+  if (!SD.readRAW(sector, 0))
+    return 0;
+  uint32_t key = ((uint32_t)CRC16::modbus(sector, sizeof(sector)) << 16) ^
+                 (uint32_t)SD.numSectors();
+  return key ? key : 1;
+}
+
+bool SDManager::readReference(uint8_t *buffer) {
+  for (int i = 0; i < VERIFY_SECTORS; i++) {
+    if (!SD.readRAW(buffer + i * 512, i))
+      return false;
+  }
+  return true;
+}
+
+int SDManager::rampUp(int step, int maxStep) {
+  uint8_t *reference = (uint8_t *)malloc(VERIFY_SECTORS * 512);
+  uint8_t *check = (uint8_t *)malloc(VERIFY_SECTORS * 512);
+  if (!reference || !check || !readReference(reference)) {
+    free(reference);
+    free(check);
+    return step;
+  }
+
+  // Climb while the card reads back exactly what it gave at the safe clock
+  int best = step;
+  bool mounted = true;
+  for (int next = step + 1; next <= maxStep; next++) {
+    SD.end();
+    if (mountAt(next) && readReference(check) &&
+        memcmp(reference, check, VERIFY_SECTORS * 512) == 0) {
+      best = next;
+      continue;
+    }
+    Serial.printf("SD: %lu Hz failed verify\n", CLOCK_LADDER[next]);
+    SD.end();
+    mounted = false;
+    break;
+  }
+  free(reference);
+  free(check);
+
+  if (!mounted && !mountAt(best))
+    return -1;
+  return best;
+}
+
+int SDManager::storedStep(uint32_t cardKey) {
+  Preferences prefs;
+  if (!cardKey || !prefs.begin(CLOCK_NS, true))
+    return -1;
+  char key[12];
+  snprintf(key, sizeof(key), "k%08lx", (unsigned long)cardKey);
+  int step = prefs.isKey(key) ? prefs.getUChar(key, 0) : -1;
+  prefs.end();
+  return step < CLOCK_STEPS ? step : -1;
+}
+
+void SDManager::saveClock() {
+  if (!_cardKey)
+    return;
+  char key[12];
+  snprintf(key, sizeof(key), "k%08lx", (unsigned long)_cardKey);
+  Preferences prefs;
+  if (!prefs.begin(CLOCK_NS, false))
+    return;
+  prefs.putUInt("last", _cardKey);
+  prefs.putUChar(key, _clockStep);
+  prefs.end();
+}
+
+bool SDManager::mount() {
   // End any existing SPI to release pins
   sdSPI.end();
   delay(50);
 
-  // Configure CS pin - must be HIGH before SPI init
+  // Configure CS pin - must be HIGH before SPI init (and as D3 in SDMMC
+  // 1-bit mode, where a low D3 at power-up would select SPI mode)
   pinMode(SD_CS, OUTPUT);
   digitalWrite(SD_CS, HIGH);
   delay(100);
 
+#if SD_HAS_SDMMC
+  if (_backend == SDBackend::SDMMC)
+    return mountMMC();
+#endif
+
   // Send 80 dummy clocks with CS high to put card in SPI mode
   // This is required per SD card spec
   sdSPI.begin(SD_SCK, SD_MISO, SD_MOSI, -1);
@@ -48,139 +229,343 @@ bool SDManager::init() {
   sdSPI.endTransaction();
   delay(10);
 
-  // Now try SD.begin with the SPI bus
+  // 1. Same card as last time: start at its known best clock
+  uint32_t lastKey = 0;
+  Preferences prefs;
+  if (prefs.begin(CLOCK_NS, true)) {
+    lastKey = prefs.getUInt("last", 0);
+    prefs.end();
+  }
+  int lastStep = storedStep(lastKey);
+
+  int step = -1;
+  if (lastStep > 0 && mountAt(lastStep)) {
+    // A garbled boot sector at this clock reads as a different key
+    if (readCardKey() == lastKey) {
+      step = lastStep;
+      _cardKey = lastKey;
+    } else {
+      SD.end();
+    }
+  }
 
-  // Try multiple frequencies, starting low
-  uint32_t frequencies[] = {1000000, 4000000, 10000000}; // 1MHz, 4MHz, 10MHz
+  // 2. Otherwise mount slow, then ramp up as far as reads verify
+  if (step < 0) {
+    for (int i = 0; i < SAFE_STEPS; i++) {
+      Serial.printf("SD: Trying frequency %lu Hz...\n", CLOCK_LADDER[i]);
+      if (mountAt(i)) {
+        step = i;
+        break;
+      }
+    }
+    if (step < 0) {
+      Serial.println("SD Card: Mount failed at all frequencies");
+      _available = false;
+      return false;
+    }
+    // A known card does not climb past its stored clock, which I/O
+    // errors may have lowered
+    _cardKey = readCardKey();
+    int known = storedStep(_cardKey);
+    step = rampUp(step, known >= 0 ? known : CLOCK_STEPS - 1);
+    if (step < 0) {
+      Serial.println("SD Card: Lost the card while ramping the clock");
+      _available = false;
+      return false;
+    }
+    _clockStep = step;
+    saveClock();
+  }
+  _clockStep = step;
+
+  Serial.printf("SD Card: Mounted at %lu Hz (%s, %llu MB)\n",
+                CLOCK_LADDER[step], cardTypeName(SD.cardType()),
+                SD.cardSize() / (1024 * 1024));
+  _available = true;
+  _suspect = false;
+  _mountGeneration++;
+  _cardGeneration++;
+  return true;
+}
 
-  for (int i = 0; i < 3; i++) {
-    Serial.printf("SD: Trying frequency %lu Hz...\n", frequencies[i]);
+bool SDManager::mountMMC() {
+#if SD_HAS_SDMMC
+  // 1-bit bus on the SPI wiring: SCK is CLK, MOSI is CMD, MISO is D0. The
+  // board does not route D1/D2, so 4-bit mode is not available.
+  if (!SD_MMC.setPins(SD_SCK, SD_MOSI, SD_MISO)) {
+    Serial.println("SD Card: SDMMC pins rejected");
+    _available = false;
+    return false;
+  }
+  for (int step = _mmcStep; step >= 0; step--) {
+    Serial.printf("SD: Trying SDMMC at %d kHz...\n", MMC_LADDER_KHZ[step]);
+    if (SD_MMC.begin("/sdcard", true, false, MMC_LADDER_KHZ[step]) &&
+        SD_MMC.cardType() != CARD_NONE) {
+      _mmcStep = step;
+      activeFS = &SD_MMC;
+      Serial.printf("SD Card: Mounted over SDMMC at %d kHz (%s, %llu MB)\n",
+                    MMC_LADDER_KHZ[step], cardTypeName(SD_MMC.cardType()),
+                    SD_MMC.cardSize() / (1024 * 1024));
+      _available = true;
+      _suspect = false;
+      _mountGeneration++;
+      _cardGeneration++;
+      return true;
+    }
+    SD_MMC.end();
+    delay(20);
+  }
+  Serial.println("SD Card: SDMMC mount failed at all frequencies");
+#endif
+  _available = false;
+  return false;
+}
 
-    if (SD.begin(SD_CS, sdSPI, frequencies[i])) {
-      uint8_t cardType = SD.cardType();
-      if (cardType != CARD_NONE) {
-        Serial.printf("SD Card: Mounted at %lu Hz!\n", frequencies[i]);
+void SDManager::stepDownClock() {
+  if (_backend == SDBackend::SDMMC) {
+    // Not persisted: the next boot tries the fastest host clock again
+    if (_mmcStep > 0)
+      _mmcStep--;
+    return;
+  }
+  if (_clockStep == 0)
+    return;
+  _clockStep--;
+  Serial.printf("SD: Dropping clock to %lu Hz\n", CLOCK_LADDER[_clockStep]);
+  saveClock();
+}
 
-        Serial.print("SD Card Type: ");
-        if (cardType == CARD_MMC) {
-          Serial.println("MMC");
-        } else if (cardType == CARD_SD) {
-          Serial.println("SDSC");
-        } else if (cardType == CARD_SDHC) {
-          Serial.println("SDHC");
-        } else {
-          Serial.println("UNKNOWN");
-        }
+uint32_t SDManager::getFrequency() const {
+  if (!_available)
+    return 0;
+  return _backend == SDBackend::SDMMC ? MMC_LADDER_KHZ[_mmcStep] * 1000UL
+                                      : CLOCK_LADDER[_clockStep];
+}
 
-        uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-        Serial.printf("SD Card Size: %lluMB\n", cardSize);
+bool SDManager::hasSdmmc() { return SD_HAS_SDMMC; }
 
-        _available = true;
-        return true;
-      }
-    }
+const char *SDManager::backendName(SDBackend backend) {
+  return backend == SDBackend::SDMMC ? "SDMMC" : "SPI";
+}
+
+bool SDManager::init() {
+  Serial.printf("SD SPI Pins: SCK=%d, MISO=%d, MOSI=%d, CS=%d\n", SD_SCK,
+                SD_MISO, SD_MOSI, SD_CS);
 
-    SD.end(); // Clean up before retry
-    delay(100);
+  // A backend picked on the diagnostics screen overrides the build default
+  Preferences prefs;
+  if (prefs.begin(CLOCK_NS, true)) {
+    _backend = (SDBackend)prefs.getUChar("backend", (uint8_t)DEFAULT_BACKEND);
+    prefs.end();
   }
+  if (_backend == SDBackend::SDMMC && !hasSdmmc())
+    _backend = SDBackend::SPI;
 
-  Serial.println("SD Card: Mount failed at all frequencies");
-  _available = false;
-  return false;
+  Serial.printf("SD: Using %s backend\n", backendName(_backend));
+  setCardPower(true); // Off if it was idle when the panel went to sleep
+  bool ok = mount();
+
+  // Wiring or card that will not do SDMMC: SPI always works on these pins
+  if (!ok && _backend == SDBackend::SDMMC) {
+    _backend = SDBackend::SPI;
+    ok = mount();
+  }
+  _lastAccess = millis();
+  trackPower();
+  return ok;
 }
 
-bool SDManager::powerCycleAndReinit() {
-  // Hardcoded pins from M5Paper S3 documentation
-  const int8_t SD_SCK = 39;
-  const int8_t SD_MISO = 40;
-  const int8_t SD_MOSI = 38;
-  const int8_t SD_CS = 47;
+bool SDManager::setBackend(SDBackend backend) {
+  if (backend == SDBackend::SDMMC && !hasSdmmc())
+    return false;
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (backend == _backend && _available) {
+    xSemaphoreGiveRecursive(_lock);
+    return true;
+  }
 
-  Serial.println("=== SD Power Cycle START ===");
+  SDBackend previous = _backend;
+  M5.Display.waitDisplay();
+  if (_asleep) {
+    setCardPower(true);
+    _asleep = false;
+    delay(POWER_UP_MS);
+  }
+  _mountGeneration++; // Open files belong to the old backend
+  unmount();
+  _backend = backend;
+  bool ok = mount();
+  if (!ok) {
+    Serial.printf("SD: %s mount failed, back to %s\n", backendName(backend),
+                  backendName(previous));
+    unmount();
+    _backend = previous;
+    mount();
+  } else {
+    Preferences prefs;
+    if (prefs.begin(CLOCK_NS, false)) {
+      prefs.putUChar("backend", (uint8_t)_backend);
+      prefs.end();
+    }
+  }
+  trackPower();
+  xSemaphoreGiveRecursive(_lock);
+  return ok;
+}
 
-  // Step 1: Unmount SD card
-  Serial.println("[1/6] Unmounting SD card...");
-  SD.end();
-  _available = false;
-  delay(50);
+bool SDManager::beginAccess() {
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (_accessDepth++ == 0)
+    trackPower();
+
+  // The card misbehaves when it is driven while the EPD is still updating:
+  // let the panel finish first instead of resetting the card afterwards
+  M5.Display.waitDisplay();
+
+  if (_asleep && powerUp())
+    return true;
+  if (_available && !_suspect)
+    return true;
+  return recover();
+}
 
-  // Step 2: Cut power to SD card (and other peripherals)
-  Serial.println("[2/6] Cutting external power (setExtOutput=false)...");
-  M5.Power.setExtOutput(false);
-  delay(300); // Hold power off for 300ms (reduced from 500ms)
+void SDManager::endAccess(bool ok) {
+  if (!ok)
+    reportError();
+  if (--_accessDepth == 0) {
+    _lastAccess = millis();
+    trackPower(); // Mounted or not, as the access left it
+  }
+  xSemaphoreGiveRecursive(_lock);
+}
 
-  // Step 3: Restore power
-  Serial.println("[3/6] Restoring external power (setExtOutput=true)...");
-  M5.Power.setExtOutput(true);
-  delay(300); // Wait for SD card to stabilize (reduced from 500ms)
+void SDManager::setCardPower(bool on) {
+#ifdef SD_POWER_PIN
+  // A switch in the card's supply alone, active high
+  pinMode(SD_POWER_PIN, OUTPUT);
+  digitalWrite(SD_POWER_PIN, on ? HIGH : LOW);
+#else
+  // The external rail; see powerCycleAndReinit() for what else is on it.
+  // M5Unified has no PaperS3 case for it, so there this leaves the card
+  // powered
+  M5.Power.setExtOutput(on);
+#endif
+}
 
-  // Step 4: Reset SPI bus
-  Serial.println("[4/6] Resetting SPI bus...");
+void SDManager::powerDown() {
+  LoopMonitor::tag("sd power down");
+  _mountGeneration++; // Open files die with the card
+  unmount();
   sdSPI.end();
-  delay(50);
 
-  // Configure CS pin
-  pinMode(SD_CS, OUTPUT);
-  digitalWrite(SD_CS, HIGH);
-  delay(100);
+  // Driven pins would feed the card through its protection diodes
+  const int8_t pins[] = {SD_SCK, SD_MISO, SD_MOSI, SD_CS};
+  for (int8_t pin : pins)
+    pinMode(pin, INPUT);
+  setCardPower(false);
+  _asleep = true;
+  _sleeps++;
+  trackPower();
+  LOG_D("SD", "Idle %lu s, card off", (unsigned long)SD_IDLE_OFF_SECS);
+}
 
-  // Send dummy clocks to put card in SPI mode
-  sdSPI.begin(SD_SCK, SD_MISO, SD_MOSI, -1);
-  sdSPI.beginTransaction(SPISettings(400000, MSBFIRST, SPI_MODE0));
-  for (int i = 0; i < 10; i++) {
-    sdSPI.transfer(0xFF);
+bool SDManager::powerUp() {
+  LoopMonitor::tag("sd power up");
+  unsigned long start = millis();
+  setCardPower(true);
+  _asleep = false;
+  delay(POWER_UP_MS);
+
+  // Same card as before it went off: the stored clock mounts it first try,
+  // and what was missing on it is still missing
+  uint32_t key = _cardKey;
+  uint32_t card = _cardGeneration;
+  if (!mount()) {
+    Serial.println("SD: Card did not come back on, recovering...");
+    return false; // beginAccess() goes on to recover()
   }
-  sdSPI.endTransaction();
-  delay(10);
+  if (_cardKey == key)
+    _cardGeneration = card;
+  LOG_D("SD", "Card on, mounted in %lu ms", millis() - start);
+  return true;
+}
 
-  // Step 5: Reinitialize SD card
-  Serial.println("[5/6] Reinitializing SD card...");
-  uint32_t frequencies[] = {1000000, 4000000, 10000000};
-
-  for (int i = 0; i < 3; i++) {
-    Serial.printf("  Trying frequency %lu Hz...\n", frequencies[i]);
-
-    if (SD.begin(SD_CS, sdSPI, frequencies[i])) {
-      uint8_t cardType = SD.cardType();
-      if (cardType != CARD_NONE) {
-        Serial.printf("[6/6] SUCCESS! SD mounted at %lu Hz\n", frequencies[i]);
-        Serial.printf("  Card Type: %s\n", cardType == CARD_MMC    ? "MMC"
-                                           : cardType == CARD_SD   ? "SDSC"
-                                           : cardType == CARD_SDHC ? "SDHC"
-                                                                   : "UNKNOWN");
-        Serial.printf("  Card Size: %llu MB\n", SD.cardSize() / (1024 * 1024));
-        Serial.println("=== SD Power Cycle END (SUCCESS) ===");
-        _available = true;
-        return true;
-      }
+bool SDManager::recover() {
+  LoopMonitor::tag("sd recovery");
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  bool ok = false;
+
+  // 1. Still answering? A raw sector read goes past the FAT cache (SPI
+  // only: the SDMMC driver has no raw access, so it goes straight to a
+  // remount)
+  if (_available && _backend == SDBackend::SPI) {
+    uint8_t sector[512];
+    if (SD.readRAW(sector, 0)) {
+      _suspect = false;
+      ok = true;
     }
+  }
 
-    SD.end();
-    delay(50);
+  // 2. Remount without cutting power, one clock step slower (the next
+  // mount starts there); open files become invalid
+  if (!ok) {
+    Serial.println("SD: Card not responding, remounting...");
+    stepDownClock();
+    _mountGeneration++;
+    unmount();
+    ok = mount();
   }
 
-  Serial.println("[6/6] FAILED - SD mount failed at all frequencies");
-  Serial.println("=== SD Power Cycle END (FAILED) ===");
-  _available = false;
-  return false;
+  // 3. Last resort: the power-cycle reset trick
+  if (!ok)
+    ok = powerCycleAndReinit();
+
+  trackPower();
+  xSemaphoreGiveRecursive(_lock);
+  return ok;
+}
+
+bool SDManager::powerCycleAndReinit() {
+  LoopMonitor::tag("sd power cycle");
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  Serial.println("=== SD Power Cycle START ===");
+  _mountGeneration++; // Unmounting invalidates every open file
+
+  unmount();
+  delay(50);
+
+  // Cut power to SD card (and other peripherals on the rail)
+  setCardPower(false);
+  delay(300);
+  setCardPower(true);
+  _asleep = false;
+  delay(300); // Wait for SD card to stabilize
+
+  bool ok = mount();
+  Serial.printf("=== SD Power Cycle END (%s) ===\n", ok ? "SUCCESS" : "FAILED");
+  trackPower();
+  xSemaphoreGiveRecursive(_lock);
+  return ok;
 }
 
 bool SDManager::ensureDirectory(const char *path) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return false;
 
-  if (SD.exists(path)) {
+  if (sdFS().exists(path)) {
     return true;
   }
 
-  return SD.mkdir(path);
+  return sdFS().mkdir(path);
 }
 
 String SDManager::readFile(const char *path) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return "";
 
-  File file = SD.open(path, FILE_READ);
+  File file = sdFS().open(path, FILE_READ);
   if (!file) {
     Serial.printf("Failed to open file: %s\n", path);
     return "";
@@ -192,56 +577,71 @@ String SDManager::readFile(const char *path) {
 }
 
 bool SDManager::writeFile(const char *path, const String &content) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return false;
 
-  File file = SD.open(path, FILE_WRITE);
+  File file = sdFS().open(path, FILE_WRITE);
   if (!file) {
     Serial.printf("Failed to open file for writing: %s\n", path);
+    access.fail();
     return false;
   }
 
   size_t written = file.print(content);
   file.close();
 
-  return written == content.length();
+  if (written != content.length()) {
+    access.fail();
+    return false;
+  }
+  return true;
 }
 
 bool SDManager::appendFile(const char *path, const String &content) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return false;
 
-  File file = SD.open(path, FILE_APPEND);
+  File file = sdFS().open(path, FILE_APPEND);
   if (!file) {
     Serial.printf("Failed to open file for appending: %s\n", path);
+    access.fail();
     return false;
   }
 
   size_t written = file.print(content);
   file.close();
 
-  return written == content.length();
+  if (written != content.length()) {
+    access.fail();
+    return false;
+  }
+  return true;
 }
 
 bool SDManager::fileExists(const char *path) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return false;
-  return SD.exists(path);
+  return sdFS().exists(path);
 }
 
 bool SDManager::deleteFile(const char *path) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return false;
-  return SD.remove(path);
+  return sdFS().remove(path);
 }
 
 int SDManager::listFiles(const char *dirPath, std::vector<String> &files,
                          const char *extensions) {
   files.clear();
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return 0;
 
-  File root = SD.open(dirPath);
+  File root = sdFS().open(dirPath);
   if (!root || !root.isDirectory()) {
     Serial.printf("Failed to open directory: %s\n", dirPath);
     return 0;
@@ -301,16 +701,25 @@ bool SDManager::matchesExtension(const String &filename,
 SDManager::SDCardInfo SDManager::getCardInfo() {
   SDCardInfo info = {0, 0, "Unknown"};
 
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return info;
 
   // Get storage info
-  info.totalBytes = SD.totalBytes();
-  info.usedBytes = SD.usedBytes();
+#if SD_HAS_SDMMC
+  if (_backend == SDBackend::SDMMC) {
+    info.totalBytes = SD_MMC.totalBytes();
+    info.usedBytes = SD_MMC.usedBytes();
+  } else
+#endif
+  {
+    info.totalBytes = SD.totalBytes();
+    info.usedBytes = SD.usedBytes();
+  }
 
   // Get card type
-  uint8_t cardType = SD.cardType();
-  switch (cardType) {
+  uint8_t type = cardType();
+  switch (type) {
   case CARD_MMC:
     info.type = "MMC";
     break;
@@ -329,13 +738,15 @@ SDManager::SDCardInfo SDManager::getCardInfo() {
 }
 
 bool SDManager::runBenchmark(float &writeSpeedMBps, float &readSpeedMBps) {
-  if (!_available)
+  SDAccess access(this);
+  if (!access)
     return false;
 
   const char *testFile = "/diag_test.bin";
   const int bufSize = 32 * 1024;     // 32KB buffer
   const int totalSize = 1024 * 1024; // 1MB test
-  uint8_t *buf = (uint8_t *)malloc(bufSize);
+  BufferPool::Buffer block(bufSize, MemTelemetry::Tag::STORAGE);
+  uint8_t *buf = block.get();
 
   if (!buf) {
     Serial.println("SDManager: Benchmark failed - Out of RAM");
@@ -348,12 +759,11 @@ bool SDManager::runBenchmark(float &writeSpeedMBps, float &readSpeedMBps) {
 
   // --- Write Test ---
   // Ensure fresh file
-  if (SD.exists(testFile))
-    SD.remove(testFile);
+  if (sdFS().exists(testFile))
+    sdFS().remove(testFile);
 
-  File file = SD.open(testFile, FILE_WRITE);
+  File file = sdFS().open(testFile, FILE_WRITE);
   if (!file) {
-    free(buf);
     return false;
   }
 
@@ -361,8 +771,7 @@ bool SDManager::runBenchmark(float &writeSpeedMBps, float &readSpeedMBps) {
   for (int i = 0; i < totalSize / bufSize; i++) {
     if (file.write(buf, bufSize) != bufSize) {
       file.close();
-      free(buf);
-      SD.remove(testFile);
+      sdFS().remove(testFile);
       return false;
     }
   }
@@ -370,10 +779,9 @@ bool SDManager::runBenchmark(float &writeSpeedMBps, float &readSpeedMBps) {
   unsigned long writeTime = millis() - startT;
 
   // --- Read Test ---
-  file = SD.open(testFile, FILE_READ);
+  file = sdFS().open(testFile, FILE_READ);
   if (!file) {
-    free(buf);
-    SD.remove(testFile);
+    sdFS().remove(testFile);
     return false;
   }
 
@@ -381,8 +789,7 @@ bool SDManager::runBenchmark(float &writeSpeedMBps, float &readSpeedMBps) {
   for (int i = 0; i < totalSize / bufSize; i++) {
     if (file.read(buf, bufSize) != bufSize) {
       file.close();
-      free(buf);
-      SD.remove(testFile);
+      sdFS().remove(testFile);
       return false;
     }
   }
@@ -390,16 +797,198 @@ bool SDManager::runBenchmark(float &writeSpeedMBps, float &readSpeedMBps) {
   unsigned long readTime = millis() - startT;
 
   // Cleanup
-  SD.remove(testFile);
-  free(buf);
+  sdFS().remove(testFile);
 
   // Calculate speeds (MB/s)
   // Time is in ms. 1MB / (time/1000) = 1000 / time
   writeSpeedMBps = 1000.0f / (float)writeTime;
   readSpeedMBps = 1000.0f / (float)readTime;
 
-  Serial.printf("SD Benchmark: Write %.2f MB/s, Read %.2f MB/s\n",
-                writeSpeedMBps, readSpeedMBps);
+  Serial.printf("SD Benchmark (%s): Write %.2f MB/s, Read %.2f MB/s\n",
+                backendName(_backend), writeSpeedMBps, readSpeedMBps);
 
   return true;
 }
+
+// ============================================================================
+// Deferred writes
+// ============================================================================
+
+SDManager::Deferred *SDManager::findDeferred(const char *path, bool append) {
+  for (Deferred &entry : _deferred) {
+    if (entry.append == append && entry.path == path)
+      return &entry;
+  }
+  Deferred entry = {path, append, false, nullptr, 0, 0};
+  _deferred.push_back(entry);
+  return &_deferred.back();
+}
+
+bool SDManager::reserveDeferred(Deferred &entry, size_t len) {
+  if (len <= entry.cap)
+    return true;
+  size_t cap = entry.cap ? entry.cap : 256;
+  while (cap < len)
+    cap *= 2;
+  uint8_t *data = (uint8_t *)heap_caps_realloc(entry.data, cap,
+                                               MALLOC_CAP_SPIRAM);
+  if (!data)
+    data = (uint8_t *)realloc(entry.data, cap);
+  if (!data)
+    return false;
+  entry.data = data;
+  entry.cap = cap;
+  return true;
+}
+
+bool SDManager::deferWrite(const char *path, const uint8_t *data, size_t len,
+                           bool atomic) {
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (_deferred.empty())
+    _deferSince = millis();
+  Deferred *entry = findDeferred(path, false);
+  bool ok = reserveDeferred(*entry, len ? len : 1);
+  if (ok) {
+    _deferredBytes = _deferredBytes - entry->len + len;
+    memcpy(entry->data, data, len);
+    entry->len = len;
+    entry->atomic = atomic;
+  } else if (!entry->len) {
+    _deferred.erase(_deferred.begin() + (entry - _deferred.data()));
+  }
+  if (!_deferIntervalMs || _deferredBytes > MAX_DEFERRED_BYTES)
+    flushDeferred();
+  xSemaphoreGiveRecursive(_lock);
+  return ok;
+}
+
+bool SDManager::deferAppend(const char *path, const uint8_t *data,
+                            size_t len) {
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  if (_deferred.empty())
+    _deferSince = millis();
+  Deferred *entry = findDeferred(path, true);
+  bool ok = reserveDeferred(*entry, entry->len + len);
+  if (ok) {
+    memcpy(entry->data + entry->len, data, len);
+    entry->len += len;
+    _deferredBytes += len;
+  } else if (!entry->len) {
+    _deferred.erase(_deferred.begin() + (entry - _deferred.data()));
+    xSemaphoreGiveRecursive(_lock);
+    return false;
+  }
+  if (!_deferIntervalMs || _deferredBytes > MAX_DEFERRED_BYTES)
+    flushDeferred();
+  else if (entry->len >= APPEND_BLOCK)
+    flushEntry(*entry, false); // Whole blocks now, the tail later
+  xSemaphoreGiveRecursive(_lock);
+  return ok;
+}
+
+const uint8_t *SDManager::peekDeferred(const char *path, size_t &len) const {
+  for (const Deferred &entry : _deferred) {
+    if (!entry.append && entry.path == path) {
+      len = entry.len;
+      return entry.data;
+    }
+  }
+  return nullptr;
+}
+
+bool SDManager::flushEntry(Deferred &entry, bool all) {
+  SDAccess access(this);
+  if (!access)
+    return false;
+
+  if (entry.append) {
+    File file = sdFS().open(entry.path.c_str(), FILE_APPEND);
+    if (!file) {
+      access.fail();
+      return false;
+    }
+    // Stop on a block boundary of the file so the next flush starts on one
+    size_t n = entry.len;
+    if (!all) {
+      size_t end = (file.size() + entry.len) / APPEND_BLOCK * APPEND_BLOCK;
+      n = end > file.size() ? end - file.size() : 0;
+    }
+    size_t written = n ? file.write(entry.data, n) : 0;
+    file.close();
+    memmove(entry.data, entry.data + written, entry.len - written);
+    entry.len -= written;
+    _deferredBytes -= written;
+    if (written != n) {
+      access.fail();
+      return false;
+    }
+    return true;
+  }
+
+  String target = entry.atomic ? entry.path + ".tmp" : entry.path;
+  File file = sdFS().open(target.c_str(), FILE_WRITE);
+  if (!file) {
+    access.fail();
+    return false;
+  }
+  bool ok = file.write(entry.data, entry.len) == entry.len;
+  file.close();
+  if (ok && entry.atomic) {
+    sdFS().remove(entry.path.c_str()); // FAT cannot rename over a file
+    ok = sdFS().rename(target.c_str(), entry.path.c_str());
+  }
+  if (!ok) {
+    access.fail();
+    return false;
+  }
+  _deferredBytes -= entry.len;
+  entry.len = 0;
+  return true;
+}
+
+bool SDManager::flushDeferred() {
+  xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+  bool ok = true;
+  for (size_t i = 0; i < _deferred.size();) {
+    Deferred &entry = _deferred[i];
+    if (flushEntry(entry, true) && entry.len == 0) {
+      free(entry.data);
+      _deferred.erase(_deferred.begin() + i);
+    } else {
+      Serial.printf("SD: Deferred write to %s failed\n", entry.path.c_str());
+      ok = false;
+      i++;
+    }
+  }
+  _deferSince = millis(); // Failed entries wait another interval
+  xSemaphoreGiveRecursive(_lock);
+  return ok;
+}
+
+void SDManager::setDeferInterval(uint32_t seconds) {
+  _deferIntervalMs = seconds * 1000;
+  if (!seconds && !_deferred.empty())
+    flushDeferred();
+}
+
+void SDManager::service() {
+  // A card that is off waits longer, or for whatever wakes it
+  uint32_t interval = _deferIntervalMs;
+  if (_asleep && interval < ASLEEP_DEFER_SECS * 1000)
+    interval = ASLEEP_DEFER_SECS * 1000;
+  if (!_deferred.empty() && millis() - _deferSince >= interval)
+    flushDeferred();
+
+  if (!SD_IDLE_OFF_SECS || !_available || _accessDepth ||
+      millis() - _lastAccess < SD_IDLE_OFF_SECS * 1000UL)
+    return;
+  // Not while another task is on the card
+  if (xSemaphoreTakeRecursive(_lock, 0) != pdTRUE)
+    return;
+  // Pending writes go out now rather than waking the card again later
+  if (_accessDepth == 0 && (_deferred.empty() || flushDeferred()))
+    powerDown();
+  else
+    _lastAccess = millis(); // Try again after another idle timeout
+  xSemaphoreGiveRecursive(_lock);
+}
@@ -1,7 +1,17 @@
 /**
  * SD Card Manager
  *
- * Handles SD card initialization and common file operations.
+ * Handles SD card initialization and common file operations. The card
+ * stays mounted between operations: wrap each one in an SDAccess, which
+ * serializes storage users, waits for the EPD to go idle and remounts only
+ * after an operation has reported an error.
+ *
+ * After SD_IDLE_OFF_SECS without an access (build flag, default 120; 0
+ * keeps it on) service() writes out what is deferred, unmounts and cuts
+ * the card's power. The next SDAccess powers it up and mounts it again,
+ * at the clock stored for the card, before the operation goes ahead. The
+ * PaperS3 has no switch in the card's supply, so unless SD_POWER_PIN names
+ * one the card is only unmounted and the energy model keeps it at idle.
  */
 
 #ifndef SD_MANAGER_H
@@ -12,8 +22,26 @@
 #undef max
 #include <FS.h>
 #include <SD.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <vector>
 
+#ifndef SD_IDLE_OFF_SECS
+#define SD_IDLE_OFF_SECS 120
+#endif
+
+/**
+ * Host interface to the card. Both drive the same four pins; SDMMC runs the
+ * ESP32-S3 SD host in 1-bit mode with its own DMA.
+ */
+enum class SDBackend : uint8_t { SPI, SDMMC };
+
+/**
+ * Filesystem of the active backend. Use this, never SD or SD_MMC directly,
+ * for every path operation (open, exists, mkdir, remove).
+ */
+fs::FS &sdFS();
+
 class SDManager {
 public:
   SDManager();
@@ -26,16 +54,82 @@ public:
   bool init();
 
   /**
-   * Power cycle the SD card and reinitialize
-   * Use before critical read/write operations to avoid SPI conflicts
+   * Start a storage operation (prefer SDAccess): takes the storage lock,
+   * waits for the display to finish updating and recovers the card if the
+   * previous operation failed. Always pair with endAccess().
+   * @return true if the card is mounted and usable
+   */
+  bool beginAccess();
+
+  /**
+   * Finish a storage operation
+   * @param ok false if an open/read/write failed, so the next access
+   *           probes the card first
+   */
+  void endAccess(bool ok = true);
+
+  /**
+   * Mark the card suspect after a failed operation
+   */
+  void reportError() { _suspect = true; }
+
+  /**
+   * Bring the card back: probe it with a raw sector read, then remount,
+   * and power cycle only if both fail
+   * @return true if the card is usable
+   */
+  bool recover();
+
+  /**
+   * Power cycle the SD card and reinitialize (the "reset trick"). Also cuts
+   * power to everything else on the external rail; recover() calls this
+   * only as a last resort.
    * @return true if reinitialization successful
    */
   bool powerCycleAndReinit();
 
   /**
-   * Check if SD card is available
+   * Check if SD card is available: mounted, or switched off while idle
+   * (the next access mounts it)
+   */
+  bool isAvailable() const { return _available || _asleep; }
+
+  /**
+   * The card is switched off while idle
+   */
+  bool isAsleep() const { return _asleep; }
+  uint32_t getSleepCount() const { return _sleeps; }
+
+  /**
+   * SPI clock the card is mounted at (0 if unmounted). The fastest clock
+   * that reads back verified data is stored per card in NVS and used
+   * first on the next mount; I/O errors step it down.
+   */
+  uint32_t getFrequency() const;
+
+  /**
+   * Switch the host interface and remount; the choice is stored in NVS and
+   * overrides the build default (-DSD_USE_SDMMC) on the next boot. Falls
+   * back to the previous backend if the card does not mount.
+   * @return true if the card is mounted on the requested backend
+   */
+  bool setBackend(SDBackend backend);
+  SDBackend getBackend() const { return _backend; }
+  static bool hasSdmmc(); // Built for a chip with an SD host
+  static const char *backendName(SDBackend backend);
+
+  /**
+   * Incremented on every (re)mount; open File handles from an older
+   * generation are invalid
+   */
+  uint32_t getMountGeneration() const { return _mountGeneration; }
+
+  /**
+   * Incremented on every mount that may have found another card: not when
+   * the card comes back from an idle power-off. A file that was missing is
+   * still missing until this changes.
    */
-  bool isAvailable() const { return _available; }
+  uint32_t getCardGeneration() const { return _cardGeneration; }
 
   /**
    * Ensure a directory exists (creates if needed)
@@ -116,10 +210,129 @@ public:
   int listFiles(const char *dirPath, std::vector<String> &files,
                 const char *extensions = nullptr);
 
+  // --- Deferred writes ---
+  // Write-back cache for frequent, non-critical saves, used from the loop
+  // task. The card sees one write per path per interval instead of one per
+  // change; reads of a pending file should check peekDeferred() first.
+
+  static const uint32_t DEFER_INTERVAL_SECS = 60;
+  static const size_t APPEND_BLOCK = 4096;         // Append flush granularity
+  static const size_t MAX_DEFERRED_BYTES = 65536;  // Flush early past this
+  static const uint32_t ASLEEP_DEFER_SECS = 600;   // Interval while off
+
+  /**
+   * Replace the whole file at the next flush; a later call for the same
+   * path supersedes the pending data. atomic writes go through
+   * <path>.tmp and a rename.
+   */
+  bool deferWrite(const char *path, const uint8_t *data, size_t len,
+                  bool atomic = true);
+
+  /**
+   * Append to the file at the next flush. Appends are coalesced; once a
+   * full block is pending it is written straight away, aligned to a
+   * multiple of APPEND_BLOCK in the file, and the tail waits.
+   */
+  bool deferAppend(const char *path, const uint8_t *data, size_t len);
+
+  /**
+   * Pending replacement for path, or nullptr
+   */
+  const uint8_t *peekDeferred(const char *path, size_t &len) const;
+
+  /**
+   * Write everything pending now (before deep sleep, on low battery)
+   * @return false if any write failed (that data stays pending)
+   */
+  bool flushDeferred();
+
+  /**
+   * Flush interval in seconds; 0 writes through, flushing what is pending
+   */
+  void setDeferInterval(uint32_t seconds);
+
+  /**
+   * Flush once the oldest pending write has waited a full interval (while
+   * the card is off, ASLEEP_DEFER_SECS or the next access that wakes it),
+   * and switch the card off once it has been idle SD_IDLE_OFF_SECS. Call
+   * from the main loop.
+   */
+  void service();
+
 private:
+  struct Deferred {
+    String path;
+    bool append;
+    bool atomic;
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+  };
+  std::vector<Deferred> _deferred;
+  size_t _deferredBytes;
+  uint32_t _deferIntervalMs;
+  unsigned long _deferSince; // When the oldest pending write was queued
+
+  Deferred *findDeferred(const char *path, bool append);
+  bool reserveDeferred(Deferred &entry, size_t len);
+  bool flushEntry(Deferred &entry, bool all);
+
   bool _available;
+  bool _suspect; // An operation failed since the last successful probe
+  bool _asleep;  // Unmounted and unpowered after SD_IDLE_OFF_SECS idle
+  uint32_t _sleeps;
+  unsigned long _lastAccess; // When the last access ended
+  uint32_t _mountGeneration;
+  uint32_t _cardGeneration;
+  SemaphoreHandle_t _lock; // Recursive: helpers nest inside SDAccess
+  int _clockStep;          // Index into the clock ladder
+  uint32_t _cardKey;       // Identifies the card for the stored clock
+  SDBackend _backend;
+  int _mmcStep; // Index into the SDMMC clock ladder
+  int _accessDepth; // Nested beginAccess() calls, under _lock
 
+  bool mount();
+  bool mountAt(int step);
+  bool mountMMC();
+  void unmount();
+  void powerDown();
+  bool powerUp();
+  void setCardPower(bool on);
+  void trackPower(); // Tell the energy model what the card is doing
+  uint8_t cardType() const;
+  uint32_t readCardKey();
+  bool readReference(uint8_t *buffer);
+  int rampUp(int step, int maxStep);
+  int storedStep(uint32_t cardKey); // -1 if the card is unknown
+  void saveClock();
+  void stepDownClock();
   bool matchesExtension(const String &filename, const char *extensions);
 };
 
+/**
+ * Scoped storage operation: begins access on construction and ends it on
+ * destruction. Call fail() when an operation goes wrong.
+ */
+class SDAccess {
+public:
+  explicit SDAccess(SDManager *manager)
+      : _manager(manager), _ok(manager && manager->beginAccess()),
+        _failed(false) {}
+  ~SDAccess() {
+    if (_manager)
+      _manager->endAccess(!_failed);
+  }
+  SDAccess(const SDAccess &) = delete;
+  SDAccess &operator=(const SDAccess &) = delete;
+
+  bool ok() const { return _ok; }
+  explicit operator bool() const { return _ok; }
+  void fail() { _failed = true; }
+
+private:
+  SDManager *_manager;
+  bool _ok;
+  bool _failed;
+};
+
 #endif // SD_MANAGER_H
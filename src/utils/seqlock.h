@@ -0,0 +1,68 @@
+/**
+ * Sequence Lock
+ *
+ * Publishes a small trivially-copyable value from one writer to readers on
+ * another core without blocking the writer. The sequence number is odd
+ * while a write is in progress; a reader that sees it change during its
+ * copy discards the copy and tries again. generation() counts completed
+ * writes, so readers can skip copying when nothing new has arrived.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+template <typename T> class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock values are copied with memcpy");
+
+public:
+  static const int MAX_READ_ATTEMPTS = 4;
+
+  /**
+   * Publish a new value (single writer only)
+   */
+  void write(const T &value) {
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&_value, &value, sizeof(T));
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  /**
+   * Copy the latest value
+   * @param generation Set to the generation of the copied value
+   * @return false if every attempt raced a write (try again later)
+   */
+  bool read(T &out, uint32_t &generation) const {
+    for (int i = 0; i < MAX_READ_ATTEMPTS; i++) {
+      uint32_t before = _seq.load(std::memory_order_acquire);
+      if (before & 1)
+        continue;
+      memcpy(&out, &_value, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) == before) {
+        generation = before / 2;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Number of completed writes
+   */
+  uint32_t generation() const {
+    return _seq.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  T _value;
+  std::atomic<uint32_t> _seq{0};
+};
+
+#endif // SEQLOCK_H
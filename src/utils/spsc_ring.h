@@ -0,0 +1,61 @@
+/**
+ * Single-Producer / Single-Consumer Ring Buffer
+ *
+ * Lock-free fixed-size FIFO. Exactly one context may push and exactly one
+ * may pop; the two can run on different cores.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+
+template <typename T, size_t N> class SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  /**
+   * Append an item (producer side)
+   * @return false if the ring is full
+   */
+  bool push(const T &item) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    if (head - tail >= N)
+      return false;
+    _items[head & (N - 1)] = item;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Remove the oldest item (consumer side)
+   * @return false if the ring is empty
+   */
+  bool pop(T &item) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t head = _head.load(std::memory_order_acquire);
+    if (tail == head)
+      return false;
+    item = _items[tail & (N - 1)];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return _head.load(std::memory_order_acquire) -
+           _tail.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T _items[N];
+  std::atomic<size_t> _head{0};
+  std::atomic<size_t> _tail{0};
+};
+
+#endif // SPSC_RING_H
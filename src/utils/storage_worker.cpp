@@ -0,0 +1,306 @@
+/**
+ * Background Storage Worker Implementation
+ */
+
+#include "storage_worker.h"
+#include "mem_telemetry.h"
+#include "profiler.h"
+#include "sd_manager.h"
+#include "wake.h"
+#include <esp_heap_caps.h>
+#include <soc/soc_memory_layout.h>
+
+extern SDManager *sdManager;
+
+// The card drivers DMA only to and from internal RAM: handed a PSRAM
+// buffer, they fall back to one 512-byte sector per command. Transfers of
+// PSRAM data go through this buffer instead, a whole number of sectors at
+// a time, so each chunk is one multi-block command.
+static const size_t BOUNCE_BYTES = 16384;   // Half a typical SDHC cluster
+static const size_t BOUNCE_MIN = 2 * 512;   // Smaller goes straight through
+static uint8_t *bounce = nullptr;           // Worker task only
+
+static bool useBounce(const uint8_t *data, size_t len) {
+  if (len < BOUNCE_MIN || !esp_ptr_external_ram(data))
+    return false;
+  if (!bounce) {
+    bounce = (uint8_t *)heap_caps_malloc(BOUNCE_BYTES,
+                                         MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!bounce)
+      return false; // Slower, not wrong
+    MemTelemetry::track(MemTelemetry::Tag::STORAGE, BOUNCE_BYTES);
+  }
+  return true;
+}
+
+static size_t readBulk(File &file, uint8_t *data, size_t len) {
+  if (!useBounce(data, len))
+    return file.read(data, len);
+  size_t done = 0;
+  while (done < len) {
+    size_t n = min(len - done, BOUNCE_BYTES);
+    size_t got = file.read(bounce, n);
+    memcpy(data + done, bounce, got);
+    done += got;
+    if (got < n)
+      break;
+  }
+  return done;
+}
+
+static size_t writeBulk(File &file, const uint8_t *data, size_t len) {
+  if (!useBounce(data, len))
+    return file.write(data, len);
+  size_t done = 0;
+  while (done < len) {
+    size_t n = min(len - done, BOUNCE_BYTES);
+    memcpy(bounce, data + done, n);
+    size_t put = file.write(bounce, n);
+    done += put;
+    if (put < n)
+      break;
+  }
+  return done;
+}
+
+StorageWorker::StorageWorker()
+    : _requests(nullptr), _completed(nullptr), _task(nullptr), _pending(0) {}
+
+bool StorageWorker::begin() {
+  _requests = xQueueCreate(MAX_REQUESTS, sizeof(Request *));
+  _completed = xQueueCreate(MAX_REQUESTS, sizeof(Request *));
+  if (!_requests || !_completed) {
+    Serial.println("Storage: Queue allocation failed");
+    return false;
+  }
+
+  // Core 0 below the touch task: a long write never delays input or the UI
+  if (xTaskCreatePinnedToCore(taskEntry, "storage", TASK_STACK, this, 1,
+                              &_task, 0) != pdPASS) {
+    Serial.println("Storage: Worker task failed to start");
+    return false;
+  }
+  return true;
+}
+
+bool StorageWorker::submit(Request *request) {
+  request->ok = false;
+  request->bytes = 0;
+  if (!_task || _pending >= MAX_REQUESTS ||
+      xQueueSend(_requests, &request, 0) != pdTRUE) {
+    Serial.printf("Storage: Queue full, %s dropped\n", request->path.c_str());
+    delete request;
+    return false;
+  }
+  _pending++;
+  return true;
+}
+
+bool StorageWorker::write(const char *path, const void *head, size_t headLen,
+                          const uint8_t *data, size_t dataLen,
+                          StorageCallback done, bool freeData,
+                          bool atomic) {
+  if (headLen > MAX_HEAD)
+    return false;
+  Request *r = new Request();
+  r->op = StorageOp::WRITE;
+  r->path = path;
+  if (headLen)
+    memcpy(r->head, head, headLen);
+  r->headLen = headLen;
+  r->data = const_cast<uint8_t *>(data);
+  r->dataLen = dataLen;
+  r->ownsData = freeData; // A rejected request leaves data with the caller
+  r->atomic = atomic;
+  r->list = nullptr;
+  r->done = done;
+  return submit(r);
+}
+
+bool StorageWorker::read(const char *path, size_t headLen, size_t dataLen,
+                         StorageCallback done) {
+  if (headLen > MAX_HEAD)
+    return false;
+  Request *r = new Request();
+  r->op = StorageOp::READ;
+  r->path = path;
+  r->headLen = headLen;
+  r->data = nullptr; // Allocated by the worker
+  r->dataLen = dataLen;
+  r->ownsData = true;
+  r->atomic = false;
+  r->list = nullptr;
+  r->done = done;
+  return submit(r);
+}
+
+bool StorageWorker::readRange(const char *path, uint32_t offset, size_t len,
+                              StorageCallback done) {
+  Request *r = new Request();
+  r->op = StorageOp::READ;
+  r->path = path;
+  r->headLen = 0;
+  r->data = nullptr; // Allocated by the worker
+  r->dataLen = len;
+  r->ownsData = true;
+  r->atomic = false;
+  r->offset = offset;
+  r->list = nullptr;
+  r->done = done;
+  return submit(r);
+}
+
+bool StorageWorker::list(const char *dir, std::vector<String> *out,
+                         const char *extensions, StorageCallback done) {
+  Request *r = new Request();
+  r->op = StorageOp::LIST;
+  r->path = dir;
+  r->extensions = extensions ? extensions : "";
+  r->headLen = 0;
+  r->data = nullptr;
+  r->dataLen = 0;
+  r->ownsData = false;
+  r->atomic = false;
+  r->list = out;
+  r->done = done;
+  return submit(r);
+}
+
+bool StorageWorker::remove(const char *path, StorageCallback done) {
+  Request *r = new Request();
+  r->op = StorageOp::REMOVE;
+  r->path = path;
+  r->headLen = 0;
+  r->data = nullptr;
+  r->dataLen = 0;
+  r->ownsData = false;
+  r->atomic = false;
+  r->list = nullptr;
+  r->done = done;
+  return submit(r);
+}
+
+bool StorageWorker::run(const char *path, StorageJob job,
+                        StorageCallback done) {
+  Request *r = new Request();
+  r->op = StorageOp::JOB;
+  r->path = path;
+  r->headLen = 0;
+  r->data = nullptr;
+  r->dataLen = 0;
+  r->ownsData = false;
+  r->atomic = false;
+  r->list = nullptr;
+  r->job = job;
+  r->done = done;
+  return submit(r);
+}
+
+void StorageWorker::taskEntry(void *arg) {
+  StorageWorker *self = static_cast<StorageWorker *>(arg);
+  Request *request;
+  for (;;) {
+    if (xQueueReceive(self->_requests, &request, portMAX_DELAY) != pdTRUE)
+      continue;
+    {
+      PROFILE_ZONE(SD_OPS);
+      self->execute(*request);
+    }
+    xQueueSend(self->_completed, &request, portMAX_DELAY);
+    Wake::signal(Wake::STORAGE); // Main loop runs the completion
+  }
+}
+
+void StorageWorker::execute(Request &r) {
+  SDAccess sd(sdManager);
+  if (!sd)
+    return;
+
+  switch (r.op) {
+  case StorageOp::WRITE: {
+    String target = r.atomic ? r.path + ".tmp" : r.path;
+    File file = sdFS().open(target, FILE_WRITE);
+    if (!file)
+      break;
+    r.bytes = file.write(r.head, r.headLen);
+    if (r.dataLen)
+      r.bytes += writeBulk(file, r.data, r.dataLen);
+    file.close();
+    r.ok = r.bytes == r.headLen + r.dataLen;
+    if (r.ok && r.atomic) {
+      // FAT cannot rename over a file; readers fall back to the temp file
+      sdFS().remove(r.path.c_str());
+      r.ok = sdFS().rename(target.c_str(), r.path.c_str());
+    }
+    break;
+  }
+
+  case StorageOp::READ: {
+    File file = sdFS().open(r.path, FILE_READ);
+    if (!file)
+      return; // Missing file
+    if (r.dataLen == REST && file.size() >= r.headLen)
+      r.dataLen = file.size() - r.headLen;
+    bool fits = r.offset ? file.size() >= r.offset + r.dataLen &&
+                               file.seek(r.offset)
+                         : file.size() == r.headLen + r.dataLen;
+    if (!fits) {
+      file.close();
+      return; // Not an I/O error: the file is not what the caller expects
+    }
+    r.data = (uint8_t *)heap_caps_malloc(r.dataLen ? r.dataLen : 1,
+                                         MALLOC_CAP_SPIRAM);
+    if (!r.data)
+      r.data = (uint8_t *)malloc(r.dataLen ? r.dataLen : 1);
+    if (!r.data) {
+      file.close();
+      return;
+    }
+    r.bytes = file.read(r.head, r.headLen);
+    r.bytes += readBulk(file, r.data, r.dataLen);
+    file.close();
+    r.ok = r.bytes == r.headLen + r.dataLen;
+    break;
+  }
+
+  case StorageOp::LIST:
+    r.bytes = sdManager->listFiles(r.path.c_str(), *r.list,
+                                   r.extensions.length() ? r.extensions.c_str()
+                                                         : nullptr);
+    r.ok = true;
+    return;
+
+  case StorageOp::REMOVE:
+    r.ok = sdFS().remove(r.path.c_str());
+    if (!r.ok && !sdFS().exists(r.path.c_str()))
+      return; // Already gone
+    break;
+
+  case StorageOp::JOB:
+    r.ok = r.job(r.bytes);
+    return; // The job reports its own card errors
+  }
+
+  if (!r.ok)
+    sd.fail();
+}
+
+void StorageWorker::service() {
+  if (!_completed)
+    return;
+  Request *r;
+  while (xQueueReceive(_completed, &r, 0) == pdTRUE) {
+    _pending--;
+    if (!r->ok)
+      Serial.printf("Storage: Request for %s failed\n", r->path.c_str());
+    if (r->done) {
+      StorageResult result = {r->op,     r->ok,      r->path.c_str(),
+                              r->bytes,  r->head,    r->headLen,
+                              r->data,   r->dataLen};
+      r->done(result);
+    }
+    if (r->ownsData)
+      free(r->data);
+    delete r;
+  }
+}
@@ -0,0 +1,130 @@
+/**
+ * Background Storage Worker
+ *
+ * Runs SD reads and writes on a low-priority task so the UI keeps drawing
+ * and taking touches while a large file streams to or from the card.
+ * Requests are queued from the loop task; each one runs under SDAccess (so
+ * it is serialized with synchronous storage users) and its completion
+ * callback runs from service(), on the loop task, never from the worker.
+ */
+
+#ifndef STORAGE_WORKER_H
+#define STORAGE_WORKER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <functional>
+#include <vector>
+
+enum class StorageOp { WRITE, READ, LIST, REMOVE, JOB };
+
+struct StorageResult {
+  StorageOp op;
+  bool ok;
+  const char *path;
+  size_t bytes; // Bytes written or read, entries listed
+  // READ only, valid for the duration of the callback
+  const uint8_t *head;
+  size_t headLen;
+  const uint8_t *data;
+  size_t dataLen;
+};
+
+using StorageCallback = std::function<void(const StorageResult &result)>;
+
+// Runs on the worker under SDAccess; sets bytes and returns success
+using StorageJob = std::function<bool(size_t &bytes)>;
+
+class StorageWorker {
+public:
+  static const int MAX_REQUESTS = 8;
+  static const size_t MAX_HEAD = 16;
+  static const uint32_t TASK_STACK = 6144;
+  static const size_t REST = (size_t)-1; // read(): whatever follows the head
+
+  StorageWorker();
+
+  /**
+   * Start the worker task
+   */
+  bool begin();
+
+  /**
+   * Write head (copied, up to MAX_HEAD bytes) followed by data to path,
+   * replacing the file. data must stay valid until the callback unless
+   * freeData is set, in which case the worker frees it. With atomic set
+   * the file is written as <path>.tmp and renamed over path once complete.
+   * @return false if the queue is full (data is then not freed)
+   */
+  bool write(const char *path, const void *head, size_t headLen,
+             const uint8_t *data, size_t dataLen, StorageCallback done,
+             bool freeData = false, bool atomic = false);
+
+  /**
+   * Read a file that must be exactly headLen + dataLen bytes, or any size
+   * from headLen up with dataLen REST. Both parts are read into buffers the
+   * worker allocates (data in PSRAM) and frees after the callback.
+   */
+  bool read(const char *path, size_t headLen, size_t dataLen,
+            StorageCallback done);
+
+  /**
+   * Read len bytes at offset from a file of at least offset + len bytes
+   * (one record out of a container file), as data
+   */
+  bool readRange(const char *path, uint32_t offset, size_t len,
+                 StorageCallback done);
+
+  /**
+   * List the files in dir (see SDManager::listFiles). out must stay valid
+   * and untouched until the callback.
+   */
+  bool list(const char *dir, std::vector<String> *out,
+            const char *extensions, StorageCallback done);
+
+  bool remove(const char *path, StorageCallback done);
+
+  /**
+   * Run a longer piece of card work (an export, say) on the worker. The
+   * job must use sdFS() only, not the UI; path names it in logs.
+   */
+  bool run(const char *path, StorageJob job, StorageCallback done);
+
+  /**
+   * Run callbacks for finished requests. Call from the main loop.
+   */
+  void service();
+
+  bool busy() const { return _pending > 0; }
+
+private:
+  struct Request {
+    StorageOp op;
+    String path;
+    String extensions;
+    uint8_t head[MAX_HEAD];
+    size_t headLen;
+    uint8_t *data;
+    size_t dataLen;
+    bool ownsData;
+    bool atomic;     // WRITE via a temp file and rename
+    uint32_t offset; // READ from here on; the file may extend beyond
+    std::vector<String> *list;
+    StorageJob job;
+    StorageCallback done;
+    bool ok;
+    size_t bytes;
+  };
+
+  QueueHandle_t _requests;
+  QueueHandle_t _completed;
+  TaskHandle_t _task;
+  int _pending;
+
+  bool submit(Request *request);
+  static void taskEntry(void *arg);
+  void execute(Request &request);
+};
+
+#endif // STORAGE_WORKER_H
@@ -0,0 +1,174 @@
+/**
+ * Timer Wheel Implementation
+ */
+
+#include "timer_wheel.h"
+
+static const int SLOT_MASK = TimerWheel::SLOTS - 1;
+
+TimerWheel::TimerWheel() : _tick(0), _lastMs(millis()) {
+  for (Timer &t : _timers)
+    t = {nullptr, 0, 0, -1, -1, -1, -1, false};
+  for (int l = 0; l < LEVELS; l++) {
+    _busy[l] = 0;
+    for (int s = 0; s < SLOTS; s++)
+      _heads[l][s] = -1;
+  }
+}
+
+int TimerWheel::create(const Callback &callback) {
+  for (int id = 0; id < MAX_TIMERS; id++) {
+    if (!_timers[id].used) {
+      _timers[id].used = true;
+      _timers[id].callback = callback;
+      return id;
+    }
+  }
+  Serial.println("Timers: All slots taken");
+  return -1;
+}
+
+void TimerWheel::start(int id, uint32_t delayMs, uint32_t periodMs) {
+  if (id < 0 || id >= MAX_TIMERS || !_timers[id].used)
+    return;
+  Timer &t = _timers[id];
+  if (t.level >= 0)
+    unlink(id);
+
+  // Time since the wheel last turned counts too; rounding up, the job
+  // never runs before delayMs is out
+  uint32_t since = millis() - _lastMs;
+  uint32_t ticks = (since + delayMs + TICK_MS - 1) / TICK_MS;
+  t.due = _tick + (ticks ? ticks : 1);
+  t.period = periodMs ? (periodMs + TICK_MS - 1) / TICK_MS : 0;
+  link(id);
+}
+
+void TimerWheel::stop(int id) {
+  if (id >= 0 && id < MAX_TIMERS && _timers[id].level >= 0)
+    unlink(id);
+}
+
+bool TimerWheel::running(int id) const {
+  return id >= 0 && id < MAX_TIMERS && _timers[id].level >= 0;
+}
+
+// Place a timer by how far ahead it is due: level 0 takes it to the tick,
+// the others to the span their slot covers
+void TimerWheel::link(int id) {
+  Timer &t = _timers[id];
+  int32_t left = (int32_t)(t.due - _tick);
+  uint32_t ahead = left > 0 ? left : 0;
+  uint32_t at = _tick + ahead;
+  int level = 0;
+  while (level < LEVELS - 1 && ahead >= 1u << ((level + 1) * SLOT_BITS))
+    level++;
+  uint32_t span = 1u << (LEVELS * SLOT_BITS);
+  if (ahead >= span)
+    at = _tick + span - 1; // Comes round again before it is due
+  int slot = (at >> (level * SLOT_BITS)) & SLOT_MASK;
+
+  t.level = level;
+  t.slot = slot;
+  t.prev = -1;
+  t.next = _heads[level][slot];
+  if (t.next >= 0)
+    _timers[t.next].prev = id;
+  _heads[level][slot] = id;
+  _busy[level] |= 1ULL << slot;
+}
+
+void TimerWheel::unlink(int id) {
+  Timer &t = _timers[id];
+  if (t.prev >= 0)
+    _timers[t.prev].next = t.next;
+  else
+    _heads[t.level][t.slot] = t.next;
+  if (t.next >= 0)
+    _timers[t.next].prev = t.prev;
+  if (_heads[t.level][t.slot] < 0)
+    _busy[t.level] &= ~(1ULL << t.slot);
+  t.level = -1;
+  t.next = t.prev = -1;
+}
+
+void TimerWheel::cascade(int level) {
+  int slot = (_tick >> (level * SLOT_BITS)) & SLOT_MASK;
+  int id = _heads[level][slot];
+  _heads[level][slot] = -1;
+  _busy[level] &= ~(1ULL << slot);
+  while (id >= 0) {
+    int next = _timers[id].next;
+    link(id); // Due within the span just reached: a level down
+    id = next;
+  }
+}
+
+void TimerWheel::expire() {
+  int slot = _tick & SLOT_MASK;
+  while (_heads[0][slot] >= 0) {
+    int id = _heads[0][slot];
+    Timer &t = _timers[id];
+    unlink(id);
+    if (t.period) {
+      // A late service skips the periods it missed rather than bursting
+      t.due += t.period;
+      if ((int32_t)(t.due - _tick) <= 0)
+        t.due = _tick + t.period;
+      link(id);
+    }
+    if (t.callback)
+      t.callback();
+  }
+}
+
+void TimerWheel::service(uint32_t nowMs) {
+  uint32_t ticks = (nowMs - _lastMs) / TICK_MS;
+  _lastMs += ticks * TICK_MS;
+  while (ticks > 0) {
+    // An empty level 0 has nothing to expire before the next cascade
+    if (!_busy[0]) {
+      uint32_t skip = SLOT_MASK - (_tick & SLOT_MASK);
+      if (ticks <= skip) {
+        _tick += ticks;
+        break;
+      }
+      _tick += skip;
+      ticks -= skip;
+    }
+    _tick++;
+    ticks--;
+    for (int level = 1; level < LEVELS; level++) {
+      if (_tick & ((1u << (level * SLOT_BITS)) - 1))
+        break;
+      cascade(level);
+    }
+    expire();
+  }
+}
+
+int TimerWheel::nextBusy(uint64_t busy, int from) {
+  uint64_t rotated = from ? (busy >> from) | (busy << (SLOTS - from)) : busy;
+  return __builtin_ctzll(rotated);
+}
+
+uint32_t TimerWheel::msUntilDue(uint32_t nowMs) const {
+  uint32_t soonest = UINT32_MAX; // Ticks
+  for (int level = 0; level < LEVELS; level++) {
+    if (!_busy[level])
+      continue;
+    // The slot after the current one comes round first; the current one
+    // last, a whole turn of this level away
+    int shift = level * SLOT_BITS;
+    uint32_t next = (_tick >> shift) + 1;
+    uint32_t at = (next + nextBusy(_busy[level], next & SLOT_MASK)) << shift;
+    uint32_t ticks = at - _tick;
+    if (ticks < soonest)
+      soonest = ticks;
+  }
+  if (soonest == UINT32_MAX)
+    return UINT32_MAX;
+  uint32_t ms = soonest * TICK_MS;
+  uint32_t since = nowMs - _lastMs;
+  return ms > since ? ms - since : 0;
+}
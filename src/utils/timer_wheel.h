@@ -0,0 +1,93 @@
+/**
+ * Timer Wheel
+ *
+ * One scheduler for the loop's periodic and one-shot jobs (clock resync,
+ * history sampling, countdown seconds, the alarm minute), so the loop can
+ * ask when the next one is due and sleep exactly that long instead of
+ * every job comparing millis() on every pass.
+ *
+ * Hierarchical wheel of LEVELS x 64 slots at TICK_MS resolution: level 0
+ * holds what is due within 64 ticks, one slot per tick; level 1 slots span
+ * 64 ticks and level 2 slots 4096, covering about 44 minutes. Anything
+ * later waits in the last level and is placed again as it comes round.
+ * Timers sit in intrusive lists, so start and stop are O(1); a level's
+ * slot comes down a level (cascades) when the wheel turns past it.
+ * msUntilDue() finds the next busy slot of each level from a bitmap, so it
+ * is O(LEVELS) too. For a timer on an upper level that is the time of its
+ * cascade, which comes a little early; the loop wakes, the timer drops a
+ * level, and the next answer is exact.
+ *
+ * Callbacks run from service(), on the loop task; they may start and stop
+ * timers, themselves included.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+#include <functional>
+
+class TimerWheel {
+public:
+  typedef std::function<void()> Callback;
+
+  static const uint32_t TICK_MS = 10;
+  static const int MAX_TIMERS = 16;
+  static const int LEVELS = 3;
+  static const int SLOT_BITS = 6;
+  static const int SLOTS = 1 << SLOT_BITS;
+
+  TimerWheel();
+
+  /**
+   * Register a job, not yet started
+   * @return Its id, or -1 when all MAX_TIMERS are taken
+   */
+  int create(const Callback &callback);
+
+  /**
+   * Run the job in delayMs (within a tick for 0), then every
+   * periodMs if that is not 0. Restarts a job already running.
+   */
+  void start(int id, uint32_t delayMs, uint32_t periodMs = 0);
+
+  void stop(int id);
+
+  bool running(int id) const;
+
+  /**
+   * Run every job that has come due by nowMs (millis())
+   */
+  void service(uint32_t nowMs);
+
+  /**
+   * Milliseconds until the next job is due (UINT32_MAX: none)
+   */
+  uint32_t msUntilDue(uint32_t nowMs) const;
+
+private:
+  struct Timer {
+    Callback callback;
+    uint32_t due;    // Tick
+    uint32_t period; // Ticks, 0 for one-shot
+    int8_t next, prev;
+    int8_t level, slot; // -1: not in the wheel
+    bool used;
+  };
+
+  Timer _timers[MAX_TIMERS];
+  int8_t _heads[LEVELS][SLOTS];
+  uint64_t _busy[LEVELS]; // Slots with timers in them
+  uint32_t _tick;         // Ticks turned so far
+  uint32_t _lastMs;       // millis() at _tick
+
+  void link(int id);
+  void unlink(int id);
+  void cascade(int level);
+  void expire();
+  static int nextBusy(uint64_t busy, int from);
+};
+
+extern TimerWheel *timers;
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,41 @@
+/**
+ * Main Loop Wake Events Implementation
+ */
+
+#include "wake.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+namespace Wake {
+
+static EventGroupHandle_t _events = nullptr;
+
+bool begin() {
+  if (_events)
+    return true;
+  _events = xEventGroupCreate();
+  if (!_events) {
+    Serial.println("Wake: Failed to create event group, polling");
+    return false;
+  }
+  return true;
+}
+
+void signal(uint32_t sources) {
+  if (_events)
+    xEventGroupSetBits(_events, sources);
+}
+
+uint32_t wait(uint32_t timeoutMs) {
+  if (!_events) {
+    delay(timeoutMs < 10 ? timeoutMs : 10); // Old polling behaviour
+    return 0;
+  }
+  if (timeoutMs == 0)
+    return xEventGroupClearBits(_events, ALL) & ALL;
+  EventBits_t bits = xEventGroupWaitBits(_events, ALL, pdTRUE, pdFALSE,
+                                         pdMS_TO_TICKS(timeoutMs));
+  return bits & ALL;
+}
+
+} // namespace Wake
@@ -0,0 +1,49 @@
+/**
+ * Main Loop Wake Events
+ *
+ * One FreeRTOS event group the main loop blocks on instead of spinning
+ * with delay(). Whatever produces work for it sets a bit: the GT911 task
+ * after queueing samples, the BLE notify callback, the storage worker
+ * when a request completes, the serial console with a command, the 2048
+ * solver when a search finishes, the weather task when a fetch is done.
+ * The loop wakes on the first bit or when the caller's timeout (its next
+ * timer deadline) runs out. While it sleeps the idle task runs, which is
+ * where PowerMode drops the clock or light-sleeps.
+ */
+
+#ifndef WAKE_H
+#define WAKE_H
+
+#include <Arduino.h>
+
+namespace Wake {
+
+enum Source : uint32_t {
+  TOUCH = 1 << 0,
+  BLE = 1 << 1,
+  STORAGE = 1 << 2,
+  SERIAL_RX = 1 << 3,
+  COMPUTE = 1 << 4,
+  NETWORK = 1 << 5,
+  ALL = TOUCH | BLE | STORAGE | SERIAL_RX | COMPUTE | NETWORK
+};
+
+/**
+ * Create the event group; call before the tasks that signal start
+ */
+bool begin();
+
+/**
+ * Wake the main loop (any task; not from an ISR)
+ */
+void signal(uint32_t sources);
+
+/**
+ * Block until a source signals or timeoutMs passes
+ * @return the sources that fired, 0 on timeout
+ */
+uint32_t wait(uint32_t timeoutMs);
+
+} // namespace Wake
+
+#endif // WAKE_H
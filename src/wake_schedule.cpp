@@ -0,0 +1,97 @@
+/**
+ * Wake Schedule Implementation
+ */
+
+#include "wake_schedule.h"
+#include "hardware/rtc.h"
+#include "utils/log.h"
+#include <esp_sleep.h>
+
+namespace WakeSchedule {
+
+static const int EVENT_COUNT = (int)Event::COUNT;
+
+static time_t _due[EVENT_COUNT] = {};
+
+void set(Event event, time_t due) { _due[(int)event] = due; }
+
+time_t due(Event event) { return _due[(int)event]; }
+
+static time_t earliestOf(Event *which, bool samples) {
+  time_t earliest = 0;
+  for (int i = 0; i < EVENT_COUNT; i++) {
+    if (!samples && (Event)i == Event::SAMPLE)
+      continue;
+    if (_due[i] && (!earliest || _due[i] < earliest)) {
+      earliest = _due[i];
+      if (which)
+        *which = (Event)i;
+    }
+  }
+  return earliest;
+}
+
+time_t next(Event *which) { return earliestOf(which, true); }
+
+time_t nextBoot(Event *which) { return earliestOf(which, false); }
+
+const char *eventName(Event event) {
+  switch (event) {
+  case Event::ALARM:
+    return "alarm";
+  case Event::TIMER:
+    return "timer";
+  case Event::POMODORO:
+    return "pomodoro";
+  case Event::CHARGE:
+    return "charge plan";
+  case Event::SAMPLE:
+    return "sample";
+  default:
+    return "?";
+  }
+}
+
+bool arm(time_t now) {
+  Event which = Event::ALARM;
+  time_t at = nextBoot(&which);
+  if (!at)
+    return false;
+
+#ifdef RTC_INT_PIN
+  uint32_t secs = at > now ? at - now : 1;
+  bool ok;
+  if (secs <= RTC::COUNTDOWN_MAX_SECS) {
+    ok = RTC::setCountdown(secs);
+  } else {
+    // The minute the event falls in; a few seconds early beats late
+    struct tm t;
+    localtime_r(&at, &t);
+    ok = RTC::setAlarm(t.tm_hour, t.tm_min);
+  }
+  if (!ok) {
+    LOG_W("Wake", "RTC program for the %s failed", eventName(which));
+    return false;
+  }
+  // INT is open drain, active low
+  esp_sleep_enable_ext1_wakeup(1ULL << RTC_INT_PIN, ESP_EXT1_WAKEUP_ALL_LOW);
+  LOG_I("Wake", "RTC wakes for the %s in %u s", eventName(which),
+        (unsigned)secs);
+  return true;
+#else
+  (void)now;
+  return false;
+#endif
+}
+
+void disarm() {
+#ifdef RTC_INT_PIN
+  uint8_t fired = RTC::firedFlags();
+  if (fired)
+    LOG_I("Wake", "RTC %s fired",
+          fired & RTC::CTRL2_AF ? "alarm" : "countdown");
+  RTC::clearWake();
+#endif
+}
+
+} // namespace WakeSchedule
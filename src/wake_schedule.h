@@ -0,0 +1,61 @@
+/**
+ * Wake Schedule
+ *
+ * The moments the device has to be awake for, as absolute Unix times: the
+ * alarm clock, a running countdown timer or pomodoro, the next change to
+ * the charge plan's program, and the next sleep-cycle sample. next() is
+ * the earliest; enterDeepSleep() sizes the ESP32 timer wake from
+ * nextBoot() (everything but the sample, which SleepCycle serves with its
+ * own short wake) through SleepCycle::arm().
+ *
+ * On boards with the BM8563's INT line on an RTC-capable GPIO (build with
+ * -DRTC_INT_PIN=<gpio>), arm() also programs the chip for nextBoot()
+ * (countdown up to four hours, the hh:mm alarm beyond) and wakes on INT:
+ * the RTC's crystal keeps far better time over a long sleep than the
+ * ESP32's RC slow clock. Without it arm() leaves the chip alone.
+ */
+
+#ifndef WAKE_SCHEDULE_H
+#define WAKE_SCHEDULE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+namespace WakeSchedule {
+
+enum class Event : uint8_t { ALARM, TIMER, POMODORO, CHARGE, SAMPLE, COUNT };
+
+/**
+ * Set when an event is due (0 = not scheduled)
+ */
+void set(Event event, time_t due);
+
+time_t due(Event event);
+
+/**
+ * Earliest scheduled event, 0 if none
+ * @param which Set to that event when not null
+ */
+time_t next(Event *which = nullptr);
+
+/**
+ * Earliest event that needs a full boot (not SAMPLE), 0 if none
+ */
+time_t nextBoot(Event *which = nullptr);
+
+const char *eventName(Event event);
+
+/**
+ * Program the RTC for nextBoot() and enable the INT wake (deep sleep)
+ * @return false if nothing is scheduled or INT is not wired
+ */
+bool arm(time_t now);
+
+/**
+ * Boot: release INT and stop the RTC program (when INT is wired)
+ */
+void disarm();
+
+} // namespace WakeSchedule
+
+#endif // WAKE_SCHEDULE_H
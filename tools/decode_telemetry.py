@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Decode TelemetryDelta messages from the MQTT bridge or /api/frame.
+
+    python3 tools/decode_telemetry.py http://192.168.1.50/api/frame
+    mosquitto_sub -t fossibot/telemetry -F %x | \\
+        python3 tools/decode_telemetry.py --hex -
+
+prints one line of JSON per frame. A URL is polled every few seconds with
+the last sequence number seen, so only the changes come back; hex lines
+(one message each) are decoded in turn, deltas against the frames before
+them. Deltas whose reference has not been seen (joined mid-stream) are
+skipped until the next keyframe. The layout is described in
+src/net/telemetry_delta.h.
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+VERSION = 1
+FLAG_KEYFRAME = 0x01
+FIELDS = ["soc10", "mv", "in_w", "out_w", "ac_in_w", "dc_in_w",
+          "to_empty_min", "to_full_min", "outputs"]
+
+
+class Decoder:
+    def __init__(self):
+        self.frames = {}  # seq -> (time, values), the recent ones
+        self.last = None
+
+    def decode(self, data):
+        """Frames in the message as (seq, time, values); None if the
+        reference is unknown"""
+        pos = 0
+
+        def varint():
+            nonlocal pos
+            value = shift = 0
+            while True:
+                byte = data[pos]
+                pos += 1
+                value |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    return value
+
+        head = data[0]
+        pos = 1
+        if head >> 4 != VERSION:
+            raise ValueError("version %d not supported" % (head >> 4))
+        keyframe = head & FLAG_KEYFRAME
+        seq = varint()
+        if keyframe:
+            self.frames = {}  # Also where a restarted device starts over
+            prev_time, prev = 0, [0] * len(FIELDS)
+        else:
+            ref = self.frames.get(varint())
+            if ref is None:
+                return None
+            prev_time, prev = ref
+        t = varint()
+        t = t if keyframe else (prev_time + t) & 0xFFFFFFFF
+        out = []
+        for i in range(varint()):
+            if i:
+                t = (t + varint()) & 0xFFFFFFFF
+            mask = varint()
+            values = list(prev)
+            for k in range(len(FIELDS)):
+                if mask >> k & 1:
+                    u = varint()
+                    values[k] += (u >> 1) ^ -(u & 1)
+            out.append((seq + i, t, values))
+            prev = values
+        for s, t, values in out:
+            self.frames[s] = (t, values)
+            self.last = s
+        for s in [s for s in self.frames if self.last - s > 256]:
+            del self.frames[s]
+        return out
+
+
+def show(frames):
+    for seq, t, values in frames:
+        row = {"seq": seq, "time": t}
+        row.update(zip(FIELDS, values))
+        print(json.dumps(row), flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="/api/frame URL, or - for hex lines")
+    parser.add_argument("--hex", action="store_true",
+                        help="read hex-encoded messages, one per line")
+    parser.add_argument("--every", type=float, default=5,
+                        help="seconds between polls of a URL")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    if args.hex or args.source == "-":
+        for line in sys.stdin:
+            line = line.strip()
+            if line:
+                frames = decoder.decode(bytes.fromhex(line))
+                if frames is None:
+                    print("waiting for a keyframe", file=sys.stderr)
+                else:
+                    show(frames)
+        return
+    while True:
+        url = args.source
+        if decoder.last is not None:
+            url += "?since=%d" % decoder.last
+        with urllib.request.urlopen(url) as response:
+            frames = decoder.decode(response.read())
+        show(frames or [])
+        time.sleep(args.every)
+
+
+if __name__ == "__main__":
+    main()
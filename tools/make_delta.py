@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Make an OTA delta from the firmware a unit runs to a new build.
+
+    python3 tools/make_delta.py old/firmware.bin .pio/build/m5paper_s3/firmware.bin \\
+        firmware.delta
+
+The unit rebuilds the new image from its running one and the delta (see
+src/ota_delta.h for the layout), and refuses a delta made against any
+other build, so keep the firmware.bin of each release you flash.
+
+The new image is matched against the old one 16 bytes at a time: a match
+is grown both ways and sent as a COPY of the old bytes, anything else as
+DATA. Code that moved keeps most of its bytes, so a small change usually
+gives a delta a fraction of the image's size.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+VERSION = 1
+BLOCK = 16       # Bytes hashed to find a match
+STEP = 4         # Old image positions indexed (code is word aligned)
+MIN_COPY = 24    # Shorter matches cost more as ops than as data
+OP_END, OP_COPY, OP_DATA = 0, 1, 2
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7F
+        n >>= 7
+        if n:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def make_delta(old, new):
+    index = {}
+    for i in range(0, len(old) - BLOCK + 1, STEP):
+        index.setdefault(old[i:i + BLOCK], i)
+
+    ops = bytearray()
+    data_start = 0  # New bytes not yet sent
+
+    def flush_data(end):
+        if end > data_start:
+            ops.append(OP_DATA)
+            ops.extend(varint(end - data_start))
+            ops.extend(new[data_start:end])
+
+    p = 0
+    while p + BLOCK <= len(new):
+        src = index.get(new[p:p + BLOCK])
+        if src is None:
+            p += 1
+            continue
+        # Grow the match forward, then back over unsent data
+        length = BLOCK
+        while (p + length < len(new) and src + length < len(old)
+               and new[p + length] == old[src + length]):
+            length += 1
+        back = 0
+        while (p - back > data_start and src - back > 0
+               and new[p - back - 1] == old[src - back - 1]):
+            back += 1
+        if length + back < MIN_COPY:
+            p += 1
+            continue
+        flush_data(p - back)
+        ops.append(OP_COPY)
+        ops.extend(varint(src - back))
+        ops.extend(varint(length + back))
+        p += length
+        data_start = p
+    flush_data(len(new))
+    ops.append(OP_END)
+
+    header = b"M5DL" + bytes([VERSION, 0, 0, 0])
+    header += struct.pack("<I", len(old)) + hashlib.sha256(old).digest()
+    header += struct.pack("<I", len(new))
+    return header + bytes(ops)
+
+
+def apply_delta(old, delta):
+    """Rebuild the new image, as the unit does (for checking)"""
+    assert delta[:4] == b"M5DL" and delta[4] == VERSION
+    base_size, = struct.unpack_from("<I", delta, 8)
+    assert base_size == len(old)
+    assert delta[12:44] == hashlib.sha256(old).digest()
+    target_size, = struct.unpack_from("<I", delta, 44)
+    out = bytearray()
+    pos = 48
+
+    def read_varint():
+        nonlocal pos
+        n = shift = 0
+        while True:
+            b = delta[pos]
+            pos += 1
+            n |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return n
+
+    while True:
+        op = delta[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            src = read_varint()
+            length = read_varint()
+            out.extend(old[src:src + length])
+        else:
+            length = read_varint()
+            out.extend(delta[pos:pos + length])
+            pos += length
+    assert len(out) == target_size
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("old", help="firmware.bin the unit is running")
+    parser.add_argument("new", help="firmware.bin to update it to")
+    parser.add_argument("out", help="delta file to write")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+    delta = make_delta(old, new)
+    if apply_delta(old, delta) != new:
+        sys.exit("delta does not rebuild the new image")
+    with open(args.out, "wb") as f:
+        f.write(delta)
+    print("%s: %d bytes for a %d byte image (%.1f%%)"
+          % (args.out, len(delta), len(new), 100.0 * len(delta) / len(new)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Convert a TrueType/OpenType font into a reader font for /fonts.
+
+    python3 tools/make_font.py DejaVuSerif.ttf serif 32
+    python3 tools/make_font.py --ranges 20-7e,a0-17f,2000-206f \\
+        DejaVuSans.ttf sans 24
+
+writes serif-32.fnt / sans-24.fnt: 4-bit anti-aliased glyphs whose line
+(ascent + descent) is at most the given pixel height. Copy the file to
+/fonts on the card. The reader looks for serif-24, -32 and -44; the
+dashboard for sans-24 and -16. The layout is read by
+src/ui/font_manager.cpp. Needs Pillow built with FreeType.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x31544E46  # "FNT1"
+VERSION = 1
+PAGE_BITS = 7
+PAGE_GLYPHS = 1 << PAGE_BITS
+GLYPH = struct.Struct("<IBBbbB3x")  # offset, width, height, left, top, advance
+HEADER = struct.Struct("<IHBBhhHH")
+PAGE_ENTRY = struct.Struct("<HHII")
+
+# Latin, Latin-1, Latin Extended-A, general punctuation, euro sign
+DEFAULT_RANGES = "20-7e,a0-17f,2000-206f,20ac"
+
+
+def parse_ranges(text):
+    points = set()
+    for part in text.split(","):
+        lo, _, hi = part.strip().partition("-")
+        lo = int(lo, 16)
+        hi = int(hi, 16) if hi else lo
+        if not 0 <= lo <= hi <= 0xFFFF:
+            raise ValueError("bad range %r (up to U+FFFF)" % part)
+        points.update(range(lo, hi + 1))
+    return sorted(points)
+
+
+def pack_bitmap(width, height, pixels):
+    """pixels: row-major 0..255 coverage; 4 bits each, high nibble first."""
+    out = bytearray()
+    for y in range(height):
+        row = pixels[y * width:(y + 1) * width]
+        for x in range(0, width, 2):
+            hi = (row[x] * 15 + 127) // 255
+            lo = (row[x + 1] * 15 + 127) // 255 if x + 1 < width else 0
+            out.append(hi << 4 | lo)
+    return bytes(out)
+
+
+def write_font(path, line_height, ascent, glyphs):
+    """glyphs: code point -> (width, height, left, top, advance, pixels)."""
+    pages = {}
+    for cp, glyph in glyphs.items():
+        pages.setdefault(cp >> PAGE_BITS, {})[cp & (PAGE_GLYPHS - 1)] = glyph
+
+    blocks = []
+    for number in sorted(pages):
+        table = bytearray()
+        bitmaps = bytearray()
+        for i in range(PAGE_GLYPHS):
+            glyph = pages[number].get(i)
+            if glyph is None:
+                table += GLYPH.pack(0, 0, 0, 0, 0, 0)
+                continue
+            width, height, left, top, advance, pixels = glyph
+            table += GLYPH.pack(len(bitmaps), width, height, left, top,
+                                advance)
+            bitmaps += pack_bitmap(width, height, pixels)
+        blocks.append((number, bytes(table + bitmaps)))
+
+    offset = HEADER.size + PAGE_ENTRY.size * len(blocks)
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, 4, PAGE_BITS, line_height, ascent,
+                            len(blocks), 0))
+        for number, data in blocks:
+            f.write(PAGE_ENTRY.pack(number, 0, offset, len(data)))
+            offset += len(data)
+        for _, data in blocks:
+            f.write(data)
+    return len(blocks), offset
+
+
+def render(font_path, px, points):
+    from PIL import Image, ImageDraw, ImageFont
+
+    # The largest size whose line fits px
+    size = px
+    while size > 4:
+        font = ImageFont.truetype(font_path, size)
+        ascent, descent = font.getmetrics()
+        if ascent + descent <= px:
+            break
+        size -= 1
+    ascent, descent = font.getmetrics()
+    print("%s: %d pt, ascent %d, descent %d" % (font_path, size, ascent,
+                                               descent))
+
+    # What the font draws for a character it does not have
+    def image(ch):
+        box = font.getbbox(ch, anchor="la")
+        return box, font.getmask(ch, mode="L").tobytes()
+    missing = image("\uffff")
+
+    glyphs = {}
+    for cp in points:
+        ch = chr(cp)
+        box, mask = image(ch)
+        if cp != 0x20 and (box, mask) == missing:
+            continue
+        left, top, right, bottom = box
+        width = max(0, min(255, right - left))
+        height = max(0, min(255, bottom - top))
+        advance = max(1, min(255, round(font.getlength(ch))))
+        pixels = b""
+        if width and height:
+            canvas = Image.new("L", (width, height), 0)
+            ImageDraw.Draw(canvas).text((-left, -top), ch, font=font,
+                                        fill=255, anchor="la")
+            pixels = canvas.tobytes()
+        glyphs[cp] = (width, height, max(-128, min(127, left)),
+                      max(-128, min(127, top)), advance, pixels)
+    return ascent, glyphs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("font", help="TrueType or OpenType file")
+    parser.add_argument("family", help="name on the card, e.g. serif")
+    parser.add_argument("px", type=int, help="line height in pixels")
+    parser.add_argument("--ranges", default=DEFAULT_RANGES,
+                        help="hex code point ranges (default %(default)s)")
+    parser.add_argument("--out", default=".", help="output directory")
+    args = parser.parse_args()
+
+    if not 8 <= args.px <= 120:
+        sys.exit("px must be 8..120")
+    ascent, glyphs = render(args.font, args.px, parse_ranges(args.ranges))
+    if ord("?") not in glyphs:
+        sys.exit("the font has no '?', which stands in for missing glyphs")
+    path = "%s/%s-%d.fnt" % (args.out, args.family, args.px)
+    pages, size = write_font(path, args.px, ascent, glyphs)
+    print("%s: %d glyphs in %d pages, %d bytes" % (path, len(glyphs), pages,
+                                                  size))
+
+
+if __name__ == "__main__":
+    main()
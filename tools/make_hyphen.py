@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Build the reader's hyphenation table from TeX patterns.
+
+    python3 tools/make_hyphen.py hyph-en-us.pat.txt
+
+writes src/reader/hyphen_patterns.h from Liang patterns: a hyph-utf8
+.pat.txt (one pattern per line) or a TeX file with a \\patterns{} block
+(hyphen.tex). Exceptions (\\hyphenation{}) are left out. The table is
+read by src/reader/hyphenate.cpp:
+
+    HYPHEN_PATTERNS  the patterns as written ("a1b2c", "." for a word
+                     edge), space-separated, sorted by their letters with
+                     the digits dropped, so a lookup is a binary search
+                     of the string in flash
+"""
+
+import argparse
+import re
+import sys
+
+HEADER = """/**
+ * Hyphenation Patterns
+ *
+ * Generated by tools/make_hyphen.py from %s; do not edit.
+ * %d Liang patterns, %d bytes. The US English set is F. M. Liang's
+ * hyphen.tex for plain TeX, whose notice permits copying as long as the
+ * modified file is not itself named hyphen.tex.
+ */
+
+#ifndef HYPHEN_PATTERNS_H
+#define HYPHEN_PATTERNS_H
+
+#include <stddef.h>
+
+static const size_t HYPHEN_PATTERN_COUNT = %d;
+
+static const char HYPHEN_PATTERNS[] =
+"""
+
+FOOTER = """;
+
+#endif // HYPHEN_PATTERNS_H
+"""
+
+PATTERN = re.compile(r"^[.a-z0-9]+$")
+
+
+def read_patterns(path):
+    with open(path, encoding="utf-8") as f:
+        text = "\n".join(line.split("%", 1)[0] for line in f)
+    block = re.search(r"\\patterns\s*{([^}]*)}", text)
+    if block:
+        text = block.group(1)
+    patterns = set()
+    for token in text.split():
+        token = token.lower()
+        if PATTERN.match(token) and re.search("[.a-z]", token):
+            patterns.add(token)
+    return patterns
+
+
+def key(pattern):
+    return re.sub("[0-9]", "", pattern)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("patterns", help="TeX hyphenation patterns")
+    parser.add_argument("--out", default="src/reader/hyphen_patterns.h",
+                        help="output header")
+    args = parser.parse_args()
+
+    patterns = sorted(read_patterns(args.patterns), key=key)
+    if not patterns:
+        sys.exit("no patterns in %s" % args.patterns)
+    for a, b in zip(patterns, patterns[1:]):
+        if key(a) == key(b):
+            sys.exit("patterns %s and %s have the same letters" % (a, b))
+
+    table = " ".join(patterns)
+    lines, line = [], ""
+    for pattern in patterns:
+        if line and len(line) + len(pattern) + 1 > 72:
+            lines.append(line)
+            line = ""
+        line += pattern + " "
+    lines.append(line.rstrip())
+    name = args.patterns.replace("\\", "/").rsplit("/", 1)[-1]
+    with open(args.out, "w") as f:
+        f.write(HEADER % (name, len(patterns), len(table) + 1,
+                          len(patterns)))
+        f.write("\n".join('    "%s"' % l for l in lines))
+        f.write(FOOTER)
+    print("%s: %d patterns, %d bytes" % (args.out, len(patterns),
+                                         len(table) + 1))
+
+
+if __name__ == "__main__":
+    main()
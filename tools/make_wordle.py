@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Pack Wordle word lists into the game's dictionary file.
+
+    python3 tools/make_wordle.py answers.txt guesses.txt
+
+writes words.wdl from a list of answers and a list of further allowed
+guesses (one word per line; anything not five letters a-z is skipped,
+answers count as guesses too). Copy it to /games/wordle/words.wdl on the
+card. The layout is read by src/ui/wordle.cpp:
+
+    header   magic "WDL1", version, answers, words, stamp (FNV-1a of the
+             rest of the file: the panel re-imports a changed file)
+    index    u16 first entry of each of the 676 two-letter buckets, plus
+             the total; u16 answers before each bucket, plus the total
+    entries  u16 per word, by bucket: the last three letters in 15 bits
+             (5 bits each, a = 0), sorted, bit 15 set for an answer
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x314C4457  # "WDL1"
+VERSION = 1
+BUCKETS = 26 * 26
+HEADER = struct.Struct("<IHHII")
+ANSWER = 0x8000
+
+
+def read_words(path):
+    words = set()
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            word = line.strip().lower()
+            if len(word) == 5 and all("a" <= c <= "z" for c in word):
+                words.add(word)
+    return words
+
+
+def letters(word):
+    return [ord(c) - ord("a") for c in word]
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def pack(answers, guesses):
+    buckets = [[] for _ in range(BUCKETS)]
+    for word in answers | guesses:
+        l = letters(word)
+        entry = (l[2] << 10) | (l[3] << 5) | l[4]
+        if word in answers:
+            entry |= ANSWER
+        buckets[l[0] * 26 + l[1]].append(entry)
+
+    starts, ranks, entries = [], [], []
+    answered = 0
+    for bucket in buckets:
+        bucket.sort(key=lambda e: e & 0x7FFF)
+        starts.append(len(entries))
+        ranks.append(answered)
+        entries.extend(bucket)
+        answered += sum(1 for e in bucket if e & ANSWER)
+    starts.append(len(entries))
+    ranks.append(answered)
+
+    body = struct.pack("<%dH" % len(starts), *starts)
+    body += struct.pack("<%dH" % len(ranks), *ranks)
+    body += struct.pack("<%dH" % len(entries), *entries)
+    return answered, len(entries), body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("answers", help="words the game may pick")
+    parser.add_argument("guesses", nargs="?",
+                        help="further words accepted as guesses")
+    parser.add_argument("--out", default="words.wdl", help="output file")
+    args = parser.parse_args()
+
+    answers = read_words(args.answers)
+    guesses = read_words(args.guesses) if args.guesses else set()
+    if not answers:
+        sys.exit("no five-letter answers in %s" % args.answers)
+    answered, words, body = pack(answers, guesses)
+    if words > 0xFFFF:
+        sys.exit("%d words: at most 65535 fit the 16-bit index" % words)
+    with open(args.out, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, answered, words, fnv1a(body)))
+        f.write(body)
+    print("%s: %d answers, %d words, %d bytes" % (args.out, answered, words,
+                                                  HEADER.size + len(body)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,46 @@
+"""PlatformIO extra script for the release environments.
+
+The image is built for size (-Os) as before, except for the translation
+units on the per-frame paths - touch, drawing, the telemetry parser and
+filter, the history - which are built with -O2. The link runs the
+link-time optimiser over the project sources, which build_src_flags
+compiles with -flto; the framework is left alone, as its IRAM placement
+goes by object file.
+
+Listed in platformio.ini as
+
+    extra_scripts = pre:tools/release_flags.py
+"""
+
+Import("env")  # noqa: F821 (provided by PlatformIO)
+
+HOT_SOURCES = (
+    "src/hardware/gt911.cpp",
+    "src/ui/ui_manager.cpp",
+    "src/ui/frame_buffer.cpp",
+    "src/ui/raster4.cpp",
+    "src/ui/band_renderer.cpp",
+    "src/ui/display_list.cpp",
+    "src/ui/stroke_renderer.cpp",
+    "src/ui/ink_filter.cpp",
+    "src/ui/glyph_atlas.cpp",
+    "src/ui/widgets.cpp",
+    "src/ui/history_envelope.cpp",
+    "src/ble/ble_client.cpp",
+    "src/net/telemetry_delta.cpp",
+    "src/telemetry_filter.cpp",
+    "src/power_history.cpp",
+    "src/history_rollup.cpp",
+)
+
+
+def hot_o2(env, node):
+    path = node.srcnode().get_path().replace("\\", "/")
+    if not path.endswith(HOT_SOURCES):
+        return node
+    flags = [f for f in env["CCFLAGS"] if not str(f).startswith("-O")]
+    return env.Object(node, CCFLAGS=flags + ["-O2"])
+
+
+env.AddBuildMiddleware(hot_o2)
+env.Append(LINKFLAGS=["-flto=auto"])